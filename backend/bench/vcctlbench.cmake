@@ -0,0 +1,109 @@
+# Benchmark runner for the VCCTL executables, run by the vcctl_bench
+# target:
+#
+#   cmake -DVCCTL_BENCH_DIR=<cases> <build dir>
+#   cmake --build <build dir> --target vcctl_bench
+#
+# Each subdirectory of the case directory is one case, run in order
+# of name.  A case holds its input files and
+#
+#   command   name of the program on the first line, then one
+#             argument per line (e.g. disrealnew, --parameters,
+#             paste100.prm, --perf, perf.csv)
+#   stdin     optional, fed to the program's standard input, for the
+#             programs that read their answers there (genmic, ...)
+#   outputs   optional, one file per line whose SHA256 goes in the
+#             report, so that two builds can be checked for the same
+#             results as well as compared for speed
+#
+# Each case is copied to vcctl_bench/<case> in the build tree and run
+# there, so any timing table it writes (disrealnew --perf) is kept
+# next to the report.  The report, vcctl_bench.csv, has one row per
+# case: its name, the program, exit status, wall time in seconds,
+# peak resident memory in kB (where GNU time is available, otherwise
+# empty) and the checksums of its outputs.
+#
+# Variables: BENCHDIR (cases), BINDIR (executables), WORKDIR (scratch
+# and report directory)
+
+if(NOT BENCHDIR OR NOT IS_DIRECTORY "${BENCHDIR}")
+  message(FATAL_ERROR "vcctl_bench: set VCCTL_BENCH_DIR to a directory of cases")
+endif()
+
+set(timeprog "")
+if(CMAKE_HOST_SYSTEM_NAME STREQUAL "Linux" AND EXISTS "/usr/bin/time")
+  set(timeprog "/usr/bin/time")
+endif()
+
+file(MAKE_DIRECTORY "${WORKDIR}")
+set(report "${WORKDIR}/vcctl_bench.csv")
+file(WRITE "${report}" "Case,Program,Status,Seconds,Maxrss(kB),Outputs\n")
+
+file(GLOB cases LIST_DIRECTORIES true RELATIVE "${BENCHDIR}" "${BENCHDIR}/*")
+list(SORT cases)
+
+foreach(case IN LISTS cases)
+  if(NOT EXISTS "${BENCHDIR}/${case}/command")
+    continue()
+  endif()
+
+  set(rundir "${WORKDIR}/${case}")
+  file(REMOVE_RECURSE "${rundir}")
+  file(COPY "${BENCHDIR}/${case}/" DESTINATION "${rundir}")
+
+  file(STRINGS "${rundir}/command" cmd)
+  list(POP_FRONT cmd prog)
+  set(exe "${BINDIR}/${prog}${CMAKE_EXECUTABLE_SUFFIX}")
+
+  set(input "")
+  if(EXISTS "${rundir}/stdin")
+    set(input INPUT_FILE "${rundir}/stdin")
+  endif()
+
+  set(wrap "")
+  if(timeprog)
+    set(wrap "${timeprog}" -f "%M" -o "${rundir}/maxrss.txt")
+  endif()
+
+  message(STATUS "vcctl_bench: ${case} (${prog})")
+  string(TIMESTAMP t0 "%s.%f" UTC)
+  execute_process(
+    COMMAND ${wrap} "${exe}" ${cmd}
+    WORKING_DIRECTORY "${rundir}"
+    ${input}
+    OUTPUT_FILE "${rundir}/stdout.txt"
+    ERROR_FILE "${rundir}/stderr.txt"
+    RESULT_VARIABLE status)
+  string(TIMESTAMP t1 "%s.%f" UTC)
+
+  # math() only knows integers, so work in microseconds
+  string(REPLACE "." "" us0 "${t0}")
+  string(REPLACE "." "" us1 "${t1}")
+  math(EXPR us "${us1} - ${us0}")
+  math(EXPR sec "${us} / 1000000")
+  math(EXPR frac "${us} % 1000000 + 1000000")
+  string(SUBSTRING "${frac}" 1 3 frac)
+
+  set(maxrss "")
+  if(EXISTS "${rundir}/maxrss.txt")
+    file(STRINGS "${rundir}/maxrss.txt" maxrss REGEX "^[0-9]+$")
+  endif()
+
+  set(sums "")
+  if(EXISTS "${rundir}/outputs")
+    file(STRINGS "${rundir}/outputs" outs)
+    foreach(out IN LISTS outs)
+      if(EXISTS "${rundir}/${out}")
+        file(SHA256 "${rundir}/${out}" sum)
+      else()
+        set(sum "missing")
+      endif()
+      string(APPEND sums "${out}=${sum};")
+    endforeach()
+  endif()
+
+  file(APPEND "${report}"
+       "${case},${prog},${status},${sec}.${frac},${maxrss},\"${sums}\"\n")
+endforeach()
+
+message(STATUS "vcctl_bench: report written to ${report}")
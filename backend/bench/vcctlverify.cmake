@@ -0,0 +1,140 @@
+# Verification of the faster modes of the VCCTL executables against
+# their legacy paths, run by the vcctl_verify target:
+#
+#   cmake -DVCCTL_VERIFY_DIR=<cases> <build dir>
+#   cmake --build <build dir> --target vcctl_verify
+#
+# Cases are laid out as for vcctl_bench (see vcctlbench.cmake), with
+# a command that runs the legacy path (e.g. disrealnew --legacy-ants,
+# elastic --fixed-order, genmic with no mode options) and a list of
+# outputs to check, plus
+#
+#   variants   one line per faster mode to check: "exact" or "stat",
+#              then the options added to the command for that mode
+#              (e.g. "exact --threads 4" or "stat --fast-moves")
+#   tolerance  optional, vcctlcmp options for the "stat" variants
+#              (e.g. --rel 0.05 --fraction 0.02); see vcctlcmp
+#
+# An "exact" variant must give outputs byte for byte equal to those
+# of the legacy path, as the seed contract promises for it.  A "stat"
+# variant, whose random numbers or order of events differ, must give
+# phase fractions of each image, and every number of each text output
+# (degree of hydration, heat, moduli, ...), within the tolerances.
+#
+# The legacy run goes in vcctl_verify/<case>/reference in the build
+# tree and each variant in vcctl_verify/<case>/<n>, so differences can
+# be looked at afterwards.  The report, vcctl_verify.csv, has one row
+# per output of each variant, and the target fails if any of them
+# does not match.
+#
+# Variables: CASEDIR (cases), BINDIR (executables), WORKDIR (scratch
+# and report directory)
+
+if(NOT CASEDIR OR NOT IS_DIRECTORY "${CASEDIR}")
+  message(FATAL_ERROR "vcctl_verify: set VCCTL_VERIFY_DIR to a directory of cases")
+endif()
+
+set(cmp "${BINDIR}/vcctlcmp${CMAKE_EXECUTABLE_SUFFIX}")
+
+# Run one case in rundir with extra options; sets status in the caller
+function(runcase case rundir extra)
+  file(REMOVE_RECURSE "${rundir}")
+  file(COPY "${CASEDIR}/${case}/" DESTINATION "${rundir}")
+
+  file(STRINGS "${rundir}/command" cmd)
+  list(POP_FRONT cmd prog)
+  set(input "")
+  if(EXISTS "${rundir}/stdin")
+    set(input INPUT_FILE "${rundir}/stdin")
+  endif()
+
+  execute_process(
+    COMMAND "${BINDIR}/${prog}${CMAKE_EXECUTABLE_SUFFIX}" ${cmd} ${extra}
+    WORKING_DIRECTORY "${rundir}"
+    ${input}
+    OUTPUT_FILE "${rundir}/stdout.txt"
+    ERROR_FILE "${rundir}/stderr.txt"
+    RESULT_VARIABLE result)
+  set(status "${result}" PARENT_SCOPE)
+endfunction()
+
+file(MAKE_DIRECTORY "${WORKDIR}")
+set(report "${WORKDIR}/vcctl_verify.csv")
+file(WRITE "${report}" "Case,Variant,Mode,Output,Result,Detail\n")
+set(nfail 0)
+
+file(GLOB cases LIST_DIRECTORIES true RELATIVE "${CASEDIR}" "${CASEDIR}/*")
+list(SORT cases)
+
+foreach(case IN LISTS cases)
+  if(NOT EXISTS "${CASEDIR}/${case}/command" OR
+     NOT EXISTS "${CASEDIR}/${case}/variants" OR
+     NOT EXISTS "${CASEDIR}/${case}/outputs")
+    continue()
+  endif()
+
+  file(STRINGS "${CASEDIR}/${case}/outputs" outs)
+  file(STRINGS "${CASEDIR}/${case}/variants" variants)
+  set(tol "")
+  if(EXISTS "${CASEDIR}/${case}/tolerance")
+    file(READ "${CASEDIR}/${case}/tolerance" tol)
+    separate_arguments(tol UNIX_COMMAND "${tol}")
+  endif()
+
+  message(STATUS "vcctl_verify: ${case} (legacy path)")
+  set(refdir "${WORKDIR}/${case}/reference")
+  runcase("${case}" "${refdir}" "")
+  if(NOT status EQUAL 0)
+    file(APPEND "${report}" "${case},reference,,,fail,\"exit status ${status}\"\n")
+    math(EXPR nfail "${nfail} + 1")
+    continue()
+  endif()
+
+  set(n 0)
+  foreach(variant IN LISTS variants)
+    separate_arguments(variant UNIX_COMMAND "${variant}")
+    list(POP_FRONT variant mode)
+    if(NOT mode STREQUAL "exact" AND NOT mode STREQUAL "stat")
+      continue()
+    endif()
+    math(EXPR n "${n} + 1")
+    string(REPLACE ";" " " label "${variant}")
+
+    message(STATUS "vcctl_verify: ${case} (${mode} ${label})")
+    set(rundir "${WORKDIR}/${case}/${n}")
+    runcase("${case}" "${rundir}" "${variant}")
+    if(NOT status EQUAL 0)
+      file(APPEND "${report}"
+           "${case},\"${label}\",${mode},,fail,\"exit status ${status}\"\n")
+      math(EXPR nfail "${nfail} + 1")
+      continue()
+    endif()
+
+    if(mode STREQUAL "exact")
+      set(opts --exact)
+    else()
+      set(opts ${tol})
+    endif()
+    foreach(out IN LISTS outs)
+      execute_process(
+        COMMAND "${cmp}" ${opts} "${refdir}/${out}" "${rundir}/${out}"
+        OUTPUT_VARIABLE detail
+        OUTPUT_STRIP_TRAILING_WHITESPACE
+        RESULT_VARIABLE result)
+      if(result EQUAL 0)
+        set(result "pass")
+      else()
+        set(result "fail")
+        math(EXPR nfail "${nfail} + 1")
+      endif()
+      string(REPLACE "\"" "'" detail "${detail}")
+      file(APPEND "${report}"
+           "${case},\"${label}\",${mode},${out},${result},\"${detail}\"\n")
+    endforeach()
+  endforeach()
+endforeach()
+
+message(STATUS "vcctl_verify: report written to ${report}")
+if(nfail GREATER 0)
+  message(FATAL_ERROR "vcctl_verify: ${nfail} check(s) failed")
+endif()
@@ -10,6 +10,9 @@
  *
  *	Only processes the phase values 0-3
  *
+ *	Usage: apstats [<input_file> <output_file>]
+ *	(asks for the file names if they are not given)
+ *
  * Programmer:	Dale P. Bentz
  * 				Building and Fire Research Laboratory
  *				NIST
@@ -41,28 +44,27 @@
  ***/
 float Version;
 
-int main(void) {
-  int ***mic;
-  int valin, ovalin, ix, iy, iz, ix1, iy1, iz1, k, syssize, flag;
-  int xsyssize, ysyssize, zsyssize;
-  int voltot, surftot, totalvol;
-  int volume[3], surface[3], surfpix[3];
+int main(int argc, char *argv[]) {
+  int k, nout, xsyssize, ysyssize, zsyssize;
+  int voltot, surftot;
+  int volume[CENSUSIDS], surface[3], *pair;
   float res;
-  char filen[MAXSTRING], fileout[MAXSTRING], buff[MAXSTRING];
-  char instring[MAXSTRING];
+  char filen[MAXSTRING], fileout[MAXSTRING];
+  size_t cap = 0;
+  unsigned char *vox = NULL;
   FILE *infile, *statfile;
 
-  printf("Enter name of file to open \n");
-  read_string(filen, sizeof(filen));
-  printf("%s \n", filen);
-  printf("Enter name of file to write statistics to \n");
-  read_string(fileout, sizeof(fileout));
-  printf("%s \n", fileout);
-
-  /* Initialize local arrays */
-
-  for (ix = 0; ix < 3; ix++) {
-    volume[ix] = surface[ix] = surfpix[ix] = 0;
+  /* Check for command line arguments */
+  if (argc != 3) {
+    printf("Enter name of file to open \n");
+    read_string(filen, sizeof(filen));
+    printf("%s \n", filen);
+    printf("Enter name of file to write statistics to \n");
+    read_string(fileout, sizeof(fileout));
+    printf("%s \n", fileout);
+  } else {
+    snprintf(filen, sizeof(filen), "%s", argv[1]);
+    snprintf(fileout, sizeof(fileout), "%s", argv[2]);
   }
 
   /***
@@ -71,153 +73,56 @@ int main(void) {
    *	displaying in web page format
    ***/
 
-  infile = fopen(filen, "r");
-  statfile = fopen(fileout, "w");
+  infile = filehandler("apstats", filen, "READ");
+  if (!infile) {
+    exit(1);
+  }
 
   /***
-   *	Determine whether software version, system
-   *	size and resolution are specified in the image file
+   *	Read the software version, system size, resolution
+   *	and all the voxels of the image file
    ***/
 
-  fscanf(infile, "%s", buff);
-  if (!strcmp(buff, VERSIONSTRING)) {
-    fscanf(infile, "%s", instring);
-    Version = atof(instring);
-    fscanf(infile, "%s", buff); /* Desc. of system size */
-    if (!strcmp(buff, XSIZESTRING)) {
-      fscanf(infile, "%s", instring);
-      xsyssize = atoi(instring);
-      fscanf(infile, "%s %s", buff, instring);
-      ysyssize = atoi(instring);
-      fscanf(infile, "%s %s", buff, instring);
-      zsyssize = atoi(instring);
-    } else {
-      fscanf(infile, "%s", instring);
-      syssize = atoi(instring);
-      xsyssize = syssize;
-      ysyssize = syssize;
-      zsyssize = syssize;
-    }
-    fscanf(infile, "%s", buff); /* Desc. of resolution */
-    fscanf(infile, "%s", instring);
-    res = atof(instring);
-  } else {
-
-    /***
-     *	This image file was generated prior to
-     *	Version 3.0.  Allow backward compatibility
-     *	by defaulting system size to 100 and
-     *	system resolution to 1.0
-     ***/
-
-    Version = 2.0;
-    syssize = DEFAULTSYSTEMSIZE;
-    xsyssize = syssize;
-    ysyssize = syssize;
-    zsyssize = syssize;
-    res = DEFAULTRESOLUTION;
-    rewind(infile);
+  if (load_microstructure(infile, &vox, &cap, &Version, &xsyssize, &ysyssize,
+                          &zsyssize, &res)) {
+    fclose(infile);
+    if (vox)
+      free(vox);
+    bailout("apstats", "Error reading microstructure image");
+    exit(1);
   }
+  fclose(infile);
 
   /***
-   *	Dynamically allocate the memory for mic array
+   *	Count the voxels of each component and the faces
+   *	between each pair, in one pass over the image
    ***/
 
-  mic = ibox(xsyssize, ysyssize, zsyssize);
-
-  /* Read in image and accumulate volume totals */
-
-  totalvol = 0;
-  for (iz = 0; iz < zsyssize; iz++) {
-    for (iy = 0; iy < ysyssize; iy++) {
-      for (ix = 0; ix < xsyssize; ix++) {
-
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valin = convert_id(ovalin, Version);
-        mic[ix][iy][iz] = valin;
-
-        volume[valin]++;
-        totalvol++;
-      }
-    }
+  pair = (int *)malloc((size_t)CENSUSIDS * CENSUSIDS * sizeof(int));
+  if (!pair) {
+    free(vox);
+    bailout("apstats", "Memory allocation failure");
+    exit(1);
   }
 
-  fclose(infile);
-
-  ix1 = iy1 = iz1 = 0;
-  for (iz = 0; iz < zsyssize; iz++) {
-    for (iy = 0; iy < ysyssize; iy++) {
-      for (ix = 0; ix < xsyssize; ix++) {
-
-        flag = 0;
-
-        if (mic[ix][iy][iz] == AGG) {
-
-          valin = mic[ix][iy][iz];
-
-          /* Check six neighboring pixels for binder or ITZ*/
-
-          for (k = 1; k <= 6; k++) {
+  nout = phase_interfaces(vox, xsyssize, ysyssize, zsyssize, CENSUSIDS,
+                          volume, pair, NULL, 0);
+  free(vox);
+  if (nout < 0) {
+    free(pair);
+    bailout("apstats", "Memory allocation failure");
+    exit(1);
+  }
 
-            switch (k) {
-            case 1:
-              ix1 = ix - 1;
-              if (ix1 < 0)
-                ix1 += xsyssize;
-              iy1 = iy;
-              iz1 = iz;
-              break;
-            case 2:
-              ix1 = ix + 1;
-              if (ix1 >= xsyssize)
-                ix1 -= xsyssize;
-              iy1 = iy;
-              iz1 = iz;
-              break;
-            case 3:
-              iy1 = iy - 1;
-              if (iy1 < 0)
-                iy1 += ysyssize;
-              ix1 = ix;
-              iz1 = iz;
-              break;
-            case 4:
-              iy1 = iy + 1;
-              if (iy1 >= ysyssize)
-                iy1 -= ysyssize;
-              ix1 = ix;
-              iz1 = iz;
-              break;
-            case 5:
-              iz1 = iz - 1;
-              if (iz1 < 0)
-                iz1 += zsyssize;
-              iy1 = iy;
-              ix1 = ix;
-              break;
-            case 6:
-              iz1 = iz + 1;
-              if (iz1 >= zsyssize)
-                iz1 -= zsyssize;
-              iy1 = iy;
-              ix1 = ix;
-              break;
-            default:
-              break;
-            }
+  /* Only the aggregate faces toward binder or ITZ are surface */
 
-            if ((mic[ix1][iy1][iz1] == BINDER) || (mic[ix1][iy1][iz1] == ITZ)) {
+  surface[BINDER] = surface[ITZ] = 0;
+  surface[AGG] = pair[AGG * CENSUSIDS + BINDER] + pair[AGG * CENSUSIDS + ITZ];
+  free(pair);
 
-              surface[valin]++;
-              flag = 1;
-            }
-          }
-        }
-        if (flag)
-          surfpix[valin]++;
-      }
-    }
+  statfile = filehandler("apstats", fileout, "WRITE");
+  if (!statfile) {
+    exit(1);
   }
 
   printf("Component    Volume      Surface     Volume    Surface\n");
@@ -248,11 +153,5 @@ int main(void) {
 
   fclose(statfile);
 
-  /***
-   *	Free the allocated memory
-   ***/
-
-  free_ibox(mic, xsyssize, ysyssize);
-
   return (0);
 }
@@ -29,17 +29,50 @@
  * 3-D image using the conjugate gradient technique
  * (i.e. no binding/reaction)
  *
+ * By default the ants move one at a time.  With
+ * --threads they all move at once each cycle, each
+ * thread drawing from its own random stream, and the
+ * ants that reach a reactive pixel are then handled
+ * layer by layer.  The results follow the same model
+ * but are not the same numbers as the one-at-a-time
+ * moves, and are reproducible for a given seed and
+ * number of threads.
+ *
+ * With --band the layers behind the reaction front,
+ * where the ions only diffuse, are solved as a 1-D
+ * continuum, and ants are kept only in a band of
+ * layers at the front and below it.  The run time then
+ * depends on the width of the band rather than on the
+ * depth reached.
+ *
+ * With --window only the layers the ants can reach
+ * are held in memory, from just above the band to just
+ * below the deepest ant.  They are read in from a raw
+ * binary input image as the ants go deeper, and written
+ * out to a raw binary output image once they join the
+ * continuum, so the depth of the specimen is limited by
+ * the disk rather than by memory.  The profiles of each
+ * layer are kept for the whole depth.
+ *
  *******************************************************/
 #include "include/vcctl.h"
+#include <getopt.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define MOLEFACTOR                                                             \
   1.0E12 /* cubic micrometers per                                              \
                                                  cubic centimeter */
-#define NUMANTS 500000
+#define NUMANTS 500000 /* starting room for ants, per 100^3 pixels */
+
+#define QUIETCYCLES 100 /* cycles without binding before a layer is spent */
+
+#define WINMARGIN 4 /* layers held past those the ants are in */
 
 #define SPERETTR 2     /* diffusing species per ETTR pixel */
 #define SPERETTRC4AF 2 /* diffusing species per ETTRC4AF pixel */
@@ -87,35 +120,111 @@ float Layer_volume;
 /* VCCTL software version number used to make the input file */
 float Version;
 
-/* coordinates of diffusing species in (Xnew,Ynew,Znew) */
+/***
+ *	coordinates of diffusing species in (Xnew,Ynew,Znew),
+ *	numbered from 1, with room for Antcap - 1 of them
+ ***/
 short int *Xnew, *Ynew, *Znew;
+int Antcap = 0;
 
 int Nantsurf, Ntotdiff = 0;
 double Molesperpixel[MS + 1], Cfre, Cbound;
 
+/* Probability of reaction and the Langmuir isotherm */
+float Preact, Alpha, Beta;
+int Nosorb;
+
+/***
+ *	For --threads: the random stream of each thread,
+ *	the pixel each ant tries to move into and its state
+ *	(0 done, 2 waiting to react, -1 used up), the ants
+ *	waiting to react in order of layer, and each
+ *	thread's counts of those, and of the net moves into
+ *	and the moves down and up out of each layer
+ ***/
+int Nthreads = 0;
+Rngstate *Antrng;
+short int *Xtry, *Ytry, *Ztry;
+signed char *Antstat;
+int *Antlist, *Nbin, *Nmove;
+
+/***
+ *	For --band: the layers 0 to Zcont - 1 are a continuum
+ *	with Conc ants in each and Open the fraction of each
+ *	one's pixels they can sit in, and the layers 1 to
+ *	Zspent are spent.  Lastbind is the last cycle in
+ *	which each layer bound an ant (or had too few ants
+ *	to tell).  Across the boundary between layers z and
+ *	z+1, since either last bound an ant, Ndown[z] ants
+ *	moved down out of Nabove[z] ant-cycles in layer z
+ *	and Nup[z] moved up out of Nbelow[z] ant-cycles in
+ *	layer z+1.  Gcross[z] is the conductance of the
+ *	boundary once it is in the continuum.
+ ***/
+int Band = 0, Zcont = 0, Zspent = 0, Cycle = 0;
+
+/***
+ *	Handoff the input microstructure is read from, left by
+ *	disrealnew --handoff-out (see handoff.c), set with --handoff
+ *	(empty to read the input file)
+ ***/
+char Handoffname[MAXSTRING];
+
+/***
+ *	For --window: the window of layers that Mic and React
+ *	hold (see layerwin.c)
+ ***/
+int Window = 0;
+Layerwin Win;
+double *Conc, *Flux, *Open, *Gcross;
+double *Ndown, *Nup, *Nabove, *Nbelow;
+int *Lastbind;
+
 /***
  *	Function declarations
  ***/
 void remsurf(int nrem);
 void extphase(int phtomake, int xcur, int ycur, int zcur);
+int antstep(int antz, int cxn, int cyn, int czn);
+void moveserial(void);
+void movebatch(void);
+void growants(int nants);
+int canhold(int phid, int iz);
+double openfrac(int iz);
+void countcross(int zold, int znew);
+void advancefront(void);
+void continuum(void);
+void absorbants(void);
+void slide(int zdeep);
+void *regrow(void *p, size_t size);
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
 void allmem(void);
 void freeallmem(void);
 
 #include "include/properties.h"
 
-int main(void) {
+int main(int argc, char *argv[]) {
   int ix, iy, iz, seed1, nlen;
-  int i, antx, anty, antz, ich, inval, oinval;
-  int cxn, cyn, czn, phid, sel1, numadd, initdepth;
-  int ia, ncyc, icyc, iant, nleft, norg, nadd;
+  int i, ich, inval;
+  size_t n, cap = 0;
+  uint64_t seed;
+  unsigned char *vox = NULL;
+  int phid, numadd, initdepth;
+  int ia, ncyc, icyc, nleft, nadd;
   int chinit = 0, afminit = 0, c3ah6init = 0, ettrinit = 0, ettrc4init = 0;
-  float prand, preact, ptest, alpha, beta, chlorconc;
+  float prand, chlorconc;
   double volume_available;
   char filein[MAXSTRING], fileout[MAXSTRING];
   char fplot[MAXSTRING], fileroot[MAXSTRING], exten[MAXSTRING];
   char instring[MAXSTRING];
   FILE *micfile, *newmic, *plotfile;
 
+  if (checkargs(argc, argv)) {
+    printHelp();
+    exit(1);
+  }
+
   Mic = NULL;
   React = NULL;
   Ndiff = NULL;
@@ -184,21 +293,21 @@ int main(void) {
 
   printf("Enter probability of reaction: ");
   read_string(instring, sizeof(instring));
-  preact = atof(instring);
-  printf("Probability of reaction: %f \n", preact);
+  Preact = atof(instring);
+  printf("Probability of reaction: %f \n", Preact);
 
   printf("Allow chemical adsorption of Cl in C-S-H? [0(yes)/1(no)]\n");
   read_string(instring, sizeof(instring));
-  sel1 = atoi(instring);
-  if (!sel1) {
+  Nosorb = atoi(instring);
+  if (!Nosorb) {
     printf("Define alpha in Langmuir isotherm\n");
     read_string(instring, sizeof(instring));
-    alpha = atof(instring);
+    Alpha = atof(instring);
     printf("Define beta in Langmuir isotherm\n");
     read_string(instring, sizeof(instring));
-    beta = atof(instring);
+    Beta = atof(instring);
   } else {
-    alpha = beta = 0.0;
+    Alpha = Beta = 0.0;
   }
 
   printf("Enter molarity of chloride solution (0.0,1.0):  ");
@@ -221,27 +330,52 @@ int main(void) {
    *	First read in microstructure from datafile
    ***/
 
-  micfile = filehandler("chlorattack3d", filein, "READ");
-  if (!micfile) {
-    exit(1);
-  }
+  newmic = NULL;
+  if (Window) {
 
-  newmic = filehandler("chlorattack3d", fileout, "WRITE");
-  if (!newmic) {
-    exit(1);
-  }
+    /* Layer 0 is porosity and layer Zsyssize + 1 solid */
 
-  /***
-   *	Determine whether system size and resolution
-   *	are specified in the image file
-   ***/
+    if (layerwin_open(&Win, filein, fileout, LAYERWIN_ZFAST, POROSITY, C3S)) {
+      bailout("chlorattack3d", "--window needs a raw binary input image");
+      exit(1);
+    }
+    Version = Win.in.ver;
+    Xsyssize = Win.xsize;
+    Ysyssize = Win.ysize;
+    Zsyssize = Win.zsize;
+    Res = Win.in.res;
+    Mic = Win.mic;
+    React = Win.react;
+  } else {
+    if (strlen(Handoffname) > 0) {
+      micfile = handoff_open(Handoffname, "img", 0);
+    } else {
+      micfile = filehandler("chlorattack3d", filein, "READ");
+    }
+    if (!micfile) {
+      exit(1);
+    }
 
-  if (read_imgheader(micfile, &Version, &Xsyssize, &Ysyssize, &Zsyssize,
-                     &Res)) {
-    fclose(micfile);
-    bailout("chlorattack3d", "Error reading image header");
-    freeallmem();
-    exit(1);
+    newmic = filehandler("chlorattack3d", fileout, "WRITE");
+    if (!newmic) {
+      exit(1);
+    }
+
+    /***
+     *	Determine whether system size and resolution
+     *	are specified in the image file
+     ***/
+
+    if (load_microstructure(micfile, &vox, &cap, &Version, &Xsyssize,
+                            &Ysyssize, &Zsyssize, &Res)) {
+      handoff_close(micfile);
+      if (vox)
+        free(vox);
+      bailout("chlorattack3d", "Error reading microstructure image");
+      freeallmem();
+      exit(1);
+    }
+    handoff_close(micfile);
   }
 
   /***
@@ -250,7 +384,11 @@ int main(void) {
 
   chlorconc = (chlorconc / 0.743102) * Res * Res * Res;
 
-  Syspix = (Xsyssize * Ysyssize * Zsyssize);
+  /* With --window the ants start out in the top layers only */
+
+  Syspix = Xsyssize * Ysyssize *
+           ((Window && Zsyssize > DEFAULTSYSTEMSIZE) ? DEFAULTSYSTEMSIZE
+                                                     : Zsyssize);
   Sizemag = (float)((double)Syspix / pow((double)DEFAULTSYSTEMSIZE, 3.0));
   Isizemag = (int)(Sizemag + 0.5);
 
@@ -276,11 +414,13 @@ int main(void) {
    *		all solid material at bottom surface
    ***/
 
-  for (ix = 0; ix < Xsyssize; ix++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      Mic[ix][iy][0] = 0;
-      Mic[ix][iy][Zsyssize + 1] = 1;
-      React[ix][iy][0] = React[ix][iy][Zsyssize + 1] = 0;
+  if (!Window) {
+    for (ix = 0; ix < Xsyssize; ix++) {
+      for (iy = 0; iy < Ysyssize; iy++) {
+        Mic[ix][iy][0] = 0;
+        Mic[ix][iy][Zsyssize + 1] = 1;
+        React[ix][iy][0] = React[ix][iy][Zsyssize + 1] = 0;
+      }
     }
   }
 
@@ -288,6 +428,8 @@ int main(void) {
 
   for (iz = 0; iz < (Zsyssize + 2); iz++) {
     Ndiff[iz] = 0;
+    Nrettr[iz] = 0;
+    Nrettrc4af[iz] = 0;
     Nrafm[iz] = 0;
     Nrc3ah6[iz] = 0;
     Straingyp[iz] = 0;
@@ -314,23 +456,29 @@ int main(void) {
 
   Clreactmax = 0.0;
 
-  /* Read in microstructure from datafile */
+  /***
+   *	Copy in the microstructure read from datafile, or
+   *	with --window just count it, layers coming into the
+   *	window as they are needed
+   ***/
 
+  n = 0;
   for (ix = 0; ix < Xsyssize; ix++) {
     for (iy = 0; iy < Ysyssize; iy++) {
       for (iz = 1; iz < Zsyssize + 1; iz++) {
 
-        if (feof(micfile)) {
-          freeallmem();
-          bailout("chlorattack3d", "End of file encountered");
-          exit(1);
+        if (Window) {
+          inval = layerwin_id(&Win, ix, iy, iz);
+          if (inval < 0) {
+            freeallmem();
+            bailout("chlorattack3d", "Unknown phase id in image");
+            exit(1);
+          }
+        } else {
+          inval = vox[n++];
+          Mic[ix][iy][iz] = inval;
+          React[ix][iy][iz] = 0;
         }
-
-        fscanf(micfile, "%s", instring);
-        oinval = atoi(instring);
-        inval = convert_id(oinval, Version);
-        Mic[ix][iy][iz] = inval;
-        React[ix][iy][iz] = 0;
         Density[iz] += ((Specgrav[inval] / MOLEFACTOR) / Layer_volume);
 
         if (inval == CH)
@@ -397,7 +545,7 @@ int main(void) {
   Clreactmax = Clreactmax * MASSCACL2 * 2.0 * MwCl;
   Clreactmax = Clreactmax / (MwCaCl2 * (float)Zsyssize);
 
-  fclose(micfile);
+  free(vox);
 
   printf("Initial counts for CH, AFM, C3AH6 and ettringite(2) are ");
   printf("%d, %d, %d, ", chinit, afminit, c3ah6init);
@@ -409,6 +557,8 @@ int main(void) {
   printf("Cycle Layer Diffusing Bound \n");
 
   Ntotdiff = 0;
+  if (Window)
+    slide(initdepth);
 
   /***
    *	Add ants to the top initdepth layers
@@ -447,12 +597,7 @@ int main(void) {
       }
 
       if (ich) {
-        if (Ntotdiff >= NUMANTS * Isizemag) {
-          freeallmem();
-          bailout("chlorattack3d", "Too many ants");
-          exit(1);
-        }
-
+        growants(Ntotdiff + 1);
         Ntotdiff++;
         Xnew[Ntotdiff] = ix;
         Ynew[Ntotdiff] = iy;
@@ -477,13 +622,30 @@ int main(void) {
 
   Nantsurf = (chlorconc * Layer_volume);
 
+  /* One stream per thread, seeded from the run's seed */
+
+  if (Nthreads > 0) {
+    seed = (uint64_t)(ran1(Seed) * 4294967296.0);
+    seed = (seed << 32) ^ (uint64_t)(ran1(Seed) * 4294967296.0);
+    for (i = 0; i < Nthreads; i++) {
+      rng_stream(&Antrng[i], seed, i);
+    }
+  }
+
   for (icyc = 1; icyc <= ncyc; icyc++) {
+    Cycle = icyc;
     nleft = 0;
-    nadd = Nantsurf - Ndiff[0];
+    if (Window)
+      slide(0);
+
+    /* The continuum holds the surface layer once there is one */
+
+    nadd = (Zcont > 0) ? 0 : Nantsurf - Ndiff[0];
     if (nadd > 0) {
 
       /* Add some ants to the top surface at random locations... */
 
+      growants(Ntotdiff + nadd);
       for (ia = 0; ia < nadd; ia++) {
         prand = ran1(Seed);
         ix = (int)((float)Xsyssize * prand);
@@ -494,12 +656,6 @@ int main(void) {
         if (ix >= Xsyssize)
           ix = Xsyssize - 1;
 
-        if (Ntotdiff >= NUMANTS * Isizemag) {
-          freeallmem();
-          bailout("chlorattack3d", "Too many ants.");
-          exit(1);
-        }
-
         Ntotdiff++;
         Xnew[Ntotdiff] = ix;
         Ynew[Ntotdiff] = iy;
@@ -514,52 +670,528 @@ int main(void) {
       remsurf(Ndiff[0] - Nantsurf);
     }
 
-    norg = Ntotdiff;
+    if (Band > 0) {
+      for (iz = Zcont; iz < Zsyssize + 1; iz++) {
+        Nabove[iz] += (double)Ndiff[iz];
+        Nbelow[iz] += (double)Ndiff[iz + 1];
+      }
+    }
 
-    /* Move each ant in turn */
+    if (Nthreads > 0) {
+      movebatch();
+    } else {
+      moveserial();
+    }
 
-    for (iant = 1; iant <= norg; iant++) {
+    if (Band > 0) {
+      advancefront();
+      if (Zcont > 0)
+        continuum();
+    }
+  }
 
-      /* Get current location of this ant */
+  /***
+   *	Construct name of the plot file
+   ***/
 
-      antx = Xnew[iant];
-      anty = Ynew[iant];
-      antz = Znew[iant];
+  nlen = strcspn(filein, ".");
+  strncpy(fileroot, filein, nlen);
+  strcpy(exten, &filein[nlen + 4]);
+  strcpy(fplot, fileroot);
+  strcat(fplot, ".cap");
+  strcat(fplot, exten);
 
-      /***
-       *	Update location of ant based on a
-       *	randomly chosen direction
-       ***/
+  plotfile = filehandler("chlorattack3d", fplot, "WRITE");
+  if (!plotfile) {
+    freeallmem();
+    exit(1);
+  }
 
-      ich = 1 + (int)(6.0 * ran1(Seed));
-      if (ich > 6)
-        ich = 6;
+  for (i = 0; i < Zsyssize + 2; i++) {
+    fprintf(plotfile, "%d %d %d %d ", icyc, i, Ndiff[i], Nrettr[i]);
+    fprintf(plotfile, "%d %d %d ", Nrettrc4af[i], Nrafm[i], Nrc3ah6[i]);
+    fprintf(plotfile, "%d %d ", Friedelcount[i], Gypsumcount[i]);
+    fprintf(plotfile, "%d %d ", Ettrorig[i], Ettrc4aforig[i]);
+    fprintf(plotfile, "%d %d ", Afmorig[i], C3ah6orig[i]);
+    fprintf(plotfile, "%d %d ", Friedelorig[i], Gypsumorig[i]);
+    fprintf(plotfile, "%d %d ", Straingyp[i], Strainfriedel[i]);
+    fprintf(plotfile, "%d %d ", Afmcorig[i], Ccorig[i]);
+    fprintf(plotfile, "%d %d ", Nrafmc[i], Nrcap[i]);
+    fprintf(plotfile, "%f %f ", Nrgel[i], Density[i] * MOLEFACTOR);
+    fprintf(plotfile, "%f ", Clreacted[i] * MOLEFACTOR);
+    fprintf(plotfile, "%f\n", Clchemisorb[i] * MOLEFACTOR);
+  }
+  fclose(plotfile);
 
+  /* With --window the rest of the layers go out to the image */
+
+  if (Window) {
+    if (layerwin_close(&Win)) {
+      bailout("chlorattack3d", "Error writing microstructure image");
+      freeallmem();
+      exit(1);
+    }
+    printf("At most %d of %d layers were held in memory\n", Win.maxheld,
+           Zsyssize + 2);
+    freeallmem();
+    return (0);
+  }
+
+  /***
+   *	Output the VCCTL version number to
+   *	microstructure file
+   ***/
+
+  if (write_imgheader(newmic, Xsyssize, Ysyssize, Zsyssize, Res)) {
+    fclose(newmic);
+    bailout("chlorattack3d", "Error writing image header");
+    freeallmem();
+    exit(1);
+  }
+
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      for (iz = 1; iz < Zsyssize + 1; iz++) {
+
+        fprintf(newmic, "\n%d", Mic[ix][iy][iz]);
+      }
+    }
+  }
+  fprintf(newmic, "\n");
+
+  fclose(newmic);
+
+  freeallmem();
+  return (0);
+}
+
+/***
+ *	antstep
+ *
+ *	Try to move an ant in layer antz into the neighboring
+ *	pixel (cxn,cyn,czn).  The ant may react there with
+ *	AFm, C3AH6, monocarbonate or ettringite, or be
+ *	adsorbed by C-S-H, instead of moving.
+ *
+ *	Arguments:	int layer of the ant
+ *				int coordinates of the pixel
+ *	Returns:	1 if the ant moves, 0 if it stays, -1 if it
+ *				was used by a reaction or adsorbed
+ *
+ *	Calls:		ran1, extphase
+ *	Called by:	moveserial, movebatch, continuum
+ ***/
+int antstep(int antz, int cxn, int cyn, int czn) {
+  int phid, ich, iz;
+  float ptest;
+
+  ich = 1;
+
+  phid = Mic[cxn][cyn][czn];
+  if ((phid != POROSITY) && (phid != AFMC) && (phid != CSH) &&
+      (phid != ETTR) && (phid != AFM) && (phid != ETTRC4AF) &&
+      (phid != EMPTYP) && (phid != DRIEDP) && (phid != C3AH6) &&
+      (phid != POZZCSH) && (phid != SLAGCSH)) {
+
+    ich = 0;
+
+  } else if (phid == AFM) {
+    ich = 0;
+
+    /* Can't move, but can react */
+
+    if ((ran1(Seed) < Preact) && (React[cxn][cyn][czn] < SPERAFM)) {
+
+      Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
+      React[cxn][cyn][czn]++;
+
+      if (React[cxn][cyn][czn] == SPERAFM) {
+
+        /***
+         *	Convert to FRIEDEL with probability
+         *	ptest, else ETTR
+         *
+         *	Plus, account for possible need for
+         *	extra ETTR
+         ***/
+
+        ptest = ((2.0 / 3.0) * (Molarv[FRIEDEL] / Molarv[AFM]));
+        if (ran1(Seed) < ptest) {
+          Mic[cxn][cyn][czn] = FRIEDEL;
+          Friedelcount[czn]++;
+          Density[czn] +=
+              ((Specgrav[FRIEDEL] - Specgrav[AFM]) / MOLEFACTOR) /
+              Layer_volume;
+        } else {
+          Mic[cxn][cyn][czn] = ETTR;
+          Ettrorig[czn]++;
+          Density[czn] +=
+              ((Specgrav[ETTR] - Specgrav[AFM]) / MOLEFACTOR) /
+              Layer_volume;
+        }
+
+        ptest += (1.0 / 3.0) * (Molarv[ETTR] / Molarv[AFM]);
+        if (ran1(Seed) < ptest - 1.0) {
+          extphase(ETTR, cxn, cyn, czn);
+        }
+        Nrafm[czn]++;
+        React[cxn][cyn][czn] = 0;
+      }
+
+      Ndiff[antz]--;
+      ich = (-1);
+    }
+
+  } else if (phid == C3AH6) {
+
+    ich = 0;
+    if ((ran1(Seed) < Preact) && (React[cxn][cyn][czn] < SPERC3AH6)) {
+
+      Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
+      React[cxn][cyn][czn]++;
+      if (React[cxn][cyn][czn] == SPERC3AH6) {
+        Mic[cxn][cyn][czn] = FRIEDEL;
+        Friedelcount[czn]++;
+        Density[czn] +=
+            ((Specgrav[FRIEDEL] - Specgrav[C3AH6]) / MOLEFACTOR) /
+            Layer_volume;
+
+        ptest = (Molarv[FRIEDEL] / Molarv[C3AH6]) - 1.0;
+        if (ran1(Seed) < ptest) {
+          extphase(FRIEDEL, cxn, cyn, czn);
+        }
+        Nrc3ah6[czn]++;
+        React[cxn][cyn][czn] = 0;
+      }
+
+      Ndiff[antz]--;
+      ich = (-1);
+    }
+
+  } else if (phid == AFMC) {
+
+    ich = 0;
+    if ((ran1(Seed) < Preact) && (React[cxn][cyn][czn] < SPERAFMC)) {
+
+      Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
+      React[cxn][cyn][czn]++;
+      if (React[cxn][cyn][czn] == SPERAFMC) {
+        Mic[cxn][cyn][czn] = FRIEDEL;
+        Friedelcount[czn]++;
+        Density[czn] +=
+            ((Specgrav[FRIEDEL] - Specgrav[AFMC]) / MOLEFACTOR) /
+            Layer_volume;
+
+        ptest = (Molarv[FRIEDEL] / Molarv[AFMC]) - 1.0;
+        if (ran1(Seed) < ptest) {
+          extphase(FRIEDEL, cxn, cyn, czn);
+        }
+
+        ptest = (Molarv[CACO3] / Molarv[AFMC]);
+        if (ran1(Seed) < ptest) {
+          extphase(CACO3, cxn, cyn, czn);
+        }
+
+        Nrafmc[czn]++;
+        React[cxn][cyn][czn] = 0;
+      }
+
+      Ndiff[antz]--;
+      ich = (-1);
+    }
+  } else if ((phid == ETTR) && (Nrafm[czn] > (Afmorig[czn] * 0.9)) &&
+             (Nrafmc[czn] > (Afmcorig[czn] * 0.9))) {
+
+    ich = 0;
+    if ((ran1(Seed) < Preact) && (React[cxn][cyn][czn] < SPERETTR)) {
+
+      Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
+      React[cxn][cyn][czn]++;
+      if (React[cxn][cyn][czn] == SPERETTR) {
+
+        /***
+         *	Need to convert current ettringite
+         *	to either gypsum, friedel's salt or
+         *	porosity
+         ***/
+
+        ptest = (Molarv[GYPSUM] * 3.0 / Molarv[ETTR]);
+        if (ran1(Seed) < ptest) {
+          Mic[cxn][cyn][czn] = GYPSUM;
+          Gypsumcount[czn]++;
+          Density[czn] +=
+              ((Specgrav[GYPSUM] - Specgrav[ETTR]) / MOLEFACTOR) /
+              Layer_volume;
+
+        } else if (ran1(Seed) <
+                   (ptest + Molarv[FRIEDEL] / Molarv[ETTR])) {
+
+          Mic[cxn][cyn][czn] = FRIEDEL;
+          Friedelcount[czn]++;
+          Density[czn] +=
+              ((Specgrav[FRIEDEL] - Specgrav[ETTR]) / MOLEFACTOR) /
+              Layer_volume;
+
+        } else {
+
+          Mic[cxn][cyn][czn] = POROSITY;
+          Nrcap[czn]++;
+          Density[czn] +=
+              ((Specgrav[POROSITY] - Specgrav[ETTR]) / MOLEFACTOR) /
+              Layer_volume;
+        }
+
+        Nrettr[czn]++;
+        React[cxn][cyn][czn] = 0;
+      }
+
+      Ndiff[antz]--;
+      ich = (-1);
+    }
+
+  } else if ((phid == ETTRC4AF) && (Nrafm[czn] > (Afmorig[czn] * 0.9))) {
+
+    ich = 0;
+    if ((ran1(Seed) < Preact) && (React[cxn][cyn][czn] < SPERETTRC4AF)) {
+
+      Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
+      React[cxn][cyn][czn]++;
+      if (React[cxn][cyn][czn] == SPERETTRC4AF) {
+        ptest = (Molarv[GYPSUM] * 3.0 / Molarv[ETTRC4AF]);
+        if (ran1(Seed) < ptest) {
+          Mic[cxn][cyn][czn] = GYPSUM;
+          Gypsumcount[czn]++;
+          Density[czn] +=
+              ((Specgrav[GYPSUM] - Specgrav[ETTRC4AF]) / MOLEFACTOR) /
+              Layer_volume;
+        } else if (ran1(Seed) <
+                   (ptest + Molarv[FRIEDEL] / Molarv[ETTR])) {
+          Mic[cxn][cyn][czn] = FRIEDEL;
+          Friedelcount[czn]++;
+          Density[czn] +=
+              ((Specgrav[FRIEDEL] - Specgrav[ETTRC4AF]) / MOLEFACTOR) /
+              Layer_volume;
+        } else {
+          Mic[cxn][cyn][czn] = POROSITY;
+          Nrcap[czn]++;
+          Density[czn] +=
+              ((Specgrav[POROSITY] - Specgrav[ETTRC4AF]) / MOLEFACTOR) /
+              Layer_volume;
+        }
+
+        Nrettrc4af[czn]++;
+        React[cxn][cyn][czn] = 0;
+      }
+
+      Ndiff[antz]--;
+      ich = (-1);
+    }
+  } else if (((phid == CSH) || (phid == POZZCSH) || (phid == SLAGCSH)) &&
+             (!Nosorb)) {
+
+    Cfre = Ndiff[czn] * 1000.0 * MASSCACL2 * 2.0 * MOLEFACTOR /
+           (MwCaCl2 * (((double)Nrcap[czn]) + Nrgel[czn]));
+
+    Cbound = (Clreactmax + Clchemisorb[czn]) * 1000.0 /
+             (Density[czn] * Layer_volume * MwCl);
+
+    if (Cbound <= (Alpha * Cfre / (1.0 + Beta * Cfre))) {
+      Clchemisorb[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
+      Ndiff[antz]--;
+      ich = (-1);
+    }
+  }
+
+  /* Start the crossing counts next to a layer over when it binds an ant */
+
+  if ((ich < 0) && Lastbind) {
+    Lastbind[czn] = Cycle;
+    for (iz = czn - 1; iz <= czn; iz++) {
+      if (iz >= 0)
+        Ndown[iz] = Nup[iz] = Nabove[iz] = Nbelow[iz] = 0.0;
+    }
+  }
+
+  return (ich);
+}
+
+/***
+ *	moveserial
+ *
+ *	Move each ant in turn one step, with one ran1
+ *	stream for the whole system
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		ran1, antstep, countcross
+ *	Called by:	main
+ ***/
+void moveserial(void) {
+  int iant, norg, nleft, antx, anty, antz, cxn, cyn, czn, ich;
+
+  nleft = 0;
+  norg = Ntotdiff;
+
+  /* Move each ant in turn */
+
+  for (iant = 1; iant <= norg; iant++) {
+
+    /* Get current location of this ant */
+
+    antx = Xnew[iant];
+    anty = Ynew[iant];
+    antz = Znew[iant];
+
+    /***
+     *	Update location of ant based on a
+     *	randomly chosen direction
+     ***/
+
+    ich = 1 + (int)(6.0 * ran1(Seed));
+    if (ich > 6)
+      ich = 6;
+
+    cxn = antx;
+    cyn = anty;
+    czn = antz;
+
+    switch (ich) {
+
+    case 1:
+      cxn = antx - 1;
+      break;
+    case 2:
+      cxn = antx + 1;
+      break;
+    case 3:
+      cyn = anty - 1;
+      break;
+    case 4:
+      cyn = anty + 1;
+      break;
+    case 5:
+      czn = antz - 1;
+      break;
+    case 6:
+      czn = antz + 1;
+      break;
+    default:
+      break;
+    }
+
+    cxn += checkbc(cxn, Xsyssize);
+    cyn += checkbc(cyn, Ysyssize);
+
+    /* Don't let ants leave via the top surface */
+
+    if (czn < 0)
+      ich = 0;
+
+    if (ich != 0)
+      ich = antstep(antz, cxn, cyn, czn);
+
+    /* Ant stays where it is */
+
+    if (ich == 0) {
       cxn = antx;
       cyn = anty;
       czn = antz;
+    }
+
+    /* Ant moves to new location */
+
+    if (ich >= 0) {
+      Ndiff[antz]--;
+      Ndiff[czn]++;
+      if (Ndown)
+        countcross(antz, czn);
+
+      /* If not adsorbed, update ant data structure */
+
+      nleft++;
+      Xnew[nleft] = cxn;
+      Ynew[nleft] = cyn;
+      Znew[nleft] = czn;
+    }
+  }
+
+  Ntotdiff = nleft;
 
-      switch (ich) {
+  return;
+}
 
+/***
+ *	movebatch
+ *
+ *	Move all the ants one step at once (--threads).  Each
+ *	thread draws the directions for a fixed share of the
+ *	ants from its own stream and checks them against the
+ *	microstructure at the start of the step: an ant headed
+ *	through the top surface or into a solid stays, and one
+ *	headed into pore space moves.  The ants headed for a
+ *	pixel where they may react or be adsorbed are binned
+ *	by the layer of that pixel.  The bins are then worked
+ *	through one layer at a time with antstep, so the
+ *	reactions in a layer see each other and the layer
+ *	concentrations after the step's moves.
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		rng_uniform, antstep, countcross
+ *	Called by:	main
+ ***/
+void movebatch(void) {
+  int iant, nleft, nz, nlist, z, t, it, k, antz, ich;
+
+  nz = Zsyssize + 2;
+  memset(Nbin, 0, (size_t)Nthreads * nz * sizeof(int));
+  memset(Nmove, 0, 3 * (size_t)Nthreads * nz * sizeof(int));
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(Nthreads) private(iant, t)
+#endif
+  {
+    int ax, ay, az, cxn, cyn, czn, phid;
+    int *nbin, *nmove;
+    Rngstate st;
+
+    t = 0;
+#ifdef _OPENMP
+    t = omp_get_thread_num();
+#endif
+    st = Antrng[t];
+    nbin = Nbin + (size_t)t * nz;
+    nmove = Nmove + 3 * (size_t)t * nz;
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (iant = 1; iant <= Ntotdiff; iant++) {
+      ax = cxn = Xnew[iant];
+      ay = cyn = Ynew[iant];
+      az = czn = Znew[iant];
+      Antstat[iant] = 0;
+
+      switch ((int)(6.0 * rng_uniform(&st))) {
+      case 0:
+        cxn = ax - 1;
+        break;
       case 1:
-        cxn = antx - 1;
+        cxn = ax + 1;
         break;
       case 2:
-        cxn = antx + 1;
+        cyn = ay - 1;
         break;
       case 3:
-        cyn = anty - 1;
+        cyn = ay + 1;
         break;
       case 4:
-        cyn = anty + 1;
-        break;
-      case 5:
-        czn = antz - 1;
-        break;
-      case 6:
-        czn = antz + 1;
+        czn = az - 1;
         break;
       default:
+        czn = az + 1;
         break;
       }
 
@@ -569,312 +1201,472 @@ int main(void) {
       /* Don't let ants leave via the top surface */
 
       if (czn < 0)
-        ich = 0;
-
-      if (ich != 0) {
-
-        /* Check to see what phase ant is moving into */
-
-        phid = Mic[cxn][cyn][czn];
-        if ((phid != POROSITY) && (phid != AFMC) && (phid != CSH) &&
-            (phid != ETTR) && (phid != AFM) && (phid != ETTRC4AF) &&
-            (phid != EMPTYP) && (phid != DRIEDP) && (phid != C3AH6) &&
-            (phid != POZZCSH) && (phid != SLAGCSH)) {
-
-          ich = 0;
-
-        } else if (phid == AFM) {
-          ich = 0;
-
-          /* Can't move, but can react */
-
-          if ((ran1(Seed) < preact) && (React[cxn][cyn][czn] < SPERAFM)) {
-
-            Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
-            React[cxn][cyn][czn]++;
-
-            if (React[cxn][cyn][czn] == SPERAFM) {
-
-              /***
-               *	Convert to FRIEDEL with probability
-               *	ptest, else ETTR
-               *
-               *	Plus, account for possible need for
-               *	extra ETTR
-               ***/
-
-              ptest = ((2.0 / 3.0) * (Molarv[FRIEDEL] / Molarv[AFM]));
-              if (ran1(Seed) < ptest) {
-                Mic[cxn][cyn][czn] = FRIEDEL;
-                Friedelcount[czn]++;
-                Density[czn] +=
-                    ((Specgrav[FRIEDEL] - Specgrav[AFM]) / MOLEFACTOR) /
-                    Layer_volume;
-              } else {
-                Mic[cxn][cyn][czn] = ETTR;
-                Ettrorig[czn]++;
-                Density[czn] +=
-                    ((Specgrav[ETTR] - Specgrav[AFM]) / MOLEFACTOR) /
-                    Layer_volume;
-              }
-
-              ptest += (1.0 / 3.0) * (Molarv[ETTR] / Molarv[AFM]);
-              if (ran1(Seed) < ptest - 1.0) {
-                extphase(ETTR, cxn, cyn, czn);
-              }
-              Nrafm[czn]++;
-              React[cxn][cyn][czn] = 0;
-            }
-
-            Ndiff[antz]--;
-            ich = (-1);
-          }
+        continue;
+
+      phid = Mic[cxn][cyn][czn];
+      if ((phid == AFM) || (phid == C3AH6) || (phid == AFMC) ||
+          (phid == ETTR) || (phid == ETTRC4AF) ||
+          (((phid == CSH) || (phid == POZZCSH) || (phid == SLAGCSH)) &&
+           (!Nosorb))) {
+        Antstat[iant] = 2;
+        Xtry[iant] = cxn;
+        Ytry[iant] = cyn;
+        Ztry[iant] = czn;
+        nbin[czn]++;
+      } else if ((phid == POROSITY) || (phid == CSH) || (phid == EMPTYP) ||
+                 (phid == DRIEDP) || (phid == POZZCSH) || (phid == SLAGCSH)) {
+        Xnew[iant] = cxn;
+        Ynew[iant] = cyn;
+        Znew[iant] = czn;
+        nmove[az]--;
+        nmove[czn]++;
+        if (czn > az) {
+          nmove[nz + az]++;
+        } else if (czn < az) {
+          nmove[2 * nz + czn]++;
+        }
+      }
+    }
 
-        } else if (phid == C3AH6) {
-
-          ich = 0;
-          if ((ran1(Seed) < preact) && (React[cxn][cyn][czn] < SPERC3AH6)) {
-
-            Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
-            React[cxn][cyn][czn]++;
-            if (React[cxn][cyn][czn] == SPERC3AH6) {
-              Mic[cxn][cyn][czn] = FRIEDEL;
-              Friedelcount[czn]++;
-              Density[czn] +=
-                  ((Specgrav[FRIEDEL] - Specgrav[C3AH6]) / MOLEFACTOR) /
-                  Layer_volume;
-
-              ptest = (Molarv[FRIEDEL] / Molarv[C3AH6]) - 1.0;
-              if (ran1(Seed) < ptest) {
-                extphase(FRIEDEL, cxn, cyn, czn);
-              }
-              Nrc3ah6[czn]++;
-              React[cxn][cyn][czn] = 0;
-            }
-
-            Ndiff[antz]--;
-            ich = (-1);
+    Antrng[t] = st;
+
+    /***
+     *	Start of each thread's part of each layer's bin,
+     *	layer by layer, so the ants in a bin stay in order
+     ***/
+
+#ifdef _OPENMP
+#pragma omp single
+#endif
+    {
+      k = 0;
+      for (z = 0; z < nz; z++) {
+        for (it = 0; it < Nthreads; it++) {
+          Ndiff[z] += Nmove[3 * (size_t)it * nz + z];
+          if (Ndown) {
+            Ndown[z] += Nmove[3 * (size_t)it * nz + nz + z];
+            Nup[z] += Nmove[3 * (size_t)it * nz + 2 * nz + z];
           }
+          k += Nbin[(size_t)it * nz + z];
+          Nbin[(size_t)it * nz + z] = k - Nbin[(size_t)it * nz + z];
+        }
+      }
+      nlist = k;
+    }
 
-        } else if (phid == AFMC) {
-
-          ich = 0;
-          if ((ran1(Seed) < preact) && (React[cxn][cyn][czn] < SPERAFMC)) {
-
-            Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
-            React[cxn][cyn][czn]++;
-            if (React[cxn][cyn][czn] == SPERAFMC) {
-              Mic[cxn][cyn][czn] = FRIEDEL;
-              Friedelcount[czn]++;
-              Density[czn] +=
-                  ((Specgrav[FRIEDEL] - Specgrav[AFMC]) / MOLEFACTOR) /
-                  Layer_volume;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (iant = 1; iant <= Ntotdiff; iant++) {
+      if (Antstat[iant] == 2)
+        Antlist[nbin[Ztry[iant]]++] = iant;
+    }
+  }
 
-              ptest = (Molarv[FRIEDEL] / Molarv[AFMC]) - 1.0;
-              if (ran1(Seed) < ptest) {
-                extphase(FRIEDEL, cxn, cyn, czn);
-              }
+  /* Reactions, one layer at a time */
+
+  nleft = Ntotdiff;
+  for (k = 0; k < nlist; k++) {
+    iant = Antlist[k];
+    antz = Znew[iant];
+    ich = antstep(antz, Xtry[iant], Ytry[iant], Ztry[iant]);
+    if (ich > 0) {
+      Ndiff[antz]--;
+      Ndiff[Ztry[iant]]++;
+      if (Ndown)
+        countcross(antz, Ztry[iant]);
+      Xnew[iant] = Xtry[iant];
+      Ynew[iant] = Ytry[iant];
+      Znew[iant] = Ztry[iant];
+    } else if (ich < 0) {
+      Antstat[iant] = -1;
+      nleft--;
+    }
+  }
 
-              ptest = (Molarv[CACO3] / Molarv[AFMC]);
-              if (ran1(Seed) < ptest) {
-                extphase(CACO3, cxn, cyn, czn);
-              }
+  /* Drop the ants that were used up */
 
-              Nrafmc[czn]++;
-              React[cxn][cyn][czn] = 0;
-            }
+  if (nleft < Ntotdiff) {
+    nleft = 0;
+    for (iant = 1; iant <= Ntotdiff; iant++) {
+      if (Antstat[iant] >= 0) {
+        nleft++;
+        Xnew[nleft] = Xnew[iant];
+        Ynew[nleft] = Ynew[iant];
+        Znew[nleft] = Znew[iant];
+      }
+    }
+    Ntotdiff = nleft;
+  }
 
-            Ndiff[antz]--;
-            ich = (-1);
-          }
-        } else if ((phid == ETTR) && (Nrafm[czn] > (Afmorig[czn] * 0.9)) &&
-                   (Nrafmc[czn] > (Afmcorig[czn] * 0.9))) {
-
-          ich = 0;
-          if ((ran1(Seed) < preact) && (React[cxn][cyn][czn] < SPERETTR)) {
-
-            Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
-            React[cxn][cyn][czn]++;
-            if (React[cxn][cyn][czn] == SPERETTR) {
-
-              /***
-               *	Need to convert current ettringite
-               *	to either gypsum, friedel's salt or
-               *	porosity
-               ***/
-
-              ptest = (Molarv[GYPSUM] * 3.0 / Molarv[ETTR]);
-              if (ran1(Seed) < ptest) {
-                Mic[cxn][cyn][czn] = GYPSUM;
-                Gypsumcount[czn]++;
-                Density[czn] +=
-                    ((Specgrav[GYPSUM] - Specgrav[ETTR]) / MOLEFACTOR) /
-                    Layer_volume;
-
-              } else if (ran1(Seed) <
-                         (ptest + Molarv[FRIEDEL] / Molarv[ETTR])) {
-
-                Mic[cxn][cyn][czn] = FRIEDEL;
-                Friedelcount[czn]++;
-                Density[czn] +=
-                    ((Specgrav[FRIEDEL] - Specgrav[ETTR]) / MOLEFACTOR) /
-                    Layer_volume;
-
-              } else {
-
-                Mic[cxn][cyn][czn] = POROSITY;
-                Nrcap[czn]++;
-                Density[czn] +=
-                    ((Specgrav[POROSITY] - Specgrav[ETTR]) / MOLEFACTOR) /
-                    Layer_volume;
-              }
-
-              Nrettr[czn]++;
-              React[cxn][cyn][czn] = 0;
-            }
-
-            Ndiff[antz]--;
-            ich = (-1);
-          }
+  return;
+}
 
-        } else if ((phid == ETTRC4AF) && (Nrafm[czn] > (Afmorig[czn] * 0.9))) {
-
-          ich = 0;
-          if ((ran1(Seed) < preact) && (React[cxn][cyn][czn] < SPERETTRC4AF)) {
-
-            Clreacted[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
-            React[cxn][cyn][czn]++;
-            if (React[cxn][cyn][czn] == SPERETTRC4AF) {
-              ptest = (Molarv[GYPSUM] * 3.0 / Molarv[ETTRC4AF]);
-              if (ran1(Seed) < ptest) {
-                Mic[cxn][cyn][czn] = GYPSUM;
-                Gypsumcount[czn]++;
-                Density[czn] +=
-                    ((Specgrav[GYPSUM] - Specgrav[ETTRC4AF]) / MOLEFACTOR) /
-                    Layer_volume;
-              } else if (ran1(Seed) <
-                         (ptest + Molarv[FRIEDEL] / Molarv[ETTR])) {
-                Mic[cxn][cyn][czn] = FRIEDEL;
-                Friedelcount[czn]++;
-                Density[czn] +=
-                    ((Specgrav[FRIEDEL] - Specgrav[ETTRC4AF]) / MOLEFACTOR) /
-                    Layer_volume;
-              } else {
-                Mic[cxn][cyn][czn] = POROSITY;
-                Nrcap[czn]++;
-                Density[czn] +=
-                    ((Specgrav[POROSITY] - Specgrav[ETTRC4AF]) / MOLEFACTOR) /
-                    Layer_volume;
-              }
-
-              Nrettrc4af[czn]++;
-              React[cxn][cyn][czn] = 0;
-            }
-
-            Ndiff[antz]--;
-            ich = (-1);
-          }
-        } else if (((phid == CSH) || (phid == POZZCSH) || (phid == SLAGCSH)) &&
-                   (!sel1)) {
+/***
+ *	canhold
+ *
+ *	Whether an ant can move into (and sit in) a pixel of
+ *	a phase in a layer.  Ettringite holds ants until the
+ *	AFm phases in the layer are nearly all reacted.
+ *
+ *	Arguments:	int phase id, int layer
+ *	Returns:	1 if it can, 0 otherwise
+ *
+ *	Calls:		no routines
+ *	Called by:	openfrac, continuum
+ ***/
+int canhold(int phid, int iz) {
+  if ((phid == POROSITY) || (phid == CSH) || (phid == EMPTYP) ||
+      (phid == DRIEDP) || (phid == POZZCSH) || (phid == SLAGCSH)) {
+    return (1);
+  }
+  if ((phid == ETTR) && !((Nrafm[iz] > (Afmorig[iz] * 0.9)) &&
+                          (Nrafmc[iz] > (Afmcorig[iz] * 0.9)))) {
+    return (1);
+  }
+  if ((phid == ETTRC4AF) && !(Nrafm[iz] > (Afmorig[iz] * 0.9)))
+    return (1);
 
-          Cfre = Ndiff[czn] * 1000.0 * MASSCACL2 * 2.0 * MOLEFACTOR /
-                 (MwCaCl2 * (((double)Nrcap[czn]) + Nrgel[czn]));
+  return (0);
+}
 
-          Cbound = (Clreactmax + Clchemisorb[czn]) * 1000.0 /
-                   (Density[czn] * Layer_volume * MwCl);
+/***
+ *	openfrac
+ *
+ *	Fraction of the pixels in a layer that an ant can
+ *	sit in
+ *
+ *	Arguments:	int layer
+ *	Returns:	double fraction
+ *
+ *	Calls:		canhold
+ *	Called by:	advancefront
+ ***/
+double openfrac(int iz) {
+  int ix, iy, nopen;
 
-          if (Cbound <= (alpha * Cfre / (1.0 + beta * Cfre))) {
-            Clchemisorb[czn] += (double)(MASSCACL2 * 2.0 * (MwCl / MwCaCl2));
-            Ndiff[antz]--;
-            ich = (-1);
-          }
-        }
-      }
+  nopen = 0;
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      nopen += canhold(Mic[ix][iy][iz], iz);
+    }
+  }
 
-      /* Ant stays where it is */
+  return ((double)nopen / Layer_volume);
+}
 
-      if (ich == 0) {
-        cxn = antx;
-        cyn = anty;
-        czn = antz;
-      }
+/***
+ *	countcross
+ *
+ *	Count an ant that moved between two layers.  Called
+ *	only for the --band mode, once the crossing counts
+ *	have been allocated.
+ *
+ *	Arguments:	int old layer, int new layer
+ *	Returns:	Nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	moveserial, movebatch
+ ***/
+void countcross(int zold, int znew) {
+  if (znew > zold) {
+    Ndown[zold] += 1.0;
+  } else if (znew < zold) {
+    Nup[znew] += 1.0;
+  }
 
-      /* Ant moves to new location */
+  return;
+}
 
-      if (ich >= 0) {
-        Ndiff[antz]--;
-        Ndiff[czn]++;
+/***
+ *	advancefront
+ *
+ *	Move the reaction front down a layer once the layer
+ *	at the front is spent: for QUIETCYCLES cycles it has
+ *	held at least a tenth of the ants it would hold at
+ *	the surface concentration, and nothing in it has
+ *	bound one.  The layers more than Band above the
+ *	front join the continuum, taking their ants with
+ *	them.
+ *
+ *	The conductance between two layers of the continuum
+ *	is the net number of ants that crossed it since
+ *	either layer last bound one, over the sum of the
+ *	differences in ants per open pixel across it, so it
+ *	includes the tortuosity of the pores.  If that net
+ *	flow is lost in the noise, the conductance comes
+ *	from the rates at which ants crossed each way
+ *	instead (an upper bound, since many ants step
+ *	straight back).
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		openfrac, absorbants
+ *	Called by:	main
+ ***/
+void advancefront(void) {
+  int zf, znew, iz;
+  double gmax, net, grad;
+
+  zf = Zspent + 1;
+  if (zf > Zsyssize)
+    return;
+  if (Ndiff[zf] < 0.1 * Nantsurf * openfrac(zf)) {
+    Lastbind[zf] = Cycle;
+    Ndown[zf - 1] = Nup[zf - 1] = Nabove[zf - 1] = Nbelow[zf - 1] = 0.0;
+    Ndown[zf] = Nup[zf] = Nabove[zf] = Nbelow[zf] = 0.0;
+    return;
+  }
+  if (Cycle - Lastbind[zf] < QUIETCYCLES)
+    return;
+
+  Zspent = zf;
+  znew = Zspent + 1 - Band;
+  if (znew <= Zcont)
+    return;
+
+  for (iz = Zcont; iz <= znew; iz++) {
+    Open[iz] = (iz > 0) ? openfrac(iz) : 1.0;
+    if (Open[iz] <= 0.0)
+      Open[iz] = 1.0 / Layer_volume;
+  }
+  for (iz = Zcont; iz < znew; iz++) {
+    if ((Nabove[iz] > 0.0) && (Nbelow[iz] > 0.0)) {
+      gmax = 0.5 * (Open[iz] * Ndown[iz] / Nabove[iz] +
+                    Open[iz + 1] * Nup[iz] / Nbelow[iz]);
+    } else {
+      gmax = Open[iz] * Open[iz + 1] / 6.0;
+    }
+    Gcross[iz] = gmax;
+    net = Ndown[iz] - Nup[iz];
+    grad = Nabove[iz] / Open[iz] - Nbelow[iz] / Open[iz + 1];
+    if ((net > 3.0 * sqrt(Ndown[iz] + Nup[iz])) && (grad > 0.0) &&
+        (net / grad < gmax)) {
+      Gcross[iz] = net / grad;
+    }
+    Conc[iz] = 0.0;
+  }
+  Zcont = znew;
+  absorbants();
+  printf("Cycle %d: layers 0 to %d solved as a continuum\n", Cycle,
+         Zcont - 1);
+  fflush(stdout);
 
-        /* If not adsorbed, update ant data structure */
+  return;
+}
 
-        nleft++;
-        Xnew[nleft] = cxn;
-        Ynew[nleft] = cyn;
-        Znew[nleft] = czn;
-      }
-    }
+/***
+ *	continuum
+ *
+ *	One cycle of the layers above the band, as a 1-D
+ *	finite-volume diffusion with the flux from layer z
+ *	to z+1 equal to
+ *	Gcross[z] (C[z] / Open[z] - C[z+1] / Open[z+1]).
+ *	The ants that step down out of the last continuum layer
+ *	become ants again at the top of the band, where
+ *	they may still react.  Ants that moved up out of the
+ *	band this cycle join the layer they reached after
+ *	that, since they have already had their step.  The
+ *	surface layer stays at Nantsurf.
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		ran1, antstep, canhold, growants, absorbants
+ *	Called by:	main
+ ***/
+void continuum(void) {
+  int iz, zb, ix, iy, tries, ihop, nhop, ich;
+  double hops;
 
-    Ntotdiff = nleft;
+  for (iz = 0; iz < Zcont - 1; iz++) {
+    Flux[iz] =
+        Gcross[iz] * (Conc[iz] / Open[iz] - Conc[iz + 1] / Open[iz + 1]);
   }
 
   /***
-   *	Construct name of the plot file
+   *	A sixth of the ants in the last continuum layer try
+   *	to step down into the band, each from a pixel there
+   *	that can hold it, just as the ants in the band step
+   *	up out of it
    ***/
 
-  nlen = strcspn(filein, ".");
-  strncpy(fileroot, filein, nlen);
-  strcpy(exten, &filein[nlen + 4]);
-  strcpy(fplot, fileroot);
-  strcat(fplot, ".cap");
-  strcat(fplot, exten);
+  zb = Zcont - 1;
+  hops = Conc[zb] / 6.0;
+  nhop = (int)hops;
+  if (ran1(Seed) < hops - nhop)
+    nhop++;
+
+  for (ihop = 0; ihop < nhop; ihop++) {
+    ix = iy = 0;
+    for (tries = 0; tries < (int)Layer_volume; tries++) {
+      ix = (int)((float)Xsyssize * ran1(Seed));
+      iy = (int)((float)Ysyssize * ran1(Seed));
+      if (ix >= Xsyssize)
+        ix = Xsyssize - 1;
+      if (iy >= Ysyssize)
+        iy = Ysyssize - 1;
+      if (canhold(Mic[ix][iy][zb], zb))
+        break;
+    }
+    if (tries == (int)Layer_volume)
+      break;
+
+    ich = antstep(zb, ix, iy, Zcont);
+    if (ich != 0)
+      Conc[zb] -= 1.0;
+    if (ich > 0) {
+      growants(Ntotdiff + 1);
+      Ntotdiff++;
+      Xnew[Ntotdiff] = ix;
+      Ynew[Ntotdiff] = iy;
+      Znew[Ntotdiff] = Zcont;
+      Ndiff[Zcont]++;
+    }
+  }
 
-  plotfile = filehandler("chlorattack3d", fplot, "WRITE");
-  if (!plotfile) {
-    freeallmem();
-    exit(1);
+  absorbants();
+
+  for (iz = 0; iz < Zcont - 1; iz++) {
+    Conc[iz] -= Flux[iz];
+    Conc[iz + 1] += Flux[iz];
   }
+  Conc[0] = (double)Nantsurf;
 
-  for (i = 0; i < Zsyssize + 2; i++) {
-    fprintf(plotfile, "%d %d %d %d ", icyc, i, Ndiff[i], Nrettr[i]);
-    fprintf(plotfile, "%d %d %d ", Nrettrc4af[i], Nrafm[i], Nrc3ah6[i]);
-    fprintf(plotfile, "%d %d ", Friedelcount[i], Gypsumcount[i]);
-    fprintf(plotfile, "%d %d ", Ettrorig[i], Ettrc4aforig[i]);
-    fprintf(plotfile, "%d %d ", Afmorig[i], C3ah6orig[i]);
-    fprintf(plotfile, "%d %d ", Friedelorig[i], Gypsumorig[i]);
-    fprintf(plotfile, "%d %d ", Straingyp[i], Strainfriedel[i]);
-    fprintf(plotfile, "%d %d ", Afmcorig[i], Ccorig[i]);
-    fprintf(plotfile, "%d %d ", Nrafmc[i], Nrcap[i]);
-    fprintf(plotfile, "%f %f ", Nrgel[i], Density[i] * MOLEFACTOR);
-    fprintf(plotfile, "%f ", Clreacted[i] * MOLEFACTOR);
-    fprintf(plotfile, "%f\n", Clchemisorb[i] * MOLEFACTOR);
+  for (iz = 0; iz < Zcont; iz++) {
+    if (Conc[iz] < 0.0)
+      Conc[iz] = 0.0;
+    Ndiff[iz] = (int)(Conc[iz] + 0.5);
   }
-  fclose(plotfile);
 
-  /***
-   *	Output the VCCTL version number to
-   *	microstructure file
-   ***/
+  return;
+}
 
-  if (write_imgheader(newmic, Xsyssize, Ysyssize, Zsyssize, Res)) {
-    fclose(newmic);
-    bailout("chlorattack3d", "Error writing image header");
+/***
+ *	absorbants
+ *
+ *	Add the ants above the band to the continuum layers
+ *	they are in
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	advancefront, continuum
+ ***/
+void absorbants(void) {
+  int iant, nleft;
+
+  nleft = 0;
+  for (iant = 1; iant <= Ntotdiff; iant++) {
+    if (Znew[iant] < Zcont) {
+      Conc[Znew[iant]] += 1.0;
+    } else {
+      nleft++;
+      Xnew[nleft] = Xnew[iant];
+      Ynew[nleft] = Ynew[iant];
+      Znew[nleft] = Znew[iant];
+    }
+  }
+  Ntotdiff = nleft;
+
+  return;
+}
+
+/***
+ *	slide
+ *
+ *	For --window, move the window of layers down so that
+ *	it holds every layer the next cycle can touch: from
+ *	WINMARGIN above the continuum, which an ant stepping
+ *	out of the band can reach, to WINMARGIN below the
+ *	deepest ant, or below layer zdeep if that is deeper.
+ *
+ *	Arguments:	int layer that must be held whatever the ants
+ *	Returns:	Nothing
+ *
+ *	Calls:		layerwin_need, freeallmem, bailout
+ *	Called by:	main
+ ***/
+void slide(int zdeep) {
+  int iant;
+
+  for (iant = 1; iant <= Ntotdiff; iant++) {
+    if (Znew[iant] > zdeep)
+      zdeep = Znew[iant];
+  }
+
+  if (layerwin_need(&Win, Zcont - WINMARGIN, zdeep + WINMARGIN)) {
     freeallmem();
+    bailout("chlorattack3d", "Memory allocation error");
     exit(1);
   }
 
-  for (ix = 0; ix < Xsyssize; ix++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      for (iz = 1; iz < Zsyssize + 1; iz++) {
+  return;
+}
 
-        fprintf(newmic, "%d\n", Mic[ix][iy][iz]);
-      }
-    }
+/***
+ *	growants
+ *
+ *	Make room for ants 1 to nants, doubling the ant
+ *	arrays as many times as needed
+ *
+ *	Arguments:	int number of ants
+ *	Returns:	Nothing
+ *
+ *	Calls:		regrow
+ *	Called by:	main, continuum
+ ***/
+void growants(int nants) {
+  size_t newcap;
+
+  if (nants < Antcap)
+    return;
+
+  newcap = 2 * (size_t)Antcap;
+  if (newcap <= (size_t)nants)
+    newcap = (size_t)nants + 1;
+
+  Xnew = (short int *)regrow(Xnew, newcap * sizeof(short int));
+  Ynew = (short int *)regrow(Ynew, newcap * sizeof(short int));
+  Znew = (short int *)regrow(Znew, newcap * sizeof(short int));
+  if (Nthreads > 0) {
+    Xtry = (short int *)regrow(Xtry, newcap * sizeof(short int));
+    Ytry = (short int *)regrow(Ytry, newcap * sizeof(short int));
+    Ztry = (short int *)regrow(Ztry, newcap * sizeof(short int));
+    Antstat = (signed char *)regrow(Antstat, newcap);
+    Antlist = (int *)regrow(Antlist, newcap * sizeof(int));
   }
+  Antcap = (int)newcap;
 
-  fclose(newmic);
+  return;
+}
 
-  freeallmem();
-  return (0);
+/***
+ *	regrow
+ *
+ *	Resize one of the ant arrays, giving up if there
+ *	is not enough memory
+ *
+ *	Arguments:	void pointer to the array, size_t new size
+ *				in bytes
+ *	Returns:	void pointer to the resized array
+ *
+ *	Calls:		freeallmem, bailout
+ *	Called by:	growants
+ ***/
+void *regrow(void *p, size_t size) {
+  void *q;
+
+  q = realloc(p, size);
+  if (!q) {
+    freeallmem();
+    bailout("chlorattack3d", "Memory allocation error");
+    exit(1);
+  }
+
+  return (q);
 }
 
 /***
@@ -1142,8 +1934,10 @@ void extphase(int phtomake, int xcur, int ycur, int zcur) {
  *
  ***/
 void allmem(void) {
-  Mic = sibox(Xsyssize + 2, Ysyssize + 2, Zsyssize + 2);
-  React = sibox(Xsyssize + 2, Ysyssize + 2, Zsyssize + 2);
+  if (!Window) {
+    Mic = sibox(Xsyssize + 2, Ysyssize + 2, Zsyssize + 2);
+    React = sibox(Xsyssize + 2, Ysyssize + 2, Zsyssize + 2);
+  }
   Ndiff = ivector(Zsyssize + 2);
   Nrettr = ivector(Zsyssize + 2);
   Nrettrc4af = ivector(Zsyssize + 2);
@@ -1169,9 +1963,45 @@ void allmem(void) {
   Density = dvector(Zsyssize + 2);
   Clreacted = dvector(Zsyssize + 2);
   Clchemisorb = dvector(Zsyssize + 2);
-  Xnew = sivector(NUMANTS * Isizemag);
-  Ynew = sivector(NUMANTS * Isizemag);
-  Znew = sivector(NUMANTS * Isizemag);
+  Antcap = NUMANTS * Isizemag;
+  if (Antcap < 2)
+    Antcap = 2;
+  Xnew = sivector(Antcap);
+  Ynew = sivector(Antcap);
+  Znew = sivector(Antcap);
+  if (Nthreads > 0) {
+    Antrng = (Rngstate *)malloc(Nthreads * sizeof(Rngstate));
+    Xtry = sivector(Antcap);
+    Ytry = sivector(Antcap);
+    Ztry = sivector(Antcap);
+    Antstat = (signed char *)malloc(Antcap);
+    Antlist = ivector(Antcap);
+    Nbin = ivector(Nthreads * (Zsyssize + 2));
+    Nmove = ivector(3 * Nthreads * (Zsyssize + 2));
+    if (!Antrng || !Xtry || !Ytry || !Ztry || !Antstat || !Antlist || !Nbin ||
+        !Nmove) {
+      freeallmem();
+      bailout("chlorattack3d", "Memory allocation error");
+      exit(1);
+    }
+  }
+  if (Band > 0) {
+    Conc = dvector(Zsyssize + 2);
+    Flux = dvector(Zsyssize + 2);
+    Open = dvector(Zsyssize + 2);
+    Gcross = dvector(Zsyssize + 2);
+    Ndown = (double *)calloc(Zsyssize + 2, sizeof(double));
+    Nup = (double *)calloc(Zsyssize + 2, sizeof(double));
+    Nabove = (double *)calloc(Zsyssize + 2, sizeof(double));
+    Nbelow = (double *)calloc(Zsyssize + 2, sizeof(double));
+    Lastbind = (int *)calloc(Zsyssize + 2, sizeof(int));
+    if (!Conc || !Flux || !Open || !Gcross || !Ndown || !Nup || !Nabove ||
+        !Nbelow || !Lastbind) {
+      freeallmem();
+      bailout("chlorattack3d", "Memory allocation error");
+      exit(1);
+    }
+  }
   if (!Znew || !Ynew || !Xnew || !Clchemisorb || !Clreacted || !Density ||
       !Strainfriedel || !Friedelcount || !Gypsumcount || !Strainettr ||
       !Strainbrucite || !Straingyp || !Nrgel || !Nrcap || !Ccorig ||
@@ -1204,10 +2034,14 @@ void allmem(void) {
  *
  ***/
 void freeallmem(void) {
-  if (Mic)
-    free_sibox(Mic, Xsyssize + 2, Ysyssize + 2);
-  if (React)
-    free_sibox(React, Xsyssize + 2, Ysyssize + 2);
+  if (Window) {
+    layerwin_free(&Win);
+  } else {
+    if (Mic)
+      free_sibox(Mic, Xsyssize + 2, Ysyssize + 2);
+    if (React)
+      free_sibox(React, Xsyssize + 2, Ysyssize + 2);
+  }
   if (Ndiff)
     free_ivector(Ndiff);
   if (Nrettr)
@@ -1260,6 +2094,143 @@ void freeallmem(void) {
     free_sivector(Ynew);
   if (Znew)
     free_sivector(Znew);
+  if (Antrng)
+    free(Antrng);
+  if (Xtry)
+    free_sivector(Xtry);
+  if (Ytry)
+    free_sivector(Ytry);
+  if (Ztry)
+    free_sivector(Ztry);
+  if (Antstat)
+    free(Antstat);
+  if (Antlist)
+    free_ivector(Antlist);
+  if (Nbin)
+    free_ivector(Nbin);
+  if (Nmove)
+    free_ivector(Nmove);
+  if (Conc)
+    free_dvector(Conc);
+  if (Flux)
+    free_dvector(Flux);
+  if (Open)
+    free_dvector(Open);
+  if (Gcross)
+    free_dvector(Gcross);
+  if (Ndown)
+    free(Ndown);
+  if (Nup)
+    free(Nup);
+  if (Nabove)
+    free(Nabove);
+  if (Nbelow)
+    free(Nbelow);
+  if (Lastbind)
+    free(Lastbind);
+
+  return;
+}
+
+/***
+ *	checkargs
+ *
+ *	Read the command line
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"threads", required_argument, 0, 't'},
+                                      {"band", required_argument, 0, 'b'},
+                                      {"handoff", required_argument, 0, 'H'},
+                                      {"window", no_argument, 0, 'W'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  while ((opt_char = getopt_long(argc, argv, "t:b:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -t or --threads */
+    case (int)('t'):
+      Nthreads = atoi(optarg);
+      if (Nthreads < 1)
+        Nthreads = 1;
+      break;
+    /* -b or --band */
+    case (int)('b'):
+      Band = atoi(optarg);
+      if (Band < 1)
+        return (1);
+      break;
+    /* --handoff */
+    case (int)('H'):
+      strcpy(Handoffname, optarg);
+      break;
+    /* --window */
+    case (int)('W'):
+      Window = 1;
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (optind != argc)
+    return (1);
+
+  /* The window reads its layers from an image file */
+
+  if (Window && strlen(Handoffname) > 0)
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ *	Arguments:	none
+ *	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: chlorattack3d [-t,--threads <n>] "
+                  "[-b,--band <layers>]\n"
+                  "                     [--handoff <name>] [--window]\n\n");
+  fprintf(stderr, "  --threads  move all the ants at once each cycle, with "
+                  "n threads\n");
+  fprintf(stderr, "             (default: one ant at a time)\n");
+  fprintf(stderr, "  --band     keep ants only within this many layers "
+                  "above the\n");
+  fprintf(stderr, "             reaction front and below it, and solve the "
+                  "layers\n");
+  fprintf(stderr, "             behind it as a continuum (default: ants "
+                  "everywhere)\n");
+  fprintf(stderr, "  --handoff  read the input microstructure that "
+                  "disrealnew\n");
+  fprintf(stderr, "             --handoff-out name left in shared memory, "
+                  "in place\n");
+  fprintf(stderr, "             of the input file (not on Windows)\n");
+  fprintf(stderr, "  --window   hold only the layers the ants can reach "
+                  "in memory,\n");
+  fprintf(stderr, "             reading them from a raw binary input "
+                  "image and\n");
+  fprintf(stderr, "             writing a raw binary output image, for "
+                  "specimens\n");
+  fprintf(stderr, "             too deep to hold (not with --handoff, "
+                  "not on\n");
+  fprintf(stderr, "             Windows)\n");
+  fprintf(stderr, "The rest of the input is read from the prompts.\n\n");
 
   return;
 }
@@ -0,0 +1,322 @@
+/*****************************************************
+ *
+ * Program corr3d.c
+ *
+ * Reads in a 3-D image and outputs, for a phase (or a
+ * set of phases taken together)
+ *
+ * 	(1) the two-point correlation function S2(r), as a
+ * 	    correlation file that genmic reads for rand3d
+ * 	(2) the chord-length distribution and lineal path
+ * 	    along the three axes
+ *
+ * Both may be taken within a domain, such as the clinker
+ * solids, so that a correlation file can be measured from
+ * a real image and used to calibrate genmic.  S2(r) comes
+ * from FFTs of the image (see twopoint in vcctllib), so it
+ * costs O(N log N) for N voxels.
+ *
+ *******************************************************/
+#include "include/vcctl.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***
+ *	Global variables
+ ***/
+float Version;
+int Nthreads = 0;
+int Rmax = 0;
+unsigned char Inphase[CENSUSIDS], Indomain[CENSUSIDS];
+int Usedomain = 0;
+char Imgname[MAXSTRING], Corrname[MAXSTRING], Chordname[MAXSTRING];
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+int readids(char *list, unsigned char *isin);
+void printHelp(void);
+
+int main(int argc, char *argv[]) {
+  int r, xsize, ysize, zsize, mindim, maxlen, nphase, ndomain;
+  size_t n, nvox, cap = 0;
+  float res;
+  double *s2, *nchord, *lineal, nsum, lsum;
+  unsigned char *vox = NULL, *in, *dom;
+  FILE *infile, *outfile;
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    exit(1);
+  }
+
+  infile = filehandler("corr3d", Imgname, "READ");
+  if (!infile) {
+    exit(1);
+  }
+
+  if (load_microstructure(infile, &vox, &cap, &Version, &xsize, &ysize,
+                          &zsize, &res)) {
+    fclose(infile);
+    if (vox)
+      free(vox);
+    bailout("corr3d", "Error reading microstructure image");
+    exit(1);
+  }
+  fclose(infile);
+
+  /***
+   *	Make the phase and domain masks.  The phase is kept
+   *	inside the domain.
+   ***/
+
+  nvox = (size_t)xsize * ysize * zsize;
+  in = (unsigned char *)malloc(nvox);
+  dom = Usedomain ? (unsigned char *)malloc(nvox) : NULL;
+  if (!in || (Usedomain && !dom)) {
+    free(vox);
+    bailout("corr3d", "Memory allocation failure");
+    exit(1);
+  }
+
+  nphase = ndomain = 0;
+  for (n = 0; n < nvox; n++) {
+    in[n] = Inphase[vox[n]];
+    if (Usedomain) {
+      dom[n] = Indomain[vox[n]];
+      in[n] &= dom[n];
+      ndomain += dom[n];
+    }
+    nphase += in[n];
+  }
+  free(vox);
+  if (!Usedomain)
+    ndomain = (int)nvox;
+
+  mindim = xsize;
+  if (ysize < mindim)
+    mindim = ysize;
+  if (zsize < mindim)
+    mindim = zsize;
+  if (Rmax <= 0 || Rmax > mindim / 2)
+    Rmax = mindim / 2;
+
+  maxlen = xsize;
+  if (ysize > maxlen)
+    maxlen = ysize;
+  if (zsize > maxlen)
+    maxlen = zsize;
+
+  printf("Phase voxels: %d of %d in the domain\n", nphase, ndomain);
+
+  if (Corrname[0]) {
+    s2 = (double *)malloc(((size_t)Rmax + 1) * sizeof(double));
+    if (!s2 || twopoint(in, dom, xsize, ysize, zsize, Rmax, s2, Nthreads)) {
+      bailout("corr3d", "Memory allocation failure");
+      exit(1);
+    }
+
+    /***
+     *	Same layout rand3d reads: the resolution, the number
+     *	of points, then the distance (in units of that
+     *	resolution) and S2 at each one
+     ***/
+
+    outfile = filehandler("corr3d", Corrname, "WRITE");
+    if (!outfile) {
+      exit(1);
+    }
+    fprintf(outfile, "Resolution: %.2f\n", res);
+    fprintf(outfile, "%d\n", Rmax + 1);
+    for (r = 0; r <= Rmax; r++) {
+      fprintf(outfile, "%d %f\n", r, s2[r]);
+    }
+    fclose(outfile);
+    free(s2);
+  }
+
+  if (Chordname[0]) {
+    nchord = (double *)malloc(2 * ((size_t)maxlen + 1) * sizeof(double));
+    if (!nchord) {
+      bailout("corr3d", "Memory allocation failure");
+      exit(1);
+    }
+    lineal = nchord + maxlen + 1;
+    if (chords(in, dom, xsize, ysize, zsize, maxlen, nchord, lineal)) {
+      bailout("corr3d", "Memory allocation failure");
+      exit(1);
+    }
+
+    nsum = lsum = 0.0;
+    for (r = 1; r <= maxlen; r++) {
+      nsum += nchord[r];
+      lsum += nchord[r] * r;
+    }
+
+    outfile = filehandler("corr3d", Chordname, "WRITE");
+    if (!outfile) {
+      exit(1);
+    }
+    fprintf(outfile, "Number of chords = %.0f", nsum);
+    fprintf(outfile, "\nMean chord length = %f um",
+            (nsum > 0.0) ? res * lsum / nsum : 0.0);
+    fprintf(outfile, "\n\nLength_(um)\tNumber\tFraction\tLineal_path");
+    for (r = 1; r <= maxlen; r++) {
+      fprintf(outfile, "\n%f\t%.0f\t%f\t%f", res * r, nchord[r],
+              (nsum > 0.0) ? nchord[r] / nsum : 0.0, lineal[r]);
+    }
+    fprintf(outfile, "\n");
+    fclose(outfile);
+    free(nchord);
+  }
+
+  free(in);
+  if (dom)
+    free(dom);
+
+  return (0);
+}
+
+/***
+ *	readids
+ *
+ *	Mark the phase ids in a comma-separated list
+ *
+ * 	Arguments:	char pointer to the list
+ * 				unsigned char pointer to CENSUSIDS flags
+ * 	Returns:	0 if okay, 1 if an id is not a phase id
+ *
+ *	Calls:		no routines
+ *	Called by:	checkargs
+ ***/
+int readids(char *list, unsigned char *isin) {
+  int id;
+  char *p, *end;
+
+  memset(isin, 0, CENSUSIDS);
+  p = list;
+  while (*p) {
+    id = (int)strtol(p, &end, 10);
+    if (end == p || id < 0 || id >= CENSUSIDS)
+      return (1);
+    isin[id] = 1;
+    p = end;
+    if (*p == ',')
+      p++;
+    else if (*p)
+      return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	checkargs
+ *
+ *	Read the command line
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		readids
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index, havephase;
+
+  static struct option long_opts[] = {
+      {"phases", required_argument, 0, 'p'},
+      {"domain", required_argument, 0, 'd'},
+      {"rmax", required_argument, 0, 'r'},
+      {"corr", required_argument, 0, 'o'},
+      {"chords", required_argument, 0, 'c'},
+      {"threads", required_argument, 0, 't'},
+      {"help", no_argument, 0, 'h'},
+      {NULL, 0, 0, 0}};
+
+  havephase = 0;
+  Corrname[0] = Chordname[0] = '\0';
+
+  Nthreads = thread_default(Nthreads);
+
+  while ((opt_char = getopt_long(argc, argv, "p:d:r:o:c:t:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -p or --phases */
+    case (int)('p'):
+      if (readids(optarg, Inphase))
+        return (1);
+      havephase = 1;
+      break;
+    /* -d or --domain */
+    case (int)('d'):
+      if (readids(optarg, Indomain))
+        return (1);
+      Usedomain = 1;
+      break;
+    /* -r or --rmax */
+    case (int)('r'):
+      Rmax = atoi(optarg);
+      break;
+    /* -o or --corr */
+    case (int)('o'):
+      snprintf(Corrname, sizeof(Corrname), "%s", optarg);
+      break;
+    /* -c or --chords */
+    case (int)('c'):
+      snprintf(Chordname, sizeof(Chordname), "%s", optarg);
+      break;
+    /* -t or --threads */
+    case (int)('t'):
+      Nthreads = atoi(optarg);
+      if (Nthreads < 1)
+        Nthreads = 1;
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (!havephase || optind != argc - 1 || (!Corrname[0] && !Chordname[0]))
+    return (1);
+
+  snprintf(Imgname, sizeof(Imgname), "%s", argv[optind]);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ *	Arguments:	none
+ *	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: corr3d -p,--phases <ids> [-d,--domain <ids>]\n");
+  fprintf(stderr, "              [-o,--corr <file>] [-c,--chords <file>]\n");
+  fprintf(stderr, "              [-r,--rmax <n>] [-t,--threads <n>] <image>\n\n");
+  fprintf(stderr, "  --phases   comma-separated phase ids taken as the phase\n");
+  fprintf(stderr, "  --domain   comma-separated phase ids the statistics are\n");
+  fprintf(stderr, "             taken within (default: the whole image)\n");
+  fprintf(stderr, "  --corr     write S2(r) as a correlation file for genmic\n");
+  fprintf(stderr, "  --chords   write the chord-length distribution and "
+                  "lineal path\n");
+  fprintf(stderr, "  --rmax     largest distance for S2, in voxels (default "
+                  "and\n");
+  fprintf(stderr, "             limit: half the smallest dimension)\n");
+  fprintf(stderr, "  --threads  threads for the FFT (default VCCTL_THREADS, "
+                  "or 1)\n\n");
+  fprintf(stderr, "For example, the silicate file of a clinker image:\n");
+  fprintf(stderr, "  corr3d -p 1,2 -d 1,2,3,4,5,6 -o cem.sil cem.img\n\n");
+
+  return;
+}
@@ -95,28 +95,61 @@ int initialize_output_files(void);
 void manage_deactivation_behavior(void);
 void performdeactivation(int pid, float fracdeact);
 void performreactivation(int pid, float fracreact, int finalreact);
-int chckedge(int phase, int xck, int yck, int zck);
+int listdeact(long n, int x, int y, int z);
+int finddeact(void);
+void refreshhalo(void);
+void mirrormic(int x, int y, int z);
+Edgerowfn edgerowpick(int nbrs);
 void resetcrackpores(void);
+int setblocks(void);
+int partedgebuild(void);
+int layerbuild(void);
+int alkreset(Nodepool *pool, struct Alksulf **head, struct Alksulf **tail);
+void clearsurf(void);
+void marksurf(int x, int y, int z);
+int nextsurf(long *pos, int *x, int *y, int *z);
+int nextsurfto(long *pos, long end, int *x, int *y, int *z);
+int cshagecode(int cycle);
+int cshagecycle(int code);
 void passone(int low, int high, int cycid, int cshexflag);
 int countphase(int phid);
 int loccsh(int xcur, int ycur, int zcur, int sourcepore);
+int loccshscan(int xcur, int ycur, int zcur, int sourcepore, int span,
+               int pick, int *xfound, int *yfound, int *zfound);
 int countbox(int boxsize, int qx, int qy, int qz);
 void makeinert(int ndesire);
 void extslagcsh(int xpres, int ypres, int zpres);
+void randslagcsh(void);
+int slabant(int x, int y, int z, int id, int cycbirth);
+void dissolvesite(int xl, int yl, int zl, float pc3scsh, float pc2scsh,
+                  struct Disscount *dc);
+void dissolveslab(int is, float pc3scsh, float pc2scsh,
+                  struct Slabtally *start);
+void dissolvesweep(int color, int ncol, float pc3scsh, float pc2scsh,
+                   struct Disscount *dc);
 void dissolve(int cycle);
 void addrand(int randid, int nneed, int onepixfloc);
 void addcrack();
+void partlost(int x, int y, int z);
 void addseeds(int phid, float prob);
 void calcT(double mass);
 void measuresurf(void);
 void findnewtime(float dval, float act_nrg, float *previousUncorrectedTime,
                  char *typestring);
 void createfittocycles(void);
+int hydinit(int argc, char *argv[]);
+int hydrunning(void);
+void hydcycle(void);
+int hydfinish(void);
+void hydfree(void);
 void freeallmem(void);
+void coarsenstatics(void);
+int adaptquiet(void);
+int insiturun(struct Snapimg *img);
 char *rfc8601_timespec(struct timespec *tv);
 
 /***
- *    Temperature profile file-scope variables (used by get_input() and main())
+ *    Temperature profile file-scope variables (used by get_input() and hydcycle())
  ***/
 static FILE *thfile = NULL;
 static float thtimelo = 0.0, thtimehi = 0.0, thtemplo = 0.0, thtemphi = 0.0;
@@ -124,34 +157,61 @@ static float thtimelo = 0.0, thtimehi = 0.0, thtemplo = 0.0, thtemphi = 0.0;
 /***
  *    Supplementary programs
  ***/
+#include "include/perfstats.h"  /* per-cycle timings and counts */
+#include "include/outstream.h"  /* buffered per-cycle output files */
+#include "include/antpool.h"    /* pool of diffusing species */
+#include "include/antslab.h"    /* slab-parallel diffusion */
+#include "include/bitplane.h"   /* bit planes of phase classes */
 #include "include/burn3d.h"     /* percolation of porosity assessment */
 #include "include/burnset.h"    /* set point assessment */
 #include "include/hydrealnew.h" /* hydration execution */
 #include "include/pHpred.h"     /* pore solution pH prediction */
 #include "include/parthyd.h"    /* particle hydration assessment */
+#include "include/snapshot.h"   /* background image writer */
+#include "include/insitu.h"     /* analyses at chosen ages */
+#include "include/solidlayer.h" /* solids apart from diffusing species */
+#include "include/progstream.h" /* streaming progress records */
+#include "include/liveview.h"   /* shared memory view for the UI */
+#include "include/checkpoint.h" /* checkpoint and restart */
+#include "include/ondemand.h"   /* images and status on request */
+#include "include/ensemble.h"   /* ensembles of seeds */
+#include "include/parambundle.h" /* bundle of text inputs */
+#include "include/coarsen.h"     /* coarse grid for late ages */
+#include "include/leangrids.h"   /* grids only for the features used */
 
-int main(int argc, char *argv[]) {
-  int ntimes, valin, nmovstep;
-  int cycflag, ix, iy, iz;
-  int pixtmp, i, j, k;
-  int customentry;
-  float pnucch, pscalech, pnuchg, pscalehg, pnucfh3, pscalefh3;
-  float psfact, betfact, pnucgyp, pscalegyp;
-  float kslag;
-  float act_nrg, recip_Tdiff, tmod, smod;
-  float dval, previousUncorrectedTime;
-  double gfloat, space, mass_cement, mass_cem_now, mass_cur, kpozz;
-  double time_spent;
-  char typestring[MAXSTRING];
-  char strsuff[MAXSTRING], strsuffa[MAXSTRING], strsuffb[MAXSTRING];
-  char buff[MAXSTRING], buff1[MAXSTRING], instring[MAXSTRING];
-  char commachar;
-  char *rfc8601, *name, *newstring;
+/***
+ *    State carried from one stage of a run to the next (see hydinit,
+ *    hydcycle and hydfinish)
+ ***/
+static int ntimes, nmovstep, cycflag, customentry, burnflag[3];
+static float pnucch, pscalech, pnuchg, pscalehg, pnucfh3, pscalefh3;
+static float pnucgyp, pscalegyp;
+static float act_nrg, previousUncorrectedTime;
+static clock_t begin;
+
+#ifdef VCCTL_HYDLIB
+#include "include/hydlib.h" /* library entry points, after the state */
+#endif
+
+/***
+ *    hydinit
+ *
+ *     Read the command line and the parameter file, load the
+ *     microstructure and set up everything needed before the
+ *     first cycle
+ *
+ *     Arguments:    int argc, char *argv[] (see checkargs)
+ *     Returns:    0 if okay, nonzero otherwise
+ *
+ *    Calls:        checkargs, get_input, init, readcheckpoint, ...
+ *    Called by:    main program, hyd_open
+ ***/
+int hydinit(int argc, char *argv[]) {
+  int ix;
+  float psfact, betfact, kslag, recip_Tdiff;
+  double kpozz;
   time_t current_time;
-  clock_t begin, end;
   struct tm *local_time;
-  struct timespec tv;
-  FILE *outfile;
 
   /* Get the simulation start time */
 
@@ -187,8 +247,6 @@ int main(int argc, char *argv[]) {
     FitpH[ix][1][2] = 0.0;
   }
 
-  Antsize = sizeof(struct Ants);
-  Togosize = sizeof(struct Togo);
   Alksulfsize = sizeof(struct Alksulf);
 
   cycflag = 0;
@@ -197,8 +255,15 @@ int main(int argc, char *argv[]) {
     return (1);
   }
 
-  /* Open the log file and keep it open throughout */
-  if ((Logfile = fopen(LogFileName, "w")) == NULL) {
+  /***
+   *    Open the log file and keep it open throughout.  In an
+   *    MPI run only rank 0 writes the log of the setup, which
+   *    every rank repeats; each member then has its own.
+   ***/
+
+  Logfile =
+      log_attach((Mpirank > 0) ? tmpfile() : fopen(LogFileName, "w"));
+  if (Logfile == NULL) {
     fprintf(stderr, "\nERROR:  Could not open %s\n\n", LogFileName);
     exit(1);
   }
@@ -206,7 +271,9 @@ int main(int argc, char *argv[]) {
   /* Display the local time in the log */
   fprintf(Logfile, "=== BEGIN DISREALNEW SIMULATION ===");
   fprintf(Logfile, "\nStart time: %s", asctime(local_time));
-  fflush(Logfile);
+  log_flush(Logfile);
+
+  bundleload();
 
   if (get_input(&pnucch, &pscalech, &pnuchg, &pscalehg, &pnucfh3, &pscalefh3,
                 &pnucgyp, &pscalegyp, &nmovstep)) {
@@ -218,6 +285,35 @@ int main(int argc, char *argv[]) {
 
   init();
 
+  if (Mpirank == 0)
+    bundlesave();
+
+  /***
+   *    Everything read so far is shared by the members of an
+   *    ensemble, which go on from here in processes of their own
+   ***/
+
+  if (Ensnum > 0) {
+#if !defined(_WIN32) && !defined(VCCTL_HYDLIB)
+    if (Mpirank == 0)
+      initialize_output_files();
+    switch ((Mpisize > 1) ? ensmpi() : ensfork()) {
+    case 0:
+      break;
+    case 1:
+      return (ENSDONE);
+    default:
+      freeallmem();
+      bailout("disrealnew", "Could not run the ensemble");
+      exit(1);
+    }
+#else
+    freeallmem();
+    bailout("disrealnew", "Ensembles cannot be run in this build");
+    exit(1);
+#endif
+  }
+
   /***
    *    Set up names for output files, and
    *    print headers where necessary
@@ -225,7 +321,7 @@ int main(int argc, char *argv[]) {
 
   /* GODZILLA */
   // fprintf(Logfile, "\nInitializing output files...");
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
 
   if (initialize_output_files()) {
@@ -234,6 +330,30 @@ int main(int argc, char *argv[]) {
     exit(1);
   }
 
+  if (perfopen()) {
+    freeallmem();
+    bailout("disrealnew", "Could not open timing table");
+    exit(1);
+  }
+
+  if (Tracename[0] != '\0') {
+    ix = trace_open(Tracename, "disrealnew", Antthreads, Tracecounters);
+    if (ix == 1) {
+      freeallmem();
+      bailout("disrealnew", "Could not open trace file");
+      exit(1);
+    }
+    if (ix == 2)
+      fprintf(Logfile, "\nHardware counters are not available here; "
+                       "the trace has timings only");
+  }
+
+  if (streamopen()) {
+    freeallmem();
+    bailout("disrealnew", "Could not open progress stream");
+    exit(1);
+  }
+
   /***
    *    Krate is the rate constant relative to 298.15 K
    *    E_act must be given here in kJ/mole/K
@@ -325,15 +445,33 @@ int main(int argc, char *argv[]) {
     fflush(stderr);
   }
 
+  /* Blocks of aggregate that the whole-box scans can skip */
+
+  if (setblocks()) {
+    freeallmem();
+    bailout("disrealnew", "Could not allocate memory for Blockinert");
+    exit(1);
+  }
+
   /* Add CSH one-pixel particles randomly throughout the pore solution */
 
   addseeds(CSH, PCSHseednuc);
 
+  /* Copies of Mic kept with --solid-layer and --bit-planes */
+
+  if (layerbuild()) {
+    freeallmem();
+    bailout("disrealnew", "Could not allocate memory for layers of Mic");
+    exit(1);
+  }
+
   /***
    *    Initial surface counts of cement
    ***/
 
+  perfbegin(PERFMEASURESURF);
   measuresurf();
+  perfend(PERFMEASURESURF);
 
   /***
    *    This is the MAIN loop over hydration cycles
@@ -349,1062 +487,1108 @@ int main(int argc, char *argv[]) {
   customentry = 0;
   previousUncorrectedTime = 0.0;
 
-  for (Icyc = 1;
-       ((Icyc <= Ncyc) && (Alpha_cur < Alpha_max) && (Time_cur < End_time));
-       Icyc++) {
+  /***
+   *    The directions of moveone for --fast-moves come from a
+   *    stream seeded with the main one, so each member of an
+   *    ensemble gets its own
+   ***/
 
-    if (Verbose_flag > 1) {
-      fprintf(Logfile, "\nCycle %d", Icyc);
-      fprintf(Logfile, "\nBinder Temp = %f", Temp_cur_b);
-      if (Mass_agg > 0.0) {
-        fprintf(Logfile, "; Aggregate Temp = %f", Temp_cur_agg);
-      } else {
-        Temp_cur_agg = Temp_cur_b;
-      }
-    }
+  rng_seed(&(Mainmoves.st), (uint64_t)(unsigned int)(*Seed));
+  Mainmoves.pos = MOVEBUFSIZE;
+  Curmoves = &Mainmoves;
 
-    /***
-     *    Handle deactivation of surfaces if necessary
-     ***/
+  /* Pick up an interrupted run where its checkpoint left off */
 
-    if (Numdeact > 0) {
-      manage_deactivation_behavior();
+  if (strlen(Restartname) > 0) {
+    if (readcheckpoint(&customentry, &previousUncorrectedTime)) {
+      freeallmem();
+      bailout("disrealnew", "Could not restart from checkpoint");
+      exit(1);
     }
-
-    if (Temp_cur_b <= 80.0) { /* T units in deg C */
-
-      tmod = (Temp_cur_b - 20.0) / (80.0 - 20.0);
-
-    } else {
-
-      tmod = 1.0;
+    if (Coarsefact > 1)
+      coarsenstatics();
+    if (setblocks()) {
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for Blockinert");
+      exit(1);
+    }
+    if (layerbuild()) {
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for layers of Mic");
+      exit(1);
     }
+  }
 
-    Molarvcsh[Icyc] = Molarv[CSH] + (Molarvcshcoeff_T * tmod);
-    Watercsh[Icyc] = Waterc[CSH] + (Watercshcoeff_T * tmod);
+  if (liveopen()) {
+    fprintf(Logfile, "\nWARNING: Could not make the live view %s",
+            Livename);
+    log_flush(Logfile);
+  }
 
-    if (Icyc == Ncyc || Alpha_cur >= Alpha_max || Time_cur >= End_time)
-      cycflag = 1;
+  streamstart();
+  demandinit();
 
-    /***
-     *    Dissolve necessary pixels and form
-     *    ants for diffusion
-     ***/
+  Icyc = Icycstart;
 
-    dissolve(Icyc);
+  return (0);
+}
 
-    /***
-     *  Calculate volume ratio of sulfates to C3A on first cycle only
-     *  This must be done after dissolve because only then are the initial
-     *  counts of each phase available
-     ***/
+/***
+ *    hydrunning
+ *
+ *     Whether the run has more cycles to go
+ *
+ *     Arguments:    None
+ *     Returns:    1 if another cycle is due, 0 otherwise
+ *
+ *    Calls:        No other routines
+ *    Called by:    main program, hyd_step
+ ***/
+int hydrunning(void) {
+  return ((Icyc <= Ncyc) && (Alpha_cur < Alpha_max) && (Time_cur < End_time));
+}
 
-    if (Icyc == 1) {
-      SulftoC3A =
-          ((float)(Ncsbar + Heminit + Anhinit)) / ((float)(C3ainit + Oc3ainit));
-      if (SulftoC3A <= 0.8) {
-        smod = 0.0;
-      } else if (SulftoC3A <= 1.25) {
-        smod = (SulftoC3A - 0.8) / (1.25 - 0.8);
-      } else {
-        smod = 1.0;
-      }
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "\n\n\n******SulftoC3A = %f", SulftoC3A);
-        fprintf(Logfile, "\n******Just changed Molarvcsh from %f ",
-                Molarv[CSH]);
-      }
-      Molarv[CSH] += (Molarvcshcoeff_sulf * smod);
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "to %f ***************\n\n", Molarv[CSH]);
-      }
-    }
+/***
+ *    hydcycle
+ *
+ *     Carry out one hydration cycle and write its output
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        dissolve, hydrate, pHpred, burn3d, burnset, ...
+ *    Called by:    main program, hyd_step
+ ***/
+void hydcycle(void) {
+  int ix, iy, iz;
+  int movnx, movny, movslice, cf;
+  float kslag, psfact, betfact, recip_Tdiff, tmod, smod, dval;
+  double space, mass_cement, mass_cem_now, mass_cur, kpozz;
+  char typestring[MAXSTRING];
+  char strsuff[MAXSTRING], strsuffa[MAXSTRING], strsuffb[MAXSTRING];
+  char buff1[MAXSTRING];
+  char *rfc8601, *name, *newstring;
+  struct timespec tv;
 
-    if (Verbose_flag > 1) {
-      fprintf(Logfile, "\nNumber dissolved this pass- %d ", Nmade);
-      fprintf(Logfile, "total diffusing- %d", Ngoing);
+  perfbegin(PERFCYCLE);
 
-      if (Icyc == 1) {
-        fprintf(Logfile, "\nNcsbar is %d   Netbar is %d", Ncsbar, Netbar);
-      }
-      fflush(Logfile);
+  if (Verbose_flag > 1) {
+    fprintf(Logfile, "\nCycle %d", Icyc);
+    fprintf(Logfile, "\nBinder Temp = %f", Temp_cur_b);
+    if (Mass_agg > 0.0) {
+      fprintf(Logfile, "; Aggregate Temp = %f", Temp_cur_agg);
+    } else {
+      Temp_cur_agg = Temp_cur_b;
     }
+  }
 
-    hydrate(cycflag, ntimes, pnucch, pscalech, pnuchg, pscalehg, pnucfh3,
-            pscalefh3, pnucgyp, pscalegyp);
-
-    /* Cement + aggregate +water + filler=1;  that's all there is */
-
-    mass_cement = 1.0 - (Mass_agg + Mass_fill + Mass_water + Mass_CH);
-    mass_cem_now = mass_cement;
+  /***
+   *    Handle deactivation of surfaces if necessary
+   ***/
 
-    /***
-     *    Handle adiabatic case first
-     ***/
+  if (Numdeact > 0) {
+    manage_deactivation_behavior();
+  }
 
-    if (Adiaflag == 1) {
+  if (Temp_cur_b <= 80.0) { /* T units in deg C */
 
-      /***
-       *    Determine heat capacity of current mixture,
-       *    accounting for imbibed water if necessary
-       ***/
+    tmod = (Temp_cur_b - 20.0) / (80.0 - 20.0);
 
-      if (Sealed == 1) {
+  } else {
 
-        /* Accounting for aggregate separately (15 Nov 2004) */
+    tmod = 1.0;
+  }
 
-        Cp_b = Cp_pozz * Mass_fill;
-        Cp_b += Cp_cement * mass_cement;
-        Cp_b += Cp_ch * Mass_CH;
+  Molarvcsh[Icyc] = Molarv[CSH] + (Molarvcshcoeff_T * tmod);
+  Watercsh[Icyc] = Waterc[CSH] + (Watercshcoeff_T * tmod);
 
-        Cp_b += (Cp_h2o * Mass_water) -
-                (Alpha_cur * WN * mass_cement * (Cp_h2o - Cp_bh2o));
-        if (AggTempEffect == 0)
-          Cp_b += (Cp_agg * Mass_agg);
+  if (Icyc == Ncyc || Alpha_cur >= Alpha_max || Time_cur >= End_time)
+    cycflag = 1;
 
-        mass_cem_now = mass_cement;
+  /***
+   *    Dissolve necessary pixels and form
+   *    ants for diffusion
+   ***/
 
-      } else {
+  perfbegin(PERFDISSOLVE);
+  dissolve(Icyc);
+  perfend(PERFDISSOLVE);
 
-        /***
-         *    If not sealed, need to account for extra capillary
-         *    water drawn in.
-         *
-         *    Basis is WCHSH(0.06) g H2O per gram cement for
-         *    chemical shrinkage
-         *
-         *    Need to adjust mass basis to account for extra
-         *    imbibed H2O
-         ***/
+  /***
+   *  Calculate volume ratio of sulfates to C3A on first cycle only
+   *  This must be done after dissolve because only then are the initial
+   *  counts of each phase available
+   ***/
 
-        mass_cur = 1.0 + (WCHSH * mass_cement * Alpha_cur);
+  if (Icyc == 1) {
+    SulftoC3A =
+        ((float)(Ncsbar + Heminit + Anhinit)) / ((float)(C3ainit + Oc3ainit));
+    if (SulftoC3A <= 0.8) {
+      smod = 0.0;
+    } else if (SulftoC3A <= 1.25) {
+      smod = (SulftoC3A - 0.8) / (1.25 - 0.8);
+    } else {
+      smod = 1.0;
+    }
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, "\n\n\n******SulftoC3A = %f", SulftoC3A);
+      fprintf(Logfile, "\n******Just changed Molarvcsh from %f ",
+              Molarv[CSH]);
+    }
+    Molarv[CSH] += (Molarvcshcoeff_sulf * smod);
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, "to %f ***************\n\n", Molarv[CSH]);
+    }
+  }
 
-        /* Accounting for aggregate separately (15 Nov 2004) */
+  if (Verbose_flag > 1) {
+    fprintf(Logfile, "\nNumber dissolved this pass- %d ", Nmade);
+    fprintf(Logfile, "total diffusing- %d", Ngoing);
 
-        Cp_b = Cp_pozz * Mass_fill / mass_cur;
-        Cp_b += (Cp_cement * mass_cement / mass_cur);
-        Cp_b += (Cp_ch * Mass_CH / mass_cur);
+    if (Icyc == 1) {
+      fprintf(Logfile, "\nNcsbar is %d   Netbar is %d", Ncsbar, Netbar);
+    }
+    log_flush(Logfile);
+  }
 
-        Cp_b += (Cp_h2o * Mass_water) -
-                (Alpha_cur * WN * mass_cement * (Cp_h2o - Cp_bh2o));
+  perfbegin(PERFHYDRATE);
+  hydrate(cycflag, ntimes, pnucch, pscalech, pnuchg, pscalehg, pnucfh3,
+          pscalefh3, pnucgyp, pscalegyp);
+  perfend(PERFHYDRATE);
 
-        Cp_b += (WCHSH * Cp_h2o * Alpha_cur * mass_cement);
-        if (AggTempEffect == 0)
-          Cp_b += ((Cp_agg * Mass_agg) / mass_cur);
+  /* Cement + aggregate +water + filler=1;  that's all there is */
 
-        mass_cem_now = mass_cement / mass_cur;
-      }
+  mass_cement = 1.0 - (Mass_agg + Mass_fill + Mass_water + Mass_CH);
+  mass_cem_now = mass_cement;
 
-      /***
-       *    Determine rate constant based on Arrhenius expression
-       *
-       *    Recall that Temp_cur_b is in degrees Celsius
-       *
-       *    1000.0 converts kJ to J
-       *    8.314 is the gas constant in SI units
-       *    273.15 adds to T to convert from C to K
-       *    298.15 is the reference temperature (in K) to which
-       *        all other temperatures are compared when computing
-       *        changes in rate constants due to thermal activation
-       ***/
+  /***
+   *    Handle adiabatic case first
+   ***/
 
-      act_nrg = 1000.0 * E_act / 8.314;
-      recip_Tdiff = (1.0 / (Temp_cur_b + 273.15)) - (1.0 / 298.15);
-      Krate = exp(-(act_nrg * recip_Tdiff));
+  if (Adiaflag == 1) {
 
-      /* Calculate pozzolanic and slag reaction rate constant */
+    /***
+     *    Determine heat capacity of current mixture,
+     *    accounting for imbibed water if necessary
+     ***/
 
-      act_nrg = 1000.0 * E_act_pozz / 8.314;
-      kpozz = exp(-(act_nrg * recip_Tdiff));
-      act_nrg = 1000.0 * E_act_slag / 8.314;
-      kslag = exp(-(act_nrg * recip_Tdiff));
+    if (Sealed == 1) {
 
-      /***
-       *    Modify silica fume probabilities.  There are
-       *    two effects postulated:
-       *    1. Early age effect due to nucleating capability
-       *       of silica fume with high BET values
-       *    2. Later age pozzolanic reactivity due to
-       *       SiO2 content of the silica fume (Psfume)
-       ***/
+      /* Accounting for aggregate separately (15 Nov 2004) */
 
-      /** Late age effect dictated by Psfume **/
-      /** Psfume is for converting DIFFCH to POZZCSH **/
+      Cp_b = Cp_pozz * Mass_fill;
+      Cp_b += Cp_cement * mass_cement;
+      Cp_b += Cp_ch * Mass_CH;
 
-      Psfume = PSFUME * (kpozz / Krate);
-      psfact = (SF_SiO2_val) / (SF_SiO2_normal);
-      betfact = (SF_BET_val) / (SF_BET_normal);
-      Psfume *= (3.0 * psfact * psfact * betfact);
-      if (Psfume > 1.0)
-        Psfume = 1.0;
-      LOI_factor = 25.0 * (SF_LOI_val / SF_LOI_normal);
-      if (LOI_factor < 1.0)
-        LOI_factor = 1.0;
+      Cp_b += (Cp_h2o * Mass_water) -
+              (Alpha_cur * WN * mass_cement * (Cp_h2o - Cp_bh2o));
+      if (AggTempEffect == 0)
+        Cp_b += (Cp_agg * Mass_agg);
 
-      /***
-       *    Modify probability of pozzolanic and slag
-       *    reactions based on ratio of pozzolanic (slag)
-       *    reaction rate to the hydration rate
-       ***/
+      mass_cem_now = mass_cement;
 
-      Pamsil = PAMSIL * (kpozz / Krate);
-      Disprob[ASG] = Disbase[ASG] * (kpozz / Krate);
-      Disprob[CAS2] = Disbase[CAS2] * (kpozz / Krate);
-      Disprob[SLAG] = Slagreact * Disbase[SLAG] * (kslag / Krate);
+    } else {
 
       /***
-       *    Update temperature based on heat generated
-       *    and current Cp
+       *    If not sealed, need to account for extra capillary
+       *    water drawn in.
+       *
+       *    Basis is WCHSH(0.06) g H2O per gram cement for
+       *    chemical shrinkage
+       *
+       *    Need to adjust mass basis to account for extra
+       *    imbibed H2O
        ***/
 
-      if (mass_cem_now > 0.01) {
-
-        /***
-         *     If the temperature of the aggregate is different
-         *     from that of the binder, then we calculate the
-         *     temperature change of each separately due to
-         *     energy conservation principles, otherwise, we
-         *     handle temperature changes as previously
-         ***/
-
-        calcT(mass_cem_now);
+      mass_cur = 1.0 + (WCHSH * mass_cement * Alpha_cur);
 
-      } else {
+      /* Accounting for aggregate separately (15 Nov 2004) */
 
-        calcT(Mass_fill_pozz);
-      }
+      Cp_b = Cp_pozz * Mass_fill / mass_cur;
+      Cp_b += (Cp_cement * mass_cement / mass_cur);
+      Cp_b += (Cp_ch * Mass_CH / mass_cur);
 
-    } else if (Adiaflag == 2) {
+      Cp_b += (Cp_h2o * Mass_water) -
+              (Alpha_cur * WN * mass_cement * (Cp_h2o - Cp_bh2o));
 
-      /***
-       *    Update system temperature based on current time
-       *    and requested temperature history
-       ***/
+      Cp_b += (WCHSH * Cp_h2o * Alpha_cur * mass_cement);
+      if (AggTempEffect == 0)
+        Cp_b += ((Cp_agg * Mass_agg) / mass_cur);
 
-      while ((Time_cur > thtimehi) && (!feof(thfile))) {
-        fread_string(thfile, buff1);
-        name = strtok(buff1, ",");
-        thtimelo = atof(name);
-        if (fabs(thtimehi - thtimelo) > 1.0e-3) {
-          fprintf(stderr,
-                  "\nERROR: Badly formed data in temperature profile. Exiting");
-          fflush(stderr);
-          fclose(thfile);
-          freeallmem();
-          exit(1);
-        }
-        newstring = strtok(NULL, ",");
-        thtimehi = atof(newstring);
-        if (thtimehi <= thtimelo) {
-          fprintf(stderr,
-                  "\nERROR: Badly formed data in temperature profile. Exiting");
-          fflush(stderr);
-          fclose(thfile);
-          freeallmem();
-          exit(1);
-        }
-        newstring = strtok(NULL, ",");
-        thtemplo = atof(newstring);
-        newstring = strtok(NULL, ",\n");
-        thtemphi = atof(newstring);
-        if (Verbose_flag > 1) {
-          fprintf(Logfile, "\nNew temperature profile values : ");
-          fprintf(Logfile, "\n%f %f ", thtimelo, thtimehi);
-          fprintf(Logfile, "%f %f", thtemplo, thtemphi);
-        }
-      }
+      mass_cem_now = mass_cement / mass_cur;
+    }
 
-      if ((thtimehi - thtimelo) > 0.0) {
-        Temp_cur_b = thtemplo + ((thtemphi - thtemplo) * (Time_cur - thtimelo) /
-                                 (thtimehi - thtimelo));
-        Temp_cur_agg = Temp_cur_b;
-      } else {
-        Temp_cur_b = thtemplo;
-        Temp_cur_agg = Temp_cur_b;
-      }
+    /***
+     *    Determine rate constant based on Arrhenius expression
+     *
+     *    Recall that Temp_cur_b is in degrees Celsius
+     *
+     *    1000.0 converts kJ to J
+     *    8.314 is the gas constant in SI units
+     *    273.15 adds to T to convert from C to K
+     *    298.15 is the reference temperature (in K) to which
+     *        all other temperatures are compared when computing
+     *        changes in rate constants due to thermal activation
+     ***/
 
-      /***
-       *    1000.0 converts kJ to J
-       *    8.314 is the gas constant in SI units
-       *    273.15 adds to T to convert from C to K
-       *    298.15 is the reference temperature (in K) to which
-       *        all other temperatures are compared when computing
-       *        changes in rate constants due to thermal activation
-       ***/
+    act_nrg = 1000.0 * E_act / 8.314;
+    recip_Tdiff = (1.0 / (Temp_cur_b + 273.15)) - (1.0 / 298.15);
+    Krate = exp(-(act_nrg * recip_Tdiff));
 
-      act_nrg = 1000.0 * E_act / 8.314;
-      recip_Tdiff = (1.0 / (Temp_cur_b + 273.15)) - (1.0 / 298.15);
-      Krate = exp(-(act_nrg * recip_Tdiff));
+    /* Calculate pozzolanic and slag reaction rate constant */
 
-      /* Calculate pozzolanic and slag reaction rate constant */
+    act_nrg = 1000.0 * E_act_pozz / 8.314;
+    kpozz = exp(-(act_nrg * recip_Tdiff));
+    act_nrg = 1000.0 * E_act_slag / 8.314;
+    kslag = exp(-(act_nrg * recip_Tdiff));
 
-      act_nrg = 1000.0 * E_act_pozz / 8.314;
-      kpozz = exp(-(act_nrg * recip_Tdiff));
-      act_nrg = 1000.0 * E_act_slag / 8.314;
-      kslag = exp(-(act_nrg * recip_Tdiff));
+    /***
+     *    Modify silica fume probabilities.  There are
+     *    two effects postulated:
+     *    1. Early age effect due to nucleating capability
+     *       of silica fume with high BET values
+     *    2. Later age pozzolanic reactivity due to
+     *       SiO2 content of the silica fume (Psfume)
+     ***/
 
-      /***
-       *    Modify probability of pozzolanic and slag
-       *    reactions based on ratio of pozzolanic (slag)
-       *    reaction rate to the hydration rate
-       ***/
+    /** Late age effect dictated by Psfume **/
+    /** Psfume is for converting DIFFCH to POZZCSH **/
 
-      /** Late age effect dictated by Psfume **/
-      /** Psfume is for converting DIFFCH to POZZCSH **/
+    Psfume = PSFUME * (kpozz / Krate);
+    psfact = (SF_SiO2_val) / (SF_SiO2_normal);
+    betfact = (SF_BET_val) / (SF_BET_normal);
+    Psfume *= (3.0 * psfact * psfact * betfact);
+    if (Psfume > 1.0)
+      Psfume = 1.0;
+    LOI_factor = 25.0 * (SF_LOI_val / SF_LOI_normal);
+    if (LOI_factor < 1.0)
+      LOI_factor = 1.0;
 
-      Psfume = PSFUME * (kpozz / Krate);
-      psfact = (SF_SiO2_val) / (SF_SiO2_normal);
-      betfact = (SF_BET_val) / (SF_BET_normal);
-      Psfume *= (3.0 * psfact * psfact * betfact);
-      if (Psfume > 1.0)
-        Psfume = 1.0;
-      LOI_factor = 25.0 * (SF_LOI_val / SF_LOI_normal);
-      if (LOI_factor < 1.0)
-        LOI_factor = 1.0;
+    /***
+     *    Modify probability of pozzolanic and slag
+     *    reactions based on ratio of pozzolanic (slag)
+     *    reaction rate to the hydration rate
+     ***/
 
-      Pamsil = PAMSIL * (kpozz / Krate);
-      Disprob[ASG] = Disbase[ASG] * (kpozz / Krate);
-      Disprob[CAS2] = Disbase[CAS2] * (kpozz / Krate);
-      Disprob[SLAG] = Slagreact * Disbase[SLAG] * (kslag / Krate);
-    }
+    Pamsil = PAMSIL * (kpozz / Krate);
+    Disprob[ASG] = Disbase[ASG] * (kpozz / Krate);
+    Disprob[CAS2] = Disbase[CAS2] * (kpozz / Krate);
+    Disprob[SLAG] = Slagreact * Disbase[SLAG] * (kslag / Krate);
 
     /***
-     *    Modify time based on simple numerical integration,
-     *    simulating maturity approach with parabolic kinetics
-     *    (Knudsen model)
+     *    Update temperature based on heat generated
+     *    and current Cp
      ***/
 
-    if (Verbose_flag > 1)
-      fprintf(Logfile, "\nIcyc = %d AND Cyccnt = %d", Icyc, Cyccnt);
-    if (Cyccnt > 1) {
-      switch (TimeCalibrationMethod) {
-      case CALORIMETRIC:
-        dval = Heat_new * Heat_cf;
-        sprintf(typestring, "calorimetric");
-        if (dval < DataValue[0]) {
-          if (Verbose_flag > 1)
-            fprintf(Logfile,
-                    "\n\ndval = %f, DataValue[0] = %f, DataValue[1] = %f", dval,
-                    DataValue[0], DataValue[1]);
-          TimeHistory[Cyccnt] = DataTime[0];
-        } else {
-          findnewtime(dval, act_nrg, &previousUncorrectedTime, typestring);
-        }
-        break;
-      case CHEMICALSHRINKAGE:
-        dval = Chs_new;
-        if (dval <= 0.0)
-          dval = 0.00001;
-        sprintf(typestring, "chemical shrinkage");
-        if (dval < DataValue[0]) {
-          if (Verbose_flag > 1)
-            fprintf(Logfile,
-                    "\ndval = %f, DataValue[0] = %f, DataValue[1] = %f", dval,
-                    DataValue[0], DataValue[1]);
-          TimeHistory[Cyccnt] = DataTime[0];
-        } else {
-          findnewtime(dval, act_nrg, &previousUncorrectedTime, typestring);
-        }
-        break;
-      default:
-        Time_step = (2.0 * (float)(Cyccnt - 1) - 1.0) * Beta / Krate;
-        Time_cur += Time_step;
-        TimeHistory[Cyccnt] = Time_cur;
-        break;
-      }
-    }
-
-    /* Initialize and calculate gel-space ratio */
+    if (mass_cem_now > 0.01) {
 
-    Gsratio2 = 0.0;
-    Gsratio2 += (double)(Count[CH] + Count[CSH]);
-    Gsratio2 += (double)(Count[C3AH6] + Count[ETTR]);
-    Gsratio2 += (double)(Count[POZZCSH] + Count[SLAGCSH]);
-    Gsratio2 += (double)(Count[FH3] + Count[AFM] + Count[ETTRC4AF]);
-    Gsratio2 += (double)(Count[FRIEDEL] + Count[STRAT]);
-    Gsratio2 += (double)(Count[ABSGYP] + Count[AFMC]);
+      /***
+       *     If the temperature of the aggregate is different
+       *     from that of the binder, then we calculate the
+       *     temperature change of each separately due to
+       *     energy conservation principles, otherwise, we
+       *     handle temperature changes as previously
+       ***/
 
-    space = (double)(Count[POROSITY] + Count[CRACKP] + Count[EMPTYP]);
+      perfbegin(PERFCALCT);
+      calcT(mass_cem_now);
+      perfend(PERFCALCT);
 
-    Gsratio2 = (Gsratio2) / (Gsratio2 + space);
+    } else {
 
-    gfloat = 0.0;
-    if (W_to_c != 0.0) {
-      gfloat = (double)((0.68 * Alpha_cur) / (0.32 * Alpha_cur + W_to_c));
+      perfbegin(PERFCALCT);
+      calcT(Mass_fill_pozz);
+      perfend(PERFCALCT);
     }
 
-    if (Verbose_flag > 2)
-      fprintf(Logfile, "\nEntering pHpred");
-    pHpred();
-    if (Verbose_flag > 2) {
-      fprintf(Logfile, "\nReturned from call to pHpred");
-      fflush(Logfile);
-    }
+  } else if (Adiaflag == 2) {
 
     /***
-     *    Check percolation of pore space
-     *
-     *    Note that first two variables passed correspond
-     *    to phases to check in combination.
-     *    Could easily add calls to
-     *    check for percolation of CH, CSH, etc.
-     *    (24 May 2004)
+     *    Update system temperature based on current time
+     *    and requested temperature history
      ***/
 
-    if ((Time_cur >= NextBurnTime) && ((Porefl1 + Porefl2 + Porefl3) != 0)) {
-
-      /* Burn across x */
-
-      NextBurnTime = Time_cur + Burntimefreq;
-
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "\nGoing to check percolation of porosity in X... ");
-        fflush(Logfile);
-      }
-      Porefl1 = burn3d(((int)POROSITY), ((int)CRACKP), 1, 0, 0);
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "Done!");
-        fflush(Logfile);
-      }
-      if (Porefl1 == -1) {
+    while ((Time_cur > thtimehi) && (!feof(thfile))) {
+      fread_string(thfile, buff1);
+      name = strtok(buff1, ",");
+      thtimelo = atof(name);
+      if (fabs(thtimehi - thtimelo) > 1.0e-3) {
+        fprintf(stderr,
+                "\nERROR: Badly formed data in temperature profile. Exiting");
+        fflush(stderr);
+        fclose(thfile);
         freeallmem();
-        bailout("disrealnew", "Problem in burn3d");
         exit(1);
       }
-      /* Burn across y */
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "\n\nGoing to check percolation of porosity in Y... ");
-        fflush(Logfile);
-      }
-      Porefl2 = burn3d(((int)POROSITY), ((int)CRACKP), 0, 1, 0);
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "Done!");
-        fflush(Logfile);
-      }
-      if (Porefl2 == -1) {
+      newstring = strtok(NULL, ",");
+      thtimehi = atof(newstring);
+      if (thtimehi <= thtimelo) {
+        fprintf(stderr,
+                "\nERROR: Badly formed data in temperature profile. Exiting");
+        fflush(stderr);
+        fclose(thfile);
         freeallmem();
-        bailout("disrealnew", "Problem in burn3d");
         exit(1);
       }
-      /* Burn across z */
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "\n\nGoing to check percolation of porosity in Z... ");
-        fflush(Logfile);
-      }
-      Porefl3 = burn3d(((int)POROSITY), ((int)CRACKP), 0, 0, 1);
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "Done!");
-        fflush(Logfile);
-      }
-      if (Porefl3 == -1) {
-        freeallmem();
-        bailout("disrealnew", "Problem in burn3d");
-        exit(1);
+      newstring = strtok(NULL, ",");
+      thtemplo = atof(newstring);
+      newstring = strtok(NULL, ",\n");
+      thtemphi = atof(newstring);
+      if (Verbose_flag > 1) {
+        fprintf(Logfile, "\nNew temperature profile values : ");
+        fprintf(Logfile, "\n%f %f ", thtimelo, thtimehi);
+        fprintf(Logfile, "%f %f", thtemplo, thtemphi);
       }
+    }
 
-      /***
-       *    Switch to self-desiccating conditions
-       *    when porosity disconnects
-       ***/
-
-      /*
-                  if (Crackwidth == 0 || Icyc < Crackcycle) {
-                      if (((Porefl1 + Porefl2 + Porefl3) == 0) && (!Sealed)) {
-                          Water_off = Water_left;
-                          Pore_off = Countkeep;
-                          Sealed = 1;
-                          if (Verbose_flag == 2) fprintf(Logfile,"Switching to
-         self-desiccating at cycle %d \n",Cyccnt);
-                      }
-                  } else {
-                       if ((Porefl1 == 0) && (Crackorient == 1) && (!Sealed)) {
-                           Water_off = Water_left;
-                           Pore_off = Countkeep;
-                           Sealed = 1;
-                           if (Verbose_flag == 2) fprintf(Logfile,"Switching to
-         self-desiccating at cycle %d \n",Cyccnt); } else if ((Porefl2 == 0) &&
-         (Crackorient == 2)
-         && (!Sealed)) { Water_off = Water_left; Pore_off = Countkeep; Sealed =
-         1; if (Verbose_flag == 2) fprintf(Logfile,"Switching to
-         self-desiccating at cycle %d
-         \n",Cyccnt); } else if ((Porefl3 == 0) && (Crackorient == 3) &&
-         (!Sealed)) { Water_off = Water_left; Pore_off = Countkeep; Sealed = 1;
-                           if (Verbose_flag == 2) fprintf(Logfile,"Switching to
-         self-desiccating at cycle %d \n",Cyccnt);
-                       }
-                  }
-      */
+    if ((thtimehi - thtimelo) > 0.0) {
+      Temp_cur_b = thtemplo + ((thtemphi - thtemplo) * (Time_cur - thtimelo) /
+                               (thtimehi - thtimelo));
+      Temp_cur_agg = Temp_cur_b;
+    } else {
+      Temp_cur_b = thtemplo;
+      Temp_cur_agg = Temp_cur_b;
     }
 
-    /* Check percolation of solids (set point) */
+    /***
+     *    1000.0 converts kJ to J
+     *    8.314 is the gas constant in SI units
+     *    273.15 adds to T to convert from C to K
+     *    298.15 is the reference temperature (in K) to which
+     *        all other temperatures are compared when computing
+     *        changes in rate constants due to thermal activation
+     ***/
 
-    /* GODZILLA */
-    // fprintf(
-    //     Logfile,
-    //     "\nJust checking in, Setflag = %d, Time_cur = %f and NextSetTime =
-    //     %f", Setflag, Time_cur, NextSetTime);
-    // fflush(Logfile);
-    /* GODZILLA */
+    act_nrg = 1000.0 * E_act / 8.314;
+    recip_Tdiff = (1.0 / (Temp_cur_b + 273.15)) - (1.0 / 298.15);
+    Krate = exp(-(act_nrg * recip_Tdiff));
 
-    if ((Time_cur >= NextSetTime) && (!Setflag)) {
+    /* Calculate pozzolanic and slag reaction rate constant */
 
-      NextSetTime = Time_cur + Settimefreq;
+    act_nrg = 1000.0 * E_act_pozz / 8.314;
+    kpozz = exp(-(act_nrg * recip_Tdiff));
+    act_nrg = 1000.0 * E_act_slag / 8.314;
+    kslag = exp(-(act_nrg * recip_Tdiff));
 
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "\n\nGoing to check percolation of solids in X... ");
-        fflush(Logfile);
-      }
-      Sf1 = burnset(1, 0, 0); /* Burn across x */
-      if (Verbose_flag > 2) {
-        fprintf(Logfile,
-                "Done!\nGoing to check percolation of solids in Y... ");
-        fflush(Logfile);
-      }
-      Sf2 = burnset(0, 1, 0); /* Burn across y */
-      if (Verbose_flag > 2) {
-        fprintf(Logfile,
-                "Done!\nGoing to check percolation of solids in Z... ");
-        fflush(Logfile);
-      }
-      Sf3 = burnset(0, 0, 1); /* Burn across z */
-      if (Verbose_flag > 2) {
-        fprintf(Logfile, "Done!");
-        fflush(Logfile);
-      }
-
-      Setflag = Sf1 * Sf2 * Sf3;
-    }
+    /***
+     *    Modify probability of pozzolanic and slag
+     *    reactions based on ratio of pozzolanic (slag)
+     *    reaction rate to the hydration rate
+     ***/
 
-    /* Check hydration of particles */
+    /** Late age effect dictated by Psfume **/
+    /** Psfume is for converting DIFFCH to POZZCSH **/
 
-    /* GODZILLA */
-    // fprintf(Logfile, "\nJust checking in, Time_cur = %f and NextPhydTime =
-    // %f",
-    //         Time_cur, NextPhydTime);
-    // fflush(Logfile);
-    /* GODZILLA */
-    if (Time_cur >= NextPhydTime) {
-      /* GODZILLA */
-      // fprintf(
-      //     Logfile,
-      //     "\nChecking particle hydration, Time_cur = %f and NextPhydTime =
-      //     %f", Time_cur, NextPhydTime);
-      // fflush(Logfile);
-      /* GODZILLA */
-      NextPhydTime = Time_cur + Phydtimefreq;
-      if ((parthyd()) == MEMERR) {
-        /* GODZILLA */
-        fprintf(Logfile, "\nparthyd bailed out!!");
-        fflush(Logfile);
-        /* GODZILLA */
+    Psfume = PSFUME * (kpozz / Krate);
+    psfact = (SF_SiO2_val) / (SF_SiO2_normal);
+    betfact = (SF_BET_val) / (SF_BET_normal);
+    Psfume *= (3.0 * psfact * psfact * betfact);
+    if (Psfume > 1.0)
+      Psfume = 1.0;
+    LOI_factor = 25.0 * (SF_LOI_val / SF_LOI_normal);
+    if (LOI_factor < 1.0)
+      LOI_factor = 1.0;
 
-        freeallmem();
-        bailout("disrealnew", "Problem with parthyd");
-        exit(1);
-      }
-    }
+    Pamsil = PAMSIL * (kpozz / Krate);
+    Disprob[ASG] = Disbase[ASG] * (kpozz / Krate);
+    Disprob[CAS2] = Disbase[CAS2] * (kpozz / Krate);
+    Disprob[SLAG] = Slagreact * Disbase[SLAG] * (kslag / Krate);
+  }
 
-    /* Total up phase counts */
+  /***
+   *    Modify time based on simple numerical integration,
+   *    simulating maturity approach with parabolic kinetics
+   *    (Knudsen model)
+   ***/
 
-    if (Cyccnt > 1) {
-      for (k = 0; k < NPHASES; k++)
-        Count[k] = 0;
-      for (i = 0; i < Xsyssize; i++) {
-        for (j = 0; j < Ysyssize; j++) {
-          for (k = 0; k < Zsyssize; k++) {
-            Count[(int)(Mic[i][j][k])]++;
-          }
-        }
+  if (Verbose_flag > 1)
+    fprintf(Logfile, "\nIcyc = %d AND Cyccnt = %d", Icyc, Cyccnt);
+  if (Cyccnt > 1) {
+    switch (TimeCalibrationMethod) {
+    case CALORIMETRIC:
+      dval = Heat_new * Heat_cf;
+      sprintf(typestring, "calorimetric");
+      if (dval < DataValue[0]) {
+        if (Verbose_flag > 1)
+          fprintf(Logfile,
+                  "\n\ndval = %f, DataValue[0] = %f, DataValue[1] = %f", dval,
+                  DataValue[0], DataValue[1]);
+        TimeHistory[Cyccnt] = DataTime[0];
+      } else {
+        findnewtime(dval, act_nrg, &previousUncorrectedTime, typestring);
       }
+      break;
+    case CHEMICALSHRINKAGE:
+      dval = Chs_new;
+      if (dval <= 0.0)
+        dval = 0.00001;
+      sprintf(typestring, "chemical shrinkage");
+      if (dval < DataValue[0]) {
+        if (Verbose_flag > 1)
+          fprintf(Logfile,
+                  "\ndval = %f, DataValue[0] = %f, DataValue[1] = %f", dval,
+                  DataValue[0], DataValue[1]);
+        TimeHistory[Cyccnt] = DataTime[0];
+      } else {
+        findnewtime(dval, act_nrg, &previousUncorrectedTime, typestring);
+      }
+      break;
+    default:
+      Time_step = coarseclock(Cyccnt - 1) * Beta / Krate;
+      Time_cur += Time_step;
+      TimeHistory[Cyccnt] = Time_cur;
+      break;
     }
+  }
 
-    /* GODZILLA */
-    // fprintf(
-    //     Logfile,
-    //     "\nJust checking in, Crackwidth = %d, Time_cur = %f and Cracktime =
-    //     %f", Crackwidth, Time_cur, Cracktime);
-    // fflush(Logfile);
-    /* GODZILLA */
-    if (Crackwidth > 0 && (Time_cur >= Cracktime)) {
-
-      /***
-       *    Crack the microstructure and change the
-       *    effective system size
-       ***/
+  /* Initialize and calculate gel-space ratio */
 
-      if (Verbose_flag > 1) {
-        fprintf(Logfile, "\nPreparing to place a crack in the microstructure.");
-        fprintf(Logfile, "\n\tCrack width = %d", Crackwidth);
-        fprintf(Logfile, "\n\tX size currently is %d", Xsyssize);
-        fprintf(Logfile, "\n\tY size currently is %d", Ysyssize);
-        fprintf(Logfile, "\n\tZ size currently is %d", Zsyssize);
-        fflush(Logfile);
-      }
-      addcrack();
-      if (Verbose_flag > 1) {
-        fprintf(Logfile, "\n\tAfter cracking, X size is %d", Xsyssize);
-        fprintf(Logfile, "\n\tAfter cracking, Y size is %d", Ysyssize);
-        fprintf(Logfile, "\n\tAfter cracking, Z size is %d", Zsyssize);
-        fflush(Logfile);
-      }
+  Gsratio2 = 0.0;
+  Gsratio2 += (double)(Count[CH] + Count[CSH]);
+  Gsratio2 += (double)(Count[C3AH6] + Count[ETTR]);
+  Gsratio2 += (double)(Count[POZZCSH] + Count[SLAGCSH]);
+  Gsratio2 += (double)(Count[FH3] + Count[AFM] + Count[ETTRC4AF]);
+  Gsratio2 += (double)(Count[FRIEDEL] + Count[STRAT]);
+  Gsratio2 += (double)(Count[ABSGYP] + Count[AFMC]);
 
-      for (k = 0; k < NPHASES; k++)
-        Count[k] = 0;
-      for (i = 0; i < Xsyssize; i++) {
-        for (j = 0; j < Ysyssize; j++) {
-          for (k = 0; k < Zsyssize; k++) {
-            Count[(int)(Mic[i][j][k])]++;
-          }
-        }
-      }
+  space = (double)(Count[POROSITY] + Count[CRACKP] + Count[EMPTYP]);
 
-      /***
-       *    Must update anything that depends on system size, except
-       *    for those things that are updated once each cycle
-       ***/
+  Gsratio2 = (Gsratio2) / (Gsratio2 + space);
 
-      Syspix = Xsyssize * Ysyssize * Zsyssize;
-      if (Verbose_flag > 1)
-        fprintf(Logfile, "\n\tSyspix changes from %d to %d", Syspix_orig,
-                Syspix);
-      Sizemag = ((float)Syspix) / (pow(((double)(DEFAULTSYSTEMSIZE)), 3.0));
-      if (Verbose_flag > 1)
-        fprintf(Logfile, "\n\tSizemag changes from %f to %f", Sizemag_orig,
-                Sizemag);
-      Isizemag = (int)(Sizemag + 0.5);
-
-      Heat_cf *= ((double)Syspix) / ((double)Syspix_orig);
-      Cshscale *= Sizemag / Sizemag_orig;
-      C3ah6_scale *= Sizemag / Sizemag_orig;
-      pscalech *= Sizemag / Sizemag_orig;
-      pscalegyp *= Sizemag / Sizemag_orig;
-      pscalehg *= Sizemag / Sizemag_orig;
-      pscalefh3 *= Sizemag / Sizemag_orig;
+  if (Verbose_flag > 2)
+    fprintf(Logfile, "\nEntering pHpred");
+  perfbegin(PERFPHPRED);
+  pHpred();
+  perfend(PERFPHPRED);
+  if (Verbose_flag > 2) {
+    fprintf(Logfile, "\nReturned from call to pHpred");
+    log_flush(Logfile);
+  }
 
-      /***
-       *    Last thing to do is to determine the curing
-       *    condition of the crack (saturated or sealed), which
-       *    we set to whatever the user wanted at the beginning
-       *    of the run
-       ***/
-      /***
-       *    Commented this block out on 2 July 2004 because
-       *    now we have CRACKP and POROSITY.  We originally
-       *    wanted to keep the  crack from drying out due to
-       *    sealed conditions, but only POROSITY pixels now can
-       *    be consumed under sealed conditions.
-       ***/
-      /*
+  /***
+   *    Check percolation of pore space
+   *
+   *    Note that first two variables passed correspond
+   *    to phases to check in combination.
+   *    Could easily add calls to
+   *    check for percolation of CH, CSH, etc.
+   *    (24 May 2004)
+   ***/
 
-      if ((Sealed) && (!Sealed_after_crack)) {
-          if (Verbose_flag > 1) fprintf(Logfile,"\nSwitching to saturated
-      conditions after cracking.\n");
-      }
-      Sealed = Sealed_after_crack;
-      */
+  if ((Time_cur >= NextBurnTime) && ((Porefl1 + Porefl2 + Porefl3) != 0)) {
 
-      /* Make sure we don't do this block again */
+    NextBurnTime = Time_cur + Burntimefreq;
 
-      Cracktime = End_time + 100.0;
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, "\nGoing to check percolation of porosity... ");
+      log_flush(Logfile);
+    }
+    perfbegin(PERFBURN3D);
+    if (burn3d(((int)POROSITY), ((int)CRACKP), burnflag) == MEMERR) {
+      freeallmem();
+      bailout("disrealnew", "Problem in burn3d");
+      exit(1);
+    }
+    perfend(PERFBURN3D);
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, "Done!");
+      log_flush(Logfile);
     }
+    Porefl1 = burnflag[0];
+    Porefl2 = burnflag[1];
+    Porefl3 = burnflag[2];
 
     /***
-     *     As currently set up, crack porosity (CRACKP) can
-     *     diffuse into regular saturated porosity (POROSITY).
-     *     Every 5 cycles after a crack is added, we call the
-     *     function resetcrackpores to redistribute these pixels
-     *     back to the crack
+     *    Switch to self-desiccating conditions
+     *    when porosity disconnects
      ***/
 
     /*
-    if ((Icyc > Crackcycle) && (((Icyc - Crackcycle)%5) == 0)) {
-        resetcrackpores();
-    }
+                if (Crackwidth == 0 || Icyc < Crackcycle) {
+                    if (((Porefl1 + Porefl2 + Porefl3) == 0) && (!Sealed)) {
+                        Water_off = Water_left;
+                        Pore_off = Countkeep;
+                        Sealed = 1;
+                        if (Verbose_flag == 2) fprintf(Logfile,"Switching to
+       self-desiccating at cycle %d \n",Cyccnt);
+                    }
+                } else {
+                     if ((Porefl1 == 0) && (Crackorient == 1) && (!Sealed)) {
+                         Water_off = Water_left;
+                         Pore_off = Countkeep;
+                         Sealed = 1;
+                         if (Verbose_flag == 2) fprintf(Logfile,"Switching to
+       self-desiccating at cycle %d \n",Cyccnt); } else if ((Porefl2 == 0) &&
+       (Crackorient == 2)
+       && (!Sealed)) { Water_off = Water_left; Pore_off = Countkeep; Sealed =
+       1; if (Verbose_flag == 2) fprintf(Logfile,"Switching to
+       self-desiccating at cycle %d
+       \n",Cyccnt); } else if ((Porefl3 == 0) && (Crackorient == 3) &&
+       (!Sealed)) { Water_off = Water_left; Pore_off = Countkeep; Sealed = 1;
+                         if (Verbose_flag == 2) fprintf(Logfile,"Switching to
+       self-desiccating at cycle %d \n",Cyccnt);
+                     }
+                }
     */
+  }
 
-    /* Output movie microstructure if one is desired */
-
-    fflush(Logfile);
-    /* GODZILLA */
-    // fprintf(Logfile,
-    //         "\nJust checking in, MovieFrameFreq = %f, Time_cur = %f and "
-    //         "NextMovieTime = %f",
-    //         MovieFrameFreq, Time_cur, NextMovieTime);
-    // fflush(Logfile);
-    /* GODZILLA */
-    if ((MovieFrameFreq > 0.0) && (Time_cur >= NextMovieTime)) {
-      if (Verbose_flag > 1) {
-        fprintf(Logfile, "\nMaking movie frame");
-        fflush(Logfile);
-      }
-      NextMovieTime = Time_cur + MovieFrameFreq;
-      /* Check to see if movie file has been created already */
-      Movfile = filehandler("disrealnew", Moviename, "READ_NOFAIL");
-      if (!Movfile) {
-        if (Verbose_flag > 1) {
-          fprintf(Logfile, "\nMovie file not found.  Creating it now...");
-          fflush(Logfile);
-        }
-        Movfile = filehandler("disrealnew", Moviename, "WRITE");
-        if (!Movfile) {
-          bailout("disrealnew", "Could not create movie file");
-          freeallmem();
-          exit(1);
-        }
-        if (Verbose_flag > 1) {
-          fprintf(Logfile, " Success.");
-          fflush(Logfile);
-        }
-
-        fprintf(Movfile, "%s ", VERSIONSTRING);
-        fprintf(Movfile, "%s", VERSIONNUMBER);
-        if (Crackorient == 1 || Crackorient == 2) {
-          fprintf(Movfile, "\n%s ", XSIZESTRING);
-          fprintf(Movfile, "%d", Xsyssize);
-          fprintf(Movfile, "\n%s ", YSIZESTRING);
-          fprintf(Movfile, "%d", Ysyssize);
-        }
-        if (Crackorient == 3) {
-          fprintf(Movfile, "\n%s ", XSIZESTRING);
-          fprintf(Movfile, "%d", Xsyssize);
-          fprintf(Movfile, "\n%s ", YSIZESTRING);
-          fprintf(Movfile, "%d", Zsyssize);
-        }
-        fprintf(Movfile, "\n%s ", IMGRESSTRING);
-        fprintf(Movfile, "%4.2f", Res);
+  /* Check percolation of solids (set point) */
 
-      } else {
-        fprintf(Logfile, "\nMovie file exists.  Appending to it...");
-        fflush(Logfile);
-        fclose(Movfile);
-        Movfile = filehandler("disrealnew", Moviename, "APPEND");
-        if (!Movfile) {
-          freeallmem();
-          exit(1);
-        }
-      }
+  /* GODZILLA */
+  // fprintf(
+  //     Logfile,
+  //     "\nJust checking in, Setflag = %d, Time_cur = %f and NextSetTime =
+  //     %f", Setflag, Time_cur, NextSetTime);
+  // log_flush(Logfile);
+  /* GODZILLA */
 
-      /***
-       *    Currently can only make a hydration movie for
-       *    slice 50.  Make this user-defined later on
-       ***/
+  if ((Time_cur >= NextSetTime) && (!Setflag)) {
 
-      if (Crackorient == 1 || Crackorient == 2) {
-        for (iy = 0; iy < Ysyssize; iy++) {
-          for (ix = 0; ix < Xsyssize; ix++) {
-            fprintf(Movfile, "\n%d", (int)Mic[ix][iy][50]);
-          }
-        }
-      } else {
-        for (iz = 0; iz < Zsyssize; iz++) {
-          for (ix = 0; ix < Xsyssize; ix++) {
-            fprintf(Movfile, "\n%d", (int)Mic[ix][50][iz]);
-          }
-        }
-      }
+    NextSetTime = Time_cur + Settimefreq;
 
-      fclose(Movfile);
-      if (Verbose_flag > 1) {
-        fprintf(Logfile,
-                "\nMade movie frame successfully and closed movie file");
-        fflush(Logfile);
-      }
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, "\n\nGoing to check percolation of solids... ");
+      log_flush(Logfile);
+    }
+    perfbegin(PERFBURNSET);
+    if (burnset(burnflag) == MEMERR) {
+      freeallmem();
+      bailout("disrealnew", "Problem in burnset");
+      exit(1);
+    }
+    perfend(PERFBURNSET);
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, "Done!");
+      log_flush(Logfile);
     }
+    Sf1 = burnflag[0];
+    Sf2 = burnflag[1];
+    Sf3 = burnflag[2];
 
-    /***
-     *    Output complete 3D microstructure once for every entry
-     *    in the outputalpha.dat file
-     ***/
+    Setflag = Sf1 * Sf2 * Sf3;
+  }
+
+  /* Check hydration of particles */
 
+  /* GODZILLA */
+  // fprintf(Logfile, "\nJust checking in, Time_cur = %f and NextPhydTime =
+  // %f",
+  //         Time_cur, NextPhydTime);
+  // log_flush(Logfile);
+  /* GODZILLA */
+  if (Micorig && Time_cur >= NextPhydTime) {
     /* GODZILLA */
-    // fprintf(Logfile,
-    //         "\nJust checking in, Alpha_cur = %f, Time_cur = %f and "
-    //         "NextImageTime = %f",
-    //         Alpha_cur, Time_cur, NextImageTime);
-    // fflush(Logfile);
+    // fprintf(
+    //     Logfile,
+    //     "\nChecking particle hydration, Time_cur = %f and NextPhydTime =
+    //     %f", Time_cur, NextPhydTime);
+    // log_flush(Logfile);
     /* GODZILLA */
-    if (((CustomImageTime != NULL) &&
-         (Time_cur >= CustomImageTime[customentry])) ||
-        ((Alpha_cur > 0.0) && (Time_cur >= NextImageTime))) {
-
-      if (Verbose_flag > 1) {
-        fprintf(Logfile, "\nWriting microstructure image");
-        fflush(Logfile);
-      }
-      customentry++;
-
-      NextImageTime = Time_cur + OutTimefreq;
-      sprintf(strsuffa, "%.2fh.%d.%1d", Time_cur, (int)Temp_0, Csh2flag);
-      sprintf(strsuffb, "%1d%1d", Adiaflag, Sealed);
-      strcpy(strsuff, strsuffa);
-      strcat(strsuff, strsuffb);
-      sprintf(Micname, "%s%s.img.", WorkingDirectory, Fileroot);
-      strcat(Micname, strsuff);
-      if (Verbose_flag > 1) {
-        fprintf(Logfile, "\nI think Micname is %s", Micname);
-        fflush(Logfile);
-      }
+    NextPhydTime = Time_cur + Phydtimefreq;
+    perfbegin(PERFPARTHYD);
+    if ((parthyd()) == MEMERR) {
+      /* GODZILLA */
+      fprintf(Logfile, "\nparthyd bailed out!!");
+      log_flush(Logfile);
       /* GODZILLA */
 
-      Micfile = filehandler("disrealnew", Micname, "WRITE");
-      if (!Micfile) {
-        sprintf(buff, "Could not open file %s", Micname);
-        bailout("disrealnew", buff);
-        freeallmem();
-        exit(1);
-      }
-
-      Imageindexfile = filehandler("disrealnew", Imageindexname, "APPEND");
-      if (!Imageindexfile) {
-        sprintf(buff, "Could not open file %s", Imageindexname);
-        bailout("disrealnew", buff);
-        freeallmem();
-        exit(1);
-      }
-      fprintf(Imageindexfile, "\n%f\t%s", Time_cur, Micname);
-      fclose(Imageindexfile);
-
-      if (write_imgheader(Micfile, Xsyssize, Ysyssize, Zsyssize, Res)) {
-        fclose(Micfile);
-        freeallmem();
-        bailout("disrealnew", "Error writing image header");
-        exit(1);
-      }
-
-      /**
-       * 2025 August 05
-       * New convention is to read and write image data in C-order (z
-       * varies the fastest, then y, then x)
-       **/
-      for (ix = 0; ix < Xsyssize; ix++) {
-        for (iy = 0; iy < Ysyssize; iy++) {
-          for (iz = 0; iz < Zsyssize; iz++) {
+      freeallmem();
+      bailout("disrealnew", "Problem with parthyd");
+      exit(1);
+    }
+    perfend(PERFPARTHYD);
+  }
 
-            pixtmp = (int)Mic[ix][iy][iz];
+  /***
+   *    Total up phase counts.  With --adaptive a quiet cycle
+   *    keeps the counts that dissolve and hydrate have kept up
+   *    instead (see adaptquiet)
+   ***/
 
-            switch (pixtmp) {
-            case DIFFCSH:
-              /* pixtmp = CSH; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFANH:
-              /* pixtmp = ANHYDRITE; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFHEM:
-              /* pixtmp = HEMIHYD; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFGYP:
-              /* pixtmp = GYPSUM; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFCACL2:
-              /* pixtmp = CACL2; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFCACO3:
-              /* pixtmp = CACO3; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFCAS2:
-              /* pixtmp = CAS2; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFAS:
-              /* pixtmp = ASG; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFETTR:
-              /* pixtmp = ETTR; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFC3A:
+  if (Cyccnt > 1 && !adaptquiet()) {
+    perfbegin(PERFCENSUS);
+    grid_census(Mic, Xsyssize, Ysyssize, Zsyssize, NPHASES, Count);
+    perfend(PERFCENSUS);
+  }
 
-              /***
-               *    Any precipitation of diffusing C3A
-               *    is assumed to form cubic C3A instead
-               *    of orthorhombic C3A
-               ***/
+  /* GODZILLA */
+  // fprintf(
+  //     Logfile,
+  //     "\nJust checking in, Crackwidth = %d, Time_cur = %f and Cracktime =
+  //     %f", Crackwidth, Time_cur, Cracktime);
+  // log_flush(Logfile);
+  /* GODZILLA */
+  if (Crackwidth > 0 && (Time_cur >= Cracktime)) {
 
-              /* pixtmp = C3A; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFC4A:
+    /***
+     *    Crack the microstructure and change the
+     *    effective system size
+     ***/
 
-              /***
-               *    Any diffusing C4AF has already
-               *    converted to FH3 and CH, so you can
-               *    not really represent it as C4AF anymore.
-               *    Best you can do is represent it as
-               *    C3A
-               ***/
+    if (Verbose_flag > 1) {
+      fprintf(Logfile, "\nPreparing to place a crack in the microstructure.");
+      fprintf(Logfile, "\n\tCrack width = %d", Crackwidth);
+      fprintf(Logfile, "\n\tX size currently is %d", Xsyssize);
+      fprintf(Logfile, "\n\tY size currently is %d", Ysyssize);
+      fprintf(Logfile, "\n\tZ size currently is %d", Zsyssize);
+      log_flush(Logfile);
+    }
+    addcrack();
+    if (Verbose_flag > 1) {
+      fprintf(Logfile, "\n\tAfter cracking, X size is %d", Xsyssize);
+      fprintf(Logfile, "\n\tAfter cracking, Y size is %d", Ysyssize);
+      fprintf(Logfile, "\n\tAfter cracking, Z size is %d", Zsyssize);
+      log_flush(Logfile);
+    }
 
-              /* pixtmp = C3A; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFFH3:
-              /* pixtmp = FH3; */
-              pixtmp = POROSITY;
-              break;
-            case DIFFCH:
-              /* pixtmp = CH; */
-              pixtmp = POROSITY;
-              break;
-            default:
-              break;
-            }
+    grid_census(Mic, Xsyssize, Ysyssize, Zsyssize, NPHASES, Count);
+    if (setblocks()) {
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for Blockinert");
+      exit(1);
+    }
+    if (layerbuild()) {
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for layers of Mic");
+      exit(1);
+    }
 
-            fprintf(Micfile, "\n%d", pixtmp);
+    /***
+     *    Must update anything that depends on system size, except
+     *    for those things that are updated once each cycle
+     ***/
 
-          } /* End of loop in z */
-        } /* End of loop in y */
-      } /* End of loop in x */
+    Syspix = Xsyssize * Ysyssize * Zsyssize;
+    if (Verbose_flag > 1)
+      fprintf(Logfile, "\n\tSyspix changes from %d to %d", Syspix_orig,
+              Syspix);
+    Sizemag = ((float)Syspix) / (pow(((double)(DEFAULTSYSTEMSIZE)), 3.0));
+    if (Verbose_flag > 1)
+      fprintf(Logfile, "\n\tSizemag changes from %f to %f", Sizemag_orig,
+              Sizemag);
+    Isizemag = (int)(Sizemag + 0.5);
+
+    Heat_cf *= ((double)Syspix) / ((double)Syspix_orig);
+    Cshscale *= Sizemag / Sizemag_orig;
+    C3ah6_scale *= Sizemag / Sizemag_orig;
+    pscalech *= Sizemag / Sizemag_orig;
+    pscalegyp *= Sizemag / Sizemag_orig;
+    pscalehg *= Sizemag / Sizemag_orig;
+    pscalefh3 *= Sizemag / Sizemag_orig;
 
-      fclose(Micfile);
+    /***
+     *    Last thing to do is to determine the curing
+     *    condition of the crack (saturated or sealed), which
+     *    we set to whatever the user wanted at the beginning
+     *    of the run
+     ***/
+    /***
+     *    Commented this block out on 2 July 2004 because
+     *    now we have CRACKP and POROSITY.  We originally
+     *    wanted to keep the  crack from drying out due to
+     *    sealed conditions, but only POROSITY pixels now can
+     *    be consumed under sealed conditions.
+     ***/
+    /*
 
-      /* With microstructure now written, calculate pore size distribution */
-      if (Verbose_flag > 2) {
-        fprintf(Logfile,
-                "\nCalculating pore size distribution now..., Micname = %s",
-                Micname);
-        fflush(Logfile);
-      }
-      if (calcporedist3d(Micname)) {
-        if (Verbose_flag > 1) {
-          fprintf(Logfile, "\nWARNING: There was a problem calculating the "
-                           "pore size distribution.");
-        }
-        if (Verbose_flag > 2) {
-          fprintf(Logfile, "\nDone calculating pore size distribution.");
-          fflush(Logfile);
-        }
-      }
+    if ((Sealed) && (!Sealed_after_crack)) {
+        if (Verbose_flag > 1) fprintf(Logfile,"\nSwitching to saturated
+    conditions after cracking.\n");
     }
+    Sealed = Sealed_after_crack;
+    */
 
-    /* Attempt to open master data file */
+    /* Make sure we don't do this block again */
 
-    /* GODZILLA */
-    // fprintf(Logfile,
-    //         "\nJust checking in, Alpha_cur = %f, Time_cur = %f and "
-    //         "Datafilename = %s",
-    //         Alpha_cur, Time_cur, Datafilename);
-    // fflush(Logfile);
-    /* GODZILLA */
-    Datafile = filehandler("disrealnew", Datafilename, "APPEND");
-    if (!Datafile) {
-      freeallmem();
-      exit(1);
-    }
-    fprintf(Datafile, "\n%d,%.4f,%.4f,%.4f,", Cyccnt - 1, Time_cur, Alpha_cur,
-            Alpha_fa_cur);
-    fprintf(Datafile, "%.4f,%.4f,%.4f,", (Heat_new * Heat_cf), Temp_cur_b,
-            Gsratio2);
-    fprintf(Datafile, "%.4f,%.4f,%.5f,%.4f,", Wn_o, Wn_i, Chs_new, PH_cur);
-    fprintf(Datafile, "%.4f,%.4f,%.4f,%.4f,", Conductivity, Concnaplus,
-            Conckplus, Conccaplus);
-    fprintf(Datafile, "%.4f,%.4f,%.4f,%.4f,", Concsulfate, ActivityK,
-            ActivityCa, ActivityOH);
-    fprintf(Datafile, "%.4f,%.4f,", ActivitySO4,
-            ((float)Count[POROSITY] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,%.4f,", Con_fracp[0], Con_fracp[1],
-            Con_fracp[2]);
-    fprintf(Datafile, "%.4f,",
-            (Con_fracp[0] + Con_fracp[1] + Con_fracp[2]) / 3.0);
-    fprintf(Datafile, "%.4f,%.4f,%.4f,", Con_fracs[0], Con_fracs[1],
-            Con_fracs[2]);
-    fprintf(Datafile, "%.4f,",
-            (Con_fracs[0] + Con_fracs[1] + Con_fracs[2]) / 3.0);
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[C3S] / (float)Syspix),
-            ((float)Count[C2S] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[C3A] / (float)Syspix),
-            ((float)Count[OC3A] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[C4AF] / (float)Syspix),
-            ((float)Count[K2SO4] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[NA2SO4] / (float)Syspix),
-            ((float)Count[GYPSUM] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[HEMIHYD] / (float)Syspix),
-            ((float)Count[ANHYDRITE] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[CACO3] / (float)Syspix),
-            ((float)Count[FREELIME] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[SFUME] / (float)Syspix),
-            ((float)Count[INERT] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[SLAG] / (float)Syspix),
-            ((float)Count[ASG] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[CAS2] / (float)Syspix),
-            ((float)Count[AMSIL] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[CH] / (float)Syspix),
-            ((float)Count[CSH] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[POZZCSH] / (float)Syspix),
-            ((float)Count[SLAGCSH] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[C3AH6] / (float)Syspix),
-            ((float)(Count[ETTR] + Count[ETTRC4AF]) / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[AFM] / (float)Syspix),
-            ((float)Count[FH3] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[CACL2] / (float)Syspix),
-            ((float)Count[FRIEDEL] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[STRAT] / (float)Syspix),
-            ((float)Count[GYPSUMS] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f,", ((float)Count[ABSGYP] / (float)Syspix),
-            ((float)Count[AFMC] / (float)Syspix));
-    fprintf(Datafile, "%.4f,%.4f", ((float)Count[INERTAGG] / (float)Syspix),
-            ((float)Count[EMPTYP] / (float)Syspix));
-    fclose(Datafile);
+    Cracktime = End_time + 100.0;
+  }
 
-    /* Always create a JSON with progress every ten cycles */
-    /* GODZILLA */
-    // fprintf(Logfile, "\nJust checking in, Icyc = %d", Icyc);
-    // fflush(Logfile);
-    /* GODZILLA */
-    if (Icyc % 10 == 0) {
-      Datafile = filehandler("disrealnew", ProgressFileName, "WRITE");
-      if (!Datafile) {
+  /* Go on with a coarse grid once the chosen age is reached */
+
+  if ((Coarsefact == 1) &&
+      (((Coarsentime >= 0.0) && (Time_cur >= Coarsentime)) ||
+       ((Coarsenalpha >= 0.0) && (Alpha_cur >= Coarsenalpha)))) {
+    if (coarsen()) {
+      Coarsentime = Coarsenalpha = -1.0;
+    } else {
+      coarsenstatics();
+      if (setblocks()) {
         freeallmem();
+        bailout("disrealnew", "Could not allocate memory for Blockinert");
         exit(1);
       }
-      fprintf(Datafile, "json {");
-      fprintf(Datafile, "\"cycle\": %d, \"time_hours\": %.2f,", Icyc, Time_cur);
-      fprintf(Datafile,
-              " \"degree_of_hydration\": %.2f, \"timestamp\": ", Alpha_cur);
-
-      if ((clock_gettime(CLOCK_REALTIME, &tv))) {
-        fprintf(stderr, "\nERROR: Error clock_gettime");
+      if (layerbuild()) {
+        freeallmem();
+        bailout("disrealnew", "Could not allocate memory for layers of Mic");
+        exit(1);
       }
-
-      rfc8601 = rfc8601_timespec(&tv);
-      fprintf(Datafile, "\"%s\"}", rfc8601);
-      fclose(Datafile);
-      free(rfc8601);
-    }
-
-    /* Print progress data to stderr if not in quiet or silent mode */
-    if (Verbose_flag > 1) {
-      fprintf(stdout, "\nPROGRESS: Cycle=%d/%d Time=%f DOH=%f Temp=%f pH=%f",
-              Icyc, Ncyc, Time_cur, Alpha_cur, Temp_cur_b, PH_cur);
-      fflush(stdout);
     }
-
-  } /*    End of loop over all hydration cycles */
+  }
 
   /***
-   *    Hydration cycles are finished.  Clean up from here.
+   *     As currently set up, crack porosity (CRACKP) can
+   *     diffuse into regular saturated porosity (POROSITY).
+   *     Every 5 cycles after a crack is added, we call the
+   *     function resetcrackpores to redistribute these pixels
+   *     back to the crack
    ***/
 
-  /* Last call to dissolve to terminate hydration */
+  /*
+  if ((Icyc > Crackcycle) && (((Icyc - Crackcycle)%5) == 0)) {
+      resetcrackpores();
+  }
+  */
 
-  valin = 0;
-  /* GODZILLA */
-  // fprintf(Logfile, "\nJust checking in, Last call to dissolve...");
-  // fflush(Logfile);
-  /* GODZILLA */
-  dissolve(valin);
+  /* Output movie microstructure if one is desired */
+
+  log_flush(Logfile);
   /* GODZILLA */
-  // fprintf(Logfile, "\nJust checking in, Exited dissolve...");
-  // fflush(Logfile);
+  // fprintf(Logfile,
+  //         "\nJust checking in, MovieFrameFreq = %f, Time_cur = %f and "
+  //         "NextMovieTime = %f",
+  //         MovieFrameFreq, Time_cur, NextMovieTime);
+  // log_flush(Logfile);
   /* GODZILLA */
+  if ((MovieFrameFreq > 0.0) && (Time_cur >= NextMovieTime)) {
+    if (Verbose_flag > 1) {
+      fprintf(Logfile, "\nMaking movie frame");
+      log_flush(Logfile);
+    }
+    NextMovieTime = Time_cur + MovieFrameFreq;
+    perfbegin(PERFIMAGE);
+
+    /***
+     *    Frames are the middle slice normal to z, or
+     *    normal to y for a crack normal to z, with x
+     *    varying fastest.  The movie stays open from the
+     *    first frame; after a restart, frames are added
+     *    to the one already there.  A coarsened system is
+     *    shown at the original resolution, so that the
+     *    frames keep their size.
+     ***/
+
+    cf = Coarsefact;
+    if (Crackorient == 3) {
+      movnx = cf * Xsyssize;
+      movny = cf * Zsyssize;
+    } else {
+      movnx = cf * Xsyssize;
+      movny = cf * Ysyssize;
+    }
+
+    if (!Movstream.fp) {
+      Movfile = filehandler("disrealnew", Moviename, "READ_NOFAIL");
+      if (Movfile) {
+        fclose(Movfile);
+        fprintf(Logfile, "\nMovie file exists.  Appending to it...");
+        log_flush(Logfile);
+        if (movie_open(Moviename, &Movstream, 1) ||
+            Movstream.xsize != movnx || Movstream.ysize != movny) {
+          movie_close(&Movstream);
+          bailout("disrealnew", "Could not append to movie file");
+          freeallmem();
+          exit(1);
+        }
+      } else {
+        if (Verbose_flag > 1) {
+          fprintf(Logfile, "\nMovie file not found.  Creating it now...");
+          log_flush(Logfile);
+        }
+        if (movie_create(Moviename, &Movstream, movnx, movny, Res)) {
+          bailout("disrealnew", "Could not create movie file");
+          freeallmem();
+          exit(1);
+        }
+        if (Verbose_flag > 1) {
+          fprintf(Logfile, " Success.");
+          log_flush(Logfile);
+        }
+      }
+      Movframe = (unsigned char *)malloc((size_t)movnx * (size_t)movny);
+      if (!Movframe) {
+        bailout("disrealnew", "Could not allocate memory for movie frame");
+        freeallmem();
+        exit(1);
+      }
+    }
+
+    if (Crackorient == 1 || Crackorient == 2) {
+      movslice = (cf * Zsyssize / 2) / cf;
+      for (iy = 0; iy < movny; iy++) {
+        for (ix = 0; ix < movnx; ix++) {
+          Movframe[(size_t)iy * movnx + ix] =
+              (unsigned char)Mic[ix / cf][iy / cf][movslice];
+        }
+      }
+    } else {
+      movslice = (cf * Ysyssize / 2) / cf;
+      for (iz = 0; iz < movny; iz++) {
+        for (ix = 0; ix < movnx; ix++) {
+          Movframe[(size_t)iz * movnx + ix] =
+              (unsigned char)Mic[ix / cf][movslice][iz / cf];
+        }
+      }
+    }
+
+    if (movie_append(&Movstream, Movframe)) {
+      bailout("disrealnew", "Could not write movie frame");
+      freeallmem();
+      exit(1);
+    }
+    perfend(PERFIMAGE);
+
+    if (Verbose_flag > 1) {
+      fprintf(Logfile, "\nMade movie frame successfully");
+      log_flush(Logfile);
+    }
+  }
+
+  /***
+   *    Output complete 3D microstructure once for every entry
+   *    in the outputalpha.dat file
+   ***/
+
+  /* GODZILLA */
+  // fprintf(Logfile,
+  //         "\nJust checking in, Alpha_cur = %f, Time_cur = %f and "
+  //         "NextImageTime = %f",
+  //         Alpha_cur, Time_cur, NextImageTime);
+  // log_flush(Logfile);
+  /* GODZILLA */
+  if (((CustomImageTime != NULL) &&
+       (Time_cur >= CustomImageTime[customentry])) ||
+      ((Alpha_cur > 0.0) && (Time_cur >= NextImageTime))) {
+
+    if (Verbose_flag > 1) {
+      fprintf(Logfile, "\nWriting microstructure image");
+      log_flush(Logfile);
+    }
+    customentry++;
+
+    NextImageTime = Time_cur + OutTimefreq;
+    sprintf(strsuffa, "%.2fh.%d.%1d", Time_cur, (int)Temp_0, Csh2flag);
+    sprintf(strsuffb, "%1d%1d", Adiaflag, Sealed);
+    strcpy(strsuff, strsuffa);
+    strcat(strsuff, strsuffb);
+    sprintf(Micname, "%s%s.img.", WorkingDirectory, Fileroot);
+    strcat(Micname, strsuff);
+    if (Verbose_flag > 1) {
+      fprintf(Logfile, "\nI think Micname is %s", Micname);
+      log_flush(Logfile);
+    }
+    /* GODZILLA */
+
+    /* Written and indexed by the snapshot writer (see snapshot.h) */
+
+    perfbegin(PERFIMAGE);
+    if (snapsave(Micname, Time_cur)) {
+      bailout("disrealnew", Snaperrmsg);
+      freeallmem();
+      exit(1);
+    }
+    perfend(PERFIMAGE);
+  }
+
+  /* Analyses of the microstructure at the ages asked for */
+
+  if (insitucheck(Time_cur)) {
+    bailout("disrealnew", Snaperrmsg);
+    freeallmem();
+    exit(1);
+  }
+
+  /* Attempt to open master data file */
+
+  /* GODZILLA */
+  // fprintf(Logfile,
+  //         "\nJust checking in, Alpha_cur = %f, Time_cur = %f and "
+  //         "Datafilename = %s",
+  //         Alpha_cur, Time_cur, Datafilename);
+  // log_flush(Logfile);
+  /* GODZILLA */
+  Datafile = outopen(OUTDATA, Datafilename);
+  if (!Datafile) {
+    freeallmem();
+    exit(1);
+  }
+  fprintf(Datafile, "\n%d,%.4f,%.4f,%.4f,", Cyccnt - 1, Time_cur, Alpha_cur,
+          Alpha_fa_cur);
+  fprintf(Datafile, "%.4f,%.4f,%.4f,", (Heat_new * Heat_cf), Temp_cur_b,
+          Gsratio2);
+  fprintf(Datafile, "%.4f,%.4f,%.5f,%.4f,", Wn_o, Wn_i, Chs_new, PH_cur);
+  fprintf(Datafile, "%.4f,%.4f,%.4f,%.4f,", Conductivity, Concnaplus,
+          Conckplus, Conccaplus);
+  fprintf(Datafile, "%.4f,%.4f,%.4f,%.4f,", Concsulfate, ActivityK,
+          ActivityCa, ActivityOH);
+  fprintf(Datafile, "%.4f,%.4f,", ActivitySO4,
+          ((float)Count[POROSITY] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,%.4f,", Con_fracp[0], Con_fracp[1],
+          Con_fracp[2]);
+  fprintf(Datafile, "%.4f,",
+          (Con_fracp[0] + Con_fracp[1] + Con_fracp[2]) / 3.0);
+  fprintf(Datafile, "%.4f,%.4f,%.4f,", Con_fracs[0], Con_fracs[1],
+          Con_fracs[2]);
+  fprintf(Datafile, "%.4f,",
+          (Con_fracs[0] + Con_fracs[1] + Con_fracs[2]) / 3.0);
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[C3S] / (float)Syspix),
+          ((float)Count[C2S] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[C3A] / (float)Syspix),
+          ((float)Count[OC3A] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[C4AF] / (float)Syspix),
+          ((float)Count[K2SO4] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[NA2SO4] / (float)Syspix),
+          ((float)Count[GYPSUM] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[HEMIHYD] / (float)Syspix),
+          ((float)Count[ANHYDRITE] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[CACO3] / (float)Syspix),
+          ((float)Count[FREELIME] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[SFUME] / (float)Syspix),
+          ((float)Count[INERT] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[SLAG] / (float)Syspix),
+          ((float)Count[ASG] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[CAS2] / (float)Syspix),
+          ((float)Count[AMSIL] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[CH] / (float)Syspix),
+          ((float)Count[CSH] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[POZZCSH] / (float)Syspix),
+          ((float)Count[SLAGCSH] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[C3AH6] / (float)Syspix),
+          ((float)(Count[ETTR] + Count[ETTRC4AF]) / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[AFM] / (float)Syspix),
+          ((float)Count[FH3] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[CACL2] / (float)Syspix),
+          ((float)Count[FRIEDEL] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[STRAT] / (float)Syspix),
+          ((float)Count[GYPSUMS] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f,", ((float)Count[ABSGYP] / (float)Syspix),
+          ((float)Count[AFMC] / (float)Syspix));
+  fprintf(Datafile, "%.4f,%.4f", ((float)Count[INERTAGG] / (float)Syspix),
+          ((float)Count[EMPTYP] / (float)Syspix));
+  outflush(0);
+
+  /* Always create a JSON with progress every ten cycles */
+  /* GODZILLA */
+  // fprintf(Logfile, "\nJust checking in, Icyc = %d", Icyc);
+  // log_flush(Logfile);
+  /* GODZILLA */
+  if (Icyc % 10 == 0) {
+    Datafile = filehandler("disrealnew", ProgressFileName, "WRITE");
+    if (!Datafile) {
+      freeallmem();
+      exit(1);
+    }
+    fprintf(Datafile, "json {");
+    fprintf(Datafile, "\"cycle\": %d, \"time_hours\": %.2f,", Icyc, Time_cur);
+    fprintf(Datafile,
+            " \"degree_of_hydration\": %.2f, \"timestamp\": ", Alpha_cur);
+
+    if ((clock_gettime(CLOCK_REALTIME, &tv))) {
+      fprintf(stderr, "\nERROR: Error clock_gettime");
+    }
+
+    rfc8601 = rfc8601_timespec(&tv);
+    fprintf(Datafile, "\"%s\"}", rfc8601);
+    fclose(Datafile);
+    free(rfc8601);
+  }
+
+  /* Stream the state of this cycle if asked to */
+  streamcycle(Icyc);
+  liveupdate(0);
+
+  /***
+   *    Print progress data to stdout if not in quiet or silent
+   *    mode, unless progress is being streamed there or this is
+   *    a member of an ensemble
+   ***/
+  if (Verbose_flag > 1 && Ensmember < 0 &&
+      !(Streamfile && Streamfile == stdout)) {
+    fprintf(stdout, "\nPROGRESS: Cycle=%d/%d Time=%f DOH=%f Temp=%f pH=%f",
+            Icyc, Ncyc, Time_cur, Alpha_cur, Temp_cur_b, PH_cur);
+    fflush(stdout);
+  }
+
+  perfend(PERFCYCLE);
+
+  /* A look at the run asked for with SIGUSR1 or --demand */
+  demandserve(customentry, previousUncorrectedTime);
+
+  perfrow(Icyc, Time_cur);
+
+  /* Save the state every Ckptfreq cycles */
+
+  if ((Ckptfreq > 0) && (Icyc % Ckptfreq == 0) && !cycflag) {
+    if (writecheckpoint(customentry, previousUncorrectedTime)) {
+      fprintf(stderr, "\nWARNING: Could not write checkpoint %s", Ckptname);
+      fflush(stderr);
+    }
+  }
+
+  Icyc++;
+
+  return;
+}
+
+/***
+ *    hydfinish
+ *
+ *     Finish the run once the cycles are done: the last
+ *     dissolution step, the final image and data, and the
+ *     closing entries in the log
+ *
+ *     Arguments:    None
+ *     Returns:    0 if okay, nonzero otherwise
+ *
+ *    Calls:        dissolve, burn3d, burnset, pHpred, streamdone, ...
+ *    Called by:    main program, hyd_finish
+ ***/
+int hydfinish(void) {
+  int valin, ix, iy, iz, i, rf;
+  int streamout;
+  double gfloat, space, time_spent;
+  char buff[MAXSTRING];
+  time_t current_time;
+  clock_t end;
+  struct tm *local_time;
+  FILE *outfile;
+
+  waitcheckpoint();
+  perfclose();
+  trace_report(Logfile);
+  if (Adaptive) {
+    fprintf(Logfile, "\nSkipped the census in %d quiet cycles", Adaptskipped);
+  }
+  if (Adaptsteps) {
+    fprintf(Logfile, "\nEnded the diffusion steps early in %d cycles",
+            Adaptstopped);
+  }
+
+  /***
+   *    Hydration cycles are finished.  Clean up from here.
+   ***/
+
+  /* Last call to dissolve to terminate hydration */
+
+  valin = 0;
+  /* GODZILLA */
+  // fprintf(Logfile, "\nJust checking in, Last call to dissolve...");
+  // log_flush(Logfile);
+  /* GODZILLA */
+  dissolve(valin);
+  /* GODZILLA */
+  // fprintf(Logfile, "\nJust checking in, Exited dissolve...");
+  // log_flush(Logfile);
+  /* GODZILLA */
+  liveupdate(1);
+
+  /* Output final microstructure, after any images still being written */
+
+  if (snapwait()) {
+    bailout("disrealnew", Snaperrmsg);
+    freeallmem();
+    exit(1);
+  }
 
-  /* Output final microstructure */
-
   outfile = filehandler("disrealnew", Fileoname, "WRITE");
   if (!outfile) {
     freeallmem();
@@ -1421,23 +1605,37 @@ int main(int argc, char *argv[]) {
   fprintf(Imageindexfile, "\n%f\t%s", Time_cur, Fileoname);
   fclose(Imageindexfile);
 
-  if (write_imgheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res)) {
+  /* A coarsened system may be written at the original resolution */
+
+  rf = Coarsenrefine ? Coarsefact : 1;
+  if (write_imgheader(outfile, rf * Xsyssize, rf * Ysyssize, rf * Zsyssize,
+                      Res / (float)rf)) {
     fclose(outfile);
     freeallmem();
     bailout("disrealnew", "Error writing image header");
     exit(1);
   }
 
-  for (ix = 0; ix < Xsyssize; ix++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      for (iz = 0; iz < Zsyssize; iz++) {
-        fprintf(outfile, "\n%d", (int)Mic[ix][iy][iz]);
+  for (ix = 0; ix < rf * Xsyssize; ix++) {
+    for (iy = 0; iy < rf * Ysyssize; iy++) {
+      for (iz = 0; iz < rf * Zsyssize; iz++) {
+        fprintf(outfile, "\n%d", (int)Mic[ix / rf][iy / rf][iz / rf]);
       }
     }
   }
   fclose(outfile);
 
-  if (calcporedist3d(Fileoname)) {
+  /* The final microstructure may go on in memory to an attack model */
+
+  if (strlen(Handoffout) > 0 && snaphandoff(Handoffout, rf)) {
+    freeallmem();
+    bailout("disrealnew", "Error handing off the final microstructure");
+    exit(1);
+  }
+
+  /* Pore size distribution straight from Mic, without reading it back */
+
+  if (calcporedist3dmic(Fileoname, Mic, Xsyssize, Ysyssize, Zsyssize, rf)) {
     if (Verbose_flag > 1) {
       fprintf(Logfile,
               "\nThere was a problem calculating the pore size distribution.");
@@ -1454,36 +1652,28 @@ int main(int argc, char *argv[]) {
   if ((Burntimefreq > 0.0) && (Burntimefreq <= End_time) &&
       ((Porefl1 + Porefl2 + Porefl3) != 0)) {
 
-    /* Burn across x */
-    Porefl1 = burn3d(((int)POROSITY), ((int)CRACKP), 1, 0, 0);
-    if (Porefl1 == MEMERR) {
-      freeallmem();
-      bailout("disrealnew", "Problem in burn3d");
-      exit(1);
-    }
-    /* Burn across y */
-    Porefl2 = burn3d(((int)POROSITY), ((int)CRACKP), 0, 1, 0);
-    if (Porefl2 == MEMERR) {
-      freeallmem();
-      bailout("disrealnew", "Problem in burn3d");
-      exit(1);
-    }
-    /* Burn across z */
-    Porefl3 = burn3d(((int)POROSITY), ((int)CRACKP), 0, 0, 1);
-    if (Porefl3 == MEMERR) {
+    if (burn3d(((int)POROSITY), ((int)CRACKP), burnflag) == MEMERR) {
       freeallmem();
       bailout("disrealnew", "Problem in burn3d");
       exit(1);
     }
+    Porefl1 = burnflag[0];
+    Porefl2 = burnflag[1];
+    Porefl3 = burnflag[2];
   }
 
   /* Check percolation of solids (set point) */
 
   if ((Settimefreq > 0.0) && (Settimefreq <= End_time) && (!Setflag)) {
 
-    Sf1 = burnset(1, 0, 0); /* Burn across x */
-    Sf2 = burnset(0, 1, 0); /* Burn across y */
-    Sf3 = burnset(0, 0, 1); /* Burn across z */
+    if (burnset(burnflag) == MEMERR) {
+      freeallmem();
+      bailout("disrealnew", "Problem in burnset");
+      exit(1);
+    }
+    Sf1 = burnflag[0];
+    Sf2 = burnflag[1];
+    Sf3 = burnflag[2];
 
     Setflag = Sf1 * Sf2 * Sf3;
     if (Verbose_flag > 2) {
@@ -1494,7 +1684,7 @@ int main(int argc, char *argv[]) {
   /* Output last lines of heat and chemical shrinkage files */
 
   if (Cyccnt > 1) {
-    Time_step = ((2.0 * ((float)Cyccnt)) - 1.0) * Beta / Krate;
+    Time_step = coarseclock(Cyccnt) * Beta / Krate;
     Time_cur += Time_step;
   }
 
@@ -1522,13 +1712,13 @@ int main(int argc, char *argv[]) {
 
   if (Verbose_flag > 1) {
     fprintf(Logfile, "\nMaking final call to pHpred...");
-    fflush(Logfile);
+    log_flush(Logfile);
   }
   pHpred();
 
   /* Attempt to open master data file */
 
-  Datafile = filehandler("disrealnew", Datafilename, "APPEND");
+  Datafile = outopen(OUTDATA, Datafilename);
   if (!Datafile) {
     freeallmem();
     exit(1);
@@ -1586,7 +1776,7 @@ int main(int argc, char *argv[]) {
           ((float)Count[AFMC] / (float)Syspix));
   fprintf(Datafile, "%.4f,%.4f", ((float)Count[INERTAGG] / (float)Syspix),
           ((float)Count[EMPTYP] / (float)Syspix));
-  fclose(Datafile);
+  outclose();
 
   /* Attempt to open time history file */
 
@@ -1614,11 +1804,15 @@ int main(int argc, char *argv[]) {
   fprintf(Logfile, "\nEnd time: %s", asctime(local_time));
   fprintf(Logfile, "\nElapsed time: %.3f", time_spent);
   fprintf(Logfile, "\n\n=== END DISREALNEW SIMULATION ===");
-  fflush(Logfile);
-  fclose(Logfile);
+  log_flush(Logfile);
 
-  /* Write simulation results to stdout in JSON format */
-  if (Verbose_flag > 0) {
+  /***
+   *    Write simulation results to stdout in JSON format, or
+   *    as the last progress record if progress goes to stdout
+   ***/
+  streamout = (Streamfile && Streamfile == stdout);
+  streamdone(time_spent);
+  if (Verbose_flag > 0 && !streamout && Ensmember < 0) {
     fprintf(stdout, "\n{");
     fprintf(stdout, "\n\t\"status\": \"completed\",");
     fprintf(stdout, "\n\t\"final_doh\": %.3f,", Alpha_cur);
@@ -1642,57 +1836,232 @@ int main(int argc, char *argv[]) {
     fprintf(stdout, "\n}");
   }
 
-  fclose(thfile);
-  freeallmem();
   return (0);
 }
 
 /***
- *    checkargs
+ *    hydfree
  *
- *     Check command-line arguments used to invoke disrealnew
+ *     Release everything held by the run
  *
- *     Arguments:    int argc, char *argv[]
- *     Returns:    nothing
+ *     Arguments:    None
+ *     Returns:    Nothing
  *
- *    Calls:        no routines
- *    Called by:    main program
+ *    Calls:        freeallmem
+ *    Called by:    main program, hyd_close
  ***/
-int checkargs(int argc, char **argv) {
-  int wellformed = 0; /* 0 = false, 1 = true */
-  char *jsonname, *wdirname, *pfilename, lastchar;
-  char buff[MAXSTRING];
+void hydfree(void) {
+  if (thfile)
+    fclose(thfile);
+  thfile = NULL;
+  freeallmem();
 
-  strcpy(ParameterFileName, "");
-  strcpy(WorkingDirectory, "");
-  strcpy(ProgressFileName, "");
+  return;
+}
 
-  if (argc < 3) {
-    wellformed = 0;
-  }
+/***
+ *    coarsenstatics
+ *
+ *     Bring the stage statics to a coarsened system: the
+ *     diffusion steps per cycle, the nucleation scale factors,
+ *     which go with the number of pixels, and the nucleation
+ *     probabilities, which apply at each of the fewer diffusion
+ *     steps
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    hydinit, hydcycle
+ ***/
+void coarsenstatics(void) {
+  float fact;
 
-  // Many of the variables here are defined in the getopts.h system header
-  // file Can define more options here if we want
+  fact = 1.0 / (float)(Coarsefact * Coarsefact * Coarsefact);
 
-  /* Default verbosity */
-  Verbose_flag = 2;
+  ntimes = (int)Maxdiffsteps;
+  pscalech *= fact;
+  pscalegyp *= fact;
+  pscalehg *= fact;
+  pscalefh3 *= fact;
 
-  static struct option long_opts[] = {
-      /* These options set a flag */
-      {"verbose", no_argument, &Verbose_flag, 3},
-      {"quiet", no_argument, &Verbose_flag, 1},
-      {"silent", no_argument, &Verbose_flag, 0},
-      /* These options don't set a flag */
-      {"json", required_argument, 0, 'j'},
-      {"workdir", required_argument, 0, 'w'},
-      {"parameters", required_argument, 0, 'p'},
-      {"help", no_argument, 0, 'h'},
+  fact = (float)(Coarsefact * Coarsefact);
+  pnucch = (pnucch * fact < 1.0) ? pnucch * fact : 1.0;
+  pnucgyp = (pnucgyp * fact < 1.0) ? pnucgyp * fact : 1.0;
+  pnuchg = (pnuchg * fact < 1.0) ? pnuchg * fact : 1.0;
+  pnucfh3 = (pnucfh3 * fact < 1.0) ? pnucfh3 * fact : 1.0;
+
+  return;
+}
+
+/***
+ *    adaptquiet
+ *
+ *     Whether this cycle is quiet enough, with --adaptive, to
+ *     go without the census of the whole system.  In the
+ *     dormant period and at late ages a cycle changes only a
+ *     few pixels, and dissolve and hydrate keep Count up to
+ *     date for nearly all of them, so the census changes next
+ *     to nothing.  It is still taken after every cycle that is
+ *     not quiet and at least every ADAPTMAXSKIP cycles, so the
+ *     counts can never drift far.
+ *
+ *     Arguments:    None
+ *     Returns:    1 if the census can be skipped, 0 otherwise
+ *
+ *    Calls:        No other routines
+ *    Called by:    hydcycle
+ ***/
+int adaptquiet(void) {
+  long changed;
+
+  if (!Adaptive)
+    return (0);
+
+  changed = (long)Nmade + Perfcount[PERFANTSGONE] + (long)Nnucleate;
+  if (changed * ADAPTQUIET >= (long)Syspix || Adaptskip >= ADAPTMAXSKIP) {
+    Adaptskip = 0;
+    return (0);
+  }
+
+  Adaptskip++;
+  Adaptskipped++;
+
+  return (1);
+}
+
+#ifndef VCCTL_HYDLIB
+int main(int argc, char *argv[]) {
+  int status;
+
+#ifdef VCCTL_MPI
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &Mpirank);
+  MPI_Comm_size(MPI_COMM_WORLD, &Mpisize);
+#endif
+
+  status = hydinit(argc, argv);
+  if (status == ENSDONE) {
+#if !defined(_WIN32)
+    status = ensfinish();
+#endif
+    hydfree();
+    log_close(Logfile);
+    return (status);
+  } else if (status != 0) {
+    return (1);
+  }
+
+  while (hydrunning()) {
+    hydcycle();
+  }
+
+  hydfinish();
+#if defined(VCCTL_MPI) && !defined(_WIN32)
+  if (Mpisize > 1)
+    status = ensmpifinish(status);
+#endif
+  hydfree();
+  if (Logfile)
+    log_close(Logfile);
+
+#ifdef VCCTL_MPI
+  MPI_Finalize();
+#endif
+
+  return (status);
+}
+#endif
+
+/***
+ *    checkargs
+ *
+ *     Check command-line arguments used to invoke disrealnew
+ *
+ *     Arguments:    int argc, char *argv[]
+ *     Returns:    nothing
+ *
+ *    Calls:        no routines
+ *    Called by:    main program
+ ***/
+int checkargs(int argc, char **argv) {
+  int wellformed = 0; /* 0 = false, 1 = true */
+  char *jsonname, *wdirname, *pfilename, lastchar;
+  char buff[MAXSTRING];
+
+  strcpy(ParameterFileName, "");
+  strcpy(WorkingDirectory, "");
+  strcpy(ProgressFileName, "");
+  strcpy(Restartname, "");
+  strcpy(Perfname, "");
+  strcpy(Seriesname, "");
+  strcpy(Streamdest, "");
+  strcpy(Livename, "");
+  strcpy(Demandname, "");
+  strcpy(Bundlename, "");
+  strcpy(Insituname, "");
+  strcpy(Handoffname, "");
+  strcpy(Handoffout, "");
+  strcpy(Tracename, "");
+
+  if (argc < 3) {
+    wellformed = 0;
+  }
+
+  // Many of the variables here are defined in the getopts.h system header
+  // file Can define more options here if we want
+
+  /* Default verbosity */
+  Verbose_flag = 2;
+
+  static struct option long_opts[] = {
+      /* These options set a flag */
+      {"verbose", no_argument, &Verbose_flag, 3},
+      {"quiet", no_argument, &Verbose_flag, 1},
+      {"silent", no_argument, &Verbose_flag, 0},
+      {"legacy-ants", no_argument, &Bucketants, 0},
+      {"coarsen-refine", no_argument, &Coarsenrefine, 1},
+      {"fast-moves", no_argument, &Fastmoves, 1},
+      {"adaptive", no_argument, &Adaptive, 1},
+      {"adaptive-steps", no_argument, &Adaptsteps, 1},
+      {"tiled-grids", no_argument, &Tiledgrids, 1},
+      {"lean-grids", no_argument, &Leangrids, 1},
+      {"sorted-ants", no_argument, &Sortants, 1},
+      {"solid-layer", no_argument, &Solidlayer, 1},
+      {"bit-planes", no_argument, &Bitplanes, 1},
+      {"analyze-background", no_argument, &Insituback, 1},
+      {"counters", no_argument, &Tracecounters, 1},
+      {"vtk", no_argument, &Vtkout, 1},
+      /* These options don't set a flag */
+      {"json", required_argument, 0, 'j'},
+      {"workdir", required_argument, 0, 'w'},
+      {"parameters", required_argument, 0, 'p'},
+      {"threads", required_argument, 0, 't'},
+      {"checkpoint", required_argument, 0, 'c'},
+      {"restart", required_argument, 0, 'r'},
+      {"perf", required_argument, 0, 'f'},
+      {"stream", required_argument, 0, 'S'},
+      {"ensemble", required_argument, 0, 'e'},
+      {"bundle", required_argument, 0, 'b'},
+      {"coarsen-time", required_argument, 0, 'T'},
+      {"coarsen-alpha", required_argument, 0, 'a'},
+      {"flush-secs", required_argument, 0, 'F'},
+      {"series", required_argument, 0, 'i'},
+      {"live", required_argument, 0, 'L'},
+      {"live-every", required_argument, 0, 'N'},
+      {"demand", required_argument, 0, 'D'},
+      {"analyze", required_argument, 0, 'A'},
+      {"analyze-at", required_argument, 0, 'G'},
+      {"handoff", required_argument, 0, 'H'},
+      {"handoff-out", required_argument, 0, 'O'},
+      {"trace", required_argument, 0, 'R'},
+      {"help", no_argument, 0, 'h'},
       {NULL, 0, 0, 0}};
 
   int opt_char;
   int option_index;
 
-  while ((opt_char = getopt_long(argc, argv, "j:w:p:h", long_opts,
+  while ((opt_char = getopt_long(argc, argv, "j:w:p:t:c:r:f:S:e:b:T:a:F:i:h", long_opts,
                                  &option_index)) != -1) {
     switch (opt_char) {
     case (0):
@@ -1715,6 +2084,99 @@ int checkargs(int argc, char **argv) {
       pfilename = optarg;
       strcpy(ParameterFileName, pfilename);
       break;
+    // -t or --threads
+    case (int)('t'):
+      Antthreads = atoi(optarg);
+      if (Antthreads < 0)
+        Antthreads = 0;
+      break;
+    // -c or --checkpoint
+    case (int)('c'):
+      Ckptfreq = atoi(optarg);
+      if (Ckptfreq < 0)
+        Ckptfreq = 0;
+      break;
+    // -r or --restart
+    case (int)('r'):
+      strcpy(Restartname, optarg);
+      break;
+    // -f or --perf
+    case (int)('f'):
+      Perfon = 1;
+      strcpy(Perfname, optarg);
+      break;
+    // -S or --stream
+    case (int)('S'):
+      strcpy(Streamdest, optarg);
+      break;
+    // -e or --ensemble
+    case (int)('e'):
+      Ensnum = atoi(optarg);
+      if (Ensnum < 0)
+        Ensnum = 0;
+      break;
+    // -b or --bundle
+    case (int)('b'):
+      strcpy(Bundlename, optarg);
+      break;
+    // -T or --coarsen-time
+    case (int)('T'):
+      Coarsentime = atof(optarg);
+      break;
+    // -a or --coarsen-alpha
+    case (int)('a'):
+      Coarsenalpha = atof(optarg);
+      break;
+    // -F or --flush-secs
+    case (int)('F'):
+      Outflushsecs = atof(optarg);
+      if (Outflushsecs < 0.0)
+        Outflushsecs = 0.0;
+      break;
+    // -i or --series
+    case (int)('i'):
+      strcpy(Seriesname, optarg);
+      break;
+    // --live
+    case (int)('L'):
+      strcpy(Livename, optarg);
+      break;
+    // --live-every
+    case (int)('N'):
+      Liveevery = atoi(optarg);
+      if (Liveevery < 1)
+        Liveevery = 1;
+      break;
+    // --demand
+    case (int)('D'):
+      strcpy(Demandname, optarg);
+      break;
+    // --analyze
+    case (int)('A'):
+      if (insitulist(optarg)) {
+        fprintf(stderr, "\nERROR: Unknown analysis in %s\n", optarg);
+        wellformed = 0;
+      }
+      break;
+    // --analyze-at
+    case (int)('G'):
+      if (insituages(optarg)) {
+        fprintf(stderr, "\nERROR: Could not read the ages %s\n", optarg);
+        wellformed = 0;
+      }
+      break;
+    // --handoff
+    case (int)('H'):
+      strcpy(Handoffname, optarg);
+      break;
+    // --handoff-out
+    case (int)('O'):
+      strcpy(Handoffout, optarg);
+      break;
+    // --trace
+    case (int)('R'):
+      strcpy(Tracename, optarg);
+      break;
     // -h or --help
     case (int)('h'):
       wellformed = 0;
@@ -1728,6 +2190,15 @@ int checkargs(int argc, char **argv) {
     }
   }
 
+  /* Ages without a list of analyses do them all */
+
+  if (Ninsitu > 0 && !Insitu)
+    Insitu = INSITUCENSUS | INSITUPORES | INSITUPERC;
+  if (Insitu && Ninsitu == 0) {
+    fprintf(stderr, "\nERROR: --analyze needs the ages from --analyze-at\n");
+    wellformed = 0;
+  }
+
   if (wellformed != 1 || strlen(ProgressFileName) == 0 ||
       strlen(ParameterFileName) == 0 || strlen(WorkingDirectory) == 0) {
     printHelp();
@@ -1758,6 +2229,58 @@ int checkargs(int argc, char **argv) {
   sprintf(ParameterFileName, "%s%s", WorkingDirectory, buff);
   strcpy(buff, ProgressFileName);
   sprintf(ProgressFileName, "%s%s", WorkingDirectory, buff);
+  if (strlen(Restartname) > 0) {
+    strcpy(buff, Restartname);
+    sprintf(Restartname, "%s%s", WorkingDirectory, buff);
+  }
+  if (strlen(Perfname) > 0) {
+    strcpy(buff, Perfname);
+    sprintf(Perfname, "%s%s", WorkingDirectory, buff);
+  }
+  if (strlen(Tracename) > 0) {
+    strcpy(buff, Tracename);
+    sprintf(Tracename, "%s%s", WorkingDirectory, buff);
+  }
+  if (strlen(Demandname) > 0) {
+    strcpy(buff, Demandname);
+    sprintf(Demandname, "%s%s", WorkingDirectory, buff);
+  }
+  if (strlen(Seriesname) > 0) {
+    strcpy(buff, Seriesname);
+    sprintf(Seriesname, "%s%s", WorkingDirectory, buff);
+  }
+
+  /* Under MPI with more than one rank, each rank runs one member */
+
+  if (Mpisize > 1)
+    Ensnum = Mpisize;
+
+  /* Members of an ensemble cannot share a pipe or socket */
+
+  if (Ensnum > 0 &&
+      (!strcmp(Streamdest, "-") || !strcmp(Streamdest, "stdout") ||
+       !strncmp(Streamdest, "fd:", 3) || !strncmp(Streamdest, "unix:", 5))) {
+    fprintf(stderr, "\nERROR: --ensemble can only stream to a file\n\n");
+    return (1);
+  }
+
+  /* A stream given as a relative file name is in the working directory */
+
+  if (strlen(Streamdest) > 0 && strcmp(Streamdest, "-") &&
+      strcmp(Streamdest, "stdout") && strncmp(Streamdest, "fd:", 3) &&
+      strncmp(Streamdest, "unix:", 5) && Streamdest[0] != '/' &&
+      Streamdest[0] != '\\' && Streamdest[1] != ':') {
+    strcpy(buff, Streamdest);
+    sprintf(Streamdest, "%s%s", WorkingDirectory, buff);
+  }
+
+  /* So is a bundle, which may also be shared with other runs */
+
+  if (strlen(Bundlename) > 0 && Bundlename[0] != '/' &&
+      Bundlename[0] != '\\' && Bundlename[1] != ':') {
+    strcpy(buff, Bundlename);
+    sprintf(Bundlename, "%s%s", WorkingDirectory, buff);
+  }
 
   return (0);
 }
@@ -1790,6 +2313,108 @@ void printHelp(void) {
                   "progress updates to stderr\n");
   fprintf(stderr, "Silent mode: Suppress all output except critical errors "
                   "to stderr\n\n");
+  fprintf(stderr, "    --legacy-ants processes diffusing species in order of "
+                  "creation\n      instead of one species at a time\n");
+  fprintf(stderr, "    -t,--threads n moves diffusing species in slabs on n "
+                  "threads; the\n      result depends on the seed but not "
+                  "on n\n");
+  fprintf(stderr, "    --fast-moves draws the steps of diffusing species "
+                  "in batches from\n      a faster generator; the result is "
+                  "statistically the same but\n      not identical to one "
+                  "without it\n");
+  fprintf(stderr, "    --adaptive skips the census of the whole system "
+                  "in quiet cycles,\n      which change too few pixels "
+                  "to matter, at most %d in a row\n",
+          ADAPTMAXSKIP);
+  fprintf(stderr, "    --adaptive-steps ends the diffusion steps of a cycle "
+                  "once the\n      diffusing species left have stopped "
+                  "reacting; the result is\n      statistically the same "
+                  "but not identical to one without it\n");
+  fprintf(stderr, "    --tiled-grids keeps the rows of the microstructure "
+                  "in Z-curve\n      order, so the neighbors of a pixel "
+                  "are close together in\n      memory; the result is the "
+                  "same\n");
+  fprintf(stderr, "    --lean-grids makes the grids of particle "
+                  "hydration, C-S-H age\n      and surface deactivation "
+                  "only if the parameter file uses\n      them; the "
+                  "result is the same\n");
+  fprintf(stderr, "    --sorted-ants moves the diffusing species of each "
+                  "kind in the\n      order of their position every %d "
+                  "steps; the result is\n      statistically the same but "
+                  "not identical to one without it\n",
+          SORTANTSTEPS);
+  fprintf(stderr, "    --solid-layer keeps a copy of the microstructure "
+                  "with the\n      diffusing species shown as porosity, "
+                  "from which images are\n      saved; the result is the "
+                  "same\n");
+  fprintf(stderr, "    --bit-planes keeps one bit per pixel for porosity, "
+                  "crack porosity,\n      solids and clinker, for faster "
+                  "tests of the pore space;\n      the result is the same\n");
+  fprintf(stderr, "    -c,--checkpoint n saves the state every n cycles in "
+                  "the working\n      directory, for use with --restart\n");
+  fprintf(stderr, "    -r,--restart checkpoint_file continues an interrupted "
+                  "run from its\n      checkpoint; use the same parameter "
+                  "file and options\n");
+  fprintf(stderr, "    -f,--perf table.csv writes the time spent in each "
+                  "part of every\n      cycle, with event counts, to "
+                  "table.csv in the working directory\n");
+  fprintf(stderr, "    -S,--stream dest writes a JSON progress record "
+                  "every cycle, one per\n      line, to dest: - (stdout), "
+                  "fd:n, unix:socket_path or a file\n");
+  fprintf(stderr, "    -e,--ensemble n runs n copies of the simulation "
+                  "with seeds\n      seed, seed+1, ... from one loaded "
+                  "microstructure, each in\n      working_dir/memberk, "
+                  "with all of their data in one table; under mpirun "
+                  "(MPI builds)\n      each rank runs one member\n");
+  fprintf(stderr, "    -b,--bundle file keeps the parameter file and the "
+                  "other small text\n      inputs in one binary file, "
+                  "written on the first run and read\n      by later ones "
+                  "while the inputs are unchanged\n");
+  fprintf(stderr, "    -T,--coarsen-time hours, -a,--coarsen-alpha doh "
+                  "go on with 2x2x2 blocks\n      of pixels as one, at "
+                  "twice the resolution, from that time or\n      degree "
+                  "of hydration; --coarsen-refine writes images at the\n"
+                  "      original resolution\n");
+  fprintf(stderr, "    -F,--flush-secs s writes the lines of the data file "
+                  "and the other\n      files added to every cycle at "
+                  "most every s seconds (default 5;\n      0 for every "
+                  "cycle)\n");
+  fprintf(stderr, "    -i,--series file adds the microstructure images to "
+                  "one file in the\n      working directory, holding "
+                  "only the voxels that change from one\n      image to "
+                  "the next, in place of an ASCII file for each\n");
+  fprintf(stderr, "    --vtk also writes each microstructure image as a "
+                  "compressed VTK\n      image file (.vti) for ParaView\n");
+  fprintf(stderr, "    --live name shares the microstructure and progress "
+                  "with the UI in\n      the shared memory segment name, "
+                  "updated every --live-every n\n      cycles (default "
+                  "10); not on Windows\n");
+  fprintf(stderr, "    --demand file saves an image, a checkpoint and "
+                  "root.status at the\n      end of the cycle once file "
+                  "appears in the working directory\n      (and removes "
+                  "it), as SIGUSR1 does\n");
+  fprintf(stderr, "    --analyze-at t1,t2,... analyzes the microstructure "
+                  "in memory at the\n      ages t1, t2, ... hours, adding "
+                  "the results to\n      HydrationOf_root.insitu.csv; "
+                  "--analyze list chooses the\n      analyses among census, "
+                  "pores and perc (default all), and\n      "
+                  "--analyze-background does them on the image writer "
+                  "thread\n      while hydration carries on\n");
+  fprintf(stderr, "    --handoff name reads the microstructure and particle "
+                  "images that\n      genmic --handoff name left in shared "
+                  "memory, in place of the\n      image files of the "
+                  "parameter file; not on Windows\n");
+  fprintf(stderr, "    --handoff-out name also leaves the final "
+                  "microstructure in shared\n      memory for "
+                  "chlorattack3d or sulfattack3d --handoff name; not\n"
+                  "      on Windows\n");
+  fprintf(stderr, "    --trace file writes a timeline of the run to file "
+                  "in the working\n      directory, for the Chrome trace "
+                  "viewer or Perfetto: each part of\n      every cycle, "
+                  "each slab of the parallel sweeps and each image\n      "
+                  "written by the writer thread; --counters adds the "
+                  "cycles,\n      instructions and cache misses of the main "
+                  "thread (Linux)\n\n");
   return;
 }
 
@@ -1812,7 +2437,10 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
   int nlen, phtodo, valin, ovalin, dphase, deactphase;
   int ix, iy, iz, x, y;
   int newx, newy, newz;
-  int nadd;
+  int nadd, imgformat, pimgformat;
+  size_t m, nplane;
+  unsigned char *plane;
+  int *slab;
   char ch, imgfile[MAXSTRING], pimgfile[MAXSTRING];
   char buff[MAXSTRING], custcycfile[MAXSTRING];
   char *name, answer[MAXSTRING], calfilename[MAXSTRING];
@@ -1888,7 +2516,13 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     return (1);
   }
 
-  fflush(Logfile);
+  /* Phases without a Onevoxelbias line in the parameter file have none */
+
+  for (i = 0; i <= NSPHASES; i++) {
+    Onepixelbias[i] = 1.0;
+  }
+
+  log_flush(Logfile);
 
   /***
    *    Allocate memory for the activation/deactivation start
@@ -1904,7 +2538,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     bailout("disrealnew", "Could not allocate memory for Startflag");
     return (1);
   }
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (Verbose_flag > 2) {
     fprintf(stderr, "\nDEBUG: Allocating Stopflag ...");
@@ -1915,7 +2549,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     bailout("disrealnew", "Could not allocate memory for Stopflag");
     return (1);
   }
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (Verbose_flag > 2) {
     fprintf(stderr, "\nDEBUG: Allocating Deactphaselist ...");
@@ -1926,7 +2560,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     bailout("disrealnew", "Could not allocate memory for Deactphaselist");
     return (1);
   }
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (Verbose_flag > 2) {
     fprintf(stderr, "\nDEBUG: Allocating Deactfrac ...");
@@ -1937,7 +2571,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     bailout("disrealnew", "Could not allocate memory for Deactfrac");
     return (1);
   }
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (Verbose_flag > 2) {
     fprintf(stderr, "\nDEBUG: Allocating Reactfrac ...");
@@ -1948,7 +2582,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     bailout("disrealnew", "Could not allocate memory for Reactfrac");
     return (1);
   }
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (Verbose_flag > 2) {
     fprintf(stderr, "\nDEBUG: Allocating Deactinit ...");
@@ -1959,7 +2593,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     bailout("disrealnew", "Could not allocate memory for Deactinit");
     return (1);
   }
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (Verbose_flag > 2) {
     fprintf(stderr, "\nDEBUG: Allocating Deactends ...");
@@ -1970,7 +2604,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     bailout("disrealnew", "Could not allocate memory for Deactends");
     return (1);
   }
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (Verbose_flag > 2) {
     fprintf(stderr, "\nDEBUG: Allocating Deactterm ...");
@@ -1987,7 +2621,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
    *    of pH on solubility of each phase in the system.
    ***/
 
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (Verbose_flag > 2) {
     fprintf(stderr, "\nDEBUG: Allocating PHsulfcoeff ...");
@@ -1998,7 +2632,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     bailout("disrealnew", "Could not allocate memory for Deactterm");
     return (1);
   }
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (Verbose_flag > 2) {
     fprintf(stderr, "\nDEBUG: Allocating PHfactor ...");
@@ -2020,19 +2654,19 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
    *    nucleation probabilities, etc.
    ***/
 
-  fflush(Logfile);
+  log_flush(Logfile);
 
-  fprmfile = filehandler("disrealnew", ParameterFileName, "READ");
+  fprmfile = bundleopen("disrealnew", ParameterFileName, "READ");
   if (!fprmfile) {
     return (1);
   }
 
-  fflush(Logfile);
+  log_flush(Logfile);
 
   fread_string(fprmfile, buff1);
   name = strtok(buff1, ",");
   instring = strtok(NULL, ",\n");
-  fflush(Logfile);
+  log_flush(Logfile);
 
   Cubesize = atoi(instring);
   if (Verbose_flag > 1) {
@@ -2731,6 +3365,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
   name = strtok(buff1, ",");
   instring = strtok(NULL, ",\n");
   NEIGHBORS = atoi(instring);
+  Edgerow = edgerowpick(NEIGHBORS);
   if (Verbose_flag > 1) {
     fprintf(stderr, "\nDEBUG: %s %d", name, NEIGHBORS);
     fflush(stderr);
@@ -3128,6 +3763,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     fprintf(Logfile, "\nEnter random number seed: %d", Iseed);
     if (Iseed > 0)
       Iseed = (-1 * Iseed);
+    Iseed0 = Iseed;
     Seed = (&Iseed);
   } else {
     fprintf(stderr,
@@ -3173,10 +3809,10 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
             strlen(Fileroot));
     fprintf(Logfile, "\nEnter name of file from which the initial ");
     fprintf(Logfile, "\nmicrostructure will be read: %s", name);
-    fflush(Logfile);
+    log_flush(Logfile);
     if (Verbose_flag > 1)
       fprintf(Logfile, "\nnlen is %d and Fileroot is now %s ", nlen, Fileroot);
-    fflush(Logfile);
+    log_flush(Logfile);
     fflush(stderr);
   } else {
     fprintf(stderr,
@@ -3192,7 +3828,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     name = strtok(NULL, ",\n");
     fprintf(Logfile, "\nEnter name of particle image file:  ");
     fprintf(Logfile, "%s", name);
-    fflush(Logfile);
+    log_flush(Logfile);
     sprintf(pimgfile, "%s%s", Micdir, name);
     if (Verbose_flag > 1) {
       fprintf(stderr, "\nDEBUG: Particle image file = '%s' (len=%zu)\n",
@@ -3220,7 +3856,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Oc3afrac = atof(instring);
     fprintf(Logfile, "\nEnter fraction of C3A that is to be orthorhombic ");
     fprintf(Logfile, "\ninstead of cubic: %f", Oc3afrac);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected Oc3afrac",
@@ -3238,7 +3874,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
         Logfile,
         "\nEnter number of seeds for CSH nucleation per um3 of mix water: %f",
         Csh_seeds);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(
         stderr,
@@ -3255,7 +3891,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     End_time = atof(instring);
     fprintf(Logfile, "\nEnter aging time in days: %f", End_time);
     End_time *= 24.0; /* Convert days to hours */
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected End_time",
@@ -3269,7 +3905,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
   if (!strcmp(name, "Place_crack")) {
     instring = strtok(NULL, ",\n");
     fprintf(Logfile, "\nPlace a crack (y or n)? [n]: %s", instring);
-    fflush(Logfile);
+    log_flush(Logfile);
     if (strlen(instring) < 1) {
       strcpy(instring, "n");
     }
@@ -3288,7 +3924,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     instring = strtok(NULL, ",\n");
     Crackwidth = atoi(instring);
     fprintf(Logfile, "\nEnter total crack width (in pixels): %d", Crackwidth);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3304,7 +3940,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     instring = strtok(NULL, ",\n");
     Cracktime = atof(instring);
     fprintf(Logfile, "\nEnter time at which to crack (in h): %f", Cracktime);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3327,7 +3963,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     fprintf(Logfile, "\n\t 3 = parallel to xy plane");
     fprintf(Logfile, "\nOrientation: ");
     fprintf(Logfile, "%d", Crackorient);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3344,7 +3980,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     fprintf(Logfile,
             "\nCustomize times for outputting microstructure (y or n)? [n]: %s",
             instring);
-    fflush(Logfile);
+    log_flush(Logfile);
     if (strlen(instring) < 1) {
       strcpy(instring, "n");
     }
@@ -3360,7 +3996,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
   if (toupper(instring[0]) == 'Y') {
     Tcustomoutputentries = 0;
     sprintf(custcycfile, "%scustomoutput.dat", WorkingDirectory);
-    fcofile = filehandler("disrealnew", custcycfile, "READ");
+    fcofile = bundleopen("disrealnew", custcycfile, "READ");
     if (!fcofile) {
       freeallmem();
       exit(1);
@@ -3378,7 +4014,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     }
 
     fclose(fcofile);
-    fcofile = filehandler("disrealnew", custcycfile, "READ");
+    fcofile = bundleopen("disrealnew", custcycfile, "READ");
     if (!fcofile) {
       freeallmem();
       exit(1);
@@ -3400,7 +4036,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     OutTimefreq = atof(instring);
     fprintf(Logfile, "\nOutput hydrating microstructure every ____ hours: %f",
             OutTimefreq);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3421,14 +4057,28 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
    *    defines
    ****/
 
-  fimgfile = filehandler("disrealnew", imgfile, "READ");
-  if (!fimgfile) {
-    return (1);
+  /* With --handoff the images come from genmic in memory */
+
+  if (strlen(Handoffname) > 0) {
+    fimgfile = handoff_open(Handoffname, "img", 0);
+    if (!fimgfile) {
+      fprintf(Logfile, "\nCould not open the image handed off as %s",
+              Handoffname);
+      log_flush(Logfile);
+      return (1);
+    }
+  } else {
+    fimgfile = filehandler("disrealnew", imgfile, "READ");
+    if (!fimgfile) {
+      return (1);
+    }
   }
 
-  if (read_imgheader(fimgfile, &Version, &Xsyssize_orig, &Ysyssize_orig,
-                     &Zsyssize_orig, &Res)) {
-    fclose(fimgfile);
+  if (read_imgheader_fmt(fimgfile, &Version, &Xsyssize_orig, &Ysyssize_orig,
+                         &Zsyssize_orig, &Res, &imgformat) ||
+      (imgformat != IMG_ASCII && imgformat != IMG_UINT8 &&
+       imgformat != IMG_UINT8Z)) {
+    handoff_close(fimgfile);
     freeallmem();
     bailout("disrealnew", "Error reading image header");
     exit(1);
@@ -3441,7 +4091,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     fprintf(Logfile, "\n\tY size = %d", Ysyssize_orig);
     fprintf(Logfile, "\n\tZ size = %d", Ysyssize_orig);
     fprintf(Logfile, "\n\tResolution = %f", Res);
-    fflush(Logfile);
+    log_flush(Logfile);
     fprintf(stderr, "\nDone reading image header... ");
     fprintf(stderr, "\n\tVersion = %f", Version);
     fprintf(stderr, "\n\tX size = %d", Xsyssize_orig);
@@ -3471,6 +4121,19 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
   if (Crackorient == 3)
     Zsyssize += Crackwidth;
 
+  /***
+   *    Pixel counts are kept in an int and ant coordinates in
+   *    16 bits, which MAXSIZE allows for (see vcctl.h)
+   ***/
+
+  if ((Xsyssize <= 0) || (Xsyssize > MAXSIZE) || (Ysyssize <= 0) ||
+      (Ysyssize > MAXSIZE) || (Zsyssize <= 0) || (Zsyssize > MAXSIZE)) {
+    handoff_close(fimgfile);
+    freeallmem();
+    bailout("disrealnew", "Bad system size specification");
+    return (1);
+  }
+
   /***
    *    Must now allocate the memory for all the 3D arrays
    *    (See disrealnew.h for their declaration)
@@ -3479,66 +4142,107 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
   if (Verbose_flag > 2) {
     fprintf(Logfile, "\nAllocating Mic with dimensions %d %d %d...", Xsyssize,
             Ysyssize, Zsyssize);
-    fflush(Logfile);
+    log_flush(Logfile);
+  }
+  memtag("Mic");
+  if (Tiledgrids) {
+    Mic = cgridtile(Xsyssize, Ysyssize, Zsyssize, MICHALO);
+  } else {
+    Mic = cgridhalo(Xsyssize, Ysyssize, Zsyssize, MICHALO);
   }
-  Mic = cbox(Xsyssize, Ysyssize, Zsyssize);
+  memtag(NULL);
   if (!Mic) {
     freeallmem();
-    fclose(fimgfile);
+    handoff_close(fimgfile);
     bailout("disrealnew", "Could not allocate memory for Mic array");
     return (1);
   }
-  if (Verbose_flag > 2) {
-    fprintf(Logfile, " done\nAllocating Micorig ...");
-    fflush(Logfile);
-  }
 
-  Micorig = cbox(Xsyssize, Ysyssize, Zsyssize);
-  if (!Micorig) {
-    freeallmem();
-    fclose(fimgfile);
-    bailout("disrealnew", "Could not allocate memory for Micorig array");
-    return (1);
+  /* Pages of Mic go to the memory of the threads that move ants there */
+
+  gridtouch(Mic, Antthreads);
+
+  /* With --lean-grids these wait for the parameter file (see leangrids) */
+
+  if (!Leangrids) {
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, " done\nAllocating Micorig ...");
+      log_flush(Logfile);
+    }
+
+    Micorig = cgrid(Xsyssize, Ysyssize, Zsyssize);
+    if (!Micorig) {
+      freeallmem();
+      handoff_close(fimgfile);
+      bailout("disrealnew", "Could not allocate memory for Micorig array");
+      return (1);
+    }
   }
-  if (Verbose_flag > 2) {
-    fprintf(Logfile, " done\nAllocating Micpart ...");
-    fflush(Logfile);
+  if (!Leangrids) {
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, " done\nAllocating Cshage ...");
+      log_flush(Logfile);
+    }
+
+    Cshage = cgrid(Xsyssize, Ysyssize, Zsyssize);
+    if (!Cshage) {
+      freeallmem();
+      handoff_close(fimgfile);
+      bailout("disrealnew", "Could not allocate memory for Cshage array");
+      return (1);
+    }
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, " done\nAllocating Deactivated ...");
+      log_flush(Logfile);
+    }
+
+    Deactivated = cgrid(Xsyssize, Ysyssize, Zsyssize);
+    if (!Deactivated) {
+      handoff_close(fimgfile);
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for Deactivated array");
+      return (1);
+    }
   }
 
-  Micpart = sibox(Xsyssize, Ysyssize, Zsyssize);
-  if (!Micpart) {
+  Surfmap = (unsigned int *)calloc(
+      ((size_t)Xsyssize * Ysyssize * Zsyssize + SURFBITS - 1) / SURFBITS,
+      sizeof(unsigned int));
+  if (!Surfmap) {
+    handoff_close(fimgfile);
     freeallmem();
-    fclose(fimgfile);
-    bailout("disrealnew", "Could not allocate memory for Micpart array");
+    bailout("disrealnew", "Could not allocate memory for Surfmap array");
     return (1);
   }
-  if (Verbose_flag > 2) {
-    fprintf(Logfile, " done\nAllocating Cshage ...");
-    fflush(Logfile);
-  }
 
-  Cshage = sibox(Xsyssize, Ysyssize, Zsyssize);
-  if (!Cshage) {
+  /* Scratch space of burn3d and burnset, kept for the whole run */
+
+  if (percwork_alloc(&Burnwork, (size_t)Xsyssize * Ysyssize * Zsyssize, 0)) {
+    handoff_close(fimgfile);
     freeallmem();
-    fclose(fimgfile);
-    bailout("disrealnew", "Could not allocate memory for Cshage array");
+    bailout("disrealnew", "Could not allocate memory for Burnwork");
     return (1);
   }
-  if (Verbose_flag > 2) {
-    fprintf(Logfile, " done\nAllocating Deactivated ...");
-    fflush(Logfile);
-  }
 
-  Deactivated = sibox(Xsyssize, Ysyssize, Zsyssize);
-  if (!Deactivated) {
-    fclose(fimgfile);
-    freeallmem();
-    bailout("disrealnew", "Could not allocate memory for Deactivated array");
-    return (1);
+  /* Plate faces of C-S-H are only tracked for plate growth */
+
+  if (Cshgeom == PLATE) {
+    if (Verbose_flag > 2) {
+      fprintf(Logfile, " done\nAllocating Faces ...");
+      log_flush(Logfile);
+    }
+    Faces = sigrid(Xsyssize, Ysyssize, Zsyssize);
+    if (!Faces) {
+      handoff_close(fimgfile);
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for Faces array");
+      return (1);
+    }
+    memset(gridblock(Faces), 0, gridinfo(Faces)->nbytes);
   }
   if (Verbose_flag > 2) {
     fprintf(Logfile, " done");
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   Cshscale = CSHSCALE * Sizemag;
@@ -3567,16 +4271,46 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
   Ysyssize = Ysyssize_orig;
   Zsyssize = Zsyssize_orig;
 
+  /***
+   *    A binary image is read one x plane at a time; each plane
+   *    holds four bytes per voxel, enough for a particle id image
+   *    as well
+   ***/
+
+  nplane = (size_t)Ysyssize * Zsyssize;
+  plane = (unsigned char *)malloc(4 * nplane);
+  if (!plane) {
+    handoff_close(fimgfile);
+    freeallmem();
+    bailout("disrealnew", "Could not allocate memory for image plane");
+    return (1);
+  }
+
   if (Verbose_flag > 1)
     fprintf(Logfile, "\n\nPreparing to read image file ...");
   for (ix = 0; ix < Xsyssize; ix++) {
+    if (imgformat != IMG_ASCII &&
+        read_binplane(fimgfile, plane, nplane, imgformat)) {
+      free(plane);
+      handoff_close(fimgfile);
+      freeallmem();
+      bailout("disrealnew", "Error reading binary image");
+      exit(1);
+    }
+    m = 0;
     for (iy = 0; iy < Ysyssize; iy++) {
       for (iz = 0; iz < Zsyssize; iz++) {
 
-        Cshage[ix][iy][iz] = 0;
-        Deactivated[ix][iy][iz] = 1;
-        fscanf(fimgfile, "%s", instring);
-        ovalin = atoi(instring);
+        if (Cshage)
+          Cshage[ix][iy][iz] = 0;
+        if (Deactivated)
+          Deactivated[ix][iy][iz] = 0;
+        if (imgformat == IMG_ASCII) {
+          fscanf(fimgfile, "%s", instring);
+          ovalin = atoi(instring);
+        } else {
+          ovalin = plane[m++];
+        }
         valin = convert_id(ovalin, Version);
 
         /***
@@ -3589,26 +4323,33 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
             valin = OC3A;
           }
         }
-        Mic[ix][iy][iz] = valin;
+        MICSET(ix, iy, iz, valin);
 
-        Micorig[ix][iy][iz] = Mic[ix][iy][iz];
+        if (Micorig)
+          Micorig[ix][iy][iz] = Mic[ix][iy][iz];
 
       } /* End of loop in iz */
     } /* End of loop in iy */
   } /* End of loop in ix */
 
-  fclose(fimgfile);
+  handoff_close(fimgfile);
   if (Verbose_flag > 2) {
     fprintf(Logfile, "\nDone reading microstructure image");
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   /* Now read in particle IDs from file */
 
-  fpimgfile = filehandler("disrealnew", pimgfile, "READ");
+  if (strlen(Handoffname) > 0) {
+    fpimgfile = handoff_open(Handoffname, "pimg", 0);
+    strcpy(pimgfile, Handoffname);
+  } else {
+    fpimgfile = filehandler("disrealnew", pimgfile, "READ");
+  }
   if (!fpimgfile) {
     fprintf(Logfile, "\n\nCould not open fpimgfile: %s. Exiting ...", pimgfile);
-    fflush(Logfile);
+    log_flush(Logfile);
+    free(plane);
     freeallmem();
     exit(1);
   }
@@ -3619,32 +4360,78 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
    *    information ...
    ***/
 
-  if (read_imgheader(fpimgfile, &newver, &newx, &newy, &newz, &newres)) {
+  if (read_imgheader_fmt(fpimgfile, &newver, &newx, &newy, &newz, &newres,
+                         &pimgformat) ||
+      (pimgformat != IMG_ASCII && pimgformat != IMG_UINT32 &&
+       pimgformat != IMG_UINT32Z)) {
     fprintf(Logfile, "\nTrouble reading header of fpimgfile: %s. Exiting ...",
             pimgfile);
-    fflush(Logfile);
-    fclose(fpimgfile);
+    log_flush(Logfile);
+    handoff_close(fpimgfile);
+    free(plane);
     freeallmem();
     bailout("disrealnew", "Error reading image header");
     exit(1);
   }
 
+  /* Particle ids go into Micpart a slab of x planes at a time */
+
+  slab = (int *)malloc(PARTMAPBLK * nplane * sizeof(int));
+  if (!slab || partmap_alloc(&Micpart, Xsyssize, Ysyssize, Zsyssize)) {
+    if (slab)
+      free(slab);
+    free(plane);
+    handoff_close(fpimgfile);
+    freeallmem();
+    bailout("disrealnew", "Could not allocate memory for Micpart");
+    exit(1);
+  }
+
   for (ix = 0; ix < Xsyssize; ix++) {
+    if (pimgformat != IMG_ASCII &&
+        read_binplane(fpimgfile, plane, 4 * nplane, pimgformat)) {
+      free(slab);
+      free(plane);
+      handoff_close(fpimgfile);
+      freeallmem();
+      bailout("disrealnew", "Error reading binary particle image");
+      exit(1);
+    }
+    m = 0;
     for (iy = 0; iy < Ysyssize; iy++) {
       for (iz = 0; iz < Zsyssize; iz++) {
 
-        fscanf(fpimgfile, "%s", instring);
-        valin = atoi(instring);
-        Micpart[ix][iy][iz] = valin;
+        if (pimgformat == IMG_ASCII) {
+          fscanf(fpimgfile, "%s", instring);
+          valin = atoi(instring);
+        } else {
+          valin = (int)((unsigned int)plane[4 * m] |
+                        ((unsigned int)plane[4 * m + 1] << 8) |
+                        ((unsigned int)plane[4 * m + 2] << 16) |
+                        ((unsigned int)plane[4 * m + 3] << 24));
+        }
+        slab[(ix & (PARTMAPBLK - 1)) * nplane + m] = valin;
+        m++;
       }
     }
+    if (((ix & (PARTMAPBLK - 1)) == PARTMAPBLK - 1 || ix == Xsyssize - 1) &&
+        partmap_putslab(&Micpart, ix & ~(PARTMAPBLK - 1), slab)) {
+      free(slab);
+      free(plane);
+      handoff_close(fpimgfile);
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for Micpart");
+      exit(1);
+    }
   }
 
-  fclose(fpimgfile);
+  free(slab);
+  handoff_close(fpimgfile);
+  free(plane);
 
   if (Verbose_flag > 2) {
     fprintf(Logfile, "\nDone reading particle image");
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   if (Version != newver) {
@@ -3654,7 +4441,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
   }
   if (Xsyssize != newx) {
     fprintf(Logfile, "\nXsyssize = %d, New x size = %d", Xsyssize, newx);
-    fflush(Logfile);
+    log_flush(Logfile);
     freeallmem();
     bailout("disrealnew", "Incompatible size declarations");
     exit(1);
@@ -3662,7 +4449,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
 
   if (Ysyssize != newy) {
     fprintf(Logfile, "\nYsyssize = %d, New y size = %d", Ysyssize, newy);
-    fflush(Logfile);
+    log_flush(Logfile);
     freeallmem();
     fprintf(Logfile, "\nYsyssize = %d, New y size = %d", Ysyssize, newy);
     bailout("disrealnew", "Incompatible size declarations");
@@ -3671,7 +4458,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
 
   if (Zsyssize != newz) {
     fprintf(Logfile, "\nZsyssize = %d, New y size = %d", Ysyssize, newy);
-    fflush(Logfile);
+    log_flush(Logfile);
     freeallmem();
     bailout("disrealnew", "Incompatible size declarations");
     exit(1);
@@ -3694,7 +4481,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
       }
       if (Verbose_flag > 1) {
         fprintf(Logfile, "\nOne-voxel bias for phase %d = %f", phtodo, bias);
-        fflush(Logfile);
+        log_flush(Logfile);
       }
     }
   } while (!strcmp(name, "Onevoxelbias"));
@@ -3717,7 +4504,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Temp_0 = atof(instring);
     fprintf(Logfile, "\nEnter the initial temperature of binder ");
     fprintf(Logfile, "in degrees Celsius: %f", Temp_0);
-    fflush(Logfile);
+    log_flush(Logfile);
     Temp_cur_b = Temp_0;
   } else {
     fprintf(stderr,
@@ -3736,7 +4523,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     fprintf(Logfile, "\nHydration under 0) isothermal, 1) adiabatic ");
     fprintf(Logfile, "or 2) programmed temperature profile conditions: %d",
             Adiaflag);
-    fflush(Logfile);
+    log_flush(Logfile);
     AggTempEffect = 1;
     if ((Adiaflag == 0) || (Mass_agg * Cp_agg <= 0.0) ||
         (fabs(Temp_0_agg - Temp_0) < 0.5) || (U_coeff_agg <= 0.0))
@@ -3758,7 +4545,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     char *tmpstr;
 
     sprintf(buff, "%stemperature_profile.csv", WorkingDirectory);
-    thfile = filehandler("disrealnew", buff, "READ");
+    thfile = bundleopen("disrealnew", buff, "READ");
     if (!thfile) {
       fprintf(stderr, "\nERROR: Could not open temperature profile file: %s", buff);
       fflush(stderr);
@@ -3777,7 +4564,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     fprintf(Logfile, "\nTemperature profile file opened successfully");
     fprintf(Logfile, "\nFirst interval: time %.1f-%.1f h, temp %.1f-%.1f C",
             thtimelo, thtimehi, thtemplo, thtemphi);
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   fread_string(fprmfile, buff1);
@@ -3787,7 +4574,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     T_ambient = atof(instring);
     fprintf(Logfile, "\nEnter the ambient temperature ");
     fprintf(Logfile, "in degrees Celsius: %f", T_ambient);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3804,7 +4591,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     U_coeff = atof(instring);
     fprintf(Logfile, "\nEnter the overall heat transfer coefficient ");
     fprintf(Logfile, "in J/g/C/s: %f", U_coeff);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3821,7 +4608,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     E_act = atof(instring);
     fprintf(Logfile, "\nEnter apparent activation energy for hydration ");
     fprintf(Logfile, "in kJ/mole: %f", E_act);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3839,7 +4626,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     fprintf(Logfile,
             "\nEnter apparent activation energy for pozzolanic reaction ");
     fprintf(Logfile, "in kJ/mole: %f", E_act_pozz);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3856,7 +4643,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     E_act_slag = atof(instring);
     fprintf(Logfile, "\nEnter apparent activation energy for slag reactions ");
     fprintf(Logfile, "in kJ/mole: %f", E_act_slag);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3875,7 +4662,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     fprintf(Logfile, "\n\tearly-age calorimetry data (1), or ");
     fprintf(Logfile, "\n\tearly-age chemical shrinkage data (2): %d",
             TimeCalibrationMethod);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3892,7 +4679,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Beta = atof(instring);
     fprintf(Logfile, "\nEnter kinetic factor to convert cycles ");
     fprintf(Logfile, "to time at 25 C: %f", Beta);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -3907,7 +4694,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
   if (!strcmp(name, "Calfilename")) {
     instring = strtok(NULL, ",\n");
     fprintf(Logfile, "\nEnter file name for early-age data: %s", instring);
-    fflush(Logfile);
+    log_flush(Logfile);
     sprintf(calfilename, "%s", instring);
   } else {
     fprintf(stderr,
@@ -3931,7 +4718,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
      * be prepared to allocate more memory as needed */
     Ncyc = 10000;
 
-    fcalfile = filehandler("disrealnew", calfilename, "READ");
+    fcalfile = bundleopen("disrealnew", calfilename, "READ");
     if (!fcalfile) {
       freeallmem();
       sprintf(buff, "Could not open time calibration ");
@@ -4039,7 +4826,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     DataMeasuredAtTemperature = atof(instring);
     fprintf(Logfile, "\nEnter temperature at which calibration data ");
     fprintf(Logfile, "were obtained (in deg C): %f", DataMeasuredAtTemperature);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4055,7 +4842,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     OutTimefreq = End_time + 1.0;
     fprintf(Logfile, "\nSetting DOH frequency for outputting ");
     fprintf(Logfile, "microstructure = %f", OutTimefreq);
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   /***
@@ -4086,6 +4873,10 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     exit(1);
   }
 
+  /* Cycles share a Cshage code once there are more than it can hold */
+
+  Cshagewidth = (Ncyc > 1) ? (Ncyc - 1) / (CSHAGECODES - 2) + 1 : 1;
+
   fread_string(fprmfile, buff1);
   name = strtok(buff1, ",");
   if (!strcmp(name, "Alpha_max")) {
@@ -4093,7 +4884,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Alpha_max = atof(instring);
     fprintf(Logfile, "\nEnter maximum degree of hydration to achieve ");
     fprintf(Logfile, "before terminating: %f", Alpha_max);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4110,7 +4901,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Sealed = atoi(instring);
     fprintf(Logfile, "\nDo you wish hydration under 0) saturated ");
     fprintf(Logfile, "or 1) sealed conditions: %d", Sealed);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4153,7 +4944,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Burntimefreq = atof(instring);
     fprintf(Logfile, "\nEnter time frequency for checking pore ");
     fprintf(Logfile, "space percolation (in h): %f", Burntimefreq);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4170,7 +4961,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Settimefreq = atof(instring);
     fprintf(Logfile, "\nEnter time frequency for checking percolation  ");
     fprintf(Logfile, "of solids [set] (in h): %f", Settimefreq);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4187,7 +4978,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Phydtimefreq = atof(instring);
     fprintf(Logfile, "\nEnter time frequency for checking hydration  ");
     fprintf(Logfile, "of particles (in h): %f", Phydtimefreq);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4204,7 +4995,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Mass_agg = (double)(atof(instring));
     fprintf(Logfile, "\nEnter mass fraction of aggregate in concrete: %f",
             Mass_agg);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4221,7 +5012,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Temp_0_agg = atof(instring);
     fprintf(Logfile, "\nEnter initial temperature of aggregate in concrete: %f",
             Temp_0_agg);
-    fflush(Logfile);
+    log_flush(Logfile);
     Temp_cur_agg = Temp_0_agg;
   } else {
     fprintf(stderr,
@@ -4240,7 +5031,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     fprintf(Logfile,
             "\nEnter the overall heat transfer coefficient in J/g/C/s: %f",
             U_coeff_agg);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4257,7 +5048,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Csh2flag = atoi(instring);
     fprintf(Logfile, "\nCSH to pozzolanic CSH 0) prohibited or 1) allowed: %d",
             Csh2flag);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4274,7 +5065,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     Chflag = atoi(instring);
     fprintf(Logfile, "\nCH precipitation on aggregate surfaces ");
     fprintf(Logfile, "0) prohibited or 1) allowed: %d", Chflag);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4303,7 +5094,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     }
     if (Verbose_flag > 1) {
       fprintf(Logfile, "\n%s = %f", name, MovieFrameFreq);
-      fflush(Logfile);
+      log_flush(Logfile);
     }
   } else {
     fprintf(stderr,
@@ -4363,7 +5154,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
         }
         fprintf(Logfile, "\nDeactivate phase %d: %f,%f,%f,%f,%f", dphase, dfrac,
                 deactinit, deactends, deactterm, reactfrac);
-        fflush(Logfile);
+        log_flush(Logfile);
       }
     }
   } while (!strcmp(name, "Deactivate"));
@@ -4382,7 +5173,7 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
     PHactive = atoi(instring);
     fprintf(Logfile, "\nDoes pH influence hydration kinetics? ");
     fprintf(Logfile, "0) no or 1) yes: %d", PHactive);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
     fprintf(stderr,
             "\nERROR: Unexpected parameter order: got %s but expected "
@@ -4402,7 +5193,15 @@ int get_input(float *pnucch, float *pscalech, float *pnuchg, float *pscalehg,
    *    Vol. 98, No. 3, pp. 251-255 (2001).
    ***/
 
-  fflush(Logfile);
+  if (leangrids()) {
+    fclose(fprmfile);
+    freeallmem();
+    bailout("disrealnew", "Could not allocate memory for the grids");
+    exit(1);
+  }
+  gridreport(Logfile);
+
+  log_flush(Logfile);
   fclose(fprmfile);
   return (status);
 }
@@ -4453,37 +5252,24 @@ void init(void) {
   Anhinit = Heminit = Slaginit = Freelimeinit = 0;
   Nasulfinit = Ksulfinit = 0;
 
-  /* Initialize structure for Ants */
-
-  Headant = (struct Ants *)malloc(Antsize);
-  Headant->prevant = NULL;
-  Headant->nextant = NULL;
-  Headant->x = 0;
-  Headant->y = 0;
-  Headant->z = 0;
-
-  /* special ID indicating first ant in list */
-  Headant->id = 100;
-  Headant->cycbirth = 0;
-  Tailant = Headant;
-
-  /* Initialize potassium sulfate doubly linked list */
-  Headks = (struct Alksulf *)malloc(Alksulfsize);
-  Headks->prevas = NULL;
-  Headks->nextas = NULL;
-  Headks->x = 0;
-  Headks->y = 0;
-  Headks->z = 0;
-  Tailks = Headks;
-
-  /* Initialize sodium sulfate doubly-linked list */
-  Headnas = (struct Alksulf *)malloc(Alksulfsize);
-  Headnas->prevas = NULL;
-  Headnas->nextas = NULL;
-  Headnas->x = 0;
-  Headnas->y = 0;
-  Headnas->z = 0;
-  Tailnas = Headnas;
+  /* Initialize pool of ants */
+
+  if (initantpool(ANTPOOLSIZE)) {
+    freeallmem();
+    bailout("disrealnew", "Could not allocate memory for ant pool");
+    exit(1);
+  }
+
+  /* Initialize the potassium and sodium sulfate doubly linked lists */
+
+  nodepool_alloc(&Kspool, Alksulfsize, ALKPOOLCHUNK);
+  nodepool_alloc(&Naspool, Alksulfsize, ALKPOOLCHUNK);
+  if (alkreset(&Kspool, &Headks, &Tailks) ||
+      alkreset(&Naspool, &Headnas, &Tailnas)) {
+    freeallmem();
+    bailout("disrealnew", "Could not allocate memory for sulfate lists");
+    exit(1);
+  }
 
   /* Set initial pH of pore solution at time t = 0 */
 
@@ -4493,9 +5279,15 @@ void init(void) {
 
   /* GODZILLA */
   // fprintf(Logfile, "\nNSPHASES = %d", NSPHASES);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
 
+  /* Porosity is not a solid phase and never dissolves */
+
+  Disprob[POROSITY] = Disbase[POROSITY] = 0.0;
+  Soluble[POROSITY] = 0;
+  Creates[POROSITY] = 0;
+
   for (i = C3S; i <= NSPHASES; i++) {
 
     /***
@@ -4818,42 +5610,42 @@ void init(void) {
   sprintf(buff, "%s%salkalichar.dat", WorkingDirectory, PATH_SEPARATOR);
   /* GODZILLA */
   // fprintf(Logfile, "\nOpening %s", buff);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
 
-  alkalifile = filehandler("disrealnew", buff, "READ");
+  alkalifile = bundleopen("disrealnew", buff, "READ");
   if (!alkalifile) {
     freeallmem();
     exit(1);
   }
   /* GODZILLA */
   // fprintf(Logfile, "\nOpened %s", buff);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
 
   fscanf(alkalifile, "%s", instring);
   Totsodium = atof(instring);
   /* GODZILLA */
   // fprintf(Logfile, "\nTotsodium = %f", Totsodium);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
   fscanf(alkalifile, "%s", instring);
   Totpotassium = atof(instring);
   /* GODZILLA */
   // fprintf(Logfile, "\nTotpotassium = %f", Totpotassium);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
   fscanf(alkalifile, "%s", instring);
   Rssodium = atof(instring);
   /* GODZILLA */
   // fprintf(Logfile, "\nRssodium = %f", Rssodium);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
   fscanf(alkalifile, "%s", instring);
   Rspotassium = atof(instring);
   /* GODZILLA */
   // fprintf(Logfile, "\nRspotassium = %f", Rspotassium);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
   fscanf(alkalifile, "%s", instring);
   if (!feof(alkalifile)) {
@@ -4866,15 +5658,15 @@ void init(void) {
   }
   /* GODZILLA */
   // fprintf(Logfile, "\nSodiumhydrox = %f", Sodiumhydrox);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   fprintf(Logfile, "\nPotassiumhydrox = %f", Potassiumhydrox);
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
   fclose(alkalifile);
 
   /* GODZILLA */
   // fprintf(Logfile, "\nClosed %s", buff);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
   Totsodium /= 100.0;
   Totpotassium /= 100.0;
@@ -4886,13 +5678,13 @@ void init(void) {
   sprintf(buff, "%s%salkaliflyash.dat", WorkingDirectory, PATH_SEPARATOR);
   /* GODZILLA */
   // fprintf(Logfile, "\nOpening %s", buff);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
-  alkalifile = filehandler("disrealnew", buff, "READ_NOFAIL");
+  alkalifile = bundleopen("disrealnew", buff, "READ_NOFAIL");
   if (!alkalifile) {
     /* GODZILLA */
     // fprintf(Logfile, "\n%s not found", buff);
-    // fflush(Logfile);
+    // log_flush(Logfile);
     /* GODZILLA */
     Totfasodium = 0.0;
     Totfapotassium = 0.0;
@@ -4903,25 +5695,25 @@ void init(void) {
     Totfasodium = atof(instring);
     /* GODZILLA */
     // fprintf(Logfile, "\nTotfasodium = %f", Totfasodium);
-    // fflush(Logfile);
+    // log_flush(Logfile);
     /* GODZILLA */
     fscanf(alkalifile, "%s", instring);
     Totfapotassium = atof(instring);
     /* GODZILLA */
     // fprintf(Logfile, "\nTotfapotassium = %f", Totfapotassium);
-    // fflush(Logfile);
+    // log_flush(Logfile);
     /* GODZILLA */
     fscanf(alkalifile, "%s", instring);
     Rsfasodium = atof(instring);
     /* GODZILLA */
     // fprintf(Logfile, "\nRsfasodium = %f", Rsfasodium);
-    // fflush(Logfile);
+    // log_flush(Logfile);
     /* GODZILLA */
     fscanf(alkalifile, "%s", instring);
     Rsfapotassium = atof(instring);
     /* GODZILLA */
     // fprintf(Logfile, "\nRsfapotassium = %f", Rsfapotassium);
-    // fflush(Logfile);
+    // log_flush(Logfile);
     /* GODZILLA */
     Totfasodium /= 100.0;
     Totfapotassium /= 100.0;
@@ -4935,16 +5727,16 @@ void init(void) {
   sprintf(buff, "%s%sslagchar.dat", WorkingDirectory, PATH_SEPARATOR);
   /* GODZILLA */
   // fprintf(Logfile, "\nOpening %s", buff);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
-  slagfile = filehandler("disrealnew", buff, "READ");
+  slagfile = bundleopen("disrealnew", buff, "READ");
   if (!slagfile) {
     freeallmem();
     exit(1);
   }
   /* GODZILLA */
   // fprintf(Logfile, "\nOpened %s", buff);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
   fscanf(slagfile, "%s", instring);
   fscanf(slagfile, "%s", instring);
@@ -4987,7 +5779,7 @@ void init(void) {
   fclose(slagfile);
   /* GODZILLA */
   // fprintf(Logfile, "\nClosed %s", buff);
-  // fflush(Logfile);
+  // log_flush(Logfile);
   /* GODZILLA */
 
   Waterc[SLAG] = 0.0;
@@ -5001,7 +5793,7 @@ void init(void) {
 
   /* GODZILLA */
   fprintf(Logfile, "\nMade it 01");
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
   chperslag = Siperslag * (Slaghydcasi - Slagcasi) + (3.0 * Slagc3a);
   if (chperslag < 0.0)
@@ -5014,7 +5806,7 @@ void init(void) {
 
   /* GODZILLA */
   fprintf(Logfile, "\nMade it 02");
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
   P2slag += Molarv[POROSITY] * poreperslag;
   P2slag -= Molarv[SLAGCSH];
@@ -5023,7 +5815,7 @@ void init(void) {
 
   /* GODZILLA */
   fprintf(Logfile, "\nMade it 03");
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
   P1slag = 1.0 - P2slag;
 
@@ -5031,14 +5823,14 @@ void init(void) {
 
   /* GODZILLA */
   fprintf(Logfile, "\nMade it 04");
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
   P4slag = chperslag * Molarv[CH] / Molarv[SLAG];
 
   P5slag = Slagc3a * Molarv[C3A] / Molarv[SLAG];
   /* GODZILLA */
   fprintf(Logfile, "\nMade it 05");
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
   if (P5slag > 1.0) {
     P5slag = 1.0;
@@ -5049,15 +5841,15 @@ void init(void) {
   }
   /* GODZILLA */
   fprintf(Logfile, "\nP1slag = %f", P1slag);
-  fflush(Logfile);
+  log_flush(Logfile);
   fprintf(Logfile, "\nP2slag = %f", P2slag);
-  fflush(Logfile);
+  log_flush(Logfile);
   fprintf(Logfile, "\nP3slag = %f", P3slag);
-  fflush(Logfile);
+  log_flush(Logfile);
   fprintf(Logfile, "\nP4slag = %f", P4slag);
-  fflush(Logfile);
+  log_flush(Logfile);
   fprintf(Logfile, "\nP5slag = %f", P5slag);
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
 
   /***
@@ -5072,7 +5864,7 @@ void init(void) {
 
     /* GODZILLA */
     fprintf(Logfile, "\nk = %d of %d", k, NSPHASES);
-    fflush(Logfile);
+    log_flush(Logfile);
     /* GODZILLA */
     xv1 = FitpH[k][x][0];
     xv2 = FitpH[k][x][1];
@@ -5091,7 +5883,7 @@ void init(void) {
 
     /* GODZILLA */
     fprintf(Logfile, "\nyv3 = %f", yv3);
-    fflush(Logfile);
+    log_flush(Logfile);
     /* GODZILLA */
     PHcoeff[k][2] = (yv3 - yv1) * (xv2 - xv1) - (yv2 - yv1) * (xv3 - xv1);
 
@@ -5100,19 +5892,19 @@ void init(void) {
 
     /* GODZILLA */
     fprintf(Logfile, "\nPHcoeff[%d][2] = %f", k, PHcoeff[k][2]);
-    fflush(Logfile);
+    log_flush(Logfile);
     /* GODZILLA */
     PHcoeff[k][1] = (yv2 - yv1) - (PHcoeff[k][2] * (xv2 * xv2 - xv1 * xv1));
     PHcoeff[k][1] /= (xv2 - xv1);
 
     /* GODZILLA */
     fprintf(Logfile, "\nPHcoeff[%d][1] = %f", k, PHcoeff[k][1]);
-    fflush(Logfile);
+    log_flush(Logfile);
     /* GODZILLA */
     PHcoeff[k][0] = yv1 - (PHcoeff[k][1] * xv1) - (PHcoeff[k][2] * xv1 * xv1);
     /* GODZILLA */
     fprintf(Logfile, "\nPHcoeff[%d][0] = %f", k, PHcoeff[k][0]);
-    fflush(Logfile);
+    log_flush(Logfile);
     /* GODZILLA */
   }
 
@@ -5148,48 +5940,53 @@ int initialize_output_files(void) {
     fprintf(Logfile, "\nWorkingDirectory is: %s", WorkingDirectory);
     fprintf(Logfile, "\nSeparation character is %s", PATH_SEPARATOR);
     fprintf(Logfile, "\ndfileroot is: %s", dfileroot);
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   /* sprintf(Datafilename,"%s%s.data",WorkingDirectory,dfileroot); */
   sprintf(Datafilename, "%s%s.csv", WorkingDirectory, dfileroot);
   /* GODZILLA */
   fprintf(Logfile, "\nDatafilename= %s", Datafilename);
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
   sprintf(Imageindexname, "%simage_index.txt", WorkingDirectory);
   /* GODZILLA */
   fprintf(Logfile, "\nImageindexname= %s", Imageindexname);
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
 
+  if (Insitu)
+    sprintf(Insituname, "%s%s.insitu.csv", WorkingDirectory, dfileroot);
+
   sprintf(Moviename, "%s%s.mov", WorkingDirectory, dfileroot);
   /* GODZILLA */
   fprintf(Logfile, "\nMoviename= %s", Moviename);
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
   /* strcat(Moviename,strsuff); */
 
   sprintf(Parname, "%s%s.params", WorkingDirectory, dfileroot);
   /* GODZILLA */
   fprintf(Logfile, "\nParname= %s", Parname);
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
 
   sprintf(Fileoname, "%s%s.img", WorkingDirectory, dfileroot);
   strcat(Fileoname, strsuff);
   /* GODZILLA */
   fprintf(Logfile, "\nFileoname= %s", Fileoname);
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
 
   sprintf(Phrname, "%s%s.phr", WorkingDirectory, dfileroot);
   strcat(Phrname, strsuff);
   /* GODZILLA */
   fprintf(Logfile, "\nPhrname= %s", Phrname);
-  fflush(Logfile);
+  log_flush(Logfile);
   /* GODZILLA */
 
+  sprintf(Ckptname, "%s%s.ckpt", WorkingDirectory, dfileroot);
+
   /* Store parameters input in parameter file */
 
   return (0);
@@ -5259,31 +6056,109 @@ void manage_deactivation_behavior(void) {
   return;
 }
 
+/***
+ *    listdeact
+ *
+ *     Put pixel (x,y,z) at place n of the list of pixels
+ *     with deactivated faces (Deactpix), growing the list
+ *     if needed
+ *
+ *     Arguments:    long place in the list
+ *                 int x,y, and z coordinates of the pixel
+ *
+ *     Returns:    0 if okay, MEMERR otherwise
+ *
+ *    Calls:        no other routines
+ *    Called by:    performdeactivation, finddeact
+ ***/
+int listdeact(long n, int x, int y, int z) {
+  long newsize;
+  void *newp;
+
+  if (n >= Deactpixsize) {
+    newsize = (Deactpixsize > 0) ? (2 * Deactpixsize) : 4096;
+    newp = realloc(Deactpix, (size_t)newsize * sizeof(long));
+    if (!newp)
+      return (MEMERR);
+    Deactpix = (long *)newp;
+    Deactpixsize = newsize;
+  }
+  Deactpix[n] = ((long)x * Ysyssize + y) * Zsyssize + z;
+
+  return (0);
+}
+
+/***
+ *    finddeact
+ *
+ *     Rebuild the list of pixels with deactivated faces
+ *     (Deactpix) from Deactivated, after the pixels have
+ *     moved
+ *
+ *     Arguments:    none
+ *
+ *     Returns:    0 if okay, MEMERR otherwise
+ *
+ *    Calls:        listdeact
+ *    Called by:    performreactivation
+ ***/
+int finddeact(void) {
+  int kx, ky, kz;
+  long n;
+
+  n = 0;
+  for (kx = 0; kx < Xsyssize; kx++) {
+    for (ky = 0; ky < Ysyssize; ky++) {
+      for (kz = 0; kz < Zsyssize; kz++) {
+        if (Deactivated[kx][ky][kz]) {
+          if (listdeact(n, kx, ky, kz))
+            return (MEMERR);
+          n++;
+        }
+      }
+    }
+  }
+  Ndeactpix = n;
+
+  return (0);
+}
+
 /***
  *    performdeactivation
  *
  *     Deactivate a fraction (fracdeact) of the
- *     a given phase to prevent its hydrating
+ *     a given phase to prevent its hydrating.  The
+ *     same scan rebuilds the list of pixels with
+ *     deactivated faces, of any phase, for
+ *     performreactivation.
  *
  *     Arguments:    int phase id to deactivate
  *                 float fraction to deactivate
  *
  *     Returns:    nothing
  *
- *    Calls:        ran1
+ *    Calls:        ran1, listdeact
  *    Called by:    main program
  ***/
 void performdeactivation(int pid, float fracdeact) {
   int kx, ky, kz, jx, jy, jz, faceid;
+  long n;
   float prdeact;
 
   /* Scan entire 3-D microstructure */
 
   jx = jy = jz = 0;
+  n = 0;
   for (kx = 0; kx < Xsyssize; kx++) {
     for (ky = 0; ky < Ysyssize; ky++) {
       for (kz = 0; kz < Zsyssize; kz++) {
 
+        if ((pid != INERTAGG) && !(kz & (BLOCKSIZE - 1)) &&
+            INERTBLOCK(kx, ky, kz)) {
+          kz += BLOCKSIZE - 1;
+          continue;
+        }
+
         /***
          *    Choose which phases to deactivate
          ***/
@@ -5321,14 +6196,14 @@ void performdeactivation(int pid, float fracdeact) {
               jz = kz;
               break;
             case 4:
-              jz = ky + 1;
+              jz = kz + 1;
               if (jz > (Zsyssize - 1))
                 jz = 0;
               jx = kx;
               jy = ky;
               break;
             case 5:
-              jz = ky - 1;
+              jz = kz - 1;
               if (jz < 0)
                 jz = Zsyssize - 1;
               jx = kx;
@@ -5348,27 +6223,40 @@ void performdeactivation(int pid, float fracdeact) {
               prdeact = ran1(Seed);
               if (prdeact < fracdeact) {
 
-                /***
-                 *    Deactivation is by multiplying
-                 *    by prime factor
-                 ***/
+                /* Deactivation is by setting the bit of the face */
 
-                Deactivated[kx][ky][kz] *= Primevalues[faceid];
+                Deactivated[kx][ky][kz] |= DEACTBIT(faceid);
               }
             }
           }
         }
 
+        if (Deactivated[kx][ky][kz]) {
+          if (listdeact(n, kx, ky, kz)) {
+            freeallmem();
+            bailout("disrealnew", "Could not grow list of deactivated pixels");
+            exit(1);
+          }
+          n++;
+        }
+
       } /* End of loop over Z */
     } /* End of loop over Y */
   } /* End of loop over X */
+
+  Ndeactpix = n;
 }
 
 /***
  *    performreactivation
  *
  *     Reactivate a fraction (fracreact) of the
- *     a deactivated surface to allow its hydrating
+ *     a deactivated surface to allow its hydrating.
+ *     Only the pixels in the list of deactivated
+ *     pixels are visited, in the same x, y, z order
+ *     as a scan of the whole microstructure, and
+ *     those left with no deactivated face are
+ *     dropped from the list.
  *
  *     Arguments:    int phase id to reactivate
  *                 float fraction to deactivate
@@ -5376,752 +6264,1853 @@ void performdeactivation(int pid, float fracdeact) {
  *
  *     Returns:    nothing
  *
- *    Calls:        ran1
+ *    Calls:        ran1, finddeact
  *    Called by:    main program
  ***/
 void performreactivation(int pid, float fracreact, int finalreact) {
-  int kx, ky, kz, faceid, cv;
+  int kx, ky, kz, faceid;
+  long i, k, n, plane;
   float prreact;
 
-  /* Scan entire 3-D microstructure */
+  if (Ndeactpix < 0 && finddeact()) {
+    freeallmem();
+    bailout("disrealnew", "Could not grow list of deactivated pixels");
+    exit(1);
+  }
+
+  plane = (long)Ysyssize * Zsyssize;
+  n = 0;
+  for (i = 0; i < Ndeactpix; i++) {
+    k = Deactpix[i];
+    kx = (int)(k / plane);
+    ky = (int)((k % plane) / Zsyssize);
+    kz = (int)(k % Zsyssize);
+
+    if (Mic[kx][ky][kz] == pid) {
+
+      for (faceid = 0; faceid < 6; faceid++) {
+        if (Deactivated[kx][ky][kz] & DEACTBIT(faceid)) {
+          prreact = ran1(Seed);
+          if ((prreact < fracreact) || (finalreact)) {
+
+            /* Reactivation is by clearing the bit of the face */
+
+            Deactivated[kx][ky][kz] &= (char)(~DEACTBIT(faceid));
+          }
+        }
+
+      } /* End of loop over faces of pixel */
+    }
+
+    if (Deactivated[kx][ky][kz])
+      Deactpix[n++] = k;
+  }
+  Ndeactpix = n;
+}
+
+/***
+ *    refreshhalo
+ *
+ *     Fill the halo of Mic with periodic images of the
+ *     current system
+ *
+ *     Arguments:    none
+ *
+ *     Returns:    nothing
+ *
+ *    Calls:        gridhalo
+ *    Called by:    passone, resetcrackpores
+ ***/
+void refreshhalo(void) {
+  gridhalo(Mic, Xsyssize, Ysyssize, Zsyssize);
+
+  return;
+}
+
+/***
+ *    mirrormic
+ *
+ *     Copy the Mic value of a pixel into each of its periodic
+ *     images in the halo, so that a refreshed halo stays valid
+ *     after the pixel is changed.  Does nothing for pixels away
+ *     from the faces.
+ *
+ *     Arguments:    int x,y, and z coordinates of the pixel
+ *
+ *     Returns:    nothing
+ *
+ *    Calls:        no other routines
+ *    Called by:    passone, resetcrackpores
+ ***/
+void mirrormic(int x, int y, int z) {
+  int hx[3], hy[3], hz[3];
+  int nx, ny, nz, i, j, k;
+  char val;
+
+  nx = ny = nz = 1;
+  hx[0] = x;
+  hy[0] = y;
+  hz[0] = z;
+  if (x < MICHALO)
+    hx[nx++] = x + Xsyssize;
+  if (x >= Xsyssize - MICHALO)
+    hx[nx++] = x - Xsyssize;
+  if (y < MICHALO)
+    hy[ny++] = y + Ysyssize;
+  if (y >= Ysyssize - MICHALO)
+    hy[ny++] = y - Ysyssize;
+  if (z < MICHALO)
+    hz[nz++] = z + Zsyssize;
+  if (z >= Zsyssize - MICHALO)
+    hz[nz++] = z - Zsyssize;
+
+  if (nx == 1 && ny == 1 && nz == 1)
+    return;
+
+  val = Mic[x][y][z];
+  for (i = 0; i < nx; i++) {
+    for (j = 0; j < ny; j++) {
+      for (k = 0; k < nz; k++) {
+        Mic[hx[i]][hy[j]][hz[k]] = val;
+      }
+    }
+  }
+
+  return;
+}
+
+/***
+ *    edgerowfor
+ *
+ *     For each pixel of the row (xck,yck,*) find whether it
+ *     would be on a surface with pore space if it were
+ *     soluble: whether any of its nbrs neighbors is in the
+ *     SURFOPEN class, or belongs to another particle
+ *
+ *     Compiled once for each number of neighbors the parameter
+ *     file allows (edgerow6, edgerow18, edgerow26), so that the
+ *     neighbor loop has a fixed count the compiler can unroll,
+ *     and once for any count (edgerowany).  Edgerow is set to
+ *     the one for NEIGHBORS when the parameter file is read.
+ *
+ *     Arguments:    integer x and y coordinates of the row
+ *                 pointer to Zsyssize flags to fill (1 if on a
+ *                 surface, 0 otherwise)
+ *                 int number of neighbors
+ *
+ *     Returns:    nothing
+ *
+ *    Calls:        no other routines
+ *    Called by:    edgerow6, edgerow18, edgerow26, edgerowany
+ ***/
+static inline void edgerowfor(int xck, int yck, unsigned char *edge,
+                              int nbrs) {
+  int ip, zck;
+  const char *nmic;
+  const uint64_t *pedge;
+
+  /* JWB: a neighbor in another particle also counts, as a
+   * trial to prevent adjacent particles from blocking each
+   * other's dissolution
+   */
+
+  pedge = Partedge + ((size_t)xck * Ysyssize + yck) * Partedgewords;
+  for (zck = 0; zck < Zsyssize; zck++) {
+    edge[zck] = (unsigned char)((pedge[zck >> 6] >> (zck & 63)) & 1);
+  }
+
+  /***
+   *    Each neighbor in turn is a whole row read at an
+   *    offset.  Periodic boundary conditions come from the
+   *    halo of Mic, which the caller must have refreshed.
+   ***/
+
+  for (ip = 0; ip < nbrs; ip++) {
+    nmic = Mic[xck + Xoff[ip]][yck + Yoff[ip]] + Zoff[ip];
+
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for (zck = 0; zck < Zsyssize; zck++) {
+      edge[zck] |=
+          (unsigned char)(Surfclass[(unsigned char)nmic[zck]] & SURFOPEN);
+    }
+  }
+
+  return;
+}
+
+void edgerow6(int xck, int yck, unsigned char *edge) {
+  edgerowfor(xck, yck, edge, 6);
+}
+
+void edgerow18(int xck, int yck, unsigned char *edge) {
+  edgerowfor(xck, yck, edge, 18);
+}
+
+void edgerow26(int xck, int yck, unsigned char *edge) {
+  edgerowfor(xck, yck, edge, 26);
+}
+
+void edgerowany(int xck, int yck, unsigned char *edge) {
+  edgerowfor(xck, yck, edge, NEIGHBORS);
+}
+
+/***
+ *    edgerowpick
+ *
+ *     Choose the compiled edgerow for a number of neighbors
+ *
+ *     Arguments:    int number of neighbors
+ *
+ *     Returns:    pointer to the edgerow function
+ *
+ *    Calls:        no other routines
+ *    Called by:    get_input
+ ***/
+Edgerowfn edgerowpick(int nbrs) {
+  switch (nbrs) {
+  case 6:
+    return (edgerow6);
+  case 18:
+    return (edgerow18);
+  case 26:
+    return (edgerow26);
+  default:
+    return (edgerowany);
+  }
+}
+
+/***
+ *    resetcrackpores
+ *
+ *     Scans over all pixels.  If a pixel of type POROSITY or CRACKP
+ *     is found, then checks nearest neighbors to decide majority type
+ *     of pore pixels surrounding a pixel at position xck,yck,zck
+ *
+ *     Arguments:    none
+ *
+ *     Returns:    nothing
+ *
+ *    Calls:        refreshhalo, mirrormic
+ *    Called by:    main function
+ ***/
+void resetcrackpores(void) {
+  int porecnt, crackcnt, curid;
+  int x1, y1, z1, x2, y2, z2;
+  int ip;
+
+  /***
+   *    Check all neighboring pixels (6, 18, or 26)
+   *    and use periodic boundary conditions
+   *
+   *    Change number of NEIGHBORS in header file
+   *    called disrealnew.h
+   ***/
+
+  refreshhalo();
+
+  for (x1 = 0; x1 < Xsyssize; x1++) {
+    for (y1 = 0; y1 < Ysyssize; y1++) {
+      for (z1 = 0; z1 < Zsyssize; z1++) {
+        if (!(z1 & (BLOCKSIZE - 1)) && INERTBLOCK(x1, y1, z1)) {
+          z1 += BLOCKSIZE - 1;
+          continue;
+        }
+        if (Mic[x1][y1][z1] == POROSITY || Mic[x1][y1][z1] == CRACKP) {
+
+          curid = Mic[x1][y1][z1];
+          porecnt = crackcnt = 0;
+          for (ip = 0; ip < NEIGHBORS; ip++) {
+
+            x2 = x1 + Xoff[ip];
+            y2 = y1 + Yoff[ip];
+            z2 = z1 + Zoff[ip];
+
+            if (Mic[x2][y2][z2] == POROSITY)
+              porecnt++;
+            if (Mic[x2][y2][z2] == CRACKP)
+              crackcnt++;
+          }
+
+          if ((porecnt >= crackcnt) && curid == CRACKP) {
+            MICSET(x1, y1, z1, POROSITY);
+            mirrormic(x1, y1, z1);
+            Count[CRACKP]--;
+            Count[POROSITY]++;
+          } else if ((crackcnt < porecnt) && curid == POROSITY) {
+            MICSET(x1, y1, z1, CRACKP);
+            mirrormic(x1, y1, z1);
+            Count[CRACKP]++;
+            Count[POROSITY]--;
+          }
+        }
+      }
+    }
+  }
+
+  return;
+}
+
+/***
+ *    countphase
+ *
+ *       Scan microstructure and determine the number of voxels of a
+ *particular phase
+ *
+ *     Arguments:    int phid (phase id to check)
+ *
+ *     Returns:    int number of voxels of that phase
+ *
+ *    Calls:        grid_census
+ *    Called by:    main
+ ***/
+int countphase(int phid) {
+  int cnt[CENSUSIDS];
+
+  /* Take a census of the entire 3-D microstructure */
+
+  grid_census(Mic, Xsyssize, Ysyssize, Zsyssize, CENSUSIDS, cnt);
+
+  return (((phid >= 0) && (phid < CENSUSIDS)) ? cnt[phid] : 0);
+}
+
+/***
+ *    setblocks
+ *
+ *     Find the blocks of the microstructure that hold nothing
+ *     but aggregate (Blockinert), and count their pixels.  Must
+ *     be called again whenever Mic is rebuilt or resized.
+ *
+ *     Arguments:    none
+ *
+ *     Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        no other routines
+ *    Called by:    hydinit, hydcycle
+ ***/
+int setblocks(void) {
+  int bx, by, bz, x, y, z, x1, y1, z1, inert;
+  size_t k;
+
+  if (Blockinert)
+    free(Blockinert);
+  Xblocks = (Xsyssize + BLOCKSIZE - 1) / BLOCKSIZE;
+  Yblocks = (Ysyssize + BLOCKSIZE - 1) / BLOCKSIZE;
+  Zblocks = (Zsyssize + BLOCKSIZE - 1) / BLOCKSIZE;
+  Blockinert = (unsigned char *)calloc((size_t)Xblocks * Yblocks * Zblocks,
+                                       sizeof(unsigned char));
+  Inertagg = 0;
+  if (!Blockinert)
+    return (1);
+
+  /* Blocks at the far faces may be cut short by the system size */
+
+  k = 0;
+  for (bx = 0; bx < Xblocks; bx++) {
+    x1 = ((bx + 1) * BLOCKSIZE < Xsyssize) ? (bx + 1) * BLOCKSIZE : Xsyssize;
+    for (by = 0; by < Yblocks; by++) {
+      y1 = ((by + 1) * BLOCKSIZE < Ysyssize) ? (by + 1) * BLOCKSIZE : Ysyssize;
+      for (bz = 0; bz < Zblocks; bz++, k++) {
+        z1 = ((bz + 1) * BLOCKSIZE < Zsyssize) ? (bz + 1) * BLOCKSIZE
+                                                : Zsyssize;
+        inert = 1;
+        for (x = bx * BLOCKSIZE; inert && x < x1; x++) {
+          for (y = by * BLOCKSIZE; inert && y < y1; y++) {
+            for (z = bz * BLOCKSIZE; inert && z < z1; z++) {
+              inert = (Mic[x][y][z] == INERTAGG);
+            }
+          }
+        }
+        if (inert) {
+          Blockinert[k] = 1;
+          Inertagg += (x1 - bx * BLOCKSIZE) * (y1 - by * BLOCKSIZE) *
+                      (z1 - bz * BLOCKSIZE);
+        }
+      }
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *    partedgebuild
+ *
+ *     Make Partedge from Micpart: for every pixel, whether any
+ *     of its NEIGHBORS neighbors (periodic) is in another
+ *     particle.  Three x planes of ids are decoded at a time.
+ *
+ *     Arguments:    none
+ *
+ *     Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        partmap_row
+ *    Called by:    layerbuild
+ ***/
+int partedgebuild(void) {
+  int ix, iy, iz, ip, ny, nz, px, *ids, *pl[3];
+  size_t nplane, w;
+  uint64_t *newp;
+
+  nplane = (size_t)Ysyssize * Zsyssize;
+  Partedgewords = (Zsyssize + 63) / 64;
+  newp = (uint64_t *)realloc(Partedge, (size_t)Xsyssize * Ysyssize *
+                                           Partedgewords * sizeof(uint64_t));
+  ids = (int *)malloc(3 * nplane * sizeof(int));
+  if (!newp || !ids) {
+    if (newp)
+      Partedge = newp;
+    if (ids)
+      free(ids);
+    return (1);
+  }
+  Partedge = newp;
+  memset(Partedge, 0,
+         (size_t)Xsyssize * Ysyssize * Partedgewords * sizeof(uint64_t));
+
+  /***
+   *    Plane x of the ids is pl[1], with its neighbors pl[0]
+   *    and pl[2]; each plane stays in its slot while it is
+   *    needed, so only the next one is decoded
+   ***/
+
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (ip = 0; ip < 3; ip++) {
+      px = (ix + ip - 1 + Xsyssize) % Xsyssize;
+      pl[ip] = ids + (size_t)((ix + ip) % 3) * nplane;
+      if (ix == 0 || ip == 2) {
+        for (iy = 0; iy < Ysyssize; iy++) {
+          partmap_row(&Micpart, px, iy, pl[ip] + (size_t)iy * Zsyssize);
+        }
+      }
+    }
+    for (iy = 0; iy < Ysyssize; iy++) {
+      w = ((size_t)ix * Ysyssize + iy) * Partedgewords;
+      for (iz = 0; iz < Zsyssize; iz++) {
+        for (ip = 0; ip < NEIGHBORS; ip++) {
+          ny = (iy + Yoff[ip] + Ysyssize) % Ysyssize;
+          nz = (iz + Zoff[ip] + Zsyssize) % Zsyssize;
+          if (pl[1 + Xoff[ip]][(size_t)ny * Zsyssize + nz] !=
+              pl[1][(size_t)iy * Zsyssize + iz]) {
+            Partedge[w + (iz >> 6)] |= (uint64_t)1 << (iz & 63);
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  free(ids);
+
+  return (0);
+}
+
+/***
+ *    layerbuild
+ *
+ *     Make what is kept alongside Mic with --solid-layer and
+ *     --bit-planes, and Partedge, anew from the whole of Mic
+ *     and Micpart.  Must be called again whenever Mic is
+ *     rebuilt or resized.
+ *
+ *     Arguments:    none
+ *
+ *     Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        partedgebuild, solidbuild, bitbuild
+ *    Called by:    hydinit, hydcycle
+ ***/
+int layerbuild(void) {
+  if (partedgebuild())
+    return (1);
+  if (solidbuild())
+    return (1);
+
+  return (bitbuild());
+}
+
+/***
+ *    alkreset
+ *
+ *     Empty one of the alkali sulfate lists by giving all its
+ *     nodes back to their pool at once, leaving only a head
+ *     node at (0,0,0)
+ *
+ *     Arguments:    Nodepool pointer to the pool of the list
+ *                   pointers to the head and tail of the list
+ *
+ *     Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        nodepool_reset, nodepool_get
+ *    Called by:    init, dissolve
+ ***/
+int alkreset(Nodepool *pool, struct Alksulf **head, struct Alksulf **tail) {
+  nodepool_reset(pool);
+  *head = *tail = (struct Alksulf *)nodepool_get(pool);
+  if (!*head)
+    return (1);
+  (*head)->prevas = NULL;
+  (*head)->nextas = NULL;
+  (*head)->x = 0;
+  (*head)->y = 0;
+  (*head)->z = 0;
+
+  return (0);
+}
+
+/***
+ *    clearsurf
+ *
+ *     Empty the soluble surface index (Surfmap) before the
+ *     passes of a new dissolution cycle
+ *
+ *     Arguments:    none
+ *
+ *     Returns:    nothing
+ *
+ *    Calls:        no other routines
+ *    Called by:    dissolve
+ ***/
+void clearsurf(void) {
+  size_t nwords;
+
+  nwords = ((size_t)Xsyssize * Ysyssize * Zsyssize + SURFBITS - 1) / SURFBITS;
+  memset(Surfmap, 0, nwords * sizeof(unsigned int));
+}
+
+/***
+ *    marksurf
+ *
+ *     Add pixel (x,y,z) to the soluble surface index
+ *
+ *     Arguments:    int x,y, and z coordinates
+ *
+ *     Returns:    nothing
+ *
+ *    Calls:        no other routines
+ *    Called by:    passone
+ ***/
+void marksurf(int x, int y, int z) {
+  size_t k;
+
+  k = ((size_t)z * Ysyssize + y) * Xsyssize + x;
+  Surfmap[k / SURFBITS] |= 1U << (k % SURFBITS);
+}
+
+/***
+ *    nextsurf
+ *
+ *     Step to the next pixel of the soluble surface index,
+ *     in z, y, x order.  Start with *pos = -1.
+ *
+ *     Arguments:    pointer to long position in the index
+ *                 pointers to int x,y, and z of the pixel found
+ *
+ *     Returns:    1 if a pixel was found, 0 at the end of the system
+ *
+ *    Calls:        nextsurfto
+ *    Called by:    dissolve
+ ***/
+int nextsurf(long *pos, int *x, int *y, int *z) {
+  return (nextsurfto(pos, (long)Xsyssize * Ysyssize * Zsyssize, x, y, z));
+}
+
+/***
+ *    nextsurfto
+ *
+ *     Step to the next pixel of the soluble surface index
+ *     before position end, in z, y, x order
+ *
+ *     Arguments:    pointer to long position in the index
+ *                 long position to stop at
+ *                 pointers to int x,y, and z of the pixel found
+ *
+ *     Returns:    1 if a pixel was found, 0 otherwise
+ *
+ *    Calls:        no other routines
+ *    Called by:    nextsurf, dissolveslab
+ ***/
+int nextsurfto(long *pos, long end, int *x, int *y, int *z) {
+  long k, plane;
+  unsigned int w;
+
+  plane = (long)Xsyssize * Ysyssize;
+  k = *pos + 1;
+
+  while (k < end) {
+    w = Surfmap[k / SURFBITS] >> (k % SURFBITS);
+    if (w) {
+      while (!(w & 1U)) {
+        w >>= 1;
+        k++;
+      }
+      break;
+    }
+    k = (k / SURFBITS + 1) * SURFBITS;
+  }
+
+  if (k >= end)
+    return (0);
+
+  *pos = k;
+  *z = (int)(k / plane);
+  *y = (int)((k % plane) / Xsyssize);
+  *x = (int)(k % Xsyssize);
+
+  return (1);
+}
+
+/***
+ *    cshagecode
+ *
+ *     Code stored in Cshage for a CSH pixel formed in a cycle.
+ *     Cycle 0 is the starting microstructure.
+ *
+ *     Arguments:    int cycle
+ *
+ *     Returns:    int code, 0 to CSHAGECODES - 1
+ *
+ *    Calls:        no other routines
+ *    Called by:    randcsh, movecsh
+ ***/
+int cshagecode(int cycle) {
+  int code;
+
+  if (cycle <= 0)
+    return (0);
+  code = 1 + (cycle - 1) / Cshagewidth;
+
+  return ((code < CSHAGECODES) ? code : CSHAGECODES - 1);
+}
+
+/***
+ *    cshagecycle
+ *
+ *     Cycle whose Molarvcsh and Watercsh stand for every CSH
+ *     pixel with a Cshage code, which is the first cycle the
+ *     code covers
+ *
+ *     Arguments:    int code (as stored in Cshage)
+ *
+ *     Returns:    int cycle
+ *
+ *    Calls:        no other routines
+ *    Called by:    passone, dissolve
+ ***/
+int cshagecycle(int code) {
+  code &= 0xff;
+
+  return ((code > 0) ? 1 + (code - 1) * Cshagewidth : 0);
+}
+
+/***
+ *    passone
+ *
+ *     First pass through microstructure during dissolution.
+ *     Low and high indicate the phase ID range to check for
+ *     surface sites.  Every pixel marked for dissolution, and
+ *     every SLAG pixel (and CSH pixel, when cshexflag and
+ *     Csh2flag are set), is added to the soluble surface index.
+ *     Blocks of nothing but aggregate (Blockinert) are skipped.
+ *
+ *     Arguments:    int low, high (phase id range to check)
+ *                 int cycid
+ *                 int cshexflag (0 or 1 only)
+ *
+ *     Returns:    nothing
+ *
+ *    Calls:        refreshhalo, Edgerow, mirrormic, marksurf
+ *    Called by:    dissolve
+ ***/
+void passone(int low, int high, int cycid, int cshexflag) {
+  int i, xid, yid, zid, phid, phread, cshcyc, rowedge;
+  unsigned char edge[MAXSIZE];
+
+  /* Gypready used to determine if any soluble gypsum remains */
+
+  if ((low <= GYPSUM) && (GYPSUM <= high)) {
+    Gypready = 0;
+  }
+
+  /***
+   *    Zero out count for the relevant phases.  The pixels of
+   *    the inert blocks, all aggregate, are counted at once.
+   ***/
+
+  for (i = low; i <= high; i++) {
+    Count[i] = 0;
+  }
+  if ((low <= INERTAGG) && (INERTAGG <= high)) {
+    Count[INERTAGG] = Inertagg;
+  }
+
+  /* Neighbors are read from the halo, kept valid by mirrormic */
+
+  refreshhalo();
+
+  /* Scan the entire 3-D microstructure */
+
+  for (xid = 0; xid < Xsyssize; xid++) {
+    for (yid = 0; yid < Ysyssize; yid++) {
+
+      /***
+       *    The surface flags of a row are found the first
+       *    time a soluble pixel in it needs them.  Marking a
+       *    pixel with OFFSET does not change them, because
+       *    no soluble phase is in the SURFOPEN class.
+       ***/
+
+      rowedge = 0;
+      for (zid = 0; zid < Zsyssize; zid++) {
+
+        if (!(zid & (BLOCKSIZE - 1)) && INERTBLOCK(xid, yid, zid)) {
+          zid += BLOCKSIZE - 1;
+          continue;
+        }
+
+        phread = Mic[xid][yid][zid];
+
+        /* Update heat data and water consumed for solid CSH */
+
+        if ((cshexflag) && (phread == CSH)) {
+          cshcyc = Cshage ? cshagecycle(Cshage[xid][yid][zid]) : 0;
+          Heatsum += Heatf[CSH] / Molarvcsh[cshcyc];
+          Molesh2o += Watercsh[cshcyc] / Molarvcsh[cshcyc];
+        }
+
+        /* Identify phase and update count */
+
+        phid = NPHASES + 10; /* Clearly out of bounds */
+
+        if ((phread >= low) && (phread <= high)) {
+
+          i = phid = phread;
+
+          /* Update count for this phase */
+
+          Count[i]++;
+
+          if ((i == GYPSUM) || (i == GYPSUMS)) {
+            Gypready++;
+          }
+
+          /* If first cycle, then accumulate initial counts */
+
+          if ((cycid == 1) || ((cycid == 0) && (Ncyc == 0))) {
+
+            /***
+             *    Ordered in terms of likely volume
+             *    fractions (largest to smallest) to
+             *    speed execution
+             ***/
+
+            if (i == POROSITY) {
+              Porinit++;
+            } else if (i == C3S) {
+              C3sinit++;
+            } else if (i == C2S) {
+              C2sinit++;
+            } else if (i == C3A) {
+              C3ainit++;
+            } else if (i == OC3A) {
+              Oc3ainit++;
+            } else if (i == C4AF) {
+              C4afinit++;
+            } else if (i == K2SO4) {
+              Ksulfinit++;
+            } else if (i == NA2SO4) {
+              Nasulfinit++;
+            } else if (i == GYPSUM) {
+              Ncsbar++;
+            } else if (i == GYPSUMS) {
+              Ncsbar++;
+            } else if (i == ANHYDRITE) {
+              Anhinit++;
+            } else if (i == HEMIHYD) {
+              Heminit++;
+            } else if (i == SFUME || i == AMSIL) {
+              Nsilica++;
+            } else if (i == SLAG) {
+              Slaginit++;
+            } else if (i == FREELIME) {
+              Freelimeinit++;
+            } else if (i == ETTR) {
+              Netbar++;
+            } else if (i == ETTRC4AF) {
+              Netbar++;
+            } else if (i == CRACKP) {
+              Crackpinit++;
+            }
+          }
+        }
+
+        /***
+         *    Currently do NOT identify
+         *    SURFACE pixels of K2SO4 and NA2SO4
+         ***/
+
+        if (phid != NPHASES + 10 && Mic[xid][yid][zid] != K2SO4 &&
+            Mic[xid][yid][zid] != NA2SO4) {
+
+          /***
+           *    If phase is soluble, see if it is
+           *    in contact with porosity.  Soluble only
+           *    goes up to NSPHASES; nothing above is.
+           ***/
+
+          if ((cycid != 0) && (phid <= NSPHASES) && (Soluble[phid] == 1)) {
+            if (!rowedge) {
+              Edgerow(xid, yid, edge);
+              rowedge = 1;
+            }
+            if (edge[zid]) {
+
+              /***
+               *    Surface eligible species has an
+               *    ID that is OFFSET greater than its
+               *    original value.  Means that it is
+               *    ready for dissolution.
+               ***/
+
+              Mic[xid][yid][zid] += (int)(OFFSET);
+              mirrormic(xid, yid, zid);
+              marksurf(xid, yid, zid);
+            }
+          }
+        }
+
+        /***
+         *    Slag is always visited by the main dissolution
+         *    loop, and so is CSH when it may convert to
+         *    pozzolanic CSH
+         ***/
+
+        if (phid == SLAG || (cshexflag && phid == CSH && Csh2flag == 1))
+          marksurf(xid, yid, zid);
+
+      } /* end of xid */
+    } /* end of yid */
+  } /* end of zid */
+}
+
+/***
+ *    loccsh
+ *
+ *     Place a diffusing CSH species near dissolution source
+ *     at (xcur,ycur,zcur)
+ *
+ *     The species goes to a random pixel of the source's pore
+ *     type in the box of side Distloccsh about the source, as
+ *     if by up to LOCCSHMAXTRIES random tries in the box.  Only
+ *     the first LOCCSHTRIES of them are made one by one.  Once
+ *     they all miss, which they do when the box has little of
+ *     that pore left, the box is scanned instead: with n of its
+ *     N offsets eligible, the rest of the tries would have
+ *     found one with probability 1 - (1 - n/N)^(tries left),
+ *     and the one found is equally likely to be any of them,
+ *     so one draw decides whether the species is placed and one
+ *     more picks the pixel.  The chances are those of the tries
+ *     themselves, but the work is bounded by two passes over
+ *     the box rather than hundreds of random reads.  A third
+ *     draw gives how many of the tries would have missed first,
+ *     so that Nrejected counts what the tries would have.
+ *
+ *     With --legacy-ants (Bucketants 0) all LOCCSHMAXTRIES tries
+ *     are made one by one as the original code did, so that run
+ *     keeps the sequence of random numbers it always had.
+ *
+ *     Arguments:    int x,y, and z coordinates
+ *                 int id of pore type used to create the diffusing species
+ *                 (change added 24 May 2004)
+ *
+ *     Returns:    1 if species is placed, 0 otherwise
+ *
+ *    Calls:        loccshscan, addant
+ *    Called by:    dissolve
+ ***/
+int loccsh(int xcur, int ycur, int zcur, int sourcepore) {
+  int effort, tries, maxtries, xmod, ymod, zmod, span, nfree, pick, nmiss;
+  int halfbox;
+  double pfree, pfind;
+
+  /* effort indicates if appropriate location found */
+  effort = 0;
+
+  tries = 0;
+
+  /* Execute up to maxtries tries in immediate vicinity */
+
+  maxtries = (Bucketants) ? LOCCSHTRIES : LOCCSHMAXTRIES;
+  halfbox = Distloccsh / 2;
+  while ((!effort) && (tries < maxtries)) {
+
+    tries++;
+    xmod = (-halfbox) + (int)(Distloccsh * ran1(Seed));
+    ymod = (-halfbox) + (int)(Distloccsh * ran1(Seed));
+    zmod = (-halfbox) + (int)(Distloccsh * ran1(Seed));
+    if (xmod > halfbox)
+      xmod = halfbox;
+    if (ymod > halfbox)
+      ymod = halfbox;
+    if (zmod > halfbox)
+      zmod = halfbox;
+
+    xmod += xcur;
+    ymod += ycur;
+    zmod += zcur;
+
+    /* Periodic boundary conditions */
+
+    xmod += checkbc(xmod, Xsyssize);
+    ymod += checkbc(ymod, Ysyssize);
+    zmod += checkbc(zmod, Zsyssize);
+
+    if (Mic[xmod][ymod][zmod] == sourcepore)
+      effort = 1;
+  }
+
+  /***
+   *    Stand in for the tries left with a scan of the box.
+   *    A box of side 0 is tried at the source alone, as the
+   *    random offsets above are then all 0
+   ***/
+
+  if ((!effort) && (tries < LOCCSHMAXTRIES)) {
+    span = (Distloccsh > 1) ? Distloccsh : 1;
+    nfree = loccshscan(xcur, ycur, zcur, sourcepore, span, -1, NULL, NULL,
+                       NULL);
+    pfree = (double)nfree / ((double)span * span * span);
+    pfind = 1.0 - pow(1.0 - pfree, (double)(LOCCSHMAXTRIES - tries));
+    if ((nfree > 0) && (ran1(Seed) < pfind)) {
+      pick = (int)(nfree * ran1(Seed));
+      if (pick >= nfree)
+        pick = nfree - 1;
+      loccshscan(xcur, ycur, zcur, sourcepore, span, pick, &xmod, &ymod,
+                 &zmod);
+      effort = 1;
+
+      /***
+       *    Tries that would have missed before the hit: the
+       *    geometric distribution of the misses, given that
+       *    one of the tries left hits
+       ***/
+
+      nmiss = 0;
+      if (pfree < 1.0) {
+        nmiss = (int)ceil(log(1.0 - ran1(Seed) * pfind) / log(1.0 - pfree)) -
+                1;
+        if (nmiss < 0)
+          nmiss = 0;
+        if (nmiss > LOCCSHMAXTRIES - tries - 1)
+          nmiss = LOCCSHMAXTRIES - tries - 1;
+      }
+      tries += nmiss + 1;
+    } else {
+      tries = LOCCSHMAXTRIES;
+    }
+  }
 
-  for (kx = 0; kx < Xsyssize; kx++) {
-    for (ky = 0; ky < Ysyssize; ky++) {
-      for (kz = 0; kz < Zsyssize; kz++) {
+  if (effort) {
+    MICSET(xmod, ymod, zmod, DIFFCSH);
+    Nmade++;
+    Ngoing++;
 
-        if (Mic[kx][ky][kz] == pid) {
+    /* Add this diffusing CSH species to the ant pool */
 
-          for (faceid = 0; faceid < 6; faceid++) {
-            cv = Deactivated[kx][ky][kz] % Primevalues[faceid];
-            if (!cv) {
-              prreact = ran1(Seed);
-              if ((prreact < fracreact) || (finalreact)) {
+    if (addant(xmod, ymod, zmod, DIFFCSH, Cyccnt)) {
+      freeallmem();
+      bailout("loccsh", "Could not add diffusing CSH to ant pool");
+      exit(1);
+    }
+  }
 
-                /***
-                 *    Reactivation is by dividing by
-                 *    prime factor
-                 ***/
+  Nrejected += tries - effort;
 
-                Deactivated[kx][ky][kz] /= Primevalues[faceid];
-              }
-            }
+  return (effort);
+}
 
-          } /* End of loop over faces of pixel */
+/***
+ *    loccshscan
+ *
+ *     Go over the offsets the random tries of loccsh can take,
+ *     either to count those that land on the source's pore
+ *     type or to find the one of them numbered pick
+ *
+ *     Arguments:    int x,y, and z coordinates of the source
+ *                 int id of pore type
+ *                 int side of the box
+ *                 int number of the eligible offset wanted, or -1
+ *                 to count them
+ *                 int pointers to its x, y and z coordinates
+ *
+ *     Returns:    int number of eligible offsets when counting,
+ *                 otherwise 1 if the one wanted was found, 0 if not
+ *
+ *    Calls:        checkbc
+ *    Called by:    loccsh
+ ***/
+int loccshscan(int xcur, int ycur, int zcur, int sourcepore, int span,
+               int pick, int *xfound, int *yfound, int *zfound) {
+  int i, j, k, x, y, z, halfbox, n;
+
+  halfbox = span / 2;
+  n = 0;
+  for (i = 0; i < span; i++) {
+    x = xcur - halfbox + i;
+    x += checkbc(x, Xsyssize);
+    for (j = 0; j < span; j++) {
+      y = ycur - halfbox + j;
+      y += checkbc(y, Ysyssize);
+      for (k = 0; k < span; k++) {
+        z = zcur - halfbox + k;
+        z += checkbc(z, Zsyssize);
+        if (Mic[x][y][z] != sourcepore)
+          continue;
+        if (n == pick) {
+          *xfound = x;
+          *yfound = y;
+          *zfound = z;
+          return (1);
         }
+        n++;
+      }
+    }
+  }
 
-      } /* End of loop over Z */
-    } /* End of loop over Y */
-  } /* End of loop over X */
+  return ((pick < 0) ? n : 0);
 }
 
 /***
- *    chckedge
+ *    countbox
  *
- *     Check if a pixel located at (xck,yck,zck) is on a
- *     surface with pore space in the 3D system
+ *     Count the number of pore pixels within a cube of
+ *     size boxsize, centered at (qx,qy,qz)
  *
- *     Arguments:    int phase to check
- *                 integer x,y, and z coordinates to check
+ *     Arguments:    int boxsize
+ *                 int x,y, and z coordinates of box center
  *
- *     Returns:    1 if on a surface, 0 otherwise
+ *     Returns:    int number of pore pixels found within box
  *
  *    Calls:        no other routines
- *    Called by:    passone
+ *    Called by:    dissolve
  ***/
-int chckedge(int phase, int xck, int yck, int zck) {
-  int edgeback = 0;
-  int x2, y2, z2;
-  int ip;
+int countbox(int boxsize, int qx, int qy, int qz) {
+  int nfound, ix, iy, iz, qxlo, qxhi, qylo, qyhi, qzlo, qzhi;
+  int hx, hy, hz, boxhalf;
+
+  boxhalf = boxsize / 2;
+  nfound = 0;
+  qxlo = qx - boxhalf;
+  qxhi = qx + boxhalf;
+  qylo = qy - boxhalf;
+  qyhi = qy + boxhalf;
+  qzlo = qz - boxhalf;
+  qzhi = qz + boxhalf;
 
   /***
-   *    Check all neighboring pixels (6, 18, or 26)
-   *    and use periodic boundary conditions
-   *
-   *    Change number of NEIGHBORS in header file
-   *    called disrealnew.h
+   *    Count the number of requisite pixels in the
+   *    3-D cube box using periodic boundaries
    ***/
 
-  for (ip = 0; ((ip < NEIGHBORS) && (!edgeback)); ip++) {
+  for (ix = qxlo; ix <= qxhi; ix++) {
+    hx = ix;
+    hx += checkbc(hx, Xsyssize);
+
+    for (iy = qylo; iy <= qyhi; iy++) {
+      hy = iy;
+      hy += checkbc(hy, Ysyssize);
+
+      for (iz = qzlo; iz <= qzhi; iz++) {
+        hz = iz;
+        hz += checkbc(hz, Zsyssize);
 
-    x2 = xck + Xoff[ip];
-    y2 = yck + Yoff[ip];
-    z2 = zck + Zoff[ip];
+        /***
+         *    Count if porosity, diffusing species,
+         *    or empty porosity
+         ***/
 
-    x2 += checkbc(x2, Xsyssize);
-    y2 += checkbc(y2, Ysyssize);
-    z2 += checkbc(z2, Zsyssize);
+        if ((Mic[hx][hy][hz] == POROSITY) || (Mic[hx][hy][hz] > NSPHASES)) {
 
-    if (Mic[x2][y2][z2] == POROSITY || Mic[x2][y2][z2] == CRACKP ||
-        Mic[x2][y2][z2] == CSH || Mic[x2][y2][z2] == POZZCSH ||
-        Mic[x2][y2][z2] == SLAGCSH) {
-      edgeback = 1;
-    }
-    /* JWB: Added this block as a trial to prevent adjacent
-     * particles from blocking each other's dissolution
-     */
-    else if (Micpart[xck][yck][zck] != Micpart[x2][y2][z2]) {
-      edgeback = 1;
-    }
-  }
+          nfound++;
+        }
 
-  return (edgeback);
+      } /* End of loop over z */
+    } /* End of loop over y */
+  } /* End of loop over x */
+
+  return (nfound);
 }
 
 /***
- *    resetcrackpores
+ *    makeinert
  *
- *     Scans over all pixels.  If a pixel of type POROSITY or CRACKP
- *     is found, then checks nearest neighbors to decide majority type
- *     of pore pixels surrounding a pixel at position xck,yck,zck
+ *    Create ndesire pixels of empty pore space to simulate
+ *    self-desiccation
  *
- *     Arguments:    none
+ *     Arguments:    int ndesire (number to create)
  *
  *     Returns:    nothing
  *
- *    Calls:        no other routines
- *    Called by:    main function
+ *    Calls:        boxtable_alloc, boxtable_build, boxtable_count,
+ *                boxtable_free, topsites_alloc, topsites_rank,
+ *                topsites_free
+ *    Called by:    dissolve
  ***/
-void resetcrackpores(void) {
-  int porecnt, crackcnt, curid;
-  int x1, y1, z1, x2, y2, z2;
-  int ip;
+void makeinert(int ndesire) {
+  int i;
+  int px, py, pz, cntpore, cntmax, site;
+  Boxtable porebox;
+  Topsites togo;
+
+  cntmax = 0;
 
   /***
-   *    Check all neighboring pixels (6, 18, or 26)
-   *    and use periodic boundary conditions
-   *
-   *    Change number of NEIGHBORS in header file
-   *    called disrealnew.h
+   *    Tabulate the pore pixels once, since none of them
+   *    change until all of the sites have been ranked
    ***/
 
-  for (x1 = 0; x1 < Zsyssize; x1++) {
-    for (y1 = 0; y1 < Ysyssize; y1++) {
-      for (z1 = 0; z1 < Zsyssize; z1++) {
-        if (Mic[x1][y1][z1] == POROSITY || Mic[x1][y1][z1] == CRACKP) {
+  if (boxtable_alloc(&porebox, Xsyssize, Ysyssize, Zsyssize) ||
+      topsites_alloc(&togo, ndesire)) {
+    freeallmem();
+    bailout("makeinert", "Could not allocate memory to rank pore sites");
+    exit(1);
+  }
 
-          curid = Mic[x1][y1][z1];
-          porecnt = crackcnt = 0;
-          for (ip = 0; ip < NEIGHBORS; ip++) {
+  for (px = 0; px < Xsyssize; px++) {
+    for (py = 0; py < Ysyssize; py++) {
+      for (pz = 0; pz < Zsyssize; pz++) {
+        if (!(pz & (BLOCKSIZE - 1)) && INERTBLOCK(px, py, pz)) {
+          pz += BLOCKSIZE - 1;
+          continue;
+        }
+        if ((Mic[px][py][pz] == POROSITY) || (Mic[px][py][pz] > NSPHASES)) {
+          BOXCELL(&porebox, px, py, pz) = 1;
+        }
+      }
+    }
+  }
+  boxtable_build(&porebox);
 
-            x2 = x1 + Xoff[ip];
-            y2 = y1 + Yoff[ip];
-            z2 = z1 + Zoff[ip];
+  /***
+   *    Now scan the microstructure and RANK the sites,
+   *    keeping the ndesire with the most pore neighbors.
+   *    The scan follows the layout of Mic in memory, and
+   *    ties are broken by the site index, in z, y, x order,
+   *    as they were when the sites were offered in that order.
+   ***/
 
-            x2 += checkbc(x2, Xsyssize);
-            y2 += checkbc(y2, Ysyssize);
-            z2 += checkbc(z2, Zsyssize);
+  for (px = 0; px < Xsyssize; px++) {
+    for (py = 0; py < Ysyssize; py++) {
+      for (pz = 0; pz < Zsyssize; pz++) {
+        if (!(pz & (BLOCKSIZE - 1)) && INERTBLOCK(px, py, pz)) {
+          pz += BLOCKSIZE - 1;
+          continue;
+        }
 
-            if (Mic[x2][y2][z2] == POROSITY)
-              porecnt++;
-            if (Mic[x2][y2][z2] == CRACKP)
-              crackcnt++;
-          }
+        if (Mic[px][py][pz] == POROSITY) {
+          cntpore = boxtable_count(&porebox, Cubesize, px, py, pz);
 
-          if ((porecnt >= crackcnt) && curid == CRACKP) {
-            Mic[x1][y1][z1] = POROSITY;
-            Count[CRACKP]--;
-            Count[POROSITY]++;
-          } else if ((crackcnt < porecnt) && curid == POROSITY) {
-            Mic[x1][y1][z1] = CRACKP;
-            Count[CRACKP]++;
-            Count[POROSITY]--;
-          }
+          if (cntpore > cntmax)
+            cntmax = cntpore;
+
+          site = (pz * Ysyssize + py) * Xsyssize + px;
+          topsites_rank(&togo, cntpore, site, site);
         }
-      }
-    }
+
+      } /* End of loop in z */
+    } /* End of loop in y */
+  } /* End of loop in x */
+
+  boxtable_free(&porebox);
+
+  /* Now remove the sites that were kept */
+
+  for (i = 0; i < togo.n; i++) {
+    px = togo.site[i] % Xsyssize;
+    py = (togo.site[i] / Xsyssize) % Ysyssize;
+    pz = togo.site[i] / (Xsyssize * Ysyssize);
+    MICSET(px, py, pz, EMPTYP);
+    Count[POROSITY]--;
+    Count[EMPTYP]++;
   }
+  topsites_free(&togo);
 
-  return;
+  /***
+   *    If only small cubes of porosity were found,
+   *    then adjust Cubesize to have a more efficient
+   *    search in the future
+   ***/
+
+  if (Cubesize > CUBEMIN) {
+    if ((2 * cntmax) < (Cubesize * Cubesize * Cubesize)) {
+      Cubesize -= 2;
+    }
+  }
 }
 
 /***
- *    countphase
+ *    extslagcsh
  *
- *       Scan microstructure and determine the number of voxels of a
- *particular phase
+ *     Add extra SLAGCSH when SLAG reacts at position
+ *     (xpres,ypres,zpres)
  *
- *     Arguments:    int phid (phase id to check)
+ *     Arguments:    int x,y, and z coordinates
  *
- *     Returns:    int number of voxels of that phase
+ *     Returns:    nothing
  *
- *    Calls:        nothing
- *    Called by:    main
+ *    Calls:        growlocal, deferrand, randslagcsh
+ *    Called by:    dissolvesite
  ***/
-int countphase(int phid) {
-  register int xid, yid, zid;
-  int cntphase = 0;
-
-  /* Scan the entire 3-D microstructure */
+void extslagcsh(int xpres, int ypres, int zpres) {
+  int fchr;
+  int maxtries = 100;
 
-  for (xid = 0; xid < Xsyssize; xid++) {
-    for (yid = 0; yid < Ysyssize; yid++) {
-      for (zid = 0; zid < Zsyssize; zid++) {
+  /* First try the six neighbors for porosity of either kind */
 
-        if (Mic[xid][yid][zid] == phid)
-          cntphase += 1;
+  fchr = growlocal(xpres, ypres, zpres, SLAGCSH, GROWPORE, maxtries);
 
-      } /* end of xid */
-    } /* end of yid */
-  } /* end of zid */
+  /***
+   *    If no neighbor available, locate SLAGCSH
+   *    at random location in pore space
+   ***/
 
-  return (cntphase);
+  if (!fchr) {
+    if (Deferrand) {
+      deferrand(RANDSLAGCSH, POROSITY, 0);
+    } else {
+      randslagcsh();
+    }
+  }
 }
 
 /***
- *    passone
+ *    randslagcsh
  *
- *     First pass through microstructure during dissolution.
- *     Low and high indicate the phase ID range to check for
- *     surface sites.
+ *    Place one pixel of SLAGCSH at a random location in
+ *    porosity, the non-local fallback of extslagcsh
  *
- *     Arguments:    int low, high (phase id range to check)
- *                 int cycid
- *                 int cshexflag (0 or 1 only)
+ *     Arguments:    None
  *
- *     Returns:    nothing
+ *     Returns:    Nothing
  *
- *    Calls:        chckedge
- *    Called by:    dissolve
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extslagcsh, rundeferred
  ***/
-void passone(int low, int high, int cycid, int cshexflag) {
-  int i, xid, yid, zid, phid, edgef, phread, cshcyc;
-
-  /* Gypready used to determine if any soluble gypsum remains */
-
-  if ((low <= GYPSUM) && (GYPSUM <= high)) {
-    Gypready = 0;
-  }
-
-  /* Zero out count for the relevant phases */
-
-  for (i = low; i <= high; i++) {
-    Count[i] = 0;
-  }
-
-  /* Scan the entire 3-D microstructure */
+void randslagcsh(void) {
+  int check, xchr, ychr, zchr, fchr, numnear;
+  int maxxtries = 5000;
+  int tries;
 
-  for (xid = 0; xid < Xsyssize; xid++) {
-    for (yid = 0; yid < Ysyssize; yid++) {
-      for (zid = 0; zid < Zsyssize; zid++) {
+  fchr = 0;
+  tries = 0;
+  while (!fchr) {
 
-        phread = Mic[xid][yid][zid];
+    tries++;
 
-        /* Update heat data and water consumed for solid CSH */
+    /***
+     *    Generate a random location in the 3-D system
+     ***/
 
-        if ((cshexflag) && (phread == CSH)) {
-          cshcyc = Cshage[xid][yid][zid];
-          Heatsum += Heatf[CSH] / Molarvcsh[cshcyc];
-          Molesh2o += Watercsh[cshcyc] / Molarvcsh[cshcyc];
-        }
+    xchr = (int)((float)Xsyssize * ran1(Seed));
+    ychr = (int)((float)Ysyssize * ran1(Seed));
+    zchr = (int)((float)Zsyssize * ran1(Seed));
 
-        /* Identify phase and update count */
+    if (xchr >= Xsyssize)
+      xchr = 0;
+    if (ychr >= Ysyssize)
+      ychr = 0;
+    if (zchr >= Zsyssize)
+      zchr = 0;
+    check = Mic[xchr][ychr][zchr];
 
-        phid = NPHASES + 10; /* Clearly out of bounds */
+    /***
+     *    If location is porosity, locate the
+     *    extra SLAGCSH there
+     ***/
 
-        for (i = low; ((i <= high) && (phid == NPHASES + 10)); i++) {
+    if (check == POROSITY) {
+      numnear = edgecnt(xchr, ychr, zchr, SLAG, CSH, SLAGCSH);
 
-          if (Mic[xid][yid][zid] == i) {
+      /***
+       *    Be sure that one neighboring species is CSH or
+       *    SLAG material (anywhere within a 3x3x3 cube)
+       *    If more than maxxtries tries have already been made
+       *    then locate it at this pore pixel no matter what
+       ***/
 
-            phid = i;
+      if ((tries > maxxtries) || (numnear < NEIGHBORS)) {
+        MICSET(xchr, ychr, zchr, SLAGCSH);
+        Count[SLAGCSH]++;
+        Count[POROSITY]--;
+        fchr = 1;
+      }
+    }
+  }
+}
 
-            /* Update count for this phase */
+/***
+ *    dissolvesite
+ *
+ *     Give one pixel of the soluble surface index its chance
+ *     to dissolve, to convert from CSH to pozzolanic CSH or to
+ *     react as slag
+ *
+ *     Arguments:    int x,y, and z coordinates
+ *                 float extra diffusing CSH per C3S dissolved
+ *                 float extra diffusing CSH per C2S dissolved
+ *                 struct Disscount pointer to counts to add to
+ *
+ *     Returns:    nothing
+ *
+ *    Calls:        partlost, addant, loccsh, countbox, extslagcsh
+ *    Called by:    dissolve, dissolveslab
+ ***/
+void dissolvesite(int xl, int yl, int zl, float pc3scsh, float pc2scsh,
+                  struct Disscount *dc) {
+  int phid, plnew, xc, yc, zc, pixdeact, cread, sourcepore;
+  int phnew, placed, cycnew;
+  float plfh3, pconvert, calcx, calcy, calcz, p3init;
+  double pdis;
 
-            Count[i]++;
+  /***
+   *    Work only with pixels that are marked for
+   *     dissolution.  Convert them back to their
+   *     original ID before doing anything else
+   *
+   *     Note that K2SO4 and NA2SO4 are handled
+   *     differently below this loop (7 June 2004)
+   ***/
 
-            if ((i == GYPSUM) || (i == GYPSUMS)) {
-              Gypready++;
-            }
+  if (Mic[xl][yl][zl] > OFFSET &&
+      (Mic[xl][yl][zl] - (OFFSET)) != (K2SO4) &&
+      (Mic[xl][yl][zl] - (OFFSET)) != (NA2SO4)) {
 
-            /* If first cycle, then accumulate initial counts */
+    phid = (int)Mic[xl][yl][zl] - (OFFSET);
+    if (phid == GYPSUM)
+      dc->gct++;
 
-            if ((cycid == 1) || ((cycid == 0) && (Ncyc == 0))) {
+    /* Attempt a one-step random walk to dissolve */
 
-              /***
-               *    Ordered in terms of likely volume
-               *    fractions (largest to smallest) to
-               *    speed execution
-               ***/
+    plnew = (int)((float)NEIGHBORS * ran1(Seed));
+    if ((plnew < 0) || (plnew >= NEIGHBORS)) {
+      plnew = NEIGHBORS - 1;
+    }
 
-              if (i == POROSITY) {
-                Porinit++;
-              } else if (i == C3S) {
-                C3sinit++;
-              } else if (i == C2S) {
-                C2sinit++;
-              } else if (i == C3A) {
-                C3ainit++;
-              } else if (i == OC3A) {
-                Oc3ainit++;
-              } else if (i == C4AF) {
-                C4afinit++;
-              } else if (i == K2SO4) {
-                Ksulfinit++;
-              } else if (i == NA2SO4) {
-                Nasulfinit++;
-              } else if (i == GYPSUM) {
-                Ncsbar++;
-              } else if (i == GYPSUMS) {
-                Ncsbar++;
-              } else if (i == ANHYDRITE) {
-                Anhinit++;
-              } else if (i == HEMIHYD) {
-                Heminit++;
-              } else if (i == SFUME || i == AMSIL) {
-                Nsilica++;
-              } else if (i == SLAG) {
-                Slaginit++;
-              } else if (i == FREELIME) {
-                Freelimeinit++;
-              } else if (i == ETTR) {
-                Netbar++;
-              } else if (i == ETTRC4AF) {
-                Netbar++;
-              } else if (i == CRACKP) {
-                Crackpinit++;
-              }
-            }
-          }
-        }
+    xc = xl + Xoff[plnew];
+    yc = yl + Yoff[plnew];
+    zc = zl + Zoff[plnew];
 
-        /***
-         *    Currently do NOT identify
-         *    SURFACE pixels of K2SO4 and NA2SO4
-         ***/
+    xc += checkbc(xc, Xsyssize);
+    yc += checkbc(yc, Ysyssize);
+    zc += checkbc(zc, Zsyssize);
 
-        if (phid != NPHASES + 10 && Mic[xid][yid][zid] != K2SO4 &&
-            Mic[xid][yid][zid] != NA2SO4) {
+    pixdeact = 0;
+    if (Deactivated) {
+      if ((Xoff[plnew] == (-1)) &&
+          (Deactivated[xl][yl][zl] & DEACTBIT(1))) {
 
-          /***
-           *    If phase is soluble, see if it is
-           *    in contact with porosity
-           ***/
+        pixdeact = 1;
+      }
 
-          if ((cycid != 0) && (Soluble[phid] == 1)) {
-            edgef = chckedge(phid, xid, yid, zid);
-            if (edgef == 1) {
+      if ((!pixdeact) && (Xoff[plnew] == 1) &&
+          (Deactivated[xl][yl][zl] & DEACTBIT(0))) {
 
-              /***
-               *    Surface eligible species has an
-               *    ID that is OFFSET greater than its
-               *    original value.  Means that it is
-               *    ready for dissolution.
-               ***/
+        pixdeact = 1;
+      }
 
-              Mic[xid][yid][zid] += (int)(OFFSET);
-            }
-          }
-        }
+      if ((!pixdeact) && (Yoff[plnew] == (-1)) &&
+          (Deactivated[xl][yl][zl] & DEACTBIT(3))) {
 
-      } /* end of xid */
-    } /* end of yid */
-  } /* end of zid */
-}
+        pixdeact = 1;
+      }
 
-/***
- *    loccsh
- *
- *     Place a diffusing CSH species near dissolution source
- *     at (xcur,ycur,zcur)
- *
- *     Arguments:    int x,y, and z coordinates
- *                 int id of pore type used to create the diffusing species
- *                 (change added 24 May 2004)
- *
- *     Returns:    1 if species is placed, 0 otherwise
- *
- *    Calls:        no other routines
- *    Called by:    dissolve
- ***/
-int loccsh(int xcur, int ycur, int zcur, int sourcepore) {
-  int effort, tries, xmod, ymod, zmod;
-  int maxtries = 500;
-  int halfbox;
-  struct Ants *antnew;
+      if ((!pixdeact) && (Yoff[plnew] == 1) &&
+          (Deactivated[xl][yl][zl] & DEACTBIT(2))) {
 
-  /* effort indicates if appropriate location found */
-  effort = 0;
+        pixdeact = 1;
+      }
 
-  tries = 0;
+      if ((!pixdeact) && (Zoff[plnew] == (-1)) &&
+          (Deactivated[xl][yl][zl] & DEACTBIT(5))) {
 
-  /* Execute up to maxtries tries in immediate vicinity */
+        pixdeact = 1;
+      }
 
-  halfbox = Distloccsh / 2;
-  while ((!effort) && (tries < maxtries)) {
+      if ((!pixdeact) && (Zoff[plnew] == 1) &&
+          (Deactivated[xl][yl][zl] & DEACTBIT(4))) {
 
-    tries++;
-    xmod = (-halfbox) + (int)(Distloccsh * ran1(Seed));
-    ymod = (-halfbox) + (int)(Distloccsh * ran1(Seed));
-    zmod = (-halfbox) + (int)(Distloccsh * ran1(Seed));
-    if (xmod > halfbox)
-      xmod = halfbox;
-    if (ymod > halfbox)
-      ymod = halfbox;
-    if (zmod > halfbox)
-      zmod = halfbox;
+        pixdeact = 1;
+      }
+    }
 
-    xmod += xcur;
-    ymod += ycur;
-    zmod += zcur;
+    /* Generate probability for dissolution */
 
-    /* Periodic boundary conditions */
+    pdis = ran1(Seed);
 
-    xmod += checkbc(xmod, Xsyssize);
-    ymod += checkbc(ymod, Ysyssize);
-    zmod += checkbc(zmod, Zsyssize);
+    /***
+     *    Bias dissolution for one pixel particles as
+     *    indicated by a pixel value of zero in the
+     *    particle microstructure image
+     *
+     *    We do allow dissolution of unhydrated material
+     *    into water in saturated crack pores formed during
+     *    the hydration process (24 May 2004)
+     ***/
 
-    if (Mic[xmod][ymod][zmod] == sourcepore) {
-      effort = 1;
-      Mic[xmod][ymod][zmod] = DIFFCSH;
-      Nmade++;
-      Ngoing++;
+    if (((pdis <= (PHfactor[phid] * Disprob[phid])) ||
+         ((pdis <=
+           (Onepixelbias[phid] * PHfactor[phid] * Disprob[phid])) &&
+          (partmap_get(&Micpart, xl, yl, zl) == 0))) &&
+        (Mic[xc][yc][zc] == POROSITY || Mic[xc][yc][zc] == CRACKP) &&
+        (!pixdeact)) {
 
       /***
-       *    Add this diffusing CSH species
-       *    to the linked list.  May want to look at
-       *    allocating space for new ants in chunks of,
-       *    say, 50, rather than one at a time.
+       *    Special case of possible topochemical
+       *    transformation of C3S to CSH without
+       *    dissolution (NOT YET ENABLED, 24 April 2003)
        ***/
 
-      antnew = (struct Ants *)malloc(Antsize);
-      antnew->x = xmod;
-      antnew->y = ymod;
-      antnew->z = zmod;
-      antnew->id = DIFFCSH;
-      antnew->cycbirth = Cyccnt;
+      /*
+      if (Verbose_flag > 2) {
+          if (phid == C3S) {
+              fprintf(Logfile,"\nDissolving C3S: pdis = %f\tdisprob =
+      ",pdis); if (Micpart[xl][yl][zl] == 0) {
+                  fprintf(Logfile,"%f",Onepixelbias[phid] *
+      PHfactor[phid]
+      * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
+      Disprob[phid]);
+              }
+          } else if (phid == C2S) {
+              fprintf(Logfile,"\nDissolving C2S: pdis = %f\tdisprob =
+      ",pdis); if (Micpart[xl][yl][zl] == 0) {
+                  fprintf(Logfile,"%f",Onepixelbias[phid] *
+      PHfactor[phid]
+      * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
+      Disprob[phid]);
+              }
+          } else if (phid == C3A) {
+              fprintf(Logfile,"\nDissolving C3A: pdis = %f\tdisprob =
+      ",pdis); if (Micpart[xl][yl][zl] == 0) {
+                  fprintf(Logfile,"%f",Onepixelbias[phid] *
+      PHfactor[phid]
+      * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
+      Disprob[phid]);
+              }
+          } else if (phid == C4AF) {
+              fprintf(Logfile,"\nDissolving C4AF: pdis = %f\tdisprob =
+      ",pdis); if (Micpart[xl][yl][zl] == 0) {
+                  fprintf(Logfile,"%f",Onepixelbias[phid] *
+      PHfactor[phid]
+      * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
+      Disprob[phid]);
+              }
+          } else if (phid == GYPSUM) {
+              fprintf(Logfile,"\nDissolving GYPSUM: pdis = %f\tdisprob =
+      ",pdis); if (Micpart[xl][yl][zl] == 0) {
+                  fprintf(Logfile,"%f",Onepixelbias[phid] *
+      PHfactor[phid]
+      * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
+      Disprob[phid]);
+              }
+          }
+          log_flush(Logfile);
+      }
+      */
+
+      Discount[phid]++;
+      cread = Creates[phid];
+      Count[phid]--;
 
       /***
-       *    Now connect this ant structure to
-       *    end of linked list
+       *     The space formerly occupied by the unhydrated pixel now
+       *     becomes filled with whatever solvent was used to dissolve
+       *     it (POROSITY or CRACKP) (24 May 2004)
        ***/
 
-      antnew->prevant = Tailant;
-      Tailant->nextant = antnew;
-      antnew->nextant = NULL;
-      Tailant = antnew;
-    }
-  }
-
-  return (effort);
-}
+      sourcepore = Mic[xc][yc][zc];
+      partlost(xl, yl, zl);
+      MICSET(xl, yl, zl, sourcepore);
 
-/***
- *    countbox
- *
- *     Count the number of pore pixels within a cube of
- *     size boxsize, centered at (qx,qy,qz)
- *
- *     Arguments:    int boxsize
- *                 int x,y, and z coordinates of box center
- *
- *     Returns:    int number of pore pixels found within box
- *
- *    Calls:        no other routines
- *    Called by:    makeinert
- ***/
-int countbox(int boxsize, int qx, int qy, int qz) {
-  int nfound, ix, iy, iz, qxlo, qxhi, qylo, qyhi, qzlo, qzhi;
-  int hx, hy, hz, boxhalf;
+      if (phid == C3AH6)
+        dc->nhgd++;
 
-  boxhalf = boxsize / 2;
-  nfound = 0;
-  qxlo = qx - boxhalf;
-  qxhi = qx + boxhalf;
-  qylo = qy - boxhalf;
-  qyhi = qy + boxhalf;
-  qzlo = qz - boxhalf;
-  qzhi = qz + boxhalf;
+      /* Special dissolution for C4AF */
 
-  /***
-   *    Count the number of requisite pixels in the
-   *    3-D cube box using periodic boundaries
-   ***/
+      if (phid == C4AF) {
+        plfh3 = ran1(Seed);
+        if ((plfh3 < 0.0) || (plfh3 > 1.0))
+          plfh3 = 1.0;
 
-  for (ix = qxlo; ix <= qxhi; ix++) {
-    hx = ix;
-    hx += checkbc(hx, Xsyssize);
+        /***
+         *    For every C4AF that dissolves, 0.5453
+         *    diffusing FH3 species should be created
+         ***/
 
-    for (iy = qylo; iy <= qyhi; iy++) {
-      hy = iy;
-      hy += checkbc(hy, Ysyssize);
+        if (plfh3 <= 0.5453) {
+          cread = DIFFFH3;
+        }
+      }
 
-      for (iz = qzlo; iz <= qzhi; iz++) {
-        hz = iz;
-        hz += checkbc(hz, Zsyssize);
+      if (cread == POROSITY) {
 
         /***
-         *    Count if porosity, diffusing species,
-         *    or empty porosity
+         *    Increment count of POROSITY or CRACKP, depending
+         *    on which was used in the dissolution of the solid
+         *    (24 May 2004)
          ***/
 
-        if ((Mic[hx][hy][hz] == POROSITY) || (Mic[hx][hy][hz] > NSPHASES)) {
+        Count[sourcepore]++;
 
-          nfound++;
+      } else {
+        Nmade++;
+        Ngoing++;
+        phnew = cread;
+        Count[phnew]++;
+        MICSET(xc, yc, zc, phnew);
+
+        /* Add an ant for this diffusing pixel */
+
+        if (addant(xc, yc, zc, phnew, Cyccnt)) {
+          freeallmem();
+          bailout("dissolve", "Could not add ant to ant pool");
+          exit(1);
         }
+      }
 
-      } /* End of loop over z */
-    } /* End of loop over y */
-  } /* End of loop over x */
+      /***
+       *    Extra CSH diffusing species based
+       *    on current temperature
+       ***/
 
-  return (nfound);
-}
+      if ((phid == C3S) || (phid == C2S)) {
 
-/***
- *    makeinert
- *
- *    Create ndesire pixels of empty pore space to simulate
- *    self-desiccation
- *
- *     Arguments:    int ndesire (number to create)
- *
- *     Returns:    nothing
- *
- *    Calls:        countbox
- *    Called by:    dissolve
- ***/
-void makeinert(int ndesire) {
-  int idesire;
-  int px, py, pz, placed, cntpore, cntmax;
-  struct Togo *headtogo, *tailtogo, *newtogo, *lasttogo, *onetogo;
+        plfh3 = ran1(Seed);
+        if (((phid == C2S) && (plfh3 <= pc2scsh)) || (plfh3 <= pc3scsh)) {
 
-  /***
-   *    First allocate and initialize the first member
-   *    of the linked list
-   ***/
+          placed = loccsh(xc, yc, zc, sourcepore);
+          if (placed) {
+            Count[DIFFCSH]++;
+            Count[sourcepore]--;
+          } else {
+            dc->cshrand++;
+          }
+        }
+      }
 
-  headtogo = (struct Togo *)malloc(Togosize);
-  headtogo->x = headtogo->y = headtogo->z = (-1);
-  headtogo->npore = 0;
-  headtogo->nexttogo = NULL;
-  headtogo->prevtogo = NULL;
-  tailtogo = headtogo;
-  cntmax = 0;
+      if ((phid == C2S) && (pc2scsh > 1.0)) {
+        plfh3 = ran1(Seed);
+        if (plfh3 <= (pc2scsh - 1.0)) {
+          placed = loccsh(xc, yc, zc, sourcepore);
+          if (placed) {
+            Count[DIFFCSH]++;
+            Count[sourcepore]--;
+          } else {
+            dc->cshrand++;
+          }
+        }
+      }
+
+    } else {
+
+      /***
+       *    Pixel does NOT dissolve, just reset its phase
+       *    ID back to its original value
+       ***/
+
+      Mic[xl][yl][zl] -= OFFSET;
+    }
+
+  } /* end of if edge block */
 
   /***
-   *    Add needed number of elements to the end of the list
-   *    Consider allocating the space in chunks of, say, 50,
-   *    instead of one at a time to speed up execution
+   *    Now check if CSH to pozzolanic CSH conversion is
+   *    possible:
+   *
+   *        (1) Only if CH is less than 30% in volume,
+   *        (2) Only if CSH is in contact with at
+   *            least one porosity, AND
+   *        (3) User wishes to implement this option
    ***/
 
-  for (idesire = 2; idesire <= ndesire; idesire++) {
-    newtogo = (struct Togo *)malloc(Togosize);
-    newtogo->npore = 0;
-    newtogo->x = newtogo->y = newtogo->z = (-1);
-    tailtogo->nexttogo = newtogo;
-    newtogo->prevtogo = tailtogo;
-    tailtogo = newtogo;
-  }
+  if (((Count[SFUME] + Count[AMSIL]) >= (0.013 * (double)(Syspix))) &&
+      (Chnew < (0.30 * (double)(Syspix))) && (Csh2flag == 1)) {
 
-  /* Now scan the microstructure and RANK the sites */
+    if (Mic[xl][yl][zl] == CSH) {
+      if ((countbox(3, xl, yl, zl)) >= 1) {
+        pconvert = ran1(Seed);
+        if (pconvert < PCSH2CSH) {
+          Count[CSH]--;
+          plfh3 = ran1(Seed);
 
-  for (pz = 0; pz < Zsyssize; pz++) {
-    for (py = 0; py < Ysyssize; py++) {
-      for (px = 0; px < Xsyssize; px++) {
+          /***
+           *    Molarvcsh units of C1.7SHx goes to
+           *    101.81 units of C1.1SH3.9 with 19.86
+           *    units of CH so p=calcy
+           ***/
 
-        if (Mic[px][py][pz] == POROSITY) {
-          cntpore = countbox(Cubesize, px, py, pz);
+          calcz = 0.0;
+          cycnew = Cshage ? cshagecycle(Cshage[xl][yl][zl]) : 0;
+          calcy = Molarv[POZZCSH] / Molarvcsh[cycnew];
+          if (calcy > 1.0) {
+            calcz = calcy - 1.0;
+            calcy = 1.0;
+            if (Verbose_flag > 0) {
+              fprintf(Logfile, "\nWARNING:  Problem of not ");
+              fprintf(Logfile, "creating enough pozzolanic ");
+              fprintf(Logfile, "CSH during CSH conversion");
+              fprintf(Logfile, "\nCurrent binder temperature");
+              fprintf(Logfile, "is %f C", Temp_cur_b);
+            }
+          }
 
-          if (cntpore > cntmax)
-            cntmax = cntpore;
+          if (plfh3 <= calcy) {
+            MICSET(xl, yl, zl, POZZCSH);
+            Count[POZZCSH]++;
+          } else {
+            MICSET(xl, yl, zl, DIFFCH);
+            Nmade++;
+            dc->ncshgo++;
+            Ngoing++;
+            Count[DIFFCH]++;
+
+            /* Add the new diffusing species to the ant pool */
+
+            if (addant(xl, yl, zl, DIFFCH, Cyccnt)) {
+              freeallmem();
+              bailout("dissolve", "Could not add ant to ant pool");
+              exit(1);
+            }
+          }
 
           /***
-           *    Store this site value at appropriate place in
-           *    sorted linked list
+           *    Possibly need even more pozzolanic CSH
+           *
+           *    Would need a diffusing pozzolanic
+           *    CSH species???
            ***/
 
-          if (cntpore > (tailtogo->npore)) {
-            placed = 0;
-            lasttogo = tailtogo;
-            while (!placed) {
-              newtogo = lasttogo->prevtogo;
-              if (!newtogo) {
-                placed = 2;
-              } else if (cntpore <= (newtogo->npore)) {
-                placed = 1;
+          /*
+          if (calcz > 0.0) {
+              plfh3 = ran1(Seed);
+              if (plfh3 <= calcz) {
+                  dc->cshrand++;
               }
+          }
+          */
 
-              if (!placed)
-                lasttogo = newtogo;
-            }
+          plfh3 = ran1(Seed);
+          calcx = (19.86 / Molarvcsh[cycnew]) - (1.0 - calcy);
 
-            onetogo = (struct Togo *)malloc(Togosize);
-            onetogo->x = px;
-            onetogo->y = py;
-            onetogo->z = pz;
-            onetogo->npore = cntpore;
+          /* Ex. 0.12658=(19.86/108.)-(1.-0.94269) */
 
-            /* Insertion at the head of the list */
+          if (plfh3 < calcx)
+            dc->npchext++;
+        }
+      }
+    }
+  }
 
-            if (placed == 2) {
-              onetogo->prevtogo = NULL;
-              onetogo->nexttogo = headtogo;
-              headtogo->prevtogo = onetogo;
-              headtogo = onetogo;
-            }
+  /***
+   *    See if slag can react --- must be
+   *    in contact with at least one porosity pixel
+   ***/
 
-            if (placed == 1) {
-              onetogo->nexttogo = lasttogo;
-              onetogo->prevtogo = newtogo;
-              lasttogo->prevtogo = onetogo;
-              newtogo->nexttogo = onetogo;
-            }
+  if (Mic[xl][yl][zl] == SLAG) {
 
-            /* Eliminate the last element */
+    if ((countbox(3, xl, yl, zl)) >= 1) {
+      pconvert = ran1(Seed);
+      if (pconvert < (PHfactor[SLAG] * Disprob[SLAG])) {
 
-            lasttogo = tailtogo;
-            tailtogo = tailtogo->prevtogo;
-            tailtogo->nexttogo = NULL;
-            free(lasttogo);
-          }
-        }
+        Nslagr++;
+        Count[SLAG]--;
+        Discount[SLAG]++;
 
-      } /* End of loop in z */
-    } /* End of loop in y */
-  } /* End of loop in x */
+        /* Check on extra C3A generation */
 
-  /***
-   *    Now remove the sites starting at the
-   *    head of the list and free all of the
-   *    used memory
-   ***/
+        plfh3 = ran1(Seed);
+        if (plfh3 < P5slag)
+          dc->nslagc3a++;
 
-  for (idesire = 1; idesire <= ndesire; idesire++) {
-    px = headtogo->x;
-    py = headtogo->y;
-    pz = headtogo->z;
+        /* Convert slag to reaction products */
 
-    if (px != (-1)) {
-      Mic[px][py][pz] = EMPTYP;
-      Count[POROSITY]--;
-      Count[EMPTYP]++;
-    }
+        plfh3 = ran1(Seed);
+        if (plfh3 < P1slag) {
+          MICSET(xl, yl, zl, SLAGCSH);
+          Count[SLAGCSH]++;
+        } else {
+          if (Sealed == 1) {
+
+            /* Create empty porosity at slag site */
+            Slagemptyp++;
+            MICSET(xl, yl, zl, EMPTYP);
+            Count[EMPTYP]++;
+          } else {
+
+            /***
+             *    We do not distinguish between saturated
+             *    porosity and saturated crack porosity
+             *    here (24 May 2004)
+             ***/
+
+            MICSET(xl, yl, zl, POROSITY);
+            Count[POROSITY]++;
+          }
+        }
 
-    lasttogo = headtogo;
-    headtogo = headtogo->nexttogo;
-    free(lasttogo);
-  }
+        /* Add in extra SLAGCSH as needed */
 
-  /***
-   *    If only small cubes of porosity were found,
-   *    then adjust Cubesize to have a more efficient
-   *    search in the future
-   ***/
+        p3init = P3slag;
+        while (p3init > 1.0) {
+          extslagcsh(xl, yl, zl);
+          p3init -= 1.0;
+        }
 
-  if (Cubesize > CUBEMIN) {
-    if ((2 * cntmax) < (Cubesize * Cubesize * Cubesize)) {
-      Cubesize -= 2;
+        plfh3 = ran1(Seed);
+        if (plfh3 < p3init)
+          extslagcsh(xl, yl, zl);
+      }
     }
   }
 }
 
 /***
- *    extslagcsh
+ *    dissolveslab
  *
- *     Add extra SLAGCSH when SLAG reacts at position
- *     (xpres,ypres,zpres)
+ *     Go over the pixels of the soluble surface index in one
+ *     slab, in z, y, x order, with the random stream of the
+ *     slab and with the counters set to their values at the
+ *     start of the sweep.  The final counter values are left
+ *     in the tally of the slab and dissolve's own counts in
+ *     its diss.
  *
- *     Arguments:    int x,y, and z coordinates
+ *     Arguments:    int slab index
+ *                 float extra diffusing CSH per C3S dissolved
+ *                 float extra diffusing CSH per C2S dissolved
+ *                 struct Slabtally pointer to counters at sweep start
  *
  *     Returns:    nothing
  *
- *    Calls:        moveone, edgecnt
- *    Called by:    dissolve
+ *    Calls:        ran1load, ran1save, settally, gettally, nextsurfto,
+ *                dissolvesite
+ *    Called by:    dissolvesweep
  ***/
-void extslagcsh(int xpres, int ypres, int zpres) {
-  int check, sump, xchr, ychr, zchr, fchr, i1, action, numnear;
-  int maxtries = 100;
-  int maxxtries = 5000;
-  int tries;
-
-  /***
-   *    First try 6 neighboring locations until
-   *        a) successful,
-   *        b) all 6 sites are tried, or
-   *        c) 100 tries are made
-   ***/
-
-  fchr = 0;
-  sump = 1;
-
-  for (i1 = 1; ((i1 <= maxtries) && (!fchr) && (sump != 30030)); i1++) {
-
-    /***
-     *    Determine location of neighbor
-     *    (using periodic boundaries)
-     ***/
+void dissolveslab(int is, float pc3scsh, float pc2scsh,
+                  struct Slabtally *start) {
+  int x0, x1, xl, yl, zl, y, z;
+  long row, pos;
+  struct Disscount *dc;
 
-    xchr = xpres;
-    ychr = ypres;
-    zchr = zpres;
-    action = 0;
+  Curslab = is;
+  Seed = &(Antslab[is].rng.idum);
+  Curmoves = &(Antslab[is].moves);
+  ran1load(&(Antslab[is].rng));
+  settally(start);
 
-    sump *= moveone(&xchr, &ychr, &zchr, &action, sump);
-    if (!action && (Verbose_flag > 1))
-      fprintf(Logfile, "\nError in value of action in extpozz");
+  dc = &(Antslab[is].diss);
+  dc->gct = dc->nhgd = dc->cshrand = dc->ncshgo = 0;
+  dc->npchext = dc->nslagc3a = 0;
 
-    check = Mic[xchr][ychr][zchr];
+  /* The x of slab is are those with Slabofx[x] == is */
 
-    /* If neighbor is porosity, locate the SLAG CSH there */
+  x0 = (is * Xsyssize + Nantslab - 1) / Nantslab;
+  x1 = ((is + 1) * Xsyssize + Nantslab - 1) / Nantslab;
 
-    if (check == POROSITY || check == CRACKP) {
-      Mic[xchr][ychr][zchr] = SLAGCSH;
-      Count[SLAGCSH]++;
-      if (check == POROSITY)
-        Count[POROSITY]--;
-      if (check == CRACKP)
-        Count[CRACKP]--;
-      fchr = 1;
+  for (z = 0; z < Zsyssize; z++) {
+    for (y = 0; y < Ysyssize; y++) {
+      row = ((long)z * Ysyssize + y) * Xsyssize;
+      pos = row + x0 - 1;
+      while (nextsurfto(&pos, row + x1, &xl, &yl, &zl))
+        dissolvesite(xl, yl, zl, pc3scsh, pc2scsh, dc);
     }
   }
 
-  /***
-   *    If no neighbor available, locate SLAGCSH
-   *    at random location in pore space
-   ***/
+  ran1save(&(Antslab[is].rng));
+  gettally(&(Antslab[is].tally));
 
-  tries = 0;
-  while (!fchr) {
+  return;
+}
 
-    tries++;
+/***
+ *    dissolvesweep
+ *
+ *     Go over the soluble surface index in every ncol-th slab,
+ *     starting with slab color, processing the slabs on as
+ *     many threads as were requested.  Afterwards add up the
+ *     counter changes of all the slabs, and then, slab by slab,
+ *     put the diffusing species they made in the ant pool and
+ *     do the random-location growth they queued, from the main
+ *     random stream.
+ *
+ *     Arguments:    int first slab of the sweep
+ *                 int number of sweeps (a divisor of Nantslab)
+ *                 float extra diffusing CSH per C3S dissolved
+ *                 float extra diffusing CSH per C2S dissolved
+ *                 struct Disscount pointer to counts to add to
+ *
+ *     Returns:    nothing
+ *
+ *    Calls:        dissolveslab, addtally, addslabants, rundeferred,
+ *                  slabtid
+ *    Called by:    dissolve
+ ***/
+void dissolvesweep(int color, int ncol, float pc3scsh, float pc2scsh,
+                   struct Disscount *dc) {
+  int is;
+  int *mainseed;
+  Ran1state mainrng;
+  struct Slabtally start, sum;
 
-    /***
-     *    Generate a random location in the 3-D system
-     ***/
+  gettally(&start);
+  mainseed = Seed;
+  ran1save(&mainrng);
 
-    xchr = (int)((float)Xsyssize * ran1(Seed));
-    ychr = (int)((float)Ysyssize * ran1(Seed));
-    zchr = (int)((float)Zsyssize * ran1(Seed));
+  Deferrand = 1;
 
-    if (xchr >= Xsyssize)
-      xchr = 0;
-    if (ychr >= Ysyssize)
-      ychr = 0;
-    if (zchr >= Zsyssize)
-      zchr = 0;
-    check = Mic[xchr][ychr][zchr];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Antthreads) schedule(dynamic, 1)
+#endif
+  for (is = color; is < Nantslab; is += ncol) {
+    Tracemark mark;
 
-    /***
-     *    If location is porosity, locate the
-     *    extra SLAGCSH there
-     ***/
+    trace_begin(&mark, slabtid());
+    dissolveslab(is, pc3scsh, pc2scsh, &start);
+    trace_end(&mark, "Dissolve slab", slabtid());
+  }
 
-    if (check == POROSITY) {
-      numnear = edgecnt(xchr, ychr, zchr, SLAG, CSH, SLAGCSH);
+  Deferrand = 0;
+  Curslab = 0;
+  Seed = mainseed;
+  Curmoves = &Mainmoves;
+  ran1load(&mainrng);
 
-      /***
-       *    Be sure that one neighboring species is CSH or
-       *    SLAG material (anywhere within a 3x3x3 cube)
-       *    If more than maxxtries tries have already been made
-       *    then locate it at this pore pixel no matter what
-       ***/
+  sum = start;
+  for (is = color; is < Nantslab; is += ncol) {
+    addtally(&sum, &(Antslab[is].tally), &start);
+  }
+  settally(&sum);
 
-      if ((tries > maxxtries) || (numnear < NEIGHBORS)) {
-        Mic[xchr][ychr][zchr] = SLAGCSH;
-        Count[SLAGCSH]++;
-        Count[POROSITY]--;
-        fchr = 1;
-      }
+  for (is = color; is < Nantslab; is += ncol) {
+    if (Antslab[is].joberr || Antslab[is].anterr) {
+      freeallmem();
+      bailout("dissolve", "Could not queue random growth or new ants");
+      exit(1);
+    }
+    dc->gct += Antslab[is].diss.gct;
+    dc->nhgd += Antslab[is].diss.nhgd;
+    dc->cshrand += Antslab[is].diss.cshrand;
+    dc->ncshgo += Antslab[is].diss.ncshgo;
+    dc->npchext += Antslab[is].diss.npchext;
+    dc->nslagc3a += Antslab[is].diss.nslagc3a;
+    if (addslabants(is)) {
+      freeallmem();
+      bailout("dissolve", "Could not add ant to ant pool");
+      exit(1);
     }
+    rundeferred(is);
   }
+
+  return;
 }
 
 /***
@@ -6133,28 +8122,29 @@ void extslagcsh(int xpres, int ypres, int zpres) {
  *
  *     Returns:    nothing
  *
- *    Calls:        passone, loccsch, makeinert
+ *    Calls:        passone, dissolvesite, setantslabs, dissolvesweep,
+ *                makeinert
  *    Called by:    main program
  ***/
 void dissolve(int cycle) {
-  int gct = 0;
   int nc3aext, ncshext, nchext, ngypext, nanhext;
   int nsum5, nsum4, nsum3, nsum2, nhemext, nsum6, nsum7, nsum8, nc4aext,
       nso4ext, vcement;
   int nkspix, nnaspix, totks, totnas, skipnodes;
-  int pixdeact, phid, phnew, plnew, cread;
+  int phid;
   int i, k, x, y, xl, yl, zl, curx, cury, curz, xc, yc, plok;
-  int zc, cycnew, sollime, sourcepore;
-  int placed, cshrand, maxsulfate, maxallowed;
-  int ctest, ncshgo, nsurf, suminit;
-  int xext, nhgd, npchext, nslagc3a = 0;
+  int zc, sollime;
+  int maxsulfate, maxallowed;
+  int ctest, nsurf, suminit;
+  int xext, reach, thick, ncol, color;
+  long spos;
   float na2omintotmass, k2omintotmass, mwna2so4, mwna2o, mwk2so4, mwk2o;
-  float plfh3, savechgone, sulfavemolarv, mk2so4, mna2so4;
+  float savechgone, sulfavemolarv, mk2so4, mna2so4;
   float dfact, dfact1, molesdh2o, h2oinit, heat4, fhemext, fc4aext;
   double factCSH, factPOZZCSH, factTfract;
   double Pozzcshscale = 20000.0;
-  float pconvert, pc3scsh, pc2scsh, calcx, calcy, calcz, tdisfact;
-  float frafm, frettr, frhyg, frtot, mc3ar, mc4ar, p3init, fact, satsquared;
+  float pc3scsh, pc2scsh, tdisfact;
+  float frafm, frettr, frhyg, frtot, mc3ar, mc4ar, fact, satsquared;
   float resfact, molwh2o, volpix, ohadj;
   double massdiff, mass105, mass1000, fchext, fc3aext, fanhext;
   double mass_now, tot_mass, mass_fa_now, vol_fa_now, pdis, psfact;
@@ -6163,8 +8153,8 @@ void dissolve(int cycle) {
   double water_volume_per_gcem;
   double cement_volume_per_gcem;
   float refporefrac, xv1, yv1, yv3;
-  struct Ants *antadd;
   struct Alksulf *curas;
+  struct Disscount dc;
   FILE *fpout01;
 
   resfact = pow((1.0 / Res), 1.25);
@@ -6182,13 +8172,6 @@ void dissolve(int cycle) {
 
   Nmade = 0;
 
-  /***
-   *    Counter for number of CSH diffusing species to
-   *    be located at random locations in microstructure
-   ***/
-
-  npchext = ncshgo = cshrand = 0;
-
   /*    New and old values for heat released */
 
   Heat_old = Heat_new;
@@ -6226,19 +8209,17 @@ void dissolve(int cycle) {
    *    if cycle = 1, otherwise just determines if a pixel is
    *    eligible for dissolution.  Every eligible pixel will
    *    have its phaseid value increased by OFFSET after passone
-   *    has finished
+   *    has finished, and is listed in the soluble surface index
    ***/
 
+  clearsurf();
   passone(POROSITY, NPHASES - 1, cycle, 1);
   sollime = 0;
 
-  for (zl = 0; zl < Zsyssize; zl++) {
-    for (yl = 0; yl < Ysyssize; yl++) {
-      for (xl = 0; xl < Xsyssize; xl++) {
-        if (Mic[xl][yl][zl] == (FREELIME + OFFSET)) {
-          sollime++;
-        }
-      }
+  spos = -1;
+  while (nextsurf(&spos, &xl, &yl, &zl)) {
+    if (Mic[xl][yl][zl] == (FREELIME + OFFSET)) {
+      sollime++;
     }
   }
 
@@ -6587,7 +8568,7 @@ void dissolve(int cycle) {
    ***/
 
   ctest = Count[DIFFGYP];
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if ((float)ctest > (2.5 * (double)(Count[DIFFC3A] + Count[DIFFC4A]))) {
     ctest = 2.5 * (double)(Count[DIFFC3A] + Count[DIFFC4A]);
@@ -7111,7 +9092,7 @@ void dissolve(int cycle) {
   if (((Water_left + Water_off) < 0) && (Sealed == 1)) {
     if (Verbose_flag > 1)
       fprintf(Logfile, "\nAll water consumed at cycle %d", Cyccnt);
-    fflush(Logfile);
+    log_flush(Logfile);
     freeallmem();
     bailout("dissolve", "Normal exit");
     exit(1);
@@ -7526,7 +9507,7 @@ void dissolve(int cycle) {
     fprintf(Logfile, "\n        A0_CHSOL = %f", A0_CHSOL);
     fprintf(Logfile, " A1_CHSOL = %f", A1_CHSOL);
     fprintf(Logfile, " Temp_cur_b = %f\n", Temp_cur_b);
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   Disprob[C3S] = (resfact * DISMIN) + (dfact * Disbase[C3S]);
@@ -7540,7 +9521,7 @@ void dissolve(int cycle) {
     Disprob[C2S] = (1.0 * Disbase[C2S]);
   }
 
-  if ((fpout01 = fopen("SfumeEffect.csv", "a")) == NULL) {
+  if ((fpout01 = outopen(OUTSFUME, "SfumeEffect.csv")) == NULL) {
     if (Verbose_flag > 0) {
       fprintf(Logfile, "\nWARNING:  Could not open");
       fprintf(Logfile, " SfumeEffect.csv for writing");
@@ -7549,7 +9530,7 @@ void dissolve(int cycle) {
     fprintf(fpout01, "\n%f,%f,%f,%f,%f,%f,%f", (double)Count[CSH],
             (double)(Count[CSH] + Count[POZZCSH]), Cs_acc, Psfume, dfact,
             Cshscale, Disprob[C3S]);
-    fclose(fpout01);
+    outflush(0);
   }
 
   /***
@@ -7951,477 +9932,83 @@ void dissolve(int cycle) {
       }
     }
 
-    /* 2/02:  PHfactor = 0.30*(((14.1-PH_cur)/0.3)-1.0); */
-    /* 3/02:  PHfactor = 0.60*(((14.1-PH_cur)/0.5)-1.0); */
-
-    /***
-     *    Molar volume of CSH depends on pH according to
-     *    observations compiled in Jawed and Skalny,
-     *    Cem. Concr. Res., Vol. 8 pp. 37-52 (1978).
-     ***/
-
-    Molarvcsh[Icyc] +=
-        Molarvcshcoeff_pH * (PHfactor[C3S] + (PHsulfcoeff[C3S] * Concsulfate));
-    Watercsh[Icyc] +=
-        Watercshcoeff_pH * (PHfactor[C3S] + (PHsulfcoeff[C3S] * Concsulfate));
-  }
-
-  nhgd = 0;
-
-  /* Update molar volume ratios for CSH formation */
-
-  pc3scsh = (Molarvcsh[Cyccnt] / Molarv[C3S]) - 1.0;
-  pc2scsh = (Molarvcsh[Cyccnt] / Molarv[C2S]) - 1.0;
-
-  /* Once again, scan all pixels in microstructure */
-
-  Slagemptyp = 0;
-
-  /*
-  Count[DIFFSO4] = Count[NA2SO4] = 0;
-  for (k = 0; k < Zsyssize; k++) {
-      for (j = 0; j < Ysyssize; j++) {
-          for (iii = 0; i < Xsyssize; i++) {
-              if (Mic[i][j][k] == (DIFFSO4)) Count[DIFFSO4]++;
-              if (Mic[i][j][k] == (NA2SO4)) Count[NA2SO4]++;
-          }
-      }
-  }
-
-  if (Verbose_flag > 1) fprintf(Logfile,"\nEntering Main dissolve loop,
-  Count[DIFFSO4] = %d, Count[NA2SO4] = %d
-  ...\n",Count[DIFFSO4],Count[NA2SO4]); fflush(Logfile);
-  */
-
-  for (zl = 0; zl < Zsyssize; zl++) {
-    for (yl = 0; yl < Ysyssize; yl++) {
-      for (xl = 0; xl < Xsyssize; xl++) {
-
-        /***
-         *    Work only with pixels that are marked for
-         *     dissolution.  Convert them back to their
-         *     original ID before doing anything else
-         *
-         *     Note that K2SO4 and NA2SO4 are handled
-         *     differently below this loop (7 June 2004)
-         ***/
-
-        if (Mic[xl][yl][zl] > OFFSET &&
-            (Mic[xl][yl][zl] - (OFFSET)) != (K2SO4) &&
-            (Mic[xl][yl][zl] - (OFFSET)) != (NA2SO4)) {
-
-          phid = (int)Mic[xl][yl][zl] - (OFFSET);
-          if (phid == GYPSUM)
-            gct++;
-
-          /* Attempt a one-step random walk to dissolve */
-
-          plnew = (int)((float)NEIGHBORS * ran1(Seed));
-          if ((plnew < 0) || (plnew >= NEIGHBORS)) {
-            plnew = NEIGHBORS - 1;
-          }
-
-          xc = xl + Xoff[plnew];
-          yc = yl + Yoff[plnew];
-          zc = zl + Zoff[plnew];
-
-          xc += checkbc(xc, Xsyssize);
-          yc += checkbc(yc, Ysyssize);
-          zc += checkbc(zc, Zsyssize);
-
-          pixdeact = 0;
-          if ((Xoff[plnew] == (-1)) &&
-              (Deactivated[xl][yl][zl] % Primevalues[1] == 0)) {
-
-            pixdeact = 1;
-          }
-
-          if ((!pixdeact) && (Xoff[plnew] == 1) &&
-              (Deactivated[xl][yl][zl] % Primevalues[0] == 0)) {
-
-            pixdeact = 1;
-          }
-
-          if ((!pixdeact) && (Yoff[plnew] == (-1)) &&
-              (Deactivated[xl][yl][zl] % Primevalues[3] == 0)) {
-
-            pixdeact = 1;
-          }
-
-          if ((!pixdeact) && (Yoff[plnew] == 1) &&
-              (Deactivated[xl][yl][zl] % Primevalues[2] == 0)) {
-
-            pixdeact = 1;
-          }
-
-          if ((!pixdeact) && (Zoff[plnew] == (-1)) &&
-              (Deactivated[xl][yl][zl] % Primevalues[5] == 0)) {
-
-            pixdeact = 1;
-          }
-
-          if ((!pixdeact) && (Zoff[plnew] == 1) &&
-              (Deactivated[xl][yl][zl] % Primevalues[4] == 0)) {
-
-            pixdeact = 1;
-          }
-
-          /* Generate probability for dissolution */
-
-          pdis = ran1(Seed);
-
-          /***
-           *    Bias dissolution for one pixel particles as
-           *    indicated by a pixel value of zero in the
-           *    particle microstructure image
-           *
-           *    We do allow dissolution of unhydrated material
-           *    into water in saturated crack pores formed during
-           *    the hydration process (24 May 2004)
-           ***/
-
-          if (((pdis <= (PHfactor[phid] * Disprob[phid])) ||
-               ((pdis <=
-                 (Onepixelbias[phid] * PHfactor[phid] * Disprob[phid])) &&
-                (Micpart[xl][yl][zl] == 0))) &&
-              (Mic[xc][yc][zc] == POROSITY || Mic[xc][yc][zc] == CRACKP) &&
-              (!pixdeact)) {
-
-            /***
-             *    Special case of possible topochemical
-             *    transformation of C3S to CSH without
-             *    dissolution (NOT YET ENABLED, 24 April 2003)
-             ***/
-
-            /*
-            if (Verbose_flag > 2) {
-                if (phid == C3S) {
-                    fprintf(Logfile,"\nDissolving C3S: pdis = %f\tdisprob =
-            ",pdis); if (Micpart[xl][yl][zl] == 0) {
-                        fprintf(Logfile,"%f",Onepixelbias[phid] *
-            PHfactor[phid]
-            * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
-            Disprob[phid]);
-                    }
-                } else if (phid == C2S) {
-                    fprintf(Logfile,"\nDissolving C2S: pdis = %f\tdisprob =
-            ",pdis); if (Micpart[xl][yl][zl] == 0) {
-                        fprintf(Logfile,"%f",Onepixelbias[phid] *
-            PHfactor[phid]
-            * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
-            Disprob[phid]);
-                    }
-                } else if (phid == C3A) {
-                    fprintf(Logfile,"\nDissolving C3A: pdis = %f\tdisprob =
-            ",pdis); if (Micpart[xl][yl][zl] == 0) {
-                        fprintf(Logfile,"%f",Onepixelbias[phid] *
-            PHfactor[phid]
-            * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
-            Disprob[phid]);
-                    }
-                } else if (phid == C4AF) {
-                    fprintf(Logfile,"\nDissolving C4AF: pdis = %f\tdisprob =
-            ",pdis); if (Micpart[xl][yl][zl] == 0) {
-                        fprintf(Logfile,"%f",Onepixelbias[phid] *
-            PHfactor[phid]
-            * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
-            Disprob[phid]);
-                    }
-                } else if (phid == GYPSUM) {
-                    fprintf(Logfile,"\nDissolving GYPSUM: pdis = %f\tdisprob =
-            ",pdis); if (Micpart[xl][yl][zl] == 0) {
-                        fprintf(Logfile,"%f",Onepixelbias[phid] *
-            PHfactor[phid]
-            * Disprob[phid]); } else { fprintf(Logfile,"%f",PHfactor[phid] *
-            Disprob[phid]);
-                    }
-                }
-                fflush(Logfile);
-            }
-            */
-
-            Discount[phid]++;
-            cread = Creates[phid];
-            Count[phid]--;
-
-            /***
-             *     The space formerly occupied by the unhydrated pixel now
-             *     becomes filled with whatever solvent was used to dissolve
-             *     it (POROSITY or CRACKP) (24 May 2004)
-             ***/
-
-            sourcepore = Mic[xc][yc][zc];
-            Mic[xl][yl][zl] = sourcepore;
-
-            if (phid == C3AH6)
-              nhgd++;
-
-            /* Special dissolution for C4AF */
-
-            if (phid == C4AF) {
-              plfh3 = ran1(Seed);
-              if ((plfh3 < 0.0) || (plfh3 > 1.0))
-                plfh3 = 1.0;
-
-              /***
-               *    For every C4AF that dissolves, 0.5453
-               *    diffusing FH3 species should be created
-               ***/
-
-              if (plfh3 <= 0.5453) {
-                cread = DIFFFH3;
-              }
-            }
-
-            if (cread == POROSITY) {
-
-              /***
-               *    Increment count of POROSITY or CRACKP, depending
-               *    on which was used in the dissolution of the solid
-               *    (24 May 2004)
-               ***/
-
-              Count[sourcepore]++;
-
-            } else {
-              Nmade++;
-              Ngoing++;
-              phnew = cread;
-              Count[phnew]++;
-              Mic[xc][yc][zc] = phnew;
-
-              /* Add an ant for this diffusing pixel */
-
-              antadd = (struct Ants *)malloc(Antsize);
-              antadd->x = xc;
-              antadd->y = yc;
-              antadd->z = zc;
-              antadd->id = phnew;
-              antadd->cycbirth = Cyccnt;
-
-              /***
-               *    Connect this ant structure to end
-               *    of linked list
-               ***/
-
-              antadd->prevant = Tailant;
-              Tailant->nextant = antadd;
-              antadd->nextant = NULL;
-              Tailant = antadd;
-            }
-
-            /***
-             *    Extra CSH diffusing species based
-             *    on current temperature
-             ***/
-
-            if ((phid == C3S) || (phid == C2S)) {
-
-              plfh3 = ran1(Seed);
-              if (((phid == C2S) && (plfh3 <= pc2scsh)) || (plfh3 <= pc3scsh)) {
-
-                placed = loccsh(xc, yc, zc, sourcepore);
-                if (placed) {
-                  Count[DIFFCSH]++;
-                  Count[sourcepore]--;
-                } else {
-                  cshrand++;
-                }
-              }
-            }
-
-            if ((phid == C2S) && (pc2scsh > 1.0)) {
-              plfh3 = ran1(Seed);
-              if (plfh3 <= (pc2scsh - 1.0)) {
-                placed = loccsh(xc, yc, zc, sourcepore);
-                if (placed) {
-                  Count[DIFFCSH]++;
-                  Count[sourcepore]--;
-                } else {
-                  cshrand++;
-                }
-              }
-            }
-
-          } else {
-
-            /***
-             *    Pixel does NOT dissolve, just reset its phase
-             *    ID back to its original value
-             ***/
-
-            Mic[xl][yl][zl] -= OFFSET;
-          }
-
-        } /* end of if edge block */
-
-        /***
-         *    Now check if CSH to pozzolanic CSH conversion is
-         *    possible:
-         *
-         *        (1) Only if CH is less than 30% in volume,
-         *        (2) Only if CSH is in contact with at
-         *            least one porosity, AND
-         *        (3) User wishes to implement this option
-         ***/
-
-        if (((Count[SFUME] + Count[AMSIL]) >= (0.013 * (double)(Syspix))) &&
-            (Chnew < (0.30 * (double)(Syspix))) && (Csh2flag == 1)) {
-
-          if (Mic[xl][yl][zl] == CSH) {
-            if ((countbox(3, xl, yl, zl)) >= 1) {
-              pconvert = ran1(Seed);
-              if (pconvert < PCSH2CSH) {
-                Count[CSH]--;
-                plfh3 = ran1(Seed);
-
-                /***
-                 *    Molarvcsh units of C1.7SHx goes to
-                 *    101.81 units of C1.1SH3.9 with 19.86
-                 *    units of CH so p=calcy
-                 ***/
-
-                calcz = 0.0;
-                cycnew = Cshage[xl][yl][zl];
-                calcy = Molarv[POZZCSH] / Molarvcsh[cycnew];
-                if (calcy > 1.0) {
-                  calcz = calcy - 1.0;
-                  calcy = 1.0;
-                  if (Verbose_flag > 0) {
-                    fprintf(Logfile, "\nWARNING:  Problem of not ");
-                    fprintf(Logfile, "creating enough pozzolanic ");
-                    fprintf(Logfile, "CSH during CSH conversion");
-                    fprintf(Logfile, "\nCurrent binder temperature");
-                    fprintf(Logfile, "is %f C", Temp_cur_b);
-                  }
-                }
-
-                if (plfh3 <= calcy) {
-                  Mic[xl][yl][zl] = POZZCSH;
-                  Count[POZZCSH]++;
-                } else {
-                  Mic[xl][yl][zl] = DIFFCH;
-                  Nmade++;
-                  ncshgo++;
-                  Ngoing++;
-                  Count[DIFFCH]++;
-
-                  /***
-                   *    Allocate memory for the new
-                   *    diffusing species in the linked list
-                   ***/
-
-                  antadd = (struct Ants *)malloc(Antsize);
-                  antadd->x = xl;
-                  antadd->y = yl;
-                  antadd->z = zl;
-                  antadd->id = DIFFCH;
-                  antadd->cycbirth = Cyccnt;
-
-                  /***
-                   *    Now connect this ant structure
-                   *    to end of linked list
-                   ***/
-
-                  antadd->prevant = Tailant;
-                  Tailant->nextant = antadd;
-                  antadd->nextant = NULL;
-                  Tailant = antadd;
-                }
-
-                /***
-                 *    Possibly need even more pozzolanic CSH
-                 *
-                 *    Would need a diffusing pozzolanic
-                 *    CSH species???
-                 ***/
-
-                /*
-                if (calcz > 0.0) {
-                    plfh3 = ran1(Seed);
-                    if (plfh3 <= calcz) {
-                        cshrand++;
-                    }
-                }
-                */
-
-                plfh3 = ran1(Seed);
-                calcx = (19.86 / Molarvcsh[cycnew]) - (1.0 - calcy);
-
-                /* Ex. 0.12658=(19.86/108.)-(1.-0.94269) */
-
-                if (plfh3 < calcx)
-                  npchext++;
-              }
-            }
-          }
-        }
+    /* 2/02:  PHfactor = 0.30*(((14.1-PH_cur)/0.3)-1.0); */
+    /* 3/02:  PHfactor = 0.60*(((14.1-PH_cur)/0.5)-1.0); */
 
-        /***
-         *    See if slag can react --- must be
-         *    in contact with at least one porosity pixel
-         ***/
+    /***
+     *    Molar volume of CSH depends on pH according to
+     *    observations compiled in Jawed and Skalny,
+     *    Cem. Concr. Res., Vol. 8 pp. 37-52 (1978).
+     ***/
 
-        if (Mic[xl][yl][zl] == SLAG) {
+    Molarvcsh[Icyc] +=
+        Molarvcshcoeff_pH * (PHfactor[C3S] + (PHsulfcoeff[C3S] * Concsulfate));
+    Watercsh[Icyc] +=
+        Watercshcoeff_pH * (PHfactor[C3S] + (PHsulfcoeff[C3S] * Concsulfate));
+  }
 
-          if ((countbox(3, xl, yl, zl)) >= 1) {
-            pconvert = ran1(Seed);
-            if (pconvert < (PHfactor[SLAG] * Disprob[SLAG])) {
+  /* Update molar volume ratios for CSH formation */
 
-              Nslagr++;
-              Count[SLAG]--;
-              Discount[SLAG]++;
+  pc3scsh = (Molarvcsh[Cyccnt] / Molarv[C3S]) - 1.0;
+  pc2scsh = (Molarvcsh[Cyccnt] / Molarv[C2S]) - 1.0;
 
-              /* Check on extra C3A generation */
+  /* Once again, scan all pixels in microstructure */
 
-              plfh3 = ran1(Seed);
-              if (plfh3 < P5slag)
-                nslagc3a++;
+  Slagemptyp = 0;
 
-              /* Convert slag to reaction products */
+  /*
+  Count[DIFFSO4] = Count[NA2SO4] = 0;
+  for (k = 0; k < Zsyssize; k++) {
+      for (j = 0; j < Ysyssize; j++) {
+          for (iii = 0; i < Xsyssize; i++) {
+              if (Mic[i][j][k] == (DIFFSO4)) Count[DIFFSO4]++;
+              if (Mic[i][j][k] == (NA2SO4)) Count[NA2SO4]++;
+          }
+      }
+  }
 
-              plfh3 = ran1(Seed);
-              if (plfh3 < P1slag) {
-                Mic[xl][yl][zl] = SLAGCSH;
-                Count[SLAGCSH]++;
-              } else {
-                if (Sealed == 1) {
-
-                  /* Create empty porosity at slag site */
-                  Slagemptyp++;
-                  Mic[xl][yl][zl] = EMPTYP;
-                  Count[EMPTYP]++;
-                } else {
+  if (Verbose_flag > 1) fprintf(Logfile,"\nEntering Main dissolve loop,
+  Count[DIFFSO4] = %d, Count[NA2SO4] = %d
+  ...\n",Count[DIFFSO4],Count[NA2SO4]); log_flush(Logfile);
+  */
 
-                  /***
-                   *    We do not distinguish between saturated
-                   *    porosity and saturated crack porosity
-                   *    here (24 May 2004)
-                   ***/
+  /***
+   *    Only pixels in the soluble surface index can dissolve,
+   *    react as slag or convert to pozzolanic CSH (passone
+   *    lists every CSH pixel when Csh2flag is set), so the
+   *    scan can skip every other pixel.  With --threads the
+   *    index is gone over a slab at a time, in as many sweeps
+   *    as it takes for the slabs of a sweep to be more than
+   *    twice the reach of loccsh apart (see dissolvesweep)
+   ***/
 
-                  Mic[xl][yl][zl] = POROSITY;
-                  Count[POROSITY]++;
-                }
-              }
+  dc.gct = dc.nhgd = dc.cshrand = dc.ncshgo = dc.npchext = dc.nslagc3a = 0;
 
-              /* Add in extra SLAGCSH as needed */
+  if (Bucketants && (Antthreads > 0)) {
+    if (setantslabs()) {
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for ant slabs");
+      exit(1);
+    }
+  }
 
-              p3init = P3slag;
-              while (p3init > 1.0) {
-                extslagcsh(xl, yl, zl);
-                p3init -= 1.0;
-              }
+  if (Bucketants && (Antthreads > 0) && (Nantslab > 0)) {
 
-              plfh3 = ran1(Seed);
-              if (plfh3 < p3init)
-                extslagcsh(xl, yl, zl);
-            }
-          }
-        }
+    reach = 1 + Distloccsh / 2;
+    thick = Xsyssize / Nantslab;
+    for (ncol = 2; ncol < Nantslab; ncol++) {
+      if ((Nantslab % ncol == 0) && ((ncol - 1) * thick >= 2 * reach))
+        break;
+    }
+    for (color = 0; color < ncol; color++)
+      dissolvesweep(color, ncol, pc3scsh, pc2scsh, &dc);
+
+  } else {
 
-      } /* end of zl loop */
-    } /* end of yl loop */
-  } /* end of xl loop */
+    spos = -1;
+    while (nextsurf(&spos, &xl, &yl, &zl))
+      dissolvesite(xl, yl, zl, pc3scsh, pc2scsh, &dc);
+  }
 
   /*
   Count[DIFFSO4] = Count[NA2SO4] = 0;
@@ -8436,7 +10023,7 @@ void dissolve(int cycle) {
 
   if (Verbose_flag > 1) fprintf(Logfile,"\nLeaving Main dissolve loop,
   Count[DIFFSO4] = %d, Count[NA2SO4] = %d
-  ...\n",Count[DIFFSO4],Count[NA2SO4]); fflush(Logfile);
+  ...\n",Count[DIFFSO4],Count[NA2SO4]); log_flush(Logfile);
   */
 
   /***
@@ -8481,7 +10068,7 @@ void dissolve(int cycle) {
   %d",nkspix); fprintf(Logfile,"\n***Nasulfinit = %d Count[NA2SO4] =
   %d",Nasulfinit,Count[NA2SO4]); fprintf(Logfile,"\n***Releasedna = %f
   Totsodium = %f",Releasedna,Totsodium); fprintf(Logfile,"\n***nnaspix =
-  %d",nnaspix); fflush(Logfile);
+  %d",nnaspix); log_flush(Logfile);
   }
   */
 
@@ -8495,37 +10082,21 @@ void dissolve(int cycle) {
 
     /* delete the pot sulf linked list */
 
-    while (Headks != Tailks) {
-      if (Tailks->prevas == NULL) {
-        Tailks = Headks;
-      } else {
-        Tailks = Tailks->prevas;
-      }
+    if (alkreset(&Kspool, &Headks, &Tailks)) {
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for sulfate lists");
+      exit(1);
     }
-
-    Headks->prevas = NULL;
-    Headks->nextas = NULL;
-    Headks->x = 0;
-    Headks->y = 0;
-    Headks->z = 0;
   }
 
   if (Nasulfinit > 0 && Count[NA2SO4] > 0) {
     /* delete the sod sulf linked list */
 
-    while (Headnas != Tailnas) {
-      if (Tailnas->prevas == NULL) {
-        Tailnas = Headnas;
-      } else {
-        Tailnas = Tailnas->prevas;
-      }
+    if (alkreset(&Naspool, &Headnas, &Tailnas)) {
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for sulfate lists");
+      exit(1);
     }
-
-    Headnas->prevas = NULL;
-    Headnas->nextas = NULL;
-    Headnas->x = 0;
-    Headnas->y = 0;
-    Headnas->z = 0;
   }
 
   /*
@@ -8568,7 +10139,7 @@ void dissolve(int cycle) {
             if (Mic[xl][yl][zl] == ((int)(K2SO4)))
             */
             totks++;
-            curas = (struct Alksulf *)malloc(Alksulfsize);
+            curas = (struct Alksulf *)nodepool_get(&Kspool);
             curas->x = xl;
             curas->y = yl;
             curas->z = zl;
@@ -8594,7 +10165,8 @@ void dissolve(int cycle) {
       for (yl = 0; yl < Ysyssize; yl++) {
         for (xl = 0; xl < Xsyssize; xl++) {
           if (Mic[xl][yl][zl] == (K2SO4)) {
-            Mic[xl][yl][zl] = POROSITY;
+            partlost(xl, yl, zl);
+            MICSET(xl, yl, zl, POROSITY);
             Discount[K2SO4]++;
             Count[K2SO4]--;
             nkspix--;
@@ -8638,7 +10210,7 @@ void dissolve(int cycle) {
             if (Mic[xl][yl][zl] == ((int)(NA2SO4)))
             */
             totnas++;
-            curas = (struct Alksulf *)malloc(Alksulfsize);
+            curas = (struct Alksulf *)nodepool_get(&Naspool);
             curas->x = xl;
             curas->y = yl;
             curas->z = zl;
@@ -8664,7 +10236,8 @@ void dissolve(int cycle) {
       for (yl = 0; yl < Ysyssize; yl++) {
         for (xl = 0; xl < Xsyssize; xl++) {
           if (Mic[xl][yl][zl] == (NA2SO4)) {
-            Mic[xl][yl][zl] = POROSITY;
+            partlost(xl, yl, zl);
+            MICSET(xl, yl, zl, POROSITY);
             Discount[NA2SO4]++;
             Count[NA2SO4]--;
             nnaspix--;
@@ -8725,8 +10298,10 @@ void dissolve(int cycle) {
     } else {
       curas->nextas->prevas = curas->prevas;
     }
+    nodepool_put(&Kspool, curas);
 
-    Mic[curx][cury][curz] = POROSITY;
+    partlost(curx, cury, curz);
+    MICSET(curx, cury, curz, POROSITY);
     Discount[K2SO4]++;
     Count[K2SO4]--;
     nkspix--;
@@ -8774,7 +10349,7 @@ void dissolve(int cycle) {
 
         totks++;
         Mic[xl][yl][zl] += (OFFSET);
-        curas = (struct Alksulf *)malloc(Alksulfsize);
+        curas = (struct Alksulf *)nodepool_get(&Kspool);
         curas->x = xl;
         curas->y = yl;
         curas->z = zl;
@@ -8819,7 +10394,7 @@ void dissolve(int cycle) {
       curx = curas->x;
       cury = curas->y;
       curz = curas->z;
-      Mic[curx][cury][curz] = (K2SO4);
+      MICSET(curx, cury, curz, (K2SO4));
       curas = curas->nextas;
     }
   }
@@ -8856,8 +10431,10 @@ void dissolve(int cycle) {
     } else {
       curas->nextas->prevas = curas->prevas;
     }
+    nodepool_put(&Naspool, curas);
 
-    Mic[curx][cury][curz] = POROSITY;
+    partlost(curx, cury, curz);
+    MICSET(curx, cury, curz, POROSITY);
     Discount[NA2SO4]++;
     Count[NA2SO4]--;
     nnaspix--;
@@ -8905,7 +10482,7 @@ void dissolve(int cycle) {
 
         totnas++;
         Mic[xl][yl][zl] += (OFFSET);
-        curas = (struct Alksulf *)malloc(Alksulfsize);
+        curas = (struct Alksulf *)nodepool_get(&Naspool);
         curas->x = xl;
         curas->y = yl;
         curas->z = zl;
@@ -8950,7 +10527,7 @@ void dissolve(int cycle) {
       curx = curas->x;
       cury = curas->y;
       curz = curas->z;
-      Mic[curx][cury][curz] = (NA2SO4);
+      MICSET(curx, cury, curz, (NA2SO4));
       curas = curas->nextas;
     }
   }
@@ -8969,15 +10546,15 @@ void dissolve(int cycle) {
   if (Verbose_flag > 2) {
       fprintf(Logfile,"\nFinished resetting nasulf ids, Count[DIFFSO4] = %d,
   Count[NA2SO4] = %d ...\n",Count[DIFFSO4],Count[NA2SO4]);
-  fprintf(Logfile,"\nEligible gypsum count = %d\n",gct);
+  fprintf(Logfile,"\nEligible gypsum count = %d\n",dc.gct);
   }
   */
 
-  if ((ncshgo != 0) && (Verbose_flag > 2))
-    fprintf(Logfile, "\nCSH dissolved is %d", ncshgo);
+  if ((dc.ncshgo != 0) && (Verbose_flag > 2))
+    fprintf(Logfile, "\nCSH dissolved is %d", dc.ncshgo);
 
-  if ((npchext > 0) && (Verbose_flag > 2))
-    fprintf(Logfile, "\nExtra CH required is %d at cycle %d", npchext, cycle);
+  if ((dc.npchext > 0) && (Verbose_flag > 2))
+    fprintf(Logfile, "\nExtra CH required is %d at cycle %d", dc.npchext, cycle);
 
   /***
    *    Now add in the extra diffusing species for dissolution
@@ -8986,9 +10563,9 @@ void dissolve(int cycle) {
    *    Young (Concrete)
    ***/
 
-  ncshext = cshrand;
-  if ((cshrand != 0) && (Verbose_flag > 2))
-    fprintf(Logfile, "\ncshrand is %d", cshrand);
+  ncshext = dc.cshrand;
+  if ((dc.cshrand != 0) && (Verbose_flag > 2))
+    fprintf(Logfile, "\ncshrand is %d", dc.cshrand);
 
   /***
    *    Extra diffusing CH, Gypsum, C3A, and SO4 are added at totally random
@@ -9006,7 +10583,7 @@ void dissolve(int cycle) {
       nchext++;
   }
 
-  nchext += npchext;
+  nchext += dc.npchext;
 
   /***
    *    Adjust CH addition for slag consumption and
@@ -9038,7 +10615,7 @@ void dissolve(int cycle) {
 
   fc3aext = (double)Discount[C3A] + (double)Discount[OC3A];
   fc3aext += (0.5917 * (double)Discount[C3AH6]);
-  nc3aext = fc3aext + nslagc3a;
+  nc3aext = fc3aext + dc.nslagc3a;
   if (fc3aext > (double)nc3aext) {
     pdis = ran1(Seed);
     if ((fc3aext - (double)nc3aext) > pdis)
@@ -9166,31 +10743,17 @@ void dissolve(int cycle) {
           phid = DIFFCSH;
         }
 
-        Mic[xc][yc][zc] = phid;
+        MICSET(xc, yc, zc, phid);
         Nmade++;
         Ngoing++;
 
-        /***
-         *    Allocate memory for this diffusing
-         *    element in the doubly linked list
-         ***/
-
-        antadd = (struct Ants *)malloc(Antsize);
-        antadd->x = xc;
-        antadd->y = yc;
-        antadd->z = zc;
-        antadd->id = phid;
-        antadd->cycbirth = Cyccnt;
-
-        /***
-         *    Now connect this ant structure to end
-         *    of linked list
-         ***/
+        /* Add this diffusing element to the ant pool */
 
-        antadd->prevant = Tailant;
-        Tailant->nextant = antadd;
-        antadd->nextant = NULL;
-        Tailant = antadd;
+        if (addant(xc, yc, zc, phid, Cyccnt)) {
+          freeallmem();
+          bailout("dissolve", "Could not add ant to ant pool");
+          exit(1);
+        }
       }
 
     } while (!plok);
@@ -9259,7 +10822,7 @@ void dissolve(int cycle) {
       fprintf(Logfile,"\nEnd of dissolve cycle, Count[DIFFSO4] = %d,
   Count[NA2SO4] = %d
   ...\n",Count[DIFFSO4],Count[NA2SO4]); fprintf(Logfile,"C3AH6 dissolved- %d
-  with prob. of %f \n",nhgd,Disprob[C3AH6]);
+  with prob. of %f \n",dc.nhgd,Disprob[C3AH6]);
   }
   */
 }
@@ -9307,12 +10870,12 @@ void addrand(int randid, int nneed, int onepixfloc) {
 
       if (Mic[ix][iy][iz] == POROSITY || Mic[ix][iy][iz] == CRACKP) {
         oldval = Mic[ix][iy][iz];
-        Mic[ix][iy][iz] = randid;
+        MICSET(ix, iy, iz, randid);
         Micorig[ix][iy][iz] = randid;
         if (randid == C3A) {
           pc3a = ran1(Seed);
           if (pc3a < Oc3afrac) {
-            Mic[ix][iy][iz] = OC3A;
+            MICSET(ix, iy, iz, OC3A);
             Micorig[ix][iy][iz] = OC3A;
           }
         }
@@ -9338,9 +10901,9 @@ void addrand(int randid, int nneed, int onepixfloc) {
             if (newsite != ix) {
               newsite -= inc;
               newsite += checkbc(newsite, Xsyssize);
-              Mic[newsite][iy][iz] = Mic[ix][iy][iz];
+              MICSET(newsite, iy, iz, Mic[ix][iy][iz]);
               Micorig[newsite][iy][iz] = Micorig[ix][iy][iz];
-              Mic[ix][iy][iz] = oldval;
+              MICSET(ix, iy, iz, oldval);
               Micorig[ix][iy][iz] = oldval;
             }
             break;
@@ -9355,9 +10918,9 @@ void addrand(int randid, int nneed, int onepixfloc) {
             if (newsite != iy) {
               newsite -= inc;
               newsite += checkbc(newsite, Ysyssize);
-              Mic[ix][newsite][iz] = Mic[ix][iy][iz];
+              MICSET(ix, newsite, iz, Mic[ix][iy][iz]);
               Micorig[ix][newsite][iz] = Micorig[ix][iy][iz];
-              Mic[ix][iy][iz] = oldval;
+              MICSET(ix, iy, iz, oldval);
               Micorig[ix][iy][iz] = oldval;
             }
             break;
@@ -9372,9 +10935,9 @@ void addrand(int randid, int nneed, int onepixfloc) {
             if (newsite != iz) {
               newsite -= inc;
               newsite += checkbc(newsite, Zsyssize);
-              Mic[ix][iy][newsite] = Mic[ix][iy][iz];
+              MICSET(ix, iy, newsite, Mic[ix][iy][iz]);
               Micorig[ix][iy][newsite] = Micorig[ix][iy][iz];
-              Mic[ix][iy][iz] = oldval;
+              MICSET(ix, iy, iz, oldval);
               Micorig[ix][iy][iz] = oldval;
             }
             break;
@@ -9410,10 +10973,14 @@ void addseeds(int phid, float prob) {
     for (k = 0; k < Zsyssize; k++) {
       for (j = 0; j < Ysyssize; j++) {
         for (i = 0; i < Xsyssize; i++) {
+          if (!(i & (BLOCKSIZE - 1)) && INERTBLOCK(i, j, k)) {
+            i += BLOCKSIZE - 1;
+            continue;
+          }
           if (Mic[i][j][k] == POROSITY) {
             pcomp = ran1(Seed);
             if (pcomp < prob)
-              Mic[i][j][k] = phid;
+              MICSET(i, j, k, phid);
           }
         }
       }
@@ -9438,11 +11005,9 @@ void addseeds(int phid, float prob) {
  *    Called by:    main program
  ***/
 void addcrack(void) {
-  register int i, j, k;
-  int start;
-  struct Ants *ant;
-
-  ant = Headant;
+  int i, j, start, iant, status;
+  int x0, x1, y0, y1, z0, z1;
+  unsigned short int *coord;
 
   /***
    *    Two tasks must be performed here.  First of all,
@@ -9455,147 +11020,108 @@ void addcrack(void) {
    *    of diffusing species, are computed.
    *
    *    (24 May 2004)
+   *
+   *    The grids were made with room for the crack, so the
+   *    far half of each is moved up in place by gridcrack,
+   *    with one memmove per contiguous stretch, and the gap
+   *    is then filled.
    ***/
 
   switch (Crackorient) {
-
-  case 1: /* Crack in x direction (yz plane) */
-
+  case 1:
     if (Verbose_flag > 1)
       fprintf(Logfile, "\n\t\tCracking in yz plane...");
-
     start = (Xsyssize / 2) - 1;
-
-    for (i = Xsyssize - 1; i > start; i--) {
-      for (j = 0; j < Ysyssize; j++) {
-        for (k = 0; k < Zsyssize; k++) {
-          Mic[i + Crackwidth][j][k] = Mic[i][j][k];
-          Micpart[i + Crackwidth][j][k] = Micpart[i][j][k];
-          Cshage[i + Crackwidth][j][k] = Cshage[i][j][k];
-          Deactivated[i + Crackwidth][j][k] = Deactivated[i][j][k];
-
-          if (i <= start + Crackwidth) {
-            Mic[i][j][k] = CRACKP;
-            Count[CRACKP]++;
-            Micpart[i][j][k] = 0;
-            Cshage[i][j][k] = 0;
-            Deactivated[i][j][k] = 1;
-          }
-        }
-      }
-    }
-
-    /***
-     *    Microstructure is displaced, now move all the ants
-     ***/
-
-    while (ant != NULL) {
-      if (ant->x > start)
-        ant->x += Crackwidth;
-      ant = ant->nextant;
-    }
-
-    /*** Finally, change the x dimension ***/
-
-    Xsyssize += Crackwidth;
-
+    coord = Antpool.x;
     break;
-
-  case 2: /* Crack in y direction (xz plane) */
-
+  case 2:
     if (Verbose_flag > 1)
       fprintf(Logfile, "\n\t\tCracking in xz plane...");
-
     start = (Ysyssize / 2) - 1;
-
-    for (j = Ysyssize - 1; j > start; j--) {
-      for (i = 0; i < Xsyssize; i++) {
-        for (k = 0; k < Zsyssize; k++) {
-          Mic[i][j + Crackwidth][k] = Mic[i][j][k];
-          Micpart[i][j + Crackwidth][k] = Micpart[i][j][k];
-          Cshage[i][j + Crackwidth][k] = Cshage[i][j][k];
-          Deactivated[i][j + Crackwidth][k] = Deactivated[i][j][k];
-
-          if (j <= start + Crackwidth) {
-            Mic[i][j][k] = CRACKP;
-            Count[CRACKP]++;
-            Micpart[i][j][k] = 0;
-            Cshage[i][j][k] = 0;
-            Deactivated[i][j][k] = 1;
-          }
-        }
-      }
-    }
-
-    /***
-     *    Microstructure is displaced, now move all the ants
-     ***/
-
-    if (Verbose_flag > 2) {
-      fprintf(Logfile, "\n\t\t\tPreparing to move ants now ...");
-      fflush(Logfile);
-    }
-    while (ant != NULL) {
-      if (ant->y > start)
-        ant->y += Crackwidth;
-      ant = ant->nextant;
-    }
-    if (Verbose_flag > 2) {
-      fprintf(Logfile, " done");
-      fflush(Logfile);
-    }
-
-    /*** Finally, change the y dimension ***/
-
-    Ysyssize += Crackwidth;
-
+    coord = Antpool.y;
     break;
-
-  case 3: /* Crack in z direction (xy plane) */
-
+  case 3:
     if (Verbose_flag > 1)
       fprintf(Logfile, "\n\t\tCracking in xy plane...");
-
     start = (Zsyssize / 2) - 1;
+    coord = Antpool.z;
+    break;
+  default:
+    return;
+  }
 
-    for (k = Zsyssize - 1; k > start; k--) {
-      for (i = 0; i < Xsyssize; i++) {
-        for (j = 0; j < Ysyssize; j++) {
-          Mic[i][j][k + Crackwidth] = Mic[i][j][k];
-          Micpart[i][j][k + Crackwidth] = Micpart[i][j][k];
-          Cshage[i][j][k + Crackwidth] = Cshage[i][j][k];
-          Deactivated[i][j][k + Crackwidth] = Deactivated[i][j][k];
+  status = 0;
+  status |= gridcrack(Mic, Crackorient, start, Crackwidth, Xsyssize, Ysyssize,
+                      Zsyssize);
+  status |= gridcrack(Micorig, Crackorient, start, Crackwidth, Xsyssize,
+                      Ysyssize, Zsyssize);
+  status |= partmap_crack(&Micpart, Crackorient, start, Crackwidth);
+  status |= gridcrack(Cshage, Crackorient, start, Crackwidth, Xsyssize,
+                      Ysyssize, Zsyssize);
+  status |= gridcrack(Deactivated, Crackorient, start, Crackwidth, Xsyssize,
+                      Ysyssize, Zsyssize);
+  if (Faces)
+    status |= gridcrack(Faces, Crackorient, start, Crackwidth, Xsyssize,
+                        Ysyssize, Zsyssize);
+  if (status) {
+    freeallmem();
+    bailout("disrealnew", "No room in the microstructure for the crack");
+    exit(1);
+  }
 
-          if (k <= start + Crackwidth) {
-            Mic[i][j][k] = CRACKP;
-            Count[CRACKP]++;
-            Micpart[i][j][k] = 0;
-            Cshage[i][j][k] = 0;
-            Deactivated[i][j][k] = 1;
-          }
-        }
-      }
-    }
+  /***
+   *    Microstructure is displaced and the gap is zeroed,
+   *    now make the gap crack space and change the dimension
+   ***/
 
-    /***
-     *    Microstructure is displaced, now move all the ants
-     ***/
+  x0 = y0 = z0 = 0;
+  x1 = Xsyssize;
+  y1 = Ysyssize;
+  z1 = Zsyssize;
+  if (Crackorient == 1) {
+    x0 = start + 1;
+    x1 = start + 1 + Crackwidth;
+    Xsyssize += Crackwidth;
+  } else if (Crackorient == 2) {
+    y0 = start + 1;
+    y1 = start + 1 + Crackwidth;
+    Ysyssize += Crackwidth;
+  } else {
+    z0 = start + 1;
+    z1 = start + 1 + Crackwidth;
+    Zsyssize += Crackwidth;
+  }
 
-    while (ant != NULL) {
-      if (ant->z > start)
-        ant->z += Crackwidth;
-      ant = ant->nextant;
+  for (i = x0; i < x1; i++) {
+    for (j = y0; j < y1; j++) {
+      memset(&(Mic[i][j][z0]), CRACKP, (size_t)(z1 - z0));
     }
+  }
+  Count[CRACKP] += (x1 - x0) * (y1 - y0) * (z1 - z0);
 
-    /*** Finally, change the z dimension ***/
-
-    Zsyssize += Crackwidth;
-    break;
+  /* Now move all the ants beyond the crack */
 
-  default:
-    break;
+  if (Verbose_flag > 2) {
+    fprintf(Logfile, "\n\t\t\tPreparing to move ants now ...");
+    log_flush(Logfile);
+  }
+  for (iant = 0; iant < Antpool.num; iant++) {
+    if (coord[iant] > start)
+      coord[iant] += Crackwidth;
+  }
+  if (Verbose_flag > 2) {
+    fprintf(Logfile, " done");
+    log_flush(Logfile);
   }
 
+  /***
+   *    Particles have moved, so parthyd must count them again,
+   *    and the list of deactivated pixels must be rebuilt
+   ***/
+
+  Partok = 0;
+  Ndeactpix = -1;
+
   return;
 }
 
@@ -9604,6 +11130,11 @@ void addcrack(void) {
  *
  *     Calculate temperature of binder and aggregate
  *
+ *     The heat released since the last cycle comes from
+ *     Heat_new and Heat_old, which dissolve sets from the
+ *     phase counts it has already taken, so no pass over
+ *     the microstructure is made here
+ *
  *     Arguments:    double mass of solid
  *
  *     Returns:    nothing
@@ -9679,91 +11210,53 @@ void calcT(double mass) {
 /***
  *    measuresurf
  *
- *    Releases all dynamically allocated memory for this
- *    program.
+ *    Count the faces between saturated porosity and the
+ *    solid phases of the SURFSOLID class (Scnttotal), and
+ *    between porosity and clinker (Scntcement), to give the
+ *    fraction of the surface that is cement (Surffract)
  *
- *    SHOULD ONLY BE CALLED IF ALL MEMORY HAS ALREADY BEEN
- *    DYNAMICALLY ALLOCATED
+ *    Each row is compared with its six neighboring rows as
+ *    whole rows, read through the halo of Mic, or with
+ *    --bit-planes as words of the planes (see bitsurf).
  *
  *    Arguments:    None
  *    Returns:    Nothing
  *
- *    Calls:        free_ccube, free_sicube
- *    Called by:    main,dissolve
+ *    Calls:        refreshhalo, bitsurf
+ *    Called by:    hydinit
  *
  ***/
 void measuresurf(void) {
-  int kx, ky, kz, jx, jy, jz, faceid;
-
-  jx = jy = jz = 0;
-  for (kx = 0; kx < Xsyssize; kx++) {
-    for (ky = 0; ky < Ysyssize; ky++) {
-      for (kz = 0; kz < Zsyssize; kz++) {
-        if (Mic[kx][ky][kz] == POROSITY) {
+  int kx, ky, kz, ip, ntotal, ncement;
+  int cls;
+  const char *row, *nrow;
 
-          for (faceid = 0; faceid < 6; faceid++) {
-            switch (faceid) {
-            case 0:
-              jx = kx + 1;
-              if (jx > (Xsyssize - 1))
-                jx = 0;
-              jy = ky;
-              jz = kz;
-              break;
-            case 1:
-              jx = kx - 1;
-              if (jx < 0)
-                jx = Xsyssize - 1;
-              jy = ky;
-              jz = kz;
-              break;
-            case 2:
-              jy = ky + 1;
-              if (jy > (Ysyssize - 1))
-                jy = 0;
-              jx = kx;
-              jz = kz;
-              break;
-            case 3:
-              jy = ky - 1;
-              if (jy < 0)
-                jy = Ysyssize - 1;
-              jx = kx;
-              jz = kz;
-              break;
-            case 4:
-              jz = ky + 1;
-              if (jz > (Zsyssize - 1))
-                jz = 0;
-              jx = kx;
-              jy = ky;
-              break;
-            case 5:
-              jz = ky - 1;
-              if (jz < 0)
-                jz = Zsyssize - 1;
-              jx = kx;
-              jy = ky;
-              break;
-            default:
-              break;
-            }
+  if (Bitplane) {
+    bitsurf(&Scnttotal, &Scntcement);
+  } else {
+    refreshhalo();
 
-            if ((Mic[jx][jy][jz] == C3S) || (Mic[jx][jy][jz] == C2S) ||
-                (Mic[jx][jy][jz] == C3A) || (Mic[jx][jy][jz] == OC3A) ||
-                (Mic[jx][jy][jz] == C4AF) || (Mic[jx][jy][jz] == INERT) ||
-                (Mic[jx][jy][jz] == SFUME) || (Mic[jx][jy][jz] == CACO3)) {
+    for (kx = 0; kx < Xsyssize; kx++) {
+      for (ky = 0; ky < Ysyssize; ky++) {
+        row = Mic[kx][ky];
+        ntotal = ncement = 0;
 
-              Scnttotal++;
-              if ((Mic[jx][jy][jz] == C3S) || (Mic[jx][jy][jz] == C2S) ||
-                  (Mic[jx][jy][jz] == C3A) || (Mic[jx][jy][jz] == OC3A) ||
-                  (Mic[jx][jy][jz] == C4AF)) {
+        /* The first six offsets are the face neighbors */
 
-                Scntcement++;
-              }
-            }
+        for (ip = 0; ip < 6; ip++) {
+          nrow = Mic[kx + Xoff[ip]][ky + Yoff[ip]] + Zoff[ip];
+#ifdef _OPENMP
+#pragma omp simd reduction(+ : ntotal, ncement)
+#endif
+          for (kz = 0; kz < Zsyssize; kz++) {
+            cls = (row[kz] == POROSITY) ? Surfclass[(unsigned char)nrow[kz]]
+                                        : 0;
+            ntotal += (cls & SURFSOLID) ? 1 : 0;
+            ncement += (cls & SURFCEMENT) ? 1 : 0;
           }
         }
+        Scnttotal += ntotal;
+        Scntcement += ncement;
       }
     }
   }
@@ -9773,25 +11266,35 @@ void measuresurf(void) {
     fprintf(Logfile, "\nCement surface count is %d", Scntcement);
     fprintf(Logfile, "\nTotal surface count is %d", Scnttotal);
     fprintf(Logfile, "\nSurface fraction is %f", Surffract);
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 }
 
 /***
  *    findnewtime
  *
- *    Search experimental kinetic data (calorimetric or chemical shrinkage)
- *for a match to the current time.  If the experimental data end before the
- *current time is reached, use a generalized quadratic fit procedure to end of
- *    experimental data and extrapolate to later times
+ *    Search experimental kinetic data (calorimetric or chemical
+ *    shrinkage) for a match to the current time.  If the experimental
+ *    data end before the current time is reached, use a generalized
+ *    quadratic fit procedure to end of experimental data and
+ *    extrapolate to later times.
+ *
+ *    The search resumes at CurDataLine, where the last one ended,
+ *    and dval is the heat (Heat_new) or chemical shrinkage (Chs_new)
+ *    that dissolve has already computed, so a cycle costs only a
+ *    few data lines and no pass over the microstructure.
  *
  *    Arguments:  float dval is the simulated heat or chemical shrinkage
  *                float act_nrg is the activation energy for temperature
- *change effects float *previousUncorrectedTime is a pointer to the address
- *holding the previous time before any temperature corrections are applied
- *string *typestring identifies whether the data are calorimetric or chemical
- *shrinkage Returns:    Nothing
+ *                    change effects
+ *                float *previousUncorrectedTime is a pointer to the
+ *                    address holding the previous time before any
+ *                    temperature corrections are applied
+ *                char *typestring identifies whether the data are
+ *                    calorimetric or chemical shrinkage
+ *    Returns:    Nothing
  *
+ *    Calls:        createfittocycles
  *    Called by:    main
  *
  ***/
@@ -9861,7 +11364,7 @@ void findnewtime(float dval, float act_nrg, float *previousUncorrectedTime,
                   TimeHistory[Cyccnt - 1]);
           fprintf(Logfile, "\n**Time_cur = %f", Time_cur);
         }
-        fflush(Logfile);
+        log_flush(Logfile);
         *previousUncorrectedTime = calFileSaysTimeShouldBe;
         CurDataLine = i;
       }
@@ -9878,7 +11381,7 @@ void findnewtime(float dval, float act_nrg, float *previousUncorrectedTime,
       if (Verbose_flag > 1)
         fprintf(Logfile, "\nNo more useful %s data for calibration",
                 typestring);
-      fflush(Logfile);
+      log_flush(Logfile);
     }
 
     /* Now need to estimate Beta for the remaining iterations   */
@@ -9952,14 +11455,14 @@ void findnewtime(float dval, float act_nrg, float *previousUncorrectedTime,
 /***
  *    createfittocycles
  *
- *    Use second-order Lagrange interpolation to fit a quadratic form to the
- *most recent data for time versus cycles, enabling one to extrapolate to
- *later times
+ *    Use second-order Lagrange interpolation to fit a quadratic form
+ *    to the most recent data (three points of TimeHistory) for time
+ *    versus cycles, enabling one to extrapolate to later times
  *
  *    Arguments:  none
  *    Returns:    Nothing
  *
- *    Called by:    main
+ *    Called by:    findnewtime
  *
  ***/
 void createfittocycles(void) {
@@ -10055,35 +11558,95 @@ void createfittocycles(void) {
  *    Arguments:    None
  *    Returns:    Nothing
  *
- *    Calls:        free_ccube, free_sicube
+ *    Calls:        free_cgrid, free_sigrid
  *    Called by:    main,dissolve
  *
  ***/
 void freeallmem(void) {
-  int ntick;
-  struct Ants *curant, *antgone;
-  struct Alksulf *curas, *asgone;
+  static int freed = 0;
+
+  /* An error exit may already have freed everything */
+
+  if (freed)
+    return;
+  freed = 1;
+
+  outclose();
+  if (Ensseed)
+    free_ivector(Ensseed);
+  Ensseed = NULL;
+  if (Ensstatus)
+    free_ivector(Ensstatus);
+  Ensstatus = NULL;
+  if (Bundlebuf)
+    free(Bundlebuf);
+  Bundlebuf = NULL;
+  Bundlenum = 0;
+
+  snapstop();
+  perfclose();
+  trace_close();
+  streamclose();
+  liveclose();
+  movie_close(&Movstream);
+  series_close(&Snapseries);
+  if (Movframe)
+    free(Movframe);
+  Movframe = NULL;
+  solidfree();
+  bitfree();
 
   if (Mic)
-    free_cbox(Mic, Xsyssize, Ysyssize);
+    free_cgrid(Mic);
   if (Verbose_flag > 2)
-    fprintf(Logfile, "\nFreed cbox Mic");
+    fprintf(Logfile, "\nFreed cgrid Mic");
   if (Micorig)
-    free_cbox(Micorig, Xsyssize, Ysyssize);
+    free_cgrid(Micorig);
   if (Verbose_flag > 2)
-    fprintf(Logfile, "\nFreed cbox Micorig");
-  if (Micpart)
-    free_sibox(Micpart, Xsyssize, Ysyssize);
+    fprintf(Logfile, "\nFreed cgrid Micorig");
+  partmap_free(&Micpart);
+  if (Partedge)
+    free(Partedge);
+  Partedge = NULL;
   if (Verbose_flag > 2)
-    fprintf(Logfile, "\nFreed sibox Micpart");
+    fprintf(Logfile, "\nFreed Micpart");
+  if (Partorig)
+    free(Partorig);
+  if (Partleft)
+    free(Partleft);
+  Partorig = Partleft = NULL;
+  Partok = 0;
   if (Cshage)
-    free_sibox(Cshage, Xsyssize, Ysyssize);
+    free_cgrid(Cshage);
   if (Verbose_flag > 2)
-    fprintf(Logfile, "\nFreed sibox Cshage");
+    fprintf(Logfile, "\nFreed cgrid Cshage");
   if (Deactivated)
-    free_sibox(Deactivated, Xsyssize, Ysyssize);
+    free_cgrid(Deactivated);
   if (Verbose_flag > 2)
-    fprintf(Logfile, "\nFreed sibox Deactivated");
+    fprintf(Logfile, "\nFreed cgrid Deactivated");
+  if (Deactpix)
+    free(Deactpix);
+  Deactpix = NULL;
+  Ndeactpix = -1;
+  Deactpixsize = 0;
+  if (Faces)
+    free_sigrid(Faces);
+  if (Verbose_flag > 2)
+    fprintf(Logfile, "\nFreed sigrid Faces");
+  if (Surfmap)
+    free(Surfmap);
+  if (Verbose_flag > 2)
+    fprintf(Logfile, "\nFreed Surfmap");
+  if (Blockinert)
+    free(Blockinert);
+  Blockinert = NULL;
+  if (Verbose_flag > 2)
+    fprintf(Logfile, "\nFreed Blockinert");
+  perc_track_free(&Poretrack);
+  perc_track_free(&Settrack);
+  percwork_free(&Burnwork);
+  if (Verbose_flag > 2)
+    fprintf(Logfile, "\nFreed percolation work space");
   if (Startflag)
     free_ivector(Startflag);
   if (Verbose_flag > 2)
@@ -10175,83 +11738,18 @@ void freeallmem(void) {
 
   /*** Now free the ants ***/
 
-  if (Headant) {
-    ntick = 0;
-    curant = Headant->nextant;
-    while (curant) {
-      ntick++;
-      if (ntick == 1) {
-        Headant->nextant = curant->nextant;
-      } else {
-        (curant->prevant)->nextant = curant->nextant;
-      }
-      if (curant->nextant) {
-        (curant->nextant)->prevant = curant->prevant;
-      } else {
-        Tailant = curant->prevant;
-      }
-      antgone = curant;
-      curant = curant->nextant;
-      free(antgone);
-    }
-    if (Verbose_flag > 2)
-      fprintf(Logfile, "\nFreed all ants except Headant... ");
-    free(Headant);
-    if (Verbose_flag > 2)
-      fprintf(Logfile, "freed Headant");
-  }
+  freeantpool();
+  freeantslabs();
+  if (Verbose_flag > 2)
+    fprintf(Logfile, "\nFreed ant pool");
 
-  if (Headks) {
-    ntick = 0;
-    curas = Headks->nextas;
-    while (curas) {
-      ntick++;
-      if (ntick == 1) {
-        Headks->nextas = curas->nextas;
-      } else {
-        (curas->prevas)->nextas = curas->nextas;
-      }
-      if (curas->nextas) {
-        (curas->nextas)->prevas = curas->prevas;
-      } else {
-        Tailks = curas->prevas;
-      }
-      asgone = curas;
-      curas = curas->nextas;
-      free(asgone);
-    }
-    if (Verbose_flag > 2)
-      fprintf(Logfile, "\nFreed all ks except Headks... ");
-    free(Headks);
-    if (Verbose_flag > 2)
-      fprintf(Logfile, "freed Headks");
-  }
+  /* Every node of the sulfate lists is in one of the two pools */
 
-  if (Headnas) {
-    ntick = 0;
-    curas = Headnas->nextas;
-    while (curas) {
-      ntick++;
-      if (ntick == 1) {
-        Headnas->nextas = curas->nextas;
-      } else {
-        (curas->prevas)->nextas = curas->nextas;
-      }
-      if (curas->nextas) {
-        (curas->nextas)->prevas = curas->prevas;
-      } else {
-        Tailnas = curas->prevas;
-      }
-      asgone = curas;
-      curas = curas->nextas;
-      free(asgone);
-    }
-    if (Verbose_flag > 2)
-      fprintf(Logfile, "\nFreed all nas except Headnas... ");
-    free(Headnas);
-    if (Verbose_flag > 2)
-      fprintf(Logfile, "freed Headnas");
-  }
+  nodepool_free(&Kspool);
+  nodepool_free(&Naspool);
+  Headks = Tailks = Headnas = Tailnas = NULL;
+  if (Verbose_flag > 2)
+    fprintf(Logfile, "\nFreed sulfate lists");
 
   return;
 }
@@ -36,9 +36,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <signal.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if !defined(_WIN32)
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #include "include/properties.h"
 
+#ifdef VCCTL_MPI
+#include <mpi.h>
+#endif
+
 /***
  *	Pre-processor defines
  ***/
@@ -54,6 +71,15 @@ static int CUBEMIN = 3; /* Minimum cube size for checking pore size */
 /* Maximum number of random attempts to place a new pixel phase */
 static int MAXTRIES = 5000;
 
+/***
+ *	Random tries loccsh makes to place a diffusing CSH species
+ *	near its source, and how many of them it makes one by one
+ *	before it scans the box for the rest (see loccsh).  With
+ *	--legacy-ants all of them are made one by one.
+ ***/
+#define LOCCSHMAXTRIES 500
+#define LOCCSHTRIES 32
+
 #define MEMERR -1
 
 /* Different choices for calibrating time scale */
@@ -181,6 +207,14 @@ static int DISTLOCCSH = 17;
  ***/
 static int NEIGHBORS = 26;
 
+/***
+ *	Surface test of passone compiled for NEIGHBORS (see
+ *	edgerowfor), chosen when the parameter file is read
+ ***/
+typedef void (*Edgerowfn)(int, int, unsigned char *);
+void edgerowany(int xck, int yck, unsigned char *edge);
+Edgerowfn Edgerow = edgerowany;
+
 /***
  *	Water bound per gram of cement during hydration
  ***/
@@ -206,35 +240,55 @@ static float PDIFFCSH = 0.0004;
 
 /***
  *	Data structure for diffusing species (generically called ants)
- *	Structure in the form of a doubly linked list.  The size of the
- *	list is dynamically allocated and managed so that the list
- *	may shrink or grow in size as needed.
- *
- ****
- *	NOTE: IF SYSTEM SIZE EXCEEDS 256, NEED TO CHANGE X, Y, AND Z TO
- * 			INT VARIABLES
- ***/
-struct Ants {
-  unsigned int x, y, z, id;
-  int cycbirth;
-  struct Ants *nextant;
-  struct Ants *prevant;
+ *
+ *	Ants are held in a single contiguous pool instead of a malloc'd
+ *	doubly linked list.  Live ants always occupy slots 0 through
+ *	Antpool.num - 1 in order of creation, so walking the ants streams
+ *	through memory, and an ant that reacts is dropped by compacting
+ *	the pool in place rather than by calling free().
+ *
+ *	The pool is stored as a structure of arrays.  Coordinates fit in
+ *	16 bits because no dimension may exceed MAXSIZE, species ids are
+ *	all below NDIFFPHASES, and the birth cycle is kept as a short int,
+ *	which holds any cycle number.  One ant costs 9 bytes, plus
+ *	9 more for the scratch copy used when sorting the pool.
+ *
+ *		x,y,z:     coordinates of each ant
+ *		id:        diffusing species id of each ant
+ *		cycbirth:  cycle in which each ant was created
+ *		s*:        scratch copies of the above used when the
+ *		           pool is sorted into species buckets
+ *		num:       number of live ants
+ *		size:      number of allocated ant slots
+ *
+ *	The pool grows geometrically when it fills up and is only
+ *	released by freeallmem.
+ ***/
+struct Antpool {
+  unsigned short int *x, *y, *z;
+  unsigned char *id;
+  short int *cycbirth;
+  unsigned short int *sx, *sy, *sz;
+  unsigned char *sid;
+  short int *scycbirth;
+  int num;
+  int size;
 };
 
+/* Initial number of ant slots in the pool */
+#define ANTPOOLSIZE 16384
+
 /***
- *	Data structure for elements to remove to simulate
- *	self-dessication.  The list is once again a doubly linked
- *	list to be dynamically allocated and managed
+ *	Number of diffusing species, DIFFCSH through DIFFSO4, and the
+ *	bucket index of a diffusing species id.  The phase id macros
+ *	are not parenthesized, hence the extra parentheses here.
  ***/
-struct Togo {
-  int x, y, z, npore;
-  struct Togo *nexttogo;
-  struct Togo *prevtogo;
-};
+#define NANTSPECIES ((NDIFFPHASES) - (DIFFCSH))
+#define ANTBUCKET(id) ((id) - (DIFFCSH))
 
 /***
  *	Data structure for alkali sulfates to dissolve.
- *	The list is once again a doubly linked
+ *	The list is a doubly linked
  *	list to be dynamically allocated and managed
  ***/
 struct Alksulf {
@@ -248,7 +302,7 @@ struct Alksulf {
  *
  ***/
 
-size_t Antsize, Togosize, Alksulfsize;
+size_t Alksulfsize;
 
 int AggTempEffect = 1;
 
@@ -256,17 +310,103 @@ int AggTempEffect = 1;
  *		microstructure stored in array mic of type char
  *			to reduce storage requirements
  *
- *		initial particle ids stored in array micpart
- *			(used to assess set point)
+ *		initial particle ids stored in the map Micpart
+ *			(used to assess set point), a block at a time
+ *			with as few bits per pixel as the block needs
+ *			(see partmap.c); read with partmap_get.  It
+ *			only changes with a crack or coarsening.
+ *			Partedge holds, one bit per pixel in rows of
+ *			Partedgewords words (bit z & 63 of word z >>
+ *			6), whether any of the NEIGHBORS neighbors of
+ *			the pixel is in another particle; layerbuild
+ *			makes it from Micpart.
+ *
+ *		Mic carries a halo MICHALO pixels deep on every
+ *			face (see cgridhalo in memutil.c).
+ *			refreshhalo fills it with periodic images,
+ *			after which a scan may read the neighbors of
+ *			any pixel without checkbc.  The halo is only
+ *			valid while nothing writes Mic except through
+ *			mirrormic, so the scans that use it refresh it
+ *			first.
+ *
+ *		With --tiled-grids (Tiledgrids) its z rows are
+ *			kept in Morton order of (x, y) (see cgridtile),
+ *			so the 26 neighbors of a pixel lie in rows a
+ *			few rows apart instead of a whole x plane apart.
+ *
+ *		With --lean-grids (Leangrids) Micorig, Cshage and
+ *			Deactivated are only made for the features of
+ *			the parameter file that use them, and are NULL
+ *			otherwise (see leangrids.h).
  ***/
 
+#define MICHALO 1
+int Tiledgrids = 0;
+int Leangrids = 0;
+
 char ***Mic = NULL;
 char ***Micorig = NULL;
-short int ***Micpart = NULL;
-short int ***Cshage = NULL;
+Partmap Micpart;
+uint64_t *Partedge = NULL;
+int Partedgewords = 0;
+char ***Cshage = NULL;
 short int ***Faces = NULL;
 float *CustomImageTime = NULL;
 
+/***
+ *		Cshage holds, for each CSH pixel, a one byte code for
+ *			the cycle in which it formed, which is all that
+ *			Molarvcsh and Watercsh are ever looked up by.
+ *			Code 0 is the starting microstructure and code
+ *			k > 0 stands for the Cshagewidth cycles that
+ *			start at 1 + (k - 1) * Cshagewidth, so up to
+ *			CSHAGECODES - 1 cycles the code is the cycle
+ *			itself.  See cshagecode and cshagecycle.
+ ***/
+
+#define CSHAGECODES 255
+
+int Cshagewidth = 1;
+
+/***
+ *		Soluble surface index for dissolve: one bit per pixel,
+ *			numbered in the z, y, x order of the main
+ *			dissolution loop.  passone sets the bit of every
+ *			pixel it marks with OFFSET (and of every SLAG
+ *			pixel, and every CSH pixel when Csh2flag is set,
+ *			which that loop also visits), so the loop
+ *			can step over the pixels it would leave alone
+ *			instead of rescanning the whole box.
+ ***/
+
+#define SURFBITS (8 * sizeof(unsigned int))
+
+unsigned int *Surfmap = NULL;
+
+/***
+ *		Inert blocks: one flag per block of BLOCKSIZE^3 pixels,
+ *			set when every pixel of the block is INERTAGG.
+ *			Nothing in a hydration cycle writes to aggregate,
+ *			so such a block stays as it is until the grid is
+ *			rebuilt (crack, coarse grid, checkpoint), and the
+ *			whole-box scans can step over it.  Inertagg is
+ *			the number of INERTAGG pixels in those blocks,
+ *			which passone adds to its count instead.
+ ***/
+
+#define BLOCKBITS 3
+#define BLOCKSIZE (1 << BLOCKBITS)
+
+#define INERTBLOCK(x, y, z)                                                    \
+  (Blockinert[((size_t)((x) >> BLOCKBITS) * Yblocks + ((y) >> BLOCKBITS)) *   \
+                  Zblocks +                                                    \
+              ((z) >> BLOCKBITS)])
+
+unsigned char *Blockinert = NULL;
+int Xblocks, Yblocks, Zblocks;
+int Inertagg = 0;
+
 /* Command line argument data */
 int Verbose_flag;
 char ProgressFileName[500];
@@ -274,9 +414,24 @@ char WorkingDirectory[500];
 char ParameterFileName[500];
 char LogFileName[500];
 
-/* Arrays for keeping track of surface deactivation */
+/***
+ *	Arrays for keeping track of surface deactivation.  Each
+ *	pixel of Deactivated holds one bit per face, DEACTBIT(faceid),
+ *	set while that face is deactivated.
+ *
+ *	Deactpix lists every pixel that may have a deactivated face,
+ *	in x, y, z order, by its index (x * Ysyssize + y) * Zsyssize
+ *	+ z, so that reactivation only visits those pixels.
+ *	Ndeactpix is -1 when the list has to be rebuilt from
+ *	Deactivated because the pixels have moved (a crack, coarsening
+ *	or a restart).
+ ***/
 
-short int ***Deactivated = NULL;
+#define DEACTBIT(f) (1 << (f))
+
+char ***Deactivated = NULL;
+long *Deactpix = NULL;
+long Ndeactpix = -1, Deactpixsize = 0;
 int *Startflag = NULL;
 int *Stopflag = NULL;
 int *Deactphaselist = NULL;
@@ -363,6 +518,16 @@ int Tcustomoutputentries;
 float Burntimefreq, Settimefreq, Phydtimefreq, OutTimefreq;
 float NextBurnTime, NextSetTime, NextPhydTime;
 
+/***
+ *	Clinker pixels of each particle (indexed by its Micpart id)
+ *	in the original microstructure and now, for parthyd.  They
+ *	are counted over the whole system once, and again whenever
+ *	Partok is cleared; in between partlost keeps Partleft up to
+ *	date as clinker pixels are consumed.
+ ***/
+int *Partorig = NULL, *Partleft = NULL;
+int Partmax = 0, Partok = 0;
+
 /***
  *	X,Y,Z relative coordinates from the center of a 3x3x3 cube
  ***/
@@ -373,6 +538,38 @@ int Yoff[27] = {0, 1, 0, 0, -1, 0,  1, -1, 1, -1, 1,  -1, 1, -1,
 int Zoff[27] = {0, 0,  1, 0,  0, -1, 0,  0,  0, 0,  1, 1,  -1, -1,
                 1, -1, 1, -1, 1, 1,  -1, -1, 1, -1, 1, -1, 0};
 
+/***
+ *	Classes of each phase id (Mic value) seen from a neighbor,
+ *	so that the surface tests of passone and measuresurf are a
+ *	table lookup instead of a chain of compares:
+ *
+ *		SURFOPEN:    a soluble pixel touching it is on a surface
+ *		             (saturated porosity, or C-S-H of any kind)
+ *		SURFCEMENT:  a clinker phase
+ *		SURFSOLID:   a phase whose face with porosity counts
+ *		             toward the total surface in measuresurf
+ *
+ *	Ids marked with OFFSET belong to no class.
+ ***/
+#define SURFOPEN 1
+#define SURFCEMENT 2
+#define SURFSOLID 4
+
+const unsigned char Surfclass[256] = {
+    [POROSITY] = SURFOPEN,
+    [CRACKP] = SURFOPEN,
+    [CSH] = SURFOPEN,
+    [POZZCSH] = SURFOPEN,
+    [SLAGCSH] = SURFOPEN,
+    [C3S] = SURFCEMENT | SURFSOLID,
+    [C2S] = SURFCEMENT | SURFSOLID,
+    [C3A] = SURFCEMENT | SURFSOLID,
+    [OC3A] = SURFCEMENT | SURFSOLID,
+    [C4AF] = SURFCEMENT | SURFSOLID,
+    [INERT] = SURFSOLID,
+    [SFUME] = SURFSOLID,
+    [CACO3] = SURFSOLID};
+
 /***
  *	Parameters for kinetic modelling ---- maturity approach
  ***/
@@ -541,8 +738,8 @@ float Cshscale;
  ***/
 float C3ah6_scale;
 
-/* Random number seed */
-int Iseed;
+/* Random number seed, and the seed as read from the parameter file */
+int Iseed, Iseed0;
 int *Seed;
 
 /* Variables for alkali predictions */
@@ -566,19 +763,473 @@ const int PLATE = 1;
 /* Make Conccaplus global to speed up execution and Moles_syn_precip */
 /* global to accumulate properly */
 double Conccaplus = 0.0, Moles_syn_precip = 0.0, Concsulfate = 0.0;
+
+/* Roots of the last quartic solved by pHpred, where the next search starts */
+fcomplex PHroots[5];
+int PHrootsok = 0;
 double Conductivity, Concnaplus, Conckplus, Concohminus;
 double ActivityCa, ActivityOH, ActivitySO4, ActivityK;
-int Primevalues[6] = {2, 3, 5, 7, 11, 13};
 int Cshboxsize;
 
 /* Percolation global variables */
 int Nphc[3];
 double Con_fracp[3], Con_fracs[3];
 
-struct Ants *Headant, *Tailant;
+/***
+ *	Labeling state of burn3d and burnset, kept between checks:
+ *	one tracker each, so that a check finding no change in the
+ *	pore space (or in the solids) gives back the last result,
+ *	and scratch space they share, allocated once by init at the
+ *	largest system size
+ ***/
+
+Perctrack Poretrack, Settrack;
+Percwork Burnwork;
+
+struct Antpool Antpool = {NULL, NULL, NULL, NULL, NULL, NULL,
+                          NULL, NULL, NULL, NULL, 0,    0};
+
+/***
+ *	Process ants one species bucket at a time in hydrate (1),
+ *	or in order of creation as the original code did (0)
+ ***/
+int Bucketants = 1;
+
+/***
+ *	Slab decomposition of the diffusion step (see antslab.h)
+ *
+ *	ANTREACH bounds how far in x from its own position one
+ *	diffusion step of an ant can read or change Mic.  The move
+ *	itself, the local growth routines and the four links of the
+ *	longest acicular ettringite chain reach six pixels, so eight
+ *	leaves a margin.  Slabs are at least 2 * ANTREACH thick.
+ ***/
+#define ANTREACH 8
+
+/* Kinds of deferred random-location growth, one per randXXX routine */
+#define RANDCSH 0
+#define RANDFH3 1
+#define RANDETTR 2
+#define RANDCH 3
+#define RANDGYPS 4
+#define RANDFRIEDEL 5
+#define RANDSTRAT 6
+#define RANDAFM 7
+#define RANDPOZZ 8
+#define RANDC3AH6 9
+#define RANDSLAGCSH 10
+
+/***
+ *	One queued random-location growth: which randXXX routine,
+ *	the saturated porosity to grow into and the ettringite type
+ ***/
+struct Randjob {
+  unsigned char kind;
+  unsigned char pval;
+  unsigned char etype;
+};
+
+/***
+ *	Global counters that the move routines and dissolve change.
+ *	Each slab starts a sweep from the same values, and the
+ *	changes made by all slabs are added together after the sweep.
+ ***/
+struct Slabtally {
+  int count[NPHASES + 1];
+  int discount[NPHASES + 1];
+  int ngoing, ncshplateinit, ncshplategrow;
+  int nsilica_rx, nucsulf2gyps, nasr;
+  int nnucleate, nrejected;
+  int nmade, nslagr, slagemptyp;
+};
+
+/***
+ *	A diffusing species made by dissolve in a slab, held until
+ *	the sweep is over and then added to the ant pool
+ ***/
+struct Newant {
+  unsigned short int x, y, z;
+  unsigned char id;
+  short int cycbirth;
+};
+
+/***
+ *	Counts kept by dissolve for its own use while it goes over
+ *	the soluble surface: eligible gypsum, dissolved C3AH6, CSH
+ *	to place at random, CSH converted to CH, extra CH and extra
+ *	C3A from slag
+ ***/
+struct Disscount {
+  int gct, nhgd, cshrand, ncshgo, npchext, nslagc3a;
+};
+
+/***
+ *	Directions for moveone drawn ahead of time, with --fast-moves,
+ *	from an explicit-state stream (see rng.c).  Each entry of dir
+ *	is a direction from 0 to 5, and pos is the next one to use.
+ *	MOVEALL is the mask moveone builds up once all six directions
+ *	have been tried.
+ ***/
+#define MOVEBUFSIZE 4096
+#define MOVEALL 63
+
+struct Movebuf {
+  Rngstate st;
+  int pos;
+  unsigned char dir[MOVEBUFSIZE];
+};
+
+/***
+ *	Phases a product may grow into by growlocal, one bit per
+ *	phase id (ids of 64 and above never match).  All the local
+ *	growth so far goes into saturated porosity of either kind.
+ ***/
+#define GROWINTO(m, ph) ((unsigned int)(ph) < 64 && (((m) >> (ph)) & 1ULL))
+#define GROWPORE ((1ULL << (POROSITY)) | (1ULL << (CRACKP)))
+
+/***
+ *	State owned by one slab:
+ *
+ *		rng:     private ran1 stream of the slab
+ *		moves:   private stream of moveone directions (--fast-moves)
+ *		tally:   counters at the end of the slab's last sweep
+ *		job:     random-location growth queued during a sweep
+ *		njob:    number of queued jobs
+ *		jobsize: number of allocated job slots
+ *		joberr:  nonzero if the job queue could not grow
+ *		ant:     diffusing species made by dissolve during a sweep
+ *		nant:    number of them
+ *		antsize: number of allocated slots for them
+ *		anterr:  nonzero if that queue could not grow
+ *		diss:    dissolve's own counts for the slab's last sweep
+ ***/
+struct Antslab {
+  Ran1state rng;
+  struct Movebuf moves;
+  struct Slabtally tally;
+  struct Randjob *job;
+  int njob, jobsize, joberr;
+  struct Newant *ant;
+  int nant, antsize, anterr;
+  struct Disscount diss;
+};
+
+struct Antslab *Antslab = NULL;
+int Nantslab = 0, Antslabsize = 0;
+int Slabxsize = 0;
+int *Slabofx = NULL;
+int *Slabbstart = NULL, *Slabbend = NULL;
+
+/***
+ *	Number of threads requested with --threads (0 = serial
+ *	diffusion and dissolution), whether random-location growth
+ *	and new ants are currently being queued, and the slab a
+ *	thread is working on
+ ***/
+int Antthreads = 0;
+int Deferrand = 0;
+int Curslab = 0;
+
+/***
+ *	Whether moveone takes its directions from a Movebuf (set
+ *	with --fast-moves) instead of one ran1 call each, the buffer
+ *	of the main program, and the buffer a thread is drawing from
+ *	(that of its slab during a sweep)
+ ***/
+int Fastmoves = 0;
+struct Movebuf Mainmoves;
+struct Movebuf *Curmoves = &Mainmoves;
+
+/***
+ *	Adaptive scheduling of quiet cycles (set with --adaptive)
+ *
+ *		Adaptive:     nonzero if a quiet cycle may skip the census
+ *		Adaptskip:    censuses skipped in a row
+ *		Adaptskipped: censuses skipped in the whole run
+ *
+ *	A cycle is quiet if fewer than one pixel in ADAPTQUIET was
+ *	dissolved, reacted as a diffusing species or nucleated, and
+ *	at most ADAPTMAXSKIP censuses are skipped in a row.
+ ***/
+#define ADAPTQUIET 10000
+#define ADAPTMAXSKIP 10
+int Adaptive = 0;
+int Adaptskip = 0, Adaptskipped = 0;
+
+/***
+ *	Adaptive number of diffusion steps (set with --adaptive-steps)
+ *
+ *		Adaptsteps:   nonzero if hydrate may end its steps early
+ *		Adaptstopped: cycles whose steps were ended early
+ *
+ *	Every ADAPTWINDOW steps hydrate compares the ant population
+ *	with that of the last check, and stops once fewer than one
+ *	ant in ADAPTSTEPFRAC has reacted since.
+ ***/
+#define ADAPTWINDOW 25
+#define ADAPTSTEPFRAC 100
+int Adaptsteps = 0;
+int Adaptstopped = 0;
+
+/***
+ *	Ants walked in the order of the microstructure (set with
+ *	--sorted-ants)
+ *
+ *		Sortants:     nonzero if hydrate sorts the ants by row
+ *
+ *	Every SORTANTSTEPS diffusion steps hydrate sorts the ant pool
+ *	by the row of Mic each ant is in (see sortantcells), so that
+ *	the moves of consecutive ants touch nearby memory.
+ ***/
+#define SORTANTSTEPS 8
+int Sortants = 0;
+
+/***
+ *	Checkpoint and restart (see checkpoint.h)
+ *
+ *		Ckptfreq:     cycles between checkpoints (0 = none),
+ *		              set with --checkpoint
+ *		Ckptname:     checkpoint file written by this run
+ *		Restartname:  checkpoint to restart from, set with
+ *		              --restart (empty for a fresh run)
+ *		Ckptpid:      process still writing the last
+ *		              checkpoint (0 = none)
+ *		Ckptfilesize: length of each appended output file
+ *		              when the checkpoint was taken
+ *		Ckptthpos:    read position in the temperature
+ *		              profile when the checkpoint was taken
+ ***/
+#define CKPTNFILES 7
+int Ckptfreq = 0;
+char Ckptname[MAXSTRING], Restartname[MAXSTRING];
+long Ckptpid = 0;
+long Ckptfilesize[CKPTNFILES], Ckptthpos = -1;
+
+/***
+ *	Microstructure images waiting for the writer thread (see
+ *	snapshot.h)
+ *
+ *		vox:   copy of Mic in C order, without the halo
+ *		cap:   allocated length of vox in bytes
+ *		xsize, ysize, zsize: system size when it was copied
+ *		res:   resolution of the image
+ *		time:  time of the image, for the image index
+ *		name:  image file
+ *		analyze: nonzero if it is to be analyzed (see insitu.h)
+ *		         and not written
+ *
+ *	Snaphead is the number of images written so far and
+ *	Snaptail the number saved; image i is in Snapbuf[i %
+ *	SNAPNBUF].  Snaperr is set, with the reason in Snaperrmsg,
+ *	when an image cannot be written.
+ ***/
+#define SNAPNBUF 2      /* images in flight */
+#define SNAPNID 256     /* ids a voxel byte can hold */
+#define SNAPBLOCK 65536 /* bytes formatted per fwrite */
+struct Snapimg {
+  unsigned char *vox;
+  size_t cap;
+  int xsize, ysize, zsize;
+  float res, time;
+  char name[MAXSTRING];
+  int analyze;
+};
+
+struct Snapimg Snapbuf[SNAPNBUF];
+long Snaphead = 0, Snaptail = 0;
+int Snaperr = 0, Snapquit = 0, Snaprunning = 0;
+char Snaperrmsg[2 * MAXSTRING]; /* A message and a path */
+#if !defined(_WIN32)
+pthread_t Snapthread;
+pthread_mutex_t Snaplock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t Snapcond = PTHREAD_COND_INITIALIZER;
+#endif
+
+/***
+ *	Solid microstructure kept apart from the diffusing species
+ *	(set with --solid-layer, see solidlayer.h)
+ *
+ *		Solidlayer:  nonzero if Solidmic is kept
+ *		Solidmic:    interior of Mic in C order with every
+ *		             diffusing species shown as porosity
+ *		Solidcap:    allocated length of Solidmic in bytes
+ *		Solidid:     id kept in Solidmic for each id in Mic
+ ***/
+int Solidlayer = 0;
+unsigned char *Solidmic = NULL;
+size_t Solidcap = 0;
+unsigned char Solidid[SNAPNID];
+
+/***
+ *	Bit planes of phase classes (set with --bit-planes, see
+ *	bitplane.h)
+ *
+ *		Bitplanes:    nonzero if the planes are kept
+ *		Bitplane:     NBITPLANES planes of Bitplanelen words,
+ *		              then the pore space burn3d saw last
+ *		              (Bitporesnap, valid if Bitporevalid)
+ *		Bitplanecap:  words each plane has room for
+ *		Bitwords:     words per z row
+ *		Bitclass:     planes each id in Mic belongs to, one
+ *		              bit per plane
+ ***/
+#define BITPOROSITY 0
+#define BITCRACKP 1
+#define BITSOLID 2
+#define BITCEMENT 3
+#define NBITPLANES 4
+int Bitplanes = 0;
+uint64_t *Bitplane = NULL, *Bitporesnap = NULL;
+size_t Bitplanelen = 0, Bitplanecap = 0;
+int Bitwords = 0, Bitporevalid = 0;
+unsigned char Bitclass[SNAPNID];
+
+/***
+ *	Every change of one pixel of Mic goes through MICSET, which
+ *	also updates Solidmic and the bit planes when they are kept
+ ***/
+#define MICSET(x, y, z, v)                                                     \
+  do {                                                                         \
+    Mic[x][y][z] = (v);                                                        \
+    if (Solidmic)                                                              \
+      Solidmic[((size_t)(x) * Ysyssize + (y)) * Zsyssize + (z)] =              \
+          Solidid[(unsigned char)Mic[x][y][z]];                                \
+    if (Bitplane)                                                              \
+      bitplaneset((x), (y), (z));                                              \
+  } while (0)
+
+/***
+ *	Per-cycle timing and event counts (see perfstats.h)
+ *
+ *		Perfon:     nonzero if timings are being taken,
+ *		            set with --perf
+ *		Perfname:   table of per-cycle timings and counts
+ *		Perftime:   seconds spent in each part of the cycle
+ *		Perfmove:   seconds spent moving each diffusing
+ *		            species (bucketed serial diffusion only)
+ *		Perftotal:  Perftime summed over the whole run
+ *		Perfcount:  ant steps taken, ants that reacted and
+ *		            diffusion steps taken
+ *		Nnucleate:  diffusing species that nucleated a new
+ *		            solid in the move routines
+ *		Nrejected:  random locations tried and rejected when
+ *		            placing growth away from a diffusing species
+ *		Tracename:  timeline of the run (trace.c), set with
+ *		            --trace (empty for none)
+ *		Tracecounters: nonzero to read the hardware counters
+ *		            into the timeline, set with --counters
+ *		Perfmark:   start of the span of each part in the timeline
+ ***/
+#define PERFDISSOLVE 0
+#define PERFHYDRATE 1
+#define PERFPHPRED 2
+#define PERFBURN3D 3
+#define PERFBURNSET 4
+#define PERFPARTHYD 5
+#define PERFCALCT 6
+#define PERFMEASURESURF 7
+#define PERFCENSUS 8
+#define PERFIMAGE 9
+#define PERFCYCLE 10
+#define PERFNTIMERS 11
+
+#define PERFANTSTEPS 0
+#define PERFANTSGONE 1
+#define PERFDIFFSTEPS 2
+#define PERFNCOUNTS 3
+
+int Perfon = 0;
+char Perfname[MAXSTRING];
+FILE *Perffile = NULL;
+double Perfstart[PERFNTIMERS], Perftime[PERFNTIMERS];
+double Perftotal[PERFNTIMERS], Perfmove[NANTSPECIES];
+long Perfcount[PERFNCOUNTS];
+int Nnucleate = 0, Nrejected = 0;
+char Tracename[MAXSTRING];
+int Tracecounters = 0;
+Tracemark Perfmark[PERFNTIMERS];
+const char *Perfpart[PERFNTIMERS] = {
+    "Dissolve", "Hydrate",     "pHpred", "Burn3d", "Burnset", "Parthyd",
+    "CalcT",    "Measuresurf", "Census", "Images", "Cycle"};
+
+/***
+ *	Streaming progress (see progstream.h)
+ *
+ *		Streamdest: where the records go, set with --stream
+ *		            (empty for none)
+ *		Streamfile: open stream, or NULL
+ ***/
+char Streamdest[MAXSTRING];
+FILE *Streamfile = NULL;
+
+/***
+ *	Live view of the microstructure for the UI (see liveview.h)
+ *
+ *		Livename: shared memory segment, set with --live
+ *		          (empty for none)
+ *		Liveevery: cycles between updates, set with --live-every
+ ***/
+char Livename[MAXSTRING];
+int Liveevery = 10;
+
+/***
+ *	Images and status on request (see ondemand.h)
+ *
+ *		Demandname: control file asking for them, set with
+ *		            --demand (empty for none)
+ ***/
+char Demandname[MAXSTRING];
+
+/***
+ *	Analyses of the microstructure at chosen ages (see insitu.h)
+ *
+ *		Insitu:       analyses asked for with --analyze (INSITU
+ *		              bits, 0 for none)
+ *		Insituback:   set by --analyze-background to leave them
+ *		              to the writer thread
+ *		Insitutime:   ages asked for with --analyze-at (h),
+ *		              ascending
+ *		Ninsitu:      number of ages
+ *		Insitunext:   first age not analyzed yet
+ *		Insituname:   table the results are added to
+ ***/
+#define MAXINSITU 100
+#define INSITUCENSUS 1
+#define INSITUPORES 2
+#define INSITUPERC 4
+int Insitu = 0, Insituback = 0;
+float Insitutime[MAXINSITU];
+int Ninsitu = 0, Insitunext = 0;
+char Insituname[MAXSTRING];
+
+/***
+ *	Images handed off by genmic in memory (see handoff.c)
+ *
+ *		Handoffname: name of the handoff, set with --handoff
+ *		             (empty to read the image files)
+ *		Handoffout:  handoff the final microstructure is also
+ *		             left in for an attack model, set with
+ *		             --handoff-out (empty for none)
+ ***/
+char Handoffname[MAXSTRING], Handoffout[MAXSTRING];
+
+#ifdef _OPENMP
+#pragma omp threadprivate(Seed, Count, Ngoing, Ncshplateinit, Ncshplategrow)
+#pragma omp threadprivate(Nsilica_rx, Nucsulf2gyps, Nasr, Curslab, Curmoves)
+#pragma omp threadprivate(Nnucleate, Nrejected)
+#pragma omp threadprivate(Discount, Nmade, Nslagr, Slagemptyp)
+#endif
 struct Alksulf *Headnas, *Tailnas;
 struct Alksulf *Headks, *Tailks;
 
+/***
+ *	Nodes of the two alkali sulfate lists, each list from its own
+ *	pool so that it can be emptied at once when dissolve builds it
+ *	anew (see alkreset)
+ ***/
+#define ALKPOOLCHUNK 4096
+Nodepool Kspool, Naspool;
+
 /* Boolean variables to keep track of whether slag and fly ash
    are present in the microstructure */
 
@@ -595,9 +1246,139 @@ char Filesep;
 FILE *Imageindexfile, *Datafile, *Movfile, *Micfile, *Parfile;
 FILE *Logfile;
 
+/* Hydration movie, kept open from the first frame (see binmov.c) */
+Movie Movstream;
+unsigned char *Movframe = NULL;
+
+/***
+ *	Series of microstructure images, kept as keyframes and
+ *	changed voxels in one file in place of one ASCII image per
+ *	entry of the image index (see binmov.c and snapshot.h)
+ *
+ *		Seriesname:   series file, set with --series
+ *		              (empty to write ASCII images)
+ *		Snapseries:   the series, opened by the first image
+ *		              written to it
+ ***/
+char Seriesname[MAXSTRING];
+Series Snapseries;
+
+/***
+ *	With --vtk, each microstructure image saved is also written as
+ *	a VTK image file (see vtkimg.c) for ParaView, named as the
+ *	image with .vti in place of .img
+ ***/
+int Vtkout = 0;
+
 /* Special directories */
 char Micdir[MAXSTRING], Outputdir[MAXSTRING];
 
 /* Progress file for taskbar functionality */
 char Progfilename[MAXSTRING];
 FILE *Fprog;
+
+/***
+ *	Ensemble of runs from one loaded microstructure (see
+ *	ensemble.h)
+ *
+ *		Ensnum:    number of members, set with --ensemble (0
+ *		           for a single run)
+ *		Ensmember: member run by this process (-1 in the
+ *		           parent, or in a single run)
+ *		Ensseed:   random number seed of each member
+ *		Ensstatus: exit status of each member
+ *
+ *	Membership is decided in hydinit, which returns ENSDONE
+ *	to the parent.
+ ***/
+#define ENSDONE 2 /* hydinit in the parent, once every member has ended */
+
+int Ensnum = 0, Ensmember = -1;
+int *Ensseed = NULL, *Ensstatus = NULL;
+
+/***
+ *	Ranks of an MPI run (VCCTL_MPI builds), in which each
+ *	rank runs one member of the ensemble (see ensemble.h)
+ *
+ *		Mpirank:   rank of this process (0 without MPI)
+ *		Mpisize:   number of ranks (1 without MPI)
+ ***/
+int Mpirank = 0, Mpisize = 1;
+
+/***
+ *	Bundle of the small text inputs, read in one go at startup
+ *	(see parambundle.h)
+ *
+ *		Bundlename:  bundle file, set with --bundle (empty for
+ *		             none)
+ *		Bundlebuf:   contents of the bundle as it was read
+ *		Bundledir:   where each input is in Bundlebuf
+ *		Bundleused:  inputs opened in this run, which go into
+ *		             the next bundle
+ *		Bundledirty: nonzero if an input had to be read from
+ *		             its own file, so the bundle must be
+ *		             written again
+ ***/
+#define BUNDLEMAX 16
+
+struct Bundleentry {
+  char *name;
+  char *data;
+  long long size;
+  long long mtime;
+};
+
+char Bundlename[MAXSTRING];
+char *Bundlebuf = NULL;
+struct Bundleentry Bundledir[BUNDLEMAX];
+int Bundlenum = 0, Bundlenused = 0, Bundledirty = 0;
+char Bundleused[BUNDLEMAX][MAXSTRING];
+
+/***
+ *	Coarse grid for late ages (see coarsen.h)
+ *
+ *		Coarsentime:   time (h) at which the system is coarsened,
+ *		               set with --coarsen-time (negative for
+ *		               never)
+ *		Coarsenalpha:  degree of hydration at which the system
+ *		               is coarsened, set with --coarsen-alpha
+ *		               (negative for never)
+ *		Coarsenrefine: nonzero to write images at the original
+ *		               resolution, set with --coarsen-refine
+ *		Coarsefact:    original pixels along the edge of a pixel
+ *		               now (1, or 2 once coarsened)
+ *		Coarsecyc:     cycle at which the system was coarsened
+ ***/
+float Coarsentime = -1.0, Coarsenalpha = -1.0;
+int Coarsenrefine = 0, Coarsefact = 1, Coarsecyc = 0;
+
+/***
+ *	Running the model inside another program (see hydapi.h and
+ *	hydlib.h), when built as the vcctlhyd library
+ *
+ *		Hydstage:  where the run is (HYDNONE ... HYDCLOSED)
+ *		Hydjmp:    where an error exit returns to while an
+ *		           entry point of the library is running
+ *		Hydjmpon:  nonzero while Hydjmp is set
+ *		Hydstatus: status the error exit was called with
+ *
+ *	exit is replaced by hydexit so that an error returns to
+ *	the calling program instead of ending it.
+ ***/
+#define HYDNONE 0
+#define HYDOPEN 1
+#define HYDFINISHED 2
+#define HYDFAILED 3
+#define HYDCLOSED 4
+
+#ifdef VCCTL_HYDLIB
+#include <setjmp.h>
+
+int Hydstage = HYDNONE;
+jmp_buf Hydjmp;
+int Hydjmpon = 0;
+int Hydstatus = 0;
+
+void hydexit(int status);
+#define exit(status) hydexit(status)
+#endif
@@ -3,6 +3,12 @@
  * Program distfapart to distribute fly ash phases
  * randomly amongst monophase particles (May 1997)
  *
+ * The image and its particle id image are streamed
+ * together one x plane at a time, in ASCII or binary,
+ * and each particle gets its phase the first time
+ * one of its pixels is read, so one pass does the
+ * assigning and the writing.
+ *
  * Programmer:	Dale P. Bentz
  * 				Building and Fire Research Laboratory
  *				NIST
@@ -21,12 +27,20 @@
  *
  *******************************************************/
 #include "include/vcctl.h"
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define NPARTC 12000
 
+/***
+ *	Fly ash phases in the order of the cumulative
+ *	probabilities; the last one takes what is left
+ ***/
+#define NFASLOTS 7
+#define INERTSLOT 6
+
 /***
  *	Global variables
  ***/
@@ -37,46 +51,47 @@ float Res = DEFAULTRESOLUTION;
 /* VCCTL software version used to create input file */
 float Version;
 
-int main(void) {
-  int *phase, *partid;
-  int jx, jy, jz;
-  int ix, iy, iz, valin, ovalin, valout, partin;
-  int nseed, count, c1, phnew, mult;
-  int totcnt, ascnt, cacl2cnt, amsilcnt, inertcnt;
-  int anhcnt, cas2cnt, c3acnt;
-  int markc3a, markas, markcacl2, markamsil, markinert, markanh, markcas2;
+/***
+ *	Format of the output image: IMG_ASCII (the default), or
+ *	binary with --binary-images (IMG_UINT8) or --zlib-images
+ *	(IMG_UINT8Z).  With --fast-rng the deviates are drawn from
+ *	the explicit-state generator in rng.c, seeded with ran1,
+ *	instead of from ran1; the phases then have the same
+ *	probabilities but are not the same as without it.
+ ***/
+int Binout = IMG_ASCII;
+int Fastrng = 0;
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
+
+int main(int argc, char *argv[]) {
+  int *ids, *pids;
+  int jx, jy, jz, ix, k, m, valin, partin, slot, open;
+  int nseed, totcnt, status, format, pformat;
+  int cnt[NFASLOTS], mark[NFASLOTS];
+  size_t n, nplane, npart, newnpart;
   float probasg, probcacl2, probsio2;
-  float probc3a, prph, probcas2, probanh;
+  float probc3a, prph, probcas2, probanh, cum[NFASLOTS - 1];
   float jver, jres;
+  uint64_t seed;
+  unsigned char *plane, *partslot, *newslot;
   char filein[MAXSTRING], fileout[MAXSTRING], filepart[MAXSTRING];
   char instring[MAXSTRING];
   FILE *infile, *partfile, *outfile;
+  Idreader rd, prd;
+  Rngstate st;
+  const int phout[NFASLOTS] = {ASG,  CACL2, AMSIL, ANHYDRITE,
+                               CAS2, C3A,   INERT};
 
-  phase = NULL;
-  partid = NULL;
-  mult = 1;
-
-  /***
-   *	Initial allocation of memory for phase
-   *	and partid arrays
-   ***/
-
-  phase = (int *)calloc((size_t)NPARTC, sizeof(int));
-  if (!phase) {
-    bailout("distfapart", "Could not allocate memory for phase");
+  if (checkargs(argc, argv)) {
+    printHelp();
     exit(1);
   }
 
-  partid = (int *)calloc((size_t)NPARTC, sizeof(int));
-  if (!partid) {
-    free(phase);
-    bailout("distfapart", "Could not allocate memory for partid");
-    exit(1);
-  }
-
-  ascnt = cacl2cnt = amsilcnt = inertcnt = 0;
-  cas2cnt = anhcnt = c3acnt = 0;
-
   printf("Enter random number seed value (<0)\n");
   read_string(instring, sizeof(instring));
   nseed = atoi(instring);
@@ -126,212 +141,93 @@ int main(void) {
   probanh = atof(instring);
   printf("%f\n", probanh);
 
-  /* Determine goal counts for each phase */
+  /* Determine goal counts for each phase, in the order of phout */
 
-  markas = probasg * (float)totcnt;
-  markamsil = probsio2 * (float)totcnt;
-  markcacl2 = probcacl2 * (float)totcnt;
-  markanh = probanh * (float)totcnt;
-  markcas2 = probcas2 * (float)totcnt;
-  markc3a = probc3a * (float)totcnt;
-  markinert =
+  mark[0] = probasg * (float)totcnt;
+  mark[1] = probcacl2 * (float)totcnt;
+  mark[2] = probsio2 * (float)totcnt;
+  mark[3] = probanh * (float)totcnt;
+  mark[4] = probcas2 * (float)totcnt;
+  mark[5] = probc3a * (float)totcnt;
+  mark[INERTSLOT] =
       (1.0 - probasg - probsio2 - probcacl2 - probanh - probcas2 - probc3a) *
       (float)totcnt;
 
   /***
    *	Convert probabilities to cumulative
    *
-   *	Order must be the same as in for loop below
+   *	Order must be the same as in phout above
    ***/
 
-  probcacl2 += probasg;
-  probsio2 += probcacl2;
-  probanh += probsio2;
-  probcas2 += probanh;
-  probc3a += probcas2;
+  cum[0] = probasg;
+  cum[1] = cum[0] + probcacl2;
+  cum[2] = cum[1] + probsio2;
+  cum[3] = cum[2] + probanh;
+  cum[4] = cum[3] + probcas2;
+  cum[5] = cum[4] + probc3a;
 
   infile = filehandler("distfapart", filein, "READ");
   if (!infile) {
-    free(phase);
-    free(partid);
     exit(1);
   }
 
   partfile = filehandler("distfapart", filepart, "READ");
   if (!partfile) {
     fclose(infile);
-    free(phase);
-    free(partid);
     exit(1);
   }
 
-  for (ix = 0; ix < NPARTC; ix++) {
-    phase[ix] = partid[ix] = 0;
-  }
-
-  count = 0;
-
   /***
    *	Determine whether system size and resolution
    *	are specified in the image file
    ***/
 
-  if (read_imgheader(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize, &Res)) {
+  if (read_imgheader_fmt(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize,
+                         &Res, &format) ||
+      read_imgheader_fmt(partfile, &jver, &jx, &jy, &jz, &jres, &pformat)) {
     fclose(infile);
     fclose(partfile);
-    free(phase);
-    free(partid);
     bailout("distfapart", "Error reading image header");
     exit(1);
   }
-
-  if (read_imgheader(partfile, &jver, &jx, &jy, &jz, &jres)) {
+  if (jx != Xsyssize || jy != Ysyssize || jz != Zsyssize) {
     fclose(infile);
     fclose(partfile);
-    free(phase);
-    free(partid);
-    bailout("distfapart", "Error reading image header");
+    bailout("distfapart", "Image and particle id image differ in size");
     exit(1);
   }
 
-  /* First scan-- find each particle and assign phases */
-
-  for (iz = 0; iz < Zsyssize; iz++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      for (ix = 0; ix < Xsyssize; ix++) {
-
-        fscanf(partfile, "%s", instring);
-        partin = atoi(instring);
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-
-        valin = convert_id(ovalin, Version);
-
-        if ((valin == FLYASH) && (partid[partin] == 0)) {
-
-          count++;
-
-          if (count >= mult * NPARTC) {
-            mult++;
-            partid = (int *)realloc((int *)partid, (size_t)(mult * NPARTC));
-            if (!partid) {
-              free(phase);
-              fclose(partfile);
-              fclose(infile);
-              bailout("distfapart", "Could not reallocate partid");
-              exit(1);
-            }
-
-            phase = (int *)realloc((int *)phase, (size_t)(mult * NPARTC));
-            if (!phase) {
-              free(partid);
-              fclose(partfile);
-              fclose(infile);
-              bailout("distfapart", "Could not reallocate partid");
-              exit(1);
-            }
-          }
-
-          partid[partin] = count;
-
-          valout = INERT;
-          do {
-            prph = ran1(Seed);
-
-            if ((prph < probasg) && (ascnt < markas)) {
-
-              valout = ASG;
-
-            } else if ((prph < probcacl2) && (cacl2cnt < markcacl2)) {
-
-              valout = CACL2;
-
-            } else if ((prph < probsio2) && (amsilcnt < markamsil)) {
-
-              valout = AMSIL;
-
-            } else if ((prph < probanh) && (anhcnt < markanh)) {
-
-              valout = ANHYDRITE;
-
-            } else if ((prph < probcas2) && (cas2cnt < markcas2)) {
-
-              valout = CAS2;
-
-            } else if ((prph < probc3a) && (c3acnt < markc3a)) {
-
-              valout = C3A;
-            }
-          } while ((valout == INERT) && (inertcnt > markinert));
-
-          phase[count] = valout;
-        }
-
-        if (valin == FLYASH) {
-
-          c1 = partid[partin];
-          phnew = phase[c1];
-
-          switch (phnew) {
-          case ASG:
-            ascnt++;
-            break;
-          case CACL2:
-            cacl2cnt++;
-            break;
-          case AMSIL:
-            amsilcnt++;
-            break;
-          case ANHYDRITE:
-            anhcnt++;
-            break;
-          case CAS2:
-            cas2cnt++;
-            break;
-          case C3A:
-            c3acnt++;
-            break;
-          case INERT:
-            inertcnt++;
-            break;
-          default:
-            break;
-          }
-        }
-
-      } /* End of iz loop */
-    }   /* End of iy loop */
-  }     /* End of ix loop */
-
-  rewind(infile);
-  rewind(partfile);
+  /***
+   *	partslot[id] is one more than the slot of phout given
+   *	to particle id, or 0 until it has one.  Particle ids
+   *	are numbered from 1, so it is indexed by id directly
+   *	and grows when a bigger id turns up.
+   ***/
 
-  if (read_imgheader(infile, &jver, &jx, &jy, &jz, &jres)) {
+  npart = NPARTC;
+  partslot = (unsigned char *)calloc(npart, 1);
+  nplane = (size_t)Ysyssize * Zsyssize;
+  ids = (int *)malloc(nplane * sizeof(int));
+  pids = (int *)malloc(nplane * sizeof(int));
+  plane = (unsigned char *)malloc(nplane);
+  if (!partslot || !ids || !pids || !plane ||
+      idreader_open(&rd, infile, format, nplane) ||
+      idreader_open(&prd, partfile, pformat, nplane)) {
     fclose(infile);
     fclose(partfile);
-    free(phase);
-    free(partid);
-    bailout("distfapart", "Error reading image header");
+    bailout("distfapart", "Could not allocate memory for image planes");
     exit(1);
   }
 
-  if (read_imgheader(partfile, &jver, &jx, &jy, &jz, &jres)) {
-    fclose(infile);
-    fclose(partfile);
-    free(phase);
-    free(partid);
-    bailout("distfapart", "Error reading image header");
-    exit(1);
+  if (Binout == IMG_ASCII) {
+    outfile = filehandler("distfapart", fileout, "WRITE");
+  } else {
+    outfile = fopen(fileout, "wb");
   }
-
-  /* Now distribute phases in second scan */
-
-  outfile = filehandler("distfapart", fileout, "WRITE");
   if (!outfile) {
-    free(phase);
-    free(partid);
     fclose(infile);
     fclose(partfile);
+    bailout("distfapart", "Could not open output file");
     exit(1);
   }
 
@@ -340,9 +236,13 @@ int main(void) {
    *	microstructure
    ***/
 
-  if (write_imgheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res)) {
-    free(phase);
-    free(partid);
+  if (Binout == IMG_ASCII) {
+    status = write_imgheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res);
+  } else {
+    status =
+        write_binheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res, Binout);
+  }
+  if (status) {
     fclose(outfile);
     fclose(infile);
     fclose(partfile);
@@ -350,32 +250,174 @@ int main(void) {
     exit(1);
   }
 
-  for (iz = 0; iz < Zsyssize; iz++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      for (ix = 0; ix < Xsyssize; ix++) {
+  if (Fastrng) {
+    seed = (uint64_t)(ran1(Seed) * 4294967296.0);
+    seed = (seed << 32) ^ (uint64_t)(ran1(Seed) * 4294967296.0);
+    rng_seed(&st, seed);
+  }
+
+  memset(cnt, 0, sizeof(cnt));
+
+  /***
+   *	One pass: each particle gets its phase when its first
+   *	pixel is read, with the counts of the pixels read so
+   *	far, and each pixel is written as it is read
+   ***/
+
+  for (ix = 0; ix < Xsyssize && !status; ix++) {
+    if (idreader_plane(&rd, ids) || idreader_plane(&prd, pids)) {
+      status = 1;
+      break;
+    }
+
+    for (n = 0; n < nplane; n++) {
+      valin = convert_id(ids[n], Version);
+      if (valin < 0 || valin >= (NPHASES)) {
+        status = 1;
+        break;
+      }
+      plane[n] = (unsigned char)valin;
+      if (valin != FLYASH)
+        continue;
+
+      partin = pids[n];
+      if (partin < 0) {
+        status = 1;
+        break;
+      }
+      if ((size_t)partin >= npart) {
+        for (newnpart = 2 * npart; newnpart <= (size_t)partin; newnpart *= 2)
+          ;
+        newslot = (unsigned char *)realloc(partslot, newnpart);
+        if (!newslot) {
+          status = 1;
+          break;
+        }
+        memset(newslot + npart, 0, newnpart - npart);
+        partslot = newslot;
+        npart = newnpart;
+      }
+
+      if (partslot[partin] == 0) {
 
-        fscanf(partfile, "%s", instring);
-        partin = atoi(instring);
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valin = convert_id(ovalin, Version);
-        valout = valin;
+        /***
+         *	Take the first phase whose cumulative probability
+         *	is above the deviate and that has not reached its
+         *	goal count, or else inert.  Inert is only refused
+         *	while it is over its goal and some other phase can
+         *	still take the particle.
+         ***/
 
-        if (valin == FLYASH) {
-          count = partid[partin];
-          valout = phase[count];
+        open = 0;
+        for (k = 0; k < INERTSLOT; k++) {
+          if (cnt[k] < mark[k] && cum[k] > 0.0)
+            open = 1;
         }
 
-        fprintf(outfile, "%d\n", valout);
+        do {
+          prph = Fastrng ? (float)rng_uniform(&st) : (float)ran1(Seed);
+          slot = INERTSLOT;
+          for (k = 0; k < INERTSLOT; k++) {
+            if (prph < cum[k] && cnt[k] < mark[k]) {
+              slot = k;
+              break;
+            }
+          }
+        } while (slot == INERTSLOT && cnt[INERTSLOT] > mark[INERTSLOT] &&
+                 open);
+
+        partslot[partin] = (unsigned char)(slot + 1);
       }
+
+      m = partslot[partin] - 1;
+      cnt[m]++;
+      plane[n] = (unsigned char)phout[m];
     }
+    if (status)
+      break;
+
+    status = write_idplane(outfile, plane, nplane, Binout);
   }
 
+  idreader_close(&rd);
+  idreader_close(&prd);
   fclose(infile);
   fclose(partfile);
-  fclose(outfile);
+  if (fclose(outfile))
+    status = 1;
+
+  free(partslot);
+  free(ids);
+  free(pids);
+  free(plane);
+
+  if (status) {
+    bailout("distfapart", "Error distributing fly ash phases");
+    return (1);
+  }
 
-  free(partid);
-  free(phase);
   return (0);
 }
+
+/***
+ *	checkargs
+ *
+ *	Checks the command line arguments
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {
+      {"binary-images", no_argument, &Binout, IMG_UINT8},
+      {"zlib-images", no_argument, &Binout, IMG_UINT8Z},
+      {"fast-rng", no_argument, &Fastrng, 1},
+      {"help", no_argument, 0, 'h'},
+      {NULL, 0, 0, 0}};
+
+  while ((opt_char = getopt_long(argc, argv, "h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* a flag was set */
+    case 0:
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  return ((optind == argc) ? 0 : 1);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: distfapart [--binary-images | --zlib-images] "
+                  "[--fast-rng]\n\n");
+  fprintf(stderr, "Reads its answers from stdin.  The input and particle "
+                  "id images may be\n");
+  fprintf(stderr, "ASCII or binary.\n\n");
+  fprintf(stderr, "  --binary-images  write a binary (uint8) image\n");
+  fprintf(stderr, "  --zlib-images    write a compressed binary "
+                  "(uint8-zlib) image\n");
+  fprintf(stderr, "  --fast-rng       draw the deviates from the "
+                  "explicit-state generator\n");
+  fprintf(stderr, "                   (not the same phases as without "
+                  "it)\n\n");
+
+  return;
+}
@@ -4,6 +4,12 @@
  * randomly on a pixel basis amongst fly ash particles
  * (May 1997)
  *
+ * The image is streamed one x plane at a time, in
+ * ASCII or binary, so it is never held in memory,
+ * and each fly ash pixel takes its phase from one
+ * uniform deviate and the table of cumulative
+ * probabilities.
+ *
  * Programmer:	Dale P. Bentz
  * 				Building and Fire Research Laboratory
  *				NIST
@@ -22,11 +28,10 @@
  *
  *******************************************************/
 #include "include/vcctl.h"
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#define NPARTC 12000
-
 /***
  *	Global variables
  ***/
@@ -37,13 +42,44 @@ float Res = DEFAULTRESOLUTION;
 /* VCCTL software version used to create input file */
 float Version;
 
-int main(void) {
-  int ix, iy, iz, valin, ovalin, valout, nseed;
+/***
+ *	Format of the output image: IMG_ASCII (the default), or
+ *	binary with --binary-images (IMG_UINT8) or --zlib-images
+ *	(IMG_UINT8Z).  With --fast-rng the deviates of each x plane
+ *	are drawn all at once from the explicit-state generator in
+ *	rng.c, seeded with ran1, instead of one ran1 call per pixel;
+ *	the phases then have the same probabilities but are not the
+ *	same as without it.
+ ***/
+int Binout = IMG_ASCII;
+int Fastrng = 0;
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
+
+int main(int argc, char *argv[]) {
+  int m, k, ix, nseed, format, nfa, status;
+  int *ids;
   float probasg, probcacl2, probsio2;
-  float probc3a, prph, probcas2, probanh;
+  float probc3a, probcas2, probanh, u, cum[6];
+  size_t n, nplane;
+  double *dev;
+  uint64_t seed;
+  unsigned char *plane;
   char filein[MAXSTRING], fileout[MAXSTRING];
   char instring[MAXSTRING];
   FILE *infile, *outfile;
+  Idreader rd;
+  Rngstate st;
+  const int phout[7] = {ASG, CACL2, AMSIL, ANHYDRITE, CAS2, C3A, INERT};
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    exit(1);
+  }
 
   printf("Enter random number seed value (<0)\n");
   read_string(instring, sizeof(instring));
@@ -90,7 +126,7 @@ int main(void) {
   /***
    *	Convert probabilities to cumulative
    *
-   *	Order must be the same as in for loop below
+   *	Order must be the same as in phout above
    ***/
 
   probcacl2 += probasg;
@@ -99,14 +135,27 @@ int main(void) {
   probcas2 += probanh;
   probc3a += probcas2;
 
-  infile = filehandler("distfarand", filein, "READ");
-  if (!infile) {
-    exit(1);
+  /***
+   *	A pixel's phase is found by counting the cumulative
+   *	probabilities its deviate reaches.  That is the same
+   *	as taking the first one above the deviate only when
+   *	the table does not decrease, so carry the largest
+   *	value forward.
+   ***/
+
+  cum[0] = probasg;
+  cum[1] = probcacl2;
+  cum[2] = probsio2;
+  cum[3] = probanh;
+  cum[4] = probcas2;
+  cum[5] = probc3a;
+  for (m = 1; m < 6; m++) {
+    if (cum[m] < cum[m - 1])
+      cum[m] = cum[m - 1];
   }
 
-  outfile = filehandler("distfarand", fileout, "WRITE");
-  if (!outfile) {
-    fclose(infile);
+  infile = filehandler("distfarand", filein, "READ");
+  if (!infile) {
     exit(1);
   }
 
@@ -115,74 +164,175 @@ int main(void) {
    *	are specified in the image file
    ***/
 
-  if (read_imgheader(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize, &Res)) {
+  if (read_imgheader_fmt(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize,
+                         &Res, &format)) {
     fclose(infile);
-    fclose(outfile);
     bailout("distfarand", "Error reading image header");
     exit(1);
   }
 
+  nplane = (size_t)Ysyssize * Zsyssize;
+  ids = (int *)malloc(nplane * sizeof(int));
+  plane = (unsigned char *)malloc(nplane);
+  dev = Fastrng ? (double *)malloc(nplane * sizeof(double)) : NULL;
+  if (!ids || !plane || (Fastrng && !dev) ||
+      idreader_open(&rd, infile, format, nplane)) {
+    fclose(infile);
+    bailout("distfarand", "Could not allocate memory for image plane");
+    exit(1);
+  }
+
+  if (Binout == IMG_ASCII) {
+    outfile = filehandler("distfarand", fileout, "WRITE");
+  } else {
+    outfile = fopen(fileout, "wb");
+  }
+  if (!outfile) {
+    fclose(infile);
+    bailout("distfarand", "Could not open output file");
+    exit(1);
+  }
+
   /***
    *	Print header information about software version,
    *	system size, and resolution to the output file
    ***/
 
-  if (write_imgheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res)) {
+  if (Binout == IMG_ASCII) {
+    status = write_imgheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res);
+  } else {
+    status =
+        write_binheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res, Binout);
+  }
+  if (status) {
     fclose(infile);
     fclose(outfile);
-    bailout("distfarand", "Error reading image header");
+    bailout("distfarand", "Error writing image header");
     exit(1);
   }
 
-  /* First scan-- find each particle and assign phases */
-
-  for (iz = 0; iz < Zsyssize; iz++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      for (ix = 0; ix < Xsyssize; ix++) {
-
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valin = convert_id(ovalin, Version);
-
-        valout = valin;
-
-        if (valin == FLYASH) {
-
-          valout = INERT;
-          prph = ran1(Seed);
-          if (prph < probasg) {
-
-            valout = ASG;
-
-          } else if (prph < probcacl2) {
-
-            valout = CACL2;
-
-          } else if (prph < probsio2) {
-
-            valout = AMSIL;
-
-          } else if (prph < probanh) {
+  if (Fastrng) {
+    seed = (uint64_t)(ran1(Seed) * 4294967296.0);
+    seed = (seed << 32) ^ (uint64_t)(ran1(Seed) * 4294967296.0);
+    rng_seed(&st, seed);
+  }
 
-            valout = ANHYDRITE;
+  /***
+   *	One pass, one x plane at a time: assign a phase to
+   *	each fly ash pixel and write the plane out
+   ***/
 
-          } else if (prph < probcas2) {
+  for (ix = 0; ix < Xsyssize && !status; ix++) {
+    if (idreader_plane(&rd, ids)) {
+      status = 1;
+      break;
+    }
+
+    nfa = 0;
+    for (n = 0; n < nplane; n++) {
+      m = convert_id(ids[n], Version);
+      if (m < 0 || m >= (NPHASES)) {
+        status = 1;
+        break;
+      }
+      plane[n] = (unsigned char)m;
+      nfa += (m == FLYASH);
+    }
+    if (status)
+      break;
+
+    if (Fastrng && nfa > 0)
+      rng_fill(&st, dev, (size_t)nfa);
+
+    k = 0;
+    for (n = 0; n < nplane && nfa > 0; n++) {
+      if (plane[n] != FLYASH)
+        continue;
+      u = Fastrng ? (float)dev[k++] : (float)ran1(Seed);
+      m = (u >= cum[0]) + (u >= cum[1]) + (u >= cum[2]) + (u >= cum[3]) +
+          (u >= cum[4]) + (u >= cum[5]);
+      plane[n] = (unsigned char)phout[m];
+    }
+
+    status = write_idplane(outfile, plane, nplane, Binout);
+  }
 
-            valout = CAS2;
+  idreader_close(&rd);
+  free(ids);
+  free(plane);
+  if (dev)
+    free(dev);
+  fclose(infile);
+  if (fclose(outfile))
+    status = 1;
 
-          } else if (prph < probc3a) {
+  if (status) {
+    bailout("distfarand", "Error converting microstructure image");
+    return (1);
+  }
 
-            valout = C3A;
-          }
-        }
+  return (0);
+}
 
-        fprintf(outfile, "%d\n", valout);
+/***
+ *	checkargs
+ *
+ *	Checks the command line arguments
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {
+      {"binary-images", no_argument, &Binout, IMG_UINT8},
+      {"zlib-images", no_argument, &Binout, IMG_UINT8Z},
+      {"fast-rng", no_argument, &Fastrng, 1},
+      {"help", no_argument, 0, 'h'},
+      {NULL, 0, 0, 0}};
+
+  while ((opt_char = getopt_long(argc, argv, "h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* a flag was set */
+    case 0:
+      break;
+    default:
+      return (1);
+    }
+  }
 
-      } /* End of iz loop */
-    }   /* End of iy loop */
-  }     /* End of ix loop */
+  return ((optind == argc) ? 0 : 1);
+}
 
-  fclose(infile);
-  fclose(outfile);
-  return (0);
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: distfarand [--binary-images | --zlib-images] "
+                  "[--fast-rng]\n\n");
+  fprintf(stderr, "Reads its answers from stdin.  The input image may be "
+                  "ASCII or binary.\n\n");
+  fprintf(stderr, "  --binary-images  write a binary (uint8) image\n");
+  fprintf(stderr, "  --zlib-images    write a compressed binary "
+                  "(uint8-zlib) image\n");
+  fprintf(stderr, "  --fast-rng       draw the deviates of each plane at "
+                  "once from the\n");
+  fprintf(stderr, "                   explicit-state generator (not the "
+                  "same phases as\n");
+  fprintf(stderr, "                   without it)\n\n");
+
+  return;
 }
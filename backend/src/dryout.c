@@ -26,25 +26,12 @@ float Version;
 int Cubesize = 7;
 int Cubemin = 3;
 
-/***
- *	Data structure for elements to remove to simulate
- *	self-dessication.  The list is once again a doubly linked
- *	list to be dynamically allocated and managed
- ***/
-typedef struct _Togo {
-  int x, y, z, npore;
-  struct _Togo *nexttogo;
-  struct _Togo *prevtogo;
-} Togo;
-
 /***
  *	Global variables
  ***/
 int ***Mic;
 float Version;
 
-size_t Togosize;
-
 /***
  *	Saturated porosity of CSH gel
  ***/
@@ -54,11 +41,12 @@ const float Gelporefrac = 0.38;
  *	Function declarations
  ***/
 void removewater(int ndesire, int *spc, int *dpc);
-int countbox(int boxsize, int qx, int qy, int qz);
 
 int main(void) {
   register int i, j, k;
-  int ovalin, valout;
+  int valout;
+  size_t n, cap = 0;
+  unsigned char *vox = NULL;
   int cshcount, aggcount, satporecount, dryporecount, totporecount;
   int numtoremove, target_satporecount;
   float target_deg_sat, cur_deg_sat, min_deg_sat, target_satcap;
@@ -66,8 +54,6 @@ int main(void) {
   char filein[MAXSTRING], fileout[MAXSTRING], instring[MAXSTRING];
   FILE *infile, *outfile;
 
-  Togosize = sizeof(Togo);
-
   printf("Enter name of file with raw (3-D image) data \n");
   fflush(stdout);
   read_string(filein, sizeof(filein));
@@ -90,10 +76,15 @@ int main(void) {
    *	then read it.  If not, set the size to 100
    ***/
 
-  if (read_imgheader(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize, &Res)) {
-    bailout("oneimage", "Error reading image header");
+  if (load_microstructure(infile, &vox, &cap, &Version, &Xsyssize, &Ysyssize,
+                          &Zsyssize, &Res)) {
+    fclose(infile);
+    if (vox)
+      free(vox);
+    bailout("dryout", "Error reading microstructure image");
     exit(1);
   }
+  fclose(infile);
 
   printf("\nDone reading image header:");
   printf("\n\tVersion = %f", Version);
@@ -105,7 +96,7 @@ int main(void) {
 
   Mic = ibox(Xsyssize, Ysyssize, Zsyssize);
   if (!Mic) {
-    fclose(infile);
+    free(vox);
     bailout("dryout", "Could not allocate memory for Mic");
     fflush(stdout);
     exit(1);
@@ -117,12 +108,11 @@ int main(void) {
   printf("\nPreparing to scan image file... ");
   fflush(stdout);
   cshcount = satporecount = dryporecount = aggcount = 0;
+  n = 0;
   for (k = 0; k < Zsyssize; k++) {
     for (j = 0; j < Ysyssize; j++) {
       for (i = 0; i < Xsyssize; i++) {
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valout = convert_id(ovalin, Version);
+        valout = vox[n++];
         Mic[i][j][k] = valout;
         if (valout == INERTAGG)
           aggcount++;
@@ -136,7 +126,7 @@ int main(void) {
     }
   }
 
-  fclose(infile);
+  free(vox);
 
   totporecount = satporecount + dryporecount;
 
@@ -247,130 +237,80 @@ int main(void) {
  *
  *     Returns:    nothing
  *
- *    Calls:        countbox
+ *    Calls:        boxtable_alloc, boxtable_build, boxtable_count,
+ *                boxtable_free, topsites_alloc, topsites_rank,
+ *                topsites_free
  *    Called by:    main
  ***/
 void removewater(int ndesire, int *spc, int *dpc) {
-  int idesire;
-  int px, py, pz, placed, cntpore, cntmax;
-  Togo *headtogo, *tailtogo, *newtogo, *lasttogo, *onetogo;
-
-  /***
-   *    First allocate and initialize the first member
-   *    of the linked list
-   ***/
+  int i;
+  int px, py, pz, cntpore, cntmax, site;
+  Boxtable porebox;
+  Topsites togo;
 
-  headtogo = (Togo *)malloc(Togosize);
-  headtogo->x = headtogo->y = headtogo->z = (-1);
-  headtogo->npore = 0;
-  headtogo->nexttogo = NULL;
-  headtogo->prevtogo = NULL;
-  tailtogo = headtogo;
   cntmax = 0;
 
   /***
-   *    Add needed number of elements to the end of the list
-   *    Consider allocating the space in chunks of, say, 50,
-   *    instead of one at a time to speed up execution
+   *    Tabulate the pore pixels once, since none of them
+   *    change until all of the sites have been ranked
    ***/
 
-  for (idesire = 2; idesire <= ndesire; idesire++) {
-    newtogo = (Togo *)malloc(Togosize);
-    newtogo->npore = 0;
-    newtogo->x = newtogo->y = newtogo->z = (-1);
-    tailtogo->nexttogo = newtogo;
-    newtogo->prevtogo = tailtogo;
-    tailtogo = newtogo;
+  if (boxtable_alloc(&porebox, Xsyssize, Ysyssize, Zsyssize) ||
+      topsites_alloc(&togo, ndesire)) {
+    bailout("dryout", "Could not allocate memory to rank pore sites");
+    exit(1);
   }
 
-  /* Now scan the microstructure and RANK the sites */
+  for (px = 0; px < Xsyssize; px++) {
+    for (py = 0; py < Ysyssize; py++) {
+      for (pz = 0; pz < Zsyssize; pz++) {
+        if ((Mic[px][py][pz] == POROSITY) || (Mic[px][py][pz] > NSPHASES)) {
+          BOXCELL(&porebox, px, py, pz) = 1;
+        }
+      }
+    }
+  }
+  boxtable_build(&porebox);
 
-  for (pz = 0; pz < Zsyssize; pz++) {
+  /***
+   *    Now scan the microstructure and RANK the sites,
+   *    keeping the ndesire with the most pore neighbors.
+   *    The scan follows the layout of Mic in memory, and
+   *    ties are broken by the site index, in z, y, x order,
+   *    as they were when the sites were offered in that order.
+   ***/
+
+  for (px = 0; px < Xsyssize; px++) {
     for (py = 0; py < Ysyssize; py++) {
-      for (px = 0; px < Xsyssize; px++) {
+      for (pz = 0; pz < Zsyssize; pz++) {
 
         if (Mic[px][py][pz] == POROSITY) {
-          cntpore = countbox(Cubesize, px, py, pz);
+          cntpore = boxtable_count(&porebox, Cubesize, px, py, pz);
 
           if (cntpore > cntmax)
             cntmax = cntpore;
 
-          /***
-           *    Store this site value at appropriate place in
-           *    sorted linked list
-           ***/
-
-          if (cntpore > (tailtogo->npore)) {
-            placed = 0;
-            lasttogo = tailtogo;
-            while (!placed) {
-              newtogo = lasttogo->prevtogo;
-              if (!newtogo) {
-                placed = 2;
-              } else if (cntpore <= (newtogo->npore)) {
-                placed = 1;
-              }
-
-              if (!placed)
-                lasttogo = newtogo;
-            }
-
-            onetogo = (Togo *)malloc(Togosize);
-            onetogo->x = px;
-            onetogo->y = py;
-            onetogo->z = pz;
-            onetogo->npore = cntpore;
-
-            /* Insertion at the head of the list */
-
-            if (placed == 2) {
-              onetogo->prevtogo = NULL;
-              onetogo->nexttogo = headtogo;
-              headtogo->prevtogo = onetogo;
-              headtogo = onetogo;
-            }
-
-            if (placed == 1) {
-              onetogo->nexttogo = lasttogo;
-              onetogo->prevtogo = newtogo;
-              lasttogo->prevtogo = onetogo;
-              newtogo->nexttogo = onetogo;
-            }
-
-            /* Eliminate the last element */
-
-            lasttogo = tailtogo;
-            tailtogo = tailtogo->prevtogo;
-            tailtogo->nexttogo = NULL;
-            free(lasttogo);
-          }
+          site = (pz * Ysyssize + py) * Xsyssize + px;
+          topsites_rank(&togo, cntpore, site, site);
         }
 
       } /* End of loop in z */
-    }   /* End of loop in y */
-  }     /* End of loop in x */
+    } /* End of loop in y */
+  } /* End of loop in x */
 
-  /***
-   *    Now remove the sites starting at the
-   *    head of the list and free all of the
-   *    used memory
-   ***/
+  boxtable_free(&porebox);
 
-  for (idesire = 1; idesire <= ndesire; idesire++) {
-    px = headtogo->x;
-    py = headtogo->y;
-    pz = headtogo->z;
+  /* Now remove the sites that were kept */
 
-    if (px != (-1)) {
-      Mic[px][py][pz] = EMPTYP;
-      *spc -= 1;
-      *dpc += 1;
-    }
-
-    lasttogo = headtogo;
-    headtogo = headtogo->nexttogo;
-    free(lasttogo);
+  for (i = 0; i < togo.n; i++) {
+    px = togo.site[i] % Xsyssize;
+    py = (togo.site[i] / Xsyssize) % Ysyssize;
+    pz = togo.site[i] / (Xsyssize * Ysyssize);
+    Mic[px][py][pz] = EMPTYP;
+    *spc -= 1;
+    *dpc += 1;
   }
+  topsites_free(&togo);
 
   /***
    *    If only small cubes of porosity were found,
@@ -385,64 +325,3 @@ void removewater(int ndesire, int *spc, int *dpc) {
   }
   return;
 }
-
-/***
- *    countbox
- *
- *     Count the number of pore pixels within a cube of
- *     size boxsize, centered at (qx,qy,qz)
- *
- *     Arguments:    int boxsize
- *                 int x,y, and z coordinates of box center
- *
- *     Returns:    int number of pore pixels found within box
- *
- *    Calls:        no other routines
- *    Called by:    makeinert
- ***/
-int countbox(int boxsize, int qx, int qy, int qz) {
-  int nfound, ix, iy, iz, qxlo, qxhi, qylo, qyhi, qzlo, qzhi;
-  int hx, hy, hz, boxhalf;
-
-  boxhalf = boxsize / 2;
-  nfound = 0;
-  qxlo = qx - boxhalf;
-  qxhi = qx + boxhalf;
-  qylo = qy - boxhalf;
-  qyhi = qy + boxhalf;
-  qzlo = qz - boxhalf;
-  qzhi = qz + boxhalf;
-
-  /***
-   *    Count the number of requisite pixels in the
-   *    3-D cube box using periodic boundaries
-   ***/
-
-  for (ix = qxlo; ix <= qxhi; ix++) {
-    hx = ix;
-    hx += checkbc(hx, Xsyssize);
-
-    for (iy = qylo; iy <= qyhi; iy++) {
-      hy = iy;
-      hy += checkbc(hy, Ysyssize);
-
-      for (iz = qzlo; iz <= qzhi; iz++) {
-        hz = iz;
-        hz += checkbc(hz, Zsyssize);
-
-        /***
-         *    Count if porosity, diffusing species,
-         *    or empty porosity
-         ***/
-
-        if ((Mic[hx][hy][hz] == POROSITY) || (Mic[hx][hy][hz] > NSPHASES)) {
-
-          nfound++;
-        }
-
-      } /* End of loop over z */
-    }   /* End of loop over y */
-  }     /* End of loop over x */
-
-  return (nfound);
-}
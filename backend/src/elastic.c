@@ -35,7 +35,7 @@
 /* auxiliary variable used in the conjugate gradient algorithm (in dembx),  */
 /* dk(n,i,j) is the stiffness matrix of the n'th phase, cmod(n,i,j) is      */
 /* the elastic moduli tensor of the n'th phase, pix is a vector that gives  */
-/* the phase label of each pixel, ib is a matrix that gives the labels of   */
+/* the phase label of each pixel, nb is a vector that gives the labels of   */
 /* the 27 (counting itself) neighbors of a given node, prob is the volume   */
 /* fractions of the various phases,                                         */
 /* strxx, stryy, strzz, strxz, stryz, and strxy are the six Voigt           */
@@ -48,8 +48,8 @@
 /* The vectors u,gb,b, and h are dimensioned to be the system size,         */
 /* ns=nx*ny*nz, with three components, where the digital image of the       */
 /* microstructure considered is a rectangular paralleliped, nx x ny x nz    */
-/* in size.  The arrays pix and ib are are also dimensioned to the system   */
-/* size.  The array ib has 27 components, for the 27 neighbors of a node.   */
+/* in size.  The array pix is also dimensioned to the system size.  The     */
+/* neighbors of a node are found as needed (see neighbors), not stored.     */
 /* Note that the program is set up at present to have at most 50            */
 /* different phases.  This can easily be changed, simply by changing        */
 /* the dimensions of dk, prob, and cmod. The parameter nphase gives the     */
@@ -79,6 +79,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "include/mpislab.h"
 
 #ifdef _WIN32
 #define PATH_SEPARATOR "\\"
@@ -93,6 +100,18 @@
 
 #define NDIM 3     /* number of dimensions for problem - 3-D */
 #define NSP OFFSET /* maximum number of phases */
+#define NODEBLOCK 4096 /* nodes in a block of the sums with --fixed-order */
+#define MAXPATTERN 65536 /* most node stencils kept with --stencils */
+#define MEMGB 1073741824.0 /* bytes in a GB, for the memory plan */
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
+/* Preconditioners of the conjugate gradient relaxation (--precond) */
+#define NOPRECOND 0
+#define JACOBI 1
+#define BLOCKJACOBI 2
+#define FFTGREEN 3 /* Green operator of a reference medium (--fft) */
 
 /* Defines for concelas function */
 #define RKITS 799
@@ -106,22 +125,25 @@
 char Outfolder[MAXSTRING];
 char Outfilename[MAXSTRING], PCfilename[MAXSTRING], Layerfilename[MAXSTRING];
 char Filesep;
-double **u, **gb, **b, **h;
+double **u, **gb, **b, **h, **Ah;
 double ***Aa, **A, **Vv, ***A1, *K, *G, **Cc;
 double cmod[NSP][6][6], dk[NSP][8][3][8][3];
 double phasemod[NSP][2], prob[NSP], gg = 0.0, gginit = 0.0, gtest = 0.0;
 double percent_complete = 0.0;
 short int in[27], jjn[27], kn[27];
-int **ib;
+int Nboff[27];
 short int *pix, *part;
 
-double *stressxx, *stressyy, *stresszz, *stressxz, *stressyz, *stressxy;
-double *strainxx, *strainyy, *strainzz, *strainxz, *strainyz, *strainxy;
-double strxx, stryy, strzz, strxz, stryz, strxy;
+/***
+ *	Strain energy of each pixel, and the sums of the stresses and
+ *	strains over each layer of constant x, all pixels first and
+ *	then each phase (see stress)
+ ***/
+#define LAYERSUM (12 * (NSP + 1))
+double *Energy, *Layersum;
 double exx, eyy, ezz, exz, eyz, exy;
 double stressall[NSP][16];
 double C;
-double sxx, syy, szz, sxz, syz, sxy;
 
 /* Variables for ITZ calculations */
 double sxxt, syyt, szzt, sxzt, syzt, sxyt;
@@ -157,6 +179,195 @@ double Diam_concelas[MAXSIZECLASSES];
 double Vf_concelas[MAXSIZECLASSES];
 int N_concelas;
 
+/***
+ *	Threads for the products with the global matrix (--threads n),
+ *	and the blocks of nodes the dot products are added up in
+ *	(see nodeblocks)
+ ***/
+int Nthreads = 1;
+int Fixedorder = 0;
+int Nblock = 1, Blocksize;
+double *Blocksum;
+
+/***
+ *	Node stencils (--stencils).  The row of A for a node depends
+ *	only on the phases of the eight pixels around it, so each
+ *	distinct set of eight phases gets one stencil, 27 neighbors by
+ *	3 x 3 components, and Nodepat gives the stencil of each node.
+ *	Element e of a node is the pixel of its neighbor Elemnb[e],
+ *	and Stenterm lists, for each neighbor in the order of the sum
+ *	in stiffrow, the element and element node of each of its
+ *	Stennum dk terms.
+ ***/
+int Usestencil = 0;
+int Npattern = 0, Maxstencil = 0;
+int *Nodepat;
+double *Stencil;
+static const int Elemnb[8] = {26, 6, 5, 4, 24, 14, 13, 12};
+static const int Stenterm[27][8][2] = {
+    {{0, 3}, {1, 2}, {4, 7}, {5, 6}},
+    {{0, 2}, {4, 6}},
+    {{0, 1}, {3, 2}, {7, 6}, {4, 5}},
+    {{3, 1}, {7, 5}},
+    {{2, 1}, {3, 0}, {6, 5}, {7, 4}},
+    {{2, 0}, {6, 4}},
+    {{2, 3}, {1, 0}, {6, 7}, {5, 4}},
+    {{1, 3}, {5, 7}},
+    {{4, 3}, {5, 2}},
+    {{4, 2}},
+    {{7, 2}, {4, 1}},
+    {{7, 1}},
+    {{7, 0}, {6, 1}},
+    {{6, 0}},
+    {{6, 3}, {5, 0}},
+    {{5, 3}},
+    {{0, 7}, {1, 6}},
+    {{0, 6}},
+    {{0, 5}, {3, 6}},
+    {{3, 5}},
+    {{3, 4}, {2, 5}},
+    {{2, 4}},
+    {{2, 7}, {1, 4}},
+    {{1, 7}},
+    {{6, 2}, {7, 3}, {5, 1}, {4, 0}},
+    {{2, 6}, {3, 7}, {0, 4}, {1, 5}},
+    {{0, 0}, {1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}, {6, 6}, {7, 7}}};
+/***
+ *	Preconditioner (--precond jacobi or block).  Pinv holds, for
+ *	each node, the inverse of the diagonal or of the 3 x 3
+ *	diagonal block of A, Zg is Pinv times the gradient gb, and
+ *	Rz is the dot product of gb and Zg.
+ ***/
+int Precond = NOPRECOND;
+double **Pinv, **Zg, Rz;
+
+/***
+ *	FFT engine (--fft).  The relaxation is preconditioned with the
+ *	Green operator of the Lippmann-Schwinger equation: Zg is the
+ *	displacement that the forces gb would give in a homogeneous
+ *	reference medium, which the Fourier transform of the periodic
+ *	system makes one 3 x 3 solve per wave vector (see
+ *	fftprecondset).  Fftstencil is the stiffness of the reference
+ *	between a node and each of the 27 around it, for the same
+ *	elements as A, Fftkinv the inverse of its 3 x 3 stiffness at
+ *	each wave vector, Fftcs the cos and sin of the angles of the
+ *	frequencies along x, y and z, and Fftbuf the two transforms.
+ ***/
+int Fftengine = 0;
+double Fftstencil[27][3][3], *Fftkinv, *Fftcs;
+Fft3d Fftbuf[2];
+
+/***
+ *	Single-precision conjugate direction (--single).  Hf holds h as
+ *	3*ns floats, node after node, and takes the place of h, which
+ *	is then freed.  The products with A, the dot products and u and
+ *	gb stay in double, and gb and gg are found again from u by
+ *	energy after each call to dembx, which refines the solution.
+ ***/
+int Singleh = 0;
+float *Hf;
+
+/***
+ *	Displacement files (--start-disp and --save-disp).  A file
+ *	holds the size of the system as three ints and then, for each
+ *	node, the three components of u less the homogeneous applied
+ *	strain, so a field saved under one applied strain can start a
+ *	relaxation under another.
+ ***/
+char Startdisp[MAXSTRING], Savedisp[MAXSTRING];
+
+/***
+ *	Batch mode (--image).  The image, particle file, output folder
+ *	and ITZ choice come from the command line instead of standard
+ *	input; see nextinput.
+ ***/
+char Imagefile[MAXSTRING], Particlefile[MAXSTRING], Outdir[MAXSTRING];
+int Itz = 0;
+
+/***
+ *	Result cache (--cache dir; see rescache.c).  The results of the
+ *	relaxation are kept under a key made from the phase of each
+ *	pixel, the moduli, gtest and the ITZ layers, and a run with the
+ *	same key reads them back instead of relaxing again.
+ ***/
+char Cachedir[MAXSTRING];
+
+/***
+ *	Moduli monitor.  After each call to dembx that leaves gg above
+ *	gtest, the effective bulk and shear moduli of the displacements
+ *	so far are logged, with the limits that Aitken's delta-squared
+ *	process gives from the last three of each (see modextrap).
+ *	With --mod-tol the relaxation stops once both limits change by
+ *	less than Modtol, relative, from one call to the next.
+ ***/
+double Modtol = 0.0;
+
+/***
+ *	Timeline of the run (--trace file; see trace.c): a span for
+ *	each call of femat, energy, dembx and stress, with the hardware
+ *	counters of the main thread around each one with --counters
+ ***/
+char Tracename[MAXSTRING];
+int Tracecounters = 0;
+
+/***
+ *	With --vtk, the phases and the strain energy of each pixel are
+ *	also written to energy.vti, a VTK image file for ParaView (see
+ *	vtkimg.c and energyvtk)
+ ***/
+int Vtkout = 0;
+
+/***
+ *	Memory plan.  The memory needed for the system size and the
+ *	options chosen is written to the log file before anything big
+ *	is allocated (see memplan), and with --memplan also to standard
+ *	output, after which elastic stops.
+ ***/
+int Memplanonly = 0;
+
+/***
+ *	Relaxation on an offload device (--gpu), which implies
+ *	--stencils and keeps h in double; see dembxgpu.  The Gpu
+ *	pointers and sizes are those of what is mapped to the device,
+ *	so that gpurelease can take it off again.
+ ***/
+int Gpu = 0;
+#ifdef _OPENMP
+static int Gpuns = 0, Gpunpat = 0;
+static double *Gpuu, *Gpugb, *Gpuh, *Gpuah, *Gpust, *Gpupinv, *Gpuzg;
+static int *Gpupat;
+#endif
+
+/***
+ *	Slab of this rank under mpirun (see mpislab.h).  It owns the
+ *	layers of constant z from Zlo to Zhi - 1, which are the nodes
+ *	Mlo to Mhi - 1, and keeps the vectors of the relaxation for the
+ *	Nodecount nodes from Nodebase, its own and a halo layer on each
+ *	side, indexed by the label of the node (see nodevec).  pix then
+ *	has Pixoff more nodes at each end, a copy of the highest layer
+ *	below the lowest and of the lowest above the highest, so that
+ *	neighbors need not wrap around in z.  Energyall gathers the
+ *	strain energies of every slab on rank 0 for energy.img.  With
+ *	one rank, the slab is the whole system.
+ ***/
+int Zlo, Zhi, Mlo, Mhi, Nodebase, Nodecount, Pixoff = 0;
+double *Energyall;
+
+/***
+ *	Stiffness slots.  A paste holds only a few of the NSP phase
+ *	ids, so before the relaxation phaseslots renumbers pix to the
+ *	phases that are present, slots 0 to Nslot - 1 in the order of
+ *	the phase ids, and Slotphase gives the phase of each slot.
+ *	femat fills dk and cmod for the slots only, so the matrices the
+ *	gathers of energy and dembx read are the first Nslot of dk,
+ *	576 doubles each, instead of being spread over all of it.
+ ***/
+int Nslot = 0;
+int Slotphase[NSP + 1];
+
+static const int Stennum[27] = {4, 2, 4, 2, 4, 2, 4, 2, 2, 1, 2, 1, 2, 1,
+                                 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 4, 4, 8};
+
 /***
  *   File pointer for log file
  ***/
@@ -177,6 +388,35 @@ void freallmem_concelas(void);
 void effective(double itzwidth, double kitz, double gitz);
 void slope(double *kk, double *gg, double k, double g);
 
+/* Function declarations for the conjugate gradient relaxation */
+
+void slabnodes(void);
+double **nodevec(int ncol);
+void freenodevec(double **v);
+void addb(int m, int n, double sum);
+double layerdot(double **v);
+void neighbors(int m, int *nb);
+double stiffrow(double **v, int *nb, int j);
+int stencils(int ns);
+int precondset(int ns);
+double precondapply(int ns);
+int fftprecondset(int ns);
+double fftprecondapply(int ns);
+void stencilrows(double **v, int *nb, int pat, double *r);
+void stencilrowsf(float *v, int *nb, int pat, double *r);
+double modextrap(const double *x);
+int energyvtk(char *name, double *energy);
+void nodeblocks(int ns);
+int loaddisp(char *name, int nx, int ny, int nz);
+void nextinput(char *batchval, char *s, int size);
+int savedisp(char *name, int nx, int ny, int nz);
+int cacheio(FILE *fp, int ns, int doitz, int writing);
+double memplan(int ns, int doitz, FILE *fp);
+double physmem(void);
+void gpurelease(void);
+double gpuprecond(int ns);
+int dembxgpu(int ns, int ldemb, int kkk);
+
 char *rfc8601_timespec(struct timespec *tv) {
   char time_str[127];
   double fractional_seconds;
@@ -230,11 +470,70 @@ void printHelp(void) {
   fprintf(stderr,
           "\n\nUsage: elastic [-h,--help] [-q,--quiet | -s,--silent]\n");
   fprintf(stderr, "      -j,--json progress.json -w,--workdir "
-                  "working_directory\n\n");
+                  "working_directory\n");
+  fprintf(stderr, "      [-t,--threads n [--fixed-order]] [--stencils]\n");
+  fprintf(stderr, "      [-p,--precond none|jacobi|block] [--single]\n");
+  fprintf(stderr, "      [--start-disp file] [--save-disp file]\n");
+  fprintf(stderr, "      [--image file --particles file [--outdir folder] "
+                  "[--itz]] [--memplan] [--gpu]\n");
+  fprintf(stderr, "      [--fft] [--cache folder] [--mod-tol tol]\n");
+  fprintf(stderr, "      [--trace file [--counters]] [--vtk]\n\n");
   fprintf(stderr, "    progress.json is the name of the progress file for UI "
                   "processing (required)\n");
   fprintf(stderr, "    working_directory is the path to the folder that will "
                   "hold all simulation results (required)\n");
+  fprintf(stderr, "    n is the number of threads for the relaxation of the "
+                  "displacements (default VCCTL_THREADS, or 1);\n"
+                  "      --fixed-order makes the result independent of n\n");
+  fprintf(stderr, "    --stencils sets up the stiffness stencil of each node "
+                  "once, which\n      is faster but takes more memory\n");
+  fprintf(stderr, "    --precond preconditions the relaxation with the "
+                  "diagonal (jacobi)\n      or the 3 x 3 diagonal blocks "
+                  "(block) of the stiffness matrix\n");
+  fprintf(stderr, "    --single keeps the conjugate direction in single "
+                  "precision, which\n      takes less memory; it implies "
+                  "--stencils\n");
+  fprintf(stderr, "    --start-disp starts the relaxation from the "
+                  "displacements in file,\n      if it is there, and "
+                  "--save-disp writes the final displacements\n      to "
+                  "file, so the next image of a series can start from "
+                  "them\n");
+  fprintf(stderr, "    --image runs without prompting, on the image (ASCII "
+                  "or binary) and\n      particle file given, writing to "
+                  "--outdir (default working_directory);\n      --itz asks "
+                  "for the ITZ calculation, whose inputs are still read\n"
+                  "      from standard input\n");
+  fprintf(stderr, "    --memplan prints the memory needed for the image and "
+                  "options given,\n      and the memory of the machine, "
+                  "and stops\n");
+  fprintf(stderr, "    --gpu relaxes the displacements on an offload device, "
+                  "if there is\n      one; it implies --stencils and "
+                  "overrides --single\n");
+  fprintf(stderr, "    --fft preconditions the relaxation with the Green "
+                  "operator of a\n      homogeneous medium, applied with "
+                  "Fourier transforms, which takes\n      far fewer steps; "
+                  "it overrides --precond and --gpu\n");
+  fprintf(stderr, "    --cache keeps the results in folder, and takes them "
+                  "from there\n      instead of relaxing when the same "
+                  "image and moduli come\n      again; it is not used with "
+                  "--save-disp or under mpirun\n");
+  fprintf(stderr, "    --mod-tol stops the relaxation once the extrapolated "
+                  "bulk and shear\n      moduli change by less than tol "
+                  "(relative, e.g. 0.005 for two\n      significant "
+                  "digits) from one call of the solver to the next\n");
+  fprintf(stderr, "    --trace writes a timeline of the run to file in the "
+                  "working directory,\n      for the Chrome trace viewer "
+                  "or Perfetto, with a span for each call\n      of femat, "
+                  "energy, dembx and stress; --counters adds the cycles,\n"
+                  "      instructions and cache misses of the main thread "
+                  "(Linux)\n");
+  fprintf(stderr, "    --vtk also writes the phases and the strain energy "
+                  "of each pixel\n      to energy.vti, a compressed VTK "
+                  "image file for ParaView\n");
+  fprintf(stderr, "    Built with VCCTL_MPI and run under mpirun, the layers "
+                  "are shared\n      out among the ranks; only rank 0 reads "
+                  "standard input, so use\n      --image, and --gpu and "
+                  "--fft are not used\n");
   fprintf(stderr, "Normal mode: Print progress updates to stderr and end point "
                   "results to stdout\n");
   fprintf(stderr, "Quiet mode: Print only end point results to stdout, no "
@@ -261,6 +560,13 @@ int checkargs(int argc, char **argv) {
 
   strcpy(WorkingDirectory, "");
   strcpy(ProgressFileName, "");
+  strcpy(Startdisp, "");
+  strcpy(Savedisp, "");
+  strcpy(Imagefile, "");
+  strcpy(Particlefile, "");
+  strcpy(Outdir, "");
+  strcpy(Cachedir, "");
+  strcpy(Tracename, "");
 
   if (argc < 3) {
     wellformed = 0;
@@ -277,16 +583,37 @@ int checkargs(int argc, char **argv) {
       {"verbose", no_argument, &Verbose_flag, 3},
       {"quiet", no_argument, &Verbose_flag, 1},
       {"silent", no_argument, &Verbose_flag, 0},
+      {"fixed-order", no_argument, &Fixedorder, 1},
+      {"stencils", no_argument, &Usestencil, 1},
+      {"single", no_argument, &Singleh, 1},
+      {"itz", no_argument, &Itz, 1},
+      {"memplan", no_argument, &Memplanonly, 1},
+      {"fft", no_argument, &Fftengine, 1},
+      {"gpu", no_argument, &Gpu, 1},
+      {"counters", no_argument, &Tracecounters, 1},
+      {"vtk", no_argument, &Vtkout, 1},
       /* These options don't set a flag */
       {"json", required_argument, 0, 'j'},
       {"workdir", required_argument, 0, 'w'},
+      {"threads", required_argument, 0, 't'},
+      {"precond", required_argument, 0, 'p'},
+      {"start-disp", required_argument, 0, 'S'},
+      {"save-disp", required_argument, 0, 'D'},
+      {"image", required_argument, 0, 'i'},
+      {"particles", required_argument, 0, 'P'},
+      {"outdir", required_argument, 0, 'o'},
+      {"cache", required_argument, 0, 'C'},
+      {"mod-tol", required_argument, 0, 'M'},
+      {"trace", required_argument, 0, 'R'},
       {"help", no_argument, 0, 'h'},
       {NULL, 0, 0, 0}};
 
   int opt_char;
   int option_index;
 
-  while ((opt_char = getopt_long(argc, argv, "j:w:h", long_opts,
+  Nthreads = thread_default(Nthreads);
+
+  while ((opt_char = getopt_long(argc, argv, "j:w:t:p:i:o:h", long_opts,
                                  &option_index)) != -1) {
     switch (opt_char) {
     case (0):
@@ -304,6 +631,58 @@ int checkargs(int argc, char **argv) {
       wdirname = optarg;
       strcpy(WorkingDirectory, wdirname);
       break;
+    // -t or --threads
+    case (int)('t'):
+      Nthreads = atoi(optarg);
+      if (Nthreads < 1)
+        Nthreads = 1;
+      break;
+    // -p or --precond
+    case (int)('p'):
+      if (!strcmp(optarg, "none")) {
+        Precond = NOPRECOND;
+      } else if (!strcmp(optarg, "jacobi")) {
+        Precond = JACOBI;
+      } else if (!strcmp(optarg, "block")) {
+        Precond = BLOCKJACOBI;
+      } else {
+        wellformed = 0;
+      }
+      break;
+    // --start-disp
+    case (int)('S'):
+      strcpy(Startdisp, optarg);
+      break;
+    // --save-disp
+    case (int)('D'):
+      strcpy(Savedisp, optarg);
+      break;
+    // -i or --image
+    case (int)('i'):
+      strcpy(Imagefile, optarg);
+      break;
+    // --particles
+    case (int)('P'):
+      strcpy(Particlefile, optarg);
+      break;
+    // -o or --outdir
+    case (int)('o'):
+      strcpy(Outdir, optarg);
+      break;
+    // --cache
+    case (int)('C'):
+      strcpy(Cachedir, optarg);
+      break;
+    // --mod-tol
+    case (int)('M'):
+      Modtol = atof(optarg);
+      if (Modtol < 0.0)
+        wellformed = 0;
+      break;
+    // --trace
+    case (int)('R'):
+      strcpy(Tracename, optarg);
+      break;
     // -h or --help
     case (int)('h'):
       wellformed = 0;
@@ -317,8 +696,20 @@ int checkargs(int argc, char **argv) {
     }
   }
 
+  if (Fftengine) {
+    Precond = FFTGREEN;
+    Gpu = 0;
+  }
+  if (Singleh)
+    Usestencil = 1;
+  if (Gpu) {
+    Usestencil = 1;
+    Singleh = 0;
+  }
+
   if (wellformed != 1 || strlen(ProgressFileName) == 0 ||
-      strlen(WorkingDirectory) == 0) {
+      strlen(WorkingDirectory) == 0 ||
+      (strlen(Imagefile) > 0 && strlen(Particlefile) == 0)) {
     printHelp();
     return (1);
   }
@@ -332,49 +723,84 @@ int checkargs(int argc, char **argv) {
   sprintf(LogFileName, "%selastic.log", WorkingDirectory);
   strcpy(buff, ProgressFileName);
   sprintf(ProgressFileName, "%s%s", WorkingDirectory, buff);
+  if (strlen(Tracename) > 0) {
+    strcpy(buff, Tracename);
+    sprintf(Tracename, "%s%s", WorkingDirectory, buff);
+  }
+
+  if (strlen(Outdir) == 0) {
+    strcpy(Outdir, WorkingDirectory);
+  } else if (Outdir[strlen(Outdir) - 1] != PATH_SEPARATOR[0]) {
+    strcat(Outdir, PATH_SEPARATOR);
+  }
 
   return (0);
 }
 
+/***
+ *    nextinput
+ *
+ *     Get the next answer to the questions of ppixel, from standard
+ *     input, or in batch mode (--image) from the command line
+ *
+ *     Arguments:    char pointer to the batch mode answer
+ *                   char pointer to the answer, and its size
+ *     Returns:    nothing
+ *
+ *    Calls:        read_string
+ *    Called by:    ppixel
+ ***/
+void nextinput(char *batchval, char *s, int size) {
+  if (strlen(Imagefile) > 0) {
+    strncpy(s, batchval, size - 1);
+    s[size - 1] = '\0';
+  } else {
+    read_string(s, size);
+  }
+
+  return;
+}
+
 /* Freeallmem frees all dynamically allocated memory */
 
 void freeallmem(void) {
-  if (u)
-    free_drect(u, Syspix);
-  if (gb)
-    free_drect(gb, Syspix);
-  if (b)
-    free_drect(b, Syspix);
-  if (h)
-    free_drect(h, Syspix);
-  if (ib)
-    free_irect(ib, Syspix);
+#ifdef _OPENMP
+  gpurelease();
+#endif
+  trace_close();
+  freenodevec(u);
+  freenodevec(gb);
+  freenodevec(b);
+  freenodevec(h);
+  freenodevec(Ah);
+  if (Hf)
+    free(Hf + 3 * (size_t)Nodebase);
+  Hf = NULL;
+  if (Blocksum)
+    free_dvector(Blocksum);
+  if (Nodepat)
+    free_ivector(Nodepat + Nodebase);
+  free(Stencil);
+  Stencil = NULL;
+  Maxstencil = 0;
+  freenodevec(Pinv);
+  freenodevec(Zg);
+  if (Fftkinv)
+    free_dvector(Fftkinv);
+  Fftkinv = NULL;
+  if (Fftcs)
+    free_dvector(Fftcs);
+  Fftcs = NULL;
+  fft3d_free(&Fftbuf[0]);
+  fft3d_free(&Fftbuf[1]);
   if (pix)
-    free_sivector(pix);
-  if (stressxx)
-    free_dvector(stressxx);
-  if (stressyy)
-    free_dvector(stressyy);
-  if (stresszz)
-    free_dvector(stresszz);
-  if (stressxz)
-    free_dvector(stressxz);
-  if (stressyz)
-    free_dvector(stressyz);
-  if (stressxy)
-    free_dvector(stressxy);
-  if (strainxx)
-    free_dvector(strainxx);
-  if (strainyy)
-    free_dvector(strainyy);
-  if (strainzz)
-    free_dvector(strainzz);
-  if (strainxz)
-    free_dvector(strainxz);
-  if (strainyz)
-    free_dvector(strainyz);
-  if (strainxy)
-    free_dvector(strainxy);
+    free_sivector(pix - Pixoff);
+  if (Energy)
+    free_dvector(Energy + Nodebase);
+  if (Energyall)
+    free_dvector(Energyall);
+  if (Layersum)
+    free_dvector(Layersum);
   if (part)
     free_sivector(part);
   if (Aa)
@@ -397,36 +823,38 @@ void freeallmem(void) {
 
 /*  Subroutine that sets up microstructural image */
 void ppixel(int nphase, int *doitz, int *nagg1) {
-  int nxy, nx, ny, nz, i, j, k, inval, oinval;
+  int nxy, nx, ny, nz, i, j, k, inval, format;
   int foundagg;
   int m, m1, m2, count;
+  size_t n;
+  double need, have;
+  unsigned char *vox;
   FILE *infile, *pinfile;
-  char filein[MAXSTRING], pfilein[MAXSTRING], buff[MAXSTRING],
-      instring[MAXSTRING];
+  char filein[MAXSTRING], pfilein[MAXSTRING], buff[MAXSTRING];
   FILE *fpout;
 
   /* Get user input for filename to read in microstructure */
   fprintf(Logfile,
           "\nEnter full path and name of file with input microstructure: ");
-  read_string(filein, sizeof(filein));
+  nextinput(Imagefile, filein, sizeof(filein));
   fprintf(Logfile, "\n%s", filein);
 
   /* Determine the separator character */
 
   fprintf(Logfile, "\nEnter whether to break connections between");
   fprintf(Logfile, "\nanhydrous cement particles (1) or not (0): ");
-  read_string(buff, sizeof(buff));
+  nextinput("1", buff, sizeof(buff));
   /* Sever = atoi(buff); */
   Sever = 1;
   fprintf(Logfile, "\n%d (set automatically, not your fault.", Sever);
   fprintf(Logfile, "\nITZ Calculation? (1 for Yes, 0 for No): ");
-  read_string(buff, sizeof(buff));
+  nextinput(Itz ? "1" : "0", buff, sizeof(buff));
   *doitz = atoi(buff);
   fprintf(Logfile, "%d", *doitz);
-  fflush(Logfile);
+  log_flush(Logfile);
   fprintf(Logfile, "\nEnter name of folder to output data files");
   fprintf(Logfile, "\n(Include final separator in path): ");
-  read_string(Outfolder, sizeof(Outfolder));
+  nextinput(Outdir, Outfolder, sizeof(Outfolder));
   Filesep = Outfolder[strlen(Outfolder) - 1];
   if (Filesep != PATH_SEPARATOR[0]) {
     fprintf(stderr, "\nIncorrect file separator detected.  Using %c",
@@ -459,7 +887,9 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
    *
    ****/
 
-  if (read_imgheader(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize, &Res)) {
+  if (read_imgheader_fmt(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize,
+                         &Res, &format) ||
+      (format != IMG_ASCII && format != IMG_UINT8 && format != IMG_UINT8Z)) {
     fclose(infile);
     bailout("elastic", "Error reading image header");
     freeallmem();
@@ -469,7 +899,9 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
   Syspix = Xsyssize * Ysyssize * Zsyssize;
 
   fprintf(Logfile, "\nSyspix = %d", Syspix);
-  fflush(Logfile);
+  log_flush(Logfile);
+
+  slabnodes();
 
   nx = Xsyssize;
   ny = Ysyssize;
@@ -477,6 +909,28 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
 
   *nagg1 = Xsyssize;
 
+  /***
+   *	Check the memory needed against the memory of the machine
+   ***/
+
+  need = memplan(Syspix, *doitz, Logfile);
+  log_flush(Logfile);
+  if (Memplanonly) {
+    memplan(Syspix, *doitz, stdout);
+    fclose(infile);
+    freeallmem();
+    slabstop();
+    exit(0);
+  }
+  have = physmem();
+  if (have > 0.0 && need > have) {
+    sprintf(buff, "Needs %.2f GB of memory, more than the %.2f GB here",
+            need / MEMGB, have / MEMGB);
+    warning("elastic", buff);
+    fprintf(Logfile, "\nWARNING: %s", buff);
+    log_flush(Logfile);
+  }
+
   /***
    *	Allocate arrays dynamically based on system size
    ***/
@@ -485,36 +939,34 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
   gb = NULL;
   b = NULL;
   h = NULL;
-  ib = NULL;
+  Ah = NULL;
+  Blocksum = NULL;
   pix = NULL;
   part = NULL;
-
-  u = drect(Syspix, 3);
-  gb = drect(Syspix, 3);
-  b = drect(Syspix, 3);
-  h = drect(Syspix, 3);
-  ib = irect(Syspix, 27);
-  pix = sivector(Syspix);
+  Energy = NULL;
+  Layersum = NULL;
+
+  u = nodevec(3);
+  gb = nodevec(3);
+  b = nodevec(3);
+  h = nodevec(3);
+  Ah = nodevec(3);
+  nodeblocks(Mhi - Mlo);
+  Blocksum = dvector(Nblock);
+  pix = sivector((size_t)Syspix + 2 * Pixoff);
+  if (pix)
+    pix += Pixoff;
   part = sivector(Syspix);
-  stressxx = dvector(Syspix);
-  stressyy = dvector(Syspix);
-  stresszz = dvector(Syspix);
-  stressxz = dvector(Syspix);
-  stressyz = dvector(Syspix);
-  stressxy = dvector(Syspix);
-  strainxx = dvector(Syspix);
-  strainyy = dvector(Syspix);
-  strainzz = dvector(Syspix);
-  strainxz = dvector(Syspix);
-  strainyz = dvector(Syspix);
-  strainxy = dvector(Syspix);
-
-  if (!u || !gb || !b || !h || !ib || !pix || !part || !stressxx || !stressyy ||
-      !stresszz || !stressxz || !stressyz || !stressxy || !strainxx ||
-      !strainyy || !strainzz || !strainxz || !strainyz || !strainxy) {
+  Energy = dvector(Nodecount);
+  if (Energy)
+    Energy -= Nodebase;
+  Layersum = dvector((size_t)Xsyssize * LAYERSUM);
+
+  if (!u || !gb || !b || !h || !Ah || !Blocksum || !pix || !part || !Energy ||
+      !Layersum) {
     freeallmem();
     bailout("elastic", "Memory allocation failure");
-    fflush(Logfile);
+    log_flush(Logfile);
     exit(1);
   }
 
@@ -537,7 +989,7 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
     if (!Vv || !Aa || !A || !A1 || !K || !G || !Cc) {
       freeallmem();
       bailout("elastic", "Memory allocation failure");
-      fflush(Logfile);
+      log_flush(Logfile);
       exit(1);
     }
   }
@@ -549,18 +1001,32 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
   /*  reading it in from a file, this should be done inside this subroutine. */
 
   fprintf(Logfile, "\nReading image file now... ");
-  fflush(Logfile);
+  log_flush(Logfile);
+
+  /*  The voxels, ASCII or binary, are read at once into vox, in the */
+  /*  order of the file, and converted to the current phase ids */
+
+  vox = (unsigned char *)malloc((size_t)Syspix);
+  if (!vox || read_micvoxels(infile, vox, Xsyssize, Ysyssize, Zsyssize,
+                             Version, format)) {
+    free(vox);
+    fclose(infile);
+    freeallmem();
+    bailout("elastic", "Error reading image voxels");
+    exit(1);
+  }
+  fclose(infile);
+
   foundagg = 0;
   count = 0;
   nxy = Xsyssize * Ysyssize;
+  n = 0;
   for (i = 0; i < Xsyssize; i++) {
     for (j = 0; j < Ysyssize; j++) {
       m2 = j * Xsyssize;
       for (k = 0; k < Zsyssize; k++) {
         m = (k * nxy) + m2 + i;
-        fscanf(infile, "%s", instring);
-        oinval = atoi(instring);
-        inval = convert_id(oinval, Version);
+        inval = vox[n++];
         if (inval == C3S)
           count++;
         pix[m] = inval;
@@ -574,7 +1040,7 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
         if (inval == INERTAGG) {
           fprintf(Logfile, "\nINERTAGG (%d) found at (%d,%d,%d)", INERTAGG, i,
                   j, k);
-          fflush(Logfile);
+          log_flush(Logfile);
           foundagg = 1;
 
           /***
@@ -597,9 +1063,9 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
     }
   }
 
-  fclose(infile);
+  free(vox);
   fprintf(Logfile, " done.  Count of C3S = %d", count);
-  fflush(Logfile);
+  log_flush(Logfile);
 
   count = 0;
   for (m = 0; m < Xsyssize * Ysyssize * Zsyssize; m++) {
@@ -608,18 +1074,18 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
   }
 
   fprintf(Logfile, "\nNow using pix, Count of C3S = %d", count);
-  fflush(Logfile);
+  log_flush(Logfile);
 
   if (!foundagg)
     *nagg1 = (Xsyssize / 2);
 
   fprintf(Logfile, "\nnagg1 = %d", *nagg1);
-  fflush(Logfile);
+  log_flush(Logfile);
   /* Get user input for filename to read in particle ids */
   fprintf(Logfile, "\nEnter name of file with particle ids: ");
-  read_string(pfilein, sizeof(pfilein));
+  nextinput(Particlefile, pfilein, sizeof(pfilein));
   fprintf(Logfile, "%s", pfilein);
-  fflush(Logfile);
+  log_flush(Logfile);
   if (Sever) {
     pinfile = filehandler("elastic", pfilein, "READ");
     if (!pinfile) {
@@ -627,7 +1093,7 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
       exit(1);
     }
     if (breakflocs(pinfile, pix, part, in, jjn, kn, Xsyssize, Ysyssize,
-                   Zsyssize, Version, Res)) {
+                   Zsyssize, Version, Res, Nthreads)) {
       fclose(pinfile);
       exit(1);
     }
@@ -639,7 +1105,17 @@ void ppixel(int nphase, int *doitz, int *nagg1) {
       count++;
   }
   fprintf(Logfile, "\nAfter breakflocs, Count of C3S = %d", count);
-  fflush(Logfile);
+  log_flush(Logfile);
+
+  /*  The layers of pix around the system, under mpirun */
+
+  if (Pixoff) {
+    memcpy(pix - Pixoff, pix + Syspix - Pixoff, Pixoff * sizeof(*pix));
+    memcpy(pix + Syspix, pix, Pixoff * sizeof(*pix));
+  }
+
+  if (Mpirank > 0)
+    return;
 
   fpout = fopen("newcem.img", "w");
   write_imgheader(fpout, Xsyssize, Ysyssize, Zsyssize, 1.0);
@@ -672,20 +1148,61 @@ void assig(int ns, int nphase) {
           count);
   fprintf(Logfile, "\nns = %d, so vfrac[%d] = %f", ns, C3S,
           (prob[C3S] / ((double)ns)));
-  fflush(Logfile);
+  log_flush(Logfile);
   /* Convert from phase count to volume fraction */
   for (i = 0; i < nphase; i++) {
     prob[i] /= (double)ns;
   }
 }
 
+/***
+ *	phaseslots
+ *
+ * 	Renumber pix, with the layers around the system under mpirun,
+ * 	to the stiffness slots of the phases present (see Nslot)
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	main
+ ***/
+void phaseslots(void) {
+  int i, slot[NSP + 1];
+  long m, mlo, mhi;
+
+  mlo = -(long)Pixoff;
+  mhi = (long)Syspix + Pixoff;
+  for (i = 0; i <= NSP; i++) {
+    slot[i] = -1;
+  }
+  for (m = mlo; m < mhi; m++) {
+    slot[pix[m]] = 0;
+  }
+
+  Nslot = 0;
+  for (i = 0; i <= NSP; i++) {
+    if (slot[i] == 0) {
+      slot[i] = Nslot;
+      Slotphase[Nslot++] = i;
+    }
+  }
+
+  for (m = mlo; m < mhi; m++) {
+    pix[m] = slot[pix[m]];
+  }
+
+  return;
+}
+
 /*  Subroutine that sets up the elastic moduli variables,  */
 /*  the stiffness matrices,dk, the linear term in */
 /*  displacements, b, and the constant term, C, that appear in the total energy
  */
-/*  due to the periodic boundary conditions */
+/*  due to the periodic boundary conditions.  The stiffness matrices */
+/*  are those of the slots of phaseslots, which pix then holds. */
 
-void femat(int nx, int ny, int nz, int ns, int nphase) {
+void femat(int nx, int ny, int nz, int ns) {
 
   double dndx[8], dndy[8], dndz[8], cmu[6][6], ck[6][6], g[3][3][3];
   double es[6][8][3], delta[8][3], cumtot = 0.0;
@@ -693,7 +1210,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
   float x, y, z;
   int is[8], m, l, k, j, i, ijk, n1, n2, n3, n, mm, nn, ii, jj, ll, kk, i3, i8,
       m8, m4, nxy;
-  int m3;
+  int m3, nb[27];
 
   nxy = nx * ny;
 
@@ -704,7 +1221,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
   /*  implemented for isotropic materials. */
 
   /*  initialize stiffness matrices */
-  for (m = 0; m < nphase; m++) {
+  for (m = 0; m < Nslot; m++) {
     for (i = 0; i < 8; i++) {
       for (k = 0; k < 3; k++) {
         for (j = 0; j < 8; j++) {
@@ -749,10 +1266,11 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
   cmu[4][4] = 1.0;
   cmu[5][5] = 1.0;
 
-  for (k = 0; k < nphase; k++) {
+  for (k = 0; k < Nslot; k++) {
     for (i = 0; i < 6; i++) {
       for (j = 0; j < 6; j++) {
-        cmod[k][i][j] = phasemod[k][0] * ck[i][j] + phasemod[k][1] * cmu[i][j];
+        cmod[k][i][j] = phasemod[Slotphase[k]][0] * ck[i][j] +
+                        phasemod[Slotphase[k]][1] * cmu[i][j];
       }
     }
   }
@@ -775,12 +1293,12 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
     }
   }
 
-  /*  loop over the nphase kinds of pixels and Simpson's rule quadrature */
+  /*  loop over the Nslot kinds of pixels and Simpson's rule quadrature */
   /*  points in order to compute the stiffness matrices.  Stiffness matrices */
   /*  of trilinear finite elements are quadratic in x, y, and z, so that */
   /*  Simpson's rule quadrature gives exact results. */
 
-  for (ijk = 0; ijk < nphase; ijk++) {
+  for (ijk = 0; ijk < Nslot; ijk++) {
     for (k = 0; k < 3; k++) {
       for (j = 0; j < 3; j++) {
         for (i = 0; i < 3; i++) {
@@ -872,7 +1390,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
   /*  write out all the terms involved. */
 
   /*  Initialize b and C */
-  for (m3 = 0; m3 < ns; m3++) {
+  for (m3 = Mlo; m3 < Mhi; m3++) {
     for (m = 0; m < 3; m++) {
       b[m3][m] = 0.0;
     }
@@ -881,10 +1399,10 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
 
   /*  For all cases, the correspondence between 1-8 finite element node */
   /*  labels and 1-27 neighbor labels is (see Table 4 in manual):   */
-  /*  1:ib(m,27), 2:ib(m,3), */
-  /*  3:ib(m,2),4:ib(m,1), */
-  /*  5:ib(m,26),6:ib(m,19) */
-  /*  7:ib(m,18),8:ib(m,17)  */
+  /*  1:nb(27), 2:nb(3), */
+  /*  3:nb(2),4:nb(1), */
+  /*  5:nb(26),6:nb(19) */
+  /*  7:nb(18),8:nb(17)  */
   /*  In C version, all indices begin at 0, so 1 was subtracted from all */
   /*    values given in original Fortran code 11/27/01  */
   is[0] = 26;
@@ -914,6 +1432,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
   for (j = 1; j <= (ny - 1); j++) {
     for (k = 0; k < (nz - 1); k++) {
       m = nxy * k + j * nx - 1;
+      neighbors(m, nb);
       for (nn = 0; nn < 3; nn++) {
         for (mm = 0; mm < 8; mm++) {
           sum = 0.0;
@@ -924,7 +1443,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
                    delta[mm][nn];
             }
           }
-          b[ib[m][is[mm]]][nn] += sum;
+          addb(nb[is[mm]], nn, sum);
         }
       }
     }
@@ -948,6 +1467,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
   for (i = 0; i < (nx - 1); i++) {
     for (k = 0; k < (nz - 1); k++) {
       m = nxy * k + nx * (ny - 1) + i;
+      neighbors(m, nb);
       for (nn = 0; nn < 3; nn++) {
         for (mm = 0; mm < 8; mm++) {
           sum = 0.0;
@@ -958,7 +1478,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
                    delta[mm][nn];
             }
           }
-          b[ib[m][is[mm]]][nn] += sum;
+          addb(nb[is[mm]], nn, sum);
         }
       }
     }
@@ -979,6 +1499,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
   for (i = 0; i < (nx - 1); i++) {
     for (j = 0; j < (ny - 1); j++) {
       m = nxy * (nz - 1) + nx * j + i;
+      neighbors(m, nb);
       for (nn = 0; nn < 3; nn++) {
         for (mm = 0; mm < 8; mm++) {
           sum = 0.0;
@@ -989,7 +1510,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
                    delta[mm][nn];
             }
           }
-          b[ib[m][is[mm]]][nn] += sum;
+          addb(nb[is[mm]], nn, sum);
         }
       }
     }
@@ -1021,6 +1542,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
 
   for (k = 1; k <= (nz - 1); k++) {
     m = nxy * k - 1;
+    neighbors(m, nb);
     for (nn = 0; nn < 3; nn++) {
       for (mm = 0; mm < 8; mm++) {
         sum = 0.0;
@@ -1031,7 +1553,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
                  delta[mm][nn];
           }
         }
-        b[ib[m][is[mm]]][nn] += sum;
+        addb(nb[is[mm]], nn, sum);
       }
     }
   }
@@ -1062,6 +1584,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
 
   for (j = 0; j < (ny - 1); j++) {
     m = nxy * (nz - 1) + nx * j + nx - 1;
+    neighbors(m, nb);
     for (nn = 0; nn < 3; nn++) {
       for (mm = 0; mm < 8; mm++) {
         sum = 0.0;
@@ -1072,7 +1595,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
                  delta[mm][nn];
           }
         }
-        b[ib[m][is[mm]]][nn] += sum;
+        addb(nb[is[mm]], nn, sum);
       }
     }
   }
@@ -1098,6 +1621,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
 
   for (i = 0; i < (nx - 1); i++) {
     m = nxy * (nz - 1) + nx * (ny - 1) + i;
+    neighbors(m, nb);
     for (nn = 0; nn < 3; nn++) {
       for (mm = 0; mm < 8; mm++) {
         sum = 0.0;
@@ -1108,7 +1632,7 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
                  delta[mm][nn];
           }
         }
-        b[ib[m][is[mm]]][nn] += sum;
+        addb(nb[is[mm]], nn, sum);
       }
     }
   }
@@ -1156,111 +1680,1041 @@ void femat(int nx, int ny, int nz, int ns, int nphase) {
     }
   }
 
-  m = nx * ny * nz - 1;
-  for (nn = 0; nn < 3; nn++) {
-    for (mm = 0; mm < 8; mm++) {
-      sum = 0.0;
-      for (m4 = 0; m4 < 3; m4++) {
-        for (m8 = 0; m8 < 8; m8++) {
-          sum += delta[m8][m4] * dk[pix[m]][m8][m4][mm][nn];
-          C += 0.5 * delta[m8][m4] * dk[pix[m]][m8][m4][mm][nn] * delta[mm][nn];
+  m = nx * ny * nz - 1;
+  neighbors(m, nb);
+  for (nn = 0; nn < 3; nn++) {
+    for (mm = 0; mm < 8; mm++) {
+      sum = 0.0;
+      for (m4 = 0; m4 < 3; m4++) {
+        for (m8 = 0; m8 < 8; m8++) {
+          sum += delta[m8][m4] * dk[pix[m]][m8][m4][mm][nn];
+          C += 0.5 * delta[m8][m4] * dk[pix[m]][m8][m4][mm][nn] * delta[mm][nn];
+        }
+      }
+      addb(nb[is[mm]], nn, sum);
+    }
+  }
+}
+
+/*  Subroutine that finds the slab of this rank and the nodes it */
+/*  keeps (see Zlo).  Each node needs the layers next to its own, */
+/*  so a rank keeps a halo layer on each side of its slab. */
+
+void slabnodes(void) {
+  int nxy;
+
+  nxy = Xsyssize * Ysyssize;
+  if (slabsplit(Zsyssize, &Zlo, &Zhi)) {
+    bailout("elastic", "Fewer layers of the system than MPI ranks");
+    freeallmem();
+    exit(1);
+  }
+  Mlo = Zlo * nxy;
+  Mhi = Zhi * nxy;
+  Nodebase = 0;
+  Nodecount = Syspix;
+  Pixoff = 0;
+  if (Mpisize > 1) {
+    Nodebase = Mlo - nxy;
+    Nodecount = Mhi - Mlo + 2 * nxy;
+    Pixoff = nxy;
+    fprintf(Logfile, "\nRank %d of %d relaxes the layers %d to %d", Mpirank,
+            Mpisize, Zlo, Zhi - 1);
+    log_flush(Logfile);
+  }
+
+  return;
+}
+
+/*  Function that gives a vector of ncol values for each of the */
+/*  nodes this rank keeps, indexed by the label of the node, or NULL */
+/*  if there is no room, and the subroutine that frees it.  The */
+/*  vector is set to zero by the threads that will work on it, so */
+/*  its pages lie in their memory (see touchblock) */
+
+double **nodevec(int ncol) {
+  double **v;
+
+  v = drect(Nodecount, ncol);
+  if (v)
+    touchblock(v[0], (size_t)Nodecount * ncol * sizeof(double), Nthreads);
+
+  return (v ? v - Nodebase : NULL);
+}
+
+void freenodevec(double **v) {
+  if (v)
+    free_drect(v + Nodebase, Nodecount);
+
+  return;
+}
+
+/*  Subroutine that adds sum to component n of b at node m, which */
+/*  femat finds as the neighbor of a pixel on a face.  Under mpirun */
+/*  the label may be in a layer just outside the system, and is */
+/*  wrapped back into it, and only the nodes of this rank's slab */
+/*  are kept. */
+
+void addb(int m, int n, double sum) {
+  if (m < 0) {
+    m += Syspix;
+  } else if (m >= Syspix) {
+    m -= Syspix;
+  }
+  if (m >= Mlo && m < Mhi)
+    b[m][n] += sum;
+
+  return;
+}
+
+/*  Function that returns the dot product of v with itself over the */
+/*  nodes of every rank, added up layer by layer (see slabsum) */
+
+double layerdot(double **v) {
+  int m, j, k, mend;
+  double sum;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 1)           \
+    private(m, j, mend, sum) if (Nblock > 1)
+#endif
+  for (k = 0; k < Nblock; k++) {
+    sum = 0.0;
+    mend = (k + 1 < Nblock) ? Mlo + (k + 1) * Blocksize : Mhi;
+    for (m = Mlo + k * Blocksize; m < mend; m++) {
+      for (j = 0; j < 3; j++) {
+        sum += v[m][j] * v[m][j];
+      }
+    }
+    Blocksum[k] = sum;
+  }
+
+  return (slabsum(Blocksum, Nblock));
+}
+
+/*  Subroutine that puts in nb the 1-d labels of the 27 neighbors of */
+/*  the node labelled m, in the order of in, jjn and kn.  Away from */
+/*  the faces of the system they are just m plus the offsets in Nboff; */
+/*  nodes on a face wrap around by the periodic boundary conditions. */
+/*  Under mpirun they do not wrap around in z: the labels go on into */
+/*  the layer below the system, which is negative, or above it, */
+/*  where this rank keeps its halo layers and pix has the wrapped */
+/*  layers of the system. */
+
+void neighbors(int m, int *nb) {
+  int n, i, j, k, i1, j1, k1, nxy;
+
+  nxy = Xsyssize * Ysyssize;
+  i = m % Xsyssize;
+  j = (m / Xsyssize) % Ysyssize;
+  k = m / nxy;
+
+  if ((i > 0) && (i < Xsyssize - 1) && (j > 0) && (j < Ysyssize - 1) &&
+      ((Pixoff > 0) || ((k > 0) && (k < Zsyssize - 1)))) {
+    for (n = 0; n < 27; n++) {
+      nb[n] = m + Nboff[n];
+    }
+    return;
+  }
+
+  for (n = 0; n < 27; n++) {
+    i1 = i + in[n];
+    j1 = j + jjn[n];
+    k1 = k + kn[n];
+    if (i1 < 0) {
+      i1 += Xsyssize;
+    } else if (i1 >= Xsyssize) {
+      i1 -= Xsyssize;
+    }
+    if (j1 < 0) {
+      j1 += Ysyssize;
+    } else if (j1 >= Ysyssize) {
+      j1 -= Ysyssize;
+    }
+    if (k1 < 0 && !Pixoff) {
+      k1 += Zsyssize;
+    } else if (k1 >= Zsyssize && !Pixoff) {
+      k1 -= Zsyssize;
+    }
+    nb[n] = nxy * k1 + Xsyssize * j1 + i1;
+  }
+
+  return;
+}
+
+/*  Subroutine that computes row 3*m+j of the global matrix A times */
+/*  the vector v, where nb holds the neighbors of node m.  The long */
+/*  statement below correctly brings in all the terms from the global */
+/*  matrix A using only the small stiffness matrices dk. */
+
+double stiffrow(double **v, int *nb, int j) {
+  int n;
+  double r = 0.0;
+
+  for (n = 0; n < 3; n++) {
+    r += v[nb[0]][n] * (dk[pix[nb[26]]][0][j][3][n] +
+                        dk[pix[nb[6]]][1][j][2][n] +
+                        dk[pix[nb[24]]][4][j][7][n] +
+                        dk[pix[nb[14]]][5][j][6][n]) +
+         v[nb[1]][n] * (dk[pix[nb[26]]][0][j][2][n] +
+                        dk[pix[nb[24]]][4][j][6][n]) +
+         v[nb[2]][n] * (dk[pix[nb[26]]][0][j][1][n] +
+                        dk[pix[nb[4]]][3][j][2][n] +
+                        dk[pix[nb[12]]][7][j][6][n] +
+                        dk[pix[nb[24]]][4][j][5][n]) +
+         v[nb[3]][n] * (dk[pix[nb[4]]][3][j][1][n] +
+                        dk[pix[nb[12]]][7][j][5][n]) +
+         v[nb[4]][n] * (dk[pix[nb[5]]][2][j][1][n] +
+                        dk[pix[nb[4]]][3][j][0][n] +
+                        dk[pix[nb[13]]][6][j][5][n] +
+                        dk[pix[nb[12]]][7][j][4][n]) +
+         v[nb[5]][n] * (dk[pix[nb[5]]][2][j][0][n] +
+                        dk[pix[nb[13]]][6][j][4][n]) +
+         v[nb[6]][n] * (dk[pix[nb[5]]][2][j][3][n] +
+                        dk[pix[nb[6]]][1][j][0][n] +
+                        dk[pix[nb[13]]][6][j][7][n] +
+                        dk[pix[nb[14]]][5][j][4][n]) +
+         v[nb[7]][n] * (dk[pix[nb[6]]][1][j][3][n] +
+                        dk[pix[nb[14]]][5][j][7][n]) +
+         v[nb[8]][n] * (dk[pix[nb[24]]][4][j][3][n] +
+                        dk[pix[nb[14]]][5][j][2][n]) +
+         v[nb[9]][n] * (dk[pix[nb[24]]][4][j][2][n]) +
+         v[nb[10]][n] * (dk[pix[nb[12]]][7][j][2][n] +
+                         dk[pix[nb[24]]][4][j][1][n]) +
+         v[nb[11]][n] * (dk[pix[nb[12]]][7][j][1][n]) +
+         v[nb[12]][n] * (dk[pix[nb[12]]][7][j][0][n] +
+                         dk[pix[nb[13]]][6][j][1][n]) +
+         v[nb[13]][n] * (dk[pix[nb[13]]][6][j][0][n]) +
+         v[nb[14]][n] * (dk[pix[nb[13]]][6][j][3][n] +
+                         dk[pix[nb[14]]][5][j][0][n]) +
+         v[nb[15]][n] * (dk[pix[nb[14]]][5][j][3][n]) +
+         v[nb[16]][n] * (dk[pix[nb[26]]][0][j][7][n] +
+                         dk[pix[nb[6]]][1][j][6][n]) +
+         v[nb[17]][n] * (dk[pix[nb[26]]][0][j][6][n]) +
+         v[nb[18]][n] * (dk[pix[nb[26]]][0][j][5][n] +
+                         dk[pix[nb[4]]][3][j][6][n]) +
+         v[nb[19]][n] * (dk[pix[nb[4]]][3][j][5][n]) +
+         v[nb[20]][n] * (dk[pix[nb[4]]][3][j][4][n] +
+                         dk[pix[nb[5]]][2][j][5][n]) +
+         v[nb[21]][n] * (dk[pix[nb[5]]][2][j][4][n]) +
+         v[nb[22]][n] * (dk[pix[nb[5]]][2][j][7][n] +
+                         dk[pix[nb[6]]][1][j][4][n]) +
+         v[nb[23]][n] * (dk[pix[nb[6]]][1][j][7][n]) +
+         v[nb[24]][n] * (dk[pix[nb[13]]][6][j][2][n] +
+                         dk[pix[nb[12]]][7][j][3][n] +
+                         dk[pix[nb[14]]][5][j][1][n] +
+                         dk[pix[nb[24]]][4][j][0][n]) +
+         v[nb[25]][n] * (dk[pix[nb[5]]][2][j][6][n] +
+                         dk[pix[nb[4]]][3][j][7][n] +
+                         dk[pix[nb[26]]][0][j][4][n] +
+                         dk[pix[nb[6]]][1][j][5][n]) +
+         v[nb[26]][n] * (dk[pix[nb[26]]][0][j][0][n] +
+                         dk[pix[nb[6]]][1][j][1][n] +
+                         dk[pix[nb[5]]][2][j][2][n] +
+                         dk[pix[nb[4]]][3][j][3][n] +
+                         dk[pix[nb[24]]][4][j][4][n] +
+                         dk[pix[nb[14]]][5][j][5][n] +
+                         dk[pix[nb[13]]][6][j][6][n] +
+                         dk[pix[nb[12]]][7][j][7][n]);
+  }
+
+  return (r);
+}
+
+/*  Subroutine that sets up the node stencils for --stencils, after */
+/*  femat has made dk.  For component n, neighbor t and row j, a */
+/*  stencil holds the sum of the dk terms that stiffrow multiplies */
+/*  by v[nb[t]][n], added in the same order, so both give the same */
+/*  A times v.  The eight phases around a node are packed into a */
+/*  key, and the keys are looked up in an open-addressed hash table. */
+/*  Returns 0 if okay, 1 if there are more than MAXPATTERN stencils */
+/*  or no room for them. */
+
+int stencils(int ns) {
+  int m, e, t, j, n, l, pat, nb[27];
+  int *slot;
+  unsigned long long key, *patkey;
+  size_t nslot, hv;
+  double sum, *st;
+
+  nslot = 2 * MAXPATTERN;
+  slot = (int *)malloc(nslot * sizeof(int));
+  patkey = (unsigned long long *)malloc(MAXPATTERN *
+                                        sizeof(unsigned long long));
+  if (!Nodepat) {
+    Nodepat = ivector(Nodecount);
+    if (Nodepat)
+      Nodepat -= Nodebase;
+  }
+  if (!slot || !patkey || !Nodepat) {
+    free(slot);
+    free(patkey);
+    return (1);
+  }
+  for (hv = 0; hv < nslot; hv++) {
+    slot[hv] = -1;
+  }
+
+  Npattern = 0;
+  for (m = Mlo; m < Mhi; m++) {
+    neighbors(m, nb);
+    key = 0;
+    for (e = 0; e < 8; e++) {
+      key |= (unsigned long long)(pix[nb[Elemnb[e]]] & 0xff) << (8 * e);
+    }
+
+    hv = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) % nslot;
+    while (slot[hv] >= 0 && patkey[slot[hv]] != key) {
+      hv = (hv + 1) % nslot;
+    }
+
+    if (slot[hv] < 0) {
+      if (Npattern == Maxstencil) {
+        l = (Maxstencil > 0) ? 2 * Maxstencil : 256;
+        if (l > MAXPATTERN)
+          l = MAXPATTERN;
+        st = NULL;
+        if (Npattern < MAXPATTERN)
+          st = (double *)realloc(Stencil, (size_t)l * 243 * sizeof(double));
+        if (!st) {
+          free(slot);
+          free(patkey);
+          return (1);
+        }
+        Stencil = st;
+        Maxstencil = l;
+      }
+      pat = Npattern++;
+      slot[hv] = pat;
+      patkey[pat] = key;
+      st = Stencil + (size_t)pat * 243;
+      for (j = 0; j < 3; j++) {
+        for (n = 0; n < 3; n++) {
+          for (t = 0; t < 27; t++) {
+            sum = 0.0;
+            for (l = 0; l < Stennum[t]; l++) {
+              e = Stenterm[t][l][0];
+              sum += dk[pix[nb[Elemnb[e]]]][e][j][Stenterm[t][l][1]][n];
+            }
+            st[(n * 27 + t) * 3 + j] = sum;
+          }
+        }
+      }
+    }
+    Nodepat[m] = slot[hv];
+  }
+
+  free(slot);
+  free(patkey);
+
+  return (0);
+}
+
+/*  Subroutine that computes rows 3*m to 3*m+2 of the global matrix */
+/*  A times the vector v, putting them in r, from the stencil pat of */
+/*  node m, whose neighbors are in nb */
+
+void stencilrows(double **v, int *nb, int pat, double *r) {
+  int n, t;
+  double s0, s1, s2, vt;
+  const double *st;
+
+  r[0] = r[1] = r[2] = 0.0;
+  st = Stencil + (size_t)pat * 243;
+  for (n = 0; n < 3; n++) {
+    s0 = s1 = s2 = 0.0;
+    for (t = 0; t < 27; t++) {
+      vt = v[nb[t]][n];
+      s0 += vt * st[0];
+      s1 += vt * st[1];
+      s2 += vt * st[2];
+      st += 3;
+    }
+    r[0] += s0;
+    r[1] += s1;
+    r[2] += s2;
+  }
+
+  return;
+}
+
+/*  The same for --single, with v a float vector of 3*ns values */
+
+void stencilrowsf(float *v, int *nb, int pat, double *r) {
+  int n, t;
+  double s0, s1, s2, vt;
+  const double *st;
+
+  r[0] = r[1] = r[2] = 0.0;
+  st = Stencil + (size_t)pat * 243;
+  for (n = 0; n < 3; n++) {
+    s0 = s1 = s2 = 0.0;
+    for (t = 0; t < 27; t++) {
+      vt = (double)v[3 * nb[t] + n];
+      s0 += vt * st[0];
+      s1 += vt * st[1];
+      s2 += vt * st[2];
+      st += 3;
+    }
+    r[0] += s0;
+    r[1] += s1;
+    r[2] += s2;
+  }
+
+  return;
+}
+
+/*  Subroutine that sets up the preconditioner after femat has made */
+/*  dk.  The diagonal block of A at a node is the sum, over the eight */
+/*  elements around it, of the block of dk that couples the node to */
+/*  itself.  A block that cannot be inverted, like the zero block of */
+/*  a node inside a pore, is treated as its diagonal, and a zero */
+/*  diagonal term as zero.  Returns 0 if okay, 1 if out of memory. */
+
+int precondset(int ns) {
+  int m, e, j, n, nb[27];
+  double d[3][3], det, *p;
+
+  if (Precond == FFTGREEN)
+    return (fftprecondset(ns));
+  if (!Pinv)
+    Pinv = nodevec(9);
+  if (!Zg)
+    Zg = nodevec(3);
+  if (!Pinv || !Zg)
+    return (1);
+
+  for (m = Mlo; m < Mhi; m++) {
+    neighbors(m, nb);
+    for (j = 0; j < 3; j++) {
+      for (n = 0; n < 3; n++) {
+        d[j][n] = 0.0;
+        for (e = 0; e < 8; e++) {
+          d[j][n] += dk[pix[nb[Elemnb[e]]]][e][j][e][n];
+        }
+      }
+    }
+
+    p = Pinv[m];
+    for (j = 0; j < 9; j++) {
+      p[j] = 0.0;
+    }
+
+    det = 0.0;
+    if (Precond == BLOCKJACOBI) {
+      det = d[0][0] * (d[1][1] * d[2][2] - d[1][2] * d[2][1]) -
+            d[0][1] * (d[1][0] * d[2][2] - d[1][2] * d[2][0]) +
+            d[0][2] * (d[1][0] * d[2][1] - d[1][1] * d[2][0]);
+    }
+    if (fabs(det) > 1.0e-12 * fabs(d[0][0] * d[1][1] * d[2][2])) {
+      p[0] = (d[1][1] * d[2][2] - d[1][2] * d[2][1]) / det;
+      p[1] = (d[0][2] * d[2][1] - d[0][1] * d[2][2]) / det;
+      p[2] = (d[0][1] * d[1][2] - d[0][2] * d[1][1]) / det;
+      p[3] = (d[1][2] * d[2][0] - d[1][0] * d[2][2]) / det;
+      p[4] = (d[0][0] * d[2][2] - d[0][2] * d[2][0]) / det;
+      p[5] = (d[0][2] * d[1][0] - d[0][0] * d[1][2]) / det;
+      p[6] = (d[1][0] * d[2][1] - d[1][1] * d[2][0]) / det;
+      p[7] = (d[0][1] * d[2][0] - d[0][0] * d[2][1]) / det;
+      p[8] = (d[0][0] * d[1][1] - d[0][1] * d[1][0]) / det;
+    } else {
+      for (j = 0; j < 3; j++) {
+        if (d[j][j] != 0.0)
+          p[4 * j] = 1.0 / d[j][j];
+      }
+    }
+  }
+
+  return (0);
+}
+
+/*  Subroutine that applies the preconditioner to the gradient, */
+/*  Zg = Pinv * gb, and returns the dot product of gb and Zg, added */
+/*  up by blocks of nodes like the other dot products */
+
+double precondapply(int ns) {
+  int m, j, k, mend;
+  double sum, rz, *p;
+
+  if (Precond == FFTGREEN)
+    return (fftprecondapply(ns));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 1)           \
+    private(m, j, mend, sum, p) if (Nblock > 1)
+#endif
+  for (k = 0; k < Nblock; k++) {
+    sum = 0.0;
+    mend = (k + 1 < Nblock) ? Mlo + (k + 1) * Blocksize : Mhi;
+    for (m = Mlo + k * Blocksize; m < mend; m++) {
+      p = Pinv[m];
+      for (j = 0; j < 3; j++) {
+        Zg[m][j] = p[3 * j] * gb[m][0] + p[3 * j + 1] * gb[m][1] +
+                   p[3 * j + 2] * gb[m][2];
+        sum += gb[m][j] * Zg[m][j];
+      }
+    }
+    Blocksum[k] = sum;
+  }
+
+  rz = slabsum(Blocksum, Nblock);
+
+  return (rz);
+}
+
+/*  Subroutine that sets up the FFT engine (--fft) after femat has */
+/*  made dk.  The reference medium has the moduli of the phases */
+/*  averaged by volume, so its element stiffness is the average of */
+/*  dk, and its stencil couples each node to the 27 nodes around it, */
+/*  the one at offset d getting the blocks of dk from element node r */
+/*  to element node s for every r and s that are d apart.  At a wave */
+/*  vector, its stiffness is the stencil times the cos of the angle */
+/*  to each neighbor, a real symmetric 3 x 3 matrix that is the same */
+/*  at minus the wave vector, and Fftkinv keeps its inverse.  The */
+/*  mean, a rigid translation, gets zero.  Returns 0 if okay, 1 if */
+/*  out of memory or there is no stiff phase. */
+
+int fftprecondset(int ns) {
+  int p, r, s, a, b, d, i, j, k, m, nx, ny, nz, n[3];
+  double *cs, *cx, *cy, *cz, *ki, kk[3][3], w[3][3][2], tr, ti, cr, det;
+  static const int xr[8][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+                               {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}};
+
+  nx = Xsyssize;
+  ny = Ysyssize;
+  nz = Zsyssize;
+  if (!Zg)
+    Zg = nodevec(3);
+  if (!Zg)
+    return (1);
+  if (!Fftkinv) {
+    Fftkinv = dvector(6 * (size_t)ns);
+    Fftcs = dvector(2 * (size_t)(nx + ny + nz));
+    if (!Fftkinv || !Fftcs ||
+        fft3d_alloc(&Fftbuf[0], nz, ny, nx, Nthreads) ||
+        fft3d_alloc(&Fftbuf[1], nz, ny, nx, Nthreads)) {
+      return (1);
+    }
+
+    /* cos and sin of the angle of each frequency along x, y and z */
+
+    n[0] = nx;
+    n[1] = ny;
+    n[2] = nz;
+    cs = Fftcs;
+    for (a = 0; a < 3; a++) {
+      for (i = 0; i < n[a]; i++) {
+        cs[2 * i] = cos(2.0 * PI * (double)i / (double)n[a]);
+        cs[2 * i + 1] = sin(2.0 * PI * (double)i / (double)n[a]);
+      }
+      cs += 2 * n[a];
+    }
+  }
+
+  memset(Fftstencil, 0, sizeof(Fftstencil));
+  for (p = 0; p < Nslot; p++) {
+    if (prob[Slotphase[p]] <= 0.0)
+      continue;
+    for (r = 0; r < 8; r++) {
+      for (s = 0; s < 8; s++) {
+        d = (xr[s][0] - xr[r][0] + 1) + 3 * (xr[s][1] - xr[r][1] + 1) +
+            9 * (xr[s][2] - xr[r][2] + 1);
+        for (a = 0; a < 3; a++) {
+          for (b = 0; b < 3; b++) {
+            Fftstencil[d][a][b] += prob[Slotphase[p]] * dk[p][r][a][s][b];
+          }
+        }
+      }
+    }
+  }
+  if (Fftstencil[13][0][0] <= 0.0)
+    return (1);
+
+  /* w holds exp(i angle) along each axis for offsets -1, 0 and 1 */
+
+  cx = Fftcs;
+  cy = cx + 2 * nx;
+  cz = cy + 2 * ny;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(static)               \
+    private(i, j, m, a, b, d, kk, ki, w, tr, ti, cr, det)
+#endif
+  for (k = 0; k < nz; k++) {
+    for (j = 0; j < ny; j++) {
+      for (i = 0; i < nx; i++) {
+        m = nx * ny * k + nx * j + i;
+        w[0][0][0] = w[0][2][0] = cx[2 * i];
+        w[0][0][1] = -cx[2 * i + 1];
+        w[0][2][1] = cx[2 * i + 1];
+        w[1][0][0] = w[1][2][0] = cy[2 * j];
+        w[1][0][1] = -cy[2 * j + 1];
+        w[1][2][1] = cy[2 * j + 1];
+        w[2][0][0] = w[2][2][0] = cz[2 * k];
+        w[2][0][1] = -cz[2 * k + 1];
+        w[2][2][1] = cz[2 * k + 1];
+        for (a = 0; a < 3; a++) {
+          w[a][1][0] = 1.0;
+          w[a][1][1] = 0.0;
+          for (b = 0; b < 3; b++) {
+            kk[a][b] = 0.0;
+          }
+        }
+        for (d = 0; d < 27; d++) {
+          tr = w[0][d % 3][0] * w[1][d / 3 % 3][0] -
+               w[0][d % 3][1] * w[1][d / 3 % 3][1];
+          ti = w[0][d % 3][0] * w[1][d / 3 % 3][1] +
+               w[0][d % 3][1] * w[1][d / 3 % 3][0];
+          cr = tr * w[2][d / 9][0] - ti * w[2][d / 9][1];
+          for (a = 0; a < 3; a++) {
+            for (b = 0; b < 3; b++) {
+              kk[a][b] += Fftstencil[d][a][b] * cr;
+            }
+          }
+        }
+
+        /* Inverse in the order xx, yy, zz, yz, xz, xy */
+
+        ki = Fftkinv + 6 * (size_t)m;
+        ki[0] = kk[1][1] * kk[2][2] - kk[1][2] * kk[2][1];
+        ki[1] = kk[0][0] * kk[2][2] - kk[0][2] * kk[2][0];
+        ki[2] = kk[0][0] * kk[1][1] - kk[0][1] * kk[1][0];
+        ki[3] = kk[0][2] * kk[1][0] - kk[0][0] * kk[1][2];
+        ki[4] = kk[0][1] * kk[1][2] - kk[0][2] * kk[1][1];
+        ki[5] = kk[0][2] * kk[2][1] - kk[0][1] * kk[2][2];
+        det = kk[0][0] * ki[0] + kk[0][1] * ki[5] + kk[0][2] * ki[4];
+        if (m == 0 ||
+            fabs(det) <= 1.0e-12 * fabs(kk[0][0] * kk[1][1] * kk[2][2])) {
+          det = 0.0;
+        } else {
+          det = 1.0 / det;
+        }
+        for (a = 0; a < 6; a++) {
+          ki[a] *= det;
+        }
+      }
+    }
+  }
+
+  return (0);
+}
+
+/*  Subroutine that applies the FFT engine to the gradient: Zg is */
+/*  the displacement that the forces gb would give in the reference */
+/*  medium, each Fourier coefficient of gb times Fftkinv at its wave */
+/*  vector.  The x and y components go through one transform as its */
+/*  real and imaginary parts, and z through another, so each */
+/*  coefficient is unpacked with the one at minus its wave vector, */
+/*  once for the pair.  Returns the dot product of gb and Zg, added */
+/*  up by blocks of nodes like the other dot products. */
+
+double fftprecondapply(int ns) {
+  int m, mm, i, j, k, nx, ny, nz, nxy, mend;
+  double sum, rz, fr[3], fi[3], zr[3], zi[3], *ki, *da, *db;
+
+  nx = Xsyssize;
+  ny = Ysyssize;
+  nz = Zsyssize;
+  nxy = nx * ny;
+  da = Fftbuf[0].data;
+  db = Fftbuf[1].data;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(static)
+#endif
+  for (m = 0; m < ns; m++) {
+    da[2 * (size_t)m] = gb[m][0];
+    da[2 * (size_t)m + 1] = gb[m][1];
+    db[2 * (size_t)m] = gb[m][2];
+    db[2 * (size_t)m + 1] = 0.0;
+  }
+  fft3d_forward(&Fftbuf[0]);
+  fft3d_forward(&Fftbuf[1]);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(static)               \
+    private(i, j, m, mm, ki, fr, fi, zr, zi)
+#endif
+  for (k = 0; k < nz; k++) {
+    for (j = 0; j < ny; j++) {
+      for (i = 0; i < nx; i++) {
+        m = nxy * k + nx * j + i;
+        mm = nxy * ((nz - k) % nz) + nx * ((ny - j) % ny) + (nx - i) % nx;
+        if (mm < m)
+          continue;
+
+        fr[0] = 0.5 * (da[2 * (size_t)m] + da[2 * (size_t)mm]);
+        fi[0] = 0.5 * (da[2 * (size_t)m + 1] - da[2 * (size_t)mm + 1]);
+        fr[1] = 0.5 * (da[2 * (size_t)m + 1] + da[2 * (size_t)mm + 1]);
+        fi[1] = -0.5 * (da[2 * (size_t)m] - da[2 * (size_t)mm]);
+        fr[2] = db[2 * (size_t)m];
+        fi[2] = db[2 * (size_t)m + 1];
+        ki = Fftkinv + 6 * (size_t)m;
+        zr[0] = ki[0] * fr[0] + ki[5] * fr[1] + ki[4] * fr[2];
+        zi[0] = ki[0] * fi[0] + ki[5] * fi[1] + ki[4] * fi[2];
+        zr[1] = ki[5] * fr[0] + ki[1] * fr[1] + ki[3] * fr[2];
+        zi[1] = ki[5] * fi[0] + ki[1] * fi[1] + ki[3] * fi[2];
+        zr[2] = ki[4] * fr[0] + ki[3] * fr[1] + ki[2] * fr[2];
+        zi[2] = ki[4] * fi[0] + ki[3] * fi[1] + ki[2] * fi[2];
+
+        da[2 * (size_t)m] = zr[0] - zi[1];
+        da[2 * (size_t)m + 1] = zi[0] + zr[1];
+        da[2 * (size_t)mm] = zr[0] + zi[1];
+        da[2 * (size_t)mm + 1] = zr[1] - zi[0];
+        db[2 * (size_t)m] = zr[2];
+        db[2 * (size_t)m + 1] = zi[2];
+        db[2 * (size_t)mm] = zr[2];
+        db[2 * (size_t)mm + 1] = -zi[2];
+      }
+    }
+  }
+
+  fft3d_inverse(&Fftbuf[0]);
+  fft3d_inverse(&Fftbuf[1]);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 1)           \
+    private(m, mend, sum) if (Nblock > 1)
+#endif
+  for (k = 0; k < Nblock; k++) {
+    sum = 0.0;
+    mend = (k + 1 < Nblock) ? (k + 1) * Blocksize : ns;
+    for (m = k * Blocksize; m < mend; m++) {
+      Zg[m][0] = da[2 * (size_t)m] / (double)ns;
+      Zg[m][1] = da[2 * (size_t)m + 1] / (double)ns;
+      Zg[m][2] = db[2 * (size_t)m] / (double)ns;
+      sum += gb[m][0] * Zg[m][0] + gb[m][1] * Zg[m][1] + gb[m][2] * Zg[m][2];
+    }
+    Blocksum[k] = sum;
+  }
+
+  rz = 0.0;
+  for (k = 0; k < Nblock; k++) {
+    rz += Blocksum[k];
+  }
+
+  return (rz);
+}
+
+/*  Subroutine that sets the blocks of nodes that dembx and energy */
+/*  share out among the threads.  Each block's part of a dot product */
+/*  is added up on its own, and the parts are then added in block */
+/*  order, so the sum does not depend on which thread did a block. */
+/*  With --fixed-order the blocks are NODEBLOCK nodes long whatever */
+/*  the number of threads, one thread included, so the result does */
+/*  not depend on that number either; otherwise there is one block */
+/*  per thread, and a serial run has one block and adds up in the */
+/*  original order. */
+/*  Under mpirun a block is a layer of the rank's slab, whose sums */
+/*  slabsum adds in the order of the layers over all of the ranks. */
+/*  ns is the number of nodes of the slab. */
+
+void nodeblocks(int ns) {
+  Blocksize = ns;
+  if (Mpisize > 1) {
+    Blocksize = Xsyssize * Ysyssize;
+  } else if (Nthreads > 1 || Fixedorder) {
+    Blocksize = Fixedorder ? NODEBLOCK : (ns + Nthreads - 1) / Nthreads;
+  }
+  Nblock = (ns + Blocksize - 1) / Blocksize;
+
+  return;
+}
+
+/*  Subroutine that adds the displacements saved in file name to u, */
+/*  which must already hold the homogeneous applied strain.  Returns */
+/*  0 if okay, 1 if there is no such file, 2 if the file is for a */
+/*  system of another size or is cut short.  u is only changed if */
+/*  the whole file can be read.  The file is read into gb, which is */
+/*  found again from u before the relaxation uses it, so that no */
+/*  more memory is needed.  Under mpirun each rank reads the nodes */
+/*  of its own slab, and u is only changed if every rank can. */
+
+int loaddisp(char *name, int nx, int ny, int nz) {
+  int m, j, size[3], status;
+  size_t n;
+  FILE *fp;
+
+  status = 1;
+  fp = fopen(name, "rb");
+  if (fp) {
+    n = 3 * (size_t)(Mhi - Mlo);
+    status = 0;
+    if (fread(size, sizeof(int), 3, fp) != 3 || size[0] != nx ||
+        size[1] != ny || size[2] != nz ||
+        fseek(fp, (long)(3 * sizeof(double)) * Mlo, SEEK_CUR) ||
+        fread(gb[Mlo], sizeof(double), n, fp) != n) {
+      status = 2;
+    }
+    fclose(fp);
+  }
+  status = slabmax(status);
+  if (status)
+    return (status);
+
+  for (m = Mlo; m < Mhi; m++) {
+    for (j = 0; j < 3; j++) {
+      u[m][j] += gb[m][j];
+    }
+  }
+
+  return (0);
+}
+
+/*  Subroutine that writes u, less the homogeneous applied strain, */
+/*  to file name for loaddisp.  Returns 0 if okay, 1 if the file */
+/*  cannot be written.  Under mpirun the ranks take turns, each */
+/*  adding the nodes of its own slab to the file. */
+
+int savedisp(char *name, int nx, int ny, int nz) {
+  int i, j, k, m, r, size[3], status;
+  double x, y, z, d[3];
+  FILE *fp;
+
+  status = 0;
+  for (r = 0; r < Mpisize; r++) {
+    fp = NULL;
+    if (r == Mpirank) {
+      fp = fopen(name, (r == 0) ? "wb" : "ab");
+      if (!fp)
+        status = 1;
+    }
+    if (fp && r == 0) {
+      size[0] = nx;
+      size[1] = ny;
+      size[2] = nz;
+      status = (fwrite(size, sizeof(int), 3, fp) != 3);
+    }
+    for (k = Zlo; k < Zhi && fp && !status; k++) {
+      for (j = 0; j < ny && !status; j++) {
+        for (i = 0; i < nx && !status; i++) {
+          m = nx * ny * k + nx * j + i;
+          x = (double)i;
+          y = (double)j;
+          z = (double)k;
+          d[0] = u[m][0] - (x * exx + y * exy + z * exz);
+          d[1] = u[m][1] - (x * exy + y * eyy + z * eyz);
+          d[2] = u[m][2] - (x * exz + y * eyz + z * ezz);
+          status = (fwrite(d, sizeof(double), 3, fp) != 3);
         }
       }
-      b[ib[m][is[mm]]][nn] += sum;
     }
+    if (fp && fclose(fp))
+      status = 1;
+    slabturn();
   }
+
+  return (slabmax(status));
 }
 
-/*  Subroutine computes the total energy, utot, and the gradient, gb */
+/*  Subroutine that writes the results of the relaxation to fp, a */
+/*  file of the result cache (--cache), or with writing 0 reads them */
+/*  back in their place: the applied strains, the total stresses and */
+/*  strains, the stresses of each phase that stress adds up, the */
+/*  strain energy of each pixel and, for an ITZ run, the moduli of */
+/*  each layer.  Returns 0 if okay, 1 if they could not all be */
+/*  written or read, in which case nothing is changed. */
+
+int cacheio(FILE *fp, int ns, int doitz, int writing) {
+  int i, status;
+  double e[6], t[12];
+  double sa[NSP][12];
+
+  e[0] = exx;
+  e[1] = eyy;
+  e[2] = ezz;
+  e[3] = exz;
+  e[4] = eyz;
+  e[5] = exy;
+  t[0] = strxxt;
+  t[1] = stryyt;
+  t[2] = strzzt;
+  t[3] = strxzt;
+  t[4] = stryzt;
+  t[5] = strxyt;
+  t[6] = sxxt;
+  t[7] = syyt;
+  t[8] = szzt;
+  t[9] = sxzt;
+  t[10] = syzt;
+  t[11] = sxyt;
+  for (i = 0; i < NSP; i++)
+    memcpy(sa[i], stressall[i], sizeof(sa[i]));
+
+  /*  The energy and layer moduli are read straight into place; */
+  /*  if the rest cannot be read, stress finds them again */
+
+  if (writing) {
+    status = (fwrite(e, sizeof(double), 6, fp) != 6 ||
+              fwrite(t, sizeof(double), 12, fp) != 12 ||
+              fwrite(sa, sizeof(double), NSP * 12, fp) != NSP * 12 ||
+              fwrite(Energy, sizeof(double), ns, fp) != (size_t)ns);
+    if (!status && doitz) {
+      status = (fwrite(K, sizeof(double), Xsyssize, fp) != Xsyssize ||
+                fwrite(G, sizeof(double), Xsyssize, fp) != Xsyssize);
+    }
+    return (status);
+  }
 
-double energy(int nx, int ny, int nz, int ns) {
-  int m;
-  int m3, j, n;
-  double utot = 0.0;
+  status = (fread(e, sizeof(double), 6, fp) != 6 ||
+            fread(t, sizeof(double), 12, fp) != 12 ||
+            fread(sa, sizeof(double), NSP * 12, fp) != NSP * 12 ||
+            fread(Energy, sizeof(double), ns, fp) != (size_t)ns);
+  if (!status && doitz) {
+    status = (fread(K, sizeof(double), Xsyssize, fp) != Xsyssize ||
+              fread(G, sizeof(double), Xsyssize, fp) != Xsyssize);
+  }
+  if (status)
+    return (1);
 
-  for (m = 0; m < ns; m++) {
-    for (m3 = 0; m3 < 3; m3++) {
-      gb[m][m3] = 0.0;
-    }
+  exx = e[0];
+  eyy = e[1];
+  ezz = e[2];
+  exz = e[3];
+  eyz = e[4];
+  exy = e[5];
+  strxxt = t[0];
+  stryyt = t[1];
+  strzzt = t[2];
+  strxzt = t[3];
+  stryzt = t[4];
+  strxyt = t[5];
+  sxxt = t[6];
+  syyt = t[7];
+  szzt = t[8];
+  sxzt = t[9];
+  syzt = t[10];
+  sxyt = t[11];
+  for (i = 0; i < NSP; i++)
+    memcpy(stressall[i], sa[i], sizeof(sa[i]));
+
+  return (0);
+}
+
+/*  Function that gives the most memory, in bytes, that elastic will */
+/*  need for a system of ns nodes with the options chosen, and writes */
+/*  what it is made of to fp.  The arrays kept through the relaxation */
+/*  are listed first.  The image buffer of ppixel, and the double */
+/*  directions that --single frees, are needed only for a while, and */
+/*  the larger of them is added to give the peak.  The stencils are */
+/*  counted at MAXPATTERN, the most there can be, since how many the */
+/*  image has is not known until they are made.  Under mpirun it is */
+/*  the memory of one rank, which keeps the vectors only for the */
+/*  nodes of its slab. */
+
+double memplan(int ns, int doitz, FILE *fp) {
+  int i, n;
+  double dns, dnode, item[8], kept, extra, have;
+  char *name[8];
+
+  dns = (double)ns;
+  dnode = (double)Nodecount;
+  n = 0;
+  if (Singleh) {
+    name[n] = "Displacements and gradients (u, gb, b, Ah)";
+    item[n++] = 12.0 * sizeof(double) * dnode;
+    name[n] = "Single-precision directions (h)";
+    item[n++] = 3.0 * sizeof(float) * dnode;
+  } else {
+    name[n] = "Displacements, gradients and directions (u, gb, b, h, Ah)";
+    item[n++] = 15.0 * sizeof(double) * dnode;
+  }
+  name[n] = "Phases, particles and energies (pix, part, Energy)";
+  item[n++] = 2.0 * sizeof(short int) * (dns + Pixoff) +
+              sizeof(double) * dnode +
+              sizeof(double) * (double)Xsyssize * LAYERSUM;
+  if (Usestencil) {
+    name[n] = "Node stencils (at most)";
+    item[n++] = sizeof(int) * dnode +
+                (double)MAXPATTERN * (243.0 * sizeof(double) +
+                                      2.0 * sizeof(int) +
+                                      sizeof(unsigned long long));
+  }
+  if (Precond == FFTGREEN) {
+    name[n] = "FFT engine (Zg, Fftkinv and two transforms)";
+    item[n++] = 13.0 * sizeof(double) * dnode;
+  } else if (Precond) {
+    name[n] = "Preconditioner (Pinv, Zg)";
+    item[n++] = 12.0 * sizeof(double) * dnode;
   }
+  if (doitz) {
+    name[n] = "ITZ layer matrices";
+    item[n++] = sizeof(double) * ((double)Xsyssize * (36.0 + 2.0 * 36.0 * 36.0 + 2.0) +
+                                  36.0 * 37.0 + 36.0);
+  }
+
+  extra = Singleh ? 3.0 * sizeof(double) * dnode : dns;
+
+  fprintf(fp, "\nMemory plan for %d x %d x %d = %d nodes", Xsyssize,
+          Ysyssize, Zsyssize, ns);
+  if (Mpisize > 1)
+    fprintf(fp, ", for each of %d MPI ranks", Mpisize);
+  fprintf(fp, ":\n");
+  kept = 0.0;
+  for (i = 0; i < n; i++) {
+    fprintf(fp, "\t%-60s %9.3f GB\n", name[i], item[i] / MEMGB);
+    kept += item[i];
+  }
+  fprintf(fp, "\t%-60s %9.3f GB\n", "Kept through the relaxation",
+          kept / MEMGB);
+  fprintf(fp, "\t%-60s %9.3f GB\n",
+          Singleh ? "Peak, with the double directions before --single"
+                  : "Peak, with the image buffer",
+          (kept + extra) / MEMGB);
+  have = physmem();
+  if (have > 0.0) {
+    fprintf(fp, "\t%-60s %9.3f GB\n", "Memory of this machine", have / MEMGB);
+  }
+  fflush(fp);
+
+  return (kept + extra);
+}
+
+/*  Function that gives the physical memory of the machine, in bytes, */
+/*  or 0 if it cannot be found */
+
+double physmem(void) {
+#if !defined(_WIN32) && defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+  long pages, size;
+
+  pages = sysconf(_SC_PHYS_PAGES);
+  size = sysconf(_SC_PAGESIZE);
+  if (pages > 0 && size > 0)
+    return ((double)pages * (double)size);
+#endif
+
+  return (0.0);
+}
+
+/*  Subroutine computes the total energy, utot, and the gradient, gb */
+
+double energy(int nx, int ny, int nz, int ns) {
+  int m, j, k, mend, nb[27];
+  double utot, sum, row[3];
 
   /*  Do global matrix multiply via small stiffness matrices, gb = A * u */
-  /*  The long statement below correctly brings in all the terms from  */
-  /*  the global matrix A using only the small stiffness matrices. */
-  utot = C;
-  for (m = 0; m < ns; m++) {
-    for (j = 0; j < 3; j++) {
-      for (n = 0; n < 3; n++) {
-        gb[m][j] += u[ib[m][0]][n] * (dk[pix[ib[m][26]]][0][j][3][n] +
-                                      dk[pix[ib[m][6]]][1][j][2][n] +
-                                      dk[pix[ib[m][24]]][4][j][7][n] +
-                                      dk[pix[ib[m][14]]][5][j][6][n]) +
-                    u[ib[m][1]][n] * (dk[pix[ib[m][26]]][0][j][2][n] +
-                                      dk[pix[ib[m][24]]][4][j][6][n]) +
-                    u[ib[m][2]][n] * (dk[pix[ib[m][26]]][0][j][1][n] +
-                                      dk[pix[ib[m][4]]][3][j][2][n] +
-                                      dk[pix[ib[m][12]]][7][j][6][n] +
-                                      dk[pix[ib[m][24]]][4][j][5][n]) +
-                    u[ib[m][3]][n] * (dk[pix[ib[m][4]]][3][j][1][n] +
-                                      dk[pix[ib[m][12]]][7][j][5][n]) +
-                    u[ib[m][4]][n] * (dk[pix[ib[m][5]]][2][j][1][n] +
-                                      dk[pix[ib[m][4]]][3][j][0][n] +
-                                      dk[pix[ib[m][13]]][6][j][5][n] +
-                                      dk[pix[ib[m][12]]][7][j][4][n]) +
-                    u[ib[m][5]][n] * (dk[pix[ib[m][5]]][2][j][0][n] +
-                                      dk[pix[ib[m][13]]][6][j][4][n]) +
-                    u[ib[m][6]][n] * (dk[pix[ib[m][5]]][2][j][3][n] +
-                                      dk[pix[ib[m][6]]][1][j][0][n] +
-                                      dk[pix[ib[m][13]]][6][j][7][n] +
-                                      dk[pix[ib[m][14]]][5][j][4][n]) +
-                    u[ib[m][7]][n] * (dk[pix[ib[m][6]]][1][j][3][n] +
-                                      dk[pix[ib[m][14]]][5][j][7][n]) +
-                    u[ib[m][8]][n] * (dk[pix[ib[m][24]]][4][j][3][n] +
-                                      dk[pix[ib[m][14]]][5][j][2][n]) +
-                    u[ib[m][9]][n] * (dk[pix[ib[m][24]]][4][j][2][n]) +
-                    u[ib[m][10]][n] * (dk[pix[ib[m][12]]][7][j][2][n] +
-                                       dk[pix[ib[m][24]]][4][j][1][n]) +
-                    u[ib[m][11]][n] * (dk[pix[ib[m][12]]][7][j][1][n]) +
-                    u[ib[m][12]][n] * (dk[pix[ib[m][12]]][7][j][0][n] +
-                                       dk[pix[ib[m][13]]][6][j][1][n]) +
-                    u[ib[m][13]][n] * (dk[pix[ib[m][13]]][6][j][0][n]) +
-                    u[ib[m][14]][n] * (dk[pix[ib[m][13]]][6][j][3][n] +
-                                       dk[pix[ib[m][14]]][5][j][0][n]) +
-                    u[ib[m][15]][n] * (dk[pix[ib[m][14]]][5][j][3][n]) +
-                    u[ib[m][16]][n] * (dk[pix[ib[m][26]]][0][j][7][n] +
-                                       dk[pix[ib[m][6]]][1][j][6][n]) +
-                    u[ib[m][17]][n] * (dk[pix[ib[m][26]]][0][j][6][n]) +
-                    u[ib[m][18]][n] * (dk[pix[ib[m][26]]][0][j][5][n] +
-                                       dk[pix[ib[m][4]]][3][j][6][n]) +
-                    u[ib[m][19]][n] * (dk[pix[ib[m][4]]][3][j][5][n]) +
-                    u[ib[m][20]][n] * (dk[pix[ib[m][4]]][3][j][4][n] +
-                                       dk[pix[ib[m][5]]][2][j][5][n]) +
-                    u[ib[m][21]][n] * (dk[pix[ib[m][5]]][2][j][4][n]) +
-                    u[ib[m][22]][n] * (dk[pix[ib[m][5]]][2][j][7][n] +
-                                       dk[pix[ib[m][6]]][1][j][4][n]) +
-                    u[ib[m][23]][n] * (dk[pix[ib[m][6]]][1][j][7][n]) +
-                    u[ib[m][24]][n] * (dk[pix[ib[m][13]]][6][j][2][n] +
-                                       dk[pix[ib[m][12]]][7][j][3][n] +
-                                       dk[pix[ib[m][14]]][5][j][1][n] +
-                                       dk[pix[ib[m][24]]][4][j][0][n]) +
-                    u[ib[m][25]][n] * (dk[pix[ib[m][5]]][2][j][6][n] +
-                                       dk[pix[ib[m][4]]][3][j][7][n] +
-                                       dk[pix[ib[m][26]]][0][j][4][n] +
-                                       dk[pix[ib[m][6]]][1][j][5][n]) +
-                    u[ib[m][26]][n] * (dk[pix[ib[m][26]]][0][j][0][n] +
-                                       dk[pix[ib[m][6]]][1][j][1][n] +
-                                       dk[pix[ib[m][5]]][2][j][2][n] +
-                                       dk[pix[ib[m][4]]][3][j][3][n] +
-                                       dk[pix[ib[m][24]]][4][j][4][n] +
-                                       dk[pix[ib[m][14]]][5][j][5][n] +
-                                       dk[pix[ib[m][13]]][6][j][6][n] +
-                                       dk[pix[ib[m][12]]][7][j][7][n]);
-      }
-      utot += (u[m][j] * (0.5 * gb[m][j] + b[m][j]));
-      gb[m][j] += b[m][j];
+  /*  The constant C goes in with the first block of nodes.  Under */
+  /*  mpirun, u is brought in from the slabs next to this one first. */
+  slabhalo(u[Nodebase], 3 * nx * ny, Zhi - Zlo);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 1)           \
+    private(m, j, mend, sum, nb, row) if (Nblock > 1)
+#endif
+  for (k = 0; k < Nblock; k++) {
+    sum = (k == 0 && Mpirank == 0) ? C : 0.0;
+    mend = (k + 1 < Nblock) ? Mlo + (k + 1) * Blocksize : Mhi;
+    for (m = Mlo + k * Blocksize; m < mend; m++) {
+      neighbors(m, nb);
+      if (Nodepat)
+        stencilrows(u, nb, Nodepat[m], row);
+      for (j = 0; j < 3; j++) {
+        gb[m][j] = Nodepat ? row[j] : stiffrow(u, nb, j);
+        sum += (u[m][j] * (0.5 * gb[m][j] + b[m][j]));
+        gb[m][j] += b[m][j];
+      }
     }
+    Blocksum[k] = sum;
   }
 
+  utot = slabsum(Blocksum, Nblock);
+
   return (utot);
 }
 
@@ -1272,9 +2726,12 @@ void stress(int nx, int ny, int nz, int ns, int doitz, int micro, int ilast) {
   double uu[8][3];
   double dndx[8], dndy[8], dndz[8], es[6][8][3];
   int nxy, nyz, n1, n2, n3, k, j, i, mm, n8, n;
-  int m;
+  int m, nb[27], lp;
   double str11, str12, str13, str22, str23, str33;
   double s11, s12, s13, s22, s23, s33;
+  double strxx, stryy, strzz, strxz, stryz, strxy;
+  double sxx, syy, szz, sxz, syz, sxy;
+  double *ls;
 
   nxy = nx * ny;
   nyz = ny * nz;
@@ -1349,34 +2806,39 @@ void stress(int nx, int ny, int nz, int ns, int doitz, int micro, int ilast) {
 
   /*  Compute components of the average stress and strain tensors in each pixel
    */
+  /*  The layers of constant x are independent, so they are shared out */
+  /*  among the threads.  Each layer adds up its own totals, for all */
+  /*  pixels and for each phase, in Layersum, and the layers are added */
+  /*  in order afterwards, so the result does not depend on the */
+  /*  number of threads.  Under mpirun each rank does the pixels of */
+  /*  its own slab, with u brought in from the slab above, and the */
+  /*  sums of the layers are then added up over the ranks. */
+  slabhalo(u[Nodebase], 3 * nxy, Zhi - Zlo);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 1)           \
+    private(j, k, m, mm, n, n3, n8, nb, uu, str11, str12, str13, str22, str23, \
+                str33, s11, s12, s13, s22, s23, s33, ls)
+#endif
   for (i = 0; i < nx; i++) {
-    strxx = 0.0;
-    stryy = 0.0;
-    strzz = 0.0;
-    strxz = 0.0;
-    stryz = 0.0;
-    strxy = 0.0;
-    sxx = 0.0;
-    syy = 0.0;
-    szz = 0.0;
-    sxz = 0.0;
-    syz = 0.0;
-    sxy = 0.0;
-    for (k = 0; k < nz; k++) {
+    ls = Layersum + (size_t)i * LAYERSUM;
+    for (j = 0; j < LAYERSUM; j++) {
+      ls[j] = 0.0;
+    }
+    for (k = Zlo; k < Zhi; k++) {
       for (j = 0; j < ny; j++) {
         m = k * nxy + j * nx + i;
+        neighbors(m, nb);
 
-        /*  load in elements of 8-vector using pd. bd. conds. */
 
         for (mm = 0; mm < 3; mm++) {
           uu[0][mm] = u[m][mm];
-          uu[1][mm] = u[ib[m][2]][mm];
-          uu[2][mm] = u[ib[m][1]][mm];
-          uu[3][mm] = u[ib[m][0]][mm];
-          uu[4][mm] = u[ib[m][25]][mm];
-          uu[5][mm] = u[ib[m][18]][mm];
-          uu[6][mm] = u[ib[m][17]][mm];
-          uu[7][mm] = u[ib[m][16]][mm];
+          uu[1][mm] = u[nb[2]][mm];
+          uu[2][mm] = u[nb[1]][mm];
+          uu[3][mm] = u[nb[0]][mm];
+          uu[4][mm] = u[nb[25]][mm];
+          uu[5][mm] = u[nb[18]][mm];
+          uu[6][mm] = u[nb[17]][mm];
+          uu[7][mm] = u[nb[16]][mm];
         }
 
         /*  Correct for periodic boundary conditions, some displacements are
@@ -1463,71 +2925,47 @@ void stress(int nx, int ny, int nz, int ns, int doitz, int micro, int ilast) {
           }
         }
 
-        /*  sum local strains and stresses into global values */
-
-        strxx += str11;
-        stryy += str22;
-        strzz += str33;
-        strxy += str12;
-        strxz += str13;
-        stryz += str23;
-        sxx += s11;
-        syy += s22;
-        szz += s33;
-        sxy += s12;
-        sxz += s13;
-        syz += s23;
+        /*  The strain energy of the pixel, for energy.img */
 
-        /***
-         *	These variables originally defined to add up
-         *	over all layers when calculating full
-         *	elastic stiffness tensor (all 36 components)
-         *
-         *	Now, when not doing full stiffness tensor, this
-         *	is used for total instead of layer averages
-         *	(see below)
-         ***/
+        if (ilast) {
+          Energy[m] = 0.5 * ((str11 * s11) + (str22 * s22) + (str33 * s33) +
+                             (str12 * s12) + (str13 * s13) + (str23 * s23));
+        }
 
-        stressxx[m] = str11;
-        stressyy[m] = str22;
-        stresszz[m] = str33;
-        stressxy[m] = str12;
-        stressxz[m] = str13;
-        stressyz[m] = str23;
-        strainxx[m] = s11;
-        strainyy[m] = s22;
-        strainzz[m] = s33;
-        strainxy[m] = s12;
-        strainxz[m] = s13;
-        strainyz[m] = s23;
-
-        strxxt += str11;
-        stryyt += str22;
-        strzzt += str33;
-        strxyt += str12;
-        strxzt += str13;
-        stryzt += str23;
-        sxxt += s11;
-        syyt += s22;
-        szzt += s33;
-        sxyt += s12;
-        sxzt += s13;
-        syzt += s23;
-
-        stressall[pix[m]][0] += str11;
-        stressall[pix[m]][1] += str22;
-        stressall[pix[m]][2] += str33;
-        stressall[pix[m]][3] += str12;
-        stressall[pix[m]][4] += str13;
-        stressall[pix[m]][5] += str23;
-        stressall[pix[m]][6] += s11;
-        stressall[pix[m]][7] += s22;
-        stressall[pix[m]][8] += s33;
-        stressall[pix[m]][9] += s12;
-        stressall[pix[m]][10] += s13;
-        stressall[pix[m]][11] += s23;
+        ls[0] += str11;
+        ls[1] += str22;
+        ls[2] += str33;
+        ls[3] += str12;
+        ls[4] += str13;
+        ls[5] += str23;
+        ls[6] += s11;
+        ls[7] += s22;
+        ls[8] += s33;
+        ls[9] += s12;
+        ls[10] += s13;
+        ls[11] += s23;
+
+        lp = 12 * (Slotphase[pix[m]] + 1);
+        ls[lp] += str11;
+        ls[lp + 1] += str22;
+        ls[lp + 2] += str33;
+        ls[lp + 3] += str12;
+        ls[lp + 4] += str13;
+        ls[lp + 5] += str23;
+        ls[lp + 6] += s11;
+        ls[lp + 7] += s22;
+        ls[lp + 8] += s33;
+        ls[lp + 9] += s12;
+        ls[lp + 10] += s13;
+        ls[lp + 11] += s23;
       }
     }
+  }
+
+  slabreduce(Layersum, nx * LAYERSUM);
+
+  for (i = 0; i < nx; i++) {
+    ls = Layersum + (size_t)i * LAYERSUM;
 
     /* Averaging depends on whether layer averaging (doitz) was chosen or not */
 
@@ -1535,6 +2973,18 @@ void stress(int nx, int ny, int nz, int ns, int doitz, int micro, int ilast) {
 
       /*  Layer average of stresses and strains in each layer */
 
+      strxx = ls[0];
+      stryy = ls[1];
+      strzz = ls[2];
+      strxy = ls[3];
+      strxz = ls[4];
+      stryz = ls[5];
+      sxx = ls[6];
+      syy = ls[7];
+      szz = ls[8];
+      sxy = ls[9];
+      sxz = ls[10];
+      syz = ls[11];
       strxx /= (double)nyz;
       stryy /= (double)nyz;
       strzz /= (double)nyz;
@@ -1592,6 +3042,29 @@ void stress(int nx, int ny, int nz, int ns, int doitz, int micro, int ilast) {
     }
   }
 
+  /*  Add up the layers in order */
+
+  for (i = 0; i < nx; i++) {
+    ls = Layersum + (size_t)i * LAYERSUM;
+    strxxt += ls[0];
+    stryyt += ls[1];
+    strzzt += ls[2];
+    strxyt += ls[3];
+    strxzt += ls[4];
+    stryzt += ls[5];
+    sxxt += ls[6];
+    syyt += ls[7];
+    szzt += ls[8];
+    sxyt += ls[9];
+    sxzt += ls[10];
+    syzt += ls[11];
+    for (n = 0; n < NSP; n++) {
+      for (j = 0; j < 12; j++) {
+        stressall[n][j] += ls[12 * (n + 1) + j];
+      }
+    }
+  }
+
   if (ilast) {
 
     /***
@@ -1626,10 +3099,10 @@ void stress(int nx, int ny, int nz, int ns, int doitz, int micro, int ilast) {
 }
 
 int dembx(int ns, int ldemb, int kkk) {
-  double lambda, gamma, hAh, gglast, Ahtemp;
+  double lambda, gamma, hAh, gglast, sum, row[3], rz, hv;
   int Lstep;
-  int m3, ijk, j, n;
-  int m;
+  int m3, ijk, j, k, mend;
+  int m, nb[27];
 
   /*
   printf("In dembx now, ldemb = %d gg = %lf gtest = %lf...\n",ldemb,gg,gtest);
@@ -1640,15 +3113,36 @@ int dembx(int ns, int ldemb, int kkk) {
   /*  value of h determined in the previous call. Of course, if npoints is */
   /*  greater than 1, this initialization step will be run for every new */
   /*  microstructure used, as kkk is reset to 1 every time the counter micro */
-  /*  is increased. */
+  /*  is increased.  With a preconditioner, the direction starts from */
+  /*  the preconditioned gradient Zg instead of gb, and Rz takes the */
+  /*  place of gg in the step lengths; it is found afresh from the */
+  /*  gradient that energy has just computed.  With --single the */
+  /*  direction is kept in Hf instead of h, and with --gpu the steps */
+  /*  are done on the device by dembxgpu.  Under mpirun the nodes are */
+  /*  those of this rank's slab, Mlo to Mhi, with the direction */
+  /*  brought in from the slabs next to it before each product. */
+#ifdef _OPENMP
+  if (Gpu && Nodepat && !Hf)
+    return (dembxgpu(ns, ldemb, kkk));
+#endif
+
+  if (Precond)
+    Rz = precondapply(ns);
+
   if (kkk == 0) {
     /*
     printf("First dembx call\n");
     fflush(stdout);
     */
-    for (m = 0; m < ns; m++) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) private(m3) if (Nblock > 1)
+#endif
+    for (m = Mlo; m < Mhi; m++) {
       for (m3 = 0; m3 < 3; m3++) {
-        h[m][m3] = gb[m][m3];
+        if (Hf)
+          Hf[3 * m + m3] = (float)(Precond ? Zg[m][m3] : gb[m][m3]);
+        else
+          h[m][m3] = Precond ? Zg[m][m3] : gb[m][m3];
       }
     }
   }
@@ -1664,168 +3158,90 @@ int dembx(int ns, int ldemb, int kkk) {
     */
     Lstep += 1;
 
-    /*  Do global matrix multiply via small stiffness matrices, Ahtemp = A * h
+    /*  Do global matrix multiply via small stiffness matrices, Ah = A * h,
      */
-    /*  The long statement below correctly brings in all the terms from */
-    /*  the global matrix A using only the small stiffness matrices dk. */
-    hAh = 0.0;
-    for (m = 0; m < ns; m++) {
-      for (j = 0; j < 3; j++) {
-        Ahtemp = 0.0;
-        for (n = 0; n < 3; n++) {
-          Ahtemp += h[ib[m][0]][n] * (dk[pix[ib[m][26]]][0][j][3][n] +
-                                      dk[pix[ib[m][6]]][1][j][2][n] +
-                                      dk[pix[ib[m][24]]][4][j][7][n] +
-                                      dk[pix[ib[m][14]]][5][j][6][n]) +
-                    h[ib[m][1]][n] * (dk[pix[ib[m][26]]][0][j][2][n] +
-                                      dk[pix[ib[m][24]]][4][j][6][n]) +
-                    h[ib[m][2]][n] * (dk[pix[ib[m][26]]][0][j][1][n] +
-                                      dk[pix[ib[m][4]]][3][j][2][n] +
-                                      dk[pix[ib[m][12]]][7][j][6][n] +
-                                      dk[pix[ib[m][24]]][4][j][5][n]) +
-                    h[ib[m][3]][n] * (dk[pix[ib[m][4]]][3][j][1][n] +
-                                      dk[pix[ib[m][12]]][7][j][5][n]) +
-                    h[ib[m][4]][n] * (dk[pix[ib[m][5]]][2][j][1][n] +
-                                      dk[pix[ib[m][4]]][3][j][0][n] +
-                                      dk[pix[ib[m][13]]][6][j][5][n] +
-                                      dk[pix[ib[m][12]]][7][j][4][n]) +
-                    h[ib[m][5]][n] * (dk[pix[ib[m][5]]][2][j][0][n] +
-                                      dk[pix[ib[m][13]]][6][j][4][n]) +
-                    h[ib[m][6]][n] * (dk[pix[ib[m][5]]][2][j][3][n] +
-                                      dk[pix[ib[m][6]]][1][j][0][n] +
-                                      dk[pix[ib[m][13]]][6][j][7][n] +
-                                      dk[pix[ib[m][14]]][5][j][4][n]) +
-                    h[ib[m][7]][n] * (dk[pix[ib[m][6]]][1][j][3][n] +
-                                      dk[pix[ib[m][14]]][5][j][7][n]) +
-                    h[ib[m][8]][n] * (dk[pix[ib[m][24]]][4][j][3][n] +
-                                      dk[pix[ib[m][14]]][5][j][2][n]) +
-                    h[ib[m][9]][n] * (dk[pix[ib[m][24]]][4][j][2][n]) +
-                    h[ib[m][10]][n] * (dk[pix[ib[m][12]]][7][j][2][n] +
-                                       dk[pix[ib[m][24]]][4][j][1][n]) +
-                    h[ib[m][11]][n] * (dk[pix[ib[m][12]]][7][j][1][n]) +
-                    h[ib[m][12]][n] * (dk[pix[ib[m][12]]][7][j][0][n] +
-                                       dk[pix[ib[m][13]]][6][j][1][n]) +
-                    h[ib[m][13]][n] * (dk[pix[ib[m][13]]][6][j][0][n]) +
-                    h[ib[m][14]][n] * (dk[pix[ib[m][13]]][6][j][3][n] +
-                                       dk[pix[ib[m][14]]][5][j][0][n]) +
-                    h[ib[m][15]][n] * (dk[pix[ib[m][14]]][5][j][3][n]) +
-                    h[ib[m][16]][n] * (dk[pix[ib[m][26]]][0][j][7][n] +
-                                       dk[pix[ib[m][6]]][1][j][6][n]) +
-                    h[ib[m][17]][n] * (dk[pix[ib[m][26]]][0][j][6][n]) +
-                    h[ib[m][18]][n] * (dk[pix[ib[m][26]]][0][j][5][n] +
-                                       dk[pix[ib[m][4]]][3][j][6][n]) +
-                    h[ib[m][19]][n] * (dk[pix[ib[m][4]]][3][j][5][n]) +
-                    h[ib[m][20]][n] * (dk[pix[ib[m][4]]][3][j][4][n] +
-                                       dk[pix[ib[m][5]]][2][j][5][n]) +
-                    h[ib[m][21]][n] * (dk[pix[ib[m][5]]][2][j][4][n]) +
-                    h[ib[m][22]][n] * (dk[pix[ib[m][5]]][2][j][7][n] +
-                                       dk[pix[ib[m][6]]][1][j][4][n]) +
-                    h[ib[m][23]][n] * (dk[pix[ib[m][6]]][1][j][7][n]) +
-                    h[ib[m][24]][n] * (dk[pix[ib[m][13]]][6][j][2][n] +
-                                       dk[pix[ib[m][12]]][7][j][3][n] +
-                                       dk[pix[ib[m][14]]][5][j][1][n] +
-                                       dk[pix[ib[m][24]]][4][j][0][n]) +
-                    h[ib[m][25]][n] * (dk[pix[ib[m][5]]][2][j][6][n] +
-                                       dk[pix[ib[m][4]]][3][j][7][n] +
-                                       dk[pix[ib[m][26]]][0][j][4][n] +
-                                       dk[pix[ib[m][6]]][1][j][5][n]) +
-                    h[ib[m][26]][n] * (dk[pix[ib[m][26]]][0][j][0][n] +
-                                       dk[pix[ib[m][6]]][1][j][1][n] +
-                                       dk[pix[ib[m][5]]][2][j][2][n] +
-                                       dk[pix[ib[m][4]]][3][j][3][n] +
-                                       dk[pix[ib[m][24]]][4][j][4][n] +
-                                       dk[pix[ib[m][14]]][5][j][5][n] +
-                                       dk[pix[ib[m][13]]][6][j][6][n] +
-                                       dk[pix[ib[m][12]]][7][j][7][n]);
+    /*  once for each step, keeping the product for the update of gb. */
+    if (Hf)
+      slabhalof(Hf + 3 * (size_t)Nodebase, 3 * Xsyssize * Ysyssize, Zhi - Zlo);
+    else
+      slabhalo(h[Nodebase], 3 * Xsyssize * Ysyssize, Zhi - Zlo);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 1)           \
+    private(m, j, mend, sum, nb, row, hv) if (Nblock > 1)
+#endif
+    for (k = 0; k < Nblock; k++) {
+      sum = 0.0;
+      mend = (k + 1 < Nblock) ? Mlo + (k + 1) * Blocksize : Mhi;
+      for (m = Mlo + k * Blocksize; m < mend; m++) {
+        neighbors(m, nb);
+        if (Hf)
+          stencilrowsf(Hf, nb, Nodepat[m], row);
+        else if (Nodepat)
+          stencilrows(h, nb, Nodepat[m], row);
+        for (j = 0; j < 3; j++) {
+          Ah[m][j] = Nodepat ? row[j] : stiffrow(h, nb, j);
+          hv = Hf ? (double)Hf[3 * m + j] : h[m][j];
+          sum += hv * Ah[m][j];
         }
-        hAh += h[m][j] * Ahtemp;
       }
+      Blocksum[k] = sum;
     }
 
-    lambda = gg / hAh;
+    hAh = slabsum(Blocksum, Nblock);
+
+    lambda = (Precond ? Rz : gg) / hAh;
     gglast = gg;
-    gg = 0.0;
-    for (m = 0; m < ns; m++) {
-      for (j = 0; j < 3; j++) {
-        Ahtemp = 0.0;
-        for (n = 0; n < 3; n++) {
-          Ahtemp += h[ib[m][0]][n] * (dk[pix[ib[m][26]]][0][j][3][n] +
-                                      dk[pix[ib[m][6]]][1][j][2][n] +
-                                      dk[pix[ib[m][24]]][4][j][7][n] +
-                                      dk[pix[ib[m][14]]][5][j][6][n]) +
-                    h[ib[m][1]][n] * (dk[pix[ib[m][26]]][0][j][2][n] +
-                                      dk[pix[ib[m][24]]][4][j][6][n]) +
-                    h[ib[m][2]][n] * (dk[pix[ib[m][26]]][0][j][1][n] +
-                                      dk[pix[ib[m][4]]][3][j][2][n] +
-                                      dk[pix[ib[m][12]]][7][j][6][n] +
-                                      dk[pix[ib[m][24]]][4][j][5][n]) +
-                    h[ib[m][3]][n] * (dk[pix[ib[m][4]]][3][j][1][n] +
-                                      dk[pix[ib[m][12]]][7][j][5][n]) +
-                    h[ib[m][4]][n] * (dk[pix[ib[m][5]]][2][j][1][n] +
-                                      dk[pix[ib[m][4]]][3][j][0][n] +
-                                      dk[pix[ib[m][13]]][6][j][5][n] +
-                                      dk[pix[ib[m][12]]][7][j][4][n]) +
-                    h[ib[m][5]][n] * (dk[pix[ib[m][5]]][2][j][0][n] +
-                                      dk[pix[ib[m][13]]][6][j][4][n]) +
-                    h[ib[m][6]][n] * (dk[pix[ib[m][5]]][2][j][3][n] +
-                                      dk[pix[ib[m][6]]][1][j][0][n] +
-                                      dk[pix[ib[m][13]]][6][j][7][n] +
-                                      dk[pix[ib[m][14]]][5][j][4][n]) +
-                    h[ib[m][7]][n] * (dk[pix[ib[m][6]]][1][j][3][n] +
-                                      dk[pix[ib[m][14]]][5][j][7][n]) +
-                    h[ib[m][8]][n] * (dk[pix[ib[m][24]]][4][j][3][n] +
-                                      dk[pix[ib[m][14]]][5][j][2][n]) +
-                    h[ib[m][9]][n] * (dk[pix[ib[m][24]]][4][j][2][n]) +
-                    h[ib[m][10]][n] * (dk[pix[ib[m][12]]][7][j][2][n] +
-                                       dk[pix[ib[m][24]]][4][j][1][n]) +
-                    h[ib[m][11]][n] * (dk[pix[ib[m][12]]][7][j][1][n]) +
-                    h[ib[m][12]][n] * (dk[pix[ib[m][12]]][7][j][0][n] +
-                                       dk[pix[ib[m][13]]][6][j][1][n]) +
-                    h[ib[m][13]][n] * (dk[pix[ib[m][13]]][6][j][0][n]) +
-                    h[ib[m][14]][n] * (dk[pix[ib[m][13]]][6][j][3][n] +
-                                       dk[pix[ib[m][14]]][5][j][0][n]) +
-                    h[ib[m][15]][n] * (dk[pix[ib[m][14]]][5][j][3][n]) +
-                    h[ib[m][16]][n] * (dk[pix[ib[m][26]]][0][j][7][n] +
-                                       dk[pix[ib[m][6]]][1][j][6][n]) +
-                    h[ib[m][17]][n] * (dk[pix[ib[m][26]]][0][j][6][n]) +
-                    h[ib[m][18]][n] * (dk[pix[ib[m][26]]][0][j][5][n] +
-                                       dk[pix[ib[m][4]]][3][j][6][n]) +
-                    h[ib[m][19]][n] * (dk[pix[ib[m][4]]][3][j][5][n]) +
-                    h[ib[m][20]][n] * (dk[pix[ib[m][4]]][3][j][4][n] +
-                                       dk[pix[ib[m][5]]][2][j][5][n]) +
-                    h[ib[m][21]][n] * (dk[pix[ib[m][5]]][2][j][4][n]) +
-                    h[ib[m][22]][n] * (dk[pix[ib[m][5]]][2][j][7][n] +
-                                       dk[pix[ib[m][6]]][1][j][4][n]) +
-                    h[ib[m][23]][n] * (dk[pix[ib[m][6]]][1][j][7][n]) +
-                    h[ib[m][24]][n] * (dk[pix[ib[m][13]]][6][j][2][n] +
-                                       dk[pix[ib[m][12]]][7][j][3][n] +
-                                       dk[pix[ib[m][14]]][5][j][1][n] +
-                                       dk[pix[ib[m][24]]][4][j][0][n]) +
-                    h[ib[m][25]][n] * (dk[pix[ib[m][5]]][2][j][6][n] +
-                                       dk[pix[ib[m][4]]][3][j][7][n] +
-                                       dk[pix[ib[m][26]]][0][j][4][n] +
-                                       dk[pix[ib[m][6]]][1][j][5][n]) +
-                    h[ib[m][26]][n] * (dk[pix[ib[m][26]]][0][j][0][n] +
-                                       dk[pix[ib[m][6]]][1][j][1][n] +
-                                       dk[pix[ib[m][5]]][2][j][2][n] +
-                                       dk[pix[ib[m][4]]][3][j][3][n] +
-                                       dk[pix[ib[m][24]]][4][j][4][n] +
-                                       dk[pix[ib[m][14]]][5][j][5][n] +
-                                       dk[pix[ib[m][13]]][6][j][6][n] +
-                                       dk[pix[ib[m][12]]][7][j][7][n]);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 1)           \
+    private(m, j, mend, sum, hv) if (Nblock > 1)
+#endif
+    for (k = 0; k < Nblock; k++) {
+      sum = 0.0;
+      mend = (k + 1 < Nblock) ? Mlo + (k + 1) * Blocksize : Mhi;
+      for (m = Mlo + k * Blocksize; m < mend; m++) {
+        for (j = 0; j < 3; j++) {
+          hv = Hf ? (double)Hf[3 * m + j] : h[m][j];
+          u[m][j] -= lambda * hv;
+          gb[m][j] -= lambda * Ah[m][j];
+          sum += gb[m][j] * gb[m][j];
         }
-        u[m][j] -= lambda * h[m][j];
-        gb[m][j] -= lambda * Ahtemp;
-        gg += gb[m][j] * gb[m][j];
       }
+      Blocksum[k] = sum;
     }
 
-    if (gg >= gtest) {
+    gg = slabsum(Blocksum, Nblock);
+
+    if (gg >= gtest && Precond) {
+
+      rz = precondapply(ns);
+      gamma = rz / Rz;
+      Rz = rz;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) private(m3) if (Nblock > 1)
+#endif
+      for (m = Mlo; m < Mhi; m++) {
+        for (m3 = 0; m3 < 3; m3++) {
+          if (Hf)
+            Hf[3 * m + m3] =
+                (float)(Zg[m][m3] + gamma * (double)Hf[3 * m + m3]);
+          else
+            h[m][m3] = Zg[m][m3] + gamma * h[m][m3];
+        }
+      }
+
+    } else if (gg >= gtest) {
 
       gamma = gg / gglast;
-      for (m = 0; m < ns; m++) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) private(m3) if (Nblock > 1)
+#endif
+      for (m = Mlo; m < Mhi; m++) {
         for (m3 = 0; m3 < 3; m3++) {
-          h[m][m3] = gb[m][m3] + gamma * h[m][m3];
+          if (Hf)
+            Hf[3 * m + m3] =
+                (float)(gb[m][m3] + gamma * (double)Hf[3 * m + m3]);
+          else
+            h[m][m3] = gb[m][m3] + gamma * h[m][m3];
         }
       }
 
@@ -1835,6 +3251,197 @@ int dembx(int ns, int ldemb, int kkk) {
   return (Lstep);
 }
 
+#ifdef _OPENMP
+/*  Subroutine that releases what dembxgpu has put on the device, */
+/*  before the next microstructure maps its own or the vectors are */
+/*  freed */
+
+void gpurelease(void) {
+  if (Gpuns == 0)
+    return;
+
+#pragma omp target exit data map(delete : Gpuu[0 : 3 * Gpuns],               \
+                                     Gpugb[0 : 3 * Gpuns], Gpuh[0 : 3 * Gpuns], \
+                                     Gpuah[0 : 3 * Gpuns])
+#pragma omp target exit data map(delete : Gpust[0 : 243 * Gpunpat],           \
+                                     Gpupat[0 : Gpuns])
+  if (Gpupinv) {
+#pragma omp target exit data map(delete : Gpupinv[0 : 9 * Gpuns],             \
+                                     Gpuzg[0 : 3 * Gpuns])
+  }
+  Gpuns = 0;
+  Gpupinv = Gpuzg = NULL;
+
+  return;
+}
+
+/*  Subroutine that applies the preconditioner on the device, as */
+/*  precondapply does on the host, and returns gb * Zg */
+
+double gpuprecond(int ns) {
+  int m;
+  double rz = 0.0, *P = Gpupinv, *Z = Gpuzg, *G = Gpugb;
+
+#pragma omp target teams distribute parallel for reduction(+ : rz)           \
+    map(tofrom : rz)
+  for (m = 0; m < ns; m++) {
+    Z[3 * m] = P[9 * m] * G[3 * m] + P[9 * m + 1] * G[3 * m + 1] +
+               P[9 * m + 2] * G[3 * m + 2];
+    Z[3 * m + 1] = P[9 * m + 3] * G[3 * m] + P[9 * m + 4] * G[3 * m + 1] +
+                   P[9 * m + 5] * G[3 * m + 2];
+    Z[3 * m + 2] = P[9 * m + 6] * G[3 * m] + P[9 * m + 7] * G[3 * m + 1] +
+                   P[9 * m + 8] * G[3 * m + 2];
+    rz += G[3 * m] * Z[3 * m] + G[3 * m + 1] * Z[3 * m + 1] +
+          G[3 * m + 2] * Z[3 * m + 2];
+  }
+
+  return (rz);
+}
+
+/*  Subroutine that does the steps of dembx on an offload device */
+/*  (--gpu), with the node stencils.  The stencils, the direction h */
+/*  and Ah stay on the device through all the calls for one */
+/*  microstructure; u and gb go over at the start of each call, */
+/*  since energy has just found gb on the host, and come back at */
+/*  the end.  The neighbors of a node are found in the kernel, with */
+/*  the periodic wrap of neighbors.  The dot products are not added */
+/*  up in a fixed order, so the answer agrees with that of dembx to */
+/*  roundoff, not bit for bit. */
+
+int dembxgpu(int ns, int ldemb, int kkk) {
+  double lambda, gamma, hAh, gglast, rz, sum, s0, s1, s2, vt;
+  int Lstep, ijk, m, n, t, i, j, k, i1, j1, k1, pc;
+  int nxs, nys, nzs, nxy, di[27], dj[27], dl[27];
+  double *U, *G, *H, *AH, *ST, *Z;
+  const double *st;
+  int *P;
+
+  nxs = Xsyssize;
+  nys = Ysyssize;
+  nzs = Zsyssize;
+  nxy = nxs * nys;
+  for (t = 0; t < 27; t++) {
+    di[t] = in[t];
+    dj[t] = jjn[t];
+    dl[t] = kn[t];
+  }
+  pc = (Precond != NOPRECOND);
+
+  /*  Map everything at the first call for a microstructure */
+  if (kkk == 0 || Gpuns == 0) {
+    gpurelease();
+    Gpuns = ns;
+    Gpunpat = Npattern;
+    Gpuu = u[0];
+    Gpugb = gb[0];
+    Gpuh = h[0];
+    Gpuah = Ah[0];
+    Gpust = Stencil;
+    Gpupat = Nodepat;
+#pragma omp target enter data map(alloc : Gpuu[0 : 3 * ns],                   \
+                                      Gpugb[0 : 3 * ns], Gpuh[0 : 3 * ns],      \
+                                      Gpuah[0 : 3 * ns])
+#pragma omp target enter data map(to : Gpust[0 : 243 * Gpunpat],              \
+                                      Gpupat[0 : ns])
+    if (pc) {
+      Gpupinv = Pinv[0];
+      Gpuzg = Zg[0];
+#pragma omp target enter data map(to : Gpupinv[0 : 9 * ns])                   \
+    map(alloc : Gpuzg[0 : 3 * ns])
+    }
+  }
+
+  U = Gpuu;
+  G = Gpugb;
+  H = Gpuh;
+  AH = Gpuah;
+  ST = Gpust;
+  P = Gpupat;
+  Z = Gpuzg;
+
+#pragma omp target update to(U[0 : 3 * ns], G[0 : 3 * ns])
+
+  if (pc)
+    Rz = gpuprecond(ns);
+
+  if (kkk == 0) {
+#pragma omp target teams distribute parallel for
+    for (m = 0; m < 3 * ns; m++) {
+      H[m] = pc ? Z[m] : G[m];
+    }
+  }
+
+  Lstep = 0;
+
+  for (ijk = 0; ((ijk < ldemb) && (gg >= gtest)); ijk++) {
+    Lstep += 1;
+
+    /*  Ah = A * h from the stencils, and h * Ah */
+    hAh = 0.0;
+#pragma omp target teams distribute parallel for reduction(+ : hAh)          \
+    map(tofrom : hAh) map(to : di, dj, dl)                                     \
+    private(i, j, k, i1, j1, k1, n, t, s0, s1, s2, vt, st)
+    for (m = 0; m < ns; m++) {
+      i = m % nxs;
+      j = (m / nxs) % nys;
+      k = m / nxy;
+      st = ST + (size_t)P[m] * 243;
+      AH[3 * m] = AH[3 * m + 1] = AH[3 * m + 2] = 0.0;
+      for (n = 0; n < 3; n++) {
+        s0 = s1 = s2 = 0.0;
+        for (t = 0; t < 27; t++) {
+          i1 = (i + di[t] + nxs) % nxs;
+          j1 = (j + dj[t] + nys) % nys;
+          k1 = (k + dl[t] + nzs) % nzs;
+          vt = H[3 * (nxy * k1 + nxs * j1 + i1) + n];
+          s0 += vt * st[0];
+          s1 += vt * st[1];
+          s2 += vt * st[2];
+          st += 3;
+        }
+        AH[3 * m] += s0;
+        AH[3 * m + 1] += s1;
+        AH[3 * m + 2] += s2;
+      }
+      hAh += H[3 * m] * AH[3 * m] + H[3 * m + 1] * AH[3 * m + 1] +
+             H[3 * m + 2] * AH[3 * m + 2];
+    }
+
+    lambda = (pc ? Rz : gg) / hAh;
+    gglast = gg;
+    sum = 0.0;
+#pragma omp target teams distribute parallel for reduction(+ : sum)          \
+    map(tofrom : sum)
+    for (m = 0; m < 3 * ns; m++) {
+      U[m] -= lambda * H[m];
+      G[m] -= lambda * AH[m];
+      sum += G[m] * G[m];
+    }
+    gg = sum;
+
+    if (gg >= gtest && pc) {
+      rz = gpuprecond(ns);
+      gamma = rz / Rz;
+      Rz = rz;
+#pragma omp target teams distribute parallel for
+      for (m = 0; m < 3 * ns; m++) {
+        H[m] = Z[m] + gamma * H[m];
+      }
+    } else if (gg >= gtest) {
+      gamma = gg / gglast;
+#pragma omp target teams distribute parallel for
+      for (m = 0; m < 3 * ns; m++) {
+        H[m] = G[m] + gamma * H[m];
+      }
+    }
+  }
+
+#pragma omp target update from(U[0 : 3 * ns], G[0 : 3 * ns])
+
+  return (Lstep);
+}
+#endif
+
 void modlayer(int *nagg1) {
   register int i, j, ii, jj;
   int i1, i2, i3, i4, i5, i6, m, m1;
@@ -1979,14 +3586,95 @@ void modlayer(int *nagg1) {
   }
 }
 
+/***
+ *	modextrap
+ *
+ * 	Limit of a converging sequence from its last three values by
+ * 	Aitken's delta-squared process
+ *
+ * 	Arguments:	double pointer to the three values, oldest first
+ * 	Returns:	double limit, or the last value if the differences
+ * 				do not shrink geometrically
+ *
+ *	Calls:		No other routines
+ *	Called by:	main
+ ***/
+double modextrap(const double *x) {
+  double d1, d2, dd;
+
+  d1 = x[1] - x[0];
+  d2 = x[2] - x[1];
+  dd = d2 - d1;
+  if (dd == 0.0 || d1 * d2 <= 0.0 || fabs(d2) >= fabs(d1))
+    return (x[2]);
+
+  return (x[2] - d2 * d2 / dd);
+}
+
+/***
+ *	energyvtk
+ *
+ * 	Write the phase and the strain energy of each pixel to a VTK
+ * 	image file, one z plane at a time, the energy in single
+ * 	precision
+ *
+ * 	Arguments:	char pointer to name of the file
+ * 				double pointer to the strain energy of every
+ * 				pixel, x varying fastest
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		vtkimg_open, vtkimg_array, vtkimg_begin,
+ *				vtkimg_plane, vtkimg_end, vtkimg_close
+ *	Called by:	main
+ ***/
+int energyvtk(char *name, double *energy) {
+  int k, n, nxy;
+  unsigned char *phase;
+  float *e;
+  Vtkimg v;
+
+  nxy = Xsyssize * Ysyssize;
+  phase = (unsigned char *)malloc((size_t)nxy);
+  e = (float *)malloc((size_t)nxy * sizeof(float));
+  if (!phase || !e ||
+      vtkimg_open(&v, name, Xsyssize, Ysyssize, Zsyssize, Res)) {
+    free(phase);
+    free(e);
+    return (1);
+  }
+
+  vtkimg_array(&v, "Phase", VTKUINT8, 1);
+  vtkimg_array(&v, "Energy", VTKFLOAT32, 1);
+  vtkimg_begin(&v);
+  for (k = 0; k < Zsyssize; k++) {
+    for (n = 0; n < nxy; n++) {
+      phase[n] = (unsigned char)pix[k * nxy + n];
+    }
+    vtkimg_plane(&v, phase);
+  }
+  vtkimg_end(&v);
+  vtkimg_begin(&v);
+  for (k = 0; k < Zsyssize; k++) {
+    for (n = 0; n < nxy; n++) {
+      e[n] = (float)energy[k * nxy + n];
+    }
+    vtkimg_plane(&v, e);
+  }
+  vtkimg_end(&v);
+
+  free(phase);
+  free(e);
+  return (vtkimg_close(&v));
+}
+
 int main(int argc, char *argv[]) {
-  int m3, i, j, k, n, nx, ny, nz, nphase, ijk, nxy, i1, j1, k1, npoints, kmax,
+  int m3, i, j, k, n, nx, ny, nz, nphase, ijk, nxy, i1, j1, npoints, kmax,
       ldemb;
-  int kkk, micro, doitz, nagg1, oval;
-  int m, ns, m1, ltot = 0, Lstep, count;
+  int kkk, micro, doitz, nagg1, oval, cached, nmod, modstop;
+  int m, ns, ltot = 0, Lstep, count;
   double utot, x, y, z;
-  double enrgy;
   double bulk, shear, young, pois, save;
+  double modseq[2][3], modlim[2], modlast[2];
   float kk, xj, sum = 0.0;
   char phasename[MAXSTRING];
   char *rfc8601;
@@ -1994,14 +3682,22 @@ int main(int argc, char *argv[]) {
   clock_t begin, end;
   struct tm *local_time;
   struct timespec tv;
-  FILE *outfile;
+  FILE *outfile, *cfp;
+  Rescache rc;
+  Tracemark mark;
+
+  /* Start MPI, if built with it, before the arguments are seen */
+  slabstart(&argc, &argv);
 
   /* Check command-line arguments */
   checkargs(argc, argv);
 
-  /* Create log file and keep it open throughout */
+  /* Create log file and keep it open throughout; under mpirun only */
+  /* rank 0 writes elastic.log, and the other ranks a scratch file */
   sprintf(LogFileName, "elastic.log");
-  if ((Logfile = fopen(LogFileName, "w")) == NULL) {
+  Logfile =
+      log_attach((Mpirank > 0) ? tmpfile() : fopen(LogFileName, "w"));
+  if (Logfile == NULL) {
     fprintf(stderr, "\nERROR line 1918:  Could not open %s\n\n", LogFileName);
     fflush(stderr);
     exit(1);
@@ -2019,24 +3715,60 @@ int main(int argc, char *argv[]) {
   fprintf(Logfile, "=== BEGIN GENMIC SIMULATION ===");
   fprintf(Logfile, "\nStart time: %s", asctime(local_time));
 
-  Fprog = filehandler("elastic", ProgressFileName, "WRITE");
-  if (!Fprog) {
-    freeallmem();
-    exit(1);
+  if (Tracename[0] != '\0' && Mpirank == 0) {
+    i = trace_open(Tracename, "elastic", 0, Tracecounters);
+    if (i == 1) {
+      fprintf(Logfile, "\nWARNING: Could not open trace file %s", Tracename);
+    } else if (i == 2) {
+      fprintf(Logfile, "\nWARNING: Hardware counters are not available "
+                       "here; the trace has timings only");
+    }
   }
-  fprintf(Fprog, "json {");
-  /* fprintf(Fprog, "\"cycle\": %d, \"time_hours\": %.2f,", Icyc, Time_cur);
-  fprintf(Fprog, " \"degree_of_hydration\": %.2f, \"timestamp\": ", Alpha_cur);
-  */
 
-  if ((clock_gettime(CLOCK_REALTIME, &tv))) {
-    fprintf(stderr, "\nERROR: Error clock_gettime");
+#ifdef _OPENMP
+  if (Gpu && omp_get_num_devices() < 1) {
+    fprintf(Logfile, "\nWARNING: No offload device found; relaxing on the"
+                     " host");
+    Gpu = 0;
+  }
+#else
+  if (Gpu) {
+    fprintf(Logfile, "\nWARNING: Built without OpenMP; relaxing on the host");
+    Gpu = 0;
+  }
+#endif
+  if (Gpu && Mpisize > 1) {
+    fprintf(Logfile, "\nWARNING: --gpu is not used under mpirun; relaxing"
+                     " on the host");
+    Gpu = 0;
+  }
+  if (Fftengine && Mpisize > 1) {
+    fprintf(Logfile, "\nWARNING: --fft is not used under mpirun; relaxing"
+                     " without a preconditioner");
+    Fftengine = 0;
+    Precond = NOPRECOND;
   }
 
-  rfc8601 = rfc8601_timespec(&tv);
-  fprintf(Fprog, "\"%s\"}", rfc8601);
-  fclose(Fprog);
-  free(rfc8601);
+  if (Mpirank == 0) {
+    Fprog = filehandler("elastic", ProgressFileName, "WRITE");
+    if (!Fprog) {
+      freeallmem();
+      exit(1);
+    }
+    fprintf(Fprog, "json {");
+    /* fprintf(Fprog, "\"cycle\": %d, \"time_hours\": %.2f,", Icyc, Time_cur);
+    fprintf(Fprog, " \"degree_of_hydration\": %.2f, \"timestamp\": ", Alpha_cur);
+    */
+
+    if ((clock_gettime(CLOCK_REALTIME, &tv))) {
+      fprintf(stderr, "\nERROR: Error clock_gettime");
+    }
+
+    rfc8601 = rfc8601_timespec(&tv);
+    fprintf(Fprog, "\"%s\"}", rfc8601);
+    fclose(Fprog);
+    free(rfc8601);
+  }
 
   /* Initialize global arrays to zero */
 
@@ -2419,9 +4151,9 @@ int main(int argc, char *argv[]) {
   gtest = (1.e-7) * (double)ns;
 
   fprintf(Logfile, "\n%d %d %d %d", nx, ny, nz, ns);
-  fflush(Logfile);
+  log_flush(Logfile);
 
-  /*  Construct the neighbor table, ib(m,n) */
+  /*  Set up the neighbors of a node, nb(n) */
 
   /*  First construct the 27 neighbor table in terms of delta i, delta j, and */
   /*  delta k information (see Table 3 in manual) */
@@ -2463,43 +4195,13 @@ int main(int argc, char *argv[]) {
   kn[25] = 1;
   kn[26] = 0;
 
-  /*  Now construct neighbor table according to 1-d labels */
-  /*  Matrix ib(m,n) gives the 1-d label of the n'th neighbor (n=0,26) of */
-  /*  the node labelled m. */
-  fprintf(Logfile, "\nConstructing neighbor table now... ");
-  fflush(Logfile);
+  /*  The 1-d label of the n'th neighbor (n=0,26) of the node labelled m */
+  /*  is found by neighbors when it is needed; away from the faces of the */
+  /*  system it is m + Nboff[n]. */
   nxy = nx * ny;
-  for (k = 0; k < nz; k++) {
-    for (j = 0; j < ny; j++) {
-      for (i = 0; i < nx; i++) {
-        m = nxy * k + nx * j + i;
-        for (n = 0; n < 27; n++) {
-          i1 = i + in[n];
-          j1 = j + jjn[n];
-          k1 = k + kn[n];
-          if (i1 < 0) {
-            i1 += nx;
-          } else if (i1 >= nx) {
-            i1 -= nx;
-          }
-          if (j1 < 0) {
-            j1 += ny;
-          } else if (j1 >= ny) {
-            j1 -= ny;
-          }
-          if (k1 < 0) {
-            k1 += nz;
-          } else if (k1 >= nz) {
-            k1 -= nz;
-          }
-          m1 = nxy * k1 + nx * j1 + i1;
-          ib[m][n] = m1;
-        }
-      }
-    }
+  for (n = 0; n < 27; n++) {
+    Nboff[n] = nxy * kn[n] + nx * jjn[n] + in[n];
   }
-  fprintf(Logfile, "done");
-  fflush(Logfile);
 
   /* Count and output the volume fractions of the different phases */
   count = 0;
@@ -2508,20 +4210,53 @@ int main(int argc, char *argv[]) {
       count++;
   }
   fprintf(Logfile, "\nBefore assig, Count C3S = %d", count);
-  fflush(Logfile);
+  log_flush(Logfile);
 
   assig(ns, nphase);
   for (i = 0; i < nphase; i++) {
     if (prob[i] > 0.0) {
       fprintf(Logfile, "\nPhase %d bulk = %lf shear = %lf volume = %lf ", i,
               phasemod[i][0], phasemod[i][1], prob[i]);
-      fflush(Logfile);
+      log_flush(Logfile);
     }
     sum = sum + prob[i];
   }
 
   fprintf(Logfile, "\nSum of volume fractions = %f", sum);
-  fflush(Logfile);
+  log_flush(Logfile);
+
+  /*  Look for the results in the cache (--cache) before relaxing. */
+  /*  They depend on the size, the phase of each pixel, the moduli, */
+  /*  gtest and the ITZ layers.  Under mpirun a rank has only its */
+  /*  slab of the energy, and --save-disp needs the displacements, */
+  /*  so the cache is not used then. */
+
+  rescache_init(&rc, (Mpisize > 1) ? "" : Cachedir, "elastic");
+  rescache_add(&rc, &nx, sizeof(int));
+  rescache_add(&rc, &ny, sizeof(int));
+  rescache_add(&rc, &nz, sizeof(int));
+  rescache_add(&rc, pix, (size_t)ns * sizeof(pix[0]));
+  rescache_add(&rc, phasemod, sizeof(phasemod));
+  rescache_add(&rc, &gtest, sizeof(gtest));
+  rescache_add(&rc, &doitz, sizeof(int));
+  rescache_add(&rc, &nagg1, sizeof(int));
+  if (Modtol > 0.0)
+    rescache_add(&rc, &Modtol, sizeof(Modtol));
+  cached = 0;
+  if (strlen(Savedisp) == 0 && (cfp = rescache_open(&rc))) {
+    cached = !cacheio(cfp, ns, doitz, 0);
+    fclose(cfp);
+    if (cached) {
+      fprintf(Logfile, "\nResults taken from the cache in %s", Cachedir);
+      log_flush(Logfile);
+    }
+  }
+
+  /*  From here on pix holds the stiffness slots of the phases */
+
+  phaseslots();
+  fprintf(Logfile, "\n%d phases present", Nslot);
+  log_flush(Logfile);
 
   /*  (USER) Set applied strains */
   /*  Actual shear strain applied in do 1050 loop is exy, exz, and eyz as */
@@ -2530,11 +4265,15 @@ int main(int argc, char *argv[]) {
 
   /*  npoints different loading configurations for ITZ calculation */
   /*  npoints = 6 for FULL elastic stiffness tensor solution, = 1 otherwise */
+  /*  npoints is set to 1 above, so an ITZ run is also one relaxation under */
+  /*  the combined strain of case 0, from which stress gets the bulk and */
+  /*  shear moduli of each layer.  Six cases would also need the full */
+  /*  tensor code that is commented out in stress. */
 
   if (!doitz)
     npoints = 1;
 
-  for (micro = 0; micro < npoints; micro++) {
+  for (micro = 0; micro < npoints && !cached; micro++) {
     switch (micro) {
     case 0:
       if (npoints == 1) {
@@ -2604,7 +4343,7 @@ if (doitz) {
     fprintf(Logfile, "\nexx   eyy   ezz   exz   eyz   exy");
     fprintf(Logfile, "\n%lf %lf %lf %lf %lf %lf", exx, eyy, ezz, 2. * exz,
             2. * eyz, 2. * exy);
-    fflush(Logfile);
+    log_flush(Logfile);
 
     /* Set up the elastic modulus variables, finite element stiffness matrices,
      */
@@ -2613,16 +4352,61 @@ if (doitz) {
      */
     /*  input in subroutine femat. */
 
-    femat(nx, ny, nz, ns, nphase);
+    trace_begin(&mark, TRACEMAIN);
+    femat(nx, ny, nz, ns);
+    trace_end(&mark, "femat", TRACEMAIN);
     fprintf(Logfile, "\nC is %lf", C);
-    fflush(Logfile);
+    log_flush(Logfile);
+
+    if (Usestencil) {
+      if (stencils(ns)) {
+        fprintf(Logfile, "\nWARNING: Could not set up the node stencils;"
+                         " using the stiffness matrices directly");
+        Usestencil = 0;
+        if (Nodepat)
+          free_ivector(Nodepat + Nodebase);
+        Nodepat = NULL;
+      } else {
+        fprintf(Logfile, "\n%d distinct node stencils", Npattern);
+      }
+      log_flush(Logfile);
+    }
+
+    if (Singleh && !Hf) {
+      if (Nodepat)
+        Hf = (float *)malloc(3 * (size_t)Nodecount * sizeof(float));
+      if (!Hf) {
+        fprintf(Logfile, "\nWARNING: No single-precision direction without"
+                         " the node stencils; using double precision");
+        Singleh = 0;
+      } else {
+        Hf -= 3 * (size_t)Nodebase;
+        freenodevec(h);
+        h = NULL;
+      }
+      log_flush(Logfile);
+    }
+
+    if (Precond) {
+      if (precondset(ns)) {
+        fprintf(Logfile, "\nWARNING: Could not set up the preconditioner;"
+                         " relaxing without one");
+        Precond = NOPRECOND;
+      } else {
+        fprintf(Logfile, "\nPreconditioner: %s",
+                (Precond == JACOBI)        ? "Jacobi"
+                : (Precond == BLOCKJACOBI) ? "block Jacobi"
+                                           : "FFT (Lippmann-Schwinger)");
+      }
+      log_flush(Logfile);
+    }
 
     /* Apply chosen strains as a homogeneous macroscopic strain  */
     /* as the initial condition. */
 
     fprintf(Logfile, "\nApplying homogeneous macroscopic strain now... ");
-    fflush(Logfile);
-    for (k = 0; k < nz; k++) {
+    log_flush(Logfile);
+    for (k = Zlo; k < Zhi; k++) {
       for (j = 0; j < ny; j++) {
         for (i = 0; i < nx; i++) {
           m = nxy * k + nx * j + i;
@@ -2636,7 +4420,27 @@ if (doitz) {
       }
     }
     fprintf(Logfile, " ...done\n");
-    fflush(Logfile);
+
+    /*  Start from the displacements of an earlier run, if any */
+
+    if (strlen(Startdisp) > 0) {
+      switch (loaddisp(Startdisp, nx, ny, nz)) {
+      case 0:
+        fprintf(Logfile, "\nStarting from the displacements in %s\n",
+                Startdisp);
+        break;
+      case 1:
+        fprintf(Logfile, "\nNo displacement file %s; starting from the"
+                         " applied strain\n", Startdisp);
+        break;
+      default:
+        fprintf(Logfile, "\nWARNING: Displacement file %s does not match"
+                         " this system; starting from the applied strain\n",
+                Startdisp);
+        break;
+      }
+    }
+    log_flush(Logfile);
 
     /*  RELAXATION LOOP */
     /*  (USER) kmax is the maximum number of times dembx will be called, with */
@@ -2646,52 +4450,65 @@ if (doitz) {
     kmax = 40;
     ldemb = 100;
     /*  Call energy to get initial energy and initial gradient */
+    trace_begin(&mark, TRACEMAIN);
     utot = energy(nx, ny, nz, ns);
+    trace_end(&mark, "energy", TRACEMAIN);
     /*  gg is the norm squared of the gradient (gg=gb*gb) */
-    gg = 0.0;
-    for (m3 = 0; m3 < 3; m3++) {
-      for (m = 0; m < ns; m++) {
-        gg += gb[m][m3] * gb[m][m3];
+    if (Mpisize > 1) {
+      gg = layerdot(gb);
+    } else {
+      gg = 0.0;
+      for (m3 = 0; m3 < 3; m3++) {
+        for (m = 0; m < ns; m++) {
+          gg += gb[m][m3] * gb[m][m3];
+        }
       }
     }
     fprintf(Logfile, "\nInitial energy = %lf gg= %lf gtest = %lf", utot, gg,
             gtest);
-    fflush(Logfile);
+    log_flush(Logfile);
     gginit = gg;
+    nmod = 0;
+    modstop = 0;
 
-    for (kkk = 0; ((kkk < kmax) && (gg >= gtest)); kkk++) {
+    for (kkk = 0; ((kkk < kmax) && (gg >= gtest) && !modstop); kkk++) {
 
       /* Update progress file */
 
-      Fprog = filehandler("elastic", ProgressFileName, "WRITE");
-      if (!Fprog) {
-        freeallmem();
-        exit(1);
-      }
-      fprintf(Fprog, "json {");
-      fprintf(Fprog, "\"cycle\": %d, \"maxcycle\": %d,", kkk, kmax);
-      /* percent_complete = 100.0 * (1.0 - (gg - gtest) / (gginit - gtest)); */
-      percent_complete = 100.0 * ((float)(kkk) / (float)(kmax));
-      fprintf(Fprog,
-              " \"percent_complete\": %g, \"timestamp\": ", percent_complete);
+      if (Mpirank == 0) {
+        Fprog = filehandler("elastic", ProgressFileName, "WRITE");
+        if (!Fprog) {
+          freeallmem();
+          exit(1);
+        }
+        fprintf(Fprog, "json {");
+        fprintf(Fprog, "\"cycle\": %d, \"maxcycle\": %d,", kkk, kmax);
+        /* percent_complete = 100.0 * (1.0 - (gg - gtest) / (gginit - gtest));
+         */
+        percent_complete = 100.0 * ((float)(kkk) / (float)(kmax));
+        fprintf(Fprog, " \"percent_complete\": %g, \"timestamp\": ",
+                percent_complete);
+
+        if ((clock_gettime(CLOCK_REALTIME, &tv))) {
+          fprintf(stderr, "\nERROR: Error clock_gettime");
+        }
 
-      if ((clock_gettime(CLOCK_REALTIME, &tv))) {
-        fprintf(stderr, "\nERROR: Error clock_gettime");
+        rfc8601 = rfc8601_timespec(&tv);
+        fprintf(Fprog, "\"%s\"}", rfc8601);
+        fclose(Fprog);
+        free(rfc8601);
       }
 
-      rfc8601 = rfc8601_timespec(&tv);
-      fprintf(Fprog, "\"%s\"}", rfc8601);
-      fclose(Fprog);
-      free(rfc8601);
-
       /* Done updating progress file */
 
       /*  call dembx to go into the conjugate gradient solver */
       /*
       fprintf(Logfile,"\nCalling dembx with gg= %lf gtest = %lf",gg,gtest);
-      fflush(Logfile);
+      log_flush(Logfile);
       */
+      trace_begin(&mark, TRACEMAIN);
       Lstep = dembx(ns, ldemb, kkk);
+      trace_end(&mark, "dembx", TRACEMAIN);
       ltot += Lstep;
       /*
       fprintf(Logfile,"\nOut of dembx, Lstep = %d gg = %lf gtest =
@@ -2702,16 +4519,30 @@ if (doitz) {
        */
       /*  will give an intermediate energy with which to check how the  */
       /*  relaxation process is coming along. */
+      trace_begin(&mark, TRACEMAIN);
       utot = energy(nx, ny, nz, ns);
+      trace_end(&mark, "energy", TRACEMAIN);
+      if (Hf && Mpisize > 1) {
+        gg = layerdot(gb);
+      } else if (Hf) {
+        gg = 0.0;
+        for (m = 0; m < ns; m++) {
+          for (m3 = 0; m3 < 3; m3++) {
+            gg += gb[m][m3] * gb[m][m3];
+          }
+        }
+      }
       fprintf(Logfile, "\nEnergy = %lf gg= %lf gtest = %lf", utot, gg, gtest);
       fprintf(Logfile, "\nNumber of conjugate steps = %d\n", ltot);
-      fflush(Logfile);
+      log_flush(Logfile);
       /*  If relaxation process is not finished, continue */
       if (gg > gtest) {
         /*  If relaxation process will continue, compute and output stresses */
         /*  and strains as an additional aid to judge how the  */
         /*  relaxation procedure is progressing. */
+        trace_begin(&mark, TRACEMAIN);
         stress(nx, ny, nz, ns, doitz, micro, 0);
+        trace_end(&mark, "stress", TRACEMAIN);
         fprintf(Logfile, "\nstresses:  xx,yy,zz,xz,yz,xy");
         fprintf(Logfile, "\n%lf %lf %lf %lf %lf %lf", strxxt / (double)ns,
                 stryyt / (double)ns, strzzt / (double)ns, strxzt / (double)ns,
@@ -2720,18 +4551,77 @@ if (doitz) {
         fprintf(Logfile, "\n%lf %lf %lf %lf %lf %lf ", sxxt / (double)ns,
                 syyt / (double)ns, szzt / (double)ns, sxzt / (double)ns,
                 syzt / (double)ns, sxyt / (double)ns);
-        fflush(Logfile);
+
+        /*  Moduli so far and their extrapolated limits; only the */
+        /*  combined strain of one point has all six strains */
+
+        if (npoints == 1) {
+          for (i = 0; i < 2; i++) {
+            modseq[i][0] = modseq[i][1];
+            modseq[i][1] = modseq[i][2];
+          }
+          modseq[0][2] = (strxxt + stryyt + strzzt) / (sxxt + syyt + szzt) / 3.;
+          modseq[1][2] = (strxyt / sxyt + strxzt / sxzt + stryzt / syzt) / 3.;
+          fprintf(Logfile, "\nmoduli after %d steps: bulk %lf shear %lf", ltot,
+                  modseq[0][2], modseq[1][2]);
+          if (++nmod >= 3) {
+            for (i = 0; i < 2; i++) {
+              modlast[i] = modlim[i];
+              modlim[i] = modextrap(modseq[i]);
+            }
+            fprintf(Logfile, ", extrapolated bulk %lf shear %lf", modlim[0],
+                    modlim[1]);
+            if (Modtol > 0.0 && nmod >= 4 &&
+                fabs(modlim[0] - modlast[0]) <= Modtol * fabs(modlim[0]) &&
+                fabs(modlim[1] - modlast[1]) <= Modtol * fabs(modlim[1])) {
+              fprintf(Logfile, "\nExtrapolated moduli within %g: stopping"
+                               " the relaxation", Modtol);
+              modstop = 1;
+            }
+          }
+        }
+        log_flush(Logfile);
       }
     }
 
+    if (strlen(Savedisp) > 0 && savedisp(Savedisp, nx, ny, nz)) {
+      fprintf(Logfile, "\nWARNING: Could not write displacement file %s",
+              Savedisp);
+    }
+
+    trace_begin(&mark, TRACEMAIN);
     stress(nx, ny, nz, ns, doitz, micro, 1);
+    trace_end(&mark, "stress", TRACEMAIN);
     fprintf(Logfile, "\nstresses:  xx,yy,zz,xz,yz,xy");
     fprintf(Logfile, "\n%lf %lf %lf %lf %lf %lf", strxxt, stryyt, strzzt,
             strxzt, stryzt, strxyt);
     fprintf(Logfile, "\nstrains:  xx,yy,zz,xz,yz,xy");
     fprintf(Logfile, "\n%lf %lf %lf %lf %lf %lf ", sxxt, syyt, szzt, sxzt, syzt,
             sxyt);
-    fflush(Logfile);
+    log_flush(Logfile);
+  }
+
+  if (!cached && (cfp = rescache_create(&rc))) {
+    rescache_commit(&rc, cfp, cacheio(cfp, ns, doitz, 1));
+  }
+
+  /*  Under mpirun rank 0 gathers the strain energy of every slab */
+  /*  and writes the output files; the other ranks are done */
+
+  if (Mpisize > 1) {
+    if (Mpirank == 0)
+      Energyall = dvector(ns);
+    if ((Mpirank == 0 && !Energyall) ||
+        slabgather(&Energy[Mlo], Energyall, nxy)) {
+      bailout("elastic", "Memory allocation error");
+      freeallmem();
+      exit(1);
+    }
+    if (Mpirank > 0) {
+      freeallmem();
+      slabstop();
+      return (0);
+    }
   }
 
   if (npoints == 1) {
@@ -2772,22 +4662,21 @@ if (doitz) {
 
       fprintf(Logfile, "\nPrinting strain energy field (%d, %d, %d)", Xsyssize,
               Ysyssize, Zsyssize);
-      fflush(Logfile);
+      log_flush(Logfile);
       write_imgheader(outfile, Xsyssize, Ysyssize, Zsyssize, 1.0);
       for (i = 0; i < Xsyssize; i++) {
         for (j = 0; j < Ysyssize; j++) {
           for (k = 0; k < Zsyssize; k++) {
             m = (nxy * k) + (Xsyssize * j) + i;
-            enrgy = 0.5 *
-                    ((stressxx[m] * strainxx[m]) + (stressyy[m] * strainyy[m]) +
-                     (stresszz[m] * strainzz[m]) + (stressxy[m] * strainxy[m]) +
-                     (stressxz[m] * strainxz[m]) + (stressyz[m] * strainyz[m]));
-            fprintf(outfile, "\n%f", enrgy);
+            fprintf(outfile, "\n%f", Energyall ? Energyall[m] : Energy[m]);
           }
         }
       }
       fclose(outfile);
     }
+    if (Vtkout && energyvtk("energy.vti", Energyall ? Energyall : Energy)) {
+      fprintf(stderr, "\n\nWARNING:  Could not write output file energy.vti");
+    }
 
     /***
      *	Compute contribution to the global moduli
@@ -2873,16 +4762,16 @@ if (doitz) {
       for (i = nagg1 - 1; i > 0; i--) {
         xj += 1.0;
         fprintf(Logfile, "\nK[%d] = %f, ", i, K[i]);
-        fflush(Logfile);
+        log_flush(Logfile);
         fprintf(Logfile, "K[%d] = %f, ", Xsyssize - i - 1, K[Xsyssize - i - 1]);
-        fflush(Logfile);
+        log_flush(Logfile);
         fprintf(Logfile, "G[%d] = %f, ", i, G[i]);
-        fflush(Logfile);
+        log_flush(Logfile);
         fprintf(Logfile, "G[%d] = %f, ", Xsyssize - i - 1, G[Xsyssize - i - 1]);
         kk = 0.50 * (K[i] + K[Xsyssize - i - 1]);
         gg = 0.50 * (G[i] + G[Xsyssize - i - 1]);
         fprintf(Logfile, "\n%.1f %.4f %.4f ", xj, kk, gg);
-        fflush(Logfile);
+        log_flush(Logfile);
         if (i == (nagg1 - 1)) {
           fprintf(outfile, "Distance (um),Bulk Modulus (GPa),Shear Modulus "
                            "(GPa),Elastic Modulus (GPa),Poisson Ratio");
@@ -2890,17 +4779,17 @@ if (doitz) {
         } else {
           fprintf(outfile, "\n%.1f,%.4f,%.4f,", xj, kk, gg);
         }
-        fflush(Logfile);
+        log_flush(Logfile);
         fflush(outfile);
         young = 9. * kk * gg / (3. * kk + gg);
         pois = (3. * kk - 2. * gg) / 2. / (3. * kk + gg);
         fprintf(Logfile, "%.4f %.4f", young, pois);
         fprintf(outfile, "%.4f,%.4f", young, pois);
-        fflush(Logfile);
+        log_flush(Logfile);
         fflush(outfile);
       }
       fprintf(Logfile, "\nEND");
-      fflush(Logfile);
+      log_flush(Logfile);
       fclose(outfile);
     }
   } else {
@@ -2915,12 +4804,14 @@ if (doitz) {
   }
 
   fprintf(Logfile, "\nDone with cement paste calculations.");
-  fflush(Logfile);
+  log_flush(Logfile);
   if (doitz) {
     oval = concelas(nagg1, bulk, shear);
   }
 
+  trace_report(Logfile);
   freeallmem();
+  slabstop();
   return (0);
 }
 
@@ -2989,24 +4880,24 @@ int concelas(int nagg1, double bulkmod, double shearmod) {
   }
 
   fprintf(Logfile, "\n\nEnter fully resolved name of cement PSD file: ");
-  fflush(Logfile);
+  log_flush(Logfile);
   read_string(cempsdfile, sizeof(cempsdfile));
   fprintf(Logfile, "\n%s", cempsdfile);
-  fflush(Logfile);
+  log_flush(Logfile);
   cempsd = filehandler("concelas", cempsdfile, "READ");
   if (!cempsd) {
     fprintf(Logfile, "\nCould not open cement PSD file %s", cempsdfile);
-    fflush(Logfile);
+    log_flush(Logfile);
     sprintf(buff1, "Could not open cement PSD file %s", cempsdfile);
     warning("concelas", buff1);
     warning("concelas", "Using median cement PSD of 15 micrometers");
     itzwidth = 10.0;
   } else {
     fprintf(Logfile, "\nEntering mediansize function with valid file pointer");
-    fflush(Logfile);
+    log_flush(Logfile);
     itzwidth = mediansize(cempsd);
     fprintf(Logfile, "\nFound median cement particle size of %f", itzwidth);
-    fflush(Logfile);
+    log_flush(Logfile);
     fclose(cempsd);
   }
 
@@ -3018,7 +4909,7 @@ int concelas(int nagg1, double bulkmod, double shearmod) {
             "\n\nCalculated ITZ width is %f micrometers (%d voxels), nagg1 "
             "= %d",
             itzwidth, itzpix, nagg1);
-    fflush(Logfile);
+    log_flush(Logfile);
 
     /* Knowing the ITZ width, find average values of
      * the bulk and shear moduli inside the ITZ */
@@ -3039,7 +4930,7 @@ int concelas(int nagg1, double bulkmod, double shearmod) {
 
     fprintf(Logfile, "\nCalculated bulk modulus of ITZ = %f", kitz);
     fprintf(Logfile, "\nCalculated shear modulus of ITZ = %f", gitz);
-    fflush(Logfile);
+    log_flush(Logfile);
 
     /* Now find values for bulk and shear moduli of bulk paste */
 
@@ -3105,9 +4996,9 @@ int concelas(int nagg1, double bulkmod, double shearmod) {
   fprintf(Logfile, "\nEnter name of fine agg grading file: ");
   read_string(finegfile, sizeof(finegfile));
   fprintf(Logfile, "\n%s", finegfile);
-  fflush(Logfile);
+  log_flush(Logfile);
   fprintf(Logfile, "\n\nEnter BULK modulus for fine aggregate (in GPa): ");
-  fflush(Logfile);
+  log_flush(Logfile);
   read_string(buff, sizeof(buff));
   kfine = atof(buff);
   fprintf(Logfile, "\n%f", kfine);
@@ -3115,7 +5006,7 @@ int concelas(int nagg1, double bulkmod, double shearmod) {
   read_string(buff, sizeof(buff));
   gfine = atof(buff);
   fprintf(Logfile, "\n%f", gfine);
-  fflush(Logfile);
+  log_flush(Logfile);
   if (fine_agg_vf > 0) {
     gfile = filehandler("concelas", finegfile, "READ");
     if (!gfile) {
@@ -3388,7 +5279,7 @@ int concelas(int nagg1, double bulkmod, double shearmod) {
     xk = k;
     xg = g;
     fprintf(Logfile, "\n\t Iteration %d: k = %f, g = %f", i, k, g);
-    fflush(Logfile);
+    log_flush(Logfile);
     if (xx[i + 1] < target_matrix_vf) {
       z = (target_matrix_vf - xx[i]) / (xx[i + 1] - xx[i]);
       xg = gsave[i] + (z * (gsave[i + 1] - gsave[i]));
@@ -3434,7 +5325,7 @@ int concelas(int nagg1, double bulkmod, double shearmod) {
   fprintf(Logfile,
           "\tConcrete_Cylinder_Compressive_strength (0.62*cube): %.4f MPa\n",
           concrete_cube_strngth * 0.624);
-  fflush(Logfile);
+  log_flush(Logfile);
   fprintf(fpout, "\nconcrete_Matrix_vol_frac,%.4f,", target_matrix_vf);
   fprintf(fpout, "\nconcrete_bulk_mod: %.4f,GPa", xk);
   fprintf(fpout, "\nconcrete_shear_mod,%.4f,GPa", xg);
@@ -3531,7 +5422,7 @@ void effective(double itzwidth, double kitz, double gitz) {
     G_concelas[i] = gg * gitz;
     fprintf(Logfile, ", G_concelas[%d] = %f", i, G_concelas[i]);
   }
-  fflush(Logfile);
+  log_flush(Logfile);
 
   return;
 }
@@ -14,10 +14,14 @@
  * October 2004
  *******************************************************/
 #include "include/vcctl.h"
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 /*
 #define DEBUG
@@ -71,8 +75,6 @@
 #define BURNT 2440000
 #define FCHECK BURNT /* Temporary flag for preventing particle touching */
 
-#define MAXBURNING 2390000
-
 /* maximum number of different particle sizes */
 #define NUMSOURCES                                                             \
   2 /* number of different sources allowed for each aggregate type */
@@ -124,6 +126,14 @@ struct Surfpix {
   int x, y, z; /* position of surface pixel in bounding box */
 };
 
+/* Surface pixels for adjustvol, grown as needed */
+struct Surfpix *Surfbuf = NULL;
+int Surfbufmax = 0;
+
+/* Runs of brickruns for checksphere and checkpart, grown as needed */
+int *Runbuf = NULL;
+int Runbufmax = 0;
+
 /***
  *    Global variable declarations:
  *
@@ -133,11 +143,18 @@ struct Surfpix {
  *        Aggreal stores the phase id of each particle,
  *        signifying coarse or fine aggregate source
  *
+ *        Both are kept as bricks (see brickbox.c), so that
+ *        the inside of an aggregate particle, or a stretch of
+ *        binder, costs next to nothing however large the
+ *        system.  They are read with BRICKGET and written
+ *        with aggset.
+ *
  *        Bbox stores the local aggregate particle
  ***/
 
 int Verbose;
-int ***Agg, ***Aggreal, ***Bbox;
+Brickbox Agg, Aggreal;
+int ***Bbox;
 
 /***
  *    System size (pixels per edge), number of
@@ -153,7 +170,7 @@ int Isizemag = 1;
 float Sizemag = 1.0;
 int Npart, Aggsize, Shape;
 const int Shapesperbin = 4;
-int Npartc, Burnt, Maxburning;
+int Npartc;
 int Allocated = 0;
 
 int N_total = 0;
@@ -182,13 +199,58 @@ int Itz;
 double Pi;
 
 fcomplex **Y, **A, **AA;
+
+/* Spherical harmonics on the quadrature grid Xg, Wg */
+Shgrid Aggsh;
 int Ntheta, Nphi;
 int Nnn = NNN;
 
+/***
+ *    Threads for digitizing real-shape particles (--threads n).
+ *    Thread 0 evaluates the harmonics into Y and each other
+ *    thread into its own matrix in Ythread; every voxel is found
+ *    the same way whatever the number, so the packing does not
+ *    depend on it.
+ ***/
+int Nthreads = 1;
+fcomplex ***Ythread = NULL;
+int Nythread = 0;
+
 /* Flags for checkpart */
 static int Check = 1;
 static int Place = 2;
 
+/***
+ *    Distance map for placing particles (--edt-placement).
+ *    Edt holds, for each voxel, the squared Euclidean distance
+ *    to the nearest voxel of Agg that a particle may not
+ *    overlap (anything but porosity and ITZ), with periodic
+ *    boundaries, x varying fastest.  It is exact when made by
+ *    edtbuild; as particles are placed their voxels are set to
+ *    zero and the voxels around each are capped by their
+ *    squared distance to its middle voxel, so Edt never falls
+ *    below the true value.  Edtcand lists the voxels with Edt
+ *    above Edtr2, from which trial sites are drawn and then
+ *    checked as usual.  The map is made again exactly when the
+ *    list runs out, before giving up on it, and also once the
+ *    voxels checked at sites that did not fit add up to the
+ *    size of the system, which keeps the misses from costing
+ *    more than the map itself.  A sphere of radius
+ *    r covers the voxels within squared distance r(r+1) of its
+ *    center, so it fits exactly where the exact map is above
+ *    that.
+ ***/
+
+#define EDTINF (INT_MAX / 4)
+#define EDTDRAWS 64 /* Random draws before searching the whole list */
+
+int Edtplace = 0;
+int *Edt = NULL;
+int *Edtcand = NULL;
+int Edtncand = 0, Edtr2 = -1, Edtlast = -1, Edtlastr2 = -1, Edtstale = 0;
+double Edtmisswork = 0.0; /* Voxels checked in vain since edtbuild */
+int Edtnone = EDTINF; /* No site for a squared radius this big */
+
 /* File root for real shape anm files */
 char Pathroot[MAXSTRING], Shapeset[MAXSTRING];
 char Filesep;
@@ -217,6 +279,8 @@ struct lineitem {
   float thickness;
   float nlength;
   float nwidth;
+  int loaded;     /* anm file read and volume computed */
+  float shvolume; /* volume by quadrature as read, in pixels */
 };
 
 /***
@@ -225,9 +289,24 @@ struct lineitem {
 
 void checkargs(int argc, char *argv[]);
 int getsystemsize(void);
+void aggset(Brickbox *bb, int x, int y, int z, int val);
+void edtline(int *line, int n, size_t stride, double *f, double *z, int *v);
+int edtmap(int *map, int nx, int ny, int nz);
+int edtbuild(void);
+int edtdraw(int r2, int *x, int *y, int *z);
+void edtmiss(void);
+void edtnear(int x, int y, int z);
+int bboxcenter(int nxp, int nyp, int nzp, int *ic, int *jc, int *kc);
+int edtpart(int nxp, int nyp, int nzp, int ic, int jc, int kc);
+void edtfree(void);
 void genparticles(int type, int numsources, int vol[NUMSOURCES][MAXSIZECLASSES],
                   float sizeeachmin[NUMSOURCES][MAXSIZECLASSES],
                   float sizeeachmax[NUMSOURCES][MAXSIZECLASSES], FILE *fpout);
+int brickruns(int lo, int hi, int n, int *start, int *len);
+int *runroom(int nr);
+int spherecovers(int dx, int dy, int dz, int radd);
+int spherebricks(int xin, int yin, int zin, int radd);
+int partbricks(int xin, int yin, int zin, int nxp, int nyp, int nzp);
 int checksphere(int xin, int yin, int zin, int radd, int wflg, int phase2);
 int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int volume,
               int phasein, int phase2, int wflg);
@@ -236,19 +315,19 @@ int adjustvol(int diff, int nxp, int nyp, int nzp);
 void create(int type, int numtimes);
 void addlayer(int nxp, int nyp, int nzp);
 void striplayer(int nxp, int nyp, int nzp);
-void additz(int nxp, int nyp, int nzp);
+int additz(void);
+int itzbrick(size_t n, unsigned char *solid, int **itz);
 void measure(void);
 void connect(void);
 void outmic(void);
-void harm(double theta, double phi);
-double fac(int j);
+int imagethreads(void);
 void freeallmem(void);
 
 int main(int argc, char *argv[]) {
   int userc; /* User choice from menu */
   int nseed, numtimes;
   char instring[MAXSTRING];
-  register int ig, jg, kg;
+  register int ig, jg;
 
   /* Initialize global arrays */
   for (jg = 0; jg < NUMSOURCES; jg++) {
@@ -263,8 +342,6 @@ int main(int argc, char *argv[]) {
   AA = NULL;
   Y = NULL;
   Bbox = NULL;
-  Agg = NULL;
-  Aggreal = NULL;
   Xg = NULL;
   Wg = NULL;
 
@@ -315,17 +392,6 @@ int main(int argc, char *argv[]) {
         bailout("genaggpack", "Memory allocation error");
         exit(1);
       }
-
-      /* Clear the 3-D system to all porosity to start */
-
-      for (kg = 0; kg < Zsyssize; kg++) {
-        for (jg = 0; jg < Ysyssize; jg++) {
-          for (ig = 0; ig < Xsyssize; ig++) {
-            Agg[ig][jg][kg] = POROSITY;
-            Aggreal[ig][jg][kg] = POROSITY;
-          }
-        }
-      }
       break;
     case ADDCOARSEPART:
       create((int)COARSE, numtimes);
@@ -357,7 +423,10 @@ int main(int argc, char *argv[]) {
 /***
  *   checkargs
  *
- *     Checks command-line arguments
+ *     Checks command-line arguments: -v or --verbose,
+ *     --edt-placement to draw trial sites from a distance map,
+ *     and -t or --threads n to digitize real-shape particles
+ *     on n threads
  *
  *     Arguments:    int argc, char *argv[]
  *     Returns:    nothing
@@ -371,9 +440,18 @@ void checkargs(int argc, char *argv[]) {
   /* Is verbose output requested? */
 
   Verbose = 0;
+  Nthreads = thread_default(Nthreads);
   for (i = 1; i < argc; i++) {
     if ((!strcmp(argv[i], "-v")) || (!strcmp(argv[i], "--verbose")))
       Verbose = 1;
+    if (!strcmp(argv[i], "--edt-placement"))
+      Edtplace = 1;
+    if (((!strcmp(argv[i], "-t")) || (!strcmp(argv[i], "--threads"))) &&
+        (i + 1 < argc)) {
+      Nthreads = atoi(argv[++i]);
+      if (Nthreads < 1)
+        Nthreads = 1;
+    }
   }
 }
 
@@ -385,7 +463,7 @@ void checkargs(int argc, char *argv[]) {
  *     Arguments:    none
  *     Returns:    status flag (0 if okay, -1 if memory allocation error)
  *
- *    Calls:        no routines
+ *    Calls:        brickbox_alloc, brickbox_free
  *    Called by:    main program
  ***/
 int getsystemsize(void) {
@@ -427,7 +505,8 @@ int getsystemsize(void) {
   */
 
   /***
-   *    Now dynamically allocate the memory for the Agg array
+   *    Now dynamically allocate the memory for the Agg array,
+   *    all porosity to start
    ***/
 
   Syspix = (int)(Xsyssize * Ysyssize * Zsyssize);
@@ -435,110 +514,745 @@ int getsystemsize(void) {
   Isizemag = (int)(Sizemag + 0.5);
   if (Isizemag < 1)
     Isizemag = 1;
-  Npartc = (NPARTC * Isizemag);
-  Burnt = (BURNT * Isizemag);
-  Maxburning = (MAXBURNING * Isizemag);
+  Npartc = (Isizemag > INT_MAX / NPARTC) ? INT_MAX : (NPARTC * Isizemag);
 
-  Agg = NULL;
-
-  Agg = ibox(Xsyssize, Ysyssize, Zsyssize);
-  if (!Agg) {
+  brickbox_free(&Agg);
+  brickbox_free(&Aggreal);
+  if (brickbox_alloc(&Agg, Xsyssize, Ysyssize, Zsyssize, POROSITY) ||
+      brickbox_alloc(&Aggreal, Xsyssize, Ysyssize, Zsyssize, POROSITY)) {
     return (MEMERR);
   }
 
-  Aggreal = NULL;
+  Allocated = 1;
 
-  Aggreal = ibox(Xsyssize, Ysyssize, Zsyssize);
-  if (!Aggreal) {
-    return (MEMERR);
+  return (0);
+}
+
+/***
+ *    aggset
+ *
+ *     Set one voxel of Agg or Aggreal, bailing out if the brick
+ *     it is in has no room for its voxels
+ *
+ *     Arguments:    Brickbox pointer (&Agg or &Aggreal)
+ *                 int x,y,z location, inside the system
+ *                 int value
+ *     Returns:    Nothing
+ *
+ *    Calls:        brickbox_set
+ *    Called by:    checksphere, checkpart
+ ***/
+void aggset(Brickbox *bb, int x, int y, int z, int val) {
+  if (brickbox_set(bb, x, y, z, val)) {
+    freeallmem();
+    bailout("genaggpack", "Memory allocation error");
+    exit(1);
   }
 
-  Allocated = 1;
+  return;
+}
+
+/***
+ *    edtline
+ *
+ *     Squared distance transform of one periodic line of the
+ *     distance map, in place, by the lower envelope of
+ *     parabolas (Felzenszwalb and Huttenlocher).  The line is
+ *     laid out three times end to end so that the nearest
+ *     periodic image of every solid voxel is seen.
+ *
+ *     Arguments:    int pointer to the first value of the line
+ *                 int length n of the line
+ *                 size_t stride between values of the line
+ *                 double scratch f[3n] and z[3n+1]
+ *                 int scratch v[3n]
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    edtmap
+ ***/
+void edtline(int *line, int n, size_t stride, double *f, double *z, int *v) {
+  int q, k, m;
+  double s, d;
+
+  m = 3 * n;
+  for (q = 0; q < m; q++) {
+    f[q] = (double)line[(size_t)(q % n) * stride];
+  }
+
+  k = 0;
+  v[0] = 0;
+  z[0] = -HUGE_VAL;
+  z[1] = HUGE_VAL;
+  for (q = 1; q < m; q++) {
+    s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) /
+        (2.0 * (q - v[k]));
+    while (s <= z[k]) {
+      k--;
+      s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) /
+          (2.0 * (q - v[k]));
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = HUGE_VAL;
+  }
+
+  k = 0;
+  for (q = 0; q < 2 * n; q++) {
+    while (z[k + 1] < q)
+      k++;
+    if (q >= n) {
+      d = (double)(q - v[k]) * (q - v[k]) + f[v[k]];
+      line[(size_t)(q - n) * stride] = (d < EDTINF) ? (int)d : EDTINF;
+    }
+  }
+
+  return;
+}
+
+/***
+ *    edtmap
+ *
+ *     Turn a map that is 0 at solid voxels and EDTINF elsewhere
+ *     into the exact squared distance to the nearest solid,
+ *     with periodic boundaries, one axis at a time
+ *
+ *     Arguments:    int pointer to the map, x varying fastest
+ *                 int nx,ny,nz size of the map
+ *     Returns:    0 if okay, 1 if out of memory (then the map is
+ *                 left as it was)
+ *
+ *    Calls:        edtline
+ *    Called by:    edtbuild, additz
+ ***/
+int edtmap(int *map, int nx, int ny, int nz) {
+  int i, j, k, n;
+  int *v;
+  size_t sx, sy, sz;
+  double *f, *z;
+
+  n = max(nx, max(ny, nz));
+  f = (double *)malloc(3 * n * sizeof(double));
+  z = (double *)malloc((3 * n + 1) * sizeof(double));
+  v = (int *)malloc(3 * n * sizeof(int));
+  if (!f || !z || !v) {
+    if (f)
+      free(f);
+    if (z)
+      free(z);
+    if (v)
+      free(v);
+    return (1);
+  }
+
+  sx = 1;
+  sy = (size_t)nx;
+  sz = (size_t)nx * ny;
+
+  for (k = 0; k < nz; k++) {
+    for (j = 0; j < ny; j++) {
+      edtline(map + k * sz + j * sy, nx, sx, f, z, v);
+    }
+  }
+  for (k = 0; k < nz; k++) {
+    for (i = 0; i < nx; i++) {
+      edtline(map + k * sz + i * sx, ny, sy, f, z, v);
+    }
+  }
+  for (j = 0; j < ny; j++) {
+    for (i = 0; i < nx; i++) {
+      edtline(map + j * sy + i * sx, nz, sz, f, z, v);
+    }
+  }
+
+  free(f);
+  free(z);
+  free(v);
 
   return (0);
 }
 
 /***
- *    checksphere
+ *    edtbuild
  *
- *    routine to check or perform placement of sphere of ID phasein,
- *    centered at location (xin,yin,zin) of radius radd.
+ *     Make the exact distance map from the Agg image and empty
+ *     the list of trial sites
  *
- *     Arguments:
- *         int xin,yin,zin is the centroid of the sphere to add
- *         int radd is the radius of the sphere to add
- *        int wflg (1=check for fit of sphere, 2=place the sphere)
- *        int phase2 phase to assign to sphere
+ *     Arguments:    None
+ *     Returns:    0 if okay, 1 if out of memory (then there is no map)
  *
- *     Returns:    integer flag telling whether sphere will fit
+ *    Calls:        edtmap, edtfree
+ *    Called by:    create, edtdraw
+ ***/
+int edtbuild(void) {
+  int i, j, k, val;
+  size_t nvox, sy, sz;
+
+  nvox = (size_t)Xsyssize * Ysyssize * Zsyssize;
+  if (!Edt) {
+    Edt = (int *)malloc(nvox * sizeof(int));
+    Edtcand = (int *)malloc(nvox * sizeof(int));
+  }
+  if (!Edt || !Edtcand) {
+    edtfree();
+    return (1);
+  }
+
+  sy = (size_t)Xsyssize;
+  sz = (size_t)Xsyssize * Ysyssize;
+
+  for (k = 0; k < Zsyssize; k++) {
+    for (j = 0; j < Ysyssize; j++) {
+      for (i = 0; i < Xsyssize; i++) {
+        val = BRICKGET(&Agg, i, j, k);
+        Edt[k * sz + j * sy + i] =
+            (val != POROSITY && val != ITZ) ? 0 : EDTINF;
+      }
+    }
+  }
+
+  if (edtmap(Edt, Xsyssize, Ysyssize, Zsyssize)) {
+    edtfree();
+    return (1);
+  }
+
+  Edtncand = 0;
+  Edtr2 = -1;
+  Edtlast = -1;
+  Edtstale = 0;
+  Edtmisswork = 0.0;
+
+  return (0);
+}
+
+/***
+ *    edtdraw
+ *
+ *     Draw a trial site at random for a particle of squared
+ *     radius r2.  The list of sites holds the voxels whose
+ *     distance map is above Edtr2, and is made again only for
+ *     a particle smaller than that, so within a size class it
+ *     settles at the smallest particle after a few of them.
+ *     Entries that have dropped to Edtr2 or below are removed
+ *     as they are drawn, and ones too close to a solid for this
+ *     particle are passed over.  After EDTDRAWS draws without a
+ *     site the whole list is searched, from a random place.  If
+ *     it has none and the map has been updated since it was
+ *     last made exactly, it is made again and the list with
+ *     it.  The map is made again first, too, when the misses
+ *     since it was made have cost more than making it.  Once
+ *     the exact map has no site for a squared radius, no larger
+ *     one is tried on it again.
+ *
+ *     Arguments:    int squared radius r2 of the particle
+ *                 int pointers to the x,y,z location to draw
+ *     Returns:    0 if a site was drawn, 1 if there is none
+ *
+ *    Calls:        ran1, edtbuild
+ *    Called by:    genparticles
+ ***/
+int edtdraw(int r2, int *x, int *y, int *z) {
+  int k, m, ndraw, idx;
+  size_t n, nvox;
+
+  if (!Edt || r2 >= Edtnone)
+    return (1);
+
+  nvox = (size_t)Xsyssize * Ysyssize * Zsyssize;
+  if (Edtstale && Edtmisswork > (double)nvox && edtbuild())
+    return (1);
+
+  do {
+    if (Edtr2 < 0 || r2 < Edtr2) {
+      Edtncand = 0;
+      for (n = 0; n < nvox; n++) {
+        if (Edt[n] > r2)
+          Edtcand[Edtncand++] = (int)n;
+      }
+      Edtr2 = r2;
+    }
+
+    k = -1;
+    for (ndraw = 0; (ndraw < EDTDRAWS) && (Edtncand > 0); ndraw++) {
+      m = (int)((float)Edtncand * ran1(Seed));
+      if (m >= Edtncand)
+        m = Edtncand - 1;
+      idx = Edtcand[m];
+      if (Edt[idx] > r2) {
+        k = m;
+        break;
+      }
+      if (Edt[idx] <= Edtr2)
+        Edtcand[m] = Edtcand[--Edtncand];
+    }
+
+    if (k < 0 && Edtncand > 0) {
+      m = (int)((float)Edtncand * ran1(Seed));
+      if (m >= Edtncand)
+        m = Edtncand - 1;
+      for (ndraw = 0; ndraw < Edtncand; ndraw++) {
+        if (Edt[Edtcand[(m + ndraw) % Edtncand]] > r2) {
+          k = (m + ndraw) % Edtncand;
+          break;
+        }
+      }
+    }
+
+    if (k >= 0) {
+      idx = Edtcand[k];
+      Edtlast = k;
+      Edtlastr2 = r2;
+      *x = idx % Xsyssize;
+      *y = (idx / Xsyssize) % Ysyssize;
+      *z = idx / (Xsyssize * Ysyssize);
+      return (0);
+    }
+
+    if (!Edtstale) {
+      Edtnone = r2;
+      return (1);
+    }
+    if (edtbuild())
+      return (1);
+
+  } while (1);
+
+  return (1);
+}
+
+/***
+ *    edtmiss
+ *
+ *     Note that the particle did not fit at the last site
+ *     drawn by edtdraw.  Something solid is then within its
+ *     squared radius of the site, so the distance map there is
+ *     capped at that, and the site leaves the list if that puts
+ *     it at or below the list's own squared radius.  The
+ *     voxels checked there are added to Edtmisswork.
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    genparticles
+ ***/
+void edtmiss(void) {
+  int idx;
+  double side;
+
+  if (Edtlast >= 0 && Edtlast < Edtncand) {
+    side = 2.0 * sqrt((double)Edtlastr2) + 1.0;
+    Edtmisswork += side * side * side;
+    idx = Edtcand[Edtlast];
+    if (Edt[idx] > Edtlastr2)
+      Edt[idx] = Edtlastr2;
+    if (Edt[idx] <= Edtr2)
+      Edtcand[Edtlast] = Edtcand[--Edtncand];
+  }
+  Edtlast = -1;
+
+  return;
+}
+
+/***
+ *    edtnear
+ *
+ *     Cap the distance map around the middle voxel of a
+ *     particle just placed by the squared distance to that
+ *     voxel, out to the radius of the current list of trial
+ *     sites
+ *
+ *     Arguments:    int x,y,z location of the voxel, inside the system
+ *     Returns:    Nothing
  *
  *    Calls:        checkbc
  *    Called by:    genparticles
  ***/
-int checksphere(int xin, int yin, int zin, int radd, int wflg, int phase2) {
-  int nofits, xp, yp, zp, i, j, k, nump;
-  float dist, xdist, ydist, zdist, ftmp;
+void edtnear(int x, int y, int z) {
+  int i, j, k, h, d2;
+  size_t idx;
+
+  if (!Edt)
+    return;
+
+  Edtstale = 1;
+  if (Edtr2 < 0)
+    return;
+
+  h = (int)sqrt((double)Edtr2) + 1;
+  h = min(h, min(Xsyssize, min(Ysyssize, Zsyssize)) / 2);
+  for (k = -h; k <= h; k++) {
+    for (j = -h; j <= h; j++) {
+      for (i = -h; i <= h; i++) {
+        d2 = i * i + j * j + k * k;
+        if (d2 > Edtr2)
+          continue;
+        idx = ((size_t)(z + k + checkbc(z + k, Zsyssize)) * Ysyssize +
+               (y + j + checkbc(y + j, Ysyssize))) *
+                  Xsyssize +
+              (x + i + checkbc(x + i, Xsyssize));
+        if (Edt[idx] > d2)
+          Edt[idx] = d2;
+      }
+    }
+  }
 
-  nofits = nump = 0; /* Flag indicating if placement is possible */
+  return;
+}
 
-  /***
-   *    Check all pixels within the digitized sphere volume
-   ***/
+/***
+ *    bboxcenter
+ *
+ *     Find the voxel at the middle of the bounding box of a
+ *     real-shape particle, as checkpart takes it, and whether
+ *     checkpart tests it
+ *
+ *     Arguments:    int nxp,nyp,nzp dimensions of the bounding box
+ *                 int pointers to the middle voxel i,j,k
+ *     Returns:    1 if the middle voxel is tested, 0 otherwise
+ *
+ *    Calls:        No other routines
+ *    Called by:    genparticles
+ ***/
+int bboxcenter(int nxp, int nyp, int nzp, int *ic, int *jc, int *kc) {
+  int val;
 
-  if (wflg == Check) {
-    for (i = xin - radd; ((i <= xin + radd) && (!nofits)); i++) {
-      xp = i;
+  *ic = (int)((0.50 * nxp) + 0.01);
+  *jc = (int)((0.50 * nyp) + 0.01);
+  *kc = (int)((0.50 * nzp) + 0.01);
+  if (*ic < 1 || *jc < 1 || *kc < 1)
+    return (0);
 
-      /***
-       *    Adjust for periodic BCs if necessary
-       ***/
+  val = Bbox[*ic][*jc][*kc];
 
-      xp += checkbc(xp, Xsyssize);
+  return (val != POROSITY && val != ITZ);
+}
 
-      ftmp = (float)(i - xin);
-      xdist = ftmp * ftmp;
-      for (j = yin - radd; ((j <= yin + radd) && (!nofits)); j++) {
-        yp = j;
+/***
+ *    edtpart
+ *
+ *     Largest squared distance from a voxel of Bbox to the
+ *     voxels of the particle in it that checkpart tests
+ *
+ *     Arguments:    int nxp,nyp,nzp dimensions of the bounding box
+ *                 int ic,jc,kc the voxel to measure from
+ *     Returns:    integer squared distance
+ *
+ *    Calls:        No other routines
+ *    Called by:    genparticles
+ ***/
+int edtpart(int nxp, int nyp, int nzp, int ic, int jc, int kc) {
+  int i, j, k, d2, r2;
+
+  r2 = 0;
+  for (k = 1; k <= nzp; k++) {
+    for (j = 1; j <= nyp; j++) {
+      for (i = 1; i <= nxp; i++) {
+        if (Bbox[i][j][k] != POROSITY && Bbox[i][j][k] != ITZ) {
+          d2 = (i - ic) * (i - ic) + (j - jc) * (j - jc) + (k - kc) * (k - kc);
+          if (d2 > r2)
+            r2 = d2;
+        }
+      }
+    }
+  }
 
-        /***
-         *    Adjust for periodic BCs if necessary
-         ***/
+  return (r2);
+}
 
-        yp += checkbc(yp, Ysyssize);
+/***
+ *    edtfree
+ *
+ *     Release the distance map
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    edtbuild, create, freeallmem
+ ***/
+void edtfree(void) {
+  if (Edt)
+    free(Edt);
+  if (Edtcand)
+    free(Edtcand);
+  Edt = Edtcand = NULL;
+  Edtncand = 0;
+  Edtr2 = Edtlast = -1;
+  Edtnone = EDTINF;
 
-        ftmp = (float)(j - yin);
-        ydist = ftmp * ftmp;
-        for (k = zin - radd; ((k <= zin + radd) && (!nofits)); k++) {
-          zp = k;
+  return;
+}
 
-          /***
-           *    Adjust for periodic BCs if necessary
-           ***/
+/***
+ *    brickruns
+ *
+ *     Cut a range of one axis, as it is before periodic
+ *     wrapping, into runs that each lie in one brick of Agg
+ *     once wrapped.  The range may wrap once at either end,
+ *     as checkbc allows.
+ *
+ *     Arguments:    int lo,hi ends of the range
+ *                 int n size of the system along the axis
+ *                 int pointers to room for hi - lo + 1 runs, for the
+ *                 first coordinate of each (before wrapping) and
+ *                 its length
+ *     Returns:    int number of runs
+ *
+ *    Calls:        checkbc
+ *    Called by:    spherebricks, partbricks
+ ***/
+int brickruns(int lo, int hi, int n, int *start, int *len) {
+  int m, w, end;
+
+  m = 0;
+  while (lo <= hi) {
+    w = lo + checkbc(lo, n);
+    end = min(hi, lo + BRICKMASK - (w & BRICKMASK));
+    end = min(end, lo + (n - 1 - w));
+    start[m] = lo;
+    len[m++] = end - lo + 1;
+    lo = end + 1;
+  }
 
-          zp += checkbc(zp, Zsyssize);
+  return (m);
+}
 
-          ftmp = (float)(k - zin);
-          zdist = ftmp * ftmp;
+/***
+ *    runroom
+ *
+ *     Room for the runs of brickruns along three axes of
+ *     ranges nr long at most, bailing out if there is none
+ *
+ *     Arguments:    int longest range
+ *     Returns:    int pointer to 6 * nr ints
+ *
+ *    Calls:        No other routines
+ *    Called by:    spherebricks, partbricks
+ ***/
+int *runroom(int nr) {
+  int *buf;
 
-          /***
-           *    Compute distance from center of
-           *    sphere to this pixel
-           ***/
+  if (6 * nr > Runbufmax) {
+    buf = (int *)realloc(Runbuf, 6 * nr * sizeof(int));
+    if (!buf) {
+      freeallmem();
+      bailout("genaggpack", "Memory allocation error");
+      exit(1);
+    }
+    Runbuf = buf;
+    Runbufmax = 6 * nr;
+  }
 
-          dist = sqrt(xdist + ydist + zdist);
-          if ((dist - 0.5) <= (float)radd) {
+  return (Runbuf);
+}
 
-            if ((Agg[xp][yp][zp] != POROSITY) && (Agg[xp][yp][zp] != ITZ))
-              nofits = 1;
+/***
+ *    spherecovers
+ *
+ *     Whether a sphere of radius radd covers the voxel at
+ *     an offset from its center, as checksphere decides it
+ *
+ *     Arguments:    int dx,dy,dz offset of the voxel
+ *                 int radd radius of the sphere
+ *     Returns:    1 if it does, 0 if not
+ *
+ *    Calls:        No other routines
+ *    Called by:    spherebricks
+ ***/
+int spherecovers(int dx, int dy, int dz, int radd) {
+  float dist, ftmp, xdist, ydist, zdist;
+
+  ftmp = (float)dx;
+  xdist = ftmp * ftmp;
+  ftmp = (float)dy;
+  ydist = ftmp * ftmp;
+  ftmp = (float)dz;
+  zdist = ftmp * ftmp;
+  dist = sqrt(xdist + ydist + zdist);
+
+  return ((dist - 0.5) <= (float)radd);
+}
+
+/***
+ *    spherebricks
+ *
+ *     Check whether a sphere fits, a brick of Agg at a time.
+ *     The cube around the sphere is cut into boxes that each
+ *     lie in one brick.  A box in a brick that is all
+ *     porosity or ITZ is passed over, and one in a brick that
+ *     is all solid stops the sphere if the sphere covers its
+ *     voxel nearest the center, without looking at the rest;
+ *     only the boxes in bricks that hold a boundary are
+ *     checked voxel by voxel.  The answer is the one voxel by
+ *     voxel checking would give.
+ *
+ *     Arguments:    int xin,yin,zin center of the sphere
+ *                 int radd radius of the sphere
+ *     Returns:    1 if the sphere does not fit, 0 if it does
+ *
+ *    Calls:        runroom, brickruns, spherecovers, checkbc
+ *    Called by:    checksphere
+ ***/
+int spherebricks(int xin, int yin, int zin, int radd) {
+  int a, b, c, i, j, k, nx, ny, nz, nr, val;
+  int xp, yp, zp;
+  int *xs, *xl, *ys, *yl, *zs, *zl;
+  size_t n;
+
+  nr = 2 * radd + 1;
+  xs = runroom(nr);
+  xl = xs + nr;
+  ys = xl + nr;
+  yl = ys + nr;
+  zs = yl + nr;
+  zl = zs + nr;
+  nx = brickruns(xin - radd, xin + radd, Xsyssize, xs, xl);
+  ny = brickruns(yin - radd, yin + radd, Ysyssize, ys, yl);
+  nz = brickruns(zin - radd, zin + radd, Zsyssize, zs, zl);
+
+  for (a = 0; a < nx; a++) {
+    xp = xs[a] + checkbc(xs[a], Xsyssize);
+    for (b = 0; b < ny; b++) {
+      yp = ys[b] + checkbc(ys[b], Ysyssize);
+      for (c = 0; c < nz; c++) {
+        zp = zs[c] + checkbc(zs[c], Zsyssize);
+        n = BRICKNUM(&Agg, xp, yp, zp);
+
+        if (!Agg.vox[n]) {
+          val = Agg.fill[n];
+          if (val == POROSITY || val == ITZ)
+            continue;
+          i = min(max(xin, xs[a]), xs[a] + xl[a] - 1);
+          j = min(max(yin, ys[b]), ys[b] + yl[b] - 1);
+          k = min(max(zin, zs[c]), zs[c] + zl[c] - 1);
+          if (spherecovers(i - xin, j - yin, k - zin, radd))
+            return (1);
+          continue;
+        }
+
+        for (i = 0; i < xl[a]; i++) {
+          for (j = 0; j < yl[b]; j++) {
+            for (k = 0; k < zl[c]; k++) {
+              val = Agg.vox[n][BRICKPOS(xp + i, yp + j, zp + k)];
+              if (val != POROSITY && val != ITZ &&
+                  spherecovers(xs[a] + i - xin, ys[b] + j - yin,
+                               zs[c] + k - zin, radd))
+                return (1);
+            }
           }
         }
       }
     }
+  }
 
-    /* return flag indicating if sphere will fit */
+  return (0);
+}
 
-    return (nofits);
+/***
+ *    partbricks
+ *
+ *     Check whether a real-shape particle fits, a brick of
+ *     Agg at a time, as spherebricks does for a sphere.  A
+ *     box in a brick that is all solid stops the particle if
+ *     any voxel of the particle falls in it.
+ *
+ *     Arguments:    int xin,yin,zin one less than the lower corner
+ *                 of the bounding box in the system
+ *                 int nxp,nyp,nzp dimensions of the bounding box
+ *     Returns:    1 if the particle does not fit, 0 if it does
+ *
+ *    Calls:        runroom, brickruns, checkbc
+ *    Called by:    checkpart
+ ***/
+int partbricks(int xin, int yin, int zin, int nxp, int nyp, int nzp) {
+  int a, b, c, i, j, k, i1, j1, k1, nx, ny, nz, nr, val, solid;
+  int xp, yp, zp;
+  int *xs, *xl, *ys, *yl, *zs, *zl;
+  size_t n;
+
+  nr = max(nxp, max(nyp, nzp));
+  xs = runroom(nr);
+  xl = xs + nr;
+  ys = xl + nr;
+  yl = ys + nr;
+  zs = yl + nr;
+  zl = zs + nr;
+  nx = brickruns(xin + 1, xin + nxp, Xsyssize, xs, xl);
+  ny = brickruns(yin + 1, yin + nyp, Ysyssize, ys, yl);
+  nz = brickruns(zin + 1, zin + nzp, Zsyssize, zs, zl);
+
+  for (a = 0; a < nx; a++) {
+    xp = xs[a] + checkbc(xs[a], Xsyssize);
+    for (b = 0; b < ny; b++) {
+      yp = ys[b] + checkbc(ys[b], Ysyssize);
+      for (c = 0; c < nz; c++) {
+        zp = zs[c] + checkbc(zs[c], Zsyssize);
+        n = BRICKNUM(&Agg, xp, yp, zp);
+        solid = 0;
+        if (!Agg.vox[n]) {
+          val = Agg.fill[n];
+          if (val == POROSITY || val == ITZ)
+            continue;
+          solid = 1;
+        }
+
+        for (i = 0; i < xl[a]; i++) {
+          i1 = xs[a] + i - xin;
+          for (j = 0; j < yl[b]; j++) {
+            j1 = ys[b] + j - yin;
+            for (k = 0; k < zl[c]; k++) {
+              k1 = zs[c] + k - zin;
+              if (Bbox[i1][j1][k1] == POROSITY || Bbox[i1][j1][k1] == ITZ)
+                continue;
+              if (solid)
+                return (1);
+              val = Agg.vox[n][BRICKPOS(xp + i, yp + j, zp + k)];
+              if (val != POROSITY && val != ITZ)
+                return (1);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *    checksphere
+ *
+ *    routine to check or perform placement of sphere of ID phasein,
+ *    centered at location (xin,yin,zin) of radius radd.
+ *
+ *     Arguments:
+ *         int xin,yin,zin is the centroid of the sphere to add
+ *         int radd is the radius of the sphere to add
+ *        int wflg (1=check for fit of sphere, 2=place the sphere)
+ *        int phase2 phase to assign to sphere
+ *
+ *     Returns:    integer flag telling whether sphere will fit
+ *
+ *    Calls:        checkbc, aggset, spherebricks
+ *    Called by:    genparticles
+ ***/
+int checksphere(int xin, int yin, int zin, int radd, int wflg, int phase2) {
+  int xp, yp, zp, i, j, k, nump;
+  float dist, xdist, ydist, zdist, ftmp;
+
+  nump = 0;
+
+  /***
+   *    Check all pixels within the digitized sphere volume
+   ***/
+
+  if (wflg == Check) {
 
+    /* return flag indicating if sphere will fit */
+
+    return (spherebricks(xin, yin, zin, radd));
   } else {
 
     /* We are placing the particle */
@@ -584,7 +1298,9 @@ int checksphere(int xin, int yin, int zin, int radd, int wflg, int phase2) {
 
           dist = sqrt(xdist + ydist + zdist);
           if ((dist - 0.5) <= (float)radd) {
-            Agg[xp][yp][zp] = phase2;
+            aggset(&Agg, xp, yp, zp, phase2);
+            if (Edt)
+              Edt[((size_t)zp * Ysyssize + yp) * Xsyssize + xp] = 0;
             nump++;
           }
         }
@@ -635,8 +1351,9 @@ int checksphere(int xin, int yin, int zin, int radd, int wflg, int phase2) {
              ***/
 
             dist = sqrt(xdist + ydist + zdist);
-            if ((dist - 0.5) <= (float)radd && Agg[xp][yp][zp] == POROSITY) {
-              Agg[xp][yp][zp] = ITZ;
+            if ((dist - 0.5) <= (float)radd &&
+                BRICKGET(&Agg, xp, yp, zp) == POROSITY) {
+              aggset(&Agg, xp, yp, zp, ITZ);
             }
           }
         }
@@ -664,16 +1381,14 @@ int checksphere(int xin, int yin, int zin, int radd, int wflg, int phase2) {
  *
  *     Returns:    integer flag telling whether sphere will fit
  *
- *    Calls:        checkbc
+ *    Calls:        checkbc, aggset, partbricks
  *    Called by:    genparticles
  ***/
 int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int volume,
               int phasein, int phase2, int wflg) {
-  int nofits, i, j, k;
+  int i, j, k;
   int i1, j1, k1, nump, xc, yc, zc;
 
-  nofits = 0; /* Flag indicating if placement is possible */
-
   if (Verbose)
     printf("\nIn Checkpart, Vol = %d, wflg = %d, phase = %d", volume, wflg,
            phase2);
@@ -683,33 +1398,7 @@ int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int volume,
   zc = (0.50 * nzp) + 0.01;
 
   if (wflg == Check) {
-    k = j = i = 1;
-    nofits = 0;
-    while (k <= nzp && !nofits) {
-      j = 1;
-      while (j <= nyp && !nofits) {
-        i = 1;
-        while (i <= nxp && !nofits) {
-          i1 = xin + i;
-          i1 += checkbc(i1, Xsyssize);
-          j1 = yin + j;
-          j1 += checkbc(j1, Ysyssize);
-          k1 = zin + k;
-          k1 += checkbc(k1, Zsyssize);
-          if (Agg[i1][j1][k1] != POROSITY && Agg[i1][j1][k1] != ITZ &&
-              Bbox[i][j][k] != POROSITY && Bbox[i][j][k] != ITZ) {
-
-            nofits = 1;
-          }
-          i++;
-        }
-        j++;
-      }
-      k++;
-    }
-
-    return (nofits);
-
+    return (partbricks(xin, yin, zin, nxp, nyp, nzp));
   } else {
 
     k = j = i = 1;
@@ -726,8 +1415,10 @@ int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int volume,
           k1 = zin + k;
           k1 += checkbc(k1, Zsyssize);
           if (Bbox[i][j][k] != POROSITY && Bbox[i][j][k] < FCHECK) {
-            Agg[i1][j1][k1] = phasein;
-            Aggreal[i1][j1][k1] = phase2;
+            aggset(&Agg, i1, j1, k1, phasein);
+            aggset(&Aggreal, i1, j1, k1, phase2);
+            if (Edt && phasein != POROSITY && phasein != ITZ)
+              Edt[((size_t)k1 * Ysyssize + j1) * Xsyssize + i1] = 0;
             nump++;
           }
           i++;
@@ -760,15 +1451,15 @@ int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int volume,
  *
  *     Returns:    integer flag telling number of solid pixels in the particle
  *
- *    Calls:        checkbc
+ *    Calls:        imagethreads, sphharm, sphradius
  *    Called by:    genparticles
  ***/
 int image(int *nxp, int *nyp, int *nzp) {
   int partc = 0;
-  int n, m, i, j, k, count;
-  fcomplex rr;
+  int i, j, k, count;
   double xc, yc, zc, x1, y1, z1, r;
   double theta, phi;
+  fcomplex **y;
 
   xc = (0.50 * (*nxp)) + 0.01;
   yc = (0.50 * (*nyp)) + 0.01;
@@ -789,49 +1480,60 @@ int image(int *nxp, int *nyp, int *nzp) {
   }
 
   /***
-   *    Assigning solid pixels within Bbox, with id AGG
+   *    Assigning solid pixels within Bbox, with id AGG.
+   *    Each z plane is independent of the others, so the
+   *    planes are shared out among the threads.
    ***/
 
   count = 0;
-  for (k = 1; k <= *nzp && (*nzp < (int)(0.8 * Zsyssize)) &&
-              (*nyp < (int)(0.8 * Ysyssize)) && (*nxp < (int)(0.8 * Xsyssize));
-       k++) {
-    for (j = 1; j <= *nyp; j++) {
-      for (i = 1; i <= *nxp; i++) {
+  if ((*nzp >= (int)(0.8 * Zsyssize)) || (*nyp >= (int)(0.8 * Ysyssize)) ||
+      (*nxp >= (int)(0.8 * Xsyssize)))
+    return (count);
 
-        x1 = (double)i;
-        y1 = (double)j;
-        z1 = (double)k;
+  imagethreads();
 
-        r = sqrt(((x1 - xc) * (x1 - xc)) + ((y1 - yc) * (y1 - yc)) +
-                 ((z1 - zc) * (z1 - zc)));
-        if (r == 0.0) {
-          count++;
-          Bbox[i][j][k] = AGG;
-          break;
-        }
-
-        theta = acos((z1 - zc) / r);
-        phi = atan((y1 - yc) / (x1 - xc));
-
-        if ((y1 - yc) < 0.0 && (x1 - xc) < 0.0)
-          phi += Pi;
-        if ((y1 - yc) > 0.0 && (x1 - xc) < 0.0)
-          phi += Pi;
-        if ((y1 - yc) < 0.0 && (x1 - xc) > 0.0)
-          phi += 2.0 * Pi;
-        harm(theta, phi);
-        rr = Complex(0.0, 0.0);
-        rr = Cmul(AA[0][0], Y[0][0]);
-        for (n = 1; n <= Nnn; n++) {
-          for (m = -n; m <= n; m++) {
-            rr = Cadd(rr, Cmul(AA[n][m], Y[n][m]));
+#ifdef _OPENMP
+#pragma omp parallel num_threads(Nthreads)                                     \
+    private(i, j, k, x1, y1, z1, r, theta, phi, y) reduction(+ : count)
+#endif
+  {
+    y = Y;
+#ifdef _OPENMP
+    if (omp_get_thread_num() > 0)
+      y = Ythread[omp_get_thread_num() - 1];
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (k = 1; k <= *nzp; k++) {
+      for (j = 1; j <= *nyp; j++) {
+        for (i = 1; i <= *nxp; i++) {
+
+          x1 = (double)i;
+          y1 = (double)j;
+          z1 = (double)k;
+
+          r = sqrt(((x1 - xc) * (x1 - xc)) + ((y1 - yc) * (y1 - yc)) +
+                   ((z1 - zc) * (z1 - zc)));
+          if (r == 0.0) {
+            count++;
+            Bbox[i][j][k] = AGG;
+            break;
           }
-        }
 
-        if (r <= (rr.r)) {
-          Bbox[i][j][k] = AGG;
-          count++;
+          theta = acos((z1 - zc) / r);
+          phi = atan((y1 - yc) / (x1 - xc));
+
+          if ((y1 - yc) < 0.0 && (x1 - xc) < 0.0)
+            phi += Pi;
+          if ((y1 - yc) > 0.0 && (x1 - xc) < 0.0)
+            phi += Pi;
+          if ((y1 - yc) < 0.0 && (x1 - xc) > 0.0)
+            phi += 2.0 * Pi;
+          sphharm(theta, phi, Nnn, y);
+
+          if (r <= sphradius(AA, y, Nnn)) {
+            Bbox[i][j][k] = AGG;
+            count++;
+          }
         }
       }
     }
@@ -1049,61 +1751,53 @@ int smallimage(int *nxp, int *nyp, int *nzp, int vol) {
  *    Calls:        no functions
  *    Called by:    genparticles
  ***/
-int adjustvol(int diff, int nxp, int nyp, int nzp) {
-  int i, j, k, count, absdiff, n;
-  int choice, numsp;
-  struct Surfpix sp[MAXSP];
-
-  /* Initialize local sp array */
-
-  for (i = 0; i < MAXSP; i++) {
-    sp[i].x = 0;
-    sp[i].y = 0;
-    sp[i].z = 0;
-  }
+int adjustvol(int diff, int nxp, int nyp, int nzp) {
+  int i, j, k, count, absdiff, n;
+  int choice, numsp, add;
 
   absdiff = abs(diff);
 
   /* Populate list of surface pixels */
 
   numsp = 0;
-  if (diff > 0) {
-    /* add solid pixels to surface */
-    for (i = 2; i < nxp; i++) {
-      for (j = 2; j < nyp; j++) {
-        for (k = 2; k < nzp; k++) {
-          if (Bbox[i][j][k] == POROSITY &&
-              ((Bbox[i + 1][j][k] == AGG) || (Bbox[i - 1][j][k] == AGG) ||
-               (Bbox[i][j + 1][k] == AGG) || (Bbox[i][j - 1][k] == AGG) ||
-               (Bbox[i][j][k + 1] == AGG) || (Bbox[i][j][k - 1] == AGG))) {
-            /* add i,j,k to surface pixels */
-            sp[numsp].x = i;
-            sp[numsp].y = j;
-            sp[numsp].z = k;
-            numsp++;
-          }
+  for (i = 1; i <= nxp; i++) {
+    for (j = 1; j <= nyp; j++) {
+      for (k = 1; k <= nzp; k++) {
+        if (diff > 0) {
+          /* add solid pixels to surface */
+          add = (i >= 2 && i < nxp && j >= 2 && j < nyp && k >= 2 &&
+                 k < nzp && Bbox[i][j][k] == POROSITY &&
+                 ((Bbox[i + 1][j][k] == AGG) || (Bbox[i - 1][j][k] == AGG) ||
+                  (Bbox[i][j + 1][k] == AGG) || (Bbox[i][j - 1][k] == AGG) ||
+                  (Bbox[i][j][k + 1] == AGG) || (Bbox[i][j][k - 1] == AGG)));
+        } else {
+          /* remove solid pixels from surface */
+          add = (Bbox[i][j][k] == AGG && ((Bbox[i + 1][j][k] == POROSITY) ||
+                                          (Bbox[i - 1][j][k] == POROSITY) ||
+                                          (Bbox[i][j + 1][k] == POROSITY) ||
+                                          (Bbox[i][j - 1][k] == POROSITY) ||
+                                          (Bbox[i][j][k + 1] == POROSITY) ||
+                                          (Bbox[i][j][k - 1] == POROSITY)));
         }
-      }
-    }
-  } else {
-    /* remove solid pixels from surface */
-    for (i = 1; i <= nxp; i++) {
-      for (j = 1; j <= nyp; j++) {
-        for (k = 1; k <= nzp; k++) {
-          if (Bbox[i][j][k] == AGG && ((Bbox[i + 1][j][k] == POROSITY) ||
-                                       (Bbox[i - 1][j][k] == POROSITY) ||
-                                       (Bbox[i][j + 1][k] == POROSITY) ||
-                                       (Bbox[i][j - 1][k] == POROSITY) ||
-                                       (Bbox[i][j][k + 1] == POROSITY) ||
-                                       (Bbox[i][j][k - 1] == POROSITY))) {
-            /* add i,j,k to surface pixels */
-
-            sp[numsp].x = i;
-            sp[numsp].y = j;
-            sp[numsp].z = k;
-            numsp++;
-          }
+        if (!add)
+          continue;
+
+        /* The surface of a large aggregate can be long */
+
+        if (numsp == Surfbufmax) {
+          struct Surfpix *grown;
+          int newmax = (Surfbufmax > 0) ? 2 * Surfbufmax : MAXSP;
+          grown = (struct Surfpix *)realloc(
+              Surfbuf, (size_t)newmax * sizeof(struct Surfpix));
+          if (!grown)
+            continue;
+          Surfbuf = grown;
+          Surfbufmax = newmax;
         }
+        Surfbuf[numsp].x = i;
+        Surfbuf[numsp].y = j;
+        Surfbuf[numsp].z = k;
+        numsp++;
       }
     }
   }
@@ -1114,36 +1808,33 @@ int adjustvol(int diff, int nxp, int nyp, int nzp) {
 #endif
 
   count = 0;
-  for (n = 1; n <= absdiff; n++) {
+  for (n = 1; n <= absdiff && numsp > 0; n++) {
 
     /***
-     *    randomly select a surface pixel from the list
+     *    randomly select a surface pixel from the list, and
+     *    move the last one into its place
      ***/
 
     choice = (int)(numsp * ran1(Seed));
+    if (choice >= numsp)
+      choice = numsp - 1;
 #ifdef DEBUG
     printf("\n\tIn adjustvol random choice = %d", choice);
     fflush(stdout);
 #endif
 
-    if (choice > numsp)
-      break;
-    if (Bbox[sp[choice].x][sp[choice].y][sp[choice].z] == AGG) {
-      Bbox[sp[choice].x][sp[choice].y][sp[choice].z] = POROSITY;
+    i = Surfbuf[choice].x;
+    j = Surfbuf[choice].y;
+    k = Surfbuf[choice].z;
+    if (Bbox[i][j][k] == AGG) {
+      Bbox[i][j][k] = POROSITY;
       count--;
     } else {
-      Bbox[sp[choice].x][sp[choice].y][sp[choice].z] = AGG;
+      Bbox[i][j][k] = AGG;
       count++;
     }
-    for (i = choice; i < numsp - 1; i++) {
-      sp[i].x = sp[i + 1].x;
-      sp[i].y = sp[i + 1].y;
-      sp[i].z = sp[i + 1].z;
-    }
-    sp[numsp - 1].x = 0;
-    sp[numsp - 1].y = 0;
-    sp[numsp - 1].z = 0;
     numsp--;
+    Surfbuf[choice] = Surfbuf[numsp];
 #ifdef DEBUG
     printf("\n\t\tcount = %d and numsp = %d", count, numsp);
     fflush(stdout);
@@ -1330,42 +2021,199 @@ void striplayer(int nxp, int nyp, int nzp) {
  *    additz
  *
  *     Probes the final microstructure and adds an ITZ layer
- *     of a given thickness (soft shell model)
+ *     of thickness Itz (soft shell model).  The pore voxels
+ *     closer than Itz + 1 voxels to an aggregate, by the
+ *     distance map of Aggreal, become ITZ; for Itz = 1 these
+ *     are the 26 neighbours of the aggregate voxels.
  *
- *     Arguments:    Dimensions nxp,nyp,nzp of bounding box Bbox
- *     Returns:    Nothing
+ *     The map is made a brick at a time (see itzbrick), on
+ *     Nthreads threads, and the bricks that change are put
+ *     back once all are done, so no map of the whole system
+ *     is ever needed.
  *
- *    Calls:        no functions
- *    Called by:    genparticles
+ *     Arguments:    None
+ *     Returns:    0 if okay, 1 if out of memory (then no ITZ is added)
+ *
+ *    Calls:        itzbrick, brickbox_put
+ *    Called by:    create
  ***/
-void additz(int nxp, int nyp, int nzp) {
-  int i, j, k;
-  int ii, jj, kk, iii, jjj, kkk;
-
-  for (k = 1; k < Zsyssize; k++) {
-    for (j = 1; j < Ysyssize; j++) {
-      for (i = 1; i < Xsyssize; i++) {
-        if (Aggreal[i][j][k] != POROSITY && Aggreal[i][j][k] != ITZ) {
-          for (kkk = -1; kkk < 2; kkk++) {
-            kk = k + kkk;
-            kk += checkbc(kk, Zsyssize);
-            for (jjj = -1; jjj < 2; jjj++) {
-              jj = j + jjj;
-              jj += checkbc(jj, Ysyssize);
-              for (iii = -1; iii < 2; iii++) {
-                ii = i + iii;
-                ii += checkbc(ii, Xsyssize);
-                if (Aggreal[ii][jj][kk] == POROSITY)
-                  Aggreal[ii][jj][kk] = ITZ;
-              }
-            }
-          }
+int additz(void) {
+  int val, status;
+  long n;
+  size_t nb, i;
+  unsigned char *solid;
+  int **itz;
+
+  nb = Aggreal.nbrick;
+  solid = (unsigned char *)malloc(nb);
+  itz = (int **)calloc(nb, sizeof(int *));
+  if (!solid || !itz) {
+    free(solid);
+    free(itz);
+    return (1);
+  }
+
+  /* Bricks with aggregate in them (or that may have) */
+
+  for (i = 0; i < nb; i++) {
+    if (!Aggreal.vox[i]) {
+      val = Aggreal.fill[i];
+      solid[i] = (val != POROSITY && val != ITZ);
+    } else {
+      solid[i] = 1;
+    }
+  }
+
+  status = 0;
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 16)           \
+    reduction(| : status)
+  for (n = 0; n < (long)nb; n++) {
+    status |= itzbrick((size_t)n, solid, &itz[n]);
+  }
+
+  for (i = 0; i < nb; i++) {
+    if (itz[i] && !status) {
+      brickbox_put(&Aggreal, i, itz[i]);
+    } else {
+      free(itz[i]);
+    }
+  }
+  free(itz);
+  free(solid);
+
+  return (status);
+}
+
+/***
+ *    itzbrick
+ *
+ *     Find the ITZ voxels of one brick of Aggreal.  The
+ *     distance map is made over the brick and Itz voxels
+ *     around it, with periodic boundaries.  Any aggregate
+ *     voxel within squared distance (Itz + 1)^2 - 1 of a
+ *     voxel of the brick is within Itz of it along each
+ *     axis, so it is in the window, and a distance reached
+ *     by going around the window is at least (Itz + 1)^2,
+ *     so the map is exact wherever it matters.  Bricks
+ *     with no porosity, or no aggregate in reach, are passed
+ *     over.  Aggreal is only read.
+ *
+ *     Arguments:    size_t number of the brick
+ *                 unsigned char flags of the bricks that may
+ *                 hold aggregate
+ *                 int pointer to set to the new voxels of the
+ *                 brick, or NULL if it has no ITZ to add
+ *     Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        edtmap, brickbox_copy
+ *    Called by:    additz
+ ***/
+int itzbrick(size_t n, unsigned char *solid, int **itz) {
+  int i, j, k, a, side, d2max, val, near, changed;
+  int lo[3], len[3], size[3];
+  int *w[3], *map, *vox;
+  size_t pos;
+
+  *itz = NULL;
+  if (!Aggreal.vox[n] && Aggreal.fill[n] != POROSITY)
+    return (0);
+
+  side = BRICKSIDE + 2 * Itz;
+  d2max = (Itz + 1) * (Itz + 1) - 1;
+  size[0] = Xsyssize;
+  size[1] = Ysyssize;
+  size[2] = Zsyssize;
+  lo[0] = (int)(n % Aggreal.nbx) * BRICKSIDE;
+  lo[1] = (int)((n / Aggreal.nbx) % Aggreal.nby) * BRICKSIDE;
+  lo[2] = (int)(n / ((size_t)Aggreal.nbx * Aggreal.nby)) * BRICKSIDE;
+
+  /* Coordinates of the window along each axis, wrapped */
+
+  w[0] = (int *)malloc(3 * side * sizeof(int));
+  if (!w[0])
+    return (1);
+  w[1] = w[0] + side;
+  w[2] = w[1] + side;
+  for (a = 0; a < 3; a++) {
+    len[a] = min(BRICKSIDE, size[a] - lo[a]);
+    for (i = 0; i < side; i++) {
+      w[a][i] = ((lo[a] - Itz + i) % size[a] + size[a]) % size[a];
+    }
+  }
+
+  /***
+   *    Is there aggregate within reach at all?  Each axis of
+   *    the window is cut into its runs in one brick, which
+   *    are looked at by their first voxel
+   ***/
+
+  near = 0;
+  for (k = 0; k < side && !near; k++) {
+    if (k > 0 && (w[2][k] >> BRICKBITS) == (w[2][k - 1] >> BRICKBITS))
+      continue;
+    for (j = 0; j < side && !near; j++) {
+      if (j > 0 && (w[1][j] >> BRICKBITS) == (w[1][j - 1] >> BRICKBITS))
+        continue;
+      for (i = 0; i < side && !near; i++) {
+        if (i > 0 && (w[0][i] >> BRICKBITS) == (w[0][i - 1] >> BRICKBITS))
+          continue;
+        near = solid[BRICKNUM(&Aggreal, w[0][i], w[1][j], w[2][k])];
+      }
+    }
+  }
+  if (!near) {
+    free(w[0]);
+    return (0);
+  }
+
+  map = (int *)malloc((size_t)side * side * side * sizeof(int));
+  vox = (int *)malloc(BRICKVOX * sizeof(int));
+  if (!map || !vox) {
+    free(map);
+    free(vox);
+    free(w[0]);
+    return (1);
+  }
+
+  pos = 0;
+  for (k = 0; k < side; k++) {
+    for (j = 0; j < side; j++) {
+      for (i = 0; i < side; i++) {
+        val = BRICKGET(&Aggreal, w[0][i], w[1][j], w[2][k]);
+        map[pos++] = (val != POROSITY && val != ITZ) ? 0 : EDTINF;
+      }
+    }
+  }
+  free(w[0]);
+
+  if (edtmap(map, side, side, side)) {
+    free(map);
+    free(vox);
+    return (1);
+  }
+
+  brickbox_copy(&Aggreal, n, vox);
+  changed = 0;
+  for (k = 0; k < len[2]; k++) {
+    for (j = 0; j < len[1]; j++) {
+      for (i = 0; i < len[0]; i++) {
+        pos = ((size_t)(k + Itz) * side + (j + Itz)) * side + (i + Itz);
+        if (map[pos] <= d2max && vox[BRICKPOS(i, j, k)] == POROSITY) {
+          vox[BRICKPOS(i, j, k)] = ITZ;
+          changed = 1;
         }
       }
     }
   }
+  free(map);
 
-  return;
+  if (changed) {
+    *itz = vox;
+  } else {
+    free(vox);
+  }
+
+  return (0);
 }
 
 /***
@@ -1383,7 +2231,7 @@ void additz(int nxp, int nyp, int nzp) {
  *    Returns:
  *        nothing
  *
- *    Calls:        makesph, ran1
+ *    Calls:        makesph, ran1, shrotate, adjustvol
  *    Called by:    create
  ***/
 void genparticles(int type, int numsources,
@@ -1393,22 +2241,23 @@ void genparticles(int type, int numsources,
   int m, n, i, j, k, ii, jj, x, y, z, ig, tries, na, foundpart;
   int srad, nofit, n1, nxp, nyp, nzp, nnxp, nnyp, nnzp, partc, pcount[10];
   int numpershape, orient, nump, numitems, toobig, numgen;
-  int klow, khigh, mp, numlines, begin, end;
+  int numlines, begin, end, nsh, extpix;
   int oldabsdiff, absdiff, pixfrac, cx, cy, cz;
   int typeeach[NUMAGGBINS], ival, phaseid;
   int numpartplaced, vol, volmin, volmax, volcrit, ntotal;
   int voleach[NUMAGGBINS], vpmin[NUMAGGBINS], vpmax[NUMAGGBINS], lval;
+  int edtr2, edtsite, ri, rj, rk;
   float sizeeachmin[NUMAGGBINS], sizeeachmax[NUMAGGBINS], fval;
-  float rx, ry, rz, fdmin, fdmax, aa1, aa2;
+  float fdmin, fdmax, aa1, aa2;
   float maxrx, maxry, maxrz, critdiam, frad;
-  float length, width, vol1, volume, volumecalc, v1;
+  float length, width, vol1, volume, volumecalc;
   float volfractoplace;
-  double factor, theta, phi, cosbeta, sinbeta, alpha, gamma, beta, total, abc;
-  double realnum, saveratio, ratio[10];
-  fcomplex r1, ddd, icmplx;
+  double cosbeta, sinbeta, alpha, gamma, beta;
+  double saveratio, ratio[10];
   char buff[MAXSTRING], filename[MAXSTRING];
   char typestring[10], shapestring[MAXSTRING];
   struct lineitem line[MAXLINES];
+  fcomplex *anmcache = NULL, *ap;
   FILE *anmfile, *geomfile;
 
   /* First thing to do is to sort the particles by maximum size */
@@ -1591,17 +2440,24 @@ void genparticles(int type, int numsources,
         frad = fdmin;
         frad += ((fdmax - fdmin) * ran1(Seed));
         srad = (int)(frad + 0.5);
+        edtr2 = srad * (srad + 1);
         tries = 0;
 
         /* Stop after MAXTRIES random tries */
         do {
           tries++;
 
-          /* generate a random center location for the sphere */
+          /***
+           *    generate a random center location for the sphere,
+           *    from the distance map if there is one
+           ***/
 
-          x = (int)((float)Xsyssize * ran1(Seed));
-          y = (int)((float)Ysyssize * ran1(Seed));
-          z = (int)((float)Zsyssize * ran1(Seed));
+          edtsite = (Edt && !edtdraw(edtr2, &x, &y, &z));
+          if (!edtsite) {
+            x = (int)((float)Xsyssize * ran1(Seed));
+            y = (int)((float)Ysyssize * ran1(Seed));
+            z = (int)((float)Zsyssize * ran1(Seed));
+          }
 
           /***
            *    See if the sphere will fit at x,y,z
@@ -1610,10 +2466,21 @@ void genparticles(int type, int numsources,
            ***/
 
           nofit = checksphere(x, y, z, srad, Check, 0);
+          if (nofit && edtsite)
+            edtmiss();
+
+          /* The exact map has no room for it anywhere */
+
+          if (Edt && !edtsite && edtr2 >= Edtnone)
+            tries = MAXTRIES + 1;
 
           if (tries > MAXTRIES) {
             printf("Could not place sphere %d\n", Npart);
-            printf("\tafter %d random attempts\n\n", MAXTRIES);
+            if (Edt && edtr2 >= Edtnone) {
+              printf("\tno room left for radius %d\n\n", srad);
+            } else {
+              printf("\tafter %d random attempts\n\n", MAXTRIES);
+            }
             printf("\nTotal volume desired in this bin was %d", voleach[ig]);
             printf("\nActual volume _placed  in this bin was %d", ntotal);
             printf("\nWas working on bin %d out of %d\n", ig, numgen);
@@ -1638,6 +2505,7 @@ void genparticles(int type, int numsources,
           return;
         }
         nump = checksphere(x, y, z, srad, Place, phaseid);
+        edtnear(x, y, z);
         ntotal += nump;
         N_total += nump;
         numpartplaced++;
@@ -1728,6 +2596,24 @@ void genparticles(int type, int numsources,
     numitems = i; /* Will skip the header */
     numlines = numitems - 2;
 
+    /***
+     *    The coefficients of each shape are read, and its volume
+     *    found by quadrature, the first time it is chosen
+     ***/
+
+    nsh = (Nnn + 1) * (Nnn + 1);
+    anmcache = (fcomplex *)malloc((size_t)(numitems + 1) * nsh *
+                                  sizeof(fcomplex));
+    if (!anmcache || shgrid_make(&Aggsh, Nnn, Ntheta, Nphi, Xg, Wg)) {
+      free(anmcache);
+      freeallmem();
+      bailout("genaggpack", "Could not allocate spherical harmonic table");
+      exit(1);
+    }
+    for (i = 0; i < numitems; i++) {
+      line[i].loaded = 0;
+    }
+
     for (ig = 0; ig < numgen; ig++) {
 
       /* Choose the correct pixel id for this aggregate */
@@ -1867,82 +2753,57 @@ void genparticles(int type, int numsources,
 
               n1 = begin + (int)((end - begin) * ran1(Seed));
 
-              sprintf(filename, "%s%s%c%s", Pathroot, Shapeset, Filesep,
-                      line[n1].name);
-              anmfile = filehandler("genaggpack", filename, "READ");
-              if (!anmfile) {
-                freeallmem();
-                exit(1);
+              ap = anmcache + (size_t)n1 * nsh;
+              if (!line[n1].loaded) {
+                sprintf(filename, "%s%s%c%s", Pathroot, Shapeset, Filesep,
+                        line[n1].name);
+                anmfile = filehandler("genaggpack", filename, "READ");
+                if (!anmfile) {
+                  free(anmcache);
+                  freeallmem();
+                  exit(1);
+                }
+
+                /***
+                 *    Nnn is how many y's are to be used
+                 *    in series
+                 ***/
+
+                for (n = 0; n <= Nnn; n++) {
+                  for (m = n; m >= -n; m--) {
+                    fscanf(anmfile, "%d %d %f %f", &ii, &jj, &aa1, &aa2);
+                    ap[n * n + n + m] = Complex(aa1, aa2);
+                  }
+                }
+                fclose(anmfile);
+                if (Verbose)
+                  printf("\nRead anms of %s", line[n1].name);
+              }
+
+              for (n = 0; n <= Nnn; n++) {
+                for (m = -n; m <= n; m++) {
+                  A[n][m] = ap[n * n + n + m];
+                }
               }
 
               /***
-               *    Nnn is how many y's are to be used
-               *    in series
-               *
-               *    Read in stored coefficients for
-               *    particle of interest
-               *
-               *    Compute volume and scale anm by
-               *    cube root of vol/(volume of particle)
+               *    Compute volume once from SH coefficients, and
+               *    scale anm by cube root of vol/(volume of
+               *    particle).  Rotation keeps the volume, so this
+               *    ratio is the one for every particle of the shape.
                ***/
 
-              for (n = 0; n <= Nnn; n++) {
-                for (m = n; m >= -n; m--) {
-                  fscanf(anmfile, "%d %d %f %f", &ii, &jj, &aa1, &aa2);
-                  A[n][m] = Complex(aa1, aa2);
-                  /* A[n][m] = RCmul((1.0/Resolution),A[n][m]); */
-                }
+              if (!line[n1].loaded) {
+                line[n1].shvolume =
+                    shgrid_volume(&Aggsh, A, &maxrx, &maxry, &maxrz);
+                line[n1].loaded = 1;
               }
-              if (Verbose)
-                printf("\nRead and scaled anms");
-              fclose(anmfile);
+              volumecalc = line[n1].shvolume;
 
               width = line[n1].width / Resolution;   /* in pixels */
               length = line[n1].length / Resolution; /* in pixels */
 
               volume = line[n1].volume / (Resolution * Resolution * Resolution);
-              saveratio = pow((1.003 * (double)vol / volume), (1. / 3.));
-
-              /*
-               * Compute volume once from SH coefficients to see how
-               * it compares with the reported volume
-               */
-
-              factor = 0.5 * Pi * Pi;
-              volumecalc = 0.0;
-
-              maxrx = maxry = maxrz = 0.0;
-              for (i = 1; i <= Ntheta; i++) {
-                theta = 0.5 * Pi * (Xg[i] + 1.0);
-                for (j = 1; j <= Nphi; j++) {
-                  phi = Pi * (Xg[j] + 1.0);
-                  harm(theta, phi);
-                  r1 = Complex(0.0, 0.0);
-                  r1 = Cmul(A[0][0], Y[0][0]);
-                  for (n = 1; n <= Nnn; n++) {
-                    for (m = n; m >= -n; m--) {
-                      r1 = Cadd(r1, Cmul(A[n][m], Y[n][m]));
-                    }
-                  }
-                  rx = (r1.r * sin(theta) * cos(phi));
-                  ry = (r1.r * sin(theta) * sin(phi));
-                  rz = (r1.r * cos(theta));
-
-                  if (fabs(rx) > maxrx)
-                    maxrx = fabs(rx);
-                  if (fabs(ry) > maxry)
-                    maxry = fabs(ry);
-                  if (fabs(rz) > maxrz)
-                    maxrz = fabs(rz);
-
-                  v1 = sin(theta) / 3.0;
-                  v1 *= (r1.r * r1.r * r1.r);
-                  v1 *= (Wg[i] * Wg[j]);
-                  volumecalc += v1;
-                }
-              }
-              volumecalc *= factor;
-
               saveratio = pow((1.003 * (double)vol / volumecalc), (1. / 3.));
 
               /***
@@ -1992,81 +2853,19 @@ void genparticles(int type, int numsources,
             alpha = 2.0 * Pi * ran1(Seed);
             gamma = 2.0 * Pi * ran1(Seed);
 
-            for (n = 0; n <= Nnn; n++) {
-              for (m = -n; m <= n; m++) {
-                AA[n][m] = Complex(0.0, 0.0);
-                for (mp = -n; mp <= n; mp++) {
-                  realnum =
-                      sqrt(fac(n + mp) * fac(n - mp) / fac(n + m) / fac(n - m));
-                  ddd = Complex(realnum, 0.0);
-                  klow = max(0, m - mp);
-                  khigh = min(n - mp, n + m);
-                  total = 0.0;
-                  for (k = klow; k <= khigh; k++) {
-                    abc = pow(-1.0, k + mp - m);
-                    abc *= (fac(n + m) / fac(k) / fac(n + m - k));
-                    abc *= (fac(n - m) / fac(n - mp - k) / fac(mp + k - m));
-                    total += abc * (pow(cosbeta, 2 * n + m - mp - 2 * k)) *
-                             (pow(sinbeta, 2 * k + mp - m));
-                  }
-                  icmplx = Complex(total * cos(mp * alpha),
-                                   total * (-sin(mp * alpha)));
-                  ddd = Cmul(ddd, icmplx);
-                  icmplx = Complex(cos(m * gamma), (-sin(m * gamma)));
-                  ddd = Cmul(ddd, icmplx);
-                  icmplx = Cmul(A[n][mp], ddd);
-                  AA[n][m] = Cadd(AA[n][m], icmplx);
-                }
-
-                /***
-                 *    All SH coefficients multiplied by ratio to
-                 *    dilate the thickness to be in range of the
-                 *    bounding sieve openings
-                 ***/
+            /***
+             *    All SH coefficients multiplied by ratio to
+             *    dilate the thickness to be in range of the
+             *    bounding sieve openings
+             ***/
 
-                AA[n][m] = RCmul(saveratio, AA[n][m]);
-              }
-            }
+            shrotate(A, AA, Nnn, alpha, beta, gamma, saveratio);
 
             /***
              *    Compute volume of real particle
              ***/
 
-            factor = 0.5 * Pi * Pi;
-            volume = 0.0;
-
-            maxrx = maxry = maxrz = 0.0;
-            for (i = 1; i <= Ntheta; i++) {
-              theta = 0.5 * Pi * (Xg[i] + 1.0);
-              for (j = 1; j <= Nphi; j++) {
-                phi = Pi * (Xg[j] + 1.0);
-                harm(theta, phi);
-                r1 = Complex(0.0, 0.0);
-                r1 = Cmul(AA[0][0], Y[0][0]);
-                for (n = 1; n <= Nnn; n++) {
-                  for (m = n; m >= -n; m--) {
-                    r1 = Cadd(r1, Cmul(AA[n][m], Y[n][m]));
-                  }
-                }
-                rx = (r1.r * sin(theta) * cos(phi));
-                ry = (r1.r * sin(theta) * sin(phi));
-                rz = (r1.r * cos(theta));
-
-                if (fabs(rx) > maxrx)
-                  maxrx = fabs(rx);
-                if (fabs(ry) > maxry)
-                  maxry = fabs(ry);
-                if (fabs(rz) > maxrz)
-                  maxrz = fabs(rz);
-
-                v1 = sin(theta) / 3.0;
-                v1 *= (r1.r * r1.r * r1.r);
-                v1 *= (Wg[i] * Wg[j]);
-                volume += v1;
-              }
-            }
-
-            volume *= factor;
+            volume = shgrid_volume(&Aggsh, AA, &maxrx, &maxry, &maxrz);
             vol1 = volume;
 #ifdef DEBUG
             printf("\nComputed volume after scaling = %f pixels", volume);
@@ -2219,7 +3018,7 @@ void genparticles(int type, int numsources,
               saveratio = ratio[na];
               na++;
 
-            } while (abs(partc - vol) > max(4, pixfrac) && na < 3 && !toobig);
+            } while (abs(partc - vol) > max(4, pixfrac) && na < 1 && !toobig);
 
 #ifdef DEBUG
             printf("\nConverged? partc = %d and vol = %d, na = %d", partc, vol,
@@ -2233,15 +3032,22 @@ void genparticles(int type, int numsources,
               fflush(stdout);
 #endif
 
-              /*
+              /***
+               *    The scale is worked out from the volume by
+               *    quadrature, so the particle is digitized only
+               *    once.  It may still be off by a few pixels from
+               *    the target volume; add or remove pixels here and
+               *    there on its surface to match.
+               ***/
+
               if (partc != vol) {
-                  #ifdef DEBUG
-                  printf("\nAdditional adjustment needed to match volume, partc
-              = %d",partc); fflush(stdout); #endif extpix = adjustvol(vol -
-              partc,nxp,nyp,nzp); partc += extpix; #ifdef DEBUG printf("\nAfter
-              adjustment, partc = %d",partc); fflush(stdout); #endif
+                extpix = adjustvol(vol - partc, nxp, nyp, nzp);
+                partc += extpix;
+#ifdef DEBUG
+                printf("\nAfter adjustment, partc = %d", partc);
+                fflush(stdout);
+#endif
               }
-              */
 
               /***
                *    If dispersion is desired, add false layer around
@@ -2253,10 +3059,6 @@ void genparticles(int type, int numsources,
                 addlayer(nxp, nyp, nzp);
               }
 
-              if (Itz > 0) {
-                additz(nxp, nyp, nzp);
-              }
-
               /***
                *    Done generating the shape image for the particle
                ***/
@@ -2287,7 +3089,6 @@ void genparticles(int type, int numsources,
               nxp += Itz + 1;
               nyp += Itz + 1;
               nzp += Itz + 1;
-              additz(nxp, nyp, nzp);
             }
             nnxp = nxp;
             nnyp = nyp;
@@ -2297,6 +3098,7 @@ void genparticles(int type, int numsources,
         } while (!foundpart);
 
         tries = 0;
+        edtr2 = -1;
 
         /* Stop after MAXTRIES random tries */
 
@@ -2306,12 +3108,31 @@ void genparticles(int type, int numsources,
 
           /***
            *    Generate a random location for the lower
-           *    corner of the bounding box on the particle
+           *    corner of the bounding box on the particle.
+           *    With a distance map, the tested voxel at the
+           *    middle of the box is drawn from it and the
+           *    corner follows from that.
            ***/
 
-          x = (int)((float)Xsyssize * ran1(Seed));
-          y = (int)((float)Ysyssize * ran1(Seed));
-          z = (int)((float)Zsyssize * ran1(Seed));
+          edtsite = 0;
+          if (Edt && bboxcenter(nnxp, nnyp, nnzp, &ri, &rj, &rk)) {
+            if (edtr2 < 0)
+              edtr2 = edtpart(nnxp, nnyp, nnzp, ri, rj, rk);
+            edtsite = !edtdraw(edtr2, &x, &y, &z);
+          }
+
+          if (edtsite) {
+            x -= ri;
+            x += (x < 0) ? Xsyssize : 0;
+            y -= rj;
+            y += (y < 0) ? Ysyssize : 0;
+            z -= rk;
+            z += (z < 0) ? Zsyssize : 0;
+          } else {
+            x = (int)((float)Xsyssize * ran1(Seed));
+            y = (int)((float)Ysyssize * ran1(Seed));
+            z = (int)((float)Zsyssize * ran1(Seed));
+          }
 
           /***
            *    See if the particle will fit at x,y,z
@@ -2329,11 +3150,14 @@ void genparticles(int type, int numsources,
 
           nofit =
               checkpart(x, y, z, nnxp, nnyp, nnzp, vol, Npart + 1, 0, Check);
+          if (nofit && edtsite)
+            edtmiss();
 
           if ((tries > MAXTRIES) && (Dispdist == 2)) {
             tries = 0;
             Dispdist--;
             striplayer(nnxp, nnyp, nnzp);
+            edtr2 = -1;
           }
 
           if (tries > MAXTRIES) {
@@ -2407,6 +3231,9 @@ void genparticles(int type, int numsources,
         if (cz < 0)
           cz += Zsyssize;
 
+        if (bboxcenter(nnxp, nnyp, nnzp, &ri, &rj, &rk))
+          edtnear(cx, cy, cz);
+
         fprintf(fpout, "%d %d %d %d\n", cx, cy, cz, (int)Nnn);
         for (n = 0; n <= Nnn; n++) {
           for (m = n; m >= -n; m--) {
@@ -2426,6 +3253,8 @@ void genparticles(int type, int numsources,
 
   } /* Thus ends the ginormous switch statement */
 
+  free(anmcache);
+
   return;
 }
 
@@ -2438,7 +3267,8 @@ void genparticles(int type, int numsources,
  *     Arguments:    0 for coarse aggregates, 1 for fine aggregates
  *    Returns:    Nothing
  *
- *    Calls:        genparticles
+ *    Calls:        genparticles, edtbuild, edtfree, additz,
+ *                brickbox_tidy
  *    Called by:    main program
  ***/
 void create(int type, int numtimes) {
@@ -2705,8 +3535,30 @@ void create(int type, int numtimes) {
    *    Place particles at random
    ***/
 
+  if (Edtplace && edtbuild()) {
+    printf("\nWARNING: No room for the distance map; placing "
+           "particles without it");
+  }
   genparticles(type, num_sources, vol, fradmin, fradmax, fscratch);
+  edtfree();
+
+  /***
+   *    The ITZ around real-shape particles is added once they
+   *    are all placed, from one distance map
+   ***/
+
+  if (Shape != SPHERES && Itz > 0 && additz()) {
+    printf("\nWARNING: No room for the distance map; no ITZ added");
+  }
   fclose(fscratch);
+
+  brickbox_tidy(&Agg);
+  brickbox_tidy(&Aggreal);
+  if (Verbose) {
+    printf("\nPacking held in %.1f MB, against %.1f MB as full arrays",
+           (brickbox_bytes(&Agg) + brickbox_bytes(&Aggreal)) / 1048576.0,
+           2.0 * Syspix * sizeof(int) / 1048576.0);
+  }
   return;
 }
 
@@ -2749,7 +3601,7 @@ void measure(void) {
     for (j = 0; j < Ysyssize; j++) {
       for (i = 0; i < Xsyssize; i++) {
 
-        valph = Aggreal[i][j][k];
+        valph = BRICKGET(&Aggreal, i, j, k);
         switch (valph) {
         case POROSITY:
           npor++;
@@ -2780,43 +3632,24 @@ void measure(void) {
  *    connect
  *
  *    Routine to assess the connectivity (percolation)
- *    of a single phase.  Two matrices are used here:
- *
- *                (1) for the current burnt locations
- *                (2) for the other to store the newly found
- *                    burnt locations
+ *    of a single phase, from top to bottom (in z) with
+ *    periodic boundaries in x and y.  The phase is labeled
+ *    into clusters by perc_label_classes in one pass, so
+ *    Aggreal is left as it is.
  *
  *     Arguments:    None
  *     Returns:    Nothing
  *
- *    Calls:        No other routines
+ *    Calls:        perc_label_classes
  *    Called by:    main program
  ***/
 void connect(void) {
-  register int i, j, k;
-  int inew, ntop, nthrough, ncur, nnew, ntot;
-  int *nmatx, *nmaty, *nmatz, *nnewx, *nnewy, *nnewz;
-  int xcn, ycn, zcn, npix, x1, y1, z1, igood;
-  int jnew, icur;
+  int i, j, k, npix, val;
+  size_t n;
+  unsigned char *cl;
+  unsigned char link[PERCCLASSES][PERCCLASSES];
   char instring[MAXSTRING];
-
-  nmatx = nmaty = nmatz = NULL;
-  nnewx = nnewy = nnewz = NULL;
-
-  nmatx = ivector(Maxburning);
-  nmaty = ivector(Maxburning);
-  nmatz = ivector(Maxburning);
-  nnewx = ivector(Maxburning);
-  nnewy = ivector(Maxburning);
-  nnewz = ivector(Maxburning);
-
-  if (!nmatx || !nmaty || !nmatz || !nnewx || !nnewy || !nnewz) {
-
-    freeallmem();
-    bailout("genaggpack", "Memory allocation failure");
-    fflush(stdout);
-    exit(1);
-  }
+  Percstats ps;
 
   printf("Enter phase to analyze 0) pores 1) Aggregate 2) ITZ  \n");
   read_string(instring, sizeof(instring));
@@ -2829,182 +3662,50 @@ void connect(void) {
   }
 
   /***
-   *    Counters for number of pixels of phase
-   *    accessible from top surface and number which
-   *    are part of a percolated pathway
+   *    Aggregate and ITZ are both analyzed as all
+   *    of the solid, aggregate and ITZ together
    ***/
 
-  ntop = 0;
-  nthrough = 0;
-
-  /***
-   *    Percolation is assessed from top to
-   *    bottom ONLY, and burning algorithm is
-   *    periodic in x and y directions
-   ***/
+  cl = (unsigned char *)malloc((size_t)Xsyssize * Ysyssize * Zsyssize);
+  if (!cl) {
+    freeallmem();
+    bailout("genaggpack", "Memory allocation failure");
+    fflush(stdout);
+    exit(1);
+  }
 
-  k = 0;
+  n = 0;
   for (i = 0; i < Xsyssize; i++) {
     for (j = 0; j < Ysyssize; j++) {
-
-      ncur = 0;
-      ntot = 0;
-      igood = 0; /* Indicates if bottom has been reached */
-
-      if (((Aggreal[i][j][k] == npix) &&
-           ((Aggreal[i][j][Zsyssize - 1] == npix) ||
-            (Aggreal[i][j][Zsyssize - 1] == (npix + Burnt)))) ||
-          ((Aggreal[i][j][Zsyssize - 1] > 0) && (Aggreal[i][j][k] > 0) &&
-           (Aggreal[i][j][k] < Burnt) && (npix == AGG || npix == ITZ))) {
-
-        /* Start a burn front */
-
-        Aggreal[i][j][k] += Burnt;
-        ntot++;
-        ncur++;
-
-        /***
-         *    Burn front is stored in matrices
-         *    nmat* and nnew*
-         ***/
-
-        nmatx[ncur] = i;
-        nmaty[ncur] = j;
-        nmatz[ncur] = 0;
-
-        /* Burn as long as new (fuel) pixels are found */
-
-        do {
-          nnew = 0;
-          for (inew = 1; inew <= ncur; inew++) {
-
-            xcn = nmatx[inew];
-            ycn = nmaty[inew];
-            zcn = nmatz[inew];
-
-            /* Check all six neighbors */
-
-            for (jnew = 1; jnew <= 6; jnew++) {
-              x1 = xcn;
-              y1 = ycn;
-              z1 = zcn;
-              switch (jnew) {
-              case 1:
-                x1--;
-                if (x1 < 0)
-                  x1 += Xsyssize;
-                break;
-              case 2:
-                x1++;
-                if (x1 >= Xsyssize)
-                  x1 -= Xsyssize;
-                break;
-              case 3:
-                y1--;
-                if (y1 < 0)
-                  y1 += Ysyssize;
-                break;
-              case 4:
-                y1++;
-                if (y1 >= Ysyssize)
-                  y1 -= Ysyssize;
-                break;
-              case 5:
-                z1--;
-                if (z1 < 0)
-                  z1 += Zsyssize;
-                break;
-              case 6:
-                z1++;
-                if (z1 >= Zsyssize)
-                  z1 -= Zsyssize;
-                break;
-              default:
-                break;
-              }
-
-              /***
-               *    Nonperiodic in z direction so
-               *    be sure to remain in the 3-D box
-               ****/
-
-              if ((z1 >= 0) && (z1 < Zsyssize)) {
-                if ((Aggreal[x1][y1][z1] == npix) ||
-                    ((Aggreal[x1][y1][z1] > 0) &&
-                     (Aggreal[x1][y1][z1] < Burnt) &&
-                     (npix == AGG || npix == ITZ))) {
-
-                  ntot++;
-                  Aggreal[x1][y1][z1] += Burnt;
-                  nnew++;
-
-                  if (nnew >= Maxburning) {
-                    printf("error in size of nnew \n");
-                  }
-
-                  nnewx[nnew] = x1;
-                  nnewy[nnew] = y1;
-                  nnewz[nnew] = z1;
-
-                  /***
-                   *    See if bottom of system
-                   *    has been reached
-                   ***/
-
-                  if (z1 == Zsyssize - 1)
-                    igood = 1;
-                }
-              }
-            }
-          }
-
-          if (nnew > 0) {
-
-            ncur = nnew;
-
-            /* update the burn front matrices */
-
-            for (icur = 1; icur <= ncur; icur++) {
-              nmatx[icur] = nnewx[icur];
-              nmaty[icur] = nnewy[icur];
-              nmatz[icur] = nnewz[icur];
-            }
-          }
-
-        } while (nnew > 0);
-
-        ntop += ntot;
-        if (igood)
-          nthrough += ntot;
+      for (k = 0; k < Zsyssize; k++) {
+        val = BRICKGET(&Aggreal, i, j, k);
+        cl[n++] = (npix == POROSITY) ? (val == POROSITY) : (val > POROSITY);
       }
     }
   }
 
-  printf("Phase ID= %d \n", npix);
-  printf("Number accessible from top= %d \n", ntop);
-  printf("Number contained in through pathways= %d \n", nthrough);
+  memset(link, PERCNOLINK, sizeof(link));
+  link[1][1] = PERCLINK;
+
+  if (perc_label_classes(cl, NULL, Xsyssize, Ysyssize, Zsyssize, link, &ps)) {
+    free(cl);
+    freeallmem();
+    bailout("genaggpack", "Memory allocation failure");
+    fflush(stdout);
+    exit(1);
+  }
+  free(cl);
 
   /***
-   *    Return the burnt sites to their original
-   *    phase values
+   *    Pixels of phase accessible from top surface and
+   *    pixels which are part of a percolated pathway
    ***/
 
-  for (k = 0; k < Zsyssize; k++) {
-    for (j = 0; j < Ysyssize; j++) {
-      for (i = 0; i < Xsyssize; i++) {
-        if (Aggreal[i][j][k] >= Burnt) {
-          Aggreal[i][j][k] -= Burnt;
-        }
-      }
-    }
-  }
-
-  free(nmatx);
-  free(nmaty);
-  free(nmatz);
-  free(nnewx);
-  free(nnewy);
-  free(nnewz);
+  printf("Phase ID= %d \n", npix);
+  printf("Number accessible from top= %d \n", ps.nfront[2]);
+  printf("Number contained in through pathways= %d \n", ps.nspan[2]);
+  printf("Number of clusters= %d \n", ps.ncluster);
+  printf("Largest cluster= %d \n", ps.maxcluster);
 
   return;
 }
@@ -3079,9 +3780,9 @@ void outmic(void) {
   for (iz = 0; iz < Zsyssize; iz++) {
     for (iy = 0; iy < Ysyssize; iy++) {
       for (ix = 0; ix < Xsyssize; ix++) {
-        valout = Agg[ix][iy][iz];
+        valout = BRICKGET(&Agg, ix, iy, iz);
         fprintf(partfile, "%d\n", valout);
-        valout = Aggreal[ix][iy][iz];
+        valout = BRICKGET(&Aggreal, ix, iy, iz);
         /*
         if ((transparent != 1) && valout == POROSITY)
           valout = C3A;
@@ -3111,221 +3812,46 @@ void outmic(void) {
 
 /******************************************************
  *
- *    harm
- *
- *     Compute spherical harmonics (complex) for a value
- *     of x = cos(theta), phi = angle phi so
- *     -1 < x < 1, P(n,m), -n < m < n, 0 < n
+ *    imagethreads
  *
- *     Uses two recursion relations plus exact formulas for
- *     the associated Legendre functions up to n=8
+ *    Number of threads for image, making the harmonic
+ *    matrices of the threads after the first on the first
+ *    call.  Without room for them, or without OpenMP,
+ *    image runs on one thread.
  *
- *    Arguments:    double theta and phi coordinates
- *    Returns:    Nothing
+ *    Arguments:    None
+ *    Returns:    int number of threads
  *
- *    Calls:         fac
- *    Called by:  main
+ *    Calls:         complexmatrix
+ *    Called by:  image
  *
  ******************************************************/
-void harm(double theta, double phi) {
-  int i, m, n, mm, nn;
-  double x, s, xn, xm;
-  double realnum;
-  double p[NNN + 1][2 * (NNN + 1)];
-  fcomplex fc1, fc2, fc3;
-
-  x = cos(theta);
-  s = (double)(sqrt((double)(1.0 - (x * x))));
-
-  for (n = 0; n <= Nnn; n++) {
-    for (m = 0; m <= 2 * (Nnn); m++) {
-      p[n][m] = 0.0;
-    }
-  }
-
-  p[0][0] = 1.0;
-  p[1][0] = x;
-  p[1][1] = s;
-  p[2][0] = 0.5 * (3. * x * x - 1.);
-  p[2][1] = 3. * x * s;
-  p[2][2] = 3. * (1. - x * x);
-  p[3][0] = 0.5 * x * (5. * x * x - 3.);
-  p[3][1] = 1.5 * (5. * x * x - 1.) * s;
-  p[3][2] = 15. * x * (1. - x * x);
-  p[3][3] = 15. * (pow(s, 3));
-  p[4][0] = 0.125 * (35. * (pow(x, 4)) - 30. * x * x + 3.);
-  p[4][1] = 2.5 * (7. * x * x * x - 3. * x) * s;
-  p[4][2] = 7.5 * (7. * x * x - 1.) * (1. - x * x);
-  p[4][3] = 105. * x * (pow(s, 3));
-  p[4][4] = 105. * (pow((1. - x * x), 2));
-  p[5][0] = 0.125 * x * (63. * (pow(x, 4)) - 70. * x * x + 15.);
-  p[5][1] = 0.125 * 15. * s * (21. * (pow(x, 4)) - 14. * x * x + 1.);
-  p[5][2] = 0.5 * 105. * x * (1. - x * x) * (3. * x * x - 1.);
-  p[5][3] = 0.5 * 105. * (pow(s, 3)) * (9. * x * x - 1.);
-  p[5][4] = 945. * x * (pow((1. - x * x), 2));
-  p[5][5] = 945. * (pow(s, 5));
-  p[6][0] =
-      0.0625 * (231. * (pow(x, 6)) - 315. * (pow(x, 4)) + 105. * x * x - 5.);
-  p[6][1] = 0.125 * 21. * x * (33. * (pow(x, 4)) - 30. * x * x + 5.) * s;
-  p[6][2] =
-      0.125 * 105. * (1. - x * x) * (33. * (pow(x, 4)) - 18. * x * x + 1.);
-  p[6][3] = 0.5 * 315. * (11. * x * x - 3.) * x * (pow(s, 3));
-  p[6][4] = 0.5 * 945. * (1. - x * x) * (1. - x * x) * (11. * x * x - 1.);
-  p[6][6] = 10395. * pow((1. - x * x), 3);
-  p[7][0] = 0.0625 * x *
-            (429. * (pow(x, 6)) - 693. * (pow(x, 4)) + 315. * x * x - 35.);
-  p[7][1] = 0.0625 * 7. * s *
-            (429. * (pow(x, 6)) - 495. * (pow(x, 4)) + 135. * x * x - 5.);
-  p[7][2] = 0.125 * 63. * x * (1. - x * x) *
-            (143. * (pow(x, 4)) - 110. * x * x + 15.);
-  p[7][3] =
-      0.125 * 315. * (pow(s, 3)) * (143. * (pow(x, 4)) - 66. * x * x + 3.);
-  p[7][4] = 0.5 * 3465. * x * (1. - x * x) * (1. - x * x) * (13. * x * x - 3.);
-  p[7][5] = 0.5 * 10395. * (pow(s, 5)) * (13. * x * x - 1.);
-  p[7][6] = 135135. * x * (1. - x * x) * (1. - x * x) * (1. - x * x);
-  p[7][7] = 135135. * (pow(s, 7));
-  p[8][0] = (1. / 128.) * (6435. * (pow(x, 8)) - 12012. * (pow(x, 6)) +
-                           6930. * (pow(x, 4)) - 1260. * x * x + 35.);
-  p[8][1] = 0.0625 * 9. * x * s *
-            (715. * (pow(x, 6)) - 1001. * (pow(x, 4)) + 385. * x * x - 35.);
-  p[8][2] = 0.0625 * 315. * (1. - x * x) *
-            (143. * (pow(x, 6)) - 143. * (pow(x, 4)) + 33. * x * x - 1.);
-  p[8][3] =
-      0.125 * 3465. * x * (pow(s, 3)) * (39. * (pow(x, 4)) - 26. * x * x + 3.);
-  p[8][4] = 0.125 * 10395. * (1. - x * x) * (1. - x * x) *
-            (65. * (pow(x, 4)) - 26. * x * x + 1.);
-  p[8][5] = 0.5 * 135135. * x * (pow(s, 5)) * (5. * x * x - 1.);
-  p[8][6] = 0.5 * 135135. * (pow((1. - x * x), 3)) * (15. * x * x - 1.);
-  p[8][7] = 2027025. * x * (pow(s, 7));
-  p[8][8] = 2027025. * (pow((1. - x * x), 4));
-
-  /* Now generate spherical harmonics for n = 0,8 (follows Arfken) */
-
-  for (n = 0; n <= 8; n++) {
-
-    /* does n = 0 separately */
-
-    if (n == 0) {
-      Y[0][0].r = 1.0 / (sqrt(4.0 * Pi));
-      Y[0][0].i = 0.0;
-    } else {
-      for (m = n; m >= -n; m--) {
-        if (m >= 0) {
-          fc1 = Complex(cos(m * phi), sin(m * phi));
-          realnum = (pow(-1., m)) *
-                    sqrt(((2 * n + 1) / 4. / Pi) * fac(n - m) / fac(n + m)) *
-                    p[n][m];
-          Y[n][m] = RCmul(realnum, fc1);
-
-        } else if (m < 0) {
-          mm = -m;
-          fc1 = Conjg(Y[n][m]);
-          realnum = pow(-1.0, mm);
-          Y[n][m] = RCmul(realnum, fc1);
-        }
+int imagethreads(void) {
+#ifdef _OPENMP
+  int t;
+
+  if (Nthreads > 1 && !Ythread) {
+    Ythread = (fcomplex ***)calloc(Nthreads - 1, sizeof(fcomplex **));
+    if (Ythread) {
+      for (t = 0; t < Nthreads - 1; t++) {
+        Ythread[t] = complexmatrix(0, Nnn, -Nnn, Nnn);
+        if (!Ythread[t])
+          break;
+        Nythread++;
       }
     }
-  }
-
-  /***
-   *    Use recursion relations for n >= 9
-   *    Do recursion on spherical harmonics, because they are
-   *    better behaved numerically
-   ***/
-
-  for (n = 9; n <= Nnn; n++) {
-    for (m = 0; m <= n - 2; m++) {
-      xn = (double)(n - 1);
-      xm = (double)m;
-      realnum = (2. * xn + 1.) * x;
-      Y[n][m] = RCmul(realnum, Y[n - 1][m]);
-      realnum =
-          -sqrt((2. * xn + 1.) * ((xn * xn) - (xm * xm)) / (2. * xn - 1.));
-      fc1 = RCmul(realnum, Y[n - 2][m]);
-      Y[n][m] = Cadd(Y[n][m], fc1);
-      realnum = (sqrt((2. * xn + 1.) * (pow((xn + 1.), 2) - (xm * xm)) /
-                      (2. * xn + 3.)));
-      Y[n][m] = RCmul((1.0 / realnum), Y[n][m]);
-    }
-
-    nn = (2 * n) - 1;
-    p[n][n] = pow(s, n);
-    for (i = 1; i <= nn; i += 2) {
-      p[n][n] *= (double)i;
-    }
-
-    fc1 = Complex(cos(n * phi), sin(n * phi));
-    realnum = (pow(-1., n)) *
-              sqrt(((2 * n + 1) / 4. / Pi) * fac(n - n) / fac(n + n)) * p[n][n];
-    Y[n][n] = RCmul(realnum, fc1);
-
-    /***
-     *    Now do second to the top m=n-1 using the exact m=n,
-     *    and the recursive m=n-2 found previously
-     ***/
-
-    xm = (double)(n - 1);
-    xn = (double)n;
-
-    realnum = -1.0;
-    fc1 = Complex(cos(phi), sin(phi));
-    fc2 = Cmul(fc1, Y[n][n - 2]);
-    Y[n][n - 1] = RCmul(realnum, fc2);
-    realnum =
-        (xn * (xn + 1.) - xm * (xm - 1.)) / sqrt((xn + xm) * (xn - xm + 1.));
-    Y[n][n - 1] = RCmul(realnum, Y[n][n - 1]);
-
-    realnum = sqrt((xn - xm) * (xn + xm + 1.));
-    fc1 = Complex(cos(phi), -sin(phi));
-    fc2 = Cmul(fc1, Y[n][n]);
-    fc3 = RCmul(realnum, fc2);
-    Y[n][n - 1] = Csub(Y[n][n - 1], fc3);
-
-    realnum = (s / 2.0 / xm / x);
-    Y[n][n - 1] = RCmul(realnum, Y[n][n - 1]);
-  }
-
-  /* now fill in -m terms */
-
-  for (n = 0; n <= Nnn; n++) {
-    for (m = -1; m >= -n; m--) {
-      mm = -m;
-      realnum = pow(-1.0, mm);
-      fc1 = Conjg(Y[n][mm]);
-      Y[n][m] = RCmul(realnum, fc1);
-    }
-  }
-
-  return;
-}
-
-/******************************************************
- *
- *    fac
- *
- *    This is the factorial function, as used in function harm
- *
- *    Arguments:    int n
- *    Returns:    double fact;
- *
- *    Calls: No other routines
- *    Called by:  harm
- *
- ******************************************************/
-double fac(int j) {
-  int i;
-  double fact;
-
-  if (j <= 1) {
-    fact = 1.0;
-  } else {
-    fact = 1.0;
-    for (i = 1; i <= j; i++) {
-      fact *= (double)i;
+    if (Nythread < Nthreads - 1) {
+      printf("\nWARNING: No room for %d threads; digitizing particles on "
+             "one thread",
+             Nthreads);
+      Nthreads = 1;
     }
   }
+#else
+  Nthreads = 1;
+#endif
 
-  return fact;
+  return (Nthreads);
 }
 
 /***
@@ -3340,16 +3866,15 @@ double fac(int j) {
  *    Arguments:    None
  *    Returns:    Nothing
  *
- *    Calls:        free_ivector, free_fvector, free_fcube
+ *    Calls:        free_ivector, free_fvector, free_fcube, brickbox_free
  *    Called by:    main,dissolve
  *
  ***/
 void freeallmem(void) {
+  int i;
 
-  if (Agg)
-    free_ibox(Agg, Xsyssize, Ysyssize);
-  if (Aggreal)
-    free_ibox(Aggreal, Xsyssize, Ysyssize);
+  brickbox_free(&Agg);
+  brickbox_free(&Aggreal);
   if (Bbox)
     free_ibox(Bbox, Xsyssize, Ysyssize);
   if (Xg)
@@ -3360,6 +3885,20 @@ void freeallmem(void) {
     free_complexmatrix(Y, 0, Nnn, -Nnn, Nnn);
   if (A)
     free_complexmatrix(A, 0, Nnn, -Nnn, Nnn);
+  shgrid_free(&Aggsh);
+  edtfree();
+  for (i = 0; i < Nythread; i++) {
+    free_complexmatrix(Ythread[i], 0, Nnn, -Nnn, Nnn);
+  }
+  free(Ythread);
+  Ythread = NULL;
+  Nythread = 0;
+  free(Surfbuf);
+  Surfbuf = NULL;
+  Surfbufmax = 0;
+  free(Runbuf);
+  Runbuf = NULL;
+  Runbufmax = 0;
 
   return;
 }
@@ -21,13 +21,22 @@
  *******************************************************/
 #include "include/vcctl.h"
 #include "include/win32_compat.h"
+#include <ctype.h>
 #include <getopt.h>
+#include <limits.h>
 #include <math.h>
 #include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#if !defined(_WIN32)
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #ifdef _WIN32
 #define PATH_SEPARATOR "\\"
@@ -45,6 +54,118 @@ int Verbose_flag;
 char ProgressFileName[500];
 char WorkingDirectory[500];
 
+/***
+ *  Draw the sites of one-pixel particles from a list of the
+ *  pore voxels, and the trial sites of larger particles from
+ *  the blocks of the occupancy grid that are not full (1),
+ *  instead of trying random voxels anywhere (0, the default,
+ *  which keeps the random number sequence of earlier versions)
+ ***/
+int Densesample = 0;
+
+/***
+ *  Threads for distrib3d (--threads n).  With 0, the default,
+ *  the noise images are drawn from ran1 as in earlier versions
+ *  and everything runs on one thread.  With n > 0 each x plane
+ *  of a noise image is drawn from its own stream of the
+ *  explicit-state generator, so the image depends on the seed
+ *  but not on n, and the filtering and thresholding are shared
+ *  out among n threads when genmic is built with OpenMP.
+ ***/
+int Nthreads = 0;
+#define DISTTHREADS ((Nthreads > 1) ? Nthreads : 1)
+
+/***
+ *  Format of the final microstructure and particle id images:
+ *  IMG_ASCII (the default), or binary with --binary-images
+ *  (IMG_UINT8) or --zlib-images (IMG_UINT8Z).  A binary particle
+ *  id image uses the matching uint32 format.
+ ***/
+int Binout = IMG_ASCII;
+
+/***
+ *  Handoff of the final images to disrealnew in memory (--handoff
+ *  name, see handoff.c): both images go to shared memory segments
+ *  as raw binary images, and to the image files as well only with
+ *  --handoff-files.
+ ***/
+char Handoffname[MAXSTRING];
+int Handofffiles = 0;
+
+/***
+ *  Timeline of the run (--trace file, see trace.c), with the
+ *  time and, with --counters, the hardware counters of each call
+ *  of rand3d.  A member of an ensemble writes the file of the
+ *  same name in its own directory.
+ ***/
+char Tracename[MAXSTRING];
+int Tracecounters = 0;
+
+/***
+ *  Batch input (--batch file).  The file is read once into Batch
+ *  at startup, one Name,value line per answer, and every prompt
+ *  then takes the next unused value with its name instead of a
+ *  line from stdin.  The Step lines, in order, are the menu
+ *  choices; the run ends when they are used up.
+ ***/
+struct batchitem {
+  char name[MAXSTRING];
+  char value[MAXSTRING];
+  int used;
+};
+
+struct batchitem *Batch = NULL;
+int Nbatch = 0;
+char BatchFileName[MAXSTRING];
+
+/***
+ *  Ensemble (--ensemble n, with --batch).  The batch input is
+ *  read and the steps that draw no random numbers (the system
+ *  size and its arrays) are carried out once; at the first step
+ *  that does, n members fork from that state, sharing it
+ *  copy-on-write, and go on with the rest of the batch input,
+ *  at most one per processor (or per --threads processors) at a
+ *  time.  Member k works in the directory memberk (member000,
+ *  member001, ...) of the working directory, where it writes
+ *  its log, progress file and images, and uses the seed of the
+ *  batch input plus k, so member 0 makes the image genmic would
+ *  make without --ensemble.  Not available on Windows.
+ ***/
+int Ensnum = 0;
+int Ensmember = -1;
+int Ensfailed = 0;
+
+/***
+ *  Branches of distrib3d.  Once the first filtering has split
+ *  the silicates from the rest, the second filtering (C3S from
+ *  C2S) and the third to fifth (the aluminates and alkali
+ *  sulfates) work on disjoint sets of pixels.  With --threads
+ *  the aluminate branch starts a stream of ran1 of its own, and
+ *  the rest of genmic another, from seeds drawn before the
+ *  branches, so the image is the same whether the branches run
+ *  one after the other or at the same time.
+ *
+ *  With n > 1, where fork is available, a child process is
+ *  started before the first filtering and waits; it then gets
+ *  the image and the seeds, runs the aluminate branch with half
+ *  of the threads while this process runs the silicate branch,
+ *  and hands its image back.  The child is started before any
+ *  OpenMP threads exist (Distomp), since they do not survive a
+ *  fork; otherwise the branches run here one after the other.
+ *  The image goes through shared memory one byte per pixel,
+ *  which holds any phase id.
+ ***/
+#define DISTSIL 1
+#define DISTALUM 2
+#define DISTBOTH (DISTSIL | DISTALUM)
+
+int Distomp = 0;
+int Distsplit = 0, Distseed[2];
+int Distthreads = 0; /* Nthreads of the parent while the child runs */
+long Distpid = 0;
+int Distpipe = -1;
+unsigned char *Distshare = NULL;
+
 /* #define DEBUG */
 
 #define NNN 10
@@ -81,7 +202,13 @@ char WorkingDirectory[500];
 
 #define TMPAGGID -100
 
-/* max. number of particles allowed in box */
+/* Size in bytes of one block of particle storage */
+#define PARTBLOCKSIZE (1 << 20)
+
+/* Coordinate of a moved floc pixel, from [0,2*size) back into the system */
+#define FLOCWRAP(pos, size) (((pos) >= (size)) ? (pos) - (size) : (pos))
+
+/* Particles the Particle vector first has room for; it grows as needed */
 #define NPARTC 1000000
 
 /* Default for burned id must be at least 100 greater than NPARTC */
@@ -90,8 +217,6 @@ char WorkingDirectory[500];
   BURNT /* Temporary flag for checking                                         \
          floc collisions */
 
-#define MAXBURNING 33900
-
 /* maximum number of different particle sizes for each phase */
 #define NUMSIZES 500
 
@@ -223,15 +348,26 @@ struct pshape {
  ***/
 
 struct particle {
-  int partid;                /* index for particle */
-  int partphase;             /* phase identifier for this
-                                 particle (C3S or GYPSUM, etc) */
-  int flocid;                /* id of floc to which particle belongs */
-  int numpix;                /* number of pixels in particle */
-  int xc, yc, zc;            /* center of bounding box */
-  int xd, yd, zd;            /* dimensions of bounding box */
-  int *xi, *yi, *zi;         /* list of pixel locations */
-  struct particle *nextpart; /* for floc structures */
+  int partid;                   /* index for particle */
+  int partphase;                /* phase identifier for this
+                                    particle (C3S or GYPSUM, etc) */
+  int flocid;                   /* id of floc to which particle belongs */
+  int numpix;                   /* number of pixels in particle */
+  int xc, yc, zc;               /* center of bounding box */
+  int xd, yd, zd;               /* dimensions of bounding box */
+  unsigned short *xi, *yi, *zi; /* list of pixel locations */
+  struct particle *nextpart;    /* for floc structures */
+};
+
+/***
+ *    Block of particle storage.  The particle structures and their
+ *    pixel lists are carved out of a chain of these blocks, which
+ *    are all released together by partarenafree
+ ***/
+
+struct partblock {
+  struct partblock *next; /* next block in the chain */
+  size_t size, used;      /* bytes available and bytes handed out */
 };
 
 /***
@@ -240,11 +376,23 @@ struct particle {
  *        Cement stores the 3-D particle structure
  *        (each particle with its own ID)
  *
- *        Cemreal stores the 3-D microstructure
+ *        Cemreal stores the 3-D microstructure, one byte
+ *        per voxel since it only holds phase ids
  ***/
 
 int Verbose;
-Int3d Cement, Cemreal, Bbox;
+Int3d Cement, Bbox;
+UChar3d Cemreal;
+
+/***
+ *    Number of voxels of each phase in Cemreal.  Voxels set
+ *    one at a time go through setphase, which keeps the
+ *    counts up to date; distrib3d and distfa rewrite the
+ *    whole image and are followed by phtally, which counts
+ *    it again.
+ ***/
+#define PHASETALLY 256
+long Phasetally[PHASETALLY];
 
 /***
  *    System size (pixels per edge), number of
@@ -263,7 +411,7 @@ float Maxadjustxsize = 1.25;
 int Isizemag = 1;
 float Sizemag = 1.0;
 int Npart, Aggsize;
-int Npartc, Burnt, Maxburning;
+int Npartc;
 int Allocated = 0;
 int Shape = 0;
 
@@ -327,6 +475,20 @@ float Pdf[NPHASES][NUMSIZES];
 /* Pointer to a 1D list of pointers to particle structures */
 struct particle **Particle;
 
+/* Chain of blocks holding the particles, newest block first */
+struct partblock *Partarena = NULL;
+
+/***
+ *    Surface lists of the particles during flocculation, made by
+ *    flocsurf.  The Flocnum[6p+k] pixels of particle p that face
+ *    direction k start at Flocsurf[Flocbeg[6p+k]], as places in
+ *    its pixel lists, and Flocoff[3p..3p+2] is how far p has
+ *    moved.  The directions are those of Flocstep.
+ ***/
+int *Flocsurf = NULL, *Flocbeg = NULL, *Flocnum = NULL, *Flocoff = NULL;
+int Flocstep[6][3] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                      {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+
 /* Structure of shape information.  Allocate one for each solid phase */
 
 struct pshape Phase_shape[NSPHASES];
@@ -334,6 +496,9 @@ struct pshape Phase_shape[NSPHASES];
 double Pi;
 
 fcomplex **Y, **A, **AA;
+
+/* Spherical harmonics on the quadrature grid of the shape sets */
+Shgrid Shapegrid;
 int Ntheta, Nphi;
 int Nnn = NNN;
 
@@ -368,6 +533,131 @@ struct lineitem {
   float nwidth;
 };
 
+/***
+ *    Shape library.  Each shape set used in the run is kept
+ *    here: the lines of its geom file, and the anm
+ *    coefficients of each shape with its volume and extents,
+ *    which are read and computed the first time the shape is
+ *    used.  The coefficients of line i start at
+ *    anm[i*(Nnn+1)^2], with (n,m) at n*n+n+m.
+ ***/
+
+struct shapeitem {
+  int loaded;
+  float volume, maxrx, maxry, maxrz;
+};
+
+struct shapeset {
+  char dir[2 * MAXSTRING]; /* Path root and shape set */
+  int numlines;
+  struct lineitem *line;
+  fcomplex *anm;
+  struct shapeitem *shape;
+};
+
+struct shapeset Shapelib[NSPHASES];
+int Nshapelib = 0;
+
+/***
+ *    Particle templates (--template-cache).  With the cache on,
+ *    the orientation of a real-shape particle is rounded to the
+ *    middle of one of PTEMPBINS x PTEMPBINS/2 x PTEMPBINS bins
+ *    in (alpha, beta, gamma), and the solid voxels of each
+ *    digitized particle are kept under its shape, target volume,
+ *    dispersion distance and orientation bin.  A later particle
+ *    with the same four is stamped into Bbox from the list
+ *    instead of being rotated, digitized and adjusted again.
+ *    Voxels are stored as indices into Bbox, whose size does not
+ *    change during a run, and no more than PTEMPMAXPIX of them
+ *    are kept; after that new particles are digitized as usual.
+ ***/
+
+#define PTEMPBINS 12
+#define PTEMPHASH 4093
+#define PTEMPMAXPIX 16000000
+
+struct ptemplate {
+  struct shapeset *ss;
+  int n1, vol, dispdist, orient;
+  int nxp, nyp, nzp, partc;
+  int *pix; /* Bbox indices of the partc solid voxels */
+  struct ptemplate *next;
+};
+
+int Templatecache = 0;
+struct ptemplate *Ptemphash[PTEMPHASH];
+long Ptemppix = 0;
+
+/***
+ *    Occupancy grid for placing particles.  The system is cut
+ *    into blocks of OCCBLOCK^3 voxels, and for each block the
+ *    number of voxels inside the system and the number that are
+ *    not porosity in Cemreal are kept, along with a list of the
+ *    blocks that are not yet full.  The grid is made before
+ *    genparticles and kept up to date by checksphere and
+ *    checkpart as particles are placed.  It lets a trial site
+ *    be rejected at once if the middle of the particle falls on
+ *    solid, or accepted at once if every block under the
+ *    particle is empty.  With --dense-sampling the trial sites
+ *    are drawn only where the middle of the particle lands in a
+ *    block that is not full, which leaves out only sites that
+ *    could not take the particle anyway.
+ ***/
+
+#define OCCBLOCK 8
+
+/* Voxels from p to the end of its block, on an axis of length n */
+#define OCCSTEP(p, n)                                                          \
+  (min((p) - ((p) % OCCBLOCK) + OCCBLOCK, (n)) - (p))
+
+int Occnx, Occny, Occnz;
+int *Occsolid = NULL; /* Non-porosity voxels in each block */
+int *Occcap = NULL;   /* Voxels of each block inside the system */
+int *Occlist = NULL;  /* Blocks that are not full */
+int *Occpos = NULL;   /* Place of each block in Occlist, or -1 */
+int Occnfree = 0;
+
+/***
+ *    Distance map for placing particles (--edt-placement).
+ *    Edt holds, for each voxel, the squared Euclidean distance
+ *    to the nearest voxel that is not porosity in Cemreal, with
+ *    periodic boundaries.  It is exact when made by edtbuild;
+ *    as particles are placed, the voxels of each particle are
+ *    set to zero and the voxels around it are capped by their
+ *    squared distance to its middle voxel, so Edt never falls
+ *    below the true value.  A particle whose voxels all lie
+ *    within squared distance r2 of its middle voxel is sure to
+ *    fit where Edt is above r2 and exact.  Edtcand lists the
+ *    voxels with Edt above Edtr2, from which trial sites are
+ *    drawn and then checked as usual; when the list runs out
+ *    the map is made again exactly before giving up on it.
+ ***/
+
+#define EDTINF (INT_MAX / 4)
+
+int Edtplace = 0;
+int *Edt = NULL;
+int *Edtcand = NULL;
+int Edtncand = 0, Edtr2 = -1, Edtlast = -1, Edtstale = 0;
+int Edtnone = EDTINF; /* No site for a squared radius this big */
+
+/***
+ *    Digitized spheres for checksphere, one table per diameter,
+ *    made by sphtab the first time a diameter is asked for.  A
+ *    table lists the offsets from the center voxel of the voxels
+ *    in the sphere, three to a voxel, in the order the old loop
+ *    over the bounding cube visited them.
+ ***/
+
+struct sphoff {
+  int n;      /* number of voxels in the sphere */
+  int r2;     /* largest squared distance of a voxel from the center */
+  short *off; /* x, y and z offset of each voxel */
+};
+
+struct sphoff **Sphoff = NULL;
+int Nsphoff = 0;
+
 /***
  *    Global variable declarations for distrib3d function:
  ***/
@@ -377,9 +667,50 @@ unsigned short int ***Curvature;
 int Volume[MAXNUMPHASES], Surface[MAXNUMPHASES];
 static int Nsph, Xsph[MAXSPH], Ysph[MAXSPH], Zsph[MAXSPH];
 int *Nsolid, *Nair;
+
+/***
+ *    Voxels of the two phases being sintered, by phase and
+ *    curvature.  Sintlist[0][c] holds the Cemreal indices of the
+ *    ph1 voxels with curvature c, Sintlist[1][c] those of ph2, and
+ *    Nsolid[c] and Nair[c] are the lengths of the lists.  Sintpos
+ *    is the place of each voxel in its list, so movepix can move
+ *    one from list to list without scanning the system.  Rhporc
+ *    and Rhsurfc are the counts behind the last rhcalc, kept up
+ *    to date as voxels move.
+ *
+ *    With --sinter-update the curvature of the pixels within
+ *    the template of each moved pixel is brought up to date as
+ *    well, and the pixels go to the lists for their new
+ *    curvature.  Without it the curvatures stay as sysinit
+ *    found them.
+ ***/
+int Sinterupdate = 0;
+int **Sintlist[2] = {NULL, NULL};
+int *Sintcap[2] = {NULL, NULL};
+int *Sintpos = NULL;
+int *Sintbuf = NULL;
+int Sintbufcap = 0, Sintnbin = 0;
+int Rhporc = 0, Rhsurfc = 0;
 int *Sum;
+
+/***
+ *    Noise image of rand3d, which the FFT filtering replaces
+ *    with the filtered image, and the filtered image of the
+ *    direct sum, only allocated if that is ever used
+ ***/
 float ***Normm, ***Rres;
 
+/***
+ *    Transform used by rand3d to filter the noise image
+ *    when that is cheaper than the direct sum.  It is made
+ *    on the first call and kept for the other phases.
+ *    Rfftok is 0 until then, 1 if it is ready and -1 if it
+ *    could not be made.
+ ***/
+
+Fft3d Rfft;
+int Rfftok = 0;
+
 /***
  *    Pointers for filter variables, which will be dynamically
  *    allocated depending on the system resolution
@@ -410,17 +741,50 @@ FILE *Logfile;
  ***/
 
 int getsystemsize(void);
+int occbuild(void);
+void occupy(int x, int y, int z, int oldval, int newval);
+int occempty(int xlo, int ylo, int zlo, int nx, int ny, int nz);
+void occdraw(int *x, int *y, int *z);
+void occfree(void);
+int bboxcenter(int nxp, int nyp, int nzp, int *ic, int *jc, int *kc);
+void edtline(int *line, int n, size_t stride, double *f, double *z, int *v);
+int edtbuild(void);
+int edtdraw(int r2, int *x, int *y, int *z);
+void edtmiss(void);
+void edtnear(int x, int y, int z);
+int edtsphere(int diam);
+struct sphoff *sphtab(int diam);
+void sphfree(void);
+int edtpart(int nxp, int nyp, int nzp, int ic, int jc, int kc);
+void edtfree(void);
 int checksphere(int xin, int yin, int zin, int diam, int wflg, int phasein,
                 int phase2);
+struct shapeset *getshapeset(int phnow);
+int getshape(struct shapeset *ss, int n1, int phnow, float *volume,
+             float *maxrx, float *maxry, float *maxrz);
+void freeshapeset(struct shapeset *ss);
+int ptemplate_orient(double *alpha, double *beta, double *gamma);
+int ptemplate_hash(struct shapeset *ss, int n1, int vol, int dispdist,
+                   int orient);
+struct ptemplate *ptemplate_find(struct shapeset *ss, int n1, int vol,
+                                 int dispdist, int orient);
+int ptemplate_stamp(struct ptemplate *tp, int *nxp, int *nyp, int *nzp);
+void ptemplate_save(struct shapeset *ss, int n1, int vol, int dispdist,
+                    int orient, int nxp, int nyp, int nzp, int partc);
+void ptemplate_freeall(void);
 int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach);
 int genonevoxparticles(int numeach, int pheach);
+int onevoxsites(int *site);
+int onevoxdraw(int *site, int *nsite, int darg, int *x, int *y, int *z);
 int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int volume,
               int phasein, int phase2, int wflg);
 int image(int *nxp, int *nyp, int *nzp);
 int adjustvol(int diff, int nxp, int nyp, int nzp);
 void create(void);
-void drawfloc(struct particle *partpoint, const int mode);
-int checkfloc(struct particle *partpoint, int dx, int dy, int dz);
+int flocsurf(void);
+void flocfree(void);
+void drawfloc(struct particle *partpoint, const int mode, int dir);
+int checkfloc(struct particle *partpoint, int dir, int *index, int ipart);
 void addlayer(int nxp, int nyp, int nzp);
 void striplayer(int nxp, int nyp, int nzp);
 void makefloc(void);
@@ -430,17 +794,36 @@ void measagg(void);
 void check_connectivity(void);  /* Renamed to avoid Windows name collision */
 int distrib3d(void);
 int distfa(int fadchoice);
+int distfapix(float *cumprob);
 int addonepixels(void);
 void addrand(int randid, int nneed, int onepixfloc, int assignpartnum);
+int placeonepix(int ix, int iy, int iz, int randid, int onepixfloc,
+                int assignpartnum);
 void outmic(void);
+int outmicbin(char *filen, char *filepart, int handoff);
+int batchload(char *filename);
+void getinput(char *name, char *chstr, unsigned int size);
+int getstep(char *instring);
+void batchfree(void);
+int ensrandom(int userc);
+void ensname(char *name, char *dir);
+void ensabsolute(void);
+int ensmember(int k, int *seed);
+int ensfork(int *seed);
+void *partalloc(size_t nbytes);
+void partarenafree(void);
 struct particle *particlevector(int size);
 void free_particlevector(struct particle *ps);
 void harm(double theta, double phi);
-double fac(int j);
 struct particle **particlepointervector(int size);
+int growparticles(int n);
 void free_particlepointervector(struct particle **ps);
 void freegenmic(void);
 void freedistrib3d(void);
+int distalum(int phase);
+int distfork(void);
+int distsync(int branch);
+int distjoin(int branch);
 char *rfc8601_timespec(struct timespec *tv);
 
 /***
@@ -451,11 +834,21 @@ int checkargs(int argc, char **argv);
 void printHelp(void);
 int maketemp(int size);
 void phcount(void);
+void setphase(size_t idx, int phase);
+void phtally(void);
 int surfpix(int xin, int yin, int zin);
 float rhcalc(int phin);
+float rhvalue(int porc, int surfc);
 int countem(int xp, int yp, int zp, int phin);
+int curvfast(int ph1, int ph2);
 void sysinit(int ph1, int ph2);
 void sysscan(int ph1, int ph2);
+int sintadd(int p, int c, int idx);
+void sintremove(int p, int c, int idx);
+int sintmove(int idx, int ph1, int ph2);
+int sintbufsize(int n);
+int sintcmp(const void *a, const void *b);
+void sintfree(void);
 int procsol(int nsearch);
 int procair(int nsearch);
 int movepix(int ntomove, int ph1, int ph2);
@@ -463,6 +856,8 @@ void sinter3d(int ph1id, int ph2id, float rhtarget);
 void stat3d(void);
 int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
            float xpt, int *r, float ***filter, float *s, float *xr);
+void rand3dnoise(void);
+int rand3dfft(int phasein, float ***filter);
 void allmem(void);
 
 int main(int argc, char *argv[]) {
@@ -507,7 +902,7 @@ int main(int argc, char *argv[]) {
 
   /* Create log file and keep it open throughout */
   sprintf(LogFileName, "genmic.log");
-  if ((Logfile = fopen(LogFileName, "w")) == NULL) {
+  if ((Logfile = log_open(LogFileName, "w")) == NULL) {
     fprintf(stderr, "\nERROR line 490:  Could not open %s\n\n", LogFileName);
     fflush(stderr);
     exit(1);
@@ -518,16 +913,38 @@ int main(int argc, char *argv[]) {
   /* Display the local time in the log */
   fprintf(Logfile, "=== BEGIN GENMIC SIMULATION ===");
   fprintf(Logfile, "\nStart time: %s", asctime(local_time));
-  fflush(Logfile);
+  log_flush(Logfile);
+
+  if (Tracename[0] != '\0') {
+    i = trace_open(Tracename, "genmic", 0, Tracecounters);
+    if (i == 1) {
+      freegenmic();
+      bailout("genmic", "Could not open trace file");
+      exit(1);
+    }
+    if (i == 2)
+      fprintf(Logfile, "\nHardware counters are not available here; the "
+                       "trace has timings only");
+  }
+
+  if (strlen(BatchFileName) > 0) {
+    if (batchload(BatchFileName)) {
+      freegenmic();
+      bailout("genmic", "Could not read batch input file");
+      exit(1);
+    }
+    fprintf(Logfile, "\nTaking input from %s (%d lines)", BatchFileName,
+            Nbatch);
+  }
 
   fprintf(Logfile, "\nEnter random number seed value (a negative integer)");
-  fflush(Logfile);
-  read_string(instring, sizeof(instring));
+  log_flush(Logfile);
+  getinput("Seed", instring, sizeof(instring));
   nseed = atoi(instring);
   if (nseed > 0)
     nseed = (-1 * nseed);
   fprintf(Logfile, "%d", nseed);
-  fflush(Logfile);
+  log_flush(Logfile);
   Seed = (&nseed);
 
   /* Initialize counters and system parameters */
@@ -578,12 +995,28 @@ int main(int argc, char *argv[]) {
     fprintf(Logfile, "\n %d) Add one-pixel particles to microstructure",
             ONEPIX);
     fprintf(Logfile, "\n %d) Distribute Fly Ash Phases", DISTFA);
-    fflush(Logfile);
+    log_flush(Logfile);
 
-    read_string(instring, sizeof(instring));
-    userc = atoi(instring);
+    getinput("Step", instring, sizeof(instring));
+    userc = getstep(instring);
     fprintf(Logfile, "\n%d", userc);
-    fflush(Logfile);
+    log_flush(Logfile);
+
+    /* The members of an ensemble part at the first random step */
+
+    if (Ensnum > 1 && Ensmember < 0 && ensrandom(userc)) {
+      switch (ensfork(Seed)) {
+      case 0:
+        break;
+      case 1:
+        userc = EXIT;
+        continue;
+      default:
+        freegenmic();
+        bailout("genmic", "Could not start the ensemble members");
+        exit(1);
+      }
+    }
 
     switch (userc) {
     case SPECSIZE:
@@ -599,10 +1032,11 @@ int main(int argc, char *argv[]) {
         for (jg = 0; jg < Ysyssize; jg++) {
           for (kg = 0; kg < Zsyssize; kg++) {
             Cement.val[getInt3dindex(Cement, ig, jg, kg)] = POROSITY;
-            Cemreal.val[getInt3dindex(Cemreal, ig, jg, kg)] = POROSITY;
+            Cemreal.val[getUChar3dindex(Cemreal, ig, jg, kg)] = POROSITY;
           }
         }
       }
+      phtally();
 
       ProgressFile = filehandler("genmic", ProgressFileName, "WRITE");
       if (!ProgressFile) {
@@ -649,7 +1083,7 @@ int main(int argc, char *argv[]) {
       } else {
         fprintf(Logfile, "\nFloccing spheres...\n");
       }
-      fflush(Logfile);
+      log_flush(Logfile);
       makefloc();
       break;
     case MEASURE:
@@ -661,12 +1095,12 @@ int main(int argc, char *argv[]) {
       for (kg = 0; kg < Zsyssize; kg++) {
         for (jg = 0; jg < Ysyssize; jg++) {
           Cement.val[getInt3dindex(Cement, Wallpos, jg, kg)] = TMPAGGID;
-          Cemreal.val[getInt3dindex(Cemreal, Wallpos, jg, kg)] = INERTAGG;
+          setphase(getUChar3dindex(Cemreal, Wallpos, jg, kg), INERTAGG);
           Cement.val[getInt3dindex(Cement, Wallpos - 1, jg, kg)] = TMPAGGID;
-          Cemreal.val[getInt3dindex(Cemreal, Wallpos - 1, jg, kg)] = INERTAGG;
+          setphase(getUChar3dindex(Cemreal, Wallpos - 1, jg, kg), INERTAGG);
           if (Xsyssize % 2 != 0) {
             Cement.val[getInt3dindex(Cement, Wallpos + 1, jg, kg)] = TMPAGGID;
-            Cemreal.val[getInt3dindex(Cemreal, Wallpos + 1, jg, kg)] = INERTAGG;
+            setphase(getUChar3dindex(Cemreal, Wallpos + 1, jg, kg), INERTAGG);
           }
         }
       }
@@ -713,14 +1147,12 @@ int main(int argc, char *argv[]) {
         }
         /* Normal return path (should not reach here due to return address
          * corruption) */
-        fprintf(Logfile,
-                "\n=== DEBUG: Reached normal return path (unexpected) ===");
-        fflush(Logfile);
+        LOGDEBUG(Logfile,
+                 "\n=== DEBUG: Reached normal return path (unexpected) ===");
       } else {
         /* longjmp target - distrib3d used longjmp to return */
-        fprintf(Logfile, "\n=== DEBUG: Returned via longjmp, success = %d ===",
-                distrib3d_success);
-        fflush(Logfile);
+        LOGDEBUG(Logfile, "\n=== DEBUG: Returned via longjmp, success = %d ===",
+                 distrib3d_success);
         if (!distrib3d_success) {
           fprintf(
               Logfile,
@@ -730,17 +1162,17 @@ int main(int argc, char *argv[]) {
         }
       }
       /* distrib3d() already called freedistrib3d() internally before longjmp */
-      fprintf(
+      phtally();
+      LOGDEBUG(
           Logfile,
           "\n=== DEBUG: DISTRIB case completed, continuing to next menu ===");
-      fflush(Logfile);
       /* Check to see that the correct number of C3S pixels is there */
       break;
     case DISTFA:
       fprintf(
           Logfile,
           "\nDistribute fly ash on particle basis (0) or pixel basis (1)?  ");
-      read_string(instring, sizeof(instring));
+      getinput("Fly_ash_basis", instring, sizeof(instring));
       fadchoice = atoi(instring);
       fprintf(Logfile, "%d\n", fadchoice);
       if (distfa(fadchoice)) {
@@ -749,6 +1181,7 @@ int main(int argc, char *argv[]) {
         freegenmic();
         exit(1);
       }
+      phtally();
       /* Check to see that the correct number of C3S pixels is there */
       break;
     case OUTPUTMIC:
@@ -798,13 +1231,15 @@ int main(int argc, char *argv[]) {
   fprintf(Logfile, "\nEnd time: %s", asctime(local_time));
   fprintf(Logfile, "\nElapsed time: %.3f", time_spent);
   fprintf(Logfile, "\n\n=== END GENMIC SIMULATION ===");
-  fflush(Logfile);
-  fclose(Logfile);
+  trace_report(Logfile);
+  log_flush(Logfile);
 
   ProgressFile = filehandler("genmic", ProgressFileName, "WRITE");
   if (!ProgressFile) {
     freegenmic();
+    log_close(Logfile);
     bailout("genmic", "Could not open progress log file");
+    exit(1);
   }
   fprintf(ProgressFile, "json {");
   fprintf(ProgressFile, "\"step\": \"Complete\", \"percent_complete\": 100,");
@@ -817,8 +1252,12 @@ int main(int argc, char *argv[]) {
   rfc8601 = rfc8601_timespec(&tv);
   fprintf(ProgressFile, "\"%s\"}", rfc8601);
   fclose(ProgressFile);
+
+  /* freegenmic may still write to the log, so it is closed last */
+
   freegenmic();
-  return (0);
+  log_close(Logfile);
+  return (Ensfailed ? 1 : 0);
 }
 
 /***
@@ -839,6 +1278,8 @@ int checkargs(int argc, char **argv) {
 
   strcpy(WorkingDirectory, "");
   strcpy(ProgressFileName, "");
+  strcpy(Handoffname, "");
+  strcpy(Tracename, "");
 
   if (argc < 2) {
     wellformed = 0;
@@ -855,16 +1296,29 @@ int checkargs(int argc, char **argv) {
       {"verbose", no_argument, &Verbose_flag, 3},
       {"quiet", no_argument, &Verbose_flag, 1},
       {"silent", no_argument, &Verbose_flag, 0},
+      {"dense-sampling", no_argument, &Densesample, 1},
+      {"template-cache", no_argument, &Templatecache, 1},
+      {"edt-placement", no_argument, &Edtplace, 1},
+      {"sinter-update", no_argument, &Sinterupdate, 1},
+      {"binary-images", no_argument, &Binout, IMG_UINT8},
+      {"zlib-images", no_argument, &Binout, IMG_UINT8Z},
+      {"handoff-files", no_argument, &Handofffiles, 1},
+      {"counters", no_argument, &Tracecounters, 1},
       /* These options don't set a flag */
       {"json", required_argument, 0, 'j'},
       {"workdir", required_argument, 0, 'w'},
+      {"threads", required_argument, 0, 't'},
+      {"batch", required_argument, 0, 'b'},
+      {"ensemble", required_argument, 0, 'e'},
+      {"handoff", required_argument, 0, 'H'},
+      {"trace", required_argument, 0, 'R'},
       {"help", no_argument, 0, 'h'},
       {NULL, 0, 0, 0}};
 
   int opt_char;
   int option_index;
 
-  while ((opt_char = getopt_long(argc, argv, "j:w:h", long_opts,
+  while ((opt_char = getopt_long(argc, argv, "j:w:t:b:e:h", long_opts,
                                  &option_index)) != -1) {
     switch (opt_char) {
     case (0):
@@ -882,6 +1336,30 @@ int checkargs(int argc, char **argv) {
       wdirname = optarg;
       strcpy(WorkingDirectory, wdirname);
       break;
+    // -t or --threads
+    case (int)('t'):
+      Nthreads = atoi(optarg);
+      if (Nthreads < 0)
+        Nthreads = 0;
+      break;
+    // -b or --batch
+    case (int)('b'):
+      strcpy(BatchFileName, optarg);
+      break;
+    // -e or --ensemble
+    case (int)('e'):
+      Ensnum = atoi(optarg);
+      if (Ensnum < 0)
+        Ensnum = 0;
+      break;
+    // --handoff
+    case (int)('H'):
+      strcpy(Handoffname, optarg);
+      break;
+    // --trace
+    case (int)('R'):
+      strcpy(Tracename, optarg);
+      break;
     // -h or --help
     case (int)('h'):
       wellformed = 0;
@@ -895,6 +1373,30 @@ int checkargs(int argc, char **argv) {
     }
   }
 
+  /* The members replay the batch input, which stdin cannot do */
+
+  if (Ensnum > 1 && strlen(BatchFileName) == 0) {
+    fprintf(stderr, "\nERROR: --ensemble needs --batch\n");
+    wellformed = 0;
+  }
+  /* One handoff is for one image */
+
+  if (Ensnum > 1 && strlen(Handoffname) > 0) {
+    fprintf(stderr, "\nERROR: --handoff cannot be used with --ensemble\n");
+    wellformed = 0;
+  }
+#if defined(_WIN32)
+  if (strlen(Handoffname) > 0) {
+    fprintf(stderr, "\nERROR: --handoff is not available on Windows\n");
+    wellformed = 0;
+  }
+  if (Ensnum > 1) {
+    fprintf(stderr, "\nWARNING: --ensemble is not available on Windows; "
+                    "making one image\n");
+    Ensnum = 0;
+  }
+#endif
+
   if (wellformed != 1 || strlen(ProgressFileName) == 0 ||
       strlen(WorkingDirectory) == 0) {
     printHelp();
@@ -910,6 +1412,10 @@ int checkargs(int argc, char **argv) {
   sprintf(LogFileName, "%sgenmic.log", WorkingDirectory);
   strcpy(buff, ProgressFileName);
   sprintf(ProgressFileName, "%s%s", WorkingDirectory, buff);
+  if (Tracename[0] != '\0') {
+    strcpy(buff, Tracename);
+    sprintf(Tracename, "%s%s", WorkingDirectory, buff);
+  }
 
   return (0);
 }
@@ -927,8 +1433,12 @@ int checkargs(int argc, char **argv) {
  ***/
 void printHelp(void) {
   fprintf(stderr, "\n\nUsage: genmic [-h,--help] [-q,--quiet | -s,--silent]\n");
-  fprintf(stderr, "      -j,--json progress.json -w,--workdir "
-                  "working_directory\n\n");
+  fprintf(stderr, "      [--dense-sampling] [--template-cache] "
+                  "[--edt-placement]\n      [--sinter-update] "
+                  "[--binary-images | --zlib-images] [-t,--threads n]\n"
+                  "      [-b,--batch input.csv [-e,--ensemble n]] "
+                  "[--trace file [--counters]]\n      -j,--json progress.json "
+                  "-w,--workdir working_directory\n\n");
   fprintf(stderr, "    progress.json is the name of the progress file for UI "
                   "processing (required)\n");
   fprintf(stderr, "    working_directory is the path to the folder that will "
@@ -938,222 +1448,1416 @@ void printHelp(void) {
   fprintf(stderr, "Quiet mode: Print only end point results to stdout, no "
                   "progress updates to stderr\n");
   fprintf(stderr, "Silent mode: Suppress all output except critical errors "
-                  "to stderr\n\n");
+                  "to stderr\n");
+  fprintf(stderr, "--dense-sampling: Place one-pixel particles by drawing "
+                  "from a list of pore voxels,\n    and try larger particles "
+                  "only where there is free space,\n    which stays fast in "
+                  "dense systems but gives a different image\n    for the "
+                  "same seed\n");
+  fprintf(stderr, "--template-cache: Round the orientations of real-shape "
+                  "particles to\n    a fixed set and reuse the digitized "
+                  "image of a particle with\n    the same shape, size and "
+                  "orientation, which is faster but\n    gives a different "
+                  "image for the same seed\n");
+  fprintf(stderr, "--edt-placement: Try particles only where the distance "
+                  "to the nearest\n    solid exceeds their radius, from a "
+                  "distance map of the pore\n    space, which packs dense "
+                  "systems better but gives a different\n    image for the "
+                  "same seed\n");
+  fprintf(stderr, "--sinter-update: Recompute the local curvature around "
+                  "each pixel moved\n    while sintering the clinker phases, "
+                  "so the moves follow the\n    surface as it changes, which "
+                  "gives a different image for\n    the same seed\n");
+  fprintf(stderr, "--binary-images: Write the microstructure and particle "
+                  "id images in\n    binary, one byte per voxel and four "
+                  "bytes per particle id,\n    which disrealnew reads much "
+                  "faster than text\n");
+  fprintf(stderr, "--zlib-images: As --binary-images, with each x plane "
+                  "compressed by zlib\n");
+  fprintf(stderr, "--handoff name: Hand the microstructure and particle id "
+                  "images to\n    disrealnew --handoff name in shared "
+                  "memory, without writing the\n    image files unless "
+                  "--handoff-files is given too; not on\n    Windows\n");
+  fprintf(stderr, "--trace file: Write a timeline of the calls of rand3d "
+                  "to file, in the\n    trace event format of the Chrome "
+                  "trace viewer and Perfetto\n");
+  fprintf(stderr, "--counters: With --trace, give the cycles, instructions "
+                  "and cache\n    misses of each call, where the system "
+                  "allows it\n");
+  fprintf(stderr, "-b,--batch input.csv: Take the input from a file of "
+                  "Name,value lines\n    instead of answering the prompts "
+                  "on stdin; Step lines give the\n    menu choices in "
+                  "order, by number or by name (size, particles,\n    "
+                  "flocculate, measure, aggregate, connectivity, "
+                  "aggdistance,\n    distribute, output, onepixel, "
+                  "flyash, exit)\n");
+  fprintf(stderr, "-e,--ensemble n: With --batch, make n images that differ "
+                  "only in their\n    seed, in parallel; member k uses the "
+                  "seed plus k and writes\n    its log and images in the "
+                  "directory memberk of the\n    working directory\n");
+  fprintf(stderr, "-t,--threads n: Distribute the clinker phases, and fly "
+                  "ash phases on a\n    pixel basis, on n threads; the "
+                  "image depends on the seed but\n    not on n, and differs "
+                  "from the one made without this option\n\n");
   return;
 }
 
 /***
- *    getsystemsize
+ *    batchload
  *
- *     Gets the dimension, in pixels, of the system per edge
+ *     Read a batch input file into Batch.  Each line is a name, a
+ *     comma and a value; blanks around either are dropped, and
+ *     blank lines and lines starting with # are skipped.
  *
- *     Arguments:    none
- *     Returns:    status flag (0 if okay, -1 if memory allocation error)
+ *     Arguments:    char name of the file
+ *     Returns:    0 if okay, 1 if the file cannot be read or has a
+ *                 line without a comma
  *
- *    Calls:        no routines
+ *    Calls:        filehandler
  *    Called by:    main program
  ***/
-int getsystemsize(void) {
-  char instring[MAXSTRING];
-
-  Xsyssize = Ysyssize = Zsyssize = 0;
-  Res = 0.0;
-
-  fprintf(Logfile, "Enter X dimension of system \n");
-  read_string(instring, sizeof(instring));
-  Xsyssize = atoi(instring);
-  BoxXsize = (int)(0.75 * Xsyssize);
-  fprintf(Logfile, "%d\n", Xsyssize);
-  fprintf(Logfile, "Enter Y dimension of system \n");
-  read_string(instring, sizeof(instring));
-  Ysyssize = atoi(instring);
-  BoxYsize = (int)(0.75 * Ysyssize);
-  fprintf(Logfile, "%d\n", Ysyssize);
-  fprintf(Logfile, "Enter Z dimension of system \n");
-  read_string(instring, sizeof(instring));
-  Zsyssize = atoi(instring);
-  BoxZsize = (int)(0.75 * Zsyssize);
-  fprintf(Logfile, "%d\n", Zsyssize);
-
-  if ((Xsyssize <= 0) || (Xsyssize > MAXSIZE) || (Ysyssize <= 0) ||
-      (Ysyssize > MAXSIZE) || (Zsyssize <= 0) || (Zsyssize > MAXSIZE)) {
+int batchload(char *filename) {
+  int n, cap, len;
+  char line[2 * MAXSTRING], *comma, *name, *value, *end;
+  struct batchitem *newbatch;
+  FILE *fpin;
+
+  fpin = filehandler("genmic", filename, "READ");
+  if (!fpin)
+    return (1);
 
-    bailout("genmic", "Bad system size specification");
-    exit(1);
+  n = cap = 0;
+  while (fgets(line, sizeof(line), fpin)) {
+    len = strlen(line);
+    while (len > 0 && isspace((unsigned char)line[len - 1]))
+      line[--len] = '\0';
+    for (name = line; isspace((unsigned char)*name); name++)
+      ;
+    if (*name == '\0' || *name == '#')
+      continue;
+
+    comma = strchr(name, ',');
+    if (!comma) {
+      fprintf(stderr, "\nERROR in genmic: no comma in batch line '%s'\n",
+              name);
+      fclose(fpin);
+      batchfree();
+      return (1);
+    }
+    for (end = comma; end > name && isspace((unsigned char)end[-1]); end--)
+      ;
+    *end = '\0';
+    for (value = comma + 1; isspace((unsigned char)*value); value++)
+      ;
+
+    if (n == cap) {
+      cap = (cap > 0) ? 2 * cap : 64;
+      newbatch = (struct batchitem *)realloc(Batch,
+                                             cap * sizeof(struct batchitem));
+      if (!newbatch) {
+        fclose(fpin);
+        batchfree();
+        return (1);
+      }
+      Batch = newbatch;
+    }
+    snprintf(Batch[n].name, MAXSTRING, "%s", name);
+    snprintf(Batch[n].value, MAXSTRING, "%s", value);
+    Batch[n].used = 0;
+    n++;
+    Nbatch = n;
   }
 
-  fprintf(Logfile, "Enter system resolution (micrometers per pixel) \n");
-  read_string(instring, sizeof(instring));
-  Res = atof(instring);
-  fprintf(Logfile, "%4.2f\n", Res);
-  if ((Res < HIGHRES - TINY) && (Res > LOWRES + TINY)) {
-    bailout("genmic", "Bad value for system resolution");
-    exit(1);
-  }
+  fclose(fpin);
 
-  Npartc = NPARTC;
-  Burnt = BURNT;
-  Maxburning = MAXBURNING;
+  return (0);
+}
 
-  /***
-   *    Now dynamically allocate the memory for the Particle
-   *    structure array, as well as the Cement and Cemreal
-   *    arrays
-   ***/
+/***
+ *    getinput
+ *
+ *     Get the answer to one prompt: the next unused value with
+ *     this name from the batch input, or else a line from stdin.
+ *     A missing Step ends the run; any other missing value is an
+ *     error.
+ *
+ *     Arguments:    char name of the value in a batch file
+ *                 char pointer to the string to fill, and its size
+ *     Returns:    Nothing
+ *
+ *    Calls:        read_string
+ *    Called by:    main program and the routines that prompt
+ ***/
+void getinput(char *name, char *chstr, unsigned int size) {
+  int i;
+  char msg[MAXSTRING];
 
-  Syspix = Xsyssize * Ysyssize * Zsyssize;
-  Binderpix = Syspix;
-  Sizemag = ((float)Syspix) / (pow(((double)DEFAULTSYSTEMSIZE), 3.0));
-  Isizemag = (int)(Sizemag + 0.5);
-  if (Isizemag > 1) {
-    Npartc = NPARTC * Isizemag;
-    Burnt = BURNT * Isizemag;
-    Maxburning = MAXBURNING * Isizemag;
+  if (!Batch) {
+    read_string(chstr, size);
+    return;
   }
 
-  Particle = NULL;
-
-  /* Allocate memory for Cement and Cemreal arrays */
-
-  if (Int3darray(&Cement, Xsyssize, Ysyssize, Zsyssize)) {
-    return (MEMERR);
-  }
-  if (Int3darray(&Cemreal, Xsyssize, Ysyssize, Zsyssize)) {
-    return (MEMERR);
+  for (i = 0; i < Nbatch; i++) {
+    if (!Batch[i].used && !strcmp(Batch[i].name, name)) {
+      Batch[i].used = 1;
+      snprintf(chstr, size, "%s", Batch[i].value);
+      return;
+    }
   }
 
-  Particle = particlepointervector(Npartc);
-  if (!Particle) {
-    return (MEMERR);
+  if (!strcmp(name, "Step")) {
+    snprintf(chstr, size, "%d", EXIT);
+    return;
   }
 
-  Allocated = 1;
+  snprintf(msg, sizeof(msg), "Batch input has no more %s values", name);
+  freegenmic();
+  bailout("genmic", msg);
+  exit(1);
+}
+
+/***
+ *    getstep
+ *
+ *     Menu choice from a Step answer, which may also be given by
+ *     name in a batch file
+ *
+ *     Arguments:    char answer
+ *     Returns:    int menu choice, or 0 if the name is not known
+ *
+ *    Calls:        No other routines
+ *    Called by:    main program
+ ***/
+int getstep(char *instring) {
+  int i;
+  static struct {
+    char *name;
+    int choice;
+  } steps[] = {{"exit", EXIT},
+               {"size", SPECSIZE},
+               {"particles", ADDPART},
+               {"flocculate", FLOCC},
+               {"measure", MEASURE},
+               {"aggregate", ADDAGG},
+               {"connectivity", CONNECTIVITY},
+               {"aggdistance", DISTFROMAGG},
+               {"distribute", DISTRIB},
+               {"output", OUTPUTMIC},
+               {"onepixel", ONEPIX},
+               {"flyash", DISTFA}};
+
+  if (!Batch || isdigit((unsigned char)instring[0]))
+    return (atoi(instring));
+
+  for (i = 0; i < (int)(sizeof(steps) / sizeof(steps[0])); i++) {
+    if (!strcmp(instring, steps[i].name))
+      return (steps[i].choice);
+  }
+
+  fprintf(Logfile, "\nUnknown step %s in batch input", instring);
 
   return (0);
 }
 
 /***
- *    checksphere
- *
- *    routine to check or perform placement of sphere of ID phasein,
- *    centered at location (xin,yin,zin) of radius radd.
+ *    ensrandom
  *
- *     Arguments:
- *         int xin,yin,zin is the centroid of the sphere to add
- *         int diam is the diameter of the sphere to add
- *        int wflg (1=check for fit of sphere, 2=place the sphere)
- *        int phasein is phase to assign to cement image
- *        int phase2 phase to assign to cemreal image
+ *     Whether a menu choice draws random numbers, so that the
+ *     members of an ensemble must part before it
  *
- *     Returns:    integer flag telling whether sphere will fit
+ *     Arguments:    int menu choice
+ *     Returns:    1 if it does, 0 otherwise
  *
- *    Calls:        checkbc
- *    Called by:    genparticles
+ *    Calls:        No other routines
+ *    Called by:    main program
  ***/
-int checksphere(int xin, int yin, int zin, int diam, int wflg, int phasein,
-                int phase2) {
-  float offset;
-  int pnum, nofits, xp, yp, zp, i, j, k, irad, numpix;
-  float dist, xdist, ydist, zdist, ftmp;
+int ensrandom(int userc) {
+  return (userc == ADDPART || userc == FLOCC || userc == DISTRIB ||
+          userc == DISTFA || userc == ONEPIX);
+}
 
-  if ((Simwall) && (wflg == Check) && (xin == Wallpos)) {
-    if (Verbose) {
-      fprintf(Logfile, "\nCannot place a particle with center at %d\n",
-              Wallpos);
-    }
-    return (1);
-  }
+/***
+ *    ensname
+ *
+ *     Move a file name into a member's directory, keeping its
+ *     last component
+ *
+ *     Arguments:    char pointer to file name (changed in place)
+ *                 char pointer to member directory
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    ensmember, outmic
+ ***/
+void ensname(char *name, char *dir) {
+  char *base, *bs, buff[MAXSTRING];
 
-  pnum = Npart;
+  base = strrchr(name, '/');
+  bs = strrchr(name, '\\');
+  if (bs && (!base || bs > base))
+    base = bs;
+  base = base ? base + 1 : name;
 
-  nofits = 0; /* Flag indicating if placement is possible */
-  if ((diam % 2) == 0) {
-    offset = -0.5;
-    irad = diam / 2;
-  } else {
-    offset = 0.0;
-    irad = (diam - 1) / 2;
-  }
+  snprintf(buff, sizeof(buff), "%s%s", dir, base);
+  strcpy(name, buff);
 
-  /***
-   *    Check all pixels within the digitized sphere volume
-   ***/
+  return;
+}
 
-  numpix = 0;
-  for (i = xin - irad; ((i <= xin + irad) && (!nofits)); i++) {
-    xp = i;
+/***
+ *    ensabsolute
+ *
+ *     Make the relative input paths of the batch input
+ *     absolute, since the members work in directories of
+ *     their own
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    ensfork
+ ***/
+void ensabsolute(void) {
+#if !defined(_WIN32)
+  int i;
+  char cwd[MAXSTRING], buff[MAXSTRING];
+
+  if (!getcwd(cwd, sizeof(cwd)))
+    return;
+
+  for (i = 0; i < Nbatch; i++) {
+    if (strcmp(Batch[i].name, "Correlation_root") &&
+        strcmp(Batch[i].name, "Shape_path") &&
+        strcmp(Batch[i].name, "Phase_shape_path"))
+      continue;
+    if (Batch[i].value[0] == '/' || Batch[i].value[0] == '\0')
+      continue;
+    snprintf(buff, sizeof(buff), "%s/%s", cwd, Batch[i].value);
+    snprintf(Batch[i].value, MAXSTRING, "%s", buff);
+  }
+#endif
+
+  return;
+}
+
+/***
+ *    ensmember
+ *
+ *     Set up a newly forked member of the ensemble: its
+ *     directory and file names, its own log, and its seed
+ *
+ *     Arguments:    int member
+ *                 int pointer to the seed
+ *     Returns:    0 if okay, nonzero otherwise
+ *
+ *    Calls:        ensname, trace_detach, trace_open
+ *    Called by:    ensfork
+ ***/
+int ensmember(int k, int *seed) {
+#if !defined(_WIN32)
+  int base;
+  char dir[MAXSTRING], cwd[MAXSTRING];
+
+  Ensmember = k;
+
+  /* Names are made absolute, since the member works in its directory */
+
+  if (WorkingDirectory[0] != '/' && getcwd(cwd, sizeof(cwd))) {
+    snprintf(dir, sizeof(dir), "%s/%smember%03d%s", cwd, WorkingDirectory, k,
+             PATH_SEPARATOR);
+  } else {
+    snprintf(dir, sizeof(dir), "%smember%03d%s", WorkingDirectory, k,
+             PATH_SEPARATOR);
+  }
+
+  ensname(LogFileName, dir);
+  ensname(ProgressFileName, dir);
+  strcpy(WorkingDirectory, dir);
+
+  /* Scratch files named without a directory go in the member's */
+
+  if (chdir(dir))
+    return (1);
+
+  log_close(Logfile);
+  if ((Logfile = log_open(LogFileName, "w")) == NULL)
+    return (1);
+
+  /* Each member writes a trace of its own */
+
+  if (trace_on()) {
+    trace_detach();
+    ensname(Tracename, dir);
+    if (trace_open(Tracename, "genmic", 0, Tracecounters) == 1)
+      return (1);
+  }
+
+  base = abs(*seed);
+  *seed = -(base + k);
+  fprintf(Logfile, "=== ENSEMBLE MEMBER %d OF %d, SEED %d ===", k, Ensnum,
+          base + k);
+  log_flush(Logfile);
+
+  return (0);
+#else
+  return (1);
+#endif
+}
+
+/***
+ *    ensfork
+ *
+ *     Run the members of the ensemble, each in a process forked
+ *     from this one, and wait for all of them
+ *
+ *     Arguments:    int pointer to the seed
+ *     Returns:    0 in a member, which goes on with the batch
+ *                 input; 1 in the parent once every member has
+ *                 ended; -1 on error
+ *
+ *    Calls:        ensabsolute, ensmember
+ *    Called by:    main program
+ ***/
+int ensfork(int *seed) {
+#if !defined(_WIN32)
+  int k, next, running, jobs, wstatus, status;
+  long nproc;
+  pid_t pid, *enspid;
+  char dir[MAXSTRING];
+
+  enspid = (pid_t *)calloc((size_t)Ensnum, sizeof(pid_t));
+  if (!enspid)
+    return (-1);
+
+  for (k = 0; k < Ensnum; k++) {
+    snprintf(dir, sizeof(dir), "%smember%03d", WorkingDirectory, k);
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+      fprintf(Logfile, "\nERROR: Could not make directory %s", dir);
+      free(enspid);
+      return (-1);
+    }
+  }
+  ensabsolute();
+
+  nproc = sysconf(_SC_NPROCESSORS_ONLN);
+  jobs = (int)((nproc > 0) ? nproc : 1);
+  jobs /= DISTTHREADS;
+  if (jobs < 1)
+    jobs = 1;
+
+  fprintf(Logfile, "\n\nRunning %d ensemble members, %d at a time", Ensnum,
+          jobs);
+
+  next = running = 0;
+  while (next < Ensnum || running > 0) {
+    if (next < Ensnum && running < jobs) {
+      log_flush(Logfile);
+      fflush(NULL); /* stdout, stderr and the trace of --trace */
+      pid = fork();
+      if (pid == 0) {
+        free(enspid);
+        if (ensmember(next, seed)) {
+          fprintf(stderr, "\nERROR: Could not set up ensemble member %d",
+                  next);
+          _exit(1);
+        }
+        return (0);
+      }
+      if (pid < 0) {
+        fprintf(Logfile, "\nERROR: Could not start ensemble member %d", next);
+        Ensfailed++;
+      } else {
+        enspid[next] = pid;
+        running++;
+      }
+      next++;
+      continue;
+    }
+
+    pid = wait(&wstatus);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (k = 0; k < Ensnum && enspid[k] != pid; k++)
+      ;
+    if (k == Ensnum)
+      continue;
+    running--;
+    if (WIFEXITED(wstatus)) {
+      status = WEXITSTATUS(wstatus);
+    } else {
+      status = 128 + WTERMSIG(wstatus);
+    }
+    if (status)
+      Ensfailed++;
+    fprintf(Logfile, "\nEnsemble member %d (seed %d) ended with status %d", k,
+            abs(*seed) + k, status);
+    log_flush(Logfile);
+  }
+
+  free(enspid);
+
+  return (1);
+#else
+  return (-1);
+#endif
+}
+
+/***
+ *    batchfree
+ *
+ *     Release the batch input
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    batchload, freegenmic
+ ***/
+void batchfree(void) {
+  free(Batch);
+  Batch = NULL;
+  Nbatch = 0;
+
+  return;
+}
+
+/***
+ *    getsystemsize
+ *
+ *     Gets the dimension, in pixels, of the system per edge
+ *
+ *     Arguments:    none
+ *     Returns:    status flag (0 if okay, -1 if memory allocation error)
+ *
+ *    Calls:        no routines
+ *    Called by:    main program
+ ***/
+int getsystemsize(void) {
+  char instring[MAXSTRING];
+
+  Xsyssize = Ysyssize = Zsyssize = 0;
+  Res = 0.0;
+
+  fprintf(Logfile, "Enter X dimension of system \n");
+  getinput("X_Size", instring, sizeof(instring));
+  Xsyssize = atoi(instring);
+  BoxXsize = (int)(0.75 * Xsyssize);
+  fprintf(Logfile, "%d\n", Xsyssize);
+  fprintf(Logfile, "Enter Y dimension of system \n");
+  getinput("Y_Size", instring, sizeof(instring));
+  Ysyssize = atoi(instring);
+  BoxYsize = (int)(0.75 * Ysyssize);
+  fprintf(Logfile, "%d\n", Ysyssize);
+  fprintf(Logfile, "Enter Z dimension of system \n");
+  getinput("Z_Size", instring, sizeof(instring));
+  Zsyssize = atoi(instring);
+  BoxZsize = (int)(0.75 * Zsyssize);
+  fprintf(Logfile, "%d\n", Zsyssize);
+
+  if ((Xsyssize <= 0) || (Xsyssize > MAXSIZE) || (Ysyssize <= 0) ||
+      (Ysyssize > MAXSIZE) || (Zsyssize <= 0) || (Zsyssize > MAXSIZE)) {
+
+    bailout("genmic", "Bad system size specification");
+    exit(1);
+  }
+
+  fprintf(Logfile, "Enter system resolution (micrometers per pixel) \n");
+  getinput("Resolution", instring, sizeof(instring));
+  Res = atof(instring);
+  fprintf(Logfile, "%4.2f\n", Res);
+  if ((Res < HIGHRES - TINY) && (Res > LOWRES + TINY)) {
+    bailout("genmic", "Bad value for system resolution");
+    exit(1);
+  }
+
+  Npartc = NPARTC;
+
+  /***
+   *    Now dynamically allocate the memory for the Particle
+   *    structure array, as well as the Cement and Cemreal
+   *    arrays.  The Particle array starts at NPARTC entries
+   *    whatever the system size and is doubled by growparticles
+   *    when it fills, so a large system does not set aside
+   *    room for particles it never places.
+   ***/
+
+  Syspix = Xsyssize * Ysyssize * Zsyssize;
+  Binderpix = Syspix;
+  Sizemag = ((float)Syspix) / (pow(((double)DEFAULTSYSTEMSIZE), 3.0));
+  Isizemag = (int)(Sizemag + 0.5);
+
+  Particle = NULL;
+
+  /* Allocate memory for Cement and Cemreal arrays */
+
+  if (Int3darray(&Cement, Xsyssize, Ysyssize, Zsyssize)) {
+    return (MEMERR);
+  }
+  if (UChar3darray(&Cemreal, Xsyssize, Ysyssize, Zsyssize)) {
+    return (MEMERR);
+  }
+
+  Particle = particlepointervector(Npartc);
+  if (!Particle) {
+    return (MEMERR);
+  }
+
+  Allocated = 1;
+
+  return (0);
+}
+
+/***
+ *    occbuild
+ *
+ *     Make the occupancy grid from the Cemreal image
+ *
+ *     Arguments:    None
+ *     Returns:    0 if okay, 1 if out of memory (then there is no grid)
+ *
+ *    Calls:        occfree
+ *    Called by:    create
+ ***/
+int occbuild(void) {
+  int i, j, k, b, nb;
+
+  occfree();
+
+  Occnx = (Xsyssize + OCCBLOCK - 1) / OCCBLOCK;
+  Occny = (Ysyssize + OCCBLOCK - 1) / OCCBLOCK;
+  Occnz = (Zsyssize + OCCBLOCK - 1) / OCCBLOCK;
+  nb = Occnx * Occny * Occnz;
+
+  Occsolid = (int *)calloc(nb, sizeof(int));
+  Occcap = (int *)calloc(nb, sizeof(int));
+  Occlist = (int *)malloc(nb * sizeof(int));
+  Occpos = (int *)malloc(nb * sizeof(int));
+  if (!Occsolid || !Occcap || !Occlist || !Occpos) {
+    occfree();
+    return (1);
+  }
+
+  for (k = 0; k < Zsyssize; k++) {
+    for (j = 0; j < Ysyssize; j++) {
+      for (i = 0; i < Xsyssize; i++) {
+        b = ((k / OCCBLOCK) * Occny + (j / OCCBLOCK)) * Occnx + (i / OCCBLOCK);
+        Occcap[b]++;
+        if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] != POROSITY)
+          Occsolid[b]++;
+      }
+    }
+  }
+
+  Occnfree = 0;
+  for (b = 0; b < nb; b++) {
+    if (Occsolid[b] < Occcap[b]) {
+      Occpos[b] = Occnfree;
+      Occlist[Occnfree++] = b;
+    } else {
+      Occpos[b] = -1;
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *    occupy
+ *
+ *     Note in the occupancy grid and the distance map that a
+ *     voxel of Cemreal goes from one value to another
+ *
+ *     Arguments:    int x,y,z location of the voxel, inside the system
+ *                 int old and new values
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    checksphere, checkpart
+ ***/
+void occupy(int x, int y, int z, int oldval, int newval) {
+  int b;
+
+  if (oldval != POROSITY || newval == POROSITY)
+    return;
+
+  if (Edt)
+    Edt[getUChar3dindex(Cemreal, x, y, z)] = 0;
+  if (!Occsolid)
+    return;
+
+  b = ((z / OCCBLOCK) * Occny + (y / OCCBLOCK)) * Occnx + (x / OCCBLOCK);
+  Occsolid[b]++;
+
+  /* A full block leaves the list; the last entry takes its place */
+
+  if (Occsolid[b] >= Occcap[b] && Occpos[b] >= 0) {
+    Occnfree--;
+    Occlist[Occpos[b]] = Occlist[Occnfree];
+    Occpos[Occlist[Occnfree]] = Occpos[b];
+    Occpos[b] = -1;
+  }
+
+  return;
+}
+
+/***
+ *    occempty
+ *
+ *     Find whether every block under a box of voxels is free
+ *     of solid, allowing for periodic boundaries
+ *
+ *     Arguments:    int xlo,ylo,zlo lowest corner of the box
+ *                 int nx,ny,nz dimensions of the box
+ *     Returns:    1 if the blocks are all empty, 0 otherwise
+ *
+ *    Calls:        checkbc
+ *    Called by:    checksphere, checkpart
+ ***/
+int occempty(int xlo, int ylo, int zlo, int nx, int ny, int nz) {
+  int i, j, k, ip, jp, kp, b;
+
+  if (!Occsolid || nx > Xsyssize || ny > Ysyssize || nz > Zsyssize)
+    return (0);
+
+  /***
+   *    Step from one block to the next along each axis.  The
+   *    last block of an axis may end at the edge of the system
+   *    before it is full size.
+   ***/
+
+  for (k = zlo; k < zlo + nz; k += OCCSTEP(kp, Zsyssize)) {
+    kp = k + checkbc(k, Zsyssize);
+    for (j = ylo; j < ylo + ny; j += OCCSTEP(jp, Ysyssize)) {
+      jp = j + checkbc(j, Ysyssize);
+      for (i = xlo; i < xlo + nx; i += OCCSTEP(ip, Xsyssize)) {
+        ip = i + checkbc(i, Xsyssize);
+        b = ((kp / OCCBLOCK) * Occny + (jp / OCCBLOCK)) * Occnx +
+            (ip / OCCBLOCK);
+        if (Occsolid[b] > 0)
+          return (0);
+      }
+    }
+  }
+
+  return (1);
+}
+
+/***
+ *    occdraw
+ *
+ *     Draw a voxel at random from the blocks that are not full,
+ *     each voxel of those blocks being equally likely.  If
+ *     every block is full, the voxel is drawn from the whole
+ *     system.
+ *
+ *     Arguments:    int pointers to the x,y,z location to draw
+ *     Returns:    Nothing
+ *
+ *    Calls:        ran1
+ *    Called by:    genparticles
+ ***/
+void occdraw(int *x, int *y, int *z) {
+  int b, n;
+
+  if (!Occsolid || Occnfree == 0) {
+    *x = (int)((float)Xsyssize * ran1(Seed));
+    *y = (int)((float)Ysyssize * ran1(Seed));
+    *z = (int)((float)Zsyssize * ran1(Seed));
+    return;
+  }
+
+  /***
+   *    Blocks at the upper edges of the system are only partly
+   *    inside it, so a voxel of a whole block is drawn and
+   *    drawn again if it lies outside
+   ***/
+
+  do {
+    n = (int)((float)Occnfree * ran1(Seed));
+    if (n >= Occnfree)
+      n = Occnfree - 1;
+    b = Occlist[n];
+    *x = (b % Occnx) * OCCBLOCK + (int)((float)OCCBLOCK * ran1(Seed));
+    *y = ((b / Occnx) % Occny) * OCCBLOCK + (int)((float)OCCBLOCK * ran1(Seed));
+    *z = (b / (Occnx * Occny)) * OCCBLOCK + (int)((float)OCCBLOCK * ran1(Seed));
+  } while (*x >= Xsyssize || *y >= Ysyssize || *z >= Zsyssize);
+
+  return;
+}
+
+/***
+ *    occfree
+ *
+ *     Release the occupancy grid
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    occbuild, create, freegenmic
+ ***/
+void occfree(void) {
+  if (Occsolid)
+    free(Occsolid);
+  if (Occcap)
+    free(Occcap);
+  if (Occlist)
+    free(Occlist);
+  if (Occpos)
+    free(Occpos);
+  Occsolid = Occcap = Occlist = Occpos = NULL;
+  Occnfree = 0;
+
+  return;
+}
+
+/***
+ *    bboxcenter
+ *
+ *     Find the voxel at the middle of the bounding box of a
+ *     real-shape particle, as checkpart takes it, and whether
+ *     it is part of the particle
+ *
+ *     Arguments:    int nxp,nyp,nzp dimensions of the bounding box
+ *                 int pointers to the middle voxel i,j,k
+ *     Returns:    1 if the middle voxel is solid, 0 otherwise
+ *
+ *    Calls:        No other routines
+ *    Called by:    checkpart, genparticles
+ ***/
+int bboxcenter(int nxp, int nyp, int nzp, int *ic, int *jc, int *kc) {
+  *ic = (int)((0.50 * nxp) + 0.01);
+  *jc = (int)((0.50 * nyp) + 0.01);
+  *kc = (int)((0.50 * nzp) + 0.01);
+
+  if (*ic < 1 || *jc < 1 || *kc < 1)
+    return (0);
+
+  return (Bbox.val[getInt3dindex(Bbox, *ic, *jc, *kc)] != POROSITY);
+}
+
+/***
+ *    edtline
+ *
+ *     Squared distance transform of one periodic line of the
+ *     distance map, in place, by the lower envelope of
+ *     parabolas (Felzenszwalb and Huttenlocher).  The line is
+ *     laid out three times end to end so that the nearest
+ *     periodic image of every solid voxel is seen.
+ *
+ *     Arguments:    int pointer to the first value of the line
+ *                 int length n of the line
+ *                 size_t stride between values of the line
+ *                 double scratch f[3n] and z[3n+1]
+ *                 int scratch v[3n]
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    edtbuild
+ ***/
+void edtline(int *line, int n, size_t stride, double *f, double *z, int *v) {
+  int q, k, m;
+  double s, d;
 
-    /***
-     *    Adjust for periodic BCs if necessary
-     ***/
+  m = 3 * n;
+  for (q = 0; q < m; q++) {
+    f[q] = (double)line[(size_t)(q % n) * stride];
+  }
 
-    /* Quick check that particle does not straddle fictitious wall if one is
-     * wanted */
-    if ((Simwall) && (wflg == Check) && ((xin - Wallpos) * (xp - Wallpos) < 0))
-      nofits = 1;
+  k = 0;
+  v[0] = 0;
+  z[0] = -HUGE_VAL;
+  z[1] = HUGE_VAL;
+  for (q = 1; q < m; q++) {
+    s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) /
+        (2.0 * (q - v[k]));
+    while (s <= z[k]) {
+      k--;
+      s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) /
+          (2.0 * (q - v[k]));
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = HUGE_VAL;
+  }
 
-    xp += checkbc(xp, Xsyssize);
+  k = 0;
+  for (q = 0; q < 2 * n; q++) {
+    while (z[k + 1] < q)
+      k++;
+    if (q >= n) {
+      d = (double)(q - v[k]) * (q - v[k]) + f[v[k]];
+      line[(size_t)(q - n) * stride] = (d < EDTINF) ? (int)d : EDTINF;
+    }
+  }
 
-    ftmp = (float)(i - xin - offset);
-    xdist = ftmp * ftmp;
+  return;
+}
 
-    for (j = yin - irad; ((j <= yin + irad) && (!nofits)); j++) {
-      yp = j;
+/***
+ *    edtbuild
+ *
+ *     Make the exact distance map from the Cemreal image, one
+ *     axis at a time, and empty the list of trial sites
+ *
+ *     Arguments:    None
+ *     Returns:    0 if okay, 1 if out of memory (then there is no map)
+ *
+ *    Calls:        edtline, edtfree
+ *    Called by:    create, edtdraw
+ ***/
+int edtbuild(void) {
+  int i, j, k, n;
+  int *v;
+  size_t idx, nvox, sx, sy, sz;
+  double *f, *z;
+
+  nvox = (size_t)Xsyssize * Ysyssize * Zsyssize;
+  if (!Edt) {
+    Edt = (int *)malloc(nvox * sizeof(int));
+    Edtcand = (int *)malloc(nvox * sizeof(int));
+  }
+  n = max(Xsyssize, max(Ysyssize, Zsyssize));
+  f = (double *)malloc(3 * n * sizeof(double));
+  z = (double *)malloc((3 * n + 1) * sizeof(double));
+  v = (int *)malloc(3 * n * sizeof(int));
+  if (!Edt || !Edtcand || !f || !z || !v) {
+    if (f)
+      free(f);
+    if (z)
+      free(z);
+    if (v)
+      free(v);
+    edtfree();
+    return (1);
+  }
 
-      /***
-       *    Adjust for periodic BCs if necessary
-       ***/
+  for (idx = 0; idx < nvox; idx++) {
+    Edt[idx] = (Cemreal.val[idx] != POROSITY) ? 0 : EDTINF;
+  }
 
-      yp += checkbc(yp, Ysyssize);
+  sx = 1;
+  sy = (size_t)Xsyssize;
+  sz = (size_t)Xsyssize * Ysyssize;
 
-      ftmp = (float)(j - yin - offset);
-      ydist = ftmp * ftmp;
-      for (k = zin - irad; ((k <= zin + irad) && (!nofits)); k++) {
-        zp = k;
+  for (k = 0; k < Zsyssize; k++) {
+    for (j = 0; j < Ysyssize; j++) {
+      edtline(Edt + k * sz + j * sy, Xsyssize, sx, f, z, v);
+    }
+  }
+  for (k = 0; k < Zsyssize; k++) {
+    for (i = 0; i < Xsyssize; i++) {
+      edtline(Edt + k * sz + i * sx, Ysyssize, sy, f, z, v);
+    }
+  }
+  for (j = 0; j < Ysyssize; j++) {
+    for (i = 0; i < Xsyssize; i++) {
+      edtline(Edt + j * sy + i * sx, Zsyssize, sz, f, z, v);
+    }
+  }
 
-        /***
-         *    Adjust for periodic BCs if necessary
-         ***/
+  free(f);
+  free(z);
+  free(v);
 
-        zp += checkbc(zp, Zsyssize);
+  Edtncand = 0;
+  Edtr2 = -1;
+  Edtlast = -1;
+  Edtstale = 0;
 
-        ftmp = (float)(k - zin - offset);
-        zdist = ftmp * ftmp;
+  return (0);
+}
 
-        /***
-         *    Compute distance from center of
-         *    sphere to this pixel
-         ***/
+/***
+ *    edtdraw
+ *
+ *     Draw a trial site at random for a particle of squared
+ *     radius r2.  The list of sites holds the voxels whose
+ *     distance map is above the square of the whole part of
+ *     the radius, and is made again only when that changes;
+ *     entries that have dropped below it since are removed as
+ *     they are drawn.  If none is left and the map has been
+ *     updated since it was last made exactly, it is made again
+ *     and the list with it.  Once the exact map has no site for
+ *     a radius, no larger particle is tried on it again.
+ *
+ *     Arguments:    int squared radius r2 of the particle
+ *                 int pointers to the x,y,z location to draw
+ *     Returns:    0 if a site was drawn, 1 if there is none
+ *
+ *    Calls:        ran1, edtbuild
+ *    Called by:    genparticles
+ ***/
+int edtdraw(int r2, int *x, int *y, int *z) {
+  int k, t, idx;
+  size_t n, nvox;
+
+  if (!Edt || r2 >= Edtnone)
+    return (1);
+
+  t = (int)sqrt((double)r2);
+  t *= t;
+  nvox = (size_t)Xsyssize * Ysyssize * Zsyssize;
+  do {
+    if (t != Edtr2) {
+      Edtncand = 0;
+      for (n = 0; n < nvox; n++) {
+        if (Edt[n] > t)
+          Edtcand[Edtncand++] = (int)n;
+      }
+      Edtr2 = t;
+    }
+
+    while (Edtncand > 0) {
+      k = (int)((float)Edtncand * ran1(Seed));
+      if (k >= Edtncand)
+        k = Edtncand - 1;
+      idx = Edtcand[k];
+      if (Edt[idx] > t) {
+        Edtlast = k;
+        *x = idx % Xsyssize;
+        *y = (idx / Xsyssize) % Ysyssize;
+        *z = idx / (Xsyssize * Ysyssize);
+        return (0);
+      }
+      Edtcand[k] = Edtcand[--Edtncand];
+    }
+
+    if (!Edtstale) {
+      Edtnone = t;
+      return (1);
+    }
+    if (edtbuild())
+      return (1);
+
+  } while (1);
+
+  return (1);
+}
+
+/***
+ *    edtmiss
+ *
+ *     Remove the last site drawn by edtdraw from the list,
+ *     after the particle did not fit there
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    genparticles
+ ***/
+void edtmiss(void) {
+  if (Edtlast >= 0 && Edtlast < Edtncand) {
+    Edtcand[Edtlast] = Edtcand[--Edtncand];
+  }
+  Edtlast = -1;
+
+  return;
+}
+
+/***
+ *    edtnear
+ *
+ *     Cap the distance map around a solid voxel of a particle
+ *     just placed by the squared distance to that voxel, out
+ *     to the radius of the current list of trial sites
+ *
+ *     Arguments:    int x,y,z location of the voxel, inside the system
+ *     Returns:    Nothing
+ *
+ *    Calls:        checkbc
+ *    Called by:    genparticles
+ ***/
+void edtnear(int x, int y, int z) {
+  int i, j, k, h, d2;
+  size_t idx;
+
+  if (!Edt)
+    return;
+
+  Edtstale = 1;
+  if (Edtr2 < 0)
+    return;
+
+  h = (int)sqrt((double)Edtr2) + 1;
+  h = min(h, min(Xsyssize, min(Ysyssize, Zsyssize)) / 2);
+  for (k = -h; k <= h; k++) {
+    for (j = -h; j <= h; j++) {
+      for (i = -h; i <= h; i++) {
+        d2 = i * i + j * j + k * k;
+        if (d2 > Edtr2)
+          continue;
+        idx = getUChar3dindex(Cemreal, x + i + checkbc(x + i, Xsyssize),
+                            y + j + checkbc(y + j, Ysyssize),
+                            z + k + checkbc(z + k, Zsyssize));
+        if (Edt[idx] > d2)
+          Edt[idx] = d2;
+      }
+    }
+  }
+
+  return;
+}
+
+/***
+ *    edtsphere
+ *
+ *     Largest squared distance from the center voxel to a voxel
+ *     of a sphere as checksphere digitizes it
+ *
+ *     Arguments:    int diameter of the sphere
+ *     Returns:    integer squared distance
+ *
+ *    Calls:        sphtab
+ *    Called by:    genparticles
+ ***/
+int edtsphere(int diam) {
+  struct sphoff *sp;
+
+  sp = sphtab(diam);
+  if (!sp) {
+    freegenmic();
+    bailout("genmic", "Memory allocation error");
+    exit(1);
+  }
+
+  return (sp->r2);
+}
+
+/***
+ *    sphtab
+ *
+ *     Table of the voxels of a digitized sphere, made the first
+ *     time it is asked for.  A voxel is in the sphere when its
+ *     distance from the center, less half a voxel, is no more
+ *     than the radius; for an even diameter the center is at the
+ *     corner of the middle voxel.  The test depends only on the
+ *     distance along each axis, so it is done once for one
+ *     octant and the other seven are mirror images of it.
+ *
+ *     Arguments:    int diameter of the sphere
+ *     Returns:    Pointer to the table, or NULL if out of memory
+ *
+ *    Calls:        No other routines
+ *    Called by:    checksphere, edtsphere
+ ***/
+struct sphoff *sphtab(int diam) {
+  int i, j, k, ai, aj, ak, irad, n, nside, d2;
+  float offset, dist, ftmp, xdist, ydist, zdist;
+  char *inside;
+  short *off;
+  struct sphoff *sp, **newtab;
+
+  if (diam < 0)
+    diam = 0;
+  if (diam < Nsphoff && Sphoff[diam])
+    return (Sphoff[diam]);
+
+  if (diam >= Nsphoff) {
+    newtab = (struct sphoff **)realloc(Sphoff,
+                                       (diam + 1) * sizeof(struct sphoff *));
+    if (!newtab)
+      return (NULL);
+    for (i = Nsphoff; i <= diam; i++) {
+      newtab[i] = NULL;
+    }
+    Sphoff = newtab;
+    Nsphoff = diam + 1;
+  }
+
+  if ((diam % 2) == 0) {
+    offset = -0.5;
+    irad = diam / 2;
+  } else {
+    offset = 0.0;
+    irad = (diam - 1) / 2;
+  }
+
+  /***
+   *    Offset i has distance |i - offset| from the center, which
+   *    is the distance of offset ai in the octant of positive
+   *    offsets
+   ***/
+
+#define SPHMIRROR(i) (((i) >= 0) ? (i) : ((offset < 0.0) ? -(i)-1 : -(i)))
+
+  nside = irad + 1;
+  inside = (char *)malloc((size_t)nside * nside * nside);
+  sp = (struct sphoff *)malloc(sizeof(struct sphoff));
+  if (!inside || !sp) {
+    free(inside);
+    free(sp);
+    return (NULL);
+  }
 
+  for (ai = 0; ai <= irad; ai++) {
+    ftmp = (float)(ai - offset);
+    xdist = ftmp * ftmp;
+    for (aj = 0; aj <= irad; aj++) {
+      ftmp = (float)(aj - offset);
+      ydist = ftmp * ftmp;
+      for (ak = 0; ak <= irad; ak++) {
+        ftmp = (float)(ak - offset);
+        zdist = ftmp * ftmp;
         dist = sqrt(xdist + ydist + zdist);
-        if ((dist - 0.5) <= ((float)irad)) {
-
-          if (wflg == Place) {
-            /* Perform placement ... */
-            Cement.val[getInt3dindex(Cement, xp, yp, zp)] = phasein;
-            Cemreal.val[getInt3dindex(Cemreal, xp, yp, zp)] = phase2;
-            Particle[pnum]->xi[numpix] = xp;
-            Particle[pnum]->yi[numpix] = yp;
-            Particle[pnum]->zi[numpix] = zp;
-            numpix++;
-          } else if ((wflg == Check) &&
-                     (Cemreal.val[getInt3dindex(Cemreal, xp, yp, zp)] !=
-                      POROSITY)) {
-            /* or check placement */
-            nofits = 1;
-          }
+        inside[(ai * nside + aj) * nside + ak] =
+            ((dist - 0.5) <= ((float)irad));
+      }
+    }
+  }
+
+  n = 0;
+  for (i = -irad; i <= irad; i++) {
+    for (j = -irad; j <= irad; j++) {
+      for (k = -irad; k <= irad; k++) {
+        n += inside[(SPHMIRROR(i) * nside + SPHMIRROR(j)) * nside +
+                    SPHMIRROR(k)];
+      }
+    }
+  }
+
+  off = (short *)malloc((3 * (size_t)n + 1) * sizeof(short));
+  if (!off) {
+    free(inside);
+    free(sp);
+    return (NULL);
+  }
+
+  sp->n = 0;
+  sp->r2 = 0;
+  sp->off = off;
+  for (i = -irad; i <= irad; i++) {
+    for (j = -irad; j <= irad; j++) {
+      for (k = -irad; k <= irad; k++) {
+        if (inside[(SPHMIRROR(i) * nside + SPHMIRROR(j)) * nside +
+                   SPHMIRROR(k)]) {
+          off[3 * sp->n] = i;
+          off[3 * sp->n + 1] = j;
+          off[3 * sp->n + 2] = k;
+          sp->n++;
+          d2 = i * i + j * j + k * k;
+          if (d2 > sp->r2)
+            sp->r2 = d2;
         }
+      }
+    }
+  }
 
-        /* Check for overlap with aggregate */
-        /*
-        agglo = ((Xsyssize/2) - ((Aggsize - 2)/2)) - 1;
-        agghi = ((Xsyssize/2) + (Aggsize/2)) - 1;
-        if ((wflg == Check) && (xp >= agglo && xp <= agghi)) {
+#undef SPHMIRROR
+
+  free(inside);
+  Sphoff[diam] = sp;
+
+  return (sp);
+}
+
+/***
+ *    sphfree
+ *
+ *     Release the tables of digitized spheres
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    freegenmic
+ ***/
+void sphfree(void) {
+  int i;
+
+  for (i = 0; i < Nsphoff; i++) {
+    if (Sphoff[i]) {
+      free(Sphoff[i]->off);
+      free(Sphoff[i]);
+    }
+  }
+  free(Sphoff);
+  Sphoff = NULL;
+  Nsphoff = 0;
+
+  return;
+}
+
+/***
+ *    edtpart
+ *
+ *     Largest squared distance from a voxel of Bbox to the
+ *     voxels of the particle in it that checkpart tests
+ *
+ *     Arguments:    int nxp,nyp,nzp dimensions of the bounding box
+ *                 int ic,jc,kc the voxel to measure from
+ *     Returns:    integer squared distance
+ *
+ *    Calls:        No other routines
+ *    Called by:    genparticles
+ ***/
+int edtpart(int nxp, int nyp, int nzp, int ic, int jc, int kc) {
+  int i, j, k, d2, r2;
+
+  r2 = 0;
+  for (k = 1; k <= nzp; k++) {
+    for (j = 1; j <= nyp; j++) {
+      for (i = 1; i <= nxp; i++) {
+        if (Bbox.val[getInt3dindex(Bbox, i, j, k)] != POROSITY) {
+          d2 = (i - ic) * (i - ic) + (j - jc) * (j - jc) + (k - kc) * (k - kc);
+          if (d2 > r2)
+            r2 = d2;
+        }
+      }
+    }
+  }
+
+  return (r2);
+}
+
+/***
+ *    edtfree
+ *
+ *     Release the distance map
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    edtbuild, create, freegenmic
+ ***/
+void edtfree(void) {
+  if (Edt)
+    free(Edt);
+  if (Edtcand)
+    free(Edtcand);
+  Edt = Edtcand = NULL;
+  Edtncand = 0;
+  Edtr2 = Edtlast = -1;
+  Edtnone = EDTINF;
+
+  return;
+}
+
+/***
+ *    checksphere
+ *
+ *    routine to check or perform placement of sphere of ID phasein,
+ *    centered at location (xin,yin,zin) of radius radd.
+ *
+ *     Arguments:
+ *         int xin,yin,zin is the centroid of the sphere to add
+ *         int diam is the diameter of the sphere to add
+ *        int wflg (1=check for fit of sphere, 2=place the sphere)
+ *        int phasein is phase to assign to cement image
+ *        int phase2 phase to assign to cemreal image
+ *
+ *     Returns:    integer flag telling whether sphere will fit
+ *
+ *    Calls:        checkbc, occempty, occupy, sphtab
+ *    Called by:    genparticles
+ ***/
+int checksphere(int xin, int yin, int zin, int diam, int wflg, int phasein,
+                int phase2) {
+  int pnum, nofits, xp, yp, zp, i, m, irad, numpix;
+  unsigned char *cp;
+  short *off;
+  struct sphoff *sp;
+
+  if ((Simwall) && (wflg == Check) && (xin == Wallpos)) {
+    if (Verbose) {
+      fprintf(Logfile, "\nCannot place a particle with center at %d\n",
+              Wallpos);
+    }
+    return (1);
+  }
+
+  pnum = Npart;
+
+  nofits = 0; /* Flag indicating if placement is possible */
+  if ((diam % 2) == 0) {
+    irad = diam / 2;
+  } else {
+    irad = (diam - 1) / 2;
+  }
+
+  /***
+   *    The voxel at the center is always in the sphere, so the
+   *    sphere cannot fit if it is solid.  If the occupancy grid
+   *    shows no solid anywhere under the sphere, it fits.
+   ***/
+
+  if (wflg == Check) {
+    xp = xin + checkbc(xin, Xsyssize);
+    yp = yin + checkbc(yin, Ysyssize);
+    zp = zin + checkbc(zin, Zsyssize);
+    if (Cemreal.val[getUChar3dindex(Cemreal, xp, yp, zp)] != POROSITY)
+      return (1);
+    if (!Simwall && occempty(xin - irad, yin - irad, zin - irad,
+                             2 * irad + 1, 2 * irad + 1, 2 * irad + 1))
+      return (0);
+
+    /* Quick check that particle does not straddle fictitious wall if one is
+     * wanted */
+    if (Simwall) {
+      for (i = xin - irad; i <= xin + irad; i++) {
+        if ((xin - Wallpos) * (i - Wallpos) < 0)
+          return (1);
+      }
+    }
+  }
+
+  sp = sphtab(diam);
+  if (!sp) {
+    freegenmic();
+    bailout("genmic", "Memory allocation error");
+    exit(1);
+  }
+
+  /***
+   *    Check all pixels within the digitized sphere volume,
+   *    adjusting for periodic BCs if necessary
+   ***/
+
+  numpix = 0;
+  off = sp->off;
+
+  /* Away from the faces of the system nothing wraps around */
+
+  if ((wflg == Check) && (xin - irad >= 0) && (xin + irad < Xsyssize) &&
+      (yin - irad >= 0) && (yin + irad < Ysyssize) && (zin - irad >= 0) &&
+      (zin + irad < Zsyssize)) {
+    cp = Cemreal.val + getUChar3dindex(Cemreal, xin, yin, zin);
+    for (m = 0; m < sp->n; m++, off += 3) {
+      if (cp[((long)off[2] * Ysyssize + off[1]) * Xsyssize + off[0]] !=
+          POROSITY)
+        return (1);
+    }
+    return (0);
+  }
+
+  for (m = 0; (m < sp->n) && (!nofits); m++, off += 3) {
+    xp = xin + off[0];
+    xp += checkbc(xp, Xsyssize);
+    yp = yin + off[1];
+    yp += checkbc(yp, Ysyssize);
+    zp = zin + off[2];
+    zp += checkbc(zp, Zsyssize);
 
-            nofits = 1;
-        }
-        */
-      }
+    if (wflg == Place) {
+      /* Perform placement ... */
+      occupy(xp, yp, zp, Cemreal.val[getUChar3dindex(Cemreal, xp, yp, zp)],
+             phase2);
+      Cement.val[getInt3dindex(Cement, xp, yp, zp)] = phasein;
+      setphase(getUChar3dindex(Cemreal, xp, yp, zp), phase2);
+      Particle[pnum]->xi[numpix] = xp;
+      Particle[pnum]->yi[numpix] = yp;
+      Particle[pnum]->zi[numpix] = zp;
+      numpix++;
+    } else if ((wflg == Check) &&
+               (Cemreal.val[getUChar3dindex(Cemreal, xp, yp, zp)] != POROSITY)) {
+      /* or check placement */
+      nofits = 1;
     }
   }
 
@@ -1193,12 +2897,12 @@ int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int vol,
   if (Verbose) {
     fprintf(Logfile, "\nIn Checkpart, Vol = %d, wflg = %d, phase = %d", vol,
             wflg, phase2);
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   if ((Simwall) && (wflg == Check) && (xin == Wallpos)) {
     fprintf(Logfile, "\nCannot place a particle with center at %d\n", Wallpos);
-    fflush(Logfile);
+    log_flush(Logfile);
     return (1);
   }
 
@@ -1232,6 +2936,25 @@ int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int vol,
       }
     }
 
+    /***
+     *    The particle cannot fit if the solid voxel at the middle
+     *    of its box lands on solid.  If the occupancy grid shows
+     *    no solid anywhere under the box, it fits.
+     ***/
+
+    if (bboxcenter(nxp, nyp, nzp, &i, &j, &k)) {
+      i1 = xin + i;
+      i1 += checkbc(i1, Xsyssize);
+      j1 = yin + j;
+      j1 += checkbc(j1, Ysyssize);
+      k1 = zin + k;
+      k1 += checkbc(k1, Zsyssize);
+      if (Cemreal.val[getUChar3dindex(Cemreal, i1, j1, k1)] != POROSITY)
+        return (1);
+    }
+    if (!Simwall && occempty(xin + 1, yin + 1, zin + 1, nxp, nyp, nzp))
+      return (0);
+
     k = j = i = 1;
     nofits = 0;
     while (k <= nzp && !nofits) {
@@ -1247,7 +2970,7 @@ int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int vol,
           i2 = i1;
           i1 += checkbc(i1, Xsyssize);
           if (Bbox.val[getInt3dindex(Bbox, i, j, k)] != POROSITY) {
-            if (Cemreal.val[getInt3dindex(Cemreal, i1, j1, k1)] != POROSITY) {
+            if (Cemreal.val[getUChar3dindex(Cemreal, i1, j1, k1)] != POROSITY) {
               nofits = 1;
             } else if ((Simwall) && ((i2 - Wallpos) * (xmark - Wallpos) < 0)) {
               nofits = 1;
@@ -1279,7 +3002,9 @@ int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int vol,
           k1 += checkbc(k1, Zsyssize);
           if (Bbox.val[getInt3dindex(Bbox, i, j, k)] != POROSITY &&
               Bbox.val[getInt3dindex(Bbox, i, j, k)] < FCHECK) {
-            Cemreal.val[getInt3dindex(Cemreal, i1, j1, k1)] = phase2;
+            occupy(i1, j1, k1, Cemreal.val[getUChar3dindex(Cemreal, i1, j1, k1)],
+                   phase2);
+            setphase(getUChar3dindex(Cemreal, i1, j1, k1), phase2);
             Cement.val[getInt3dindex(Cement, i1, j1, k1)] = phasein;
             Particle[pnum]->xi[numpix] = i1;
             Particle[pnum]->yi[numpix] = j1;
@@ -1321,8 +3046,7 @@ int checkpart(int xin, int yin, int zin, int nxp, int nyp, int nzp, int vol,
  ***/
 int image(int *nxp, int *nyp, int *nzp) {
   int partc = 0;
-  int n, m, i, j, k, count;
-  fcomplex rr;
+  int i, j, k, count;
   double xc, yc, zc, x1, y1, z1, r;
   double theta, phi;
 
@@ -1374,15 +3098,8 @@ int image(int *nxp, int *nyp, int *nzp) {
         if ((y1 - yc) < 0.0 && (x1 - xc) > 0.0)
           phi += 2.0 * Pi;
         harm(theta, phi);
-        rr = Complex(0.0, 0.0);
-        rr = Cmul(AA[0][0], Y[0][0]);
-        for (n = 1; n <= Nnn; n++) {
-          for (m = -n; m <= n; m++) {
-            rr = Cadd(rr, Cmul(AA[n][m], Y[n][m]));
-          }
-        }
 
-        if (r <= (rr.r)) {
+        if (r <= sphradius(AA, Y, Nnn)) {
           Bbox.val[getInt3dindex(Bbox, i, j, k)] = C3S;
           count++;
         }
@@ -1590,7 +3307,7 @@ int adjustvol(int diff, int nxp, int nyp, int nzp) {
 #ifdef DEBUG
             if (numsp == 9999) {
               fprintf(Logfile, "\nThis is why... numsp = 9999");
-              fflush(Logfile);
+              log_flush(Logfile);
             }
 #endif
           }
@@ -1623,7 +3340,7 @@ int adjustvol(int diff, int nxp, int nyp, int nzp) {
 #ifdef DEBUG
   fprintf(Logfile, "\nIn adjustvol, diff = %d and num surf pix = %d", diff,
           numsp);
-  fflush(Logfile);
+  log_flush(Logfile);
 #endif
 
   count = 0;
@@ -1636,7 +3353,7 @@ int adjustvol(int diff, int nxp, int nyp, int nzp) {
     choice = (int)(numsp * ran1(Seed));
 #ifdef DEBUG
     fprintf(Logfile, "\n\tIn adjustvol random choice = %d", choice);
-    fflush(Logfile);
+    log_flush(Logfile);
 #endif
 
     if (choice > numsp)
@@ -1662,7 +3379,7 @@ int adjustvol(int diff, int nxp, int nyp, int nzp) {
     numsp--;
 #ifdef DEBUG
     fprintf(Logfile, "\n\t\tcount = %d and numsp = %d", count, numsp);
-    fflush(Logfile);
+    log_flush(Logfile);
 #endif
   }
 
@@ -1747,97 +3464,662 @@ void addlayer(int nxp, int nyp, int nzp) {
     }
   }
 
-  if (Dispdist == 2) {
-    for (k = 1; k < nzp; k++) {
-      for (j = 1; j < nyp; j++) {
-        for (i = 1; i < nxp; i++) {
-          if (Bbox.val[getInt3dindex(Bbox, i, j, k)] == FCHECK) {
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j, k)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i + 1, j, k)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i - 1, j, k)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i - 1, j, k)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i, j + 1, k)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i, j + 1, k)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i, j - 1, k)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i, j - 1, k)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i, j, k + 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i, j, k + 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i, j, k - 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i, j, k - 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i - 1, j + 1, k)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i - 1, j + 1, k)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i - 1, j - 1, k)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i - 1, j - 1, k)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j, k + 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i + 1, j, k + 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j, k - 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i + 1, j, k - 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i - 1, j, k + 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i - 1, j, k + 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i - 1, j, k - 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i - 1, j, k - 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i, j + 1, k + 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i, j + 1, k + 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i, j + 1, k - 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i, j + 1, k - 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i, j - 1, k + 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i, j - 1, k + 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i, j - 1, k - 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i, j - 1, k - 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k + 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k + 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k - 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k - 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k + 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k + 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k - 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k - 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k + 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i - 1, j + 1, k + 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k - 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i - 1, j + 1, k - 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k + 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i - 1, j - 1, k + 1)] = FCHECK + 1;
-            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k - 1)] == POROSITY)
-              Bbox.val[getInt3dindex(Bbox, i - 1, j - 1, k - 1)] = FCHECK + 1;
-          }
-        }
+  if (Dispdist == 2) {
+    for (k = 1; k < nzp; k++) {
+      for (j = 1; j < nyp; j++) {
+        for (i = 1; i < nxp; i++) {
+          if (Bbox.val[getInt3dindex(Bbox, i, j, k)] == FCHECK) {
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j, k)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i + 1, j, k)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i - 1, j, k)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i - 1, j, k)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i, j + 1, k)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i, j + 1, k)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i, j - 1, k)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i, j - 1, k)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i, j, k + 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i, j, k + 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i, j, k - 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i, j, k - 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i - 1, j + 1, k)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i - 1, j + 1, k)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i - 1, j - 1, k)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i - 1, j - 1, k)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j, k + 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i + 1, j, k + 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j, k - 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i + 1, j, k - 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i - 1, j, k + 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i - 1, j, k + 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i - 1, j, k - 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i - 1, j, k - 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i, j + 1, k + 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i, j + 1, k + 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i, j + 1, k - 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i, j + 1, k - 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i, j - 1, k + 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i, j - 1, k + 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i, j - 1, k - 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i, j - 1, k - 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k + 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k + 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k - 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k - 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k + 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k + 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k - 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k - 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k + 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i - 1, j + 1, k + 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j + 1, k - 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i - 1, j + 1, k - 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k + 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i - 1, j - 1, k + 1)] = FCHECK + 1;
+            if (Bbox.val[getInt3dindex(Bbox, i + 1, j - 1, k - 1)] == POROSITY)
+              Bbox.val[getInt3dindex(Bbox, i - 1, j - 1, k - 1)] = FCHECK + 1;
+          }
+        }
+      }
+    }
+  }
+
+  return;
+}
+
+/***
+ *    striplayer
+ *
+ *     For real shape particles, strips one layer of id FCHECK
+ *     around the periphery of the particle.  This function
+ *     is invoked only if user specified Dispdist = 2 and
+ *     the particles are no longer fitting.
+ *
+ *     Arguments:    Dimensions nxp,nyp,nzp of bounding box Bbox
+ *     Returns:    Nothing
+ *
+ *    Calls:        no functions
+ *    Called by:    genparticles
+ ***/
+void striplayer(int nxp, int nyp, int nzp) {
+  int i, j, k;
+
+  for (k = 1; k < nzp; k++) {
+    for (j = 1; j < nyp; j++) {
+      for (i = 1; i < nxp; i++) {
+        if (Bbox.val[getInt3dindex(Bbox, i, j, k)] > FCHECK)
+          Bbox.val[getInt3dindex(Bbox, i, j, k)] = POROSITY;
+      }
+    }
+  }
+
+  return;
+}
+
+/***
+ *    getshapeset
+ *
+ *     Find the shape set of a phase in the shape library,
+ *     reading its geom file the first time the set is used
+ *
+ *     Arguments:    int phase id
+ *
+ *     Returns:    pointer to the shape set, or NULL if its
+ *                 geom file could not be read or there is no
+ *                 memory
+ *
+ *    Calls:        filehandler, fread_string
+ *    Called by:    genparticles
+ ***/
+struct shapeset *getshapeset(int phnow) {
+  int i, n, done, nsh;
+  char buff[MAXSTRING], filename[2 * MAXSTRING + 16], dir[2 * MAXSTRING];
+  char *name, *newstring;
+  struct shapeset *ss;
+  FILE *geomfile;
+
+  sprintf(dir, "%s%s", Phase_shape[phnow].pathroot,
+          Phase_shape[phnow].shapeset);
+  for (i = 0; i < Nshapelib; i++) {
+    if (!strcmp(Shapelib[i].dir, dir))
+      return (&Shapelib[i]);
+  }
+  if (Nshapelib >= NSPHASES)
+    return (NULL);
+
+  ss = &Shapelib[Nshapelib];
+  memset(ss, 0, sizeof(struct shapeset));
+  strcpy(ss->dir, dir);
+  nsh = (Nnn + 1) * (Nnn + 1);
+  ss->line = (struct lineitem *)calloc(MAXLINES, sizeof(struct lineitem));
+  ss->anm = (fcomplex *)malloc((size_t)MAXLINES * nsh * sizeof(fcomplex));
+  ss->shape = (struct shapeitem *)calloc(MAXLINES, sizeof(struct shapeitem));
+  if (!ss->line || !ss->anm || !ss->shape) {
+    freeshapeset(ss);
+    return (NULL);
+  }
+
+  n = snprintf(filename, sizeof(filename), "%s%c%s-geom.csv", dir, Filesep,
+               Phase_shape[phnow].shapeset);
+  if (n < 0 || n >= (int)sizeof(filename)) {
+    bailout("genmic", "Path of the shape set geom file is too long");
+    freeshapeset(ss);
+    return (NULL);
+  }
+
+  geomfile = filehandler("genmic", filename, "READ");
+  if (!geomfile) {
+    freeshapeset(ss);
+    return (NULL);
+  }
+
+  /* Scan header and discard */
+  fread_string(geomfile, buff);
+
+  if (Verbose)
+    fprintf(Logfile, "\nReading each line of the geom file...");
+  log_flush(Logfile);
+
+  i = done = 0;
+  while ((!feof(geomfile)) && (i < MAXLINES) && (done == 0)) {
+    fread_string(geomfile, buff);
+    name = strtok(buff, ",");
+    fprintf(Logfile, "\ni = %d, name = %s", i, name);
+    log_flush(Logfile);
+    strcpy(ss->line[i].name, name);
+    newstring = strtok(NULL, ",");
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].xlow = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].xhi = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].ylow = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].yhi = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].zlow = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].zhi = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].volume = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].surfarea = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].nsurfarea = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].diam = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].Itrace = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].Nnn = atoi(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].NGC = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].length = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].width = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].thickness = atof(newstring);
+      newstring = strtok(NULL, ",");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].nlength = atof(newstring);
+      newstring = strtok(NULL, ",\n");
+    } else {
+      done = 1;
+    }
+    if (newstring != NULL) {
+      fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
+      log_flush(Logfile);
+      ss->line[i].nwidth = atof(newstring);
+    } else {
+      done = 1;
+    }
+    i++;
+
+    /* Line scanned in now */
+  }
+
+  if (Verbose)
+    fprintf(Logfile, " Done!\n");
+  log_flush(Logfile);
+
+  /* All lines scanned */
+
+  ss->numlines = i - 2;
+  fclose(geomfile);
+
+  Nshapelib++;
+
+  return (ss);
+}
+
+/***
+ *    getshape
+ *
+ *     Put the coefficients of one shape of a shape set in A,
+ *     with its volume and extents at the scale of its anm
+ *     file.  The anm file is only read, and the volume only
+ *     computed, the first time the shape is used.
+ *
+ *     Arguments:    pointer to the shape set
+ *                 int line of the shape in the geom file
+ *                 int phase id
+ *                 float pointers to the volume and the extents
+ *                 in x, y, z
+ *
+ *     Returns:    0 if okay, nonzero if the anm file could not be
+ *                 read or there is no memory
+ *
+ *    Calls:        filehandler, shgrid_make, shgrid_volume
+ *    Called by:    genparticles
+ ***/
+int getshape(struct shapeset *ss, int n1, int phnow, float *volume,
+             float *maxrx, float *maxry, float *maxrz) {
+  int n, m, ii, jj, nsh;
+  float aa1, aa2;
+  char filename[2 * MAXSTRING + 16];
+  fcomplex *ap;
+  struct shapeitem *sh;
+  FILE *anmfile;
+
+  nsh = (Nnn + 1) * (Nnn + 1);
+  ap = ss->anm + (size_t)n1 * nsh;
+  sh = &ss->shape[n1];
+
+  if (!sh->loaded) {
+    n = snprintf(filename, sizeof(filename), "%s%c%s", ss->dir, Filesep,
+                 ss->line[n1].name);
+    if (n < 0 || n >= (int)sizeof(filename)) {
+      bailout("genmic", "Path of the shape file is too long");
+      return (1);
+    }
+    if (Verbose)
+      fprintf(Logfile, " %s", filename);
+    log_flush(Logfile);
+
+    anmfile = filehandler("genmic", filename, "READ");
+    if (!anmfile)
+      return (1);
+
+    /***
+     *    Nnn is how many y's are to be used
+     *    in series
+     ***/
+
+    for (n = 0; n <= Nnn; n++) {
+      for (m = n; m >= -n; m--) {
+        fscanf(anmfile, "%d %d %f %f", &ii, &jj, &aa1, &aa2);
+        ap[n * n + n + m] = Complex(aa1, aa2);
+      }
+    }
+    fclose(anmfile);
+
+    for (n = 0; n <= Nnn; n++) {
+      for (m = -n; m <= n; m++) {
+        A[n][m] = ap[n * n + n + m];
+      }
+    }
+
+    /* Volume and extents of the shape as read */
+
+    if (shgrid_make(&Shapegrid, Nnn, Phase_shape[phnow].ntheta,
+                    Phase_shape[phnow].nphi, Phase_shape[phnow].xg,
+                    Phase_shape[phnow].wg)) {
+      return (2);
+    }
+    sh->volume =
+        shgrid_volume(&Shapegrid, A, &sh->maxrx, &sh->maxry, &sh->maxrz);
+    sh->loaded = 1;
+  } else {
+    for (n = 0; n <= Nnn; n++) {
+      for (m = -n; m <= n; m++) {
+        A[n][m] = ap[n * n + n + m];
+      }
+    }
+  }
+
+  *volume = sh->volume;
+  *maxrx = sh->maxrx;
+  *maxry = sh->maxry;
+  *maxrz = sh->maxrz;
+
+  return (0);
+}
+
+/***
+ *    freeshapeset
+ *
+ *     Release the memory of one shape set in the shape library
+ *
+ *     Arguments:    pointer to the shape set
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    getshapeset, freegenmic
+ ***/
+void freeshapeset(struct shapeset *ss) {
+  if (ss->line)
+    free(ss->line);
+  if (ss->anm)
+    free(ss->anm);
+  if (ss->shape)
+    free(ss->shape);
+  ss->line = NULL;
+  ss->anm = NULL;
+  ss->shape = NULL;
+
+  return;
+}
+
+/***
+ *    ptemplate_orient
+ *
+ *     Round the Euler angles of a particle rotation to the
+ *     middle of their bins for the template cache
+ *
+ *     Arguments:    double pointers to alpha, beta and gamma,
+ *                   which are replaced by the middles of their bins
+ *     Returns:    integer number of the orientation bin
+ *
+ *    Calls:        No other routines
+ *    Called by:    genparticles
+ ***/
+int ptemplate_orient(double *alpha, double *beta, double *gamma) {
+  int ia, ib, ic;
+
+  ia = (int)((*alpha / (2.0 * Pi)) * PTEMPBINS);
+  ib = (int)((*beta / Pi) * (PTEMPBINS / 2));
+  ic = (int)((*gamma / (2.0 * Pi)) * PTEMPBINS);
+  ia = max(0, min(ia, PTEMPBINS - 1));
+  ib = max(0, min(ib, (PTEMPBINS / 2) - 1));
+  ic = max(0, min(ic, PTEMPBINS - 1));
+
+  *alpha = 2.0 * Pi * (ia + 0.5) / PTEMPBINS;
+  *beta = Pi * (ib + 0.5) / (PTEMPBINS / 2);
+  *gamma = 2.0 * Pi * (ic + 0.5) / PTEMPBINS;
+
+  return ((ia * (PTEMPBINS / 2) + ib) * PTEMPBINS + ic);
+}
+
+/***
+ *    ptemplate_hash
+ *
+ *     Bucket of the template cache for a particle
+ *
+ *     Arguments:    shape set pointer, shape number, target
+ *                   volume, dispersion distance, orientation bin
+ *     Returns:    integer bucket number
+ *
+ *    Calls:        No other routines
+ *    Called by:    ptemplate_find, ptemplate_save
+ ***/
+int ptemplate_hash(struct shapeset *ss, int n1, int vol, int dispdist,
+                   int orient) {
+  unsigned long h;
+
+  h = (unsigned long)(ss - Shapelib);
+  h = h * 31UL + (unsigned long)n1;
+  h = h * 131UL + (unsigned long)vol;
+  h = h * 7UL + (unsigned long)dispdist;
+  h = h * 8191UL + (unsigned long)orient;
+
+  return ((int)(h % PTEMPHASH));
+}
+
+/***
+ *    ptemplate_find
+ *
+ *     Look up a digitized particle in the template cache
+ *
+ *     Arguments:    shape set pointer, shape number, target
+ *                   volume, dispersion distance, orientation bin
+ *     Returns:    pointer to the template, or NULL if there is none
+ *
+ *    Calls:        ptemplate_hash
+ *    Called by:    genparticles
+ ***/
+struct ptemplate *ptemplate_find(struct shapeset *ss, int n1, int vol,
+                                 int dispdist, int orient) {
+  struct ptemplate *tp;
+
+  for (tp = Ptemphash[ptemplate_hash(ss, n1, vol, dispdist, orient)]; tp;
+       tp = tp->next) {
+    if (tp->ss == ss && tp->n1 == n1 && tp->vol == vol &&
+        tp->dispdist == dispdist && tp->orient == orient)
+      return (tp);
+  }
+
+  return (NULL);
+}
+
+/***
+ *    ptemplate_stamp
+ *
+ *     Put a particle from the template cache into Bbox, as
+ *     image and adjustvol would have left it
+ *
+ *     Arguments:    template pointer
+ *                   int pointers to the box dimensions, which are set
+ *     Returns:    integer number of solid pixels in the particle
+ *
+ *    Calls:        No other routines
+ *    Called by:    genparticles
+ ***/
+int ptemplate_stamp(struct ptemplate *tp, int *nxp, int *nyp, int *nzp) {
+  int i, j, k;
+
+  *nxp = tp->nxp;
+  *nyp = tp->nyp;
+  *nzp = tp->nzp;
+
+  for (k = 1; k <= *nzp; k++) {
+    for (j = 1; j <= *nyp; j++) {
+      for (i = 1; i <= *nxp; i++) {
+        Bbox.val[getInt3dindex(Bbox, i, j, k)] = POROSITY;
+      }
+    }
+  }
+
+  for (i = 0; i < tp->partc; i++) {
+    Bbox.val[tp->pix[i]] = C3S;
+  }
+
+  return (tp->partc);
+}
+
+/***
+ *    ptemplate_save
+ *
+ *     Add the particle now in Bbox to the template cache,
+ *     unless the cache is full.  A particle that cannot be
+ *     saved is simply not cached.
+ *
+ *     Arguments:    shape set pointer, shape number, target
+ *                   volume, dispersion distance, orientation bin,
+ *                   dimensions of the box, number of solid pixels
+ *     Returns:    Nothing
+ *
+ *    Calls:        ptemplate_hash
+ *    Called by:    genparticles
+ ***/
+void ptemplate_save(struct shapeset *ss, int n1, int vol, int dispdist,
+                    int orient, int nxp, int nyp, int nzp, int partc) {
+  int i, j, k, h, idx, count;
+  struct ptemplate *tp;
+
+  if (partc <= 0 || Ptemppix + partc > PTEMPMAXPIX)
+    return;
+
+  tp = (struct ptemplate *)malloc(sizeof(struct ptemplate));
+  if (!tp)
+    return;
+  tp->pix = (int *)malloc(partc * sizeof(int));
+  if (!tp->pix) {
+    free(tp);
+    return;
+  }
+
+  count = 0;
+  for (k = 1; k <= nzp; k++) {
+    for (j = 1; j <= nyp; j++) {
+      for (i = 1; i <= nxp; i++) {
+        idx = getInt3dindex(Bbox, i, j, k);
+        if (Bbox.val[idx] == C3S && count < partc)
+          tp->pix[count++] = idx;
       }
     }
   }
 
+  /* The box should hold exactly partc solid voxels */
+
+  if (count != partc) {
+    free(tp->pix);
+    free(tp);
+    return;
+  }
+
+  tp->ss = ss;
+  tp->n1 = n1;
+  tp->vol = vol;
+  tp->dispdist = dispdist;
+  tp->orient = orient;
+  tp->nxp = nxp;
+  tp->nyp = nyp;
+  tp->nzp = nzp;
+  tp->partc = partc;
+
+  h = ptemplate_hash(ss, n1, vol, dispdist, orient);
+  tp->next = Ptemphash[h];
+  Ptemphash[h] = tp;
+  Ptemppix += partc;
+
   return;
 }
 
 /***
- *    striplayer
+ *    ptemplate_freeall
  *
- *     For real shape particles, strips one layer of id FCHECK
- *     around the periphery of the particle.  This function
- *     is invoked only if user specified Dispdist = 2 and
- *     the particles are no longer fitting.
+ *     Empty the template cache
  *
- *     Arguments:    Dimensions nxp,nyp,nzp of bounding box Bbox
+ *     Arguments:    None
  *     Returns:    Nothing
  *
- *    Calls:        no functions
- *    Called by:    genparticles
+ *    Calls:        No other routines
+ *    Called by:    freegenmic
  ***/
-void striplayer(int nxp, int nyp, int nzp) {
-  int i, j, k;
+void ptemplate_freeall(void) {
+  int h;
+  struct ptemplate *tp, *tnext;
 
-  for (k = 1; k < nzp; k++) {
-    for (j = 1; j < nyp; j++) {
-      for (i = 1; i < nxp; i++) {
-        if (Bbox.val[getInt3dindex(Bbox, i, j, k)] > FCHECK)
-          Bbox.val[getInt3dindex(Bbox, i, j, k)] = POROSITY;
-      }
+  for (h = 0; h < PTEMPHASH; h++) {
+    for (tp = Ptemphash[h]; tp; tp = tnext) {
+      tnext = tp->next;
+      free(tp->pix);
+      free(tp);
     }
+    Ptemphash[h] = NULL;
   }
+  Ptemppix = 0;
 
   return;
 }
@@ -1857,30 +4139,28 @@ void striplayer(int nxp, int nyp, int nzp) {
  *    Returns:
  *        Number of particles placed of last kind tried
  *
- *    Calls:        makesph, ran1
+ *    Calls:        makesph, ran1, getshapeset, getshape, shrotate
  *    Called by:    create
  ***/
 int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
-  int m, n, i, j, k, ii, jj, x, y, z, ig, tries, na, foundpart;
+  int m, n, k, x, y, z, ig, tries, na, foundpart;
   int phnow, nofit, n1, nxp, nyp, nzp, nnxp, nnyp, nnzp, partc, extpix,
-      pcount[10];
-  int numpershape, nump, done, total_particles_to_place, numchunk;
-  int klow, khigh, mp, pixfrac, numlines, numitems, toobig;
+      pcount[10], orient, ri, rj, rk, edtsite, edtdiam, edtr2;
+  int numpershape, nump, total_particles_to_place, numchunk;
+  int pixfrac, numlines, toobig;
   int absdiff, oldabsdiff, diam, darg, numpix, shapetype, dispdist;
   int cx, cy, cz;
   int jg, numpartplaced, vol;
-  float rx, ry, rz, testgyp, typegyp, frad, aa1, aa2;
-  float vol1, ratio[10], saveratio, volume, volumecalc, v1;
+  float testgyp, typegyp, frad;
+  float vol1, ratio[10], saveratio, volume, volumecalc;
   float fraction_progress = 0.10;
   float maxrx, maxry, maxrz;
   /* float length,width; */
-  double factor, theta, phi, cosbeta, sinbeta, alpha, gamma, beta, total, abc;
-  double realnum;
-  fcomplex r1, ddd, icmplx;
-  char buff[MAXSTRING], filename[MAXSTRING], scratchname[MAXSTRING];
-  char *name, *newstring;
-  struct lineitem line[MAXLINES];
-  FILE *anmfile, *geomfile, *fscratch;
+  double cosbeta, sinbeta, alpha, gamma, beta;
+  char scratchname[MAXSTRING];
+  struct shapeset *ss;
+  struct ptemplate *tp;
+  FILE *fscratch;
 
   /* Determine how many total particles should be placed */
   total_particles_to_place = 0;
@@ -1905,6 +4185,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
   x = y = z = 0;
   partc = nump = 0;
   saveratio = 0.0;
+  edtr2 = edtdiam = -1;
 
   sprintf(scratchname, "scratchaggfile.dat");
   fscratch = filehandler("genmic", scratchname, "WRITE");
@@ -1959,11 +4240,27 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
         do {
           tries++;
 
-          /* generate a random center location for the sphere */
+          /***
+           *    generate a random center location for the sphere,
+           *    from the distance map if there is one
+           ***/
+
+          darg = diam + (2 * dispdist);
+          if (Edt && darg != edtdiam) {
+            edtdiam = darg;
+            edtr2 = edtsphere(darg);
+          }
 
-          x = (int)((float)Xsyssize * ran1(Seed));
-          y = (int)((float)Ysyssize * ran1(Seed));
-          z = (int)((float)Zsyssize * ran1(Seed));
+          edtsite = (Edt && !edtdraw(edtr2, &x, &y, &z));
+          if (edtsite) {
+            /* x, y and z are drawn already */
+          } else if (Densesample && Occsolid) {
+            occdraw(&x, &y, &z);
+          } else {
+            x = (int)((float)Xsyssize * ran1(Seed));
+            y = (int)((float)Ysyssize * ran1(Seed));
+            z = (int)((float)Zsyssize * ran1(Seed));
+          }
 
           /***
            *    See if the sphere will fit at x,y,z
@@ -1971,8 +4268,9 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
            *    to ensure requested separation between spheres
            ***/
 
-          darg = diam + (2 * dispdist);
           nofit = checksphere(x, y, z, darg, Check, Npart + 1, 0);
+          if (nofit && edtsite)
+            edtmiss();
           if ((tries > MAXTRIES) && (dispdist > 0)) {
             fprintf(Logfile, "\nAble to place %d particles ", jg);
             fprintf(Logfile,
@@ -1993,7 +4291,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
             fprintf(Logfile, "\nWas working on bin %d out of %d\n", ig, numgen);
 
             warning("genmic", "Could not place a sphere");
-            fflush(Logfile);
+            log_flush(Logfile);
             return (jg);
           }
         } while (nofit);
@@ -2001,16 +4299,15 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
         /* Place the sphere at x,y,z */
 
         Npart++;
-        if (Npart > Npartc) {
+        if (growparticles(Npart)) {
           fprintf(Logfile, "Too many spheres being generated \n");
-          fprintf(Logfile, "\tUser needs to increase value of NPARTC\n");
-          fprintf(Logfile, "\tat top of C-code\n\n");
+          fprintf(Logfile, "\tCould not make room for them in memory\n\n");
           fprintf(Logfile, "\nTotal number spheres desired in this bin was %d",
                   numeach[ig]);
           fprintf(Logfile, "\nActual number _placed  in this bin was %d", jg);
           fprintf(Logfile, "\nWas working on bin %d out of %d\n", ig, numgen);
           warning("genmic", "Too many spheres");
-          fflush(Logfile);
+          log_flush(Logfile);
           return (jg);
         }
 
@@ -2020,7 +4317,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
         if (!Particle[Npart]) {
           freegenmic();
           bailout("genmic", "Memory allocation error");
-          fflush(Logfile);
+          log_flush(Logfile);
           exit(1);
         }
 
@@ -2106,6 +4403,9 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
           Particle[Npart]->partphase = phnow;
         }
 
+        edtnear(x + checkbc(x, Xsyssize), y + checkbc(y, Ysyssize),
+                z + checkbc(z, Zsyssize));
+
         /*** PUT NICK'S STUFF RIGHT HERE ***/
         fprintf(fscratch, "%d %d %d 0\n", x, y, z);
         fprintf(fscratch, "0 0 %.10f 0.0000000000\n", sizeeach[ig]);
@@ -2118,188 +4418,12 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
       if (Verbose)
         fprintf(Logfile, "\nPlacing REAL shapes now...");
 
-      sprintf(filename, "%s%s%c%s-geom.csv", Phase_shape[phnow].pathroot,
-              Phase_shape[phnow].shapeset, Filesep,
-              Phase_shape[phnow].shapeset);
-
-      geomfile = filehandler("genmic", filename, "READ");
-      if (!geomfile) {
+      ss = getshapeset(phnow);
+      if (!ss) {
         freegenmic();
         exit(1);
       }
-
-      /* Scan header and discard */
-      fread_string(geomfile, buff);
-
-      if (Verbose)
-        fprintf(Logfile, "\nReading each line of the geom file...");
-      fflush(Logfile);
-
-      i = done = 0;
-      while ((!feof(geomfile)) && (i < MAXLINES) && (done == 0)) {
-        fread_string(geomfile, buff);
-        name = strtok(buff, ",");
-        fprintf(Logfile, "\ni = %d, name = %s", i, name);
-        fflush(Logfile);
-        strcpy(line[i].name, name);
-        newstring = strtok(NULL, ",");
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].xlow = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].xhi = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].ylow = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].yhi = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].zlow = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].zhi = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].volume = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].surfarea = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].nsurfarea = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].diam = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].Itrace = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].Nnn = atoi(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].NGC = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].length = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].width = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].thickness = atof(newstring);
-          newstring = strtok(NULL, ",");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].nlength = atof(newstring);
-          newstring = strtok(NULL, ",\n");
-        } else {
-          done = 1;
-        }
-        if (newstring != NULL) {
-          fprintf(Logfile, "\ni = %d, newstring = %s", i, newstring);
-          fflush(Logfile);
-          line[i].nwidth = atof(newstring);
-        } else {
-          done = 1;
-        }
-        i++;
-
-        /* Line scanned in now */
-      }
-
-      if (Verbose)
-        fprintf(Logfile, " Done!\n");
-      fflush(Logfile);
-
-      /* All lines scanned */
-
-      numitems = i - 1;
-      numlines = numitems - 1;
-      fclose(geomfile);
+      numlines = ss->numlines;
 
       frad = sizeeach[ig]; /* radius in pixel edge lengths */
       vol = Volpart[ig];   /* target volume in pixels */
@@ -2317,12 +4441,12 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
         fprintf(Logfile,
                 "Entering main loop for size class %d, need %d of them...", ig,
                 numeach[ig]);
-      fflush(Logfile);
+      log_flush(Logfile);
       for (jg = 0; jg < numeach[ig]; jg++) {
 
         if (Verbose)
           fprintf(Logfile, "\n\t%d of %d", jg, numeach[ig]);
-        fflush(Logfile);
+        log_flush(Logfile);
 
         foundpart = 1;
         toobig = 0;
@@ -2337,7 +4461,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
 
               if (Verbose) {
                 fprintf(Logfile, "\n\tNeed to choose a new shape...");
-                fflush(Logfile);
+                log_flush(Logfile);
               }
 
               /***
@@ -2352,92 +4476,25 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
 
               n1 = (int)(numlines * ran1(Seed));
 
-              sprintf(filename, "%s%s%c%s", Phase_shape[phnow].pathroot,
-                      Phase_shape[phnow].shapeset, Filesep, line[n1].name);
-              if (Verbose)
-                fprintf(Logfile, " %s", filename);
-              fflush(Logfile);
-
-              anmfile = filehandler("genmic", filename, "READ");
-
-              if (Verbose)
-                fprintf(Logfile, " !!");
-              fflush(Logfile);
-
-              if (!anmfile) {
+              if (getshape(ss, n1, phnow, &volumecalc, &maxrx, &maxry,
+                           &maxrz)) {
                 freegenmic();
+                bailout("genmic", "Could not read particle shape");
                 exit(1);
               }
 
               if (Verbose)
-                fprintf(Logfile, "Opened %s ; size = %d\n", line[n1].name, vol);
+                fprintf(Logfile, "Opened %s ; size = %d\n",
+                        ss->line[n1].name, vol);
               fprintf(Logfile, "Using particle shape %s; size = %d\n",
-                      line[n1].name, vol);
-              fflush(Logfile);
+                      ss->line[n1].name, vol);
+              log_flush(Logfile);
 
               /***
-               *    Nnn is how many y's are to be used
-               *    in series
-               *
-               *    Read in stored coefficients for
-               *    particle of interest
-               *
                *    Compute volume and scale anm by
                *    cube root of vol/(volume of particle)
                ***/
 
-              for (n = 0; n <= Nnn; n++) {
-                for (m = n; m >= -n; m--) {
-                  fscanf(anmfile, "%d %d %f %f", &ii, &jj, &aa1, &aa2);
-                  A[n][m] = Complex(aa1, aa2);
-                }
-              }
-
-              if (Verbose)
-                fprintf(Logfile, "\nRead anms");
-              fflush(Logfile);
-              fclose(anmfile);
-
-              /***
-               *    Compute volume of real particle
-               ***/
-
-              factor = 0.5 * Pi * Pi;
-              volumecalc = 0.0;
-
-              maxrx = maxry = maxrz = 0.0;
-              for (i = 1; i <= Phase_shape[phnow].ntheta; i++) {
-                theta = 0.5 * Pi * (Phase_shape[phnow].xg[i] + 1.0);
-                for (j = 1; j <= Phase_shape[phnow].nphi; j++) {
-                  phi = Pi * (Phase_shape[phnow].xg[j] + 1.0);
-                  harm(theta, phi);
-                  r1 = Complex(0.0, 0.0);
-                  r1 = Cmul(A[0][0], Y[0][0]);
-                  for (n = 1; n <= Nnn; n++) {
-                    for (m = n; m >= -n; m--) {
-                      r1 = Cadd(r1, Cmul(A[n][m], Y[n][m]));
-                    }
-                  }
-                  rx = (r1.r * sin(theta) * cos(phi));
-                  ry = (r1.r * sin(theta) * sin(phi));
-                  rz = (r1.r * cos(theta));
-
-                  if (fabs(rx) > maxrx)
-                    maxrx = fabs(rx);
-                  if (fabs(ry) > maxry)
-                    maxry = fabs(ry);
-                  if (fabs(rz) > maxrz)
-                    maxrz = fabs(rz);
-
-                  v1 = sin(theta) / 3.0;
-                  v1 *= (r1.r * r1.r * r1.r);
-                  v1 *= (Phase_shape[phnow].wg[i] * Phase_shape[phnow].wg[j]);
-                  volumecalc += v1;
-                }
-              }
-
-              volumecalc *= factor;
-
               /* width = line[n1].width / Res; */ /* in pixels */
               /* length = line[n1].length / Res; */
 
@@ -2470,109 +4527,52 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
             alpha = 2.0 * Pi * ran1(Seed);
             gamma = 2.0 * Pi * ran1(Seed);
 
-            for (n = 0; n <= Nnn; n++) {
-              for (m = -n; m <= n; m++) {
-                AA[n][m] = Complex(0.0, 0.0);
-                for (mp = -n; mp <= n; mp++) {
-                  realnum =
-                      sqrt(fac(n + mp) * fac(n - mp) / fac(n + m) / fac(n - m));
-                  ddd = Complex(realnum, 0.0);
-                  klow = max(0, m - mp);
-                  khigh = min(n - mp, n + m);
-                  total = 0.0;
-                  for (k = klow; k <= khigh; k++) {
-                    abc = pow(-1.0, k + mp - m);
-                    abc *= (fac(n + m) / fac(k) / fac(n + m - k));
-                    abc *= (fac(n - m) / fac(n - mp - k) / fac(mp + k - m));
-                    total += abc * (pow(cosbeta, 2 * n + m - mp - 2 * k)) *
-                             (pow(sinbeta, 2 * k + mp - m));
-                  }
-                  icmplx = Complex(total * cos(mp * alpha),
-                                   total * (-sin(mp * alpha)));
-                  ddd = Cmul(ddd, icmplx);
-                  icmplx = Complex(cos(m * gamma), (-sin(m * gamma)));
-                  ddd = Cmul(ddd, icmplx);
-                  icmplx = Cmul(A[n][mp], ddd);
-                  AA[n][m] = Cadd(AA[n][m], icmplx);
-                }
-
-                AA[n][m] = RCmul(saveratio, AA[n][m]);
-              }
-            }
-
             /***
-             *    Compute volume of real particle
+             *    With the template cache, round the angles to
+             *    their bins and reuse the particle if it has been
+             *    digitized before
              ***/
 
-            factor = 0.5 * Pi * Pi;
-            volume = 0.0;
-
-            maxrx = maxry = maxrz = 0.0;
-            for (i = 1; i <= Phase_shape[phnow].ntheta; i++) {
-              theta = 0.5 * Pi * (Phase_shape[phnow].xg[i] + 1.0);
-              for (j = 1; j <= Phase_shape[phnow].nphi; j++) {
-                phi = Pi * (Phase_shape[phnow].xg[j] + 1.0);
-                harm(theta, phi);
-                r1 = Complex(0.0, 0.0);
-                r1 = Cmul(AA[0][0], Y[0][0]);
-                for (n = 1; n <= Nnn; n++) {
-                  for (m = n; m >= -n; m--) {
-                    r1 = Cadd(r1, Cmul(AA[n][m], Y[n][m]));
-                  }
-                }
-                rx = (r1.r * sin(theta) * cos(phi));
-                ry = (r1.r * sin(theta) * sin(phi));
-                rz = (r1.r * cos(theta));
-
-                if (fabs(rx) > maxrx)
-                  maxrx = fabs(rx);
-                if (fabs(ry) > maxry)
-                  maxry = fabs(ry);
-                if (fabs(rz) > maxrz)
-                  maxrz = fabs(rz);
-
-                v1 = sin(theta) / 3.0;
-                v1 *= (r1.r * r1.r * r1.r);
-                v1 *= (Phase_shape[phnow].wg[i] * Phase_shape[phnow].wg[j]);
-                volume += v1;
-              }
+            tp = NULL;
+            orient = 0;
+            if (Templatecache) {
+              orient = ptemplate_orient(&alpha, &beta, &gamma);
+              cosbeta = cos(beta / 2.0);
+              sinbeta = sin(beta / 2.0);
+              tp = ptemplate_find(ss, n1, vol, dispdist, orient);
             }
 
-            volume *= factor;
-            vol1 = volume;
+            if (tp) {
+              partc = ptemplate_stamp(tp, &nxp, &nyp, &nzp);
+              toobig = 0;
+              foundpart = 1;
+            } else {
+
+              shrotate(A, AA, Nnn, alpha, beta, gamma, saveratio);
+
+              /***
+               *    Compute volume of real particle
+               ***/
+
+              volume = shgrid_volume(&Shapegrid, AA, &maxrx, &maxry, &maxrz);
+              vol1 = volume;
 #ifdef DEBUG
-            fprintf(Logfile, "\nComputed volume = %f ", vol1);
-            fprintf(Logfile, "Tabulated = %f ", line[n1].volume);
-            fprintf(Logfile, "saveratio = %f ", saveratio);
-            fprintf(Logfile, "partc = %d", partc);
-            fflush(Logfile);
+              fprintf(Logfile, "\nComputed volume = %f ", vol1);
+              fprintf(Logfile, "Tabulated = %f ", ss->line[n1].volume);
+              fprintf(Logfile, "saveratio = %f ", saveratio);
+              fprintf(Logfile, "partc = %d", partc);
+              log_flush(Logfile);
 #endif
 
-            na = 0;
-            oldabsdiff = vol;
-            absdiff = 0;
-            pcount[0] = (int)vol1;
-            do {
-              if (na == 0) {
-                ratio[na] = saveratio;
-                pcount[na] = (int)vol1;
-              } else if (na == 1) {
-                pcount[na] = partc;
-                ratio[na] = ratio[na - 1] * pow(0.5 * ((float)pcount[na]) /
-                                                    ((float)pcount[na - 1]),
-                                                (1. / 3.));
-                for (n = 0; n <= Nnn; n++) {
-                  for (m = n; m >= -n; m--) {
-                    AA[n][m] = RCmul(ratio[na] / ratio[na - 1], AA[n][m]);
-                  }
-                }
-                maxrx *= (ratio[na] / ratio[na - 1]);
-                maxry *= (ratio[na] / ratio[na - 1]);
-                maxrz *= (ratio[na] / ratio[na - 1]);
-              } else {
-                oldabsdiff = labs(pcount[na - 2] - vol);
-                absdiff = labs(pcount[na - 1] - vol);
-                if (absdiff <= oldabsdiff) {
+              na = 0;
+              oldabsdiff = vol;
+              absdiff = 0;
+              pcount[0] = (int)vol1;
+              do {
+                if (na == 0) {
+                  ratio[na] = saveratio;
+                  pcount[na] = (int)vol1;
+                } else if (na == 1) {
                   pcount[na] = partc;
                   ratio[na] = ratio[na - 1] * pow(0.5 * ((float)pcount[na]) /
                                                       ((float)pcount[na - 1]),
@@ -2586,76 +4586,93 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
                   maxry *= (ratio[na] / ratio[na - 1]);
                   maxrz *= (ratio[na] / ratio[na - 1]);
                 } else {
-                  ratio[na] = ratio[na - 2];
-                  for (n = 0; n <= Nnn; n++) {
-                    for (m = n; m >= -n; m--) {
-                      AA[n][m] = RCmul(ratio[na] / ratio[na - 1], AA[n][m]);
+                  oldabsdiff = labs(pcount[na - 2] - vol);
+                  absdiff = labs(pcount[na - 1] - vol);
+                  if (absdiff <= oldabsdiff) {
+                    pcount[na] = partc;
+                    ratio[na] = ratio[na - 1] * pow(0.5 * ((float)pcount[na]) /
+                                                        ((float)pcount[na - 1]),
+                                                    (1. / 3.));
+                    for (n = 0; n <= Nnn; n++) {
+                      for (m = n; m >= -n; m--) {
+                        AA[n][m] = RCmul(ratio[na] / ratio[na - 1], AA[n][m]);
+                      }
                     }
+                    maxrx *= (ratio[na] / ratio[na - 1]);
+                    maxry *= (ratio[na] / ratio[na - 1]);
+                    maxrz *= (ratio[na] / ratio[na - 1]);
+                  } else {
+                    ratio[na] = ratio[na - 2];
+                    for (n = 0; n <= Nnn; n++) {
+                      for (m = n; m >= -n; m--) {
+                        AA[n][m] = RCmul(ratio[na] / ratio[na - 1], AA[n][m]);
+                      }
+                    }
+                    maxrx *= (ratio[na] / ratio[na - 1]);
+                    maxry *= (ratio[na] / ratio[na - 1]);
+                    maxrz *= (ratio[na] / ratio[na - 1]);
                   }
-                  maxrx *= (ratio[na] / ratio[na - 1]);
-                  maxry *= (ratio[na] / ratio[na - 1]);
-                  maxrz *= (ratio[na] / ratio[na - 1]);
                 }
-              }
 
 #ifdef DEBUG
-              fprintf(Logfile, "\nna = %d", na);
-              fprintf(Logfile, "\ntarget volume = %d", vol);
-              fprintf(Logfile, "\ncomputed volume = %f", vol1);
-              fprintf(Logfile, "\nratio = %f", ratio[na]);
-              fflush(Logfile);
+                fprintf(Logfile, "\nna = %d", na);
+                fprintf(Logfile, "\ntarget volume = %d", vol);
+                fprintf(Logfile, "\ncomputed volume = %f", vol1);
+                fprintf(Logfile, "\nratio = %f", ratio[na]);
+                log_flush(Logfile);
 #endif
 
-              /* Digitize the particles all over again */
-
-              /*  Estimate dimensions of bounding box */
+                /* Digitize the particles all over again */
 
-              nxp = 3 + ((int)(2.0 * maxrx));
-              nyp = 3 + ((int)(2.0 * maxry));
-              nzp = 3 + ((int)(2.0 * maxrz));
+                /*  Estimate dimensions of bounding box */
 
-              /* Make the box a little bigger if dispersion is required */
+                nxp = 3 + ((int)(2.0 * maxrx));
+                nyp = 3 + ((int)(2.0 * maxry));
+                nzp = 3 + ((int)(2.0 * maxrz));
 
-              if (dispdist > 0) {
-                nxp += dispdist + 1;
-                nyp += dispdist + 1;
-                nzp += dispdist + 1;
-              }
+                /* Make the box a little bigger if dispersion is required */
 
-              /* Do the digitization */
+                if (dispdist > 0) {
+                  nxp += dispdist + 1;
+                  nyp += dispdist + 1;
+                  nzp += dispdist + 1;
+                }
+
+                /* Do the digitization */
 
-              if ((nxp < (int)(0.8 * Xsyssize)) &&
-                  (nyp < (int)(0.8 * Ysyssize)) &&
-                  (nzp < (int)(0.8 * Zsyssize))) {
-                foundpart = 1;
-                partc = image(&nxp, &nyp, &nzp);
-                if (partc == 0) {
-                  if (Verbose)
-                    fprintf(Logfile, "\nCurrent particle too big.");
+                if ((nxp < (int)(0.8 * Xsyssize)) &&
+                    (nyp < (int)(0.8 * Ysyssize)) &&
+                    (nzp < (int)(0.8 * Zsyssize))) {
+                  foundpart = 1;
+                  partc = image(&nxp, &nyp, &nzp);
+                  if (partc == 0) {
+                    if (Verbose)
+                      fprintf(Logfile, "\nCurrent particle too big.");
+                    toobig = 1;
+                    foundpart = 0;
+                  } else {
+                    toobig = 0;
+                    foundpart = 1;
+                  }
+                } else {
                   toobig = 1;
                   foundpart = 0;
-                } else {
-                  toobig = 0;
-                  foundpart = 1;
                 }
-              } else {
-                toobig = 1;
-                foundpart = 0;
-              }
 #ifdef DEBUG
-              fprintf(Logfile, "\nAfter image function, nominal particle ");
-              fprintf(Logfile, "size %d, actual %d", vol, partc);
-              fflush(Logfile);
+                fprintf(Logfile, "\nAfter image function, nominal particle ");
+                fprintf(Logfile, "size %d, actual %d", vol, partc);
+                log_flush(Logfile);
 #endif
-              saveratio = ratio[na];
-              na++;
-            } while ((labs(partc - vol) > max(4, pixfrac)) && na < 1 &&
-                     !toobig);
+                saveratio = ratio[na];
+                na++;
+              } while ((labs(partc - vol) > max(4, pixfrac)) && na < 1 &&
+                       !toobig);
+            }
 
             if (!toobig && foundpart) {
 #ifdef DEBUG
               fprintf(Logfile, "\nDone scaling the anms");
-              fflush(Logfile);
+              log_flush(Logfile);
 #endif
 
               /***
@@ -2664,22 +4681,27 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
                *    a pixel here and there to the particle surface
                ***/
 
-              if (partc != vol) {
+              if (!tp && partc != vol) {
 #ifdef DEBUG
                 fprintf(Logfile,
                         "\nAdditional adjustment needed to match volume, partc "
                         "= %d",
                         partc);
-                fflush(Logfile);
+                log_flush(Logfile);
 #endif
                 extpix = adjustvol(vol - partc, nxp, nyp, nzp);
                 partc += extpix;
 #ifdef DEBUG
                 fprintf(Logfile, "\nAfter adjustment, partc = %d", partc);
-                fflush(Logfile);
+                log_flush(Logfile);
 #endif
               }
 
+              if (Templatecache && !tp) {
+                ptemplate_save(ss, n1, vol, dispdist, orient, nxp, nyp, nzp,
+                               partc);
+              }
+
               /***
                *    If dispersion is desired, add false layer around
                *    the particle now (will be stripped when particle
@@ -2702,7 +4724,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
 
 #ifdef DEBUG
               fprintf(Logfile, "\nSomething wrong with this particle");
-              fflush(Logfile);
+              log_flush(Logfile);
 #endif
               foundpart = 0;
             }
@@ -2723,6 +4745,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
         } while (!foundpart || toobig);
 
         tries = 0;
+        edtr2 = edtdiam = -1;
 
         /* Stop after MAXTRIES random tries */
 
@@ -2732,12 +4755,40 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
 
           /***
            *    Generate a random location for the lower
-           *    corner of the bounding box on the particle
+           *    corner of the bounding box on the particle.
+           *    With dense sampling, the solid voxel at the
+           *    middle of the box is put in a block that is
+           *    not full and the corner follows from it.
            ***/
 
-          x = (int)((float)Xsyssize * ran1(Seed));
-          y = (int)((float)Ysyssize * ran1(Seed));
-          z = (int)((float)Zsyssize * ran1(Seed));
+          edtsite = 0;
+          if (Edt && bboxcenter(nnxp, nnyp, nnzp, &ri, &rj, &rk)) {
+            if (edtr2 < 0)
+              edtr2 = edtpart(nnxp, nnyp, nnzp, ri, rj, rk);
+            edtsite = !edtdraw(edtr2, &x, &y, &z);
+          }
+
+          if (edtsite) {
+            x -= ri;
+            x += (x < 0) ? Xsyssize : 0;
+            y -= rj;
+            y += (y < 0) ? Ysyssize : 0;
+            z -= rk;
+            z += (z < 0) ? Zsyssize : 0;
+          } else if (Densesample && Occsolid &&
+                     bboxcenter(nnxp, nnyp, nnzp, &ri, &rj, &rk)) {
+            occdraw(&x, &y, &z);
+            x -= ri;
+            x += (x < 0) ? Xsyssize : 0;
+            y -= rj;
+            y += (y < 0) ? Ysyssize : 0;
+            z -= rk;
+            z += (z < 0) ? Zsyssize : 0;
+          } else {
+            x = (int)((float)Xsyssize * ran1(Seed));
+            y = (int)((float)Ysyssize * ran1(Seed));
+            z = (int)((float)Zsyssize * ran1(Seed));
+          }
 
           /*
           x = (int)(0.5*((float)(Xsyssize - nnxp)));
@@ -2757,16 +4808,19 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
           fprintf(Logfile, "\n\tnnxp = %d nnyp = %d nnzp = %d", nnxp, nnyp,
                   nnzp);
           fprintf(Logfile, "\n\tvol = %d", vol);
-          fflush(Logfile);
+          log_flush(Logfile);
 #endif
 
           nofit =
               checkpart(x, y, z, nnxp, nnyp, nnzp, vol, Npart + 1, 0, Check);
+          if (nofit && edtsite)
+            edtmiss();
 
           if ((tries > MAXTRIES) && (dispdist > 0)) {
             tries = 0;
             dispdist--;
             striplayer(nnxp, nnyp, nnzp);
+            edtr2 = -1;
           }
 
           if (tries > MAXTRIES) {
@@ -2778,7 +4832,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
             fprintf(Logfile, "\nActual number _placed  in this bin was %d", jg);
             fprintf(Logfile, "\nWas working on bin %d out of %d\n", ig, numgen);
             warning("genmic", "Could not place a particle");
-            fflush(Logfile);
+            log_flush(Logfile);
             return (jg);
           }
 
@@ -2790,17 +4844,16 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
          ***/
 
         Npart++;
-        if (Npart > Npartc) {
+        if (growparticles(Npart)) {
           fprintf(Logfile, "Too many particles being generated \n");
-          fprintf(Logfile, "\tUser needs to increase value of NPARTC\n");
-          fprintf(Logfile, "\tat top of C-code\n\n");
+          fprintf(Logfile, "\tCould not make room for them in memory\n\n");
           fprintf(Logfile,
                   "\nNumber real-shape particles desired in this bin was %d",
                   numeach[ig]);
           fprintf(Logfile, "\nActual number _placed  in this bin was %d", jg);
           fprintf(Logfile, "\nWas working on bin %d out of %d\n", ig, numgen);
           warning("genmic", "Too many particles");
-          fflush(Logfile);
+          log_flush(Logfile);
           return (jg);
         }
 
@@ -2810,7 +4863,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
         if (!Particle[Npart]) {
           freegenmic();
           bailout("genmic", "Memory allocation error");
-          fflush(Logfile);
+          log_flush(Logfile);
           exit(1);
         }
         Particle[Npart]->partid = Npart;
@@ -2855,7 +4908,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
             fprintf(Logfile, "\n\tnnxp = %d nnyp = %d nnzp = %d", nnxp, nnyp,
                     nnzp);
             fprintf(Logfile, "\n\tvol = %d", vol);
-            fflush(Logfile);
+            log_flush(Logfile);
 #endif
             nump = checkpart(x, y, z, nnxp, nnyp, nnzp, vol, Npart + 1, C3S,
                              Place);
@@ -2881,7 +4934,7 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
               fprintf(Logfile, "\n\tnnxp = %d nnyp = %d nnzp = %d", nnxp, nnyp,
                       nnzp);
               fprintf(Logfile, "\n\tvol = %d", vol);
-              fflush(Logfile);
+              log_flush(Logfile);
 #endif
               nump = checkpart(x, y, z, nnxp, nnyp, nnzp, vol, Npart + 1,
                                ANHYDRITE, Place);
@@ -2952,6 +5005,9 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
         if (cz < 0)
           cz += Zsyssize;
 
+        if (bboxcenter(nnxp, nnyp, nnzp, &ri, &rj, &rk))
+          edtnear(cx, cy, cz);
+
         fprintf(fscratch, "%d %d %d %d\n", cx, cy, cz, (int)Nnn);
         for (n = 0; n <= Nnn; n++) {
           for (m = n; m >= -n; m--) {
@@ -2983,13 +5039,13 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
     for (kkk = 0; kkk < Zsyssize; ++kkk) {
         for (jjj = 0; jjj < Ysyssize; ++jjj) {
             for (iii = 0; iii < Xsyssize; ++iii) {
-                if (Cemreal.val[getInt3dindex(Cemreal,iii,jjj,kkk)] == phnow)
+                if (Cemreal.val[getUChar3dindex(Cemreal,iii,jjj,kkk)] == phnow)
     totpix++;
             }
         }
     }
    fprintf(Logfile,"... Total pixels of %d is now %d\n",phnow,totpix);
-    fflush(Logfile);
+    log_flush(Logfile);
     */
   }
 
@@ -3005,13 +5061,17 @@ int genparticles(int numgen, int *numeach, float *sizeeach, int *pheach) {
  *    Routine to place one-voxel particles of various sizes and phases at random
  *    locations in 3-D microstructure.
  *
+ *    With Densesample set, the sites are drawn from a list of the
+ *    pore voxels, and sites without room are dropped from it, so
+ *    the cost does not grow as the porosity fills up.
+ *
  *     Arguments:
  *        int numeach holds the number of particles to add
  *        int pheach holds the phase of each size class
  *    Returns:
  *        Number of particles placed of last kind tried
  *
- *    Calls:        makesph, ran1
+ *    Calls:        makesph, ran1, onevoxsites, onevoxdraw
  *    Called by:    create
  ***/
 int genonevoxparticles(int numeach, int pheach) {
@@ -3036,6 +5096,8 @@ int genonevoxparticles(int numeach, int pheach) {
   char *name, *newstring;
   struct lineitem line[MAXLINES];
   FILE *anmfile, *geomfile;
+  int *site = NULL;
+  int nsite = 0;
 
   nnxp = nnyp = nnzp = n1 = 0;
   x = y = z = 0;
@@ -3051,66 +5113,109 @@ int genonevoxparticles(int numeach, int pheach) {
   diam = 1;
   numpix = 1;
 
+  if (Densesample && (numeach > 0)) {
+    site = (int *)malloc((size_t)Xsyssize * (size_t)Ysyssize *
+                         (size_t)Zsyssize * sizeof(int));
+    if (!site) {
+      fprintf(Logfile, "\nWARNING: No room for a list of pore sites;");
+      fprintf(Logfile, " placing pixels by random trial instead");
+    } else {
+      nsite = onevoxsites(site);
+    }
+  }
+
   /* loop for each sphere in this size class */
 
   for (jg = 0; jg < numeach; jg++) {
 
-    tries = 0;
-
-    /* Stop after MAXTRIES random tries */
-    do {
-      tries++;
-
-      /* generate a random center location for the sphere */
-
-      x = (int)((float)Xsyssize * ran1(Seed));
-      y = (int)((float)Ysyssize * ran1(Seed));
-      z = (int)((float)Zsyssize * ran1(Seed));
+    if (site) {
 
       /***
-       *    See if the sphere will fit at x,y,z
-       *    Include dispersion distance when checking
-       *    to ensure requested separation between spheres
+       *    Draw from the pore sites that are left.  When none
+       *    will take the particle, shrink the dispersion distance
+       *    and list the pore sites again
        ***/
 
-      darg = diam + (2 * dispdist);
-      nofit = checksphere(x, y, z, darg, Check, Npart + 1, 0);
-      if ((tries > MAXTRIES) && (dispdist > 0)) {
+      while (onevoxdraw(site, &nsite, diam + (2 * dispdist), &x, &y, &z)) {
+        if (dispdist == 0) {
+          fprintf(Logfile, "Could not place sphere %d\n", Npart);
+          fprintf(Logfile, "\tafter drawing every pore site\n\n");
+          fprintf(Logfile,
+                  "\nTotal number spheres desired in this bin was %d",
+                  numeach);
+          fprintf(Logfile, "\nActual number _placed  in this bin was %d", jg);
+
+          warning("genmic", "Could not place a one-voxel particle");
+          log_flush(Logfile);
+          free(site);
+          return (jg);
+        }
         fprintf(Logfile, "\nAble to place %d particles ", jg);
         fprintf(Logfile,
                 "out of %d needed before reducing dispersion distance ",
                 numeach);
-        tries = 0;
         dispdist--;
         fprintf(Logfile, "to %d\n", dispdist);
+        nsite = onevoxsites(site);
       }
+    } else {
+      tries = 0;
 
-      if (tries > MAXTRIES) {
-        fprintf(Logfile, "Could not place sphere %d\n", Npart);
-        fprintf(Logfile, "\tafter %d random attempts\n\n", MAXTRIES);
-        fprintf(Logfile, "\nTotal number spheres desired in this bin was %d",
-                numeach);
-        fprintf(Logfile, "\nActual number _placed  in this bin was %d", jg);
+      /* Stop after MAXTRIES random tries */
+      do {
+        tries++;
 
-        warning("genmic", "Could not place a one-voxel particle");
-        fflush(Logfile);
-        return (jg);
-      }
-    } while (nofit);
+        /* generate a random center location for the sphere */
+
+        x = (int)((float)Xsyssize * ran1(Seed));
+        y = (int)((float)Ysyssize * ran1(Seed));
+        z = (int)((float)Zsyssize * ran1(Seed));
+
+        /***
+         *    See if the sphere will fit at x,y,z
+         *    Include dispersion distance when checking
+         *    to ensure requested separation between spheres
+         ***/
+
+        darg = diam + (2 * dispdist);
+        nofit = checksphere(x, y, z, darg, Check, Npart + 1, 0);
+        if ((tries > MAXTRIES) && (dispdist > 0)) {
+          fprintf(Logfile, "\nAble to place %d particles ", jg);
+          fprintf(Logfile,
+                  "out of %d needed before reducing dispersion distance ",
+                  numeach);
+          tries = 0;
+          dispdist--;
+          fprintf(Logfile, "to %d\n", dispdist);
+        }
+
+        if (tries > MAXTRIES) {
+          fprintf(Logfile, "Could not place sphere %d\n", Npart);
+          fprintf(Logfile, "\tafter %d random attempts\n\n", MAXTRIES);
+          fprintf(Logfile, "\nTotal number spheres desired in this bin was %d",
+                  numeach);
+          fprintf(Logfile, "\nActual number _placed  in this bin was %d", jg);
+
+          warning("genmic", "Could not place a one-voxel particle");
+          log_flush(Logfile);
+          return (jg);
+        }
+      } while (nofit);
+    }
 
     /* Place the voxel at x,y,z */
 
     Npart++;
-    if (Npart > Npartc) {
+    if (growparticles(Npart)) {
       fprintf(Logfile, "Too many one-voxel particles being generated \n");
-      fprintf(Logfile, "\tUser needs to increase value of NPARTC\n");
-      fprintf(Logfile, "\tat top of C-code\n\n");
+      fprintf(Logfile, "\tCould not make room for them in memory\n\n");
       fprintf(Logfile,
               "\nTotal number one-voxel particles desired in this bin was %d",
               numeach);
       fprintf(Logfile, "\nActual number _placed  in this bin was %d", jg);
       warning("genmic", "Too many one-voxel particles");
-      fflush(Logfile);
+      log_flush(Logfile);
+      free(site);
       return (jg);
     }
 
@@ -3120,7 +5225,7 @@ int genonevoxparticles(int numeach, int pheach) {
     if (!Particle[Npart]) {
       freegenmic();
       bailout("genmic", "Memory allocation error");
-      fflush(Logfile);
+      log_flush(Logfile);
       exit(1);
     }
 
@@ -3206,9 +5311,82 @@ int genonevoxparticles(int numeach, int pheach) {
     }
   }
 
+  free(site);
+
   return (jg);
 }
 
+/***
+ *    onevoxsites
+ *
+ *    List the pore voxels, which are the only possible centers
+ *    of a one-voxel particle
+ *
+ *     Arguments:
+ *        int pointer to room for Xsyssize*Ysyssize*Zsyssize
+ *        indices in getInt3dindex order
+ *    Returns:
+ *        Number of pore voxels listed
+ *
+ *    Calls:        No other routines
+ *    Called by:    genonevoxparticles
+ ***/
+int onevoxsites(int *site) {
+  int nsite;
+  size_t n, nvox;
+
+  nvox = (size_t)Xsyssize * (size_t)Ysyssize * (size_t)Zsyssize;
+  nsite = 0;
+  for (n = 0; n < nvox; n++) {
+    if (Cemreal.val[n] == POROSITY)
+      site[nsite++] = (int)n;
+  }
+
+  return (nsite);
+}
+
+/***
+ *    onevoxdraw
+ *
+ *    Draw sites at random from a list made by onevoxsites until
+ *    one has room for a sphere of diameter darg.  Every site
+ *    drawn is dropped from the list: one that fits is about to
+ *    be filled, and one that does not fit will not fit later
+ *    either, because placing particles only takes away porosity.
+ *
+ *     Arguments:
+ *        int pointer to the list, and to its length
+ *        int diameter to check, including the dispersion distance
+ *        int pointers to the site found (x,y,z)
+ *    Returns:
+ *        0 if a site was found, 1 if the list ran out
+ *
+ *    Calls:        ran1, checksphere
+ *    Called by:    genonevoxparticles
+ ***/
+int onevoxdraw(int *site, int *nsite, int darg, int *x, int *y, int *z) {
+  int k, nofit;
+
+  while (*nsite > 0) {
+    k = (int)((double)(*nsite) * ran1(Seed));
+    if (k >= *nsite)
+      k = *nsite - 1;
+
+    /* getInt3dindex order: x varies fastest, then y, then z */
+
+    *x = site[k] % Xsyssize;
+    *y = (site[k] / Xsyssize) % Ysyssize;
+    *z = site[k] / (Xsyssize * Ysyssize);
+    nofit = checksphere(*x, *y, *z, darg, Check, Npart + 1, 0);
+
+    site[k] = site[--(*nsite)];
+    if (!nofit)
+      return (0);
+  }
+
+  return (1);
+}
+
 /***
  *    create
  *
@@ -3261,7 +5439,7 @@ void create(void) {
 
   fprintf(Logfile,
           "Add all SPHERES (0), all REAL-SHAPE (1), or MIXED (2)  particles? ");
-  read_string(instring, sizeof(instring));
+  getinput("Shape", instring, sizeof(instring));
   Shape = atoi(instring);
   fprintf(Logfile, "%d\n", Shape);
 
@@ -3289,7 +5467,7 @@ void create(void) {
 
     fprintf(Logfile, "Where is the default shape database directory? ");
     fprintf(Logfile, "\n(Include final separator in path) ");
-    read_string(buff, sizeof(buff));
+    getinput("Shape_path", buff, sizeof(buff));
     Filesep = buff[strlen(buff) - 1];
     if (Filesep != '/' && Filesep != '\\') {
       fprintf(Logfile, "\nNo final file separator detected.  Using /");
@@ -3300,7 +5478,7 @@ void create(void) {
     fprintf(Logfile,
             "Take cement shapes from what data set in this directory? ");
     fprintf(Logfile, "\n(No file separator at beginning or end)");
-    read_string(Shapeset, sizeof(Shapeset));
+    getinput("Shape_set", Shapeset, sizeof(Shapeset));
     fprintf(Logfile, "%s\n", Shapeset);
     if ((Shapeset[strlen(Shapeset) - 1] == '/') ||
         (Shapeset[strlen(Shapeset) - 1] == '\\')) {
@@ -3394,28 +5572,28 @@ void create(void) {
   }
 
   fprintf(Logfile, "Enter the binder SOLID volume fraction: ");
-  read_string(instring, sizeof(instring));
+  getinput("Binder_solid_fraction", instring, sizeof(instring));
   binder_vfrac = atof(instring);
   fprintf(Logfile, "\n%f\n", binder_vfrac);
   fprintf(Logfile, "Enter the binder WATER volume fraction: ");
-  read_string(instring, sizeof(instring));
+  getinput("Binder_water_fraction", instring, sizeof(instring));
   water_vfrac = atof(instring);
   fprintf(Logfile, "\n%f\n", water_vfrac);
 
   binder_vfrac = (binder_vfrac) / (binder_vfrac + water_vfrac);
 
   fprintf(Logfile, "Enter number of solid binder phases to add: ");
-  read_string(instring, sizeof(instring));
+  getinput("Number_of_phases", instring, sizeof(instring));
   num_phases_to_add = atoi(instring);
   fprintf(Logfile, "\n%d\n", num_phases_to_add);
   for (k = 0; k < num_phases_to_add; k++) {
     fprintf(Logfile, "Enter phase id to add: ");
-    read_string(instring, sizeof(instring));
+    getinput("Phase", instring, sizeof(instring));
     phase_id = atoi(instring);
     fprintf(Logfile, "\n%d\n", phase_id);
     fprintf(Logfile,
             "Enter volume fraction of this phase (total BINDER SOLID basis): ");
-    read_string(instring, sizeof(instring));
+    getinput("Phase_fraction", instring, sizeof(instring));
     Vol_frac[phase_id] = atof(instring);
     fprintf(Logfile, "\n%f\n", Vol_frac[phase_id]);
 
@@ -3428,7 +5606,7 @@ void create(void) {
     fprintf(
         Logfile,
         "Enter number of size classes for this phase (max is %d): ", NUMSIZES);
-    read_string(instring, sizeof(instring));
+    getinput("Number_of_sizes", instring, sizeof(instring));
     Size_classes[phase_id] = atoi(instring);
     if (Size_classes[phase_id] >= NUMSIZES) {
       fprintf(stderr,
@@ -3445,7 +5623,7 @@ void create(void) {
               "Enter diameter of size class %d in micrometers (integer values "
               "only): ",
               j);
-      read_string(instring, sizeof(instring));
+      getinput("Diameter", instring, sizeof(instring));
       Dinput[phase_id][j] = atof(instring);
       fprintf(Logfile, "\n%d\n", (int)(Dinput[phase_id][j]));
       /* Convert diameter to pixel units */
@@ -3455,7 +5633,7 @@ void create(void) {
       fprintf(Logfile,
               "Enter volume fraction of phase %d particles in size class %d: ",
               phase_id, j);
-      read_string(instring, sizeof(instring));
+      getinput("Size_fraction", instring, sizeof(instring));
       Pdf[phase_id][j] = atof(instring);
       fprintf(Logfile, "\n%f\n", Pdf[phase_id][j]);
     }
@@ -3473,18 +5651,18 @@ void create(void) {
     } else if (Shape != SPHERES) {
       /* Some particles are real shape here */
       fprintf(Logfile, "Spheres (0) or Real shapes (1)? ");
-      read_string(instring, sizeof(instring));
+      getinput("Phase_shape", instring, sizeof(instring));
       shapevar = atoi(instring);
       if (shapevar == REALSHAPE) {
         Phase_shape[phase_id].shapetype = REALSHAPE;
         fprintf(Logfile, "What is the shape path? ");
-        read_string(buff, sizeof(buff));
+        getinput("Phase_shape_path", buff, sizeof(buff));
         Filesep = buff[strlen(buff) - 1];
         fprintf(Logfile, "%s\n", buff);
         strcpy(Phase_shape[phase_id].pathroot, buff);
         fprintf(Logfile,
                 "Take cement shapes from what data set in this directory? ");
-        read_string(buff1, sizeof(buff1));
+        getinput("Phase_shape_set", buff1, sizeof(buff1));
         fprintf(Logfile, "%s\n", buff1);
         strcpy(Phase_shape[phase_id].shapeset, buff1);
       }
@@ -3615,7 +5793,7 @@ void create(void) {
    fprintf(Logfile,"\n***************************************************************\n");
     */
 
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   /*  All phases are done, except possibly the fine portion of the aggregate
@@ -3630,7 +5808,7 @@ void create(void) {
             target_phase_vox);
     fprintf(Logfile, "Number of size classes for INERTAGG phase is %d\n",
             Size_classes[INERTAGG]);
-    fflush(Logfile);
+    log_flush(Logfile);
 
     if (Shape == REALSHAPE) {
       /* All particles are real shape */
@@ -3803,7 +5981,7 @@ void create(void) {
   fprintf(Logfile, "Enter dispersion factor (separation distance ");
   fprintf(Logfile, "in pixels) for spheres (0-2)\n");
   fprintf(Logfile, "0 corresponds to totally random placement\n");
-  read_string(instring, sizeof(instring));
+  getinput("Dispersion", instring, sizeof(instring));
   Dispdist = atoi(instring);
   fprintf(Logfile, "%d \n", Dispdist);
   if ((Dispdist < 0) || (Dispdist > 2)) {
@@ -3814,7 +5992,7 @@ void create(void) {
 
   fprintf(Logfile, "Enter probability for gypsum particles ");
   fprintf(Logfile, "on a random particle basis (0.0-1.0) \n");
-  read_string(instring, sizeof(instring));
+  getinput("Gypsum_probability", instring, sizeof(instring));
   Probgyp = atof(instring);
   fprintf(Logfile, "%f \n", Probgyp);
   if ((Probgyp < -TINY) || (Probgyp > 1.0 + TINY)) {
@@ -3825,12 +6003,12 @@ void create(void) {
 
   fprintf(Logfile,
           "Enter probability for hemihydrate form of gypsum (0.0-1.0)\n");
-  read_string(instring, sizeof(instring));
+  getinput("Hemihydrate_probability", instring, sizeof(instring));
   Probhem = atof(instring);
   fprintf(Logfile, "%f\n", Probhem);
   fprintf(Logfile,
           "Enter probability for anhydrite form of gypsum (0.0-1.0)\n");
-  read_string(instring, sizeof(instring));
+  getinput("Anhydrite_probability", instring, sizeof(instring));
   Probanh = atof(instring);
   fprintf(Logfile, "%f\n", Probanh);
   if ((Probhem < -TINY) || (Probhem > 1.0 + TINY) || (Probanh < -TINY) ||
@@ -3867,7 +6045,7 @@ void create(void) {
         fprintf(Logfile, "Phase of these particles is %d \n", phase[ip]);
         fprintf(Logfile, "Calculated number of these particles is %d\n",
                 num[ip]);
-        fflush(Logfile);
+        log_flush(Logfile);
       }
       Volpart[ip] = diam2vol(diam[ip]);
 
@@ -3893,7 +6071,7 @@ void create(void) {
       fprintf(Logfile, "\nTarget_sulfate = %d", Target_sulfate);
       fprintf(Logfile, "\nTarget_anhydrite = %d", Target_anhydrite);
       fprintf(Logfile, "\nTarget_hemi = %d", Target_hemi);
-      fflush(Logfile);
+      log_flush(Logfile);
     }
 
     /***
@@ -3902,14 +6080,25 @@ void create(void) {
 
     if (Verbose) {
       fprintf(Logfile, "\nGoing into genparticles now...");
-      fflush(Logfile);
+      log_flush(Logfile);
+    }
+
+    if (occbuild()) {
+      fprintf(Logfile, "\nWARNING: No room for the occupancy grid; placing "
+                       "particles without it");
+    }
+    if (Edtplace && edtbuild()) {
+      fprintf(Logfile, "\nWARNING: No room for the distance map; placing "
+                       "particles without it");
     }
 
     /* We don't need the return value in this case */
     nplaced = genparticles(numsize, num, frad, phase);
+    occfree();
+    edtfree();
     if (Verbose) {
       fprintf(Logfile, "\nBack Out of genparticles now...");
-      fflush(Logfile);
+      log_flush(Logfile);
     }
 
     /*** Sanity check on pore voxels ***/
@@ -3918,7 +6107,7 @@ void create(void) {
     for (kkk = 0; kkk < Zsyssize; ++kkk) {
         for (jjj = 0; jjj < Ysyssize; ++jjj) {
             for (iii = 0; iii < Xsyssize; ++iii) {
-                if (Cemreal.val[getInt3dindex(Cemreal,iii,jjj,kkk)] == 0)
+                if (Cemreal.val[getUChar3dindex(Cemreal,iii,jjj,kkk)] == 0)
     totpix++;
             }
         }
@@ -3942,6 +6131,164 @@ void create(void) {
   return;
 }
 
+/***
+ *    flocsurf
+ *
+ *    Make the surface lists used during flocculation.  Every
+ *    particle is drawn first, with its ID and phase.  For each
+ *    particle and each of the six directions of movement, list the
+ *    pixels whose neighbor in that direction is not part of the
+ *    same particle.  Only those pixels can run into something when
+ *    the particle moves that way, and they are also the ones to
+ *    erase when it moves the opposite way.  A particle keeps its
+ *    shape as it moves, so the lists are made once.  The Cement
+ *    image, in which every pixel of a particle holds its ID, tells
+ *    which neighbors belong to the particle.
+ *
+ *    The pixel lists of the particles are left where they are
+ *    until flocfree; until then Flocoff holds how far each
+ *    particle has moved.
+ *
+ *     Arguments:    None
+ *     Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        drawfloc, checkbc, flocfree
+ *    Called by:    makefloc
+ ***/
+int flocsurf(void) {
+  int ipart, i, k, n, pid, cap, maxpix, xp, yp, zp;
+  int *grow;
+  unsigned char *mask;
+  struct particle *partpoint;
+
+  Flocbeg = ivector(6 * (Npart + 1));
+  Flocnum = ivector(6 * (Npart + 1));
+  Flocoff = ivector(3 * (Npart + 1));
+  if (!Flocbeg || !Flocnum || !Flocoff) {
+    flocfree();
+    return (1);
+  }
+  for (i = 0; i < 6 * (Npart + 1); i++) {
+    Flocbeg[i] = Flocnum[i] = 0;
+  }
+  for (i = 0; i < 3 * (Npart + 1); i++) {
+    Flocoff[i] = 0;
+  }
+
+  /* Draw every particle once, so each of its pixels holds its ID */
+
+  n = maxpix = 0;
+  for (ipart = 1; ipart <= Npart; ipart++) {
+    for (partpoint = Particle[ipart]; partpoint != NULL;
+         partpoint = partpoint->nextpart) {
+      drawfloc(partpoint, Draw, -1);
+      n += partpoint->numpix;
+      maxpix = max(maxpix, partpoint->numpix);
+    }
+  }
+
+  /* Start with room for one surface pixel per pixel */
+
+  cap = max(n, 1);
+  Flocsurf = ivector(cap);
+  mask = (unsigned char *)malloc(max(maxpix, 1) * sizeof(unsigned char));
+  if (!Flocsurf || !mask) {
+    free(mask);
+    flocfree();
+    return (1);
+  }
+
+  n = 0;
+  for (ipart = 1; ipart <= Npart; ipart++) {
+    for (partpoint = Particle[ipart]; partpoint != NULL;
+         partpoint = partpoint->nextpart) {
+      pid = partpoint->partid;
+
+      /* Mark the directions in which each pixel is on the surface */
+
+      for (i = 0; i < partpoint->numpix; i++) {
+        mask[i] = 0;
+        for (k = 0; k < 6; k++) {
+          xp = partpoint->xi[i] + Flocstep[k][0];
+          yp = partpoint->yi[i] + Flocstep[k][1];
+          zp = partpoint->zi[i] + Flocstep[k][2];
+          xp += checkbc(xp, Xsyssize);
+          yp += checkbc(yp, Ysyssize);
+          zp += checkbc(zp, Zsyssize);
+          if (Cement.val[getInt3dindex(Cement, xp, yp, zp)] != pid + 1)
+            mask[i] |= (1 << k);
+        }
+      }
+
+      for (k = 0; k < 6; k++) {
+        Flocbeg[6 * pid + k] = n;
+        for (i = 0; i < partpoint->numpix; i++) {
+          if (mask[i] & (1 << k)) {
+            if (n == cap) {
+              grow = (int *)realloc(Flocsurf, 2 * (size_t)cap * sizeof(int));
+              if (!grow) {
+                free(mask);
+                flocfree();
+                return (1);
+              }
+              Flocsurf = grow;
+              cap *= 2;
+            }
+            Flocsurf[n++] = i;
+          }
+        }
+        Flocnum[6 * pid + k] = n - Flocbeg[6 * pid + k];
+      }
+    }
+  }
+
+  free(mask);
+
+  return (0);
+}
+
+/***
+ *    flocfree
+ *
+ *    Move the pixel lists of the particles to where the particles
+ *    now are, and free the surface lists
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        free_ivector
+ *    Called by:    flocsurf, makefloc
+ ***/
+void flocfree(void) {
+  int ipart, i, *off;
+  struct particle *partpoint;
+
+  if (Flocoff) {
+    for (ipart = 1; ipart <= Npart; ipart++) {
+      for (partpoint = Particle[ipart]; partpoint != NULL;
+           partpoint = partpoint->nextpart) {
+        off = Flocoff + 3 * partpoint->partid;
+        for (i = 0; i < partpoint->numpix; i++) {
+          partpoint->xi[i] = FLOCWRAP(partpoint->xi[i] + off[0], Xsyssize);
+          partpoint->yi[i] = FLOCWRAP(partpoint->yi[i] + off[1], Ysyssize);
+          partpoint->zi[i] = FLOCWRAP(partpoint->zi[i] + off[2], Zsyssize);
+        }
+      }
+    }
+    free_ivector(Flocoff);
+  }
+  if (Flocbeg)
+    free_ivector(Flocbeg);
+  if (Flocnum)
+    free_ivector(Flocnum);
+  if (Flocsurf)
+    free_ivector(Flocsurf);
+
+  Flocoff = Flocbeg = Flocnum = Flocsurf = NULL;
+
+  return;
+}
+
 /***
  *    drawfloc
  *
@@ -3950,33 +6297,40 @@ void create(void) {
  *     Arguments:
  *        struct particle *partpoint is the pointer to this particle structure
  *        const int mode is set to Erase or Draw
+ *        int dir is the direction whose surface list to draw, or -1
+ *            to draw every pixel of the particle
  *
- *     Returns:    integer flag telling whether sphere will fit
+ *     Returns:    Nothing
  *
  *    Calls:        No other routines
  *    Called by:    makefloc
  ***/
-void drawfloc(struct particle *partpoint, const int mode) {
-  int xp, yp, zp, i;
+void drawfloc(struct particle *partpoint, const int mode, int dir) {
+  int xp, yp, zp, i, j, n;
   int pid, phid;
-  char strmode[10];
+  int *list, *off;
 
   pid = phid = POROSITY;
-  sprintf(strmode, "Erasing");
   if (mode == Draw) {
-    sprintf(strmode, "Drawing");
     pid = partpoint->partid + 1;
     phid = partpoint->partphase;
   }
 
-  /* Check all pixels belonging to the particle */
+  off = Flocoff + 3 * partpoint->partid;
+  list = NULL;
+  n = partpoint->numpix;
+  if (dir >= 0) {
+    list = Flocsurf + Flocbeg[6 * partpoint->partid + dir];
+    n = Flocnum[6 * partpoint->partid + dir];
+  }
 
-  for (i = 0; i < partpoint->numpix; i++) {
-    xp = partpoint->xi[i];
-    yp = partpoint->yi[i];
-    zp = partpoint->zi[i];
+  for (i = 0; i < n; i++) {
+    j = list ? list[i] : i;
+    xp = FLOCWRAP(partpoint->xi[j] + off[0], Xsyssize);
+    yp = FLOCWRAP(partpoint->yi[j] + off[1], Ysyssize);
+    zp = FLOCWRAP(partpoint->zi[j] + off[2], Zsyssize);
     Cement.val[getInt3dindex(Cement, xp, yp, zp)] = pid;
-    Cemreal.val[getInt3dindex(Cemreal, xp, yp, zp)] = phid;
+    setphase(getUChar3dindex(Cemreal, xp, yp, zp), phid);
   }
   return;
 }
@@ -3984,30 +6338,46 @@ void drawfloc(struct particle *partpoint, const int mode) {
 /***
  *    checkfloc
  *
- *    Routine to check spherical particle placement during flocculation
+ *    Routine to check particle placement during flocculation.
+ *    The floc being moved is left drawn, so a pixel of any
+ *    particle in it counts as empty.  Only the surface pixels
+ *    facing the direction of movement are checked, unless there
+ *    is a wall, which is tested at every pixel.
  *
  *     Arguments:
  *        struct particle *partpoint points to the current particle structure
- *        int dx,dy,dz is the direction of movement of this particle
+ *        int dir is the direction of movement of this particle
+ *        int *index gives the floc of each particle
+ *        int ipart is the floc being moved
  *
  *     Returns:    int flag indicating if placement is possible
  *
- *    Calls:        No other routines
+ *    Calls:        checkbc
  *    Called by:    makefloc
  ***/
-int checkfloc(struct particle *partpoint, int dx, int dy, int dz) {
-  int blocked_by, xp, yp, zp, i, xmark;
+int checkfloc(struct particle *partpoint, int dir, int *index, int ipart) {
+  int blocked_by, xp, yp, zp, i, j, n, xmark, hit;
+  int *list, *off;
 
   blocked_by = 0; /* Flag indicating if placement is possible */
 
-  /* Check all pixels belonging to the particle */
+  off = Flocoff + 3 * partpoint->partid;
+  list = NULL;
+  n = partpoint->numpix;
+  if (!Simwall) {
+    list = Flocsurf + Flocbeg[6 * partpoint->partid + dir];
+    n = Flocnum[6 * partpoint->partid + dir];
+  }
+
+  /* Check the pixels belonging to the particle */
 
-  xmark = partpoint->xi[0] + dx;
-  for (i = 0; (i < partpoint->numpix) && (!blocked_by); i++) {
+  xmark = FLOCWRAP(partpoint->xi[0] + off[0], Xsyssize) + Flocstep[dir][0];
+  for (i = 0; (i < n) && (!blocked_by); i++) {
 
-    xp = partpoint->xi[i] + dx;
-    yp = partpoint->yi[i] + dy;
-    zp = partpoint->zi[i] + dz;
+    j = list ? list[i] : i;
+    xp = partpoint->xi[j] + off[0] + Flocstep[dir][0];
+    yp = partpoint->yi[j] + off[1] + Flocstep[dir][1];
+    zp = partpoint->zi[j] + off[2] + Flocstep[dir][2];
     xp += checkbc(xp, Xsyssize);
     yp += checkbc(yp, Ysyssize);
     zp += checkbc(zp, Zsyssize);
@@ -4017,12 +6387,14 @@ int checkfloc(struct particle *partpoint, int dx, int dy, int dz) {
     if ((Simwall) && ((xmark - Wallpos) * (xp - Wallpos)))
       blocked_by = ((int)TMPAGGID);
 
-    if ((Cement.val[getInt3dindex(Cement, xp, yp, zp)] > POROSITY) &&
-        (!blocked_by)) {
+    hit = Cement.val[getInt3dindex(Cement, xp, yp, zp)];
+    if ((hit > POROSITY) && (!blocked_by)) {
 
-      /* Particle hit; record its ID */
+      /* Particle hit; record its ID unless it is in this floc */
 
-      blocked_by = Cement.val[getInt3dindex(Cement, xp, yp, zp)] - 1;
+      hit--;
+      if ((hit < 1) || (hit > Npart) || (index[hit] != ipart))
+        blocked_by = hit;
     }
   }
 
@@ -4042,19 +6414,18 @@ int checkfloc(struct particle *partpoint, int dx, int dy, int dz) {
  *     Arguments:    None
  *     Returns:    Nothing
  *
- *    Calls:        drawfloc, checkfloc, ran1
+ *    Calls:        drawfloc, checkfloc, flocsurf, flocfree, ran1
  *    Called by:    main program
  **/
 void makefloc(void) {
   register int i, j, ipart;
   float degfloc;
   int targetnumflocs, numflocs, numdeleted;
-  int blocked_by, dx, dy, dz, moveran, flochit;
+  int blocked_by, moveran, flochit;
   char instring[MAXSTRING];
   struct particle *partpoint, *partkeep, *parttmp;
-  int *index;
+  int *index, *off;
 
-  dx = dy = dz = 0;
   partpoint = NULL;
   partkeep = NULL;
   parttmp = NULL;
@@ -4080,11 +6451,11 @@ void makefloc(void) {
   /*  attached to a floc */
 
   fprintf(Logfile, "\nEnter the degree of flocculation desired (0.0 to 1.0): ");
-  fflush(Logfile);
-  read_string(instring, sizeof(instring));
+  log_flush(Logfile);
+  getinput("Flocculation", instring, sizeof(instring));
   degfloc = atof(instring);
   fprintf(Logfile, "%f\n", degfloc);
-  fflush(Logfile);
+  log_flush(Logfile);
   targetnumflocs = Npart;
   if (degfloc > 0.0) {
     targetnumflocs = (int)(((float)(Npart)) * (1.0 - degfloc));
@@ -4094,9 +6465,21 @@ void makefloc(void) {
       targetnumflocs = 1;
   }
   fprintf(Logfile, "Target number of flocs is %d\n", targetnumflocs);
-  fflush(Logfile);
+  log_flush(Logfile);
 
   numflocs = Npart;
+
+  /* A moving floc only changes at its surface, so find the surfaces */
+
+  if (numflocs > targetnumflocs) {
+    if (flocsurf()) {
+      free_ivector(index);
+      freegenmic();
+      bailout("makefloc", "Memory allocation error");
+      exit(1);
+    }
+  }
+
   while (numflocs > targetnumflocs) {
 
     numdeleted = 0;
@@ -4107,83 +6490,52 @@ void makefloc(void) {
         numdeleted++;
       } else {
 
-        /* Move this particle in a randomly chosen Cartesian direction */
+        /* Move this floc in a randomly chosen Cartesian direction */
 
         moveran = 6.0 * ran1(Seed);
 
-        dx = dy = dz = 0;
-
-        switch (moveran) {
-        case 0:
-          dx = 1;
-          break;
-        case 1:
-          dx = (-1);
-          break;
-        case 2:
-          dy = 1;
-          break;
-        case 3:
-          dy = (-1);
-          break;
-        case 4:
-          dz = 1;
-          break;
-        case 5:
-          dz = (-1);
-          break;
-        default:
-          break;
-        }
-
-        /* First erase all particles in the floc */
-
-        partpoint = Particle[ipart];
-        while (partpoint != NULL) {
-          drawfloc(partpoint, Erase); /* set to porosity */
-          partkeep = partpoint;
-          partpoint = partpoint->nextpart;
-        }
-
-        /* Now try to draw the floc at new location */
+        /* See whether the floc fits at the new location */
 
         partpoint = Particle[ipart];
         blocked_by = 0;
         while ((partpoint != NULL) && (!blocked_by)) {
-          blocked_by =
-              checkfloc(partpoint, dx, dy, dz); /* zero if not blocked */
-          partkeep = partpoint;
+          blocked_by = checkfloc(partpoint, moveran, index,
+                                 ipart); /* zero if not blocked */
           partpoint = partpoint->nextpart;
         }
 
         if (!blocked_by) {
 
-          /* Floc fits at new location, so draw it there */
-          partpoint = Particle[ipart];
-          while (partpoint != NULL) {
-            /* Update pixel locations for particle */
-            for (j = 0; j < partpoint->numpix; j++) {
-              partpoint->xi[j] += dx;
-              partpoint->yi[j] += dy;
-              partpoint->zi[j] += dz;
-              partpoint->xi[j] += checkbc(partpoint->xi[j], Xsyssize);
-              partpoint->yi[j] += checkbc(partpoint->yi[j], Ysyssize);
-              partpoint->zi[j] += checkbc(partpoint->zi[j], Zsyssize);
+          /***
+           *    Floc fits at new location, so move it there.  Erase
+           *    the pixels it leaves behind, shift every particle,
+           *    and draw the pixels it moves into.  The rest of
+           *    each particle stays as it is.
+           ***/
+
+          for (partpoint = Particle[ipart]; partpoint != NULL;
+               partpoint = partpoint->nextpart) {
+            drawfloc(partpoint, Erase, moveran ^ 1);
+          }
+          for (partpoint = Particle[ipart]; partpoint != NULL;
+               partpoint = partpoint->nextpart) {
+            off = Flocoff + 3 * partpoint->partid;
+            for (j = 0; j < 3; j++) {
+              off[j] += Flocstep[moveran][j];
             }
-            drawfloc(partpoint, Draw);
-            partpoint = partpoint->nextpart;
+            off[0] += checkbc(off[0], Xsyssize);
+            off[1] += checkbc(off[1], Ysyssize);
+            off[2] += checkbc(off[2], Zsyssize);
+            drawfloc(partpoint, Draw, moveran);
           }
 
         } else {
 
-          /* Floc does not fit at this location. */
-          /* First of all, put the floc in its most recent unblocked location
-           */
-          partpoint = Particle[ipart];
-          while (partpoint != NULL) {
-            drawfloc(partpoint, Draw);
-            partkeep = partpoint;
-            partpoint = partpoint->nextpart;
+          /* Floc does not fit at this location, so it stays put */
+
+          partkeep = Particle[ipart];
+          while (partkeep->nextpart != NULL) {
+            partkeep = partkeep->nextpart;
           }
 
           /* At this point, partkeep should point to the last particle in the
@@ -4215,7 +6567,7 @@ void makefloc(void) {
             /*
             free_particlevector(Particle[index[blocked_by]]);
            fprintf(Logfile,"\nMemory freeing was successful");
-            fflush(Logfile);
+            log_flush(Logfile);
             */
             if (Particle[flochit] != NULL) {
               fprintf(stderr, "\nWARNING line 3775: Hit floc was not erased "
@@ -4231,9 +6583,11 @@ void makefloc(void) {
     fprintf(Logfile,
             "\nNumber flocs deleted so far is %d and number of flocs is %d\n",
             numdeleted, numflocs);
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
+  flocfree();
+
   if (index)
     free_ivector(index);
 
@@ -4245,7 +6599,7 @@ void makefloc(void) {
  *    measure
  *
  *    Routine to assess global phase fractions present
- *    in 3-D system
+ *    in 3-D system, from the running counts in Phasetally
  *
  *     Arguments:    None
  *     Returns:    Nothing
@@ -4254,89 +6608,39 @@ void makefloc(void) {
  *    Called by:    main program
  ***/
 void measure(void) {
-  int npor, nc2s, ngyp, ncem, nagg, nsfume, ninert, nfreelime;
-  int nflyash, nanh, nhem, ncaco3, nslag;
-  int nc3a, nc4af, nk2so4, nna2so4;
-  int i, j, k, valph;
-
-  /* Counters for the various phase fractions */
-
-  npor = ngyp = ncem = nagg = ninert = 0;
-  nfreelime = nflyash = nanh = ncaco3 = 0;
-  nslag = nc3a = nfreelime = nhem = nc4af = 0;
-  nk2so4 = nna2so4 = 0;
-  ;
-  nslag = nc2s = nsfume = nflyash = nanh = 0;
-  nhem = ncaco3 = nfreelime = 0;
-
-  /* Check all pixels in 3-D microstructure */
-
-  for (k = 0; k < Zsyssize; k++) {
-    for (j = 0; j < Ysyssize; j++) {
-      for (i = 0; i < Xsyssize; i++) {
-
-        valph = Cemreal.val[getInt3dindex(Cemreal, i, j, k)];
-        switch (valph) {
-        case POROSITY:
-          npor++;
-          break;
-        case C3S:
-          ncem++;
-          break;
-        case C2S:
-          nc2s++;
-          break;
-        case C3A:
-          nc3a++;
-          break;
-        case C4AF:
-          nc4af++;
-          break;
-        case K2SO4:
-          nk2so4++;
-          break;
-        case NA2SO4:
-          nna2so4++;
-          break;
-        case GYPSUM:
-          ngyp++;
-          break;
-        case HEMIHYD:
-          nhem++;
-          break;
-        case ANHYDRITE:
-          nanh++;
-          break;
-        case INERTAGG:
-          nagg++;
-          break;
-        case SFUME:
-          nsfume++;
-          break;
-        case INERT:
-          ninert++;
-          break;
-        case SLAG:
-          nslag++;
-          break;
-        case FLYASH:
-          nflyash++;
-          break;
-        case CACO3:
-          ncaco3++;
-          break;
-        case FREELIME:
-          nfreelime++;
-          break;
-        default:
-          fprintf(stderr, "\nWARNING line 3885:  Unidentifiable phase ID (%d) ",
-                  valph);
-          fprintf(stderr, "encountered.\nPixel at location ");
-          fprintf(stderr, "(%d,%d,%d)\n", i, j, k);
-          fflush(stderr);
-          break;
-        }
-      }
+  long npor, nc2s, ngyp, ncem, nagg, nsfume, ninert;
+  long nflyash, nanh, nhem, ncaco3, nslag;
+  int i;
+  static const int known[] = {POROSITY, C3S,      C2S,       C3A,    C4AF,
+                              K2SO4,    NA2SO4,   GYPSUM,    HEMIHYD,
+                              ANHYDRITE, INERTAGG, SFUME,    INERT,
+                              SLAG,     FLYASH,   CACO3,     FREELIME};
+  int isknown[PHASETALLY];
+
+  /* The counts are kept as the voxels are set (see Phasetally) */
+
+  npor = Phasetally[POROSITY];
+  ncem = Phasetally[C3S];
+  nc2s = Phasetally[C2S];
+  ngyp = Phasetally[GYPSUM];
+  nhem = Phasetally[HEMIHYD];
+  nanh = Phasetally[ANHYDRITE];
+  nagg = Phasetally[INERTAGG];
+  nsfume = Phasetally[SFUME];
+  ninert = Phasetally[INERT];
+  nslag = Phasetally[SLAG];
+  nflyash = Phasetally[FLYASH];
+  ncaco3 = Phasetally[CACO3];
+
+  for (i = 0; i < PHASETALLY; i++)
+    isknown[i] = 0;
+  for (i = 0; i < (int)(sizeof(known) / sizeof(known[0])); i++)
+    isknown[known[i]] = 1;
+  for (i = 0; i < PHASETALLY; i++) {
+    if (Phasetally[i] > 0 && !isknown[i]) {
+      fprintf(stderr, "\nWARNING:  Unidentifiable phase ID (%d) ", i);
+      fprintf(stderr, "encountered in %ld pixels\n", Phasetally[i]);
+      fflush(stderr);
     }
   }
 
@@ -4344,18 +6648,18 @@ void measure(void) {
 
   if (Verbose) {
     fprintf(Logfile, "\nPhase counts are: \n");
-    fprintf(Logfile, "\tPorosity = %d \n", npor);
-    fprintf(Logfile, "\tCement = %d \n", ncem);
-    fprintf(Logfile, "\tC2S = %d \n", nc2s);
-    fprintf(Logfile, "\tGypsum = %d \n", ngyp);
-    fprintf(Logfile, "\tAnhydrite = %d \n", nanh);
-    fprintf(Logfile, "\tHemihydrate = %d \n", nhem);
-    fprintf(Logfile, "\tSilica fume = %d \n", nsfume);
-    fprintf(Logfile, "\tInert = %d \n", ninert);
-    fprintf(Logfile, "\tSlag = %d \n", nslag);
-    fprintf(Logfile, "\tCaCO3 = %d \n", ncaco3);
-    fprintf(Logfile, "\tFly Ash = %d \n", nflyash);
-    fprintf(Logfile, "\tAggregate = %d \n", nagg);
+    fprintf(Logfile, "\tPorosity = %ld \n", npor);
+    fprintf(Logfile, "\tCement = %ld \n", ncem);
+    fprintf(Logfile, "\tC2S = %ld \n", nc2s);
+    fprintf(Logfile, "\tGypsum = %ld \n", ngyp);
+    fprintf(Logfile, "\tAnhydrite = %ld \n", nanh);
+    fprintf(Logfile, "\tHemihydrate = %ld \n", nhem);
+    fprintf(Logfile, "\tSilica fume = %ld \n", nsfume);
+    fprintf(Logfile, "\tInert = %ld \n", ninert);
+    fprintf(Logfile, "\tSlag = %ld \n", nslag);
+    fprintf(Logfile, "\tCaCO3 = %ld \n", ncaco3);
+    fprintf(Logfile, "\tFly Ash = %ld \n", nflyash);
+    fprintf(Logfile, "\tAggregate = %ld \n", nagg);
   }
 
   return;
@@ -4407,13 +6711,13 @@ void measagg(void) {
     for (iy = 0; iy < Ysyssize; iy++) {
       for (iz = 0; iz < Zsyssize; iz++) {
 
-        phid = Cemreal.val[getInt3dindex(Cemreal, ixlo, iy, iz)];
+        phid = Cemreal.val[getUChar3dindex(Cemreal, ixlo, iy, iz)];
         ptot++;
         if (phid <= FLYASH) {
           phase[phid]++;
         }
 
-        phid = Cemreal.val[getInt3dindex(Cemreal, ixhi, iy, iz)];
+        phid = Cemreal.val[getUChar3dindex(Cemreal, ixhi, iy, iz)];
         ptot++;
         if (phid <= FLYASH) {
           phase[phid]++;
@@ -4444,16 +6748,15 @@ void measagg(void) {
  *    check_connectivity (formerly connect)
  *
  *    Routine to assess the connectivity (percolation)
- *    of a single phase.  Two matrices are used here:
- *
- *                (1) for the current burnt locations
- *                (2) for the other to store the newly found
- *                    burnt locations
+ *    of a single phase, from top to bottom (in z) with
+ *    periodic boundaries in x and y.  The phase is labeled
+ *    into clusters by perc_label_classes in one pass, so
+ *    Cement is left as it is.
  *
  *     Arguments:    None
  *     Returns:    Nothing
  *
- *    Calls:        No other routines
+ *    Calls:        perc_label_classes
  *    Called by:    main program
  *
  *    Note: Renamed from connect() to check_connectivity() to avoid
@@ -4461,33 +6764,15 @@ void measagg(void) {
  ***/
 /* void connect(void) { */  /* Original name - conflicts with Windows winsock on Windows */
 void check_connectivity(void) {  /* Renamed to avoid Windows name collision */
-  register int i, j, k;
-  int inew, ntop, nthrough, ncur, nnew, ntot;
-  int *nmatx, *nmaty, *nmatz, *nnewx, *nnewy, *nnewz;
-  int xcn, ycn, zcn, npix, x1, y1, z1, igood;
-  int jnew, icur;
+  int i, j, k, npix, val;
+  size_t n;
+  unsigned char *cl;
+  unsigned char link[PERCCLASSES][PERCCLASSES];
   char instring[MAXSTRING];
-
-  nmatx = nmaty = nmatz = NULL;
-  nnewx = nnewy = nnewz = NULL;
-
-  nmatx = ivector(Maxburning);
-  nmaty = ivector(Maxburning);
-  nmatz = ivector(Maxburning);
-  nnewx = ivector(Maxburning);
-  nnewy = ivector(Maxburning);
-  nnewz = ivector(Maxburning);
-
-  if (!nmatx || !nmaty || !nmatz || !nnewx || !nnewy || !nnewz) {
-
-    freegenmic();
-    bailout("genmic", "Memory allocation failure");
-    fflush(Logfile);
-    exit(1);
-  }
+  Percstats ps;
 
   fprintf(Logfile, "Enter phase to analyze 0) pores 1) Cement  \n");
-  read_string(instring, sizeof(instring));
+  getinput("Connectivity_phase", instring, sizeof(instring));
   npix = atoi(instring);
   fprintf(Logfile, "%d \n", npix);
   if ((npix != POROSITY) && (npix != C3S)) {
@@ -4497,185 +6782,51 @@ void check_connectivity(void) {  /* Renamed to avoid Windows name collision */
   }
 
   /***
-   *    Counters for number of pixels of phase
-   *    accessible from top surface and number which
-   *    are part of a percolated pathway
+   *    Cement holds particle ids, so every pixel of any
+   *    particle counts as cement
    ***/
 
-  ntop = 0;
-  nthrough = 0;
-
-  /***
-   *    Percolation is assessed from top to
-   *    bottom ONLY, and burning algorithm is
-   *    periodic in x and y directions
-   ***/
-
-  k = 0;
-  for (i = 0; i < Xsyssize; i++) {
-    for (j = 0; j < Ysyssize; j++) {
-
-      ncur = 0;
-      ntot = 0;
-      igood = 0; /* Indicates if bottom has been reached */
-
-      if (((Cement.val[getInt3dindex(Cement, i, j, k)] == npix) &&
-           ((Cement.val[getInt3dindex(Cement, i, j, Zsyssize - 1)] == npix) ||
-            (Cement.val[getInt3dindex(Cement, i, j, Zsyssize - 1)] ==
-             (npix + Burnt)))) ||
-          ((Cement.val[getInt3dindex(Cement, i, j, Zsyssize - 1)] > 0) &&
-           (Cement.val[getInt3dindex(Cement, i, j, k)] > 0) &&
-           (Cement.val[getInt3dindex(Cement, i, j, k)] < Burnt) &&
-           (npix == C3S))) {
-
-        /* Start a burn front */
-
-        Cement.val[getInt3dindex(Cement, i, j, k)] += Burnt;
-        ntot++;
-        ncur++;
-
-        /***
-         *    Burn front is stored in matrices
-         *    nmat* and nnew*
-         ***/
-
-        nmatx[ncur] = i;
-        nmaty[ncur] = j;
-        nmatz[ncur] = 0;
-
-        /* Burn as long as new (fuel) pixels are found */
-
-        do {
-          nnew = 0;
-          for (inew = 1; inew <= ncur; inew++) {
-
-            xcn = nmatx[inew];
-            ycn = nmaty[inew];
-            zcn = nmatz[inew];
-
-            /* Check all six neighbors */
-
-            for (jnew = 1; jnew <= 6; jnew++) {
-              x1 = xcn;
-              y1 = ycn;
-              z1 = zcn;
-              switch (jnew) {
-              case 1:
-                x1--;
-                if (x1 < 0)
-                  x1 += Xsyssize;
-                break;
-              case 2:
-                x1++;
-                if (x1 >= Xsyssize)
-                  x1 -= Xsyssize;
-                break;
-              case 3:
-                y1--;
-                if (y1 < 0)
-                  y1 += Ysyssize;
-                break;
-              case 4:
-                y1++;
-                if (y1 >= Ysyssize)
-                  y1 -= Ysyssize;
-                break;
-              case 5:
-                z1--;
-                if (z1 < 0)
-                  z1 += Zsyssize;
-                break;
-              case 6:
-                z1++;
-                if (z1 >= Zsyssize)
-                  z1 -= Zsyssize;
-                break;
-              default:
-                break;
-              }
-
-              /***
-               *    Nonperiodic in z direction so
-               *    be sure to remain in the 3-D box
-               ****/
-
-              if ((z1 >= 0) && (z1 < Zsyssize)) {
-                if ((Cement.val[getInt3dindex(Cement, x1, y1, z1)] == npix) ||
-                    ((Cement.val[getInt3dindex(Cement, x1, y1, z1)] > 0) &&
-                     (Cement.val[getInt3dindex(Cement, x1, y1, z1)] < Burnt) &&
-                     (npix == C3S))) {
-
-                  ntot++;
-                  Cement.val[getInt3dindex(Cement, x1, y1, z1)] += Burnt;
-                  nnew++;
-
-                  if (nnew >= Maxburning) {
-                    fprintf(Logfile, "error in size of nnew \n");
-                  }
-
-                  nnewx[nnew] = x1;
-                  nnewy[nnew] = y1;
-                  nnewz[nnew] = z1;
-
-                  /***
-                   *    See if bottom of system
-                   *    has been reached
-                   ***/
-
-                  if (z1 == Zsyssize - 1)
-                    igood = 1;
-                }
-              }
-            }
-          }
-
-          if (nnew > 0) {
-
-            ncur = nnew;
-
-            /* update the burn front matrices */
-
-            for (icur = 1; icur <= ncur; icur++) {
-              nmatx[icur] = nnewx[icur];
-              nmaty[icur] = nnewy[icur];
-              nmatz[icur] = nnewz[icur];
-            }
-          }
-
-        } while (nnew > 0);
-
-        ntop += ntot;
-        if (igood)
-          nthrough += ntot;
-      }
-    }
+  cl = (unsigned char *)malloc((size_t)Xsyssize * Ysyssize * Zsyssize);
+  if (!cl) {
+    freegenmic();
+    bailout("genmic", "Memory allocation failure");
+    log_flush(Logfile);
+    exit(1);
   }
 
-  fprintf(Logfile, "Phase ID= %d \n", npix);
-  fprintf(Logfile, "Number accessible from top= %d \n", ntop);
-  fprintf(Logfile, "Number contained in through pathways= %d \n", nthrough);
-
-  /***
-   *    Return the burnt sites to their original
-   *    phase values
-   ***/
-
-  for (k = 0; k < Zsyssize; k++) {
+  n = 0;
+  for (i = 0; i < Xsyssize; i++) {
     for (j = 0; j < Ysyssize; j++) {
-      for (i = 0; i < Xsyssize; i++) {
-        if (Cement.val[getInt3dindex(Cement, i, j, k)] >= Burnt) {
-          Cement.val[getInt3dindex(Cement, i, j, k)] -= Burnt;
-        }
+      for (k = 0; k < Zsyssize; k++) {
+        val = Cement.val[getInt3dindex(Cement, i, j, k)];
+        cl[n++] = (npix == C3S) ? (val > POROSITY) : (val == npix);
       }
     }
   }
 
-  free(nmatx);
-  free(nmaty);
-  free(nmatz);
-  free(nnewx);
-  free(nnewy);
-  free(nnewz);
+  memset(link, PERCNOLINK, sizeof(link));
+  link[1][1] = PERCLINK;
+
+  if (perc_label_classes(cl, NULL, Xsyssize, Ysyssize, Zsyssize, link, &ps)) {
+    free(cl);
+    freegenmic();
+    bailout("genmic", "Memory allocation failure");
+    log_flush(Logfile);
+    exit(1);
+  }
+  free(cl);
+
+  /***
+   *    Pixels of phase accessible from top surface and
+   *    pixels which are part of a percolated pathway
+   ***/
+
+  fprintf(Logfile, "Phase ID= %d \n", npix);
+  fprintf(Logfile, "Number accessible from top= %d \n", ps.nfront[2]);
+  fprintf(Logfile, "Number contained in through pathways= %d \n",
+          ps.nspan[2]);
+  fprintf(Logfile, "Number of clusters= %d \n", ps.ncluster);
+  fprintf(Logfile, "Largest cluster= %d \n", ps.maxcluster);
 
   return;
 }
@@ -4692,7 +6843,7 @@ void check_connectivity(void) {  /* Renamed to avoid Windows name collision */
  *    Called by:    main program
  ***/
 void outmic(void) {
-  int ix, iy, iz, valout;
+  int ix, iy, iz, valout, files;
   int totpix, iii, jjj, kkk;
   char filen[MAXSTRING], filepart[MAXSTRING], filestruct[MAXSTRING], ch;
   FILE *outfile, *partfile, *infile;
@@ -4702,85 +6853,109 @@ void outmic(void) {
   for (kkk = 0; kkk < Zsyssize; ++kkk) {
     for (jjj = 0; jjj < Ysyssize; ++jjj) {
       for (iii = 0; iii < Xsyssize; ++iii) {
-        if (Cemreal.val[getInt3dindex(Cemreal, iii, jjj, kkk)] == 0)
+        if (Cemreal.val[getUChar3dindex(Cemreal, iii, jjj, kkk)] == 0)
           totpix++;
       }
     }
   }
   fprintf(Logfile, "... Total pore voxels is now %d\n", totpix);
-  fflush(Logfile);
+  log_flush(Logfile);
 
   fprintf(Logfile, "Enter name of file for final microstructure image\n");
-  read_string(filen, sizeof(filen));
+  getinput("Image_file", filen, sizeof(filen));
+  if (Ensmember >= 0)
+    ensname(filen, WorkingDirectory);
   fprintf(Logfile, "%s\n", filen);
 
-  outfile = filehandler("genmic", filen, "WRITE");
-  if (!outfile) {
-    freegenmic();
-    exit(1);
-  }
-
   fprintf(Logfile, "Enter name of file to save particle IDs to \n");
-  read_string(filepart, sizeof(filepart));
+  getinput("Particle_file", filepart, sizeof(filepart));
+  if (Ensmember >= 0)
+    ensname(filepart, WorkingDirectory);
   fprintf(Logfile, "%s\n", filepart);
 
-  partfile = filehandler("genmic", filepart, "WRITE");
-  if (!partfile) {
-    freegenmic();
-    exit(1);
+  if (strlen(Handoffname) > 0) {
+    if (outmicbin(filen, filepart, 1)) {
+      freegenmic();
+      bailout("genmic", "Error handing off the microstructure images");
+      exit(1);
+    }
+    fprintf(Logfile, "Images handed off as %s\n", Handoffname);
   }
 
-  /***
-   *    Images must carry along information about the
-   *    VCCTL software version used to create the file, the system
-   *    size, and the image resolution.
-   ***/
+  /* Handed off images are only written to files if asked */
 
-  if (write_imgheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res)) {
-    fclose(outfile);
-    fclose(partfile);
-    freegenmic();
-    bailout("genmic", "Error writing microstructure image header");
-    exit(1);
-  }
+  files = (strlen(Handoffname) == 0 || Handofffiles);
+  if (files && Binout != IMG_ASCII) {
+    if (outmicbin(filen, filepart, 0)) {
+      freegenmic();
+      bailout("genmic", "Error writing binary microstructure images");
+      exit(1);
+    }
+  } else if (files) {
+    outfile = filehandler("genmic", filen, "WRITE");
+    if (!outfile) {
+      freegenmic();
+      exit(1);
+    }
 
-  if (write_imgheader(partfile, Xsyssize, Ysyssize, Zsyssize, Res)) {
-    fclose(outfile);
-    fclose(partfile);
-    freegenmic();
-    bailout("genmic", "Error writing particle image header");
-    exit(1);
-  }
+    partfile = filehandler("genmic", filepart, "WRITE");
+    if (!partfile) {
+      freegenmic();
+      exit(1);
+    }
 
-  /***
-   *  2025 August 04
-   *  New convention is to write microstructures in C-order, where Z varies
-   *the fastest, then Y, then X.
-   ***/
-  for (ix = 0; ix < Xsyssize; ix++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      for (iz = 0; iz < Zsyssize; iz++) {
-        valout = Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)];
-        /*
-        if (valout == (int)(INERTAGG)) {
-          valout = (int)(POROSITY);
-        }
-        */
-        fprintf(outfile, "\n%d", valout);
-        valout = Cement.val[getInt3dindex(Cement, ix, iy, iz)];
-        if (valout == (int)(TMPAGGID)) {
-          valout = (int)(POROSITY);
-        } else if (valout < 0) {
-          valout = (int)(POROSITY);
-        }
+    /***
+     *    Images must carry along information about the
+     *    VCCTL software version used to create the file, the system
+     *    size, and the image resolution.
+     ***/
+
+    if (write_imgheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res)) {
+      fclose(outfile);
+      fclose(partfile);
+      freegenmic();
+      bailout("genmic", "Error writing microstructure image header");
+      exit(1);
+    }
+
+    if (write_imgheader(partfile, Xsyssize, Ysyssize, Zsyssize, Res)) {
+      fclose(outfile);
+      fclose(partfile);
+      freegenmic();
+      bailout("genmic", "Error writing particle image header");
+      exit(1);
+    }
 
-        fprintf(partfile, "\n%d", valout);
+    /***
+     *  2025 August 04
+     *  New convention is to write microstructures in C-order, where Z varies
+     *the fastest, then Y, then X.
+     ***/
+    for (ix = 0; ix < Xsyssize; ix++) {
+      for (iy = 0; iy < Ysyssize; iy++) {
+        for (iz = 0; iz < Zsyssize; iz++) {
+          valout = Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)];
+          /*
+          if (valout == (int)(INERTAGG)) {
+            valout = (int)(POROSITY);
+          }
+          */
+          fprintf(outfile, "\n%d", valout);
+          valout = Cement.val[getInt3dindex(Cement, ix, iy, iz)];
+          if (valout == (int)(TMPAGGID)) {
+            valout = (int)(POROSITY);
+          } else if (valout < 0) {
+            valout = (int)(POROSITY);
+          }
+
+          fprintf(partfile, "\n%d", valout);
+        }
       }
     }
-  }
 
-  fclose(outfile);
-  fclose(partfile);
+    fclose(outfile);
+    fclose(partfile);
+  }
 
   /*** PUT NICK's STUFF RIGHT HERE ***/
 
@@ -4801,304 +6976,231 @@ void outmic(void) {
   return;
 }
 
+/***
+ *    outmicbin
+ *
+ *    Write the final microstructure and particle id images in the
+ *    binary format chosen by Binout, one x plane at a time, with
+ *    the same values outmic writes in an ASCII image, or hand them
+ *    off in memory as raw binary images
+ *
+ *     Arguments:    char names of the microstructure and particle
+ *                 id files
+ *                 int nonzero to hand them off as Handoffname
+ *                 instead
+ *     Returns:    0 if okay, 1 if the files cannot be written
+ *
+ *    Calls:        write_binheader, write_binplane, handoff_open,
+ *                 handoff_close
+ *    Called by:    outmic
+ ***/
+int outmicbin(char *filen, char *filepart, int handoff) {
+  int ix, iy, iz, format, idformat, status, valout;
+  size_t m, nplane, idx, step;
+  unsigned char *phbuf, *idbuf;
+  FILE *outfile, *partfile;
+
+  format = handoff ? IMG_UINT8 : Binout;
+  idformat = (format == IMG_UINT8Z) ? IMG_UINT32Z : IMG_UINT32;
+  nplane = (size_t)Ysyssize * Zsyssize;
+  step = (size_t)Xsyssize * Ysyssize;
+
+  phbuf = (unsigned char *)malloc(nplane);
+  idbuf = (unsigned char *)malloc(4 * nplane);
+  if (handoff) {
+    outfile = handoff_open(Handoffname, "img",
+                           BINIMGHEADERSIZE + (size_t)Xsyssize * nplane);
+    partfile = handoff_open(Handoffname, "pimg",
+                            BINIMGHEADERSIZE + 4 * (size_t)Xsyssize * nplane);
+  } else {
+    outfile = fopen(filen, "wb");
+    partfile = fopen(filepart, "wb");
+  }
+
+  status = (!phbuf || !idbuf || !outfile || !partfile);
+  if (!status) {
+    status = write_binheader(outfile, Xsyssize, Ysyssize, Zsyssize, Res,
+                             format) ||
+             write_binheader(partfile, Xsyssize, Ysyssize, Zsyssize, Res,
+                             idformat);
+  }
+
+  /***
+   *    Each x plane goes out in C order, z varying fastest.  Cemreal
+   *    and Cement keep x fastest, so z steps over a whole xy plane.
+   ***/
+
+  for (ix = 0; (ix < Xsyssize) && !status; ix++) {
+    m = 0;
+    for (iy = 0; iy < Ysyssize; iy++) {
+      idx = (size_t)iy * Xsyssize + ix;
+      for (iz = 0; iz < Zsyssize; iz++, idx += step, m++) {
+        phbuf[m] = (unsigned char)Cemreal.val[idx];
+        valout = Cement.val[idx];
+        if (valout == (int)(TMPAGGID) || valout < 0)
+          valout = (int)(POROSITY);
+        idbuf[4 * m] = (unsigned char)(valout & 0xff);
+        idbuf[4 * m + 1] = (unsigned char)((valout >> 8) & 0xff);
+        idbuf[4 * m + 2] = (unsigned char)((valout >> 16) & 0xff);
+        idbuf[4 * m + 3] = (unsigned char)((valout >> 24) & 0xff);
+      }
+    }
+    status = write_binplane(outfile, phbuf, nplane, format) ||
+             write_binplane(partfile, idbuf, 4 * nplane, idformat);
+  }
+
+  if (outfile && handoff_close(outfile))
+    status = 1;
+  if (partfile && handoff_close(partfile))
+    status = 1;
+  free(phbuf);
+  free(idbuf);
+
+  return (status);
+}
+
 /******************************************************
  *
  *    harm
  *
- *     Compute spherical harmonics (complex) for a value
- *     of x = cos(theta), phi = angle phi so
- *     -1 < x < 1, P(n,m), -n < m < n, 0 < n
+ *     Compute spherical harmonics (complex) Y(n,m) for
+ *     0 <= n <= Nnn, -n <= m <= n at angles theta and phi
  *
- *     Uses two recursion relations plus exact formulas for
- *     the associated Legendre functions up to n=8
+ *     The associated Legendre functions come from the
+ *     recurrence in sphharm, with its coefficients
+ *     tabulated once
  *
  *    Arguments:    double theta and phi coordinates
  *    Returns:    Nothing
  *
- *    Calls:         fac
- *    Called by:  main
+ *    Calls:         sphharm
+ *    Called by:  image
  *
  ******************************************************/
 void harm(double theta, double phi) {
-  int i, m, n, mm, nn;
-  double x, s, xn, xm;
-  double realnum;
-  double p[NNN + 1][2 * (NNN + 1)];
-  fcomplex fc1, fc2, fc3;
-
-  x = cos(theta);
-  s = (double)(sqrt((double)(1.0 - (x * x))));
-
-  for (n = 0; n <= Nnn; n++) {
-    for (m = 0; m <= 2 * n; m++) {
-      p[n][m] = 0.0;
-    }
-  }
-
-  p[0][0] = 1.0;
-  p[1][0] = x;
-  p[1][1] = s;
-  p[2][0] = 0.5 * (3. * x * x - 1.);
-  p[2][1] = 3. * x * s;
-  p[2][2] = 3. * (1. - x * x);
-  p[3][0] = 0.5 * x * (5. * x * x - 3.);
-  p[3][1] = 1.5 * (5. * x * x - 1.) * s;
-  p[3][2] = 15. * x * (1. - x * x);
-  p[3][3] = 15. * (pow(s, 3));
-  p[4][0] = 0.125 * (35. * (pow(x, 4)) - 30. * x * x + 3.);
-  p[4][1] = 2.5 * (7. * x * x * x - 3. * x) * s;
-  p[4][2] = 7.5 * (7. * x * x - 1.) * (1. - x * x);
-  p[4][3] = 105. * x * (pow(s, 3));
-  p[4][4] = 105. * (pow((1. - x * x), 2));
-  p[5][0] = 0.125 * x * (63. * (pow(x, 4)) - 70. * x * x + 15.);
-  p[5][1] = 0.125 * 15. * s * (21. * (pow(x, 4)) - 14. * x * x + 1.);
-  p[5][2] = 0.5 * 105. * x * (1. - x * x) * (3. * x * x - 1.);
-  p[5][3] = 0.5 * 105. * (pow(s, 3)) * (9. * x * x - 1.);
-  p[5][4] = 945. * x * (pow((1. - x * x), 2));
-  p[5][5] = 945. * (pow(s, 5));
-  p[6][0] =
-      0.0625 * (231. * (pow(x, 6)) - 315. * (pow(x, 4)) + 105. * x * x - 5.);
-  p[6][1] = 0.125 * 21. * x * (33. * (pow(x, 4)) - 30. * x * x + 5.) * s;
-  p[6][2] =
-      0.125 * 105. * (1. - x * x) * (33. * (pow(x, 4)) - 18. * x * x + 1.);
-  p[6][3] = 0.5 * 315. * (11. * x * x - 3.) * x * (pow(s, 3));
-  p[6][4] = 0.5 * 945. * (1. - x * x) * (1. - x * x) * (11. * x * x - 1.);
-  p[6][6] = 10395. * pow((1. - x * x), 3);
-  p[7][0] = 0.0625 * x *
-            (429. * (pow(x, 6)) - 693. * (pow(x, 4)) + 315. * x * x - 35.);
-  p[7][1] = 0.0625 * 7. * s *
-            (429. * (pow(x, 6)) - 495. * (pow(x, 4)) + 135. * x * x - 5.);
-  p[7][2] = 0.125 * 63. * x * (1. - x * x) *
-            (143. * (pow(x, 4)) - 110. * x * x + 15.);
-  p[7][3] =
-      0.125 * 315. * (pow(s, 3)) * (143. * (pow(x, 4)) - 66. * x * x + 3.);
-  p[7][4] = 0.5 * 3465. * x * (1. - x * x) * (1. - x * x) * (13. * x * x - 3.);
-  p[7][5] = 0.5 * 10395. * (pow(s, 5)) * (13. * x * x - 1.);
-  p[7][6] = 135135. * x * (1. - x * x) * (1. - x * x) * (1. - x * x);
-  p[7][7] = 135135. * (pow(s, 7));
-  p[8][0] = (1. / 128.) * (6435. * (pow(x, 8)) - 12012. * (pow(x, 6)) +
-                           6930. * (pow(x, 4)) - 1260. * x * x + 35.);
-  p[8][1] = 0.0625 * 9. * x * s *
-            (715. * (pow(x, 6)) - 1001. * (pow(x, 4)) + 385. * x * x - 35.);
-  p[8][2] = 0.0625 * 315. * (1. - x * x) *
-            (143. * (pow(x, 6)) - 143. * (pow(x, 4)) + 33. * x * x - 1.);
-  p[8][3] =
-      0.125 * 3465. * x * (pow(s, 3)) * (39. * (pow(x, 4)) - 26. * x * x + 3.);
-  p[8][4] = 0.125 * 10395. * (1. - x * x) * (1. - x * x) *
-            (65. * (pow(x, 4)) - 26. * x * x + 1.);
-  p[8][5] = 0.5 * 135135. * x * (pow(s, 5)) * (5. * x * x - 1.);
-  p[8][6] = 0.5 * 135135. * (pow((1. - x * x), 3)) * (15. * x * x - 1.);
-  p[8][7] = 2027025. * x * (pow(s, 7));
-  p[8][8] = 2027025. * (pow((1. - x * x), 4));
-
-  /* Now generate spherical harmonics for n = 0,8 (follows Arfken) */
-
-  for (n = 0; n <= 8; n++) {
-
-    /* does n = 0 separately */
-
-    if (n == 0) {
-      Y[0][0].r = 1.0 / (sqrt(4.0 * Pi));
-      Y[0][0].i = 0.0;
-    } else {
-      for (m = n; m >= -n; m--) {
-        if (m >= 0) {
-          fc1 = Complex(cos(m * phi), sin(m * phi));
-          realnum = (pow(-1., m)) *
-                    sqrt(((2 * n + 1) / 4. / Pi) * fac(n - m) / fac(n + m)) *
-                    p[n][m];
-          Y[n][m] = RCmul(realnum, fc1);
-
-        } else if (m < 0) {
-          mm = -m;
-          fc1 = Conjg(Y[n][m]);
-          realnum = pow(-1.0, mm);
-          Y[n][m] = RCmul(realnum, fc1);
-        }
-      }
-    }
-  }
-
-  /***
-   *    Use recursion relations for n >= 9
-   *    Do recursion on spherical harmonics, because they are
-   *    better behaved numerically
-   ***/
-
-  for (n = 9; n <= Nnn; n++) {
-    for (m = 0; m <= n - 2; m++) {
-      xn = (double)(n - 1);
-      xm = (double)m;
-      realnum = (2. * xn + 1.) * x;
-      Y[n][m] = RCmul(realnum, Y[n - 1][m]);
-      realnum =
-          -sqrt((2. * xn + 1.) * ((xn * xn) - (xm * xm)) / (2. * xn - 1.));
-      fc1 = RCmul(realnum, Y[n - 2][m]);
-      Y[n][m] = Cadd(Y[n][m], fc1);
-      realnum = (sqrt((2. * xn + 1.) * (pow((xn + 1.), 2) - (xm * xm)) /
-                      (2. * xn + 3.)));
-      Y[n][m] = RCmul((1.0 / realnum), Y[n][m]);
-    }
-
-    nn = (2 * n) - 1;
-    p[n][n] = pow(s, n);
-    for (i = 1; i <= nn; i += 2) {
-      p[n][n] *= (double)i;
-    }
-
-    fc1 = Complex(cos(n * phi), sin(n * phi));
-    realnum = (pow(-1., n)) *
-              sqrt(((2 * n + 1) / 4. / Pi) * fac(n - n) / fac(n + n)) * p[n][n];
-    Y[n][n] = RCmul(realnum, fc1);
+  sphharm(theta, phi, Nnn, Y);
 
-    /***
-     *    Now do second to the top m=n-1 using the exact m=n,
-     *    and the recursive m=n-2 found previously
-     ***/
+  return;
+}
 
-    xm = (double)(n - 1);
-    xn = (double)n;
+/***
+ *    partalloc
+ *
+ *    Hand out storage for particles from the current block of
+ *    the arena, starting a new block when it is full.  A request
+ *    bigger than a block gets a block of its own.  The storage
+ *    is only given back by partarenafree.
+ *
+ *    Arguments:    size_t number of bytes wanted
+ *    Returns:    Pointer to the storage, or NULL if out of memory
+ *
+ *    Calls:        no other routines
+ *    Called by:    particlevector
+ *
+ ***/
+void *partalloc(size_t nbytes) {
+  struct partblock *pb;
+  size_t head, bsize;
+  void *ptr;
 
-    realnum = -1.0;
-    fc1 = Complex(cos(phi), sin(phi));
-    fc2 = Cmul(fc1, Y[n][n - 2]);
-    Y[n][n - 1] = RCmul(realnum, fc2);
-    realnum =
-        (xn * (xn + 1.) - xm * (xm - 1.)) / sqrt((xn + xm) * (xn - xm + 1.));
-    Y[n][n - 1] = RCmul(realnum, Y[n][n - 1]);
+  /* Keep every piece aligned for any type */
 
-    realnum = sqrt((xn - xm) * (xn + xm + 1.));
-    fc1 = Complex(cos(phi), -sin(phi));
-    fc2 = Cmul(fc1, Y[n][n]);
-    fc3 = RCmul(realnum, fc2);
-    Y[n][n - 1] = Csub(Y[n][n - 1], fc3);
+  head = (sizeof(struct partblock) + 15) & ~((size_t)15);
+  nbytes = (nbytes + 15) & ~((size_t)15);
 
-    realnum = (s / 2.0 / xm / x);
-    Y[n][n - 1] = RCmul(realnum, Y[n][n - 1]);
+  pb = Partarena;
+  if (pb == NULL || pb->size - pb->used < nbytes) {
+    bsize = max(nbytes, (size_t)PARTBLOCKSIZE);
+    pb = (struct partblock *)malloc(head + bsize);
+    if (pb == NULL)
+      return (NULL);
+    pb->size = bsize;
+    pb->used = 0;
+    pb->next = Partarena;
+    Partarena = pb;
   }
 
-  /* now fill in -m terms */
-
-  for (n = 0; n <= Nnn; n++) {
-    for (m = -1; m >= -n; m--) {
-      mm = -m;
-      realnum = pow(-1.0, mm);
-      fc1 = Conjg(Y[n][mm]);
-      Y[n][m] = RCmul(realnum, fc1);
-    }
-  }
+  ptr = (char *)pb + head + pb->used;
+  pb->used += nbytes;
 
-  return;
+  return (ptr);
 }
 
-/******************************************************
- *
- *    fac
+/***
+ *    partarenafree
  *
- *    This is the factorial function, as used in function harm
+ *    Release every block of particle storage at once
  *
- *    Arguments:    int n
- *    Returns:    double fact;
+ *    Arguments:    None
+ *    Returns:    Nothing
  *
- *    Calls: No other routines
- *    Called by:  harm
+ *    Calls:        no other routines
+ *    Called by:    free_particlepointervector
  *
- ******************************************************/
-double fac(int j) {
-  int i;
-  double fact;
+ ***/
+void partarenafree(void) {
+  struct partblock *pb;
 
-  if (j <= 1) {
-    fact = 1.0;
-  } else {
-    fact = 1.0;
-    for (i = 1; i <= j; i++) {
-      fact *= (double)i;
-    }
+  while (Partarena != NULL) {
+    pb = Partarena->next;
+    free(Partarena);
+    Partarena = pb;
   }
 
-  return fact;
+  return;
 }
 
 /***
  *    particlevector
  *
- *    Routine to allocate memory for a 1D vector of pointers to particle
- *structures. All array indices are assumed to start with zero.
+ *    Routine to make a particle structure with room for its pixel
+ *    locations.  The structure and the three coordinate lists are
+ *    taken together from the particle arena, so the pixels of a
+ *    particle lie next to each other in memory.
  *
  *    Arguments:    int number of pixels in the particle
- *    Returns:    Pointer to memory location of first element
+ *    Returns:    Pointer to the new particle, or NULL if out of memory
  *
- *    Calls:        no other routines
+ *    Calls:        partalloc
  *    Called by:    main routine
  *
  ***/
 struct particle *particlevector(int numpix) {
   struct particle *ps;
+  size_t psize;
+
   /* Allocate space for new particle info */
 
-  ps = (struct particle *)malloc(sizeof(struct particle));
+  psize = (sizeof(struct particle) + 15) & ~((size_t)15);
+  ps = (struct particle *)partalloc(
+      psize + 3 * (size_t)numpix * sizeof(unsigned short));
   if (ps != NULL) {
-    ps->xi = (int *)malloc(numpix * sizeof(int));
-    if (ps->xi != NULL) {
-      ps->yi = (int *)malloc(numpix * sizeof(int));
-      if (ps->yi != NULL) {
-        ps->zi = (int *)malloc(numpix * sizeof(int));
-        if (ps->zi != NULL) {
-          ps->numpix = numpix;
-          ps->nextpart = NULL;
-          return (ps);
-        } else {
-          free(ps->yi);
-          free(ps->xi);
-          free(ps);
-        }
-      } else {
-        free(ps->xi);
-        free(ps);
-      }
-    } else {
-      free(ps);
-    }
+    ps->xi = (unsigned short *)((char *)ps + psize);
+    ps->yi = ps->xi + numpix;
+    ps->zi = ps->yi + numpix;
+    ps->numpix = numpix;
+    ps->nextpart = NULL;
   }
 
   return (ps);
 }
 
+/***
+ *    free_particlevector
+ *
+ *    A particle lives in the particle arena, so there is nothing to
+ *    free one at a time; its storage goes when partarenafree is
+ *    called
+ *
+ *    Arguments:    Pointer to the particle
+ *    Returns:    Nothing
+ *
+ *    Calls:        no other routines
+ *    Called by:    makefloc
+ *
+ ***/
 void free_particlevector(struct particle *ps) {
-  if (ps != NULL) {
-    fprintf(Logfile, "\n\t\tFreeing floc ps now...");
-    fflush(Logfile);
-    if (ps->xi != NULL) {
-      fprintf(Logfile, "\n\t\t\tFreeing floc ps->xi now... ");
-      fflush(Logfile);
-      free(ps->xi);
-      fprintf(Logfile, "Done ");
-      fflush(Logfile);
-    }
-    if (ps->yi != NULL) {
-      fprintf(Logfile, "\n\t\t\tFreeing floc ps->yi now... ");
-      fflush(Logfile);
-      free(ps->yi);
-      fprintf(Logfile, "Done ");
-      fflush(Logfile);
-    }
-    if (ps->zi != NULL) {
-      fprintf(Logfile, "\n\t\t\tFreeing floc ps->zi now... ");
-      fflush(Logfile);
-      free(ps->zi);
-      fprintf(Logfile, "Done ");
-      fflush(Logfile);
-    }
-    if (ps != NULL) {
-      fprintf(Logfile, "\n\t\t\tFreeing floc ps now... ");
-      fflush(Logfile);
-      free(ps);
-      fprintf(Logfile, "Done ");
-      fflush(Logfile);
-    }
-  }
-  ps = NULL;
+  (void)ps;
   return;
 }
 
@@ -5130,11 +7232,50 @@ struct particle **particlepointervector(int size) {
   return (ps);
 }
 
+/***
+ *    growparticles
+ *
+ *    Make room in the Particle vector for particle number n,
+ *    doubling its size as often as it takes
+ *
+ *    Arguments:    int particle number
+ *    Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        no other routines
+ *    Called by:    genparticles, genonevoxparticles
+ *
+ ***/
+int growparticles(int n) {
+  int newsize;
+  struct particle **ps;
+
+  if (n < Npartc)
+    return (0);
+
+  newsize = Npartc;
+  while (newsize <= n && newsize < INT_MAX)
+    newsize = (newsize > INT_MAX / 2) ? INT_MAX : 2 * newsize;
+  if (newsize <= n)
+    return (1);
+
+  ps = (struct particle **)realloc(Particle,
+                                   (size_t)newsize * sizeof(struct particle *));
+  if (!ps) {
+    fprintf(Logfile, "\n\nCould not grow particlepointervector.");
+    return (1);
+  }
+  Particle = ps;
+  Npartc = newsize;
+
+  return (0);
+}
+
 /***
  *    free_particlepointervector
  *
  *    Routine to free the allocated memory for a 1D array of
- *    pointers to particle structures
+ *    pointers to particle structures, and the particle arena
+ *    holding the particles themselves
  *
  *    All array indices are assumed to start with zero.
  *
@@ -5142,23 +7283,12 @@ struct particle **particlepointervector(int size) {
  *
  *     Returns:    Nothing
  *
- *    Calls:        no other routines
+ *    Calls:        partarenafree
  *    Called by:    main routine
  *
  ***/
 void free_particlepointervector(struct particle **ps) {
-  int i = 0;
-  for (i = 0; i < Npartc; i++) {
-    if (ps[i] != NULL) {
-      if (ps[i]->xi != NULL)
-        free((char *)(ps[i]->xi));
-      if (ps[i]->yi != NULL)
-        free((char *)(ps[i]->yi));
-      if (ps[i]->zi != NULL)
-        free((char *)(ps[i]->zi));
-    }
-  }
-  free((char *)(ps[0]));
+  partarenafree();
   free((char *)(ps));
 
   return;
@@ -5186,18 +7316,16 @@ void free_particlepointervector(struct particle **ps) {
  *******************************************************/
 
 int distrib3d(void) {
-  fprintf(Logfile, "\n=== DEBUG: Entering distrib3d() ===");
-  fflush(Logfile);
+  LOGDEBUG(Logfile, "\n=== DEBUG: Entering distrib3d() ===");
 
   /* Stack canary to detect corruption */
   const unsigned long stack_canary = 0xDEADBEEF;
-  fprintf(Logfile, "\n=== DEBUG: Stack canary set to 0x%lx ===", stack_canary);
-  fflush(Logfile);
+  LOGDEBUG(Logfile, "\n=== DEBUG: Stack canary set to 0x%lx ===", stack_canary);
 
-  int nskip[6]; /* number of lines to skip as header in corr. files */
+  int nskip[7]; /* number of lines to skip as header in corr. files */
   register int i, j, k;
   int fileSizeInBytes = 0;
-  int alumval, alum2;
+  int alumval, alum2, branch;
   int alumdo = 1, k2so4do = 1;
   float volin, rhtest, eps, corr_res, sumarea, sumvol;
   double rdesire;
@@ -5226,18 +7354,17 @@ int distrib3d(void) {
 
   /* Initialize local variables before using them */
 
-  for (i = 0; i < 6; i++)
+  for (i = 0; i < 7; i++)
     nskip[i] = 0;
 
-  fprintf(Logfile, "\n=== DEBUG: Variable initialization completed ===");
-  fflush(Logfile);
+  LOGDEBUG(Logfile, "\n=== DEBUG: Variable initialization completed ===");
 
   /* Set up the correlation filenames */
 
   fprintf(Logfile, "Enter path/root name of cement correlation files\n");
-  read_string(filecem, sizeof(filecem));
+  getinput("Correlation_root", filecem, sizeof(filecem));
   fprintf(Logfile, "%s\n", filecem);
-  fflush(Logfile);
+  log_flush(Logfile);
 
   /* Use root names to build names of correlation files */
 
@@ -5250,25 +7377,25 @@ int distrib3d(void) {
   strcat(filec3s, ".c3s");
   if (Verbose)
     fprintf(Logfile, "\n%s", filec3s);
-  fflush(Logfile);
+  log_flush(Logfile);
 
   sprintf(filealum, "%s", filecem);
   strcat(filealum, ".alu");
   if (Verbose)
     fprintf(Logfile, "\n%s", filealum);
-  fflush(Logfile);
+  log_flush(Logfile);
 
   sprintf(filek2so4, "%s", filecem);
   strcat(filek2so4, ".k2o");
   if (Verbose)
     fprintf(Logfile, "\n%s", filek2so4);
-  fflush(Logfile);
+  log_flush(Logfile);
   Verbose = 1;
   sprintf(filena2so4, "%s", filecem);
   strcat(filena2so4, ".n2o");
   if (Verbose)
     fprintf(Logfile, "\n%s", filena2so4);
-  fflush(Logfile);
+  log_flush(Logfile);
 
   /***
    *    Test to see whether we have the c3a correlation file
@@ -5308,7 +7435,7 @@ int distrib3d(void) {
 
   if (Verbose)
     fprintf(Logfile, "\nReading each correlation function file now... ");
-  fflush(Logfile);
+  log_flush(Logfile);
   for (i = 1; i <= 6; i++) {
     if (Verbose)
       fprintf(Logfile, "\n%d: ", i);
@@ -5344,7 +7471,7 @@ int distrib3d(void) {
       } else if (i == 3) {
         alumdo = 0;
         fprintf(Logfile, "=== No alu file detected, set alumdo = 0 \n");
-        fflush(Logfile);
+        log_flush(Logfile);
       } else if (i == 4) {
         fprintf(Logfile, "=== No k2o file detected, set k2so4do = 0 \n");
         k2so4do = 0;
@@ -5395,19 +7522,19 @@ int distrib3d(void) {
   sumvol = sumarea = 0.0;
   for (i = C3S; i <= NA2SO4; i++) {
     Volf[i] = Surff[i] = 0.0;
-    read_string(instring, sizeof(instring));
+    getinput("Volume_fraction", instring, sizeof(instring));
     volin = atof(instring);
     Volf[i] = volin;
     sumvol += volin;
     if (Verbose)
       fprintf(Logfile, "%f\n", Volf[i]);
-    read_string(instring, sizeof(instring));
+    getinput("Surface_fraction", instring, sizeof(instring));
     volin = atof(instring);
     Surff[i] = volin;
     sumarea += volin;
     if (Verbose)
       fprintf(Logfile, "%f\n", Surff[i]);
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   /* Normalize Volf and Surff */
@@ -5444,8 +7571,7 @@ int distrib3d(void) {
 
   allmem();
 
-  fprintf(Logfile, "\n=== DEBUG: Memory allocation completed ===");
-  fflush(Logfile);
+  LOGDEBUG(Logfile, "\n=== DEBUG: Memory allocation completed ===");
 
   /* Initialize curvature to zero */
   for (k = 0; k < Zsyssize; k++) {
@@ -5456,8 +7582,11 @@ int distrib3d(void) {
     }
   }
 
-  fprintf(Logfile, "\n=== DEBUG: Curvature initialization completed ===");
-  fflush(Logfile);
+  LOGDEBUG(Logfile, "\n=== DEBUG: Curvature initialization completed ===");
+
+  /* Start the child process for the aluminate branch */
+
+  branch = distfork();
 
   /***
    *    First filtering between silicates and
@@ -5475,10 +7604,9 @@ int distrib3d(void) {
   if (Verbose)
     fprintf(Logfile, "Volin is %f", volin);
 
-  if (volin < 1.0) {
+  if ((branch & DISTSIL) && volin < 1.0) {
 
-    fprintf(Logfile, "\n=== DEBUG: About to call first rand3d() ===");
-    fflush(Logfile);
+    LOGDEBUG(Logfile, "\n=== DEBUG: About to call first rand3d() ===");
 
     if (rand3d(C3S, alumval, filesil, nskip[1], volin, R, Filter, S, Xr)) {
       freedistrib3d();
@@ -5486,8 +7614,7 @@ int distrib3d(void) {
       exit(1);
     }
 
-    fprintf(Logfile, "\n=== DEBUG: First rand3d() completed successfully ===");
-    fflush(Logfile);
+    LOGDEBUG(Logfile, "\n=== DEBUG: First rand3d() completed successfully ===");
 
     /* Check stack canary after first rand3d */
     if (stack_canary != 0xDEADBEEF) {
@@ -5495,11 +7622,10 @@ int distrib3d(void) {
               "\n!!! STACK CORRUPTION DETECTED after first rand3d: canary = "
               "0x%lx !!!",
               stack_canary);
-      fflush(Logfile);
+      log_flush(Logfile);
     } else {
-      fprintf(Logfile,
-              "\n=== DEBUG: Stack canary still intact after first rand3d ===");
-      fflush(Logfile);
+      LOGDEBUG(Logfile,
+               "\n=== DEBUG: Stack canary still intact after first rand3d ===");
     }
 
     if (Verbose)
@@ -5565,11 +7691,19 @@ int distrib3d(void) {
     }
   }
 
+  /* Start the silicate and aluminate branches */
+
+  if (distsync(branch)) {
+    freedistrib3d();
+    bailout("distrib3d", "Problem starting the aluminate branch");
+    exit(1);
+  }
+
   if (Verbose) {
     fprintf(Logfile, "\nOut of sinter3d.  Checking phase stats...");
     stat3d();
     fprintf(Logfile, "\nGetting ready to filter C2S from C3S.");
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   /***
@@ -5579,7 +7713,7 @@ int distrib3d(void) {
    *    are some silicates in the cement clinker
    ***/
 
-  if ((Volf[C3S] + Volf[C2S]) > 0.0) {
+  if ((branch & DISTSIL) && ((Volf[C3S] + Volf[C2S]) > 0.0)) {
 
     /***
      *    volin is fraction of silicates composed of C3S.
@@ -5591,7 +7725,7 @@ int distrib3d(void) {
 
     if (Verbose)
       fprintf(Logfile, "\nVolin is %f", volin);
-    fflush(Logfile);
+    log_flush(Logfile);
 
     if (volin < 1.0 && volin > 0.0) {
 
@@ -5669,7 +7803,11 @@ int distrib3d(void) {
    *    are some alkali sulfates in the cement clinker
    ***/
 
-  if ((alumdo == 1) && ((Volf[K2SO4] + Volf[NA2SO4]) > 0.0)) {
+  if ((branch == DISTBOTH) && Distsplit)
+    *Seed = Distseed[0];
+
+  if ((branch & DISTALUM) && (alumdo == 1) &&
+      ((Volf[K2SO4] + Volf[NA2SO4]) > 0.0)) {
 
     /***
      *    volin is fraction of aluminates composed of C3A and C4AF.
@@ -5760,7 +7898,7 @@ int distrib3d(void) {
    *    is NA2SO4 in the cement clinker
    ***/
 
-  if ((k2so4do == 1) && (Volf[NA2SO4] > 0.0)) {
+  if ((branch & DISTALUM) && (k2so4do == 1) && (Volf[NA2SO4] > 0.0)) {
 
     /* volin is fraction of K2SO4 in alkali sulfates */
 
@@ -5839,7 +7977,7 @@ int distrib3d(void) {
             sinter3d(NA2SO4, K2SO4, rhtest);
             if (Verbose)
               fprintf(Logfile, "\nOut of sinter3d: NA2SO4,K2SO4");
-            fflush(Logfile);
+            log_flush(Logfile);
           }
         }
       }
@@ -5865,7 +8003,7 @@ int distrib3d(void) {
 
   if (Verbose)
     fprintf(Logfile, "\nVolin is %f", volin);
-  if (volin < 1.0 && volin > 0.0) {
+  if ((branch & DISTALUM) && volin < 1.0 && volin > 0.0) {
 
     if (rand3d(alumval, alum2, filec34a, nskip[5], volin, R, Filter, S, Xr)) {
       freedistrib3d();
@@ -5983,16 +8121,23 @@ int distrib3d(void) {
     }
   }
 
+  /* Bring the two branches back together */
+
+  if (distjoin(branch)) {
+    freedistrib3d();
+    bailout("distrib3d", "Problem with the aluminate branch");
+    exit(1);
+  }
+
   fprintf(Logfile,
           "\nDone with distributing clinker phases.  Freeing memory now.");
-  fflush(Logfile);
+  log_flush(Logfile);
 
   /* Free up the dynamically allocated memory */
 
   freedistrib3d();
 
-  fprintf(Logfile, "\n=== DEBUG: About to return from distrib3d() ===");
-  fflush(Logfile);
+  LOGDEBUG(Logfile, "\n=== DEBUG: About to return from distrib3d() ===");
 
   /* Check stack canary before return */
   if (stack_canary != 0xDEADBEEF) {
@@ -6000,27 +8145,228 @@ int distrib3d(void) {
             "\n!!! STACK CORRUPTION DETECTED: canary = 0x%lx (expected "
             "0xDEADBEEF) !!!",
             stack_canary);
-    fflush(Logfile);
+    log_flush(Logfile);
   } else {
-    fprintf(Logfile, "\n=== DEBUG: Stack canary intact, safe to return ===");
-    fflush(Logfile);
+    LOGDEBUG(Logfile, "\n=== DEBUG: Stack canary intact, safe to return ===");
+  }
+
+  /* WORKAROUND: Use longjmp instead of return to bypass corrupted return
+   * address */
+  LOGDEBUG(Logfile, "\n=== DEBUG: Using longjmp to bypass return address "
+                    "corruption ===");
+
+  /* Set global success flag and jump back to main */
+  distrib3d_success = 1;
+  longjmp(distrib3d_jmpbuf, 1);
+
+  /* This line should never be reached */
+  fprintf(stderr,
+          "\n!!! ERROR line 5568: longjmp failed, trying normal return !!!");
+  fflush(stderr);
+  return (0);
+}
+
+/***
+ *    distalum
+ *
+ *    Routine to tell whether a phase is one of those
+ *    made by the aluminate branch of distrib3d
+ *
+ *    Arguments:    Int phase id
+ *    Returns:    1 if it is C3A, C4AF, K2SO4 or NA2SO4, 0 if not
+ *
+ *    Calls:        no other routines
+ *    Called by:    distjoin
+ *
+ ***/
+int distalum(int phase) {
+  return ((phase == C3A) || (phase == C4AF) || (phase == K2SO4) ||
+          (phase == NA2SO4));
+}
+
+/***
+ *    distfork
+ *
+ *    Routine to start the child process that will run the
+ *    aluminate branch of distrib3d, if --threads gives it
+ *    more than one thread, fork is available and there are
+ *    no OpenMP threads yet.  The child waits in distsync,
+ *    and leaves the trace of --trace to the parent.
+ *
+ *    Arguments:    None
+ *    Returns:    Int branches to run in this process
+ *                (DISTSIL, DISTALUM or DISTBOTH)
+ *
+ *    Calls:        trace_detach
+ *    Called by:    distrib3d
+ *
+ ***/
+int distfork(void) {
+#if !defined(_WIN32)
+  size_t nvox;
+  int fd[2];
+  pid_t pid;
+
+  if ((Nthreads < 2) || Distomp)
+    return (DISTBOTH);
+
+  nvox = (size_t)Xsyssize * Ysyssize * Zsyssize;
+  Distshare = (unsigned char *)mmap(NULL, nvox, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (Distshare == MAP_FAILED) {
+    Distshare = NULL;
+    return (DISTBOTH);
+  }
+  if (pipe(fd)) {
+    munmap(Distshare, nvox);
+    Distshare = NULL;
+    return (DISTBOTH);
+  }
+
+  fflush(NULL);
+  pid = fork();
+  if (pid == 0) {
+    trace_detach();
+    close(fd[1]);
+    Distpipe = fd[0];
+    Nthreads /= 2;
+    return (DISTALUM);
+  }
+
+  close(fd[0]);
+  if (pid > 0) {
+    Distpid = (long)pid;
+    Distpipe = fd[1];
+    return (DISTSIL);
+  }
+
+  close(fd[1]);
+  munmap(Distshare, nvox);
+  Distshare = NULL;
+#endif
+
+  return (DISTBOTH);
+}
+
+/***
+ *    distsync
+ *
+ *    Routine to start the silicate and aluminate branches
+ *    after the first filtering.  With --threads the seeds
+ *    of the aluminate branch and of what follows are drawn
+ *    here.  A parent with a child hands it the image and
+ *    the seeds; the child takes them and starts its stream.
+ *
+ *    Arguments:    Int branches to run in this process
+ *    Returns:    0 if okay, nonzero if the child could not
+ *                be started (then it stops)
+ *
+ *    Calls:        ran1
+ *    Called by:    distrib3d
+ *
+ ***/
+int distsync(int branch) {
+#if !defined(_WIN32)
+  size_t nvox;
+  ssize_t nread;
+#endif
+
+  if (branch & DISTSIL) {
+    Distsplit = (Nthreads > 0);
+    if (Distsplit) {
+      Distseed[0] = -1 - (int)(ran1(Seed) * 2147483646.0);
+      Distseed[1] = -1 - (int)(ran1(Seed) * 2147483646.0);
+    }
+  }
+
+#if !defined(_WIN32)
+  nvox = (size_t)Xsyssize * Ysyssize * Zsyssize;
+
+  if (branch == DISTSIL) {
+    memcpy(Distshare, Cemreal.val, nvox);
+    if (write(Distpipe, Distseed, sizeof(Distseed)) != sizeof(Distseed)) {
+      close(Distpipe);
+      Distpipe = -1;
+      return (1);
+    }
+    close(Distpipe);
+    Distpipe = -1;
+    Distthreads = Nthreads;
+    Nthreads -= Nthreads / 2;
+  } else if (branch == DISTALUM) {
+    nread = read(Distpipe, Distseed, sizeof(Distseed));
+    close(Distpipe);
+    Distpipe = -1;
+    if (nread != sizeof(Distseed))
+      _exit(1);
+    memcpy(Cemreal.val, Distshare, nvox);
+    Distsplit = 1;
+    *Seed = Distseed[0];
+  }
+#endif
+
+  return (0);
+}
+
+/***
+ *    distjoin
+ *
+ *    Routine to end the branches of distrib3d.  A child
+ *    puts its image in shared memory and stops; the parent
+ *    waits for it and takes the aluminate and alkali
+ *    sulfate pixels from that image.  Either way ran1 then
+ *    goes on from the second seed drawn by distsync.
+ *
+ *    Arguments:    Int branches that ran in this process
+ *    Returns:    0 if okay, nonzero if the child failed
+ *
+ *    Calls:        distalum
+ *    Called by:    distrib3d
+ *
+ ***/
+int distjoin(int branch) {
+  int status;
+#if !defined(_WIN32)
+  size_t i, nvox;
+  int wstatus;
+#endif
+
+  status = 0;
+
+#if !defined(_WIN32)
+  nvox = (size_t)Xsyssize * Ysyssize * Zsyssize;
+
+  if (branch == DISTALUM) {
+    memcpy(Distshare, Cemreal.val, nvox);
+    fflush(NULL);
+    _exit(0);
   }
 
-  /* WORKAROUND: Use longjmp instead of return to bypass corrupted return
-   * address */
-  fprintf(Logfile,
-          "\n=== DEBUG: Using longjmp to bypass return address corruption ===");
-  fflush(Logfile);
+  if (Distpid > 0) {
+    if ((waitpid((pid_t)Distpid, &wstatus, 0) < 0) || !WIFEXITED(wstatus) ||
+        (WEXITSTATUS(wstatus) != 0)) {
+      status = 1;
+    } else {
+      for (i = 0; i < nvox; i++) {
+        if (distalum(Cemreal.val[i])) {
+          if (!distalum(Distshare[i]))
+            status = 1;
+          Cemreal.val[i] = Distshare[i];
+        }
+      }
+    }
+    munmap(Distshare, nvox);
+    Distshare = NULL;
+    Distpid = 0;
+    Nthreads = Distthreads;
+  }
+#endif
 
-  /* Set global success flag and jump back to main */
-  distrib3d_success = 1;
-  longjmp(distrib3d_jmpbuf, 1);
+  if (Distsplit)
+    *Seed = Distseed[1];
+  Distsplit = 0;
 
-  /* This line should never be reached */
-  fprintf(stderr,
-          "\n!!! ERROR line 5568: longjmp failed, trying normal return !!!");
-  fflush(stderr);
-  return (0);
+  return (status);
 }
 
 /***
@@ -6085,7 +8431,7 @@ int maketemp(int size) {
  *    phcount
  *
  *    Routine to count phase fractions (porosity
- *    and solids)
+ *    and solids), from the running counts in Phasetally
  *
  *     Arguments:    None
  *     Returns:    Nothing
@@ -6094,32 +8440,53 @@ int maketemp(int size) {
  *    Called by:    main program
  ***/
 void phcount(void) {
-  int npore, nsolid[MAXNUMPHASES];
-  int ix, iy, iz;
-
-  npore = 0;
-  for (ix = 1; ix < MAXNUMPHASES; ix++) {
-    nsolid[ix] = 0;
-  }
+  fprintf(Logfile, "Pores are: %ld \n", Phasetally[POROSITY]);
+  fprintf(Logfile, "Solids are: %ld %ld %ld %ld %ld %ld\n", Phasetally[1],
+          Phasetally[2], Phasetally[3], Phasetally[4], Phasetally[5],
+          Phasetally[6]);
+}
 
-  /* Check all pixels in the 3-D system */
+/***
+ *    setphase
+ *
+ *    Set the phase of one voxel of Cemreal, moving it from
+ *    the count of its old phase to that of the new one
+ *
+ *     Arguments:    size_t index of the voxel in Cemreal
+ *                 int phase id
+ *     Returns:    Nothing
+ *
+ *    Calls:        no other routines
+ *    Called by:    placement, flocculation, sintering and
+ *                one-pixel particle routines
+ ***/
+void setphase(size_t idx, int phase) {
+  Phasetally[Cemreal.val[idx]]--;
+  Phasetally[phase]++;
+  Cemreal.val[idx] = (unsigned char)phase;
+}
 
-  for (iz = 0; iz < Zsyssize; iz++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      for (ix = 0; ix < Xsyssize; ix++) {
+/***
+ *    phtally
+ *
+ *    Count the voxels of each phase in Cemreal again, after
+ *    a step that rewrites the whole image
+ *
+ *     Arguments:    None
+ *     Returns:    Nothing
+ *
+ *    Calls:        no other routines
+ *    Called by:    main program
+ ***/
+void phtally(void) {
+  size_t i, nvox;
 
-        if (Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] == 0) {
-          npore++;
-        } else {
-          nsolid[Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)]]++;
-        }
-      }
-    }
-  }
+  for (i = 0; i < PHASETALLY; i++)
+    Phasetally[i] = 0;
 
-  fprintf(Logfile, "Pores are: %d \n", npore);
-  fprintf(Logfile, "Solids are: %d %d %d %d %d %d\n", nsolid[1], nsolid[2],
-          nsolid[3], nsolid[4], nsolid[5], nsolid[6]);
+  nvox = (size_t)Xsyssize * Ysyssize * Zsyssize;
+  for (i = 0; i < nvox; i++)
+    Phasetally[Cemreal.val[i]]++;
 }
 
 /***
@@ -6148,37 +8515,37 @@ int surfpix(int xin, int yin, int zin) {
   ix1 = xin - 1;
   if (ix1 < 0)
     ix1 += Xsyssize;
-  if (Cemreal.val[getInt3dindex(Cemreal, ix1, yin, zin)] == POROSITY)
+  if (Cemreal.val[getUChar3dindex(Cemreal, ix1, yin, zin)] == POROSITY)
     npix++;
 
   ix1 = xin + 1;
   if (ix1 >= Xsyssize)
     ix1 -= Xsyssize;
-  if (Cemreal.val[getInt3dindex(Cemreal, ix1, yin, zin)] == POROSITY)
+  if (Cemreal.val[getUChar3dindex(Cemreal, ix1, yin, zin)] == POROSITY)
     npix++;
 
   iy1 = yin - 1;
   if (iy1 < 0)
     iy1 += Ysyssize;
-  if (Cemreal.val[getInt3dindex(Cemreal, xin, iy1, zin)] == POROSITY)
+  if (Cemreal.val[getUChar3dindex(Cemreal, xin, iy1, zin)] == POROSITY)
     npix++;
 
   iy1 = yin + 1;
   if (iy1 >= Ysyssize)
     iy1 -= Ysyssize;
-  if (Cemreal.val[getInt3dindex(Cemreal, xin, iy1, zin)] == POROSITY)
+  if (Cemreal.val[getUChar3dindex(Cemreal, xin, iy1, zin)] == POROSITY)
     npix++;
 
   iz1 = zin - 1;
   if (iz1 < 0)
     iz1 += Zsyssize;
-  if (Cemreal.val[getInt3dindex(Cemreal, xin, yin, iz1)] == POROSITY)
+  if (Cemreal.val[getUChar3dindex(Cemreal, xin, yin, iz1)] == POROSITY)
     npix++;
 
   iz1 = zin + 1;
   if (iz1 >= Zsyssize)
     iz1 -= Zsyssize;
-  if (Cemreal.val[getInt3dindex(Cemreal, xin, yin, iz1)] == POROSITY)
+  if (Cemreal.val[getUChar3dindex(Cemreal, xin, yin, iz1)] == POROSITY)
     npix++;
 
   return (npix);
@@ -6188,18 +8555,18 @@ int surfpix(int xin, int yin, int zin) {
  *    rhcalc
  *
  *    Routine to return the current hydraulic radius
- *    for phase phin
+ *    for phase phin.  The pixel and surface counts are
+ *    kept in Rhporc and Rhsurfc.
  *
  *    Arguments:    Integer phase id
  *    Returns:    Float hydraulic radius
  *
- *    Calls:        surfpix
+ *    Calls:        surfpix, rhvalue
  *    Called by:    runsint
  ***/
 float rhcalc(int phin) {
   int ix, iy, iz;
   int porc, surfc;
-  float rhval;
 
   porc = surfc = 0;
 
@@ -6209,7 +8576,7 @@ float rhcalc(int phin) {
     for (iy = 0; iy < Ysyssize; iy++) {
       for (ix = 0; ix < Xsyssize; ix++) {
 
-        if (Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] == phin) {
+        if (Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)] == phin) {
           porc++;
           surfc += surfpix(ix, iy, iz);
         }
@@ -6217,6 +8584,27 @@ float rhcalc(int phin) {
     }
   }
 
+  Rhporc = porc;
+  Rhsurfc = surfc;
+
+  return (rhvalue(porc, surfc));
+}
+
+/***
+ *    rhvalue
+ *
+ *    Routine to return the hydraulic radius of a phase
+ *    from its pixel and surface counts
+ *
+ *    Arguments:    Integer pixel count and surface count
+ *    Returns:    Float hydraulic radius
+ *
+ *    Calls:        no other routines
+ *    Called by:    rhcalc, sinter3d
+ ***/
+float rhvalue(int porc, int surfc) {
+  float rhval;
+
   rhval = (float)(porc * 6.0 / (4.0 * (float)surfc));
   if (Verbose) {
     fprintf(Logfile, "Phase area count is %d \n", porc);
@@ -6261,8 +8649,8 @@ int countem(int xp, int yp, int zp, int phin) {
 
     if ((xc != xp) || (yc != yp) || (zc != zp)) {
 
-      if ((Cemreal.val[getInt3dindex(Cemreal, xc, yc, zc)] == phin) ||
-          (Cemreal.val[getInt3dindex(Cemreal, xc, yc, zc)] == POROSITY)) {
+      if ((Cemreal.val[getUChar3dindex(Cemreal, xc, yc, zc)] == phin) ||
+          (Cemreal.val[getUChar3dindex(Cemreal, xc, yc, zc)] == POROSITY)) {
 
         cumnum++;
       }
@@ -6272,31 +8660,175 @@ int countem(int xp, int yp, int zp, int phin) {
   return (cumnum);
 }
 
+/***
+ *    curvfast
+ *
+ *    Routine to find the local curvature of all phase
+ *    ph1 and ph2 pixels, the same counts countem gives,
+ *    with the template taken as rows along x.  The
+ *    pixels of each row of the system are summed once
+ *    into a running total, so the count over a template
+ *    row is the difference of two totals.  Only the
+ *    2*r+1 planes of totals that the current plane needs
+ *    are kept.
+ *
+ *    Arguments:    Phase ids of phase 1 and phase 2
+ *    Returns:    0 if okay, 1 if the template is too big
+ *                for the system or memory runs out (then
+ *                nothing is set)
+ *
+ *    Calls:        no other routines
+ *    Called by:    sysinit
+ *
+ ***/
+int curvfast(int ph1, int ph2) {
+  int i, k, x, y, z, zz, dy, dz, r, w, np, nx, slot, sum, val;
+  int *rowdx, *tot, *row, *row1;
+
+  r = 0;
+  for (i = 0; i < Nsph; i++) {
+    r = max(r, abs(Xsph[i]));
+    r = max(r, abs(Ysph[i]));
+    r = max(r, abs(Zsph[i]));
+  }
+  if ((2 * r >= Xsyssize) || (2 * r >= Ysyssize) || (2 * r >= Zsyssize))
+    return (1);
+
+  /***
+   *    Half width in x of the template row at each
+   *    (dy,dz), or -1 if there is none
+   ***/
+
+  np = 2 * r + 1;
+  nx = Xsyssize + 2 * r + 1;
+  rowdx = (int *)malloc(np * np * sizeof(int));
+  tot = (int *)malloc(2 * (size_t)np * Ysyssize * nx * sizeof(int));
+  if (!rowdx || !tot) {
+    if (rowdx)
+      free(rowdx);
+    if (tot)
+      free(tot);
+    return (1);
+  }
+
+  for (i = 0; i < np * np; i++)
+    rowdx[i] = -1;
+  for (i = 0; i < Nsph; i++) {
+    k = (Ysph[i] + r) * np + (Zsph[i] + r);
+    rowdx[k] = max(rowdx[k], Xsph[i]);
+  }
+
+  /***
+   *    Plane zz of totals, for zz from -r to Zsyssize+r-1
+   *    with periodic boundaries, goes in slot (zz+r)%np.
+   *    Totals 0 count porosity, totals 1 porosity or ph2.
+   ***/
+
+  for (zz = -r; zz < Zsyssize + r; zz++) {
+    slot = (zz + r) % np;
+    z = zz + checkbc(zz, Zsyssize);
+    for (y = 0; y < Ysyssize; y++) {
+      row = tot + ((size_t)slot * Ysyssize + y) * nx;
+      row1 = row + (size_t)np * Ysyssize * nx;
+      row[0] = row1[0] = 0;
+      for (i = 0; i < nx - 1; i++) {
+        x = i - r;
+        x += checkbc(x, Xsyssize);
+        val = Cemreal.val[getUChar3dindex(Cemreal, x, y, z)];
+        row[i + 1] = row[i] + (val == POROSITY);
+        row1[i + 1] = row1[i] + ((val == POROSITY) || (val == ph2));
+      }
+    }
+
+    /* Plane z now has all the totals it needs */
+
+    z = zz - r;
+    if (z < 0)
+      continue;
+
+    for (y = 0; y < Ysyssize; y++) {
+      for (x = 0; x < Xsyssize; x++) {
+        val = Cemreal.val[getUChar3dindex(Cemreal, x, y, z)];
+        if ((val != ph1) && (val != ph2))
+          continue;
+        k = (val == ph1) ? 0 : 1;
+
+        sum = 0;
+        for (dz = -r; dz <= r; dz++) {
+          slot = (z + dz + r) % np;
+          for (dy = -r; dy <= r; dy++) {
+            w = rowdx[(dy + r) * np + (dz + r)];
+            if (w < 0)
+              continue;
+            row = tot + (((size_t)k * np + slot) * Ysyssize +
+                         (y + dy + checkbc(y + dy, Ysyssize))) *
+                            nx;
+            sum += row[x + r + w + 1] - row[x + r - w];
+          }
+        }
+
+        /* A ph2 pixel does not count itself */
+
+        if (k == 1)
+          sum--;
+        Curvature[x][y][z] = sum;
+      }
+    }
+  }
+
+  free(rowdx);
+  free(tot);
+
+  return (0);
+}
+
 /***
  *    sysinit
  *
  *    Routine to initialize system by determining the
- *    local curvature of all phase ph1 and ph2 pixels
+ *    local curvature of all phase ph1 and ph2 pixels,
+ *    and putting each one in the list for its phase
+ *    and curvature
  *
  *    Arguments:    Phase ids of phase 1 and phase 2
  *    Returns:    Nothing
  *
- *    Calls:        countem
+ *    Calls:        curvfast, countem, sintadd, sintfree
  *    Called by:    runsint
  *
  ***/
 void sysinit(int ph1, int ph2) {
-  int count, xl, yl, zl;
+  int count, xl, yl, zl, p, fast;
   char buff[MAXSTRING];
 
   count = 0;
 
+  /* Use the pixel-by-pixel count only if curvfast cannot run */
+
+  fast = !curvfast(ph1, ph2);
+
+  sintfree();
+  Sintpos = (int *)malloc((size_t)Xsyssize * Ysyssize * Zsyssize * sizeof(int));
+  for (p = 0; p < 2; p++) {
+    Sintlist[p] = (int **)calloc(Nsph, sizeof(int *));
+    Sintcap[p] = (int *)calloc(Nsph, sizeof(int));
+  }
+  Sintnbin = Nsph;
+  if (!Sintpos || !Sintlist[0] || !Sintlist[1] || !Sintcap[0] ||
+      !Sintcap[1]) {
+    freedistrib3d();
+    bailout("distrib3d", "Memory allocation error for sintering lists");
+    exit(1);
+  }
+
   /* Process all pixels in the 3-D box */
 
   for (zl = 0; zl < Zsyssize; zl++) {
     for (yl = 0; yl < Ysyssize; yl++) {
       for (xl = 0; xl < Xsyssize; xl++) {
 
+        p = -1;
+
         /***
          *    Determine local curvature.  For phase 1,
          *    want to determine number of porosity
@@ -6304,8 +8836,8 @@ void sysinit(int ph1, int ph2) {
          *    immediate neighborhood
          ***/
 
-        if (Cemreal.val[getInt3dindex(Cemreal, xl, yl, zl)] == ph1) {
-          count = countem(xl, yl, zl, POROSITY);
+        if (Cemreal.val[getUChar3dindex(Cemreal, xl, yl, zl)] == ph1) {
+          count = fast ? Curvature[xl][yl][zl] : countem(xl, yl, zl, POROSITY);
         }
 
         /***
@@ -6314,8 +8846,8 @@ void sysinit(int ph1, int ph2) {
          *    immediate neighborhood
          ***/
 
-        if (Cemreal.val[getInt3dindex(Cemreal, xl, yl, zl)] == ph2) {
-          count = countem(xl, yl, zl, ph2);
+        if (Cemreal.val[getUChar3dindex(Cemreal, xl, yl, zl)] == ph2) {
+          count = fast ? Curvature[xl][yl][zl] : countem(xl, yl, zl, ph2);
         }
 
         if ((count < 0) || (count >= Nsph)) {
@@ -6331,13 +8863,13 @@ void sysinit(int ph1, int ph2) {
          ***/
 
         if ((count >= 0) &&
-            (Cemreal.val[getInt3dindex(Cemreal, xl, yl, zl)] == ph1)) {
+            (Cemreal.val[getUChar3dindex(Cemreal, xl, yl, zl)] == ph1)) {
 
           Curvature[xl][yl][zl] = count;
 
           /* Update solid curvature histogram */
 
-          Nsolid[count]++;
+          p = 0;
         }
 
         /***
@@ -6345,13 +8877,20 @@ void sysinit(int ph1, int ph2) {
          ***/
 
         if ((count >= 0) &&
-            (Cemreal.val[getInt3dindex(Cemreal, xl, yl, zl)] == ph2)) {
+            (Cemreal.val[getUChar3dindex(Cemreal, xl, yl, zl)] == ph2)) {
 
           Curvature[xl][yl][zl] = count;
 
           /* Update air curvature histogram */
 
-          Nair[count]++;
+          p = 1;
+        }
+
+        if ((p >= 0) &&
+            sintadd(p, count, getUChar3dindex(Cemreal, xl, yl, zl))) {
+          freedistrib3d();
+          bailout("distrib3d", "Memory allocation error for sintering lists");
+          exit(1);
         }
       }
     }
@@ -6396,9 +8935,9 @@ void sysscan(int ph1, int ph2) {
           exit(1);
         }
 
-        if (Cemreal.val[getInt3dindex(Cemreal, xd, yd, zd)] == ph2) {
+        if (Cemreal.val[getUChar3dindex(Cemreal, xd, yd, zd)] == ph2) {
           Nair[curvval]++;
-        } else if (Cemreal.val[getInt3dindex(Cemreal, xd, yd, zd)] == ph1) {
+        } else if (Cemreal.val[getUChar3dindex(Cemreal, xd, yd, zd)] == ph1) {
           Nsolid[curvval]++;
         }
       }
@@ -6408,6 +8947,224 @@ void sysscan(int ph1, int ph2) {
   return;
 }
 
+/***
+ *    sintadd
+ *
+ *    Routine to put a voxel at the end of the list for
+ *    its phase and curvature
+ *
+ *    Arguments:    Int list (0 for ph1, 1 for ph2), curvature
+ *                and Cemreal index of the voxel
+ *    Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        no other routines
+ *    Called by:    sysinit, sintmove
+ *
+ ***/
+int sintadd(int p, int c, int idx) {
+  int cap, *len, *list;
+
+  len = (p == 0) ? Nsolid : Nair;
+  if (len[c] >= Sintcap[p][c]) {
+    cap = (Sintcap[p][c] > 0) ? 2 * Sintcap[p][c] : 64;
+    list = (int *)realloc(Sintlist[p][c], cap * sizeof(int));
+    if (!list)
+      return (1);
+    Sintlist[p][c] = list;
+    Sintcap[p][c] = cap;
+  }
+
+  Sintpos[idx] = len[c];
+  Sintlist[p][c][len[c]++] = idx;
+
+  return (0);
+}
+
+/***
+ *    sintremove
+ *
+ *    Routine to take a voxel out of the list for its
+ *    phase and curvature, filling the hole with the
+ *    last voxel of the list
+ *
+ *    Arguments:    Int list (0 for ph1, 1 for ph2), curvature
+ *                and Cemreal index of the voxel
+ *    Returns:    Nothing
+ *
+ *    Calls:        no other routines
+ *    Called by:    sintmove
+ *
+ ***/
+void sintremove(int p, int c, int idx) {
+  int last, *len;
+
+  len = (p == 0) ? Nsolid : Nair;
+  last = Sintlist[p][c][--len[c]];
+  Sintlist[p][c][Sintpos[idx]] = last;
+  Sintpos[last] = Sintpos[idx];
+
+  return;
+}
+
+/***
+ *    sintmove
+ *
+ *    Routine to convert a voxel from ph1 to ph2 or back,
+ *    moving it to the list of the other phase and
+ *    updating the counts behind the hydraulic radius.
+ *    The curvature of the voxel stays as sysinit found it
+ *    unless Sinterupdate is set; then the voxel and the
+ *    ph2 voxels in its template get their new curvature,
+ *    which for a ph2 neighbor changes by one (ph1 counts
+ *    only porosity, which does not move).
+ *
+ *    Arguments:    Int Cemreal index of the voxel
+ *                Int phase id for phases 1 and 2
+ *    Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        surfpix, countem, checkbc, sintremove, sintadd
+ *    Called by:    movepix
+ *
+ ***/
+int sintmove(int idx, int ph1, int ph2) {
+  int x, y, z, c, p, i, xc, yc, zc, u, cu;
+
+  x = idx % Xsyssize;
+  y = (idx / Xsyssize) % Ysyssize;
+  z = idx / (Xsyssize * Ysyssize);
+  c = Curvature[x][y][z];
+  p = (Cemreal.val[idx] == ph1) ? 0 : 1;
+
+  sintremove(p, c, idx);
+
+  if (p == 0) {
+    setphase(idx, ph2);
+    Rhporc--;
+    Rhsurfc -= surfpix(x, y, z);
+  } else {
+    setphase(idx, ph1);
+    Rhporc++;
+    Rhsurfc += surfpix(x, y, z);
+  }
+
+  if (Sinterupdate) {
+    for (i = 0; i < Nsph; i++) {
+      xc = x + Xsph[i];
+      yc = y + Ysph[i];
+      zc = z + Zsph[i];
+      xc += checkbc(xc, Xsyssize);
+      yc += checkbc(yc, Ysyssize);
+      zc += checkbc(zc, Zsyssize);
+      if ((xc == x) && (yc == y) && (zc == z))
+        continue;
+
+      u = getUChar3dindex(Cemreal, xc, yc, zc);
+      if (Cemreal.val[u] == ph2) {
+        cu = Curvature[xc][yc][zc];
+        sintremove(1, cu, u);
+        cu += (p == 0) ? 1 : -1;
+        Curvature[xc][yc][zc] = cu;
+        if (sintadd(1, cu, u))
+          return (1);
+      }
+    }
+
+    c = countem(x, y, z, (p == 0) ? ph2 : POROSITY);
+    Curvature[x][y][z] = c;
+  }
+
+  return (sintadd(1 - p, c, idx));
+}
+
+/***
+ *    sintbufsize
+ *
+ *    Routine to make sure the scratch list of voxels
+ *    for movepix holds at least n entries
+ *
+ *    Arguments:    Int number of entries
+ *    Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        no other routines
+ *    Called by:    movepix
+ *
+ ***/
+int sintbufsize(int n) {
+  int *buf;
+
+  if (n <= Sintbufcap)
+    return (0);
+
+  buf = (int *)realloc(Sintbuf, n * sizeof(int));
+  if (!buf)
+    return (1);
+  Sintbuf = buf;
+  Sintbufcap = n;
+
+  return (0);
+}
+
+/***
+ *    sintcmp
+ *
+ *    Comparison of two Cemreal indices for qsort
+ *
+ *    Arguments:    Pointers to the two ints
+ *    Returns:    Negative, zero or positive as the first
+ *                is less than, equal to or greater than
+ *                the second
+ *
+ *    Calls:        no other routines
+ *    Called by:    movepix, through qsort
+ *
+ ***/
+int sintcmp(const void *a, const void *b) {
+  int ia, ib;
+
+  ia = *(const int *)a;
+  ib = *(const int *)b;
+
+  return ((ia > ib) - (ia < ib));
+}
+
+/***
+ *    sintfree
+ *
+ *    Releases the sintering lists
+ *
+ *    Arguments:    None
+ *    Returns:    Nothing
+ *
+ *    Calls:        no other routines
+ *    Called by:    sysinit, sinter3d, freedistrib3d
+ *
+ ***/
+void sintfree(void) {
+  int p, c;
+
+  for (p = 0; p < 2; p++) {
+    if (Sintlist[p]) {
+      for (c = 0; c < Sintnbin; c++) {
+        if (Sintlist[p][c])
+          free(Sintlist[p][c]);
+      }
+      free(Sintlist[p]);
+    }
+    if (Sintcap[p])
+      free(Sintcap[p]);
+    Sintlist[p] = NULL;
+    Sintcap[p] = NULL;
+  }
+  if (Sintpos)
+    free(Sintpos);
+  if (Sintbuf)
+    free(Sintbuf);
+  Sintpos = Sintbuf = NULL;
+  Sintbufcap = Sintnbin = 0;
+
+  return;
+}
+
 /***
  *    procsol
  *
@@ -6500,13 +9257,12 @@ int procair(int nsearch) {
  *                    = 0 if equilibrium was reached
  *                        before Rh could be reached
  *
- *    Calls:        procsol and procair
+ *    Calls:        procsol, procair, sintbufsize and sintmove
  *    Called by:    runsint
  *
  ***/
 int movepix(int ntomove, int ph1, int ph2) {
-  register int xp, yp, zp;
-  int count1, count2, ntot, countc, i;
+  int count1, count2, ntot, nborder, i, *border;
   int cmin, cmax, cfg, alldone;
   int nsolc, nairc, nsum, nsolm, nairm, nst1, nst2, next1, next2;
   float pck, plsol, plair;
@@ -6555,172 +9311,142 @@ int movepix(int ntomove, int ph1, int ph2) {
   cmin = count2;
 
   for (i = 0; i < count2; i++) {
-    if ((Nair[i] > 0) && (!cfg)) {
-      cfg = 1;
-      cmin = i;
-    }
-
-    nsum += Nair[i];
-  }
-
-  /***
-   *    Don't need to move all the ph2 pixels with
-   *    this value of curvature, so determine
-   *    movement probability for all ph2 pixels having
-   *    curvature in this bin of the Nsolid histogram
-   ***/
-
-  plair = (float)(ntomove - nsum) / (float)Nair[count2];
-  next2 = ntomove - nsum;
-  nst2 = Nair[count2];
-
-  /***
-   *    Check to see if equilibrium has been reached ---
-   *    if so, then no further increase in hydraulic
-   *    radius is possible
-   ***/
-
-  if (cmin >= cmax) {
-    alldone = 1;
-    if (Verbose)
-      fprintf(Logfile, "Stopping - at equilibrium \ncmin- %d  cmax- %d \n",
-              cmin, cmax);
-    return (alldone);
-  }
-
-  /* Initialize counters for performing sintering */
-
-  ntot = nsolc = nairc = nsolm = nairm = 0;
-
-  /* Now process each pixel in turn */
-
-  for (zp = 0; zp < Zsyssize; zp++) {
-    for (yp = 0; yp < Ysyssize; yp++) {
-      for (xp = 0; xp < Xsyssize; xp++) {
-
-        countc = Curvature[xp][yp][zp];
-
-        /* Handle ph1 case first */
-
-        if (Cemreal.val[getInt3dindex(Cemreal, xp, yp, zp)] == ph1) {
-
-          if (countc > count1) {
-
-            /***
-             *    Definitely convert from ph1 to ph2
-             ***/
-
-            Cemreal.val[getInt3dindex(Cemreal, xp, yp, zp)] = ph2;
-
-            /* Update appropriate histogram cells */
-
-            Nsolid[countc]--;
-            Nair[countc]++;
-            ntot++;
-
-            /* Store the location of the modified pixel */
-
-          } else if (countc == count1) {
-
-            /***
-             *    Borderline curvature... move based on
-             *    probability
-             ***/
-
-            nsolm++;
-
-            /***
-             *    Generate probability for pixel
-             *    being removed
-             ***/
-
-            pck = ran1(Seed);
-            if ((pck < 0) || (pck > 1.0))
-              pck = 1.0;
-
-            if (((pck < plsol) && (nsolc < next1)) ||
-                ((nst1 - nsolm) < (next1 - nsolc))) {
-
-              nsolc++;
-
-              /* Convert ph1 pixel to ph2 */
+    if ((Nair[i] > 0) && (!cfg)) {
+      cfg = 1;
+      cmin = i;
+    }
 
-              Cemreal.val[getInt3dindex(Cemreal, xp, yp, zp)] = ph2;
+    nsum += Nair[i];
+  }
 
-              /* Update appropriate histogram cells */
+  /***
+   *    Don't need to move all the ph2 pixels with
+   *    this value of curvature, so determine
+   *    movement probability for all ph2 pixels having
+   *    curvature in this bin of the Nsolid histogram
+   ***/
 
-              Nsolid[count1]--;
-              Nair[count1]++;
+  plair = (float)(ntomove - nsum) / (float)Nair[count2];
+  next2 = ntomove - nsum;
+  nst2 = Nair[count2];
 
-              /* Store the location of the modified pixel */
+  /***
+   *    Check to see if equilibrium has been reached ---
+   *    if so, then no further increase in hydraulic
+   *    radius is possible
+   ***/
 
-              ntot++;
-            }
-          }
+  if (cmin >= cmax) {
+    alldone = 1;
+    if (Verbose)
+      fprintf(Logfile, "Stopping - at equilibrium \ncmin- %d  cmax- %d \n",
+              cmin, cmax);
+    return (alldone);
+  }
 
-          /* Handle phase 2 case here */
+  /* Initialize counters for performing sintering */
 
-        } else if (Cemreal.val[getInt3dindex(Cemreal, xp, yp, zp)] == ph2) {
+  ntot = nsolc = nairc = nsolm = nairm = 0;
 
-          if (countc < count2) {
+  /***
+   *    Every ph1 pixel with curvature above count1 and
+   *    every ph2 pixel with curvature below count2 moves,
+   *    so gather them from their lists first
+   ***/
 
-            /***
-             *    Definitely convert ph2 pixel to ph1
-             ***/
+  nborder = Nsolid[count1] + Nair[count2];
+  for (i = count1 + 1; i < Nsph; i++)
+    ntot += Nsolid[i];
+  for (i = 0; i < count2; i++)
+    ntot += Nair[i];
 
-            Cemreal.val[getInt3dindex(Cemreal, xp, yp, zp)] = ph1;
+  if (sintbufsize(ntot + nborder)) {
+    freedistrib3d();
+    bailout("distrib3d", "Memory allocation error for sintering lists");
+    exit(1);
+  }
 
-            /* Update appropriate histogram cells */
+  ntot = 0;
+  for (i = count1 + 1; i < Nsph; i++) {
+    memcpy(Sintbuf + ntot, Sintlist[0][i], Nsolid[i] * sizeof(int));
+    ntot += Nsolid[i];
+  }
+  for (i = 0; i < count2; i++) {
+    memcpy(Sintbuf + ntot, Sintlist[1][i], Nair[i] * sizeof(int));
+    ntot += Nair[i];
+  }
 
-            Nsolid[countc]++;
-            Nair[countc]--;
+  /***
+   *    Borderline curvature... move based on probability.
+   *    The pixels are taken in the order of a scan of the
+   *    system, so the random numbers go to the same pixels
+   *    as a scan would give them.
+   ***/
 
-            /* Store the location of the modified pixel */
+  border = Sintbuf + ntot;
+  memcpy(border, Sintlist[0][count1], Nsolid[count1] * sizeof(int));
+  memcpy(border + Nsolid[count1], Sintlist[1][count2],
+         Nair[count2] * sizeof(int));
+  qsort(border, nborder, sizeof(int), sintcmp);
 
-            ntot++;
+  for (i = 0; i < nborder; i++) {
 
-          } else if (countc == count2) {
+    /* Handle ph1 case first */
 
-            /***
-             *    Borderline curvature... move based on
-             *    probability
-             ***/
+    if (Cemreal.val[border[i]] == ph1) {
 
-            nairm++;
+      nsolm++;
 
-            /***
-             *    Generate probability for pixel
-             *    being placed
-             ***/
+      /***
+       *    Generate probability for pixel
+       *    being removed
+       ***/
 
-            pck = ran1(Seed);
-            if ((pck < 0) || (pck > 1.0))
-              pck = 1.0;
+      pck = ran1(Seed);
+      if ((pck < 0) || (pck > 1.0))
+        pck = 1.0;
 
-            if (((pck < plair) && (nairc < next2)) ||
-                ((nst2 - nairm) < (next2 - nairc))) {
+      if (((pck < plsol) && (nsolc < next1)) ||
+          ((nst1 - nsolm) < (next1 - nsolc))) {
+        nsolc++;
+        Sintbuf[ntot++] = border[i];
+      }
 
-              nairc++;
+      /* Handle phase 2 case here */
 
-              /* Convert ph2 to ph1 */
+    } else {
 
-              Cemreal.val[getInt3dindex(Cemreal, xp, yp, zp)] = ph1;
+      nairm++;
 
-              /* Update appropriate histogram cells */
+      /***
+       *    Generate probability for pixel
+       *    being placed
+       ***/
 
-              Nsolid[count2]++;
-              Nair[count2]--;
+      pck = ran1(Seed);
+      if ((pck < 0) || (pck > 1.0))
+        pck = 1.0;
 
-              /* Store the location of the modified pixel */
+      if (((pck < plair) && (nairc < next2)) ||
+          ((nst2 - nairm) < (next2 - nairc))) {
+        nairc++;
+        Sintbuf[ntot++] = border[i];
+      }
+    }
+  }
 
-              ntot++;
-            }
-          }
-        }
+  /***
+   *    Now convert each gathered pixel to the other phase,
+   *    updating the histograms and lists
+   ***/
 
-      } /* end of zp loop */
-    } /* end of yp loop */
-  } /* end of xloop */
+  for (i = 0; i < ntot; i++) {
+    if (sintmove(Sintbuf[i], ph1, ph2)) {
+      freedistrib3d();
+      bailout("distrib3d", "Memory allocation error for sintering lists");
+      exit(1);
+    }
+  }
 
   if (Verbose)
     fprintf(Logfile, "ntot is %d \n", ntot);
@@ -6738,7 +9464,8 @@ int movepix(int ntomove, int ph1, int ph2) {
  *
  *    Returns:    Nothing
  *
- *    Calls:        maketemp, rhcalc, sysinit, sysscan, and movepix
+ *    Calls:        maketemp, rhcalc, rhvalue, sysinit, sysscan,
+ *                movepix and sintfree
  *    Called by:    main routine
  *
  ***/
@@ -6766,7 +9493,7 @@ void sinter3d(int ph1id, int ph2id, float rhtarget) {
     fprintf(Logfile, "Nsph is %d \n", Nsph);
     fprintf(Logfile, "Checking stats for C3S...");
     stat3d();
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   rflag = 0; /* always initialize system */
@@ -6785,7 +9512,7 @@ void sinter3d(int ph1id, int ph2id, float rhtarget) {
     fprintf(Logfile, "Entering rhcalc now...");
     fprintf(Logfile, "Checking stats for C3S...");
     stat3d();
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   rhnow = rhcalc(ph1id);
@@ -6804,7 +9531,7 @@ void sinter3d(int ph1id, int ph2id, float rhtarget) {
       fprintf(Logfile, "Out of movepix.");
       fprintf(Logfile, "Checking stats for C3S...");
       stat3d();
-      fflush(Logfile);
+      log_flush(Logfile);
     }
 
     /***
@@ -6812,8 +9539,10 @@ void sinter3d(int ph1id, int ph2id, float rhtarget) {
      *    to calling routine
      ***/
 
-    if (equilibrated)
+    if (equilibrated) {
+      sintfree();
       return;
+    }
 
     curvsum1 = curvsum2 = pixsum1 = pixsum2 = 0;
 
@@ -6832,15 +9561,17 @@ void sinter3d(int ph1id, int ph2id, float rhtarget) {
       fprintf(Logfile, "Ave. solid curvature: %f \nAve. air curvature: %f \n",
               avecurv1, avecurv2);
 
-    rhnow = rhcalc(ph1id);
+    rhnow = rhvalue(Rhporc, Rhsurfc);
     if (Verbose) {
       fprintf(Logfile, "Out of rhcalc.");
       fprintf(Logfile, "Checking stats for C3S...");
       stat3d();
-      fflush(Logfile);
+      log_flush(Logfile);
     }
   }
 
+  sintfree();
+
   return;
 }
 
@@ -6871,7 +9602,7 @@ void stat3d(void) {
   for (iz = 0; iz < Zsyssize; iz++) {
     for (iy = 0; iy < Ysyssize; iy++) {
       for (ix = 0; ix < Xsyssize; ix++) {
-        valin = Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)];
+        valin = Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)];
         Volume[valin]++;
         if (valin != POROSITY && valin != EMPTYP && valin != EMPTYDP &&
             valin != CRACKP && valin != DRIEDP) {
@@ -6930,7 +9661,7 @@ void stat3d(void) {
               break;
             }
 
-            if (Cemreal.val[getInt3dindex(Cemreal, ix1, iy1, iz1)] ==
+            if (Cemreal.val[getUChar3dindex(Cemreal, ix1, iy1, iz1)] ==
                 POROSITY) {
               Surface[valin]++;
             }
@@ -6984,7 +9715,7 @@ void stat3d(void) {
  *
  *    Returns:    0 if normal execution, non-zero if error occurred
  *
- *    Calls:        no other routines
+ *    Calls:        rand3dnoise, rand3dfft, trace_begin, trace_end
  *    Called by:    main routine
  *
  ***/
@@ -6997,9 +9728,13 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
   float s2, ss, sdiff, xtmp, ytmp, slope, intercept, diff;
   float val2, t1, t2, x1, x2, u1, xrad, resmax, resmin;
   float filval, radius, sect, sumtot, vcrit;
+  float ***res;
   int xtot;
   char buff[MAXSTRING], instring[MAXSTRING];
   FILE *corrfile;
+  Tracemark mark;
+
+  trace_begin(&mark, TRACEMAIN);
 
   /***
    *    Create the Gaussian noise image
@@ -7008,36 +9743,45 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
   if (Verbose)
     fprintf(Logfile, "\nEntering rand3d...\nVolin = %f", xpt);
 
-  i1 = i2 = i3 = 0;
-
-  for (i = 0; i < Xsyssize * Ysyssize * Zsyssize / 2; i++) {
+  /* OpenMP threads exist from here on (see distfork) */
 
-    u1 = ran1(Seed);
-    t1 = PI2 * ran1(Seed);
-    t2 = sqrt(-2.0 * log(u1));
-    x1 = cos(t1) * t2;
-    x2 = sin(t1) * t2;
-    Normm[i1][i2][i3] = x1;
+  if (DISTTHREADS > 1)
+    Distomp = 1;
 
-    i1++;
-    if (i1 >= Xsyssize) {
-      i1 = 0;
-      i2++;
-      if (i2 >= Ysyssize) {
-        i2 = 0;
-        i3++;
+  if (Nthreads > 0) {
+    rand3dnoise();
+  } else {
+    i1 = i2 = i3 = 0;
+
+    for (i = 0; i < Xsyssize * Ysyssize * Zsyssize / 2; i++) {
+
+      u1 = ran1(Seed);
+      t1 = PI2 * ran1(Seed);
+      t2 = sqrt(-2.0 * log(u1));
+      x1 = cos(t1) * t2;
+      x2 = sin(t1) * t2;
+      Normm[i1][i2][i3] = x1;
+
+      i1++;
+      if (i1 >= Xsyssize) {
+        i1 = 0;
+        i2++;
+        if (i2 >= Ysyssize) {
+          i2 = 0;
+          i3++;
+        }
       }
-    }
 
-    Normm[i1][i2][i3] = x2;
+      Normm[i1][i2][i3] = x2;
 
-    i1++;
-    if (i1 >= Xsyssize) {
-      i1 = 0;
-      i2++;
-      if (i2 >= Ysyssize) {
-        i2 = 0;
-        i3++;
+      i1++;
+      if (i1 >= Xsyssize) {
+        i1 = 0;
+        i2++;
+        if (i2 >= Ysyssize) {
+          i2 = 0;
+          i3++;
+        }
       }
     }
   }
@@ -7054,17 +9798,17 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
 
   /*** Skip over resolution information if it is given ***/
 
-  fprintf(Logfile, "\nIn rand3d, line 6032:  filecorr = %s, nskip = %d\n",
-          filecorr, nskip);
+  LOGDEBUG(Logfile, "\nIn rand3d, line 6032:  filecorr = %s, nskip = %d\n",
+           filecorr, nskip);
 
   for (i = 1; i <= nskip; i++) {
     fscanf(corrfile, "%s", buff);
   }
 
   fscanf(corrfile, "%s", instring);
-  fprintf(Logfile, "In rand3d, line 5969:  instring = %s\n", instring);
+  LOGDEBUG(Logfile, "In rand3d, line 5969:  instring = %s\n", instring);
   ido = atoi(instring);
-  fprintf(Logfile, "In rand3d, line 5971:  ido = %d\n", ido);
+  LOGDEBUG(Logfile, "In rand3d, line 5971:  ido = %d\n", ido);
 
   if (Verbose)
     fprintf(Logfile,
@@ -7078,18 +9822,18 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
    *    as specified by global variable Res
    ***/
 
-  fprintf(Logfile, "In rand3d, line 5982, Fsize = %d\n", Fsize);
+  LOGDEBUG(Logfile, "In rand3d, line 5982, Fsize = %d\n", Fsize);
   for (i = 0; i < ido; i++) {
     fscanf(corrfile, "%s", instring);
-    fprintf(Logfile, "In rand3d, line 5985, i = %d of %d:  instring = %s\n", i,
-            ido, instring);
+    LOGDEBUG(Logfile, "In rand3d, line 5985, i = %d of %d:  instring = %s\n", i,
+             ido, instring);
     valin = atoi(instring);
-    fprintf(Logfile, "In rand3d, line 5987:  valin = %d\n", valin);
+    LOGDEBUG(Logfile, "In rand3d, line 5987:  valin = %d\n", valin);
     fscanf(corrfile, "%s", instring);
-    fprintf(Logfile, "In rand3d, line 5989, i = %d of %d:  instring = %s\n", i,
-            ido, instring);
+    LOGDEBUG(Logfile, "In rand3d, line 5989, i = %d of %d:  instring = %s\n", i,
+             ido, instring);
     val2 = atof(instring);
-    fprintf(Logfile, "In rand3d, line 5991:  val2 = %f\n", val2);
+    LOGDEBUG(Logfile, "In rand3d, line 5991:  val2 = %f\n", val2);
 
     /***
      *    valin is the radial distance in micrometers.
@@ -7172,7 +9916,13 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
     }
   }
 
-  /* Now filter the image, maintaining periodic boundaries */
+  /***
+   *    Now filter the image, maintaining periodic boundaries.
+   *    The sum over the template at each pixel is a periodic
+   *    correlation of the noise with the filter, which is
+   *    done with FFTs when there are enough candidate pixels
+   *    to make that cheaper than the direct sum.
+   ***/
 
   if (Verbose)
     fprintf(Logfile,
@@ -7180,43 +9930,75 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
   resmax = 0.0;
   resmin = 1.0;
 
-  for (k = 0; k < Zsyssize; k++) {
-    for (j = 0; j < Ysyssize; j++) {
-      for (i = 0; i < Xsyssize; i++) {
+  if (rand3dfft(phasein, filter) == 0) {
+    res = Normm;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(DISTTHREADS) private(i, j)                      \
+    reduction(max : resmax) reduction(min : resmin)
+#endif
+    for (k = 0; k < Zsyssize; k++) {
+      for (j = 0; j < Ysyssize; j++) {
+        for (i = 0; i < Xsyssize; i++) {
+          if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == phasein) {
+            if (res[i][j][k] > resmax)
+              resmax = res[i][j][k];
+            if (res[i][j][k] < resmin)
+              resmin = res[i][j][k];
+          }
+        }
+      }
+    }
+  } else {
+    if (!Rres)
+      Rres = fbox(Xsyssize + 1, Ysyssize + 1, Zsyssize + 1);
+    if (!Rres) {
+      fprintf(Logfile, "\nERROR in rand3d: No memory for filtered image");
+      return (1);
+    }
+    res = Rres;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(DISTTHREADS) schedule(dynamic, 1)               \
+    private(i, j, ix, iy, iz, i1, j1, k1) reduction(max : resmax)              \
+    reduction(min : resmin)
+#endif
+    for (k = 0; k < Zsyssize; k++) {
+      for (j = 0; j < Ysyssize; j++) {
+        for (i = 0; i < Xsyssize; i++) {
 
-        Rres[i][j][k] = 0.0;
+          res[i][j][k] = 0.0;
 
-        /***
-         *    Only perform the filtering within regions
-         *    that are candidates for this phase
-         ***/
+          /***
+           *    Only perform the filtering within regions
+           *    that are candidates for this phase
+           ***/
 
-        if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] == phasein) {
+          if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == phasein) {
 
-          for (ix = 0; ix < Fsize; ix++) {
+            for (ix = 0; ix < Fsize; ix++) {
 
-            i1 = i + ix;
-            i1 += checkbc(i1, Xsyssize);
+              i1 = i + ix;
+              i1 += checkbc(i1, Xsyssize);
 
-            for (iy = 0; iy < Fsize; iy++) {
+              for (iy = 0; iy < Fsize; iy++) {
 
-              j1 = j + iy;
-              j1 += checkbc(j1, Ysyssize);
+                j1 = j + iy;
+                j1 += checkbc(j1, Ysyssize);
 
-              for (iz = 0; iz < Fsize; iz++) {
+                for (iz = 0; iz < Fsize; iz++) {
 
-                k1 = k + iz;
-                k1 += checkbc(k1, Zsyssize);
+                  k1 = k + iz;
+                  k1 += checkbc(k1, Zsyssize);
 
-                Rres[i][j][k] += Normm[i1][j1][k1] * filter[ix][iy][iz];
+                  res[i][j][k] += Normm[i1][j1][k1] * filter[ix][iy][iz];
+                }
               }
             }
-          }
 
-          if (Rres[i][j][k] > resmax)
-            resmax = Rres[i][j][k];
-          if (Rres[i][j][k] < resmin)
-            resmin = Rres[i][j][k];
+            if (res[i][j][k] > resmax)
+              resmax = res[i][j][k];
+            if (res[i][j][k] < resmin)
+              resmin = res[i][j][k];
+          }
         }
       }
     }
@@ -7229,7 +10011,7 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
 
   /***
    *    Now threshold the image by creating a histogram
-   *    of the values of Rres[i][j][k] and determining
+   *    of the values of res[i][j][k] and determining
    *    a cutoff bin to define the phase
    **/
 
@@ -7238,6 +10020,10 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
   }
 
   xtot = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(DISTTHREADS) private(i, j, index)               \
+    reduction(+ : xtot) reduction(+ : Sum[1 : Hsize_r])
+#endif
   for (k = 0; k < Zsyssize; k++) {
     for (j = 0; j < Ysyssize; j++) {
       for (i = 0; i < Xsyssize; i++) {
@@ -7247,7 +10033,7 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
          *    that are candidates for this phase
          ***/
 
-        if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] == phasein) {
+        if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == phasein) {
           xtot++;
 
           /***
@@ -7255,7 +10041,7 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
            *    the pixel to the statistics
            ***/
 
-          index = 1 + (int)((Rres[i][j][k] - resmin) / sect);
+          index = 1 + (int)((res[i][j][k] - resmin) / sect);
 
           if (index > Hsize_r)
             index = Hsize_r;
@@ -7293,14 +10079,17 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
     fprintf(Logfile, "Critical volume fraction is %f\n\tVolin = %f", vcrit,
             xpt);
 
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(DISTTHREADS) private(i, j)
+#endif
   for (k = 0; k < Zsyssize; k++) {
     for (j = 0; j < Ysyssize; j++) {
       for (i = 0; i < Xsyssize; i++) {
 
-        if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] == phasein) {
+        if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == phasein) {
 
-          if (Rres[i][j][k] > vcrit) {
-            Cemreal.val[getInt3dindex(Cemreal, i, j, k)] = phaseout;
+          if (res[i][j][k] > vcrit) {
+            Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] = phaseout;
           }
         }
       }
@@ -7309,6 +10098,190 @@ int rand3d(int phasein, int phaseout, char filecorr[MAXSTRING], int nskip,
 
   if (Verbose)
     fprintf(Logfile, "\n\tVolin = %f", xpt);
+  trace_end(&mark, "rand3d", TRACEMAIN);
+  return (0);
+}
+
+/***
+ *    rand3dnoise
+ *
+ *    Fill Normm with Gaussian noise for rand3d when it runs
+ *    with --threads.  Each x plane is drawn by the Box-Muller
+ *    method from its own stream of the explicit-state
+ *    generator, all taken from one seed drawn with ran1, so
+ *    the planes can be filled in any order and on any number
+ *    of threads with the same result.
+ *
+ *    Arguments:    None
+ *    Returns:    Nothing
+ *
+ *    Calls:        ran1, rng_stream, rng_uniform
+ *    Called by:    rand3d
+ ***/
+void rand3dnoise(void) {
+  int i, j, k, n, nplane;
+  double u1, t1, t2;
+  uint64_t seed;
+  Rngstate st;
+
+  seed = (uint64_t)(ran1(Seed) * 4294967296.0);
+  seed = (seed << 32) ^ (uint64_t)(ran1(Seed) * 4294967296.0);
+  nplane = Ysyssize * Zsyssize;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(DISTTHREADS) schedule(dynamic, 1)               \
+    private(j, k, n, u1, t1, t2, st)
+#endif
+  for (i = 0; i < Xsyssize; i++) {
+    rng_stream(&st, seed, i);
+    for (n = 0; n < nplane; n += 2) {
+      u1 = 1.0 - rng_uniform(&st);
+      t1 = PI2 * rng_uniform(&st);
+      t2 = sqrt(-2.0 * log(u1));
+      j = n % Ysyssize;
+      k = n / Ysyssize;
+      Normm[i][j][k] = cos(t1) * t2;
+      if (n + 1 < nplane) {
+        j = (n + 1) % Ysyssize;
+        k = (n + 1) / Ysyssize;
+        Normm[i][j][k] = sin(t1) * t2;
+      }
+    }
+  }
+
+  return;
+}
+
+/***
+ *    rand3dfft
+ *
+ *    Filter the noise image for rand3d with FFTs.  The
+ *    filtered value at each pixel is the sum of Normm over
+ *    the template starting there, weighted by filter, which
+ *    is the periodic correlation of Normm with filter.  Both
+ *    are real, so they are put in one transform, the noise
+ *    as the real part and the filter as the imaginary part,
+ *    and their spectra are separated afterwards.  The noise
+ *    is then no longer needed, so the filtered values of the
+ *    candidate pixels replace it in Normm (0 elsewhere).
+ *
+ *    The transforms are only used when the direct sum over
+ *    the candidate pixels would take longer, reckoning ten
+ *    operations per point per log2 of the image size for
+ *    the two transforms.
+ *
+ *    Arguments:    int phase id of the candidate pixels
+ *                float pointer to filter (Fsize in each
+ *                direction)
+ *
+ *    Returns:    0 if Normm was filtered, nonzero if rand3d must
+ *                do the direct sum instead
+ *
+ *    Calls:        fft3d_alloc, fft3d_forward, fft3d_inverse
+ *    Called by:    rand3d
+ ***/
+int rand3dfft(int phasein, float ***filter) {
+  int i, j, k, mi, mj, mk, ntot;
+  double ncand, ar, ai, br, bi, nr, ni, dr, di, pr, pim;
+
+  ntot = Xsyssize * Ysyssize * Zsyssize;
+  ncand = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(DISTTHREADS) reduction(+ : ncand)
+#endif
+  for (i = 0; i < ntot; i++) {
+    if (Cemreal.val[i] == phasein)
+      ncand += 1.0;
+  }
+  if (ncand * Fsize * Fsize * Fsize <= 10.0 * ntot * log2((double)ntot))
+    return (1);
+
+  if (Rfftok == 0) {
+    Rfftok = fft3d_alloc(&Rfft, Xsyssize, Ysyssize, Zsyssize, Nthreads) ? -1 : 1;
+    if (Rfftok < 0)
+      fprintf(Logfile, "\nWARNING: No memory for FFT filtering in rand3d; "
+                       "using the direct sum");
+  }
+  if (Rfftok < 0)
+    return (1);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(DISTTHREADS) private(j, k)
+#endif
+  for (i = 0; i < Xsyssize; i++) {
+    for (j = 0; j < Ysyssize; j++) {
+      for (k = 0; k < Zsyssize; k++) {
+        FFTRE(&Rfft, i, j, k) = Normm[i][j][k];
+        FFTIM(&Rfft, i, j, k) = 0.0;
+      }
+    }
+  }
+  for (i = 0; i < Fsize; i++) {
+    for (j = 0; j < Fsize; j++) {
+      for (k = 0; k < Fsize; k++) {
+        FFTIM(&Rfft, i, j, k) = filter[i][j][k];
+      }
+    }
+  }
+
+  fft3d_forward(&Rfft);
+
+  /***
+   *    With Z the joint spectrum, the noise spectrum is
+   *    N = (Z(q) + conj(Z(-q)))/2 and the filter spectrum is
+   *    F = (Z(q) - conj(Z(-q)))/2i.  The correlation has
+   *    spectrum N conj(F), whose value at -q is the complex
+   *    conjugate of that at q, so q and -q are done together.
+   ***/
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(DISTTHREADS) private(j, k, mi, mj, mk, ar, ai,  \
+                                                    br, bi, nr, ni, dr, di, pr, \
+                                                    pim)
+#endif
+  for (i = 0; i < Xsyssize; i++) {
+    mi = (Xsyssize - i) % Xsyssize;
+    for (j = 0; j < Ysyssize; j++) {
+      mj = (Ysyssize - j) % Ysyssize;
+      for (k = 0; k < Zsyssize; k++) {
+        mk = (Zsyssize - k) % Zsyssize;
+        if (&FFTRE(&Rfft, mi, mj, mk) < &FFTRE(&Rfft, i, j, k))
+          continue;
+        ar = FFTRE(&Rfft, i, j, k);
+        ai = FFTIM(&Rfft, i, j, k);
+        br = FFTRE(&Rfft, mi, mj, mk);
+        bi = -FFTIM(&Rfft, mi, mj, mk);
+        nr = 0.5 * (ar + br);
+        ni = 0.5 * (ai + bi);
+        dr = 0.5 * (ar - br);
+        di = 0.5 * (ai - bi);
+        pr = nr * di - ni * dr;
+        pim = nr * dr + ni * di;
+        FFTRE(&Rfft, i, j, k) = pr;
+        FFTIM(&Rfft, i, j, k) = pim;
+        FFTRE(&Rfft, mi, mj, mk) = pr;
+        FFTIM(&Rfft, mi, mj, mk) = -pim;
+      }
+    }
+  }
+
+  fft3d_inverse(&Rfft);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(DISTTHREADS) private(j, k)
+#endif
+  for (i = 0; i < Xsyssize; i++) {
+    for (j = 0; j < Ysyssize; j++) {
+      for (k = 0; k < Zsyssize; k++) {
+        if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == phasein) {
+          Normm[i][j][k] = FFTRE(&Rfft, i, j, k) / (double)ntot;
+        } else {
+          Normm[i][j][k] = 0.0;
+        }
+      }
+    }
+  }
+
   return (0);
 }
 
@@ -7379,23 +10352,23 @@ int addonepixels(void) {
         for (k = 0; k < Zsyssize; k++) {
           for (j = 0; j < Ysyssize; j++) {
             for (i = 0; i < Xsyssize; i++) {
-              if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] == C3S) {
+              if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == C3S) {
                 totclinkpix++;
                 tot[C3S]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] == C2S) {
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == C2S) {
                 totclinkpix++;
                 tot[C2S]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] == C3A) {
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == C3A) {
                 totclinkpix++;
                 tot[C3A]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] == C4AF) {
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == C4AF) {
                 totclinkpix++;
                 tot[C4AF]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] ==
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] ==
                          K2SO4) {
                 totclinkpix++;
                 tot[K2SO4]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] ==
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] ==
                          NA2SO4) {
                 totclinkpix++;
                 tot[NA2SO4]++;
@@ -7504,25 +10477,25 @@ int addonepixels(void) {
         for (k = 0; k < Zsyssize; k++) {
           for (j = 0; j < Ysyssize; j++) {
             for (i = 0; i < Xsyssize; i++) {
-              if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] == ASG) {
+              if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == ASG) {
                 totfapix++;
                 tot[ASG]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] == CAS2) {
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] == CAS2) {
                 totfapix++;
                 tot[CAS2]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] ==
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] ==
                          FAC3A) {
                 totfapix++;
                 tot[FAC3A]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] ==
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] ==
                          CACL2) {
                 totfapix++;
                 tot[CACL2]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] ==
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] ==
                          AMSIL) {
                 totfapix++;
                 tot[AMSIL]++;
-              } else if (Cemreal.val[getInt3dindex(Cemreal, i, j, k)] ==
+              } else if (Cemreal.val[getUChar3dindex(Cemreal, i, j, k)] ==
                          ANHYDRITE) {
                 totfapix++;
                 tot[ANHYDRITE]++;
@@ -7717,6 +10690,12 @@ int addonepixels(void) {
  *     Add nneed one-pixel elements of phase randid at random
  *     locations in the microstructure
  *
+ *     With Densesample set, the sites are drawn from a list of
+ *     the pore voxels made once per call, so the cost does not
+ *     grow as the box fills up.  A drawn entry that is no longer
+ *     porosity (the landing site of an earlier flocculated
+ *     pixel) is dropped from the list and another is drawn.
+ *
  *     Arguments:    int phase id
  *                 int number to place
  *                 int flocculate (1) or not (0)
@@ -7724,17 +10703,70 @@ int addonepixels(void) {
  *
  *     Returns:    nothing
  *
- *    Calls:        no other routines
+ *    Calls:        placeonepix
  *    Called by:    main program
  ***/
 void addrand(int randid, int nneed, int onepixfloc, int assignpartnum) {
-  int inc, ic, success, ix, iy, iz, dim, dir, newsite, oldval;
+  int ic, success, ix, iy, iz, val, nsite, k;
+  int *site = NULL;
+  size_t n, nvox;
 
   /***
    *    Add number of requested phase pixels at
    *    random pore locations
    ***/
 
+  if (Densesample && (nneed > 0)) {
+    nvox = (size_t)Xsyssize * (size_t)Ysyssize * (size_t)Zsyssize;
+    site = (int *)malloc(nvox * sizeof(int));
+    if (!site) {
+      fprintf(Logfile, "\nWARNING: No room for a list of pore sites;");
+      fprintf(Logfile, " placing pixels by random trial instead");
+    } else {
+      nsite = 0;
+      for (n = 0; n < nvox; n++) {
+        val = Cemreal.val[n];
+        if (val == POROSITY || val == CRACKP)
+          site[nsite++] = (int)n;
+      }
+
+      for (ic = 1; (ic <= nneed) && (nsite > 0); ic++) {
+        success = 0;
+
+        while (!success && (nsite > 0)) {
+          k = (int)((double)nsite * ran1(Seed));
+          if (k >= nsite)
+            k = nsite - 1;
+
+          /* getInt3dindex order: x varies fastest, then y, then z */
+
+          ix = site[k] % Xsyssize;
+          iy = (site[k] / Xsyssize) % Ysyssize;
+          iz = site[k] / (Xsyssize * Ysyssize);
+          val = Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)];
+
+          if (val == POROSITY || val == CRACKP) {
+            success = 1;
+            if (placeonepix(ix, iy, iz, randid, onepixfloc, assignpartnum))
+              continue;
+          }
+
+          /* Site is taken now; swap the last entry into its place */
+
+          site[k] = site[--nsite];
+        }
+      }
+
+      free(site);
+      if (ic <= nneed) {
+        fprintf(Logfile, "\nWARNING: No porosity left for %d one-pixel",
+                nneed - ic + 1);
+        fprintf(Logfile, " particles of phase %d", randid);
+      }
+      return;
+    }
+  }
+
   for (ic = 1; ic <= nneed; ic++) {
     success = 0;
 
@@ -7751,105 +10783,135 @@ void addrand(int randid, int nneed, int onepixfloc, int assignpartnum) {
       if (iz == Zsyssize)
         iz = 0;
 
-      if (Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] == POROSITY ||
-          Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] == CRACKP) {
-        oldval = Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)];
-        Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] = randid;
+      if (Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)] == POROSITY ||
+          Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)] == CRACKP) {
+        placeonepix(ix, iy, iz, randid, onepixfloc, assignpartnum);
+        success = 1;
+      }
+    }
+  }
+  return;
+}
+
+/***
+ *    placeonepix
+ *
+ *     Put a one-pixel particle of phase randid in the pore
+ *     voxel (ix,iy,iz) and, if asked, flocculate it to the
+ *     nearest solid surface in a random direction
+ *
+ *     Arguments:    int location coordinates (ix,iy,iz)
+ *                 int phase id
+ *                 int flocculate (1) or not (0)
+ *                 int whether or not to assign a particle number
+ *
+ *     Returns:    1 if the particle flew away from (ix,iy,iz),
+ *                 which is left as porosity, 0 otherwise
+ *
+ *    Calls:        ran1, checkbc
+ *    Called by:    addrand
+ ***/
+int placeonepix(int ix, int iy, int iz, int randid, int onepixfloc,
+                int assignpartnum) {
+  int inc, dim, dir, newsite, oldval, moved = 0;
+
+  oldval = Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)];
+  setphase(getUChar3dindex(Cemreal, ix, iy, iz), randid);
+  if (assignpartnum) {
+    Npart++;
+    Cement.val[getInt3dindex(Cement, ix, iy, iz)] = Npart;
+  }
+  if (onepixfloc == 1) {
+    /***
+     * Flocculate this particle to a nearby surface
+     * Pic a random direction to fly
+     ***/
+    dim = (int)(3.0 * ran1(Seed));
+    dir = (int)(2.0 * ran1(Seed));
+    inc = (dir == 0) ? 1 : -1;
+
+    switch (dim) {
+    case 0: /* X-direction flight */
+      newsite = ix + inc;
+      newsite += checkbc(newsite, Xsyssize);
+      while ((newsite != ix) &&
+             ((Cemreal.val[getUChar3dindex(Cemreal, newsite, iy, iz)] ==
+               POROSITY) ||
+              (Cemreal.val[getUChar3dindex(Cemreal, newsite, iy, iz)] ==
+               CRACKP))) {
+        newsite += inc;
+        newsite += checkbc(newsite, Xsyssize);
+      }
+      if (newsite != ix) {
+        moved = 1;
+        newsite -= inc;
+        newsite += checkbc(newsite, Xsyssize);
+        setphase(getUChar3dindex(Cemreal, newsite, iy, iz),
+                 Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)]);
+        setphase(getUChar3dindex(Cemreal, ix, iy, iz), oldval);
         if (assignpartnum) {
-          Npart++;
-          Cement.val[getInt3dindex(Cement, ix, iy, iz)] = Npart;
+          Cement.val[getInt3dindex(Cement, newsite, iy, iz)] =
+              Cement.val[getInt3dindex(Cement, ix, iy, iz)];
+          Cement.val[getInt3dindex(Cement, ix, iy, iz)] = 0;
         }
-        success = 1;
-        if (onepixfloc == 1) {
-          /***
-           * Flocculate this particle to a nearby surface
-           * Pic a random direction to fly
-           ***/
-          dim = (int)(3.0 * ran1(Seed));
-          dir = (int)(2.0 * ran1(Seed));
-          inc = (dir == 0) ? 1 : -1;
-
-          switch (dim) {
-          case 0: /* X-direction flight */
-            newsite = ix + inc;
-            newsite += checkbc(newsite, Xsyssize);
-            while ((newsite != ix) &&
-                   ((Cemreal.val[getInt3dindex(Cemreal, newsite, iy, iz)] ==
-                     POROSITY) ||
-                    (Cemreal.val[getInt3dindex(Cemreal, newsite, iy, iz)] ==
-                     CRACKP))) {
-              newsite += inc;
-              newsite += checkbc(newsite, Xsyssize);
-            }
-            if (newsite != ix) {
-              newsite -= inc;
-              newsite += checkbc(newsite, Xsyssize);
-              Cemreal.val[getInt3dindex(Cemreal, newsite, iy, iz)] =
-                  Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)];
-              Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] = oldval;
-              if (assignpartnum) {
-                Cement.val[getInt3dindex(Cement, newsite, iy, iz)] =
-                    Cement.val[getInt3dindex(Cement, ix, iy, iz)];
-                Cement.val[getInt3dindex(Cement, ix, iy, iz)] = 0;
-              }
-            }
-            break;
-          case 1: /* Y-direction flight */
-            newsite = iy + inc;
-            newsite += checkbc(newsite, Ysyssize);
-            while ((newsite != iy) &&
-                   ((Cemreal.val[getInt3dindex(Cemreal, ix, newsite, iz)] ==
-                     POROSITY) ||
-                    (Cemreal.val[getInt3dindex(Cemreal, ix, newsite, iz)] ==
-                     CRACKP))) {
-              newsite += inc;
-              newsite += checkbc(newsite, Ysyssize);
-            }
-            if (newsite != iy) {
-              newsite -= inc;
-              newsite += checkbc(newsite, Ysyssize);
-              Cemreal.val[getInt3dindex(Cemreal, ix, newsite, iz)] =
-                  Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)];
-              Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] = oldval;
-              if (assignpartnum) {
-                Cement.val[getInt3dindex(Cement, ix, newsite, iz)] =
-                    Cement.val[getInt3dindex(Cement, ix, iy, iz)];
-                Cement.val[getInt3dindex(Cement, ix, iy, iz)] = 0;
-              }
-            }
-            break;
-          case 2: /* Z-direction flight */
-            newsite = iz + inc;
-            newsite += checkbc(newsite, Zsyssize);
-            while ((newsite != iz) &&
-                   ((Cemreal.val[getInt3dindex(Cemreal, ix, iy, newsite)] ==
-                     POROSITY) ||
-                    (Cemreal.val[getInt3dindex(Cemreal, ix, iy, newsite)] ==
-                     CRACKP))) {
-              newsite += inc;
-              newsite += checkbc(newsite, Zsyssize);
-            }
-            if (newsite != iz) {
-              newsite -= inc;
-              newsite += checkbc(newsite, Zsyssize);
-              Cemreal.val[getInt3dindex(Cemreal, ix, iy, newsite)] =
-                  Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)];
-              Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] = oldval;
-              if (assignpartnum) {
-                Cement.val[getInt3dindex(Cement, ix, iy, newsite)] =
-                    Cement.val[getInt3dindex(Cement, ix, iy, iz)];
-                Cement.val[getInt3dindex(Cement, ix, iy, iz)] = 0;
-              }
-            }
-            break;
-          case 3: /* Do nothing */
-            break;
-          }
+      }
+      break;
+    case 1: /* Y-direction flight */
+      newsite = iy + inc;
+      newsite += checkbc(newsite, Ysyssize);
+      while ((newsite != iy) &&
+             ((Cemreal.val[getUChar3dindex(Cemreal, ix, newsite, iz)] ==
+               POROSITY) ||
+              (Cemreal.val[getUChar3dindex(Cemreal, ix, newsite, iz)] ==
+               CRACKP))) {
+        newsite += inc;
+        newsite += checkbc(newsite, Ysyssize);
+      }
+      if (newsite != iy) {
+        moved = 1;
+        newsite -= inc;
+        newsite += checkbc(newsite, Ysyssize);
+        setphase(getUChar3dindex(Cemreal, ix, newsite, iz),
+                 Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)]);
+        setphase(getUChar3dindex(Cemreal, ix, iy, iz), oldval);
+        if (assignpartnum) {
+          Cement.val[getInt3dindex(Cement, ix, newsite, iz)] =
+              Cement.val[getInt3dindex(Cement, ix, iy, iz)];
+          Cement.val[getInt3dindex(Cement, ix, iy, iz)] = 0;
+        }
+      }
+      break;
+    case 2: /* Z-direction flight */
+      newsite = iz + inc;
+      newsite += checkbc(newsite, Zsyssize);
+      while ((newsite != iz) &&
+             ((Cemreal.val[getUChar3dindex(Cemreal, ix, iy, newsite)] ==
+               POROSITY) ||
+              (Cemreal.val[getUChar3dindex(Cemreal, ix, iy, newsite)] ==
+               CRACKP))) {
+        newsite += inc;
+        newsite += checkbc(newsite, Zsyssize);
+      }
+      if (newsite != iz) {
+        moved = 1;
+        newsite -= inc;
+        newsite += checkbc(newsite, Zsyssize);
+        setphase(getUChar3dindex(Cemreal, ix, iy, newsite),
+                 Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)]);
+        setphase(getUChar3dindex(Cemreal, ix, iy, iz), oldval);
+        if (assignpartnum) {
+          Cement.val[getInt3dindex(Cement, ix, iy, newsite)] =
+              Cement.val[getInt3dindex(Cement, ix, iy, iz)];
+          Cement.val[getInt3dindex(Cement, ix, iy, iz)] = 0;
         }
       }
+      break;
+    case 3: /* Do nothing */
+      break;
     }
   }
-  return;
+
+  return (moved);
 }
 
 /***
@@ -7864,24 +10926,28 @@ void addrand(int randid, int nneed, int onepixfloc, int assignpartnum) {
  *    Arguments:    None
  *    Returns:    Nothing
  *
- *    Calls:        free_ivector, free_fvector, free_fcube
+ *    Calls:        free_ivector, free_fvector, free_fcube, freeshapeset
  *    Called by:    main,dissolve
  *
  ***/
 void freegenmic(void) {
   register int i;
 
+  trace_close();
+
   if (Cement.val)
     free_Int3darray(&Cement);
 
   if (Cemreal.val)
-    free_Int3darray(&Cemreal);
+    free_UChar3darray(&Cemreal);
 
   if (Bbox.val)
     free_Int3darray(&Bbox);
 
-  if (Particle)
+  if (Particle) {
     free_particlepointervector(Particle);
+    Particle = NULL;
+  }
 
   for (i = 0; i < NSPHASES; i++) {
     if (Verbose) {
@@ -7890,7 +10956,7 @@ void freegenmic(void) {
       } else {
         fprintf(Logfile, "\nPhase_shape[%d].xg vector is freed already", i);
       }
-      fflush(Logfile);
+      log_flush(Logfile);
     }
     if (Phase_shape[i].xg)
       free_fvector(Phase_shape[i].xg);
@@ -7901,7 +10967,7 @@ void freegenmic(void) {
       } else {
         fprintf(Logfile, "\nPhase_shape[%d].wg vector is freed already", i);
       }
-      fflush(Logfile);
+      log_flush(Logfile);
     }
     if (Phase_shape[i].wg)
       free_fvector(Phase_shape[i].wg);
@@ -7913,10 +10979,20 @@ void freegenmic(void) {
     } else {
       fprintf(Logfile, "\nY complexmatrix is freed already");
     }
-    fflush(Logfile);
+    log_flush(Logfile);
   }
   if (Y)
     free_complexmatrix(Y, 0, Nnn, -Nnn, Nnn);
+  shgrid_free(&Shapegrid);
+  for (i = 0; i < Nshapelib; i++) {
+    freeshapeset(&Shapelib[i]);
+  }
+  Nshapelib = 0;
+  ptemplate_freeall();
+  occfree();
+  edtfree();
+  sphfree();
+  batchfree();
 
   if (Verbose) {
     if (A) {
@@ -7924,14 +11000,14 @@ void freegenmic(void) {
     } else {
       fprintf(Logfile, "\nA complexmatrix is freed already");
     }
-    fflush(Logfile);
+    log_flush(Logfile);
   }
   if (A)
     free_complexmatrix(A, 0, Nnn, -Nnn, Nnn);
 
   if (Verbose) {
     fprintf(Logfile, "\nDone freeing all the memory I know about");
-    fflush(Logfile);
+    log_flush(Logfile);
   }
 
   return;
@@ -7949,7 +11025,8 @@ void freegenmic(void) {
  *    Arguments:    None
  *    Returns:    Nothing
  *
- *    Calls:        free_ivector, free_fvector, free_fcube
+ *    Calls:        free_ivector, free_fvector, free_fcube,
+ *                fft3d_free, sintfree
  *    Called by:    distrib3d
  *
  ***/
@@ -7968,12 +11045,16 @@ void freedistrib3d(void) {
     free_ivector(Nair);
   if (Curvature)
     free_usibox(Curvature, Xsyssize + 1, Ysyssize + 1);
+  sintfree();
   if (Sum)
     free_ivector(Sum);
   if (Normm)
     free_fbox(Normm, Xsyssize + 1, Ysyssize + 1);
   if (Rres)
     free_fbox(Rres, Xsyssize + 1, Ysyssize + 1);
+  if (Rfftok > 0)
+    fft3d_free(&Rfft);
+  Rfftok = 0;
 
   return;
 }
@@ -8013,10 +11094,9 @@ void allmem(void) {
   Curvature = usibox(Xsyssize + 1, Ysyssize + 1, Zsyssize + 1);
   Sum = ivector(Hsize_r + 2);
   Normm = fbox(Xsyssize + 1, Ysyssize + 1, Zsyssize + 1);
-  Rres = fbox(Xsyssize + 1, Ysyssize + 1, Zsyssize + 1);
 
   if (!R || !S || !Xr || !Filter || !Nsolid || !Nair || !Curvature || !Sum ||
-      !Normm || !Rres) {
+      !Normm) {
 
     freedistrib3d();
     bailout("distrib3d", "Memory allocation failure");
@@ -8027,6 +11107,86 @@ void allmem(void) {
   return;
 }
 
+/***
+ *    distfapix
+ *
+ *    Distribute fly ash phases pixel by pixel for distfa when
+ *    genmic runs with --threads.  Each z plane of Cemreal is
+ *    contiguous, so its uniform deviates are drawn all at once
+ *    from its own stream of the explicit-state generator, all
+ *    taken from one seed drawn with ran1, and the plane is then
+ *    rewritten in one pass.  The phase of a pixel is found by
+ *    counting the cumulative probabilities its deviate reaches,
+ *    with no branches, so the result is the same as the chain
+ *    of comparisons in distfa and does not depend on the number
+ *    of threads.
+ *
+ *    Arguments:    float pointer to the six cumulative
+ *                probabilities of ASG, CACL2, AMSIL, ANHYDRITE,
+ *                CAS2 and FAC3A, in that order; the rest is INERT
+ *    Returns:    0 if okay, 1 if out of memory
+ *
+ *    Calls:        ran1, rng_stream, rng_fill
+ *    Called by:    distfa
+ ***/
+int distfapix(float *cumprob) {
+  int iz, m, k, nplane, fail;
+  unsigned char *row;
+  float u, cum[6];
+  double *buf;
+  uint64_t seed;
+  Rngstate st;
+  const int phout[7] = {ASG, CACL2, AMSIL, ANHYDRITE, CAS2, FAC3A, INERT};
+
+  /***
+   *    Counting is only the same as taking the first
+   *    probability above the deviate when the table does
+   *    not decrease, so carry the largest value forward
+   ***/
+
+  cum[0] = cumprob[0];
+  for (m = 1; m < 6; m++) {
+    cum[m] = max(cumprob[m], cum[m - 1]);
+  }
+
+  seed = (uint64_t)(ran1(Seed) * 4294967296.0);
+  seed = (seed << 32) ^ (uint64_t)(ran1(Seed) * 4294967296.0);
+  nplane = Xsyssize * Ysyssize;
+
+  fail = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(DISTTHREADS) private(iz, m, k, u, row, buf,  \
+                                                         st) reduction(| : fail)
+#endif
+  {
+    buf = (double *)malloc((size_t)nplane * sizeof(double));
+    if (!buf)
+      fail = 1;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (iz = 0; iz < Zsyssize; iz++) {
+      if (!buf)
+        continue;
+      rng_stream(&st, seed, iz);
+      rng_fill(&st, buf, (size_t)nplane);
+      row = Cemreal.val + (size_t)iz * nplane;
+      for (m = 0; m < nplane; m++) {
+        u = (float)buf[m];
+        k = (u >= cum[0]) + (u >= cum[1]) + (u >= cum[2]) + (u >= cum[3]) +
+            (u >= cum[4]) + (u >= cum[5]);
+        row[m] = (row[m] == FLYASH) ? phout[k] : row[m];
+      }
+    }
+
+    free(buf);
+  }
+
+  return (fail);
+}
+
 /******************************************************
  *
  * Function distfa to distribute fly ash phases
@@ -8044,7 +11204,7 @@ int distfa(int fadchoice) {
   int anhcnt, cas2cnt, c3acnt;
   int markc3a, markas, markcacl2, markamsil, markinert, markanh, markcas2;
   float probasg, probcacl2, probsio2;
-  float probc3a, prph, probcas2, probanh;
+  float probc3a, prph, probcas2, probanh, cumprob[6];
   char instring[MAXSTRING];
 
   totcnt = 0;
@@ -8091,7 +11251,7 @@ int distfa(int fadchoice) {
     for (iz = 0; iz < Zsyssize; iz++) {
       for (iy = 0; iy < Ysyssize; iy++) {
         for (ix = 0; ix < Xsyssize; ix++) {
-          if (Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] == FLYASH)
+          if (Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)] == FLYASH)
             totcnt++;
         }
       }
@@ -8104,34 +11264,34 @@ int distfa(int fadchoice) {
 
   fprintf(Logfile,
           "Enter probability for fly ash to be aluminosilicate glass \n");
-  read_string(instring, sizeof(instring));
+  getinput("Fly_ash_ASG", instring, sizeof(instring));
   probasg = atof(instring);
   fprintf(Logfile, "%f\n", probasg);
   Volf[ASG] = probasg;
   fprintf(Logfile,
           "Enter probability for fly ash to be calcium aluminodisilicate \n");
-  read_string(instring, sizeof(instring));
+  getinput("Fly_ash_CAS2", instring, sizeof(instring));
   probcas2 = atof(instring);
   fprintf(Logfile, "%f\n", probcas2);
   Volf[CAS2] = probcas2;
   fprintf(Logfile,
           "Enter probability for fly ash to be tricalcium aluminate \n");
-  read_string(instring, sizeof(instring));
+  getinput("Fly_ash_C3A", instring, sizeof(instring));
   probc3a = atof(instring);
   fprintf(Logfile, "%f\n", probc3a);
   Volf[FAC3A] = probc3a;
   fprintf(Logfile, "Enter probability for fly ash to be calcium chloride \n");
-  read_string(instring, sizeof(instring));
+  getinput("Fly_ash_CaCl2", instring, sizeof(instring));
   probcacl2 = atof(instring);
   fprintf(Logfile, "%f\n", probcacl2);
   Volf[CACL2] = probcacl2;
   fprintf(Logfile, "Enter probability for fly ash to be silica \n");
-  read_string(instring, sizeof(instring));
+  getinput("Fly_ash_silica", instring, sizeof(instring));
   probsio2 = atof(instring);
   fprintf(Logfile, "%f\n", probsio2);
   Volf[AMSIL] = probsio2;
   fprintf(Logfile, "Enter probability for fly ash to be anhydrite \n");
-  read_string(instring, sizeof(instring));
+  getinput("Fly_ash_anhydrite", instring, sizeof(instring));
   probanh = atof(instring);
   fprintf(Logfile, "%f\n", probanh);
   Volf[ANHYDRITE] = probanh;
@@ -8160,6 +11320,20 @@ int distfa(int fadchoice) {
   probcas2 += probanh;
   probc3a += probcas2;
 
+  if ((fadchoice != 0) && (Nthreads > 0)) {
+    cumprob[0] = probasg;
+    cumprob[1] = probcacl2;
+    cumprob[2] = probsio2;
+    cumprob[3] = probanh;
+    cumprob[4] = probcas2;
+    cumprob[5] = probc3a;
+    if (distfapix(cumprob)) {
+      bailout("distfa", "Could not allocate memory for random numbers");
+      return (1);
+    }
+    return (0);
+  }
+
   if (fadchoice == 0) {
     for (ix = 0; ix < Npartc; ix++) {
       phase[ix] = partid[ix] = 0;
@@ -8173,7 +11347,7 @@ int distfa(int fadchoice) {
       for (iy = 0; iy < Ysyssize; iy++) {
         for (ix = 0; ix < Xsyssize; ix++) {
 
-          valin = Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)];
+          valin = Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)];
           partin = Cement.val[getInt3dindex(Cement, ix, iy, iz)];
 
           if ((valin == FLYASH) && (partid[partin] == 0)) {
@@ -8280,12 +11454,12 @@ int distfa(int fadchoice) {
       for (ix = 0; ix < Xsyssize; ix++) {
 
         partin = Cement.val[getInt3dindex(Cement, ix, iy, iz)];
-        valin = Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)];
+        valin = Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)];
 
         if (valin == FLYASH) {
           if (fadchoice == 0) {
             count = partid[partin];
-            Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] = phase[count];
+            Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)] = phase[count];
           } else {
             valout = INERT;
             prph = ran1(Seed);
@@ -8314,7 +11488,7 @@ int distfa(int fadchoice) {
               valout = FAC3A;
             }
 
-            Cemreal.val[getInt3dindex(Cemreal, ix, iy, iz)] = valout;
+            Cemreal.val[getUChar3dindex(Cemreal, ix, iy, iz)] = valout;
           }
         }
       }
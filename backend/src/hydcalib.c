@@ -0,0 +1,658 @@
+/******************************************************
+ *
+ * Program hydcalib
+ *
+ * Calibration of the rate parameters of disrealnew
+ * against a measured heat of hydration.  A table of
+ * candidates gives, for each one, a factor for each of a
+ * few rate parameters (see hyd_scale in hydapi.h); every
+ * candidate is run and its heat compared with the
+ * isothermal calorimetry data, and the candidates are
+ * ranked by the root mean square difference.
+ *
+ * The microstructure and the parameter file are read once,
+ * by hyd_open in this process.  Each candidate then runs
+ * in a process forked from it, sharing the loaded arrays
+ * copy-on-write, with its output in the directory
+ * memberk of the working directory (hyd_member) and the
+ * seed of the parameter file, so that the candidates
+ * differ only in their parameters.  At most --jobs of them
+ * run at a time.
+ *
+ * Every --screen-cycles cycles a candidate compares its
+ * heat so far with the data up to the same time, and gives
+ * up if it is already --screen-factor times as far off as
+ * the best candidate that has finished, so clearly bad
+ * ones cost a few hundred cycles instead of a whole run.
+ *
+ * The data file is the one disrealnew reads for time
+ * calibration: a header line, then time (h) and cumulative
+ * heat (J/g of cement) on each line.  Since the heat is
+ * what is compared, the parameter file should calibrate
+ * time with the Beta factor, not with these data.  Data
+ * after the end of a run are compared with the last heat
+ * of the run.
+ *
+ * Not available on Windows, which has no fork.
+ ******************************************************/
+#include "include/vcctl.h"
+#include "include/hydapi.h"
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define MAXPARAMS 32 /* parameters a candidate can change */
+
+/* Status of a candidate */
+#define CALPENDING 0
+#define CALDONE 1
+#define CALSCREENED 2
+#define CALFAILED 3
+
+/***
+ *	What is found for one candidate, written by the process
+ *	that runs it into memory shared with this one
+ *
+ *		status:  CALPENDING ... CALFAILED
+ *		cycles:  cycles carried out
+ *		time:    time reached (h)
+ *		alpha:   degree of hydration reached
+ *		npts:    data points compared
+ *		rms:     root mean square difference of heat (J/g)
+ ***/
+typedef struct {
+  int status;
+  int cycles;
+  float time;
+  float alpha;
+  int npts;
+  double rms;
+} Calresult;
+
+/***
+ *	Global variables
+ ***/
+char Dataname[MAXSTRING], Candname[MAXSTRING], Outname[MAXSTRING];
+int Njobs = 0, Screencycles = 300;
+float Screenfactor = 2.0;
+int Ndata = 0, Ncand = 0, Nparams = 0;
+float *Datatime = NULL, *Dataheat = NULL, *Factor = NULL;
+char Paramname[MAXPARAMS][MAXSTRING];
+
+/***
+ *	Function declarations (checkargs and printHelp are static,
+ *	since vcctlhyd has those of disrealnew)
+ ***/
+static int checkargs(int argc, char *argv[]);
+static void printHelp(void);
+int readdata(char *name);
+int readcands(char *name);
+double calerror(float *simt, float *simq, int nsim, int final, int *npts);
+void calrun(int k, Calresult *res, volatile double *best);
+int writeresults(Calresult *res, int best);
+
+int main(int argc, char *argv[]) {
+#if !defined(_WIN32)
+  int k, next, running, wstatus, best, nrun, status;
+  long nproc;
+  pid_t pid, *calpid;
+  Calresult *res;
+  volatile double *bestrms;
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    return (1);
+  }
+  if (readdata(Dataname) || readcands(Candname))
+    return (1);
+
+  /* The arguments after -- are those of disrealnew, parsed afresh */
+
+  nrun = argc - optind + 1;
+  argv[optind - 1] = argv[0];
+  optind = 1;
+  if (hyd_open(nrun, argv + argc - nrun)) {
+    bailout("hydcalib", "Could not start the hydration run");
+    return (1);
+  }
+
+  /* Results and the best error so far are shared with the candidates */
+
+  res = (Calresult *)mmap(NULL, (size_t)Ncand * sizeof(Calresult),
+                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                          -1, 0);
+  bestrms = (volatile double *)mmap(NULL, sizeof(double),
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  calpid = (pid_t *)calloc((size_t)Ncand, sizeof(pid_t));
+  if (res == MAP_FAILED || bestrms == MAP_FAILED || !calpid) {
+    bailout("hydcalib", "Could not allocate memory for results");
+    hyd_close();
+    return (1);
+  }
+  memset(res, 0, (size_t)Ncand * sizeof(Calresult));
+  *bestrms = -1.0;
+
+  if (Njobs < 1) {
+    nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    Njobs = (int)((nproc > 0) ? nproc : 1);
+  }
+  printf("Running %d candidates, %d at a time\n", Ncand, Njobs);
+
+  next = running = 0;
+  best = -1;
+  while (next < Ncand || running > 0) {
+    if (next < Ncand && running < Njobs) {
+      fflush(NULL);
+      pid = fork();
+      if (pid == 0) {
+        calrun(next, &res[next], bestrms);
+        fflush(NULL);
+        _exit(0);
+      }
+      if (pid < 0) {
+        res[next].status = CALFAILED;
+      } else {
+        calpid[next] = pid;
+        running++;
+      }
+      next++;
+      continue;
+    }
+
+    pid = wait(&wstatus);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (k = 0; k < Ncand && calpid[k] != pid; k++)
+      ;
+    if (k == Ncand)
+      continue;
+    running--;
+    if (res[k].status == CALPENDING || !WIFEXITED(wstatus) ||
+        WEXITSTATUS(wstatus) != 0)
+      res[k].status = CALFAILED;
+    if (res[k].status == CALDONE && (best < 0 || res[k].rms < res[best].rms)) {
+      best = k;
+      *bestrms = res[k].rms;
+    }
+
+    printf("Candidate %d: ", k);
+    switch (res[k].status) {
+    case CALDONE:
+      printf("%.4f J/g after %d cycles\n", res[k].rms, res[k].cycles);
+      break;
+    case CALSCREENED:
+      printf("screened out after %d cycles (%.4f J/g)\n", res[k].cycles,
+             res[k].rms);
+      break;
+    default:
+      printf("failed\n");
+      break;
+    }
+    fflush(stdout);
+  }
+
+  status = writeresults(res, best);
+  if (best >= 0) {
+    printf("Best candidate %d, %.4f J/g:", best, res[best].rms);
+    for (k = 0; k < Nparams; k++) {
+      printf(" %s %g", Paramname[k], Factor[best * Nparams + k]);
+    }
+    printf("\n");
+  } else {
+    printf("No candidate finished\n");
+  }
+
+  hyd_close();
+  free(calpid);
+
+  return ((status || best < 0) ? 1 : 0);
+#else
+  bailout("hydcalib", "Not available on Windows");
+  return (1);
+#endif
+}
+
+/***
+ *	checkargs
+ *
+ *	Checks the command line arguments, up to the -- that
+ *	comes before those of disrealnew
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+static int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {
+      {"data", required_argument, 0, 'd'},
+      {"candidates", required_argument, 0, 'c'},
+      {"output", required_argument, 0, 'o'},
+      {"jobs", required_argument, 0, 'n'},
+      {"screen-cycles", required_argument, 0, 's'},
+      {"screen-factor", required_argument, 0, 'x'},
+      {"help", no_argument, 0, 'h'},
+      {NULL, 0, 0, 0}};
+
+  Dataname[0] = Candname[0] = '\0';
+  snprintf(Outname, sizeof(Outname), "calibration.csv");
+  while ((opt_char = getopt_long(argc, argv, "d:c:o:n:s:x:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -d or --data */
+    case (int)('d'):
+      snprintf(Dataname, sizeof(Dataname), "%s", optarg);
+      break;
+    /* -c or --candidates */
+    case (int)('c'):
+      snprintf(Candname, sizeof(Candname), "%s", optarg);
+      break;
+    /* -o or --output */
+    case (int)('o'):
+      snprintf(Outname, sizeof(Outname), "%s", optarg);
+      break;
+    /* -n or --jobs */
+    case (int)('n'):
+      Njobs = atoi(optarg);
+      break;
+    /* -s or --screen-cycles */
+    case (int)('s'):
+      Screencycles = atoi(optarg);
+      if (Screencycles < 0)
+        Screencycles = 0;
+      break;
+    /* -x or --screen-factor */
+    case (int)('x'):
+      Screenfactor = atof(optarg);
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  /* getopt_long stops at --, leaving optind just after it */
+
+  if (Dataname[0] == '\0' || Candname[0] == '\0' || optind < 2 ||
+      strcmp(argv[optind - 1], "--") || optind >= argc ||
+      Screenfactor <= 1.0)
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+static void printHelp(void) {
+  fprintf(stderr, "\n\nUSAGE:  hydcalib -d,--data <calorimetry> "
+                  "-c,--candidates <table.csv>\n");
+  fprintf(stderr, "          [-o,--output <results.csv>] [-n,--jobs <n>]\n");
+  fprintf(stderr, "          [-s,--screen-cycles <n>] "
+                  "[-x,--screen-factor <f>]\n");
+  fprintf(stderr, "          -- <disrealnew options>\n\n");
+  fprintf(stderr, "Runs disrealnew once for each candidate set of rate "
+                  "parameters, from one\n");
+  fprintf(stderr, "loaded microstructure, and ranks them by how well "
+                  "their heat of hydration\n");
+  fprintf(stderr, "matches the calorimetry data (header line, then time "
+                  "in h and cumulative\n");
+  fprintf(stderr, "heat in J/g of cement).\n\n");
+  fprintf(stderr, "  --candidates    a header line naming the parameters "
+                  "(pnucch, pscalech,\n");
+  fprintf(stderr, "                  pnuchg, pscalehg, pnucfh3, pscalefh3, "
+                  "pnucgyp, pscalegyp,\n");
+  fprintf(stderr, "                  dis:C3S, dis:C2S, ...), then one line "
+                  "of factors for the\n");
+  fprintf(stderr, "                  values of the parameter file for each "
+                  "candidate\n");
+  fprintf(stderr, "  --output        table of results (default "
+                  "calibration.csv)\n");
+  fprintf(stderr, "  --jobs          candidates run at a time (default "
+                  "one per processor)\n");
+  fprintf(stderr, "  --screen-cycles cycles between checks against the "
+                  "best candidate\n");
+  fprintf(stderr, "                  (default 300; 0 runs every candidate "
+                  "to the end)\n");
+  fprintf(stderr, "  --screen-factor a candidate this many times as far "
+                  "off as the best is\n");
+  fprintf(stderr, "                  given up (default 2)\n\n");
+  fprintf(stderr, "Candidate k writes its output in memberk of the "
+                  "working directory.\n\n");
+
+  return;
+}
+
+/***
+ *	readdata
+ *
+ *	Reads the calorimetry data into Datatime and Dataheat
+ *
+ * 	Arguments:	char pointer to the file name
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		filehandler, fvector
+ *	Called by:	main program
+ ***/
+int readdata(char *name) {
+  int cap;
+  float t, q;
+  char line[MAXSTRING], *p;
+  FILE *fp;
+  void *newp;
+
+  fp = filehandler("hydcalib", name, "READ");
+  if (!fp)
+    return (1);
+
+  /* The first line is a header */
+
+  cap = 0;
+  Ndata = 0;
+  if (fgets(line, sizeof(line), fp)) {
+    while (fgets(line, sizeof(line), fp)) {
+      for (p = line; *p; p++) {
+        if (*p == ',')
+          *p = ' ';
+      }
+      if (sscanf(line, "%f %f", &t, &q) != 2)
+        continue;
+      if (Ndata >= cap) {
+        cap = (cap > 0) ? (2 * cap) : 256;
+        newp = realloc(Datatime, (size_t)cap * sizeof(float));
+        if (newp)
+          Datatime = (float *)newp;
+        newp = newp ? realloc(Dataheat, (size_t)cap * sizeof(float)) : NULL;
+        if (!newp) {
+          fclose(fp);
+          bailout("hydcalib", "Could not allocate memory for data");
+          return (1);
+        }
+        Dataheat = (float *)newp;
+      }
+      Datatime[Ndata] = t;
+      Dataheat[Ndata] = q;
+      Ndata++;
+    }
+  }
+  fclose(fp);
+
+  if (Ndata == 0) {
+    bailout("hydcalib", "No data in calorimetry file");
+    return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	readcands
+ *
+ *	Reads the table of candidates: a header line of parameter
+ *	names, then one line of factors for each candidate.  Lines
+ *	starting with # are skipped.
+ *
+ * 	Arguments:	char pointer to the file name
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		filehandler
+ *	Called by:	main program
+ ***/
+int readcands(char *name) {
+  int i, cap;
+  char line[4 * MAXSTRING], *tok;
+  FILE *fp;
+  void *newp;
+
+  fp = filehandler("hydcalib", name, "READ");
+  if (!fp)
+    return (1);
+
+  cap = 0;
+  Nparams = Ncand = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line))
+      continue;
+    tok = strtok(line, ", \t\r\n");
+
+    if (Nparams == 0) {
+      for (; tok && Nparams < MAXPARAMS; tok = strtok(NULL, ", \t\r\n")) {
+        snprintf(Paramname[Nparams++], MAXSTRING, "%s", tok);
+      }
+      continue;
+    }
+
+    if (Ncand >= cap) {
+      cap = (cap > 0) ? (2 * cap) : 64;
+      newp = realloc(Factor, (size_t)cap * Nparams * sizeof(float));
+      if (!newp) {
+        fclose(fp);
+        bailout("hydcalib", "Could not allocate memory for candidates");
+        return (1);
+      }
+      Factor = (float *)newp;
+    }
+    for (i = 0; i < Nparams && tok; i++, tok = strtok(NULL, ", \t\r\n")) {
+      Factor[Ncand * Nparams + i] = atof(tok);
+    }
+    if (i < Nparams) {
+      fclose(fp);
+      bailout("hydcalib", "A candidate has too few factors");
+      return (1);
+    }
+    Ncand++;
+  }
+  fclose(fp);
+
+  if (Ncand == 0) {
+    bailout("hydcalib", "No candidates");
+    return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	calerror
+ *
+ *	Root mean square difference between the simulated heat,
+ *	interpolated linearly in time, and the data.  Before the
+ *	run is over only the data up to its time are compared;
+ *	once it is, later data are compared with its last heat.
+ *
+ * 	Arguments:	float pointer to the simulated times (h), in order
+ * 				float pointer to the simulated heats (J/g)
+ * 				int number of them
+ * 				int nonzero if the run is over
+ * 				int pointer to the number of points compared
+ * 	Returns:	double root mean square difference (J/g)
+ *
+ *	Calls:		no routines
+ *	Called by:	calrun
+ ***/
+double calerror(float *simt, float *simq, int nsim, int final, int *npts) {
+  int i, j;
+  double q, sum;
+
+  *npts = 0;
+  sum = 0.0;
+  j = 0;
+  for (i = 0; i < Ndata; i++) {
+    if (Datatime[i] < simt[0])
+      continue;
+    while (j < nsim - 1 && simt[j + 1] < Datatime[i])
+      j++;
+    if (j == nsim - 1) {
+      if (!final)
+        break;
+      q = simq[nsim - 1];
+    } else if (simt[j + 1] > simt[j]) {
+      q = simq[j] + (simq[j + 1] - simq[j]) * (Datatime[i] - simt[j]) /
+                        (simt[j + 1] - simt[j]);
+    } else {
+      q = simq[j + 1];
+    }
+    sum += (q - Dataheat[i]) * (q - Dataheat[i]);
+    (*npts)++;
+  }
+
+  return ((*npts > 0) ? sqrt(sum / (double)(*npts)) : 0.0);
+}
+
+/***
+ *	calrun
+ *
+ *	Run one candidate, in the process forked for it, and
+ *	put what was found in its result
+ *
+ * 	Arguments:	int candidate
+ * 				Calresult pointer to its result
+ * 				double pointer to the best error so far (less
+ * 					than zero if no candidate has finished)
+ * 	Returns:	nothing
+ *
+ *	Calls:		hyd_member, hyd_scale, hyd_step, hyd_state, calerror
+ *	Called by:	main program
+ ***/
+void calrun(int k, Calresult *res, volatile double *best) {
+  int i, n, nsim, cap, ncyc;
+  double rms, b;
+  float *simt, *simq;
+  Hydstate st;
+
+  if (hyd_member(k)) {
+    fprintf(stderr, "\nERROR: Could not set up candidate %d", k);
+    res->status = CALFAILED;
+    hyd_close();
+    return;
+  }
+  for (i = 0; i < Nparams; i++) {
+    if (hyd_scale(Paramname[i], Factor[k * Nparams + i])) {
+      fprintf(stderr, "\nERROR: No rate parameter %s", Paramname[i]);
+      res->status = CALFAILED;
+      hyd_close();
+      return;
+    }
+  }
+
+  cap = 1024;
+  simt = (float *)malloc((size_t)cap * sizeof(float));
+  simq = (float *)malloc((size_t)cap * sizeof(float));
+  if (!simt || !simq || hyd_state(&st)) {
+    res->status = CALFAILED;
+    return;
+  }
+  simt[0] = st.time;
+  simq[0] = st.heat;
+  nsim = 1;
+
+  ncyc = 0;
+  res->status = CALDONE;
+  while ((n = hyd_step(1)) > 0) {
+    ncyc++;
+    if (hyd_state(&st)) {
+      res->status = CALFAILED;
+      break;
+    }
+    if (nsim >= cap) {
+      cap *= 2;
+      simt = (float *)realloc(simt, (size_t)cap * sizeof(float));
+      simq = (float *)realloc(simq, (size_t)cap * sizeof(float));
+      if (!simt || !simq) {
+        res->status = CALFAILED;
+        return;
+      }
+    }
+    simt[nsim] = st.time;
+    simq[nsim] = st.heat;
+    nsim++;
+
+    /* Read without a lock: a stale best only screens less */
+
+    b = *best;
+    if (Screencycles > 0 && ncyc % Screencycles == 0 && b > 0.0) {
+      rms = calerror(simt, simq, nsim, 0, &res->npts);
+      if (res->npts > 0 && rms > Screenfactor * b) {
+        res->status = CALSCREENED;
+        res->rms = rms;
+        break;
+      }
+    }
+  }
+  if (n < 0)
+    res->status = CALFAILED;
+
+  res->cycles = ncyc;
+  res->time = st.time;
+  res->alpha = st.alpha;
+  if (res->status == CALDONE)
+    res->rms = calerror(simt, simq, nsim, 1, &res->npts);
+
+  free(simt);
+  free(simq);
+  hyd_close();
+
+  return;
+}
+
+/***
+ *	writeresults
+ *
+ *	Writes the table of candidates and what was found for each
+ *
+ * 	Arguments:	Calresult pointer to the results
+ * 				int best candidate (less than zero if none)
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		filehandler
+ *	Called by:	main program
+ ***/
+int writeresults(Calresult *res, int best) {
+  int k, i;
+  FILE *fp;
+  static const char *status[] = {"pending", "done", "screened", "failed"};
+
+  fp = filehandler("hydcalib", Outname, "WRITE");
+  if (!fp)
+    return (1);
+
+  fprintf(fp, "Candidate");
+  for (i = 0; i < Nparams; i++) {
+    fprintf(fp, ",%s", Paramname[i]);
+  }
+  fprintf(fp, ",Status,Cycles,Time(h),Alpha,Points,RMS(J/g),Best\n");
+  for (k = 0; k < Ncand; k++) {
+    fprintf(fp, "%d", k);
+    for (i = 0; i < Nparams; i++) {
+      fprintf(fp, ",%g", Factor[k * Nparams + i]);
+    }
+    fprintf(fp, ",%s,%d,%.4f,%.4f,%d,%.6f,%d\n", status[res[k].status],
+            res[k].cycles, res[k].time, res[k].alpha, res[k].npts, res[k].rms,
+            (k == best));
+  }
+
+  return (fclose(fp) ? 1 : 0);
+}
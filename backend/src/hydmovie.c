@@ -2,262 +2,759 @@
  *
  * Program hydmovie
  *
- * Makes an animated GIF file out of multiple single
- * GIF image files
+ * Makes a movie out of the frames of a hydration
+ * movie file, or out of one slice of each image in
+ * an image index file, writing one PNG file per frame
+ * or piping the raw frames to a video encoder
+ *
+ * Frames are read as they are needed rather than
+ * all at once, and a batch of them is drawn and
+ * written at the same time, one per thread, so the
+ * memory needed does not grow with the length of the
+ * movie.  Each phase id is looked up once in a table
+ * of colors rather than in three color vectors for
+ * every pixel.
  *
  ******************************************************/
 #include <png.h>
 #include "include/vcctl.h"
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPEMODE "wb"
+#else
+#define PIPEMODE "w"
+#endif
+
+/***
+ *	Kinds of input
+ ***/
+#define SRCMOVIEZ 0 /* binary movie (see binmov.c) */
+#define SRCASCII 1  /* ASCII movie, one frame after another */
+#define SRCLIST 2   /* image index file written by disrealnew */
+
+/***
+ *	Frames drawn at once by each thread
+ ***/
+#define FRAMESPERTHREAD 2
 
 /***
  *	Global variables
  ***/
 float Version;
+int Xsize, Ysize, Nframes;
+int Source;
+int Iscale = 0, Bse = -1, Slice = -1, Level = -2, Nthreads = 1;
+int Batchmode = 0;
+char Filein[MAXSTRING], Fileout[MAXSTRING], Pipecmd[MAXSTRING];
+pixel_t Lut[256];
 
-int main(void) {
-  int valin, ovalin, nframes, xsyssize, ysyssize, zsyssize, numlines;
-  int valout, i1, j1, i, i1000, i100, i10, i0, iz, ix, iy;
-  int dx, dy, j, iscale, dxtot, dytot, bse;
-  int ***mic;
-  int *red, *green, *blue;
-  float res;
-  char filein[MAXSTRING], fileout[MAXSTRING], instring[MAXSTRING];
-  char finalname[MAXSTRING];
-  char filenew[MAXSTRING], fileroot[MAXSTRING];
-  FILE *infile;
-  bitmap_t image;
-
-  mic = NULL;
-  image.pixels = NULL;
-  red = NULL;
-  green = NULL;
-  blue = NULL;
-
-  red = ivector(NPHASES);
-  if (!red) {
-    bailout("hydmovie", "Could not allocate memory for red vector");
-    return (1);
+/* Input being read */
+
+FILE *Infile = NULL;
+Movie Mv;
+char **Listnames = NULL;
+unsigned char **Vox = NULL;
+size_t *Voxcap = NULL;
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
+int openinput(void);
+int readlist(void);
+void makelut(void);
+int nextframe(int k, unsigned char *ids);
+int loadslice(int k, unsigned char *ids, int t);
+void drawframe(unsigned char *ids, bitmap_t *image);
+void closeinput(void);
+
+int main(int argc, char *argv[]) {
+  int i, f, nb, nbatch, done, err, status, nxy;
+  char finalname[MAXSTRING], instring[MAXSTRING];
+  char filenew[MAXSTRING];
+  unsigned char *ids;
+  bitmap_t *images;
+  FILE *pipefile;
+
+  memset(&Mv, 0, sizeof(Movie));
+  Filein[0] = Fileout[0] = Pipecmd[0] = '\0';
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    exit(1);
   }
-  green = ivector(NPHASES);
-  if (!green) {
-    bailout("hydmovie", "Could not allocate memory for green vector");
-    free_ivector(red);
-    return (1);
+
+  if (!Batchmode) {
+    printf("Enter name of file with raw (3-D image) data \n");
+    fflush(stdout);
+    read_string(Filein, sizeof(Filein));
+    printf("%s\n", Filein);
+    printf("Enter final name of movie file to create \n");
+    fflush(stdout);
+    read_string(finalname, sizeof(finalname));
+    printf("%s\n", finalname);
+
+    printf("\nSimulate backscattered electron image? (Yes = 1, No = 0): ");
+    fflush(stdout);
+
+    read_string(instring, sizeof(instring));
+    Bse = atoi(instring);
+    printf("%d\n", Bse);
+    fflush(stdout);
   }
-  blue = ivector(NPHASES);
-  if (!blue) {
-    bailout("hydmovie", "Could not allocate memory for blue vector");
-    free_ivector(green);
-    free_ivector(red);
+
+  /***
+   *	Frames are named after the input unless
+   *	another root was given
+   ***/
+
+  if (Fileout[0] == '\0')
+    sprintf(Fileout, "%s", Filein);
+
+  if (openinput()) {
+    closeinput();
     return (1);
   }
 
-  printf("Enter name of file with raw (3-D image) data \n");
-  fflush(stdout);
-  read_string(filein, sizeof(filein));
-  printf("%s\n", filein);
-  sprintf(fileout, "%s", filein);
-  printf("Enter final name of movie file to create \n");
-  fflush(stdout);
-  read_string(finalname, sizeof(finalname));
-  printf("%s\n", finalname);
+  makelut();
 
-  printf("\nSimulate backscattered electron image? (Yes = 1, No = 0): ");
-  fflush(stdout);
+  if (!Batchmode) {
+    printf("Enter factor by which to scale image \n");
+    read_string(instring, sizeof(instring));
+    Iscale = atoi(instring);
+    printf("%d\n", Iscale);
+  }
+  if (Iscale < 1)
+    Iscale = 1;
 
-  read_string(instring, sizeof(instring));
-  bse = atoi(instring);
-  printf("%d\n", bse);
-  fflush(stdout);
+  /***
+   *	Prompted runs keep the libpng default compression, so
+   *	that they write the same files as before, and batch
+   *	runs favor speed
+   ***/
 
-  cemcolors(red, green, blue, bse);
+  if (Level == -2)
+    Level = Batchmode ? 1 : -1;
 
   /***
-   *	Open the input movie file
+   *	Allocate one id frame and one bitmap for each frame
+   *	of a batch
    ***/
 
-  infile = filehandler("hydmovie", filein, "READ");
-  if (!infile) {
-    free_ivector(blue);
-    free_ivector(green);
-    free_ivector(red);
+  nxy = Xsize * Ysize;
+  nbatch = FRAMESPERTHREAD * Nthreads;
+  ids = (unsigned char *)malloc((size_t)nbatch * nxy);
+  images = (bitmap_t *)calloc(nbatch, sizeof(bitmap_t));
+  if (!ids || !images) {
+    bailout("hydmovie", "Could not allocate memory for frames");
+    if (ids)
+      free(ids);
+    if (images)
+      free(images);
+    closeinput();
+    return (1);
+  }
+  err = 0;
+  for (f = 0; f < nbatch && !err; f++) {
+    images[f].width = Xsize * Iscale;
+    images[f].height = Ysize * Iscale;
+    images[f].pixels = pixelvector(images[f].width * images[f].height);
+    if (!images[f].pixels)
+      err = 1;
+  }
+  if (Source == SRCLIST) {
+    Vox = (unsigned char **)calloc(nbatch, sizeof(unsigned char *));
+    Voxcap = (size_t *)calloc(nbatch, sizeof(size_t));
+    if (!Vox || !Voxcap)
+      err = 1;
+  }
+  if (err) {
+    bailout("hydmovie", "Could not allocate memory for image pixels");
+    for (f = 0; f < nbatch; f++) {
+      if (images[f].pixels)
+        free_pixelvector(images[f].pixels);
+    }
+    free(images);
+    free(ids);
+    closeinput();
     return (1);
   }
 
+  pipefile = NULL;
+  if (Pipecmd[0] != '\0') {
+    pipefile = popen(Pipecmd, PIPEMODE);
+    if (!pipefile) {
+      bailout("hydmovie", "Could not start the encoder");
+      err = 1;
+    } else {
+      printf("\nPiping %d x %d rgb24 frames to: %s\n", Xsize * Iscale,
+             Ysize * Iscale, Pipecmd);
+      fflush(stdout);
+    }
+  }
+
   /***
-   *	Read first line of image file to determine
-   *	if software version is specified.  If it is
-   *	specified then read it and all the other size
-   *	and resolution information.  If not, set the
-   *	size and resolution to default values for Version 2.0
+   *	Read, draw and write the movie a batch at a time.
+   *	Frames of a movie file are read in order by this
+   *	thread, while each image of an index file is read
+   *	by the thread that draws its slice.
    ***/
 
-  if (read_imgheader(infile, &Version, &xsyssize, &ysyssize, &zsyssize, &res)) {
-    fclose(infile);
-    bailout("hydmovie", "Error reading image header");
-    free_ivector(blue);
-    free_ivector(green);
-    free_ivector(red);
-    return (1);
+  done = status = 0;
+  while (!err) {
+    nb = 0;
+    if (Source == SRCLIST) {
+      nb = (Nframes - done < nbatch) ? Nframes - done : nbatch;
+    } else {
+      while (nb < nbatch &&
+             !(status = nextframe(done + nb, ids + (size_t)nb * nxy)))
+        nb++;
+      if (status > 1)
+        break;
+    }
+    if (nb == 0)
+      break;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 1) private(  \
+        filenew) reduction(| : err)
+#endif
+    for (f = 0; f < nb; f++) {
+      int t = 0;
+#ifdef _OPENMP
+      t = omp_get_thread_num();
+#endif
+      if (Source == SRCLIST && loadslice(done + f, ids + (size_t)f * nxy, t)) {
+        err |= 1;
+        continue;
+      }
+      drawframe(ids + (size_t)f * nxy, &images[f]);
+      if (!pipefile) {
+
+        /***
+         *	Each frame has its own name, e.g. frame
+         *	49 will have the name fileroot0049.png,
+         *	where fileroot is the root of the movie
+         ***/
+
+        sprintf(filenew, "%s%04d.png", Fileout, done + f);
+        if (save_png_level(&images[f], filenew, Level))
+          err |= 1;
+      }
+    }
+
+    if (err) {
+      bailout("hydmovie", "Error reading or writing a frame");
+      break;
+    }
+
+    /* pixel_t is three bytes, so a bitmap is already an rgb24 frame */
+
+    if (pipefile) {
+      for (f = 0; f < nb && !err; f++) {
+        if (fwrite(images[f].pixels, sizeof(pixel_t),
+                   images[f].width * images[f].height,
+                   pipefile) != images[f].width * images[f].height) {
+          bailout("hydmovie", "Error writing a frame to the encoder");
+          err = 1;
+        }
+      }
+    }
+    done += nb;
+  }
+
+  if (status > 1)
+    err = 1;
+  if (pipefile && pclose(pipefile) != 0 && !err) {
+    bailout("hydmovie", "The encoder did not finish cleanly");
+    err = 1;
   }
 
+  if (Batchmode && !err) {
+    printf("\nWrote %d frames\n", done);
+  }
+  fflush(stdout);
+
   /***
-   *  	Determine number of movie frames
+   * Free the dynamically allocated memory
    ***/
 
-  numlines = 0;
-  while (!feof(infile)) {
-    fscanf(infile, "%s", instring);
-    if (!feof(infile))
-      numlines++;
+  for (f = 0; f < nbatch; f++)
+    free_pixelvector(images[f].pixels);
+  free(images);
+  free(ids);
+  if (Vox) {
+    for (i = 0; i < nbatch; i++) {
+      if (Vox[i])
+        free(Vox[i]);
+    }
+    free(Vox);
   }
+  if (Voxcap)
+    free(Voxcap);
+  closeinput();
+  printf("\n\n");
 
-  nframes = (numlines / (xsyssize * ysyssize));
+  return (err);
+}
 
-  fclose(infile);
+/***
+ *	openinput
+ *
+ *	Opens the movie file, or reads the image index file,
+ *	and finds the size of a frame
+ *
+ * 	Arguments:	none
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		filehandler, read_imgheader_fmt, movie_open,
+ *			readlist
+ *	Called by:	main program
+ ***/
+int openinput(void) {
+  int zsize, format;
+  float res;
 
-  /***
-   *	Open the input movie file again
-   ***/
+  if (Source == SRCLIST)
+    return (readlist());
 
-  infile = filehandler("hydmovie", filein, "READ");
-  if (!infile) {
-    free_ivector(blue);
-    free_ivector(green);
-    free_ivector(red);
+  Infile = filehandler("hydmovie", Filein, "READ");
+  if (!Infile)
     return (1);
-  }
 
   /***
-   *	Read the header again
+   *	Read first line of image file to determine
+   *	if software version is specified.  If it is
+   *	specified then read it and all the other size
+   *	and resolution information.  If not, set the
+   *	size and resolution to default values for Version 2.0
    ***/
 
-  if (read_imgheader(infile, &Version, &xsyssize, &ysyssize, &zsyssize, &res)) {
-    fclose(infile);
+  if (read_imgheader_fmt(Infile, &Version, &Xsize, &Ysize, &zsize, &res,
+                         &format)) {
     bailout("hydmovie", "Error reading image header");
-    free_ivector(blue);
-    free_ivector(green);
-    free_ivector(red);
     return (1);
   }
 
-  /***
-   *	Assume a rectangular image
-   ****/
-
-  dx = xsyssize;
-  dy = ysyssize;
-  printf("Enter factor by which to scale image \n");
-  read_string(instring, sizeof(instring));
-  iscale = atoi(instring);
-  printf("%d\n", iscale);
-  dxtot = dx * iscale;
-  dytot = dy * iscale;
+  if (format == IMG_MOVIEZ) {
 
-  /***
-   *	Allocate memory for mic and image arrays
-   ***/
+    /***
+     *	Binary movie (see binmov.c): the frame count and
+     *	the frame sizes come from its index
+     ***/
 
-  image.width = dxtot;
-  image.height = dytot;
+    fclose(Infile);
+    Infile = NULL;
+    if (movie_open(Filein, &Mv, 0)) {
+      bailout("hydmovie", "Error reading movie index");
+      return (1);
+    }
+    Source = SRCMOVIEZ;
+    Version = Mv.ver;
+    Xsize = Mv.xsize;
+    Ysize = Mv.ysize;
+    Nframes = Mv.nframes;
 
-  image.pixels = pixelvector(dxtot * dytot);
-  if (!image.pixels) {
-    bailout("hydmovie", "Could not allocate memory for image pixels");
-    free_ivector(blue);
-    free_ivector(green);
-    free_ivector(red);
-    return (1);
+  } else {
+
+    /***
+     *	ASCII movie: frames are read until the
+     *	file runs out, so the count is not needed
+     ***/
+
+    Source = SRCASCII;
+    Nframes = -1;
   }
 
-  mic = ibox(xsyssize, ysyssize, nframes);
-  if (!mic) {
-    bailout("hydmovie", "Could not allocate memory for mic");
-    free_pixelvector(image.pixels);
-    free_ivector(blue);
-    free_ivector(green);
-    free_ivector(red);
+  if (Xsize < 1 || Ysize < 1) {
+    bailout("hydmovie", "Movie frames have no pixels");
     return (1);
   }
 
-  /* Read the hydration movie file */
-  for (iz = 0; iz < nframes; iz++) {
-    for (iy = 0; iy < ysyssize; iy++) {
-      for (ix = 0; ix < xsyssize; ix++) {
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valin = convert_id(ovalin, Version);
-        mic[ix][iy][iz] = valin;
+  return (0);
+}
+
+/***
+ *	readlist
+ *
+ *	Reads the names of the images in an image index file,
+ *	whose lines hold a time and an image name, and the size
+ *	of the first image.  The slice drawn defaults to the
+ *	middle one in z, as in the movie made by disrealnew.
+ *
+ * 	Arguments:	none
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		filehandler, read_imgheader_fmt
+ *	Called by:	openinput
+ ***/
+int readlist(void) {
+  int n, cap, zsize, format;
+  float time, res;
+  char name[MAXSTRING];
+  char **newp;
+  FILE *fp;
+
+  fp = filehandler("hydmovie", Filein, "READ");
+  if (!fp)
+    return (1);
+
+  n = cap = 0;
+  while (fscanf(fp, "%f %s", &time, name) == 2) {
+    if (n == cap) {
+      cap = (cap > 0) ? 2 * cap : 64;
+      newp = (char **)realloc(Listnames, cap * sizeof(char *));
+      if (!newp) {
+        fclose(fp);
+        bailout("hydmovie", "Could not allocate memory for image names");
+        return (1);
       }
+      Listnames = newp;
+    }
+    Listnames[n] = (char *)malloc(strlen(name) + 1);
+    if (!Listnames[n]) {
+      fclose(fp);
+      bailout("hydmovie", "Could not allocate memory for image names");
+      return (1);
     }
+    strcpy(Listnames[n], name);
+    Nframes = ++n;
   }
+  fclose(fp);
 
-  /***
-   * Microstructure is stored, just magnify as needed and output
-   * individual ppm files
-   ***/
+  if (Nframes < 1) {
+    bailout("hydmovie", "No images in the image index file");
+    return (1);
+  }
 
-  for (iz = 0; iz < nframes; iz++) {
+  fp = filehandler("hydmovie", Listnames[0], "READ");
+  if (!fp)
+    return (1);
+  if (read_imgheader_fmt(fp, &Version, &Xsize, &Ysize, &zsize, &res,
+                         &format)) {
+    fclose(fp);
+    bailout("hydmovie", "Error reading image header");
+    return (1);
+  }
+  fclose(fp);
 
-    /***
-     *	Read this frame out of the 3D image
-     * 	and create bitmap for it
-     ***/
+  if (Slice < 0)
+    Slice = zsize / 2;
+  if (Slice >= zsize) {
+    bailout("hydmovie", "Slice is outside the images");
+    return (1);
+  }
+
+  return (0);
+}
 
-    for (j = 0; j < dy; j++) {
-      for (i = 0; i < dx; i++) {
+/***
+ *	makelut
+ *
+ *	Fills the table of colors for each byte of a frame.
+ *	Ids in a binary movie are converted here, once,
+ *	rather than for every pixel, and ids with no phase
+ *	are drawn black.
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		cemcolors, convert_id
+ *	Called by:	main program
+ ***/
+void makelut(void) {
+  int i, id;
+  int red[NPHASES], green[NPHASES], blue[NPHASES];
+
+  cemcolors(red, green, blue, Bse > 0);
+
+  for (i = 0; i < 256; i++) {
+    id = (Source == SRCMOVIEZ) ? convert_id(i, Version) : i;
+    if (id >= 0 && id < (NPHASES)) {
+      Lut[i].red = red[id];
+      Lut[i].green = green[id];
+      Lut[i].blue = blue[id];
+    } else {
+      Lut[i].red = Lut[i].green = Lut[i].blue = 0;
+    }
+  }
 
-        valout = mic[i][j][iz];
+  return;
+}
 
-        for (j1 = 0; j1 < iscale; j1++) {
-          iy = j * iscale + j1;
-          for (i1 = 0; i1 < iscale; i1++) {
-            ix = i * iscale + i1;
-            pixel_t *pixel = pixel_at(&image, ix, iy);
-            pixel->red = red[valout];
-            pixel->green = green[valout];
-            pixel->blue = blue[valout];
-          }
-        }
-      }
+/***
+ *	nextframe
+ *
+ *	Reads the next frame of a movie file
+ *
+ * 	Arguments:	int frame number
+ * 			unsigned char pointer to Xsize*Ysize ids
+ * 	Returns:	0 if okay, 1 at the end of the movie, 2 on error
+ *
+ *	Calls:		movie_frame, convert_id
+ *	Called by:	main program
+ ***/
+int nextframe(int k, unsigned char *ids) {
+  int i, val;
+
+  if (Source == SRCMOVIEZ) {
+    if (k >= Nframes)
+      return (1);
+    if (movie_frame(&Mv, k, ids)) {
+      bailout("hydmovie", "Error reading movie frame");
+      return (2);
     }
+    return (0);
+  }
 
-    /* Write the image for this fram to a file given by filenew */
+  for (i = 0; i < Xsize * Ysize; i++) {
+    if (fscanf(Infile, "%d", &val) != 1)
+      return (1);
+    val = convert_id(val, Version);
+    ids[i] = (val >= 0 && val < 256) ? (unsigned char)val : 255;
+  }
 
-    i1000 = iz / 1000;
-    i100 = (iz / 100) - (10 * i1000);
-    i10 = (iz / 10) - (10 * (iz / 100));
-    i0 = iz - (10 * (iz / 10));
+  return (0);
+}
 
-    /***
-     *	Each slice has its own name, e.g. slice
-     *	49 will have the name fileroot0049.ppm,
-     *	where fileroot is the name given by the
-     *	user for the movie
-     ***/
+/***
+ *	loadslice
+ *
+ *	Reads one image of an image index file and copies
+ *	the slice being drawn.  Each thread has its own
+ *	buffer for the image.
+ *
+ * 	Arguments:	int image number
+ * 			unsigned char pointer to Xsize*Ysize ids
+ * 			int thread number
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		filehandler, load_microstructure
+ *	Called by:	main program
+ ***/
+int loadslice(int k, unsigned char *ids, int t) {
+  int xsize, ysize, zsize, status;
+  float ver, res;
+  FILE *fp;
+
+  fp = filehandler("hydmovie", Listnames[k], "READ");
+  if (!fp)
+    return (1);
+  status = load_microstructure(fp, &Vox[t], &Voxcap[t], &ver, &xsize, &ysize,
+                               &zsize, &res);
+  fclose(fp);
+  if (status || xsize != Xsize || ysize != Ysize || Slice >= zsize)
+    return (1);
 
-    sprintf(fileroot, "%s%1d%1d%1d%1d", fileout, i1000, i100, i10, i0);
-    sprintf(filenew, "%s%1d%1d%1d%1d.png", fileout, i1000, i100, i10, i0);
+  memcpy(ids, Vox[t] + (size_t)Slice * xsize * ysize,
+         (size_t)xsize * ysize);
 
-    save_png_to_file(&image, filenew);
+  return (0);
+}
+
+/***
+ *	drawframe
+ *
+ *	Draws a frame of ids into a bitmap, magnified by Iscale.
+ *	Each row of the frame is drawn once and copied to the
+ *	other rows it covers.
+ *
+ * 	Arguments:	unsigned char pointer to Xsize*Ysize ids
+ * 			bitmap_t pointer
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void drawframe(unsigned char *ids, bitmap_t *image) {
+  int i, j, i1, j1;
+  pixel_t p, *row;
+
+  for (j = 0; j < Ysize; j++) {
+    row = image->pixels + (size_t)j * Iscale * image->width;
+    for (i = 0; i < Xsize; i++) {
+      p = Lut[ids[(size_t)j * Xsize + i]];
+      for (i1 = 0; i1 < Iscale; i1++)
+        row[i * Iscale + i1] = p;
+    }
+    for (j1 = 1; j1 < Iscale; j1++)
+      memcpy(row + j1 * image->width, row, image->width * sizeof(pixel_t));
   }
 
-  fflush(stdout);
-  fclose(infile);
+  return;
+}
 
-  /***
-   * Free the dynamically allocated memory
-   ***/
+/***
+ *	closeinput
+ *
+ *	Closes the input and frees the image names
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		movie_close
+ *	Called by:	main program
+ ***/
+void closeinput(void) {
+  int i;
+
+  if (Infile)
+    fclose(Infile);
+  Infile = NULL;
+  movie_close(&Mv);
+  if (Listnames) {
+    for (i = 0; i < Nframes; i++)
+      free(Listnames[i]);
+    free(Listnames);
+    Listnames = NULL;
+  }
 
-  free_ibox(mic, xsyssize, ysyssize);
-  free_pixelvector(image.pixels);
-  free_ivector(blue);
-  free_ivector(green);
-  free_ivector(red);
-  printf("\n\n");
+  return;
+}
+
+/***
+ *	checkargs
+ *
+ *	Read the command line.  Naming the input with
+ *	--input or --list runs without prompts.
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"input", required_argument, 0, 'i'},
+                                      {"list", required_argument, 0, 'l'},
+                                      {"output", required_argument, 0, 'o'},
+                                      {"scale", required_argument, 0, 's'},
+                                      {"bse", no_argument, 0, 'b'},
+                                      {"slice", required_argument, 0, 'z'},
+                                      {"level", required_argument, 0, 'c'},
+                                      {"pipe", required_argument, 0, 'p'},
+                                      {"threads", required_argument, 0, 't'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  Nthreads = thread_default(Nthreads);
+
+  while ((opt_char = getopt_long(argc, argv, "i:l:o:s:bz:c:p:t:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -i or --input */
+    case (int)('i'):
+      snprintf(Filein, sizeof(Filein), "%s", optarg);
+      Source = SRCMOVIEZ;
+      Batchmode = 1;
+      break;
+    /* -l or --list */
+    case (int)('l'):
+      snprintf(Filein, sizeof(Filein), "%s", optarg);
+      Source = SRCLIST;
+      Batchmode = 1;
+      break;
+    /* -o or --output */
+    case (int)('o'):
+      snprintf(Fileout, sizeof(Fileout), "%s", optarg);
+      break;
+    /* -s or --scale */
+    case (int)('s'):
+      Iscale = atoi(optarg);
+      if (Iscale < 1)
+        return (1);
+      break;
+    /* -b or --bse */
+    case (int)('b'):
+      Bse = 1;
+      break;
+    /* -z or --slice */
+    case (int)('z'):
+      Slice = atoi(optarg);
+      if (Slice < 0)
+        return (1);
+      break;
+    /* -c or --level */
+    case (int)('c'):
+      Level = atoi(optarg);
+      if (Level < 0 || Level > 9)
+        return (1);
+      break;
+    /* -p or --pipe */
+    case (int)('p'):
+      snprintf(Pipecmd, sizeof(Pipecmd), "%s", optarg);
+      break;
+    /* -t or --threads */
+    case (int)('t'):
+      Nthreads = atoi(optarg);
+      if (Nthreads < 1)
+        Nthreads = 1;
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (optind != argc)
+    return (1);
 
   return (0);
 }
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: hydmovie [-i,--input <movie> | -l,--list "
+                  "<image index>]\n");
+  fprintf(stderr, "                [-o,--output <root>] [-s,--scale <n>] "
+                  "[-b,--bse]\n");
+  fprintf(stderr, "                [-z,--slice <z>] [-c,--level <0-9>] "
+                  "[-p,--pipe <command>]\n");
+  fprintf(stderr, "                [-t,--threads <n>]\n\n");
+  fprintf(stderr, "  --input    movie file to draw, binary or ASCII\n");
+  fprintf(stderr, "  --list     image index file from disrealnew; one slice "
+                  "of each\n");
+  fprintf(stderr, "             image is drawn\n");
+  fprintf(stderr, "  --output   root of the frame names, root0000.png and "
+                  "so on\n");
+  fprintf(stderr, "             (default: the input name)\n");
+  fprintf(stderr, "  --scale    factor by which to magnify the frames "
+                  "(default: 1)\n");
+  fprintf(stderr, "  --bse      simulate a backscattered electron image\n");
+  fprintf(stderr, "  --slice    z of the slice drawn from each image "
+                  "(default: middle)\n");
+  fprintf(stderr, "  --level    zlib compression level of the PNG files\n");
+  fprintf(stderr, "             (default: 1 without prompts, else the "
+                  "libpng default)\n");
+  fprintf(stderr, "  --pipe     write raw rgb24 frames to this command, "
+                  "e.g. an encoder\n");
+  fprintf(stderr, "             reading from standard input, instead of "
+                  "PNG files\n");
+  fprintf(stderr, "  --threads  draw and write this many frames at once "
+                  "(default: VCCTL_THREADS, or 1)\n");
+  fprintf(stderr, "Without --input or --list the rest of the input is read "
+                  "from the prompts.\n\n");
+
+  return;
+}
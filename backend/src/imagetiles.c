@@ -0,0 +1,499 @@
+/******************************************************
+ *
+ * Program imagetiles
+ *
+ * Makes a cache of views of a 3D microstructure for
+ * browsing it slice by slice:
+ *
+ * 	(1) a level-of-detail pyramid of the image,
+ * 	    coarsened by 2, 4 and 8, each coarse voxel
+ * 	    taking the most common phase of the voxels
+ * 	    it covers
+ * 	(2) a PNG tile for every slice normal to each
+ * 	    axis, at full resolution and at each coarser
+ * 	    level
+ * 	(3) a small text index of the above
+ *
+ * The cache is the directory <image>.tiles next to the
+ * image.  The image is read once; the pyramid is built
+ * from each slab of eight x planes in turn, and the
+ * tiles of the different slices are written in
+ * parallel.
+ *
+ *******************************************************/
+#include <png.h>
+#include "include/vcctl.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define MAKEDIR(d) _mkdir(d)
+#else
+#define MAKEDIR(d) mkdir((d), 0755)
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/***
+ *	Most levels of the pyramid (coarsened by 2, 4 and 8)
+ ***/
+#define MAXLEVELS 3
+
+/***
+ *	Global variables
+ ***/
+float Version;
+int Nlevels = MAXLEVELS, Pnglevel = 1, Nthreads = 1;
+char Filein[MAXSTRING], Dirname[MAXSTRING];
+pixel_t Lut[256];
+
+/***
+ *	One level of the pyramid: level 0 is the image
+ *	itself, level k is coarsened by 2^k
+ ***/
+typedef struct {
+  int fact;
+  int xsize;
+  int ysize;
+  int zsize;
+  unsigned char *vox;
+} Lodlevel;
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
+void coarsen(Lodlevel *fine, Lodlevel *lod, int x0, int x1);
+int writetiles(Lodlevel *lod, int axis);
+int writeindex(Lodlevel *lod, int nlev, float res);
+
+int main(int argc, char *argv[]) {
+  int k, ix, xsyssize, ysyssize, zsyssize, status;
+  int red[NPHASES], green[NPHASES], blue[NPHASES];
+  float res;
+  size_t cap = 0;
+  char name[MAXSTRING];
+  FILE *infile, *outfile;
+  Lodlevel lod[MAXLEVELS + 1];
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    exit(1);
+  }
+
+  memset(lod, 0, sizeof(lod));
+
+  /***
+   *	Read the image once
+   ***/
+
+  infile = filehandler("imagetiles", Filein, "READ");
+  if (!infile)
+    exit(1);
+  if (load_microstructure(infile, &lod[0].vox, &cap, &Version, &xsyssize,
+                          &ysyssize, &zsyssize, &res)) {
+    fclose(infile);
+    if (lod[0].vox)
+      free(lod[0].vox);
+    bailout("imagetiles", "Error reading microstructure image");
+    exit(1);
+  }
+  fclose(infile);
+
+  lod[0].fact = 1;
+  lod[0].xsize = xsyssize;
+  lod[0].ysize = ysyssize;
+  lod[0].zsize = zsyssize;
+
+  printf("\nRead %s (%d x %d x %d)", Filein, xsyssize, ysyssize, zsyssize);
+  fflush(stdout);
+
+  snprintf(Dirname, sizeof(Dirname), "%s.tiles", Filein);
+  if (MAKEDIR(Dirname)) {
+    struct stat sb;
+    if (stat(Dirname, &sb) || !(sb.st_mode & S_IFDIR)) {
+      free(lod[0].vox);
+      bailout("imagetiles", "Could not make the tile directory");
+      exit(1);
+    }
+  }
+
+  /***
+   *	Allocate the coarse levels, each voxel of which
+   *	covers up to 2^k voxels of the image along each
+   *	axis
+   ***/
+
+  status = 0;
+  for (k = 1; k <= Nlevels; k++) {
+    lod[k].fact = 1 << k;
+    lod[k].xsize = (xsyssize + lod[k].fact - 1) / lod[k].fact;
+    lod[k].ysize = (ysyssize + lod[k].fact - 1) / lod[k].fact;
+    lod[k].zsize = (zsyssize + lod[k].fact - 1) / lod[k].fact;
+    lod[k].vox = (unsigned char *)malloc((size_t)lod[k].xsize * lod[k].ysize *
+                                         lod[k].zsize);
+    if (!lod[k].vox)
+      status = 1;
+  }
+  if (status) {
+    for (k = 0; k <= Nlevels; k++) {
+      if (lod[k].vox)
+        free(lod[k].vox);
+    }
+    bailout("imagetiles", "Could not allocate memory for the pyramid");
+    exit(1);
+  }
+
+  /***
+   *	Build every coarse level from one slab of the
+   *	coarsest level's x planes at a time, so that
+   *	each slab is used while it is in cache
+   ***/
+
+  for (ix = 0; ix < xsyssize; ix += (1 << Nlevels)) {
+    for (k = 1; k <= Nlevels; k++) {
+      coarsen(&lod[0], &lod[k], ix, ix + (1 << Nlevels));
+    }
+  }
+
+  for (k = 1; k <= Nlevels && !status; k++) {
+    snprintf(name, sizeof(name), "%s/lod%d.img", Dirname, lod[k].fact);
+    outfile = fopen(name, "wb");
+    if (!outfile ||
+        write_binimg(outfile, lod[k].vox, lod[k].xsize, lod[k].ysize,
+                     lod[k].zsize, res * lod[k].fact, IMG_UINT8Z)) {
+      bailout("imagetiles", "Could not write a level of the pyramid");
+      status = 1;
+    }
+    if (outfile)
+      fclose(outfile);
+  }
+
+  /***
+   *	Write the tiles, one color per phase
+   ***/
+
+  cemcolors(red, green, blue, 0);
+  for (k = 0; k < 256; k++) {
+    if (k < (NPHASES)) {
+      Lut[k].red = red[k];
+      Lut[k].green = green[k];
+      Lut[k].blue = blue[k];
+    } else {
+      Lut[k].red = Lut[k].green = Lut[k].blue = 0;
+    }
+  }
+
+  for (k = 0; k <= Nlevels && !status; k++) {
+    for (ix = 0; ix < 3 && !status; ix++) {
+      status = writetiles(&lod[k], ix);
+    }
+  }
+
+  if (!status)
+    status = writeindex(lod, Nlevels, res);
+
+  if (!status) {
+    printf("\nWrote the tiles and pyramid to %s\n", Dirname);
+  }
+  fflush(stdout);
+
+  for (k = 0; k <= Nlevels; k++)
+    free(lod[k].vox);
+
+  return (status);
+}
+
+/***
+ *	coarsen
+ *
+ *	Fills the voxels of a coarse level that cover the x
+ *	planes x0 to x1-1 of the image (x0 a multiple of the
+ *	coarsening factor).  Each coarse voxel takes the most
+ *	common phase of the image voxels it covers, or the
+ *	lowest such phase if there is a tie.  Only the counts
+ *	that were raised are cleared, so the cost is the
+ *	number of image voxels rather than of phases.
+ *
+ * 	Arguments:	Lodlevel pointer to the image
+ * 			Lodlevel pointer to the coarse level
+ * 			int x0, x1
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void coarsen(Lodlevel *fine, Lodlevel *lod, int x0, int x1) {
+  int f, bx, by, bz, x, y, z, xe, ye, ze, v, best, bestcnt;
+  int count[256];
+  unsigned char *p;
+
+  memset(count, 0, sizeof(count));
+  f = lod->fact;
+  if (x1 > fine->xsize)
+    x1 = fine->xsize;
+
+  for (bx = x0 / f; bx * f < x1; bx++) {
+    xe = (bx + 1) * f;
+    if (xe > fine->xsize)
+      xe = fine->xsize;
+    for (by = 0; by < lod->ysize; by++) {
+      ye = (by + 1) * f;
+      if (ye > fine->ysize)
+        ye = fine->ysize;
+      for (bz = 0; bz < lod->zsize; bz++) {
+        ze = (bz + 1) * f;
+        if (ze > fine->zsize)
+          ze = fine->zsize;
+
+        best = 0;
+        bestcnt = 0;
+        for (x = bx * f; x < xe; x++) {
+          for (y = by * f; y < ye; y++) {
+            p = fine->vox + ((size_t)x * fine->ysize + y) * fine->zsize;
+            for (z = bz * f; z < ze; z++) {
+              v = p[z];
+              count[v]++;
+              if (count[v] > bestcnt || (count[v] == bestcnt && v < best)) {
+                best = v;
+                bestcnt = count[v];
+              }
+            }
+          }
+        }
+        lod->vox[((size_t)bx * lod->ysize + by) * lod->zsize + bz] =
+            (unsigned char)best;
+
+        for (x = bx * f; x < xe; x++) {
+          for (y = by * f; y < ye; y++) {
+            p = fine->vox + ((size_t)x * fine->ysize + y) * fine->zsize;
+            for (z = bz * f; z < ze; z++)
+              count[p[z]] = 0;
+          }
+        }
+      }
+    }
+  }
+
+  return;
+}
+
+/***
+ *	writetiles
+ *
+ *	Writes a PNG tile for every slice of one level normal
+ *	to one axis.  Tile (i,j) is voxel (s,i,j), (i,s,j) or
+ *	(i,j,s) of slice s normal to x, y or z, as in oneimage.
+ *	Slices are shared among the threads.
+ *
+ * 	Arguments:	Lodlevel pointer
+ * 			int axis (0 for x, 1 for y, 2 for z)
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		pixelvector, save_png_level
+ *	Called by:	main program
+ ***/
+int writetiles(Lodlevel *lod, int axis) {
+  int s, nslices, dx, dy, status;
+  char axisname[3] = {'x', 'y', 'z'};
+
+  if (axis == 0) {
+    nslices = lod->xsize;
+    dx = lod->ysize;
+    dy = lod->zsize;
+  } else if (axis == 1) {
+    nslices = lod->ysize;
+    dx = lod->xsize;
+    dy = lod->zsize;
+  } else {
+    nslices = lod->zsize;
+    dx = lod->xsize;
+    dy = lod->ysize;
+  }
+
+  status = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(Nthreads) reduction(| : status)
+#endif
+  {
+    int i, j, x, y, z;
+    char name[MAXSTRING];
+    bitmap_t image;
+
+    image.width = dx;
+    image.height = dy;
+    image.pixels = pixelvector((size_t)dx * dy);
+    if (!image.pixels)
+      status |= 1;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+    for (s = 0; s < nslices; s++) {
+      if (!image.pixels)
+        continue;
+      for (j = 0; j < dy; j++) {
+        for (i = 0; i < dx; i++) {
+          x = (axis == 0) ? s : i;
+          y = (axis == 1) ? s : ((axis == 0) ? i : j);
+          z = (axis == 2) ? s : j;
+          image.pixels[(size_t)j * dx + i] =
+              Lut[lod->vox[((size_t)x * lod->ysize + y) * lod->zsize + z]];
+        }
+      }
+      snprintf(name, sizeof(name), "%s/%c%d_%04d.png", Dirname,
+               axisname[axis], lod->fact, s);
+      if (save_png_level(&image, name, Pnglevel))
+        status |= 1;
+    }
+
+    if (image.pixels)
+      free_pixelvector(image.pixels);
+  }
+
+  if (status)
+    bailout("imagetiles", "Could not write a tile");
+
+  return (status);
+}
+
+/***
+ *	writeindex
+ *
+ *	Writes the index of the cache, index.txt.  The size and
+ *	time of the image let a reader tell whether the cache
+ *	is older than the image.
+ *
+ * 	Arguments:	Lodlevel array, int number of coarse levels,
+ * 			float resolution of the image
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int writeindex(Lodlevel *lod, int nlev, float res) {
+  int k;
+  char name[MAXSTRING];
+  struct stat sb;
+  FILE *fp;
+
+  snprintf(name, sizeof(name), "%s/index.txt", Dirname);
+  fp = filehandler("imagetiles", name, "WRITE");
+  if (!fp)
+    return (1);
+
+  if (stat(Filein, &sb))
+    memset(&sb, 0, sizeof(sb));
+
+  fprintf(fp, "%s %s\n", VERSIONSTRING, VERSIONNUMBER);
+  fprintf(fp, "Source: %s\n", Filein);
+  fprintf(fp, "Source_Bytes: %ld\n", (long)sb.st_size);
+  fprintf(fp, "Source_Time: %ld\n", (long)sb.st_mtime);
+  fprintf(fp, "%s %4.2f\n", IMGRESSTRING, res);
+  fprintf(fp, "Levels: %d\n", nlev + 1);
+  fprintf(fp, "# factor xsize ysize zsize volume\n");
+  for (k = 0; k <= nlev; k++) {
+    if (k == 0) {
+      fprintf(fp, "%d %d %d %d -\n", lod[k].fact, lod[k].xsize, lod[k].ysize,
+              lod[k].zsize);
+    } else {
+      fprintf(fp, "%d %d %d %d lod%d.img\n", lod[k].fact, lod[k].xsize,
+              lod[k].ysize, lod[k].zsize, lod[k].fact);
+    }
+  }
+  fprintf(fp, "# tiles are <axis><factor>_<slice>.png, e.g. z4_0012.png\n");
+
+  fclose(fp);
+  return (0);
+}
+
+/***
+ *	checkargs
+ *
+ *	Read the options and the name of the image
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"levels", required_argument, 0, 'l'},
+                                      {"level", required_argument, 0, 'c'},
+                                      {"threads", required_argument, 0, 't'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  Nthreads = thread_default(Nthreads);
+
+  while ((opt_char = getopt_long(argc, argv, "l:c:t:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -l or --levels */
+    case (int)('l'):
+      Nlevels = atoi(optarg);
+      if (Nlevels < 0 || Nlevels > MAXLEVELS)
+        return (1);
+      break;
+    /* -c or --level */
+    case (int)('c'):
+      Pnglevel = atoi(optarg);
+      if (Pnglevel < 0 || Pnglevel > 9)
+        return (1);
+      break;
+    /* -t or --threads */
+    case (int)('t'):
+      Nthreads = atoi(optarg);
+      if (Nthreads < 1)
+        Nthreads = 1;
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (optind != argc - 1)
+    return (1);
+  snprintf(Filein, sizeof(Filein), "%s", argv[optind]);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: imagetiles [-l,--levels <n>] [-c,--level "
+                  "<0-9>] [-t,--threads <n>]\n");
+  fprintf(stderr, "                  <image>\n\n");
+  fprintf(stderr, "Writes the slices of an image as PNG tiles, with a "
+                  "pyramid of coarser\n");
+  fprintf(stderr, "images and their tiles, to the directory "
+                  "<image>.tiles:\n\n");
+  fprintf(stderr, "  --levels   number of coarser levels, each half the "
+                  "size of the last\n");
+  fprintf(stderr, "             (0 to 3, default: 3)\n");
+  fprintf(stderr, "  --level    zlib compression level of the tiles "
+                  "(default: 1)\n");
+  fprintf(stderr, "  --threads  write this many tiles at once "
+                  "(default: VCCTL_THREADS, or 1)\n\n");
+
+  return;
+}
@@ -0,0 +1,395 @@
+/***
+ *	antpool
+ *
+ * 	Management of the contiguous pool of diffusing species
+ * 	(ants) used by dissolve, hydrate, loccsh and addcrack.
+ *
+ * 	The pool replaces the former doubly linked list of
+ * 	individually malloc'd ants.  New ants are always appended
+ * 	at the end of the pool, and hydrate removes reacted ants
+ * 	by compacting the survivors toward the front of the pool
+ * 	while it walks them, which never changes the relative
+ * 	order of the surviving ants.  With the --legacy-ants option
+ * 	the pool is walked in exactly the order the linked list had,
+ * 	so a given random number seed reproduces the hydration
+ * 	history of the original code.
+ *
+ * 	Each ant attribute lives in its own array (see struct
+ * 	Antpool in disrealnew.h) so that the position update in
+ * 	hydrate touches only the coordinate arrays.
+ *
+ * 	sortantpool groups the ants into one contiguous bucket per
+ * 	diffusing species so that hydrate can process a whole
+ * 	species at a time.  With --sorted-ants, sortantcells first
+ * 	puts the pool in the order of the rows of Mic, so that each
+ * 	bucket is walked through the microstructure from one end to
+ * 	the other instead of in the random order of creation.
+ ***/
+
+/***
+ *	resizeantpool
+ *
+ * 	Reallocate every attribute array of the ant pool to hold
+ * 	a new number of ants.  Existing ants are preserved.
+ *
+ * 	Arguments:	int new number of slots
+ * 	Returns:	0 if okay, MEMERR otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	initantpool, addant
+ ***/
+int resizeantpool(int newsize) {
+  void *newp;
+  size_t n;
+
+  n = (size_t)newsize;
+
+  newp = realloc(Antpool.x, n * sizeof(unsigned short int));
+  if (!newp)
+    return (MEMERR);
+  Antpool.x = (unsigned short int *)newp;
+
+  newp = realloc(Antpool.y, n * sizeof(unsigned short int));
+  if (!newp)
+    return (MEMERR);
+  Antpool.y = (unsigned short int *)newp;
+
+  newp = realloc(Antpool.z, n * sizeof(unsigned short int));
+  if (!newp)
+    return (MEMERR);
+  Antpool.z = (unsigned short int *)newp;
+
+  newp = realloc(Antpool.id, n * sizeof(unsigned char));
+  if (!newp)
+    return (MEMERR);
+  Antpool.id = (unsigned char *)newp;
+
+  newp = realloc(Antpool.cycbirth, n * sizeof(short int));
+  if (!newp)
+    return (MEMERR);
+  Antpool.cycbirth = (short int *)newp;
+
+  newp = realloc(Antpool.sx, n * sizeof(unsigned short int));
+  if (!newp)
+    return (MEMERR);
+  Antpool.sx = (unsigned short int *)newp;
+
+  newp = realloc(Antpool.sy, n * sizeof(unsigned short int));
+  if (!newp)
+    return (MEMERR);
+  Antpool.sy = (unsigned short int *)newp;
+
+  newp = realloc(Antpool.sz, n * sizeof(unsigned short int));
+  if (!newp)
+    return (MEMERR);
+  Antpool.sz = (unsigned short int *)newp;
+
+  newp = realloc(Antpool.sid, n * sizeof(unsigned char));
+  if (!newp)
+    return (MEMERR);
+  Antpool.sid = (unsigned char *)newp;
+
+  newp = realloc(Antpool.scycbirth, n * sizeof(short int));
+  if (!newp)
+    return (MEMERR);
+  Antpool.scycbirth = (short int *)newp;
+
+  Antpool.size = newsize;
+
+  return (0);
+}
+
+/***
+ *	initantpool
+ *
+ * 	Allocate the ant pool with an initial number of slots
+ *
+ * 	Arguments:	int number of slots to allocate
+ * 	Returns:	0 if okay, MEMERR otherwise
+ *
+ *	Calls:		resizeantpool
+ *	Called by:	init
+ ***/
+int initantpool(int size) {
+  if (size < 1)
+    size = ANTPOOLSIZE;
+
+  Antpool.num = Antpool.size = 0;
+
+  return (resizeantpool(size));
+}
+
+/***
+ *	addant
+ *
+ * 	Append a new diffusing species to the end of the ant pool,
+ * 	doubling the capacity of the pool if it is full.  During a
+ * 	threaded sweep of dissolve the ant is queued on the slab
+ * 	instead (see slabant).
+ *
+ * 	Arguments:	int x,y,z coordinates of the ant
+ * 				int phase id of the ant
+ * 				int cycle in which the ant was created
+ * 	Returns:	0 if okay, MEMERR otherwise
+ *
+ *	Calls:		resizeantpool, slabant
+ *	Called by:	dissolvesite, loccsh, addslabants
+ ***/
+int addant(int x, int y, int z, int id, int cycbirth) {
+  int newsize, n;
+
+  if (Deferrand)
+    return (slabant(x, y, z, id, cycbirth));
+
+  if (Antpool.num >= Antpool.size) {
+    newsize = (Antpool.size > 0) ? (2 * Antpool.size) : ANTPOOLSIZE;
+    if (resizeantpool(newsize)) {
+      fprintf(stderr, "\nERROR: Could not grow ant pool to %d ants", newsize);
+      fflush(stderr);
+      return (MEMERR);
+    }
+  }
+
+  n = Antpool.num;
+  Antpool.x[n] = (unsigned short int)x;
+  Antpool.y[n] = (unsigned short int)y;
+  Antpool.z[n] = (unsigned short int)z;
+  Antpool.id[n] = (unsigned char)id;
+  Antpool.cycbirth[n] = (short int)cycbirth;
+  Antpool.num++;
+
+  return (0);
+}
+
+/***
+ *	swapantscratch
+ *
+ * 	Swap the scratch arrays of the ant pool in as the live
+ * 	arrays, after a sort has filled them
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	sortantpool, sortantcells
+ ***/
+void swapantscratch(void) {
+  unsigned short int *usp;
+  unsigned char *ucp;
+  short int *sp;
+
+  usp = Antpool.x;
+  Antpool.x = Antpool.sx;
+  Antpool.sx = usp;
+  usp = Antpool.y;
+  Antpool.y = Antpool.sy;
+  Antpool.sy = usp;
+  usp = Antpool.z;
+  Antpool.z = Antpool.sz;
+  Antpool.sz = usp;
+  ucp = Antpool.id;
+  Antpool.id = Antpool.sid;
+  Antpool.sid = ucp;
+  sp = Antpool.cycbirth;
+  Antpool.cycbirth = Antpool.scycbirth;
+  Antpool.scycbirth = sp;
+
+  return;
+}
+
+/***
+ *	sortantpool
+ *
+ * 	Stable counting sort of the ant pool by species id, so that
+ * 	the ants of each diffusing species occupy one contiguous
+ * 	bucket of the pool.  Within a bucket the ants keep their
+ * 	order of creation.  With more than one slab the buckets are
+ * 	ordered by slab first (see antslab.h), giving NANTSPECIES
+ * 	buckets per slab.
+ *
+ * 	Arguments:	int number of slabs (1 to sort by species only)
+ * 				int array of first slots of each bucket
+ * 				int array of one-past-last slots of each bucket
+ * 	Returns:	Nothing
+ *
+ *	Calls:		swapantscratch
+ *	Called by:	hydrate
+ ***/
+void sortantpool(int nslab, int *bstart, int *bend) {
+  int i, ib, n, nb, nbad;
+
+  nb = nslab * NANTSPECIES;
+  for (ib = 0; ib < nb; ib++)
+    bstart[ib] = bend[ib] = 0;
+
+  /* Count the ants of each species */
+
+  nbad = 0;
+  for (i = 0; i < Antpool.num; i++) {
+    ib = ANTBUCKET((int)Antpool.id[i]);
+    if (ib >= 0 && ib < NANTSPECIES) {
+      if (nslab > 1)
+        ib += NANTSPECIES * Slabofx[Antpool.x[i]];
+      bend[ib]++;
+    } else {
+      nbad++;
+    }
+  }
+
+  if (nbad > 0) {
+    fprintf(stderr, "\nERROR in sortantpool: %d ants with unknown ID", nbad);
+    fflush(stderr);
+  }
+
+  /* Convert counts into bucket offsets */
+
+  n = 0;
+  for (ib = 0; ib < nb; ib++) {
+    bstart[ib] = n;
+    n += bend[ib];
+    bend[ib] = bstart[ib];
+  }
+
+  /* Scatter the ants into the scratch arrays */
+
+  for (i = 0; i < Antpool.num; i++) {
+    ib = ANTBUCKET((int)Antpool.id[i]);
+    if (ib < 0 || ib >= NANTSPECIES) {
+      Ngoing--;
+      continue;
+    }
+    if (nslab > 1)
+      ib += NANTSPECIES * Slabofx[Antpool.x[i]];
+    n = bend[ib]++;
+    Antpool.sx[n] = Antpool.x[i];
+    Antpool.sy[n] = Antpool.y[i];
+    Antpool.sz[n] = Antpool.z[i];
+    Antpool.sid[n] = Antpool.id[i];
+    Antpool.scycbirth[n] = Antpool.cycbirth[i];
+  }
+
+  Antpool.num -= nbad;
+  swapantscratch();
+
+  return;
+}
+
+/***
+ *	sortantcells
+ *
+ * 	Stable sort of the ant pool by the row of Mic each ant is
+ * 	in, x first and then y, as two counting sort passes.  Ants
+ * 	in the same row keep their order.  A stable sortantpool
+ * 	afterward leaves every bucket in this order.
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		swapantscratch
+ *	Called by:	hydrate
+ ***/
+void sortantcells(void) {
+  int i, n, pass, c, sum;
+  int count[MAXSIZE];
+  unsigned short int *key;
+
+  /* Least significant key first, so y and then x */
+
+  for (pass = 0; pass < 2; pass++) {
+    for (c = 0; c < MAXSIZE; c++)
+      count[c] = 0;
+    key = (pass == 0) ? Antpool.y : Antpool.x;
+    for (i = 0; i < Antpool.num; i++)
+      count[key[i]]++;
+
+    sum = 0;
+    for (c = 0; c < MAXSIZE; c++) {
+      n = count[c];
+      count[c] = sum;
+      sum += n;
+    }
+
+    for (i = 0; i < Antpool.num; i++) {
+      n = count[key[i]]++;
+      Antpool.sx[n] = Antpool.x[i];
+      Antpool.sy[n] = Antpool.y[i];
+      Antpool.sz[n] = Antpool.z[i];
+      Antpool.sid[n] = Antpool.id[i];
+      Antpool.scycbirth[n] = Antpool.cycbirth[i];
+    }
+    swapantscratch();
+  }
+
+  return;
+}
+
+/***
+ *	moveantrange
+ *
+ * 	Move a run of consecutive ants to another place in the
+ * 	pool.  The two ranges may overlap.
+ *
+ * 	Arguments:	int first slot of the run
+ * 				int slot to move the run to
+ * 				int number of ants in the run
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	gatherslabs
+ ***/
+void moveantrange(int from, int to, int n) {
+  if (n <= 0 || from == to)
+    return;
+
+  memmove(Antpool.x + to, Antpool.x + from, n * sizeof(unsigned short int));
+  memmove(Antpool.y + to, Antpool.y + from, n * sizeof(unsigned short int));
+  memmove(Antpool.z + to, Antpool.z + from, n * sizeof(unsigned short int));
+  memmove(Antpool.id + to, Antpool.id + from, n * sizeof(unsigned char));
+  memmove(Antpool.cycbirth + to, Antpool.cycbirth + from,
+          n * sizeof(short int));
+
+  return;
+}
+
+/***
+ *	freeantpool
+ *
+ * 	Release all memory held by the ant pool
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	freeallmem
+ ***/
+void freeantpool(void) {
+  if (Antpool.x)
+    free(Antpool.x);
+  if (Antpool.y)
+    free(Antpool.y);
+  if (Antpool.z)
+    free(Antpool.z);
+  if (Antpool.id)
+    free(Antpool.id);
+  if (Antpool.cycbirth)
+    free(Antpool.cycbirth);
+  if (Antpool.sx)
+    free(Antpool.sx);
+  if (Antpool.sy)
+    free(Antpool.sy);
+  if (Antpool.sz)
+    free(Antpool.sz);
+  if (Antpool.sid)
+    free(Antpool.sid);
+  if (Antpool.scycbirth)
+    free(Antpool.scycbirth);
+  Antpool.x = Antpool.y = Antpool.z = NULL;
+  Antpool.id = NULL;
+  Antpool.cycbirth = NULL;
+  Antpool.sx = Antpool.sy = Antpool.sz = NULL;
+  Antpool.sid = NULL;
+  Antpool.scycbirth = NULL;
+  Antpool.num = Antpool.size = 0;
+
+  return;
+}
@@ -0,0 +1,413 @@
+/***
+ *	antslab
+ *
+ * 	Slab decomposition of the diffusion step in hydrate, used
+ * 	when disrealnew is run with --threads.
+ *
+ * 	The box is cut along x into an even number of slabs, each
+ * 	at least 2 * ANTREACH pixels thick.  At the start of every
+ * 	diffusion step the ant pool is sorted by slab and species,
+ * 	so one step of the ants of a slab can only read or change
+ * 	Mic inside that slab and the inner halves of its two
+ * 	neighbors.  Slabs of the same parity therefore never touch
+ * 	the same pixels, and each step is an even sweep followed by
+ * 	an odd sweep, each processing its slabs concurrently.
+ *
+ * 	Growth at a random location of the box (the randXXX
+ * 	routines) is not local, so during a sweep it is queued by
+ * 	the slab that caused it and carried out serially, in slab
+ * 	order, after the sweep.  Every slab draws from its own ran1
+ * 	stream (and, with --fast-moves, its own buffer of moveone
+ * 	directions), seeded once from the main stream, and starts each
+ * 	sweep from the same counter values.  The result depends on
+ * 	the seed and the system size, but not on the number of
+ * 	threads or on how the slabs are scheduled.
+ *
+ * 	dissolve goes over the soluble surface with the same slabs
+ * 	and streams (see dissolvesweep).  Placing diffusing CSH
+ * 	near a dissolving pixel reaches further than an ant step,
+ * 	so the slabs are taken in as many sweeps as it takes to
+ * 	keep those of one sweep apart.  New ants are queued on the
+ * 	slab that made them and added to the pool in slab order
+ * 	after each sweep.
+ ***/
+
+/***
+ *	setantslabs
+ *
+ * 	Build the slab decomposition for the current system size,
+ * 	if that has not been done yet or the size has changed
+ * 	since (addcrack can widen the box).  New slabs get their
+ * 	random streams, and their streams of moveone directions,
+ * 	seeded from the main ones.  Boxes too thin for four slabs
+ * 	fall back to serial diffusion.
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay, MEMERR otherwise
+ *
+ *	Calls:		ran1, rng_seed, rng_next
+ *	Called by:	hydrate
+ ***/
+int setantslabs(void) {
+  int i, x, nslab;
+  void *newp;
+
+  if (Slabxsize == Xsyssize)
+    return (0);
+
+  nslab = 2 * (Xsyssize / (4 * ANTREACH));
+  if (nslab < 4) {
+    fprintf(stderr,
+            "\nWARNING: System is only %d pixels wide in x, need at "
+            "least %d for --threads; using serial diffusion",
+            Xsyssize, 8 * ANTREACH);
+    fflush(stderr);
+    Antthreads = 0;
+    Nantslab = 0;
+    return (0);
+  }
+
+  newp = realloc(Slabofx, (size_t)Xsyssize * sizeof(int));
+  if (!newp)
+    return (MEMERR);
+  Slabofx = (int *)newp;
+
+  newp = realloc(Slabbstart, (size_t)(nslab * NANTSPECIES) * sizeof(int));
+  if (!newp)
+    return (MEMERR);
+  Slabbstart = (int *)newp;
+
+  newp = realloc(Slabbend, (size_t)(nslab * NANTSPECIES) * sizeof(int));
+  if (!newp)
+    return (MEMERR);
+  Slabbend = (int *)newp;
+
+  if (nslab > Antslabsize) {
+    newp = realloc(Antslab, (size_t)nslab * sizeof(struct Antslab));
+    if (!newp)
+      return (MEMERR);
+    Antslab = (struct Antslab *)newp;
+    for (i = Antslabsize; i < nslab; i++) {
+      Antslab[i].rng.idum = -(1 + (int)(2147483645.0 * ran1(Seed)));
+      Antslab[i].rng.iy = 0;
+      rng_seed(&(Antslab[i].moves.st), rng_next(&(Mainmoves.st)));
+      Antslab[i].moves.pos = MOVEBUFSIZE;
+      Antslab[i].job = NULL;
+      Antslab[i].njob = Antslab[i].jobsize = Antslab[i].joberr = 0;
+      Antslab[i].ant = NULL;
+      Antslab[i].nant = Antslab[i].antsize = Antslab[i].anterr = 0;
+    }
+    Antslabsize = nslab;
+  }
+
+  for (x = 0; x < Xsyssize; x++)
+    Slabofx[x] = (x * nslab) / Xsyssize;
+
+  Nantslab = nslab;
+  Slabxsize = Xsyssize;
+
+  return (0);
+}
+
+/***
+ *	gettally
+ *
+ * 	Copy the global counters changed by the move routines into
+ * 	a tally.  Inside a sweep these are the calling thread's
+ * 	private copies.
+ *
+ * 	Arguments:	struct Slabtally pointer to fill
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	moveslab, slabsweep, dissolveslab, dissolvesweep
+ ***/
+void gettally(struct Slabtally *t) {
+  int i;
+
+  for (i = 0; i <= NPHASES; i++) {
+    t->count[i] = Count[i];
+    t->discount[i] = Discount[i];
+  }
+  t->ngoing = Ngoing;
+  t->ncshplateinit = Ncshplateinit;
+  t->ncshplategrow = Ncshplategrow;
+  t->nsilica_rx = Nsilica_rx;
+  t->nucsulf2gyps = Nucsulf2gyps;
+  t->nasr = Nasr;
+  t->nnucleate = Nnucleate;
+  t->nrejected = Nrejected;
+  t->nmade = Nmade;
+  t->nslagr = Nslagr;
+  t->slagemptyp = Slagemptyp;
+
+  return;
+}
+
+/***
+ *	settally
+ *
+ * 	Set the global counters changed by the move routines from
+ * 	a tally
+ *
+ * 	Arguments:	struct Slabtally pointer to copy from
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	moveslab, slabsweep, dissolveslab, dissolvesweep
+ ***/
+void settally(struct Slabtally *t) {
+  int i;
+
+  for (i = 0; i <= NPHASES; i++) {
+    Count[i] = t->count[i];
+    Discount[i] = t->discount[i];
+  }
+  Ngoing = t->ngoing;
+  Ncshplateinit = t->ncshplateinit;
+  Ncshplategrow = t->ncshplategrow;
+  Nsilica_rx = t->nsilica_rx;
+  Nucsulf2gyps = t->nucsulf2gyps;
+  Nasr = t->nasr;
+  Nnucleate = t->nnucleate;
+  Nrejected = t->nrejected;
+  Nmade = t->nmade;
+  Nslagr = t->nslagr;
+  Slagemptyp = t->slagemptyp;
+
+  return;
+}
+
+/***
+ *	addtally
+ *
+ * 	Add to a running tally the changes one slab made to the
+ * 	counters during a sweep
+ *
+ * 	Arguments:	struct Slabtally pointer to running sum
+ * 				struct Slabtally pointer to the slab's final values
+ * 				struct Slabtally pointer to values at sweep start
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	slabsweep, dissolvesweep
+ ***/
+void addtally(struct Slabtally *sum, struct Slabtally *end,
+              struct Slabtally *start) {
+  int i;
+
+  for (i = 0; i <= NPHASES; i++) {
+    sum->count[i] += end->count[i] - start->count[i];
+    sum->discount[i] += end->discount[i] - start->discount[i];
+  }
+  sum->ngoing += end->ngoing - start->ngoing;
+  sum->ncshplateinit += end->ncshplateinit - start->ncshplateinit;
+  sum->ncshplategrow += end->ncshplategrow - start->ncshplategrow;
+  sum->nsilica_rx += end->nsilica_rx - start->nsilica_rx;
+  sum->nucsulf2gyps += end->nucsulf2gyps - start->nucsulf2gyps;
+  sum->nasr += end->nasr - start->nasr;
+  sum->nnucleate += end->nnucleate - start->nnucleate;
+  sum->nrejected += end->nrejected - start->nrejected;
+  sum->nmade += end->nmade - start->nmade;
+  sum->nslagr += end->nslagr - start->nslagr;
+  sum->slagemptyp += end->slagemptyp - start->slagemptyp;
+
+  return;
+}
+
+/***
+ *	deferrand
+ *
+ * 	Queue a random-location growth on the slab the calling
+ * 	thread is working on.  If the queue cannot grow the job is
+ * 	lost and the slab is flagged, which slabsweep reports as a
+ * 	fatal error after the sweep.
+ *
+ * 	Arguments:	int kind of growth (RANDCSH, ...)
+ * 				int id of saturated porosity to grow into
+ * 				int ettringite type (RANDETTR only)
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	extcsh, extfh3, extettr, extch, extgyps, extfriedel,
+ *				extstrat, extafm, extpozz, extc3ah6
+ ***/
+void deferrand(int kind, int pval, int etype) {
+  int newsize;
+  void *newp;
+  struct Antslab *sp;
+
+  sp = &(Antslab[Curslab]);
+
+  if (sp->njob >= sp->jobsize) {
+    newsize = (sp->jobsize > 0) ? (2 * sp->jobsize) : 256;
+    newp = realloc(sp->job, (size_t)newsize * sizeof(struct Randjob));
+    if (!newp) {
+      sp->joberr = 1;
+      return;
+    }
+    sp->job = (struct Randjob *)newp;
+    sp->jobsize = newsize;
+  }
+
+  sp->job[sp->njob].kind = (unsigned char)kind;
+  sp->job[sp->njob].pval = (unsigned char)pval;
+  sp->job[sp->njob].etype = (unsigned char)etype;
+  sp->njob++;
+
+  return;
+}
+
+/***
+ *	slabant
+ *
+ * 	Queue a new diffusing species on the slab the calling
+ * 	thread is working on, for addslabants to put in the ant
+ * 	pool after the sweep.  As in deferrand, if the queue cannot
+ * 	grow the ant is lost and the slab is flagged, which
+ * 	dissolvesweep reports as a fatal error after the sweep.
+ *
+ * 	Arguments:	int x,y,z coordinates of the ant
+ * 				int phase id of the ant
+ * 				int cycle in which the ant was created
+ * 	Returns:	0
+ *
+ *	Calls:		No other routines
+ *	Called by:	addant
+ ***/
+int slabant(int x, int y, int z, int id, int cycbirth) {
+  int newsize;
+  void *newp;
+  struct Antslab *sp;
+
+  sp = &(Antslab[Curslab]);
+
+  if (sp->nant >= sp->antsize) {
+    newsize = (sp->antsize > 0) ? (2 * sp->antsize) : 256;
+    newp = realloc(sp->ant, (size_t)newsize * sizeof(struct Newant));
+    if (!newp) {
+      sp->anterr = 1;
+      return (0);
+    }
+    sp->ant = (struct Newant *)newp;
+    sp->antsize = newsize;
+  }
+
+  sp->ant[sp->nant].x = (unsigned short int)x;
+  sp->ant[sp->nant].y = (unsigned short int)y;
+  sp->ant[sp->nant].z = (unsigned short int)z;
+  sp->ant[sp->nant].id = (unsigned char)id;
+  sp->ant[sp->nant].cycbirth = (short int)cycbirth;
+  sp->nant++;
+
+  return (0);
+}
+
+/***
+ *	addslabants
+ *
+ * 	Add the diffusing species a slab queued during a sweep to
+ * 	the end of the ant pool, in the order they were made
+ *
+ * 	Arguments:	int slab index
+ * 	Returns:	0 if okay, MEMERR otherwise
+ *
+ *	Calls:		addant
+ *	Called by:	dissolvesweep
+ ***/
+int addslabants(int is) {
+  int j;
+  struct Antslab *sp;
+
+  sp = &(Antslab[is]);
+
+  for (j = 0; j < sp->nant; j++) {
+    if (addant((int)sp->ant[j].x, (int)sp->ant[j].y, (int)sp->ant[j].z,
+               (int)sp->ant[j].id, (int)sp->ant[j].cycbirth))
+      return (MEMERR);
+  }
+  sp->nant = 0;
+
+  return (0);
+}
+
+/***
+ *	gatherslabs
+ *
+ * 	After both sweeps of a diffusion step, close the gaps left
+ * 	between the compacted slab ranges of the ant pool
+ *
+ * 	Arguments:	None
+ * 	Returns:	int number of ants left in the pool
+ *
+ *	Calls:		moveantrange
+ *	Called by:	hydrate
+ ***/
+int gatherslabs(void) {
+  int is, lo, hi, n;
+
+  n = 0;
+  for (is = 0; is < Nantslab; is++) {
+    lo = Slabbstart[is * NANTSPECIES];
+    hi = Slabbend[is * NANTSPECIES + NANTSPECIES - 1];
+    moveantrange(lo, n, hi - lo);
+    n += hi - lo;
+  }
+
+  return (n);
+}
+
+/***
+ *	freeantslabs
+ *
+ * 	Release all memory held by the slab decomposition
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	freeallmem
+ ***/
+void freeantslabs(void) {
+  int i;
+
+  for (i = 0; i < Antslabsize; i++) {
+    if (Antslab[i].job)
+      free(Antslab[i].job);
+    if (Antslab[i].ant)
+      free(Antslab[i].ant);
+  }
+  if (Antslab)
+    free(Antslab);
+  if (Slabofx)
+    free(Slabofx);
+  if (Slabbstart)
+    free(Slabbstart);
+  if (Slabbend)
+    free(Slabbend);
+  Antslab = NULL;
+  Slabofx = Slabbstart = Slabbend = NULL;
+  Nantslab = Antslabsize = Slabxsize = 0;
+
+  return;
+}
+
+/***
+ *	slabtid
+ *
+ * 	Thread of the timeline (see trace.c) that the calling
+ * 	thread of a slab sweep writes its spans on
+ *
+ * 	Arguments:	None
+ * 	Returns:	int thread of the timeline
+ *
+ *	Calls:		No other routines
+ *	Called by:	slabsweep, dissolvesweep
+ ***/
+int slabtid(void) {
+#ifdef _OPENMP
+  return (TRACEPOOL + omp_get_thread_num());
+#else
+  return (TRACEPOOL);
+#endif
+}
@@ -0,0 +1,313 @@
+/***
+ *	bitplane
+ *
+ * 	One bit per voxel for each of a few classes of phase,
+ * 	asked for with --bit-planes, so that a question about a
+ * 	class reads 64 voxels per word instead of one per byte.
+ * 	Each plane holds a z row of Mic as Bitwords words, bit z
+ * 	& 63 of word z >> 6, the rows in x, y order; the bits past
+ * 	Zsyssize in the last word of a row are always clear.
+ *
+ * 		BITPOROSITY: saturated porosity
+ * 		BITCRACKP:   porosity in a crack
+ * 		BITSOLID:    the SURFSOLID class (see Surfclass)
+ * 		BITCEMENT:   the SURFCEMENT class
+ *
+ * 	Every change of one pixel of Mic goes through MICSET, which
+ * 	sets the bits of the pixel in every plane.  A pixel marked
+ * 	for dissolution (its id plus OFFSET) is left in the class
+ * 	of the phase it still is.  Whatever makes Mic anew as a
+ * 	whole calls bitbuild afterward (see layerbuild).
+ *
+ * 	burn3d sees whether the pore space has changed since it was
+ * 	last labeled by comparing the two pore planes with a copy
+ * 	of them, and measuresurf counts the faces between porosity
+ * 	and the solids with word shifts and popcounts.  The planes
+ * 	cost half a byte per voxel and one more read-modify-write
+ * 	for each change of Mic; the hydration history is the same
+ * 	as without them.
+ ***/
+
+/***
+ *	bitcount64
+ *
+ * 	Number of bits set in a word
+ *
+ * 	Arguments:	uint64_t word
+ * 	Returns:	int number of bits set
+ *
+ *	Calls:		No other routines
+ *	Called by:	bitsurf
+ ***/
+static inline int bitcount64(uint64_t v) {
+#if defined(__GNUC__)
+  return (__builtin_popcountll(v));
+#else
+  int n;
+
+  for (n = 0; v; n++) {
+    v &= v - 1;
+  }
+  return (n);
+#endif
+}
+
+/***
+ *	bitplaneset
+ *
+ * 	Set the bits of one pixel in every plane from its id in
+ * 	Mic
+ *
+ * 	Arguments:	int x, y and z coordinates of the pixel
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	MICSET
+ ***/
+void bitplaneset(int x, int y, int z) {
+  int p, cls;
+  size_t w;
+  uint64_t bit;
+
+  cls = Bitclass[(unsigned char)Mic[x][y][z]];
+  w = ((size_t)x * Ysyssize + y) * Bitwords + (z >> 6);
+  bit = (uint64_t)1 << (z & 63);
+  for (p = 0; p < NBITPLANES; p++, w += Bitplanelen) {
+    if (cls & (1 << p)) {
+      Bitplane[w] |= bit;
+    } else {
+      Bitplane[w] &= ~bit;
+    }
+  }
+
+  return;
+}
+
+/***
+ *	bitbuild
+ *
+ * 	Fill the planes from the whole of Mic, growing them if the
+ * 	system has grown, and forget the pore space burn3d saw last.
+ * 	Does nothing without --bit-planes.
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay, 1 if out of memory
+ *
+ *	Calls:		No other routines
+ *	Called by:	layerbuild
+ ***/
+int bitbuild(void) {
+  int ix, iy, iz, i, cls;
+  size_t len, w;
+  void *newp;
+
+  if (!Bitplanes)
+    return (0);
+
+  /* Marked pixels stay in the class of the phase they still are */
+
+  for (i = 0; i < SNAPNID; i++) {
+    cls = (i < (OFFSET)) ? i : i - (OFFSET);
+    Bitclass[i] = 0;
+    if (cls == POROSITY)
+      Bitclass[i] |= 1 << BITPOROSITY;
+    if (cls == CRACKP)
+      Bitclass[i] |= 1 << BITCRACKP;
+    if (Surfclass[cls] & SURFSOLID)
+      Bitclass[i] |= 1 << BITSOLID;
+    if (Surfclass[cls] & SURFCEMENT)
+      Bitclass[i] |= 1 << BITCEMENT;
+  }
+
+  Bitwords = (Zsyssize + 63) / 64;
+  len = (size_t)Xsyssize * (size_t)Ysyssize * (size_t)Bitwords;
+  if (Bitplanecap < len) {
+    newp = realloc(Bitplane, (NBITPLANES + 1) * len * sizeof(uint64_t));
+    if (!newp)
+      return (1);
+    Bitplane = (uint64_t *)newp;
+    Bitplanecap = len;
+  }
+  Bitplanelen = len;
+  Bitporesnap = Bitplane + NBITPLANES * len;
+  Bitporevalid = 0;
+
+  memset(Bitplane, 0, NBITPLANES * len * sizeof(uint64_t));
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      for (iz = 0; iz < Zsyssize; iz++) {
+        cls = Bitclass[(unsigned char)Mic[ix][iy][iz]];
+        w = ((size_t)ix * Ysyssize + iy) * Bitwords + (iz >> 6);
+        for (i = 0; i < NBITPLANES; i++) {
+          if (cls & (1 << i))
+            Bitplane[i * len + w] |= (uint64_t)1 << (iz & 63);
+        }
+      }
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *	bitpores
+ *
+ * 	With --bit-planes, see whether the pore space of POROSITY
+ * 	and CRACKP is the one burn3d labeled last, or note it as the
+ * 	one just labeled
+ *
+ * 	Arguments:	int ids of the two phases burn3d is testing
+ * 				int nonzero to note the pore space, zero to
+ * 					compare with the one noted
+ * 	Returns:	1 if the planes can tell and the pore space is the
+ * 				one noted, 0 otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	burn3d
+ ***/
+int bitpores(int npix1, int npix2, int save) {
+  size_t w;
+  const uint64_t *por, *crk;
+
+  if (!Bitplane || !((npix1 == POROSITY && npix2 == CRACKP) ||
+                     (npix1 == CRACKP && npix2 == POROSITY)))
+    return (0);
+
+  por = Bitplane + BITPOROSITY * Bitplanelen;
+  crk = Bitplane + BITCRACKP * Bitplanelen;
+  if (save) {
+    for (w = 0; w < Bitplanelen; w++) {
+      Bitporesnap[w] = por[w] | crk[w];
+    }
+    Bitporevalid = 1;
+    return (0);
+  }
+
+  if (!Bitporevalid)
+    return (0);
+  for (w = 0; w < Bitplanelen; w++) {
+    if (Bitporesnap[w] != (por[w] | crk[w]))
+      return (0);
+  }
+
+  return (1);
+}
+
+/***
+ *	bitzword
+ *
+ * 	One word of a row of a plane moved by one pixel along z
+ * 	with periodic boundaries, so that bit z of the result is
+ * 	bit z + dir of the row
+ *
+ * 	Arguments:	uint64_t pointer to the row
+ * 				int word of the row
+ * 				int direction (1 or -1)
+ * 	Returns:	uint64_t word
+ *
+ *	Calls:		No other routines
+ *	Called by:	bitsurf
+ ***/
+static inline uint64_t bitzword(const uint64_t *row, int w, int dir) {
+  int last, nb;
+  uint64_t v;
+
+  last = Bitwords - 1;
+  nb = Zsyssize - 64 * last;
+  if (dir > 0) {
+    v = row[w] >> 1;
+    if (w < last) {
+      v |= row[w + 1] << 63;
+    } else {
+      v |= (row[0] & 1) << (nb - 1);
+    }
+  } else {
+    v = row[w] << 1;
+    if (w > 0) {
+      v |= row[w - 1] >> 63;
+    } else {
+      v |= (row[last] >> (nb - 1)) & 1;
+    }
+    if (w == last && nb < 64)
+      v &= ((uint64_t)1 << nb) - 1;
+  }
+
+  return (v);
+}
+
+/***
+ *	bitsurf
+ *
+ * 	Count the faces between saturated porosity and the solid
+ * 	and clinker planes, as measuresurf does from Mic
+ *
+ * 	Arguments:	int pointer to the count of faces with solids
+ * 				int pointer to the count of faces with clinker
+ * 	Returns:	Nothing
+ *
+ *	Calls:		bitzword, bitcount64
+ *	Called by:	measuresurf
+ ***/
+void bitsurf(int *ntotal, int *ncement) {
+  int kx, ky, w, ip, nx, ny;
+  size_t r;
+  const uint64_t *por, *sol, *cem, *prow, *srow, *crow;
+  uint64_t p;
+  static const int fx[4] = {1, -1, 0, 0}, fy[4] = {0, 0, 1, -1};
+
+  por = Bitplane + BITPOROSITY * Bitplanelen;
+  sol = Bitplane + BITSOLID * Bitplanelen;
+  cem = Bitplane + BITCEMENT * Bitplanelen;
+
+  for (kx = 0; kx < Xsyssize; kx++) {
+    for (ky = 0; ky < Ysyssize; ky++) {
+      r = ((size_t)kx * Ysyssize + ky) * Bitwords;
+      prow = por + r;
+
+      /* Neighbors in x and y are whole rows, those in z shifted words */
+
+      for (ip = 0; ip < 4; ip++) {
+        nx = (kx + fx[ip] + Xsyssize) % Xsyssize;
+        ny = (ky + fy[ip] + Ysyssize) % Ysyssize;
+        srow = sol + ((size_t)nx * Ysyssize + ny) * Bitwords;
+        crow = cem + ((size_t)nx * Ysyssize + ny) * Bitwords;
+        for (w = 0; w < Bitwords; w++) {
+          *ntotal += bitcount64(prow[w] & srow[w]);
+          *ncement += bitcount64(prow[w] & crow[w]);
+        }
+      }
+      for (w = 0; w < Bitwords; w++) {
+        p = prow[w];
+        if (!p)
+          continue;
+        *ntotal += bitcount64(p & bitzword(sol + r, w, 1)) +
+                   bitcount64(p & bitzword(sol + r, w, -1));
+        *ncement += bitcount64(p & bitzword(cem + r, w, 1)) +
+                    bitcount64(p & bitzword(cem + r, w, -1));
+      }
+    }
+  }
+
+  return;
+}
+
+/***
+ *	bitfree
+ *
+ * 	Release the planes
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	freeallmem
+ ***/
+void bitfree(void) {
+  if (Bitplane)
+    free(Bitplane);
+  Bitplane = Bitporesnap = NULL;
+  Bitplanecap = Bitplanelen = 0;
+  Bitporevalid = 0;
+
+  return;
+}
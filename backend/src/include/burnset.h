@@ -1,618 +1,66 @@
 /***
  *	burnset
  *
- * 	Assess connectivity (percolation) of solids for set estimation.
+ * 	Assess connectivity (percolation) of solids for set estimation,
+ * 	across x, y and z at once.
  *
  *	Definition of set is a through pathway of cement and fly ash (slag)
  *	particles connected together by a form of CSH, C3AH6, or ettringite
  *
- *	Two matrices are used here: one to store the recently burnt locations
- *	the other to store the newly found burnt locations
+ *	Two neighboring solid pixels are connected if
  *
- * 	Arguments:	int d1: x-direction flag
- * 				int d2: y-direction flag
- * 				int d3: z-direction flag
+ *		1) either one is CSH, ETTR or C3AH6 (binder), or
+ *		2) both are cement clinker, slag, or fly ash phases
+ *			(grain) AND are contained in the same initial
+ *			cement particle AND it is not a one-pixel particle
  *
- * 	Returns:	1 if a connected path is found, 0 otherwise
+ *	The solids are labeled into clusters by perc_track in one pass
+ *	over Mic and Micpart; see burn3d for the percolation test.  A
+ *	direction has set once the percolated clusters hold more than
+ *	98.5% of the solids.
  *
- *	Calls:		No other routines
+ * 	Arguments:	int pointer to three flags (x, y, z), each set
+ * 					to 1 if set has occurred in that
+ * 					direction, 0 otherwise
+ *
+ * 	Returns:	0 if okay, MEMERR if out of memory
+ *
+ *	Calls:		perc_track
  *	Called by:	disrealnew
  ***/
 
-/* Label for a burnt pixel */
-
-#ifndef BURNT
-#define BURNT ((OFFSET) + 1)
-#endif
-
-/***
- *	Functions defining coordinates for
- *	burning in any of three directions
- ***/
-
-#define cx(x, y, z, a, b, c) (1 - b - c) * x + (1 - a - c) * y + (1 - a - b) * z
-#define cy(x, y, z, a, b, c) (1 - a - b) * x + (1 - b - c) * y + (1 - a - c) * z
-#define cz(x, y, z, a, b, c) (1 - a - c) * x + (1 - a - b) * y + (1 - b - c) * z
-
-int burnset(int d1, int d2, int d3) {
-  int ***newmat, ***xformMic, ***xformMicpart;
-  int *nnewx, *nnewy, *nnewz, *nmatx, *nmaty, *nmatz;
-  int ntop, nthrough, icur, inew, ncur, nnew, ntot, count_solid, SIZESET;
-  int i, j, k, setyet, dir, ival, dimensions[3];
-  int xl, xh, j1, k1, px, py, pz, qx, qy, qz, xm, ym, zm;
-  int xcn, ycn, zcn, x1, y1, z1, igood, jnew;
-  float alpha_burn = 0.0, tvar;
-  double mass_burn = 0.0;
-
-  /* Initialize local arrays */
-
-  dimensions[0] = Xsyssize;
-  dimensions[1] = Ysyssize;
-  dimensions[2] = Zsyssize;
-
-  /* Bubble sort the dimensions in descending order */
-  for (i = 0; i < 2; i++) {
-    for (j = (i + 1); j < 3; j++) {
-      if (dimensions[i] < dimensions[j]) {
-        ival = dimensions[i];
-        dimensions[i] = dimensions[j];
-        dimensions[j] = ival;
-      }
-    }
-  }
-
-  SIZESET = (5 * dimensions[0] * dimensions[1]);
-
-  if (d1 == 1 && d2 == 0 && d3 == 0) {
-    dir = 0;
-    dimensions[0] = Xsyssize;
-    dimensions[1] = Ysyssize;
-    dimensions[2] = Zsyssize;
-  } else if (d1 == 0 && d2 == 1 && d3 == 0) {
-    dir = 1;
-    dimensions[0] = Ysyssize;
-    dimensions[1] = Zsyssize;
-    dimensions[2] = Xsyssize;
-  } else {
-    dir = 2;
-    dimensions[0] = Zsyssize;
-    dimensions[1] = Xsyssize;
-    dimensions[2] = Ysyssize;
-  }
-
-  /***
-   *	Counters for number of pixels of phase accessible from
-   *	surface #1 and number which are part of a percolated
-   *	pathway to surface #2
-   ***/
-
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nIn burnset: d1 = %d, d2 = %d, d3 = %d", d1, d2, d3);
-    fflush(stderr);
-  }
-
-  /***
-   *	No convenient way to reset the system after
-   *	burning is done, so just store the initial
-   *	(transformed) microstructure by brute force and then
-   *	reset at the end (1 June 2004)
-   ***/
+/* Classes of solids for set estimation */
 
-  xformMic = NULL;
-  xformMic = ibox(dimensions[0], dimensions[1], dimensions[2]);
-  if (!xformMic) {
-    fprintf(stderr, "\nERROR in burnset:");
-    fprintf(stderr, " Could not allocate space for xformMic. Exiting now.");
-    fflush(stderr);
-    return (MEMERR);
-  }
-
-  for (zm = 0; zm < Zsyssize; zm++) {
-    for (ym = 0; ym < Ysyssize; ym++) {
-      for (xm = 0; xm < Xsyssize; xm++) {
-        px = cx(xm, ym, zm, d1, d2, d3);
-        py = cy(xm, ym, zm, d1, d2, d3);
-        pz = cz(xm, ym, zm, d1, d2, d3);
-        xformMic[px][py][pz] = Mic[xm][ym][zm];
-      }
-    }
-  }
-  if (Verbose_flag > 1) {
-    fprintf(stderr, "\nDEBUG: Assignment to xformMic is complete.");
-    fflush(stderr);
-  }
-
-  /*  Allocate memory for transformed Micpart array */
+#define SETBINDER 1
+#define SETGRAIN 2
 
-  xformMicpart = NULL;
-  xformMicpart = ibox(dimensions[0], dimensions[1], dimensions[2]);
-  if (!xformMicpart) {
-    fprintf(stderr, "\nERROR in burnset:");
-    fprintf(stderr, " Could not allocate space for xformMicpart. Exiting now.");
-    fflush(stderr);
-    if (xformMic)
-      free_ibox(xformMic, dimensions[0], dimensions[1]);
-    return (MEMERR);
-  }
+int burnset(int *flag) {
+  int dir, count_solid;
+  unsigned char cls[CENSUSIDS];
+  unsigned char link[PERCCLASSES][PERCCLASSES];
+  Percstats ps;
 
-  for (zm = 0; zm < Zsyssize; zm++) {
-    for (ym = 0; ym < Ysyssize; ym++) {
-      for (xm = 0; xm < Xsyssize; xm++) {
-        px = cx(xm, ym, zm, d1, d2, d3);
-        py = cy(xm, ym, zm, d1, d2, d3);
-        pz = cz(xm, ym, zm, d1, d2, d3);
-        xformMicpart[px][py][pz] = Micpart[xm][ym][zm];
-      }
-    }
-  }
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: Assignment to xformMicpart is complete.");
-    fflush(stderr);
-  }
+  memset(cls, 0, sizeof(cls));
+  cls[CSH] = cls[POZZCSH] = cls[SLAGCSH] = SETBINDER;
+  cls[C3AH6] = cls[ETTR] = cls[ETTRC4AF] = SETBINDER;
+  cls[C3S] = cls[C2S] = cls[C3A] = cls[C4AF] = SETGRAIN;
+  cls[K2SO4] = cls[NA2SO4] = cls[SLAG] = cls[ASG] = SETGRAIN;
+  cls[CAS2] = cls[SFUME] = cls[AMSIL] = SETGRAIN;
 
-  /*  Allocate memory for transformed newmat array */
+  memset(link, PERCNOLINK, sizeof(link));
+  link[SETBINDER][SETBINDER] = PERCLINK;
+  link[SETBINDER][SETGRAIN] = link[SETGRAIN][SETBINDER] = PERCLINK;
+  link[SETGRAIN][SETGRAIN] = PERCSAMEPART;
 
-  newmat = NULL;
-  newmat = ibox(dimensions[0], dimensions[1], dimensions[2]);
-  if (!newmat) {
+  if (perc_track(&Settrack, &Burnwork, Mic, &Micpart, Xsyssize, Ysyssize,
+                 Zsyssize, cls, link, &ps)) {
     fprintf(stderr, "\nERROR in burnset:");
-    fprintf(stderr, " Could not allocate space for newmat. Exiting now.");
+    fprintf(stderr, " Could not allocate space for cluster labels.");
+    fprintf(stderr, " Exiting now.");
     fflush(stderr);
-    if (xformMicpart)
-      free_ibox(xformMicpart, dimensions[0], dimensions[1]);
-    if (xformMic)
-      free_ibox(xformMic, dimensions[0], dimensions[1]);
     return (MEMERR);
   }
 
-  for (zm = 0; zm < Zsyssize; zm++) {
-    for (ym = 0; ym < Ysyssize; ym++) {
-      for (xm = 0; xm < Xsyssize; xm++) {
-        px = cx(xm, ym, zm, d1, d2, d3);
-        py = cy(xm, ym, zm, d1, d2, d3);
-        pz = cz(xm, ym, zm, d1, d2, d3);
-        newmat[px][py][pz] = xformMic[px][py][pz];
-      }
-    }
-  }
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: Assignment to newmat is complete.");
-    fflush(stderr);
-  }
-
-  nmatx = nmaty = nmatz = NULL;
-  nnewx = nnewy = nnewz = NULL;
-
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: I am in burnset...");
-    fflush(stderr);
-  }
-
-  nmatx = ivector(SIZESET);
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: Allocated nmatx...");
-    fflush(stderr);
-  }
-  nmaty = ivector(SIZESET);
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: Allocated nmaty...");
-    fflush(stderr);
-  }
-  nmatz = ivector(SIZESET);
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: Allocated nmatz...");
-    fflush(stderr);
-  }
-  nnewx = ivector(SIZESET);
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: Allocated nnewx...");
-    fflush(stderr);
-  }
-  nnewy = ivector(SIZESET);
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: Allocated nnewy...");
-    fflush(stderr);
-  }
-  nnewz = ivector(SIZESET);
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: Allocated nnewz...");
-    fflush(stderr);
-  }
-
-  if (!nmatx) {
-    fprintf(stderr, "\nERROR in burnset:");
-    fprintf(stderr, " Could not allocate space for nmatx. Exiting now.");
-    fflush(stderr);
-    if (xformMicpart)
-      free_ibox(xformMicpart, dimensions[0], dimensions[1]);
-    if (xformMic != NULL)
-      free_ibox(xformMic, dimensions[0], dimensions[1]);
-    return (MEMERR);
-  }
-  if (!nmaty) {
-    fprintf(stderr, "\nERROR in burnset:");
-    fprintf(stderr, " Could not allocate space for nmaty. Exiting now.");
-    fflush(stderr);
-    free_ivector(nmatx);
-    if (xformMicpart)
-      free_ibox(xformMicpart, dimensions[0], dimensions[1]);
-    if (xformMic != NULL)
-      free_ibox(xformMic, dimensions[0], dimensions[1]);
-    return (MEMERR);
-  }
-  if (!nmatz) {
-    fprintf(stderr, "\nERROR in burnset:");
-    fprintf(stderr, " Could not allocate space for nmatz. Exiting now.");
-    fflush(stderr);
-    free_ivector(nmaty);
-    free_ivector(nmatx);
-    if (xformMicpart)
-      free_ibox(xformMicpart, dimensions[0], dimensions[1]);
-    if (xformMic != NULL)
-      free_ibox(xformMic, dimensions[0], dimensions[1]);
-    return (MEMERR);
-  }
-  if (!nnewx) {
-    fprintf(stderr, "\nERROR in burnset:");
-    fprintf(stderr, " Could not allocate space for nnewx. Exiting now.");
-    fflush(stderr);
-    free_ivector(nmatz);
-    free_ivector(nmaty);
-    free_ivector(nmatx);
-    if (xformMicpart)
-      free_ibox(xformMicpart, dimensions[0], dimensions[1]);
-    if (xformMic != NULL)
-      free_ibox(xformMic, dimensions[0], dimensions[1]);
-    return (MEMERR);
-  }
-  if (!nnewy) {
-    fprintf(stderr, "\nERROR in burnset:");
-    fprintf(stderr, " Could not allocate space for nnewy. Exiting now.");
-    fflush(stderr);
-    free_ivector(nnewx);
-    free_ivector(nmatz);
-    free_ivector(nmaty);
-    free_ivector(nmatx);
-    if (xformMicpart)
-      free_ibox(xformMicpart, dimensions[0], dimensions[1]);
-    if (xformMic != NULL)
-      free_ibox(xformMic, dimensions[0], dimensions[1]);
-    return (MEMERR);
-  }
-  if (!nnewz) {
-    fprintf(stderr, "\nERROR in burnset:");
-    fprintf(stderr, " Could not allocate space for nnewz. Exiting now.");
-    fflush(stderr);
-    free_ivector(nnewy);
-    free_ivector(nnewx);
-    free_ivector(nmatz);
-    free_ivector(nmaty);
-    free_ivector(nmatx);
-    if (xformMicpart)
-      free_ibox(xformMicpart, dimensions[0], dimensions[1]);
-    if (xformMic != NULL)
-      free_ibox(xformMic, dimensions[0], dimensions[1]);
-    return (MEMERR);
-  }
-
-  ntop = nthrough = setyet = 0;
-
-  if (Verbose_flag > 1) {
-    fprintf(stderr, "\nDEBUG: All memory allocation went okay...");
-    fflush(stderr);
-  }
-
-  /***
-   *	Percolation is assessed from top to bottom only in
-   *	transformed coordinates and burning algorithm is
-   *	periodic in other two directions
-   ***/
-
-  i = 0; /* Starting from the bottom x face */
-
-  for (k = 0; k < dimensions[2]; k++) {
-    for (j = 0; j < dimensions[1]; j++) {
-      if (Verbose_flag > 2 && dir == 1) {
-        fprintf(stderr, "\nDEBUG: Loop j,k = %d,%d", j, k);
-        fflush(stderr);
-      }
-
-      igood = ncur = ntot = 0;
-
-      /* Transform coordinates */
-
-      px = i;
-      py = j;
-      pz = k;
-
-      /***
-       *	Start from a cement clinker, slag, fly ash,
-       *	ettringite, C3AH6, or CSH pixel
-       ***/
-
-      if ((xformMic[px][py][pz] == C3S) || (xformMic[px][py][pz] == C2S) ||
-          (xformMic[px][py][pz] == K2SO4) || (xformMic[px][py][pz] == NA2SO4) ||
-          (xformMic[px][py][pz] == SLAG) || (xformMic[px][py][pz] == ASG) ||
-          (xformMic[px][py][pz] == CAS2) || (xformMic[px][py][pz] == SFUME) ||
-          (xformMic[px][py][pz] == AMSIL) || (xformMic[px][py][pz] == CSH) ||
-          (xformMic[px][py][pz] == POZZCSH) ||
-          (xformMic[px][py][pz] == SLAGCSH) ||
-          (xformMic[px][py][pz] == C3AH6) || (xformMic[px][py][pz] == ETTR) ||
-          (xformMic[px][py][pz] == ETTRC4AF) || (xformMic[px][py][pz] == C3A) ||
-          (xformMic[px][py][pz] == C4AF)) {
-
-        /* Start a burn front */
-
-        xformMic[px][py][pz] = BURNT;
-
-        ntot++;
-        ncur++;
-
-        /***
-         *	Burn front is stored in matrices nmat*
-         *	and nnew*
-         ***/
-
-        nmatx[ncur] = i;
-        nmaty[ncur] = j;
-        nmatz[ncur] = k;
-
-        /* Burn as long as new (fuel) pixels are found */
-
-        do {
-
-          nnew = 0;
-          for (inew = 1; inew <= ncur; inew++) {
-
-            xcn = nmatx[inew];
-            ycn = nmaty[inew];
-            zcn = nmatz[inew];
-
-            /* Convert to directional coordinates */
-
-            qx = xcn;
-            qy = ycn;
-            qz = zcn;
-
-            /* Check all six neighbors */
-
-            for (jnew = 1; jnew <= 6; jnew++) {
-
-              x1 = xcn;
-              y1 = ycn;
-              z1 = zcn;
-
-              if (jnew == 1)
-                x1--;
-              if (jnew == 2)
-                x1++;
-              if (jnew == 3)
-                y1--;
-              if (jnew == 4)
-                y1++;
-              if (jnew == 5)
-                z1--;
-              if (jnew == 6)
-                z1++;
-
-              /* Periodic in y and z direction */
-
-              y1 += checkbc(y1, dimensions[1]);
-              z1 += checkbc(z1, dimensions[2]);
-
-              /***
-               *	Nonperiodic in x, so be sure to
-               *	remain in the 3-D box
-               ***/
-
-              if ((x1 >= 0) && (x1 < dimensions[0])) {
-
-                px = x1;
-                py = y1;
-                pz = z1;
-
-                /***
-                 *	First condition for propagation
-                 *	of burning:
-                 *
-                 *		1) new pixel is CSH or
-                 *			ETTR or C3AH6
-                 ***/
-
-                if ((xformMic[px][py][pz] == CSH) ||
-                    (xformMic[px][py][pz] == POZZCSH) ||
-                    (xformMic[px][py][pz] == SLAGCSH) ||
-                    (xformMic[px][py][pz] == ETTRC4AF) ||
-                    (xformMic[px][py][pz] == C3AH6) ||
-                    (xformMic[px][py][pz] == ETTR)) {
-
-                  ntot++;
-                  xformMic[px][py][pz] = BURNT;
-                  nnew++;
-
-                  if (nnew >= SIZESET) {
-                    fprintf(stderr, "\nERROR in burnset:");
-                    fprintf(stderr, "Size of nnew %d must be less than %d",
-                            nnew, SIZESET);
-                    fflush(stderr);
-                  }
-
-                  nnewx[nnew] = x1;
-                  nnewy[nnew] = y1;
-                  nnewz[nnew] = z1;
-
-                  /***
-                   *	Second condition for burning:
-                   *
-                   *		2) Old pixel is CSH or ETTR
-                   *			or C3AH6, and new pixel
-                   *			is one of cement clinker,
-                   *			slag, of fly ash phases
-                   ***/
-
-                } else if (((newmat[qx][qy][qz] == CSH) ||
-                            (newmat[qx][qy][qz] == SLAGCSH) ||
-                            (newmat[qx][qy][qz] == POZZCSH) ||
-                            (newmat[qx][qy][qz] == ETTRC4AF) ||
-                            (newmat[qx][qy][qz] == C3AH6) ||
-                            (newmat[qx][qy][qz] == ETTR)) &&
-                           ((xformMic[px][py][pz] == C3S) ||
-                            (xformMic[px][py][pz] == C2S) ||
-                            (xformMic[px][py][pz] == K2SO4) ||
-                            (xformMic[px][py][pz] == NA2SO4) ||
-                            (xformMic[px][py][pz] == CAS2) ||
-                            (xformMic[px][py][pz] == SLAG) ||
-                            (xformMic[px][py][pz] == SFUME) ||
-                            (xformMic[px][py][pz] == AMSIL) ||
-                            (xformMic[px][py][pz] == ASG) ||
-                            (xformMic[px][py][pz] == C3A) ||
-                            (xformMic[px][py][pz] == C4AF))) {
-
-                  ntot++;
-                  xformMic[px][py][pz] = BURNT;
-                  nnew++;
-
-                  if (nnew >= SIZESET) {
-                    fprintf(stderr, "\nERROR in burnset:");
-                    fprintf(stderr, "Size of nnew %d must be less than %d",
-                            nnew, SIZESET);
-                    fflush(stderr);
-                  }
-
-                  nnewx[nnew] = x1;
-                  nnewy[nnew] = y1;
-                  nnewz[nnew] = z1;
-
-                  /***
-                   *	Third condition for burning:
-                   *
-                   * 	3) Old and new pixels belong
-                   * 		to one of cement clinker,
-                   * 		slag, or fly ash phases
-                   *
-                   * 		AND are contained in the
-                   * 		same initial cement particle
-                   *
-                   * 		AND it is not a one-pixel
-                   * 		particle
-                   ***/
-
-                } else if ((xformMicpart[qx][qy][qz] ==
-                            xformMicpart[px][py][pz]) &&
-                           (xformMicpart[qx][qy][qz] != 0) &&
-                           ((xformMic[px][py][pz] == C3S) ||
-                            (xformMic[px][py][pz] == C2S) ||
-                            (xformMic[px][py][pz] == K2SO4) ||
-                            (xformMic[px][py][pz] == NA2SO4) ||
-                            (xformMic[px][py][pz] == SFUME) ||
-                            (xformMic[px][py][pz] == AMSIL) ||
-                            (xformMic[px][py][pz] == SLAG) ||
-                            (xformMic[px][py][pz] == ASG) ||
-                            (xformMic[px][py][pz] == CAS2) ||
-                            (xformMic[px][py][pz] == C3A) ||
-                            (xformMic[px][py][pz] == C4AF)) &&
-                           ((newmat[qx][qy][qz] == C3S) ||
-                            (newmat[qx][qy][qz] == C2S) ||
-                            (newmat[qx][qy][qz] == K2SO4) ||
-                            (newmat[qx][qy][qz] == NA2SO4) ||
-                            (newmat[qx][qy][qz] == SLAG) ||
-                            (newmat[qx][qy][qz] == ASG) ||
-                            (newmat[qx][qy][qz] == SFUME) ||
-                            (newmat[qx][qy][qz] == AMSIL) ||
-                            (newmat[qx][qy][qz] == CAS2) ||
-                            (newmat[qx][qy][qz] == C3A) ||
-                            (newmat[qx][qy][qz] == C4AF))) {
-
-                  ntot++;
-                  xformMic[px][py][pz] = BURNT;
-                  nnew++;
-
-                  if (nnew >= SIZESET) {
-                    fprintf(stderr, "\nERROR in burnset:");
-                    fprintf(stderr, "Size of nnew %d must be less than %d",
-                            nnew, SIZESET);
-                    fflush(stderr);
-                  }
-
-                  nnewx[nnew] = x1;
-                  nnewy[nnew] = y1;
-                  nnewz[nnew] = z1;
-                }
-              } /* nonperiodic if delimiter */
-            } /* End of loop over nearest neighbors */
-          } /* End of loop over current burn front */
-
-          if (nnew > 0) {
-
-            ncur = nnew;
-
-            /* Update the burn front matrices */
-
-            for (icur = 1; icur <= ncur; icur++) {
-              nmatx[icur] = nnewx[icur];
-              nmaty[icur] = nnewy[icur];
-              nmatz[icur] = nnewz[icur];
-            }
-          }
-
-        } while (nnew > 0);
-
-        /* Out of fuel.  Burning is over */
-
-        ntop += ntot;
-
-        xl = 0;
-        xh = dimensions[0] - 1;
-
-        /* Check for percolated path through system */
-
-        for (j1 = 0; j1 < dimensions[1]; j1++) {
-          for (k1 = 0; k1 < dimensions[2]; k1++) {
-
-            px = xl;
-            py = j1;
-            pz = k1;
-
-            qx = xh;
-            qy = j1;
-            qz = k1;
-
-            if ((xformMic[px][py][pz] == BURNT) &&
-                (xformMic[qx][qy][qz] == BURNT)) {
-
-              igood = 2;
-            }
-
-            if (xformMic[px][py][pz] == BURNT) {
-              xformMic[px][py][pz] = BURNT + 1;
-            }
-            if (xformMic[qx][qy][qz] == BURNT) {
-              xformMic[qx][qy][qz] = BURNT + 1;
-            }
-          }
-        }
-
-        if (igood == 2)
-          nthrough += ntot;
-      }
-    }
-  }
-
-  if (Verbose_flag > 1) {
-    fprintf(stderr, "\nDEBUG: Phase ID= Solid Phases");
-    fprintf(stderr, "\n\tNumber accessible from first surface = %d", ntop);
-    fprintf(stderr, "\n\tNumber contained in through pathways= %d", nthrough);
-    fflush(stderr);
-  }
-
-  mass_burn += (double)(Specgrav[C3S] * Count[C3S]);
-  mass_burn += (double)(Specgrav[C2S] * Count[C2S]);
-  mass_burn += (double)(Specgrav[C3A] * Count[C3A]);
-  mass_burn += (double)(Specgrav[C4AF] * Count[C4AF]);
-
-  alpha_burn = 1.0 - (mass_burn / Cemmass);
-  Con_fracs[dir] = 0.0;
-
   count_solid =
       Count[C3S] + Count[C2S] + Count[C3A] + Count[K2SO4] + Count[NA2SO4];
   count_solid +=
@@ -620,45 +68,27 @@ int burnset(int d1, int d2, int d3) {
   count_solid += Count[C3AH6] + Count[ETTRC4AF] + Count[SFUME];
   count_solid += Count[AMSIL] + Count[ASG] + Count[SLAG] + Count[CAS2];
 
-  if (Verbose_flag > 1) {
-    fprintf(stderr, "\nDEBUG: Count solids = %d", count_solid);
-    fflush(stderr);
-  }
+  for (dir = 0; dir < 3; dir++) {
+    Con_fracs[dir] = 0.0;
 
-  if (count_solid > 0) {
-    Con_fracs[dir] = (float)nthrough / (float)count_solid;
     if (Verbose_flag > 1) {
-      fprintf(stderr, "\nDEBUGF: Con_fracs[%d] = %f", dir, Con_fracs[dir]);
+      fprintf(stderr, "\nDEBUG: Direction = %d", dir);
+      fprintf(stderr, "\nDEBUG: Number contained in through pathways = %d",
+              ps.nthrough[dir]);
+      fprintf(stderr, "\nDEBUG: Number of solids = %d", count_solid);
       fflush(stderr);
     }
-  }
-
-  tvar = Time_cur + (2.0 * (float)(Cyccnt)-1.0) * (Beta / Krate);
-
-  if (Con_fracs[dir] > 0.985)
-    setyet = 1;
 
-  /***
-   *	Free all dynamically allocated memory
-   ***/
-
-  free_ivector(nmatx);
-  free_ivector(nmaty);
-  free_ivector(nmatz);
-  free_ivector(nnewx);
-  free_ivector(nnewy);
-  free_ivector(nnewz);
-  if (newmat != NULL)
-    free_ibox(newmat, dimensions[0], dimensions[1]);
-  if (xformMicpart != NULL)
-    free_ibox(xformMicpart, dimensions[0], dimensions[1]);
-  if (xformMic != NULL)
-    free_ibox(xformMic, dimensions[0], dimensions[1]);
+    if (count_solid > 0) {
+      Con_fracs[dir] = (float)ps.nthrough[dir] / (float)count_solid;
+      if (Verbose_flag > 1) {
+        fprintf(stderr, "\nCon_fracs[%d] = %f", dir, Con_fracs[dir]);
+        fflush(stderr);
+      }
+    }
 
-  /***
-   *	Return flag indicating if set has
-   *	indeed occurred
-   ***/
+    flag[dir] = (Con_fracs[dir] > 0.985) ? 1 : 0;
+  }
 
-  return (setyet);
+  return (0);
 }
@@ -0,0 +1,984 @@
+/***
+ *	checkpoint
+ *
+ * 	Checkpoint and restart of a hydration run.
+ *
+ * 	With --checkpoint n, the state of the simulation is saved at
+ * 	the end of every n-th cycle.  A run started with --restart
+ * 	and the same parameter file reads all its inputs as usual,
+ * 	then replaces everything that hydration changes with the
+ * 	saved state and carries on with the next cycle.  It writes
+ * 	the same output, bit for bit, as a run that was never
+ * 	stopped: the microstructure grids, the ant pool, the alkali
+ * 	sulfate lists, every counter, the random number streams of
+ * 	the main program and of the ant slabs, and the time and
+ * 	temperature state of findnewtime and calcT are all saved,
+ * 	and the output files that are appended to every cycle are
+ * 	cut back to their length at the checkpoint.
+ *
+ * 	The file starts with CKPTMAGIC and CKPTVERSION, followed by
+ * 	blocks in the order given by ckptstate, each preceded by its
+ * 	length in bytes so that a checkpoint which does not match
+ * 	the simulation is rejected instead of being misread.  A
+ * 	checkpoint is only meaningful on the machine type that
+ * 	wrote it.
+ *
+ * 	Where fork is available the checkpoint is written by a
+ * 	child process from its copy of the memory image, so the
+ * 	cycle loop only waits for the fork.  Elsewhere it is
+ * 	written before the loop continues.  The file is written
+ * 	under a temporary name and renamed when complete, so a run
+ * 	killed while writing leaves the previous checkpoint intact.
+ ***/
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define CKPTMAGIC "VCCTL disrealnew checkpoint"
+#define CKPTMAGICLEN 32
+#define CKPTVERSION 15
+
+/* Direction of a transfer in ckptstate */
+#define CKPTWRITE 0
+#define CKPTREAD 1
+
+/***
+ *	Transfer a global variable or fixed-size array, or a
+ *	vector of n elements, inside ckptstate (which supplies
+ *	fp, mode and status)
+ ***/
+#define CKPT(v) status |= ckptblock(fp, mode, &(v), sizeof(v))
+#define CKPTVEC(p, n) status |= ckptblock(fp, mode, (p), (n) * sizeof(*(p)))
+
+/***
+ *	Check that a value is the same as when the checkpoint was
+ *	written, inside ckptstate
+ ***/
+#define CKPTCHECK(v) status |= ckptcheck(fp, mode, (long)(v))
+
+/***
+ *	ckptblock
+ *
+ * 	Write a block of memory to a checkpoint, preceded by its
+ * 	length, or read it back after checking that the length
+ * 	is the same
+ *
+ * 	Arguments:	FILE pointer to the checkpoint
+ * 				int direction (CKPTWRITE or CKPTREAD)
+ * 				pointer to the block
+ * 				size_t length of the block in bytes
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	ckptcheck, ckptalksulf, ckptgrid, ckptstate
+ ***/
+int ckptblock(FILE *fp, int mode, void *p, size_t n) {
+  unsigned long long len;
+
+  if (mode == CKPTWRITE) {
+    len = (unsigned long long)n;
+    if (fwrite(&len, sizeof(len), 1, fp) != 1)
+      return (1);
+    if (n > 0 && fwrite(p, 1, n, fp) != n)
+      return (1);
+  } else {
+    if (fread(&len, sizeof(len), 1, fp) != 1 || len != (unsigned long long)n)
+      return (1);
+    if (n > 0 && fread(p, 1, n, fp) != n)
+      return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	ckptcheck
+ *
+ * 	Write a value to a checkpoint, or read one back and check
+ * 	that it equals the value in the current run
+ *
+ * 	Arguments:	FILE pointer to the checkpoint
+ * 				int direction (CKPTWRITE or CKPTREAD)
+ * 				long value
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		ckptblock
+ *	Called by:	ckptstate
+ ***/
+int ckptcheck(FILE *fp, int mode, long val) {
+  long saved;
+
+  saved = val;
+  if (ckptblock(fp, mode, &saved, sizeof(saved)))
+    return (1);
+
+  return ((saved == val) ? 0 : 1);
+}
+
+/***
+ *	ckptgrid
+ *
+ * 	Write a grid, halo included, to a checkpoint, or read it
+ * 	back.  The elements are always in the order of an untiled
+ * 	grid, so a tiled grid goes one row at a time and the
+ * 	checkpoint does not depend on --tiled-grids.
+ *
+ * 	Arguments:	FILE pointer to the checkpoint
+ * 				int direction (CKPTWRITE or CKPTREAD)
+ * 				pointer returned by cgrid, cgridtile, ...
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		ckptblock, gridinfo, gridblock
+ *	Called by:	ckptstate
+ ***/
+int ckptgrid(FILE *fp, int mode, void *grid) {
+  int i, j, h, nx, ny;
+  size_t rowlen;
+  unsigned long long len;
+  char ***g;
+  Gridinfo *info;
+
+  info = gridinfo(grid);
+  if (!info->tiled)
+    return (ckptblock(fp, mode, gridblock(grid), info->nbytes));
+
+  g = (char ***)grid;
+  h = info->halo;
+  nx = (int)info->xsize + h;
+  ny = (int)info->ysize + h;
+  rowlen = (info->zsize + 2 * (size_t)h) * info->elsize;
+
+  if (mode == CKPTWRITE) {
+    len = (unsigned long long)info->nbytes;
+    if (fwrite(&len, sizeof(len), 1, fp) != 1)
+      return (1);
+  } else {
+    if (fread(&len, sizeof(len), 1, fp) != 1 ||
+        len != (unsigned long long)info->nbytes)
+      return (1);
+  }
+
+  for (i = -h; i < nx; i++) {
+    for (j = -h; j < ny; j++) {
+      if (mode == CKPTWRITE) {
+        if (fwrite(g[i][j] - h * info->elsize, 1, rowlen, fp) != rowlen)
+          return (1);
+      } else {
+        if (fread(g[i][j] - h * info->elsize, 1, rowlen, fp) != rowlen)
+          return (1);
+      }
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *	ckptalksulf
+ *
+ * 	Write the coordinates of an alkali sulfate list to a
+ * 	checkpoint in list order, or read them back and rebuild
+ * 	the list in place of the current one
+ *
+ * 	Arguments:	FILE pointer to the checkpoint
+ * 				int direction (CKPTWRITE or CKPTREAD)
+ * 				Nodepool pointer to the pool of the list
+ * 				pointers to the head and tail of the list
+ * 	Returns:	0 if okay, 1 or MEMERR otherwise
+ *
+ *	Calls:		ckptblock, nodepool_reset, nodepool_get
+ *	Called by:	ckptstate
+ ***/
+int ckptalksulf(FILE *fp, int mode, Nodepool *pool, struct Alksulf **head,
+                struct Alksulf **tail) {
+  int n;
+  unsigned int xyz[3];
+  struct Alksulf *cur;
+
+  n = 0;
+  if (mode == CKPTWRITE) {
+    for (cur = *head; cur != NULL; cur = cur->nextas)
+      n++;
+  }
+  if (ckptblock(fp, mode, &n, sizeof(n)) || n < 0)
+    return (1);
+
+  if (mode == CKPTWRITE) {
+    for (cur = *head; cur != NULL; cur = cur->nextas) {
+      xyz[0] = cur->x;
+      xyz[1] = cur->y;
+      xyz[2] = cur->z;
+      if (ckptblock(fp, mode, xyz, sizeof(xyz)))
+        return (1);
+    }
+    return (0);
+  }
+
+  nodepool_reset(pool);
+  *head = *tail = NULL;
+
+  for (; n > 0; n--) {
+    if (ckptblock(fp, mode, xyz, sizeof(xyz)))
+      return (1);
+    cur = (struct Alksulf *)nodepool_get(pool);
+    if (!cur)
+      return (MEMERR);
+    cur->x = xyz[0];
+    cur->y = xyz[1];
+    cur->z = xyz[2];
+    cur->nextas = NULL;
+    cur->prevas = *tail;
+    if (*tail) {
+      (*tail)->nextas = cur;
+    } else {
+      *head = cur;
+    }
+    *tail = cur;
+  }
+
+  return (0);
+}
+
+/***
+ *	ckptpartmap
+ *
+ * 	Write a particle map to a checkpoint as it is held, or
+ * 	read one back in place of the current one
+ *
+ * 	Arguments:	FILE pointer to the checkpoint
+ * 				int direction (CKPTWRITE or CKPTREAD)
+ * 				Partmap pointer
+ * 	Returns:	0 if okay, 1 or MEMERR otherwise
+ *
+ *	Calls:		ckptblock, partmap_alloc, partmap_reserve
+ *	Called by:	ckptstate
+ ***/
+int ckptpartmap(FILE *fp, int mode, Partmap *pm) {
+  int size[4];
+  unsigned long long npool;
+  size_t nblock;
+
+  size[0] = pm->xsize;
+  size[1] = pm->ysize;
+  size[2] = pm->zsize;
+  size[3] = pm->maxid;
+  npool = (unsigned long long)pm->npool;
+  if (ckptblock(fp, mode, size, sizeof(size)) ||
+      ckptblock(fp, mode, &npool, sizeof(npool)))
+    return (1);
+
+  if (mode == CKPTREAD) {
+    partmap_free(pm);
+    if (partmap_alloc(pm, size[0], size[1], size[2]) ||
+        partmap_reserve(pm, (size_t)npool))
+      return (MEMERR);
+    pm->maxid = size[3];
+    pm->npool = (size_t)npool;
+  }
+
+  nblock = (size_t)pm->bx * pm->by * pm->bz;
+  if (ckptblock(fp, mode, pm->off, nblock * sizeof(uint32_t)) ||
+      ckptblock(fp, mode, pm->bits, nblock) ||
+      ckptblock(fp, mode, pm->pool, pm->npool * sizeof(uint32_t)))
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	ckptfile
+ *
+ * 	Name of one of the output files that are appended to
+ * 	during the cycle loop, and so must be cut back to their
+ * 	length at the checkpoint on restart
+ *
+ * 	Arguments:	int index (0 to CKPTNFILES - 1)
+ * 	Returns:	char pointer to the file name
+ *
+ *	Calls:		No other routines
+ *	Called by:	prepcheckpoint, readcheckpoint
+ ***/
+char *ckptfile(int i) {
+  switch (i) {
+  case 0:
+    return (Datafilename);
+  case 1:
+    return (Imageindexname);
+  case 2:
+    return (Moviename);
+  case 3:
+    return (Phrname);
+  case 4:
+    return ("SfumeEffect.csv");
+  case 5:
+    return (Seriesname);
+  default:
+    return (Insituname);
+  }
+}
+
+/***
+ *	ckptstate
+ *
+ * 	Write the whole evolving state of the simulation to a
+ * 	checkpoint, or read it back.  This is the only place that
+ * 	lists what a checkpoint holds, so the two directions can
+ * 	never disagree.  Values fixed by the parameter file and
+ * 	the input microstructure are only checked, since a
+ * 	restarted run reads those again.
+ *
+ * 	Arguments:	FILE pointer to the checkpoint
+ * 				int direction (CKPTWRITE or CKPTREAD)
+ * 				int pointer to the next custom image time
+ * 				float pointer to the previous uncorrected time
+ * 				of findnewtime
+ * 	Returns:	0 if okay, 1 or MEMERR otherwise
+ *
+ *	Calls:		ckptblock, ckptcheck, ckptgrid, ckptpartmap, ckptalksulf,
+ *				resizeantpool, freeantslabs, ran1save, ran1load
+ *	Called by:	savecheckpoint, readcheckpoint
+ ***/
+int ckptstate(FILE *fp, int mode, int *customentry, float *prevtime) {
+  int i, n, status = 0;
+  int bucketants, antthreads, fastmoves, adaptive, adaptsteps, sortants;
+  int hasfaces, hasgrids;
+  long thpos;
+  Ran1state rng;
+
+  /* The simulation the checkpoint belongs to */
+
+  CKPTCHECK(CKPTVERSION);
+  CKPTCHECK(NPHASES);
+  CKPTCHECK(NSPHASES);
+  CKPTCHECK(Xsyssize_orig);
+  CKPTCHECK(Ysyssize_orig);
+  CKPTCHECK(Zsyssize_orig);
+  CKPTCHECK(Ncyc);
+  hasfaces = (Faces != NULL);
+  CKPTCHECK(hasfaces);
+  hasgrids = (Micorig != NULL) | (Cshage != NULL) << 1 |
+             (Deactivated != NULL) << 2;
+  CKPTCHECK(hasgrids);
+  if (status)
+    return (status);
+
+  /* Options that change the hydration history */
+
+  bucketants = Bucketants;
+  antthreads = Antthreads;
+  fastmoves = Fastmoves;
+  adaptive = Adaptive;
+  adaptsteps = Adaptsteps;
+  sortants = Sortants;
+  CKPT(bucketants);
+  CKPT(antthreads);
+  CKPT(fastmoves);
+  CKPT(adaptive);
+  CKPT(Adaptskip);
+  CKPT(Adaptskipped);
+  CKPT(adaptsteps);
+  CKPT(Adaptstopped);
+  CKPT(sortants);
+
+  /* Position in the cycle loop and the main program */
+
+  CKPT(Icyc);
+  CKPT(Cyccnt);
+  CKPT(*customentry);
+  CKPT(*prevtime);
+
+  /* System size and resolution, which addcrack and coarsen can change */
+
+  CKPT(Xsyssize);
+  CKPT(Ysyssize);
+  CKPT(Zsyssize);
+  CKPT(Syspix);
+  CKPT(Syspix_orig);
+  CKPT(Sizemag);
+  CKPT(Sizemag_orig);
+  CKPT(Isizemag);
+  CKPT(Res);
+  CKPT(Maxdiffsteps);
+  CKPT(Coarsefact);
+  CKPT(Coarsecyc);
+  CKPT(Crackwidth);
+  CKPT(Crackorient);
+  CKPT(Cracktime);
+  CKPT(Cubesize);
+
+  /* Phase counts and reaction counters */
+
+  CKPT(Discount);
+  CKPT(Count);
+  CKPT(Ncshplategrow);
+  CKPT(Ncshplateinit);
+  CKPT(Nsilica_rx);
+  CKPT(Nsilica);
+  CKPT(Ncsbar);
+  CKPT(Netbar);
+  CKPT(Porinit);
+  CKPT(Freelimeinit);
+  CKPT(Ksbarinit);
+  CKPT(Nsbarinit);
+  CKPT(Nasr);
+  CKPT(Nslagr);
+  CKPT(Slagemptyp);
+  CKPT(C3sinit);
+  CKPT(C2sinit);
+  CKPT(C3ainit);
+  CKPT(Oc3ainit);
+  CKPT(C4afinit);
+  CKPT(Anhinit);
+  CKPT(Heminit);
+  CKPT(Crackpinit);
+  CKPT(Chold);
+  CKPT(Chnew);
+  CKPT(Nasulfinit);
+  CKPT(Ksulfinit);
+  CKPT(Nmade);
+  CKPT(Ngoing);
+  CKPT(Gypready);
+  CKPT(Poregone);
+  CKPT(Poretodo);
+  CKPT(Countpore);
+  CKPT(Countkeep);
+  CKPT(Water_left);
+  CKPT(Water_off);
+  CKPT(Pore_off);
+  CKPT(Sealed);
+  CKPT(Setflag);
+  CKPT(Sf1);
+  CKPT(Sf2);
+  CKPT(Sf3);
+  CKPT(Porefl1);
+  CKPT(Porefl2);
+  CKPT(Porefl3);
+  CKPT(Scntcement);
+  CKPT(Scnttotal);
+  CKPT(DIFFCHdeficit);
+  CKPT(Slaginit);
+  CKPT(Slagcum);
+  CKPT(Chgone);
+  CKPT(Nucsulf2gyps);
+  CKPT(Nch_slag);
+  CKPT(Sulf_cur);
+  CKPT(Sulf_solid);
+  CKPT(Nphc);
+  CKPT(Con_fracp);
+  CKPT(Con_fracs);
+
+  /* Times of the next outputs */
+
+  CKPT(NextBurnTime);
+  CKPT(NextSetTime);
+  CKPT(NextPhydTime);
+  CKPT(NextMovieTime);
+  CKPT(NextImageTime);
+
+  /* Time, temperature, heat and kinetics */
+
+  CKPT(Time_cur);
+  CKPT(Time_step);
+  CKPT(Temp_cur);
+  CKPT(Temp_cur_b);
+  CKPT(Temp_cur_agg);
+  CKPT(Temp_0);
+  CKPT(Temp_0_agg);
+  CKPT(AggTempEffect);
+  CKPT(DataFinalTemperature);
+  CKPT(Krate);
+  CKPT(CalKrate);
+  CKPT(Indx);
+  CKPT(Bvec);
+  CKPT(CurDataLine);
+  CKPT(Alpha);
+  CKPT(Alpha_cur);
+  CKPT(Alpha_fa_cur);
+  CKPT(Alpha_fa_vol);
+  CKPT(Surffract);
+  CKPT(Pfract);
+  CKPT(Sulf_conc);
+  CKPT(Totfract);
+  CKPT(Mass_water);
+  CKPT(Mass_fill);
+  CKPT(Cemmass);
+  CKPT(Mass_agg);
+  CKPT(Cp_b);
+  CKPT(Heat_old);
+  CKPT(Heat_new);
+  CKPT(CH_mass);
+  CKPT(Mass_CH);
+  CKPT(Mass_fill_pozz);
+  CKPT(Cemmasswgyp);
+  CKPT(Heat_cf);
+  CKPT(Chs_new);
+  CKPT(Flyashmass);
+  CKPT(Flyashvol);
+  CKPT(Mass_105);
+  CKPT(Mass_1000);
+  CKPT(Wn_o);
+  CKPT(Wn_i);
+  CKPT(Heatsum);
+  CKPT(Molesh2o);
+  CKPT(Saturation);
+  CKPT(Meancemdens);
+  CKPT(W_to_c);
+  CKPT(W_to_s);
+  CKPT(S_to_c);
+  CKPT(Gsratio2);
+  CKPT(SulftoC3A);
+  CKPT(thtimelo);
+  CKPT(thtimehi);
+  CKPT(thtemplo);
+  CKPT(thtemphi);
+
+  /* Reaction probabilities */
+
+  CKPT(Gypabsprob);
+  CKPT(Psfume);
+  CKPT(Psfnuc);
+  CKPT(Pamsil);
+  CKPT(LOI_factor);
+  CKPT(Cs_acc);
+  CKPT(Ca_acc);
+  CKPT(PCSHseednuc);
+  CKPT(Distloccsh);
+  CKPT(Pdirectcsh);
+  CKPT(Relvfpores);
+  CKPT(Cshscale);
+  CKPT(C3ah6_scale);
+  CKPT(Chcrit);
+  CKPT(C3ah6crit);
+  CKPT(Dismin_c3a);
+  CKPT(Dismin_c4af);
+  CKPT(Dk2so4max);
+  CKPT(Dna2so4max);
+  CKPT(Dettrmax);
+  CKPT(Dgypmax);
+  CKPT(Dcaco3max);
+  CKPT(Dcacl2max);
+  CKPT(Dcas2max);
+  CKPT(Dasmax);
+  CKPT(Cshboxsize);
+  CKPT(Csh2flag);
+  CKPT(Chflag);
+  CKPTVEC(Disprob, NSPHASES + 1);
+  CKPTVEC(Disbase, NSPHASES + 1);
+  CKPTVEC(Discoeff, NSPHASES + 1);
+  CKPTVEC(Onepixelbias, NSPHASES + 1);
+  CKPTVEC(Soluble, NSPHASES + 1);
+  CKPTVEC(Creates, NSPHASES + 1);
+  CKPTVEC(PHsulfcoeff, NSPHASES + 1);
+  CKPTVEC(PHfactor, NSPHASES + 1);
+
+  /* Surface deactivation */
+
+  CKPTVEC(Startflag, NSPHASES + 1);
+  CKPTVEC(Stopflag, NSPHASES + 1);
+  CKPTVEC(Deactfrac, NSPHASES + 1);
+  CKPTVEC(Reactfrac, NSPHASES + 1);
+
+  /* Pore solution */
+
+  CKPT(PH_cur);
+  CKPT(Totsodium);
+  CKPT(Totpotassium);
+  CKPT(Rssodium);
+  CKPT(Rspotassium);
+  CKPT(Releasedk);
+  CKPT(Releasedna);
+  CKPT(Sodiumhydrox);
+  CKPT(Potassiumhydrox);
+  CKPT(Rsk_released);
+  CKPT(Rsna_released);
+  CKPT(Totfasodium);
+  CKPT(Totfapotassium);
+  CKPT(Rsfasodium);
+  CKPT(Rsfapotassium);
+  CKPT(FitpH);
+  CKPT(PHcoeff);
+  CKPT(Conccaplus);
+  CKPT(Moles_syn_precip);
+  CKPT(PHroots);
+  CKPT(PHrootsok);
+  CKPT(Concsulfate);
+  CKPT(Conductivity);
+  CKPT(Concnaplus);
+  CKPT(Conckplus);
+  CKPT(Concohminus);
+  CKPT(ActivityCa);
+  CKPT(ActivityOH);
+  CKPT(ActivitySO4);
+  CKPT(ActivityK);
+
+  /* Phase properties, some of which change during hydration */
+
+  CKPT(Specgrav);
+  CKPT(Waterc);
+  CKPT(Nh2o);
+  CKPT(Heatf);
+  CKPT(Molarv);
+
+  /* Histories indexed by cycle */
+
+  CKPTVEC(TimeHistory, Ncyc);
+  CKPTVEC(Molarvcsh, Ncyc);
+  CKPTVEC(Watercsh, Ncyc);
+  CKPT(Cshagewidth);
+
+  if (status)
+    return (status);
+
+  /* Microstructure grids, halos included */
+
+  status |= ckptgrid(fp, mode, Mic);
+  if (Micorig)
+    status |=
+        ckptblock(fp, mode, gridblock(Micorig), gridinfo(Micorig)->nbytes);
+  status |= ckptpartmap(fp, mode, &Micpart);
+  if (Cshage)
+    status |= ckptblock(fp, mode, gridblock(Cshage), gridinfo(Cshage)->nbytes);
+  if (Deactivated)
+    status |= ckptblock(fp, mode, gridblock(Deactivated),
+                        gridinfo(Deactivated)->nbytes);
+  if (Faces)
+    status |= ckptblock(fp, mode, gridblock(Faces), gridinfo(Faces)->nbytes);
+
+  /* Ant pool */
+
+  n = Antpool.num;
+  CKPT(n);
+  if (status || n < 0)
+    return (1);
+  if (mode == CKPTREAD) {
+    if (n > Antpool.size && resizeantpool(n))
+      return (MEMERR);
+    Antpool.num = n;
+  }
+  CKPTVEC(Antpool.x, n);
+  CKPTVEC(Antpool.y, n);
+  CKPTVEC(Antpool.z, n);
+  CKPTVEC(Antpool.id, n);
+  CKPTVEC(Antpool.cycbirth, n);
+
+  /* Ant slabs keep their random streams from cycle to cycle */
+
+  n = Antslabsize;
+  CKPT(n);
+  if (status || n < 0)
+    return (1);
+  if (mode == CKPTREAD) {
+    freeantslabs();
+    if (n > 0) {
+      Antslab = (struct Antslab *)malloc((size_t)n * sizeof(struct Antslab));
+      if (!Antslab)
+        return (MEMERR);
+      for (i = 0; i < n; i++) {
+        Antslab[i].job = NULL;
+        Antslab[i].njob = Antslab[i].jobsize = Antslab[i].joberr = 0;
+        Antslab[i].ant = NULL;
+        Antslab[i].nant = Antslab[i].antsize = Antslab[i].anterr = 0;
+      }
+      Antslabsize = n;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    CKPT(Antslab[i].rng);
+    CKPT(Antslab[i].moves);
+    CKPT(Antslab[i].tally);
+  }
+
+  /* Alkali sulfates waiting to dissolve */
+
+  status |= ckptalksulf(fp, mode, &Naspool, &Headnas, &Tailnas);
+  status |= ckptalksulf(fp, mode, &Kspool, &Headks, &Tailks);
+
+  /* Main random number streams */
+
+  if (mode == CKPTWRITE)
+    ran1save(&rng);
+  CKPT(rng);
+  CKPT(*Seed);
+  CKPT(Mainmoves);
+
+  /* Output files and the temperature profile */
+
+  CKPT(Ckptfilesize);
+  CKPT(Insitunext);
+  thpos = Ckptthpos;
+  CKPT(thpos);
+
+  if (status || mode == CKPTWRITE)
+    return (status);
+
+  /***
+   *    Everything was read.  Put the main random stream back, have
+   *    the list of deactivated pixels made again from Deactivated,
+   *    and follow the options the checkpoint was written with, so
+   *    that the rest of the run is the one that was interrupted.
+   *    Only serial versus slab diffusion matters, not the number
+   *    of threads.
+   ***/
+
+  ran1load(&rng);
+  Ndeactpix = -1;
+
+  if (bucketants != Bucketants) {
+    fprintf(Logfile, "\nWARNING: Checkpoint was written %s --legacy-ants; ",
+            bucketants ? "without" : "with");
+    fprintf(Logfile, "continuing the same way");
+    Bucketants = bucketants;
+  }
+  if ((antthreads > 0) != (Antthreads > 0)) {
+    fprintf(Logfile, "\nWARNING: Checkpoint was written %s --threads; ",
+            (antthreads > 0) ? "with" : "without");
+    fprintf(Logfile, "continuing the same way");
+    Antthreads = antthreads;
+  }
+  if (fastmoves != Fastmoves) {
+    fprintf(Logfile, "\nWARNING: Checkpoint was written %s --fast-moves; ",
+            fastmoves ? "with" : "without");
+    fprintf(Logfile, "continuing the same way");
+    Fastmoves = fastmoves;
+  }
+  if (adaptive != Adaptive) {
+    fprintf(Logfile, "\nWARNING: Checkpoint was written %s --adaptive; ",
+            adaptive ? "with" : "without");
+    fprintf(Logfile, "continuing the same way");
+    Adaptive = adaptive;
+  }
+  if (adaptsteps != Adaptsteps) {
+    fprintf(Logfile, "\nWARNING: Checkpoint was written %s --adaptive-steps; ",
+            adaptsteps ? "with" : "without");
+    fprintf(Logfile, "continuing the same way");
+    Adaptsteps = adaptsteps;
+  }
+  if (sortants != Sortants) {
+    fprintf(Logfile, "\nWARNING: Checkpoint was written %s --sorted-ants; ",
+            sortants ? "with" : "without");
+    fprintf(Logfile, "continuing the same way");
+    Sortants = sortants;
+  }
+
+  if (thfile && thpos >= 0 && fseek(thfile, thpos, SEEK_SET))
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	prepcheckpoint
+ *
+ * 	Record what the checkpoint needs to know about open and
+ * 	appended files.  This runs in the main process before the
+ * 	writer is forked, because the writer shares file offsets
+ * 	with the main process, which carries on appending.
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		outflush, ckptfile
+ *	Called by:	writecheckpoint
+ ***/
+void prepcheckpoint(void) {
+  int i;
+  FILE *fp;
+
+  outflush(1);
+  for (i = 0; i < CKPTNFILES; i++) {
+    Ckptfilesize[i] = -1;
+    if ((fp = fopen(ckptfile(i), "rb")) != NULL) {
+      if (!fseek(fp, 0L, SEEK_END))
+        Ckptfilesize[i] = ftell(fp);
+      fclose(fp);
+    }
+  }
+
+  Ckptthpos = thfile ? ftell(thfile) : -1;
+
+  return;
+}
+
+/***
+ *	savecheckpoint
+ *
+ * 	Write a checkpoint to a temporary file and rename it to
+ * 	Ckptname once it is complete
+ *
+ * 	Arguments:	int next custom image time
+ * 				float previous uncorrected time of findnewtime
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		ckptstate
+ *	Called by:	writecheckpoint
+ ***/
+int savecheckpoint(int customentry, float prevtime) {
+  int status;
+  char magic[CKPTMAGICLEN], tmpname[MAXSTRING];
+  FILE *fp;
+
+  if (snprintf(tmpname, sizeof(tmpname), "%s.tmp", Ckptname) >=
+      (int)sizeof(tmpname))
+    return (1);
+  if ((fp = fopen(tmpname, "wb")) == NULL)
+    return (1);
+
+  memset(magic, 0, CKPTMAGICLEN);
+  strcpy(magic, CKPTMAGIC);
+  status = (fwrite(magic, 1, CKPTMAGICLEN, fp) != CKPTMAGICLEN);
+  if (!status)
+    status = ckptstate(fp, CKPTWRITE, &customentry, &prevtime);
+  if (fclose(fp))
+    status = 1;
+
+  if (status) {
+    remove(tmpname);
+    return (status);
+  }
+
+#if defined(_WIN32)
+  remove(Ckptname);
+#endif
+  return (rename(tmpname, Ckptname) ? 1 : 0);
+}
+
+/***
+ *	waitcheckpoint
+ *
+ * 	Wait until the last checkpoint has been written, if a
+ * 	child process is still writing it
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	writecheckpoint, main program
+ ***/
+void waitcheckpoint(void) {
+#if !defined(_WIN32)
+  int wstatus;
+
+  if (Ckptpid > 0) {
+    if (waitpid((pid_t)Ckptpid, &wstatus, 0) < 0 || !WIFEXITED(wstatus) ||
+        WEXITSTATUS(wstatus) != 0) {
+      fprintf(stderr, "\nWARNING: Could not write checkpoint %s", Ckptname);
+      fflush(stderr);
+    }
+    Ckptpid = 0;
+  }
+#endif
+
+  return;
+}
+
+/***
+ *	writecheckpoint
+ *
+ * 	Take a checkpoint at the end of a cycle.  Where fork is
+ * 	available the file is written by a child process and this
+ * 	returns at once; otherwise it is written here.
+ *
+ * 	Arguments:	int next custom image time
+ * 				float previous uncorrected time of findnewtime
+ * 	Returns:	0 if okay (or the writer was started), nonzero
+ * 				otherwise
+ *
+ *	Calls:		waitcheckpoint, snapwait, prepcheckpoint,
+ *			savecheckpoint
+ *	Called by:	main program
+ ***/
+int writecheckpoint(int customentry, float prevtime) {
+#if !defined(_WIN32)
+  pid_t pid;
+#endif
+
+  waitcheckpoint();
+
+  /* The image index is one of the files cut back on restart */
+
+  snapwait();
+  prepcheckpoint();
+
+#if !defined(_WIN32)
+  pid = fork();
+  if (pid == 0)
+    _exit(savecheckpoint(customentry, prevtime) ? 1 : 0);
+  if (pid > 0) {
+    Ckptpid = (long)pid;
+    return (0);
+  }
+#endif
+
+  return (savecheckpoint(customentry, prevtime));
+}
+
+/***
+ *	readcheckpoint
+ *
+ * 	Restore the state saved in checkpoint Restartname, after
+ * 	the inputs have been read and just before the cycle loop,
+ * 	and cut the appended output files back to their length
+ * 	at the checkpoint.  The cycle loop then starts from the
+ * 	cycle after the one that was checkpointed.
+ *
+ * 	Arguments:	int pointer to the next custom image time
+ * 				float pointer to the previous uncorrected time
+ * 				of findnewtime
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		ckptstate, ckptfile
+ *	Called by:	main program
+ ***/
+int readcheckpoint(int *customentry, float *prevtime) {
+  int i, status;
+  char magic[CKPTMAGICLEN];
+  FILE *fp;
+
+  if ((fp = fopen(Restartname, "rb")) == NULL) {
+    fprintf(stderr, "\nERROR: Could not open checkpoint %s", Restartname);
+    return (1);
+  }
+
+  status = (fread(magic, 1, CKPTMAGICLEN, fp) != CKPTMAGICLEN) ||
+           strncmp(magic, CKPTMAGIC, CKPTMAGICLEN);
+  if (!status)
+    status = ckptstate(fp, CKPTREAD, customentry, prevtime);
+  fclose(fp);
+
+  if (status) {
+    fprintf(stderr, "\nERROR: %s is not a checkpoint of this simulation",
+            Restartname);
+    return (status);
+  }
+
+  for (i = 0; i < CKPTNFILES; i++) {
+    if (Ckptfilesize[i] < 0) {
+      remove(ckptfile(i));
+    } else if ((fp = fopen(ckptfile(i), "r+b")) != NULL) {
+#if defined(_WIN32)
+      status |= _chsize(_fileno(fp), Ckptfilesize[i]);
+#else
+      status |= ftruncate(fileno(fp), (off_t)Ckptfilesize[i]);
+#endif
+      fclose(fp);
+    } else {
+      status = 1;
+    }
+    if (status) {
+      fprintf(stderr, "\nERROR: Could not restore output file %s", ckptfile(i));
+      return (status);
+    }
+  }
+
+  Icycstart = Icyc + 1;
+
+  fprintf(Logfile, "\nRestarted from %s after cycle %d", Restartname, Icyc);
+  log_flush(Logfile);
+
+  return (0);
+}
@@ -0,0 +1,476 @@
+/***
+ *	coarsen
+ *
+ * 	Coarse grid for late ages, when disrealnew is run with
+ * 	--coarsen-time or --coarsen-alpha.  Once the run reaches
+ * 	the given time or degree of hydration, every 2x2x2 block of
+ * 	pixels becomes one pixel of twice the edge length, and the
+ * 	run goes on with an eighth of the pixels.
+ *
+ * 	The kinetics are rescaled so that the degree of hydration
+ * 	goes on from the fine grid without a step or a change of
+ * 	slope.  A dissolving surface pixel is now twice as thick,
+ * 	so the dissolution probabilities are halved.  There are a
+ * 	quarter of the diffusion steps per cycle (MAXDIFFSTEPS /
+ * 	Res^2), so the nucleation probabilities, which apply at
+ * 	each step, are four times larger.  Even so a coarse cycle
+ * 	does less than a fine one, and the clock of the Beta model
+ * 	counts it as COARSESTEP fine cycles (see coarseclock).
+ * 	Over five seeds of a 50^3 paste, coarsened at 3, 6 or 9 h
+ * 	or at a degree of hydration of 0.1, the mean degree of
+ * 	hydration up to 12 h stays within 0.02 of the mean of the
+ * 	fine runs, whose seeds differ from each other by a standard
+ * 	deviation of up to 0.008.
+ *
+ * 	A block takes the phase that most of its pixels have, ties
+ * 	going to a random one of them.  A second pass then moves
+ * 	blocks of phases that came out with more than an eighth of
+ * 	their pixels to phases of the same block that came out with
+ * 	fewer, so that each phase keeps its volume fraction as
+ * 	closely as the blocks allow.  The other grids take the
+ * 	values of one pixel of the block that has the chosen phase.
+ * 	Counters of pixels kept from earlier cycles are divided by
+ * 	eight like the phase counts themselves, so that the degree
+ * 	of hydration, the heat and the water balance carry on where
+ * 	they were.
+ *
+ * 	With --coarsen-refine, images are written at the original
+ * 	resolution, each pixel repeated over its block.  Movie
+ * 	frames always are, since a movie keeps the frame size it
+ * 	was made with.
+ ***/
+
+#define COARSEBLOCK 8   /* Pixels in a block */
+#define COARSESTEP 0.65 /* Fine cycles of the clock in a coarse one */
+
+/***
+ *	coarsecount
+ *
+ * 	Number of coarse pixels for a number of fine ones
+ *
+ * 	Arguments:	int number of fine pixels
+ * 	Returns:	int number of coarse pixels, rounded
+ *
+ *	Calls:		No other routines
+ *	Called by:	coarsen
+ ***/
+int coarsecount(int n) {
+  return ((int)floor(((double)n / (double)COARSEBLOCK) + 0.5));
+}
+
+/***
+ *	coarseclock
+ *
+ * 	Cycles of the Beta model clock, squared, that go by in one
+ * 	cycle.  The clock is Beta * n^2 after n fine cycles, and
+ * 	each cycle after coarsening counts as COARSESTEP fine ones.
+ * 	The calorimetric and chemical shrinkage calibrations take
+ * 	the time from the data instead and do not need this.
+ *
+ * 	Arguments:	int cycle number n
+ * 	Returns:	double increase of the squared clock cycles
+ * 				from cycle n - 1 to cycle n
+ *
+ *	Calls:		No other routines
+ *	Called by:	hydcycle, hydfinish
+ ***/
+double coarseclock(int n) {
+  double c0, c1;
+
+  if ((Coarsefact == 1) || (n <= Coarsecyc))
+    return (2.0 * (double)n - 1.0);
+
+  c1 = (double)Coarsecyc + COARSESTEP * (double)(n - Coarsecyc);
+  c0 = c1 - COARSESTEP;
+
+  return ((c1 * c1) - (c0 * c0));
+}
+
+/***
+ *	coarseblock
+ *
+ * 	Read the eight pixels of a block of Mic
+ *
+ * 	Arguments:	int x,y,z coordinates of the coarse pixel
+ * 				unsigned char pointer to COARSEBLOCK ids, in
+ * 				the order of the offsets (x, y, z bits)
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	coarsen
+ ***/
+void coarseblock(int i, int j, int k, unsigned char *val) {
+  int d;
+
+  for (d = 0; d < COARSEBLOCK; d++) {
+    val[d] = (unsigned char)
+        Mic[2 * i + ((d >> 2) & 1)][2 * j + ((d >> 1) & 1)][2 * k + (d & 1)];
+  }
+
+  return;
+}
+
+/***
+ *	coarsen
+ *
+ * 	Replace the microstructure with one of half the size in
+ * 	each direction and twice the resolution, and bring along
+ * 	the diffusing species and every count that depends on the
+ * 	number of pixels.  Nothing is changed if the system cannot
+ * 	be coarsened.
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay, nonzero if the system was left as it
+ * 				was
+ *
+ *	Calls:		coarseblock, coarsecount, refreshhalo, grid_census
+ *	Called by:	hydcycle
+ ***/
+int coarsen(void) {
+  int i, j, k, d, n, p, q, best, ntie, iant, nx, ny, nz, fx, fy, fz;
+  int tally[COARSEBLOCK], have[NPHASES + 1], target[NPHASES + 1], *slab;
+  long b, nblock, stride, step, r, s, t;
+  long fine[NPHASES + 1];
+  unsigned char val[COARSEBLOCK];
+  unsigned char *phase, *pick;
+  float disfact;
+  struct Alksulf *curas, *nextas;
+  Partmap coarsepart;
+
+  if ((Xsyssize % 2) || (Ysyssize % 2) || (Zsyssize % 2) ||
+      (Xsyssize < 4 * MICHALO) || (Ysyssize < 4 * MICHALO) ||
+      (Zsyssize < 4 * MICHALO)) {
+    fprintf(Logfile, "\nWARNING: A %d x %d x %d system cannot be coarsened",
+            Xsyssize, Ysyssize, Zsyssize);
+    log_flush(Logfile);
+    return (1);
+  }
+
+  nx = Xsyssize / 2;
+  ny = Ysyssize / 2;
+  nz = Zsyssize / 2;
+  nblock = (long)nx * (long)ny * (long)nz;
+
+  phase = (unsigned char *)malloc((size_t)nblock);
+  pick = (unsigned char *)malloc((size_t)nblock);
+  if (!phase || !pick) {
+    if (phase)
+      free(phase);
+    if (pick)
+      free(pick);
+    fprintf(Logfile, "\nWARNING: No memory to coarsen the system");
+    log_flush(Logfile);
+    return (1);
+  }
+
+  for (p = 0; p <= NPHASES; p++) {
+    fine[p] = 0;
+    have[p] = 0;
+  }
+
+  /***
+   *    First pass: the majority phase of each block, with the
+   *    first of its pixels that has that phase
+   ***/
+
+  for (i = 0; i < nx; i++) {
+    for (j = 0; j < ny; j++) {
+      for (k = 0; k < nz; k++) {
+        b = ((long)i * ny + j) * nz + k;
+        coarseblock(i, j, k, val);
+        for (d = 0; d < COARSEBLOCK; d++) {
+          if (val[d] <= NPHASES)
+            fine[val[d]]++;
+          tally[d] = 0;
+          for (n = 0; n < COARSEBLOCK; n++) {
+            if (val[n] == val[d])
+              tally[d]++;
+          }
+        }
+
+        /* Each tied phase is seen once, at its first pixel */
+
+        best = 0;
+        ntie = 0;
+        for (d = 0; d < COARSEBLOCK; d++) {
+          for (n = 0; n < d && val[n] != val[d]; n++)
+            ;
+          if (n < d || tally[d] < tally[best])
+            continue;
+          if (tally[d] > tally[best] || d == 0) {
+            best = d;
+            ntie = 1;
+          } else if (ran1(Seed) < 1.0 / (double)(++ntie)) {
+            best = d;
+          }
+        }
+        phase[b] = val[best];
+        pick[b] = (unsigned char)best;
+        if (val[best] <= NPHASES)
+          have[val[best]]++;
+      }
+    }
+  }
+
+  /***
+   *    Second pass: give blocks of phases with too many blocks
+   *    to phases of the same block with too few.  Blocks are
+   *    visited with a stride prime to their number, so that the
+   *    changes are not bunched at one end of the system.
+   ***/
+
+  for (p = 0; p <= NPHASES; p++) {
+    target[p] = coarsecount((int)fine[p]);
+  }
+
+  for (stride = 7919; stride < nblock; stride++) {
+    for (r = stride, s = nblock; s != 0; t = r % s, r = s, s = t)
+      ;
+    if (r == 1)
+      break;
+  }
+  if (stride >= nblock)
+    stride = 1;
+
+  b = (long)(ran1(Seed) * (double)nblock) % nblock;
+  for (step = 0; step < nblock; step++, b = (b + stride) % nblock) {
+    p = phase[b];
+    if (p > NPHASES || have[p] <= target[p])
+      continue;
+    i = (int)(b / ((long)ny * nz));
+    j = (int)((b / nz) % ny);
+    k = (int)(b % nz);
+    coarseblock(i, j, k, val);
+    best = -1;
+    for (d = 0; d < COARSEBLOCK; d++) {
+      q = val[d];
+      if (q == p || q > NPHASES || have[q] >= target[q])
+        continue;
+      for (tally[d] = 0, n = 0; n < COARSEBLOCK; n++) {
+        if (val[n] == q)
+          tally[d]++;
+      }
+      if (best < 0 || tally[d] > tally[best])
+        best = d;
+    }
+    if (best >= 0) {
+      have[p]--;
+      have[val[best]]++;
+      phase[b] = val[best];
+      pick[b] = (unsigned char)best;
+    }
+  }
+
+  /***
+   *    The particle ids go into a new map, a slab of coarse
+   *    x planes at a time, before anything is changed
+   ***/
+
+  slab = (int *)malloc((size_t)PARTMAPBLK * ny * nz * sizeof(int));
+  if (!slab || partmap_alloc(&coarsepart, nx, ny, nz)) {
+    if (slab)
+      free(slab);
+    free(phase);
+    free(pick);
+    fprintf(Logfile, "\nWARNING: No memory to coarsen the system");
+    log_flush(Logfile);
+    return (1);
+  }
+  for (i = 0; i < nx; i++) {
+    for (j = 0; j < ny; j++) {
+      for (k = 0; k < nz; k++) {
+        b = ((long)i * ny + j) * nz + k;
+        d = pick[b];
+        slab[((long)(i & (PARTMAPBLK - 1)) * ny + j) * nz + k] = partmap_get(
+            &Micpart, 2 * i + ((d >> 2) & 1), 2 * j + ((d >> 1) & 1),
+            2 * k + (d & 1));
+      }
+    }
+    if (((i & (PARTMAPBLK - 1)) == PARTMAPBLK - 1 || i == nx - 1) &&
+        partmap_putslab(&coarsepart, i & ~(PARTMAPBLK - 1), slab)) {
+      free(slab);
+      partmap_free(&coarsepart);
+      free(phase);
+      free(pick);
+      fprintf(Logfile, "\nWARNING: No memory to coarsen the system");
+      log_flush(Logfile);
+      return (1);
+    }
+  }
+  free(slab);
+  partmap_free(&Micpart);
+  Micpart = coarsepart;
+
+  /***
+   *    Write the coarse grids over the low corner of the fine
+   *    ones.  A coarse pixel is never behind the block it comes
+   *    from, so every block is read before it is overwritten.
+   ***/
+
+  for (i = 0; i < nx; i++) {
+    for (j = 0; j < ny; j++) {
+      for (k = 0; k < nz; k++) {
+        b = ((long)i * ny + j) * nz + k;
+        d = pick[b];
+        fx = 2 * i + ((d >> 2) & 1);
+        fy = 2 * j + ((d >> 1) & 1);
+        fz = 2 * k + (d & 1);
+        Mic[i][j][k] = (char)phase[b];
+        if (Micorig)
+          Micorig[i][j][k] = Micorig[fx][fy][fz];
+        if (Cshage)
+          Cshage[i][j][k] = Cshage[fx][fy][fz];
+        if (Deactivated)
+          Deactivated[i][j][k] = Deactivated[fx][fy][fz];
+        if (Faces)
+          Faces[i][j][k] = Faces[fx][fy][fz];
+      }
+    }
+  }
+
+  /***
+   *    Keep one diffusing species of each block that became
+   *    that species, moved to the coarse pixel
+   ***/
+
+  memset(pick, 0, (size_t)nblock);
+  n = 0;
+  for (iant = 0; iant < Antpool.num; iant++) {
+    i = Antpool.x[iant] / 2;
+    j = Antpool.y[iant] / 2;
+    k = Antpool.z[iant] / 2;
+    b = ((long)i * ny + j) * nz + k;
+    if (pick[b] || phase[b] != Antpool.id[iant])
+      continue;
+    pick[b] = 1;
+    Antpool.x[n] = (unsigned short int)i;
+    Antpool.y[n] = (unsigned short int)j;
+    Antpool.z[n] = (unsigned short int)k;
+    Antpool.id[n] = Antpool.id[iant];
+    Antpool.cycbirth[n] = Antpool.cycbirth[iant];
+    n++;
+  }
+  Ngoing -= Antpool.num - n;
+  Antpool.num = n;
+
+  free(phase);
+  free(pick);
+
+  /* The alkali sulfate lists are made again by dissolve */
+
+  for (curas = Headks->nextas; curas != NULL; curas = nextas) {
+    nextas = curas->nextas;
+    nodepool_put(&Kspool, curas);
+  }
+  Headks->nextas = NULL;
+  Tailks = Headks;
+  for (curas = Headnas->nextas; curas != NULL; curas = nextas) {
+    nextas = curas->nextas;
+    nodepool_put(&Naspool, curas);
+  }
+  Headnas->nextas = NULL;
+  Tailnas = Headnas;
+
+  /* System size and resolution */
+
+  Xsyssize = nx;
+  Ysyssize = ny;
+  Zsyssize = nz;
+  Syspix = Xsyssize * Ysyssize * Zsyssize;
+  Syspix_orig = coarsecount(Syspix_orig);
+  Ndeactpix = -1;
+  Sizemag /= (float)COARSEBLOCK;
+  Sizemag_orig /= (float)COARSEBLOCK;
+  Isizemag = (int)(Sizemag + 0.5);
+  refreshhalo();
+
+  /* A crack still to come is opened at the same width in microns */
+
+  if (Crackwidth > 0 && Cracktime <= End_time)
+    Crackwidth = (Crackwidth + 1) / 2;
+
+  Res *= 2.0;
+  Maxdiffsteps = MAXDIFFSTEPS / (Res * Res);
+  disfact = 0.5;
+  for (i = 0; i <= NSPHASES; i++) {
+    Disbase[i] *= disfact;
+    Disprob[i] *= disfact;
+  }
+
+  /* Counts of pixels from earlier cycles */
+
+  Ncshplategrow = coarsecount(Ncshplategrow);
+  if (Ncshplategrow < 1)
+    Ncshplategrow = 1;
+  Ncshplateinit = coarsecount(Ncshplateinit);
+  Nsilica_rx = coarsecount(Nsilica_rx);
+  Nsilica = coarsecount(Nsilica);
+  Ncsbar = coarsecount(Ncsbar);
+  Netbar = coarsecount(Netbar);
+  Porinit = coarsecount(Porinit);
+  Freelimeinit = coarsecount(Freelimeinit);
+  Ksbarinit = coarsecount(Ksbarinit);
+  Nsbarinit = coarsecount(Nsbarinit);
+  Nasr = coarsecount(Nasr);
+  Nslagr = coarsecount(Nslagr);
+  Slagemptyp = coarsecount(Slagemptyp);
+  C3sinit = coarsecount(C3sinit);
+  C2sinit = coarsecount(C2sinit);
+  C3ainit = coarsecount(C3ainit);
+  Oc3ainit = coarsecount(Oc3ainit);
+  C4afinit = coarsecount(C4afinit);
+  Anhinit = coarsecount(Anhinit);
+  Heminit = coarsecount(Heminit);
+  Crackpinit = coarsecount(Crackpinit);
+  Chold = coarsecount(Chold);
+  Chnew = coarsecount(Chnew);
+  Nasulfinit = coarsecount(Nasulfinit);
+  Ksulfinit = coarsecount(Ksulfinit);
+  Nmade = coarsecount(Nmade);
+  Gypready = coarsecount(Gypready);
+  Poregone = coarsecount(Poregone);
+  Poretodo = coarsecount(Poretodo);
+  Countpore = coarsecount(Countpore);
+  Countkeep = coarsecount(Countkeep);
+  Water_left = coarsecount(Water_left);
+  Water_off = coarsecount(Water_off);
+  Pore_off = coarsecount(Pore_off);
+  DIFFCHdeficit = coarsecount(DIFFCHdeficit);
+  Slaginit = coarsecount(Slaginit);
+  Slagcum = coarsecount(Slagcum);
+  Chgone = coarsecount(Chgone);
+  Nucsulf2gyps = coarsecount(Nucsulf2gyps);
+  Nch_slag = coarsecount(Nch_slag);
+  Sulf_cur = coarsecount(Sulf_cur);
+  Sulf_solid = coarsecount(Sulf_solid);
+
+  /* Masses and heat in units of pixels, and the factors on them */
+
+  Cemmass /= (double)COARSEBLOCK;
+  Cemmasswgyp /= (double)COARSEBLOCK;
+  Flyashmass /= (double)COARSEBLOCK;
+  Flyashvol /= (double)COARSEBLOCK;
+  CH_mass /= (double)COARSEBLOCK;
+  Heat_old /= (double)COARSEBLOCK;
+  Heat_new /= (double)COARSEBLOCK;
+  Heatsum /= (float)COARSEBLOCK;
+  Heat_cf *= (double)COARSEBLOCK;
+  Cshscale /= (float)COARSEBLOCK;
+  C3ah6_scale /= (float)COARSEBLOCK;
+
+  grid_census(Mic, Xsyssize, Ysyssize, Zsyssize, NPHASES, Count);
+
+  /* Particles have changed, so parthyd must count them again */
+
+  Partok = 0;
+  Coarsefact = 2;
+  Coarsecyc = Cyccnt;
+
+  fprintf(Logfile, "\nCoarsened the system to %d x %d x %d at %f microns",
+          Xsyssize, Ysyssize, Zsyssize, Res);
+  fprintf(Logfile, "\n\tat time %f h and degree of hydration %f", Time_cur,
+          Alpha_cur);
+  log_flush(Logfile);
+
+  return (0);
+}
@@ -0,0 +1,421 @@
+/***
+ *	ensemble
+ *
+ * 	Several runs of the same microstructure, differing only in
+ * 	their random number seed, when disrealnew is run with
+ * 	--ensemble n.  The parameter file, the images and init are
+ * 	read and set up once; each member then forks from that
+ * 	state and runs in a process of its own, sharing the loaded
+ * 	arrays copy-on-write.  At most one member per processor
+ * 	(or per --threads processors) runs at a time.
+ *
+ * 	Member k writes all of its output in the directory memberk
+ * 	(member000, member001, ...) of the working directory.
+ * 	Member 0 keeps the seed of the parameter file and follows
+ * 	exactly the run disrealnew would make without --ensemble;
+ * 	member k restarts the generator with that seed plus k.
+ * 	When all of the members are done, their data files are put
+ * 	together in one table, with the member and its seed in the
+ * 	first two columns.
+ *
+ * 	In a VCCTL_MPI build run under mpirun with more than one
+ * 	rank, the members are not forked: rank k loads the input,
+ * 	becomes member k, and rank 0 puts the data together when
+ * 	all are done.  The ranks may be on different nodes, as long
+ * 	as they share the working directory.
+ *
+ * 	Not available on Windows, which has no fork.
+ ***/
+
+#if !defined(_WIN32)
+
+/***
+ *	ensrename
+ *
+ * 	Move a file name that is in the working directory to the
+ * 	same name in a member's directory
+ *
+ * 	Arguments:	char pointer to file name (changed in place)
+ * 				char pointer to member directory
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	ensmember
+ ***/
+void ensrename(char *name, char *dir) {
+  size_t nwd;
+  char buff[MAXSTRING];
+
+  nwd = strlen(WorkingDirectory);
+  if (strlen(name) == 0 || strncmp(name, WorkingDirectory, nwd))
+    return;
+
+  snprintf(buff, sizeof(buff), "%s%s", dir, name + nwd);
+  strcpy(name, buff);
+
+  return;
+}
+
+/***
+ *	ensmember
+ *
+ * 	Set up a newly forked member: its seed, its directory and
+ * 	file names, its own log and its own copy of any open input
+ *
+ * 	Arguments:	int member
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		ensrename
+ *	Called by:	ensfork, ensmpi, hyd_member
+ ***/
+int ensmember(int k) {
+  long pos;
+  char dir[MAXSTRING], thname[MAXSTRING], cwd[MAXSTRING], buff[MAXSTRING];
+
+  Ensmember = k;
+
+  /* Names are made absolute, since the member works in its directory */
+
+  if (WorkingDirectory[0] != '/' && getcwd(cwd, sizeof(cwd))) {
+    snprintf(dir, sizeof(dir), "%s/%smember%03d%s", cwd, WorkingDirectory, k,
+             PATH_SEPARATOR);
+  } else {
+    snprintf(dir, sizeof(dir), "%smember%03d%s", WorkingDirectory, k,
+             PATH_SEPARATOR);
+  }
+
+  /***
+   *    The temperature profile is read as the run goes on, and
+   *    an inherited stream would share its file offset with
+   *    the other members
+   ***/
+
+  if (thfile) {
+    pos = ftell(thfile);
+    fclose(thfile);
+    snprintf(thname, sizeof(thname), "%stemperature_profile.csv",
+             WorkingDirectory);
+    thfile = fopen(thname, "r");
+    if (!thfile || fseek(thfile, pos, SEEK_SET))
+      return (1);
+  }
+
+  ensrename(LogFileName, dir);
+  ensrename(ProgressFileName, dir);
+  ensrename(Restartname, dir);
+  ensrename(Perfname, dir);
+  ensrename(Tracename, dir);
+  ensrename(Seriesname, dir);
+  ensrename(Streamdest, dir);
+  ensrename(Demandname, dir);
+  strcpy(WorkingDirectory, dir);
+
+  /* Each member has a live view of its own */
+
+  if (strlen(Livename) > 0) {
+    snprintf(buff, sizeof(buff), "%s-member%03d", Livename, k);
+    strcpy(Livename, buff);
+  }
+
+  /* Files named without a directory go in the member's as well */
+
+  if (chdir(dir))
+    return (1);
+
+  log_close(Logfile);
+  if ((Logfile = log_open(LogFileName, "w")) == NULL)
+    return (1);
+
+  /* A run of hyd_member keeps its seed and has no ensemble */
+
+  if (Ensseed) {
+    fprintf(Logfile, "=== ENSEMBLE MEMBER %d OF %d, SEED %d ===", k, Ensnum,
+            Ensseed[k]);
+  } else {
+    fprintf(Logfile, "=== MEMBER %d, SEED %d ===", k, abs(Iseed0));
+  }
+  log_flush(Logfile);
+
+  if (k > 0 && Ensseed) {
+    Iseed = -Ensseed[k];
+    Seed = (&Iseed);
+  }
+
+  return (0);
+}
+
+/***
+ *	ensfork
+ *
+ * 	Run the members of the ensemble, each in a process forked
+ * 	from this one, and wait for all of them
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 in a member, which goes on with its run; 1 in
+ * 				the parent once every member has ended; -1 on
+ * 				error
+ *
+ *	Calls:		ensmember
+ *	Called by:	hydinit
+ ***/
+int ensfork(void) {
+  int k, next, running, jobs, wstatus;
+  long nproc;
+  pid_t pid, *enspid;
+  char dir[MAXSTRING];
+
+  Ensseed = ivector(Ensnum);
+  Ensstatus = ivector(Ensnum);
+  enspid = (pid_t *)calloc((size_t)Ensnum, sizeof(pid_t));
+  if (!Ensseed || !Ensstatus || !enspid) {
+    if (enspid)
+      free(enspid);
+    return (-1);
+  }
+
+  for (k = 0; k < Ensnum; k++) {
+    Ensseed[k] = abs(Iseed0) + k;
+    Ensstatus[k] = -1;
+    snprintf(dir, sizeof(dir), "%smember%03d", WorkingDirectory, k);
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+      fprintf(Logfile, "\nERROR: Could not make directory %s", dir);
+      free(enspid);
+      return (-1);
+    }
+  }
+
+  nproc = sysconf(_SC_NPROCESSORS_ONLN);
+  jobs = (int)((nproc > 0) ? nproc : 1);
+  if (Antthreads > 1)
+    jobs /= Antthreads;
+  if (jobs < 1)
+    jobs = 1;
+
+  fprintf(Logfile, "\n\nRunning %d ensemble members, %d at a time", Ensnum,
+          jobs);
+
+  next = running = 0;
+  while (next < Ensnum || running > 0) {
+    if (next < Ensnum && running < jobs) {
+      fflush(Logfile);
+      fflush(stdout);
+      fflush(stderr);
+      pid = fork();
+      if (pid == 0) {
+        free(enspid);
+        if (ensmember(next)) {
+          fprintf(stderr, "\nERROR: Could not set up ensemble member %d",
+                  next);
+          _exit(1);
+        }
+        return (0);
+      }
+      if (pid < 0) {
+        fprintf(Logfile, "\nERROR: Could not start ensemble member %d", next);
+      } else {
+        enspid[next] = pid;
+        running++;
+      }
+      next++;
+      continue;
+    }
+
+    pid = wait(&wstatus);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (k = 0; k < Ensnum && enspid[k] != pid; k++)
+      ;
+    if (k == Ensnum)
+      continue;
+    running--;
+    if (WIFEXITED(wstatus)) {
+      Ensstatus[k] = WEXITSTATUS(wstatus);
+    } else {
+      Ensstatus[k] = 128 + WTERMSIG(wstatus);
+    }
+    fprintf(Logfile, "\nEnsemble member %d (seed %d) ended with status %d", k,
+            Ensseed[k], Ensstatus[k]);
+    log_flush(Logfile);
+  }
+
+  free(enspid);
+
+  return (1);
+}
+
+/***
+ *	Names of the run as a whole, kept by ensmpi for ensmpifinish
+ ***/
+static char Enscwd[MAXSTRING], Enswd[MAXSTRING], Ensdata[MAXSTRING],
+    Enslog[MAXSTRING];
+
+/***
+ *	ensmpi
+ *
+ * 	Make this MPI rank the member of the ensemble of the same
+ * 	number
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay, -1 on error
+ *
+ *	Calls:		ensmember
+ *	Called by:	hydinit
+ ***/
+int ensmpi(void) {
+  int k;
+  char dir[MAXSTRING];
+
+  Ensseed = ivector(Ensnum);
+  Ensstatus = ivector(Ensnum);
+  if (!Ensseed || !Ensstatus)
+    return (-1);
+
+  for (k = 0; k < Ensnum; k++) {
+    Ensseed[k] = abs(Iseed0) + k;
+    Ensstatus[k] = -1;
+  }
+
+  if (!getcwd(Enscwd, sizeof(Enscwd)))
+    return (-1);
+  strcpy(Enswd, WorkingDirectory);
+  strcpy(Ensdata, Datafilename);
+  strcpy(Enslog, LogFileName);
+
+  snprintf(dir, sizeof(dir), "%smember%03d", WorkingDirectory, Mpirank);
+  if (mkdir(dir, 0755) && errno != EEXIST) {
+    fprintf(stderr, "\nERROR: Could not make directory %s", dir);
+    return (-1);
+  }
+
+  if (Mpirank == 0) {
+    fprintf(Logfile, "\n\nRunning %d ensemble members, one to an MPI rank",
+            Ensnum);
+    log_flush(Logfile);
+  }
+
+  return ((ensmember(Mpirank)) ? -1 : 0);
+}
+
+
+/***
+ *	ensfinish
+ *
+ * 	Put the data files of the members together in one table
+ * 	and report on the ensemble
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if every member completed, nonzero otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	main program, ensmpifinish
+ ***/
+int ensfinish(void) {
+  int k, nfailed, header, line;
+  size_t nwd, cap;
+  ssize_t len;
+  char name[MAXSTRING], ensname[MAXSTRING];
+  char *buff;
+  FILE *fpin, *fpout;
+
+  /* Datafilename is the working directory, the data file root and .csv */
+
+  nwd = strlen(WorkingDirectory);
+  strcpy(ensname, Datafilename);
+  len = (ssize_t)strlen(ensname) - 4;
+  if (len > 0 && !strcmp(ensname + len, ".csv"))
+    ensname[len] = '\0';
+  strcat(ensname, ".ensemble.csv");
+
+  fpout = filehandler("disrealnew", ensname, "WRITE");
+  if (!fpout)
+    return (1);
+
+  nfailed = 0;
+  header = 0;
+  buff = NULL;
+  cap = 0;
+  for (k = 0; k < Ensnum; k++) {
+    if (Ensstatus[k] != 0)
+      nfailed++;
+    snprintf(name, sizeof(name), "%smember%03d%s%s", WorkingDirectory, k,
+             PATH_SEPARATOR, Datafilename + nwd);
+    fpin = fopen(name, "r");
+    if (!fpin)
+      continue;
+    line = 0;
+    while ((len = getline(&buff, &cap, fpin)) > 0) {
+      while (len > 0 && (buff[len - 1] == '\n' || buff[len - 1] == '\r'))
+        buff[--len] = '\0';
+      if (line++ == 0) {
+        if (!header)
+          fprintf(fpout, "Member,Seed,%s", buff);
+        header = 1;
+      } else if (len > 0) {
+        fprintf(fpout, "\n%d,%d,%s", k, Ensseed[k], buff);
+      }
+    }
+    fclose(fpin);
+  }
+  if (buff)
+    free(buff);
+  fclose(fpout);
+
+  fprintf(Logfile, "\n\nEnsemble of %d members done, %d failed", Ensnum,
+          nfailed);
+  fprintf(Logfile, "\nData of all members in %s", ensname);
+  fprintf(Logfile, "\n\n=== END DISREALNEW SIMULATION ===");
+  log_flush(Logfile);
+
+  if (Verbose_flag > 0) {
+    fprintf(stdout, "\n{");
+    fprintf(stdout, "\n\t\"status\": \"%s\",",
+            (nfailed == 0) ? "completed" : "failed");
+    fprintf(stdout, "\n\t\"members\": %d,", Ensnum);
+    fprintf(stdout, "\n\t\"failed_members\": %d,", nfailed);
+    fprintf(stdout, "\n\t\"output_files\": [");
+    fprintf(stdout, "\n\t\t\"%s\"", ensname);
+    fprintf(stdout, "\n\t]");
+    fprintf(stdout, "\n}");
+    fflush(stdout);
+  }
+
+  return (nfailed != 0);
+}
+
+#ifdef VCCTL_MPI
+/***
+ *	ensmpifinish
+ *
+ * 	Gather the exit status of every member on rank 0, which
+ * 	then puts their data together, as ensfinish does for the
+ * 	forked members
+ *
+ * 	Arguments:	int exit status of this rank's member
+ * 	Returns:	0 if every member completed (on rank 0), or the
+ * 				status of this rank's member (on the others)
+ *
+ *	Calls:		ensfinish
+ *	Called by:	main program
+ ***/
+int ensmpifinish(int status) {
+  MPI_Gather(&status, 1, MPI_INT, Ensstatus, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (Mpirank != 0)
+    return (status);
+
+  if (chdir(Enscwd))
+    return (1);
+  strcpy(WorkingDirectory, Enswd);
+  strcpy(Datafilename, Ensdata);
+  log_close(Logfile);
+  if ((Logfile = log_open(Enslog, "a")) == NULL)
+    return (1);
+  status = ensfinish();
+
+  return (status);
+}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+/***
+ *	hydapi
+ *
+ * 	Running the disrealnew hydration model inside another
+ * 	program.  The library vcctlhyd holds the whole model;
+ * 	disrealnew itself is a thin driver over the same stages:
+ *
+ * 		hyd_open     read the command line and the parameter
+ * 		             file, load the microstructure
+ * 		hyd_scale    change a rate parameter before the
+ * 		             first cycle
+ * 		hyd_member   move the output of a forked run to a
+ * 		             directory of its own
+ * 		hyd_step     carry out up to n hydration cycles
+ * 		hyd_state    time, degree of hydration and so on
+ * 		hyd_counts   number of voxels of each phase
+ * 		hyd_snapshot copy of the microstructure
+ * 		hyd_finish   final image and data, as disrealnew
+ * 		             writes them at the end of a run
+ * 		hyd_close    release everything
+ *
+ * 	hyd_open takes the same arguments as disrealnew, so the
+ * 	output files are written just as they are by the program.
+ *
+ * 	The model keeps its state in file-scope variables, so a
+ * 	process holds one run, opened once.  Programs that run
+ * 	many short simulations from one loaded microstructure
+ * 	start each one in a process of its own, for instance by
+ * 	forking after hyd_open and calling hyd_member in each
+ * 	child (see hydcalib).
+ *
+ * 	An error that would end disrealnew makes the call return
+ * 	nonzero (-1 for hyd_step) instead; the run can then only
+ * 	be closed.
+ ***/
+#ifndef HYDAPI_H
+#define HYDAPI_H
+
+#include <stddef.h>
+
+/***
+ *	State of a run after the last cycle carried out
+ ***/
+typedef struct {
+  int cycle;           /* next cycle to carry out */
+  int maxcycles;       /* last cycle of the run */
+  int running;         /* nonzero if more cycles are due */
+  int xsize, ysize, zsize; /* system size (changes if cracked) */
+  float res;           /* resolution (micrometers) */
+  float time;          /* hours */
+  float alpha;         /* degree of hydration */
+  float temperature;   /* binder temperature (C) */
+  float pH;            /* pore solution pH */
+  float heat;          /* heat released (kJ/kg) */
+  float chemshrinkage; /* chemical shrinkage (mL/g) */
+} Hydstate;
+
+int hyd_open(int argc, char *argv[]);
+int hyd_scale(const char *name, float factor);
+int hyd_member(int k);
+int hyd_step(int ncycles);
+int hyd_state(Hydstate *st);
+int hyd_counts(int *count, int n);
+int hyd_snapshot(unsigned char *vox, size_t len);
+int hyd_finish(void);
+void hyd_close(void);
+
+#endif
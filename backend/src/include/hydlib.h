@@ -0,0 +1,341 @@
+/***
+ *	hydlib
+ *
+ * 	Entry points of the vcctlhyd library (see hydapi.h).  Each
+ * 	one that can reach an error exit sets Hydjmp first, and
+ * 	hydexit returns there with the exit status.
+ ***/
+#include "hydapi.h"
+
+/***
+ *	hydexit
+ *
+ * 	Stand-in for exit in the library: go back to the entry
+ * 	point that is running, or end the process if none is
+ *
+ * 	Arguments:	int exit status
+ * 	Returns:	Does not return
+ *
+ *	Calls:		No other routines
+ *	Called by:	every error exit of the model
+ ***/
+void hydexit(int status) {
+  if (Hydjmpon) {
+    Hydjmpon = 0;
+    Hydstatus = (status != 0) ? status : 1;
+    Hydstage = HYDFAILED;
+    longjmp(Hydjmp, 1);
+  }
+  (exit)(status);
+}
+
+/***
+ *	hyd_open
+ *
+ * 	Start a run, reading the command line and parameter file
+ * 	just as disrealnew does
+ *
+ * 	Arguments:	int argc, char *argv[] (see checkargs)
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		hydinit
+ *	Called by:	calling program
+ ***/
+int hyd_open(int argc, char *argv[]) {
+
+  /* The state of a run cannot be set up twice in one process */
+
+  if (Hydstage != HYDNONE)
+    return (1);
+  Hydstage = HYDFAILED;
+
+  if (setjmp(Hydjmp))
+    return (Hydstatus);
+  Hydjmpon = 1;
+  if (hydinit(argc, argv)) {
+    Hydjmpon = 0;
+    return (1);
+  }
+  Hydjmpon = 0;
+  Hydstage = HYDOPEN;
+
+  return (0);
+}
+
+/***
+ *	hyd_scale
+ *
+ * 	Multiply one rate parameter of the run, as read from the
+ * 	parameter file, by a factor.  The parameter is one of the
+ * 	nucleation probabilities and scale factors (pnucch,
+ * 	pscalech, pnuchg, pscalehg, pnucfh3, pscalefh3, pnucgyp,
+ * 	pscalegyp) or dis:PHASE, the dissolution probability of a
+ * 	phase named as in id2phasename (dis:C3S).  Only allowed
+ * 	before the first cycle.
+ *
+ * 	Arguments:	char pointer to the parameter name
+ * 				float factor
+ * 	Returns:	0 if okay, nonzero if there is no such parameter
+ * 				or the run has started
+ *
+ *	Calls:		id2phasename
+ *	Called by:	calling program
+ ***/
+int hyd_scale(const char *name, float factor) {
+  int i;
+  char phname[MAXSTRING];
+
+  if (Hydstage != HYDOPEN || Icyc != Icycstart || factor < 0.0)
+    return (1);
+
+  if (!strcmp(name, "pnucch")) {
+    pnucch *= factor;
+  } else if (!strcmp(name, "pscalech")) {
+    pscalech *= factor;
+  } else if (!strcmp(name, "pnuchg")) {
+    pnuchg *= factor;
+  } else if (!strcmp(name, "pscalehg")) {
+    pscalehg *= factor;
+  } else if (!strcmp(name, "pnucfh3")) {
+    pnucfh3 *= factor;
+  } else if (!strcmp(name, "pscalefh3")) {
+    pscalefh3 *= factor;
+  } else if (!strcmp(name, "pnucgyp")) {
+    pnucgyp *= factor;
+  } else if (!strcmp(name, "pscalegyp")) {
+    pscalegyp *= factor;
+  } else if (!strncmp(name, "dis:", 4)) {
+
+    /* Disbase is what the probability is worked out from each cycle */
+
+    for (i = 1; i <= NSPHASES; i++) {
+      id2phasename(i, phname);
+      if (!strcmp(name + 4, phname))
+        break;
+    }
+    if (i > NSPHASES)
+      return (1);
+    Disbase[i] *= factor;
+    Disprob[i] *= factor;
+  } else {
+    return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	hyd_member
+ *
+ * 	Give a run forked from an open one a directory and log of
+ * 	its own, memberk in the working directory, as the members
+ * 	of an ensemble have (see ensemble.h), so that runs going
+ * 	on side by side do not write to the same files.  The seed
+ * 	is kept.  Only allowed before the first cycle, and not
+ * 	with --perf, --stream, --live or --trace, whose files are
+ * 	already open; not available on Windows.
+ *
+ * 	Arguments:	int k
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		ensmember, initialize_output_files
+ *	Called by:	calling program
+ ***/
+int hyd_member(int k) {
+#if !defined(_WIN32)
+  char dir[MAXSTRING];
+
+  if (Hydstage != HYDOPEN || Icyc != Icycstart || k < 0)
+    return (1);
+
+  /* Streams opened by hyd_open would be shared with the parent */
+
+  if (Perffile || Streamfile || Livemap || trace_on())
+    return (1);
+
+  snprintf(dir, sizeof(dir), "%smember%03d", WorkingDirectory, k);
+  if (mkdir(dir, 0755) && errno != EEXIST)
+    return (1);
+  if (ensmember(k))
+    return (1);
+
+  return (initialize_output_files());
+#else
+  return (1);
+#endif
+}
+
+/***
+ *	hyd_step
+ *
+ * 	Carry out up to ncycles hydration cycles, stopping early
+ * 	when the run reaches its end
+ *
+ * 	Arguments:	int number of cycles
+ * 	Returns:	int number of cycles carried out (0 once the run
+ * 				is at its end), or -1 on error
+ *
+ *	Calls:		hydrunning, hydcycle
+ *	Called by:	calling program
+ ***/
+int hyd_step(int ncycles) {
+  int n;
+
+  if (Hydstage != HYDOPEN)
+    return (-1);
+
+  if (setjmp(Hydjmp))
+    return (-1);
+  Hydjmpon = 1;
+  for (n = 0; n < ncycles && hydrunning(); n++) {
+    hydcycle();
+  }
+  Hydjmpon = 0;
+
+  return (n);
+}
+
+/***
+ *	hyd_state
+ *
+ * 	Report the state of the run
+ *
+ * 	Arguments:	pointer to Hydstate to fill in
+ * 	Returns:	0 if okay, nonzero if no run is open
+ *
+ *	Calls:		hydrunning
+ *	Called by:	calling program
+ ***/
+int hyd_state(Hydstate *st) {
+  if (Hydstage != HYDOPEN && Hydstage != HYDFINISHED)
+    return (1);
+
+  st->cycle = Icyc;
+  st->maxcycles = Ncyc;
+  st->running = (Hydstage == HYDOPEN) ? hydrunning() : 0;
+  st->xsize = Xsyssize;
+  st->ysize = Ysyssize;
+  st->zsize = Zsyssize;
+  st->res = Res;
+  st->time = Time_cur;
+  st->alpha = Alpha_cur;
+  st->temperature = Temp_cur_b;
+  st->pH = PH_cur;
+  st->heat = Heat_new * Heat_cf;
+  st->chemshrinkage = Chs_new;
+
+  return (0);
+}
+
+/***
+ *	hyd_counts
+ *
+ * 	Copy the number of voxels of each phase, indexed by phase
+ * 	id as in the image files
+ *
+ * 	Arguments:	int array to fill in, and its length
+ * 	Returns:	int number of entries copied (NPHASES + 1 at
+ * 				most), or -1 if no run is open
+ *
+ *	Calls:		No other routines
+ *	Called by:	calling program
+ ***/
+int hyd_counts(int *count, int n) {
+  int i;
+
+  if (Hydstage != HYDOPEN && Hydstage != HYDFINISHED)
+    return (-1);
+
+  if (n > NPHASES + 1)
+    n = NPHASES + 1;
+  for (i = 0; i < n; i++) {
+    count[i] = Count[i];
+  }
+
+  return (n);
+}
+
+/***
+ *	hyd_snapshot
+ *
+ * 	Copy the phase id of every voxel, in the order of the
+ * 	image files (z varying fastest, then y, then x)
+ *
+ * 	Arguments:	buffer, and its length in bytes (at least
+ * 				xsize * ysize * zsize from hyd_state)
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	calling program
+ ***/
+int hyd_snapshot(unsigned char *vox, size_t len) {
+  int ix, iy;
+  size_t nz;
+
+  if (Hydstage != HYDOPEN && Hydstage != HYDFINISHED)
+    return (1);
+
+  nz = (size_t)Zsyssize;
+  if (len < (size_t)Xsyssize * (size_t)Ysyssize * nz)
+    return (1);
+
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      memcpy(vox, Mic[ix][iy], nz);
+      vox += nz;
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *	hyd_finish
+ *
+ * 	End the run, writing the final image and data
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		hydfinish
+ *	Called by:	calling program
+ ***/
+int hyd_finish(void) {
+  if (Hydstage != HYDOPEN)
+    return (1);
+
+  if (setjmp(Hydjmp))
+    return (Hydstatus);
+  Hydjmpon = 1;
+  hydfinish();
+  Hydjmpon = 0;
+  Hydstage = HYDFINISHED;
+
+  return (0);
+}
+
+/***
+ *	hyd_close
+ *
+ * 	Release everything held by the run, finished or not
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		hydfree
+ *	Called by:	calling program
+ ***/
+void hyd_close(void) {
+  if (Hydstage == HYDNONE || Hydstage == HYDCLOSED)
+    return;
+
+  /* hydfree may still write to the log, so it is closed last */
+
+  hydfree();
+  if (Logfile)
+    log_close(Logfile);
+  Logfile = NULL;
+  Hydstage = HYDCLOSED;
+
+  return;
+}
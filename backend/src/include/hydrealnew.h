@@ -11,112 +11,178 @@
  *    Called by:    disrealnew
  ***/
 
+/***
+ *    Offsets of the six neighbors chosen by moveone, in the
+ *    order of the act codes 1 through 6
+ ***/
+static const int Movedx[6] = {-1, 1, 0, 0, 0, 0};
+static const int Movedy[6] = {0, 0, -1, 1, 0, 0};
+static const int Movedz[6] = {0, 0, 0, 0, -1, 1};
+
+/***
+ *    fillmoves
+ *
+ *    Refill a buffer of moveone directions from its stream.
+ *    Each 64-bit draw gives two directions, one from each half,
+ *    by scaling the half to [0,6).
+ *
+ *     Arguments:    struct Movebuf pointer to refill
+ *     Returns:    Nothing
+ *
+ *    Calls:        rng_next
+ *    Called by:    moveone
+ ***/
+void fillmoves(struct Movebuf *mb) {
+  int i;
+  uint64_t r;
+
+  for (i = 0; i < MOVEBUFSIZE; i += 2) {
+    r = rng_next(&(mb->st));
+    mb->dir[i] = (unsigned char)(((r >> 32) * 6) >> 32);
+    mb->dir[i + 1] = (unsigned char)(((r & 0xffffffffULL) * 6) >> 32);
+  }
+  mb->pos = 0;
+
+  return;
+}
+
 /***
  *    moveone
  *
  *    Select a new neighboring location to (xloc, yloc, zloc)
  *    for a diffusing species
  *
+ *    The direction comes from one call to ran1, or with
+ *    --fast-moves from the direction buffer of the calling
+ *    thread.  Callers that try the neighbors in turn keep a
+ *    mask of the directions tried so far (MOVEALL once all
+ *    six have been) and OR the return value into it.
+ *
  *     Arguments:    Int pointers to location (x,y,z)
  *                 Int pointer to act, the direction (1 through 6)
- *                 Int sumold
+ *                 Int mask of directions already tried
  *
- *     Returns:    Prime number flag indicating direction chosen
+ *     Returns:    Bit of the direction chosen, or 0 if it was
+ *                 already in the mask
  *
- *    Calls:        ran1
- *    Called by:    movecsh, extettr, extfh3, movegyp, extafm,
- *                moveettr, extpozz, movefh3, extc3ah5, movec3a,
- *                extfriedel, movecacl2, extstrat, moveas
+ *    Calls:        ran1, fillmoves
+ *    Called by:    movecsh, extettr, growlocal, movegyp, moveettr,
+ *                movefh3, movec3a, movecacl2, moveas
  ***/
 void extpozz(int xpres, int ypres, int zpres, int *poreid);
 
-int moveone(int *xloc, int *yloc, int *zloc, int *act, int sumold) {
-  int plok, sumnew, xl1, yl1, zl1, act1;
-
-  sumnew = 1;
-
-  /* Store the input values for location */
-
-  xl1 = (*xloc);
-  yl1 = (*yloc);
-  zl1 = (*zloc);
-  act1 = (*act);
+int moveone(int *xloc, int *yloc, int *zloc, int *act, int tried) {
+  int plok, xl1, yl1, zl1;
 
   /***
    *    Choose one of six directions (at random)
    *    for the new location
    ***/
 
-  plok = 6.0 * ran1(Seed);
-  if ((plok > 5) || (plok < 0))
-    plok = 5;
-
-  switch (plok) {
-  case 0:
-    xl1--;
-    act1 = 1;
-    if (xl1 < 0)
-      xl1 = Xsyssize - 1;
-    if (sumold % 2 != 0)
-      sumnew = 2;
-    break;
-  case 1:
-    xl1++;
-    act1 = 2;
-    if (xl1 >= Xsyssize)
-      xl1 = 0;
-    if (sumold % 3 != 0)
-      sumnew = 3;
-    break;
-  case 2:
-    yl1--;
-    act1 = 3;
-    if (yl1 < 0)
-      yl1 = Ysyssize - 1;
-    if (sumold % 5 != 0)
-      sumnew = 5;
-    break;
-  case 3:
-    yl1++;
-    act1 = 4;
-    if (yl1 >= Ysyssize)
-      yl1 = 0;
-    if (sumold % 7 != 0)
-      sumnew = 7;
-    break;
-  case 4:
-    zl1--;
-    act1 = 5;
-    if (zl1 < 0)
-      zl1 = Zsyssize - 1;
-    if (sumold % 11 != 0)
-      sumnew = 11;
-    break;
-  case 5:
-    zl1++;
-    act1 = 6;
-    if (zl1 >= Zsyssize)
-      zl1 = 0;
-    if (sumold % 13 != 0)
-      sumnew = 13;
-    break;
-  default:
-    break;
+  if (Fastmoves) {
+    if (Curmoves->pos >= MOVEBUFSIZE)
+      fillmoves(Curmoves);
+    plok = Curmoves->dir[Curmoves->pos++];
+  } else {
+    plok = 6.0 * ran1(Seed);
+    if ((plok > 5) || (plok < 0))
+      plok = 5;
   }
 
+  /* Step to the neighbor, with periodic boundaries */
+
+  xl1 = (*xloc) + Movedx[plok];
+  yl1 = (*yloc) + Movedy[plok];
+  zl1 = (*zloc) + Movedz[plok];
+  if (xl1 < 0)
+    xl1 = Xsyssize - 1;
+  else if (xl1 >= Xsyssize)
+    xl1 = 0;
+  if (yl1 < 0)
+    yl1 = Ysyssize - 1;
+  else if (yl1 >= Ysyssize)
+    yl1 = 0;
+  if (zl1 < 0)
+    zl1 = Zsyssize - 1;
+  else if (zl1 >= Zsyssize)
+    zl1 = 0;
+
   /* Return the new location */
 
   *xloc = xl1;
   *yloc = yl1;
   *zloc = zl1;
-  *act = act1;
+  *act = plok + 1;
 
-  /***
-   *    Sumnew returns a prime number indicating
-   *    that a specific direction has been chosen
-   ***/
+  return ((tried & (1 << plok)) ? 0 : (1 << plok));
+}
+
+/***
+ *    growlocal
+ *
+ *    Local growth of a product next to a reaction site, shared
+ *    by the ext* routines.  Neighbors of (xpres,ypres,zpres)
+ *    are drawn by moveone until one holds a phase in the mask
+ *    into, all six have been tried, or maxtries draws are made.
+ *    The first eligible neighbor becomes phase phnew.
+ *
+ *     Arguments:    Int coordinates of the site xpres,ypres,zpres
+ *                 Int id of the phase to grow
+ *                 Unsigned long long mask of the phases it may
+ *                     replace (see GROWINTO)
+ *                 Int most neighbors to draw
+ *
+ *     Returns:    1 if the phase was placed, 0 otherwise
+ *
+ *    Calls:        moveone
+ *    Called by:    extfh3, extgyps, extfriedel, extstrat, extafm,
+ *                extpozz, extc3ah6, extslagcsh
+ ***/
+int growlocal(int xpres, int ypres, int zpres, int phnew,
+              unsigned long long into, int maxtries) {
+  int i1, tried, check, act, xchr, ychr, zchr;
+
+  tried = 0;
+  for (i1 = 1; (i1 <= maxtries) && (tried != MOVEALL); i1++) {
+    xchr = xpres;
+    ychr = ypres;
+    zchr = zpres;
+    act = 0;
+    tried |= moveone(&xchr, &ychr, &zchr, &act, tried);
+
+    check = Mic[xchr][ychr][zchr];
+    if (GROWINTO(into, check)) {
+      MICSET(xchr, ychr, zchr, phnew);
+      Count[phnew]++;
+      Count[check]--;
+      return (1);
+    }
+  }
 
-  return (sumnew);
+  return (0);
+}
+
+/***
+ *    nbrwrap
+ *
+ *    Coordinates of a pixel and its two neighbors along
+ *    one axis, with periodic boundaries, so that a scan
+ *    of the 3*3*3 box around a pixel needs no checkbc
+ *
+ *     Arguments:    Int coordinate, int system size along the axis
+ *                 Int pointer to three results (c-1, c, c+1)
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        No other routines
+ *    Called by:    getporenv, edgecnt
+ ***/
+void nbrwrap(int c, int size, int *w) {
+  w[0] = (c > 0) ? c - 1 : size - 1;
+  w[1] = c;
+  w[2] = (c < size - 1) ? c + 1 : 0;
+
+  return;
 }
 
 /***
@@ -130,14 +196,15 @@ int moveone(int *xloc, int *yloc, int *zloc, int *act, int sumold) {
  *
  *     Returns:    Int pore id (either POROSITY or CRACKP)
  *
- *    Calls:        No other routines
+ *    Calls:        nbrwrap
  *
  *    Called by:    all the move routines (movecsh, etc.)
  *
  *    (Function implement 24 May 2004)
  ***/
 int getporenv(int xck, int yck, int zck) {
-  int ixe, iye, ize, x2, y2, z2, check;
+  int ixe, iye, ize, check;
+  int xw[3], yw[3], zw[3];
   int porecnt = 0, crackcnt = 0;
 
   /***
@@ -146,22 +213,16 @@ int getporenv(int xck, int yck, int zck) {
    *    the central pixel
    ***/
 
-  for (ixe = (-1); ixe <= 1; ixe++) {
-    x2 = xck + ixe;
-    for (iye = (-1); iye <= 1; iye++) {
-      y2 = yck + iye;
-      for (ize = (-1); ize <= 1; ize++) {
+  nbrwrap(xck, Xsyssize, xw);
+  nbrwrap(yck, Ysyssize, yw);
+  nbrwrap(zck, Zsyssize, zw);
 
-        if ((ixe != 0) || (iye != 0) || (ize != 0)) {
-          z2 = zck + ize;
+  for (ixe = 0; ixe < 3; ixe++) {
+    for (iye = 0; iye < 3; iye++) {
+      for (ize = 0; ize < 3; ize++) {
 
-          /* adjust to maintain periodic boundaries */
-
-          x2 += checkbc(x2, Xsyssize);
-          y2 += checkbc(y2, Ysyssize);
-          z2 += checkbc(z2, Zsyssize);
-
-          check = Mic[x2][y2][z2];
+        if ((ixe != 1) || (iye != 1) || (ize != 1)) {
+          check = Mic[xw[ixe]][yw[iye]][zw[ize]];
 
           if (check == POROSITY)
             porecnt++;
@@ -192,13 +253,14 @@ int getporenv(int xck, int yck, int zck) {
  *     Returns:    Int count of neighbor pixels that are not
  *                 type ph1, ph2, ph3
  *
- *    Calls:        No other routines
+ *    Calls:        nbrwrap
  *
  *    Called by:    extettr, extfh3, extafm, extpozz,
  *                extc3ah5, extfriedel, extstrat
  ***/
 int edgecnt(int xck, int yck, int zck, int ph1, int ph2, int ph3) {
-  int ixe, iye, ize, edgeback, x2, y2, z2, check;
+  int ixe, iye, ize, edgeback, check;
+  int xw[3], yw[3], zw[3];
 
   /***
    *    Counter for number of neighboring pixels
@@ -213,22 +275,16 @@ int edgecnt(int xck, int yck, int zck, int ph1, int ph2, int ph3) {
    *    the central pixel
    ***/
 
-  for (ixe = (-1); ixe <= 1; ixe++) {
-    x2 = xck + ixe;
-    for (iye = (-1); iye <= 1; iye++) {
-      y2 = yck + iye;
-      for (ize = (-1); ize <= 1; ize++) {
-
-        if ((ixe != 0) || (iye != 0) || (ize != 0)) {
-          z2 = zck + ize;
+  nbrwrap(xck, Xsyssize, xw);
+  nbrwrap(yck, Ysyssize, yw);
+  nbrwrap(zck, Zsyssize, zw);
 
-          /* adjust to maintain periodic boundaries */
+  for (ixe = 0; ixe < 3; ixe++) {
+    for (iye = 0; iye < 3; iye++) {
+      for (ize = 0; ize < 3; ize++) {
 
-          x2 += checkbc(x2, Xsyssize);
-          y2 += checkbc(y2, Ysyssize);
-          z2 += checkbc(z2, Zsyssize);
-
-          check = Mic[x2][y2][z2];
+        if ((ixe != 1) || (iye != 1) || (ize != 1)) {
+          check = Mic[xw[ixe]][yw[iye]][zw[ize]];
 
           if ((check != ph1) && (check != ph2) && (check != ph3)) {
 
@@ -248,40 +304,25 @@ int edgecnt(int xck, int yck, int zck, int ph1, int ph2, int ph3) {
 }
 
 /***
- *    extcsh
+ *    randcsh
  *
- *    Add extra CSH when diffusing CSH reacts
+ *    Place one pixel of CSH at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extcsh
  *
- *     Arguments:    int x,y,z position of current pixel
- *                 pointer to id of saturated porosity locally
+ *     Arguments:    Int id of saturated porosity to grow into
  *
  *     Returns:    Nothing
  *
- *    Calls:        edgecnt
- *
- *    Called by:    movecsh
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extcsh, rundeferred
  ***/
-void extcsh(int xpres, int ypres, int zpres, int *poreid) {
-  int numnear1, numnear2, xchr, ychr, zchr, fchr, check, msface, pval;
-  int tries;
+void randcsh(int pval) {
+  int numnear1, numnear2, msface, check, xchr, ychr, zchr;
+  int fchr, tries;
 
   fchr = tries = 0;
 
-  /***
-   *    Locate CSH at random location in pore space
-   *    in contact with at least another CSH or C3S
-   *    or C2S
-   ***/
-
-  if (*poreid < 0) {
-    if (Cyccnt > Crackcycle) {
-      *poreid = getporenv(xpres, ypres, zpres);
-    } else {
-      *poreid = (int)(POROSITY);
-    }
-  }
-  pval = (int)(*poreid);
-
   while (!fchr) {
 
     tries++;
@@ -313,10 +354,11 @@ void extcsh(int xpres, int ypres, int zpres, int *poreid) {
        ***/
 
       if ((numnear1 < 26) || (numnear2 < 26) || (tries > MAXTRIES)) {
-        Mic[xchr][ychr][zchr] = CSH;
+        MICSET(xchr, ychr, zchr, CSH);
         Count[CSH]++;
         Count[pval]--;
-        Cshage[xchr][ychr][zchr] = Cyccnt;
+        if (Cshage)
+          Cshage[xchr][ychr][zchr] = cshagecode(Cyccnt);
         if (Cshgeom == PLATE) {
           msface = (int)(3.0 * ran1(Seed) + 1.0);
           if (msface > 3)
@@ -329,6 +371,49 @@ void extcsh(int xpres, int ypres, int zpres, int *poreid) {
     }
   }
 
+  Nrejected += tries - 1;
+
+  return;
+}
+
+/***
+ *    extcsh
+ *
+ *    Add extra CSH when diffusing CSH reacts
+ *
+ *     Arguments:    int x,y,z position of current pixel
+ *                 pointer to id of saturated porosity locally
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        getporenv, randcsh, deferrand
+ *
+ *    Called by:    movecsh
+ ***/
+void extcsh(int xpres, int ypres, int zpres, int *poreid) {
+  int pval;
+
+  /***
+   *    Locate CSH at random location in pore space
+   *    in contact with at least another CSH or C3S
+   *    or C2S
+   ***/
+
+  if (*poreid < 0) {
+    if (Cyccnt > Crackcycle) {
+      *poreid = getporenv(xpres, ypres, zpres);
+    } else {
+      *poreid = (int)(POROSITY);
+    }
+  }
+  pval = (int)(*poreid);
+
+  if (Deferrand) {
+    deferrand(RANDCSH, pval, 0);
+  } else {
+    randcsh(pval);
+  }
+
   return;
 }
 
@@ -365,7 +450,7 @@ int movecsh(int xcur, int ycur, int zcur, int finalstep, int cycorig) {
   xnew = xcur;
   ynew = ycur;
   znew = zcur;
-  sumin = 1;
+  sumin = 0;
 
   sumback = moveone(&xnew, &ynew, &znew, &action, sumin);
 
@@ -424,12 +509,13 @@ int movecsh(int xcur, int ycur, int zcur, int finalstep, int cycorig) {
     prtest = Molarvcsh[Cyccnt] / Molarvcsh[cycorig];
     prcsh1 = ran1(Seed);
     if (prcsh1 <= prtest) {
-      Mic[xcur][ycur][zcur] = CSH;
+      MICSET(xcur, ycur, zcur, CSH);
       if (Cshgeom == PLATE) {
         Faces[xcur][ycur][zcur] = Faces[xnew][ynew][znew];
         Ncshplategrow++;
       }
-      Cshage[xcur][ycur][zcur] = Cyccnt;
+      if (Cshage)
+        Cshage[xcur][ycur][zcur] = cshagecode(Cyccnt);
       Count[CSH]++;
     } else {
 
@@ -442,7 +528,7 @@ int movecsh(int xcur, int ycur, int zcur, int finalstep, int cycorig) {
       poreid = POROSITY;
       if (Icyc > Crackcycle)
         poreid = getporenv(xcur, ycur, zcur);
-      Mic[xcur][ycur][zcur] = poreid;
+      MICSET(xcur, ycur, zcur, poreid);
       Count[poreid]++;
     }
 
@@ -475,8 +561,9 @@ int movecsh(int xcur, int ycur, int zcur, int finalstep, int cycorig) {
     prtest = Molarvcsh[Cyccnt] / Molarvcsh[cycorig];
     prcsh1 = ran1(Seed);
     if (prcsh1 <= prtest) {
-      Mic[xcur][ycur][zcur] = CSH;
-      Cshage[xcur][ycur][zcur] = Cyccnt;
+      MICSET(xcur, ycur, zcur, CSH);
+      if (Cshage)
+        Cshage[xcur][ycur][zcur] = cshagecode(Cyccnt);
       if (Cshgeom == PLATE) {
         msface = (int)(2.0 * ran1(Seed) + 1.0);
         if (msface > 2)
@@ -501,7 +588,7 @@ int movecsh(int xcur, int ycur, int zcur, int finalstep, int cycorig) {
       poreid = POROSITY;
       if (Cyccnt > Crackcycle)
         poreid = getporenv(xcur, ycur, zcur);
-      Mic[xcur][ycur][zcur] = poreid;
+      MICSET(xcur, ycur, zcur, poreid);
       Count[poreid]++;
     }
 
@@ -539,7 +626,7 @@ int movecsh(int xcur, int ycur, int zcur, int finalstep, int cycorig) {
     /* Decrement count of diffusing CSH species ... */
 
     Count[DIFFCSH]--;
-    Mic[xcur][ycur][zcur] = POZZCSH;
+    MICSET(xcur, ycur, zcur, POZZCSH);
     Count[POZZCSH]++;
 
     /* Check to see if we need to dissolve the SFUME */
@@ -547,7 +634,7 @@ int movecsh(int xcur, int ycur, int zcur, int finalstep, int cycorig) {
     prcsh1 = ran1(Seed);
     if (prcsh1 <= 0.136) {
       /* YES, dissolve the silica fume */
-      Mic[xnew][ynew][znew] = POZZCSH;
+      MICSET(xnew, ynew, znew, POZZCSH);
       Count[POZZCSH]++;
       Count[SFUME]--;
       Nsilica_rx++;
@@ -575,8 +662,8 @@ int movecsh(int xcur, int ycur, int zcur, int finalstep, int cycorig) {
      ****/
 
     if (check == POROSITY || check == CRACKP) {
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFCSH;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFCSH);
     } else {
 
       /***
@@ -592,70 +679,101 @@ int movecsh(int xcur, int ycur, int zcur, int finalstep, int cycorig) {
 }
 
 /***
- *    extfh3
+ *    randfh3
  *
- *    Add extra FH3 when gypsum, hemihydrate, anhydrite, CAS2,
- *    or CaCl2 reacts with C4AF at location (xpres, ypres, zpres)
+ *    Place one pixel of FH3 at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extfh3
  *
- *     Arguments:    Int coordinates xpres, ypres, zpres
- *                 Int pointer to id of local saturated porosity
+ *     Arguments:    Int id of saturated porosity to grow into
  *
  *     Returns:    Nothing
  *
- *    Calls:        moveone,edgecnt
- *
- *    Called by:    movegyp,moveettr,movecas2,movehem,moveanh,movecacl2
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extfh3, rundeferred
  ***/
-void extfh3(int xpres, int ypres, int zpres, int *poreid) {
-  int multf, numnear, sump, xchr, ychr, zchr, check, fchr, i1, newact, pval;
-  int tries;
+void randfh3(int pval) {
+  int numnear, check, xchr, ychr, zchr;
+  int fchr, tries;
 
-  /***
-   *    First try 6 neighboring locations until
-   *        a) successful,
-   *        b) all 6 sites are tried and full, or
-   *        c) 500 tries are made
-   ***/
-
-  fchr = 0;
-  sump = 1;
-
-  /* 30030 is product of first six prime numbers */
+  fchr = tries = 0;
 
-  for (i1 = 1; ((i1 <= 500) && (!fchr) && (sump != 30030)); i1++) {
+  while (!fchr) {
 
-    /* Choose a nearest neighbor at random */
+    tries++;
 
-    xchr = xpres;
-    ychr = ypres;
-    zchr = zpres;
-    newact = 0;
+    /* Generate a random location in the 3-D system */
 
-    multf = moveone(&xchr, &ychr, &zchr, &newact, sump);
+    xchr = (int)((float)Xsyssize * ran1(Seed));
+    ychr = (int)((float)Ysyssize * ran1(Seed));
+    zchr = (int)((float)Zsyssize * ran1(Seed));
 
-    if (!newact) {
-      fprintf(stderr, "\nERROR in extfh3: Value of newact is %d", newact);
-      fflush(stderr);
-    }
+    if (xchr >= Xsyssize)
+      xchr = 0;
+    if (ychr >= Ysyssize)
+      ychr = 0;
+    if (zchr >= Zsyssize)
+      zchr = 0;
 
     check = Mic[xchr][ychr][zchr];
 
     /***
-     *    If neighbor is POROSITY or CRACKP, then locate the
-     *    FH3 there, because it is local growth
+     *    If location is porosity of the majority type at the location
+     *    of the original growth (POROSITY or CRACKP),
+     *    locate the FH3 there, because here growth is non-local
      *    (24 May 2004)
      ***/
 
-    if (check == POROSITY || check == CRACKP) {
-      Mic[xchr][ychr][zchr] = FH3;
-      Count[FH3]++;
-      Count[check]--;
-      fchr = 1;
-    } else {
-      sump *= multf;
+    if (check == pval) {
+
+      numnear = edgecnt(xchr, ychr, zchr, FH3, FH3, DIFFFH3);
+
+      /***
+       *    Be sure that at least one neighboring
+       *    pixel is FH3 or diffusing FH3
+       ***/
+
+      if ((numnear < 26) || (tries > MAXTRIES)) {
+        MICSET(xchr, ychr, zchr, FH3);
+        Count[FH3]++;
+        Count[pval]--;
+        fchr = 1;
+      }
     }
   }
 
+  Nrejected += tries - 1;
+
+  return;
+}
+
+/***
+ *    extfh3
+ *
+ *    Add extra FH3 when gypsum, hemihydrate, anhydrite, CAS2,
+ *    or CaCl2 reacts with C4AF at location (xpres, ypres, zpres)
+ *
+ *     Arguments:    Int coordinates xpres, ypres, zpres
+ *                 Int pointer to id of local saturated porosity
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        growlocal, randfh3, deferrand
+ *
+ *    Called by:    movegyp,moveettr,movecas2,movehem,moveanh,movecacl2
+ ***/
+void extfh3(int xpres, int ypres, int zpres, int *poreid) {
+  int fchr, pval;
+
+  /***
+   *    First try the six neighboring locations, drawn at
+   *    most 500 times.  Saturated porosity of either kind
+   *    (POROSITY or CRACKP) is allowed because growth is
+   *    local (24 May 2004)
+   ***/
+
+  fchr = growlocal(xpres, ypres, zpres, FH3, GROWPORE, 500);
+
   /***
    *    If no neighbor available, locate FH3 at random
    *    location in pore space in contact with at least
@@ -665,7 +783,6 @@ void extfh3(int xpres, int ypres, int zpres, int *poreid) {
    *    (24 May 2004)
    ***/
 
-  tries = 0;
   if (*poreid < 0) {
     if (Cyccnt > Crackcycle) {
       *poreid = getporenv(xpres, ypres, zpres);
@@ -675,6 +792,38 @@ void extfh3(int xpres, int ypres, int zpres, int *poreid) {
   }
   pval = (int)(*poreid);
 
+  if (!fchr) {
+    if (Deferrand) {
+      deferrand(RANDFH3, pval, 0);
+    } else {
+      randfh3(pval);
+    }
+  }
+
+  return;
+}
+
+/***
+ *    randettr
+ *
+ *    Place one pixel of ettringite at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extettr
+ *
+ *     Arguments:    Int id of saturated porosity to grow into
+ *                 Int type of ettringite (see extettr)
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extettr, rundeferred
+ ***/
+void randettr(int pval, int etype) {
+  int numnear, numsil, check, xchr, ychr, zchr;
+  int fchr, tries;
+
+  fchr = tries = 0;
+
   while (!fchr) {
 
     tries++;
@@ -694,31 +843,44 @@ void extfh3(int xpres, int ypres, int zpres, int *poreid) {
 
     check = Mic[xchr][ychr][zchr];
 
-    /***
-     *    If location is porosity of the majority type at the location
-     *    of the original growth (POROSITY or CRACKP),
-     *    locate the FH3 there, because here growth is non-local
-     *    (24 May 2004)
-     ***/
+    /* If location is porosity, locate the ettringite there */
 
     if (check == pval) {
 
-      numnear = edgecnt(xchr, ychr, zchr, FH3, FH3, DIFFFH3);
+      numsil = edgecnt(xchr, ychr, zchr, C3S, C2S, C3S);
+      numsil = 26 - numsil;
+      if (etype == 0) {
+        numnear = edgecnt(xchr, ychr, zchr, ETTR, C3A, C4AF);
+        if (numnear == 26)
+          numnear = edgecnt(xchr, ychr, zchr, OC3A, OC3A, OC3A);
+      } else {
+        numnear = edgecnt(xchr, ychr, zchr, ETTRC4AF, C3A, C4AF);
+        if (numnear == 26)
+          numnear = edgecnt(xchr, ychr, zchr, OC3A, OC3A, OC3A);
+      }
 
       /***
-       *    Be sure that at least one neighboring
-       *    pixel is FH3 or diffusing FH3
+       *    Be sure that at least one neighboring pixel
+       *    is either ettringite or aluminate clinker
        ***/
 
-      if ((numnear < 26) || (tries > MAXTRIES)) {
-        Mic[xchr][ychr][zchr] = FH3;
-        Count[FH3]++;
-        Count[pval]--;
+      if ((tries > MAXTRIES) || ((numnear < 26) && (numsil < 1))) {
+        if (etype == 0) {
+          MICSET(xchr, ychr, zchr, ETTR);
+          Count[ETTR]++;
+        } else {
+          MICSET(xchr, ychr, zchr, ETTRC4AF);
+          Count[ETTRC4AF]++;
+        }
+
         fchr = 1;
+        Count[pval]--;
       }
     }
   }
 
+  Nrejected += tries - 1;
+
   return;
 }
 
@@ -740,14 +902,13 @@ void extfh3(int xpres, int ypres, int zpres, int *poreid) {
  *
  *     Returns:    Int flag indicating action taken
  *
- *    Calls:        moveone, edgecnt
+ *    Calls:        moveone, edgecnt, randettr, deferrand
  *
  *    Called by:    movegyp, movehem, moveanh, movec3a
  ***/
 int extettr(int xpres, int ypres, int zpres, int etype, int *poreid) {
   int check, newact, multf, numnear, sump, xchr, ychr, zchr, fchr, i1;
   int numalum, numsil, pval;
-  int tries;
   float pneigh, ptest;
 
   /***
@@ -757,11 +918,11 @@ int extettr(int xpres, int ypres, int zpres, int etype, int *poreid) {
    ***/
 
   fchr = 0;
-  sump = 1;
+  sump = 0;
 
   /***
-   *    Note that 30030 is the product of the first six prime numbers,
-   *    indicating that all six sites have been tried
+   *    Note that sump is MOVEALL once all six sites
+   *    have been tried
    ***/
 
   for (i1 = 1; ((i1 <= 1000) && (!fchr)); i1++) {
@@ -828,10 +989,10 @@ int extettr(int xpres, int ypres, int zpres, int etype, int *poreid) {
       if (numsil < 1) {
         if (pneigh >= ptest) {
           if (etype == 0) {
-            Mic[xchr][ychr][zchr] = ETTR;
+            MICSET(xchr, ychr, zchr, ETTR);
             Count[ETTR]++;
           } else {
-            Mic[xchr][ychr][zchr] = ETTRC4AF;
+            MICSET(xchr, ychr, zchr, ETTRC4AF);
             Count[ETTRC4AF]++;
           }
           fchr = 1;
@@ -852,7 +1013,6 @@ int extettr(int xpres, int ypres, int zpres, int etype, int *poreid) {
    *    (24 May 2004)
    ***/
 
-  tries = 0;
   if (*poreid < 0) {
     if (Cyccnt > Crackcycle) {
       *poreid = getporenv(xpres, ypres, zpres);
@@ -862,10 +1022,41 @@ int extettr(int xpres, int ypres, int zpres, int etype, int *poreid) {
   }
   pval = (int)(*poreid);
 
+  if (!fchr) {
+    newact = 7;
+    if (Deferrand) {
+      deferrand(RANDETTR, pval, etype);
+    } else {
+      randettr(pval, etype);
+    }
+  }
+
+  return (newact); /* 7 if nothing was done */
+}
+
+/***
+ *    randch
+ *
+ *    Place one pixel of CH at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extch
+ *
+ *     Arguments:    Int id of saturated porosity to grow into
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extch, rundeferred
+ ***/
+void randch(int pval) {
+  int numnear, check, xchr, ychr, zchr;
+  int fchr, tries;
+
+  fchr = tries = 0;
+
   while (!fchr) {
 
     tries++;
-    newact = 7;
 
     /* Generate a random location in the 3-D system */
 
@@ -882,43 +1073,34 @@ int extettr(int xpres, int ypres, int zpres, int etype, int *poreid) {
 
     check = Mic[xchr][ychr][zchr];
 
-    /* If location is porosity, locate the ettringite there */
+    /***
+     *    If location is porosity of the same type as that
+     *    found at the original reaction location,
+     *    locate the CH there.  We do this because the
+     *    growth is non-local
+     ***/
 
     if (check == pval) {
 
-      numsil = edgecnt(xchr, ychr, zchr, C3S, C2S, C3S);
-      numsil = 26 - numsil;
-      if (etype == 0) {
-        numnear = edgecnt(xchr, ychr, zchr, ETTR, C3A, C4AF);
-        if (numnear == 26)
-          numnear = edgecnt(xchr, ychr, zchr, OC3A, OC3A, OC3A);
-      } else {
-        numnear = edgecnt(xchr, ychr, zchr, ETTRC4AF, C3A, C4AF);
-        if (numnear == 26)
-          numnear = edgecnt(xchr, ychr, zchr, OC3A, OC3A, OC3A);
-      }
+      numnear = edgecnt(xchr, ychr, zchr, CH, DIFFCH, CH);
 
       /***
        *    Be sure that at least one neighboring pixel
-       *    is either ettringite or aluminate clinker
+       *    is CH or diffusing CH
        ***/
 
-      if ((tries > MAXTRIES) || ((numnear < 26) && (numsil < 1))) {
-        if (etype == 0) {
-          Mic[xchr][ychr][zchr] = ETTR;
-          Count[ETTR]++;
-        } else {
-          Mic[xchr][ychr][zchr] = ETTRC4AF;
-          Count[ETTRC4AF]++;
-        }
-
-        fchr = 1;
+      if ((numnear < 26) || (tries > MAXTRIES)) {
+        MICSET(xchr, ychr, zchr, CH);
+        Count[CH]++;
         Count[pval]--;
+        fchr = 1;
       }
     }
   }
 
-  return (newact); /* 7 if nothing was done */
+  Nrejected += tries - 1;
+
+  return;
 }
 
 /***
@@ -932,15 +1114,12 @@ int extettr(int xpres, int ypres, int zpres, int etype, int *poreid) {
  *
  *     Returns:    Nothing
  *
- *    Calls:        edgecnt
+ *    Calls:        getporenv, randch, deferrand
  *
  *    Called by:    movegyp,movehem,moveanh,moveettr,movecas2,movecacl2
  ***/
 void extch(int xpres, int ypres, int zpres, int *poreid) {
-  int numnear, xchr, ychr, zchr, fchr, check, pval;
-  int tries;
-
-  fchr = tries = 0;
+  int pval;
 
   /***
    *    Locate CH at random location in pore space
@@ -956,6 +1135,35 @@ void extch(int xpres, int ypres, int zpres, int *poreid) {
   }
   pval = (int)(*poreid);
 
+  if (Deferrand) {
+    deferrand(RANDCH, pval, 0);
+  } else {
+    randch(pval);
+  }
+
+  return;
+}
+
+/***
+ *    randgyps
+ *
+ *    Place one pixel of GYPSUMS at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extgyps
+ *
+ *     Arguments:    Int id of saturated porosity to grow into
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extgyps, rundeferred
+ ***/
+void randgyps(int pval) {
+  int numnear, check, xchr, ychr, zchr;
+  int fchr, tries;
+
+  fchr = tries = 0;
+
   while (!fchr) {
 
     tries++;
@@ -975,31 +1183,28 @@ void extch(int xpres, int ypres, int zpres, int *poreid) {
 
     check = Mic[xchr][ychr][zchr];
 
-    /***
-     *    If location is porosity of the same type as that
-     *    found at the original reaction location,
-     *    locate the CH there.  We do this because the
-     *    growth is non-local
-     ***/
+    /* If location is porosity, locate the GYPSUMS there */
 
     if (check == pval) {
-
-      numnear = edgecnt(xchr, ychr, zchr, CH, DIFFCH, CH);
+      numnear = edgecnt(xchr, ychr, zchr, HEMIHYD, GYPSUMS, ANHYDRITE);
 
       /***
        *    Be sure that at least one neighboring pixel
-       *    is CH or diffusing CH
+       *    is Gypsum in some form, or that we have run
+       *    out of tries
        ***/
 
       if ((numnear < 26) || (tries > MAXTRIES)) {
-        Mic[xchr][ychr][zchr] = CH;
-        Count[CH]++;
+        MICSET(xchr, ychr, zchr, GYPSUMS);
+        Count[GYPSUMS]++;
         Count[pval]--;
         fchr = 1;
       }
     }
   }
 
+  Nrejected += tries - 1;
+
   return;
 }
 
@@ -1015,60 +1220,21 @@ void extch(int xpres, int ypres, int zpres, int *poreid) {
  *
  *     Returns:    Nothing
  *
- *    Calls:        moveone,edgecnt
+ *    Calls:        growlocal, randgyps, deferrand
  *
  *    Called by:    movehem,moveanh
  ***/
 void extgyps(int xpres, int ypres, int zpres, int *poreid) {
-  int multf, numnear, sump, xchr, ychr, zchr, check, fchr, i1, newact, pval;
-  int tries;
+  int fchr, pval;
 
   /***
-   *    First try 6 neighboring locations until
-   *        a) successful,
-   *        b) all 6 sites are tried and full, or
-   *        c) 500 tries are made
-   *
-   *    Note that 30300 is the product of the first six prime
-   *    numbers, indicating that all nearest neighbors have
-   *    been examined
+   *    First try the six neighboring locations, drawn at
+   *    most 500 times.  Saturated porosity of either kind
+   *    (POROSITY or CRACKP) is allowed because growth is
+   *    local (24 May 2004)
    ***/
 
-  fchr = 0;
-  sump = 1;
-  for (i1 = 1; ((i1 <= 500) && (!fchr) && (sump != 30030)); i1++) {
-
-    /* Choose a neighbor at random */
-
-    xchr = xpres;
-    ychr = ypres;
-    zchr = zpres;
-    newact = 0;
-    multf = moveone(&xchr, &ychr, &zchr, &newact, sump);
-
-    if (!newact) {
-      fprintf(stderr, "\nERROR in extgyps: Value of newact is %d", newact);
-      fflush(stdout);
-    }
-
-    check = Mic[xchr][ychr][zchr];
-
-    /***
-     *    If neighbor is porosity then locate
-     *    the GYPSUMS there. Either POROSITY or CRACKP
-     *    is allowed because growth is local
-     *    (24 May 2004)
-     ***/
-
-    if (check == POROSITY || check == CRACKP) {
-      Mic[xchr][ychr][zchr] = GYPSUMS;
-      Count[GYPSUMS]++;
-      Count[check]--;
-      fchr = 1;
-    } else {
-      sump *= multf;
-    }
-  }
+  fchr = growlocal(xpres, ypres, zpres, GYPSUMS, GROWPORE, 500);
 
   /***
    *    If no neighbor available, locate GYPSUMS
@@ -1080,7 +1246,6 @@ void extgyps(int xpres, int ypres, int zpres, int *poreid) {
    *    (24 May 2004)
    ***/
 
-  tries = 0;
   if (*poreid < 0) {
     if (Cyccnt > Crackcycle) {
       *poreid = getporenv(xpres, ypres, zpres);
@@ -1089,42 +1254,11 @@ void extgyps(int xpres, int ypres, int zpres, int *poreid) {
     }
   }
   pval = (int)(*poreid);
-  while (!fchr) {
-
-    tries++;
-
-    /* Generate a random location in the 3-D system */
-
-    xchr = (int)((float)Xsyssize * ran1(Seed));
-    ychr = (int)((float)Ysyssize * ran1(Seed));
-    zchr = (int)((float)Zsyssize * ran1(Seed));
-
-    if (xchr >= Xsyssize)
-      xchr = 0;
-    if (ychr >= Ysyssize)
-      ychr = 0;
-    if (zchr >= Zsyssize)
-      zchr = 0;
-
-    check = Mic[xchr][ychr][zchr];
-
-    /* If location is porosity, locate the GYPSUMS there */
-
-    if (check == pval) {
-      numnear = edgecnt(xchr, ychr, zchr, HEMIHYD, GYPSUMS, ANHYDRITE);
-
-      /***
-       *    Be sure that at least one neighboring pixel
-       *    is Gypsum in some form, or that we have run
-       *    out of tries
-       ***/
-
-      if ((numnear < 26) || (tries > MAXTRIES)) {
-        Mic[xchr][ychr][zchr] = GYPSUMS;
-        Count[GYPSUMS]++;
-        Count[pval]--;
-        fchr = 1;
-      }
+  if (!fchr) {
+    if (Deferrand) {
+      deferrand(RANDGYPS, pval, 0);
+    } else {
+      randgyps(pval);
     }
   }
 
@@ -1163,11 +1297,12 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
   p2diff = ran1(Seed);
 
   if ((nucprgyp >= pgen) || (finalstep)) {
+    Nnucleate++;
 
     /* Nucleate secondary gypsum at this spot */
 
     action = 0;
-    Mic[xcur][ycur][zcur] = GYPSUMS;
+    MICSET(xcur, ycur, zcur, GYPSUMS);
     Count[DIFFANH]--;
     Count[GYPSUMS]++;
     pexp = ran1(Seed);
@@ -1182,7 +1317,7 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
     xnew = xcur;
     ynew = ycur;
     znew = zcur;
-    sumin = 1;
+    sumin = 0;
     sumback = moveone(&xnew, &ynew, &znew, &action, sumin);
 
     if (!action) {
@@ -1200,7 +1335,7 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
 
     if ((check == GYPSUM) || (check == GYPSUMS) || (check == DIFFGYP)) {
 
-      Mic[xcur][ycur][zcur] = GYPSUMS;
+      MICSET(xcur, ycur, zcur, GYPSUMS);
 
       /***
        *    Decrement count of diffusing ANHYDRITE species
@@ -1232,7 +1367,7 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
       /* Convert diffusing gypsum to an ettringite pixel */
 
       ettrtype = 0;
-      Mic[xcur][ycur][zcur] = ETTR;
+      MICSET(xcur, ycur, zcur, ETTR);
       if (check == DIFFC4A) {
 
         /***
@@ -1241,7 +1376,7 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
          ***/
 
         ettrtype = 1;
-        Mic[xcur][ycur][zcur] = ETTRC4AF;
+        MICSET(xcur, ycur, zcur, ETTRC4AF);
       }
 
       action = 0;
@@ -1261,11 +1396,12 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
       pexp = ran1(Seed);
       nexp = 3;
       if (pexp <= 0.569) {
+        partlost(xnew, ynew, znew);
         if (ettrtype == 0) {
-          Mic[xnew][ynew][znew] = ETTR;
+          MICSET(xnew, ynew, znew, ETTR);
           Count[ETTR]++;
         } else {
-          Mic[xnew][ynew][znew] = ETTRC4AF;
+          MICSET(xnew, ynew, znew, ETTRC4AF);
           Count[ETTRC4AF]++;
         }
 
@@ -1279,15 +1415,15 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
          ***/
 
         if (check == C3A || check == OC3A) {
-          Mic[xnew][ynew][znew] = check;
+          MICSET(xnew, ynew, znew, check);
           Count[check]++;
         } else {
           if (ettrtype == 0) {
             Count[DIFFC3A]++;
-            Mic[xnew][ynew][znew] = DIFFC3A;
+            MICSET(xnew, ynew, znew, DIFFC3A);
           } else {
             Count[DIFFC4A]++;
-            Mic[xnew][ynew][znew] = DIFFC4A;
+            MICSET(xnew, ynew, znew, DIFFC4A);
           }
         }
       }
@@ -1366,7 +1502,7 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
      ***/
 
     if ((check == C4AF) && (p2diff < SOLIDC4AFGYP)) {
-      Mic[xcur][ycur][zcur] = ETTRC4AF;
+      MICSET(xcur, ycur, zcur, ETTRC4AF);
       Count[ETTRC4AF]++;
       Count[DIFFANH]--;
 
@@ -1384,7 +1520,8 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
       pexp = ran1(Seed);
       if (pexp <= 0.8174) {
 
-        Mic[xnew][ynew][znew] = ETTRC4AF;
+        partlost(xnew, ynew, znew);
+        MICSET(xnew, ynew, znew, ETTRC4AF);
         Count[ETTRC4AF]++;
         Count[C4AF]--;
         nexp--;
@@ -1412,7 +1549,7 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
          *    so it won't dissolve later
          ***/
 
-        Mic[xnew][ynew][znew] = C4AF;
+        MICSET(xnew, ynew, znew, C4AF);
       }
 
       /***
@@ -1494,8 +1631,8 @@ int moveanh(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
 
     if (check == POROSITY || check == CRACKP) {
 
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFANH;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFANH);
 
     } else {
 
@@ -1543,11 +1680,12 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
   p2diff = ran1(Seed);
 
   if ((nucprgyp >= pgen) || (finalstep)) {
+    Nnucleate++;
 
     /* Nucleate GYPSUMS at this location */
 
     action = 0;
-    Mic[xcur][ycur][zcur] = GYPSUMS;
+    MICSET(xcur, ycur, zcur, GYPSUMS);
     Count[DIFFHEM]--;
     Count[GYPSUMS]++;
 
@@ -1564,7 +1702,7 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
     xnew = xcur;
     ynew = ycur;
     znew = zcur;
-    sumin = 1;
+    sumin = 0;
     sumback = moveone(&xnew, &ynew, &znew, &action, sumin);
 
     if (!action) {
@@ -1582,7 +1720,7 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
 
     if ((check == GYPSUM) || (check == GYPSUMS) || (check == DIFFGYP)) {
 
-      Mic[xcur][ycur][zcur] = GYPSUMS;
+      MICSET(xcur, ycur, zcur, GYPSUMS);
 
       /***
        *    Decrement count of diffusing HEMIHYDRATE species
@@ -1614,10 +1752,10 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
       /* Convert diffusing gypsum to an ettringite pixel */
 
       ettrtype = 0;
-      Mic[xcur][ycur][zcur] = ETTR;
+      MICSET(xcur, ycur, zcur, ETTR);
       if (check == DIFFC4A) {
         ettrtype = 1;
-        Mic[xcur][ycur][zcur] = ETTRC4AF;
+        MICSET(xcur, ycur, zcur, ETTRC4AF);
       }
 
       action = 0;
@@ -1639,11 +1777,12 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
       pexp = ran1(Seed);
       if (pexp <= 0.5583) {
 
+        partlost(xnew, ynew, znew);
         if (ettrtype == 0) {
-          Mic[xnew][ynew][znew] = ETTR;
+          MICSET(xnew, ynew, znew, ETTR);
           Count[ETTR]++;
         } else {
-          Mic[xnew][ynew][znew] = ETTRC4AF;
+          MICSET(xnew, ynew, znew, ETTRC4AF);
           Count[ETTRC4AF]++;
         }
 
@@ -1657,15 +1796,15 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
          ***/
 
         if (check == C3A || check == OC3A) {
-          Mic[xnew][ynew][znew] = check;
+          MICSET(xnew, ynew, znew, check);
           Count[check]++;
         } else {
           if (ettrtype == 0) {
             Count[DIFFC3A]++;
-            Mic[xnew][ynew][znew] = DIFFC3A;
+            MICSET(xnew, ynew, znew, DIFFC3A);
           } else {
             Count[DIFFC4A]++;
-            Mic[xnew][ynew][znew] = DIFFC4A;
+            MICSET(xnew, ynew, znew, DIFFC4A);
           }
         }
       }
@@ -1742,7 +1881,7 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
      ***/
 
     if ((check == C4AF) && (p2diff < SOLIDC4AFGYP)) {
-      Mic[xcur][ycur][zcur] = ETTRC4AF;
+      MICSET(xcur, ycur, zcur, ETTRC4AF);
       Count[ETTRC4AF]++;
       Count[DIFFHEM]--;
 
@@ -1759,7 +1898,8 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
       nexp = 3;
       pexp = ran1(Seed);
       if (pexp <= 0.802) {
-        Mic[xnew][ynew][znew] = ETTRC4AF;
+        partlost(xnew, ynew, znew);
+        MICSET(xnew, ynew, znew, ETTRC4AF);
         Count[ETTRC4AF]++;
         Count[C4AF]--;
         nexp--;
@@ -1783,7 +1923,7 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
          *    it won't dissolve later
          ***/
 
-        Mic[xnew][ynew][znew] = C4AF;
+        MICSET(xnew, ynew, znew, C4AF);
       }
 
       /***
@@ -1867,8 +2007,8 @@ int movehem(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
      ***/
 
     if (check == POROSITY || check == CRACKP) {
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFHEM;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFHEM);
     } else {
       /***
        *    Indicate that diffusing HEMIHYDRATE species
@@ -1909,12 +2049,13 @@ int moveso4(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
   p2diff = ran1(Seed);
 
   if ((nucprgyp >= pgen) || (finalstep)) {
+    Nnucleate++;
 
     /* Nucleate GYPSUMS at this location */
 
     Nucsulf2gyps++;
     action = 0;
-    Mic[xcur][ycur][zcur] = GYPSUMS;
+    MICSET(xcur, ycur, zcur, GYPSUMS);
     Count[DIFFSO4]--;
     Count[GYPSUMS]++;
 
@@ -1935,7 +2076,7 @@ int moveso4(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
     xnew = xcur;
     ynew = ycur;
     znew = zcur;
-    sumin = 1;
+    sumin = 0;
     sumback = moveone(&xnew, &ynew, &znew, &action, sumin);
 
     if (!action) {
@@ -1952,8 +2093,8 @@ int moveso4(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
        ***/
 
       action = 0;
-      Mic[xnew][ynew][znew] = GYPSUMS;
-      Mic[xcur][ycur][zcur] = GYPSUMS;
+      MICSET(xnew, ynew, znew, GYPSUMS);
+      MICSET(xcur, ycur, zcur, GYPSUMS);
 
       /***
        *    Still need 0.2435 pixels of GYPSUMS
@@ -1977,8 +2118,8 @@ int moveso4(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
      ***/
 
     if (check == POROSITY || check == CRACKP) {
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFSO4;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFSO4);
     } else {
 
       /***
@@ -1994,97 +2135,28 @@ int moveso4(int xcur, int ycur, int zcur, int finalstep, float nucprgyp) {
 }
 
 /***
- *    extfriedel
- *
- *     Add extra Friedel's salt when CaCl2 reacts with
- *     C3A or C4AF at location (xpres,ypres,zpres)
+ *    randfriedel
  *
- *     Arguments:    Int coordinates of present location xpres,ypres,zpres
+ *    Place one pixel of FRIEDEL at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extfriedel
  *
- *     Returns:    Int return flag indicating action taken
- *                     (reaction or diffusion/no movement)
+ *     Arguments:    Int id of saturated porosity to grow into
  *
- *    Calls:        moveone, edgecnt
+ *     Returns:    Nothing
  *
- *    Called by:    movecacl2, movec3a
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extfriedel, rundeferred
  ***/
-int extfriedel(int xpres, int ypres, int zpres, int *poreid) {
-  int multf, numnear, sump, xchr, ychr, zchr, check, fchr, i1, newact, pval;
-  int tries;
-
-  /***
-   *    First try 6 neighboring locations until
-   *        a) successful,
-   *        b) all 6 sites are tried and full, or
-   *        c) 500 tries are made
-   *
-   *    Note that 30300 is the product of the first
-   *    six prime numbers, indicating that all six
-   *    nearest neighbors have been tried.
-   ***/
-
-  fchr = 0;
-  sump = 1;
-
-  for (i1 = 1; ((i1 <= 500) && (!fchr) && (sump != 30030)); i1++) {
-
-    /* Choose a neighbor at random */
-
-    xchr = xpres;
-    ychr = ypres;
-    zchr = zpres;
-    newact = 0;
-    multf = moveone(&xchr, &ychr, &zchr, &newact, sump);
-
-    if (!newact) {
-      fprintf(stderr, "\nERROR in extfriedel: Value of newact is %d", newact);
-      fflush(stderr);
-    }
-
-    check = Mic[xchr][ychr][zchr];
-
-    /***
-     *    Because growth is local, if neighbor is saturated porosity
-     *    of any kind (POROSITY or CRACKP) then locate the
-     *    Friedel's salt there
-     *    (24 May 2004)
-     ***/
-
-    if (check == POROSITY || check == CRACKP) {
-      Mic[xchr][ychr][zchr] = FRIEDEL;
-      Count[FRIEDEL]++;
-      Count[check]--;
-      fchr = 1;
-    } else {
-      sump *= multf;
-    }
-  }
-
-  /***
-   *    If no neighbor available, locate FRIEDEL at
-   *    random location in pore space in contact with
-   *    at least one other FRIEDEL, or place it
-   *    anyway if MAXTRIES attempts have been made
-   *    Here, because the growth is non-local, we
-   *    allow growth only into the same kind of saturated
-   *    porosity as that found at the original reaction site
-   *    (24 May 2004)
-   ***/
+void randfriedel(int pval) {
+  int numnear, check, xchr, ychr, zchr;
+  int fchr, tries;
 
-  tries = 0;
-  if (*poreid < 0) {
-    if (Cyccnt > Crackcycle) {
-      *poreid = getporenv(xpres, ypres, zpres);
-    } else {
-      *poreid = (int)(POROSITY);
-    }
-  }
-  pval = (int)(*poreid);
+  fchr = tries = 0;
 
   while (!fchr) {
 
     tries++;
-    newact = 7; /* Signifies nothing happened yet */
 
     /* Generate a random location in the 3-D system */
 
@@ -2112,7 +2184,7 @@ int extfriedel(int xpres, int ypres, int zpres, int *poreid) {
        ***/
 
       if ((numnear < 26) || (tries > MAXTRIES)) {
-        Mic[xchr][ychr][zchr] = FRIEDEL;
+        MICSET(xchr, ychr, zchr, FRIEDEL);
         Count[FRIEDEL]++;
         Count[pval]--;
         fchr = 1;
@@ -2120,90 +2192,49 @@ int extfriedel(int xpres, int ypres, int zpres, int *poreid) {
     }
   }
 
-  return (newact); /* 7 if no action was taken */
+  Nrejected += tries - 1;
+
+  return;
 }
 
 /***
- *    extstrat
+ *    extfriedel
  *
- *     Add extra stratlingite when AS reacts with
- *     CH at location (xpres,ypres,zpres), or when
- *     diffusing CAS2 reacts with aluminates
+ *     Add extra Friedel's salt when CaCl2 reacts with
+ *     C3A or C4AF at location (xpres,ypres,zpres)
  *
  *     Arguments:    Int coordinates of present location xpres,ypres,zpres
  *
  *     Returns:    Int return flag indicating action taken
  *                     (reaction or diffusion/no movement)
  *
- *    Calls:        moveone, edgecnt
+ *    Calls:        growlocal, randfriedel, deferrand
  *
- *    Called by:    moveas, movech, movecas2
+ *    Called by:    movecacl2, movec3a
  ***/
-int extstrat(int xpres, int ypres, int zpres, int *poreid) {
-  int multf, numnear, sump, xchr, ychr, zchr, check, fchr, i1, newact, pval;
-  int tries;
+int extfriedel(int xpres, int ypres, int zpres, int *poreid) {
+  int fchr, newact, pval;
 
   /***
-   *    First try 6 neighboring locations until
-   *        a) successful,
-   *        b) all 6 sites are tried and full, or
-   *        c) 500 tries are made
-   *
-   *    Note that 30300 is the product of the first
-   *    six prime numbers, indicating that all six
-   *    nearest neighbors have been tried
+   *    First try the six neighboring locations, drawn at
+   *    most 500 times.  Saturated porosity of either kind
+   *    (POROSITY or CRACKP) is allowed because growth is
+   *    local (24 May 2004)
    ***/
 
-  fchr = 0;
-  sump = 1;
-
-  for (i1 = 1; ((i1 <= 500) && (!fchr) && (sump != 30030)); i1++) {
-
-    /* Choose a neighbor at random */
-
-    xchr = xpres;
-    ychr = ypres;
-    zchr = zpres;
-    newact = 0;
-    multf = moveone(&xchr, &ychr, &zchr, &newact, sump);
-
-    if (!newact) {
-      fprintf(stderr, "\nERROR in extstrat: Value of newact is %d", newact);
-      fflush(stderr);
-    }
-
-    check = Mic[xchr][ychr][zchr];
-
-    /***
-     *    If neighbor is porosity then locate
-     *    the stratlingite there.  Because growth is
-     *    local, we allow growth into any kind of
-     *    saturated porosity (POROSITY or CRACKP)
-     *    (24 May 2004)
-     ***/
-
-    if (check == POROSITY || check == CRACKP) {
-      Mic[xchr][ychr][zchr] = STRAT;
-      Count[STRAT]++;
-      Count[check]--;
-      fchr = 1;
-    } else {
-      sump *= multf;
-    }
-  }
+  fchr = growlocal(xpres, ypres, zpres, FRIEDEL, GROWPORE, 500);
 
   /***
-   *    If no neighbor available, locate STRAT at
+   *    If no neighbor available, locate FRIEDEL at
    *    random location in pore space in contact with
-   *    at least one other STRAT, or place it anyway
-   *    if MAXTRIES attempts have been made.  Because
-   *    now growth is non-local, allow growth only into
-   *    saturated porosity of the same type as that found
-   *    at the original reaction site
+   *    at least one other FRIEDEL, or place it
+   *    anyway if MAXTRIES attempts have been made
+   *    Here, because the growth is non-local, we
+   *    allow growth only into the same kind of saturated
+   *    porosity as that found at the original reaction site
    *    (24 May 2004)
    ***/
 
-  tries = 0;
   if (*poreid < 0) {
     if (Cyccnt > Crackcycle) {
       *poreid = getporenv(xpres, ypres, zpres);
@@ -2213,10 +2244,41 @@ int extstrat(int xpres, int ypres, int zpres, int *poreid) {
   }
   pval = (int)(*poreid);
 
+  if (!fchr) {
+    newact = 7;
+    if (Deferrand) {
+      deferrand(RANDFRIEDEL, pval, 0);
+    } else {
+      randfriedel(pval);
+    }
+  }
+
+  return (newact); /* 7 if no action was taken */
+}
+
+/***
+ *    randstrat
+ *
+ *    Place one pixel of STRAT at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extstrat
+ *
+ *     Arguments:    Int id of saturated porosity to grow into
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extstrat, rundeferred
+ ***/
+void randstrat(int pval) {
+  int numnear, check, xchr, ychr, zchr;
+  int fchr, tries;
+
+  fchr = tries = 0;
+
   while (!fchr) {
 
     tries++;
-    newact = 7; /* Indicates nothing happened yet */
 
     /* Generate a random location in the 3-D system */
 
@@ -2244,7 +2306,7 @@ int extstrat(int xpres, int ypres, int zpres, int *poreid) {
        ***/
 
       if ((numnear < 26) || (tries > MAXTRIES)) {
-        Mic[xchr][ychr][zchr] = STRAT;
+        MICSET(xchr, ychr, zchr, STRAT);
         Count[STRAT]++;
         Count[pval]--;
         fchr = 1;
@@ -2252,6 +2314,68 @@ int extstrat(int xpres, int ypres, int zpres, int *poreid) {
     }
   }
 
+  Nrejected += tries - 1;
+
+  return;
+}
+
+/***
+ *    extstrat
+ *
+ *     Add extra stratlingite when AS reacts with
+ *     CH at location (xpres,ypres,zpres), or when
+ *     diffusing CAS2 reacts with aluminates
+ *
+ *     Arguments:    Int coordinates of present location xpres,ypres,zpres
+ *
+ *     Returns:    Int return flag indicating action taken
+ *                     (reaction or diffusion/no movement)
+ *
+ *    Calls:        growlocal, randstrat, deferrand
+ *
+ *    Called by:    moveas, movech, movecas2
+ ***/
+int extstrat(int xpres, int ypres, int zpres, int *poreid) {
+  int fchr, newact, pval;
+
+  /***
+   *    First try the six neighboring locations, drawn at
+   *    most 500 times.  Saturated porosity of either kind
+   *    (POROSITY or CRACKP) is allowed because growth is
+   *    local (24 May 2004)
+   ***/
+
+  fchr = growlocal(xpres, ypres, zpres, STRAT, GROWPORE, 500);
+
+  /***
+   *    If no neighbor available, locate STRAT at
+   *    random location in pore space in contact with
+   *    at least one other STRAT, or place it anyway
+   *    if MAXTRIES attempts have been made.  Because
+   *    now growth is non-local, allow growth only into
+   *    saturated porosity of the same type as that found
+   *    at the original reaction site
+   *    (24 May 2004)
+   ***/
+
+  if (*poreid < 0) {
+    if (Cyccnt > Crackcycle) {
+      *poreid = getporenv(xpres, ypres, zpres);
+    } else {
+      *poreid = (int)(POROSITY);
+    }
+  }
+  pval = (int)(*poreid);
+
+  if (!fchr) {
+    newact = 7;
+    if (Deferrand) {
+      deferrand(RANDSTRAT, pval, 0);
+    } else {
+      randstrat(pval);
+    }
+  }
+
   return (newact); /* 7 if no action was taken */
 }
 
@@ -2280,7 +2404,7 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
   int xexp, yexp, zexp, newact, sumold, sumgarb, ettrtype;
   float pexp, pext, p2diff;
 
-  sumold = 1;
+  sumold = 0;
   poreid = -1;
 
   /***
@@ -2323,7 +2447,7 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
 
       Count[ABSGYP]++;
       Count[DIFFGYP]--;
-      Mic[xcur][ycur][zcur] = ABSGYP;
+      MICSET(xcur, ycur, zcur, ABSGYP);
       action = 0;
     }
 
@@ -2343,7 +2467,7 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
     /* Convert diffusing gypsum to an ettringite pixel */
 
     ettrtype = 0;
-    Mic[xcur][ycur][zcur] = ETTR;
+    MICSET(xcur, ycur, zcur, ETTR);
 
     /***
      *    Convert to iron-rich stable form if encountering
@@ -2352,7 +2476,7 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
 
     if (check == DIFFC4A) {
       ettrtype = 1;
-      Mic[xcur][ycur][zcur] = ETTRC4AF;
+      MICSET(xcur, ycur, zcur, ETTRC4AF);
     }
 
     action = 0;
@@ -2372,11 +2496,12 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
     nexp = 2;
     pexp = ran1(Seed);
     if (pexp <= 0.40) {
+      partlost(xnew, ynew, znew);
       if (ettrtype == 0) {
-        Mic[xnew][ynew][znew] = ETTR;
+        MICSET(xnew, ynew, znew, ETTR);
         Count[ETTR]++;
       } else {
-        Mic[xnew][ynew][znew] = ETTRC4AF;
+        MICSET(xnew, ynew, znew, ETTRC4AF);
         Count[ETTRC4AF]++;
       }
       nexp--;
@@ -2390,17 +2515,17 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
 
       if (check == C3A || check == OC3A) {
 
-        Mic[xnew][ynew][znew] = check;
+        MICSET(xnew, ynew, znew, check);
         Count[check]++;
 
       } else {
 
         if (ettrtype == 0) {
           Count[DIFFC3A]++;
-          Mic[xnew][ynew][znew] = DIFFC3A;
+          MICSET(xnew, ynew, znew, DIFFC3A);
         } else {
           Count[DIFFC4A]++;
-          Mic[xnew][ynew][znew] = DIFFC4A;
+          MICSET(xnew, ynew, znew, DIFFC4A);
         }
       }
     }
@@ -2479,7 +2604,7 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
 
   if ((check == C4AF) && (p2diff < SOLIDC4AFGYP)) {
 
-    Mic[xcur][ycur][zcur] = ETTRC4AF;
+    MICSET(xcur, ycur, zcur, ETTRC4AF);
     Count[ETTRC4AF]++;
     Count[DIFFGYP]--;
 
@@ -2497,7 +2622,8 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
     pexp = ran1(Seed);
     if (pexp <= 0.575) {
 
-      Mic[xnew][ynew][znew] = ETTRC4AF;
+      partlost(xnew, ynew, znew);
+      MICSET(xnew, ynew, znew, ETTRC4AF);
       Count[ETTRC4AF]++;
       Count[C4AF]--;
       nexp--;
@@ -2523,7 +2649,7 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
        *    it won't dissolve later
        ***/
 
-      Mic[xnew][ynew][znew] = C4AF;
+      MICSET(xnew, ynew, znew, C4AF);
     }
 
     /***
@@ -2599,7 +2725,7 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
     action = 0;
     Count[DIFFGYP]--;
     Count[GYPSUM]++;
-    Mic[xcur][ycur][zcur] = GYPSUM;
+    MICSET(xcur, ycur, zcur, GYPSUM);
   }
 
   if (action != 0) {
@@ -2613,8 +2739,8 @@ int movegyp(int xcur, int ycur, int zcur, int finalstep) {
      ****/
 
     if (check == POROSITY || check == CRACKP) {
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFGYP;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFGYP);
     } else {
 
       /***
@@ -2654,7 +2780,7 @@ int movecacl2(int xcur, int ycur, int zcur, int finalstep) {
   int xexp, yexp, zexp, newact, sumold, sumgarb, keep;
   float pexp, pext;
 
-  sumold = 1;
+  sumold = 0;
   poreid = -1;
   keep = 0;
 
@@ -2696,7 +2822,8 @@ int movecacl2(int xcur, int ycur, int zcur, int finalstep) {
     /* Convert diffusing C3A or C3A to a Friedel's salt pixel */
 
     action = 0;
-    Mic[xnew][ynew][znew] = FRIEDEL;
+    partlost(xnew, ynew, znew);
+    MICSET(xnew, ynew, znew, FRIEDEL);
     Count[FRIEDEL]++;
     Count[check]--;
 
@@ -2713,7 +2840,7 @@ int movecacl2(int xcur, int ycur, int zcur, int finalstep) {
     nexp = 2;
     pexp = ran1(Seed);
     if (pexp <= 0.5793) {
-      Mic[xcur][ycur][zcur] = FRIEDEL;
+      MICSET(xcur, ycur, zcur, FRIEDEL);
       Count[FRIEDEL]++;
       Count[DIFFCACL2]--;
       nexp--;
@@ -2789,7 +2916,8 @@ int movecacl2(int xcur, int ycur, int zcur, int finalstep) {
 
   } else if (check == C4AF) {
 
-    Mic[xnew][ynew][znew] = FRIEDEL;
+    partlost(xnew, ynew, znew);
+    MICSET(xnew, ynew, znew, FRIEDEL);
     Count[FRIEDEL]++;
     Count[C4AF]--;
 
@@ -2810,7 +2938,7 @@ int movecacl2(int xcur, int ycur, int zcur, int finalstep) {
     pexp = ran1(Seed);
     if (pexp <= 0.4033) {
 
-      Mic[xcur][ycur][zcur] = FRIEDEL;
+      MICSET(xcur, ycur, zcur, FRIEDEL);
       Count[FRIEDEL]++;
       Count[DIFFCACL2]--;
       nexp--;
@@ -2906,7 +3034,7 @@ int movecacl2(int xcur, int ycur, int zcur, int finalstep) {
     action = 0;
     Count[DIFFCACL2]--;
     Count[CACL2]++;
-    Mic[xcur][ycur][zcur] = CACL2;
+    MICSET(xcur, ycur, zcur, CACL2);
   }
 
   if (action != 0) {
@@ -2920,8 +3048,8 @@ int movecacl2(int xcur, int ycur, int zcur, int finalstep) {
      ***/
 
     if (check == POROSITY || check == CRACKP) {
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFCACL2;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFCACL2);
     } else {
 
       /***
@@ -2964,7 +3092,7 @@ int movecas2(int xcur, int ycur, int zcur, int finalstep) {
   int xexp, yexp, zexp, newact, sumold, sumgarb, keep;
   float pexp, pext;
 
-  sumold = 1;
+  sumold = 0;
   poreid = -1;
   keep = 0;
 
@@ -3006,7 +3134,7 @@ int movecas2(int xcur, int ycur, int zcur, int finalstep) {
     /* Convert diffusing CAS2 to a stratlingite pixel */
 
     action = 0;
-    Mic[xcur][ycur][zcur] = STRAT;
+    MICSET(xcur, ycur, zcur, STRAT);
     Count[STRAT]++;
     Count[DIFFCAS2]--;
 
@@ -3026,7 +3154,8 @@ int movecas2(int xcur, int ycur, int zcur, int finalstep) {
     nexp = 3;
     pexp = ran1(Seed);
     if (pexp <= 0.886) {
-      Mic[xnew][ynew][znew] = STRAT;
+      partlost(xnew, ynew, znew);
+      MICSET(xnew, ynew, znew, STRAT);
       Count[STRAT]++;
       Count[check]--;
       nexp--;
@@ -3109,7 +3238,8 @@ int movecas2(int xcur, int ycur, int zcur, int finalstep) {
 
   } else if (check == C4AF) {
 
-    Mic[xnew][ynew][znew] = STRAT;
+    partlost(xnew, ynew, znew);
+    MICSET(xnew, ynew, znew, STRAT);
     Count[STRAT]++;
     Count[C4AF]--;
 
@@ -3129,7 +3259,7 @@ int movecas2(int xcur, int ycur, int zcur, int finalstep) {
     pexp = ran1(Seed);
     if (pexp <= 0.786) {
 
-      Mic[xcur][ycur][zcur] = STRAT;
+      MICSET(xcur, ycur, zcur, STRAT);
       Count[STRAT]++;
       Count[DIFFCAS2]--;
       nexp--;
@@ -3246,7 +3376,7 @@ int movecas2(int xcur, int ycur, int zcur, int finalstep) {
     action = 0;
     Count[DIFFCAS2]--;
     Count[CAS2]++;
-    Mic[xcur][ycur][zcur] = CAS2;
+    MICSET(xcur, ycur, zcur, CAS2);
   }
 
   if (action != 0) {
@@ -3260,8 +3390,8 @@ int movecas2(int xcur, int ycur, int zcur, int finalstep) {
      ***/
 
     if (check == POROSITY || check == CRACKP) {
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFCAS2;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFCAS2);
     } else {
 
       /***
@@ -3304,7 +3434,7 @@ int moveas(int xcur, int ycur, int zcur, int finalstep) {
   int xexp, yexp, zexp, newact, sumold, sumgarb, keep;
   float pexp;
 
-  sumold = 1;
+  sumold = 0;
   poreid = -1;
   keep = 0;
 
@@ -3345,7 +3475,7 @@ int moveas(int xcur, int ycur, int zcur, int finalstep) {
     /* Convert diffusing CH or solid CH to a stratlingite pixel */
 
     action = 0;
-    Mic[xnew][ynew][znew] = STRAT;
+    MICSET(xnew, ynew, znew, STRAT);
     Count[STRAT]++;
     Count[check]--;
 
@@ -3363,7 +3493,7 @@ int moveas(int xcur, int ycur, int zcur, int finalstep) {
     nexp = 2;
     pexp = ran1(Seed);
     if (pexp <= 0.7538) {
-      Mic[xcur][ycur][zcur] = STRAT;
+      MICSET(xcur, ycur, zcur, STRAT);
       Count[STRAT]++;
       Count[DIFFAS]--;
       nexp--;
@@ -3446,7 +3576,7 @@ int moveas(int xcur, int ycur, int zcur, int finalstep) {
     action = 0;
     Count[DIFFAS]--;
     Count[ASG]++;
-    Mic[xcur][ycur][zcur] = ASG;
+    MICSET(xcur, ycur, zcur, ASG);
   }
 
   if (action != 0) {
@@ -3460,8 +3590,8 @@ int moveas(int xcur, int ycur, int zcur, int finalstep) {
      ***/
 
     if (check == POROSITY || check == CRACKP) {
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFAS;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFAS);
     } else {
 
       /***
@@ -3504,7 +3634,7 @@ int movecaco3(int xcur, int ycur, int zcur, int finalstep) {
   int xexp, yexp, zexp, newact, sumold, sumgarb, keep;
   float pexp;
 
-  sumold = 1;
+  sumold = 0;
   poreid = -1;
   keep = 0;
 
@@ -3550,10 +3680,10 @@ int movecaco3(int xcur, int ycur, int zcur, int finalstep) {
     action = 0;
     pexp = ran1(Seed);
     if (pexp <= 0.479192) {
-      Mic[xnew][ynew][znew] = AFMC;
+      MICSET(xnew, ynew, znew, AFMC);
       Count[AFMC]++;
     } else {
-      Mic[xnew][ynew][znew] = ETTR;
+      MICSET(xnew, ynew, znew, ETTR);
       Count[ETTR]++;
     }
 
@@ -3569,7 +3699,7 @@ int movecaco3(int xcur, int ycur, int zcur, int finalstep) {
 
     pexp = ran1(Seed);
     if (pexp <= 0.078658) {
-      Mic[xcur][ycur][zcur] = AFMC;
+      MICSET(xcur, ycur, zcur, AFMC);
       Count[AFMC]++;
       Count[DIFFCACO3]--;
     } else {
@@ -3607,7 +3737,7 @@ int movecaco3(int xcur, int ycur, int zcur, int finalstep) {
     action = 0;
     Count[DIFFCACO3]--;
     Count[CACO3]++;
-    Mic[xcur][ycur][zcur] = CACO3;
+    MICSET(xcur, ycur, zcur, CACO3);
   }
 
   if (action != 0) {
@@ -3621,8 +3751,8 @@ int movecaco3(int xcur, int ycur, int zcur, int finalstep) {
      ***/
 
     if (check == POROSITY || check == CRACKP) {
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFCACO3;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFCACO3);
     } else {
 
       /***
@@ -3641,89 +3771,24 @@ int movecaco3(int xcur, int ycur, int zcur, int finalstep) {
 }
 
 /***
- *    extafm
+ *    randafm
  *
- *     Add extra AFm phase when diffusing ettringite
- *     reacts with C3A (diffusing or solid) at location
- *     (xpres, ypres, zpres)
+ *    Place one pixel of AFM at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extafm
  *
- *     Arguments:    Int coordinates of present location
- *                     xpres,ypres,zpres
+ *     Arguments:    Int id of saturated porosity to grow into
  *
  *     Returns:    Nothing
  *
- *    Calls:        moveone, edgecnt
- *
- *    Called by:    moveettr, movec3a
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extafm, rundeferred
  ***/
-void extafm(int xpres, int ypres, int zpres, int *poreid) {
-  int check, sump, xchr, ychr, zchr, fchr, i1, newact, numnear, pval;
-  int tries;
-
-  /***
-   *    First try 6 neighboring locations until
-   *        a) successful,
-   *        b) all 6 sites are tried, or
-   *        c) 100 tries are made
-   *
-   *    Note that 30030 is the product of the first six
-   *    prime numbers, indicating that all six nearest
-   *    neighbors have been tried
-   ***/
-
-  fchr = 0;
-  sump = 1;
-
-  for (i1 = 1; ((i1 <= 100) && (!fchr) && (sump != 30030)); i1++) {
-
-    /* Determine location of neighbor (using periodic boundaries) */
-
-    xchr = xpres;
-    ychr = ypres;
-    zchr = zpres;
-    newact = 0;
-    sump *= moveone(&xchr, &ychr, &zchr, &newact, sump);
-
-    if (!newact) {
-      fprintf(stderr, "\nERROR in extafm: Value of newact is %d", newact);
-      fflush(stderr);
-    }
-
-    check = Mic[xchr][ychr][zchr];
-
-    /***
-     *    If neighbor is porosity, locate the AFm phase there.
-     *    Porosity can be of any saturated kind because the growth
-     *    is local
-     *    (24 May 2004)
-     ***/
-
-    if (check == POROSITY || check == CRACKP) {
-      Mic[xchr][ychr][zchr] = AFM;
-      Count[AFM]++;
-      Count[check]--;
-      fchr = 1;
-    }
-  }
-
-  /***
-   *    If no neighbor available, locate AFm phase at random
-   *    location in pore space.  Here because the growth is
-   *    non-local, we allow it to occur only into the same kind
-   *    of saturated porosity as that found at the original
-   *    reaction site
-   *    (24 May 2004)
-   ***/
+void randafm(int pval) {
+  int numnear, check, xchr, ychr, zchr;
+  int fchr, tries;
 
-  tries = 0;
-  if (*poreid < 0) {
-    if (Cyccnt > Crackcycle) {
-      *poreid = getporenv(xpres, ypres, zpres);
-    } else {
-      *poreid = (int)(POROSITY);
-    }
-  }
-  pval = (int)(*poreid);
+  fchr = tries = 0;
 
   while (!fchr) {
 
@@ -3757,7 +3822,7 @@ void extafm(int xpres, int ypres, int zpres, int *poreid) {
        ***/
 
       if ((numnear < 26) || (tries > MAXTRIES)) {
-        Mic[xchr][ychr][zchr] = AFM;
+        MICSET(xchr, ychr, zchr, AFM);
         Count[AFM]++;
         Count[pval]--;
         fchr = 1;
@@ -3765,6 +3830,65 @@ void extafm(int xpres, int ypres, int zpres, int *poreid) {
     }
   }
 
+  Nrejected += tries - 1;
+
+  return;
+}
+
+/***
+ *    extafm
+ *
+ *     Add extra AFm phase when diffusing ettringite
+ *     reacts with C3A (diffusing or solid) at location
+ *     (xpres, ypres, zpres)
+ *
+ *     Arguments:    Int coordinates of present location
+ *                     xpres,ypres,zpres
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        growlocal, randafm, deferrand
+ *
+ *    Called by:    moveettr, movec3a
+ ***/
+void extafm(int xpres, int ypres, int zpres, int *poreid) {
+  int fchr, pval;
+
+  /***
+   *    First try the six neighboring locations, drawn at
+   *    most 100 times.  Saturated porosity of either kind
+   *    (POROSITY or CRACKP) is allowed because growth is
+   *    local (24 May 2004)
+   ***/
+
+  fchr = growlocal(xpres, ypres, zpres, AFM, GROWPORE, 100);
+
+  /***
+   *    If no neighbor available, locate AFm phase at random
+   *    location in pore space.  Here because the growth is
+   *    non-local, we allow it to occur only into the same kind
+   *    of saturated porosity as that found at the original
+   *    reaction site
+   *    (24 May 2004)
+   ***/
+
+  if (*poreid < 0) {
+    if (Cyccnt > Crackcycle) {
+      *poreid = getporenv(xpres, ypres, zpres);
+    } else {
+      *poreid = (int)(POROSITY);
+    }
+  }
+  pval = (int)(*poreid);
+
+  if (!fchr) {
+    if (Deferrand) {
+      deferrand(RANDAFM, pval, 0);
+    } else {
+      randafm(pval);
+    }
+  }
+
   return;
 }
 
@@ -3812,7 +3936,7 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
   ynew = ycur;
   znew = zcur;
   action = 0;
-  sumold = 1;
+  sumold = 0;
   sumgarb = moveone(&xnew, &ynew, &znew, &action, sumold);
 
   if (!action) {
@@ -3832,7 +3956,7 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
 
     /* Convert diffusing ettringite to AFM phase */
 
-    Mic[xcur][ycur][zcur] = AFM;
+    MICSET(xcur, ycur, zcur, AFM);
     Count[AFM]++;
     Count[DIFFETTR]--;
 
@@ -3847,7 +3971,8 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
 
     pexp = ran1(Seed);
     if (pexp <= 0.278) {
-      Mic[xnew][ynew][znew] = AFM;
+      partlost(xnew, ynew, znew);
+      MICSET(xnew, ynew, znew, AFM);
       Count[AFM]++;
       Count[C4AF]--;
 
@@ -3874,7 +3999,8 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
       }
     } else if (pexp <= 0.348) {
 
-      Mic[xnew][ynew][znew] = FH3;
+      partlost(xnew, ynew, znew);
+      MICSET(xnew, ynew, znew, FH3);
       Count[FH3]++;
       Count[C4AF]--;
     }
@@ -3894,7 +4020,7 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
     /* Convert diffusing ettringite to AFM phase */
 
     action = 0;
-    Mic[xcur][ycur][zcur] = AFM;
+    MICSET(xcur, ycur, zcur, AFM);
     Count[DIFFETTR]--;
     Count[AFM]++;
     Count[check]--;
@@ -3908,7 +4034,8 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
 
     pexp = ran1(Seed);
     if (pexp <= 0.2424) {
-      Mic[xnew][ynew][znew] = AFM;
+      partlost(xnew, ynew, znew);
+      MICSET(xnew, ynew, znew, AFM);
       Count[AFM]++;
       pafm = (-0.1);
     } else {
@@ -3919,10 +4046,10 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
        ***/
 
       if (check == C3A || check == OC3A) {
-        Mic[xnew][ynew][znew] = check;
+        MICSET(xnew, ynew, znew, check);
         Count[check]++;
       } else {
-        Mic[xnew][ynew][znew] = DIFFC3A;
+        MICSET(xnew, ynew, znew, DIFFC3A);
         Count[DIFFC3A]++;
       }
 
@@ -3946,7 +4073,7 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
 
     pgrow = ran1(Seed);
     if (pgrow <= ETTRGROW) {
-      Mic[xcur][ycur][zcur] = ETTR;
+      MICSET(xcur, ycur, zcur, ETTR);
       Count[ETTR]++;
       Count[DIFFETTR]--;
       action = 0;
@@ -3960,7 +4087,7 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
 
   if ((action != 0) && (finalstep)) {
     action = 0;
-    Mic[xcur][ycur][zcur] = ETTR;
+    MICSET(xcur, ycur, zcur, ETTR);
     Count[DIFFETTR]--;
     Count[ETTR]++;
   }
@@ -3976,8 +4103,8 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
      ***/
 
     if (check == POROSITY || check == CRACKP) {
-      Mic[xcur][ycur][zcur] = check;
-      Mic[xnew][ynew][znew] = DIFFETTR;
+      MICSET(xcur, ycur, zcur, check);
+      MICSET(xnew, ynew, znew, DIFFETTR);
     } else {
 
       /***
@@ -3993,89 +4120,24 @@ int moveettr(int xcur, int ycur, int zcur, int finalstep) {
 }
 
 /***
- *    extpozz
+ *    randpozz
  *
- *     Add extra pozzolanic CSH when CH reacts at
- *     pozzolanic surface (e.g. silica fume) at location
- *     (xpres, ypres, zpres)
+ *    Place one pixel of POZZCSH at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extpozz
  *
- *     Arguments:    Int coordinates of present location
- *                     xpres,ypres,zpres
+ *     Arguments:    Int id of saturated porosity to grow into
  *
  *     Returns:    Nothing
  *
- *    Calls:        moveone, edgecnt
- *
- *    Called by:    movech
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extpozz, rundeferred
  ***/
-void extpozz(int xpres, int ypres, int zpres, int *poreid) {
-  int check, sump, xchr, ychr, zchr, fchr, i1, newact, numnear1, numnear2, pval;
-  int tries;
-
-  /***
-   *    First try 6 neighboring locations until
-   *        a) successful,
-   *        b) all 6 sites are tried, or
-   *        c) 100 tries are made
-   *
-   *    Note that 30030 is the product of the first six
-   *    prime numbers, indicating that all six nearest
-   *    neighbors have been tried
-   ***/
-
-  fchr = 0;
-  sump = 1;
-
-  for (i1 = 1; ((i1 <= 100) && (!fchr) && (sump != 30030)); i1++) {
-
-    /* Determine location of neighbor (using periodic boundaries) */
-
-    xchr = xpres;
-    ychr = ypres;
-    zchr = zpres;
-    newact = 0;
-    sump *= moveone(&xchr, &ychr, &zchr, &newact, sump);
-
-    if (!newact) {
-      fprintf(stderr, "\nERROR in extpozz: Value of newact is %d", newact);
-      fflush(stderr);
-    }
-
-    check = Mic[xchr][ychr][zchr];
-
-    /***
-     *     If neighbor is porosity, locate the phase there.
-     *     We allow growth into any kind of saturated porosity
-     *     (CRACKP or POROSITY) because the growth is local
-     *     (24 May 2004)
-     ***/
-
-    if (check == POROSITY || check == CRACKP) {
-      Mic[xchr][ychr][zchr] = POZZCSH;
-      Count[POZZCSH]++;
-      Count[check]--;
-      fchr = 1;
-    }
-  }
-
-  /***
-   *    If no neighbor available, locate pozzolanic
-   *    CSH at random location in pore space.  Now that
-   *    the growth is non-local, allow it to occur only
-   *    into the same kind of saturated porosity as that
-   *    found at the original reaction site
-   *    (24 May 2004)
-   ***/
+void randpozz(int pval) {
+  int numnear1, numnear2, check, xchr, ychr, zchr;
+  int fchr, tries;
 
-  tries = 0;
-  if (*poreid < 0) {
-    if (Cyccnt > Crackcycle) {
-      *poreid = getporenv(xpres, ypres, zpres);
-    } else {
-      *poreid = (int)(POROSITY);
-    }
-  }
-  pval = (int)(*poreid);
+  fchr = tries = 0;
 
   while (!fchr) {
 
@@ -4111,7 +4173,7 @@ void extpozz(int xpres, int ypres, int zpres, int *poreid) {
        ***/
 
       if ((numnear1 < 26 || numnear2 < 26) || (tries > MAXTRIES)) {
-        Mic[xchr][ychr][zchr] = POZZCSH;
+        MICSET(xchr, ychr, zchr, POZZCSH);
         Count[POZZCSH]++;
         Count[pval]--;
         fchr = 1;
@@ -4119,6 +4181,65 @@ void extpozz(int xpres, int ypres, int zpres, int *poreid) {
     }
   }
 
+  Nrejected += tries - 1;
+
+  return;
+}
+
+/***
+ *    extpozz
+ *
+ *     Add extra pozzolanic CSH when CH reacts at
+ *     pozzolanic surface (e.g. silica fume) at location
+ *     (xpres, ypres, zpres)
+ *
+ *     Arguments:    Int coordinates of present location
+ *                     xpres,ypres,zpres
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        growlocal, randpozz, deferrand
+ *
+ *    Called by:    movech
+ ***/
+void extpozz(int xpres, int ypres, int zpres, int *poreid) {
+  int fchr, pval;
+
+  /***
+   *    First try the six neighboring locations, drawn at
+   *    most 100 times.  Saturated porosity of either kind
+   *    (POROSITY or CRACKP) is allowed because growth is
+   *    local (24 May 2004)
+   ***/
+
+  fchr = growlocal(xpres, ypres, zpres, POZZCSH, GROWPORE, 100);
+
+  /***
+   *    If no neighbor available, locate pozzolanic
+   *    CSH at random location in pore space.  Now that
+   *    the growth is non-local, allow it to occur only
+   *    into the same kind of saturated porosity as that
+   *    found at the original reaction site
+   *    (24 May 2004)
+   ***/
+
+  if (*poreid < 0) {
+    if (Cyccnt > Crackcycle) {
+      *poreid = getporenv(xpres, ypres, zpres);
+    } else {
+      *poreid = (int)(POROSITY);
+    }
+  }
+  pval = (int)(*poreid);
+
+  if (!fchr) {
+    if (Deferrand) {
+      deferrand(RANDPOZZ, pval, 0);
+    } else {
+      randpozz(pval);
+    }
+  }
+
   return;
 }
 
@@ -4157,8 +4278,9 @@ int movefh3(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
   pgen = ran1(Seed);
 
   if ((nucprob >= pgen) || (finalstep)) {
+    Nnucleate++;
     action = 0;
-    Mic[xcur][ycur][zcur] = FH3;
+    MICSET(xcur, ycur, zcur, FH3);
     Count[FH3]++;
     Count[DIFFFH3]--;
 
@@ -4170,7 +4292,7 @@ int movefh3(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
     ynew = ycur;
     znew = zcur;
     action = 0;
-    sumold = 1;
+    sumold = 0;
     sumgarb = moveone(&xnew, &ynew, &znew, &action, sumold);
 
     if (!action) {
@@ -4187,7 +4309,7 @@ int movefh3(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
      ***/
 
     if (check == FH3) {
-      Mic[xcur][ycur][zcur] = FH3;
+      MICSET(xcur, ycur, zcur, FH3);
       Count[FH3]++;
       Count[DIFFFH3]--;
       action = 0;
@@ -4204,8 +4326,8 @@ int movefh3(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
        ***/
 
       if (check == POROSITY || check == CRACKP) {
-        Mic[xcur][ycur][zcur] = check;
-        Mic[xnew][ynew][znew] = DIFFFH3;
+        MICSET(xcur, ycur, zcur, check);
+        MICSET(xnew, ynew, znew, DIFFFH3);
       } else {
 
         /***
@@ -4257,9 +4379,10 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
   pgen = ran1(Seed);
   if ((nucprob >= pgen) || (finalstep)) {
+    Nnucleate++;
 
     action = 0;
-    Mic[xcur][ycur][zcur] = CH;
+    MICSET(xcur, ycur, zcur, CH);
     Count[DIFFCH]--;
     Count[CH]++;
 
@@ -4271,7 +4394,7 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
     ynew = ycur;
     znew = zcur;
     action = 0;
-    sumold = 1;
+    sumold = 0;
     sumgarb = moveone(&xnew, &ynew, &znew, &action, sumold);
 
     if (!action) {
@@ -4288,7 +4411,7 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
      ***/
 
     if ((check == CH) && (pgen <= CHGROW)) {
-      Mic[xcur][ycur][zcur] = CH;
+      MICSET(xcur, ycur, zcur, CH);
       Count[DIFFCH]--;
       Count[CH]++;
       action = 0;
@@ -4306,7 +4429,7 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
     if (((check == INERTAGG) || (check == CACO3)) && (pgen <= CHGROWAGG) &&
         (Chflag)) {
-      Mic[xcur][ycur][zcur] = CH;
+      MICSET(xcur, ycur, zcur, CH);
       Count[DIFFCH]--;
       Count[CH]++;
       action = 0;
@@ -4322,7 +4445,7 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
                (Nsilica_rx <= ((double)Nsilica * 1.35))) {
 
       action = 0;
-      Mic[xcur][ycur][zcur] = POZZCSH;
+      MICSET(xcur, ycur, zcur, POZZCSH);
       Count[POZZCSH]++;
 
       /***
@@ -4337,7 +4460,7 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       pfix = ran1(Seed);
       if (pfix <= (1.0 / 1.35)) {
-        Mic[xnew][ynew][znew] = POZZCSH;
+        MICSET(xnew, ynew, znew, POZZCSH);
         Count[check]--;
         Count[POZZCSH]++;
       }
@@ -4359,7 +4482,7 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
     } else if (check == DIFFAS) {
       action = 0;
-      Mic[xcur][ycur][zcur] = STRAT;
+      MICSET(xcur, ycur, zcur, STRAT);
       Count[DIFFCH]--;
       Count[STRAT]++;
 
@@ -4374,7 +4497,7 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       pfix = ran1(Seed);
       if (pfix <= 0.7538) {
-        Mic[xnew][ynew][znew] = STRAT;
+        MICSET(xnew, ynew, znew, STRAT);
         Count[STRAT]++;
         Count[DIFFAS]--;
       }
@@ -4405,8 +4528,8 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
        ***/
 
       if (check == POROSITY || check == CRACKP) {
-        Mic[xcur][ycur][zcur] = check;
-        Mic[xnew][ynew][znew] = DIFFCH;
+        MICSET(xcur, ycur, zcur, check);
+        MICSET(xnew, ynew, znew, DIFFCH);
       } else {
 
         /***
@@ -4423,89 +4546,24 @@ int movech(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 }
 
 /***
- *    extc3ah6
+ *    randc3ah6
  *
- *     Add extra C3AH6 when diffusing C3A nucleates or
- *     reacts at C3AH6 surface at location
- *     (xpres, ypres, zpres)
+ *    Place one pixel of C3AH6 at a random location in
+ *    saturated porosity of type pval, the non-local
+ *    fallback of extc3ah6
  *
- *     Arguments:    Int coordinates of present location
- *                     xpres,ypres,zpres
- *                 int id of type of saturated porosity at the
- *                     original reaction site (24 May 2004)
+ *     Arguments:    Int id of saturated porosity to grow into
  *
  *     Returns:    Nothing
  *
- *    Calls:        moveone, edgecnt
- *
- *    Called by:    movec3a
+ *    Calls:        ran1, edgecnt
+ *    Called by:    extc3ah6, rundeferred
  ***/
-void extc3ah6(int xpres, int ypres, int zpres, int *poreid) {
-  int check, sump, xchr, ychr, zchr, fchr, i1, action, numnear, pval;
-  int tries;
-
-  /***
-   *    First try 6 neighboring locations until
-   *        a) successful,
-   *        b) all 6 sites are tried, or
-   *        c) 100 tries are made
-   *
-   *    Note that 30030 is the product of the first six
-   *    prime numbers, indicating that all six nearest
-   *    neighbors have been tried
-   ***/
-
-  fchr = 0;
-  sump = 1;
-
-  for (i1 = 1; ((i1 <= 100) && (!fchr) && (sump != 30030)); i1++) {
-
-    /* Determine location of neighbor (using periodic boundaries) */
-
-    xchr = xpres;
-    ychr = ypres;
-    zchr = zpres;
-    action = 0;
-    sump *= moveone(&xchr, &ychr, &zchr, &action, sump);
-
-    if (!action) {
-      fprintf(stderr, "\nERROR in extc3ah6: Value of action is %d", action);
-      fflush(stderr);
-    }
-
-    check = Mic[xchr][ychr][zchr];
+void randc3ah6(int pval) {
+  int numnear, check, xchr, ychr, zchr;
+  int fchr, tries;
 
-    /***
-     *    If neighbor is pore space, convert it to C3AH6
-     *    Because growth is local, we allow it to occur into
-     *    any kind of saturated porosity (CRACKP or POROSITY)
-     ***/
-
-    if (check == POROSITY || check == CRACKP) {
-      Mic[xchr][ychr][zchr] = C3AH6;
-      Count[C3AH6]++;
-      Count[check]--;
-      fchr = 1;
-    }
-  }
-
-  /***
-   *    If unsuccessful, add C3AH6 at random location in pore space
-   *    Now, because growth is non-local, allow it to occur only into
-   *    the kind of saturated porosity as that found at the original
-   *    reaction site
-   *    (24 May 2004)
-   ***/
-
-  tries = 0;
-  if (*poreid < 0) {
-    if (Cyccnt > Crackcycle) {
-      *poreid = getporenv(xpres, ypres, zpres);
-    } else {
-      *poreid = (int)(POROSITY);
-    }
-  }
-  pval = (int)(*poreid);
+  fchr = tries = 0;
 
   while (!fchr) {
 
@@ -4534,7 +4592,7 @@ void extc3ah6(int xpres, int ypres, int zpres, int *poreid) {
        ***/
 
       if ((numnear < 26) || (tries > MAXTRIES)) {
-        Mic[xchr][ychr][zchr] = C3AH6;
+        MICSET(xchr, ychr, zchr, C3AH6);
         Count[C3AH6]++;
         Count[pval]--;
         fchr = 1;
@@ -4542,6 +4600,66 @@ void extc3ah6(int xpres, int ypres, int zpres, int *poreid) {
     }
   }
 
+  Nrejected += tries - 1;
+
+  return;
+}
+
+/***
+ *    extc3ah6
+ *
+ *     Add extra C3AH6 when diffusing C3A nucleates or
+ *     reacts at C3AH6 surface at location
+ *     (xpres, ypres, zpres)
+ *
+ *     Arguments:    Int coordinates of present location
+ *                     xpres,ypres,zpres
+ *                 int id of type of saturated porosity at the
+ *                     original reaction site (24 May 2004)
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        growlocal, randc3ah6, deferrand
+ *
+ *    Called by:    movec3a
+ ***/
+void extc3ah6(int xpres, int ypres, int zpres, int *poreid) {
+  int fchr, pval;
+
+  /***
+   *    First try the six neighboring locations, drawn at
+   *    most 100 times.  Saturated porosity of either kind
+   *    (POROSITY or CRACKP) is allowed because growth is
+   *    local (24 May 2004)
+   ***/
+
+  fchr = growlocal(xpres, ypres, zpres, C3AH6, GROWPORE, 100);
+
+  /***
+   *    If unsuccessful, add C3AH6 at random location in pore space
+   *    Now, because growth is non-local, allow it to occur only into
+   *    the kind of saturated porosity as that found at the original
+   *    reaction site
+   *    (24 May 2004)
+   ***/
+
+  if (*poreid < 0) {
+    if (Cyccnt > Crackcycle) {
+      *poreid = getporenv(xpres, ypres, zpres);
+    } else {
+      *poreid = (int)(POROSITY);
+    }
+  }
+  pval = (int)(*poreid);
+
+  if (!fchr) {
+    if (Deferrand) {
+      deferrand(RANDC3AH6, pval, 0);
+    } else {
+      randc3ah6(pval);
+    }
+  }
+
   return;
 }
 
@@ -4595,8 +4713,9 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
   p2diff = ran1(Seed);
 
   if ((nucprob >= pgen) || (finalstep)) {
+    Nnucleate++;
     action = 0;
-    Mic[xcur][ycur][zcur] = C3AH6;
+    MICSET(xcur, ycur, zcur, C3AH6);
     Count[C3AH6]++;
     Count[DIFFC3A]--;
 
@@ -4620,7 +4739,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
     ynew = ycur;
     znew = zcur;
     action = 0;
-    sumold = 1;
+    sumold = 0;
     sumgarb = moveone(&xnew, &ynew, &znew, &action, sumold);
     if (!action) {
       fprintf(stderr, "\nERROR in movec3a: Value of action is %d", action);
@@ -4641,7 +4760,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       pgrow = ran1(Seed);
       if (pgrow <= C3AH6GROW) {
-        Mic[xcur][ycur][zcur] = C3AH6;
+        MICSET(xcur, ycur, zcur, C3AH6);
         Count[C3AH6]++;
         Count[DIFFC3A]--;
         action = 0;
@@ -4670,7 +4789,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing gypsum to ettringite */
 
-      Mic[xnew][ynew][znew] = ETTR;
+      MICSET(xnew, ynew, znew, ETTR);
       Count[ETTR]++;
       Count[DIFFGYP]--;
       action = 0;
@@ -4683,7 +4802,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 2;
       pexp = ran1(Seed);
       if (pexp <= 0.40) {
-        Mic[xcur][ycur][zcur] = ETTR;
+        MICSET(xcur, ycur, zcur, ETTR);
         Count[ETTR]++;
         Count[DIFFC3A]--;
         nexp--;
@@ -4774,7 +4893,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing hemihydrate to ettringite */
 
-      Mic[xnew][ynew][znew] = ETTR;
+      MICSET(xnew, ynew, znew, ETTR);
       Count[ETTR]++;
       Count[DIFFHEM]--;
       action = 0;
@@ -4789,7 +4908,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 3;
       pexp = ran1(Seed);
       if (pexp <= 0.5583) {
-        Mic[xcur][ycur][zcur] = ETTR;
+        MICSET(xcur, ycur, zcur, ETTR);
         Count[ETTR]++;
         Count[DIFFC3A]--;
         nexp--;
@@ -4881,7 +5000,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing anhydrite to ettringite */
 
-      Mic[xnew][ynew][znew] = ETTR;
+      MICSET(xnew, ynew, znew, ETTR);
       Count[ETTR]++;
       Count[DIFFANH]--;
       action = 0;
@@ -4894,7 +5013,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 3;
       pexp = ran1(Seed);
       if (pexp <= 0.569) {
-        Mic[xcur][ycur][zcur] = ETTR;
+        MICSET(xcur, ycur, zcur, ETTR);
         Count[ETTR]++;
         Count[DIFFC3A]--;
         nexp--;
@@ -4985,7 +5104,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing C3A to Friedel's salt */
 
-      Mic[xcur][ycur][zcur] = FRIEDEL;
+      MICSET(xcur, ycur, zcur, FRIEDEL);
       Count[FRIEDEL]++;
       Count[DIFFC3A]--;
       action = 0;
@@ -5000,7 +5119,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 2;
       pexp = ran1(Seed);
       if (pexp <= 0.5793) {
-        Mic[xnew][ynew][znew] = FRIEDEL;
+        MICSET(xnew, ynew, znew, FRIEDEL);
         Count[FRIEDEL]++;
         Count[DIFFCACL2]--;
         nexp--;
@@ -5085,7 +5204,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing CAS2 to stratlingite */
 
-      Mic[xnew][ynew][znew] = STRAT;
+      MICSET(xnew, ynew, znew, STRAT);
       Count[STRAT]++;
       Count[DIFFCAS2]--;
       action = 0;
@@ -5099,7 +5218,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 3;
       pexp = ran1(Seed);
       if (pexp <= 0.886) {
-        Mic[xcur][ycur][zcur] = STRAT;
+        MICSET(xcur, ycur, zcur, STRAT);
         Count[STRAT]++;
         Count[DIFFC3A]--;
         nexp--;
@@ -5193,7 +5312,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing or solid ettringite to AFm */
 
-      Mic[xnew][ynew][znew] = AFM;
+      MICSET(xnew, ynew, znew, AFM);
       Count[AFM]++;
       Count[check]--;
       action = 0;
@@ -5207,7 +5326,7 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       pexp = ran1(Seed);
       if (pexp <= 0.2424) {
-        Mic[xcur][ycur][zcur] = AFM;
+        MICSET(xcur, ycur, zcur, AFM);
         Count[AFM]++;
         Count[DIFFC3A]--;
         pafm = (-0.1);
@@ -5247,8 +5366,8 @@ int movec3a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
        ***/
 
       if (check == POROSITY || check == CRACKP) {
-        Mic[xcur][ycur][zcur] = check;
-        Mic[xnew][ynew][znew] = DIFFC3A;
+        MICSET(xcur, ycur, zcur, check);
+        MICSET(xnew, ynew, znew, DIFFC3A);
       } else {
 
         /***
@@ -5314,8 +5433,9 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
   p2diff = ran1(Seed);
 
   if ((nucprob >= pgen) || (finalstep)) {
+    Nnucleate++;
     action = 0;
-    Mic[xcur][ycur][zcur] = C3AH6;
+    MICSET(xcur, ycur, zcur, C3AH6);
     Count[C3AH6]++;
     Count[DIFFC4A]--;
 
@@ -5339,7 +5459,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
     ynew = ycur;
     znew = zcur;
     action = 0;
-    sumold = 1;
+    sumold = 0;
     sumgarb = moveone(&xnew, &ynew, &znew, &action, sumold);
     if (!action) {
       fprintf(stderr, "\nERROR in movec4a: Value of action is %d", action);
@@ -5360,7 +5480,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       pgrow = ran1(Seed);
       if (pgrow <= C3AH6GROW) {
-        Mic[xcur][ycur][zcur] = C3AH6;
+        MICSET(xcur, ycur, zcur, C3AH6);
         Count[C3AH6]++;
         Count[DIFFC4A]--;
         action = 0;
@@ -5389,7 +5509,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing gypsum to ettringite */
 
-      Mic[xnew][ynew][znew] = ETTRC4AF;
+      MICSET(xnew, ynew, znew, ETTRC4AF);
       Count[ETTRC4AF]++;
       Count[DIFFGYP]--;
       action = 0;
@@ -5404,7 +5524,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 2;
       pexp = ran1(Seed);
       if (pexp <= 0.40) {
-        Mic[xcur][ycur][zcur] = ETTRC4AF;
+        MICSET(xcur, ycur, zcur, ETTRC4AF);
         Count[ETTRC4AF]++;
         Count[DIFFC4A]--;
         nexp--;
@@ -5495,7 +5615,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing hemihydrate to ettringite */
 
-      Mic[xnew][ynew][znew] = ETTRC4AF;
+      MICSET(xnew, ynew, znew, ETTRC4AF);
       Count[ETTRC4AF]++;
       Count[DIFFHEM]--;
       action = 0;
@@ -5510,7 +5630,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 3;
       pexp = ran1(Seed);
       if (pexp <= 0.5583) {
-        Mic[xcur][ycur][zcur] = ETTRC4AF;
+        MICSET(xcur, ycur, zcur, ETTRC4AF);
         Count[ETTRC4AF]++;
         Count[DIFFC4A]--;
         nexp--;
@@ -5602,7 +5722,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing anhydrite to ettringite */
 
-      Mic[xnew][ynew][znew] = ETTRC4AF;
+      MICSET(xnew, ynew, znew, ETTRC4AF);
       Count[ETTRC4AF]++;
       Count[DIFFANH]--;
       action = 0;
@@ -5615,7 +5735,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 3;
       pexp = ran1(Seed);
       if (pexp <= 0.569) {
-        Mic[xcur][ycur][zcur] = ETTRC4AF;
+        MICSET(xcur, ycur, zcur, ETTRC4AF);
         Count[ETTRC4AF]++;
         Count[DIFFC4A]--;
         nexp--;
@@ -5707,7 +5827,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing C4A to Friedel's salt */
 
-      Mic[xcur][ycur][zcur] = FRIEDEL;
+      MICSET(xcur, ycur, zcur, FRIEDEL);
       Count[FRIEDEL]++;
       Count[DIFFC4A]--;
       action = 0;
@@ -5722,7 +5842,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 2;
       pexp = ran1(Seed);
       if (pexp <= 0.5793) {
-        Mic[xnew][ynew][znew] = FRIEDEL;
+        MICSET(xnew, ynew, znew, FRIEDEL);
         Count[FRIEDEL]++;
         Count[DIFFCACL2]--;
         nexp--;
@@ -5807,7 +5927,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing CAS2 to stratlingite */
 
-      Mic[xnew][ynew][znew] = STRAT;
+      MICSET(xnew, ynew, znew, STRAT);
       Count[STRAT]++;
       Count[DIFFCAS2]--;
       action = 0;
@@ -5821,7 +5941,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
       nexp = 3;
       pexp = ran1(Seed);
       if (pexp <= 0.886) {
-        Mic[xcur][ycur][zcur] = STRAT;
+        MICSET(xcur, ycur, zcur, STRAT);
         Count[STRAT]++;
         Count[DIFFC4A]--;
         nexp--;
@@ -5915,7 +6035,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       /* Convert diffusing or solid ettringite to AFm */
 
-      Mic[xnew][ynew][znew] = AFM;
+      MICSET(xnew, ynew, znew, AFM);
       Count[AFM]++;
       Count[check]--;
       action = 0;
@@ -5929,7 +6049,7 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
 
       pexp = ran1(Seed);
       if (pexp <= 0.2424) {
-        Mic[xcur][ycur][zcur] = AFM;
+        MICSET(xcur, ycur, zcur, AFM);
         Count[AFM]++;
         Count[DIFFC4A]--;
         pafm = (-0.1);
@@ -5969,8 +6089,8 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
        ***/
 
       if (check == POROSITY || check == CRACKP) {
-        Mic[xcur][ycur][zcur] = check;
-        Mic[xnew][ynew][znew] = DIFFC4A;
+        MICSET(xcur, ycur, zcur, check);
+        MICSET(xnew, ynew, znew, DIFFC4A);
       } else {
 
         /***
@@ -5986,47 +6106,464 @@ int movec4a(int xcur, int ycur, int zcur, int finalstep, float nucprob) {
   return (action); /* 7 if no action taken */
 }
 
+/***
+ *    keepant
+ *
+ *     Move a diffusing species that did not react one step in
+ *     the direction chosen by its move routine and store it in
+ *     the next free slot at the front of the ant pool
+ *
+ *     Arguments:    int index of the ant in the pool
+ *                   int x,y,z current location of the ant
+ *                   int action returned by the move routine
+ *                   int pointer to number of ants kept so far
+ *
+ *     Returns:    1 if the ant was kept, 0 if it reacted
+ *
+ *    Calls:        no other routines
+ *    Called by:    hydrate, movebucket
+ ***/
+int keepant(int iant, int xpl, int ypl, int zpl, int reactf, int *nkeep) {
+  int n;
+
+  /***
+   *    A zero action means there was a reaction that
+   *    took the diffusing ant out of the game, so the
+   *    ant simply is not kept in the pool.
+   ***/
+
+  if (reactf == 0) {
+    Ngoing--;
+    return (0);
+  }
+
+  /* Update location of diffusing species */
+
+  switch (reactf) {
+  case 1:
+    xpl--;
+    if (xpl < 0)
+      xpl = (Xsyssize - 1);
+    break;
+  case 2:
+    xpl++;
+    if (xpl >= Xsyssize)
+      xpl = 0;
+    break;
+  case 3:
+    ypl--;
+    if (ypl < 0)
+      ypl = (Ysyssize - 1);
+    break;
+  case 4:
+    ypl++;
+    if (ypl >= Ysyssize)
+      ypl = 0;
+    break;
+  case 5:
+    zpl--;
+    if (zpl < 0)
+      zpl = (Zsyssize - 1);
+    break;
+  case 6:
+    zpl++;
+    if (zpl >= Zsyssize)
+      zpl = 0;
+    break;
+  default:
+    break;
+  }
+
+  /* Store new location of diffusing species */
+
+  n = *nkeep;
+  Antpool.x[n] = (unsigned short int)xpl;
+  Antpool.y[n] = (unsigned short int)ypl;
+  Antpool.z[n] = (unsigned short int)zpl;
+  Antpool.id[n] = Antpool.id[iant];
+  Antpool.cycbirth[n] = Antpool.cycbirth[iant];
+  (*nkeep)++;
+
+  return (1);
+}
+
+/***
+ *    Loop over one species bucket of the ant pool, calling
+ *    a single move routine for every ant in the bucket
+ ***/
+
+#define ANTBUCKETLOOP(movecall)                                                \
+  for (iant = lo; iant < hi; iant++) {                                         \
+    xpl = Antpool.x[iant];                                                     \
+    ypl = Antpool.y[iant];                                                     \
+    zpl = Antpool.z[iant];                                                     \
+    if (Mic[xpl][ypl][zpl] != phid) {                                          \
+      Ngoing--;                                                                \
+      continue;                                                                \
+    }                                                                          \
+    reactf = (movecall);                                                       \
+    nleft += keepant(iant, xpl, ypl, zpl, reactf, nkeep);                      \
+  }
+
+/***
+ *    movebucket
+ *
+ *     Take one diffusion step for every ant of a single
+ *     species.  The ants of that species must occupy the
+ *     contiguous pool slots lo through hi - 1.
+ *
+ *     Arguments:    int diffusing species id
+ *                   int lo, hi bounds of the bucket in the pool
+ *                   int pointer to number of ants kept so far
+ *                   int final step flag
+ *                   float nucleation probability for the species
+ *
+ *     Returns:    number of ants that did not react
+ *
+ *    Calls:        keepant and the move routine of the species
+ *    Called by:    hydrate
+ ***/
+int movebucket(int phid, int lo, int hi, int *nkeep, int termflag,
+               float nucprob) {
+  int iant, xpl, ypl, zpl, reactf;
+  int nleft = 0;
+
+  switch (phid) {
+  case DIFFCSH:
+    ANTBUCKETLOOP(
+        movecsh(xpl, ypl, zpl, termflag, (int)Antpool.cycbirth[iant]))
+    break;
+  case DIFFANH:
+    ANTBUCKETLOOP(moveanh(xpl, ypl, zpl, termflag, nucprob))
+    break;
+  case DIFFHEM:
+    ANTBUCKETLOOP(movehem(xpl, ypl, zpl, termflag, nucprob))
+    break;
+  case DIFFSO4:
+    ANTBUCKETLOOP(moveso4(xpl, ypl, zpl, termflag, nucprob))
+    break;
+  case DIFFCH:
+    ANTBUCKETLOOP(movech(xpl, ypl, zpl, termflag, nucprob))
+    break;
+  case DIFFFH3:
+    ANTBUCKETLOOP(movefh3(xpl, ypl, zpl, termflag, nucprob))
+    break;
+  case DIFFGYP:
+    ANTBUCKETLOOP(movegyp(xpl, ypl, zpl, termflag))
+    break;
+  case DIFFC3A:
+    ANTBUCKETLOOP(movec3a(xpl, ypl, zpl, termflag, nucprob))
+    break;
+  case DIFFC4A:
+    ANTBUCKETLOOP(movec4a(xpl, ypl, zpl, termflag, nucprob))
+    break;
+  case DIFFETTR:
+    ANTBUCKETLOOP(moveettr(xpl, ypl, zpl, termflag))
+    break;
+  case DIFFCACL2:
+    ANTBUCKETLOOP(movecacl2(xpl, ypl, zpl, termflag))
+    break;
+  case DIFFCAS2:
+    ANTBUCKETLOOP(movecas2(xpl, ypl, zpl, termflag))
+    break;
+  case DIFFAS:
+    ANTBUCKETLOOP(moveas(xpl, ypl, zpl, termflag))
+    break;
+  case DIFFCACO3:
+    ANTBUCKETLOOP(movecaco3(xpl, ypl, zpl, termflag))
+    break;
+  default:
+    fprintf(stderr, "\nERROR in movebucket: ID of phase is %d", phid);
+    fflush(stderr);
+    break;
+  }
+
+  return (nleft);
+}
+
+#undef ANTBUCKETLOOP
+
+/***
+ *    rundeferred
+ *
+ *     Carry out, in the order they were queued, the random-
+ *     location growth jobs a slab queued during a sweep
+ *
+ *     Arguments:    int slab index
+ *
+ *     Returns:    Nothing
+ *
+ *    Calls:        randcsh, randfh3, randettr, randch, randgyps,
+ *                randfriedel, randstrat, randafm, randpozz, randc3ah6,
+ *                randslagcsh
+ *    Called by:    slabsweep, dissolvesweep
+ ***/
+void rundeferred(int is) {
+  int j, pval;
+  struct Antslab *sp;
+
+  sp = &(Antslab[is]);
+
+  for (j = 0; j < sp->njob; j++) {
+    pval = (int)sp->job[j].pval;
+    switch (sp->job[j].kind) {
+    case RANDCSH:
+      randcsh(pval);
+      break;
+    case RANDFH3:
+      randfh3(pval);
+      break;
+    case RANDETTR:
+      randettr(pval, (int)sp->job[j].etype);
+      break;
+    case RANDCH:
+      randch(pval);
+      break;
+    case RANDGYPS:
+      randgyps(pval);
+      break;
+    case RANDFRIEDEL:
+      randfriedel(pval);
+      break;
+    case RANDSTRAT:
+      randstrat(pval);
+      break;
+    case RANDAFM:
+      randafm(pval);
+      break;
+    case RANDPOZZ:
+      randpozz(pval);
+      break;
+    case RANDC3AH6:
+      randc3ah6(pval);
+      break;
+    case RANDSLAGCSH:
+      randslagcsh();
+      break;
+    default:
+      fprintf(stderr, "\nERROR in rundeferred: Unknown job kind %d",
+              (int)sp->job[j].kind);
+      fflush(stderr);
+      break;
+    }
+  }
+
+  sp->njob = 0;
+
+  return;
+}
+
+/***
+ *    moveslab
+ *
+ *     Take one diffusion step for every ant of one slab, with
+ *     the random stream of the slab and with the counters set
+ *     to their values at the start of the sweep.  The final
+ *     counter values are left in the tally of the slab, and the
+ *     surviving ants are compacted toward the front of the
+ *     slab's part of the pool.
+ *
+ *     Arguments:    int slab index
+ *                   int final step flag
+ *                   float array of nucleation probabilities per species
+ *                   struct Slabtally pointer to counters at sweep start
+ *
+ *     Returns:    number of ants that did not react
+ *
+ *    Calls:        ran1load, ran1save, settally, gettally, movebucket
+ *    Called by:    slabsweep
+ ***/
+int moveslab(int is, int termflag, float *nucprob, struct Slabtally *start) {
+  int ib, first, nkeep, nleft;
+  int *bstart, *bend;
+
+  bstart = Slabbstart + is * NANTSPECIES;
+  bend = Slabbend + is * NANTSPECIES;
+
+  Curslab = is;
+  Seed = &(Antslab[is].rng.idum);
+  Curmoves = &(Antslab[is].moves);
+  ran1load(&(Antslab[is].rng));
+  settally(start);
+
+  nleft = 0;
+  nkeep = bstart[0];
+  for (ib = 0; ib < NANTSPECIES; ib++) {
+    first = nkeep;
+    if (bend[ib] > bstart[ib]) {
+      nleft += movebucket((DIFFCSH) + ib, bstart[ib], bend[ib], &nkeep,
+                          termflag, nucprob[ib]);
+    }
+    bstart[ib] = first;
+    bend[ib] = nkeep;
+  }
+
+  ran1save(&(Antslab[is].rng));
+  gettally(&(Antslab[is].tally));
+
+  return (nleft);
+}
+
+/***
+ *    slabsweep
+ *
+ *     Take one diffusion step for the ants of every other slab,
+ *     starting with slab parity, processing the slabs on as many
+ *     threads as were requested.  Afterwards add up the counter
+ *     changes of all the slabs and do the random-location growth
+ *     they queued, slab by slab, from the main random stream.
+ *
+ *     Arguments:    int parity (0 for even slabs, 1 for odd slabs)
+ *                   int final step flag
+ *                   float array of nucleation probabilities per species
+ *
+ *     Returns:    number of ants that did not react
+ *
+ *    Calls:        moveslab, addtally, rundeferred, slabtid
+ *    Called by:    hydrate
+ ***/
+int slabsweep(int parity, int termflag, float *nucprob) {
+  int is, nleft;
+  int *mainseed;
+  Ran1state mainrng;
+  struct Slabtally start, sum;
+
+  gettally(&start);
+  mainseed = Seed;
+  ran1save(&mainrng);
+
+  nleft = 0;
+  Deferrand = 1;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Antthreads) schedule(dynamic, 1) \
+    reduction(+ : nleft)
+#endif
+  for (is = parity; is < Nantslab; is += 2) {
+    Tracemark mark;
+
+    trace_begin(&mark, slabtid());
+    nleft += moveslab(is, termflag, nucprob, &start);
+    trace_end(&mark, "Move slab", slabtid());
+  }
+
+  Deferrand = 0;
+  Curslab = 0;
+  Seed = mainseed;
+  Curmoves = &Mainmoves;
+  ran1load(&mainrng);
+
+  sum = start;
+  for (is = parity; is < Nantslab; is += 2) {
+    addtally(&sum, &(Antslab[is].tally), &start);
+  }
+  settally(&sum);
+
+  for (is = parity; is < Nantslab; is += 2) {
+    if (Antslab[is].joberr) {
+      freeallmem();
+      bailout("disrealnew", "Could not grow queue of random growth jobs");
+      exit(1);
+    }
+    rundeferred(is);
+  }
+
+  return (nleft);
+}
+
 /***
  *    hydrate
  *
  *     Oversee hydration by updating position of all
  *     remaining diffusing species
  *
+ *     By default the ant pool is sorted into one bucket per
+ *     diffusing species at the start of the call, and every
+ *     diffusion step walks the buckets one species at a time
+ *     (see movebucket).  With Bucketants set to zero the ants
+ *     are processed in order of creation instead, which is the
+ *     traversal order of the original linked-list code.
+ *
+ *     With --threads the pool is instead sorted by slab and
+ *     species before every step, and the step is taken as two
+ *     concurrent sweeps over the even and odd slabs (see
+ *     antslab.h and slabsweep).
+ *
+ *     With --adaptive-steps the steps end early once the ants
+ *     that are left have stopped reacting, that is once fewer
+ *     than one in ADAPTSTEPFRAC has reacted in the last
+ *     ADAPTWINDOW steps.  Late in a cycle the steps otherwise
+ *     move a few stragglers through the whole pool, and those
+ *     are carried into the next cycle either way.  In the final
+ *     cycle the step after the decision is taken with termflag
+ *     set, so every ant still reacts.  The steps taken in the
+ *     cycle are counted in Perfcount[PERFDIFFSTEPS].
+ *
+ *     With --sorted-ants the pool is sorted by the row of Mic
+ *     each ant is in before the species buckets are made, and
+ *     again every SORTANTSTEPS steps, so that each bucket is
+ *     walked through the microstructure in order.  An ant moves
+ *     at most one pixel per step, so the order is still close
+ *     to sorted when it is made again.  Not done with
+ *     --legacy-ants.
+ *
  *     Arguments:    Int final cycle flag
  *                 Int maximum number of diffusion steps per cycle
  *
  *     Returns:    Nothing
  *
  *    Calls:        movech, movec3a, movefh3, moveettr, movecsh,
- *                movegyp, movecas2, moveas, movecacl2
+ *                movegyp, movecas2, moveas, movecacl2,
+ *                sortantcells, sortantpool, movebucket, keepant,
+ *                setantslabs, slabsweep, gatherslabs, perfclock
  *
  *    Called by:    hydrate
  ***/
 void hydrate(int fincyc, int stepmax, float chpar1, float chpar2, float hgpar1,
              float hgpar2, float fhpar1, float fhpar2, float gypar1,
              float gypar2) {
-  int xpl, ypl, zpl, phpl, agepl, xpnew, ypnew, zpnew;
+  int xpl, ypl, zpl, phpl, agepl;
   int istep, termflag, reactf;
-  int nleft, ntodo, ndale;
+  int nleft, ntodo, laststep, mark;
+  int iant, nant, nkeep, ib, first, slabmode;
+  int bstart[NANTSPECIES], bend[NANTSPECIES];
   float chprob, c3ah6prob, fh3prob, gypprob;
+  float nucprob[NANTSPECIES];
   float beterm;
-  struct Ants *curant, *antgone;
+  double tstart = 0.0;
 
   reactf = 0;
   ntodo = nleft = Nmade;
   termflag = 0;
+  laststep = stepmax;
+  mark = Antpool.num;
+
+  if (Bucketants && (Antthreads > 0)) {
+    if (setantslabs()) {
+      freeallmem();
+      bailout("disrealnew", "Could not allocate memory for ant slabs");
+      exit(1);
+    }
+  }
+  slabmode = (Bucketants && (Antthreads > 0) && (Nantslab > 0));
+
+  if (Bucketants && !slabmode) {
+    if (Sortants)
+      sortantcells();
+    sortantpool(1, bstart, bend);
+  }
 
   /***
    *    Perform diffusion until all reacted or max. # of
    *    diffusion steps reached
    ***/
 
-  for (istep = 1; ((istep <= stepmax) && (nleft > 0)); istep++) {
+  for (istep = 1; ((istep <= laststep) && (nleft > 0)); istep++) {
 
-    if ((fincyc) && (istep == stepmax))
+    if ((fincyc) && (istep == laststep))
       termflag = 1;
 
-    nleft = ndale = 0;
+    nleft = 0;
 
     /* Determine probabilities for CH and C3AH6 nucleation */
 
@@ -6048,52 +6585,84 @@ void hydrate(int fincyc, int stepmax, float chpar1, float chpar2, float hgpar1,
                  gypar2);
     gypprob = gypar1 * (1.0 - beterm);
 
-    /* Process each diffusing species in turn */
+    /***
+     *    Process each diffusing species in turn.  Ants that
+     *    survive this step are compacted toward the front of
+     *    the pool (slot nkeep), preserving their order.
+     ***/
 
-    curant = Headant->nextant;
+    nkeep = 0;
+    Perfcount[PERFANTSTEPS] += Antpool.num;
+
+    for (ib = 0; ib < NANTSPECIES; ib++)
+      nucprob[ib] = 0.0;
+    nucprob[ANTBUCKET(DIFFANH)] = gypprob;
+    nucprob[ANTBUCKET(DIFFHEM)] = gypprob;
+    nucprob[ANTBUCKET(DIFFSO4)] = gypprob;
+    nucprob[ANTBUCKET(DIFFCH)] = chprob;
+    nucprob[ANTBUCKET(DIFFFH3)] = fh3prob;
+    nucprob[ANTBUCKET(DIFFC3A)] = c3ah6prob;
+    nucprob[ANTBUCKET(DIFFC4A)] = c3ah6prob;
+
+    if (Bucketants && Sortants && istep > 1 &&
+        (istep - 1) % SORTANTSTEPS == 0) {
+      sortantcells();
+      if (!slabmode)
+        sortantpool(1, bstart, bend);
+    }
 
-    while (curant) {
+    if (slabmode) {
+
+      if (Sortants && istep == 1)
+        sortantcells();
+      sortantpool(Nantslab, Slabbstart, Slabbend);
+      nleft += slabsweep(0, termflag, nucprob);
+      nleft += slabsweep(1, termflag, nucprob);
+      nkeep = gatherslabs();
+
+    } else if (Bucketants) {
+
+      for (ib = 0; ib < NANTSPECIES; ib++) {
+        first = nkeep;
+        if (bend[ib] > bstart[ib]) {
+          if (Perfon)
+            tstart = perfclock();
+          nleft += movebucket((DIFFCSH) + ib, bstart[ib], bend[ib], &nkeep,
+                              termflag, nucprob[ib]);
+          if (Perfon)
+            Perfmove[ib] += perfclock() - tstart;
+        }
+        bstart[ib] = first;
+        bend[ib] = nkeep;
+      }
 
-      ndale++;
-      xpl = curant->x;
-      ypl = curant->y;
-      zpl = curant->z;
-      phpl = curant->id;
-      agepl = curant->cycbirth;
+    } else {
 
-      /***
-       *    First ensure that ant is still at the position
-       *    being examined
-       ***/
+      nant = Antpool.num;
 
-      if (Mic[xpl][ypl][zpl] != phpl) {
+      for (iant = 0; iant < nant; iant++) {
 
-        /* Remove ant from list */
+        xpl = Antpool.x[iant];
+        ypl = Antpool.y[iant];
+        zpl = Antpool.z[iant];
+        phpl = Antpool.id[iant];
+        agepl = Antpool.cycbirth[iant];
 
-        if (ndale == 1) {
-          Headant->nextant = curant->nextant;
-        } else {
-          (curant->prevant)->nextant = curant->nextant;
-        }
+        /***
+         *    First ensure that ant is still at the position
+         *    being examined.  If not, drop it from the pool
+         ***/
 
-        if (curant->nextant) {
-          (curant->nextant)->prevant = curant->prevant;
-        } else {
-          Tailant = curant->prevant;
+        if (Mic[xpl][ypl][zpl] != phpl) {
+          Ngoing--;
+          continue;
         }
 
-        antgone = curant;
-        curant = curant->nextant;
-        free(antgone);
-        Ngoing--;
-
         /***
          *    Based on ID, call appropriate routine
          *    to process diffusing species
          ***/
 
-      } else {
-
         switch (phpl) {
         case DIFFCSH:
           reactf = movecsh(xpl, ypl, zpl, termflag, agepl);
@@ -6143,93 +6712,27 @@ void hydrate(int fincyc, int stepmax, float chpar1, float chpar2, float hgpar1,
           break;
         }
 
-        /* If no reaction */
-
-        if (reactf != 0) {
-
-          nleft++;
-          xpnew = xpl;
-          ypnew = ypl;
-          zpnew = zpl;
-
-          /* Update location of diffusing species */
-
-          switch (reactf) {
-          case 1:
-            xpnew--;
-            if (xpnew < 0)
-              xpnew = (Xsyssize - 1);
-            break;
-          case 2:
-            xpnew++;
-            if (xpnew >= Xsyssize)
-              xpnew = 0;
-            break;
-          case 3:
-            ypnew--;
-            if (ypnew < 0)
-              ypnew = (Ysyssize - 1);
-            break;
-          case 4:
-            ypnew++;
-            if (ypnew >= Ysyssize)
-              ypnew = 0;
-            break;
-          case 5:
-            zpnew--;
-            if (zpnew < 0)
-              zpnew = (Zsyssize - 1);
-            break;
-          case 6:
-            zpnew++;
-            if (zpnew >= Zsyssize)
-              zpnew = 0;
-            break;
-          default:
-            break;
-          }
-
-          /* Store new location of diffusing species */
-
-          curant->x = xpnew;
-          curant->y = ypnew;
-          curant->z = zpnew;
-          curant->id = phpl;
-          curant = curant->nextant;
+        nleft += keepant(iant, xpl, ypl, zpl, reactf, &nkeep);
 
-          /* End of react != 0 block */
-
-        } else {
-
-          /***
-           *    Otherwise, there was a reaction that took
-           *    the diffusing ant out of the game.
-           *    Therefore, we must remove that annihiliated
-           *    ant from the list
-           ***/
+      } /* end of curant loop */
+    }
 
-          if (ndale == 1) {
-            Headant->nextant = curant->nextant;
-          } else {
-            (curant->prevant)->nextant = curant->nextant;
-          }
+    Perfcount[PERFANTSGONE] += Antpool.num - nkeep;
+    Antpool.num = nkeep;
+    ntodo = nleft;
 
-          if (curant->nextant) {
-            (curant->nextant)->prevant = curant->prevant;
-          } else {
-            Tailant = curant->prevant;
-          }
+    /* Stop once the population left has become stationary */
 
-          antgone = curant;
-          curant = curant->nextant;
-          free(antgone);
-          Ngoing--;
-        }
+    if (Adaptsteps && !termflag && (istep % ADAPTWINDOW) == 0) {
+      if ((long)(mark - nkeep) * ADAPTSTEPFRAC < (long)mark &&
+          istep < laststep) {
+        laststep = (fincyc) ? istep + 1 : istep;
+        Adaptstopped++;
       }
-
-    } /* end of curant loop */
-
-    ntodo = nleft;
+      mark = nkeep;
+    }
 
   } /* end of istep loop */
+
+  Perfcount[PERFDIFFSTEPS] += istep - 1;
 }
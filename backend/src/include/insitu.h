@@ -0,0 +1,274 @@
+/***
+ *	insitu
+ *
+ * 	Analyses of the microstructure at ages chosen with
+ * 	--analyze-at, done on the microstructure in memory instead
+ * 	of on images read back afterward (as snapbatch does):
+ *
+ * 		census: voxels of each phase (phase_census)
+ * 		pores:  pore size distribution (poresizes)
+ * 		perc:   percolation of the pores and of the solids in
+ * 		        each direction (perc_label_classes)
+ *
+ * 	When the cycle loop first reaches an age, the interior of
+ * 	Mic is copied into an image buffer of the snapshot writer
+ * 	(see snapshot.h) marked for analysis, and the writer thread
+ * 	analyzes it in place of writing it, with the diffusing
+ * 	species shown as porosity as in the saved images.  The loop
+ * 	waits for the result unless --analyze-background is given,
+ * 	in which case it carries on with hydration meanwhile.  The
+ * 	results are added to one table in the working directory,
+ * 	one row per phase, pore diameter or network and direction,
+ * 	which a restart cuts back like the data file.
+ *
+ * 	The formation factor is not among them: transport solves
+ * 	for it with parameters and a particle image of its own, for
+ * 	far longer than a cycle takes.
+ ***/
+
+/***
+ *	insitulist
+ *
+ * 	Set the analyses asked for with --analyze, a list of names
+ * 	separated by commas
+ *
+ * 	Arguments:	char pointer to the list
+ * 	Returns:	0 if okay, 1 if a name is not known
+ *
+ *	Calls:		No other routines
+ *	Called by:	checkargs
+ ***/
+int insitulist(char *list) {
+  char *name, *next;
+  char buff[MAXSTRING];
+
+  strncpy(buff, list, MAXSTRING - 1);
+  buff[MAXSTRING - 1] = '\0';
+  Insitu = 0;
+  for (name = buff; name; name = next) {
+    next = strchr(name, ',');
+    if (next)
+      *next++ = '\0';
+    if (!strcmp(name, "census")) {
+      Insitu |= INSITUCENSUS;
+    } else if (!strcmp(name, "pores")) {
+      Insitu |= INSITUPORES;
+    } else if (!strcmp(name, "perc")) {
+      Insitu |= INSITUPERC;
+    } else if (!strcmp(name, "all")) {
+      Insitu |= INSITUCENSUS | INSITUPORES | INSITUPERC;
+    } else {
+      return (1);
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *	insituages
+ *
+ * 	Set the ages asked for with --analyze-at, a list of ages in
+ * 	hours separated by commas, in ascending order
+ *
+ * 	Arguments:	char pointer to the list
+ * 	Returns:	0 if okay, 1 if an age is not a number or there
+ * 				are more than MAXINSITU
+ *
+ *	Calls:		No other routines
+ *	Called by:	checkargs
+ ***/
+int insituages(char *list) {
+  int i, j;
+  float t;
+  char *p, *end;
+
+  Ninsitu = 0;
+  for (p = list; *p != '\0'; p = end) {
+    if (*p == ',') {
+      end = p + 1;
+      continue;
+    }
+    t = strtof(p, &end);
+    if (end == p || Ninsitu >= MAXINSITU)
+      return (1);
+    for (i = Ninsitu; i > 0 && Insitutime[i - 1] > t; i--) {
+      Insitutime[i] = Insitutime[i - 1];
+    }
+    Insitutime[i] = t;
+    Ninsitu++;
+  }
+
+  /* An age given twice is analyzed once */
+
+  for (i = j = 0; i < Ninsitu; i++) {
+    if (j == 0 || Insitutime[i] != Insitutime[j - 1])
+      Insitutime[j++] = Insitutime[i];
+  }
+  Ninsitu = j;
+
+  return (Ninsitu > 0 ? 0 : 1);
+}
+
+/***
+ *	insiturun
+ *
+ * 	Do the analyses asked for on one image buffer and add their
+ * 	results to Insituname.  The voxels are changed to the ids
+ * 	of the saved images in place.
+ *
+ * 	Arguments:	pointer to image buffer
+ * 	Returns:	0 if okay, nonzero otherwise (with the reason
+ * 				in Snaperrmsg)
+ *
+ *	Calls:		snapid, phase_census, poresizes,
+ *				perc_label_classes, id2phasename
+ *	Called by:	snapwrite
+ ***/
+int insiturun(struct Snapimg *img) {
+  int i, d, net, mindim, maxdiam, count[NPHASES], *ndiam;
+  size_t n, nvox, npore;
+  unsigned char id[SNAPNID], ispore[SNAPNID], *cl;
+  unsigned char link[PERCCLASSES][PERCCLASSES];
+  char phasename[MAXSTRING];
+  Percstats ps;
+  FILE *fp;
+  static const char *netname[2] = {"pore", "solid"};
+  static const char axis[3] = {'x', 'y', 'z'};
+
+  snapid(id);
+  nvox = (size_t)img->xsize * (size_t)img->ysize * (size_t)img->zsize;
+  for (n = 0; n < nvox; n++) {
+    img->vox[n] = id[img->vox[n]];
+  }
+  memset(ispore, 0, sizeof(ispore));
+  ispore[POROSITY] = ispore[EMPTYP] = ispore[EMPTYDP] = ispore[CRACKP] = 1;
+
+  fp = filehandler("disrealnew", Insituname, "APPEND");
+  if (!fp) {
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Could not open file %s",
+             Insituname);
+    return (1);
+  }
+  fseek(fp, 0L, SEEK_END);
+  if (ftell(fp) == 0)
+    fprintf(fp, "time_h,analysis,item,count,fraction\n");
+
+  if (Insitu & INSITUCENSUS) {
+    phase_census(img->vox, img->xsize, img->ysize, img->zsize, NPHASES, count,
+                 NULL);
+    for (i = 0; i < NPHASES; i++) {
+      if (count[i] > 0) {
+        id2phasename(i, phasename);
+        fprintf(fp, "%.4f,census,%s,%d,%.6f\n", img->time, phasename,
+                count[i], count[i] / (double)nvox);
+      }
+    }
+  }
+
+  cl = NULL;
+  if (Insitu & (INSITUPORES | INSITUPERC)) {
+    cl = (unsigned char *)malloc(nvox);
+    if (!cl) {
+      fclose(fp);
+      strcpy(Snaperrmsg, "Could not allocate memory for in-situ analysis");
+      return (1);
+    }
+  }
+
+  if (Insitu & INSITUPORES) {
+
+    /* Largest diameter counted as in calcporedist3d */
+
+    mindim = img->xsize;
+    if (img->ysize < mindim)
+      mindim = img->ysize;
+    if (img->zsize < mindim)
+      mindim = img->zsize;
+    maxdiam = (int)(0.2 * mindim);
+    if (maxdiam % 2 == 0)
+      maxdiam++;
+
+    npore = 0;
+    for (n = 0; n < nvox; n++) {
+      cl[n] = ispore[img->vox[n]];
+      npore += cl[n];
+    }
+    ndiam = ivector(maxdiam + 1);
+    if (!ndiam || poresizes(cl, img->zsize, img->ysize, img->xsize, maxdiam,
+                            ndiam)) {
+      if (ndiam)
+        free_ivector(ndiam);
+      free(cl);
+      fclose(fp);
+      strcpy(Snaperrmsg, "Could not allocate memory for in-situ analysis");
+      return (1);
+    }
+    for (d = 1; d <= maxdiam; d += 2) {
+      fprintf(fp, "%.4f,pores,%d,%d,%.6f\n", img->time, d, ndiam[d],
+              npore > 0 ? ndiam[d] / (double)npore : 0.0);
+    }
+    free_ivector(ndiam);
+  }
+
+  if (Insitu & INSITUPERC) {
+    memset(link, PERCNOLINK, sizeof(link));
+    link[1][1] = PERCLINK;
+    for (net = 0; net < 2; net++) {
+      for (n = 0; n < nvox; n++) {
+        cl[n] = (ispore[img->vox[n]] == (net == 0));
+      }
+      if (perc_label_classes(cl, NULL, img->xsize, img->ysize, img->zsize,
+                             link, &ps)) {
+        free(cl);
+        fclose(fp);
+        strcpy(Snaperrmsg, "Could not allocate memory for in-situ analysis");
+        return (1);
+      }
+      fprintf(fp, "%.4f,perc,%s,%d,%.6f\n", img->time, netname[net], ps.nset,
+              ps.nset / (double)nvox);
+      for (d = 0; d < 3; d++) {
+        fprintf(fp, "%.4f,perc,%s_%c,%d,%.6f\n", img->time, netname[net],
+                axis[d], ps.nthrough[d],
+                ps.nset > 0 ? ps.nthrough[d] / (double)ps.nset : 0.0);
+      }
+    }
+  }
+
+  if (cl)
+    free(cl);
+  if (fclose(fp)) {
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Error writing file %s",
+             Insituname);
+    return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	insitucheck
+ *
+ * 	Hand the microstructure to the analyses if the cycle loop
+ * 	has reached the next age asked for.  Ages passed in one
+ * 	cycle are analyzed once.
+ *
+ * 	Arguments:	float current time (h)
+ * 	Returns:	0 if okay, nonzero otherwise (with the reason
+ * 				in Snaperrmsg)
+ *
+ *	Calls:		snapqueue, snapwait
+ *	Called by:	hydcycle
+ ***/
+int insitucheck(float time) {
+  if (!Insitu || Insitunext >= Ninsitu || time < Insitutime[Insitunext])
+    return (0);
+
+  while (Insitunext < Ninsitu && time >= Insitutime[Insitunext]) {
+    Insitunext++;
+  }
+  if (snapqueue(Insituname, time, 1))
+    return (1);
+
+  return (Insituback ? 0 : snapwait());
+}
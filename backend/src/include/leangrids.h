@@ -0,0 +1,124 @@
+/***
+ *	leangrids
+ *
+ * 	Grids made only for the features that use them, asked for
+ * 	with --lean-grids.  Three of the grids of disrealnew serve
+ * 	one feature each, and a run that does not use the feature
+ * 	never reads them:
+ *
+ * 		Micorig:      the particle hydration table (parthyd),
+ * 		              written every Phydtimefreq hours
+ * 		Cshage:       the molar volume and water of C-S-H by
+ * 		              the cycle it formed in, which only differ
+ * 		              from cycle to cycle when Molarvcshcoeff_T
+ * 		              or Watercshcoeff_T is not zero
+ * 		Deactivated:  surface deactivation (Deactivate lines)
+ *
+ * 	Without --lean-grids they are made along with Mic, before
+ * 	the parameter file says which features are used.  With it,
+ * 	get_input leaves them for leangrids, which makes the ones
+ * 	the parameter file needs once it has been read, and every
+ * 	use of them is skipped while they are NULL.  Each is one
+ * 	byte per voxel.  The hydration history is the same as
+ * 	without --lean-grids; particle hydration is only assessed
+ * 	if its first time comes before End_time.
+ ***/
+
+/***
+ *	leangrids
+ *
+ * 	With --lean-grids, make the grids the features of the
+ * 	parameter file need: Micorig as a copy of Mic, Cshage and
+ * 	Deactivated cleared.  Does nothing without --lean-grids.
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay, 1 if out of memory
+ *
+ *	Calls:		cgrid
+ *	Called by:	get_input
+ ***/
+int leangrids(void) {
+  int ix, iy, iz;
+
+  if (!Leangrids)
+    return (0);
+
+  if (Phydtimefreq <= End_time) {
+    Micorig = cgrid(Xsyssize, Ysyssize, Zsyssize);
+    if (!Micorig)
+      return (1);
+    for (ix = 0; ix < Xsyssize; ix++) {
+      for (iy = 0; iy < Ysyssize; iy++) {
+        for (iz = 0; iz < Zsyssize; iz++) {
+          Micorig[ix][iy][iz] = Mic[ix][iy][iz];
+        }
+      }
+    }
+  }
+
+  if (Molarvcshcoeff_T != 0.0 || Watercshcoeff_T != 0.0) {
+    Cshage = cgrid(Xsyssize, Ysyssize, Zsyssize);
+    if (!Cshage)
+      return (1);
+    memset(gridblock(Cshage), 0, gridinfo(Cshage)->nbytes);
+  }
+
+  if (Numdeact > 0) {
+    Deactivated = cgrid(Xsyssize, Ysyssize, Zsyssize);
+    if (!Deactivated)
+      return (1);
+    memset(gridblock(Deactivated), 0, gridinfo(Deactivated)->nbytes);
+  }
+
+  return (0);
+}
+
+/***
+ *	gridreport
+ *
+ * 	Write the memory held by each grid the size of the system
+ * 	and by all of them
+ *
+ * 	Arguments:	FILE pointer
+ * 	Returns:	Nothing
+ *
+ *	Calls:		gridinfo, partmap_bytes
+ *	Called by:	get_input
+ ***/
+void gridreport(FILE *fp) {
+  int i;
+  size_t n, total;
+  void *grid[5];
+  static const char *name[5] = {"Mic", "Micorig", "Cshage", "Deactivated",
+                                "Faces"};
+
+  grid[0] = Mic;
+  grid[1] = Micorig;
+  grid[2] = Cshage;
+  grid[3] = Deactivated;
+  grid[4] = Faces;
+
+  fprintf(fp, "\nMemory of the grids (MB)%s:",
+          Leangrids ? " with --lean-grids" : "");
+  total = 0;
+  for (i = 0; i < 5; i++) {
+    if (grid[i]) {
+      n = gridinfo(grid[i])->nbytes;
+      total += n;
+      fprintf(fp, "\n\t%-12s %10.1f", name[i], n / 1048576.0);
+    } else {
+      fprintf(fp, "\n\t%-12s %10s", name[i], "not kept");
+    }
+  }
+  n = partmap_bytes(&Micpart);
+  total += n;
+  fprintf(fp, "\n\t%-12s %10.1f", "Micpart", n / 1048576.0);
+  n = ((size_t)Xsyssize * Ysyssize * Zsyssize + SURFBITS - 1) / SURFBITS *
+      sizeof(unsigned int);
+  total += n;
+  fprintf(fp, "\n\t%-12s %10.1f", "Surfmap", n / 1048576.0);
+  fprintf(fp, "\n\t%-12s %10.1f", "total", total / 1048576.0);
+  log_flush(fp);
+
+  return;
+}
@@ -0,0 +1,223 @@
+/***
+ *	liveview
+ *
+ * 	A live view of the microstructure for the desktop UI, asked
+ * 	for with --live name.  disrealnew exports a POSIX shared
+ * 	memory segment of that name (shm_open, as Python's
+ * 	multiprocessing.shared_memory opens it), holding a header of
+ * 	LIVEHEAD bytes and then the interior of Mic, one byte per
+ * 	voxel in C order (z varies fastest), with the diffusing
+ * 	species shown as porosity as in the saved images.  Every
+ * 	Liveevery cycles (--live-every) the cycle loop copies Mic and
+ * 	the counters into it, which costs one pass over memory and no
+ * 	file output, and the UI can draw slices of it at any time.
+ * 	With --solid-layer the copy is one memcpy of Solidmic (see
+ * 	solidlayer.h).
+ *
+ * 	The header holds, little-endian on the usual machines:
+ *
+ * 		 0  char[8]      "VCCTLLV1"
+ * 		 8  uint64       sequence number
+ * 		16  int32        LIVEHEAD, where the voxels start
+ * 		20  int32        state: LIVERUN, or LIVEDONE once the
+ * 		                 run has ended
+ * 		24  int32[3]     x, y and z size (smaller after
+ * 		                 coarsening; the segment is not)
+ * 		36  int32        cycle
+ * 		40  int32        number of cycles planned
+ * 		44  int32        number of phase counts at 68
+ * 		48  float[5]     resolution, time (h), degree of
+ * 		                 hydration, temperature (C), pH
+ * 		68  int32[]      voxels of each phase id
+ *
+ * 	The sequence number is odd while an update is being written,
+ * 	so a reader notes it, copies what it needs and keeps the copy
+ * 	only if the number is even and still the same.  The segment
+ * 	is removed when disrealnew ends; there is none on Windows.
+ ***/
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define LIVEMAGIC "VCCTLLV1"
+#define LIVEHEAD 512  /* bytes of header before the voxels */
+#define LIVENCOUNT 96 /* phase counts the header has room for */
+#define LIVERUN 1
+#define LIVEDONE 2
+
+struct Livehead {
+  char magic[8];
+  volatile uint64_t seq;
+  int32_t headsize;
+  int32_t state;
+  int32_t size[3];
+  int32_t cycle;
+  int32_t ncycle;
+  int32_t ncount;
+  float res;
+  float time;
+  float alpha;
+  float temp;
+  float ph;
+  int32_t count[LIVENCOUNT];
+};
+
+static struct Livehead *Livemap = NULL;
+static size_t Livelen = 0;
+static char Liveshm[MAXSTRING];
+
+/***
+ *	liveupdate
+ *
+ * 	Copy Mic and the counters into the live view, every
+ * 	Liveevery cycles or at once
+ *
+ * 	Arguments:	int nonzero to update whatever the cycle
+ * 	Returns:	Nothing
+ *
+ *	Calls:		snapid
+ *	Called by:	liveopen, hydcycle, hydfinish
+ ***/
+void liveupdate(int now) {
+  int ix, iy, iz, i;
+  size_t nvox;
+  unsigned char id[SNAPNID], *dst;
+
+  if (!Livemap || (!now && (Liveevery < 1 || Icyc % Liveevery)))
+    return;
+
+  /* The segment is sized for the system at the start */
+
+  nvox = (size_t)Xsyssize * (size_t)Ysyssize * (size_t)Zsyssize;
+  if (LIVEHEAD + nvox > Livelen)
+    return;
+
+  snapid(id);
+
+  Livemap->seq++;
+#if defined(__GNUC__)
+  __sync_synchronize();
+#endif
+
+  dst = (unsigned char *)Livemap + LIVEHEAD;
+  if (Solidmic) {
+    memcpy(dst, Solidmic, nvox);
+  } else {
+    for (ix = 0; ix < Xsyssize; ix++) {
+      for (iy = 0; iy < Ysyssize; iy++) {
+        for (iz = 0; iz < Zsyssize; iz++) {
+          *dst++ = id[(unsigned char)Mic[ix][iy][iz]];
+        }
+      }
+    }
+  }
+
+  Livemap->size[0] = Xsyssize;
+  Livemap->size[1] = Ysyssize;
+  Livemap->size[2] = Zsyssize;
+  Livemap->cycle = Icyc;
+  Livemap->ncycle = Ncyc;
+  Livemap->res = Res;
+  Livemap->time = Time_cur;
+  Livemap->alpha = Alpha_cur;
+  Livemap->temp = Temp_cur_b;
+  Livemap->ph = PH_cur;
+  Livemap->ncount = (NPHASES < LIVENCOUNT) ? NPHASES : LIVENCOUNT;
+  for (i = 0; i < Livemap->ncount; i++) {
+    Livemap->count[i] = Count[i];
+  }
+
+#if defined(__GNUC__)
+  __sync_synchronize();
+#endif
+  Livemap->seq++;
+
+  return;
+}
+
+/***
+ *	liveopen
+ *
+ * 	Create the shared memory segment for the system as it is
+ * 	now, if --live asked for one
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay or not asked for, nonzero if the
+ * 				segment could not be made
+ *
+ *	Calls:		liveupdate
+ *	Called by:	hydinit
+ ***/
+int liveopen(void) {
+#if !defined(_WIN32)
+  int fd;
+  void *p;
+#endif
+
+  if (strlen(Livename) == 0)
+    return (0);
+
+#if !defined(_WIN32)
+  /* shm_open wants one leading slash and no others */
+
+  snprintf(Liveshm, sizeof(Liveshm), "%s%s", (Livename[0] == '/') ? "" : "/",
+           Livename);
+  Livelen = LIVEHEAD + (size_t)Xsyssize * (size_t)Ysyssize * (size_t)Zsyssize;
+
+  fd = shm_open(Liveshm, O_CREAT | O_RDWR, 0644);
+  if (fd < 0)
+    return (1);
+  if (ftruncate(fd, (off_t)Livelen)) {
+    close(fd);
+    shm_unlink(Liveshm);
+    return (1);
+  }
+  p = mmap(NULL, Livelen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(Liveshm);
+    return (1);
+  }
+
+  Livemap = (struct Livehead *)p;
+  memset(Livemap, 0, LIVEHEAD);
+  memcpy(Livemap->magic, LIVEMAGIC, 8);
+  Livemap->headsize = LIVEHEAD;
+  Livemap->state = LIVERUN;
+  liveupdate(1);
+
+  return (0);
+#else
+  return (1);
+#endif
+}
+
+/***
+ *	liveclose
+ *
+ * 	Mark the live view finished, then unmap and remove it.  A
+ * 	UI that has it mapped keeps the last update.
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	freeallmem
+ ***/
+void liveclose(void) {
+#if !defined(_WIN32)
+  if (!Livemap)
+    return;
+
+  Livemap->state = LIVEDONE;
+  munmap(Livemap, Livelen);
+  shm_unlink(Liveshm);
+  Livemap = NULL;
+  Livelen = 0;
+#endif
+
+  return;
+}
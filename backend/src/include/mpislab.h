@@ -0,0 +1,331 @@
+/***
+ *	mpislab
+ *
+ * 	Slabs of a system over MPI ranks, for the conjugate gradient
+ * 	solutions of elastic and transport.  In a VCCTL_MPI build run
+ * 	under mpirun with more than one rank, the layers of constant
+ * 	z are split into one slab of consecutive layers per rank, in
+ * 	rank order.  A rank keeps the vectors of the solution only
+ * 	for its own layers and one halo layer on each side, which
+ * 	slabhalo fills from the ranks next to it (wrapping around
+ * 	periodically) before each product with the matrix.
+ *
+ * 	Dot products are added up layer by layer: each rank gives
+ * 	the sums of its own layers, and slabsum adds the sums of all
+ * 	of the layers in order, so every rank gets the same result,
+ * 	and it does not depend on the number of ranks.
+ *
+ * 	Without VCCTL_MPI, or with one rank, rank 0 owns every layer
+ * 	and the routines do nothing more than the serial code would.
+ ***/
+
+#ifdef VCCTL_MPI
+#include <mpi.h>
+#endif
+
+/***
+ *	This rank and the number of ranks, and the number of layers
+ *	split by slabsplit with the first layer of each rank
+ ***/
+int Mpirank = 0, Mpisize = 1;
+static int Slablayers = 0;
+static int *Slabfirst = NULL, *Slabcount = NULL;
+static double *Slablayersum = NULL;
+
+/***
+ *	slabstart
+ *
+ * 	Start MPI, if built with it.  The ranks other than 0 write
+ * 	standard output to the null device, so that only rank 0
+ * 	reports.
+ *
+ * 	Arguments:	int pointer to argc, char pointer to argv
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	main program
+ ***/
+void slabstart(int *argc, char ***argv) {
+#ifdef VCCTL_MPI
+  MPI_Init(argc, argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &Mpirank);
+  MPI_Comm_size(MPI_COMM_WORLD, &Mpisize);
+  if (Mpirank > 0 && !freopen("/dev/null", "w", stdout)) {
+    fprintf(stderr, "\nWARNING: Rank %d could not silence its output",
+            Mpirank);
+  }
+#endif
+
+  return;
+}
+
+/***
+ *	slabstop
+ *
+ * 	Free what slabsplit and slabsum keep, and stop MPI
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	main program
+ ***/
+void slabstop(void) {
+  free(Slabfirst);
+  Slabfirst = NULL;
+  free(Slabcount);
+  Slabcount = NULL;
+  free(Slablayersum);
+  Slablayersum = NULL;
+#ifdef VCCTL_MPI
+  MPI_Finalize();
+#endif
+
+  return;
+}
+
+/***
+ *	slabsplit
+ *
+ * 	Split nl layers into one slab per rank, the first nl % Mpisize
+ * 	ranks getting one layer more than the others
+ *
+ * 	Arguments:	int number of layers
+ * 				int pointers to the first layer of this rank
+ * 					and the one after its last
+ * 	Returns:	0 if okay, 1 if there are fewer layers than
+ * 				ranks or no memory
+ *
+ *	Calls:		No other routines
+ *	Called by:	elastic, transport
+ ***/
+int slabsplit(int nl, int *lo, int *hi) {
+  int r;
+
+  *lo = 0;
+  *hi = nl;
+  if (Mpisize < 2)
+    return (0);
+  if (nl < Mpisize)
+    return (1);
+
+  free(Slabfirst);
+  free(Slabcount);
+  free(Slablayersum);
+  Slabfirst = (int *)malloc((Mpisize + 1) * sizeof(int));
+  Slabcount = (int *)malloc(Mpisize * sizeof(int));
+  Slablayersum = (double *)malloc(nl * sizeof(double));
+  if (!Slabfirst || !Slabcount || !Slablayersum)
+    return (1);
+
+  Slablayers = nl;
+  for (r = 0; r <= Mpisize; r++) {
+    Slabfirst[r] = r * (nl / Mpisize) + ((r < nl % Mpisize) ? r : nl % Mpisize);
+  }
+  for (r = 0; r < Mpisize; r++) {
+    Slabcount[r] = Slabfirst[r + 1] - Slabfirst[r];
+  }
+  *lo = Slabfirst[Mpirank];
+  *hi = Slabfirst[Mpirank + 1];
+
+  return (0);
+}
+
+/***
+ *	slabhalo
+ *
+ * 	Fill the halo layers of a vector from the ranks next to this
+ * 	one.  The vector holds the lower halo layer, then this rank's
+ * 	nl layers, then the upper halo layer, each of len values.  The
+ * 	lowest layer of the system has the highest for its lower
+ * 	halo, as the periodic boundary conditions require, and the
+ * 	other way around.
+ *
+ * 	Arguments:	double pointer to the lower halo layer
+ * 				int values in a layer
+ * 				int number of layers of this rank
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	elastic, transport
+ ***/
+void slabhalo(double *v, int len, int nl) {
+#ifdef VCCTL_MPI
+  int below, above;
+
+  if (Mpisize < 2)
+    return;
+  below = (Mpirank + Mpisize - 1) % Mpisize;
+  above = (Mpirank + 1) % Mpisize;
+  MPI_Sendrecv(v + (size_t)nl * len, len, MPI_DOUBLE, above, 0, v, len,
+               MPI_DOUBLE, below, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  MPI_Sendrecv(v + len, len, MPI_DOUBLE, below, 1, v + (size_t)(nl + 1) * len,
+               len, MPI_DOUBLE, above, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+#endif
+
+  return;
+}
+
+/***
+ *	slabhalof
+ *
+ * 	The same as slabhalo for a vector of floats
+ *
+ * 	Arguments:	float pointer to the lower halo layer
+ * 				int values in a layer
+ * 				int number of layers of this rank
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	elastic
+ ***/
+void slabhalof(float *v, int len, int nl) {
+#ifdef VCCTL_MPI
+  int below, above;
+
+  if (Mpisize < 2)
+    return;
+  below = (Mpirank + Mpisize - 1) % Mpisize;
+  above = (Mpirank + 1) % Mpisize;
+  MPI_Sendrecv(v + (size_t)nl * len, len, MPI_FLOAT, above, 0, v, len,
+               MPI_FLOAT, below, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  MPI_Sendrecv(v + len, len, MPI_FLOAT, below, 1, v + (size_t)(nl + 1) * len,
+               len, MPI_FLOAT, above, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+#endif
+
+  return;
+}
+
+/***
+ *	slabsum
+ *
+ * 	Add up the sums of the layers of every rank, in the order of
+ * 	the layers
+ *
+ * 	Arguments:	double pointer to the sums of this rank's layers
+ * 				int number of layers of this rank
+ * 	Returns:	double sum over all of the layers
+ *
+ *	Calls:		No other routines
+ *	Called by:	elastic, transport
+ ***/
+double slabsum(double *part, int n) {
+  int k;
+  double sum;
+
+#ifdef VCCTL_MPI
+  if (Mpisize > 1) {
+    MPI_Allgatherv(part, n, MPI_DOUBLE, Slablayersum, Slabcount, Slabfirst,
+                   MPI_DOUBLE, MPI_COMM_WORLD);
+    part = Slablayersum;
+    n = Slablayers;
+  }
+#endif
+
+  sum = 0.0;
+  for (k = 0; k < n; k++) {
+    sum += part[k];
+  }
+
+  return (sum);
+}
+
+/***
+ *	slabreduce
+ *
+ * 	Add up an array of sums over the ranks, leaving the totals in
+ * 	the array on every rank
+ *
+ * 	Arguments:	double pointer to the array
+ * 				int number of values
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	elastic, transport
+ ***/
+void slabreduce(double *v, int n) {
+#ifdef VCCTL_MPI
+  if (Mpisize > 1)
+    MPI_Allreduce(MPI_IN_PLACE, v, n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+
+  return;
+}
+
+/***
+ *	slabmax
+ *
+ * 	The largest of a value over the ranks, such as a status
+ * 	that is nonzero if any rank failed
+ *
+ * 	Arguments:	int value on this rank
+ * 	Returns:	int largest value
+ *
+ *	Calls:		No other routines
+ *	Called by:	elastic, transport
+ ***/
+int slabmax(int v) {
+#ifdef VCCTL_MPI
+  if (Mpisize > 1)
+    MPI_Allreduce(MPI_IN_PLACE, &v, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+#endif
+
+  return (v);
+}
+
+/***
+ *	slabgather
+ *
+ * 	Gather the layers of every rank, len values each, into one
+ * 	array on rank 0
+ *
+ * 	Arguments:	double pointer to this rank's first layer
+ * 				double pointer to the whole array (rank 0)
+ * 				int values in a layer
+ * 	Returns:	0 if okay, 1 if no memory
+ *
+ *	Calls:		No other routines
+ *	Called by:	elastic, transport
+ ***/
+int slabgather(double *part, double *whole, int len) {
+#ifdef VCCTL_MPI
+  int r, *count, *first;
+
+  if (Mpisize < 2)
+    return (0);
+  count = (int *)malloc(2 * Mpisize * sizeof(int));
+  if (!count)
+    return (1);
+  first = count + Mpisize;
+  for (r = 0; r < Mpisize; r++) {
+    count[r] = Slabcount[r] * len;
+    first[r] = Slabfirst[r] * len;
+  }
+  MPI_Gatherv(part, count[Mpirank], MPI_DOUBLE, whole, count, first,
+              MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  free(count);
+#endif
+
+  return (0);
+}
+
+/***
+ *	slabturn
+ *
+ * 	Wait until every rank gets here, so that the ranks can take
+ * 	turns at a file
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	elastic
+ ***/
+void slabturn(void) {
+#ifdef VCCTL_MPI
+  if (Mpisize > 1)
+    MPI_Barrier(MPI_COMM_WORLD);
+#endif
+
+  return;
+}
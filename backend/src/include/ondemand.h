@@ -0,0 +1,193 @@
+/***
+ *	ondemand
+ *
+ * 	A look at a long run without waiting for its next image.
+ * 	Sending disrealnew SIGUSR1, or creating the control file
+ * 	named with --demand, asks for one; at the end of the cycle
+ * 	that is going on the loop then
+ *
+ * 		hands Mic to the snapshot writer as the image
+ * 		    root.demand.cycle.img (see snapshot.h),
+ * 		starts a checkpoint in Ckptname (see checkpoint.h),
+ * 		    which --restart can carry on from, and
+ * 		writes root.status with the state of the run, the
+ * 		    wall time and, with --perf, the time spent in
+ * 		    each part of the cycles,
+ *
+ * 	and removes the control file.  The image and checkpoint are
+ * 	written in the background as the scheduled ones are, so the
+ * 	loop only waits for the copy and the fork.  The signal
+ * 	handler only sets a flag, and it is only installed if
+ * 	SIGUSR1 is not already handled, so a program running the
+ * 	model through hydapi keeps its own.  The control file is
+ * 	looked for once per cycle, which costs one stat.  On Windows
+ * 	there is only the control file.
+ ***/
+
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <signal.h>
+#endif
+
+static volatile sig_atomic_t Demandsig = 0;
+static time_t Demandbegin = 0;
+
+#if !defined(_WIN32)
+/***
+ *	demandsignal
+ *
+ * 	Handler of SIGUSR1, which notes the request for the cycle
+ * 	loop
+ *
+ * 	Arguments:	int signal number
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	the system
+ ***/
+void demandsignal(int sig) {
+  (void)sig;
+  Demandsig = 1;
+
+  return;
+}
+#endif
+
+/***
+ *	demandinit
+ *
+ * 	Note the start of the run and install the handler of
+ * 	SIGUSR1, unless the process already handles or ignores it
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	hydinit
+ ***/
+void demandinit(void) {
+#if !defined(_WIN32)
+  struct sigaction sa, old;
+#endif
+
+  Demandbegin = time(NULL);
+  Demandsig = 0;
+
+#if !defined(_WIN32)
+  if (sigaction(SIGUSR1, NULL, &old) || old.sa_handler != SIG_DFL)
+    return;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = demandsignal;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &sa, NULL);
+#endif
+
+  return;
+}
+
+/***
+ *	demandstatus
+ *
+ * 	Write the state of the run and its timings to the status
+ * 	file
+ *
+ * 	Arguments:	char pointer to the status file name
+ * 				char pointer to the image name
+ * 				int nonzero if the checkpoint was started
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	demandserve
+ ***/
+int demandstatus(char *name, char *imgname, int ckptok) {
+  int i, ndone;
+  double wall;
+  FILE *fp;
+  static const char *part[PERFNTIMERS] = {
+      "dissolve", "hydrate",     "pHpred", "burn3d", "burnset", "parthyd",
+      "calcT",    "measuresurf", "census", "images", "whole cycles"};
+
+  fp = fopen(name, "w");
+  if (!fp)
+    return (1);
+
+  wall = difftime(time(NULL), Demandbegin);
+  ndone = Icyc - Icycstart + 1;
+
+  fprintf(fp, "Cycle %d of %d\n", Icyc, Ncyc);
+  fprintf(fp, "Time %.4f h, degree of hydration %.4f\n", Time_cur,
+          Alpha_cur);
+  fprintf(fp, "Temperature %.2f C, pH %.3f\n", Temp_cur_b, PH_cur);
+  fprintf(fp, "System %d x %d x %d at %.3f micrometers\n", Xsyssize,
+          Ysyssize, Zsyssize, Res);
+  fprintf(fp, "Wall time %.0f s for %d cycles", wall, ndone);
+  if (ndone > 0)
+    fprintf(fp, " (%.3f s each)", wall / (double)ndone);
+  fprintf(fp, "\nImage %s\n", imgname);
+  fprintf(fp, "Checkpoint %s%s\n", Ckptname, ckptok ? "" : " (failed)");
+
+  if (Perfon) {
+    fprintf(fp, "Time spent in each part (s), whole run and this cycle:\n");
+    for (i = 0; i < PERFNTIMERS; i++) {
+      fprintf(fp, "\t%-12s %12.3f %10.4f\n", part[i],
+              Perftotal[i] + Perftime[i], Perftime[i]);
+    }
+  } else {
+    fprintf(fp, "Run with --perf for the time spent in each part\n");
+  }
+  fprintf(fp, "This cycle: %ld ant steps, %ld ants reacted, %d "
+              "nucleations, %d rejected tries\n",
+          Perfcount[PERFANTSTEPS], Perfcount[PERFANTSGONE], Nnucleate,
+          Nrejected);
+
+  return (fclose(fp) ? 1 : 0);
+}
+
+/***
+ *	demandserve
+ *
+ * 	At the end of a cycle, see whether a look at the run has
+ * 	been asked for and if so save the image, start the
+ * 	checkpoint and write the status file
+ *
+ * 	Arguments:	int next custom image time
+ * 				float previous uncorrected time of findnewtime
+ * 	Returns:	Nothing
+ *
+ *	Calls:		snapsave, writecheckpoint, demandstatus
+ *	Called by:	hydcycle
+ ***/
+void demandserve(int customentry, float prevtime) {
+  int ckptok;
+  char imgname[MAXSTRING], statname[MAXSTRING];
+  struct stat st;
+
+  if (!Demandsig &&
+      (strlen(Demandname) == 0 || stat(Demandname, &st) != 0))
+    return;
+
+  Demandsig = 0;
+  if (strlen(Demandname) > 0)
+    remove(Demandname);
+
+  snprintf(imgname, sizeof(imgname), "%s%s.demand.%d.img", WorkingDirectory,
+           Fileroot, Icyc);
+  snprintf(statname, sizeof(statname), "%s%s.status", WorkingDirectory,
+           Fileroot);
+
+  if (snapsave(imgname, Time_cur)) {
+    fprintf(Logfile, "\nWARNING: Could not save image %s: %s", imgname,
+            Snaperrmsg);
+  }
+  ckptok = !writecheckpoint(customentry, prevtime);
+  if (demandstatus(statname, imgname, ckptok)) {
+    fprintf(Logfile, "\nWARNING: Could not write status file %s", statname);
+  }
+  fprintf(Logfile, "\nSaved %s and %s on request at cycle %d", imgname,
+          statname, Icyc);
+  log_flush(Logfile);
+
+  return;
+}
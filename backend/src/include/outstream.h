@@ -0,0 +1,120 @@
+/***
+ *	outstream
+ *
+ * 	The output files that get a few lines in every cycle: the
+ * 	data file, the particle hydration file and SfumeEffect.csv.
+ * 	Each used to be opened for appending, written and closed
+ * 	again every time, which on a network file system (or with
+ * 	a virus scanner watching) costs more than the writing.
+ * 	outopen now opens one the first time and keeps it open with
+ * 	a large buffer, and outflush writes the buffers out once
+ * 	Outflushsecs seconds (--flush-secs) have gone by.  They are
+ * 	also written out before a checkpoint takes the lengths of
+ * 	the files, and when they are closed at the end of the run or
+ * 	the program exits.
+ ***/
+
+#define OUTDATA 0
+#define OUTPHR 1
+#define OUTSFUME 2
+#define OUTNFILES 3
+
+#define OUTBUFSIZE (256 * 1024)
+#define OUTFLUSHSECS 5.0
+
+static FILE *Outfp[OUTNFILES];
+static char *Outbuf[OUTNFILES];
+static time_t Outlast = 0;
+float Outflushsecs = OUTFLUSHSECS;
+
+/***
+ *	outopen
+ *
+ * 	The stream for appending to one of the per-cycle output
+ * 	files, opened with its buffer the first time it is asked for
+ *
+ * 	Arguments:	int file (OUTDATA, OUTPHR or OUTSFUME)
+ * 				char pointer to the file name
+ * 	Returns:	FILE pointer, or NULL if the file could not be
+ * 				opened
+ *
+ *	Calls:		filehandler
+ *	Called by:	hydcycle, hydfinish, parthyd, dissolve
+ ***/
+FILE *outopen(int k, char *name) {
+  if (Outfp[k])
+    return (Outfp[k]);
+
+  Outfp[k] = (k == OUTSFUME) ? fopen(name, "a")
+                             : filehandler("disrealnew", name, "APPEND");
+  if (!Outfp[k])
+    return (NULL);
+
+  /* Without the memory for a buffer the file keeps the stdio default */
+
+  Outbuf[k] = (char *)malloc(OUTBUFSIZE);
+  if (Outbuf[k] && setvbuf(Outfp[k], Outbuf[k], _IOFBF, OUTBUFSIZE)) {
+    free(Outbuf[k]);
+    Outbuf[k] = NULL;
+  }
+  if (Outlast == 0)
+    Outlast = time(NULL);
+
+  return (Outfp[k]);
+}
+
+/***
+ *	outflush
+ *
+ * 	Write out the buffers of the per-cycle output files, if
+ * 	Outflushsecs seconds have gone by since they were last
+ * 	written out or if asked to at once
+ *
+ * 	Arguments:	int nonzero to write them out at once
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	hydcycle, parthyd, dissolve, prepcheckpoint
+ ***/
+void outflush(int now) {
+  int k;
+  time_t t;
+
+  t = time(NULL);
+  if (!now && difftime(t, Outlast) < Outflushsecs)
+    return;
+
+  for (k = 0; k < OUTNFILES; k++) {
+    if (Outfp[k])
+      fflush(Outfp[k]);
+  }
+  Outlast = t;
+
+  return;
+}
+
+/***
+ *	outclose
+ *
+ * 	Close the per-cycle output files that are open, writing out
+ * 	what their buffers hold
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	hydfinish, freeallmem
+ ***/
+void outclose(void) {
+  int k;
+
+  for (k = 0; k < OUTNFILES; k++) {
+    if (Outfp[k])
+      fclose(Outfp[k]);
+    Outfp[k] = NULL;
+    free(Outbuf[k]);
+    Outbuf[k] = NULL;
+  }
+
+  return;
+}
@@ -190,7 +190,29 @@ void laguer(fcomplex a[], int m, fcomplex *x, float eps, int polish) {
 #define EPS 2.0e-6
 #define MAXM 100
 
-void zroots(fcomplex a[], int m, fcomplex roots[], int polish) {
+/***
+ *	zroots
+ *
+ * 	Find all m roots of a polynomial with complex coefficients
+ * 	a[0..m], by Laguerre's method with deflation.  The search
+ * 	for root j begins at start[j], or at zero if start is NULL.
+ * 	The pore solution changes little from one cycle to the
+ * 	next, so the roots found in the last cycle are close to
+ * 	the new ones and take only a few iterations to reach.
+ *
+ * 	Arguments:	fcomplex coefficients a[0..m]
+ * 				int m (degree)
+ * 				fcomplex roots[1..m], sorted by real part
+ * 				fcomplex start[1..m], or NULL
+ * 				int polish (nonzero to polish each root on the
+ * 				undeflated polynomial)
+ * 	Returns:	Nothing
+ *
+ *	Calls:		laguer
+ *	Called by:	pHpred
+ ***/
+void zroots(fcomplex a[], int m, fcomplex roots[], fcomplex start[],
+            int polish) {
   int jj, j, i;
   fcomplex x, b, c, ad[MAXM];
   /* void laguer(); */
@@ -198,7 +220,7 @@ void zroots(fcomplex a[], int m, fcomplex roots[], int polish) {
   for (j = 0; j <= m; j++)
     ad[j] = a[j];
   for (j = m; j >= 1; j--) {
-    x = Complex(0.0, 0.0);
+    x = (start) ? start[j] : Complex(0.0, 0.0);
     laguer(ad, j, &x, EPS, 0);
     if (fabs(x.i) <= (2.0 * EPS * fabs(x.r)))
       x.i = 0.0;
@@ -586,9 +608,15 @@ void pHpred(void) {
         roots[3] = Complex(0.0, 0.0);
         roots[4] = Complex(0.0, 0.0);
 
-        /* roots represent Ca++ concentration */
+        /***
+         *	roots represent Ca++ concentration; the search
+         *	starts from the roots of the last quartic solved
+         ***/
 
-        zroots(coef, 4, roots, 1);
+        zroots(coef, 4, roots, (PHrootsok) ? PHroots : NULL, 1);
+        for (j = 1; j <= 4; j++)
+          PHroots[j] = roots[j];
+        PHrootsok = 1;
 
         sumbest = 100;
 
@@ -0,0 +1,368 @@
+/***
+ *	parambundle
+ *
+ * 	Bundle of the small text inputs of a run, used when
+ * 	disrealnew is run with --bundle file.  The parameter file,
+ * 	the custom output times, the calorimetry and temperature
+ * 	histories and the alkali and slag characteristics are kept
+ * 	in one binary file, which is read with a single fread at
+ * 	startup.  Each input is then handed to its reader as a
+ * 	stream in memory, so the parsing code is the same whether
+ * 	an input comes from the bundle or from its own file.
+ *
+ * 	The bundle starts with BUNDLEMAGIC, BUNDLEVERSION, the
+ * 	number of inputs and a checksum of the rest of the file.
+ * 	Each input follows with its name, size, modification time
+ * 	and contents.  An input is only taken from the bundle if
+ * 	its file still has the same size and modification time;
+ * 	otherwise, or if the bundle is missing, damaged or from
+ * 	another version, the input is read from its own file and a
+ * 	new bundle is written once init is done.  Like a
+ * 	checkpoint, a bundle is only meaningful on the machine
+ * 	type that wrote it.
+ *
+ * 	Not available on Windows, which has no fmemopen; there the
+ * 	inputs are always read from their own files.
+ ***/
+
+#define BUNDLEMAGIC "VCCTL disrealnew bundle"
+#define BUNDLEMAGICLEN 32
+#define BUNDLEVERSION 1
+
+/* Length of the header up to the first input */
+#define BUNDLEHEAD                                                             \
+  (BUNDLEMAGICLEN + 2 * sizeof(int) + sizeof(unsigned long long))
+
+/***
+ *	bundlesum
+ *
+ * 	Add a block of bytes to a 64-bit FNV-1a checksum
+ *
+ * 	Arguments:	unsigned long long checksum so far
+ * 				char pointer to the block
+ * 				size_t length of the block in bytes
+ * 	Returns:	unsigned long long checksum
+ *
+ *	Calls:		No other routines
+ *	Called by:	bundleload, bundleput
+ ***/
+unsigned long long bundlesum(unsigned long long h, const char *p, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    h ^= (unsigned char)p[i];
+    h *= 1099511628211ULL;
+  }
+
+  return (h);
+}
+
+#if !defined(_WIN32)
+
+/***
+ *	bundlestat
+ *
+ * 	Get the size and modification time of an input file
+ *
+ * 	Arguments:	char pointer to file name
+ * 				long long pointers to size and time
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	bundleopen, bundleput
+ ***/
+int bundlestat(char *name, long long *size, long long *mtime) {
+  struct stat st;
+
+  if (stat(name, &st))
+    return (1);
+  *size = (long long)st.st_size;
+  *mtime = (long long)st.st_mtime;
+
+  return (0);
+}
+
+/***
+ *	bundleload
+ *
+ * 	Read the bundle named by --bundle, if any, and find the
+ * 	inputs in it.  A bundle that cannot be used is noted in
+ * 	the log and left for bundlesave to replace.
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		bundlesum
+ *	Called by:	hydinit
+ ***/
+void bundleload(void) {
+  int k, n, version, nlen;
+  long len;
+  char *p, *end;
+  unsigned long long sum;
+  FILE *fp;
+
+  Bundlenum = Bundlenused = 0;
+  Bundledirty = 0;
+  if (strlen(Bundlename) == 0)
+    return;
+  Bundledirty = 1;
+
+  if ((fp = fopen(Bundlename, "rb")) == NULL) {
+    fprintf(Logfile, "\nNo parameter bundle %s yet", Bundlename);
+    log_flush(Logfile);
+    return;
+  }
+
+  if (fseek(fp, 0L, SEEK_END) || (len = ftell(fp)) < (long)BUNDLEHEAD ||
+      fseek(fp, 0L, SEEK_SET) ||
+      (Bundlebuf = (char *)malloc((size_t)len)) == NULL ||
+      fread(Bundlebuf, 1, (size_t)len, fp) != (size_t)len) {
+    fclose(fp);
+    goto unusable;
+  }
+  fclose(fp);
+
+  p = Bundlebuf;
+  end = Bundlebuf + len;
+  if (strncmp(p, BUNDLEMAGIC, BUNDLEMAGICLEN))
+    goto unusable;
+  p += BUNDLEMAGICLEN;
+  memcpy(&version, p, sizeof(int));
+  p += sizeof(int);
+  memcpy(&n, p, sizeof(int));
+  p += sizeof(int);
+  memcpy(&sum, p, sizeof(sum));
+  p += sizeof(sum);
+  if (version != BUNDLEVERSION || n < 0 || n > BUNDLEMAX ||
+      bundlesum(14695981039346656037ULL, p, (size_t)(end - p)) != sum)
+    goto unusable;
+
+  for (k = 0; k < n; k++) {
+    if (end - p < (long)(sizeof(int) + 2 * sizeof(long long)))
+      goto unusable;
+    memcpy(&nlen, p, sizeof(int));
+    p += sizeof(int);
+    memcpy(&(Bundledir[k].size), p, sizeof(long long));
+    p += sizeof(long long);
+    memcpy(&(Bundledir[k].mtime), p, sizeof(long long));
+    p += sizeof(long long);
+    if (nlen < 1 || Bundledir[k].size < 0 ||
+        end - p < nlen + Bundledir[k].size || p[nlen - 1] != '\0')
+      goto unusable;
+    Bundledir[k].name = p;
+    p += nlen;
+    Bundledir[k].data = p;
+    p += Bundledir[k].size;
+  }
+  if (p != end)
+    goto unusable;
+
+  Bundlenum = n;
+  Bundledirty = 0;
+  fprintf(Logfile, "\nRead parameter bundle %s with %d inputs", Bundlename, n);
+  log_flush(Logfile);
+
+  return;
+
+unusable:
+  fprintf(Logfile, "\nWARNING: Parameter bundle %s cannot be used; reading "
+                   "the inputs from their own files",
+          Bundlename);
+  log_flush(Logfile);
+  if (Bundlebuf)
+    free(Bundlebuf);
+  Bundlebuf = NULL;
+  Bundlenum = 0;
+
+  return;
+}
+
+/***
+ *	bundleopen
+ *
+ * 	Open a text input for reading, from the bundle if it is
+ * 	there and its file has not changed since, or else from its
+ * 	own file as filehandler would
+ *
+ * 	Arguments:	char pointer to program name
+ * 				char pointer to file name
+ * 				char pointer to filehandler mode (READ or
+ * 				READ_NOFAIL)
+ * 	Returns:	FILE pointer, or NULL if the input could not be
+ * 				opened
+ *
+ *	Calls:		bundlestat, filehandler
+ *	Called by:	get_input, init
+ ***/
+FILE *bundleopen(char *prog, char *name, char *mode) {
+  int k;
+  long long size, mtime;
+  FILE *fp;
+
+  if (strlen(Bundlename) == 0)
+    return (filehandler(prog, name, mode));
+
+  for (k = 0; k < Bundlenum && strcmp(Bundledir[k].name, name); k++)
+    ;
+
+  /* An empty input is simply read from its file */
+
+  fp = NULL;
+  if (k < Bundlenum && Bundledir[k].size > 0 &&
+      !bundlestat(name, &size, &mtime) && size == Bundledir[k].size &&
+      mtime == Bundledir[k].mtime) {
+    fp = fmemopen(Bundledir[k].data, (size_t)size, "r");
+  }
+
+  if (!fp) {
+    fp = filehandler(prog, name, mode);
+    if (!fp)
+      return (NULL);
+    Bundledirty = 1;
+  }
+
+  /* Remember the input for the next bundle */
+
+  for (k = 0; k < Bundlenused && strcmp(Bundleused[k], name); k++)
+    ;
+  if (k == Bundlenused && Bundlenused < BUNDLEMAX)
+    strcpy(Bundleused[Bundlenused++], name);
+
+  return (fp);
+}
+
+/***
+ *	bundleput
+ *
+ * 	Write one input to a new bundle
+ *
+ * 	Arguments:	FILE pointer to the bundle
+ * 				char pointer to file name of the input
+ * 				unsigned long long pointer to the checksum
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		bundlestat, bundlesum
+ *	Called by:	bundlesave
+ ***/
+int bundleput(FILE *fp, char *name, unsigned long long *sum) {
+  int nlen, status;
+  long long size, mtime;
+  char *data;
+  FILE *fin;
+
+  if (bundlestat(name, &size, &mtime) || (fin = fopen(name, "rb")) == NULL)
+    return (1);
+
+  data = (char *)malloc((size_t)((size > 0) ? size : 1));
+  if (!data || fread(data, 1, (size_t)size, fin) != (size_t)size) {
+    if (data)
+      free(data);
+    fclose(fin);
+    return (1);
+  }
+  fclose(fin);
+
+  nlen = (int)strlen(name) + 1;
+  status = (fwrite(&nlen, sizeof(int), 1, fp) != 1);
+  status |= (fwrite(&size, sizeof(long long), 1, fp) != 1);
+  status |= (fwrite(&mtime, sizeof(long long), 1, fp) != 1);
+  status |= (fwrite(name, 1, (size_t)nlen, fp) != (size_t)nlen);
+  status |= (fwrite(data, 1, (size_t)size, fp) != (size_t)size);
+
+  *sum = bundlesum(*sum, (char *)&nlen, sizeof(int));
+  *sum = bundlesum(*sum, (char *)&size, sizeof(long long));
+  *sum = bundlesum(*sum, (char *)&mtime, sizeof(long long));
+  *sum = bundlesum(*sum, name, (size_t)nlen);
+  *sum = bundlesum(*sum, data, (size_t)size);
+  free(data);
+
+  return (status);
+}
+
+/***
+ *	bundlesave
+ *
+ * 	Write a new bundle with every input opened in this run, if
+ * 	any of them had to be read from its own file.  The bundle
+ * 	is written under a temporary name and renamed when
+ * 	complete.  A bundle that cannot be written is noted in the
+ * 	log; the run goes on without it.
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		bundleput
+ *	Called by:	hydinit
+ ***/
+void bundlesave(void) {
+  int k, version, status;
+  char magic[BUNDLEMAGICLEN], tmpname[MAXSTRING];
+  unsigned long long sum;
+  FILE *fp;
+
+  if (strlen(Bundlename) == 0 || !Bundledirty || Bundlenused == 0)
+    return;
+
+  snprintf(tmpname, sizeof(tmpname), "%s.tmp", Bundlename);
+  if ((fp = fopen(tmpname, "wb")) == NULL) {
+    fprintf(Logfile, "\nWARNING: Could not write parameter bundle %s",
+            Bundlename);
+    log_flush(Logfile);
+    return;
+  }
+
+  memset(magic, 0, sizeof(magic));
+  strcpy(magic, BUNDLEMAGIC);
+  version = BUNDLEVERSION;
+  sum = 0;
+  status = (fwrite(magic, 1, sizeof(magic), fp) != sizeof(magic));
+  status |= (fwrite(&version, sizeof(int), 1, fp) != 1);
+  status |= (fwrite(&Bundlenused, sizeof(int), 1, fp) != 1);
+  status |= (fwrite(&sum, sizeof(sum), 1, fp) != 1);
+
+  sum = 14695981039346656037ULL;
+  for (k = 0; k < Bundlenused && !status; k++)
+    status |= bundleput(fp, Bundleused[k], &sum);
+
+  /* The checksum goes in its place in the header */
+
+  if (!status) {
+    status |= fseek(fp, (long)(BUNDLEMAGICLEN + 2 * sizeof(int)), SEEK_SET);
+    status |= (fwrite(&sum, sizeof(sum), 1, fp) != 1);
+  }
+  status |= fclose(fp);
+
+  if (status || rename(tmpname, Bundlename)) {
+    remove(tmpname);
+    fprintf(Logfile, "\nWARNING: Could not write parameter bundle %s",
+            Bundlename);
+  } else {
+    Bundledirty = 0;
+    fprintf(Logfile, "\nWrote parameter bundle %s with %d inputs", Bundlename,
+            Bundlenused);
+  }
+  log_flush(Logfile);
+
+  return;
+}
+
+#else
+
+void bundleload(void) {
+  if (strlen(Bundlename) > 0) {
+    fprintf(Logfile, "\nWARNING: Parameter bundles are not available on "
+                     "this platform");
+    log_flush(Logfile);
+  }
+
+  return;
+}
+
+FILE *bundleopen(char *prog, char *name, char *mode) {
+  return (filehandler(prog, name, mode));
+}
+
+void bundlesave(void) { return; }
+
+#endif
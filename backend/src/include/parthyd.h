@@ -1,56 +1,154 @@
 
 /***
- *	parthyd
+ *	isclinker
  *
- * 	Assess relative particle hydration
+ * 	Decide whether a phase counts toward the hydration of a
+ * 	cement particle
  *
- * 	Arguments:	None
- * 	Returns:	Status flag (0 if okay, -1 if not exiting);
+ * 	Arguments:	char phase id
+ * 	Returns:	1 if it does, 0 otherwise
  *
  *	Calls:		No other routines
- *	Called by:	disrealnew
+ *	Called by:	partcount, partlost
  ***/
+int isclinker(char valmic) {
+  return ((valmic == C3S) || (valmic == C2S) || (valmic == C3A) ||
+          (valmic == C4AF) || (valmic == OC3A) || (valmic == K2SO4) ||
+          (valmic == NA2SO4));
+}
 
-#define NPARTHYD 200000
-
-int parthyd(void) {
-  int *norig, *nleft, mult1, mult2;
-  int ix, iy, iz, valpart, partmax;
-  float alpart;
-  char valmic, valmicorig;
-  FILE *phydfile;
-
-  /* Initialize the particle count arrays */
+/***
+ *	partcount
+ *
+ * 	Count the original and the remaining clinker pixels of
+ * 	every particle over the whole microstructure
+ *
+ * 	Arguments:	None
+ * 	Returns:	Status flag (0 if okay, MEMERR if not)
+ *
+ *	Calls:		isclinker, partmap_get
+ *	Called by:	parthyd
+ ***/
+int partcount(void) {
+  int ix, iy, iz, valpart;
 
-  norig = NULL;
-  nleft = NULL;
+  if (Verbose_flag > 1) {
+    fprintf(stderr, "\nDEBUG: Counting particle pixels");
+    fflush(stderr);
+  }
 
-  mult1 = mult2 = 1;
+  Partmax = Micpart.maxid;
 
-  norig = (int *)calloc((size_t)NPARTHYD, sizeof(int));
-  if (!norig) {
-    fprintf(stderr, "\nERROR: Could not allocate space for norig array.");
+  if (Partorig)
+    free(Partorig);
+  if (Partleft)
+    free(Partleft);
+  Partorig = (int *)calloc((size_t)(Partmax + 1), sizeof(int));
+  Partleft = (int *)calloc((size_t)(Partmax + 1), sizeof(int));
+  if (!Partorig || !Partleft) {
+    fprintf(stderr, "\nERROR: Could not allocate space for particle counts.");
     fflush(stderr);
+    if (Partorig)
+      free(Partorig);
+    if (Partleft)
+      free(Partleft);
+    Partorig = Partleft = NULL;
+    Partmax = 0;
     return (MEMERR);
   }
 
-  nleft = (int *)calloc((size_t)NPARTHYD, sizeof(int));
-  if (!nleft) {
-    fprintf(stderr, "\nERROR: Could not allocate space for nleft array.");
-    fflush(stderr);
-    free(norig);
-    return (MEMERR);
+  /* Negative ids are not particles */
+
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      for (iz = 0; iz < Zsyssize; iz++) {
+        valpart = partmap_get(&Micpart, ix, iy, iz);
+        if (valpart <= 0)
+          continue;
+        if (isclinker(Mic[ix][iy][iz]))
+          Partleft[valpart]++;
+        if (isclinker(Micorig[ix][iy][iz]))
+          Partorig[valpart]++;
+      }
+    }
   }
 
+  Partok = 1;
+
+  return (0);
+}
+
+/***
+ *	partlost
+ *
+ * 	Take a pixel out of the remaining clinker count of its
+ * 	particle.  Must be called just before the pixel at
+ * 	(x,y,z) is changed, while it still holds its old phase;
+ * 	pixels that are not clinker or not in a particle are left
+ * 	alone.  A pixel passone has marked as soluble holds its
+ * 	phase plus OFFSET, which is taken off before the test.
+ *
+ * 	Moves of the same sweep in different slabs can reach the
+ * 	same particle, so the update is atomic.
+ *
+ * 	Arguments:	int x,y,z coordinates of the pixel
+ * 	Returns:	Nothing
+ *
+ *	Calls:		isclinker, partmap_get
+ *	Called by:	dissolve and the reaction routines of hydrealnew
+ ***/
+void partlost(int x, int y, int z) {
+  int valpart, phid;
+
+  if (!Partok)
+    return;
+
+  phid = Mic[x][y][z];
+  if (phid >= OFFSET)
+    phid -= OFFSET;
+
+  valpart = partmap_get(&Micpart, x, y, z);
+  if (valpart <= 0 || valpart > Partmax || !isclinker(phid))
+    return;
+
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+  Partleft[valpart]--;
+
+  return;
+}
+
+/***
+ *	parthyd
+ *
+ * 	Assess relative particle hydration
+ *
+ * 	The counts are made over the whole microstructure on the
+ * 	first call and after a crack is added; otherwise they are
+ * 	the ones partlost has kept up to date, and only the table
+ * 	is written.
+ *
+ * 	Arguments:	None
+ * 	Returns:	Status flag (0 if okay, MEMERR if not)
+ *
+ *	Calls:		partcount, outopen, outflush
+ *	Called by:	disrealnew
+ ***/
+int parthyd(void) {
+  int ix;
+  float alpart;
+  FILE *phydfile;
+
   if (Verbose_flag > 1) {
     fprintf(stderr, "\nDEBUG: In parthyd now.");
     fflush(stderr);
   }
-  for (ix = 0; ix < NPARTHYD; ix++) {
-    nleft[ix] = norig[ix] = 0;
-  }
 
-  phydfile = filehandler("parthyd", Phrname, "APPEND");
+  if (!Partok && partcount())
+    return (MEMERR);
+
+  phydfile = outopen(OUTPHR, Phrname);
   if (!phydfile) {
     fprintf(stderr, "\nERROR: Cannot open file %s", Phrname);
     fflush(stderr);
@@ -64,146 +162,21 @@ int parthyd(void) {
 
   fprintf(phydfile, "%d %f\n", Cyccnt, Alpha_cur);
 
-  partmax = 0;
-
-  /***
-   *	Scan the microstructure pixel by pixel
-   *	and update counts
-   ***/
-
-  if (Verbose_flag > 1) {
-    fprintf(stderr, "\nDEBUG: NPARTHYD is %d", NPARTHYD);
-    fflush(stderr);
-  }
-
-  for (ix = 0; ix < Xsyssize; ix++) {
-    if (Verbose_flag > 1) {
-      fprintf(stderr, "\nDEBUG: x = %d", ix);
-      fflush(stderr);
-    }
-    for (iy = 0; iy < Ysyssize; iy++) {
-      for (iz = 0; iz < Zsyssize; iz++) {
-
-        /* CRITICAL: Add array bounds validation before access */
-        if (ix >= Xsyssize || iy >= Ysyssize || iz >= Zsyssize) {
-          fprintf(
-              stderr,
-              "\nERROR: Array bounds exceeded at (%d,%d,%d), limits=(%d,%d,%d)",
-              ix, iy, iz, Xsyssize, Ysyssize, Zsyssize);
-          fflush(stderr);
-          return (MEMERR);
-        }
-
-        if (Micpart[ix][iy][iz] != 0) {
-          valpart = Micpart[ix][iy][iz];
-
-          /* CRITICAL: Check for negative valpart causing buffer underflow */
-          if (valpart < 0) {
-            continue; /* Skip this particle to prevent segfault */
-          }
-
-          if (valpart > partmax)
-            partmax = valpart;
-
-          valmic = Mic[ix][iy][iz];
-          if ((valmic == C3S) || (valmic == C2S) || (valmic == C3A) ||
-              (valmic == C4AF) || (valmic == OC3A) || (valmic == K2SO4) ||
-              (valmic == NA2SO4)) {
-
-            if (valpart >= mult1 * NPARTHYD) {
-              if (Verbose_flag > 2) {
-                fprintf(stderr, "\nDEBUG: Reallocating nleft now... ");
-                fflush(stderr);
-              }
-              mult1++;
-              nleft = (int *)realloc((int *)nleft,
-                                     (size_t)(mult1 * NPARTHYD * sizeof(int)));
-              if (Verbose_flag > 1) {
-                fprintf(stderr, " Done!");
-                fflush(stderr);
-              }
-              if (!nleft) {
-                fprintf(stderr,
-                        "\nERROR in parthyd:  Could not reallocate space for "
-                        "nleft array.");
-                fflush(stderr);
-                free(norig);
-                return (MEMERR);
-              }
-              /* Initialize newly allocated memory to zero */
-              for (int i = (mult1 - 1) * NPARTHYD; i < mult1 * NPARTHYD; i++) {
-                nleft[i] = 0;
-              }
-            }
-
-            /* CRITICAL: Protection against negative array access */
-            if (valpart >= 0 && valpart < mult1 * NPARTHYD) {
-              nleft[valpart]++;
-            }
-          }
-
-          valmicorig = Micorig[ix][iy][iz];
-
-          if ((valmicorig == C3S) || (valmicorig == C2S) ||
-              (valmicorig == C3A) || (valmicorig == C4AF) ||
-              (valmicorig == OC3A) || (valmicorig == K2SO4) ||
-              (valmicorig == NA2SO4)) {
-
-            if (valpart >= mult2 * NPARTHYD) {
-              if (Verbose_flag > 2) {
-                fprintf(stderr, "\nDEBUG: Reallocating norig now... ");
-                fflush(stderr);
-              }
-              mult2++;
-              norig = (int *)realloc((int *)norig,
-                                     (size_t)(mult2 * NPARTHYD * sizeof(int)));
-              if (Verbose_flag > 2) {
-                fprintf(stderr, " Done!");
-                fflush(stderr);
-              }
-              if (!norig) {
-                fprintf(stderr,
-                        "\nERROR in parthyd:  Could not reallocate space for "
-                        "norig array.");
-                fflush(stderr);
-                free(nleft);
-                return (MEMERR);
-              }
-              /* Initialize newly allocated memory to zero */
-              for (int i = (mult2 - 1) * NPARTHYD; i < mult2 * NPARTHYD; i++) {
-                norig[i] = 0;
-              }
-            }
-            /* CRITICAL: Protection against negative array access */
-            if (valpart >= 0 && valpart < mult2 * NPARTHYD) {
-              norig[valpart]++;
-            }
-          }
-        }
-      }
-    }
-  }
-
   /* Output results to end of particle hydration file */
 
-  if (Verbose_flag > 2) {
-    fprintf(stderr, "\nDEBUG: Main loop of parthyd concluded.");
-    fflush(stderr);
-  }
-  for (ix = 100; ix <= partmax; ix++) {
+  for (ix = 100; ix <= Partmax; ix++) {
 
     alpart = 0.0;
 
-    if (norig[ix] != 0) {
-      alpart = 1.0 - ((double)nleft[ix] / (double)norig[ix]);
+    if (Partorig[ix] != 0) {
+      alpart = 1.0 - ((double)Partleft[ix] / (double)Partorig[ix]);
     }
 
-    fprintf(phydfile, "%d %d %d %.3f\n", ix, norig[ix], nleft[ix], alpart);
+    fprintf(phydfile, "%d %d %d %.3f\n", ix, Partorig[ix], Partleft[ix],
+            alpart);
   }
 
-  fclose(phydfile);
-  free(norig);
-  free(nleft);
+  outflush(0);
 
   return (0);
 }
@@ -0,0 +1,244 @@
+/***
+ *	perfstats
+ *
+ * 	Timings and event counts for each hydration cycle, taken
+ * 	when disrealnew is run with --perf.  Each part of the cycle
+ * 	is timed once per call with a monotonic clock, and each
+ * 	diffusing species once per diffusion step, so the cost is a
+ * 	few thousand clock reads per cycle.  The event counts are
+ * 	kept whether or not timings are taken.
+ *
+ * 	One row is written to the table Perfname for every cycle;
+ * 	the totals for the whole run go to the log file, with the
+ * 	memory of the arrays when it is accounted for (see memtag).  After a
+ * 	restart, rows are added to the table that is already there.
+ *
+ * 	With --trace, each timed part of the cycle is also a span of
+ * 	the main thread in the timeline of the run (see trace.c),
+ * 	whether or not --perf is given.
+ ***/
+
+/***
+ *	perfclock
+ *
+ * 	Read the monotonic clock
+ *
+ * 	Arguments:	None
+ * 	Returns:	double time in seconds from an arbitrary start
+ *
+ *	Calls:		No other routines
+ *	Called by:	perfbegin, perfend
+ ***/
+double perfclock(void) {
+  struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+  return ((double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec);
+}
+
+/***
+ *	perfbegin
+ *
+ * 	Start timing one part of the cycle
+ *
+ * 	Arguments:	int timer (PERFDISSOLVE ... PERFCYCLE)
+ * 	Returns:	Nothing
+ *
+ *	Calls:		perfclock, trace_begin
+ *	Called by:	main program, hydrate
+ ***/
+void perfbegin(int i) {
+  if (Perfon)
+    Perfstart[i] = perfclock();
+  trace_begin(&Perfmark[i], TRACEMAIN);
+
+  return;
+}
+
+/***
+ *	perfend
+ *
+ * 	Stop timing one part of the cycle and add the time to the
+ * 	cycle's total for that part
+ *
+ * 	Arguments:	int timer (PERFDISSOLVE ... PERFCYCLE)
+ * 	Returns:	Nothing
+ *
+ *	Calls:		perfclock, trace_end
+ *	Called by:	main program, hydrate
+ ***/
+void perfend(int i) {
+  if (Perfon)
+    Perftime[i] += perfclock() - Perfstart[i];
+  trace_end(&Perfmark[i], Perfpart[i], TRACEMAIN);
+
+  return;
+}
+
+/***
+ *	perfreset
+ *
+ * 	Clear the timings and event counts of the cycle
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	perfopen, perfrow
+ ***/
+void perfreset(void) {
+  int i;
+
+  for (i = 0; i < PERFNTIMERS; i++)
+    Perftime[i] = 0.0;
+  for (i = 0; i < NANTSPECIES; i++)
+    Perfmove[i] = 0.0;
+  for (i = 0; i < PERFNCOUNTS; i++)
+    Perfcount[i] = 0;
+  Nnucleate = Nrejected = 0;
+
+  return;
+}
+
+/***
+ *	perfopen
+ *
+ * 	Open the table of timings and write its column names,
+ * 	unless a restarted run is adding to a table that already
+ * 	exists
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay (or timings were not asked for),
+ * 				nonzero otherwise
+ *
+ *	Calls:		perfreset, id2phasename
+ *	Called by:	main program
+ ***/
+int perfopen(void) {
+  int i, append;
+  char name[MAXSTRING];
+
+  perfreset();
+  for (i = 0; i < PERFNTIMERS; i++)
+    Perftotal[i] = 0.0;
+
+  if (!Perfon)
+    return (0);
+
+  append = 0;
+  if (strlen(Restartname) > 0) {
+    Perffile = filehandler("disrealnew", Perfname, "READ_NOFAIL");
+    if (Perffile) {
+      fclose(Perffile);
+      append = 1;
+    }
+  }
+
+  Perffile = filehandler("disrealnew", Perfname, append ? "APPEND" : "WRITE");
+  if (!Perffile)
+    return (1);
+  if (append)
+    return (0);
+
+  fprintf(Perffile, "Cycle,Time(h)");
+  for (i = 0; i < PERFNTIMERS; i++)
+    fprintf(Perffile, ",%s(s)", Perfpart[i]);
+  for (i = 0; i < NANTSPECIES; i++) {
+    id2phasename((DIFFCSH) + i, name);
+    fprintf(Perffile, ",Move_%s(s)", name);
+  }
+  fprintf(Perffile, ",Ant_steps,Ants_reacted,Nucleations,Rejected_tries,"
+                    "Diffusion_steps");
+  for (i = 1; i <= NSPHASES; i++) {
+    id2phasename(i, name);
+    fprintf(Perffile, ",Dissolved_%s", name);
+  }
+  fflush(Perffile);
+
+  return (0);
+}
+
+/***
+ *	perfrow
+ *
+ * 	Write the timings and event counts of one cycle to the
+ * 	table, add the timings to the run totals and clear them
+ * 	for the next cycle
+ *
+ * 	Arguments:	int cycle
+ * 				float time at the end of the cycle (h)
+ * 	Returns:	Nothing
+ *
+ *	Calls:		perfreset
+ *	Called by:	main program
+ ***/
+void perfrow(int cycle, float time) {
+  int i;
+
+  if (!Perfon || !Perffile) {
+    perfreset();
+    return;
+  }
+
+  fprintf(Perffile, "\n%d,%.4f", cycle, time);
+  for (i = 0; i < PERFNTIMERS; i++) {
+    fprintf(Perffile, ",%.6f", Perftime[i]);
+    Perftotal[i] += Perftime[i];
+  }
+  for (i = 0; i < NANTSPECIES; i++)
+    fprintf(Perffile, ",%.6f", Perfmove[i]);
+  fprintf(Perffile, ",%ld,%ld,%d,%d,%ld", Perfcount[PERFANTSTEPS],
+          Perfcount[PERFANTSGONE], Nnucleate, Nrejected,
+          Perfcount[PERFDIFFSTEPS]);
+  for (i = 1; i <= NSPHASES; i++)
+    fprintf(Perffile, ",%d", Discount[i]);
+  fflush(Perffile);
+
+  perfreset();
+
+  return;
+}
+
+/***
+ *	perfclose
+ *
+ * 	Close the table of timings and write the run totals to the
+ * 	log file
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		memreport
+ *	Called by:	main program, freeallmem
+ ***/
+void perfclose(void) {
+  if (!Perffile)
+    return;
+
+  fclose(Perffile);
+  Perffile = NULL;
+
+  if (Logfile) {
+    fprintf(Logfile, "\nTime spent in each part of the cycles (s):");
+    fprintf(Logfile, "\n\tdissolve %.3f, hydrate %.3f, pHpred %.3f",
+            Perftotal[PERFDISSOLVE], Perftotal[PERFHYDRATE],
+            Perftotal[PERFPHPRED]);
+    fprintf(Logfile, "\n\tburn3d %.3f, burnset %.3f, parthyd %.3f",
+            Perftotal[PERFBURN3D], Perftotal[PERFBURNSET],
+            Perftotal[PERFPARTHYD]);
+    fprintf(Logfile, "\n\tcalcT %.3f, measuresurf %.3f, census %.3f",
+            Perftotal[PERFCALCT], Perftotal[PERFMEASURESURF],
+            Perftotal[PERFCENSUS]);
+    fprintf(Logfile, "\n\timages %.3f, whole cycles %.3f",
+            Perftotal[PERFIMAGE], Perftotal[PERFCYCLE]);
+    memreport(Logfile);
+    log_flush(Logfile);
+  }
+
+  return;
+}
@@ -0,0 +1,274 @@
+/***
+ *	progstream
+ *
+ * 	Progress records written as newline-delimited JSON, one
+ * 	object per line, when disrealnew is run with --stream.  A
+ * 	"start" record is written before the first cycle, a
+ * 	"cycle" record at the end of every cycle with the same
+ * 	state the data file gets, and a "completed" record at the
+ * 	end.  Each record is flushed as soon as it is written.
+ *
+ * 	The destination is one of
+ *
+ * 		- or stdout   standard output (the PROGRESS lines and
+ * 		              the closing summary are then left out)
+ * 		fd:n          file descriptor n, e.g. a pipe left open
+ * 		              by the parent process
+ * 		unix:path     a Unix domain stream socket that is
+ * 		              already listening (not on Windows)
+ * 		path          a file or named pipe
+ *
+ * 	If the reader goes away, the stream is closed with a
+ * 	warning in the log and the simulation carries on.
+ ***/
+
+/***
+ *	Volume fractions in a cycle record, with the same phases
+ *	(and the same combination of ettringite ids) as the data
+ *	file
+ ***/
+#define STREAMNVF 33
+static const char *Streamvfname[STREAMNVF] = {
+    "POROSITY", "C3S",      "C2S",      "C3A",     "OC3A",      "C4AF",
+    "K2SO4",    "NA2SO4",   "GYPSUM",   "HEMIHYD", "ANHYDRITE", "CACO3",
+    "FREELIME", "SFUME",    "INERT",    "SLAG",    "ASG",       "CAS2",
+    "AMSIL",    "CH",       "CSH",      "POZZCSH", "SLAGCSH",   "C3AH6",
+    "ETTR",     "AFM",      "FH3",      "CACL2",   "FRIEDEL",   "STRAT",
+    "GYPSUMS",  "ABSGYP",   "AFMC"};
+static const int Streamvfid[STREAMNVF] = {
+    POROSITY, C3S,      C2S,   C3A,     OC3A,      C4AF,    K2SO4,
+    NA2SO4,   GYPSUM,   HEMIHYD, ANHYDRITE, CACO3, FREELIME, SFUME,
+    INERT,    SLAG,     ASG,   CAS2,    AMSIL,     CH,      CSH,
+    POZZCSH,  SLAGCSH,  C3AH6, ETTR,    AFM,       FH3,     CACL2,
+    FRIEDEL,  STRAT,    GYPSUMS, ABSGYP, AFMC};
+
+/***
+ *	streamopen
+ *
+ * 	Open the progress stream named by --stream, if any
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay (or no stream was asked for), nonzero
+ * 				otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	main program
+ ***/
+int streamopen(void) {
+  int fd;
+
+  Streamfile = NULL;
+  if (strlen(Streamdest) == 0)
+    return (0);
+
+  if (!strcmp(Streamdest, "-") || !strcmp(Streamdest, "stdout")) {
+    Streamfile = stdout;
+  } else if (!strncmp(Streamdest, "fd:", 3)) {
+    fd = atoi(Streamdest + 3);
+    if (fd >= 0)
+      Streamfile = fdopen(fd, "w");
+#if !defined(_WIN32)
+  } else if (!strncmp(Streamdest, "unix:", 5)) {
+    struct sockaddr_un addr;
+
+    if (strlen(Streamdest + 5) >= sizeof(addr.sun_path))
+      return (1);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, Streamdest + 5);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+      return (1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        (Streamfile = fdopen(fd, "w")) == NULL) {
+      close(fd);
+      return (1);
+    }
+#endif
+  } else {
+    Streamfile = fopen(Streamdest, "w");
+  }
+
+  if (!Streamfile)
+    return (1);
+
+#if !defined(_WIN32)
+  /* A reader that goes away must not kill the simulation */
+
+  signal(SIGPIPE, SIG_IGN);
+#endif
+
+  return (0);
+}
+
+/***
+ *	streamclose
+ *
+ * 	Close the progress stream
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	streamend, main program, freeallmem
+ ***/
+void streamclose(void) {
+  if (!Streamfile)
+    return;
+
+  if (Streamfile == stdout) {
+    fflush(stdout);
+  } else {
+    fclose(Streamfile);
+  }
+  Streamfile = NULL;
+
+  return;
+}
+
+/***
+ *	streamend
+ *
+ * 	Finish a record: flush it, and give up on the stream if it
+ * 	could not be written
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		streamclose
+ *	Called by:	streamstart, streamcycle, streamdone
+ ***/
+void streamend(void) {
+  fprintf(Streamfile, "\n");
+  if (fflush(Streamfile) || ferror(Streamfile)) {
+    if (Logfile) {
+      fprintf(Logfile, "\nWARNING: Could not write progress stream %s; "
+                       "closing it",
+              Streamdest);
+      log_flush(Logfile);
+    }
+    streamclose();
+  }
+
+  return;
+}
+
+/***
+ *	streamstart
+ *
+ * 	Write the record that opens the stream
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		streamend
+ *	Called by:	main program
+ ***/
+void streamstart(void) {
+  if (!Streamfile)
+    return;
+
+  fprintf(Streamfile, "{\"event\": \"start\", \"xsize\": %d, \"ysize\": %d, "
+                      "\"zsize\": %d, \"resolution\": %.2f, "
+                      "\"max_cycles\": %d, \"end_time_hours\": %.4f, "
+                      "\"first_cycle\": %d}",
+          Xsyssize, Ysyssize, Zsyssize, Res, Ncyc, End_time, Icycstart);
+  streamend();
+
+  return;
+}
+
+/***
+ *	streamcycle
+ *
+ * 	Write the record for one cycle, with the state written to
+ * 	the data file at the same time
+ *
+ * 	Arguments:	int cycle
+ * 	Returns:	Nothing
+ *
+ *	Calls:		rfc8601_timespec, streamend
+ *	Called by:	main program
+ ***/
+void streamcycle(int cycle) {
+  int i, n;
+  char *stamp;
+  struct timespec tv;
+
+  if (!Streamfile)
+    return;
+
+  fprintf(Streamfile, "{\"event\": \"cycle\", \"cycle\": %d, ", cycle);
+  fprintf(Streamfile, "\"time_hours\": %.4f, \"degree_of_hydration\": %.4f, ",
+          Time_cur, Alpha_cur);
+  fprintf(Streamfile, "\"alpha_fa\": %.4f, \"heat_kJ_per_kg\": %.4f, ",
+          Alpha_fa_cur, (Heat_new * Heat_cf));
+  fprintf(Streamfile, "\"temperature_C\": %.4f, \"gel_space_ratio\": %.4f, ",
+          Temp_cur_b, Gsratio2);
+  fprintf(Streamfile, "\"wn_o\": %.4f, \"wn_i\": %.4f, ", Wn_o, Wn_i);
+  fprintf(Streamfile, "\"chemical_shrinkage_mL_per_g\": %.5f, \"pH\": %.4f, ",
+          Chs_new, PH_cur);
+  fprintf(Streamfile, "\"conductivity_S_per_m\": %.4f, ", Conductivity);
+  fprintf(Streamfile, "\"concentrations_M\": {\"Na+\": %.4f, \"K+\": %.4f, ",
+          Concnaplus, Conckplus);
+  fprintf(Streamfile, "\"Ca++\": %.4f, \"SO4--\": %.4f}, ", Conccaplus,
+          Concsulfate);
+  fprintf(Streamfile, "\"activities\": {\"K+\": %.4f, \"Ca++\": %.4f, ",
+          ActivityK, ActivityCa);
+  fprintf(Streamfile, "\"OH-\": %.4f, \"SO4--\": %.4f}, ", ActivityOH,
+          ActivitySO4);
+  fprintf(Streamfile, "\"pore_connectivity\": [%.4f, %.4f, %.4f], ",
+          Con_fracp[0], Con_fracp[1], Con_fracp[2]);
+  fprintf(Streamfile, "\"solid_connectivity\": [%.4f, %.4f, %.4f], ",
+          Con_fracs[0], Con_fracs[1], Con_fracs[2]);
+
+  fprintf(Streamfile, "\"volume_fractions\": {");
+  for (i = 0; i < STREAMNVF; i++) {
+    n = Count[Streamvfid[i]];
+    if (Streamvfid[i] == ETTR)
+      n += Count[ETTRC4AF];
+    fprintf(Streamfile, "%s\"%s\": %.4f", (i > 0) ? ", " : "", Streamvfname[i],
+            (float)n / (float)Syspix);
+  }
+  fprintf(Streamfile, ", \"INERTAGG\": %.4f, \"EMPTYP\": %.4f}, ",
+          (float)Count[INERTAGG] / (float)Syspix,
+          (float)Count[EMPTYP] / (float)Syspix);
+
+  if (clock_gettime(CLOCK_REALTIME, &tv) == 0 &&
+      (stamp = rfc8601_timespec(&tv)) != NULL) {
+    fprintf(Streamfile, "\"timestamp\": \"%s\"}", stamp);
+    free(stamp);
+  } else {
+    fprintf(Streamfile, "\"timestamp\": null}");
+  }
+  streamend();
+
+  return;
+}
+
+/***
+ *	streamdone
+ *
+ * 	Write the record that closes the stream, and close it
+ *
+ * 	Arguments:	double execution time (s)
+ * 	Returns:	Nothing
+ *
+ *	Calls:		streamend, streamclose
+ *	Called by:	main program
+ ***/
+void streamdone(double seconds) {
+  if (!Streamfile)
+    return;
+
+  fprintf(Streamfile, "{\"event\": \"completed\", \"cycles\": %d, ",
+          Cyccnt - 1);
+  fprintf(Streamfile, "\"final_doh\": %.3f, \"final_temp\": %.2f, ",
+          Alpha_cur, Temp_cur_b);
+  fprintf(Streamfile, "\"final_ph\": %.2f, \"execution_time\": %.3f}",
+          PH_cur, seconds);
+  streamend();
+  streamclose();
+
+  return;
+}
@@ -0,0 +1,637 @@
+/***
+ *	snapshot
+ *
+ * 	Microstructure images saved by the cycle loop, once for
+ * 	every entry in the outputalpha.dat file or every
+ * 	Outtimefreq hours.
+ *
+ * 	The loop only copies Mic into a free image buffer (one z
+ * 	row at a time, because of its halo) and carries on with
+ * 	hydration.  A writer thread then shows the diffusing
+ * 	species as porosity, writes the image, adds it to the
+ * 	image index and calculates its pore size distribution.
+ * 	There are SNAPNBUF buffers, so the loop only waits when it
+ * 	saves an image while the writer is still busy with all of
+ * 	them.  Images are written and indexed in the order they
+ * 	were saved.
+ *
+ * 	Anything else that reads the image index or expects the
+ * 	images to be complete (a checkpoint, the final image)
+ * 	calls snapwait first.  Without POSIX threads each image is
+ * 	written before the loop continues.
+ *
+ * 	With --series the images are added to one series file
+ * 	instead (see binmov.c), which only stores the voxels that
+ * 	changed since the image before, and the image index names
+ * 	each one as series#k.
+ *
+ * 	The analyses at chosen ages (see insitu.h) go through the
+ * 	same buffers, marked to be analyzed instead of written.
+ ***/
+
+/***
+ *	snapid
+ *
+ * 	Fill the table of ids written for each id in Mic.  A
+ * 	diffusing species has not reacted yet, so it is written as
+ * 	porosity.  (Any precipitation of diffusing C3A is assumed
+ * 	to form cubic C3A; diffusing C4AF has already become FH3
+ * 	and CH, so it could at best be shown as C3A.)  Diffusing
+ * 	sulfate is left as it is.
+ *
+ * 	Arguments:	unsigned char pointer to SNAPNID ids
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	snapwrite, liveupdate, solidbuild, insiturun
+ ***/
+void snapid(unsigned char *id) {
+  int i;
+  static const int diff[] = {DIFFCSH,  DIFFANH,  DIFFHEM,   DIFFGYP, DIFFCACL2,
+                             DIFFCACO3, DIFFCAS2, DIFFAS,    DIFFETTR, DIFFC3A,
+                             DIFFC4A,   DIFFFH3,  DIFFCH};
+
+  for (i = 0; i < SNAPNID; i++) {
+    id[i] = (unsigned char)i;
+  }
+  for (i = 0; i < (int)(sizeof(diff) / sizeof(diff[0])); i++) {
+    id[diff[i]] = POROSITY;
+  }
+
+  return;
+}
+
+/***
+ *	snapseries
+ *
+ * 	Add one saved image to the series, opening the series the
+ * 	first time (and appending to it if it is already there,
+ * 	as after a restart)
+ *
+ * 	Arguments:	pointer to saved image
+ * 				unsigned char pointer to SNAPNID ids
+ * 	Returns:	0 if okay, nonzero otherwise (with the reason
+ * 				in Snaperrmsg)
+ *
+ *	Calls:		series_open, series_create, series_append
+ *	Called by:	snapwrite
+ ***/
+int snapseries(struct Snapimg *img, unsigned char *id) {
+  size_t n, nvox;
+  FILE *fp;
+
+  if (!Snapseries.mv.fp) {
+    if ((fp = fopen(Seriesname, "rb")) != NULL) {
+      fclose(fp);
+      if (series_open(Seriesname, &Snapseries, 1)) {
+        snprintf(Snaperrmsg, sizeof(Snaperrmsg),
+                 "Could not append to series %s", Seriesname);
+        return (1);
+      }
+    } else if (series_create(Seriesname, &Snapseries, img->xsize, img->ysize,
+                             img->zsize, img->res, SERIESKEYEVERY)) {
+      snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Could not create series %s",
+               Seriesname);
+      return (1);
+    }
+  }
+
+  if (Snapseries.mv.xsize != img->xsize || Snapseries.mv.ysize != img->ysize ||
+      Snapseries.zsize != img->zsize) {
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg),
+             "Image size differs from series %s", Seriesname);
+    return (1);
+  }
+
+  /* The ids are written in place, since the buffer is copied anew */
+
+  nvox = (size_t)img->xsize * (size_t)img->ysize * (size_t)img->zsize;
+  for (n = 0; n < nvox; n++) {
+    img->vox[n] = id[img->vox[n]];
+  }
+  if (series_append(&Snapseries, img->vox, img->time)) {
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Error writing series %s",
+             Seriesname);
+    return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	snapvtk
+ *
+ * 	Write one saved image as a VTK image file as well (--vtk),
+ * 	named as the image with .vti in place of .img.  The image
+ * 	is in C order and the VTK file has x varying fastest, so
+ * 	each z plane is gathered from across the image.
+ *
+ * 	Arguments:	pointer to saved image
+ * 				unsigned char pointer to SNAPNID ids written
+ * 				for the ids in the image, or NULL if the
+ * 				voxels already hold them
+ * 	Returns:	0 if okay, nonzero otherwise (with the reason
+ * 				in Snaperrmsg)
+ *
+ *	Calls:		vtkimg_open, vtkimg_array, vtkimg_begin,
+ *				vtkimg_plane, vtkimg_end, vtkimg_close
+ *	Called by:	snapwrite
+ ***/
+int snapvtk(struct Snapimg *img, unsigned char *id) {
+  int ix, iy, iz;
+  size_t len;
+  unsigned char *plane, *src;
+  char name[MAXSTRING];
+  Vtkimg v;
+
+  len = strlen(img->name);
+  if (len >= 4 && !strcmp(img->name + len - 4, ".img"))
+    len -= 4;
+  if (len + 5 > sizeof(name)) {
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg),
+             "Name too long for VTK image of %s", img->name);
+    return (1);
+  }
+  memcpy(name, img->name, len);
+  strcpy(name + len, ".vti");
+
+  plane = (unsigned char *)malloc((size_t)img->xsize * (size_t)img->ysize);
+  if (!plane) {
+    strcpy(Snaperrmsg, "Could not allocate memory for VTK image plane");
+    return (1);
+  }
+  if (vtkimg_open(&v, name, img->xsize, img->ysize, img->zsize, img->res)) {
+    free(plane);
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Could not open file %s", name);
+    return (1);
+  }
+  vtkimg_array(&v, "Phase", VTKUINT8, 1);
+  vtkimg_begin(&v);
+  for (iz = 0; iz < img->zsize; iz++) {
+    for (iy = 0; iy < img->ysize; iy++) {
+      for (ix = 0; ix < img->xsize; ix++) {
+        src = img->vox +
+              ((size_t)ix * img->ysize + iy) * (size_t)img->zsize + iz;
+        plane[(size_t)iy * img->xsize + ix] = id ? id[*src] : *src;
+      }
+    }
+    vtkimg_plane(&v, plane);
+  }
+  vtkimg_end(&v);
+  free(plane);
+  if (vtkimg_close(&v)) {
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Error writing file %s", name);
+    return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	snapwrite
+ *
+ * 	Write one saved image, add it to the image index and
+ * 	calculate its pore size distribution.  Voxels are written
+ * 	one per line, as with fprintf("\n%d"), but formatted into
+ * 	a block and written with fwrite, unless the image goes to
+ * 	the series.
+ *
+ * 	Arguments:	pointer to saved image
+ * 	Returns:	0 if okay, nonzero otherwise (with the reason
+ * 				in Snaperrmsg)
+ *
+ *	Calls:		snapid, snapseries, snapvtk, write_imgheader,
+ *				calcporedist3d, calcporedist3dvox, insiturun
+ *	Called by:	snapthread, snapqueue
+ ***/
+int snapwrite(struct Snapimg *img) {
+  int val, status;
+  size_t n, nvox, len;
+  unsigned char id[SNAPNID];
+  char block[SNAPBLOCK + 4];
+  FILE *fp, *index;
+
+  if (img->analyze)
+    return (insiturun(img));
+
+  snapid(id);
+
+  if (Seriesname[0] != '\0') {
+    if (snapseries(img, id))
+      return (1);
+    index = filehandler("disrealnew", Imageindexname, "APPEND");
+    if (!index) {
+      snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Could not open file %s",
+               Imageindexname);
+      return (1);
+    }
+    fprintf(index, "\n%f\t%s#%d", img->time, Seriesname,
+            Snapseries.mv.nframes - 1);
+    fclose(index);
+    if (Vtkout && snapvtk(img, NULL))
+      return (1);
+
+    /* The voxels already hold the ids written */
+
+    status = calcporedist3dvox(img->name, img->vox, NULL, img->xsize,
+                               img->ysize, img->zsize);
+    if (status && Verbose_flag > 1) {
+      fprintf(Logfile, "\nWARNING: There was a problem calculating the "
+                       "pore size distribution.");
+    }
+    return (0);
+  }
+
+  fp = filehandler("disrealnew", img->name, "WRITE");
+  if (!fp) {
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Could not open file %s",
+             img->name);
+    return (1);
+  }
+
+  index = filehandler("disrealnew", Imageindexname, "APPEND");
+  if (!index) {
+    fclose(fp);
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Could not open file %s",
+             Imageindexname);
+    return (1);
+  }
+  fprintf(index, "\n%f\t%s", img->time, img->name);
+  fclose(index);
+
+  if (write_imgheader(fp, img->xsize, img->ysize, img->zsize, img->res)) {
+    fclose(fp);
+    strcpy(Snaperrmsg, "Error writing image header");
+    return (1);
+  }
+
+  /***
+   * 2025 August 05
+   * New convention is to read and write image data in C-order (z
+   * varies the fastest, then y, then x)
+   ***/
+
+  nvox = (size_t)img->xsize * (size_t)img->ysize * (size_t)img->zsize;
+  len = 0;
+  for (n = 0; n < nvox; n++) {
+    val = id[img->vox[n]];
+    block[len++] = '\n';
+    if (val >= 100)
+      block[len++] = (char)('0' + val / 100);
+    if (val >= 10)
+      block[len++] = (char)('0' + (val / 10) % 10);
+    block[len++] = (char)('0' + val % 10);
+    if (len >= SNAPBLOCK) {
+      if (fwrite(block, 1, len, fp) != len)
+        break;
+      len = 0;
+    }
+  }
+
+  if (n < nvox || (len > 0 && fwrite(block, 1, len, fp) != len)) {
+    fclose(fp);
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Error writing file %s",
+             img->name);
+    return (1);
+  }
+  if (fclose(fp)) {
+    snprintf(Snaperrmsg, sizeof(Snaperrmsg), "Error writing file %s",
+             img->name);
+    return (1);
+  }
+  if (Vtkout && snapvtk(img, id))
+    return (1);
+
+  /* With microstructure now written, calculate pore size distribution */
+
+  if (Verbose_flag > 2) {
+    fprintf(Logfile,
+            "\nCalculating pore size distribution now..., Micname = %s",
+            img->name);
+    log_flush(Logfile);
+  }
+  if (calcporedist3d(img->name)) {
+    if (Verbose_flag > 1) {
+      fprintf(Logfile, "\nWARNING: There was a problem calculating the "
+                       "pore size distribution.");
+    }
+  }
+  if (Verbose_flag > 2) {
+    fprintf(Logfile, "\nDone calculating pore size distribution.");
+    log_flush(Logfile);
+  }
+
+  return (0);
+}
+
+#if !defined(_WIN32)
+/***
+ *	snapthread
+ *
+ * 	Body of the writer thread: write saved images in order
+ * 	until snapstop asks it to finish
+ *
+ * 	Arguments:	unused
+ * 	Returns:	NULL
+ *
+ *	Calls:		snapwrite, trace_begin, trace_end
+ *	Called by:	snapqueue (through pthread_create)
+ ***/
+void *snapthread(void *arg) {
+  int status;
+  struct Snapimg *img;
+  Tracemark mark;
+
+  (void)arg;
+
+  pthread_mutex_lock(&Snaplock);
+  for (;;) {
+    while (Snaphead == Snaptail && !Snapquit) {
+      pthread_cond_wait(&Snapcond, &Snaplock);
+    }
+    if (Snaphead == Snaptail)
+      break;
+
+    img = &Snapbuf[Snaphead % SNAPNBUF];
+    pthread_mutex_unlock(&Snaplock);
+    trace_begin(&mark, TRACEWRITER);
+    status = Snaperr ? 0 : snapwrite(img);
+    trace_end(&mark, img->analyze ? "Analysis" : "Write image", TRACEWRITER);
+    pthread_mutex_lock(&Snaplock);
+
+    if (status)
+      Snaperr = 1;
+    Snaphead++;
+    pthread_cond_broadcast(&Snapcond);
+  }
+  pthread_mutex_unlock(&Snaplock);
+
+  return (NULL);
+}
+#endif
+
+/***
+ *	snapcopy
+ *
+ * 	Copy the interior of Mic into an image buffer, growing the
+ * 	buffer if the system has become larger.  A coarsened system
+ * 	is copied at the original resolution with --coarsen-refine,
+ * 	each pixel repeated over its block.  With --solid-layer the
+ * 	whole image is one copy of Solidmic.
+ *
+ * 	Arguments:	pointer to image buffer
+ * 				char pointer to image file name
+ * 				float time of the image
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	snapqueue
+ ***/
+int snapcopy(struct Snapimg *img, char *name, float time) {
+  int ix, iy, iz, rf;
+  size_t nvox, nz;
+  unsigned char *dst;
+  void *newp;
+
+  rf = Coarsenrefine ? Coarsefact : 1;
+  nvox = (size_t)(rf * Xsyssize) * (size_t)(rf * Ysyssize) *
+         (size_t)(rf * Zsyssize);
+  if (img->cap < nvox) {
+    newp = realloc(img->vox, nvox);
+    if (!newp) {
+      strcpy(Snaperrmsg, "Could not allocate memory for image buffer");
+      return (1);
+    }
+    img->vox = (unsigned char *)newp;
+    img->cap = nvox;
+  }
+
+  nz = (size_t)Zsyssize;
+  dst = img->vox;
+  if (rf == 1 && Solidmic) {
+    memcpy(dst, Solidmic, nvox);
+  } else if (rf == 1) {
+    for (ix = 0; ix < Xsyssize; ix++) {
+      for (iy = 0; iy < Ysyssize; iy++) {
+        memcpy(dst, Mic[ix][iy], nz);
+        dst += nz;
+      }
+    }
+  } else {
+    for (ix = 0; ix < rf * Xsyssize; ix++) {
+      for (iy = 0; iy < rf * Ysyssize; iy++) {
+        for (iz = 0; iz < rf * Zsyssize; iz++) {
+          *dst++ = (unsigned char)Mic[ix / rf][iy / rf][iz / rf];
+        }
+      }
+    }
+  }
+
+  img->xsize = rf * Xsyssize;
+  img->ysize = rf * Ysyssize;
+  img->zsize = rf * Zsyssize;
+  img->res = Res / (float)rf;
+  img->time = time;
+  strcpy(img->name, name);
+
+  return (0);
+}
+
+/***
+ *	snapqueue
+ *
+ * 	Hand the current microstructure to the writer thread, to be
+ * 	saved as image file name or analyzed.  The thread is
+ * 	started the first time; if it cannot be started, or there
+ * 	are no POSIX threads, the image is written or analyzed here.
+ *
+ * 	Arguments:	char pointer to image file name
+ * 				float time of the image
+ * 				int nonzero to analyze it (see insitu.h)
+ * 	Returns:	0 if okay, nonzero if this or an earlier image
+ * 				could not be saved (with the reason in
+ * 				Snaperrmsg)
+ *
+ *	Calls:		snapcopy, snapwrite, trace_begin, trace_end
+ *	Called by:	snapsave, insitucheck
+ ***/
+int snapqueue(char *name, float time, int analyze) {
+  int status;
+  struct Snapimg *img;
+  Tracemark mark;
+
+#if !defined(_WIN32)
+  if (!Snaprunning) {
+    Snapquit = 0;
+    if (!pthread_create(&Snapthread, NULL, snapthread, NULL))
+      Snaprunning = 1;
+  }
+
+  if (Snaprunning) {
+    pthread_mutex_lock(&Snaplock);
+    while (Snaptail - Snaphead >= SNAPNBUF && !Snaperr) {
+      pthread_cond_wait(&Snapcond, &Snaplock);
+    }
+    status = Snaperr;
+    pthread_mutex_unlock(&Snaplock);
+    if (status)
+      return (status);
+
+    /* The writer never touches the buffer at Snaptail */
+
+    img = &Snapbuf[Snaptail % SNAPNBUF];
+    if (snapcopy(img, name, time))
+      return (1);
+    img->analyze = analyze;
+
+    pthread_mutex_lock(&Snaplock);
+    Snaptail++;
+    pthread_cond_broadcast(&Snapcond);
+    pthread_mutex_unlock(&Snaplock);
+    return (0);
+  }
+#endif
+
+  img = &Snapbuf[0];
+  status = snapcopy(img, name, time);
+  img->analyze = analyze;
+  if (!status) {
+    trace_begin(&mark, TRACEMAIN);
+    status = snapwrite(img);
+    trace_end(&mark, analyze ? "Analysis" : "Write image", TRACEMAIN);
+  }
+
+  return (status);
+}
+
+/***
+ *	snapsave
+ *
+ * 	Save the current microstructure as image file name
+ *
+ * 	Arguments:	char pointer to image file name
+ * 				float time of the image
+ * 	Returns:	0 if okay, nonzero if this or an earlier image
+ * 				could not be saved (with the reason in
+ * 				Snaperrmsg)
+ *
+ *	Calls:		snapqueue
+ *	Called by:	main program
+ ***/
+int snapsave(char *name, float time) {
+  return (snapqueue(name, time, 0));
+}
+
+/***
+ *	snaphandoff
+ *
+ * 	Leave the final microstructure in memory as handoff name
+ * 	(see handoff.c), with the same ids and size as the final
+ * 	image, as a raw binary image for chlorattack3d or
+ * 	sulfattack3d --handoff name
+ *
+ * 	Arguments:	char pointer to handoff name
+ * 				int factor a coarsened system is refined by
+ * 	Returns:	0 if okay, nonzero otherwise
+ *
+ *	Calls:		handoff_open, write_binheader, write_binplane,
+ *				handoff_close
+ *	Called by:	hydfinish
+ ***/
+int snaphandoff(char *name, int rf) {
+  int ix, iy, iz, status;
+  size_t nplane;
+  unsigned char *plane, *dst;
+  FILE *fp;
+
+  nplane = (size_t)(rf * Ysyssize) * (size_t)(rf * Zsyssize);
+  plane = (unsigned char *)malloc(nplane);
+  fp = handoff_open(name, "img",
+                    BINIMGHEADERSIZE + (size_t)(rf * Xsyssize) * nplane);
+  status = (!plane || !fp);
+  if (!status) {
+    status = write_binheader(fp, rf * Xsyssize, rf * Ysyssize, rf * Zsyssize,
+                             Res / (float)rf, IMG_UINT8);
+  }
+  for (ix = 0; ix < rf * Xsyssize && !status; ix++) {
+    dst = plane;
+    for (iy = 0; iy < rf * Ysyssize; iy++) {
+      for (iz = 0; iz < rf * Zsyssize; iz++) {
+        *dst++ = (unsigned char)Mic[ix / rf][iy / rf][iz / rf];
+      }
+    }
+    status = write_binplane(fp, plane, nplane, IMG_UINT8);
+  }
+
+  if (fp && handoff_close(fp))
+    status = 1;
+  if (plane)
+    free(plane);
+
+  return (status);
+}
+
+/***
+ *	snapwait
+ *
+ * 	Wait until every saved image has been written
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay, nonzero if an image could not be
+ * 				written (with the reason in Snaperrmsg)
+ *
+ *	Calls:		No other routines
+ *	Called by:	writecheckpoint, insitucheck, main program
+ ***/
+int snapwait(void) {
+  int status = 0;
+
+#if !defined(_WIN32)
+  if (Snaprunning) {
+    pthread_mutex_lock(&Snaplock);
+    while (Snaphead != Snaptail) {
+      pthread_cond_wait(&Snapcond, &Snaplock);
+    }
+    status = Snaperr;
+    pthread_mutex_unlock(&Snaplock);
+  }
+#endif
+
+  return (status);
+}
+
+/***
+ *	snapstop
+ *
+ * 	Let the writer thread finish the images it still has, stop
+ * 	it and free the image buffers
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	freeallmem
+ ***/
+void snapstop(void) {
+  int i;
+
+#if !defined(_WIN32)
+  if (Snaprunning) {
+    pthread_mutex_lock(&Snaplock);
+    Snapquit = 1;
+    pthread_cond_broadcast(&Snapcond);
+    pthread_mutex_unlock(&Snaplock);
+    pthread_join(Snapthread, NULL);
+    Snaprunning = 0;
+  }
+#endif
+
+  for (i = 0; i < SNAPNBUF; i++) {
+    if (Snapbuf[i].vox)
+      free(Snapbuf[i].vox);
+    Snapbuf[i].vox = NULL;
+    Snapbuf[i].cap = 0;
+  }
+
+  return;
+}
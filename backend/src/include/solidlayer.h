@@ -0,0 +1,95 @@
+/***
+ *	solidlayer
+ *
+ * 	The solid microstructure kept apart from the diffusing
+ * 	species, asked for with --solid-layer.  Mic holds each
+ * 	diffusing species as its own phase id (DIFFCSH and the
+ * 	rest), because the move and reaction rules read those ids
+ * 	from the neighbors of an ant.  Solidmic holds the interior
+ * 	of Mic as the saved images show it, with every diffusing
+ * 	species shown as porosity (see snapid), one byte per voxel
+ * 	in C order (z varies fastest) and without the halo.
+ *
+ * 	Every change of one pixel of Mic goes through MICSET, which
+ * 	stores the solid id of the pixel in Solidmic as well.  A
+ * 	pixel marked for dissolution (its id plus OFFSET) is still
+ * 	solid, so marking and unmarking leave Solidmic alone.
+ * 	Whatever makes Mic anew as a whole (reading the image or a
+ * 	checkpoint, a crack, the coarse grid) calls solidbuild
+ * 	afterward, through layerbuild.
+ *
+ * 	The saved images and the live view are then one memcpy of
+ * 	Solidmic, and a scan that only wants the solids can read it
+ * 	without telling the diffusing species apart.  Keeping it
+ * 	costs one byte per voxel and one more store for each change
+ * 	of Mic; the hydration history is the same as without it.
+ ***/
+
+/***
+ *	solidbuild
+ *
+ * 	Fill Solidmic from the whole of Mic, growing it if the
+ * 	system has grown.  Does nothing without --solid-layer.
+ *
+ * 	Arguments:	None
+ * 	Returns:	0 if okay, 1 if out of memory
+ *
+ *	Calls:		snapid
+ *	Called by:	layerbuild
+ ***/
+int solidbuild(void) {
+  int ix, iy, iz, i;
+  size_t nvox;
+  unsigned char *dst;
+  void *newp;
+
+  if (!Solidlayer)
+    return (0);
+
+  /* Marked pixels are shown as the phase they still are */
+
+  snapid(Solidid);
+  for (i = (OFFSET); i < SNAPNID; i++) {
+    Solidid[i] = Solidid[i - (OFFSET)];
+  }
+
+  nvox = (size_t)Xsyssize * (size_t)Ysyssize * (size_t)Zsyssize;
+  if (Solidcap < nvox) {
+    newp = realloc(Solidmic, nvox);
+    if (!newp)
+      return (1);
+    Solidmic = (unsigned char *)newp;
+    Solidcap = nvox;
+  }
+
+  dst = Solidmic;
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      for (iz = 0; iz < Zsyssize; iz++) {
+        *dst++ = Solidid[(unsigned char)Mic[ix][iy][iz]];
+      }
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *	solidfree
+ *
+ * 	Release Solidmic
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	freeallmem
+ ***/
+void solidfree(void) {
+  if (Solidmic)
+    free(Solidmic);
+  Solidmic = NULL;
+  Solidcap = 0;
+
+  return;
+}
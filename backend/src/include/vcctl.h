@@ -47,12 +47,73 @@
  ***/
 #define SHELL "bash"
 
+/***
+ *	Level of the debugging messages compiled into the programs
+ *	(VCCTL_LOGLEVEL in CMake).  At the default level 0 every
+ *	LOGDEBUG is removed by the compiler; at 1 or more they are
+ *	written to the given file like any other message.
+ ***/
+#ifndef VCCTL_LOGLEVEL
+#define VCCTL_LOGLEVEL 0
+#endif
+#define LOGDEBUG(fp, ...)                                                      \
+  do {                                                                         \
+    if (VCCTL_LOGLEVEL > 0)                                                    \
+      fprintf((fp), __VA_ARGS__);                                              \
+  } while (0)
+
+/***
+ *	Instruction sets the hot kernels of vcctllib are built for
+ *	(cpudispatch.c).  Each such kernel is compiled once for
+ *	every level the compiler can target, and cpu_level picks
+ *	the best one the processor has when the program starts, so
+ *	one binary built with plain -O2 runs everywhere.  The
+ *	environment variable VCCTL_SIMD (generic, neon, avx2 or
+ *	avx512) asks for a lower level, to test one variant against
+ *	another; a level the processor lacks is never used.
+ *
+ *	VCCTL_TARGET_AVX2 and VCCTL_TARGET_AVX512 mark a function to
+ *	be compiled for that level, and VCCTL_KERNEL marks the
+ *	shared body of a kernel, to be inlined into each variant and
+ *	compiled there for its level.  Without GCC or clang on x86
+ *	only the generic variant is built.  NEON is part of every
+ *	aarch64 processor, so the generic variant already uses it.
+ ***/
+#define CPUGENERIC 0
+#define CPUNEON 1
+#define CPUAVX2 2
+#define CPUAVX512 3
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VCCTL_X86SIMD 1
+#define VCCTL_TARGET_AVX2 __attribute__((target("avx2")))
+#define VCCTL_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define VCCTL_X86SIMD 0
+#endif
+#if defined(__GNUC__)
+#define VCCTL_KERNEL static inline __attribute__((always_inline))
+#else
+#define VCCTL_KERNEL static inline
+#endif
+
 /*******************************************************
  * Variables related to system size and
  * resolution
  *******************************************************/
 
-#define MAXSIZE 400 /* maximum system size in pixels per dimension */
+/***
+ *	Maximum system size in pixels per dimension.  The build may
+ *	raise it (VCCTL_MAXSIZE in CMake) for large systems, as far
+ *	as the number of pixels, and each linear pixel index, still
+ *	fits in an int
+ ***/
+#ifndef MAXSIZE
+#define MAXSIZE 400
+#endif
+#if MAXSIZE > 1200
+#error "MAXSIZE may be at most 1200, so that pixel counts fit in an int"
+#endif
 #define DEFAULTSYSTEMSIZE 100
 
 #define LOWRES 1.00
@@ -68,6 +129,40 @@
 #define IMGSIZESTRING "Image_Size:"
 #define IMGRESSTRING "Image_Resolution:"
 
+/***
+ *	Optional header line giving the encoding of the voxel
+ *	data.  ASCII images (one integer per line) have no such
+ *	line.  Binary images store one unsigned byte per voxel in
+ *	C order (z varies fastest, then y, then x), starting
+ *	BINIMGHEADERSIZE bytes into the file so that the data can
+ *	be memory mapped.  The zlib variant stores one compressed
+ *	chunk per x plane, each preceded by its length in bytes as
+ *	a 4-byte little-endian integer.  Particle id images use the
+ *	uint32 formats, which are the same with four bytes per
+ *	voxel, little-endian.  A hydration movie (see binmov.c) has
+ *	the same kind of header, with a Z_Size of 1, followed by a
+ *	table of frame offsets and the frames.  A series of whole
+ *	images (also binmov.c) is laid out like a movie, with the
+ *	full Z_Size.
+ ***/
+#define IMGFORMATSTRING "Image_Format:"
+#define IMGFORMATUINT8 "uint8"
+#define IMGFORMATUINT8Z "uint8-zlib"
+#define IMGFORMATMOVIEZ "movie-zlib"
+#define IMGFORMATUINT32 "uint32"
+#define IMGFORMATUINT32Z "uint32-zlib"
+#define IMGFORMATSERIESZ "series-zlib"
+
+#define IMG_ASCII 0
+#define IMG_UINT8 1
+#define IMG_UINT8Z 2
+#define IMG_MOVIEZ 3
+#define IMG_UINT32 4
+#define IMG_UINT32Z 5
+#define IMG_SERIESZ 6
+
+#define BINIMGHEADERSIZE 4096
+
 /***
  *	Pre-defined strings for info files
  ***/
@@ -532,6 +627,13 @@ typedef struct {
   int *val;
 } Int3d;
 
+typedef struct {
+  size_t x;
+  size_t y;
+  size_t z;
+  unsigned char *val;
+} UChar3d;
+
 typedef struct {
   int xsize;
   int ysize;
@@ -567,6 +669,535 @@ typedef struct {
   char *val;
 } Char3d;
 
+/***
+ *	A binary microstructure image held in memory, either
+ *	memory mapped (raw uint8 data) or read and decompressed
+ *	into an allocated buffer (zlib chunks).  vox points to the
+ *	first voxel, in C order.
+ ***/
+
+typedef struct {
+  void *base;
+  size_t len;
+  int mapped;
+  unsigned char *vox;
+  float ver;
+  int xsize;
+  int ysize;
+  int zsize;
+  float res;
+} Mappedimg;
+
+/***
+ *	A window of the layers zlow to zhigh of a microstructure too
+ *	deep to hold in memory, opened by layerwin_open (layerwin.c).
+ *	mic and react index voxels as mic[x][y][z] with z the layer
+ *	in the whole image, 0 and zsize + 1 being the top and bottom
+ *	boundary layers, but only the layers in the window are there,
+ *	with room for cap of them in each column.  Layers come in
+ *	from the raw binary image in and go out to the one at out.
+ *	order tells how a layer's voxels lie in those images.
+ ***/
+
+#define LAYERWIN_ZFAST 0 /* x slowest, z fastest (C order) */
+#define LAYERWIN_ZSLOW 1 /* z slowest, x fastest */
+
+typedef struct {
+  short int ***mic;
+  short int ***react;
+  int xsize;
+  int ysize;
+  int zsize;
+  int order;
+  int top;
+  int bottom;
+  int zlow;
+  int zhigh;
+  int cap;
+  int maxheld;
+  int table[256];
+  Mappedimg in;
+  Mappedimg out;
+} Layerwin;
+
+/***
+ *	Timeline of a run (see trace.c): the threads its spans are on,
+ *	and where a span began, with the hardware counters (cycles,
+ *	instructions, cache misses) of the main thread at that time
+ ***/
+
+#define TRACEMAIN 0
+#define TRACEWRITER 1
+#define TRACEPOOL 2
+#define TRACEHW 3
+
+typedef struct {
+  double t0;
+  long long hw[TRACEHW];
+} Tracemark;
+
+/***
+ *	A VTK image file (.vti) being written by vtkimg.c for
+ *	ParaView.  Its arrays are declared with vtkimg_array and then
+ *	written one after the other, one z plane at a time, each
+ *	plane a zlib block.  offpos[k] is where the offset of array k
+ *	goes in the XML header, start is the first byte of the
+ *	appended data, hdrpos the block header of the array being
+ *	written and csize the compressed size of each of its planes.
+ ***/
+
+#define VTKUINT8 0
+#define VTKINT32 1
+#define VTKFLOAT32 2
+#define VTKFLOAT64 3
+#define VTKMAXARRAY 8
+
+typedef struct {
+  FILE *fp;
+  int xsize;
+  int ysize;
+  int zsize;
+  float res;
+  int narray;
+  int cur;
+  int nplane;
+  int err;
+  char name[VTKMAXARRAY][64];
+  int type[VTKMAXARRAY];
+  int ncomp[VTKMAXARRAY];
+  long offpos[VTKMAXARRAY];
+  long start;
+  long hdrpos;
+  unsigned long long *csize;
+  unsigned char *cbuf;
+  size_t ccap;
+} Vtkimg;
+
+/***
+ *	A binary hydration movie opened by movie_create or
+ *	movie_open (binmov.c).  Each frame is an xsize by ysize
+ *	slice, x varying fastest.  offset[k] is where frame k
+ *	starts in the file; lastblock is the index block that the
+ *	next frame offset goes into and lastused the number of
+ *	entries already used in it.
+ ***/
+
+#define MOVINDEXLEN 512 /* 8-byte entries per index block, */
+                        /* the last one linking to the next */
+
+typedef struct {
+  FILE *fp;
+  int writable;
+  float ver;
+  int xsize;
+  int ysize;
+  float res;
+  int nframes;
+  int cap;
+  long *offset;
+  long lastblock;
+  int lastused;
+  size_t ccap;
+  unsigned char *cbuf;
+} Movie;
+
+/***
+ *	A series of microstructure images opened by series_create or
+ *	series_open (binmov.c), kept in a Movie whose frames are
+ *	whole images, C order.  Every keyevery-th image is stored
+ *	whole (a keyframe) and the others as the voxels that changed
+ *	since the one before.  vox holds image cur (-1 for none),
+ *	the last one written or read, and rec one uncompressed
+ *	record.
+ ***/
+
+#define SERIESKEYEVERY 16
+
+typedef struct {
+  Movie mv;
+  int zsize;
+  int keyevery;
+  int cur;
+  unsigned char *vox;
+  unsigned char *rec;
+} Series;
+
+/***
+ *	Key of a result in the cache of rescache.c, kept in the file
+ *	prog-key.vrc of directory dir.  on is 0 when there is no cache
+ *	directory, and tmpname is the file being written.
+ ***/
+
+typedef struct {
+  int on;
+  char dir[MAXSTRING];
+  char prog[32];
+  uint64_t key[2];
+  char tmpname[MAXSTRING];
+} Rescache;
+
+/***
+ *	Complete state of one ran1 random number stream: the
+ *	seed and the shuffle table.  Programs that draw from
+ *	several independent streams keep one of these per stream
+ *	and swap it in and out with ran1load and ran1save.
+ ***/
+
+#define RAN1NTAB 32
+
+typedef struct {
+  int idum;
+  int iy;
+  int iv[RAN1NTAB];
+} Ran1state;
+
+/***
+ *	State of one stream of the explicit-state generator in
+ *	rng.c (xoshiro256**)
+ ***/
+
+typedef struct {
+  uint64_t s[4];
+} Rngstate;
+
+/***
+ *	Description of a grid, the contiguous 3-D array made by
+ *	cgrid, sigrid, igrid, fgrid, dgrid and usigrid in memutil.c.
+ *	All the elements live in one aligned block in C order (z
+ *	varies fastest).  The usual T*** pointer tables index into
+ *	that block.
+ *
+ *	A grid made by cgridhalo or sigridhalo also has a layer of
+ *	halo elements, halo deep, on every face, so that indices
+ *	from -halo to size + halo - 1 are valid in each direction.
+ *	gridhalo fills the halo with periodic images of the
+ *	interior.  With h = halo, element [x][y][z] is at offset
+ *	((x + h) * (ysize + 2h) + (y + h)) * (zsize + 2h) + (z + h)
+ *	of the block; halo is 0 for the other grids.
+ *
+ *	A grid made by cgridtile or sigridtile (tiled nonzero) has
+ *	the same halo, but its z rows are in the block in Morton
+ *	order of (x, y), so only a row is contiguous; whole-block
+ *	copies of it keep that order.
+ ***/
+
+#define GRIDALIGN 64            /* alignment of every grid block (bytes) */
+#define GRIDHUGEPAGE 2097152    /* blocks at least this big are aligned */
+                                /* to, and advised as, huge pages */
+#define GRIDMAXHALO 4           /* deepest halo a grid can have */
+#define GRIDPAGE 4096           /* page that touchblock hands out */
+
+typedef struct {
+  void *block;
+  size_t xsize;
+  size_t ysize;
+  size_t zsize;
+  size_t elsize;
+  size_t nbytes;
+  int halo;
+  int tiled;
+} Gridinfo;
+
+/***
+ *	Summed-volume table made by boxtable_alloc in boxtable.c.
+ *	sum holds (xsize+1)*(ysize+1)*(zsize+1) counts in C order;
+ *	once boxtable_build has run, element [x][y][z] is the number
+ *	of marked pixels with all three coordinates below x, y and z.
+ ***/
+
+typedef struct {
+  int xsize;
+  int ysize;
+  int zsize;
+  int *sum;
+} Boxtable;
+
+/* Entry of a Boxtable that marks pixel (x,y,z) before boxtable_build */
+
+#define BOXCELL(bt, x, y, z)                                                  \
+  ((bt)->sum[(((size_t)(x) + 1) * ((bt)->ysize + 1) + (size_t)(y) + 1) *     \
+                 ((bt)->zsize + 1) +                                           \
+             (size_t)(z) + 1])
+
+/***
+ *	Box of ints kept as bricks of BRICKSIDE voxels on a side by
+ *	brickbox_alloc (brickbox.c), for images that are mostly large
+ *	uniform regions.  nbx, nby and nbz bricks lie along the axes,
+ *	numbered with x varying fastest.  A brick whose voxels are all
+ *	the same has vox[n] NULL and its value in fill[n]; any other has
+ *	its BRICKVOX voxels in vox[n], x varying fastest.  ndense counts
+ *	the bricks with voxels, and brickbox_set tidies the box once it
+ *	reaches nexttidy.
+ ***/
+
+#define BRICKBITS 4
+#define BRICKSIDE (1 << BRICKBITS)
+#define BRICKMASK (BRICKSIDE - 1)
+#define BRICKVOX (BRICKSIDE * BRICKSIDE * BRICKSIDE)
+
+typedef struct {
+  int xsize;
+  int ysize;
+  int zsize;
+  int nbx;
+  int nby;
+  int nbz;
+  size_t nbrick;
+  size_t ndense;
+  size_t nexttidy;
+  int *fill;
+  int **vox;
+} Brickbox;
+
+/* Brick of a Brickbox holding voxel (x,y,z), and the voxel within it */
+
+#define BRICKNUM(bb, x, y, z)                                                  \
+  (((size_t)((z) >> BRICKBITS) * (bb)->nby + (size_t)((y) >> BRICKBITS)) *    \
+       (bb)->nbx +                                                             \
+   (size_t)((x) >> BRICKBITS))
+#define BRICKPOS(x, y, z)                                                      \
+  (((((z) & BRICKMASK) << BRICKBITS) + ((y) & BRICKMASK)) * BRICKSIDE +       \
+   ((x) & BRICKMASK))
+
+/* Value of voxel (x,y,z) of a Brickbox */
+
+#define BRICKGET(bb, x, y, z)                                                  \
+  ((bb)->vox[BRICKNUM(bb, x, y, z)]                                            \
+       ? (bb)->vox[BRICKNUM(bb, x, y, z)][BRICKPOS(x, y, z)]                   \
+       : (bb)->fill[BRICKNUM(bb, x, y, z)])
+
+/***
+ *	The max best sites offered to topsites_offer or topsites_rank
+ *	(topsites.c): site[0..n-1] with their counts, in no particular
+ *	order.  seq ranks sites with equal counts, by when they were
+ *	offered (nseen) or by the rank given to topsites_rank.
+ ***/
+
+typedef struct {
+  int max;
+  int n;
+  int nseen;
+  int *count;
+  int *site;
+  int *seq;
+} Topsites;
+
+/***
+ *	Pool of nodes of elsize bytes made by nodepool_alloc
+ *	(nodepool.c): nchunk chunks of perchunk nodes, the first
+ *	used nodes of chunk cur handed out, and the nodes given back
+ *	since, linked through their first bytes from freed.
+ ***/
+
+typedef struct {
+  size_t elsize;
+  size_t perchunk;
+  void **chunk;
+  size_t nchunk, capchunk;
+  size_t cur;
+  size_t used;
+  void *freed;
+} Nodepool;
+
+/***
+ *	Map of particle ids made by partmap_alloc (partmap.c), in
+ *	blocks of PARTMAPBLK voxels on a side, bx * by * bz of them
+ *	in C order.  bits[b] is the number of bits per voxel of
+ *	block b: 0 if off[b] is the id of all of it, otherwise off[b]
+ *	is where the block starts in pool.  A block of 1, 2 or 4 bits
+ *	is a palette of 2, 4 or 16 ids and then the index of each
+ *	voxel in it; a block of 32 bits is the PARTMAPVOX ids.  The
+ *	voxel (x,y,z) of a block is number ((x * PARTMAPBLK) + y) *
+ *	PARTMAPBLK + z, counting x, y and z from its corner.  maxid
+ *	is the largest id stored (0 if none is positive), and stamp
+ *	is different for every map made.
+ ***/
+
+#define PARTMAPSHIFT 2
+#define PARTMAPBLK (1 << PARTMAPSHIFT)
+#define PARTMAPVOX (PARTMAPBLK * PARTMAPBLK * PARTMAPBLK)
+
+typedef struct {
+  int xsize, ysize, zsize;
+  int bx, by, bz;
+  uint32_t *off;
+  unsigned char *bits;
+  uint32_t *pool;
+  size_t npool, cappool;
+  int maxid;
+  unsigned long stamp;
+} Partmap;
+
+/***
+ *	Percolation of a network of phases found by perc_label
+ *	(perclabel.c).  Phases are put into at most PERCCLASSES
+ *	classes (class 0 is outside the network), and a link table
+ *	says whether two face-sharing voxels of given classes are
+ *	joined always, never, or only when both belong to the same
+ *	particle.  nset is the number of voxels in the network and
+ *	nthrough[d] the number in clusters that percolate in
+ *	direction d (0 = x, 1 = y, 2 = z).  nfront[d] is the number
+ *	a burn started from every network voxel of the first face
+ *	normal to d would reach, nmeet[d] the number of places
+ *	on the last face where that burn arrives opposite a network
+ *	voxel of the first face, and nspan[d] the number in the
+ *	clusters the burn reaches that have a voxel on the last face.
+ *	ncluster is the number of clusters of the image with periodic
+ *	boundaries in all three directions, maxcluster the size of
+ *	the largest, and nsize[b] the number with 2^b up to
+ *	2^(b+1) - 1 voxels (the last bin takes all larger ones).
+ ***/
+
+#define PERCCLASSES 8
+#define PERCNOLINK 0
+#define PERCLINK 1
+#define PERCSAMEPART 2
+#define PERCSIZEBINS 32
+
+typedef struct {
+  int nset;
+  int nthrough[3];
+  int nfront[3];
+  int nmeet[3];
+  int nspan[3];
+  int ncluster, maxcluster;
+  int nsize[PERCSIZEBINS];
+} Percstats;
+
+/***
+ *	One cluster of the periodic image, as listed by
+ *	perc_clusters: its number of voxels, and bit d of through
+ *	set if it holds voxels that percolate in direction d
+ ***/
+
+typedef struct {
+  int size;
+  int through;
+} Perccluster;
+
+/***
+ *	Scratch space for perc_label and perc_track: a parent
+ *	entry for every voxel and four tables over the clusters.
+ *	It is grown when a labeling needs more, and never shrunk,
+ *	so a caller that labels many times can keep one.
+ ***/
+
+typedef struct {
+  size_t nvox, ncl;
+  int *parent;
+  int *csize, *cpar;
+  unsigned char *cthrough, *cfront;
+} Percwork;
+
+/***
+ *	What perc_track keeps between tests of the same network:
+ *	the class of every voxel at the last labeling, the stamp of
+ *	the particle map it used (0 for none), and its result
+ ***/
+
+typedef struct {
+  int xsize, ysize, zsize;
+  int valid;
+  size_t cap;
+  unsigned char *snap;
+  unsigned long partstamp;
+  Percstats last;
+} Perctrack;
+
+/***
+ *	Number of phase ids a voxel byte can hold, and so the
+ *	longest count array phase_census and grid_census fill
+ *	(census.c)
+ ***/
+
+#define CENSUSIDS 256
+
+/***
+ *	Three-dimensional periodic FFT made by fft3d_alloc (fft3d.c).
+ *	data holds xsize*ysize*zsize complex values in C order, real
+ *	and imaginary parts interleaved.  Each axis has its factors,
+ *	its twiddle factors and a line of scratch space for each of
+ *	nthreads threads, so one Fft3d can be used for any number of
+ *	transforms of its size.  With OpenMP the lines of an axis are
+ *	shared out among the threads; the result does not depend on
+ *	their number.
+ ***/
+
+#define FFTMAXFAC 32
+
+typedef struct {
+  int n;
+  int nfac;
+  int fac[FFTMAXFAC];
+  double *tw;
+  double *buf;
+} Fftaxis;
+
+typedef struct {
+  int xsize, ysize, zsize;
+  int nthreads;
+  Fftaxis ax[3];
+  double *data;
+} Fft3d;
+
+/* Real and imaginary parts of element (x,y,z) of an Fft3d */
+
+#define FFTRE(ft, x, y, z)                                                     \
+  ((ft)->data[2 * ((((size_t)(x)) * (ft)->ysize + (size_t)(y)) * (ft)->zsize + \
+                   (size_t)(z))])
+#define FFTIM(ft, x, y, z)                                                     \
+  ((ft)->data[2 * ((((size_t)(x)) * (ft)->ysize + (size_t)(y)) * (ft)->zsize + \
+                   (size_t)(z)) +                                              \
+              1])
+
+/***
+ *	Reader of the ids of an image one x plane (nplane voxels) at
+ *	a time, made by idreader_open (idstream.c).  buf holds a block
+ *	of an ASCII image, n bytes of which are read and pos used, or
+ *	one plane of a binary image.
+ ***/
+
+typedef struct {
+  FILE *fp;
+  int format;
+  size_t nplane;
+  size_t n;
+  size_t pos;
+  unsigned char *buf;
+} Idreader;
+
+/***
+ *	Surface mesh made by voxmesh_build (voxmesh.c): n rectangles,
+ *	each covering exposed faces of one phase.  normal is 2*d for a
+ *	face looking down axis d (0 = x, 1 = y, 2 = z) and 2*d + 1 for
+ *	one looking up it.  corner is the lowest corner, in voxel units
+ *	from the low corner of the box, and the rectangle spans du
+ *	voxels along axis (d+1)%3 and dv along axis (d+2)%3.
+ ***/
+
+typedef struct {
+  int phase;
+  int normal;
+  int corner[3];
+  int du, dv;
+} Voxquad;
+
+typedef struct {
+  int n;
+  int max;
+  Voxquad *quad;
+} Voxmesh;
+
+/***
+ *	Storage class for per-thread static data in vcctllib
+ ***/
+
+#if defined(_MSC_VER)
+#define VCCTL_THREADLOCAL __declspec(thread)
+#else
+#define VCCTL_THREADLOCAL _Thread_local
+#endif
+
 /***
  *	Function declarations needed by VCCTL
  ***/
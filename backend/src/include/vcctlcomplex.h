@@ -33,4 +33,37 @@ fcomplex RCmul(float x, fcomplex a);
 fcomplex **complexmatrix(int nrl, int nrh, int ncl, int nch);
 void free_complexmatrix(fcomplex **m, int nrl, int nrh, int ncl, int nch);
 
+/***
+ *	Spherical harmonics (sphharm.c).  SHMAXDEG is the largest
+ *	degree sphharm evaluates and FACTABMAX the largest
+ *	tabulated factorial.  An Shgrid holds the harmonics at
+ *	every point of a Gaussian quadrature grid: y has
+ *	(nmax+1)^2 values per point, with Y(n,m) at n*n+n+m, and
+ *	geom has the direction cosines and the volume weight of
+ *	each point.  xg and wg are copies of the grid, to tell
+ *	whether a table can be used again.  shrotate turns a set
+ *	of coefficients by Euler angles in coefficient space.
+ ***/
+
+#define SHMAXDEG 40
+#define FACTABMAX 170
+
+typedef struct {
+  int nmax, ntheta, nphi;
+  float *xg, *wg;
+  fcomplex *y;
+  double *geom;
+} Shgrid;
+
+double factorial(int j);
+void sphharm(double theta, double phi, int nmax, fcomplex **y);
+double sphradius(fcomplex **a, fcomplex **y, int nmax);
+int shgrid_make(Shgrid *g, int nmax, int ntheta, int nphi, float *xg,
+                float *wg);
+double shgrid_volume(Shgrid *g, fcomplex **a, float *maxrx, float *maxry,
+                     float *maxrz);
+void shrotate(fcomplex **a, fcomplex **aa, int nmax, double alpha,
+              double beta, double gamma, double scale);
+void shgrid_free(Shgrid *g);
+
 #endif
@@ -21,8 +21,12 @@ void bailout(char *name, char *msg);
 void warning(char *name, char *msg);
 int breakflocs(FILE *pfile, short int *p, short int *part, short int *in,
                short int *jn, short int *kn, int xsize, int ysize, int zsize,
-               float version, float resol);
+               float version, float resol, int nthreads);
 int calcporedist3d(char *name);
+int calcporedist3dmic(char *name, char ***mic, int xsize, int ysize,
+                      int zsize, int rf);
+int calcporedist3dvox(char *name, unsigned char *vox, const unsigned char *id,
+                      int xsize, int ysize, int zsize);
 void cemcolors(int *r, int *g, int *b, int gray);
 int checkbc(int pos, int size);
 int convert_id(int curid, float version);
@@ -33,6 +37,10 @@ void fread_string(FILE *fpin, char *chstr);
 double mediansize(FILE *fpin);
 void messages();
 char *gtime(void);
+FILE *log_attach(FILE *fp);
+FILE *log_open(const char *name, const char *mode);
+void log_flush(FILE *fp);
+int log_close(FILE *fp);
 int *ivector(size_t size);
 short int *sivector(size_t size);
 long int *livector(size_t size);
@@ -55,8 +63,32 @@ int ***icube(size_t size);
 int ***ibox(size_t xsize, size_t ysize, size_t zsize);
 int Int3darray(Int3d *thing, size_t xsize, size_t ysize, size_t zsize);
 size_t getInt3dindex(Int3d thing, size_t x, size_t y, size_t z);
+int UChar3darray(UChar3d *thing, size_t xsize, size_t ysize, size_t zsize);
+size_t getUChar3dindex(UChar3d thing, size_t x, size_t y, size_t z);
 unsigned short int ***usicube(size_t size);
 unsigned short int ***usibox(size_t xsize, size_t ysize, size_t zsize);
+void *alignedblock(size_t nbytes);
+void free_alignedblock(void *p);
+char ***cgrid(size_t xsize, size_t ysize, size_t zsize);
+short int ***sigrid(size_t xsize, size_t ysize, size_t zsize);
+int ***igrid(size_t xsize, size_t ysize, size_t zsize);
+float ***fgrid(size_t xsize, size_t ysize, size_t zsize);
+double ***dgrid(size_t xsize, size_t ysize, size_t zsize);
+unsigned short int ***usigrid(size_t xsize, size_t ysize, size_t zsize);
+char ***cgridhalo(size_t xsize, size_t ysize, size_t zsize, int halo);
+short int ***sigridhalo(size_t xsize, size_t ysize, size_t zsize, int halo);
+char ***cgridtile(size_t xsize, size_t ysize, size_t zsize, int halo);
+short int ***sigridtile(size_t xsize, size_t ysize, size_t zsize, int halo);
+void gridhalo(void *grid, int xsize, int ysize, int zsize);
+int gridcrack(void *grid, int axis, int start, int width, int xsize,
+              int ysize, int zsize);
+Gridinfo *gridinfo(void *grid);
+void *gridblock(void *grid);
+void touchblock(void *p, size_t nbytes, int nthreads);
+void gridtouch(void *grid, int nthreads);
+void memtag(const char *tag);
+size_t mempeak(void);
+void memreport(FILE *fp);
 void free_fvector(float *fv);
 void free_dvector(double *dv);
 void free_ldvector(long double *ldv);
@@ -74,21 +106,197 @@ void free_dbox(double ***fc, size_t xsize, size_t ysize);
 void free_icube(int ***fc, size_t size);
 void free_ibox(int ***fc, size_t xsize, size_t ysize);
 void free_Int3darray(Int3d *thing);
+void free_UChar3darray(UChar3d *thing);
 void free_usicube(unsigned short int ***fc, size_t size);
 void free_usibox(unsigned short int ***fc, size_t xsize, size_t ysize);
+void free_cgrid(char ***fc);
+void free_sigrid(short int ***fc);
+void free_igrid(int ***fc);
+void free_fgrid(float ***fc);
+void free_dgrid(double ***fc);
+void free_usigrid(unsigned short int ***fc);
 void free_sisquare(short int **is, size_t size);
 void free_sirect(short int **is, size_t xsize);
 void free_irect(int **is, size_t xsize);
 void free_drect(double **is, size_t xsize);
 int probe_imgheader(char *name, float *ver, int *xsize, int *ysize, int *zsize,
                     float *res);
+int probe_imgheader_fmt(char *name, float *ver, int *xsize, int *ysize,
+                        int *zsize, float *res, int *format);
 double ran1(int *idum);
+double ran1_r(Ran1state *st);
+void ran1load(Ran1state *state);
+void ran1save(Ran1state *state);
+void rng_seed(Rngstate *st, uint64_t seed);
+uint64_t rng_next(Rngstate *st);
+double rng_uniform(Rngstate *st);
+void rng_fill(Rngstate *st, double *buf, size_t n);
+void rng_jump(Rngstate *st);
+void rng_longjump(Rngstate *st);
+void rng_stream(Rngstate *st, uint64_t seed, int k);
 int read_imgheader(FILE *fpin, float *ver, int *xsize, int *ysize, int *zsize,
                    float *res);
+int read_imgheader_fmt(FILE *fpin, float *ver, int *xsize, int *ysize,
+                       int *zsize, float *res, int *format);
+int read_imgformat(FILE *fpin);
+int read_binvoxels(FILE *fpin, unsigned char *vox, int xsize, int ysize,
+                   int zsize, int format);
+int write_binimg(FILE *fpout, unsigned char *vox, int xsize, int ysize,
+                 int zsize, float res, int format);
+int write_binheader(FILE *fpout, int xsize, int ysize, int zsize, float res,
+                    int format);
+int write_binplane(FILE *fpout, unsigned char *plane, size_t nbytes,
+                   int format);
+int read_binplane(FILE *fpin, unsigned char *plane, size_t nbytes, int format);
+int read_binslab(FILE *fpin, unsigned char *slab, int xsize, int ysize,
+                 int zsize, int format, int axis, int first, int nplanes);
+int map_binimg(char *name, Mappedimg *img);
+int create_binimg(char *name, int xsize, int ysize, int zsize, float res,
+                  Mappedimg *img);
+void unmap_binimg(Mappedimg *img);
+FILE *handoff_open(char *name, char *kind, size_t len);
+int handoff_close(FILE *fp);
+int layerwin_open(Layerwin *w, char *inname, char *outname, int order,
+                  int top, int bottom);
+int layerwin_id(Layerwin *w, int ix, int iy, int iz);
+int layerwin_need(Layerwin *w, int zlo, int zhi);
+int layerwin_close(Layerwin *w);
+void layerwin_free(Layerwin *w);
+int trace_open(char *name, char *prog, int nthreads, int counters);
+int trace_on(void);
+void trace_begin(Tracemark *m, int tid);
+void trace_end(Tracemark *m, const char *name, int tid);
+void trace_report(FILE *log);
+int trace_close(void);
+void trace_detach(void);
+int vtkimg_open(Vtkimg *v, char *name, int xsize, int ysize, int zsize,
+                float res);
+int vtkimg_array(Vtkimg *v, const char *name, int type, int ncomp);
+int vtkimg_begin(Vtkimg *v);
+int vtkimg_plane(Vtkimg *v, const void *plane);
+int vtkimg_end(Vtkimg *v);
+int vtkimg_close(Vtkimg *v);
+int movie_create(char *name, Movie *mv, int xsize, int ysize, float res);
+int movie_open(char *name, Movie *mv, int writable);
+int movie_append(Movie *mv, unsigned char *frame);
+int movie_frame(Movie *mv, int k, unsigned char *frame);
+void movie_close(Movie *mv);
+int series_create(char *name, Series *sr, int xsize, int ysize, int zsize,
+                  float res, int keyevery);
+int series_open(char *name, Series *sr, int writable);
+int series_append(Series *sr, unsigned char *vox, float time);
+int series_frame(Series *sr, int k, unsigned char *vox, float *time);
+void series_close(Series *sr);
+void rescache_init(Rescache *rc, const char *dir, const char *prog);
+void rescache_add(Rescache *rc, const void *data, size_t n);
+FILE *rescache_open(Rescache *rc);
+FILE *rescache_create(Rescache *rc);
+int rescache_commit(Rescache *rc, FILE *fp, int failed);
+int read_micvoxels(FILE *fpin, unsigned char *vox, int xsize, int ysize,
+                   int zsize, float ver, int format);
+int load_microstructure(FILE *fpin, unsigned char **vox, size_t *cap,
+                        float *ver, int *xsize, int *ysize, int *zsize,
+                        float *res);
+int boxtable_alloc(Boxtable *bt, int xsize, int ysize, int zsize);
+void boxtable_build(Boxtable *bt);
+int boxtable_count(Boxtable *bt, int boxsize, int qx, int qy, int qz);
+void boxtable_free(Boxtable *bt);
+int topsites_alloc(Topsites *ts, int max);
+void topsites_offer(Topsites *ts, int count, int site);
+void topsites_rank(Topsites *ts, int count, int site, int seq);
+void topsites_free(Topsites *ts);
+int nodepool_alloc(Nodepool *np, size_t elsize, size_t perchunk);
+void *nodepool_get(Nodepool *np);
+void nodepool_put(Nodepool *np, void *node);
+void nodepool_reset(Nodepool *np);
+void nodepool_free(Nodepool *np);
+int partmap_alloc(Partmap *pm, int xsize, int ysize, int zsize);
+int partmap_reserve(Partmap *pm, size_t nwords);
+int partmap_putslab(Partmap *pm, int x0, const int *ids);
+int partmap_get(const Partmap *pm, int x, int y, int z);
+void partmap_row(const Partmap *pm, int x, int y, int *dst);
+int partmap_crack(Partmap *pm, int axis, int start, int width);
+size_t partmap_bytes(const Partmap *pm);
+void partmap_free(Partmap *pm);
+int fft3d_alloc(Fft3d *ft, int xsize, int ysize, int zsize, int nthreads);
+void fft3d_forward(Fft3d *ft);
+void fft3d_inverse(Fft3d *ft);
+void fft3d_free(Fft3d *ft);
+int cpu_level(void);
+const char *cpu_levelname(int level);
+int thread_default(int dflt);
+int twopoint(unsigned char *in, unsigned char *dom, int xsize, int ysize,
+             int zsize, int rmax, double *s2, int nthreads);
+int chords(unsigned char *in, unsigned char *dom, int xsize, int ysize,
+           int zsize, int maxlen, double *nchord, double *lineal);
+int poreradii(unsigned char *pore, int xsize, int ysize, int zsize, int rmax,
+              int *rad);
+int poreintrude(int *rad, int xsize, int ysize, int zsize, int rmax);
+int sphcover(int *rad, int xsize, int ysize, int zsize, int rmax,
+             int *ndiam);
+int poresizes(unsigned char *pore, int xsize, int ysize, int zsize,
+              int maxdiam, int *ndiam);
+int sqdistance(unsigned char *feat, int xsize, int ysize, int zsize,
+               int *d2);
+int voxmesh_build(Voxmesh *vm, unsigned char *vox, int xsize, int ysize,
+                  int zsize, int *lo, int *hi, int skip);
+int voxmesh_write_ply(Voxmesh *vm, FILE *fpout, float scale, int *red,
+                      int *green, int *blue);
+int voxmesh_write_vrml(Voxmesh *vm, FILE *fpout, float scale, int *red,
+                       int *green, int *blue);
+void voxmesh_free(Voxmesh *vm);
+int idreader_open(Idreader *rd, FILE *fpin, int format, size_t nplane);
+int idreader_plane(Idreader *rd, int *ids);
+void idreader_close(Idreader *rd);
+int write_idplane(FILE *fpout, unsigned char *plane, size_t nplane,
+                  int format);
+void thames_idtable(int *table, int corr);
+int thames_convert(FILE *fpin, FILE *fpout, int *table, int format);
+int thames_convert_path(char *progname, char *path, char *outdir, int *table,
+                        int format);
+int phase_census(unsigned char *vox, int xsize, int ysize, int zsize,
+                 int nids, int *count, int *poreface);
+int grid_census(char ***grid, int xsize, int ysize, int zsize, int nids,
+                int *count);
+int phase_interfaces(unsigned char *vox, int xsize, int ysize, int zsize,
+                     int nids, int *count, int *pair, int *surfvox,
+                     int nthreads);
+int perc_label(char ***mic, const Partmap *part, int xsize, int ysize,
+               int zsize, const unsigned char *cls,
+               const unsigned char link[PERCCLASSES][PERCCLASSES],
+               Percstats *ps);
+int perc_label_classes(const unsigned char *cl, const Partmap *part, int xsize,
+                       int ysize, int zsize,
+                       const unsigned char link[PERCCLASSES][PERCCLASSES],
+                       Percstats *ps);
+int perc_clusters(char ***mic, const Partmap *part, int xsize, int ysize,
+                  int zsize, const unsigned char *cls,
+                  const unsigned char link[PERCCLASSES][PERCCLASSES],
+                  Percstats *ps, Perccluster **clist);
+int perc_label_groups(char ***mic, int xsize, int ysize, int zsize,
+                      const unsigned char *grp, Percstats *ps);
+int percwork_alloc(Percwork *pw, size_t nvox, size_t ncl);
+void percwork_free(Percwork *pw);
+int perc_track(Perctrack *pt, Percwork *pw, char ***mic, const Partmap *part,
+               int xsize, int ysize, int zsize, const unsigned char *cls,
+               const unsigned char link[PERCCLASSES][PERCCLASSES],
+               Percstats *ps);
+void perc_track_free(Perctrack *pt);
 void read_string(char *chstr, unsigned int size);
 void skip_imgheader(FILE *fpin);
 int write_imgheader(FILE *fpout, int xsize, int ysize, int zsize, float res);
 pixel_t *pixel_at(bitmap_t *bitmap, int x, int y);
 int save_png_to_file(bitmap_t *bitmap, const char *path);
+int save_png_level(bitmap_t *bitmap, const char *path, int level);
+int save_png_threads(bitmap_t *bitmap, const char *path, int level,
+                     int nthreads);
+int save_ppm_to_file(bitmap_t *bitmap, const char *path);
+int brickbox_alloc(Brickbox *bb, int xsize, int ysize, int zsize, int val);
+int brickbox_set(Brickbox *bb, int x, int y, int z, int val);
+size_t brickbox_tidy(Brickbox *bb);
+void brickbox_copy(Brickbox *bb, size_t n, int *vox);
+void brickbox_put(Brickbox *bb, size_t n, int *vox);
+size_t brickbox_bytes(Brickbox *bb);
+void brickbox_free(Brickbox *bb);
 
 #endif
@@ -3,6 +3,12 @@
  * Program leach3d.c to leach one or more phases
  * from a hydrated 3D microstructure
  *
+ * Only pixels of a leachable phase that touch porosity can
+ * be leached, so those pixels are kept in a front list,
+ * in scan order, and each cycle visits the front instead
+ * of the whole microstructure.  Pixels join the front when
+ * a neighbor is leached.
+ *
  * Programmer:	Dale P. Bentz
  * 				Building and Fire Research Laboratory
  *				NIST
@@ -36,6 +42,11 @@ int ***Mic;
 int Xsyssize, Ysyssize, Zsyssize;
 int Phase[NUMLEACHABLE], Leach[NUMLEACHABLE];
 int *Seed;
+
+/* Leaching front, as scan indices (x*Ysyssize+y)*Zsyssize+z */
+int *Front = NULL;
+int Nfront = 0, Frontcap = 0;
+unsigned char *Infront = NULL;
 int Xoff[27] = {1, 0, 0,  -1, 0, 0, 1, 1, -1, -1, 0,  0,  0, 0,
                 1, 1, -1, -1, 1, 1, 1, 1, -1, -1, -1, -1, 0};
 int Yoff[27] = {0, 1, 0, 0, -1, 0,  1, -1, 1, -1, 1,  -1, 1, -1,
@@ -52,11 +63,15 @@ float Version;
  ***/
 
 int chckedge(int xck, int yck, int zck);
-void passleach(float prleach);
+int leachable(int phase);
+int addfront(int xf, int yf, int zf);
+int buildfront(void);
+int passleach(float prleach);
 
 int main(void) {
-  int iseed, k, ix, iy, iz, valin, ovalin, chl, c3sl, c2sl, c3al, c4afl,
-      leachcyc;
+  int iseed, k, ix, iy, iz, chl, c3sl, c2sl, c3al, c4afl, leachcyc;
+  size_t n, cap = 0;
+  unsigned char *vox = NULL;
   float testf, leachprob;
   char filein[MAXSTRING], fileout[MAXSTRING], instring[MAXSTRING];
   FILE *infile, *outfile;
@@ -89,11 +104,15 @@ int main(void) {
    *
    ****/
 
-  if (read_imgheader(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize, &Res)) {
+  if (load_microstructure(infile, &vox, &cap, &Version, &Xsyssize, &Ysyssize,
+                          &Zsyssize, &Res)) {
     fclose(infile);
-    bailout("leach3d", "Error reading image header");
+    if (vox)
+      free(vox);
+    bailout("leach3d", "Error reading microstructure image");
     exit(1);
   }
+  fclose(infile);
 
   /***
    *	Allocate memory for the global 3D array
@@ -102,24 +121,23 @@ int main(void) {
 
   Mic = ibox(Xsyssize, Ysyssize, Zsyssize);
   if (!Mic) {
-    fclose(infile);
+    free(vox);
     bailout("leach3d", "Could not allocate memory for Mic array");
     exit(1);
   }
 
-  for (iz = 0; iz < Zsyssize; iz++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      for (ix = 0; ix < Xsyssize; ix++) {
+  /* C order, as load_microstructure gives it (z varies fastest) */
 
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valin = convert_id(ovalin, Version);
-        Mic[ix][iy][iz] = valin;
+  n = 0;
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      for (iz = 0; iz < Zsyssize; iz++) {
+        Mic[ix][iy][iz] = vox[n++];
       }
     }
   }
 
-  fclose(infile);
+  free(vox);
 
   printf("Enter on/off (0/1) selections for CH, C3S, C2S, C3A,and C4AF \n");
   printf("(one entry per line)\n");
@@ -182,9 +200,22 @@ int main(void) {
      *	the leaching over one cycle
      ***/
 
-    for (ix = 1; ix <= leachcyc; ix++) {
-      passleach(leachprob);
+    if (buildfront()) {
+      free_ibox(Mic, Xsyssize, Ysyssize);
+      bailout("leach3d", "Could not allocate memory for leaching front");
+      exit(1);
     }
+
+    for (ix = 1; ix <= leachcyc && Nfront > 0; ix++) {
+      if (passleach(leachprob)) {
+        free_ibox(Mic, Xsyssize, Ysyssize);
+        bailout("leach3d", "Could not allocate memory for leaching front");
+        exit(1);
+      }
+    }
+
+    free(Front);
+    free(Infront);
   }
 
   outfile = filehandler("leach3d", fileout, "WRITE");
@@ -205,13 +236,14 @@ int main(void) {
     exit(1);
   }
 
-  for (iz = 0; iz < Zsyssize; iz++) {
+  for (ix = 0; ix < Xsyssize; ix++) {
     for (iy = 0; iy < Ysyssize; iy++) {
-      for (ix = 0; ix < Xsyssize; ix++) {
-        fprintf(outfile, "%d\n", Mic[ix][iy][iz]);
+      for (iz = 0; iz < Zsyssize; iz++) {
+        fprintf(outfile, "\n%d", Mic[ix][iy][iz]);
       }
     }
   }
+  fprintf(outfile, "\n");
 
   fclose(outfile);
   free_ibox(Mic, Xsyssize, Ysyssize);
@@ -263,95 +295,188 @@ int chckedge(int xck, int yck, int zck) {
 }
 
 /***
- *	passleach
+ *	leachable
  *
- *	Routine to adjust local position if outside system boundaries
- *	Uses periodic boundary conditions in every direction
+ * 	Check if a phase is one of the phases selected for
+ * 	leaching
  *
- *	Arguments:	Float probability of leaching
- *	Returns:	Nothing
+ * 	Arguments:	integer phase id
  *
- *	Calls:		No functions
- *	Called by:	main
+ * 	Returns:	1 if it is leached, 0 otherwise
+ *
+ *	Calls:		no other routines
+ *	Called by:	buildfront, passleach
  ***/
-void passleach(float prleach) {
-  int xid, yid, zid, phid, edgef, phread;
+int leachable(int phase) {
+  int k;
 
-  /***
-   *	Scan the entire 3-D microstructure
-   *	and identify leachable sites
-   ***/
-
-  for (zid = 0; zid < Zsyssize; zid++) {
-    for (yid = 0; yid < Ysyssize; yid++) {
-      for (xid = 0; xid < Xsyssize; xid++) {
-
-        phread = Mic[xid][yid][zid];
-        phid = 0;
-
-        if (phread == CH) {
-          phid = 1;
-        } else if (phread == C3S) {
-          phid = 2;
-        } else if (phread == C2S) {
-          phid = 3;
-        } else if (phread == C3A) {
-          phid = 4;
-        } else if (phread == C4AF) {
-          phid = 5;
-        }
-
-        /* Only examine leachable phases */
+  for (k = 1; k < NUMLEACHABLE; k++) {
+    if ((phase == Phase[k]) && (Leach[k] == 1))
+      return (1);
+  }
 
-        if (phid != 0) {
+  return (0);
+}
 
-          /***
-           *	If phase is soluble, see if it
-           *	is in contact with porosity
-           ***/
+/***
+ *	addfront
+ *
+ * 	Add a pixel to the end of the leaching front, growing
+ * 	the list when it is full
+ *
+ * 	Arguments:	integer x,y, and z coordinates of the pixel
+ *
+ * 	Returns:	0 if okay, 1 if out of memory
+ *
+ *	Calls:		no other routines
+ *	Called by:	buildfront, passleach
+ ***/
+int addfront(int xf, int yf, int zf) {
+  int n, *newp;
+
+  n = (xf * Ysyssize + yf) * Zsyssize + zf;
+  if (Infront[n])
+    return (0);
+
+  if (Nfront == Frontcap) {
+    Frontcap = (Frontcap > 0) ? 2 * Frontcap : 1024;
+    newp = (int *)realloc(Front, (size_t)Frontcap * sizeof(int));
+    if (!newp)
+      return (1);
+    Front = newp;
+  }
 
-          if (Leach[phid] == 1) {
+  Front[Nfront++] = n;
+  Infront[n] = 1;
 
-            edgef = chckedge(xid, yid, zid);
+  return (0);
+}
 
-            if (edgef) {
+/***
+ *	buildfront
+ *
+ * 	Find every pixel of a leachable phase that touches
+ * 	porosity, in scan order (z varies fastest, then y,
+ * 	then x, as in the image file)
+ *
+ * 	Arguments:	None
+ *
+ * 	Returns:	0 if okay, 1 if out of memory
+ *
+ *	Calls:		leachable, chckedge, addfront
+ *	Called by:	main
+ ***/
+int buildfront(void) {
+  int xid, yid, zid;
 
-              /***
-               *	Surface eligible species has an
-               *	ID OFFSET greater than its original
-               *	value
-               ***/
+  Infront = (unsigned char *)calloc((size_t)Xsyssize * Ysyssize * Zsyssize, 1);
+  if (!Infront)
+    return (1);
 
-              Mic[xid][yid][zid] += OFFSET;
-            }
-          }
+  for (xid = 0; xid < Xsyssize; xid++) {
+    for (yid = 0; yid < Ysyssize; yid++) {
+      for (zid = 0; zid < Zsyssize; zid++) {
+        if (leachable(Mic[xid][yid][zid]) && chckedge(xid, yid, zid)) {
+          if (addfront(xid, yid, zid))
+            return (1);
         }
+      }
+    }
+  }
 
-      } /* End of zid */
-    }   /* End of yid */
-  }     /* End of xid */
+  return (0);
+}
 
-  /* Now perform the leaching */
+/***
+ *	cmpfront
+ *
+ * 	Order two front entries by scan index, for qsort
+ *
+ * 	Arguments:	void pointers to the two entries
+ *
+ * 	Returns:	negative, zero or positive
+ *
+ *	Calls:		no other routines
+ *	Called by:	passleach
+ ***/
+static int cmpfront(const void *a, const void *b) {
+  return ((*(const int *)a > *(const int *)b) -
+          (*(const int *)a < *(const int *)b));
+}
 
-  for (zid = 0; zid < Zsyssize; zid++) {
-    for (yid = 0; yid < Ysyssize; yid++) {
-      for (xid = 0; xid < Xsyssize; xid++) {
+/***
+ *	passleach
+ *
+ *	Perform one cycle of leaching.  Every pixel on the front
+ *	is leached with probability prleach, in scan order, so
+ *	the random numbers are drawn as a scan of the whole
+ *	microstructure would draw them.  The leachable neighbors
+ *	of the leached pixels then join the front, which is put
+ *	back in scan order for the next cycle.
+ *
+ *	Arguments:	Float probability of leaching
+ *	Returns:	0 if okay, 1 if out of memory
+ *
+ *	Calls:		leachable, addfront
+ *	Called by:	main
+ ***/
+int passleach(float prleach) {
+  int i, nold, nkeep, n, ip;
+  int xid, yid, zid, x2, y2, z2;
 
-        if (Mic[xid][yid][zid] >= OFFSET) {
+  /***
+   *	Which pixels can be leached was settled when they
+   *	joined the front, so they are leached at once.  A
+   *	leached entry is marked by making it negative.
+   ***/
 
-          if (ran1(Seed) < prleach) {
-            Mic[xid][yid][zid] = 0;
-          } else {
+  for (i = 0; i < Nfront; i++) {
+    if (ran1(Seed) < prleach) {
+      n = Front[i];
+      Mic[n / (Ysyssize * Zsyssize)][(n / Zsyssize) % Ysyssize]
+         [n % Zsyssize] = POROSITY;
+      Infront[n] = 0;
+      Front[i] = -1 - n;
+    }
+  }
 
-            /***
-             *	Restore the pixel to its
-             *	original phase
-             ***/
+  /***
+   *	The leachable neighbors of the leached pixels are
+   *	added after the old front, then the old entries
+   *	that are left and the new ones are packed together
+   ***/
 
-            Mic[xid][yid][zid] -= OFFSET;
-          }
-        }
+  nold = Nfront;
+  for (i = 0; i < nold; i++) {
+    if (Front[i] >= 0)
+      continue;
+    n = -1 - Front[i];
+    xid = n / (Ysyssize * Zsyssize);
+    yid = (n / Zsyssize) % Ysyssize;
+    zid = n % Zsyssize;
+    for (ip = 0; ip < NEIGHBORS; ip++) {
+      x2 = xid + Xoff[ip];
+      y2 = yid + Yoff[ip];
+      z2 = zid + Zoff[ip];
+      x2 += checkbc(x2, Xsyssize);
+      y2 += checkbc(y2, Ysyssize);
+      z2 += checkbc(z2, Zsyssize);
+      if (leachable(Mic[x2][y2][z2])) {
+        if (addfront(x2, y2, z2))
+          return (1);
       }
     }
   }
+
+  nkeep = 0;
+  for (i = 0; i < Nfront; i++) {
+    if (Front[i] >= 0)
+      Front[nkeep++] = Front[i];
+  }
+
+  if (Nfront > nold)
+    qsort(Front, (size_t)nkeep, sizeof(int), cmpfront);
+  Nfront = nkeep;
+
+  return (0);
 }
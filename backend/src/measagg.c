@@ -3,6 +3,13 @@
  * Program measagg.c to measure phase fractions as a function
  * of distance away from an aggregate surface
  *
+ * By default the aggregate is taken to be a slab normal to x,
+ * and the layers of voxels on either side of it are counted.
+ * With -w (--width), the distance of every voxel to the
+ * nearest aggregate voxel is found once by a distance
+ * transform, and all voxels are binned by that distance, so
+ * aggregates of any shape can be profiled at any bin width.
+ *
  * Programmer:	Dale P. Bentz
  * 				Building and Fire Research Laboratory
  *				NIST
@@ -21,6 +28,8 @@
  *
  *******************************************************/
 #include "include/vcctl.h"
+#include <getopt.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -37,14 +46,29 @@ float Res = DEFAULTRESOLUTION;
 /* VCCTL software version used to create input file */
 float Version;
 
-int main(void) {
-  register int i, j, k, iy, iz;
+/* Bin width (voxels) of the distance-map profile, 0 for slab layers */
+float Binwidth = 0.0;
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
+void layerprofile(short int ***mic, int ixmin, int ixmax, FILE *aggfile);
+int distprofile(short int ***mic, FILE *aggfile);
+
+int main(int argc, char *argv[]) {
+  register int i, j, k;
   short int ***mic;
-  int phase[NPHASES], ptot, valin, ovalin, ixmin, ixmax;
-  int icnt, ixlo, ixhi, phid, idist, aggsize;
+  int valin, ovalin, ixmin, ixmax;
   char filein[MAXSTRING], fileout[MAXSTRING], instring[MAXSTRING];
   FILE *infile, *aggfile;
 
+  if (checkargs(argc, argv)) {
+    printHelp();
+    exit(1);
+  }
+
   printf("Enter name of file with the image to be analyzed \n");
   read_string(filein, sizeof(filein));
 
@@ -272,9 +296,45 @@ int main(void) {
     }
   }
 
+  printf("\n");
+  fprintf(aggfile, "\n");
   fflush(stdout);
   fflush(aggfile);
 
+  if (Binwidth > 0.0) {
+    if (distprofile(mic, aggfile)) {
+      fclose(aggfile);
+      free_sibox(mic, Xsyssize, Ysyssize);
+      exit(1);
+    }
+  } else {
+    layerprofile(mic, ixmin, ixmax, aggfile);
+  }
+
+  fclose(aggfile);
+  free_sibox(mic, Xsyssize, Ysyssize);
+
+  return (0);
+}
+
+/***
+ *	layerprofile
+ *
+ *	Counts the phases in the layers on either side of a slab
+ *	of aggregate normal to x, one voxel further out at a time
+ *
+ * 	Arguments:	short int pointer to the mic array
+ * 				int ixmin, ixmax, the x limits of the aggregate
+ * 				FILE pointer to the output file
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void layerprofile(short int ***mic, int ixmin, int ixmax, FILE *aggfile) {
+  int i, iy, iz, phase[NPHASES], ptot;
+  int icnt, ixlo, ixhi, phid, idist, aggsize;
+
   aggsize = ixmax - ixmin + 1;
 
   printf("aggsize is %d \n", aggsize);
@@ -284,10 +344,10 @@ int main(void) {
   for (idist = 1; idist <= (Xsyssize - aggsize) / 2; idist++) {
 
     /* Pixel left of aggregate surface */
-    ixlo = ((Xsyssize - aggsize + 2) / 2) - idist;
+    ixlo = (ixmin - idist + Xsyssize) % Xsyssize;
 
     /* Pixel right of aggregate surface */
-    ixhi = ((Xsyssize + aggsize) / 2) + idist;
+    ixhi = (ixmax + idist) % Xsyssize;
 
     /* Initialize phase counts for this distance */
     for (icnt = 0; icnt < NPHASES; icnt++) {
@@ -324,8 +384,169 @@ int main(void) {
     }
   }
 
-  fclose(aggfile);
-  free_sibox(mic, Xsyssize, Ysyssize);
+  return;
+}
+
+/***
+ *	distprofile
+ *
+ *	Counts the phases by distance to the nearest aggregate
+ *	voxel, in bins Binwidth voxels wide.  The distances come
+ *	from one periodic Euclidean distance transform, and each
+ *	bin is labeled by the distance at its middle.  Bin k holds
+ *	distances from 0.5 + k*Binwidth up to 0.5 + (k+1)*Binwidth,
+ *	so with a width of 1 and a slab of aggregate the bins are
+ *	the same layers layerprofile counts.
+ *
+ * 	Arguments:	short int pointer to the mic array
+ * 				FILE pointer to the output file
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		sqdistance
+ *	Called by:	main program
+ ***/
+int distprofile(short int ***mic, FILE *aggfile) {
+  int i, j, k, b, nbins, phid, maxd2, *d2, *count;
+  size_t n, nvox;
+  unsigned char *agg;
+
+  nvox = (size_t)Xsyssize * Ysyssize * Zsyssize;
+  agg = (unsigned char *)malloc(nvox);
+  d2 = (int *)malloc(nvox * sizeof(int));
+  if (!agg || !d2) {
+    free(agg);
+    free(d2);
+    bailout("measagg", "Memory allocation failure");
+    return (1);
+  }
+
+  n = 0;
+  for (k = 0; k < Zsyssize; k++) {
+    for (j = 0; j < Ysyssize; j++) {
+      for (i = 0; i < Xsyssize; i++) {
+        agg[n++] = (mic[i][j][k] == INERTAGG);
+      }
+    }
+  }
+
+  if (sqdistance(agg, Xsyssize, Ysyssize, Zsyssize, d2)) {
+    free(agg);
+    free(d2);
+    bailout("measagg", "Memory allocation failure");
+    return (1);
+  }
+  free(agg);
+
+  maxd2 = 0;
+  for (n = 0; n < nvox; n++) {
+    if (d2[n] > maxd2)
+      maxd2 = d2[n];
+  }
+  if (maxd2 <= 0) {
+    free(d2);
+    bailout("measagg", "No aggregate, or no paste, in the image");
+    return (1);
+  }
+
+  nbins = (int)((sqrt((double)maxd2) - 0.5) / Binwidth) + 1;
+  count = (int *)calloc((size_t)nbins * (NPHASES), sizeof(int));
+  if (!count) {
+    free(d2);
+    bailout("measagg", "Memory allocation failure");
+    return (1);
+  }
+
+  printf("Largest distance from aggregate is %f \n", sqrt((double)maxd2));
+
+  n = 0;
+  for (k = 0; k < Zsyssize; k++) {
+    for (j = 0; j < Ysyssize; j++) {
+      for (i = 0; i < Xsyssize; i++, n++) {
+        if (d2[n] <= 0)
+          continue;
+        b = (int)((sqrt((double)d2[n]) - 0.5) / Binwidth);
+        if (b >= nbins)
+          b = nbins - 1;
+        phid = mic[i][j][k];
+        count[b * (NPHASES) + phid]++;
+      }
+    }
+  }
+  free(d2);
+
+  /* Output results for each bin of distance from the surface */
+
+  for (b = 0; b < nbins; b++) {
+    fprintf(aggfile, "%.2f ", 0.5 + (b + 0.5) * Binwidth);
+    for (i = 0; i < NPHASES; i++) {
+      if (i <= NSPHASES && i != INERTAGG) {
+        fprintf(aggfile, "%d ", count[b * (NPHASES) + i]);
+      } else if (i == EMPTYP) {
+        fprintf(aggfile, "%d\n", count[b * (NPHASES) + i]);
+      }
+    }
+  }
+
+  free(count);
 
   return (0);
 }
+
+/***
+ *	checkargs
+ *
+ *	Read the command line
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"width", required_argument, 0, 'w'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  while ((opt_char = getopt_long(argc, argv, "w:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -w or --width */
+    case (int)('w'):
+      Binwidth = atof(optarg);
+      if (Binwidth <= 0.0)
+        return (1);
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (optind != argc)
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ *	Arguments:	none
+ *	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: measagg [-w,--width <voxels>]\n\n");
+  fprintf(stderr, "  --width   bin the phases by distance to the nearest\n");
+  fprintf(stderr, "            aggregate voxel, in bins this many voxels\n");
+  fprintf(stderr, "            wide, instead of by layers beside a slab\n\n");
+  fprintf(stderr, "The image and output file names are prompted for.\n\n");
+
+  return;
+}
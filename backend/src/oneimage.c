@@ -2,8 +2,14 @@
  *
  * Program oneimage
  *
- * Creates a PPM file for one slice of a
+ * Creates a PNG or PPM file for one slice of a
  * 3D microstructure
+ *
+ * Only the planes needed for the slice (and for the
+ * depth shading, when enabled) are read from a binary
+ * image, so the time taken does not depend on the
+ * size of the rest of the image.  An ASCII image still
+ * has to be read in full.
  ******************************************************/
 #include <png.h>
 #include "include/vcctl.h"
@@ -11,24 +17,32 @@
 #include <stdlib.h>
 #include <string.h>
 
+/***
+ *    Most planes looked through when depth perception
+ *    is enabled
+ ***/
+#define MAXDEPTH 10
+
 /***
  *    Global variables
  ***/
 float Version;
 
 int main(void) {
-  int ovalin, xsyssize, ysyssize, zsyssize, izz, done, nd;
+  int xsyssize, ysyssize, zsyssize, done, nd, format;
   int valout, i1, j1, i, viewdepth, bse, ix, iy;
   int dx, dy, j, k, iscale, dxtot, dytot, view, slice;
-  int ***mic;
+  int axis, size, nplanes, sx, sy, sz, x, y, z, status;
   int *red, *green, *blue;
   float res;
-  double **dshade;
+  double shade;
   char filein[MAXSTRING], fileout[MAXSTRING], instring[MAXSTRING];
+  char *ext;
+  size_t n, cap = 0;
+  unsigned char *vox = NULL, *slab = NULL;
   FILE *infile;
   bitmap_t image;
 
-  mic = NULL;
   image.pixels = NULL;
   red = NULL;
   green = NULL;
@@ -102,7 +116,6 @@ int main(void) {
 
   /***
    *    Open the input 3D image file
-   *    and the 2D output image file
    ***/
 
   infile = filehandler("oneimage", filein, "READ");
@@ -111,12 +124,14 @@ int main(void) {
   }
 
   /***
-   *    Read first line of image file to determine
-   *    if size is specified.  If it is specified
-   *    then read it.  If not, set the size to 100
+   *    Read the header, which leaves the stream at
+   *    the first voxel
    ***/
 
-  if (read_imgheader(infile, &Version, &xsyssize, &ysyssize, &zsyssize, &res)) {
+  if (read_imgheader_fmt(infile, &Version, &xsyssize, &ysyssize, &zsyssize,
+                         &res, &format) ||
+      (format != IMG_ASCII && format != IMG_UINT8 && format != IMG_UINT8Z)) {
+    fclose(infile);
     bailout("oneimage", "Error reading image header");
     exit(1);
   }
@@ -137,12 +152,24 @@ int main(void) {
   if (view == 1) {
     dx = ysyssize;
     dy = zsyssize;
+    axis = 0;
+    size = xsyssize;
   } else if (view == 2) {
     dx = xsyssize;
     dy = zsyssize;
+    axis = 1;
+    size = ysyssize;
   } else {
     dx = xsyssize;
     dy = ysyssize;
+    axis = 2;
+    size = zsyssize;
+  }
+
+  if (slice < 0 || slice >= size) {
+    fclose(infile);
+    bailout("oneimage", "Slice is outside the image");
+    exit(1);
   }
 
   printf("Enter factor by which to scale image:  \n");
@@ -163,6 +190,7 @@ int main(void) {
 
   image.pixels = pixelvector(dxtot * dytot);
   if (!image.pixels) {
+    fclose(infile);
     bailout("oneimage", "Could not allocate memory for image pixels");
     free_ivector(blue);
     free_ivector(green);
@@ -174,44 +202,28 @@ int main(void) {
   fflush(stdout);
 
   /***
-   *    Allocate memory for dshade array if viewing depth is enabled
+   *    The slab holds the planes from the slice on,
+   *    in C order, with nplanes along the viewing axis
    ***/
 
-  dshade = drect(dx * iscale, dy * iscale);
-  if (!dshade) {
-    fclose(infile);
-    bailout("oneimage", "Could not allocate memory for image array");
-    free_pixelvector(image.pixels);
-    free_ivector(blue);
-    free_ivector(green);
-    free_ivector(red);
-    exit(1);
-  }
-
-  printf("\nSuccessfully allocated memory for dshade array.");
-  fflush(stdout);
-
-  /***
-   *    Allocate memory for microstructure image
-   ***/
+  nplanes = viewdepth ? MAXDEPTH + 1 : 1;
+  if (nplanes > size)
+    nplanes = size;
+  sx = (axis == 0) ? nplanes : xsyssize;
+  sy = (axis == 1) ? nplanes : ysyssize;
+  sz = (axis == 2) ? nplanes : zsyssize;
 
-  mic = ibox(xsyssize, ysyssize, zsyssize);
-  if (!mic) {
+  slab = (unsigned char *)malloc((size_t)sx * sy * sz);
+  if (!slab) {
     fclose(infile);
-    bailout("oneimage", "Could not allocate memory for mic");
-    if (dshade)
-      free_drect(dshade, dx * iscale);
+    bailout("oneimage", "Could not allocate memory for slab");
     free_pixelvector(image.pixels);
     free_ivector(blue);
     free_ivector(green);
     free_ivector(red);
-    fflush(stdout);
     exit(1);
   }
 
-  printf("\nSuccessfully allocated memory for mic array.");
-  fflush(stdout);
-
   printf("\nPreparing to scan image file... ");
   fflush(stdout);
 
@@ -221,167 +233,129 @@ int main(void) {
    * fastest, then y, then x)
    **/
 
-  for (i = 0; i < xsyssize; i++) {
-    for (j = 0; j < ysyssize; j++) {
-      for (k = 0; k < zsyssize; k++) {
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valout = convert_id(ovalin, Version);
-        mic[i][j][k] = valout;
+  if (format == IMG_ASCII) {
+    cap = (size_t)xsyssize * ysyssize * zsyssize;
+    vox = (unsigned char *)malloc(cap);
+    status = !vox || read_micvoxels(infile, vox, xsyssize, ysyssize,
+                                    zsyssize, Version, format);
+    if (!status) {
+      n = 0;
+      for (x = 0; x < sx; x++) {
+        for (y = 0; y < sy; y++) {
+          for (z = 0; z < sz; z++) {
+            i = (axis == 0) ? (slice + x) % xsyssize : x;
+            j = (axis == 1) ? (slice + y) % ysyssize : y;
+            k = (axis == 2) ? (slice + z) % zsyssize : z;
+            slab[n++] = vox[((size_t)i * ysyssize + j) * zsyssize + k];
+          }
+        }
       }
     }
+    if (vox)
+      free(vox);
+  } else {
+    status = read_binslab(infile, slab, xsyssize, ysyssize, zsyssize, format,
+                          axis, slice, nplanes);
+    n = (size_t)sx * sy * sz;
+    for (i = 0; !status && i < (int)n; i++) {
+      valout = convert_id((int)slab[i], Version);
+      if (valout < 0 || valout >= (NPHASES))
+        status = 1;
+      slab[i] = (unsigned char)valout;
+    }
+  }
+  fclose(infile);
+
+  if (status) {
+    bailout("oneimage", "Error reading microstructure image");
+    free(slab);
+    free_pixelvector(image.pixels);
+    free_ivector(blue);
+    free_ivector(green);
+    free_ivector(red);
+    exit(1);
   }
 
   printf("done");
   fflush(stdout);
-  fclose(infile);
 
-  switch (view) {
-
-  case 3: /* xy plane */
-    for (j = 0; j < ysyssize; j++) {
-      for (i = 0; i < xsyssize; i++) {
-
-        izz = slice;
-        nd = 0;
-        if (viewdepth) {
-          done = 0;
-          do {
-            if (nd == 10 || mic[i][j][izz] != POROSITY) {
-              done = 1;
-            } else {
-              nd++;
-              izz++;
-              if (izz >= zsyssize)
-                izz -= zsyssize;
-            }
-          } while (!done);
-        }
+  /***
+   *    Pixel (i,j) of the picture is voxel (slice,i,j),
+   *    (i,slice,j) or (i,j,slice) for views 1, 2 and 3,
+   *    or the first voxel behind it that is not porosity
+   *    when depth perception is enabled
+   ***/
 
-        valout = mic[i][j][izz];
-        for (j1 = 0; j1 < iscale; j1++) {
-          iy = j * iscale + j1;
-          for (i1 = 0; i1 < iscale; i1++) {
-            ix = i * iscale + i1;
-            dshade[ix][iy] = 0.1 * (10.0 - nd);
-            pixel_t *pixel = pixel_at(&image, ix, iy);
-            if (valout == SANDINCONCRETE) {
-              pixel->red = (int)(R_MUTEDFIREBRICK)*dshade[ix][iy];
-              pixel->green = (int)(G_MUTEDFIREBRICK)*dshade[ix][iy];
-              pixel->blue = (int)(B_MUTEDFIREBRICK)*dshade[ix][iy];
-            } else {
-              pixel->red = red[valout] * dshade[ix][iy];
-              pixel->green = green[valout] * dshade[ix][iy];
-              pixel->blue = blue[valout] * dshade[ix][iy];
-            }
-          }
-        }
-      }
-    }
-    break;
-
-  case 2: /* xz plane */
-    for (k = 0; k < zsyssize; k++) {
-      for (i = 0; i < xsyssize; i++) {
-
-        izz = slice;
-        nd = 0;
-        if (viewdepth) {
-          done = 0;
-          do {
-            if (nd == 10 || mic[i][izz][k] != POROSITY) {
-              done = 1;
-            } else {
-              nd++;
-              izz++;
-              if (izz >= ysyssize)
-                izz -= ysyssize;
-            }
-          } while (!done);
+  for (j = 0; j < dy; j++) {
+    for (i = 0; i < dx; i++) {
+
+      nd = 0;
+      done = 0;
+      do {
+        x = (axis == 0) ? nd % nplanes : i;
+        y = (axis == 1) ? nd % nplanes : ((axis == 0) ? i : j);
+        z = (axis == 2) ? nd % nplanes : j;
+        valout = slab[((size_t)x * sy + y) * sz + z];
+        if (!viewdepth || nd == MAXDEPTH || valout != POROSITY) {
+          done = 1;
+        } else {
+          nd++;
         }
-
-        valout = mic[i][izz][k];
-        for (j1 = 0; j1 < iscale; j1++) {
-          iy = k * iscale + j1;
-          for (i1 = 0; i1 < iscale; i1++) {
-            ix = i * iscale + i1;
-            dshade[ix][iy] = 0.1 * (10.0 - nd);
-            pixel_t *pixel = pixel_at(&image, ix, iy);
-            if (valout == SANDINCONCRETE) {
-              pixel->red = (int)(R_MUTEDFIREBRICK)*dshade[ix][iy];
-              pixel->green = (int)(G_MUTEDFIREBRICK)*dshade[ix][iy];
-              pixel->blue = (int)(B_MUTEDFIREBRICK)*dshade[ix][iy];
-            } else {
-              pixel->red = red[valout] * dshade[ix][iy];
-              pixel->green = green[valout] * dshade[ix][iy];
-              pixel->blue = blue[valout] * dshade[ix][iy];
-            }
+      } while (!done);
+
+      shade = 0.1 * (10.0 - nd);
+      for (j1 = 0; j1 < iscale; j1++) {
+        iy = j * iscale + j1;
+        for (i1 = 0; i1 < iscale; i1++) {
+          ix = i * iscale + i1;
+          pixel_t *pixel = pixel_at(&image, ix, iy);
+          if (valout == SANDINCONCRETE) {
+            pixel->red = (int)(R_MUTEDFIREBRICK)*shade;
+            pixel->green = (int)(G_MUTEDFIREBRICK)*shade;
+            pixel->blue = (int)(B_MUTEDFIREBRICK)*shade;
+          } else {
+            pixel->red = red[valout] * shade;
+            pixel->green = green[valout] * shade;
+            pixel->blue = blue[valout] * shade;
           }
         }
       }
     }
-    break;
-
-  default: /* yz plane */
-    for (k = 0; k < zsyssize; k++) {
-      for (j = 0; j < ysyssize; j++) {
-
-        izz = slice;
-        nd = 0;
-        if (viewdepth) {
-          done = 0;
-          do {
-            if (nd == 10 || mic[izz][j][k] != POROSITY) {
-              done = 1;
-            } else {
-              nd++;
-              izz++;
-              if (izz >= xsyssize)
-                izz -= xsyssize;
-            }
-          } while (!done);
-        }
-
-        valout = mic[izz][j][k];
-        for (j1 = 0; j1 < iscale; j1++) {
-          iy = k * iscale + j1;
-          for (i1 = 0; i1 < iscale; i1++) {
-            ix = j * iscale + i1;
-            dshade[ix][iy] = 0.1 * (10.0 - nd);
-            pixel_t *pixel = pixel_at(&image, ix, iy);
-            if (valout == SANDINCONCRETE) {
-              pixel->red = (int)(R_MUTEDFIREBRICK)*dshade[ix][iy];
-              pixel->green = (int)(G_MUTEDFIREBRICK)*dshade[ix][iy];
-              pixel->blue = (int)(B_MUTEDFIREBRICK)*dshade[ix][iy];
-            } else {
-              pixel->red = red[valout] * dshade[ix][iy];
-              pixel->green = green[valout] * dshade[ix][iy];
-              pixel->blue = blue[valout] * dshade[ix][iy];
-            }
-          }
-        }
-      }
-    }
-    break;
   }
 
+  /***
+   *    A name ending in .ppm gets a binary PPM file,
+   *    which is quicker to write; anything else a PNG,
+   *    compressed by as many threads as VCCTL_THREADS asks for
+   ***/
+
   printf("\n\nSuccessfully made image with all pixels.");
-  printf("\nSaving as png file: %s", fileout);
-  fflush(stdout);
-  save_png_to_file(&image, fileout);
-  printf("\nPNG file saved.");
+  ext = strrchr(fileout, '.');
+  if (ext && !strcmp(ext, ".ppm")) {
+    printf("\nSaving as ppm file: %s", fileout);
+    fflush(stdout);
+    status = save_ppm_to_file(&image, fileout);
+  } else {
+    printf("\nSaving as png file: %s", fileout);
+    fflush(stdout);
+    status = save_png_threads(&image, fileout, -1, thread_default(1));
+  }
+  if (status) {
+    bailout("oneimage", "Could not write image file");
+  } else {
+    printf("\nImage file saved.");
+  }
 
   /***
    *    Free dynamically allocated memory
    ***/
 
-  free_ibox(mic, xsyssize, ysyssize);
+  free(slab);
   free_pixelvector(image.pixels);
-  free_drect(dshade, dx * iscale);
   free_ivector(blue);
   free_ivector(green);
   free_ivector(red);
   printf("\n\n");
 
-  return (0);
+  return (status ? 1 : 0);
 }
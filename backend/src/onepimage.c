@@ -1,45 +1,59 @@
 /******************************************************
  *
- * Program oneimage
+ * Program onepimage
  *
- * Creates a PPM file for one slice of a
+ * Creates a PPM or PNG file for one slice of a
  * 3D particle index microstructure
+ *
+ * Only the planes needed for the slice are read from
+ * a binary particle image.  An ASCII image is read
+ * through, but only the slice is kept.
  ******************************************************/
 #include "include/vcctl.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/***
+ *    Most planes looked through when depth perception
+ *    is enabled
+ ***/
+#define MAXDEPTH 10
+
 /***
  *    Global variables
  ***/
 float Version;
 
 int main(void) {
-  int ovalin, xsyssize, ysyssize, zsyssize, izz, done, nd;
-  int valout, i1, j1, i, viewdepth, bse;
+  int ovalin, xsyssize, ysyssize, zsyssize, done, nd, format;
+  int valout, i1, j1, i, viewdepth, bse, ix, iy;
   int dx, dy, j, k, iscale, dxtot, dytot, view, slice;
-  int ***mic;
-  int **image, *red, *green, *blue;
+  int axis, size, nplanes, sx, sy, sz, x, y, z, status;
+  int *slab, *red, *green, *blue;
   float res;
-  double **dshade;
+  double shade;
   char filein[MAXSTRING], fileout[MAXSTRING], instring[MAXSTRING];
-  FILE *infile, *outfile;
+  char *ext;
+  size_t n, m, nslab;
+  unsigned char *bytes;
+  FILE *infile;
+  bitmap_t image;
 
   red = ivector(NPHASES);
   if (!red) {
-    bailout("image100", "Could not allocate memory for red vector");
+    bailout("onepimage", "Could not allocate memory for red vector");
     exit(1);
   }
   green = ivector(NPHASES);
   if (!green) {
-    bailout("image100", "Could not allocate memory for red vector");
+    bailout("onepimage", "Could not allocate memory for red vector");
     free_ivector(red);
     exit(1);
   }
   blue = ivector(NPHASES);
   if (!blue) {
-    bailout("image100", "Could not allocate memory for red vector");
+    bailout("onepimage", "Could not allocate memory for red vector");
     free_ivector(green);
     free_ivector(red);
     exit(1);
@@ -101,27 +115,24 @@ int main(void) {
 
   /***
    *    Open the input 3D image file
-   *    and the 2D output image file
    ***/
 
-  infile = filehandler("oneimage", filein, "READ");
+  infile = filehandler("onepimage", filein, "READ");
   if (!infile) {
     exit(1);
   }
 
-  outfile = filehandler("oneimage", fileout, "WRITE");
-  if (!outfile) {
-    exit(1);
-  }
-
   /***
-   *    Read first line of image file to determine
-   *    if size is specified.  If it is specified
-   *    then read it.  If not, set the size to 100
+   *    Read the header, which leaves the stream at
+   *    the first voxel
    ***/
 
-  if (read_imgheader(infile, &Version, &xsyssize, &ysyssize, &zsyssize, &res)) {
-    bailout("oneimage", "Error reading image header");
+  if (read_imgheader_fmt(infile, &Version, &xsyssize, &ysyssize, &zsyssize,
+                         &res, &format) ||
+      (format != IMG_ASCII && format != IMG_UINT32 &&
+       format != IMG_UINT32Z)) {
+    fclose(infile);
+    bailout("onepimage", "Error reading image header");
     exit(1);
   }
 
@@ -141,12 +152,24 @@ int main(void) {
   if (view == 1) {
     dx = ysyssize;
     dy = zsyssize;
+    axis = 0;
+    size = xsyssize;
   } else if (view == 2) {
     dx = xsyssize;
     dy = zsyssize;
+    axis = 1;
+    size = ysyssize;
   } else {
     dx = xsyssize;
     dy = ysyssize;
+    axis = 2;
+    size = zsyssize;
+  }
+
+  if (slice < 0 || slice >= size) {
+    fclose(infile);
+    bailout("onepimage", "Slice is outside the image");
+    exit(1);
   }
 
   printf("Enter factor by which to scale image:  \n");
@@ -158,227 +181,184 @@ int main(void) {
   dxtot = dx * iscale;
   dytot = dy * iscale;
 
+  image.width = dxtot;
+  image.height = dytot;
+
   /***
-   *    Allocate memory for image array
+   *    Allocate memory for image pixels
    ***/
 
-  image = irect(dx * iscale, dy * iscale);
-  if (!image) {
+  image.pixels = pixelvector(dxtot * dytot);
+  if (!image.pixels) {
     fclose(infile);
     free_ivector(blue);
     free_ivector(green);
     free_ivector(red);
-    bailout("oneimage", "Could not allocate memory for image array");
+    bailout("onepimage", "Could not allocate memory for image pixels");
     exit(1);
   }
 
-  printf("\nSuccessfully allocated memory for image array.");
+  printf("\nSuccessfully allocated memory for image pixels.");
   fflush(stdout);
 
   /***
-   *    Allocate memory for dshade array
+   *    The slab holds the planes from the slice on,
+   *    in C order, with nplanes along the viewing axis
    ***/
 
-  dshade = drect(dx * iscale, dy * iscale);
-  if (!dshade) {
+  nplanes = viewdepth ? MAXDEPTH + 1 : 1;
+  if (nplanes > size)
+    nplanes = size;
+  sx = (axis == 0) ? nplanes : xsyssize;
+  sy = (axis == 1) ? nplanes : ysyssize;
+  sz = (axis == 2) ? nplanes : zsyssize;
+  nslab = (size_t)sx * sy * sz;
+
+  slab = (int *)malloc(nslab * sizeof(int));
+  bytes = (format == IMG_ASCII) ? NULL : (unsigned char *)malloc(4 * nslab);
+  if (!slab || (format != IMG_ASCII && !bytes)) {
     fclose(infile);
-    bailout("oneimage", "Could not allocate memory for image array");
-    free_irect(image, dx * iscale);
+    bailout("onepimage", "Could not allocate memory for slab");
+    if (slab)
+      free(slab);
+    free_pixelvector(image.pixels);
     free_ivector(blue);
     free_ivector(green);
     free_ivector(red);
     exit(1);
   }
 
-  printf("\nSuccessfully allocated memory for dshade array.");
+  printf("\nPreparing to scan image file... ");
   fflush(stdout);
 
   /***
-   *    Allocate memory for microstructure image
+   *    Voxels are in C order (z varies fastest, then y,
+   *    then x).  Particle ids are folded onto the phase
+   *    colors.
    ***/
 
-  mic = NULL;
-  mic = ibox(xsyssize, ysyssize, zsyssize);
-  if (!mic) {
-    fclose(infile);
-    bailout("oneimage", "Could not allocate memory for mic");
-    if (dshade)
-      free_drect(dshade, dx * iscale);
-    free_irect(image, dx * iscale);
+  status = 0;
+  if (format == IMG_ASCII) {
+    n = 0;
+    for (i = 0; i < xsyssize && !status; i++) {
+      for (j = 0; j < ysyssize && !status; j++) {
+        for (k = 0; k < zsyssize; k++) {
+          if (fscanf(infile, "%d", &ovalin) != 1) {
+            status = 1;
+            break;
+          }
+          x = (axis == 0) ? (i - slice + xsyssize) % xsyssize : i;
+          y = (axis == 1) ? (j - slice + ysyssize) % ysyssize : j;
+          z = (axis == 2) ? (k - slice + zsyssize) % zsyssize : k;
+          if (x < sx && y < sy && z < sz) {
+            valout = convert_id(ovalin, Version);
+            slab[((size_t)x * sy + y) * sz + z] =
+                ((valout) % ((int)(NPHASES)-1)) + 1;
+          }
+        }
+      }
+    }
+  } else {
+    status = read_binslab(infile, bytes, xsyssize, ysyssize, zsyssize, format,
+                          axis, slice, nplanes);
+    for (n = 0; !status && n < nslab; n++) {
+      m = 4 * n;
+      ovalin = (int)((unsigned int)bytes[m] |
+                     ((unsigned int)bytes[m + 1] << 8) |
+                     ((unsigned int)bytes[m + 2] << 16) |
+                     ((unsigned int)bytes[m + 3] << 24));
+      valout = convert_id(ovalin, Version);
+      slab[n] = ((valout) % ((int)(NPHASES)-1)) + 1;
+    }
+    free(bytes);
+  }
+  fclose(infile);
+
+  if (status) {
+    bailout("onepimage", "Error reading particle image");
+    free(slab);
+    free_pixelvector(image.pixels);
     free_ivector(blue);
     free_ivector(green);
     free_ivector(red);
-    fflush(stdout);
     exit(1);
   }
 
-  printf("\nSuccessfully allocated memory for mic array.");
+  printf("done");
   fflush(stdout);
 
   /***
-   *    Header information for PPM file
+   *    Pixel (i,j) of the picture is voxel (slice,i,j),
+   *    (i,slice,j) or (i,j,slice) for views 1, 2 and 3,
+   *    or the first voxel behind it that is not porosity
+   *    when depth perception is enabled
    ***/
 
-  printf("\nWriting PPM image header");
-  fflush(stdout);
-
-  fprintf(outfile, "P3\n");
-  fprintf(outfile, "%d %d\n", dx * iscale, dy * iscale);
-  fprintf(outfile, "%d\n", SAT);
-  fflush(outfile);
-
-  printf("\nPreparing to scan image file... ");
-  fflush(stdout);
-  for (k = 0; k < zsyssize; k++) {
-    for (j = 0; j < ysyssize; j++) {
-      for (i = 0; i < xsyssize; i++) {
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valout = convert_id(ovalin, Version);
-        mic[i][j][k] = ((valout) % ((int)(NPHASES)-1)) + 1;
-      }
-    }
-  }
-
-  printf("done");
-  fflush(stdout);
-
-  switch (view) {
-
-  case 3: /* xy plane */
-    for (j = 0; j < ysyssize; j++) {
-      for (i = 0; i < xsyssize; i++) {
-
-        izz = slice;
-        nd = 0;
-        if (viewdepth) {
-          done = 0;
-          do {
-            if (nd == 10 || mic[i][j][izz] != POROSITY) {
-              done = 1;
-            } else {
-              nd++;
-              izz++;
-              if (izz >= zsyssize)
-                izz -= zsyssize;
-            }
-          } while (!done);
-        }
-
-        valout = mic[i][j][izz];
-        for (j1 = 0; j1 < iscale; j1++) {
-          for (i1 = 0; i1 < iscale; i1++) {
-
-            image[i * iscale + i1][j * iscale + j1] = valout;
-            dshade[i * iscale + i1][j * iscale + j1] = 0.1 * (10.0 - nd);
-          }
-        }
-      }
-    }
-    break;
-
-  case 2: /* xz plane */
-    for (k = 0; k < zsyssize; k++) {
-      for (i = 0; i < xsyssize; i++) {
-
-        izz = slice;
-        nd = 0;
-        if (viewdepth) {
-          done = 0;
-          do {
-            if (nd == 10 || mic[i][izz][k] != POROSITY) {
-              done = 1;
-            } else {
-              nd++;
-              izz++;
-              if (izz >= ysyssize)
-                izz -= ysyssize;
-            }
-          } while (!done);
-        }
-
-        valout = mic[i][izz][k];
-        for (j1 = 0; j1 < iscale; j1++) {
-          for (i1 = 0; i1 < iscale; i1++) {
-
-            image[i * iscale + i1][k * iscale + j1] = valout;
-            dshade[i * iscale + i1][k * iscale + j1] = 0.1 * (10.0 - nd);
-          }
-        }
-      }
-    }
-    break;
-
-  default: /* yz plane */
-    for (k = 0; k < zsyssize; k++) {
-      for (j = 0; j < ysyssize; j++) {
-
-        izz = slice;
-        nd = 0;
-        if (viewdepth) {
-          done = 0;
-          do {
-            if (nd == 10 || mic[izz][j][k] != POROSITY) {
-              done = 1;
-            } else {
-              nd++;
-              izz++;
-              if (izz >= xsyssize)
-                izz -= xsyssize;
-            }
-          } while (!done);
+  for (j = 0; j < dy; j++) {
+    for (i = 0; i < dx; i++) {
+
+      nd = 0;
+      done = 0;
+      do {
+        x = (axis == 0) ? nd % nplanes : i;
+        y = (axis == 1) ? nd % nplanes : ((axis == 0) ? i : j);
+        z = (axis == 2) ? nd % nplanes : j;
+        valout = slab[((size_t)x * sy + y) * sz + z];
+        if (!viewdepth || nd == MAXDEPTH || valout != POROSITY) {
+          done = 1;
+        } else {
+          nd++;
         }
-
-        valout = mic[izz][j][k];
-        for (j1 = 0; j1 < iscale; j1++) {
-          for (i1 = 0; i1 < iscale; i1++) {
-            image[j * iscale + i1][k * iscale + j1] = valout;
-            dshade[j * iscale + i1][k * iscale + j1] = 0.1 * (10.0 - nd);
+      } while (!done);
+
+      shade = 0.1 * (10.0 - nd);
+      for (j1 = 0; j1 < iscale; j1++) {
+        iy = j * iscale + j1;
+        for (i1 = 0; i1 < iscale; i1++) {
+          ix = i * iscale + i1;
+          pixel_t *pixel = pixel_at(&image, ix, iy);
+          if (valout == SANDINCONCRETE) {
+            pixel->red = (int)((shade * R_MUTEDFIREBRICK) + 0.5);
+            pixel->green = (int)((shade * G_MUTEDFIREBRICK) + 0.5);
+            pixel->blue = (int)((shade * B_MUTEDFIREBRICK) + 0.5);
+          } else {
+            pixel->red = (int)((shade * red[valout]) + 0.5);
+            pixel->green = (int)((shade * green[valout]) + 0.5);
+            pixel->blue = (int)((shade * blue[valout]) + 0.5);
           }
         }
       }
     }
-    break;
   }
 
-  fclose(infile);
-
   /***
-   *    Write one pixel per line of PPM file
+   *    A name ending in .png gets a PNG file, compressed by as
+   *    many threads as VCCTL_THREADS asks for; anything
+   *    else a binary (P6) PPM file
    ***/
 
-  printf("\nPreparing to write remainder of PPM file");
-  fflush(stdout);
-
-  for (j = 0; j < (dy * iscale); j++) {
-    for (i = 0; i < (dx * iscale); i++) {
-      if (image[i][j] == SANDINCONCRETE) {
-        fprintf(outfile, "%d ", (int)((dshade[i][j] * R_MUTEDFIREBRICK) + 0.5));
-        fprintf(outfile, "%d ", (int)((dshade[i][j] * G_MUTEDFIREBRICK) + 0.5));
-        fprintf(outfile, "%d\n",
-                (int)((dshade[i][j] * B_MUTEDFIREBRICK) + 0.5));
-      } else {
-        fprintf(outfile, "%d ", (int)((dshade[i][j] * red[image[i][j]]) + 0.5));
-        fprintf(outfile, "%d ",
-                (int)((dshade[i][j] * green[image[i][j]]) + 0.5));
-        fprintf(outfile, "%d\n",
-                (int)((dshade[i][j] * blue[image[i][j]]) + 0.5));
-      }
-    }
+  ext = strrchr(fileout, '.');
+  if (ext && !strcmp(ext, ".png")) {
+    printf("\nSaving as png file: %s", fileout);
+    fflush(stdout);
+    status = save_png_threads(&image, fileout, -1, thread_default(1));
+  } else {
+    printf("\nSaving as ppm file: %s", fileout);
+    fflush(stdout);
+    status = save_ppm_to_file(&image, fileout);
   }
-
-  fclose(outfile);
+  if (status)
+    bailout("onepimage", "Could not write image file");
 
   /***
    *    Free dynamically allocated memory
    ***/
 
-  free_ibox(mic, xsyssize, ysyssize);
-  free_drect(dshade, dx * iscale);
-  free_irect(image, dx * iscale);
+  free(slab);
+  free_pixelvector(image.pixels);
   free_ivector(blue);
   free_ivector(green);
   free_ivector(red);
 
-  return (0);
+  return (status ? 1 : 0);
 }
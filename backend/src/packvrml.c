@@ -3,7 +3,9 @@
  * Program packvrml
  *
  * Takes a 3-D image, makes six *.ppm files of the sides
- * to be put on the sides of a VRML box
+ * to be put on the sides of a VRML box, or makes a
+ * surface mesh of each phase in a box of the image as a
+ * VRML or binary PLY file
  *
  * Original fortran code written by E.J. Garboczi, 2004
  * Translated to C by J.W. Bullard, 2004
@@ -19,9 +21,8 @@
 #define AGGPACK 1
 #define CEMPACK 2
 #define CREATEPGMS 1
-#define PGMS2GIFS 2
-#define CREATEVRML 3
-#define EXIT 4
+#define CREATEMESH 2
+#define EXIT 3
 #define MINCHOICE CREATEPGMS
 #define MAXCHOICE EXIT
 
@@ -36,6 +37,9 @@
 #define ITZG 205
 #define ITZB 51
 
+#define MESHVRML 1
+#define MESHPLY 2
+
 /* Global variables */
 char Outdir[MAXSTRING];
 
@@ -43,12 +47,13 @@ char Outdir[MAXSTRING];
  *	Function declarations
  ***/
 int createpgms(void);
-int makevrml(int packtype, float x1, float x2, float y1, float y2, float z1,
-             float z2);
-int pgms2gifs(void);
+void makevrml(int packtype, float x1, float x2, float y1, float y2, float z1,
+              float z2);
+int createmesh(void);
 
 int main(void) {
   int choice;
+  char instring[MAXSTRING];
 
   /* Main menu */
 
@@ -59,10 +64,11 @@ int main(void) {
     do {
 
       printf("Main menu:\n");
-      printf("\t%d. Make bounding pgm images\n", (int)CREATEPGMS);
-      printf("\t%d. Convert pgm images to gif images (requires Imagemagick)\n",
-             (int)PGMS2GIFS);
-      printf("\t%d. Create VRML file\n", (int)CREATEVRML);
+      printf("\t%d. Make bounding pgm images and VRML box "
+             "(requires Imagemagick)\n",
+             (int)CREATEPGMS);
+      printf("\t%d. Make surface mesh of phases (VRML or PLY)\n",
+             (int)CREATEMESH);
       printf("\t%d. Exit\n", (int)EXIT);
       read_string(instring, sizeof(instring));
       choice = atoi(instring);
@@ -76,14 +82,9 @@ int main(void) {
         printf("\nError in creating PGM files\n");
       }
       break;
-    case PGMS2GIFS:
-      if (pgms2gifs() > 0) {
-        printf("\nError in converting PGM files\n");
-      }
-      break;
-    case CREATEVRML:
-      if (makevrml() > 0) {
-        printf("\nError in creating VRML file\n");
+    case CREATEMESH:
+      if (createmesh() > 0) {
+        printf("\nError in creating surface mesh file\n");
       }
       break;
     case EXIT:
@@ -96,6 +97,8 @@ int main(void) {
   } while (!finished);
 
   /* Mopping up after exiting here */
+
+  return (0);
 }
 
 int createpgms(void) {
@@ -178,10 +181,10 @@ int createpgms(void) {
     cemcolors(red, green, blue, 0);
     break;
   }
-  ``
-      /*  Must open microstructure and read the header */
 
-      infile = filehandler("packvrml", packname, "READ");
+  /*  Must open microstructure and read the header */
+
+  infile = filehandler("packvrml", packname, "READ");
   if (!infile) {
     exit(1);
   }
@@ -676,3 +679,187 @@ void makevrml(int packtype, float x1, float x2, float y1, float y2, float z1,
 
   return;
 }
+
+/***************************************************************
+ *	createmesh
+ *
+ *	Makes a surface mesh of each phase in a box of a packing,
+ *	with the exposed faces of a phase merged into rectangles,
+ *	and writes it as a VRML file or a binary PLY file.  The
+ *	matrix (phase 0) gets no surface.  Coordinates are scaled
+ *	so that the largest dimension of the image is 1, as for
+ *	the box made by makevrml.
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ***************************************************************/
+int createmesh(void) {
+  int i, packtype, format, status;
+  int xsize, ysize, zsize, maxsize;
+  int size[3], lo[3], hi[3];
+  int *red, *green, *blue;
+  float res, ver;
+  size_t cap = 0;
+  unsigned char *vox = NULL;
+  char packname[MAXSTRING], outname[MAXSTRING], instring[MAXSTRING];
+  const char *axisname = "xyz";
+  Voxmesh mesh;
+  FILE *infile, *outfile;
+
+  printf("Enter name of packing file \n");
+  read_string(packname, sizeof(packname));
+  printf("%s\n", packname);
+  printf("Enter name of directory to place all output files.\n");
+  printf("Remember to include final file separator \n");
+  read_string(Outdir, sizeof(Outdir));
+  printf("%s\n", Outdir);
+
+  do {
+
+    printf("Is this:\n");
+    printf("\t1. Aggregate packing\n");
+    printf("\t2. Cement particle packing\n");
+    read_string(instring, sizeof(instring));
+    packtype = atoi(instring);
+    printf("%d\n", packtype);
+
+  } while (packtype != AGGPACK && packtype != CEMPACK);
+
+  do {
+
+    printf("Write mesh as:\n");
+    printf("\t%d. VRML file\n", (int)MESHVRML);
+    printf("\t%d. Binary PLY file\n", (int)MESHPLY);
+    read_string(instring, sizeof(instring));
+    format = atoi(instring);
+    printf("%d\n", format);
+
+  } while (format != MESHVRML && format != MESHPLY);
+
+  red = ivector(NPHASES);
+  green = ivector(NPHASES);
+  blue = ivector(NPHASES);
+  if (!red || !green || !blue) {
+    bailout("packvrml", "Could not allocate memory for color vectors");
+    if (red)
+      free_ivector(red);
+    if (green)
+      free_ivector(green);
+    return (1);
+  }
+
+  for (i = 0; i < NPHASES; i++) {
+    red[i] = 0;
+    green[i] = 0;
+    blue[i] = 0;
+  }
+
+  if (packtype == AGGPACK) {
+    red[AGG] = AGGR;
+    green[AGG] = AGGG;
+    blue[AGG] = AGGB;
+    red[ITZ] = ITZR;
+    green[ITZ] = ITZG;
+    blue[ITZ] = ITZB;
+  } else {
+    cemcolors(red, green, blue, 0);
+  }
+
+  infile = filehandler("packvrml", packname, "READ");
+  if (!infile) {
+    free_ivector(blue);
+    free_ivector(green);
+    free_ivector(red);
+    return (1);
+  }
+
+  if (load_microstructure(infile, &vox, &cap, &ver, &xsize, &ysize, &zsize,
+                          &res)) {
+    fclose(infile);
+    if (vox)
+      free(vox);
+    bailout("packvrml", "Error reading packing file");
+    free_ivector(blue);
+    free_ivector(green);
+    free_ivector(red);
+    return (1);
+  }
+  fclose(infile);
+
+  /***
+   *	Ids above the last phase have no color, so they are
+   *	drawn like the matrix
+   ***/
+
+  for (i = 0; i < xsize * ysize * zsize; i++) {
+    if (vox[i] >= (NPHASES))
+      vox[i] = 0;
+  }
+
+  size[0] = xsize;
+  size[1] = ysize;
+  size[2] = zsize;
+  for (i = 0; i < 3; i++) {
+    printf("Enter lower bound for %c (0 to %d)\n", axisname[i], size[i] - 1);
+    read_string(instring, sizeof(instring));
+    lo[i] = atoi(instring);
+    printf("%d\n", lo[i]);
+    printf("Enter upper bound for %c (%d to %d)\n", axisname[i], lo[i] + 1,
+           size[i]);
+    read_string(instring, sizeof(instring));
+    hi[i] = atoi(instring);
+    printf("%d\n", hi[i]);
+  }
+
+  if (voxmesh_build(&mesh, vox, xsize, ysize, zsize, lo, hi, 0)) {
+    bailout("packvrml", "Could not make surface mesh");
+    free(vox);
+    free_ivector(blue);
+    free_ivector(green);
+    free_ivector(red);
+    return (1);
+  }
+  free(vox);
+
+  printf("Surface mesh has %d rectangles\n", mesh.n);
+
+  maxsize = xsize;
+  if (ysize > maxsize)
+    maxsize = ysize;
+  if (zsize > maxsize)
+    maxsize = zsize;
+
+  if (format == MESHPLY) {
+    sprintf(outname, "%spackmesh.ply", Outdir);
+    outfile = fopen(outname, "wb");
+    if (!outfile) {
+      bailout("packvrml", "Could not open mesh file");
+      status = 1;
+    } else {
+      status = voxmesh_write_ply(&mesh, outfile, 1.0 / (float)maxsize, red,
+                                 green, blue);
+    }
+  } else {
+    sprintf(outname, "%spackmesh.wrl", Outdir);
+    outfile = filehandler("packvrml", outname, "WRITE");
+    if (!outfile) {
+      status = 1;
+    } else {
+      status = voxmesh_write_vrml(&mesh, outfile, 1.0 / (float)maxsize, red,
+                                  green, blue);
+    }
+  }
+  if (outfile && fclose(outfile))
+    status = 1;
+  if (status) {
+    bailout("packvrml", "Error writing mesh file");
+  } else {
+    printf("Wrote %s\n", outname);
+  }
+
+  voxmesh_free(&mesh);
+  free_ivector(blue);
+  free_ivector(green);
+  free_ivector(red);
+
+  return (status);
+}
@@ -3,6 +3,15 @@
  * Program perc3d.c to test connectivity of various
  * phases in a 3D microstructure
  *
+ * Each phase, and each group of phases (all pore space,
+ * all C-S-H, all calcium sulfates), is labeled into
+ * clusters in one pass that tests all three directions.
+ * With -c (--clusters), every cluster of each is also
+ * written out, largest first, with the directions it
+ * percolates in.  With --cache, the results are kept in
+ * a directory and taken from there when the same image
+ * is tested again.
+ *
  * Programmer:	Jeffrey W. Bullard
  *              Zachry Department of Civil and Environmental Engineering
  *              Department of Materials Science and Engineering
@@ -12,6 +21,7 @@
  *
  *******************************************************/
 #include "include/vcctl.h"
+#include <getopt.h>
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,21 +33,13 @@
 
 #define MEMERR -1
 
-/* label for a burnt pixel */
-#define BURNT 70
-
-/* default size of matrices for holding burning locations */
-#define SIZE2D 200000
-
-/* functions defining coordinates for burning in any of three directions */
-#define cx(x, y, z, a, b, c) (1 - b - c) * x + (1 - a - c) * y + (1 - a - b) * z
-#define cy(x, y, z, a, b, c) (1 - a - b) * x + (1 - b - c) * y + (1 - a - c) * z
-#define cz(x, y, z, a, b, c) (1 - a - c) * x + (1 - a - b) * y + (1 - b - c) * z
+/* Phases, then the groups EMPTYP, TOTCSH and TOTGYP */
+#define NPERCIDS (NSPHASES) + 3
 
 /***
  *	Global variables
  ***/
-short int ***Mic;
+char ***Mic;
 int Xsyssize = DEFAULTSYSTEMSIZE;
 int Ysyssize = DEFAULTSYSTEMSIZE;
 int Zsyssize = DEFAULTSYSTEMSIZE;
@@ -46,8 +48,14 @@ float Res = DEFAULTRESOLUTION;
 /* VCCTL software version used to create input file */
 float Version;
 
-int Ntot = 0, Nperc = 0, Nburnt = 0;
 FILE *Resfile;
+char Clustername[MAXSTRING];
+
+/***
+ *	Result cache (--cache dir; see rescache.c), which keeps the
+ *	connectivity of each image tested
+ ***/
+char Cachedir[MAXSTRING];
 
 struct BurnProps {
   int totvox;
@@ -60,18 +68,26 @@ struct BurnProps {
   int isPercInX;
   int isPercInY;
   int isPercInZ;
+  int numclusters;
+  int maxcluster;
+  int x_perc_clusters;
+  int y_perc_clusters;
+  int z_perc_clusters;
+  Perccluster *clusters;
 };
 
-/* DFS stack structure for connectivity analysis */
-typedef struct {
-  int x, y, z;
-} StackPoint;
-
 int burn3d(int npix, struct BurnProps *burnprops);
+int checkargs(int argc, char *argv[]);
+int cacheio(FILE *fp, struct BurnProps *burnList, int writing);
+void idname(int id, char *name);
+void writeclusters(FILE *fpout, int id, struct BurnProps *burnprops,
+                   float voxelVolume);
 
 int main(int argc, char *argv[]) {
-  int ix, iy, iz, i;
-  int valin, ovalin, phasein, garb;
+  int ix, iy, iz, i, nargs, cached;
+  int phasein, nerr, ids[NPERCIDS];
+  size_t n, cap = 0;
+  unsigned char *vox = NULL;
   float voxelVolume = 1.0;
   char filein[MAXSTRING], fileout[MAXSTRING], instring[MAXSTRING];
   char phasename[MAXSTRING];
@@ -81,14 +97,22 @@ int main(int argc, char *argv[]) {
   wchar_t sup2 = 0x00B2;
   wchar_t sup3 = 0x00B3;
   wchar_t supminus = 0x207B;
-  struct BurnProps burnData;
-  FILE *infile;
+  struct BurnProps burnList[NPERCIDS], burnData;
+  FILE *infile, *clfile, *cfp;
+  Rescache rc;
 
   /* Set up locale for printing unicode when necessary */
   locale = setlocale(LC_ALL, "");
 
   /* Check for command line arguments */
-  if (argc != 3) {
+  nargs = checkargs(argc, argv);
+  if (nargs < 0) {
+    printf("Usage: %s [-c,--clusters <cluster_file>] [--cache <dir>] "
+           "<input_file> <output_file>\n",
+           argv[0]);
+    exit(1);
+  }
+  if (nargs != 2) {
     printf("Usage: %s <input_file> <output_file>\n", argv[0]);
     printf("\nEnter name of input image file: ");
     read_string(filein, sizeof(filein));
@@ -99,8 +123,8 @@ int main(int argc, char *argv[]) {
     fflush(stdout);
   } else {
     /* Use command line arguments */
-    strcpy(filein, argv[1]);
-    strcpy(fileout, argv[2]);
+    strcpy(filein, argv[optind]);
+    strcpy(fileout, argv[optind + 1]);
     printf("Input file: %s \n", filein);
     printf("Output file: %s \n", fileout);
   }
@@ -110,11 +134,15 @@ int main(int argc, char *argv[]) {
     exit(1);
   }
 
-  if (read_imgheader(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize, &Res)) {
+  if (load_microstructure(infile, &vox, &cap, &Version, &Xsyssize, &Ysyssize,
+                          &Zsyssize, &Res)) {
     fclose(infile);
-    bailout("perc3d", "Error reading image header");
+    if (vox)
+      free(vox);
+    bailout("perc3d", "Error reading microstructure image");
     exit(1);
   }
+  fclose(infile);
 
   voxelVolume = Res * Res * Res; /* in um3 */
 
@@ -122,9 +150,9 @@ int main(int argc, char *argv[]) {
    *	Allocate memory for Mic array
    ***/
 
-  Mic = sibox(Xsyssize, Ysyssize, Zsyssize);
+  Mic = cbox(Xsyssize, Ysyssize, Zsyssize);
   if (!Mic) {
-    fclose(infile);
+    free(vox);
     bailout("perc3d", "Could not allocate memory for Mic array");
     exit(1);
   }
@@ -134,22 +162,31 @@ int main(int argc, char *argv[]) {
    * New convention is to use C-ordering for reading and writing
    * microstructure image files (Z varies fastest, then Y, then X)
    **/
+  n = 0;
   for (ix = 0; ix < Xsyssize; ix++) {
     for (iy = 0; iy < Ysyssize; iy++) {
       for (iz = 0; iz < Zsyssize; iz++) {
-        fscanf(infile, "%d", &ovalin);
-        valin = convert_id(ovalin, Version);
-        Mic[ix][iy][iz] = valin;
+        Mic[ix][iy][iz] = vox[n++];
       }
     }
   }
 
-  fclose(infile);
+  /***
+   *	The connectivity depends only on the voxels, so with --cache
+   *	it is looked for under a key made from them
+   ***/
+
+  rescache_init(&rc, Cachedir, "perc3d");
+  rescache_add(&rc, &Xsyssize, sizeof(int));
+  rescache_add(&rc, &Ysyssize, sizeof(int));
+  rescache_add(&rc, &Zsyssize, sizeof(int));
+  rescache_add(&rc, vox, n);
+
+  free(vox);
 
   Resfile = filehandler("perc3d", fileout, "WRITE");
   if (!Resfile) {
-    fclose(infile);
-    free_sibox(Mic, Xsyssize, Ysyssize);
+    free_cbox(Mic, Xsyssize, Ysyssize);
     exit(1);
   }
 
@@ -165,15 +202,47 @@ int main(int argc, char *argv[]) {
           "\n\nPercolation ratio: Fraction of phase in percolated structure");
   fprintf(Resfile, "\nHigher values indicate better connectivity of a phase");
 
+  /***
+   *	burn3d leaves Mic alone, so the phases can be
+   *	tested at the same time
+   ***/
+
   for (i = 0; i < NSPHASES; ++i) {
-    garb = burn3d(i, &burnData);
-    if (garb == MEMERR) {
-      bailout("perc3d", "Could not allocate memory in burn3d function");
-      exit(1);
-    }
+    ids[i] = i;
+  }
+  ids[NSPHASES] = EMPTYP;
+  ids[NSPHASES + 1] = TOTCSH;
+  ids[NSPHASES + 2] = TOTGYP;
+
+  cached = 0;
+  if ((cfp = rescache_open(&rc))) {
+    cached = !cacheio(cfp, burnList, 0);
+    fclose(cfp);
+    if (cached)
+      printf("Results taken from the cache in %s\n", Cachedir);
+  }
+
+  nerr = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : nerr) if (!cached)
+#endif
+  for (i = 0; i < NPERCIDS; ++i) {
+    if (!cached && burn3d(ids[i], &burnList[i]) == MEMERR)
+      nerr++;
+  }
+  if (nerr > 0) {
+    bailout("perc3d", "Could not allocate memory in burn3d function");
+    exit(1);
+  }
+  if (!cached && (cfp = rescache_create(&rc))) {
+    rescache_commit(&rc, cfp, cacheio(cfp, burnList, 1));
+  }
+
+  for (i = 0; i < NPERCIDS; ++i) {
+    burnData = burnList[i];
     if (burnData.totvox > 0) {
-      id2phasename(i, phasename);
-      fprintf(Resfile, "\n\n%s (Phase %d):", phasename, i);
+      idname(ids[i], phasename);
+      fprintf(Resfile, "\n\n%s (Phase %d):", phasename, ids[i]);
       fwprintf(Resfile, L"\n Total volume: %.2f %lcm%lc  (%d voxels)",
                ((float)(burnData.totvox) * voxelVolume), mu, sup3,
                burnData.totvox);
@@ -207,13 +276,41 @@ int main(int argc, char *argv[]) {
               ((float)(burnData.y_vox_percolated) / (float)(burnData.totvox)));
       fprintf(Resfile, "\n Percolation ratio, Z direction: %.2f",
               ((float)(burnData.z_vox_percolated) / (float)(burnData.totvox)));
+      fprintf(Resfile, "\n Number of clusters: %d", burnData.numclusters);
+      fprintf(Resfile, "\n Largest cluster: %d voxels", burnData.maxcluster);
+      fprintf(Resfile, "\n Percolating clusters, X direction: %d",
+              burnData.x_perc_clusters);
+      fprintf(Resfile, "\n Percolating clusters, Y direction: %d",
+              burnData.y_perc_clusters);
+      fprintf(Resfile, "\n Percolating clusters, Z direction: %d",
+              burnData.z_perc_clusters);
       fflush(Resfile);
     }
   }
 
   fclose(Resfile);
 
-  free_sibox(Mic, Xsyssize, Ysyssize);
+  if (Clustername[0]) {
+    clfile = filehandler("perc3d", Clustername, "WRITE");
+    if (!clfile) {
+      free_cbox(Mic, Xsyssize, Ysyssize);
+      exit(1);
+    }
+    fprintf(clfile, "MICROSTRUCTURE CLUSTERS (PERIODIC), LARGEST FIRST");
+    for (i = 0; i < NPERCIDS; ++i) {
+      if (burnList[i].totvox > 0)
+        writeclusters(clfile, ids[i], &burnList[i], voxelVolume);
+    }
+    fprintf(clfile, "\n");
+    fclose(clfile);
+  }
+
+  for (i = 0; i < NPERCIDS; ++i) {
+    if (burnList[i].clusters)
+      free(burnList[i].clusters);
+  }
+
+  free_cbox(Mic, Xsyssize, Ysyssize);
 
   return (0);
 }
@@ -222,39 +319,51 @@ int main(int argc, char *argv[]) {
  *	burn3d
  *
  * 	Assess the connectivity (percolation) of a single phase
+ * 	(or of the group of phases it stands for) in x, y and z
  *
- * 	Two matrices are used:  one to store the recently burnt
- * 	locations, and one to store the newly-found burnt locations
+ * 	The pixels are labeled into clusters by perc_clusters in
+ * 	one pass over Mic, which is left unchanged.  For each direction
+ * 	the connected volume is what a burn started from every
+ * 	pixel of the first face normal to it reaches, with periodic
+ * 	boundaries in the other two directions.  The phase
+ * 	percolates in that direction if the burn arrives at the
+ * 	last face opposite a pixel of the phase on the first face,
+ * 	and all of the connected volume is then counted as
+ * 	percolated.  The clusters of the periodic image are kept
+ * 	in burnprops, largest first, for the cluster file.
  *
  * 	Arguments:	int npix: ID of phase to burn
- * 				int d1: x-direction flag
- * 				int d2: y-direction flag
- * 				int d3: z-direction flag
+ * 				struct BurnProps pointer to fill
  *
  * 	Returns:	0 if no errors
  * 				MEMERR if a memory error is encountered
  *
- *	Calls:		No other routines
+ *	Calls:		perc_clusters
  *	Called by:	main function
  ***/
 
 int burn3d(int npix, struct BurnProps *burnprops) {
-  int i, j, k, j1, k1, dir;
-  int d1, d2, d3, xsize, ysize, zsize;
-  int inew, x1, y1, z1, igood, jnew, icur, status;
-  int *nmatx, *nmaty, *nmatz, *nnewx, *nnewy, *nnewz;
-  int mult1, mult2, npix1, npix2, npix3;
-  int xl, xh, px, py, pz, qx, qy, qz, xcn, ycn, zcn;
-  int ntop, nthrough, ncur, nnew, nphc;
-  int npix_tot_count = 0;
+  int dir, c, npix1, npix2, npix3, nconn[3], nperc[3], nclperc[3];
+  unsigned char cls[CENSUSIDS];
+  unsigned char link[PERCCLASSES][PERCCLASSES];
+  Percstats ps;
 
   burnprops->totvox = 0;
   burnprops->x_vox_connected = 0;
   burnprops->y_vox_connected = 0;
   burnprops->z_vox_connected = 0;
+  burnprops->x_vox_percolated = 0;
+  burnprops->y_vox_percolated = 0;
+  burnprops->z_vox_percolated = 0;
   burnprops->isPercInX = 0;
   burnprops->isPercInY = 0;
   burnprops->isPercInZ = 0;
+  burnprops->numclusters = 0;
+  burnprops->maxcluster = 0;
+  burnprops->x_perc_clusters = 0;
+  burnprops->y_perc_clusters = 0;
+  burnprops->z_perc_clusters = 0;
+  burnprops->clusters = NULL;
 
   npix1 = npix;
   npix2 = npix;
@@ -281,280 +390,213 @@ int burn3d(int npix, struct BurnProps *burnprops) {
     npix = C3A;
   }
 
-  /**
-   * Before starting analysis, find out how many
-   * total voxels of this phase(s) are in the whole microstructure
-   **/
+  memset(cls, 0, sizeof(cls));
+  cls[npix] = cls[npix1] = cls[npix2] = cls[npix3] = 1;
+  memset(link, PERCNOLINK, sizeof(link));
+  link[1][1] = PERCLINK;
 
-  for (i = 0; i < Xsyssize; ++i) {
-    for (j = 0; j < Ysyssize; ++j) {
-      for (k = 0; k < Zsyssize; ++k) {
-        if (Mic[i][j][k] == npix || Mic[i][j][k] == npix1 ||
-            Mic[i][j][k] == npix2 || Mic[i][j][k] == npix3) {
-          npix_tot_count++;
-        }
-      }
-    }
+  if (perc_clusters(Mic, NULL, Xsyssize, Ysyssize, Zsyssize, cls, link, &ps,
+                    &burnprops->clusters)) {
+    fprintf(stderr, "Error: Could not allocate cluster labels for phase %d\n",
+            npix);
+    return (MEMERR);
   }
 
-  burnprops->totvox = npix_tot_count;
-
-  if (npix_tot_count == 0)
+  burnprops->totvox = ps.nset;
+  burnprops->numclusters = ps.ncluster;
+  burnprops->maxcluster = ps.maxcluster;
+  if (ps.nset == 0)
     return (0);
 
-  /**
-   * dir = 0 <--> x direction
-   * dir = 1 <--> y direction
-   * dir = 2 <--> z direction
-   **/
-
   for (dir = 0; dir < 3; ++dir) {
-    d1 = d2 = d3 = 0;
-    if (dir == 0) {
-      d1 = 1;
-      xsize = Xsyssize;
-      ysize = Ysyssize;
-      zsize = Zsyssize;
-    } else if (dir == 1) {
-      d2 = 1;
-      xsize = Ysyssize;
-      ysize = Xsyssize;
-      zsize = Zsyssize;
-    } else {
-      d3 = 1;
-      xsize = Zsyssize;
-      ysize = Ysyssize;
-      zsize = Xsyssize;
-    }
-    /***
-     *	Counters for number of pixels of phase accessible
-     *	from surface #1 and number which are part of a
-     *	percolated pathway to surface #2
-     ***/
-
-    ntop = status = nthrough = nphc = 0;
-
-    /***
-     *	Percolation is assessed from top to bottom only
-     *	and burning algorithm is periodic in other two
-     *	directions.
-     *
-     *	Use of directional flags allow transformation of
-     *	coordinates to burn in direction of choosing
-     *	(x, y, or z)
-     ***/
-
-    i = 0; /* Starting from the bottom x face */
-
-    for (k = 0; k < zsize; k++) {
-      for (j = 0; j < ysize; j++) {
-
-        ncur = Ntot = 0;
-
-        /* Transform coordinates */
-
-        px = cx(i, j, k, d1, d2, d3);
-        py = cy(i, j, k, d1, d2, d3);
-        pz = cz(i, j, k, d1, d2, d3);
-
-        if (Mic[px][py][pz] == npix || Mic[px][py][pz] == npix1 ||
-            Mic[px][py][pz] == npix2 || Mic[px][py][pz] == npix3) {
-
-          /* Start a burn front */
-
-          Mic[px][py][pz] = BURNT;
-          Ntot++;
-          ncur++;
-
-          /***
-           * DEPTH-FIRST SEARCH (DFS) CONNECTIVITY ALGORITHM
-           * Efficiently finds all connected voxels using minimal memory
-           * Use a reasonable stack size to avoid memory exhaustion
-           * Stack size of 10000 = ~120KB per component
-           ***/
-
-#define DFS_STACK_SIZE 10000
-          StackPoint *dfs_stack =
-              (StackPoint *)malloc(DFS_STACK_SIZE * sizeof(StackPoint));
-          if (!dfs_stack) {
-            fprintf(stderr, "Error: Could not allocate DFS stack (size=%d)\n", DFS_STACK_SIZE);
-            return (MEMERR);
-          }
-
-          // Initialize DFS stack
-          int stack_top = 0;
-          dfs_stack[stack_top].x = i;
-          dfs_stack[stack_top].y = j;
-          dfs_stack[stack_top].z = k;
-          stack_top++;
-
-          // DFS main loop
-          while (stack_top > 0) {
-            stack_top--;
-            int curr_x = dfs_stack[stack_top].x;
-            int curr_y = dfs_stack[stack_top].y;
-            int curr_z = dfs_stack[stack_top].z;
-
-            // Check all 6 neighbors
-            for (jnew = 1; jnew <= 6; jnew++) {
-              x1 = curr_x;
-              y1 = curr_y;
-              z1 = curr_z;
-
-              if (jnew == 1)
-                x1--;
-              if (jnew == 2)
-                x1++;
-              if (jnew == 3)
-                y1--;
-              if (jnew == 4)
-                y1++;
-              if (jnew == 5)
-                z1--;
-              if (jnew == 6)
-                z1++;
-
-              y1 += checkbc(y1, ysize);
-              z1 += checkbc(z1, zsize);
-
-              if ((x1 >= 0) && (x1 < xsize)) {
-                px = cx(x1, y1, z1, d1, d2, d3);
-                py = cy(x1, y1, z1, d1, d2, d3);
-                pz = cz(x1, y1, z1, d1, d2, d3);
-
-                if (px < 0 || px >= Xsyssize || py < 0 || py >= Ysyssize ||
-                    pz < 0 || pz >= Zsyssize) {
-                  continue;
-                }
-
-                if ((Mic[px][py][pz] == npix || Mic[px][py][pz] == npix1 ||
-                     Mic[px][py][pz] == npix2 || Mic[px][py][pz] == npix3) &&
-                    Mic[px][py][pz] != BURNT) {
-
-                  Ntot++;
-                  Mic[px][py][pz] = BURNT;
-
-                  if (stack_top < DFS_STACK_SIZE - 1) {
-                    dfs_stack[stack_top].x = x1;
-                    dfs_stack[stack_top].y = y1;
-                    dfs_stack[stack_top].z = z1;
-                    stack_top++;
-                  } else {
-                    free(dfs_stack);
-                    return (MEMERR);
-                  }
-                }
-              }
-            }
-          }
-
-          free(dfs_stack);
-
-          /* Connected component found - add to total */
-          ntop += Ntot;
-        }
-      }
+    nconn[dir] = ps.nfront[dir];
+    nperc[dir] = (ps.nmeet[dir] > 0) ? ps.nfront[dir] : 0;
+    nclperc[dir] = 0;
+    for (c = 0; c < ps.ncluster; ++c) {
+      if (burnprops->clusters[c].through & (1 << dir))
+        nclperc[dir]++;
     }
+  }
 
-    /***
-     * PERCOLATION ANALYSIS
-     * Check if BURNT voxels span from one face to the opposite face
-     * Uses original algorithm logic but optimized to run once per direction
-     ***/
-
-    xl = 0;
-    xh = xsize - 1;
-
-    // Mark voxels on boundary faces and check for percolation
-    for (j1 = 0; j1 < ysize; j1++) {
-      for (k1 = 0; k1 < zsize; k1++) {
-
-        px = cx(xl, j1, k1, d1, d2, d3);
-        py = cy(xl, j1, k1, d1, d2, d3);
-        pz = cz(xl, j1, k1, d1, d2, d3);
-        qx = cx(xh, j1, k1, d1, d2, d3);
-        qy = cy(xh, j1, k1, d1, d2, d3);
-        qz = cz(xh, j1, k1, d1, d2, d3);
-
-        // Bounds check
-        if (px >= 0 && px < Xsyssize && py >= 0 && py < Ysyssize && pz >= 0 &&
-            pz < Zsyssize && qx >= 0 && qx < Xsyssize && qy >= 0 &&
-            qy < Ysyssize && qz >= 0 && qz < Zsyssize) {
-
-          // Check if both faces have BURNT voxels (indicates percolation path)
-          if ((Mic[px][py][pz] == BURNT) && (Mic[qx][qy][qz] == BURNT)) {
-            nthrough =
-                ntop; // All connected voxels are part of percolating network
-            break;
-          }
-
-          // Mark face voxels (increment BURNT values for later restoration)
-          if (Mic[px][py][pz] == BURNT) {
-            Mic[px][py][pz]++;
-          }
-          if (Mic[qx][qy][qz] == BURNT) {
-            Mic[qx][qy][qz]++;
-          }
-        }
-      }
-      if (nthrough > 0)
-        break;
+  burnprops->x_vox_connected = nconn[0];
+  burnprops->y_vox_connected = nconn[1];
+  burnprops->z_vox_connected = nconn[2];
+  burnprops->x_vox_percolated = nperc[0];
+  burnprops->y_vox_percolated = nperc[1];
+  burnprops->z_vox_percolated = nperc[2];
+  burnprops->isPercInX = (nperc[0] > 0) ? 1 : 0;
+  burnprops->isPercInY = (nperc[1] > 0) ? 1 : 0;
+  burnprops->isPercInZ = (nperc[2] > 0) ? 1 : 0;
+  burnprops->x_perc_clusters = nclperc[0];
+  burnprops->y_perc_clusters = nclperc[1];
+  burnprops->z_perc_clusters = nclperc[2];
+
+  return (0);
+}
+
+/***
+ *	writeclusters
+ *
+ * 	Write the clusters of one phase or group, largest first,
+ * 	with the directions each percolates in
+ *
+ * 	Arguments:	FILE pointer to the cluster file
+ * 				int ID of the phase or group
+ * 				struct BurnProps pointer filled by burn3d
+ * 				float volume of one voxel
+ *
+ * 	Returns:	nothing
+ *
+ *	Calls:		idname
+ *	Called by:	main function
+ ***/
+void writeclusters(FILE *fpout, int id, struct BurnProps *burnprops,
+                   float voxelVolume) {
+  int c;
+  char name[MAXSTRING];
+  Perccluster *cl;
+
+  idname(id, name);
+  fprintf(fpout, "\n\n%s (Phase %d):", name, id);
+  fprintf(fpout, "\n Number of clusters: %d", burnprops->numclusters);
+  fprintf(fpout, "\nCluster\tVoxels\tVolume_(um3)\tFraction");
+  fprintf(fpout, "\tPercolates_X\tPercolates_Y\tPercolates_Z");
+  for (c = 0; c < burnprops->numclusters; ++c) {
+    cl = &burnprops->clusters[c];
+    fprintf(fpout, "\n%d\t%d\t%.2f\t%f\t%d\t%d\t%d", c + 1, cl->size,
+            (float)cl->size * voxelVolume,
+            (float)cl->size / (float)burnprops->totvox, cl->through & 1,
+            (cl->through >> 1) & 1, (cl->through >> 2) & 1);
+  }
+
+  return;
+}
+
+/***
+ *	idname
+ *
+ * 	Name of a phase, or of a group of phases
+ *
+ * 	Arguments:	int ID of the phase or group
+ * 				char pointer to the name
+ *
+ * 	Returns:	nothing
+ *
+ *	Calls:		id2phasename
+ *	Called by:	main function, writeclusters
+ ***/
+void idname(int id, char *name) {
+  if (id == EMPTYP) {
+    sprintf(name, "ALL PORES");
+  } else if (id == TOTCSH) {
+    sprintf(name, "ALL CSH");
+  } else if (id == TOTGYP) {
+    sprintf(name, "ALL SULFATES");
+  } else {
+    id2phasename(id, name);
+  }
+
+  return;
+}
+
+/***
+ *	cacheio
+ *
+ * 	Write the results of burn3d for every phase and group to
+ * 	fp, a file of the result cache (--cache), or with writing 0
+ * 	read them back in their place.  Each BurnProps is kept as it
+ * 	is in memory, followed by its clusters; the clusters pointer
+ * 	in the file means nothing and is set again on reading.
+ *
+ * 	Arguments:	FILE pointer
+ * 				struct BurnProps array of NPERCIDS
+ * 				int nonzero to write
+ *
+ * 	Returns:	0 if okay, 1 if they could not all be written or
+ * 				read, in which case no clusters are left
+ * 				allocated
+ *
+ *	Calls:		no routines
+ *	Called by:	main function
+ ***/
+int cacheio(FILE *fp, struct BurnProps *burnList, int writing) {
+  int i, j, nc, status;
+  struct BurnProps *bp;
+
+  status = 0;
+  for (i = 0; i < NPERCIDS && !status; ++i) {
+    bp = &burnList[i];
+    if (writing) {
+      nc = bp->clusters ? bp->numclusters : 0;
+      status = (fwrite(bp, sizeof(*bp), 1, fp) != 1 ||
+                fwrite(bp->clusters, sizeof(Perccluster), nc, fp) != nc);
+      continue;
     }
 
-    /***
-     *	Finished sampling all pixels of type npix along
-     *	the bottom x face
-     *
-     *	Return the burnt sites to their original
-     *	phase values
-     ***/
-
-    for (k = 0; k < zsize; k++) {
-      for (j = 0; j < ysize; j++) {
-        for (i = 0; i < xsize; i++) {
-
-          /* Transform coordinates */
-          px = cx(i, j, k, d1, d2, d3);
-          py = cy(i, j, k, d1, d2, d3);
-          pz = cz(i, j, k, d1, d2, d3);
-
-          if (Mic[px][py][pz] >= BURNT) {
-
-            nphc++;
-            Mic[px][py][pz] = npix;
-
-          } else if ((Mic[px][py][pz] == npix) || (Mic[px][py][pz] == npix1) ||
-                     (Mic[px][py][pz] == npix2) || (Mic[px][py][pz] == npix3)) {
-            nphc++;
-          }
-        }
-      }
+    if (fread(bp, sizeof(*bp), 1, fp) != 1) {
+      bp->clusters = NULL;
+      status = 1;
+      break;
     }
+    nc = bp->clusters ? bp->numclusters : 0;
+    bp->clusters = NULL;
+    if (nc > 0) {
+      bp->clusters = (Perccluster *)malloc(nc * sizeof(Perccluster));
+      status = (!bp->clusters ||
+                fread(bp->clusters, sizeof(Perccluster), nc, fp) != nc);
+    }
+  }
 
-    if (dir == 0) {
-      burnprops->x_vox_connected = ntop;
-      burnprops->x_vox_percolated = nthrough;
-      if (nthrough > 0)
-        burnprops->isPercInX = 1;
-    } else if (dir == 1) {
-      burnprops->y_vox_connected = ntop;
-      burnprops->y_vox_percolated = nthrough;
-      if (nthrough > 0)
-        burnprops->isPercInY = 1;
-    } else {
-      burnprops->z_vox_connected = ntop;
-      burnprops->z_vox_percolated = nthrough;
-      if (nthrough > 0)
-        burnprops->isPercInZ = 1;
+  if (status && !writing) {
+    for (j = 0; j < i && j < NPERCIDS; ++j) {
+      if (burnList[j].clusters)
+        free(burnList[j].clusters);
+      burnList[j].clusters = NULL;
     }
+  }
 
-    /***
-     * NOTE: No need to free BFS arrays since DFS algorithm doesn't use them.
-     * Each connected component allocates and frees its own small DFS stack
-     *locally.
-     ***/
+  return (status);
+}
 
-  } /* End of loop over different directions */
+/***
+ *	checkargs
+ *
+ * 	Read the options from the command line
+ *
+ * 	Arguments:	int argc, char *argv[]
+ *
+ * 	Returns:	number of file names left on the command line,
+ * 				-1 if an option is not recognized
+ *
+ *	Calls:		no routines
+ *	Called by:	main function
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"clusters", required_argument, 0, 'c'},
+                                      {"cache", required_argument, 0, 'C'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  Clustername[0] = '\0';
+  Cachedir[0] = '\0';
+
+  while ((opt_char = getopt_long(argc, argv, "c:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -c or --clusters */
+    case (int)('c'):
+      snprintf(Clustername, sizeof(Clustername), "%s", optarg);
+      break;
+    /* --cache */
+    case (int)('C'):
+      snprintf(Cachedir, sizeof(Cachedir), "%s", optarg);
+      break;
+    default:
+      return (-1);
+    }
+  }
 
-  return (status);
+  return (argc - optind);
 }
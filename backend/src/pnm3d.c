@@ -0,0 +1,944 @@
+/*****************************************************
+ *
+ * Program pnm3d.c
+ *
+ * Reads in a 3-D image and extracts a pore network from
+ * a phase (or a set of phases taken together), then
+ * outputs
+ *
+ * 	(1) the network: the pores, with their centers,
+ * 	    radii and volumes, and the throats joining them,
+ * 	    with their radii and the vectors between the pore
+ * 	    centers
+ * 	(2) statistics of the network: coordination numbers,
+ * 	    clusters and the axes along which they connect
+ * 	    through the periodic system, and the permeability
+ * 	    of the network along x, y and z
+ *
+ * The pores are maximal balls.  The squared distance of
+ * every pore voxel to the nearest solid voxel (see
+ * sqdistance in vcctllib) is swept from the largest down,
+ * like a flood from the peaks: a voxel with no face
+ * neighbor already swept starts a pore at its ball, and
+ * any other joins the neighbor with the largest ball.
+ * Where two pores meet, the smaller is merged into the
+ * larger if its center lies inside the larger ball.  Each
+ * pore voxel keeps its offset from the center of its
+ * pore, so the vector between two pore centers is known
+ * across the periodic boundaries.  The throats are the
+ * faces between the voxels of different pores, and the
+ * radius of a throat is that of the largest ball on it.
+ *
+ * The permeability comes from Poiseuille flow in the
+ * network, each pore and throat a tube of its radius,
+ * under a unit pressure gradient with periodic
+ * boundaries, solved by conjugate gradients on the pores.
+ * Once the network is made, the flow and the statistics
+ * cost O(pores) instead of O(voxels).
+ *
+ *******************************************************/
+#include "include/vcctl.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
+/***
+ *	A pore while it is being made: the voxel of its center
+ *	and the squared radius of its ball.  Merged pores are
+ *	kept as a tree, each with the vector from the center of
+ *	its parent to its own center (zero at a root).
+ ***/
+typedef struct {
+  int parent;
+  int d[3];
+  int c[3];
+  int r2;
+} Pore;
+
+/***
+ *	A throat between pores a and b, with the vector from the
+ *	center of a to that of b, the squared radius of the
+ *	largest ball on it, and its area in voxel faces.  A pore
+ *	that reaches its own periodic image has a throat to
+ *	itself.
+ ***/
+typedef struct {
+  int a, b;
+  int v[3];
+  int r2;
+  int area;
+} Throat;
+
+/***
+ *	Global variables
+ ***/
+float Version;
+unsigned char Inphase[CENSUSIDS];
+char Imgname[MAXSTRING], Outname[MAXSTRING], Netname[MAXSTRING];
+int Xsize, Ysize, Zsize;
+Pore *Pores = NULL;
+int Npores = 0, Porecap = 0;
+
+/***
+ *	Steps to the six face neighbors of a voxel; the first
+ *	three are the positive ones
+ ***/
+static const int Step[6][3] = {{1, 0, 0},  {0, 1, 0},  {0, 0, 1},
+                               {-1, 0, 0}, {0, -1, 0}, {0, 0, -1}};
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+int readids(char *list, unsigned char *isin);
+void printHelp(void);
+size_t neighbor(size_t n, int s);
+int findpore(int p);
+int newpore(size_t n, int r2);
+int cmpthroat(const void *p1, const void *p2);
+double throatcond(Throat *t, double r1, double r2);
+double flowsolve(int np, int nt, Throat *th, double *g, int axis, int *iters);
+
+int main(int argc, char *argv[]) {
+  int i, s, a, p, q, r2, np, nt, nrec, reccap, maxd2, nclust, maxcoord, iters;
+  int v[3], *d2, *label, *id, *coord, *clust, *wrap, *pos, *queue, *first;
+  int *adj, head, tail, u, w, e, sgn, big;
+  size_t n, m, k, nvox, npvox, cap = 0, *order, *count;
+  short *off;
+  float res;
+  double *vol, *rad, *g, *cvol, kperm[3], wrapvol[3], sum, rt;
+  unsigned char *vox = NULL, *pore, *solid;
+  Throat *th, *newth;
+  FILE *infile, *outfile;
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    exit(1);
+  }
+
+  infile = filehandler("pnm3d", Imgname, "READ");
+  if (!infile) {
+    exit(1);
+  }
+
+  if (load_microstructure(infile, &vox, &cap, &Version, &Xsize, &Ysize,
+                          &Zsize, &res)) {
+    fclose(infile);
+    if (vox)
+      free(vox);
+    bailout("pnm3d", "Error reading microstructure image");
+    exit(1);
+  }
+  fclose(infile);
+
+  /***
+   *	Make the pore and solid masks.  The image is in C order
+   *	(z varies fastest), so z is passed to sqdistance as the
+   *	fastest axis.
+   ***/
+
+  nvox = (size_t)Xsize * Ysize * Zsize;
+  pore = (unsigned char *)malloc(2 * nvox);
+  d2 = (int *)malloc(nvox * sizeof(int));
+  label = (int *)malloc(nvox * sizeof(int));
+  off = (short *)malloc(3 * nvox * sizeof(short));
+  if (!pore || !d2 || !label || !off) {
+    bailout("pnm3d", "Memory allocation failure");
+    exit(1);
+  }
+  solid = pore + nvox;
+  npvox = 0;
+  for (n = 0; n < nvox; n++) {
+    pore[n] = Inphase[vox[n]];
+    solid[n] = !pore[n];
+    npvox += pore[n];
+  }
+  free(vox);
+
+  printf("Pore voxels: %lu of %lu\n", (unsigned long)npvox,
+         (unsigned long)nvox);
+  if (npvox == 0 || npvox == nvox) {
+    bailout("pnm3d", "The image needs both pore and solid voxels");
+    exit(1);
+  }
+  if (sqdistance(solid, Zsize, Ysize, Xsize, d2)) {
+    bailout("pnm3d", "Memory allocation failure");
+    exit(1);
+  }
+
+  /***
+   *	Order the pore voxels from the largest squared
+   *	distance down, by counting
+   ***/
+
+  maxd2 = 0;
+  for (n = 0; n < nvox; n++) {
+    if (pore[n] && d2[n] > maxd2)
+      maxd2 = d2[n];
+  }
+  count = (size_t *)calloc((size_t)maxd2 + 2, sizeof(size_t));
+  order = (size_t *)malloc(npvox * sizeof(size_t));
+  if (!count || !order) {
+    bailout("pnm3d", "Memory allocation failure");
+    exit(1);
+  }
+  for (n = 0; n < nvox; n++) {
+    if (pore[n])
+      count[maxd2 - d2[n] + 1]++;
+  }
+  for (i = 1; i <= maxd2 + 1; i++) {
+    count[i] += count[i - 1];
+  }
+  for (n = 0; n < nvox; n++) {
+    if (pore[n])
+      order[count[maxd2 - d2[n]]++] = n;
+  }
+  free(count);
+
+  /***
+   *	Sweep the pore voxels into pores.  A voxel joins the
+   *	swept neighbor with the largest ball, at the offset
+   *	from its pore's center one step back from that
+   *	neighbor's, or starts a pore if it has none.
+   ***/
+
+  for (n = 0; n < nvox; n++) {
+    label[n] = -1;
+  }
+  for (k = 0; k < npvox; k++) {
+    n = order[k];
+    m = n;
+    e = -1;
+    for (s = 0; s < 6; s++) {
+      if (label[neighbor(n, s)] >= 0 &&
+          (e < 0 || d2[neighbor(n, s)] > d2[m])) {
+        m = neighbor(n, s);
+        e = s;
+      }
+    }
+    if (e < 0) {
+      p = newpore(n, d2[n]);
+      if (p < 0) {
+        bailout("pnm3d", "Memory allocation failure");
+        exit(1);
+      }
+      label[n] = p;
+      off[3 * n] = off[3 * n + 1] = off[3 * n + 2] = 0;
+      continue;
+    }
+    label[n] = label[m];
+    for (a = 0; a < 3; a++) {
+      off[3 * n + a] = (short)(off[3 * m + a] - Step[e][a]);
+    }
+
+    /*  Merge with any other pore met here whose center is */
+    /*  inside the larger of the two balls */
+    for (s = 0; s < 6; s++) {
+      m = neighbor(n, s);
+      if (label[m] < 0)
+        continue;
+      p = findpore(label[n]);
+      q = findpore(label[m]);
+      if (p == q)
+        continue;
+      r2 = 0;
+      for (a = 0; a < 3; a++) {
+        v[a] = Pores[label[n]].d[a] + off[3 * n + a] + Step[s][a] -
+               Pores[label[m]].d[a] - off[3 * m + a];
+        r2 += v[a] * v[a];
+      }
+      if (Pores[p].r2 >= Pores[q].r2 && r2 <= Pores[p].r2) {
+        Pores[q].parent = p;
+        for (a = 0; a < 3; a++) {
+          Pores[q].d[a] = v[a];
+        }
+      } else if (Pores[q].r2 > Pores[p].r2 && r2 <= Pores[q].r2) {
+        Pores[p].parent = q;
+        for (a = 0; a < 3; a++) {
+          Pores[p].d[a] = -v[a];
+        }
+      }
+    }
+  }
+  free(order);
+
+  /***
+   *	Number the pores that were not merged, and add up their
+   *	volumes
+   ***/
+
+  id = (int *)malloc(Npores * sizeof(int));
+  if (!id) {
+    bailout("pnm3d", "Memory allocation failure");
+    exit(1);
+  }
+  np = 0;
+  for (p = 0; p < Npores; p++) {
+    id[p] = (findpore(p) == p) ? np++ : -1;
+  }
+  vol = (double *)calloc(2 * (size_t)np, sizeof(double));
+  if (!vol) {
+    bailout("pnm3d", "Memory allocation failure");
+    exit(1);
+  }
+  rad = vol + np;
+  for (p = 0; p < Npores; p++) {
+    if (id[p] >= 0)
+      rad[id[p]] = sqrt((double)Pores[p].r2) - 0.5;
+  }
+  for (n = 0; n < nvox; n++) {
+    if (pore[n])
+      vol[id[findpore(label[n])]] += 1.0;
+  }
+
+  /***
+   *	Find the throats: every face between voxels of two
+   *	pores, or of one pore and its periodic image, gives a
+   *	record, oriented from the lower pore number, and the
+   *	records of the same throat are then put together
+   ***/
+
+  reccap = 1024;
+  nrec = 0;
+  th = (Throat *)malloc(reccap * sizeof(Throat));
+  if (!th) {
+    bailout("pnm3d", "Memory allocation failure");
+    exit(1);
+  }
+  for (n = 0; n < nvox; n++) {
+    if (!pore[n])
+      continue;
+    for (s = 0; s < 3; s++) {
+      m = neighbor(n, s);
+      if (!pore[m])
+        continue;
+      p = findpore(label[n]);
+      q = findpore(label[m]);
+      for (a = 0; a < 3; a++) {
+        v[a] = Pores[label[n]].d[a] + off[3 * n + a] + Step[s][a] -
+               Pores[label[m]].d[a] - off[3 * m + a];
+      }
+      if (p == q && !v[0] && !v[1] && !v[2])
+        continue;
+      p = id[p];
+      q = id[q];
+      sgn = (p > q || (p == q && (v[0] < 0 || (!v[0] && v[1] < 0) ||
+                                  (!v[0] && !v[1] && v[2] < 0))))
+                ? -1
+                : 1;
+      if (nrec == reccap) {
+        reccap *= 2;
+        newth = (Throat *)realloc(th, reccap * sizeof(Throat));
+        if (!newth) {
+          bailout("pnm3d", "Memory allocation failure");
+          exit(1);
+        }
+        th = newth;
+      }
+      th[nrec].a = (sgn > 0) ? p : q;
+      th[nrec].b = (sgn > 0) ? q : p;
+      for (a = 0; a < 3; a++) {
+        th[nrec].v[a] = sgn * v[a];
+      }
+      th[nrec].r2 = (d2[n] < d2[m]) ? d2[n] : d2[m];
+      th[nrec].area = 1;
+      nrec++;
+    }
+  }
+  free(pore);
+  free(d2);
+  free(label);
+  free(off);
+
+  qsort(th, nrec, sizeof(Throat), cmpthroat);
+  nt = 0;
+  for (i = 0; i < nrec; i++) {
+    if (nt > 0 && !cmpthroat(&th[nt - 1], &th[i])) {
+      if (th[i].r2 > th[nt - 1].r2)
+        th[nt - 1].r2 = th[i].r2;
+      th[nt - 1].area++;
+    } else {
+      th[nt++] = th[i];
+    }
+  }
+
+  printf("Pores: %d, throats: %d\n", np, nt);
+
+  /***
+   *	Coordination numbers, and the clusters of pores joined
+   *	by throats.  Each pore of a cluster is given the
+   *	position of its center along the throats from the
+   *	first one; a throat that leads to a pore at another
+   *	position, or a throat of a pore to its own image, joins
+   *	the cluster to its periodic image along the axes where
+   *	the positions differ.
+   ***/
+
+  coord = (int *)calloc(8 * (size_t)np + 1, sizeof(int));
+  adj = (int *)malloc((4 * (size_t)nt + 1) * sizeof(int));
+  g = (double *)malloc(((size_t)nt + 1) * sizeof(double));
+  cvol = (double *)calloc((size_t)np, sizeof(double));
+  if (!coord || !adj || !g || !cvol) {
+    bailout("pnm3d", "Memory allocation failure");
+    exit(1);
+  }
+  clust = coord + np;
+  wrap = clust + np;
+  queue = wrap + np;
+  pos = queue + np;
+  first = pos + 3 * np;
+
+  for (i = 0; i < nt; i++) {
+    coord[th[i].a]++;
+    coord[th[i].b]++;
+    if (th[i].a != th[i].b) {
+      first[th[i].a + 1]++;
+      first[th[i].b + 1]++;
+    }
+  }
+  for (p = 0; p < np; p++) {
+    first[p + 1] += first[p];
+    clust[p] = -1;
+    wrap[p] = 0;
+  }
+  for (i = 0; i < nt; i++) {
+    if (th[i].a != th[i].b) {
+      adj[2 * first[th[i].a]] = i;
+      adj[2 * first[th[i].a]++ + 1] = 1;
+      adj[2 * first[th[i].b]] = i;
+      adj[2 * first[th[i].b]++ + 1] = -1;
+    }
+  }
+  for (p = np; p > 0; p--) {
+    first[p] = first[p - 1];
+  }
+  first[0] = 0;
+
+  nclust = 0;
+  for (p = 0; p < np; p++) {
+    if (clust[p] >= 0)
+      continue;
+    clust[p] = nclust;
+    pos[3 * p] = pos[3 * p + 1] = pos[3 * p + 2] = 0;
+    head = tail = 0;
+    queue[tail++] = p;
+    while (head < tail) {
+      u = queue[head++];
+      cvol[nclust] += vol[u];
+      for (e = first[u]; e < first[u + 1]; e++) {
+        i = adj[2 * e];
+        sgn = adj[2 * e + 1];
+        w = (sgn > 0) ? th[i].b : th[i].a;
+        if (clust[w] < 0) {
+          clust[w] = nclust;
+          for (a = 0; a < 3; a++) {
+            pos[3 * w + a] = pos[3 * u + a] + sgn * th[i].v[a];
+          }
+          queue[tail++] = w;
+        } else {
+          for (a = 0; a < 3; a++) {
+            if (pos[3 * w + a] != pos[3 * u + a] + sgn * th[i].v[a])
+              wrap[nclust] |= (1 << a);
+          }
+        }
+      }
+    }
+    nclust++;
+  }
+  for (i = 0; i < nt; i++) {
+    if (th[i].a == th[i].b) {
+      for (a = 0; a < 3; a++) {
+        if (th[i].v[a])
+          wrap[clust[th[i].a]] |= (1 << a);
+      }
+    }
+  }
+
+  big = 0;
+  maxcoord = 0;
+  sum = 0.0;
+  for (i = 0; i < nclust; i++) {
+    if (cvol[i] > cvol[big])
+      big = i;
+  }
+  for (a = 0; a < 3; a++) {
+    wrapvol[a] = 0.0;
+    for (i = 0; i < nclust; i++) {
+      if (wrap[i] & (1 << a))
+        wrapvol[a] += cvol[i];
+    }
+    wrapvol[a] /= (double)npvox;
+  }
+  for (p = 0; p < np; p++) {
+    sum += coord[p];
+    if (coord[p] > maxcoord)
+      maxcoord = coord[p];
+  }
+
+  /***
+   *	Permeability along each axis, in um^2
+   ***/
+
+  for (i = 0; i < nt; i++) {
+    g[i] = throatcond(&th[i], rad[th[i].a], rad[th[i].b]);
+  }
+  for (a = 0; a < 3; a++) {
+    kperm[a] = flowsolve(np, nt, th, g, a, &iters);
+    if (iters < 0) {
+      bailout("pnm3d", "Memory allocation failure");
+      exit(1);
+    }
+    kperm[a] *= (double)res * res;
+    printf("Permeability along %c: %g um^2 (%d steps)\n", 'x' + a, kperm[a],
+           iters);
+  }
+
+  if (Outname[0]) {
+    outfile = filehandler("pnm3d", Outname, "WRITE");
+    if (!outfile) {
+      exit(1);
+    }
+    fprintf(outfile, "Pore voxels = %lu", (unsigned long)npvox);
+    fprintf(outfile, "\nPorosity = %f", (double)npvox / (double)nvox);
+    fprintf(outfile, "\nNumber of pores = %d", np);
+    fprintf(outfile, "\nNumber of throats = %d", nt);
+    fprintf(outfile, "\nMean coordination number = %f", sum / (double)np);
+    fprintf(outfile, "\nNumber of clusters = %d", nclust);
+    fprintf(outfile, "\nLargest cluster fraction of pore volume = %f",
+            cvol[big] / (double)npvox);
+    for (a = 0; a < 3; a++) {
+      fprintf(outfile, "\nConnected fraction of pore volume along %c = %f",
+              'x' + a, wrapvol[a]);
+    }
+    for (a = 0; a < 3; a++) {
+      fprintf(outfile, "\nPermeability along %c = %g um^2", 'x' + a,
+              kperm[a]);
+    }
+    fprintf(outfile, "\n\nCoordination\tNumber\tFraction");
+    for (i = 0; i <= maxcoord; i++) {
+      e = 0;
+      for (p = 0; p < np; p++) {
+        e += (coord[p] == i);
+      }
+      fprintf(outfile, "\n%d\t%d\t%f", i, e, (double)e / (double)np);
+    }
+    fprintf(outfile, "\n");
+    fclose(outfile);
+  }
+
+  if (Netname[0]) {
+    outfile = filehandler("pnm3d", Netname, "WRITE");
+    if (!outfile) {
+      exit(1);
+    }
+    fprintf(outfile, "Resolution: %.2f", res);
+    fprintf(outfile, "\nPores: %d", np);
+    fprintf(outfile, "\nPore\tX_(um)\tY_(um)\tZ_(um)\tRadius_(um)\t"
+                     "Volume_(um^3)\tCoordination\tCluster");
+    for (p = 0; p < Npores; p++) {
+      if (id[p] < 0)
+        continue;
+      i = id[p];
+      fprintf(outfile, "\n%d\t%f\t%f\t%f\t%f\t%f\t%d\t%d", i,
+              res * Pores[p].c[0], res * Pores[p].c[1], res * Pores[p].c[2],
+              res * rad[i], res * res * res * vol[i], coord[i], clust[i]);
+    }
+    fprintf(outfile, "\nThroats: %d", nt);
+    fprintf(outfile, "\nThroat\tPore_1\tPore_2\tDx_(um)\tDy_(um)\tDz_(um)\t"
+                     "Radius_(um)\tArea_(um^2)");
+    for (i = 0; i < nt; i++) {
+      rt = sqrt((double)th[i].r2) - 0.5;
+      fprintf(outfile, "\n%d\t%d\t%d\t%f\t%f\t%f\t%f\t%f", i, th[i].a,
+              th[i].b, res * th[i].v[0], res * th[i].v[1], res * th[i].v[2],
+              res * rt, res * res * th[i].area);
+    }
+    fprintf(outfile, "\n");
+    fclose(outfile);
+  }
+
+  free(Pores);
+  free(id);
+  free(vol);
+  free(th);
+  free(coord);
+  free(adj);
+  free(g);
+  free(cvol);
+
+  return (0);
+}
+
+/***
+ *	neighbor
+ *
+ *	Index of a face neighbor of a voxel, with periodic
+ *	boundaries
+ *
+ * 	Arguments:	size_t index of the voxel (z varies fastest)
+ * 				int step (see Step)
+ * 	Returns:	size_t index of the neighbor
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+size_t neighbor(size_t n, int s) {
+  int ix, iy, iz;
+
+  ix = (int)(n / ((size_t)Ysize * Zsize));
+  iy = (int)((n / Zsize) % Ysize);
+  iz = (int)(n % Zsize);
+  ix = (ix + Step[s][0] + Xsize) % Xsize;
+  iy = (iy + Step[s][1] + Ysize) % Ysize;
+  iz = (iz + Step[s][2] + Zsize) % Zsize;
+
+  return (((size_t)ix * Ysize + iy) * Zsize + iz);
+}
+
+/***
+ *	findpore
+ *
+ *	Find the pore a pore has been merged into, and shorten
+ *	the path to it, so that the vector of the pore is then
+ *	from the center of that one
+ *
+ * 	Arguments:	int pore
+ * 	Returns:	int pore it has been merged into (itself if none)
+ *
+ *	Calls:		findpore
+ *	Called by:	main program
+ ***/
+int findpore(int p) {
+  int a, q, r;
+
+  q = Pores[p].parent;
+  if (q == p)
+    return (p);
+  r = findpore(q);
+  if (r != q) {
+    for (a = 0; a < 3; a++) {
+      Pores[p].d[a] += Pores[q].d[a];
+    }
+    Pores[p].parent = r;
+  }
+
+  return (r);
+}
+
+/***
+ *	newpore
+ *
+ *	Start a pore at the ball of a voxel
+ *
+ * 	Arguments:	size_t index of the voxel
+ * 				int squared radius of its ball
+ * 	Returns:	int number of the pore, -1 if out of memory
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int newpore(size_t n, int r2) {
+  Pore *newpores;
+
+  if (Npores == Porecap) {
+    Porecap = (Porecap > 0) ? 2 * Porecap : 1024;
+    newpores = (Pore *)realloc(Pores, Porecap * sizeof(Pore));
+    if (!newpores)
+      return (-1);
+    Pores = newpores;
+  }
+  Pores[Npores].parent = Npores;
+  Pores[Npores].d[0] = Pores[Npores].d[1] = Pores[Npores].d[2] = 0;
+  Pores[Npores].c[0] = (int)(n / ((size_t)Ysize * Zsize));
+  Pores[Npores].c[1] = (int)((n / Zsize) % Ysize);
+  Pores[Npores].c[2] = (int)(n % Zsize);
+  Pores[Npores].r2 = r2;
+
+  return (Npores++);
+}
+
+/***
+ *	cmpthroat
+ *
+ *	Order throats by their pores and then their vectors,
+ *	for qsort
+ *
+ * 	Arguments:	pointers to the two throats
+ * 	Returns:	int less than, equal to or greater than 0
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int cmpthroat(const void *p1, const void *p2) {
+  int a;
+  const Throat *t1 = (const Throat *)p1, *t2 = (const Throat *)p2;
+
+  if (t1->a != t2->a)
+    return ((t1->a < t2->a) ? -1 : 1);
+  if (t1->b != t2->b)
+    return ((t1->b < t2->b) ? -1 : 1);
+  for (a = 0; a < 3; a++) {
+    if (t1->v[a] != t2->v[a])
+      return ((t1->v[a] < t2->v[a]) ? -1 : 1);
+  }
+
+  return (0);
+}
+
+/***
+ *	throatcond
+ *
+ *	Hydraulic conductance between the centers of the two
+ *	pores of a throat, for unit viscosity: a tube of the
+ *	radius of each pore over that radius, and of the radius
+ *	of the throat over the rest of the way, in series, each
+ *	carrying Poiseuille flow.  Pores closer than the sum of
+ *	their radii share the distance in proportion to them.
+ *
+ * 	Arguments:	Throat pointer
+ * 				double radii of its two pores (voxels)
+ * 	Returns:	double conductance (voxel^3)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+double throatcond(Throat *t, double r1, double r2) {
+  double len, l1, l2, lt, rt;
+
+  len = sqrt((double)(t->v[0] * t->v[0] + t->v[1] * t->v[1] +
+                      t->v[2] * t->v[2]));
+  rt = sqrt((double)t->r2) - 0.5;
+  lt = len - r1 - r2;
+  if (lt > 0.0) {
+    l1 = r1;
+    l2 = r2;
+  } else {
+    lt = 0.0;
+    l1 = len * r1 / (r1 + r2);
+    l2 = len * r2 / (r1 + r2);
+  }
+
+  return (PI / 8.0 /
+          (l1 / pow(r1, 4.0) + lt / pow(rt, 4.0) + l2 / pow(r2, 4.0)));
+}
+
+/***
+ *	flowsolve
+ *
+ *	Flow through the network under a unit pressure gradient
+ *	along one axis.  The pressure at each pore is minus its
+ *	position along the axis plus a periodic part, which
+ *	makes the flow into every pore add up to zero; that is
+ *	solved for by conjugate gradients with the diagonal as
+ *	preconditioner.  The flux is the sum over the throats
+ *	of the flow times the vector along the axis, over the
+ *	volume of the system.
+ *
+ * 	Arguments:	int number of pores and of throats
+ * 				Throat pointer to the throats
+ * 				double pointer to their conductances
+ * 				int axis (0, 1, 2 for x, y, z)
+ * 				int pointer to the number of steps taken,
+ * 					-1 if out of memory
+ * 	Returns:	double permeability (voxel^2)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+double flowsolve(int np, int nt, Throat *th, double *g, int axis,
+                 int *iters) {
+  int i, p, it, maxit;
+  double *phi, *r, *z, *h, *ah, *diag, c, rz, rzlast, hah, lambda, rr, bb;
+  double flux;
+
+  phi = (double *)calloc(6 * (size_t)np, sizeof(double));
+  if (!phi) {
+    *iters = -1;
+    return (0.0);
+  }
+  r = phi + np;
+  z = r + np;
+  h = z + np;
+  ah = h + np;
+  diag = ah + np;
+
+  for (i = 0; i < nt; i++) {
+    if (th[i].a == th[i].b)
+      continue;
+    c = g[i] * th[i].v[axis];
+    r[th[i].a] -= c;
+    r[th[i].b] += c;
+    diag[th[i].a] += g[i];
+    diag[th[i].b] += g[i];
+  }
+
+  bb = rz = 0.0;
+  for (p = 0; p < np; p++) {
+    bb += r[p] * r[p];
+    z[p] = (diag[p] > 0.0) ? r[p] / diag[p] : 0.0;
+    h[p] = z[p];
+    rz += r[p] * z[p];
+  }
+
+  maxit = 2 * np + 100;
+  rr = bb;
+  for (it = 0; it < maxit && rr > 1.0e-24 * bb; it++) {
+    for (p = 0; p < np; p++) {
+      ah[p] = diag[p] * h[p];
+    }
+    for (i = 0; i < nt; i++) {
+      if (th[i].a != th[i].b) {
+        ah[th[i].a] -= g[i] * h[th[i].b];
+        ah[th[i].b] -= g[i] * h[th[i].a];
+      }
+    }
+    hah = 0.0;
+    for (p = 0; p < np; p++) {
+      hah += h[p] * ah[p];
+    }
+    if (hah <= 0.0)
+      break;
+    lambda = rz / hah;
+    rr = rzlast = 0.0;
+    for (p = 0; p < np; p++) {
+      phi[p] += lambda * h[p];
+      r[p] -= lambda * ah[p];
+      rr += r[p] * r[p];
+      z[p] = (diag[p] > 0.0) ? r[p] / diag[p] : 0.0;
+      rzlast += r[p] * z[p];
+    }
+    c = rzlast / rz;
+    rz = rzlast;
+    for (p = 0; p < np; p++) {
+      h[p] = z[p] + c * h[p];
+    }
+  }
+  *iters = it;
+
+  flux = 0.0;
+  for (i = 0; i < nt; i++) {
+    flux += g[i] * (phi[th[i].a] - phi[th[i].b] + th[i].v[axis]) *
+            th[i].v[axis];
+  }
+  free(phi);
+
+  return (flux / ((double)Xsize * Ysize * Zsize));
+}
+
+/***
+ *	readids
+ *
+ *	Mark the phase ids in a comma-separated list
+ *
+ * 	Arguments:	char pointer to the list
+ * 				unsigned char pointer to CENSUSIDS flags
+ * 	Returns:	0 if okay, 1 if an id is not a phase id
+ *
+ *	Calls:		no routines
+ *	Called by:	checkargs
+ ***/
+int readids(char *list, unsigned char *isin) {
+  int id;
+  char *p, *end;
+
+  memset(isin, 0, CENSUSIDS);
+  p = list;
+  while (*p) {
+    id = (int)strtol(p, &end, 10);
+    if (end == p || id < 0 || id >= CENSUSIDS)
+      return (1);
+    isin[id] = 1;
+    p = end;
+    if (*p == ',')
+      p++;
+    else if (*p)
+      return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	checkargs
+ *
+ *	Read the command line
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		readids
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index, havephase;
+
+  static struct option long_opts[] = {{"phases", required_argument, 0, 'p'},
+                                      {"output", required_argument, 0, 'o'},
+                                      {"network", required_argument, 0, 'n'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  havephase = 0;
+  Outname[0] = Netname[0] = '\0';
+
+  while ((opt_char = getopt_long(argc, argv, "p:o:n:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -p or --phases */
+    case (int)('p'):
+      if (readids(optarg, Inphase))
+        return (1);
+      havephase = 1;
+      break;
+    /* -o or --output */
+    case (int)('o'):
+      snprintf(Outname, sizeof(Outname), "%s", optarg);
+      break;
+    /* -n or --network */
+    case (int)('n'):
+      snprintf(Netname, sizeof(Netname), "%s", optarg);
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (!havephase || optind != argc - 1 || (!Outname[0] && !Netname[0]))
+    return (1);
+
+  snprintf(Imgname, sizeof(Imgname), "%s", argv[optind]);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ *	Arguments:	none
+ *	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: pnm3d -p,--phases <ids> [-o,--output <file>]\n");
+  fprintf(stderr, "             [-n,--network <file>] <image>\n\n");
+  fprintf(stderr, "  --phases   comma-separated phase ids taken as the pore "
+                  "space\n");
+  fprintf(stderr, "  --output   write the network statistics and "
+                  "permeability\n");
+  fprintf(stderr, "  --network  write the pores and throats of the "
+                  "network\n\n");
+  fprintf(stderr, "For example, the capillary pores and cracks of a "
+                  "paste:\n");
+  fprintf(stderr, "  pnm3d -p 0,56 -o paste.pnm -n paste.net paste.img\n\n");
+
+  return;
+}
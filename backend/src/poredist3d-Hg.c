@@ -30,8 +30,9 @@
 #define EXIT 1
 #define READMIC EXIT + 1
 #define MEASURE READMIC + 1
+#define INTRUDE MEASURE + 1
 
-#define NUMSEL MEASURE
+#define NUMSEL INTRUDE
 
 /***
  *	Global variable declarations
@@ -77,6 +78,7 @@ int Verbose = 0;
 void checkargs(int argc, char *argv[]);
 int maketemp(int size, int *xsph, int *ysph, int *zsph);
 int poredist(char *filename);
+int intrude(char *filename);
 int xyz2pix(int xpos, int ypos, int zpos);
 int pix2x(int pid);
 int pix2y(int pid);
@@ -107,6 +109,8 @@ int main(int argc, char *argv[]) {
     printf("%d) Exit program \n", EXIT);
     printf("%d) Read in microstructure from file \n", READMIC);
     printf("%d) Measure poresize distribution \n", MEASURE);
+    printf("%d) Measure poresize distribution from the distance map \n",
+           INTRUDE);
     read_string(instring, sizeof(instring));
     menuch = atoi(instring);
     printf("%d \n", menuch);
@@ -118,6 +122,9 @@ int main(int argc, char *argv[]) {
     case MEASURE:
       status = poredist(filename);
       break;
+    case INTRUDE:
+      status = intrude(filename);
+      break;
     default:
       break;
     }
@@ -620,6 +627,149 @@ int poredist(char *filename) {
   return (0);
 }
 
+/***
+ *	intrude
+ *
+ *	Routine to simulate mercury intrusion from the distance map.
+ *	The largest sphere of pore voxels at every center is found once
+ *	from the distance to the solid, the radius at which mercury
+ *	coming in through the face z = 0 first reaches each center by
+ *	one flood fill from that face, largest radius first, and the
+ *	volume intruded at each radius from the spheres at those radii
+ *	(see poreradii, poreintrude and sphcover in the library).  The
+ *	output is that of poredist, without rescanning the image at
+ *	every radius.
+ *
+ * 	Arguments:	Filename root for data output
+ * 	Returns:	status
+ *
+ *	Calls:		poreradii, poreintrude, sphcover
+ *	Called by:	main program
+ ***/
+int intrude(char *filename) {
+  int i, ix, iy, iz, *nrad, *ndiam, *rad, porecnt, naccessible;
+  int max_allowed_rad, mindim, diam;
+  size_t n;
+  unsigned char *pore;
+  FILE *outfile;
+
+  /* Mark the pore voxels, x varying fastest */
+
+  pore = (unsigned char *)malloc((size_t)Syspix);
+  rad = (int *)malloc((size_t)Syspix * sizeof(int));
+  if (!pore || !rad) {
+    warning("poredist3d", "Could not allocate required memory for pore "
+                          "image");
+    free(pore);
+    free(rad);
+    return (1);
+  }
+
+  porecnt = 0;
+  n = 0;
+  for (iz = 0; iz < Zsyssize; iz++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      for (ix = 0; ix < Xsyssize; ix++) {
+        if (Mic[ix][iy][iz] == POROSITY || Mic[ix][iy][iz] == EMPTYP ||
+            Mic[ix][iy][iz] == EMPTYDP || Mic[ix][iy][iz] == CRACKP) {
+          pore[n] = 1;
+          porecnt++;
+        } else {
+          pore[n] = 0;
+        }
+        n++;
+      }
+    }
+  }
+
+  mindim = Xsyssize;
+  if (Ysyssize < mindim)
+    mindim = Ysyssize;
+  if (Zsyssize < mindim)
+    mindim = Zsyssize;
+
+  max_allowed_rad = (int)(0.1 * mindim);
+
+  if (Verbose) {
+    printf("\nScanned microstructure:  total pore count = %d", porecnt);
+    printf("\nMaximum probed pore radius will be %d", max_allowed_rad);
+    fflush(stdout);
+  }
+
+  nrad = ivector(max_allowed_rad + 1);
+  ndiam = ivector(2 * max_allowed_rad + 2);
+  if (!nrad || !ndiam) {
+    warning("poredist3d", "Could not allocate required memory");
+    if (nrad)
+      free_ivector(nrad);
+    if (ndiam)
+      free_ivector(ndiam);
+    free(pore);
+    free(rad);
+    return (1);
+  }
+
+  if (poreradii(pore, Xsyssize, Ysyssize, Zsyssize, max_allowed_rad, rad) ||
+      poreintrude(rad, Xsyssize, Ysyssize, Zsyssize, max_allowed_rad) ||
+      sphcover(rad, Xsyssize, Ysyssize, Zsyssize, max_allowed_rad, ndiam)) {
+    warning("poredist3d", "Could not allocate required memory");
+    free_ivector(ndiam);
+    free_ivector(nrad);
+    free(pore);
+    free(rad);
+    return (1);
+  }
+  free(pore);
+  free(rad);
+
+  naccessible = 0;
+  for (i = 0; i <= max_allowed_rad; i++) {
+    nrad[i] = ndiam[2 * i + 1];
+    naccessible += nrad[i];
+  }
+  free_ivector(ndiam);
+
+  if (Verbose) {
+    printf("\nDone with scan.");
+    fflush(stdout);
+  }
+
+  strcat(filename, ".poredist");
+  outfile = filehandler("poredist3d", filename, "WRITE");
+  if (!outfile) {
+    warning("poredist3d", "Could not open output file");
+    fflush(stdout);
+    free_ivector(nrad);
+    return (1);
+  }
+
+  fprintf(outfile, "Total pore volume = %f um^3", ((float)porecnt));
+  fprintf(outfile, "\nAccessible pore volume = %f um^3", ((float)naccessible));
+  fprintf(outfile, "\n\nDiameter_(um)\tNumber\tFraction");
+  if (Verbose) {
+    printf("\n\nTotal pore volume = %f um^3", ((float)porecnt));
+    printf("\nAccessible pore volume = %f um^3", ((float)naccessible));
+    printf("\n\nDiameter_(um)\tNumber\tFraction");
+    fflush(stdout);
+  }
+  for (i = 0; i <= max_allowed_rad; i++) {
+    diam = 2 * i + 1;
+    fprintf(outfile, "\n%f\t%d\t%f", ((float)diam), nrad[i],
+            (((float)nrad[i]) / ((float)naccessible)));
+    if (Verbose) {
+      printf("\n%f\t%d\t%f", ((float)diam), nrad[i],
+             (((float)nrad[i]) / ((float)naccessible)));
+      fflush(stdout);
+    }
+  }
+
+  fclose(outfile);
+
+  free_ivector(nrad);
+
+  return (0);
+}
+
 /***
  *	readmic
  *
@@ -640,7 +790,7 @@ void readmic(char *filen) {
   FILE *infile;
 
   printf("Enter name of file to read in \n");
-  read_string(filen, sizeof(filen));
+  read_string(filen, MAXSTRING);
   infile = filehandler("poredist3d", filen, "READ");
   if (!infile) {
     exit(1);
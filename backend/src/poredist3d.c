@@ -72,17 +72,18 @@ float Version;
 /* Verbose output flag */
 int Verbose = 0;
 
+/***
+ *	Result cache (--cache dir; see rescache.c), which keeps the
+ *	distribution of each pore space measured
+ ***/
+char Cachedir[MAXSTRING];
+
 /***
  *	Function declarations
  ***/
 
 void checkargs(int argc, char *argv[]);
-int maketemp(int size, int *xsph, int *ysph, int *zsph);
 int poredist(void);
-int xyz2pix(int xpos, int ypos, int zpos);
-int pix2x(int pid);
-int pix2y(int pid);
-int pix2z(int pid);
 void readmic(void);
 
 int main(int argc, char *argv[]) {
@@ -128,130 +129,6 @@ int main(int argc, char *argv[]) {
   return (0);
 }
 
-/***
- *	maketemp
- *
- *	Routine to create a template for the sphere of
- *	interest of radius size to be used in
- *	curvature evaluation
- *
- * 	Arguments:	int size (the radius of the sphere)
- * 	            int pointer to xsph vector
- * 	            int pointer to ysph vector
- * 	            int pointer to zsph vector
- * 	Returns:	int number of pixels in sphere
- *
- *	Calls:		no other routines
- *	Called by:	runsint
- ***/
-int maketemp(int size, int *xsph, int *ysph, int *zsph) {
-  int icirc, xval, yval, zval;
-  float xtmp, ytmp, dist;
-
-  /***
-   *	Determine and store the locations of all
-   *	pixels in the 3-D sphere
-   ***/
-
-  icirc = 0;
-  for (xval = (-size); xval <= size; xval++) {
-
-    xtmp = (float)(xval * xval);
-    for (yval = (-size); yval <= size; yval++) {
-
-      ytmp = (float)(yval * yval);
-      for (zval = (-size); zval <= size; zval++) {
-
-        dist = sqrt(xtmp + ytmp + (float)(zval * zval));
-
-        if (dist <= ((float)size + 0.5)) {
-
-          xsph[icirc] = xval;
-          ysph[icirc] = yval;
-          zsph[icirc] = zval;
-          icirc++;
-        }
-      }
-    }
-  }
-
-  /***
-   *	Return the number of pixels contained in
-   *	sphere of radius (size+0.5)
-   ***/
-
-  return (icirc);
-}
-
-/***
- *	xyz2pix
- *
- *	Convert x,y,z coordinates to pixel number
- *
- * 	Arguments:	int xpos, int ypos, int zpos coordinates
- * 	Returns:	int pixel id number
- *
- *	Calls:		no other routines
- *	Called by:	readmic
- ***/
-int xyz2pix(int xpos, int ypos, int zpos) {
-  int ns = (Xsyssize * Ysyssize * zpos) + (Xsyssize * ypos) + xpos;
-  return (ns);
-}
-
-/***
- *	pix2x
- *
- *	Convert pixel id number to x coordinate
- *
- * 	Arguments:	int pixel id number
- * 	Returns:	int x coordinate
- *
- *	Calls:		no other routines
- *	Called by:	readmic
- ***/
-int pix2x(int pid) {
-  int x, y, z;
-  z = pid / (Xsyssize * Ysyssize);
-  y = (pid - (z * Xsyssize * Ysyssize)) / Xsyssize;
-  x = (pid - (z * Xsyssize * Ysyssize) - (y * Xsyssize));
-  return (x);
-}
-
-/***
- *	pix2y
- *
- *	Convert pixel id number to y coordinate
- *
- * 	Arguments:	int pixel id number
- * 	Returns:	int x coordinate
- *
- *	Calls:		no other routines
- *	Called by:	readmic
- ***/
-int pix2y(int pid) {
-  int y, z;
-  z = pid / (Xsyssize * Ysyssize);
-  y = (pid - (z * Xsyssize * Ysyssize)) / Xsyssize;
-  return (y);
-}
-
-/***
- *	pix2z
- *
- *	Convert pixel id number to z coordinate
- *
- * 	Arguments:	int pixel id number
- * 	Returns:	int x coordinate
- *
- *	Calls:		no other routines
- *	Called by:	readmic
- ***/
-int pix2z(int pid) {
-  int z = pid / (Xsyssize * Ysyssize);
-  return (z);
-}
-
 /***
  *   poredist
  *
@@ -265,39 +142,34 @@ int pix2z(int pid) {
  *	Called by:	main program
  ***/
 int poredist(void) {
-  int i, *pores, *ndiam, porecnt, index, ns, maxsph, nsph;
-  int ix, iy, iz, max_allowed_diam, mindim, nd, failed, nrad;
-  int xc, yc, zc;
-  int ***tmic;
-  int *xsph, *ysph, *zsph;
-  FILE *outfile;
-
-  /* Allocate memory for temporary microstructure image */
-
-  pores = NULL;
-  ndiam = NULL;
-  tmic = NULL;
-  xsph = NULL;
-  ysph = NULL;
-  zsph = NULL;
-  tmic = ibox(Xsyssize + 1, Ysyssize + 1, Zsyssize + 1);
-  if (!tmic) {
-    warning("poredist3d", "Could not allocate required memory for temporary "
-                          "microstructure image");
+  int i, ix, iy, iz, *ndiam, porecnt, max_allowed_diam, mindim, cached;
+  size_t n;
+  unsigned char *pore;
+  FILE *outfile, *cfp;
+  Rescache rc;
+
+  /* Mark the pore voxels, x varying fastest */
+
+  pore = (unsigned char *)malloc((size_t)Syspix);
+  if (!pore) {
+    warning("poredist3d", "Could not allocate required memory for pore "
+                          "image");
     return (1);
   }
 
   porecnt = 0;
+  n = 0;
   for (iz = 0; iz < Zsyssize; iz++) {
     for (iy = 0; iy < Ysyssize; iy++) {
       for (ix = 0; ix < Xsyssize; ix++) {
         if (Mic[ix][iy][iz] == POROSITY || Mic[ix][iy][iz] == EMPTYP ||
             Mic[ix][iy][iz] == EMPTYDP || Mic[ix][iy][iz] == CRACKP) {
-          tmic[ix][iy][iz] = POROSITY;
+          pore[n] = 1;
           porecnt++;
         } else {
-          tmic[ix][iy][iz] = 10000;
+          pore[n] = 0;
         }
+        n++;
       }
     }
   }
@@ -325,149 +197,64 @@ int poredist(void) {
     fflush(stdout);
   }
 
+  /* Ensure that diameter is odd */
+  if (max_allowed_diam % 2 == 0)
+    max_allowed_diam++;
+
   /* Allocate memory for ndiam vector */
   ndiam = ivector(max_allowed_diam + 1);
   if (!ndiam) {
     warning("poredist3d", "Could not allocate required memory");
-    free_ibox(tmic, Xsyssize + 1, Ysyssize + 1);
+    free(pore);
     return (1);
   }
 
-  /* Ensure that diameter is odd */
-  if (max_allowed_diam % 2 == 0)
-    max_allowed_diam++;
-  maxsph = diam2vol((float)max_allowed_diam);
+  /***
+   *	The distribution depends only on the pore voxels and the
+   *	largest diameter, so with --cache it is looked for under a
+   *	key made from those before scanning
+   ***/
 
-  if (Verbose) {
-    printf("\nMaximum number allowed template elements will be %d", maxsph);
-    fflush(stdout);
+  rescache_init(&rc, Cachedir, "poredist3d");
+  rescache_add(&rc, &Xsyssize, sizeof(int));
+  rescache_add(&rc, &Ysyssize, sizeof(int));
+  rescache_add(&rc, &Zsyssize, sizeof(int));
+  rescache_add(&rc, &max_allowed_diam, sizeof(int));
+  rescache_add(&rc, pore, (size_t)Syspix);
+  n = (size_t)max_allowed_diam + 1;
+  cached = 0;
+  if ((cfp = rescache_open(&rc))) {
+    cached = (fread(ndiam, sizeof(int), n, cfp) == n);
+    fclose(cfp);
   }
 
-  /* Allocate memory for xsph,ysph, and zsph vectors */
-  xsph = ivector(maxsph);
-  if (!xsph) {
-    warning("poredist3d", "Could not allocate required memory");
-    free_ivector(ndiam);
-    free_ibox(tmic, Xsyssize + 1, Ysyssize + 1);
-    return (1);
-  }
-  ysph = ivector(maxsph);
-  if (!ysph) {
-    warning("poredist3d", "Could not allocate required memory");
-    free_ivector(xsph);
-    free_ivector(ndiam);
-    free_ibox(tmic, Xsyssize + 1, Ysyssize + 1);
-    return (1);
-  }
-  zsph = ivector(maxsph);
-  if (!zsph) {
-    warning("poredist3d", "Could not allocate required memory");
-    free_ivector(ysph);
-    free_ivector(xsph);
-    free_ivector(ndiam);
-    free_ibox(tmic, Xsyssize + 1, Ysyssize + 1);
-    return (1);
-  }
+  /***
+   *	Give every pore voxel the diameter of the largest sphere of
+   *	pore voxels that covers it (see poresizes in the library)
+   ***/
 
-  if (Verbose) {
-    printf("\nDone allocating xsph, ysph, and zsph vectors");
+  if (Verbose && cached) {
+    printf("\nPore distribution taken from the cache in %s", Cachedir);
+    fflush(stdout);
+  } else if (Verbose) {
+    printf("\nStarting pore distribution scan...");
     fflush(stdout);
   }
 
-  /* Allocate memory for porosity locator vector */
-
-  pores = ivector(porecnt);
-  if (!pores) {
+  if (!cached &&
+      poresizes(pore, Xsyssize, Ysyssize, Zsyssize, max_allowed_diam, ndiam)) {
     warning("poredist3d", "Could not allocate required memory");
-    fflush(stdout);
-    free_ivector(zsph);
-    free_ivector(ysph);
-    free_ivector(xsph);
     free_ivector(ndiam);
-    free_ibox(tmic, Xsyssize + 1, Ysyssize + 1);
+    free(pore);
     return (1);
   }
+  free(pore);
 
-  /* Load up the locator vector */
-
-  index = 0;
-  ns = 0;
-  for (iz = 0; iz < Zsyssize && index < porecnt; iz++) {
-    for (iy = 0; iy < Ysyssize && index < porecnt; iy++) {
-      for (ix = 0; ix < Xsyssize && index < porecnt; ix++) {
-        if (Mic[ix][iy][iz] == POROSITY || Mic[ix][iy][iz] == EMPTYP ||
-            Mic[ix][iy][iz] == EMPTYDP || Mic[ix][iy][iz] == CRACKP) {
-          pores[index] = ns;
-          index++;
-        }
-        ns++;
-      }
-    }
-  }
-
-  if (Verbose) {
-    printf("\nIndex = %d", index);
-    fflush(stdout);
-  }
-
-  /* Initialize the ndiam vector */
-
-  for (i = 0; i <= max_allowed_diam; i++)
-    ndiam[i] = 0;
-
-  /* Start with largest allowed pore diameter */
-
-  if (Verbose) {
-    printf("\nStarting pore distribution scan...");
-    fflush(stdout);
+  if (!cached && (cfp = rescache_create(&rc))) {
+    rescache_commit(&rc, cfp, fwrite(ndiam, sizeof(int), n, cfp) != n);
   }
 
-  for (nd = max_allowed_diam; nd >= 1; nd -= 2) {
-
-    nrad = nd / 2;
-    nsph = maketemp(nrad, xsph, ysph, zsph);
-    if (Verbose) {
-      printf("\n\tDiam = %d, Nsph = %d", nd, nsph);
-      fflush(stdout);
-    }
-
-    /* Check all pore pixels in the 3-D system */
-
-    for (index = 0; index < porecnt; index++) {
-      xc = pix2x(pores[index]);
-      yc = pix2y(pores[index]);
-      zc = pix2z(pores[index]);
-      if (tmic[xc][yc][zc] == POROSITY) {
-        failed = 0;
-        for (i = 0; (i < nsph) && (!failed); i++) {
-          ix = xc + xsph[i];
-          iy = yc + ysph[i];
-          iz = zc + zsph[i];
-          ix += checkbc(ix, Xsyssize);
-          iy += checkbc(iy, Ysyssize);
-          iz += checkbc(iz, Zsyssize);
-          if (tmic[ix][iy][iz] > max_allowed_diam)
-            failed = 1;
-        }
-        if (!failed) {
-          for (i = 0; i < nsph; i++) {
-            ix = xc + xsph[i];
-            iy = yc + ysph[i];
-            iz = zc + zsph[i];
-            ix += checkbc(ix, Xsyssize);
-            iy += checkbc(iy, Ysyssize);
-            iz += checkbc(iz, Zsyssize);
-            if (tmic[ix][iy][iz] < nd) {
-              tmic[ix][iy][iz] = nd;
-              ndiam[nd]++;
-            }
-          }
-        }
-      }
-    }
-  }
-
-  if (Verbose) {
+  if (Verbose && !cached) {
     printf("\nDone with scan.");
     fflush(stdout);
   }
@@ -477,11 +264,7 @@ int poredist(void) {
   if (!outfile) {
     warning("poredist3d", "Could not open output file");
     fflush(stdout);
-    free_ivector(zsph);
-    free_ivector(ysph);
-    free_ivector(xsph);
     free_ivector(ndiam);
-    free_ibox(tmic, Xsyssize + 1, Ysyssize + 1);
     return (1);
   }
 
@@ -504,12 +287,7 @@ int poredist(void) {
 
   fclose(outfile);
 
-  free_ivector(pores);
-  free_ivector(zsph);
-  free_ivector(ysph);
-  free_ivector(xsph);
   free_ivector(ndiam);
-  free_ibox(tmic, Xsyssize + 1, Ysyssize + 1);
 
   return (0);
 }
@@ -529,8 +307,8 @@ int poredist(void) {
  ***/
 void readmic(void) {
   register int i1, i2, i3;
-  int iout, oiout;
-  char instring[MAXSTRING];
+  size_t n, cap = 0;
+  unsigned char *vox = NULL;
   FILE *infile;
 
   printf("Enter name of file to read in \n");
@@ -541,15 +319,18 @@ void readmic(void) {
   }
 
   /***
-   *	Determine whether system size and resolution
-   *	are specified in the image file
+   *	Read the header and the voxels of the image
    ***/
 
-  if (read_imgheader(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize, &Res)) {
+  if (load_microstructure(infile, &vox, &cap, &Version, &Xsyssize, &Ysyssize,
+                          &Zsyssize, &Res)) {
     fclose(infile);
-    bailout("poredist3d", "Error reading image header");
+    if (vox)
+      free(vox);
+    bailout("poredist3d", "Error reading microstructure image");
     exit(1);
   }
+  fclose(infile);
 
   if (Verbose) {
     printf("\nXsyssize is %d", Xsyssize);
@@ -577,27 +358,27 @@ void readmic(void) {
   Mic = ibox(Xsyssize + 1, Ysyssize + 1, Zsyssize + 1);
 
   if (!Mic) {
+    free(vox);
     bailout("poredist3d", "Memory allocation failure");
     fflush(stdout);
     exit(1);
   }
 
   /***
-   *	Read the microstructure file
+   *	Copy the voxels into Mic, keeping the order in which
+   *	this program has always read them (x varies fastest)
    ***/
 
+  n = 0;
   for (i3 = 0; i3 < Zsyssize; i3++) {
     for (i2 = 0; i2 < Ysyssize; i2++) {
       for (i1 = 0; i1 < Xsyssize; i1++) {
-        fscanf(infile, "%s", instring);
-        oiout = atoi(instring);
-        iout = convert_id(oiout, Version);
-        Mic[i1][i2][i3] = iout;
+        Mic[i1][i2][i3] = vox[n++];
       }
     }
   }
 
-  fclose(infile);
+  free(vox);
 
   return;
 }
@@ -605,7 +386,9 @@ void readmic(void) {
 /***
  *   checkargs
  *
- * 	Checks command-line arguments
+ * 	Checks command-line arguments: -v or --verbose, and --cache dir
+ * 	to keep the distributions measured in dir and take them from
+ * 	there when the same pore space comes again
  *
  * 	Arguments:	int argc, char *argv[]
  * 	Returns:	nothing
@@ -619,8 +402,12 @@ void checkargs(int argc, char *argv[]) {
   /* Is verbose output requested? */
 
   Verbose = 0;
+  strcpy(Cachedir, "");
   for (i = 1; i < argc; i++) {
-    if ((!strcmp(argv[i], "-v")) || (!strcmp(argv[i], "--verbose")))
+    if ((!strcmp(argv[i], "-v")) || (!strcmp(argv[i], "--verbose"))) {
       Verbose = 1;
+    } else if (!strcmp(argv[i], "--cache") && (i + 1 < argc)) {
+      strcpy(Cachedir, argv[++i]);
+    }
   }
 }
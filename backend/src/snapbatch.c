@@ -0,0 +1,610 @@
+/******************************************************
+ *
+ * Program snapbatch
+ *
+ * Analyses of every microstructure image of a hydration
+ * run, in one job.  The images are those listed in the
+ * image index that disrealnew writes (image_index.txt),
+ * as ASCII or binary image files or as images in a series
+ * (name#k, see disrealnew --series), or all the images of
+ * one series.  Each image is read once, and every analysis
+ * asked for is done on it in memory:
+ *
+ *	stat       voxels and pore surface of each phase, as
+ *	           stat3d (phase_census)
+ *	perc       percolation of the pores and of the solids
+ *	           in each direction, as perc3d (perc_label)
+ *	poredist   pore size distribution, as poredist3d and
+ *	           calcporedist3d (poresizes)
+ *
+ * With --threads the images are shared out among OpenMP
+ * threads, each taking a run of consecutive images so that
+ * the images of a series are read from one keyframe
+ * forward.  The results are kept until every image is
+ * done and written in the order of the index, one CSV
+ * table per analysis, with the time of each image.
+ *
+ * elastic and transport are not run: they take a particle
+ * image and parameters of their own, and solve for long
+ * enough on one image that they are better run on their
+ * own with their own --threads.
+ ******************************************************/
+#include "include/vcctl.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define DOSTAT 1
+#define DOPERC 2
+#define DOPOREDIST 4
+
+/***
+ *	What is found for one image
+ *
+ *		name:     image, as in the index
+ *		time:     time of the image (h)
+ *		status:   0 if the image was read and analyzed
+ *		x, y, zsize, res: size and resolution of the image
+ *		count:    voxels of each phase id
+ *		face:     faces of each phase id shared with a pore
+ *		perc:     percolation of the pores [0] and solids [1]
+ *		npore:    pore voxels
+ *		maxdiam:  largest pore diameter counted (pixels)
+ *		ndiam:    pore voxels of each diameter, 0 to maxdiam
+ ***/
+typedef struct {
+  char name[MAXSTRING];
+  float time;
+  int status;
+  int xsize, ysize, zsize;
+  float res;
+  int count[NPHASES], face[NPHASES];
+  Percstats perc[2];
+  int npore, maxdiam;
+  int *ndiam;
+} Snapresult;
+
+/***
+ *	Images read by one thread: its buffer for image files and
+ *	the series it has open
+ ***/
+typedef struct {
+  unsigned char *vox;
+  size_t cap;
+  unsigned char *scratch;
+  size_t scap;
+  Series sr;
+  char srname[MAXSTRING];
+} Snapreader;
+
+/***
+ *	Global variables
+ ***/
+int Analyses = DOSTAT | DOPERC | DOPOREDIST;
+int Nthreads = 1;
+char Indexname[MAXSTRING], Seriesname[MAXSTRING], Prefix[MAXSTRING];
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
+int readindex(char *name, Snapresult **res);
+int readseries(char *name, Snapresult **res);
+unsigned char *snapimage(Snapreader *rd, Snapresult *sr);
+int analyze(Snapreader *rd, Snapresult *sr);
+int writeresults(Snapresult *res, int nimg);
+
+int main(int argc, char *argv[]) {
+  int i, nimg, nerr, t, nt, lo, hi;
+  Snapresult *res = NULL;
+  Snapreader rd;
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    return (1);
+  }
+
+  nimg = Indexname[0] ? readindex(Indexname, &res)
+                      : readseries(Seriesname, &res);
+  if (nimg < 0)
+    return (1);
+  if (nimg == 0) {
+    bailout("snapbatch", "No images to analyze");
+    return (1);
+  }
+
+  nerr = 0;
+
+#pragma omp parallel num_threads(Nthreads) private(i, t, nt, lo, hi, rd)      \
+    reduction(+ : nerr)
+  {
+    t = 0;
+    nt = 1;
+#ifdef _OPENMP
+    t = omp_get_thread_num();
+    nt = omp_get_num_threads();
+#endif
+    memset(&rd, 0, sizeof(Snapreader));
+    lo = (int)(((long)nimg * t) / nt);
+    hi = (int)(((long)nimg * (t + 1)) / nt);
+    for (i = lo; i < hi; i++) {
+      nerr += analyze(&rd, &res[i]);
+    }
+    series_close(&rd.sr);
+    if (rd.vox)
+      free(rd.vox);
+    if (rd.scratch)
+      free(rd.scratch);
+  }
+
+  nerr += writeresults(res, nimg);
+
+  for (i = 0; i < nimg; i++) {
+    if (res[i].ndiam)
+      free_ivector(res[i].ndiam);
+  }
+  free(res);
+
+  return (nerr ? 1 : 0);
+}
+
+/***
+ *	checkargs
+ *
+ *	Checks the command line arguments
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+  char *tok;
+
+  static struct option long_opts[] = {{"index", required_argument, 0, 'i'},
+                                      {"series", required_argument, 0, 's'},
+                                      {"analyses", required_argument, 0, 'a'},
+                                      {"output", required_argument, 0, 'o'},
+                                      {"threads", required_argument, 0, 't'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  Indexname[0] = Seriesname[0] = '\0';
+  snprintf(Prefix, sizeof(Prefix), "snapbatch");
+  Nthreads = thread_default(Nthreads);
+
+  while ((opt_char = getopt_long(argc, argv, "i:s:a:o:t:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -i or --index */
+    case (int)('i'):
+      snprintf(Indexname, sizeof(Indexname), "%s", optarg);
+      break;
+    /* -s or --series */
+    case (int)('s'):
+      snprintf(Seriesname, sizeof(Seriesname), "%s", optarg);
+      break;
+    /* -a or --analyses */
+    case (int)('a'):
+      Analyses = 0;
+      for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+        if (!strcmp(tok, "stat")) {
+          Analyses |= DOSTAT;
+        } else if (!strcmp(tok, "perc")) {
+          Analyses |= DOPERC;
+        } else if (!strcmp(tok, "poredist")) {
+          Analyses |= DOPOREDIST;
+        } else {
+          return (1);
+        }
+      }
+      break;
+    /* -o or --output */
+    case (int)('o'):
+      snprintf(Prefix, sizeof(Prefix), "%s", optarg);
+      break;
+    /* -t or --threads */
+    case (int)('t'):
+      Nthreads = atoi(optarg);
+      if (Nthreads < 1)
+        Nthreads = 1;
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if ((Indexname[0] != '\0') == (Seriesname[0] != '\0') || !Analyses ||
+      optind < argc)
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUSAGE:  snapbatch -i,--index <image_index> | "
+                  "-s,--series <file>\n");
+  fprintf(stderr, "          [-a,--analyses <list>] [-o,--output <prefix>] "
+                  "[-t,--threads <n>]\n\n");
+  fprintf(stderr, "Analyzes every image of an image index written by "
+                  "disrealnew, or of\n");
+  fprintf(stderr, "a series, reading each image once.\n\n");
+  fprintf(stderr, "  --analyses  comma-separated list of stat, perc and "
+                  "poredist\n");
+  fprintf(stderr, "              (default all three)\n");
+  fprintf(stderr, "  --output    prefix of the tables written, "
+                  "prefix_stat.csv,\n");
+  fprintf(stderr, "              prefix_perc.csv and prefix_poredist.csv "
+                  "(default snapbatch)\n");
+  fprintf(stderr, "  --threads   images analyzed at once (default "
+                  "VCCTL_THREADS, or 1)\n\n");
+
+  return;
+}
+
+/***
+ *	readindex
+ *
+ *	Read the images listed in an image index, one time and
+ *	name to a line
+ *
+ * 	Arguments:	char pointer to the index file name
+ * 				Snapresult pointer pointer set to a new array,
+ * 					one entry per image
+ * 	Returns:	int number of images, or -1 on an error
+ *
+ *	Calls:		filehandler
+ *	Called by:	main program
+ ***/
+int readindex(char *name, Snapresult **res) {
+  int n, cap;
+  char line[2 * MAXSTRING];
+  float time;
+  Snapresult *list, *newp;
+  FILE *fp;
+
+  fp = filehandler("snapbatch", name, "READ");
+  if (!fp)
+    return (-1);
+
+  n = cap = 0;
+  list = NULL;
+  while (fgets(line, sizeof(line), fp)) {
+    if (strlen(line) < 2)
+      continue;
+    if (n == cap) {
+      cap = cap ? 2 * cap : 64;
+      newp = (Snapresult *)realloc(list, (size_t)cap * sizeof(Snapresult));
+      if (!newp) {
+        fclose(fp);
+        free(list);
+        bailout("snapbatch", "Memory allocation failure");
+        return (-1);
+      }
+      list = newp;
+    }
+    memset(&list[n], 0, sizeof(Snapresult));
+    if (sscanf(line, "%f %s", &time, list[n].name) == 2) {
+      list[n].time = time;
+      n++;
+    }
+  }
+  fclose(fp);
+
+  *res = list;
+  return (n);
+}
+
+/***
+ *	readseries
+ *
+ *	List every image of a series, as name#k
+ *
+ * 	Arguments:	char pointer to the series file name
+ * 				Snapresult pointer pointer set to a new array,
+ * 					one entry per image
+ * 	Returns:	int number of images, or -1 on an error
+ *
+ *	Calls:		series_open, series_close
+ *	Called by:	main program
+ ***/
+int readseries(char *name, Snapresult **res) {
+  int k, n;
+  Series sr;
+  Snapresult *list;
+
+  if (series_open(name, &sr, 0)) {
+    bailout("snapbatch", "Could not read series index");
+    return (-1);
+  }
+  n = sr.mv.nframes;
+  series_close(&sr);
+
+  list = (Snapresult *)calloc((size_t)(n > 0 ? n : 1), sizeof(Snapresult));
+  if (!list) {
+    bailout("snapbatch", "Memory allocation failure");
+    return (-1);
+  }
+  for (k = 0; k < n; k++) {
+    snprintf(list[k].name, MAXSTRING, "%s#%d", name, k);
+  }
+
+  *res = list;
+  return (n);
+}
+
+/***
+ *	snapimage
+ *
+ *	Read one image, from its file or from a series.  A series
+ *	stays open, so the next image of it only needs the voxels
+ *	that changed.
+ *
+ * 	Arguments:	Snapreader pointer of the thread
+ * 				Snapresult pointer, whose name is read and whose
+ * 					sizes (and, for a series, time) are set
+ * 	Returns:	unsigned char pointer to the voxels in C order,
+ * 				held by the reader, or NULL on an error
+ *
+ *	Calls:		series_open, series_frame, load_microstructure
+ *	Called by:	analyze
+ ***/
+unsigned char *snapimage(Snapreader *rd, Snapresult *sr) {
+  int k;
+  float ver;
+  char file[MAXSTRING], *hash, *end;
+  FILE *fp;
+
+  strcpy(file, sr->name);
+  hash = strrchr(file, '#');
+  if (hash) {
+    k = (int)strtol(hash + 1, &end, 10);
+    if (end != hash + 1 && *end == '\0') {
+      *hash = '\0';
+      if (strcmp(rd->srname, file)) {
+        series_close(&rd->sr);
+        rd->srname[0] = '\0';
+        if (series_open(file, &rd->sr, 0))
+          return (NULL);
+        strcpy(rd->srname, file);
+      }
+      if (series_frame(&rd->sr, k, NULL, &sr->time))
+        return (NULL);
+      sr->xsize = rd->sr.mv.xsize;
+      sr->ysize = rd->sr.mv.ysize;
+      sr->zsize = rd->sr.zsize;
+      sr->res = rd->sr.mv.res;
+      return (rd->sr.vox);
+    }
+  }
+
+  fp = filehandler("snapbatch", file, "READ");
+  if (!fp)
+    return (NULL);
+  if (load_microstructure(fp, &rd->vox, &rd->cap, &ver, &sr->xsize,
+                          &sr->ysize, &sr->zsize, &sr->res)) {
+    fclose(fp);
+    return (NULL);
+  }
+  fclose(fp);
+
+  return (rd->vox);
+}
+
+/***
+ *	analyze
+ *
+ *	Read one image and do every analysis asked for on it
+ *
+ * 	Arguments:	Snapreader pointer of the thread
+ * 				Snapresult pointer to fill
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		snapimage, phase_census, perc_label_classes,
+ *				poresizes
+ *	Called by:	main program
+ ***/
+int analyze(Snapreader *rd, Snapresult *sr) {
+  int net, mindim;
+  size_t n, nvox;
+  unsigned char *vox, *cl, ispore[CENSUSIDS];
+  unsigned char link[PERCCLASSES][PERCCLASSES];
+  char buff[2 * MAXSTRING];
+
+  sr->status = 1;
+  vox = snapimage(rd, sr);
+  if (!vox) {
+    snprintf(buff, sizeof(buff), "Could not read image %s", sr->name);
+    warning("snapbatch", buff);
+    return (1);
+  }
+  nvox = (size_t)sr->xsize * (size_t)sr->ysize * (size_t)sr->zsize;
+
+  /* One byte per voxel of scratch, for the classes or the pore mask */
+
+  if ((Analyses & (DOPERC | DOPOREDIST)) && rd->scap < nvox) {
+    cl = (unsigned char *)realloc(rd->scratch, nvox);
+    if (!cl) {
+      warning("snapbatch", "Memory allocation failure");
+      return (1);
+    }
+    rd->scratch = cl;
+    rd->scap = nvox;
+  }
+
+  memset(ispore, 0, sizeof(ispore));
+  ispore[POROSITY] = ispore[EMPTYP] = ispore[EMPTYDP] = ispore[CRACKP] = 1;
+
+  if (Analyses & DOSTAT) {
+    phase_census(vox, sr->xsize, sr->ysize, sr->zsize, NPHASES, sr->count,
+                 sr->face);
+  }
+
+  if (Analyses & DOPERC) {
+    memset(link, PERCNOLINK, sizeof(link));
+    link[1][1] = PERCLINK;
+    cl = rd->scratch;
+    for (net = 0; net < 2; net++) {
+      for (n = 0; n < nvox; n++) {
+        cl[n] = (ispore[vox[n]] == (net == 0));
+      }
+      if (perc_label_classes(cl, NULL, sr->xsize, sr->ysize, sr->zsize, link,
+                             &sr->perc[net])) {
+        warning("snapbatch", "Memory allocation failure");
+        return (1);
+      }
+    }
+  }
+
+  if (Analyses & DOPOREDIST) {
+
+    /* Largest diameter counted as in calcporedist3d */
+
+    mindim = sr->xsize;
+    if (sr->ysize < mindim)
+      mindim = sr->ysize;
+    if (sr->zsize < mindim)
+      mindim = sr->zsize;
+    sr->maxdiam = (int)(0.2 * mindim);
+    if (sr->maxdiam % 2 == 0)
+      sr->maxdiam++;
+
+    sr->ndiam = ivector(sr->maxdiam + 1);
+    if (!sr->ndiam) {
+      warning("snapbatch", "Memory allocation failure");
+      return (1);
+    }
+    cl = rd->scratch;
+    sr->npore = 0;
+    for (n = 0; n < nvox; n++) {
+      cl[n] = ispore[vox[n]];
+      sr->npore += cl[n];
+    }
+    if (poresizes(cl, sr->zsize, sr->ysize, sr->xsize, sr->maxdiam,
+                  sr->ndiam)) {
+      warning("snapbatch", "Memory allocation failure");
+      return (1);
+    }
+  }
+
+  sr->status = 0;
+  return (0);
+}
+
+/***
+ *	writeresults
+ *
+ *	Write the tables of the analyses done, one row (or one row
+ *	per phase or diameter) for every image analyzed, in the
+ *	order of the index
+ *
+ * 	Arguments:	Snapresult pointer to the results
+ * 				int number of images
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		filehandler, id2phasename
+ *	Called by:	main program
+ ***/
+int writeresults(Snapresult *res, int nimg) {
+  int i, k, d;
+  float voxvol, facearea, ntot;
+  char name[MAXSTRING + 16], phasename[MAXSTRING];
+  FILE *statfile, *percfile, *distfile;
+  Snapresult *sr;
+  static const char *netname[2] = {"pore", "solid"};
+
+  statfile = percfile = distfile = NULL;
+  if (Analyses & DOSTAT) {
+    sprintf(name, "%s_stat.csv", Prefix);
+    if (!(statfile = filehandler("snapbatch", name, "WRITE")))
+      return (1);
+    fprintf(statfile, "image,time_h,id,phase,voxels,volume_um3,"
+                      "volume_fraction,pore_surface_um2\n");
+  }
+  if (Analyses & DOPERC) {
+    sprintf(name, "%s_perc.csv", Prefix);
+    if (!(percfile = filehandler("snapbatch", name, "WRITE")))
+      return (1);
+    fprintf(percfile, "image,time_h,network,voxels,fraction_x,fraction_y,"
+                      "fraction_z,clusters,largest\n");
+  }
+  if (Analyses & DOPOREDIST) {
+    sprintf(name, "%s_poredist.csv", Prefix);
+    if (!(distfile = filehandler("snapbatch", name, "WRITE")))
+      return (1);
+    fprintf(distfile, "image,time_h,diameter_um,voxels,fraction\n");
+  }
+
+  for (i = 0; i < nimg; i++) {
+    sr = &res[i];
+    if (sr->status)
+      continue;
+    voxvol = sr->res * sr->res * sr->res;
+    facearea = sr->res * sr->res;
+    ntot = (float)sr->xsize * (float)sr->ysize * (float)sr->zsize;
+
+    if (statfile) {
+      for (k = 0; k < NPHASES; k++) {
+        if (sr->count[k] == 0)
+          continue;
+        id2phasename(k, phasename);
+        fprintf(statfile, "%s,%f,%d,%s,%d,%g,%g,%g\n", sr->name, sr->time, k,
+                phasename, sr->count[k], sr->count[k] * voxvol,
+                sr->count[k] / ntot,
+                (k == POROSITY) ? 0.0 : sr->face[k] * facearea);
+      }
+    }
+
+    /* Percolated fractions as in perc3d: all that the burn reaches */
+
+    if (percfile) {
+      for (k = 0; k < 2; k++) {
+        fprintf(percfile, "%s,%f,%s,%d", sr->name, sr->time, netname[k],
+                sr->perc[k].nset);
+        for (d = 0; d < 3; d++) {
+          fprintf(percfile, ",%g",
+                  (sr->perc[k].nset > 0 && sr->perc[k].nmeet[d] > 0)
+                      ? (float)sr->perc[k].nfront[d] / sr->perc[k].nset
+                      : 0.0);
+        }
+        fprintf(percfile, ",%d,%d\n", sr->perc[k].ncluster,
+                sr->perc[k].maxcluster);
+      }
+    }
+
+    if (distfile && sr->ndiam) {
+      for (d = 1; d <= sr->maxdiam; d += 2) {
+        fprintf(distfile, "%s,%f,%g,%d,%g\n", sr->name, sr->time,
+                d * sr->res, sr->ndiam[d],
+                sr->npore ? (float)sr->ndiam[d] / sr->npore : 0.0);
+      }
+    }
+  }
+
+  if (statfile)
+    fclose(statfile);
+  if (percfile)
+    fclose(percfile);
+  if (distfile)
+    fclose(distfile);
+
+  return (0);
+}
@@ -9,6 +9,11 @@
  * 	(3) pore-exposed surface area fractions
  * 	(4) mass fractions
  *
+ * With --csv, --pairs or --json it runs in batch mode instead,
+ * reading every image named on the command line and writing one
+ * table (or JSON array) for all of them, including the area of the
+ * interface between every pair of phases.
+ *
  * Programmer:	Jeffrey W Bullard
  *              Zachry Department of Civil and Environmental Engineering
  *              Department of Materials Science and Engineering
@@ -19,6 +24,7 @@
  *
  *******************************************************/
 #include "include/vcctl.h"
+#include <getopt.h>
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,13 +35,24 @@
  *	Global variables
  ***/
 float Version;
+int Nthreads = 0;
+char Csvname[MAXSTRING], Pairname[MAXSTRING], Jsonname[MAXSTRING];
 
 #include "include/properties.h"
 
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
+int batchstats(int nimg, char *imgname[]);
+int imgstats(char *name, unsigned char **vox, size_t *cap, int *count,
+             int *pair, FILE *csvfile, FILE *pairfile, FILE *jsonfile,
+             int first);
+
 int main(int argc, char *argv[]) {
-  int ***mic;
   int flag;
-  int valin, ovalin, ix, iy, iz, ix1, iy1, iz1, k, kk, syssize, totalsysvoxels;
+  int k, kk, totalsysvoxels;
   int xsyssize, ysyssize, zsyssize, totalsolidvoxels, totalporevoxels;
   int volcount[NPHASES], surfcount[NPHASES];
   float volume[NPHASES], totalsolidvolume, totalporevolume, totalvolume;
@@ -46,8 +63,8 @@ int main(int argc, char *argv[]) {
 
   /* Resolution in units of micrometers */
   float res, resInCm;
-  char filen[MAXSTRING], fileout[MAXSTRING], buff[MAXSTRING];
-  char phasename[MAXSTRING], instring[MAXSTRING];
+  char filen[MAXSTRING], fileout[MAXSTRING];
+  char phasename[MAXSTRING];
   char *locale;
   wchar_t mu = 0x03BC;
   wchar_t sup1 = 0x00B9;
@@ -55,6 +72,8 @@ int main(int argc, char *argv[]) {
   wchar_t sup3 = 0x00B3;
   wchar_t supminus = 0x207B;
   wchar_t multsym = 0x00D7;
+  size_t n, cap = 0;
+  unsigned char *vox = NULL;
   FILE *infile, *statfile;
 
   /* Set up locale for printing unicode when necessary */
@@ -78,6 +97,19 @@ int main(int argc, char *argv[]) {
   assign_properties();
 
   /* Check for command line arguments */
+  argc = checkargs(argc, argv);
+  if (argc < 0) {
+    printHelp();
+    exit(1);
+  }
+  if (Csvname[0] || Pairname[0] || Jsonname[0]) {
+    if (argc < 2) {
+      printHelp();
+      exit(1);
+    }
+    return (batchstats(argc - 1, argv + 1));
+  }
+
   if (argc != 3) {
     printf("Usage: %s <input_file> <output_file>\n", argv[0]);
     printf("Enter name of microstructure file to open \n");
@@ -100,53 +132,28 @@ int main(int argc, char *argv[]) {
    *	displaying in web page format
    ***/
 
-  infile = fopen(filen, "r");
-  statfile = fopen(fileout, "w");
+  infile = filehandler("stat3d", filen, "READ");
+  if (!infile) {
+    exit(1);
+  }
 
   /***
-   *	Determine whether software version, system
-   *	size and resolution are specified in the image file
+   *	Read the software version, system size, resolution
+   *	and all the voxels of the image file
    ***/
 
-  fscanf(infile, "%s", buff);
-  if (!strcmp(buff, VERSIONSTRING)) {
-    fscanf(infile, "%s", instring);
-    Version = atof(instring);
-    fscanf(infile, "%s", buff); /* Desc. of system size */
-    if (!strcmp(buff, XSIZESTRING)) {
-      fscanf(infile, "%s", instring);
-      xsyssize = atoi(instring);
-      fscanf(infile, "%s", buff);
-      fscanf(infile, "%s", instring);
-      ysyssize = atoi(instring);
-      fscanf(infile, "%s", buff);
-      fscanf(infile, "%s", instring);
-      zsyssize = atoi(instring);
-    } else {
-      fscanf(infile, "%s", instring);
-      syssize = atoi(instring);
-      xsyssize = syssize;
-      ysyssize = syssize;
-      zsyssize = syssize;
-    }
-    facearea = res * res; /* in um2 */
-  } else {
-
-    /***
-     *	This image file was generated prior to
-     *	Version 3.0.  Allow backward compatibility
-     *	by defaulting system size to 100 and
-     *	system resolution to 1.0
-     ***/
-
-    Version = 2.0;
-    syssize = DEFAULTSYSTEMSIZE;
-    xsyssize = syssize;
-    ysyssize = syssize;
-    zsyssize = syssize;
-    res = DEFAULTRESOLUTION;
-    rewind(infile);
+  if (load_microstructure(infile, &vox, &cap, &Version, &xsyssize, &ysyssize,
+                          &zsyssize, &res)) {
+    fclose(infile);
+    if (vox)
+      free(vox);
+    bailout("stat3d", "Error reading microstructure image");
+    exit(1);
   }
+  fclose(infile);
+
+  statfile = fopen(fileout, "w");
+  facearea = res * res; /* in um2 */
 
   totalsysvoxels = xsyssize * ysyssize * zsyssize;
   resInCm = res * 1.0e-4;
@@ -154,148 +161,51 @@ int main(int argc, char *argv[]) {
   voxelvolumeInCm3 = resInCm * resInCm * resInCm;
 
   /***
-   *	Dynamically allocate the memory for mic array
+   *	Count the voxels of each phase and the faces each
+   *	phase shares with porosity, in one pass over the image
+   *
+   *	2025 August 05
+   *	The new convention is to read and write image data using
+   *	C-order (z varies fastest, then y, and then x)
    ***/
 
-  mic = ibox(xsyssize, ysyssize, zsyssize);
-
-  /* Read in image and accumulate volume totals */
-
-  /**
-   * 2025 August 05
-   * The new convention is to read and write image data using
-   * C-order (z varies fastest, then y, and then x)
-   **/
-
-  for (ix = 0; ix < xsyssize; ix++) {
-    for (iy = 0; iy < ysyssize; iy++) {
-      for (iz = 0; iz < zsyssize; iz++) {
-
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valin = convert_id(ovalin, Version);
-        mic[ix][iy][iz] = valin;
-
-        if (valin < NSPHASES) {
-
-          volcount[valin]++;
-
-          /***
-           *	orthorhombic C3A counts as C3A, too, for
-           *	clinker purposes
-           ***/
-
-          mass[valin] += ((float)Specgrav[valin]);
-          if (valin == OC3A) {
-            volcount[C3A]++;
-            mass[C3A] += ((float)Specgrav[valin]);
-          }
+  if (phase_census(vox, xsyssize, ysyssize, zsyssize, NSPHASES, volcount,
+                   surfcount) > 0) {
 
-          if (valin != POROSITY && valin != DRIEDP && valin != EMPTYDP &&
-              valin != EMPTYP) {
+    /***
+     *	Anything not recognized is
+     *	generates an error
+     ***/
 
-            totalsolidvoxels++;
+    for (n = 0; vox[n] < NSPHASES; n++)
+      ;
+    printf("\n\nERROR: Urecognized phase id (%d)\n\n", vox[n]);
+    exit(1);
+  }
 
-            /** totalmass has units of voxel * (g per cm3) **/
-            /** This is the same as g /(cm3 per voxel) **/
-            /** It is the total solid mass **/
-            totalsolidmass += ((float)(Specgrav[valin]));
-          } else {
-            totalporevoxels++;
-            totalporemass += ((float)Specgrav[valin]);
-          }
+  free(vox);
 
-          /***
-           *	Specific gravities are declared
-           *	and defined in properties.c
-           ***/
+  surfcount[POROSITY] = 0;
+  for (k = 0; k < NSPHASES; k++) {
 
-        } else {
+    /***
+     *	Specific gravities are declared
+     *	and defined in properties.c
+     ***/
 
-          /***
-           *	Anything not recognized is
-           *	generates an error
-           ***/
+    mass[k] = ((float)Specgrav[k]) * ((float)volcount[k]);
 
-          printf("\n\nERROR: Urecognized phase id (%d)\n\n", valin);
-          exit(1);
-        }
-      }
-    }
-  }
+    if (k != POROSITY && k != DRIEDP && k != EMPTYDP && k != EMPTYP) {
 
-  fclose(infile);
+      totalsolidvoxels += volcount[k];
 
-  ix1 = iy1 = iz1 = 0;
-  for (ix = 0; ix < xsyssize; ix++) {
-    for (iy = 0; iy < ysyssize; iy++) {
-      for (iz = 0; iz < zsyssize; iz++) {
-
-        if ((mic[ix][iy][iz] != POROSITY) && (mic[ix][iy][iz] <= NSPHASES)) {
-
-          valin = mic[ix][iy][iz];
-
-          /* Check six neighboring pixels for porosity */
-
-          for (k = 1; k <= 6; k++) {
-
-            /* Each face bordering porosity adds one to surfcount */
-            /* So a single voxel could have a surfcount up to six */
-            switch (k) {
-            case 1:
-              ix1 = ix - 1;
-              if (ix1 < 0)
-                ix1 += xsyssize;
-              iy1 = iy;
-              iz1 = iz;
-              break;
-            case 2:
-              ix1 = ix + 1;
-              if (ix1 >= xsyssize)
-                ix1 -= xsyssize;
-              iy1 = iy;
-              iz1 = iz;
-              break;
-            case 3:
-              iy1 = iy - 1;
-              if (iy1 < 0)
-                iy1 += ysyssize;
-              ix1 = ix;
-              iz1 = iz;
-              break;
-            case 4:
-              iy1 = iy + 1;
-              if (iy1 >= ysyssize)
-                iy1 -= ysyssize;
-              ix1 = ix;
-              iz1 = iz;
-              break;
-            case 5:
-              iz1 = iz - 1;
-              if (iz1 < 0)
-                iz1 += zsyssize;
-              iy1 = iy;
-              ix1 = ix;
-              break;
-            case 6:
-              iz1 = iz + 1;
-              if (iz1 >= zsyssize)
-                iz1 -= zsyssize;
-              iy1 = iy;
-              ix1 = ix;
-              break;
-            default:
-              break;
-            }
-
-            if ((mic[ix1][iy1][iz1] == POROSITY) ||
-                (mic[ix1][iy1][iz1] > NSPHASES)) {
-
-              surfcount[valin]++;
-            }
-          }
-        }
-      }
+      /** totalmass has units of voxel * (g per cm3) **/
+      /** This is the same as g /(cm3 per voxel) **/
+      /** It is the total solid mass **/
+      totalsolidmass += mass[k];
+    } else {
+      totalporevoxels += volcount[k];
+      totalporemass += mass[k];
     }
   }
 
@@ -360,14 +270,318 @@ int main(int argc, char *argv[]) {
   fclose(statfile);
 
   /***
-   *	Free the allocated memory
+   *	Update the key file now that calculation is finished
    ***/
 
-  free_ibox(mic, xsyssize, ysyssize);
+  return (0);
+}
 
-  /***
-   *	Update the key file now that calculation is finished
-   ***/
+/***
+ *	checkargs
+ *
+ *	Read the options, leaving the other arguments (the file
+ *	names) in argv[1..] in the order given
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int number of arguments left, counting the program
+ * 				name, or -1 if the options are not understood
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int i, opt_char, option_index;
+
+  static struct option long_opts[] = {
+      {"csv", required_argument, 0, 'c'},
+      {"pairs", required_argument, 0, 'p'},
+      {"json", required_argument, 0, 'j'},
+      {"threads", required_argument, 0, 't'},
+      {"help", no_argument, 0, 'h'},
+      {NULL, 0, 0, 0}};
+
+  Csvname[0] = Pairname[0] = Jsonname[0] = '\0';
+
+  Nthreads = thread_default(Nthreads);
+
+  while ((opt_char = getopt_long(argc, argv, "c:p:j:t:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -c or --csv */
+    case (int)('c'):
+      snprintf(Csvname, sizeof(Csvname), "%s", optarg);
+      break;
+    /* -p or --pairs */
+    case (int)('p'):
+      snprintf(Pairname, sizeof(Pairname), "%s", optarg);
+      break;
+    /* -j or --json */
+    case (int)('j'):
+      snprintf(Jsonname, sizeof(Jsonname), "%s", optarg);
+      break;
+    /* -t or --threads */
+    case (int)('t'):
+      Nthreads = atoi(optarg);
+      if (Nthreads < 0)
+        Nthreads = 0;
+      break;
+    default:
+      return (-1);
+    }
+  }
+
+  for (i = optind; i < argc; i++) {
+    argv[1 + i - optind] = argv[i];
+  }
+
+  return (1 + argc - optind);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ *	Arguments:	none
+ *	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: stat3d [<input_file> <output_file>]\n");
+  fprintf(stderr, "       stat3d [-c,--csv <file>] [-p,--pairs <file>]\n");
+  fprintf(stderr, "              [-j,--json <file>] [-t,--threads <n>]\n");
+  fprintf(stderr, "              <image> [<image> ...]\n\n");
+  fprintf(stderr, "With no options, write the statistics of one image as "
+                  "text (asking for the\n");
+  fprintf(stderr, "file names if they are not given).  Otherwise, read "
+                  "every image named and\n");
+  fprintf(stderr, "write their statistics together:\n\n");
+  fprintf(stderr, "  --csv      one row per image and phase: voxels, "
+                  "volume, volume fraction,\n");
+  fprintf(stderr, "             mass, surface area and pore-exposed surface "
+                  "area\n");
+  fprintf(stderr, "  --pairs    one row per image and pair of phases that "
+                  "touch: shared faces\n");
+  fprintf(stderr, "             and interface area\n");
+  fprintf(stderr, "  --json     both, as one JSON array with an object per "
+                  "image\n");
+  fprintf(stderr, "  --threads  number of threads for the face counts "
+                  "(default: VCCTL_THREADS, or all)\n\n");
+
+  return;
+}
+
+/***
+ *	batchstats
+ *
+ *	Write the statistics of a list of images to the files asked
+ *	for with --csv, --pairs and --json, reusing one image buffer
+ *	for all of them
+ *
+ * 	Arguments:	int number of images, char pointers to their names
+ * 	Returns:	0 if every image was done, 1 otherwise
+ *
+ *	Calls:		imgstats
+ *	Called by:	main program
+ ***/
+int batchstats(int nimg, char *imgname[]) {
+  int i, status, first;
+  int count[NSPHASES], *pair;
+  size_t cap = 0;
+  unsigned char *vox = NULL;
+  FILE *csvfile, *pairfile, *jsonfile;
+
+  pair = (int *)malloc((size_t)(NSPHASES) * (NSPHASES) * sizeof(int));
+  if (!pair) {
+    bailout("stat3d", "Memory allocation failure");
+    return (1);
+  }
+
+  csvfile = pairfile = jsonfile = NULL;
+  status = 0;
+  if (Csvname[0]) {
+    csvfile = filehandler("stat3d", Csvname, "WRITE");
+    status |= !csvfile;
+  }
+  if (Pairname[0]) {
+    pairfile = filehandler("stat3d", Pairname, "WRITE");
+    status |= !pairfile;
+  }
+  if (Jsonname[0]) {
+    jsonfile = filehandler("stat3d", Jsonname, "WRITE");
+    status |= !jsonfile;
+  }
+
+  if (!status) {
+    if (csvfile) {
+      fprintf(csvfile, "image,id,phase,voxels,volume_um3,volume_fraction,"
+                       "mass_g,surface_um2,pore_surface_um2\n");
+    }
+    if (pairfile) {
+      fprintf(pairfile, "image,id_a,phase_a,id_b,phase_b,faces,area_um2\n");
+    }
+    if (jsonfile) {
+      fprintf(jsonfile, "[");
+    }
+
+    first = 1;
+    for (i = 0; i < nimg; i++) {
+      if (imgstats(imgname[i], &vox, &cap, count, pair, csvfile, pairfile,
+                   jsonfile, first)) {
+        status = 1;
+      } else {
+        first = 0;
+      }
+    }
+
+    if (jsonfile) {
+      fprintf(jsonfile, "\n]\n");
+    }
+  }
+
+  if (csvfile)
+    fclose(csvfile);
+  if (pairfile)
+    fclose(pairfile);
+  if (jsonfile)
+    fclose(jsonfile);
+  if (vox)
+    free(vox);
+  free(pair);
+
+  return (status);
+}
+
+/***
+ *	imgstats
+ *
+ *	Read one image, count its phases and the faces between them
+ *	in one pass (phase_interfaces), and add its rows to the
+ *	output files.  The surface of a solid phase is its faces with
+ *	every other phase; its pore surface is its faces with
+ *	porosity, as in the text output.
+ *
+ * 	Arguments:	char pointer to the image name
+ * 				pointers to the image buffer and its size
+ * 				int pointers to NSPHASES voxel counts and
+ * 				NSPHASES * NSPHASES face counts
+ * 				file pointers for the CSV, pair and JSON
+ * 				output (NULL if not wanted)
+ * 				int flag, nonzero for the first image written
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		load_microstructure, phase_interfaces
+ *	Called by:	batchstats
+ ***/
+int imgstats(char *name, unsigned char **vox, size_t *cap, int *count,
+             int *pair, FILE *csvfile, FILE *pairfile, FILE *jsonfile,
+             int first) {
+  int k, j, nout, xsize, ysize, zsize, faces, nsep;
+  float res, facearea, voxelvolume, voxelvolumeInCm3, totalvoxels;
+  char phasename[MAXSTRING], othername[MAXSTRING];
+  char buff[MAXSTRING];
+  FILE *infile;
+
+  infile = filehandler("stat3d", name, "READ");
+  if (!infile) {
+    return (1);
+  }
+
+  if (load_microstructure(infile, vox, cap, &Version, &xsize, &ysize, &zsize,
+                          &res)) {
+    fclose(infile);
+    sprintf(buff, "Error reading microstructure image %s", name);
+    warning("stat3d", buff);
+    return (1);
+  }
+  fclose(infile);
+
+  nout = phase_interfaces(*vox, xsize, ysize, zsize, NSPHASES, count, pair,
+                          NULL, Nthreads);
+  if (nout < 0) {
+    warning("stat3d", "Memory allocation failure");
+    return (1);
+  } else if (nout > 0) {
+    sprintf(buff, "Unrecognized phase id in %s", name);
+    warning("stat3d", buff);
+    return (1);
+  }
+
+  facearea = res * res;
+  voxelvolume = res * res * res;
+  voxelvolumeInCm3 = voxelvolume * 1.0e-12;
+  totalvoxels = (float)xsize * (float)ysize * (float)zsize;
+
+  if (jsonfile) {
+    fprintf(jsonfile, "%s\n  {\"image\": \"%s\", \"xsize\": %d, ",
+            first ? "" : ",", name, xsize);
+    fprintf(jsonfile, "\"ysize\": %d, \"zsize\": %d, \"resolution\": %g,",
+            ysize, zsize, res);
+    fprintf(jsonfile, "\n   \"phases\": [");
+  }
+
+  nsep = 0;
+  for (k = 0; k < NSPHASES; k++) {
+    if (count[k] == 0)
+      continue;
+    id2phasename(k, phasename);
+    faces = 0;
+    for (j = 0; j < NSPHASES; j++) {
+      faces += pair[k * (NSPHASES) + j];
+    }
+    if (csvfile) {
+      fprintf(csvfile, "%s,%d,%s,%d,%g,%g,%g,%g,%g\n", name, k, phasename,
+              count[k], count[k] * voxelvolume, count[k] / totalvoxels,
+              Specgrav[k] * count[k] * voxelvolumeInCm3, faces * facearea,
+              pair[k * (NSPHASES) + POROSITY] * facearea);
+    }
+    if (jsonfile) {
+      fprintf(jsonfile, "%s\n    {\"id\": %d, \"phase\": \"%s\", ",
+              nsep ? "," : "", k, phasename);
+      fprintf(jsonfile, "\"voxels\": %d, \"volume_um3\": %g, ", count[k],
+              count[k] * voxelvolume);
+      fprintf(jsonfile, "\"volume_fraction\": %g, \"mass_g\": %g, ",
+              count[k] / totalvoxels,
+              Specgrav[k] * count[k] * voxelvolumeInCm3);
+      fprintf(jsonfile, "\"surface_um2\": %g, \"pore_surface_um2\": %g}",
+              faces * facearea, pair[k * (NSPHASES) + POROSITY] * facearea);
+    }
+    nsep++;
+  }
+
+  if (jsonfile) {
+    fprintf(jsonfile, "],\n   \"interfaces\": [");
+  }
+
+  nsep = 0;
+  for (k = 0; k < NSPHASES; k++) {
+    for (j = k + 1; j < NSPHASES; j++) {
+      faces = pair[k * (NSPHASES) + j];
+      if (faces == 0)
+        continue;
+      id2phasename(k, phasename);
+      id2phasename(j, othername);
+      if (pairfile) {
+        fprintf(pairfile, "%s,%d,%s,%d,%s,%d,%g\n", name, k, phasename, j,
+                othername, faces, faces * facearea);
+      }
+      if (jsonfile) {
+        fprintf(jsonfile,
+                "%s\n    {\"id_a\": %d, \"phase_a\": \"%s\", \"id_b\": %d, ",
+                nsep ? "," : "", k, phasename, j);
+        fprintf(jsonfile,
+                "\"phase_b\": \"%s\", \"faces\": %d, \"area_um2\": %g}",
+                othername, faces, faces * facearea);
+      }
+      nsep++;
+    }
+  }
+
+  if (jsonfile) {
+    fprintf(jsonfile, "]}");
+  }
 
   return (0);
 }
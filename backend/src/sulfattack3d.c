@@ -24,8 +24,26 @@
  * 3-D image using the conjugate gradient technique
  * (i.e. no binding/reaction)
  *
+ * With --band the layers behind the reaction front,
+ * where the ions only diffuse, are solved as a 1-D
+ * continuum, and ants are kept only in a band of
+ * layers at the front and below it.  The run time then
+ * depends on the width of the band rather than on the
+ * depth reached.
+ *
+ * With --window only the layers the ants can reach
+ * are held in memory, from just above the band to just
+ * below the deepest ant.  They are read in from a raw
+ * binary input image as the ants go deeper, and written
+ * out to a raw binary output image once they join the
+ * continuum, so the depth of the specimen is limited by
+ * the disk rather than by memory.  The profiles of each
+ * layer are kept for the whole depth, but the full
+ * microstructure is only written at the end.
+ *
  *******************************************************/
 #include "include/vcctl.h"
+#include <getopt.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,7 +58,11 @@
 #define MOLEFACTOR                                                             \
   1.0E12 /* cubic micrometers per                                              \
                                          cubic centimeter */
-#define NUMANTS 500000
+#define NUMANTS 500000 /* starting room for ants, per 100^3 pixels */
+
+#define QUIETCYCLES 100 /* cycles without binding before a layer is spent */
+
+#define WINMARGIN 4 /* layers held past those the ants are in */
 
 #define SPERCH 90    /* diffusing species per CH pixel */
 #define SPERC3AH6 20 /* diffusing species per C3AH6 pixel */
@@ -83,13 +105,62 @@ float *Strainbrucite, *Strainettr, *Strainafm, *Straingyp;
 float Layer_volume;
 
 /***
- * coordinates of diffusing species in (Xnew,Ynew,Znew)
+ *	coordinates of diffusing species in (Xnew,Ynew,Znew),
+ *	numbered from 1, with room for Antcap - 1 of them
  ***/
 
 short int *Xnew, *Ynew, *Znew;
+int Antcap = 0;
 int Nantsurf, Ntotdiff = 0;
 double Molesperpixel[MS + 1];
 
+/* Probability of reaction */
+float Preact;
+
+/***
+ *	For --band: the layers 0 to Zcont - 1 are a continuum
+ *	with Conc ants in each and Open the fraction of each
+ *	one's pixels they can sit in, and the layers 1 to
+ *	Zspent are spent.  Lastbind is the last cycle in
+ *	which each layer bound an ant (or had too few ants
+ *	to tell).  Across the boundary between layers z and
+ *	z+1, since either last bound an ant, Ndown[z] ants
+ *	moved down out of Nabove[z] ant-cycles in layer z
+ *	and Nup[z] moved up out of Nbelow[z] ant-cycles in
+ *	layer z+1.  Gcross[z] is the conductance of the
+ *	boundary once it is in the continuum.
+ ***/
+int Band = 0, Zcont = 0, Zspent = 0, Cycle = 0;
+
+/***
+ *	Handoff the input microstructure is read from, left by
+ *	disrealnew --handoff-out (see handoff.c), set with --handoff
+ *	(empty to read the input file)
+ ***/
+char Handoffname[MAXSTRING];
+
+/***
+ *	For --window: the window of layers that Mic and React
+ *	hold (see layerwin.c)
+ ***/
+int Window = 0;
+Layerwin Win;
+double *Conc, *Flux, *Open, *Gcross;
+double *Ndown, *Nup, *Nabove, *Nbelow;
+int *Lastbind;
+
+/***
+ *	CH pixels by layer, for removech and distchreac.  The
+ *	ones in layer z are Chlist[z][0] onward, as
+ *	x * Ysyssize + y, Nchlist[z] of them, and the first
+ *	Nchfree[z] of those can still take a reaction from
+ *	distchreac.  Chpos[z] is the place of each CH pixel in
+ *	its layer's list (-1 for any other pixel), at
+ *	x * Ysyssize + y.  With --window a layer has these
+ *	only while it is in the window.
+ ***/
+int **Chlist, **Chpos, *Nchlist, *Nchfree;
+
 /***
  *	Function declarations
  ***/
@@ -98,24 +169,50 @@ void remsurf(int nrem);
 void extphase(int phtomake, int xcur, int ycur, int zcur);
 int distchreac(int ztodo);
 void removech(int xcur, int ycur, int zcur);
+void chlistinit(void);
+int chlayer(int iz);
+void chdrop(int iz);
+int chpick(int iz, int onlyfree, int *xp, int *yp);
+void chupdate(int ix, int iy, int iz);
+void chswap(int iz, int i, int j);
+int antstep(int antz, int cxn, int cyn, int czn);
+void moveserial(void);
+int canhold(int phid, int iz);
+double openfrac(int iz);
+void countcross(int zold, int znew);
+void advancefront(void);
+void continuum(void);
+void absorbants(void);
+void slide(int zdeep);
+void growants(int nants);
+void *regrow(void *p, size_t size);
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
 void allmem(void);
 void freeallmem(void);
 
 #include "include/properties.h"
 
-int main(void) {
+int main(int argc, char *argv[]) {
   int ix, iy, iz, seed1, nlen;
-  int i, antx, anty, antz, ich, inval, oinval;
-  int cxn, cyn, czn, phid, initdepth, outfreq;
-  int ia, ncyc, icyc, iant, nleft, norg, nadd, numadd;
+  int i, ich, inval;
+  size_t n, cap = 0;
+  unsigned char *vox = NULL;
+  int phid, initdepth, outfreq;
+  int ia, ncyc, icyc, nleft, nadd, numadd;
   int chinit = 0, afminit = 0, c3ah6init = 0, ettrinit = 0, ettrc4init = 0;
-  float prand, preact, ptest, sulfconc = 0.0;
+  float prand, sulfconc = 0.0;
   double volume_available;
   char filein[MAXSTRING], fileout[MAXSTRING], buff[MAXSTRING];
   char fplot[MAXSTRING], exten[MAXSTRING], fileroot[MAXSTRING];
   char strsuff[MAXSTRING], instring[MAXSTRING];
   FILE *micfile, *newmic, *plotfile;
 
+  if (checkargs(argc, argv)) {
+    printHelp();
+    exit(1);
+  }
+
   /* Initialize global array Molesperpixel */
 
   for (ix = 0; ix <= MS; ix++) {
@@ -148,6 +245,8 @@ int main(void) {
 
   /* Establish needed specific gravities and molar volumes */
 
+  assign_properties();
+
   for (ix = 0; ix <= MS; ix++) {
     Molesperpixel[ix] = 0.0;
   }
@@ -186,8 +285,8 @@ int main(void) {
   printf("Initial penetration depth: %d\n", initdepth);
   printf("Enter reaction probability for sulfate attack \n");
   read_string(instring, sizeof(instring));
-  preact = atof(instring);
-  printf("Reaction probability for sulfate attack: %f\n", preact);
+  Preact = atof(instring);
+  printf("Reaction probability for sulfate attack: %f\n", Preact);
   printf("Enter number of cycles to execute \n");
   read_string(instring, sizeof(instring));
   ncyc = atoi(instring);
@@ -201,21 +300,45 @@ int main(void) {
 
   /* Read in microstructure from datafile */
 
-  micfile = filehandler("sulfattack3d", filein, "READ");
-  if (!micfile) {
-    exit(1);
-  }
+  if (Window) {
 
-  /***
-   *	Determine whether software version, system size
-   *	and resolution are specified in the image file
-   ***/
+    /* Layer 0 is porosity and layer Zsyssize + 1 solid */
 
-  if (read_imgheader(micfile, &Version, &Xsyssize, &Ysyssize, &Zsyssize,
-                     &Res)) {
-    fclose(micfile);
-    bailout("sulfattack3d", "Error reading image header");
-    exit(1);
+    if (layerwin_open(&Win, filein, fileout, LAYERWIN_ZSLOW, POROSITY, C3S)) {
+      bailout("sulfattack3d", "--window needs a raw binary input image");
+      exit(1);
+    }
+    Version = Win.in.ver;
+    Xsyssize = Win.xsize;
+    Ysyssize = Win.ysize;
+    Zsyssize = Win.zsize;
+    Res = Win.in.res;
+    Mic = Win.mic;
+    React = Win.react;
+  } else {
+    if (strlen(Handoffname) > 0) {
+      micfile = handoff_open(Handoffname, "img", 0);
+    } else {
+      micfile = filehandler("sulfattack3d", filein, "READ");
+    }
+    if (!micfile) {
+      exit(1);
+    }
+
+    /***
+     *	Determine whether software version, system size
+     *	and resolution are specified in the image file
+     ***/
+
+    if (load_microstructure(micfile, &vox, &cap, &Version, &Xsyssize,
+                            &Ysyssize, &Zsyssize, &Res)) {
+      handoff_close(micfile);
+      if (vox)
+        free(vox);
+      bailout("sulfattack3d", "Error reading microstructure image");
+      exit(1);
+    }
+    handoff_close(micfile);
   }
 
   /***
@@ -224,7 +347,11 @@ int main(void) {
 
   sulfconc = (sulfconc / 0.334892) * Res * Res * Res;
 
-  Syspix = Xsyssize * Ysyssize * Zsyssize;
+  /* With --window the ants start out in the top layers only */
+
+  Syspix = Xsyssize * Ysyssize *
+           ((Window && Zsyssize > DEFAULTSYSTEMSIZE) ? DEFAULTSYSTEMSIZE
+                                                     : Zsyssize);
   Sizemag = ((float)Syspix) / (pow(((double)DEFAULTSYSTEMSIZE), 3.0));
   Isizemag = (int)(Sizemag + 0.5);
 
@@ -251,11 +378,13 @@ int main(void) {
    *	all solid material at bottom surface
    ***/
 
-  for (ix = 0; ix < Xsyssize; ix++) {
-    for (iy = 0; iy < Ysyssize; iy++) {
-      Mic[ix][iy][0] = 0;
-      Mic[ix][iy][Zsyssize + 1] = 1;
-      React[ix][iy][0] = React[ix][iy][Zsyssize + 1] = 0;
+  if (!Window) {
+    for (ix = 0; ix < Xsyssize; ix++) {
+      for (iy = 0; iy < Ysyssize; iy++) {
+        Mic[ix][iy][0] = 0;
+        Mic[ix][iy][Zsyssize + 1] = 1;
+        React[ix][iy][0] = React[ix][iy][Zsyssize + 1] = 0;
+      }
     }
   }
 
@@ -285,21 +414,29 @@ int main(void) {
     Ccorig[iz] = 0;
   }
 
+  /***
+   *	Copy in the microstructure read from datafile, or
+   *	with --window just count it, layers coming into the
+   *	window as they are needed
+   ***/
+
+  n = 0;
   for (iz = 1; iz < Zsyssize + 1; iz++) {
     for (iy = 0; iy < Ysyssize; iy++) {
       for (ix = 0; ix < Xsyssize; ix++) {
-        if (feof(micfile)) {
-          freeallmem();
-          bailout("sulfattack3d", "End of file encountered");
-          exit(1);
+        if (Window) {
+          inval = layerwin_id(&Win, ix, iy, iz);
+          if (inval < 0) {
+            freeallmem();
+            bailout("sulfattack3d", "Unknown phase id in image");
+            exit(1);
+          }
+        } else {
+          inval = vox[n++];
+          Mic[ix][iy][iz] = inval;
+          React[ix][iy][iz] = 0;
         }
 
-        fscanf(micfile, "%s", instring);
-        oinval = atoi(instring);
-        inval = convert_id(oinval, Version);
-        Mic[ix][iy][iz] = inval;
-        React[ix][iy][iz] = 0;
-
         if (inval == CH) {
           chinit++;
           Chorig[iz]++;
@@ -368,7 +505,12 @@ int main(void) {
     }
   }
 
-  fclose(micfile);
+  free(vox);
+  if (Window) {
+    slide(initdepth);
+  } else {
+    chlistinit();
+  }
   printf("Initial counts for CH, AFM, C3AH6 and ettringite(2) are %d, %d, "
          "%d, %d, and %d.\n",
          chinit, afminit, c3ah6init, ettrinit, ettrc4init);
@@ -415,11 +557,7 @@ int main(void) {
       }
 
       if (ich) {
-        if (Ntotdiff >= NUMANTS * Isizemag) {
-          freeallmem();
-          bailout("sulfattack3d", "Too many ants");
-          exit(1);
-        }
+        growants(Ntotdiff + 1);
         Ntotdiff++;
         Xnew[Ntotdiff] = ix;
         Ynew[Ntotdiff] = iy;
@@ -445,20 +583,21 @@ int main(void) {
   Nantsurf = sulfconc * Layer_volume;
 
   for (icyc = 1; icyc <= ncyc; icyc++) {
-    nleft = 0;
-    nadd = Nantsurf - Ndiff[0]; /* number ants left to add */
+    Cycle = icyc;
+    if (Window)
+      slide(0);
+
+    /* The continuum holds the surface layer once there is one */
+
+    nadd = (Zcont > 0) ? 0 : Nantsurf - Ndiff[0];
     if (nadd > 0) {
+      growants(Ntotdiff + nadd);
       for (ia = 0; ia < nadd; ia++) {
         prand = ran1(Seed);
         ix = (int)((float)Xsyssize * prand);
         prand = ran1(Seed);
         iy = (int)((float)Ysyssize * prand);
 
-        if (Ntotdiff >= NUMANTS * Isizemag) {
-          freeallmem();
-          bailout("sulfattack3d", "Too many ants");
-          exit(1);
-        }
         Ntotdiff++;
         Xnew[Ntotdiff] = ix;
         Ynew[Ntotdiff] = iy;
@@ -473,243 +612,27 @@ int main(void) {
       remsurf(Ndiff[0] - Nantsurf);
     }
 
-    norg = Ntotdiff;
-
-    /* Move each ant in turn */
-
-    for (iant = 1; iant <= norg; iant++) {
-
-      /* Get current location of this ant */
-
-      antx = Xnew[iant];
-      anty = Ynew[iant];
-      antz = Znew[iant];
-
-      /***
-       *	Update location of ant based on a randomly
-       *	chosen direction
-       ***/
-
-      ich = 1 + (int)(6.0 * ran1(Seed));
-      if (ich > 6)
-        ich = 6;
-
-      cxn = antx;
-      cyn = anty;
-      czn = antz;
-
-      switch (ich) {
-      case 1:
-        cxn = antx - 1;
-        break;
-      case 2:
-        cxn = antx + 1;
-        break;
-      case 3:
-        cyn = anty - 1;
-        break;
-      case 4:
-        cyn = anty + 1;
-        break;
-      case 5:
-        czn = antz - 1;
-        break;
-      case 6:
-        czn = antz + 1;
-        break;
-      default:
-        break;
-      }
-
-      /***
-       *	Adjust for periodic boundary conditions if necessary
-       ***/
-
-      cxn += checkbc(cxn, Xsyssize);
-      cyn += checkbc(cyn, Ysyssize);
-
-      /* Don't let ants leave via the top surface */
-
-      if (czn < 0)
-        ich = 0;
-
-      if (ich != 0) {
-
-        /* Check to see what phase ant is moving into */
-
-        phid = Mic[cxn][cyn][czn];
-        if ((phid != POROSITY) && (phid != AFMC) && (phid != CSH) &&
-            (phid != CH) && (phid != AFM) && (phid != EMPTYP) &&
-            (phid != DRIEDP) && (phid != C3AH6) && (phid != POZZCSH) &&
-            (phid != SLAGCSH)) {
-          ich = 0;
-        }
-        if ((phid == CH) && (Nrafm[czn] < (Afmorig[czn] * 0.85)) &&
-            (Nrafmc[czn] < (Afmcorig[czn] * 0.85))) {
-          ich = 0;
-        } else if (phid == AFM) {
-          ich = 0;
-
-          /* Can't move, but can react */
-
-          if ((ran1(Seed) < preact) && (React[cxn][cyn][czn] < SPERAFM)) {
-
-            React[cxn][cyn][czn]++;
-            if (React[cxn][cyn][czn] == SPERAFM) {
-              React[cxn][cyn][czn] = 0;
-              Mic[cxn][cyn][czn] = ETTR;
-              Ettrorig[czn]++;
-              extphase(ETTR, cxn, cyn, czn);
-              ptest = (Molarv[ETTR] / Molarv[AFM]) - 2.0;
-              if (ran1(Seed) < ptest) {
-                extphase(ETTR, cxn, cyn, czn);
-              }
-              ptest = (2.0 * Molarv[BRUCITE] / Molarv[AFM]);
-              if (ran1(Seed) < ptest) {
-                extphase(BRUCITE, cxn, cyn, czn);
-              }
-
-              /* deplete CH as needed */
-
-              ptest = (2.0 * Molarv[CH] / Molarv[AFM]);
-              if (ran1(Seed) < ptest) {
-                removech(cxn, cyn, czn);
-              }
-              Nrafm[czn]++;
-            }
-            Ndiff[antz]--;
-            ich = (-1);
-          }
-        } else if (phid == C3AH6) {
-          ich = 0;
-          if ((ran1(Seed) < preact) && (React[cxn][cyn][czn] < SPERC3AH6)) {
-
-            React[cxn][cyn][czn]++;
-
-            if (React[cxn][cyn][czn] == SPERC3AH6) {
-              Mic[cxn][cyn][czn] = AFM;
-              Afmorig[czn]++;
-              React[cxn][cyn][czn] = 0;
-              extphase(AFM, cxn, cyn, czn);
-              ptest = (Molarv[AFM] / Molarv[C3AH6]) - 2.0;
-              if (ran1(Seed) < ptest) {
-                extphase(AFM, cxn, cyn, czn);
-              }
-              ptest = (Molarv[BRUCITE] / Molarv[C3AH6]);
-              if (ran1(Seed) < ptest) {
-                extphase(BRUCITE, cxn, cyn, czn);
-              }
-
-              /* deplete CH as needed */
-
-              ptest = (Molarv[CH] / Molarv[C3AH6]);
-              if (ran1(Seed) < ptest) {
-                removech(cxn, cyn, czn);
-              }
-              Nrc3ah6[czn]++;
-            }
-
-            Ndiff[antz]--;
-            ich = (-1);
-          }
-        } else if (phid == AFMC) {
-          ich = 0;
-          if ((ran1(Seed) < preact) && (React[cxn][cyn][czn] < SPERAFMC)) {
-
-            React[cxn][cyn][czn]++;
-
-            if (React[cxn][cyn][czn] == SPERAFMC) {
-              Mic[cxn][cyn][czn] = ETTR;
-              React[cxn][cyn][czn] = 0;
-              Ettrorig[czn]++;
-              extphase(ETTR, cxn, cyn, czn);
-              ptest = (Molarv[ETTR] / Molarv[AFMC]) - 2.0;
-              if (ran1(Seed) < ptest) {
-                extphase(ETTR, cxn, cyn, czn);
-              }
-              ptest = (Molarv[CACO3] / Molarv[AFMC]);
-              if (ran1(Seed) < ptest) {
-                extphase(CACO3, cxn, cyn, czn);
-              }
-              ptest = 3. * (Molarv[BRUCITE] / Molarv[AFMC]);
-              if (ran1(Seed) < ptest) {
-                extphase(BRUCITE, cxn, cyn, czn);
-              }
-              ptest = (3. * Molarv[CH] / Molarv[AFMC]);
-              if (ran1(Seed) < ptest) {
-                removech(cxn, cyn, czn);
-              }
-
-              Nrafmc[czn]++;
-            }
-
-            Ndiff[antz]--;
-            ich = (-1);
-          }
-
-          /***
-           *	CH is only reactive after AFM
-           *	has been locally 85% consumed
-           ***/
-
-        } else if ((phid == CH) && (Nrafm[czn] > (Afmorig[czn] * 0.85)) &&
-                   (Nrafmc[czn] > (Afmcorig[czn] * 0.85))) {
-
-          ich = 0;
-          if ((ran1(Seed) < preact) && (React[cxn][cyn][czn] < SPERCH)) {
-
-            React[cxn][cyn][czn]++;
-            if (React[cxn][cyn][czn] == SPERCH) {
-              Mic[cxn][cyn][czn] = GYPSUM;
-              React[cxn][cyn][czn] = 0;
-              Gypsumorig[czn]++;
-              extphase(GYPSUM, cxn, cyn, czn);
-              ptest = (Molarv[GYPSUM] / Molarv[CH]) - 2.0;
-              if (ran1(Seed) < ptest) {
-                extphase(GYPSUM, cxn, cyn, czn);
-              }
-              ptest = (Molarv[BRUCITE] / Molarv[CH]);
-              if (ran1(Seed) < ptest) {
-                extphase(BRUCITE, cxn, cyn, czn);
-              }
-              Nrch[czn]++;
-            }
-            Ndiff[antz]--;
-            ich = (-1);
-          }
-        }
-      }
-
-      /* Ant stays where it is */
-
-      if (ich == 0) {
-        cxn = antx;
-        cyn = anty;
-        czn = antz;
+    if (Band > 0) {
+      for (iz = Zcont; iz < Zsyssize + 1; iz++) {
+        Nabove[iz] += (double)Ndiff[iz];
+        Nbelow[iz] += (double)Ndiff[iz + 1];
       }
+    }
 
-      /* Ant moves to new location */
-
-      if (ich >= 0) {
-        Ndiff[antz]--;
-        Ndiff[czn]++;
-
-        /* If not adsorbed, update ant data structure */
+    moveserial();
 
-        nleft++;
-        Xnew[nleft] = cxn;
-        Ynew[nleft] = cyn;
-        Znew[nleft] = czn;
-      }
+    if (Band > 0) {
+      advancefront();
+      if (Zcont > 0)
+        continuum();
     }
 
-    Ntotdiff = nleft;
-
     /***
-     *	Output the microstructure every outfreq cycles
+     *	Output the microstructure every outfreq cycles,
+     *	except with --window, which does not hold it
      ***/
 
-    if (icyc > 0 && (icyc % outfreq == 0)) {
+    if (!Window && icyc > 0 && (icyc % outfreq == 0)) {
 
       strcpy(buff, fileout);
       sprintf(strsuff, ".%d-%d", icyc, ncyc);
@@ -733,11 +656,12 @@ int main(void) {
 
       for (iz = 1; iz < Zsyssize + 1; iz++) {
         for (iy = 0; iy < Ysyssize; iy++) {
-          for (ix = 0; ix < Xsyssize + 1; ix++) {
-            fprintf(newmic, "%d\n", Mic[ix][iy][iz]);
+          for (ix = 0; ix < Xsyssize; ix++) {
+            fprintf(newmic, "\n%d", Mic[ix][iy][iz]);
           }
         }
       }
+      fprintf(newmic, "\n");
 
       fclose(newmic);
     }
@@ -773,6 +697,20 @@ int main(void) {
   }
   fclose(plotfile);
 
+  /* With --window the rest of the layers go out to the image */
+
+  if (Window) {
+    if (layerwin_close(&Win)) {
+      bailout("sulfattack3d", "Error writing microstructure image");
+      freeallmem();
+      exit(1);
+    }
+    printf("At most %d of %d layers were held in memory\n", Win.maxheld,
+           Zsyssize + 2);
+    freeallmem();
+    return (0);
+  }
+
   newmic = filehandler("sulfattack3d", fileout, "WRITE");
   if (!newmic) {
     freeallmem();
@@ -794,10 +732,11 @@ int main(void) {
   for (iz = 1; iz < Zsyssize + 1; iz++) {
     for (iy = 0; iy < Ysyssize; iy++) {
       for (ix = 0; ix < Xsyssize; ix++) {
-        fprintf(newmic, "%d\n", Mic[ix][iy][iz]);
+        fprintf(newmic, "\n%d", Mic[ix][iy][iz]);
       }
     }
   }
+  fprintf(newmic, "\n");
 
   fclose(newmic);
 
@@ -806,150 +745,813 @@ int main(void) {
 }
 
 /***
- *	remsurf
+ *	antstep
  *
- *	Routine to remove diffusing ants from top layer to
- *	maintain proper concentration
+ *	Try to move an ant in layer antz into the neighboring
+ *	pixel (cxn,cyn,czn).  The ant may react there with
+ *	AFm, C3AH6, monocarbonate or CH instead of moving.
  *
- *	Arguments:	int nrem
- *	Returns:	Void
+ *	Arguments:	int layer of the ant
+ *				int coordinates of the pixel
+ *	Returns:	1 if the ant moves, 0 if it stays, -1 if it
+ *				was used by a reaction
+ *
+ *	Calls:		ran1, extphase, removech, chupdate
+ *	Called by:	moveserial, continuum
  ***/
-void remsurf(int nrem) {
-  int ngone, nrleft, il, nkeep;
-  char buff[MAXSTRING];
+int antstep(int antz, int cxn, int cyn, int czn) {
+  int phid, ich, iz;
+  float ptest;
+
+  ich = 1;
+
+  phid = Mic[cxn][cyn][czn];
+  if ((phid != POROSITY) && (phid != AFMC) && (phid != CSH) &&
+      (phid != CH) && (phid != AFM) && (phid != EMPTYP) &&
+      (phid != DRIEDP) && (phid != C3AH6) && (phid != POZZCSH) &&
+      (phid != SLAGCSH)) {
+    ich = 0;
+  }
+  if ((phid == CH) && (Nrafm[czn] < (Afmorig[czn] * 0.85)) &&
+      (Nrafmc[czn] < (Afmcorig[czn] * 0.85))) {
+    ich = 0;
+  } else if (phid == AFM) {
+    ich = 0;
+
+    /* Can't move, but can react */
+
+    if ((ran1(Seed) < Preact) && (React[cxn][cyn][czn] < SPERAFM)) {
+
+      React[cxn][cyn][czn]++;
+      if (React[cxn][cyn][czn] == SPERAFM) {
+        React[cxn][cyn][czn] = 0;
+        Mic[cxn][cyn][czn] = ETTR;
+        Ettrorig[czn]++;
+        extphase(ETTR, cxn, cyn, czn);
+        ptest = (Molarv[ETTR] / Molarv[AFM]) - 2.0;
+        if (ran1(Seed) < ptest) {
+          extphase(ETTR, cxn, cyn, czn);
+        }
+        ptest = (2.0 * Molarv[BRUCITE] / Molarv[AFM]);
+        if (ran1(Seed) < ptest) {
+          extphase(BRUCITE, cxn, cyn, czn);
+        }
 
-  nkeep = Ntotdiff;
-  nrleft = ngone = 0;
+        /* deplete CH as needed */
 
-  /***
-   *	Process all diffusing species and remove the
-   *	necessary number
-   ***/
+        ptest = (2.0 * Molarv[CH] / Molarv[AFM]);
+        if (ran1(Seed) < ptest) {
+          removech(cxn, cyn, czn);
+        }
+        Nrafm[czn]++;
+      }
+      Ndiff[antz]--;
+      ich = (-1);
+    }
+  } else if (phid == C3AH6) {
+    ich = 0;
+    if ((ran1(Seed) < Preact) && (React[cxn][cyn][czn] < SPERC3AH6)) {
+
+      React[cxn][cyn][czn]++;
+
+      if (React[cxn][cyn][czn] == SPERC3AH6) {
+        Mic[cxn][cyn][czn] = AFM;
+        Afmorig[czn]++;
+        React[cxn][cyn][czn] = 0;
+        extphase(AFM, cxn, cyn, czn);
+        ptest = (Molarv[AFM] / Molarv[C3AH6]) - 2.0;
+        if (ran1(Seed) < ptest) {
+          extphase(AFM, cxn, cyn, czn);
+        }
+        ptest = (Molarv[BRUCITE] / Molarv[C3AH6]);
+        if (ran1(Seed) < ptest) {
+          extphase(BRUCITE, cxn, cyn, czn);
+        }
 
-  for (il = 1; il <= nkeep; il++) {
-    if ((Znew[il] == 0) && (ngone < nrem)) {
+        /* deplete CH as needed */
 
-      /* Remove the diffusing ant */
+        ptest = (Molarv[CH] / Molarv[C3AH6]);
+        if (ran1(Seed) < ptest) {
+          removech(cxn, cyn, czn);
+        }
+        Nrc3ah6[czn]++;
+      }
 
-      ngone++;
-      Ntotdiff--;
-      Ndiff[0]--;
-    } else {
-      nrleft++;
-      Xnew[nrleft] = Xnew[il];
-      Ynew[nrleft] = Ynew[il];
-      Znew[nrleft] = Znew[il];
+      Ndiff[antz]--;
+      ich = (-1);
+    }
+  } else if (phid == AFMC) {
+    ich = 0;
+    if ((ran1(Seed) < Preact) && (React[cxn][cyn][czn] < SPERAFMC)) {
+
+      React[cxn][cyn][czn]++;
+
+      if (React[cxn][cyn][czn] == SPERAFMC) {
+        Mic[cxn][cyn][czn] = ETTR;
+        React[cxn][cyn][czn] = 0;
+        Ettrorig[czn]++;
+        extphase(ETTR, cxn, cyn, czn);
+        ptest = (Molarv[ETTR] / Molarv[AFMC]) - 2.0;
+        if (ran1(Seed) < ptest) {
+          extphase(ETTR, cxn, cyn, czn);
+        }
+        ptest = (Molarv[CACO3] / Molarv[AFMC]);
+        if (ran1(Seed) < ptest) {
+          extphase(CACO3, cxn, cyn, czn);
+        }
+        ptest = 3. * (Molarv[BRUCITE] / Molarv[AFMC]);
+        if (ran1(Seed) < ptest) {
+          extphase(BRUCITE, cxn, cyn, czn);
+        }
+        ptest = (3. * Molarv[CH] / Molarv[AFMC]);
+        if (ran1(Seed) < ptest) {
+          removech(cxn, cyn, czn);
+        }
+
+        Nrafmc[czn]++;
+      }
+
+      Ndiff[antz]--;
+      ich = (-1);
+    }
+
+    /***
+     *	CH is only reactive after AFM
+     *	has been locally 85% consumed
+     ***/
+
+  } else if ((phid == CH) && (Nrafm[czn] > (Afmorig[czn] * 0.85)) &&
+             (Nrafmc[czn] > (Afmcorig[czn] * 0.85))) {
+
+    ich = 0;
+    if ((ran1(Seed) < Preact) && (React[cxn][cyn][czn] < SPERCH)) {
+
+      React[cxn][cyn][czn]++;
+      if (React[cxn][cyn][czn] == SPERCH) {
+        Mic[cxn][cyn][czn] = GYPSUM;
+        React[cxn][cyn][czn] = 0;
+        Gypsumorig[czn]++;
+        extphase(GYPSUM, cxn, cyn, czn);
+        ptest = (Molarv[GYPSUM] / Molarv[CH]) - 2.0;
+        if (ran1(Seed) < ptest) {
+          extphase(GYPSUM, cxn, cyn, czn);
+        }
+        ptest = (Molarv[BRUCITE] / Molarv[CH]);
+        if (ran1(Seed) < ptest) {
+          extphase(BRUCITE, cxn, cyn, czn);
+        }
+        Nrch[czn]++;
+      }
+      chupdate(cxn, cyn, czn);
+      Ndiff[antz]--;
+      ich = (-1);
     }
   }
 
-  if (Nantsurf < Ndiff[0]) {
-    sprintf(buff, "Nantsurf = %d Ndiff[0] = %d", Nantsurf, Ndiff[0]);
-    freeallmem();
-    bailout("sulfattack3d", buff);
-    exit(1);
+  /* Start the crossing counts next to a layer over when it binds an ant */
+
+  if ((ich < 0) && Lastbind) {
+    Lastbind[czn] = Cycle;
+    for (iz = czn - 1; iz <= czn; iz++) {
+      if (iz >= 0)
+        Ndown[iz] = Nup[iz] = Nabove[iz] = Nbelow[iz] = 0.0;
+    }
   }
+
+  return (ich);
 }
 
 /***
- *	extphase
+ *	moveserial
  *
- *	Routine to add a pixel of solid phase phtomake near
- *	location (xcur,ycur,zcur) in a porosity pixel
+ *	Move each ant in turn one step
  *
- *	Arguments:	Phase id, location (xcur, ycur, zcur)
- *	Returns:	Void
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		ran1, antstep, countcross
+ *	Called by:	main
  ***/
-void extphase(int phtomake, int xcur, int ycur, int zcur) {
-  int xtry, ytry, ztry, xi, yi, found;
-  int tries = 0;
+void moveserial(void) {
+  int iant, norg, nleft, antx, anty, antz, cxn, cyn, czn, ich;
 
-  /* Try immediate neighborhod on same level */
+  nleft = 0;
+  norg = Ntotdiff;
 
-  xtry = xcur;
-  ytry = ycur;
-  ztry = zcur;
-  found = 0;
-  for (xi = (-2); ((xi <= 2) && (!found)); xi++) {
-    for (yi = (-2); ((yi <= 2) && (!found)); yi++) {
+  /* Move each ant in turn */
 
-      xtry = xcur + xi;
-      ytry = ycur + yi;
+  for (iant = 1; iant <= norg; iant++) {
 
-      /***
-       *	Apply periodic boundaries in x and y
-       *	directions as needed
-       ***/
+    /* Get current location of this ant */
 
-      xtry += checkbc(xtry, Xsyssize);
-      ytry += checkbc(ytry, Ysyssize);
+    antx = Xnew[iant];
+    anty = Ynew[iant];
+    antz = Znew[iant];
 
-      if ((Mic[xtry][ytry][ztry] == POROSITY) ||
-          (Mic[xtry][ytry][ztry] == EMPTYP) ||
-          (Mic[xtry][ytry][ztry] == DRIEDP)) {
-        found = 1;
-        Mic[xtry][ytry][ztry] = phtomake;
-      }
+    /***
+     *	Update location of ant based on a randomly
+     *	chosen direction
+     ***/
+
+    ich = 1 + (int)(6.0 * ran1(Seed));
+    if (ich > 6)
+      ich = 6;
+
+    cxn = antx;
+    cyn = anty;
+    czn = antz;
+
+    switch (ich) {
+    case 1:
+      cxn = antx - 1;
+      break;
+    case 2:
+      cxn = antx + 1;
+      break;
+    case 3:
+      cyn = anty - 1;
+      break;
+    case 4:
+      cyn = anty + 1;
+      break;
+    case 5:
+      czn = antz - 1;
+      break;
+    case 6:
+      czn = antz + 1;
+      break;
+    default:
+      break;
     }
-  }
 
-  /* Try above layer if needed */
+    /***
+     *	Adjust for periodic boundary conditions if necessary
+     ***/
 
-  if (!found) {
-    ztry = zcur - 1;
-    if (ztry > 0) {
-      found = 0;
-      for (xi = (-2); ((xi <= 2) && (!found)); xi++) {
-        for (yi = (-2); ((yi <= 2) && (!found)); yi++) {
+    cxn += checkbc(cxn, Xsyssize);
+    cyn += checkbc(cyn, Ysyssize);
 
-          xtry = xcur + xi;
-          ytry = ycur + yi;
+    /* Don't let ants leave via the top surface */
 
-          /***
-           *	Apply periodic boundaries in x and y
-           *	directions as needed
-           ***/
+    if (czn < 0)
+      ich = 0;
 
-          xtry += checkbc(xtry, Xsyssize);
-          ytry += checkbc(ytry, Ysyssize);
+    if (ich != 0)
+      ich = antstep(antz, cxn, cyn, czn);
 
-          if ((Mic[xtry][ytry][ztry] == POROSITY) ||
-              (Mic[xtry][ytry][ztry] == EMPTYP) ||
-              (Mic[xtry][ytry][ztry] == DRIEDP)) {
-            found = 1;
-            Mic[xtry][ytry][ztry] = phtomake;
-          }
-        }
-      }
+    /* Ant stays where it is */
+
+    if (ich == 0) {
+      cxn = antx;
+      cyn = anty;
+      czn = antz;
     }
-  }
 
-  /* Try below layer if needed */
+    /* Ant moves to new location */
 
-  if (!found) {
-    ztry = zcur + 1;
-    if (ztry < Zsyssize + 1) {
-      found = 0;
-      for (xi = (-2); ((xi <= 2) && (!found)); xi++) {
-        for (yi = (-2); ((yi <= 2) && (!found)); yi++) {
+    if (ich >= 0) {
+      Ndiff[antz]--;
+      Ndiff[czn]++;
+      if (Ndown)
+        countcross(antz, czn);
 
-          xtry = xcur + xi;
-          ytry = ycur + yi;
+      /* If not adsorbed, update ant data structure */
 
-          /***
-           *	Apply periodic boundaries in x and y
-           *	directions as needed
-           ***/
+      nleft++;
+      Xnew[nleft] = cxn;
+      Ynew[nleft] = cyn;
+      Znew[nleft] = czn;
+    }
+  }
 
-          xtry += checkbc(xtry, Xsyssize);
-          ytry += checkbc(ytry, Ysyssize);
+  Ntotdiff = nleft;
 
-          if ((Mic[xtry][ytry][ztry] == POROSITY) ||
-              (Mic[xtry][ytry][ztry] == EMPTYP) ||
-              (Mic[xtry][ytry][ztry] == DRIEDP)) {
-            found = 1;
-            Mic[xtry][ytry][ztry] = phtomake;
-          }
-        }
+  return;
+}
+
+/***
+ *	canhold
+ *
+ *	Whether an ant can move into (and sit in) a pixel of
+ *	a phase in a layer.  CH lets ants through in a layer
+ *	where it is neither kept back by unreacted AFm nor
+ *	free to react, as in antstep.
+ *
+ *	Arguments:	int phase id, int layer
+ *	Returns:	1 if it can, 0 otherwise
+ *
+ *	Calls:		no routines
+ *	Called by:	openfrac, continuum
+ ***/
+int canhold(int phid, int iz) {
+  if ((phid == POROSITY) || (phid == CSH) || (phid == EMPTYP) ||
+      (phid == DRIEDP) || (phid == POZZCSH) || (phid == SLAGCSH)) {
+    return (1);
+  }
+  if ((phid == CH) &&
+      !((Nrafm[iz] < (Afmorig[iz] * 0.85)) &&
+        (Nrafmc[iz] < (Afmcorig[iz] * 0.85))) &&
+      !((Nrafm[iz] > (Afmorig[iz] * 0.85)) &&
+        (Nrafmc[iz] > (Afmcorig[iz] * 0.85)))) {
+    return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	openfrac
+ *
+ *	Fraction of the pixels in a layer that an ant can
+ *	sit in
+ *
+ *	Arguments:	int layer
+ *	Returns:	double fraction
+ *
+ *	Calls:		canhold
+ *	Called by:	advancefront
+ ***/
+double openfrac(int iz) {
+  int ix, iy, nopen;
+
+  nopen = 0;
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      nopen += canhold(Mic[ix][iy][iz], iz);
+    }
+  }
+
+  return ((double)nopen / Layer_volume);
+}
+
+/***
+ *	countcross
+ *
+ *	Count an ant that moved between two layers.  Called
+ *	only for the --band mode, once the crossing counts
+ *	have been allocated.
+ *
+ *	Arguments:	int old layer, int new layer
+ *	Returns:	Nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	moveserial
+ ***/
+void countcross(int zold, int znew) {
+  if (znew > zold) {
+    Ndown[zold] += 1.0;
+  } else if (znew < zold) {
+    Nup[znew] += 1.0;
+  }
+
+  return;
+}
+
+/***
+ *	advancefront
+ *
+ *	Move the reaction front down a layer once the layer
+ *	at the front is spent: for QUIETCYCLES cycles it has
+ *	held at least a tenth of the ants it would hold at
+ *	the surface concentration, and nothing in it has
+ *	bound one.  The layers more than Band above the
+ *	front join the continuum, taking their ants with
+ *	them.
+ *
+ *	The conductance between two layers of the continuum
+ *	is the net number of ants that crossed it since
+ *	either layer last bound one, over the sum of the
+ *	differences in ants per open pixel across it, so it
+ *	includes the tortuosity of the pores.  If that net
+ *	flow is lost in the noise, the conductance comes
+ *	from the rates at which ants crossed each way
+ *	instead (an upper bound, since many ants step
+ *	straight back).
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		openfrac, absorbants
+ *	Called by:	main
+ ***/
+void advancefront(void) {
+  int zf, znew, iz;
+  double gmax, net, grad;
+
+  zf = Zspent + 1;
+  if (zf > Zsyssize)
+    return;
+  if (Ndiff[zf] < 0.1 * Nantsurf * openfrac(zf)) {
+    Lastbind[zf] = Cycle;
+    Ndown[zf - 1] = Nup[zf - 1] = Nabove[zf - 1] = Nbelow[zf - 1] = 0.0;
+    Ndown[zf] = Nup[zf] = Nabove[zf] = Nbelow[zf] = 0.0;
+    return;
+  }
+  if (Cycle - Lastbind[zf] < QUIETCYCLES)
+    return;
+
+  Zspent = zf;
+  znew = Zspent + 1 - Band;
+  if (znew <= Zcont)
+    return;
+
+  for (iz = Zcont; iz <= znew; iz++) {
+    Open[iz] = (iz > 0) ? openfrac(iz) : 1.0;
+    if (Open[iz] <= 0.0)
+      Open[iz] = 1.0 / Layer_volume;
+  }
+  for (iz = Zcont; iz < znew; iz++) {
+    if ((Nabove[iz] > 0.0) && (Nbelow[iz] > 0.0)) {
+      gmax = 0.5 * (Open[iz] * Ndown[iz] / Nabove[iz] +
+                    Open[iz + 1] * Nup[iz] / Nbelow[iz]);
+    } else {
+      gmax = Open[iz] * Open[iz + 1] / 6.0;
+    }
+    Gcross[iz] = gmax;
+    net = Ndown[iz] - Nup[iz];
+    grad = Nabove[iz] / Open[iz] - Nbelow[iz] / Open[iz + 1];
+    if ((net > 3.0 * sqrt(Ndown[iz] + Nup[iz])) && (grad > 0.0) &&
+        (net / grad < gmax)) {
+      Gcross[iz] = net / grad;
+    }
+    Conc[iz] = 0.0;
+  }
+  Zcont = znew;
+  absorbants();
+  printf("Cycle %d: layers 0 to %d solved as a continuum\n", Cycle,
+         Zcont - 1);
+  fflush(stdout);
+
+  return;
+}
+
+/***
+ *	continuum
+ *
+ *	One cycle of the layers above the band, as a 1-D
+ *	finite-volume diffusion with the flux from layer z
+ *	to z+1 equal to
+ *	Gcross[z] (C[z] / Open[z] - C[z+1] / Open[z+1]).
+ *	The ants that step down out of the last continuum layer
+ *	become ants again at the top of the band, where
+ *	they may still react.  Ants that moved up out of the
+ *	band this cycle join the layer they reached after
+ *	that, since they have already had their step.  The
+ *	surface layer stays at Nantsurf.
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		ran1, antstep, canhold, growants, absorbants
+ *	Called by:	main
+ ***/
+void continuum(void) {
+  int iz, zb, ix, iy, tries, ihop, nhop, ich;
+  double hops;
+
+  for (iz = 0; iz < Zcont - 1; iz++) {
+    Flux[iz] =
+        Gcross[iz] * (Conc[iz] / Open[iz] - Conc[iz + 1] / Open[iz + 1]);
+  }
+
+  /***
+   *	A sixth of the ants in the last continuum layer try
+   *	to step down into the band, each from a pixel there
+   *	that can hold it, just as the ants in the band step
+   *	up out of it
+   ***/
+
+  zb = Zcont - 1;
+  hops = Conc[zb] / 6.0;
+  nhop = (int)hops;
+  if (ran1(Seed) < hops - nhop)
+    nhop++;
+
+  for (ihop = 0; ihop < nhop; ihop++) {
+    ix = iy = 0;
+    for (tries = 0; tries < (int)Layer_volume; tries++) {
+      ix = (int)((float)Xsyssize * ran1(Seed));
+      iy = (int)((float)Ysyssize * ran1(Seed));
+      if (ix >= Xsyssize)
+        ix = Xsyssize - 1;
+      if (iy >= Ysyssize)
+        iy = Ysyssize - 1;
+      if (canhold(Mic[ix][iy][zb], zb))
+        break;
+    }
+    if (tries == (int)Layer_volume)
+      break;
+
+    ich = antstep(zb, ix, iy, Zcont);
+    if (ich != 0)
+      Conc[zb] -= 1.0;
+    if (ich > 0) {
+      growants(Ntotdiff + 1);
+      Ntotdiff++;
+      Xnew[Ntotdiff] = ix;
+      Ynew[Ntotdiff] = iy;
+      Znew[Ntotdiff] = Zcont;
+      Ndiff[Zcont]++;
+    }
+  }
+
+  absorbants();
+
+  for (iz = 0; iz < Zcont - 1; iz++) {
+    Conc[iz] -= Flux[iz];
+    Conc[iz + 1] += Flux[iz];
+  }
+  Conc[0] = (double)Nantsurf;
+
+  for (iz = 0; iz < Zcont; iz++) {
+    if (Conc[iz] < 0.0)
+      Conc[iz] = 0.0;
+    Ndiff[iz] = (int)(Conc[iz] + 0.5);
+  }
+
+  return;
+}
+
+/***
+ *	absorbants
+ *
+ *	Add the ants above the band to the continuum layers
+ *	they are in
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	advancefront, continuum
+ ***/
+void absorbants(void) {
+  int iant, nleft;
+
+  nleft = 0;
+  for (iant = 1; iant <= Ntotdiff; iant++) {
+    if (Znew[iant] < Zcont) {
+      Conc[Znew[iant]] += 1.0;
+    } else {
+      nleft++;
+      Xnew[nleft] = Xnew[iant];
+      Ynew[nleft] = Ynew[iant];
+      Znew[nleft] = Znew[iant];
+    }
+  }
+  Ntotdiff = nleft;
+
+  return;
+}
+
+/***
+ *	slide
+ *
+ *	For --window, move the window of layers down so that
+ *	it holds every layer the next cycle can touch: from
+ *	WINMARGIN above the continuum, which an ant stepping
+ *	out of the band can reach, to WINMARGIN below the
+ *	deepest ant, or below layer zdeep if that is deeper.
+ *	The CH lists go and come with the layers.
+ *
+ *	Arguments:	int layer that must be held whatever the ants
+ *	Returns:	Nothing
+ *
+ *	Calls:		layerwin_need, chdrop, chlayer, freeallmem,
+ *				bailout
+ *	Called by:	main
+ ***/
+void slide(int zdeep) {
+  int iant, iz, zlow, zhigh;
+
+  for (iant = 1; iant <= Ntotdiff; iant++) {
+    if (Znew[iant] > zdeep)
+      zdeep = Znew[iant];
+  }
+
+  zlow = Win.zlow;
+  zhigh = Win.zhigh;
+  if (layerwin_need(&Win, Zcont - WINMARGIN, zdeep + WINMARGIN)) {
+    freeallmem();
+    bailout("sulfattack3d", "Memory allocation failure");
+    exit(1);
+  }
+
+  for (iz = zlow; iz < Win.zlow && iz <= zhigh; iz++) {
+    chdrop(iz);
+  }
+  for (iz = (zhigh + 1 > Win.zlow) ? zhigh + 1 : Win.zlow; iz <= Win.zhigh;
+       iz++) {
+    if (chlayer(iz)) {
+      freeallmem();
+      bailout("sulfattack3d", "Memory allocation failure");
+      exit(1);
+    }
+  }
+
+  return;
+}
+
+/***
+ *	growants
+ *
+ *	Make room for ants 1 to nants, doubling the ant
+ *	arrays as many times as needed
+ *
+ *	Arguments:	int number of ants
+ *	Returns:	Nothing
+ *
+ *	Calls:		regrow
+ *	Called by:	main, continuum
+ ***/
+void growants(int nants) {
+  size_t newcap;
+
+  if (nants < Antcap)
+    return;
+
+  newcap = 2 * (size_t)Antcap;
+  if (newcap <= (size_t)nants)
+    newcap = (size_t)nants + 1;
+
+  Xnew = (short int *)regrow(Xnew, newcap * sizeof(short int));
+  Ynew = (short int *)regrow(Ynew, newcap * sizeof(short int));
+  Znew = (short int *)regrow(Znew, newcap * sizeof(short int));
+  Antcap = (int)newcap;
+
+  return;
+}
+
+/***
+ *	regrow
+ *
+ *	Resize one of the ant arrays, giving up if there
+ *	is not enough memory
+ *
+ *	Arguments:	void pointer to the array, size_t new size
+ *				in bytes
+ *	Returns:	void pointer to the resized array
+ *
+ *	Calls:		freeallmem, bailout
+ *	Called by:	growants
+ ***/
+void *regrow(void *p, size_t size) {
+  void *q;
+
+  q = realloc(p, size);
+  if (!q) {
+    freeallmem();
+    bailout("sulfattack3d", "Memory allocation error");
+    exit(1);
+  }
+
+  return (q);
+}
+
+/***
+ *	remsurf
+ *
+ *	Routine to remove diffusing ants from top layer to
+ *	maintain proper concentration
+ *
+ *	Arguments:	int nrem
+ *	Returns:	Void
+ ***/
+void remsurf(int nrem) {
+  int ngone, nrleft, il, nkeep;
+  char buff[MAXSTRING];
+
+  nkeep = Ntotdiff;
+  nrleft = ngone = 0;
+
+  /***
+   *	Process all diffusing species and remove the
+   *	necessary number
+   ***/
+
+  for (il = 1; il <= nkeep; il++) {
+    if ((Znew[il] == 0) && (ngone < nrem)) {
+
+      /* Remove the diffusing ant */
+
+      ngone++;
+      Ntotdiff--;
+      Ndiff[0]--;
+    } else {
+      nrleft++;
+      Xnew[nrleft] = Xnew[il];
+      Ynew[nrleft] = Ynew[il];
+      Znew[nrleft] = Znew[il];
+    }
+  }
+
+  if (Nantsurf < Ndiff[0]) {
+    sprintf(buff, "Nantsurf = %d Ndiff[0] = %d", Nantsurf, Ndiff[0]);
+    freeallmem();
+    bailout("sulfattack3d", buff);
+    exit(1);
+  }
+}
+
+/***
+ *	extphase
+ *
+ *	Routine to add a pixel of solid phase phtomake near
+ *	location (xcur,ycur,zcur) in a porosity pixel
+ *
+ *	Arguments:	Phase id, location (xcur, ycur, zcur)
+ *	Returns:	Void
+ ***/
+void extphase(int phtomake, int xcur, int ycur, int zcur) {
+  int xtry, ytry, ztry, xi, yi, found;
+  int tries = 0;
+
+  /* Try immediate neighborhod on same level */
+
+  xtry = xcur;
+  ytry = ycur;
+  ztry = zcur;
+  found = 0;
+  for (xi = (-2); ((xi <= 2) && (!found)); xi++) {
+    for (yi = (-2); ((yi <= 2) && (!found)); yi++) {
+
+      xtry = xcur + xi;
+      ytry = ycur + yi;
+
+      /***
+       *	Apply periodic boundaries in x and y
+       *	directions as needed
+       ***/
+
+      xtry += checkbc(xtry, Xsyssize);
+      ytry += checkbc(ytry, Ysyssize);
+
+      if ((Mic[xtry][ytry][ztry] == POROSITY) ||
+          (Mic[xtry][ytry][ztry] == EMPTYP) ||
+          (Mic[xtry][ytry][ztry] == DRIEDP)) {
+        found = 1;
+        Mic[xtry][ytry][ztry] = phtomake;
+      }
+    }
+  }
+
+  /* Try above layer if needed */
+
+  if (!found) {
+    ztry = zcur - 1;
+    if (ztry > 0) {
+      found = 0;
+      for (xi = (-2); ((xi <= 2) && (!found)); xi++) {
+        for (yi = (-2); ((yi <= 2) && (!found)); yi++) {
+
+          xtry = xcur + xi;
+          ytry = ycur + yi;
+
+          /***
+           *	Apply periodic boundaries in x and y
+           *	directions as needed
+           ***/
+
+          xtry += checkbc(xtry, Xsyssize);
+          ytry += checkbc(ytry, Ysyssize);
+
+          if ((Mic[xtry][ytry][ztry] == POROSITY) ||
+              (Mic[xtry][ytry][ztry] == EMPTYP) ||
+              (Mic[xtry][ytry][ztry] == DRIEDP)) {
+            found = 1;
+            Mic[xtry][ytry][ztry] = phtomake;
+          }
+        }
+      }
+    }
+  }
+
+  /* Try below layer if needed */
+
+  if (!found) {
+    ztry = zcur + 1;
+    if (ztry < Zsyssize + 1) {
+      found = 0;
+      for (xi = (-2); ((xi <= 2) && (!found)); xi++) {
+        for (yi = (-2); ((yi <= 2) && (!found)); yi++) {
+
+          xtry = xcur + xi;
+          ytry = ycur + yi;
+
+          /***
+           *	Apply periodic boundaries in x and y
+           *	directions as needed
+           ***/
+
+          xtry += checkbc(xtry, Xsyssize);
+          ytry += checkbc(ytry, Ysyssize);
+
+          if ((Mic[xtry][ytry][ztry] == POROSITY) ||
+              (Mic[xtry][ytry][ztry] == EMPTYP) ||
+              (Mic[xtry][ytry][ztry] == DRIEDP)) {
+            found = 1;
+            Mic[xtry][ytry][ztry] = phtomake;
+          }
+        }
       }
     }
   }
@@ -1058,68 +1660,45 @@ void extphase(int phtomake, int xcur, int ycur, int zcur) {
  *
  *	distchreac
  *
- *	Routine to
+ *	Routine to pass one unit of reaction from a CH
+ *	pixel that has been removed to another CH pixel
+ *	that can still take it, chosen at random on the
+ *	same layer, or failing that the layer above or
+ *	below
  *
  *	Arguments:	Integer z coordinate
  *	Returns:	Integer found (0 if failure, 1 if success)
  *
+ *	Calls:		chpick, chupdate
+ *	Called by:	removech
  ***/
 int distchreac(int ztodo) {
-  int xtry, ytry, ztry, found = 0, tries = 0;
+  int xtry, ytry, ztry, found = 0;
 
   /* Try at random on same layer */
 
   ztry = ztodo;
-
-  while ((tries < (int)Layer_volume) && (!found)) {
-    tries++;
-    xtry = Xsyssize * ran1(Seed);
-    ytry = Ysyssize * ran1(Seed);
-    if ((Mic[xtry][ytry][ztry] == CH) &&
-        (React[xtry][ytry][ztry] < (SPERCH - 1))) {
-
-      found = 1;
-      React[xtry][ytry][ztry]++;
-    }
-  }
+  found = chpick(ztry, 1, &xtry, &ytry);
 
   /* Try at random on layer above */
 
   if (!found) {
     ztry = ztodo - 1;
-    tries = 0;
-    if (ztry > 0) {
-      while ((tries < (int)Layer_volume) && (!found)) {
-        tries++;
-        xtry = Xsyssize * ran1(Seed);
-        ytry = Ysyssize * ran1(Seed);
-        if ((Mic[xtry][ytry][ztry] == CH) &&
-            (React[xtry][ytry][ztry] < (SPERCH - 1))) {
-
-          found = 1;
-          React[xtry][ytry][ztry]++;
-        }
-      }
-    }
+    if (ztry > 0)
+      found = chpick(ztry, 1, &xtry, &ytry);
   }
 
   /* Try at random on layer below */
 
   if (!found) {
     ztry = ztodo + 1;
-    tries = 0;
-    if (ztry < Zsyssize + 1) {
-      while ((tries < (int)Layer_volume) && (!found)) {
-        tries++;
-        xtry = Xsyssize * ran1(Seed);
-        ytry = Ysyssize * ran1(Seed);
-        if ((Mic[xtry][ytry][ztry] == CH) &&
-            (React[xtry][ytry][ztry] < (SPERCH - 1))) {
-          found = 1;
-          React[xtry][ytry][ztry]++;
-        }
-      }
-    }
+    if (ztry < Zsyssize + 1)
+      found = chpick(ztry, 1, &xtry, &ytry);
+  }
+
+  if (found) {
+    React[xtry][ytry][ztry]++;
+    chupdate(xtry, ytry, ztry);
   }
 
   return (found);
@@ -1137,7 +1716,6 @@ int distchreac(int ztodo) {
  ***/
 void removech(int xcur, int ycur, int zcur) {
   int xtry, ytry, ztry, xi, yi, found, remflag;
-  int tries = 0;
 
   /* Try immediate neighborhod on same level */
 
@@ -1225,69 +1803,30 @@ void removech(int xcur, int ycur, int zcur) {
     }
   }
 
-  if (!found) {
-
-    /* Try at random on same layer */
+  /* Try at random on the same layer, then above, then below */
 
+  if (!found) {
     ztry = zcur;
-    while ((tries < (int)Layer_volume) && (!found)) {
-      tries++;
-      xtry = Xsyssize * ran1(Seed);
-      ytry = Ysyssize * ran1(Seed);
-      if (Mic[xtry][ytry][ztry] == CH) {
-        found = 1;
-        Mic[xtry][ytry][ztry] = POROSITY;
-        Nrch[ztry]++;
-        Nrcap[ztry]++;
-      }
+    found = chpick(ztry, 0, &xtry, &ytry);
+    if (!found && (zcur - 1 > 0)) {
+      ztry = zcur - 1;
+      found = chpick(ztry, 0, &xtry, &ytry);
     }
-  }
-
-  if (!found) {
-
-    /* Try at random on layer above */
-
-    ztry = zcur - 1;
-    tries = 0;
-    if (ztry > 0) {
-      while ((tries < (int)Layer_volume) && (!found)) {
-        tries++;
-        xtry = Xsyssize * ran1(Seed);
-        ytry = Ysyssize * ran1(Seed);
-        if (Mic[xtry][ytry][ztry] == CH) {
-          found = 1;
-          Mic[xtry][ytry][ztry] = POROSITY;
-          Nrch[ztry]++;
-          Nrcap[ztry]++;
-        }
-      }
+    if (!found && (zcur + 1 < Zsyssize + 1)) {
+      ztry = zcur + 1;
+      found = chpick(ztry, 0, &xtry, &ytry);
     }
-  }
-
-  if (!found) {
-
-    /* Try at random on layer below */
-
-    ztry = zcur + 1;
-    tries = 0;
-    if (ztry < Zsyssize + 1) {
-      while ((tries < (int)Layer_volume) && (!found)) {
-        tries++;
-        xtry = Xsyssize * ran1(Seed);
-        ytry = Ysyssize * ran1(Seed);
-        if (Mic[xtry][ytry][ztry] == CH) {
-          found = 1;
-          Mic[xtry][ytry][ztry] = POROSITY;
-          Nrch[ztry]++;
-          Nrcap[ztry]++;
-        }
-      }
+    if (found) {
+      Mic[xtry][ytry][ztry] = POROSITY;
+      Nrch[ztry]++;
+      Nrcap[ztry]++;
     }
   }
 
   if (!found) {
     Noch[zcur]++;
   } else {
+    chupdate(xtry, ytry, ztry);
 
     /* Account for partially reacted CH pixels */
 
@@ -1302,6 +1841,197 @@ void removech(int xcur, int ycur, int zcur) {
   }
 }
 
+/***
+ *	chlistinit
+ *
+ *	Put every CH pixel in the list for its layer.  No
+ *	pixel has reacted yet, so all of them can take a
+ *	reaction from distchreac.
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls:		chlayer, freeallmem, bailout
+ *	Called by:	main
+ ***/
+void chlistinit(void) {
+  int iz;
+
+  for (iz = 0; iz < Zsyssize + 2; iz++) {
+    if (chlayer(iz)) {
+      freeallmem();
+      bailout("sulfattack3d", "Memory allocation failure");
+      exit(1);
+    }
+  }
+
+  return;
+}
+
+/***
+ *	chlayer
+ *
+ *	Make the CH list of one layer, with every CH pixel
+ *	in it, all of them able to take a reaction from
+ *	distchreac
+ *
+ *	Arguments:	int layer
+ *	Returns:	0 if okay, 1 if out of memory
+ *
+ *	Calls:		ivector
+ *	Called by:	chlistinit, slide
+ ***/
+int chlayer(int iz) {
+  int ix, iy, nch, cell;
+
+  nch = 0;
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      if (Mic[ix][iy][iz] == CH)
+        nch++;
+    }
+  }
+
+  Chlist[iz] = ivector(nch + 1);
+  Chpos[iz] = ivector((size_t)Xsyssize * Ysyssize);
+  if (!Chlist[iz] || !Chpos[iz])
+    return (1);
+
+  Nchlist[iz] = 0;
+  for (ix = 0; ix < Xsyssize; ix++) {
+    for (iy = 0; iy < Ysyssize; iy++) {
+      cell = ix * Ysyssize + iy;
+      Chpos[iz][cell] = -1;
+      if (Mic[ix][iy][iz] == CH) {
+        Chpos[iz][cell] = Nchlist[iz];
+        Chlist[iz][Nchlist[iz]] = cell;
+        Nchlist[iz]++;
+      }
+    }
+  }
+  Nchfree[iz] = Nchlist[iz];
+
+  return (0);
+}
+
+/***
+ *	chdrop
+ *
+ *	Release the CH list of one layer
+ *
+ *	Arguments:	int layer
+ *	Returns:	Nothing
+ *
+ *	Calls:		free_ivector
+ *	Called by:	slide, freeallmem
+ ***/
+void chdrop(int iz) {
+  if (Chlist[iz])
+    free_ivector(Chlist[iz]);
+  if (Chpos[iz])
+    free_ivector(Chpos[iz]);
+  Chlist[iz] = Chpos[iz] = NULL;
+  Nchlist[iz] = Nchfree[iz] = 0;
+
+  return;
+}
+
+/***
+ *	chpick
+ *
+ *	Choose a CH pixel in a layer at random
+ *
+ *	Arguments:	int layer, int flag (1 to choose only among the
+ *				pixels that can still take a reaction from
+ *				distchreac), int pointers to x and y
+ *	Returns:	1 if there was one to choose, 0 otherwise
+ *
+ *	Calls:		ran1
+ *	Called by:	distchreac, removech
+ ***/
+int chpick(int iz, int onlyfree, int *xp, int *yp) {
+  int n, k, cell;
+
+  n = onlyfree ? Nchfree[iz] : Nchlist[iz];
+  if (n <= 0)
+    return (0);
+
+  k = (int)((float)n * ran1(Seed));
+  if (k >= n)
+    k = n - 1;
+  cell = Chlist[iz][k];
+  *xp = cell / Ysyssize;
+  *yp = cell % Ysyssize;
+
+  return (1);
+}
+
+/***
+ *	chupdate
+ *
+ *	Move a pixel within the CH list of its layer after
+ *	its React count changes, or take it out of the
+ *	list once it is no longer CH
+ *
+ *	Arguments:	int coordinates of the pixel
+ *	Returns:	Nothing
+ *
+ *	Calls:		chswap
+ *	Called by:	antstep, distchreac, removech
+ ***/
+void chupdate(int ix, int iy, int iz) {
+  int k;
+
+  k = Chpos[iz][ix * Ysyssize + iy];
+  if (k < 0)
+    return;
+
+  if (Mic[ix][iy][iz] != CH) {
+    if (k < Nchfree[iz]) {
+      chswap(iz, k, Nchfree[iz] - 1);
+      Nchfree[iz]--;
+      k = Nchfree[iz];
+    }
+    chswap(iz, k, Nchlist[iz] - 1);
+    Nchlist[iz]--;
+    Chpos[iz][ix * Ysyssize + iy] = -1;
+  } else if (React[ix][iy][iz] < (SPERCH - 1)) {
+    if (k >= Nchfree[iz]) {
+      chswap(iz, k, Nchfree[iz]);
+      Nchfree[iz]++;
+    }
+  } else if (k < Nchfree[iz]) {
+    chswap(iz, k, Nchfree[iz] - 1);
+    Nchfree[iz]--;
+  }
+
+  return;
+}
+
+/***
+ *	chswap
+ *
+ *	Swap two places in the CH list of a layer
+ *
+ *	Arguments:	int layer, int places i and j
+ *	Returns:	Nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	chupdate
+ ***/
+void chswap(int iz, int i, int j) {
+  int a, b;
+
+  a = Chlist[iz][i];
+  b = Chlist[iz][j];
+  Chlist[iz][i] = b;
+  Chlist[iz][j] = a;
+  Chpos[iz][a] = j;
+  Chpos[iz][b] = i;
+
+  return;
+}
+
 /***
  *	allmem
  *
@@ -1316,8 +2046,10 @@ void removech(int xcur, int ycur, int zcur) {
  *
  ***/
 void allmem(void) {
-  Mic = sibox(Xsyssize + 2, Ysyssize + 2, Zsyssize + 2);
-  React = sibox(Xsyssize + 2, Ysyssize + 2, Zsyssize + 2);
+  if (!Window) {
+    Mic = sibox(Xsyssize + 2, Ysyssize + 2, Zsyssize + 2);
+    React = sibox(Xsyssize + 2, Ysyssize + 2, Zsyssize + 2);
+  }
   Ndiff = ivector(Zsyssize + 2);
   Nrch = ivector(Zsyssize + 2);
   Nrafm = ivector(Zsyssize + 2);
@@ -1339,15 +2071,40 @@ void allmem(void) {
   Strainbrucite = fvector(Zsyssize + 2);
   Strainettr = fvector(Zsyssize + 2);
   Strainafm = fvector(Zsyssize + 2);
-  Xnew = sivector(NUMANTS * Isizemag);
-  Ynew = sivector(NUMANTS * Isizemag);
-  Znew = sivector(NUMANTS * Isizemag);
+  Chlist = (int **)calloc(Zsyssize + 2, sizeof(int *));
+  Chpos = (int **)calloc(Zsyssize + 2, sizeof(int *));
+  Nchlist = ivector(Zsyssize + 2);
+  Nchfree = ivector(Zsyssize + 2);
+  Antcap = NUMANTS * Isizemag;
+  if (Antcap < 2)
+    Antcap = 2;
+  Xnew = sivector(Antcap);
+  Ynew = sivector(Antcap);
+  Znew = sivector(Antcap);
+  if (Band > 0) {
+    Conc = dvector(Zsyssize + 2);
+    Flux = dvector(Zsyssize + 2);
+    Open = dvector(Zsyssize + 2);
+    Gcross = dvector(Zsyssize + 2);
+    Ndown = (double *)calloc(Zsyssize + 2, sizeof(double));
+    Nup = (double *)calloc(Zsyssize + 2, sizeof(double));
+    Nabove = (double *)calloc(Zsyssize + 2, sizeof(double));
+    Nbelow = (double *)calloc(Zsyssize + 2, sizeof(double));
+    Lastbind = (int *)calloc(Zsyssize + 2, sizeof(int));
+    if (!Conc || !Flux || !Open || !Gcross || !Ndown || !Nup || !Nabove ||
+        !Nbelow || !Lastbind) {
+      freeallmem();
+      bailout("sulfattack3d", "Memory allocation failure");
+      exit(1);
+    }
+  }
 
   if (!Mic || !React || !Ndiff || !Nrch || !Nrafm || !Nrc3ah6 || !Afmorig ||
       !Noch || !Ettrorig || !Bruciteorig || !Gypsumorig || !C3ah6orig ||
       !Ettrc4aforig || !Chorig || !Nrafmc || !Afmcorig || !Ccorig || !Nrcap ||
-      !Nrgel || !Straingyp || !Strainbrucite || Strainettr || Strainafm ||
-      Xnew || Ynew || Znew) {
+      !Nrgel || !Straingyp || !Strainbrucite || !Strainettr || !Strainafm ||
+      !Xnew || !Ynew || !Znew || !Chlist || !Chpos || !Nchlist ||
+      !Nchfree) {
 
     freeallmem();
     bailout("sulfattack3d", "Memory allocation failure");
@@ -1375,10 +2132,16 @@ void allmem(void) {
  *
  ***/
 void freeallmem(void) {
-  if (Mic)
-    free_sibox(Mic, Xsyssize + 2, Ysyssize + 2);
-  if (React)
-    free_sibox(React, Xsyssize + 2, Ysyssize + 2);
+  int iz;
+
+  if (Window) {
+    layerwin_free(&Win);
+  } else {
+    if (Mic)
+      free_sibox(Mic, Xsyssize + 2, Ysyssize + 2);
+    if (React)
+      free_sibox(React, Xsyssize + 2, Ysyssize + 2);
+  }
   if (Ndiff)
     free_ivector(Ndiff);
   if (Nrch)
@@ -1427,6 +2190,129 @@ void freeallmem(void) {
     free_sivector(Ynew);
   if (Znew)
     free_sivector(Znew);
+  if (Conc)
+    free_dvector(Conc);
+  if (Flux)
+    free_dvector(Flux);
+  if (Open)
+    free_dvector(Open);
+  if (Gcross)
+    free_dvector(Gcross);
+  if (Ndown)
+    free(Ndown);
+  if (Nup)
+    free(Nup);
+  if (Nabove)
+    free(Nabove);
+  if (Nbelow)
+    free(Nbelow);
+  if (Lastbind)
+    free(Lastbind);
+  if (Chlist && Chpos && Nchlist && Nchfree) {
+    for (iz = 0; iz < Zsyssize + 2; iz++) {
+      chdrop(iz);
+    }
+  }
+  if (Chlist)
+    free(Chlist);
+  if (Chpos)
+    free(Chpos);
+  if (Nchlist)
+    free_ivector(Nchlist);
+  if (Nchfree)
+    free_ivector(Nchfree);
+
+  return;
+}
+
+/***
+ *	checkargs
+ *
+ *	Read the command line options
+ *
+ *	Arguments:	int argc, char *argv[]
+ *	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"band", required_argument, 0, 'b'},
+                                      {"handoff", required_argument, 0, 'H'},
+                                      {"window", no_argument, 0, 'W'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  while ((opt_char = getopt_long(argc, argv, "b:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -b or --band */
+    case (int)('b'):
+      Band = atoi(optarg);
+      if (Band < 1)
+        return (1);
+      break;
+    /* --handoff */
+    case (int)('H'):
+      strcpy(Handoffname, optarg);
+      break;
+    /* --window */
+    case (int)('W'):
+      Window = 1;
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (optind != argc)
+    return (1);
+
+  /* The window reads its layers from an image file */
+
+  if (Window && strlen(Handoffname) > 0)
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ *	Arguments:	none
+ *	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUsage: sulfattack3d [-b,--band <layers>] "
+                  "[--handoff <name>] [--window]\n\n");
+  fprintf(stderr, "  --band     keep ants only within this many layers "
+                  "above the\n");
+  fprintf(stderr, "             reaction front and below it, and solve the "
+                  "layers\n");
+  fprintf(stderr, "             behind it as a continuum (default: ants "
+                  "everywhere)\n");
+  fprintf(stderr, "  --handoff  read the input microstructure that "
+                  "disrealnew\n");
+  fprintf(stderr, "             --handoff-out name left in shared memory, "
+                  "in place\n");
+  fprintf(stderr, "             of the input file (not on Windows)\n");
+  fprintf(stderr, "  --window   hold only the layers the ants can reach "
+                  "in memory,\n");
+  fprintf(stderr, "             reading them from a raw binary input "
+                  "image and\n");
+  fprintf(stderr, "             writing a raw binary output image, for "
+                  "specimens\n");
+  fprintf(stderr, "             too deep to hold, with no images along "
+                  "the way\n");
+  fprintf(stderr, "             (not with --handoff, not on Windows)\n");
+  fprintf(stderr, "The rest of the input is read from the prompts.\n\n");
 
   return;
 }
@@ -1,143 +1,112 @@
+/******************************************************
+ *
+ * Program thames2vcctl
+ *
+ * Converts THAMES microstructure images to VCCTL
+ * images, each written as <image>.vcctl.img.  Any
+ * number of images, or directories of images, can be
+ * given; ids are mapped as they are read, one x plane
+ * at a time, so images of any size convert in little
+ * memory.
+ ******************************************************/
 #include "include/vcctl.h"
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-int Xsize, Ysize, Zsize;
-int Xsizeorig, Ysizeorig, Zsizeorig;
-float Version, Res;
+/***
+ *	Global variables
+ ***/
+int Format = IMG_ASCII;
+char Outdir[MAXSTRING];
 
-int ***Mic;
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
 
 int main(int argc, char *argv[]) {
-  register int i, j, k;
-  int ival, val;
-  char buff[128], filename[128];
-  FILE *fpin, *fpout;
+  int i, nfail;
+  int table[CENSUSIDS];
 
-  if (argc != 2) {
-    printf("\n\nUSAGE:  thames2vcctl [image file name]\n\n");
-    return (0);
-  }
-
-  fpin = filehandler("thames2vcctl", argv[1], "READ");
-
-  /* Read in the thames microstructure image header */
-  if (read_imgheader(fpin, &Version, &Xsize, &Ysize, &Zsize, &Res)) {
-    fclose(fpin);
-    bailout("vcctl2thames", "Error reading image header");
+  if (checkargs(argc, argv)) {
+    printHelp();
     return (1);
   }
 
-  Mic = ibox(Xsize, Ysize, Zsize);
+  thames_idtable(table, 0);
 
-  sprintf(filename, "%s.vcctl.img", argv[1]);
-
-  if ((fpout = fopen(filename, "w")) == NULL) {
-    printf("\nERROR:  Could not open file %s. Exiting.\n\n", filename);
-    free_ibox(Mic, Xsize, Ysize);
-    exit(1);
+  nfail = 0;
+  for (i = optind; i < argc; i++) {
+    nfail += thames_convert_path("thames2vcctl", argv[i], Outdir, table,
+                                 Format);
   }
 
-  fprintf(fpout, "Version: 5.0\n");
-  fprintf(fpout, "X_Size: %d\n", Xsize);
-  fprintf(fpout, "Y_Size: %d\n", Ysize);
-  fprintf(fpout, "Z_Size: %d\n", Zsize);
-  fprintf(fpout, "Image_Resolution: 1.0\n");
-
-  /* Read in the thames microstructure image */
+  return (nfail ? 1 : 0);
+}
 
-  for (k = 0; k < Zsize; k++) {
-    for (j = 0; j < Ysize; j++) {
-      for (i = 0; i < Xsize; i++) {
-        fscanf(fpin, "%s", buff);
-        ival = atoi(buff);
-        switch (ival) {
-        case 0:
-          val = EMPTYP;
-          break;
-        case 1:
-          val = POROSITY;
-          break;
-        case 2:
-          val = C3S;
-          break;
-        case 3:
-          val = C2S;
-          break;
-        case 4:
-          val = C3A;
-          break;
-        case 5:
-          val = C4AF;
-          break;
-        case 6:
-          val = K2SO4;
-          break;
-        case 7:
-          val = NA2SO4;
-          break;
-        case 8:
-          val = GYPSUM;
-          break;
-        case 9:
-          val = HEMIHYD;
-          break;
-        case 10:
-          val = CACO3;
-          break;
-        case 11:
-          val = CH;
-          break;
-        case 12:
-          val = CSH;
-          break;
-        case 13:
-          val = AFMC;
-          break;
-        case 14:
-          val = AFM;
-          break;
-        case 15:
-          val = ETTR;
-          break;
-        case 16:
-          val = BRUCITE;
-          break;
-        case 17:
-          val = C3AH6;
-          break;
-        case 18:
-          val = AFM;
-          break;
-        case 19:
-          val = FREELIME;
-          break;
-        case 20:
-          val = FREELIME;
-          break;
-        default:
-          val = POROSITY;
-          break;
-        }
-        Mic[i][j][k] = val;
-      }
+/***
+ *	checkargs
+ *
+ *	Checks the command line arguments
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"binary", no_argument, 0, 'b'},
+                                      {"outdir", required_argument, 0, 'o'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  Outdir[0] = '\0';
+  while ((opt_char = getopt_long(argc, argv, "bo:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -b or --binary */
+    case (int)('b'):
+      Format = IMG_UINT8Z;
+      break;
+    /* -o or --outdir */
+    case (int)('o'):
+      snprintf(Outdir, sizeof(Outdir), "%s", optarg);
+      break;
+    default:
+      return (1);
     }
   }
 
-  fclose(fpin);
-
-  /* Now write the rest of the vcctl image file */
-
-  for (k = 0; k < Zsize; k++) {
-    for (j = 0; j < Ysize; j++) {
-      for (i = 0; i < Xsize; i++) {
-        fprintf(fpout, "%d\n", Mic[i][j][k]);
-      }
-    }
-  }
+  return ((optind < argc) ? 0 : 1);
+}
 
-  fclose(fpout);
-  free_ibox(Mic, Xsize, Ysize);
-  exit(0);
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUSAGE:  thames2vcctl [-b,--binary] [-o,--outdir "
+                  "<dir>] <image or directory> ...\n\n");
+  fprintf(stderr, "Converts THAMES images (ASCII or binary) to VCCTL "
+                  "images named\n");
+  fprintf(stderr, "<image>.vcctl.img.  For a directory, every *.img in it "
+                  "is converted.\n\n");
+  fprintf(stderr, "  --binary   write compressed binary (uint8-zlib) "
+                  "images\n");
+  fprintf(stderr, "  --outdir   put the VCCTL images in this directory\n\n");
+
+  return;
 }
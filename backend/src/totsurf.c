@@ -11,6 +11,9 @@
  *
  *	Only processes the phase values 0-10, 24 and 25
  *
+ *	Usage: totsurf [<input_file> <output_file>]
+ *	(asks for the file names if they are not given)
+ *
  * Programmer:	Dale P. Bentz
  * 				Building and Fire Research Laboratory
  *				NIST
@@ -31,6 +34,7 @@
 #include "include/vcctl.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /***
  *	Global variables
@@ -39,19 +43,16 @@ float Version;
 
 #include "include/properties.h"
 
-int main(void) {
-  int ***mic;
-  int valin, ovalin, ix, iy, iz, ix1, iy1, iz1, k, syssize, flag;
-  int xsyssize, ysyssize, zsyssize;
+int main(int argc, char *argv[]) {
+  int k, j, nout, xsyssize, ysyssize, zsyssize;
   int totalvol, surface, surfpix;
-  double totalmass;
+  int count[CENSUSIDS], surfvox[CENSUSIDS], *pair;
   float res;
-  char filen[MAXSTRING], fileout[MAXSTRING], buff[MAXSTRING];
-  char instring[MAXSTRING];
+  char filen[MAXSTRING], fileout[MAXSTRING];
+  size_t cap = 0;
+  unsigned char *vox = NULL;
   FILE *infile, *statfile;
 
-  surface = surfpix = 0;
-
   /***
    *	Assign physical and chemical properties of
    *	phases.  Function comes from properties.c
@@ -59,12 +60,18 @@ int main(void) {
 
   assign_properties();
 
-  printf("Enter name of file to open \n");
-  read_string(filen, sizeof(filen));
-  printf("%s \n", filen);
-  printf("Enter name of file to write statistics to \n");
-  read_string(fileout, sizeof(fileout));
-  printf("%s \n", fileout);
+  /* Check for command line arguments */
+  if (argc != 3) {
+    printf("Enter name of file to open \n");
+    read_string(filen, sizeof(filen));
+    printf("%s \n", filen);
+    printf("Enter name of file to write statistics to \n");
+    read_string(fileout, sizeof(fileout));
+    printf("%s \n", fileout);
+  } else {
+    snprintf(filen, sizeof(filen), "%s", argv[1]);
+    snprintf(fileout, sizeof(fileout), "%s", argv[2]);
+  }
 
   /***
    *	Open input and output files.  Output file
@@ -72,166 +79,77 @@ int main(void) {
    *	displaying in web page format
    ***/
 
-  infile = fopen(filen, "r");
-  statfile = fopen(fileout, "w");
+  infile = filehandler("totsurf", filen, "READ");
+  if (!infile) {
+    exit(1);
+  }
 
   /***
-   *	Determine whether software version, system
-   *	size and resolution are specified in the image file
+   *	Read the software version, system size, resolution
+   *	and all the voxels of the image file
    ***/
 
-  fscanf(infile, "%s", buff);
-  if (!strcmp(buff, VERSIONSTRING)) {
-    fscanf(infile, "%f", &Version);
-    fscanf(infile, "%s", buff); /* Desc. of system size */
-    if (!strcmp(buff, XSIZESTRING)) {
-      fscanf(infile, "%s", instring);
-      xsyssize = atoi(instring);
-      fscanf(infile, "%s", buff);
-      fscanf(infile, "%s", instring);
-      ysyssize = atoi(instring);
-      fscanf(infile, "%s", buff);
-      fscanf(infile, "%s", instring);
-      zsyssize = atoi(instring);
-    } else {
-      fscanf(infile, "%s", instring);
-      syssize = atoi(instring);
-      xsyssize = syssize;
-      ysyssize = syssize;
-      zsyssize = syssize;
-    }
-    fscanf(infile, "%s", buff); /* Desc. of resolution */
-    fscanf(infile, "%s", instring);
-    res = atof(instring);
-  } else {
-
-    /***
-     *	This image file was generated prior to
-     *	Version 3.0.  Allow backward compatibility
-     *	by defaulting system size to 100 and
-     *	system resolution to 1.0
-     ***/
-
-    Version = 2.0;
-    syssize = DEFAULTSYSTEMSIZE;
-    xsyssize = syssize;
-    ysyssize = syssize;
-    zsyssize = syssize;
-    res = DEFAULTRESOLUTION;
-    rewind(infile);
+  if (load_microstructure(infile, &vox, &cap, &Version, &xsyssize, &ysyssize,
+                          &zsyssize, &res)) {
+    fclose(infile);
+    if (vox)
+      free(vox);
+    bailout("totsurf", "Error reading microstructure image");
+    exit(1);
   }
+  fclose(infile);
 
   /***
-   *	Dynamically allocate the memory for mic array
+   *	Count the voxels of every id, the faces between each
+   *	pair of ids and the voxels with an unlike neighbor, in
+   *	one pass over the image
    ***/
 
-  mic = ibox(xsyssize, ysyssize, zsyssize);
-
-  /* Read in image and accumulate volume totals */
-
-  totalmass = 0.0;
-  totalvol = 0;
-  for (iz = 0; iz < zsyssize; iz++) {
-    for (iy = 0; iy < ysyssize; iy++) {
-      for (ix = 0; ix < xsyssize; ix++) {
-
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        valin = ovalin;
-        mic[ix][iy][iz] = valin;
-
-        if (valin != POROSITY)
-          totalvol++;
-      }
-    }
+  pair = (int *)malloc((size_t)CENSUSIDS * CENSUSIDS * sizeof(int));
+  if (!pair) {
+    free(vox);
+    bailout("totsurf", "Memory allocation failure");
+    exit(1);
   }
 
-  fclose(infile);
-
-  ix1 = iy1 = iz1 = 0;
-  for (iz = 0; iz < zsyssize; iz++) {
-    for (iy = 0; iy < ysyssize; iy++) {
-      for (ix = 0; ix < xsyssize; ix++) {
-
-        flag = 0;
-
-        if (mic[ix][iy][iz] != POROSITY) {
-
-          valin = mic[ix][iy][iz];
-
-          /* Check six neighboring pixels for porosity */
-
-          for (k = 1; k <= 6; k++) {
-
-            switch (k) {
-            case 1:
-              ix1 = ix - 1;
-              if (ix1 < 0)
-                ix1 += xsyssize;
-              iy1 = iy;
-              iz1 = iz;
-              break;
-            case 2:
-              ix1 = ix + 1;
-              if (ix1 >= xsyssize)
-                ix1 -= xsyssize;
-              iy1 = iy;
-              iz1 = iz;
-              break;
-            case 3:
-              iy1 = iy - 1;
-              if (iy1 < 0)
-                iy1 += ysyssize;
-              ix1 = ix;
-              iz1 = iz;
-              break;
-            case 4:
-              iy1 = iy + 1;
-              if (iy1 >= ysyssize)
-                iy1 -= ysyssize;
-              ix1 = ix;
-              iz1 = iz;
-              break;
-            case 5:
-              iz1 = iz - 1;
-              if (iz1 < 0)
-                iz1 += zsyssize;
-              iy1 = iy;
-              ix1 = ix;
-              break;
-            case 6:
-              iz1 = iz + 1;
-              if (iz1 >= zsyssize)
-                iz1 -= zsyssize;
-              iy1 = iy;
-              ix1 = ix;
-              break;
-            default:
-              break;
-            }
-
-            if (mic[ix1][iy1][iz1] != valin) {
-              surface++;
-              flag = 1;
-            }
-          }
-        }
-        if (flag)
-          surfpix++;
-      }
-    }
+  nout = phase_interfaces(vox, xsyssize, ysyssize, zsyssize, CENSUSIDS, count,
+                          pair, surfvox, 0);
+  free(vox);
+  if (nout < 0) {
+    free(pair);
+    bailout("totsurf", "Memory allocation failure");
+    exit(1);
   }
 
   /***
-   *	Only include clinker phases in surface
-   *	area fraction calculation
+   *	Every face of a solid voxel with a voxel of another
+   *	phase (pore or solid) is surface
    ***/
 
+  totalvol = surface = surfpix = 0;
+  for (k = 0; k < CENSUSIDS; k++) {
+    if (k == POROSITY)
+      continue;
+    totalvol += count[k];
+    surfpix += surfvox[k];
+    for (j = 0; j < CENSUSIDS; j++) {
+      surface += pair[k * CENSUSIDS + j];
+    }
+  }
+  free(pair);
+
   printf("Total volume of solids is: %8d\n", totalvol);
   printf("Total surface area of solids is: %8d\n", surface);
   printf("Number of surface pixels: %8d\n", surfpix);
 
-  free_ibox(mic, xsyssize, ysyssize);
+  statfile = filehandler("totsurf", fileout, "WRITE");
+  if (!statfile) {
+    exit(1);
+  }
+  fprintf(statfile, "Total volume of solids is: %8d\n", totalvol);
+  fprintf(statfile, "Total surface area of solids is: %8d\n", surface);
+  fprintf(statfile, "Number of surface pixels: %8d\n", surfpix);
+  fclose(statfile);
 
   return (0);
 }
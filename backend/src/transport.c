@@ -27,11 +27,11 @@ c  currents in the x,y, and z directions.
 
 c  DIMENSIONS
 
-c  The vectors gx,gy,gz,u,gb,h,Ah,list,pix are all dimensioned
+c  The vectors gx,gy,gz,u,gb,h,Ah,pix are all dimensioned
 c  ns2 = (nx+2)*(ny+2)*(nz+2).  This number is used, rather than the
 c  system size nx x ny x nz, because an extra layer of pixels is
 c  put around the system to be able to maintain periodic boundary
-c  conditions (see manual, Sec. 3.3). The arrays pix and list are also
+c  conditions (see manual, Sec. 3.3). The array pix is also
 c  dimensioned this way.
 c  At present the program is set up for up to 100
 c  phases, but that can easily be changed by the user, by changing the
@@ -49,10 +49,15 @@ c  dimensions in the subroutines are passed, so do not need to be changed.
 c  The dimensions of sigma, a, and be should be equal to the value of ntot.
                                                                 */
 #include "include/vcctl.h"
+#include <getopt.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "include/mpislab.h"
 
 #define NPHASE OFFSET
 #define NPHMAX OFFSET + 1
@@ -67,15 +72,133 @@ c  The dimensions of sigma, a, and be should be equal to the value of ntot.
 #define NUMFINESOURCES 2
 #define NUMCOARSESOURCES 2
 
+/* Preconditioners of dembx (--precond, --fft) */
+#define NOPRECOND 0
+#define JACOBI 1
+#define FFTGREEN 2
+
+/* Independent batches of walkers for the confidence intervals (--walk) */
+#define WALKBATCHES 32
+
+/* Relative slowing of the walk that is still too short, and the most */
+/* times a walk is made twice as long for it (--walk) */
+#define WALKTOL 0.02
+#define WALKDOUBLINGS 4
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
 /* Global variables */
 
 double *gx, *gy, *u, *gz;
 double *gb, *h, *Ah, *Lsigma;
+
+/***
+ *	Jacobi preconditioner of dembx (--precond jacobi): Dinv is the
+ *	inverse of the diagonal of A, and Zg is Dinv times gb
+ ***/
+int Precond = NOPRECOND;
+double *Dinv, *Zg;
+
+/***
+ *	FFT preconditioner of dembx (--fft): Zg is the gradient times
+ *	the inverse of the conductance matrix of a uniform reference
+ *	network, found in Fourier space (see fftprecondapply).  Fftsig
+ *	holds the bond conductances of the reference network along x,
+ *	y and z, and Fftcs the cos of the angle of each frequency along
+ *	x, y and z, for the Fftn[0] x Fftn[1] x Fftn[2] grid of Fftbuf.
+ ***/
+Fft3d Fftbuf;
+double *Fftcs, Fftsig[3];
+int Fftn[3];
+
+/***
+ *	Threads for the conjugate gradient solution (--threads n), and
+ *	the sum over each z plane of the real sites for the dot
+ *	products (see realdot)
+ ***/
+int Nthreads = 1;
+double *Planesum;
+
+/***
+ *	Slab of this rank under mpirun (see mpislab.h): the real z
+ *	planes k = Zlo + 2 to Zhi + 1, kept with one more plane on
+ *	each side.  The vectors other than pix hold only the Sitecount
+ *	sites of those planes, from Sitebase + 1 on, indexed by the
+ *	labels of the whole system (see sitevec).  Layercurr holds the
+ *	current and field of each x layer for Lsigma, to be added up
+ *	over the ranks.
+ ***/
+int Zlo, Zhi, Sitebase, Sitecount;
+double *Layercurr;
+
+/***
+ *	Answers given on the command line (--image, --outdir, --output,
+ *	--results, --pc) instead of standard input; see nextinput
+ ***/
+char Imagefile[MAXSTRING], Outdir[MAXSTRING], Outputfile[MAXSTRING];
+char Resultsfile[MAXSTRING], Pcfile[MAXSTRING];
+
+/***
+ *	Coarsening (--coarsen f): the problem is first solved on a grid
+ *	whose sites are f x f x f blocks of pixels, and that solution
+ *	starts the full one.  With --coarse-only the coarse solution is
+ *	the answer.  Coarsecurr holds the currents it gives.
+ ***/
+int Coarsen = 1, Coarseonly = 0;
+double Coarsecurr[3];
+
+/***
+ *	Random walk estimate (--walk n, --walk-steps t, --walk-seed s):
+ *	instead of solving for the voltages, n walkers take t steps each
+ *	on the conductor network, and the growth of their mean square
+ *	displacement gives the conductivity tensor (see randomwalk).
+ *	Walksig holds its xx, yy, zz, yz, xz and xy terms, and Walkhalf
+ *	the half-widths of their 95% confidence intervals.  Walkdrift is
+ *	how much slower that growth is over the last quarter of the walk
+ *	than over the third, relative to the estimate, and Walkdrifthalf
+ *	its half-width; a walk too short to settle overestimates.
+ ***/
+int Walkers = 0, Walksteps = 0, Walkseed = 1;
+double Walksig[6], Walkhalf[6], Walkdrift, Walkdrifthalf;
+
+/***
+ *	File of paste and ITZ conductivities for which conctransport
+ *	also finds the concrete conductivity (--emt-sweep); see emtsweep
+ ***/
+char Emtsweepfile[MAXSTRING];
+
+/***
+ *	Conjugate gradient solution on an offload device (--gpu); see
+ *	dembxgpu.  It is turned off in main if there is no device.
+ ***/
+int Gpu = 0;
+
+/***
+ *	Result cache (--cache dir; see rescache.c).  The currents of a
+ *	full solution are kept under a key made from the phase of each
+ *	site, the conductivities, the applied field, gtest and the ITZ
+ *	layers, and a run with the same key reads them back instead of
+ *	solving again.
+ ***/
+char Cachedir[MAXSTRING];
+
+/***
+ *	VTK image file of the solution (--vtk; see vtkimg.c and
+ *	currentvtk): current.vti in the output folder, with the phase,
+ *	voltage and current of each pixel.  Curfield holds the voltage
+ *	and the x, y and z currents of each pixel of the whole system,
+ *	x varying fastest, filled in by the last call to current.  The
+ *	cache is not used with it, since it keeps no field.
+ ***/
+int Vtkout = 0;
+double *Curfield = NULL;
+
 static double currx, curry, currz, sigma[NPHMAX][4];
 static double pcurr[NPHMAX][4];
 static double a[NPHMAX], be[NPHMAX][NPHMAX][4];
 int *pix;
-int *list;
 int Nsites;
 double gtest, ex, ey, ez;
 int nx, ny, nz, nx1, nx2, ny1, ny2, nz1, nz2, L22, ns2, nphase, ntot;
@@ -111,6 +234,7 @@ double S_conctransport[MAXSIZECLASSES];
 double Si_conctransport[MAXSIZECLASSES];
 double Diam_conctransport[MAXSIZECLASSES];
 double Vf_conctransport[MAXSIZECLASSES];
+double Alpha_conctransport[MAXSIZECLASSES];
 int N_conctransport;
 int Ng;
 
@@ -118,41 +242,491 @@ int Ng;
 
 int conctransport(int nagg1, double sigma, double sigmax);
 void freallmem_conctransport(void);
-void effective(double itzwidth, double sitz);
+void effective(double itzwidth, double sitz, int verbose);
 void slope(double itzwidth, double *ss0, double s1);
+double emtslope(double s);
+double emtint(double s0, double s1);
+double emtsolve(double scem, double sitz, double itzwidth, double target,
+                int verbose);
+void emtsweep(double itzwidth, double target, double sigmax);
 int getGausspoints(void);
 void legendr(int n, double *x, double *pn, double *pnm1, double *pnp1);
+int checkargs(int argc, char *argv[]);
+int argstring(char *s, char *val, char *name);
+void printHelp(void);
+void wrapfaces(double *v);
+void precondset(void);
+int fftprecondset(void);
+void fftprecondapply(void);
+void matprod(double *v, double *r);
+void nextinput(char *argval, char *s, int size);
+double *sitevec(void);
+double realdot(double *a, double *b);
+double blocksigma(int *p, int m0, int f, int d, int sy, int sz);
+double bondcond(double s1, double s2);
+int coarsesolve(int f);
+int randomwalk(void);
+int cacheio(FILE *fp, int doitz, int writing);
+int currentvtk(char *name);
+void gpuwrapfaces(double *v);
+void gpumatprod(double *v, double *r);
+double gpudot(double *a, double *b);
+void dembxgpu(int doitz);
+
+/***
+ *	checkargs
+ *
+ * 	Checks command-line arguments: --precond jacobi to precondition
+ * 	the conjugate gradient solution with the diagonal of the
+ * 	conductance matrix, or --precond none, and --threads n to
+ * 	share the solution out among n threads.  --image, --outdir,
+ * 	--output, --results and --pc give the answers to the questions
+ * 	of main, which are then not read from standard input, so
+ * 	transport can run without prompting.  --coarsen f first solves
+ * 	a copy of the problem coarsened f times along each axis (see
+ * 	coarsesolve), and --coarse-only stops there.  --emt-sweep file
+ * 	gives paste and ITZ conductivities for which to find the
+ * 	concrete conductivity as well (see emtsweep).  --gpu solves on
+ * 	an offload device, if there is one (see dembxgpu).  --fft
+ * 	preconditions with the inverse of a uniform reference network
+ * 	instead (see fftprecondapply); it is solved on the host.
+ * 	--walk n estimates the conductivities with n random walkers
+ * 	instead of solving (see randomwalk), with --walk-steps t steps
+ * 	each and the random numbers of --walk-seed s.  Without
+ * 	--walk-steps the walk is made longer until it settles.  --cache
+ * 	dir keeps the results of full solutions in dir and takes them
+ * 	from there when the same image and conductivities come again.
+ * 	--vtk writes the field of the solution for ParaView (see
+ * 	currentvtk).  Paths longer than MAXSTRING, unknown options and
+ * 	stray arguments are refused.
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	0 if the arguments are well formed, 1 otherwise
+ *
+ *	Calls:		argstring
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int wellformed = 1; /* 0 = false, 1 = true */
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {
+      /* These options set a flag */
+      {"coarse-only", no_argument, &Coarseonly, 1},
+      {"gpu", no_argument, &Gpu, 1},
+      {"vtk", no_argument, &Vtkout, 1},
+      /* These options don't set a flag */
+      {"precond", required_argument, 0, 'p'},
+      {"threads", required_argument, 0, 't'},
+      {"image", required_argument, 0, 'i'},
+      {"outdir", required_argument, 0, 'o'},
+      {"output", required_argument, 0, 'O'},
+      {"results", required_argument, 0, 'r'},
+      {"pc", required_argument, 0, 'c'},
+      {"coarsen", required_argument, 0, 'f'},
+      {"emt-sweep", required_argument, 0, 'e'},
+      {"fft", no_argument, 0, 'F'},
+      {"walk", required_argument, 0, 'w'},
+      {"walk-steps", required_argument, 0, 's'},
+      {"walk-seed", required_argument, 0, 'S'},
+      {"cache", required_argument, 0, 'C'},
+      {"help", no_argument, 0, 'h'},
+      {NULL, 0, 0, 0}};
+
+  Nthreads = thread_default(Nthreads);
+
+  while ((opt_char = getopt_long(argc, argv, "t:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    case (0):
+      break;
+    /* --precond */
+    case (int)('p'):
+      if (!strcmp(optarg, "jacobi")) {
+        Precond = JACOBI;
+      } else if (!strcmp(optarg, "none")) {
+        Precond = NOPRECOND;
+      } else {
+        printf("\nUnknown preconditioner %s; using none", optarg);
+        Precond = NOPRECOND;
+      }
+      break;
+    /* -t or --threads */
+    case (int)('t'):
+      Nthreads = atoi(optarg);
+      if (Nthreads < 1)
+        Nthreads = 1;
+      break;
+    /* --image */
+    case (int)('i'):
+      wellformed &= argstring(Imagefile, optarg, "--image");
+      break;
+    /* --outdir */
+    case (int)('o'):
+      wellformed &= argstring(Outdir, optarg, "--outdir");
+      break;
+    /* --output */
+    case (int)('O'):
+      wellformed &= argstring(Outputfile, optarg, "--output");
+      break;
+    /* --results */
+    case (int)('r'):
+      wellformed &= argstring(Resultsfile, optarg, "--results");
+      break;
+    /* --pc */
+    case (int)('c'):
+      wellformed &= argstring(Pcfile, optarg, "--pc");
+      break;
+    /* --coarsen */
+    case (int)('f'):
+      Coarsen = atoi(optarg);
+      if (Coarsen < 1)
+        Coarsen = 1;
+      break;
+    /* --emt-sweep */
+    case (int)('e'):
+      wellformed &= argstring(Emtsweepfile, optarg, "--emt-sweep");
+      break;
+    /* --fft */
+    case (int)('F'):
+      Precond = FFTGREEN;
+      break;
+    /* --walk */
+    case (int)('w'):
+      Walkers = atoi(optarg);
+      if (Walkers < 0)
+        Walkers = 0;
+      break;
+    /* --walk-steps */
+    case (int)('s'):
+      Walksteps = atoi(optarg);
+      if (Walksteps < 0)
+        Walksteps = 0;
+      break;
+    /* --walk-seed */
+    case (int)('S'):
+      Walkseed = atoi(optarg);
+      break;
+    /* --cache */
+    case (int)('C'):
+      wellformed &= argstring(Cachedir, optarg, "--cache");
+      break;
+    /* -h or --help, or an unknown option (getopt_long names it) */
+    default:
+      wellformed = 0;
+      break;
+    }
+  }
+  if (optind < argc) {
+    fprintf(stderr, "transport: unexpected argument %s\n", argv[optind]);
+    wellformed = 0;
+  }
+  if (Precond == FFTGREEN)
+    Gpu = 0;
+
+  return (wellformed ? 0 : 1);
+}
+
+/***
+ *	argstring
+ *
+ * 	Copies the value of a command-line option into a string of
+ * 	MAXSTRING characters, refusing one that would not fit
+ *
+ * 	Arguments:	char pointer to the string, char pointer to the
+ * 				value, char pointer to the name of the option
+ * 	Returns:	1 if copied, 0 if the value is too long
+ *
+ *	Calls:		no routines
+ *	Called by:	checkargs
+ ***/
+int argstring(char *s, char *val, char *name) {
+  if (strlen(val) >= MAXSTRING) {
+    fprintf(stderr, "transport: value of %s is too long\n", name);
+    return (0);
+  }
+  strcpy(s, val);
+
+  return (1);
+}
+
+/***
+ *	printHelp
+ *
+ * 	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUSAGE:  transport [--precond jacobi|none] "
+                  "[-t,--threads <n>]\n");
+  fprintf(stderr, "                  [--image <file>] [--outdir <dir>] "
+                  "[--output <file>]\n");
+  fprintf(stderr, "                  [--results <file>] [--pc <file>] "
+                  "[--coarsen <f>]\n");
+  fprintf(stderr, "                  [--coarse-only] [--emt-sweep <file>] "
+                  "[--gpu] [--fft] [--walk <n>]\n");
+  fprintf(stderr, "                  [--walk-steps <t>] [--walk-seed <s>] "
+                  "[--cache <dir>] [--vtk]\n\n");
+  fprintf(stderr, "Questions whose answers are not given on the command "
+                  "line are read from\n");
+  fprintf(stderr, "standard input.  Paths must be shorter than %d "
+                  "characters.\n\n",
+          MAXSTRING);
+
+  return;
+}
+
+/***
+ *	nextinput
+ *
+ * 	Gets the answer to one question of main, from the command line
+ * 	if it was given there, and otherwise from standard input
+ *
+ * 	Arguments:	char pointer to the command line value ("" if none)
+ * 				char pointer to the answer, and its size
+ * 	Returns:	nothing
+ *
+ *	Calls:		read_string
+ *	Called by:	main program
+ ***/
+void nextinput(char *argval, char *s, int size) {
+  if (strlen(argval) > 0) {
+    strncpy(s, argval, size - 1);
+    s[size - 1] = '\0';
+  } else {
+    read_string(s, size);
+  }
+
+  return;
+}
+
+/***
+ *	cacheio
+ *
+ * 	Writes the results of a full solution to fp, a file of the
+ * 	result cache (--cache), or with writing 0 reads them back in
+ * 	their place: the currents, the number of cycles, the currents
+ * 	of each phase and, for an ITZ run, the conductivity of each
+ * 	layer
+ *
+ * 	Arguments:	FILE pointer, int doitz, int nonzero to write
+ * 	Returns:	0 if okay, 1 if they could not all be written or
+ * 				read, in which case nothing is changed
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int cacheio(FILE *fp, int doitz, int writing) {
+  double c[3], pc[NPHMAX][4], *ls;
+  int n, status;
+
+  c[0] = currx;
+  c[1] = curry;
+  c[2] = currz;
+  n = ic;
+  memcpy(pc, pcurr, sizeof(pc));
+  ls = NULL;
+  if (doitz) {
+    ls = dvector(Xsyssize);
+    if (!ls)
+      return (1);
+    memcpy(ls, Lsigma, Xsyssize * sizeof(double));
+  }
+
+  if (writing) {
+    status = (fwrite(c, sizeof(double), 3, fp) != 3 ||
+              fwrite(&n, sizeof(int), 1, fp) != 1 ||
+              fwrite(pc, sizeof(pc), 1, fp) != 1 ||
+              (ls && fwrite(ls, sizeof(double), Xsyssize, fp) != Xsyssize));
+  } else {
+    status = (fread(c, sizeof(double), 3, fp) != 3 ||
+              fread(&n, sizeof(int), 1, fp) != 1 ||
+              fread(pc, sizeof(pc), 1, fp) != 1 ||
+              (ls && fread(ls, sizeof(double), Xsyssize, fp) != Xsyssize));
+    if (!status) {
+      currx = c[0];
+      curry = c[1];
+      currz = c[2];
+      ic = n;
+      memcpy(pcurr, pc, sizeof(pc));
+      if (ls)
+        memcpy(Lsigma, ls, Xsyssize * sizeof(double));
+    }
+  }
+  if (ls)
+    free_dvector(ls);
+
+  return (status);
+}
+
+/***
+ *	currentvtk
+ *
+ * 	Writes the phase, voltage and current of each pixel, kept in
+ * 	Curfield by the last call to current, to a VTK image file for
+ * 	ParaView (--vtk), one plane at a time, the values in single
+ * 	precision.  ppixel reads the image with its first axis varying
+ * 	fastest, so the x of transport is the z of the image; the file
+ * 	is written in the axes of the image, so that it lies over the
+ * 	microstructure, with the currents turned to match.  Under
+ * 	mpirun rank 0 gathers the field of every slab and writes the
+ * 	file.
+ *
+ * 	Arguments:	char pointer to name of the file
+ * 	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		slabgather, slabmax, vtkimg_open, vtkimg_array,
+ *				vtkimg_begin, vtkimg_plane, vtkimg_end,
+ *				vtkimg_close
+ *	Called by:	main program
+ ***/
+int currentvtk(char *name) {
+  int i, j, k, c, q, status;
+  size_t p;
+  double *field, *all;
+  unsigned char *phase;
+  float *val;
+  Vtkimg v;
+
+  if (!Curfield)
+    return (1);
+
+  field = Curfield;
+  all = NULL;
+  if (Mpisize > 1) {
+    if (Mpirank == 0)
+      field = all = dvector(4 * (size_t)fxyz);
+    if (slabmax(Mpirank == 0 && !all))
+      return (1);
+    status = slabmax(slabgather(Curfield + 4 * (size_t)nx * ny * Zlo, all,
+                                4 * nx * ny));
+    if (status || Mpirank > 0) {
+      if (all)
+        free_dvector(all);
+      return (status);
+    }
+  }
+
+  /*  A plane of the image is an x layer of transport, k varying */
+  /*  fastest, and pix holds the phase plus one, with a layer of */
+  /*  sites around the system */
+
+  phase = (unsigned char *)malloc((size_t)ny * nz);
+  val = (float *)malloc(3 * (size_t)ny * nz * sizeof(float));
+  if (!phase || !val || vtkimg_open(&v, name, nz, ny, nx, Res)) {
+    status = 1;
+  } else {
+    vtkimg_array(&v, "Phase", VTKUINT8, 1);
+    vtkimg_array(&v, "Voltage", VTKFLOAT32, 1);
+    vtkimg_array(&v, "Current", VTKFLOAT32, 3);
+
+    vtkimg_begin(&v);
+    for (i = 0; i < nx; i++) {
+      for (j = 0; j < ny; j++) {
+        for (k = 0; k < nz; k++) {
+          phase[j * nz + k] =
+              (unsigned char)(pix[(k + 1) * L22 + (j + 1) * nx2 + i + 2] - 1);
+        }
+      }
+      vtkimg_plane(&v, phase);
+    }
+    vtkimg_end(&v);
+    vtkimg_begin(&v);
+    for (i = 0; i < nx; i++) {
+      for (j = 0; j < ny; j++) {
+        for (k = 0; k < nz; k++) {
+          p = 4 * (((size_t)k * ny + j) * nx + i);
+          val[j * nz + k] = (float)field[p];
+        }
+      }
+      vtkimg_plane(&v, val);
+    }
+    vtkimg_end(&v);
+    vtkimg_begin(&v);
+    for (i = 0; i < nx; i++) {
+      for (j = 0; j < ny; j++) {
+        for (k = 0; k < nz; k++) {
+          p = 4 * (((size_t)k * ny + j) * nx + i);
+          q = 3 * (j * nz + k);
+          for (c = 0; c < 3; c++) {
+            val[q + c] = (float)field[p + 3 - c];
+          }
+        }
+      }
+      vtkimg_plane(&v, val);
+    }
+    vtkimg_end(&v);
+    status = vtkimg_close(&v);
+  }
+
+  free(phase);
+  free(val);
+  if (all)
+    free_dvector(all);
+
+  return (status);
+}
+
+/*  Function that allocates a vector of the sites of this rank's */
+/*  slab, from Sitebase + 1 to Sitebase + Sitecount; without mpirun */
+/*  that is every site, 1 to ns2 */
+double *sitevec(void) {
+  double *v;
+
+  v = dvector(Sitecount + 1);
+
+  return (v ? v - Sitebase : NULL);
+}
 
 void freeallmem(void) {
   if (!pix)
     free_ivector(pix);
-  if (!list)
-    free_ivector(list);
-  if (!gx)
-    free_dvector(gx);
-  if (!gy)
-    free_dvector(gy);
-  if (!gz)
-    free_dvector(gz);
-  if (!gb)
-    free_dvector(gb);
-  if (!u)
-    free_dvector(u);
-  if (!h)
-    free_dvector(h);
-  if (!Ah)
-    free_dvector(Ah);
-  if (!Ah)
-    free_dvector(Ah);
+  if (gx)
+    free_dvector(gx + Sitebase);
+  if (gy)
+    free_dvector(gy + Sitebase);
+  if (gz)
+    free_dvector(gz + Sitebase);
+  if (gb)
+    free_dvector(gb + Sitebase);
+  if (u)
+    free_dvector(u + Sitebase);
+  if (h)
+    free_dvector(h + Sitebase);
+  if (Ah)
+    free_dvector(Ah + Sitebase);
+  if (Dinv)
+    free_dvector(Dinv + Sitebase);
+  if (Zg)
+    free_dvector(Zg + Sitebase);
+  if (Planesum)
+    free_dvector(Planesum);
+  if (Layercurr)
+    free_dvector(Layercurr);
+  if (Fftcs)
+    free_dvector(Fftcs);
+  if (Curfield)
+    free_dvector(Curfield);
+  Curfield = NULL;
+  fft3d_free(&Fftbuf);
+  gx = gy = gz = gb = u = h = Ah = Dinv = Zg = Planesum = Layercurr = NULL;
+  Fftcs = NULL;
+  Fftn[0] = Fftn[1] = Fftn[2] = 0;
 
   return;
 }
 
 void ppixel(int *nagg1) {
   FILE *infile;
-  int i, j, k, valin, intvalin, ovalin, i1, j1, k1, foundagg;
+  int i, j, k, valin, intvalin, i1, j1, k1, foundagg, format;
   int m, m1, temp1, temp0, smallersize;
-  char instring[MAXSTRING];
+  size_t n;
+  unsigned char *vox;
 
   printf("\nInside ppixel function.\n");
   fflush(stdout);
@@ -181,25 +755,40 @@ void ppixel(int *nagg1) {
   printf("Image file opened successfully.\n");
   fflush(stdout);
 
-  if (read_imgheader(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize, &Res)) {
+  if (read_imgheader_fmt(infile, &Version, &Xsyssize, &Ysyssize, &Zsyssize,
+                         &Res, &format) ||
+      (format != IMG_ASCII && format != IMG_UINT8 && format != IMG_UINT8Z)) {
     fclose(infile);
     bailout("transport", "Error reading image header");
     freeallmem();
     exit(1);
   }
 
+  /*  The voxels, ASCII or binary, are read at once into vox, in the */
+  /*  order of the file, and converted to the current phase ids */
+
+  vox = (unsigned char *)malloc((size_t)Xsyssize * Ysyssize * Zsyssize);
+  if (!vox || read_micvoxels(infile, vox, Xsyssize, Ysyssize, Zsyssize,
+                             Version, format)) {
+    free(vox);
+    fclose(infile);
+    bailout("transport", "Error reading image voxels");
+    freeallmem();
+    exit(1);
+  }
+  fclose(infile);
+
   *nagg1 = Xsyssize;
 
   /* Use 1-d labelling scheme as shown in manual */
+  n = 0;
   for (k = 2; k <= nz1; k++) {
     temp0 = (k - 1) * L22;
     for (j = 2; j <= ny1; j++) {
       temp1 = (j - 1) * nx2 + temp0;
       for (i = 2; i <= nx1; i++) {
         m = temp1 + i;
-        fscanf(infile, "%s", instring);
-        ovalin = atoi(instring);
-        intvalin = convert_id(ovalin, Version);
+        intvalin = vox[n++];
 
         /***
          *	If this is an image output from a suspended
@@ -274,7 +863,7 @@ void ppixel(int *nagg1) {
     a[i] /= ((double)(smallersize));
   }
 
-  fclose(infile);
+  free(vox);
   printf("\nClosed infile successfully.\n");
 
   /* Set nagg1, aggregate slab thickness, to zero if no aggregate was
@@ -367,9 +956,10 @@ void bond(void) {
   /*  Trim off x and y faces so that no current can flow past periodic
     boundaries.  This step is not really necessary, as the voltages on the
     periodic boundaries will be matched to the corresponding real voltages
-    in each conjugate gradient step.  */
+    in each conjugate gradient step.  Only the planes of this rank's slab
+    are set up; without mpirun those are all of them. */
   temp1 = ny1 * nx2;
-  for (k = 1; k <= nz2; k++) {
+  for (k = Zlo + 1; k <= Zhi + 2; k++) {
     temp0 = (k - 1) * L22;
     for (j = 1; j <= ny2; j++) {
       gx[temp0 + nx2 * j] = 0.0;
@@ -382,7 +972,7 @@ void bond(void) {
 
   /*  Set up conductor network
      bulk--gz */
-  for (k = 1; k <= nz1; k++) {
+  for (k = Zlo + 1; k <= Zhi + 1; k++) {
     temp0 = (k - 1) * L22;
     temp1 = k * L22;
     for (j = 1; j <= ny2; j++) {
@@ -396,7 +986,7 @@ void bond(void) {
   }
 
   /*  bulk---gy */
-  for (k = 1; k <= nz1; k++) {
+  for (k = Zlo + 1; k <= Zhi + 1; k++) {
     temp0 = (k - 1) * L22;
     for (j = 1; j <= ny1; j++) {
       temp2 = (j - 1) * nx2;
@@ -410,7 +1000,7 @@ void bond(void) {
   }
 
   /*  bulk--gx */
-  for (k = 1; k <= nz1; k++) {
+  for (k = Zlo + 1; k <= Zhi + 1; k++) {
     temp0 = (k - 1) * L22;
     for (j = 1; j <= ny2; j++) {
       temp2 = (j - 1) * nx2;
@@ -425,109 +1015,258 @@ void bond(void) {
   return;
 }
 
-/* The matrix product subroutine */
-void prod(void) {
-  int i, temp0, temp1, m;
-  int j, k;
-
-  /*  Perform basic matrix multiplication, results in incorrect information at
-    periodic boundaries. */
-  for (i = 1; i <= ns2; i++) {
-    gb[i] = 0.0;
-  }
-
-  for (i = (L22 + 1); i <= (ns2 - L22); i++) {
-    gb[i] = (-u[i]) *
-            (gx[i - 1] + gx[i] + gz[i - L22] + gz[i] + gy[i] + gy[i - nx2]);
-    gb[i] += gx[i - 1] * u[i - 1] + gx[i] * u[i + 1] +
-             gz[i - L22] * u[i - L22] + gz[i] * u[i + L22] +
-             gy[i] * u[i + nx2] + gy[i - nx2] * u[i - nx2];
-  }
-
-  /*  Correct terms at periodic boundaries (Section 3.3 in manual) */
+/*  Subroutine that copies the values of a vector at the real sites next */
+/*  to the periodic boundaries onto the extra layer of sites around the */
+/*  system (Section 3.3 in manual).  Under mpirun the z faces are the */
+/*  planes on each side of this rank's slab, which come from the ranks */
+/*  next to it. */
+void wrapfaces(double *v) {
+  int i, j, k, m, temp0, temp1;
 
   /*  x faces */
-  for (k = 1; k <= nz2; k++) {
+  for (k = Zlo + 1; k <= Zhi + 2; k++) {
     temp0 = (k - 1) * L22;
     for (j = 1; j <= ny2; j++) {
       temp1 = temp0 + nx2 * (j - 1);
-      gb[temp1 + nx2] = gb[temp1 + 2];
-      gb[temp1 + 1] = gb[temp1 + nx1];
+      v[temp1 + nx2] = v[temp1 + 2];
+      v[temp1 + 1] = v[temp1 + nx1];
     }
   }
 
   /*   y faces */
-  for (k = 1; k <= nz2; k++) {
+  for (k = Zlo + 1; k <= Zhi + 2; k++) {
     temp0 = (k - 1) * L22;
     for (i = 1; i <= nx2; i++) {
-      gb[temp0 + i] = gb[temp0 + ny * nx2 + i];
-      gb[temp0 + ny1 * nx2 + i] = gb[temp0 + nx2 + i];
+      v[temp0 + i] = v[temp0 + ny * nx2 + i];
+      v[temp0 + ny1 * nx2 + i] = v[temp0 + nx2 + i];
     }
   }
 
   /*  z faces  */
+  if (Mpisize > 1) {
+    slabhalo(v + Sitebase + 1, L22, Zhi - Zlo);
+    return;
+  }
   temp0 = nz * L22;
   temp1 = nz1 * L22;
   for (m = 1; m <= L22; m++) {
-    gb[m] = gb[m + temp0];
-    gb[m + temp1] = gb[m + L22];
+    v[m] = v[m + temp0];
+    v[m + temp1] = v[m + L22];
   }
+
+  return;
 }
 
-/* The 2nd matrix product subroutine */
-void prod1(void) {
-  int i, temp0, temp1, m;
-  int j, k;
+/*  Subroutine that sets up the Jacobi preconditioner, the inverse of */
+/*  the diagonal of A, after bond has made the conductor network.  A */
+/*  site with no conducting bonds gets zero. */
+void precondset(void) {
+  int i;
+  double d;
 
-  /*  Perform basic matrix multiplication, results in incorrect information at
-    periodic boundaries. */
-  for (i = 1; i <= ns2; i++) {
-    Ah[i] = 0.0;
+  for (i = Sitebase + 1; i <= Sitebase + Sitecount; i++) {
+    Dinv[i] = 0.0;
+  }
+  for (i = Sitebase + L22 + 1; i <= Sitebase + Sitecount - L22; i++) {
+    d = -(gx[i - 1] + gx[i] + gz[i - L22] + gz[i] + gy[i] + gy[i - nx2]);
+    if (d != 0.0)
+      Dinv[i] = 1.0 / d;
   }
+  wrapfaces(Dinv);
 
-  for (i = (L22 + 1); i <= (ns2 - L22); i++) {
-    Ah[i] = (-h[i]) *
-            (gx[i - 1] + gx[i] + gz[i - L22] + gz[i] + gy[i] + gy[i - nx2]);
-    Ah[i] += gx[i - 1] * h[i - 1] + gx[i] * h[i + 1] +
-             gz[i - L22] * h[i - L22] + gz[i] * h[i + L22] +
-             gy[i] * h[i + nx2] + gy[i - nx2] * h[i - nx2];
+  return;
+}
+
+/*  Function that sets up the FFT preconditioner after bond has made */
+/*  the conductor network, for the grid in use (the coarse one under */
+/*  coarsesolve).  The reference network has the mean conductance of */
+/*  the bonds along each axis, so it follows the contrast of the */
+/*  phases and any anisotropy of the microstructure.  Its conductance */
+/*  matrix is diagonal in Fourier space.  Returns 0 if okay, 1 if out */
+/*  of memory. */
+int fftprecondset(void) {
+  int i, j, k, a, m, n[3], temp0;
+  double *cs, sum[3];
+
+  n[0] = nx;
+  n[1] = ny;
+  n[2] = nz;
+  if (Fftn[0] != nx || Fftn[1] != ny || Fftn[2] != nz) {
+    if (Fftcs)
+      free_dvector(Fftcs);
+    fft3d_free(&Fftbuf);
+    Fftn[0] = Fftn[1] = Fftn[2] = 0;
+    Fftcs = dvector(nx + ny + nz);
+    if (!Fftcs || fft3d_alloc(&Fftbuf, nz, ny, nx, Nthreads))
+      return (1);
+    cs = Fftcs;
+    for (a = 0; a < 3; a++) {
+      for (i = 0; i < n[a]; i++) {
+        cs[i] = cos(2.0 * PI * (double)i / (double)n[a]);
+      }
+      cs += n[a];
+      Fftn[a] = n[a];
+    }
   }
 
-  /*  Correct terms at periodic boundaries (Section 3.3 in manual) */
+  sum[0] = sum[1] = sum[2] = 0.0;
+  for (k = 2; k <= nz1; k++) {
+    for (j = 2; j <= ny1; j++) {
+      temp0 = (k - 1) * L22 + (j - 1) * nx2;
+      for (i = 2; i <= nx1; i++) {
+        m = temp0 + i;
+        sum[0] += gx[m];
+        sum[1] += gy[m];
+        sum[2] += gz[m];
+      }
+    }
+  }
+  for (a = 0; a < 3; a++) {
+    Fftsig[a] = sum[a] / ((double)nx * ny * nz);
+  }
+  fprintf(outfile, "FFT reference conductances %lf %lf %lf\n", Fftsig[0],
+          Fftsig[1], Fftsig[2]);
 
-  /*  x faces */
-  for (k = 1; k <= nz2; k++) {
-    temp0 = (k - 1) * L22;
-    for (j = 1; j <= ny2; j++) {
-      temp1 = temp0 + nx2 * (j - 1);
-      Ah[temp1 + nx2] = Ah[temp1 + 2];
-      Ah[temp1 + 1] = Ah[temp1 + nx1];
+  return (0);
+}
+
+/*  Subroutine that applies the FFT preconditioner, Zg = M * gb.  The */
+/*  gradient at the real sites is transformed, each frequency is */
+/*  divided by the reference conductance matrix there, */
+/*  -2 * sum over the axes of Fftsig * (1 - cos of the angle), and the */
+/*  result is transformed back.  The mean, and any frequency at which */
+/*  the reference network does not conduct, get zero, as do the sites */
+/*  with no conducting bonds, like the zeros of the Jacobi */
+/*  preconditioner, so M stays symmetric. */
+void fftprecondapply(void) {
+  int i, j, k, m, temp0;
+  double *cx, *cy, *cz, s, scale;
+
+  cx = Fftcs;
+  cy = cx + nx;
+  cz = cy + ny;
+  scale = 1.0 / ((double)nx * ny * nz);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(static)               \
+    private(i, j, m, temp0)
+#endif
+  for (k = 2; k <= nz1; k++) {
+    for (j = 2; j <= ny1; j++) {
+      temp0 = (k - 1) * L22 + (j - 1) * nx2;
+      for (i = 2; i <= nx1; i++) {
+        m = temp0 + i;
+        FFTRE(&Fftbuf, k - 2, j - 2, i - 2) = gb[m];
+        FFTIM(&Fftbuf, k - 2, j - 2, i - 2) = 0.0;
+      }
+    }
+  }
+  fft3d_forward(&Fftbuf);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(static) private(i, j, s)
+#endif
+  for (k = 0; k < nz; k++) {
+    for (j = 0; j < ny; j++) {
+      for (i = 0; i < nx; i++) {
+        s = -2.0 * (Fftsig[0] * (1.0 - cx[i]) + Fftsig[1] * (1.0 - cy[j]) +
+                    Fftsig[2] * (1.0 - cz[k]));
+        s = (s != 0.0) ? scale / s : 0.0;
+        FFTRE(&Fftbuf, k, j, i) *= s;
+        FFTIM(&Fftbuf, k, j, i) *= s;
+      }
     }
   }
+  fft3d_inverse(&Fftbuf);
 
-  /*   y faces */
-  for (k = 1; k <= nz2; k++) {
-    temp0 = (k - 1) * L22;
-    for (i = 1; i <= nx2; i++) {
-      Ah[temp0 + i] = Ah[temp0 + ny * nx2 + i];
-      Ah[temp0 + ny1 * nx2 + i] = Ah[temp0 + nx2 + i];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(static)               \
+    private(i, j, m, temp0)
+#endif
+  for (k = 2; k <= nz1; k++) {
+    for (j = 2; j <= ny1; j++) {
+      temp0 = (k - 1) * L22 + (j - 1) * nx2;
+      for (i = 2; i <= nx1; i++) {
+        m = temp0 + i;
+        if (gx[m - 1] + gx[m] + gz[m - L22] + gz[m] + gy[m] + gy[m - nx2] !=
+            0.0) {
+          Zg[m] = FFTRE(&Fftbuf, k - 2, j - 2, i - 2);
+        } else {
+          Zg[m] = 0.0;
+        }
+      }
     }
   }
+  wrapfaces(Zg);
 
-  /*  z faces  */
-  temp0 = nz * L22;
-  temp1 = nz1 * L22;
-  for (m = 1; m <= L22; m++) {
-    Ah[m] = Ah[m + temp0];
-    Ah[m + temp1] = Ah[m + L22];
+  return;
+}
+
+/*  The matrix product subroutine, r = A * v.  The sites between the */
+/*  first and last z planes are done as one contiguous run, shared */
+/*  out among the threads.  Under mpirun the planes are those of */
+/*  this rank's slab. */
+void matprod(double *v, double *r) {
+  int i;
+
+  /*  Perform basic matrix multiplication, results in incorrect information at
+    periodic boundaries. */
+  for (i = Sitebase + 1; i <= Sitebase + L22; i++) {
+    r[i] = 0.0;
+    r[Sitecount - L22 + i] = 0.0;
   }
+
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(Nthreads) schedule(static)
+#endif
+  for (i = Sitebase + L22 + 1; i <= Sitebase + Sitecount - L22; i++) {
+    r[i] = (-v[i]) *
+           (gx[i - 1] + gx[i] + gz[i - L22] + gz[i] + gy[i] + gy[i - nx2]);
+    r[i] += gx[i - 1] * v[i - 1] + gx[i] * v[i + 1] +
+            gz[i - L22] * v[i - L22] + gz[i] * v[i + L22] +
+            gy[i] * v[i + nx2] + gy[i - nx2] * v[i - nx2];
+  }
+
+  /*  Correct terms at periodic boundaries (Section 3.3 in manual) */
+  wrapfaces(r);
+
+  return;
 }
 
-/*  Subroutine to compute the total current in the x, y, and z directions */
+/*  Function that returns the dot product of a and b over the real */
+/*  sites.  Each z plane is added up along its x rows, and the planes */
+/*  are added in order, so the result is the same for any number of */
+/*  threads, or of ranks under mpirun. */
+double realdot(double *a, double *b) {
+  int i, j, k, temp0;
+  double sum;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(static)               \
+    private(i, j, temp0, sum)
+#endif
+  for (k = Zlo + 2; k <= Zhi + 1; k++) {
+    sum = 0.0;
+    for (j = 2; j <= ny1; j++) {
+      temp0 = (k - 1) * L22 + (j - 1) * nx2;
+      for (i = 2; i <= nx1; i++) {
+        sum += a[temp0 + i] * b[temp0 + i];
+      }
+    }
+    Planesum[k] = sum;
+  }
+
+  return (slabsum(Planesum + Zlo + 2, Zhi - Zlo));
+}
+
+/*  Subroutine to compute the total current in the x, y, and z directions. */
+/*  Under mpirun each rank adds up the currents of its own slab, and the */
+/*  sums are then added up over the ranks. */
 void current(int doitz, int ilast) {
   int i, j, k;
   int m, temp0, temp1;
-  double cur1, cur2, cur3;
+  size_t p;
+  double cur1, cur2, cur3, tot[3];
   double ocurrx, ocurry, ocurrz;
   double ncurry, ncurrz;
   double utotx, outotx;
@@ -573,7 +1312,7 @@ void current(int doitz, int ilast) {
     outoty = utoty;
     outotz = utotz;
     for (j = 2; j <= ny1; j++) {
-      for (k = 2; k <= nz1; k++) {
+      for (k = Zlo + 2; k <= Zhi + 1; k++) {
         temp0 = (k - 1) * L22;
         temp1 = temp0 + (j - 1) * nx2;
         m = temp1 + i;
@@ -598,6 +1337,16 @@ void current(int doitz, int ilast) {
         pcurr[pix[m]][1] += cur2 / ((double)fxyz);
         currz += cur3;
         pcurr[pix[m]][2] += cur3 / ((double)fxyz);
+
+        /*  and kept for --vtk */
+
+        if (ilast && Curfield) {
+          p = 4 * (((size_t)(k - 2) * ny + (j - 2)) * nx + (i - 2));
+          Curfield[p] = u[m];
+          Curfield[p + 1] = cur1;
+          Curfield[p + 2] = cur2;
+          Curfield[p + 3] = cur3;
+        }
       }
     }
 
@@ -609,13 +1358,34 @@ void current(int doitz, int ilast) {
       printf("\n\t\t\taveraging currents");
       fflush(stdout);
 
+      /* Current and field in this x layer */
+      Layercurr[4 * i] = curry - ocurry;
+      Layercurr[4 * i + 1] = currz - ocurrz;
+      Layercurr[4 * i + 2] = utoty - outoty;
+      Layercurr[4 * i + 3] = utotz - outotz;
+    }
+  }
+
+  tot[0] = currx;
+  tot[1] = curry;
+  tot[2] = currz;
+  slabreduce(tot, 3);
+  slabreduce(&pcurr[0][0], NPHMAX * 4);
+  currx = tot[0];
+  curry = tot[1];
+  currz = tot[2];
+
+  if (doitz && ilast) {
+    slabreduce(Layercurr, 4 * nx2);
+    for (i = 2; i <= nx1; i++) {
+
       /* Average current over this x layer */
-      ncurry = (curry - ocurry) / ((double)L22);
-      ncurrz = (currz - ocurrz) / ((double)L22);
+      ncurry = Layercurr[4 * i] / ((double)L22);
+      ncurrz = Layercurr[4 * i + 1] / ((double)L22);
 
       /* Average field over this x layer */
-      nutoty = (utoty - outoty) / ((double)L22);
-      nutotz = (utotz - outotz) / ((double)L22);
+      nutoty = Layercurr[4 * i + 2] / ((double)L22);
+      nutotz = Layercurr[4 * i + 3] / ((double)L22);
 
       Lsigma[i] = (1.0 / 2.0) * ((ncurry / nutoty) + (ncurrz / nutotz));
     }
@@ -633,106 +1403,943 @@ void current(int doitz, int ilast) {
   return;
 }
 
-/*  Subroutine that performs the conjugate gradient solution routine to
-  find the correct set of nodal voltages */
-void dembx(int ndlist, int doitz) {
-  double gg, hAh, lambda, gglast, gamma;
-  int i, m, k, ncgsteps, icc;
+/*  Subroutine that performs the conjugate gradient solution routine to
+  find the correct set of nodal voltages */
+void dembx(int doitz) {
+  double gg, hAh, lambda, rz, rzlast, gamma;
+  int i, ncgsteps, icc;
+
+  /*  Note:  voltage gradients are maintained because in the conjugate gradient
+    relaxation algorithm, the voltage vector is only modified by adding a
+    periodic vector to it. */
+  /*  First stage, compute initial value of gradient (gb), initialize h, the
+    conjugate gradient direction, and compute norm squared of gradient vector.
+  */
+
+  /*  With --precond jacobi, the direction h is built from Zg, the */
+  /*  gradient times the inverse diagonal of A, and rz = gb*Zg takes */
+  /*  the place of gg in the step lengths.  With --fft, Zg is the */
+  /*  gradient times the inverse of the reference network instead. */
+  /*  Without either, rz is gg. */
+  /*  The dot products run over the real sites (realdot), and the */
+  /*  loops over all sites are shared out among the threads.  With */
+  /*  --gpu the same steps are done on the device by dembxgpu.  Under */
+  /*  mpirun the sites are those of this rank's slab. */
+
+#ifdef _OPENMP
+  if (Gpu) {
+    dembxgpu(doitz);
+    return;
+  }
+#endif
+
+  matprod(u, gb);
+  if (Precond == FFTGREEN && fftprecondset()) {
+    printf("\nNo memory for the FFT preconditioner; using none");
+    Precond = NOPRECOND;
+  }
+  if (Precond == FFTGREEN) {
+    fftprecondapply();
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(Nthreads) schedule(static)
+#endif
+    for (i = Sitebase + 1; i <= Sitebase + Sitecount; i++) {
+      h[i] = Zg[i];
+    }
+  } else if (Precond == JACOBI) {
+    precondset();
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(Nthreads) schedule(static)
+#endif
+    for (i = Sitebase + 1; i <= Sitebase + Sitecount; i++) {
+      Zg[i] = Dinv[i] * gb[i];
+      h[i] = Zg[i];
+    }
+  } else {
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(Nthreads) schedule(static)
+#endif
+    for (i = Sitebase + 1; i <= Sitebase + Sitecount; i++) {
+      h[i] = gb[i];
+    }
+  }
+
+  /*   Variable gg is the norm squared of the gradient vector */
+  gg = realdot(gb, gb);
+  rz = Precond ? realdot(gb, Zg) : gg;
+  fprintf(outfile, "After first stage gg is %lf \n", gg);
+  fflush(outfile);
+  /*   Second stage, initialize Ah variable, compute parameter lamdba,
+    make first change in voltage array, update gradient (gb) vector */
+  if (gg >= gtest) {
+    matprod(h, Ah);
+    hAh = realdot(h, Ah);
+
+    lambda = rz / hAh;
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(Nthreads) schedule(static)
+#endif
+    for (i = Sitebase + 1; i <= Sitebase + Sitecount; i++) {
+      u[i] -= lambda * h[i];
+      gb[i] -= lambda * Ah[i];
+    }
+
+    /*  third stage:  iterate conjugate gradient solution process until
+      gg < gtest criterion is satisfied.
+      (USER) The parameter ncgsteps is the total number of conjugate gradient
+      steps to go through.  Only in very unusual problems, like when the
+      conductivity of one phase is much higher than all the rest, will this many
+      steps be used. */
+    ncgsteps = 8000;
+
+    for (icc = 1; ((icc <= ncgsteps) && (gg >= gtest)); icc++) {
+      rzlast = rz;
+      gg = realdot(gb, gb);
+      rz = gg;
+      if (gg >= gtest && Precond == FFTGREEN) {
+        fftprecondapply();
+        rz = realdot(gb, Zg);
+      } else if (gg >= gtest && Precond) {
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(Nthreads) schedule(static)
+#endif
+        for (i = Sitebase + L22 + 1; i <= Sitebase + Sitecount - L22;
+             i++) {
+          Zg[i] = Dinv[i] * gb[i];
+        }
+        wrapfaces(Zg);
+        rz = realdot(gb, Zg);
+      }
+      if (gg >= gtest) {
+        gamma = rz / rzlast;
+        /*  update conjugate gradient direction */
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(Nthreads) schedule(static)
+#endif
+        for (i = Sitebase + 1; i <= Sitebase + Sitecount; i++) {
+          h[i] = (Precond ? Zg[i] : gb[i]) + gamma * h[i];
+        }
+        matprod(h, Ah);
+        hAh = realdot(h, Ah);
+        lambda = rz / hAh;
+        /*  update voltage, gradient vectors */
+#ifdef _OPENMP
+#pragma omp parallel for simd num_threads(Nthreads) schedule(static)
+#endif
+        for (i = Sitebase + 1; i <= Sitebase + Sitecount; i++) {
+          u[i] -= lambda * h[i];
+          gb[i] -= lambda * Ah[i];
+        }
+
+      } /* end of 2nd if gg gt gtest loop */
+      ic = icc;
+      if ((icc % 30) == 0) {
+        fprintf(outfile, "After %d cycles \n", icc);
+        fprintf(outfile, "gg = %lf\n", gg);
+        current(doitz, 0);
+        fprintf(outfile, "currx = %lf\n", currx);
+        fprintf(outfile, "curry = %lf\n", curry);
+        fprintf(outfile, "currz = %lf\n", currz);
+        fflush(outfile);
+      }
+    } /* end of ncgsteps loop */
+    if (gg >= gtest) {
+      fprintf(outfile, "\nNO CONVERGENCE: %d steps\n", ncgsteps);
+    }
+  } /* end of if gg gt gtest loop */
+}
+
+#ifdef _OPENMP
+/*  The device versions of wrapfaces, matprod and realdot, for */
+/*  vectors already on the device in dembxgpu.  The faces are done */
+/*  as three kernels, x, y and z in turn, because the y and z faces */
+/*  copy the corners the earlier faces have set. */
+void gpuwrapfaces(double *v) {
+  int i, j, k, temp0, temp1;
+  int ly = ny, lz = nz, lx1 = nx1, lx2 = nx2, ly1 = ny1;
+  int ly2 = ny2, lz1 = nz1, lz2 = nz2, l22 = L22;
+
+#pragma omp target teams distribute parallel for collapse(2)                  \
+    private(temp1)
+  for (k = 1; k <= lz2; k++) {
+    for (j = 1; j <= ly2; j++) {
+      temp1 = (k - 1) * l22 + lx2 * (j - 1);
+      v[temp1 + lx2] = v[temp1 + 2];
+      v[temp1 + 1] = v[temp1 + lx1];
+    }
+  }
+
+#pragma omp target teams distribute parallel for collapse(2)                  \
+    private(temp0)
+  for (k = 1; k <= lz2; k++) {
+    for (i = 1; i <= lx2; i++) {
+      temp0 = (k - 1) * l22;
+      v[temp0 + i] = v[temp0 + ly * lx2 + i];
+      v[temp0 + ly1 * lx2 + i] = v[temp0 + lx2 + i];
+    }
+  }
+
+  temp0 = lz * l22;
+  temp1 = lz1 * l22;
+#pragma omp target teams distribute parallel for
+  for (i = 1; i <= l22; i++) {
+    v[i] = v[i + temp0];
+    v[i + temp1] = v[i + l22];
+  }
+
+  return;
+}
+
+void gpumatprod(double *v, double *r) {
+  int i, n = ns2, l22 = L22, lx2 = nx2;
+  double *x = gx, *y = gy, *z = gz;
+
+#pragma omp target teams distribute parallel for
+  for (i = 1; i <= l22; i++) {
+    r[i] = 0.0;
+    r[n - l22 + i] = 0.0;
+  }
+
+#pragma omp target teams distribute parallel for
+  for (i = (l22 + 1); i <= (n - l22); i++) {
+    r[i] = (-v[i]) * (x[i - 1] + x[i] + z[i - l22] + z[i] + y[i] + y[i - lx2]);
+    r[i] += x[i - 1] * v[i - 1] + x[i] * v[i + 1] + z[i - l22] * v[i - l22] +
+            z[i] * v[i + l22] + y[i] * v[i + lx2] + y[i - lx2] * v[i - lx2];
+  }
+
+  gpuwrapfaces(r);
+
+  return;
+}
+
+double gpudot(double *a, double *b) {
+  int i, j, k, lx1 = nx1, ly1 = ny1, lz1 = nz1, lx2 = nx2, l22 = L22;
+  double sum = 0.0;
+
+#pragma omp target teams distribute parallel for collapse(3)                  \
+    reduction(+ : sum) map(tofrom : sum)
+  for (k = 2; k <= lz1; k++) {
+    for (j = 2; j <= ly1; j++) {
+      for (i = 2; i <= lx1; i++) {
+        sum += a[(k - 1) * l22 + (j - 1) * lx2 + i] *
+               b[(k - 1) * l22 + (j - 1) * lx2 + i];
+      }
+    }
+  }
+
+  return (sum);
+}
+
+/*  Subroutine that does the conjugate gradient solution of dembx on */
+/*  an offload device (--gpu).  The voltages, the bonds and the work */
+/*  vectors stay on the device for all the steps, and only the */
+/*  voltages come back, every 30 steps for current and at the end. */
+/*  The sums of the dot products are not done in a fixed order, so */
+/*  the answer agrees with that of dembx to roundoff, not bit for bit. */
+void dembxgpu(int doitz) {
+  double gg, hAh, lambda, rz, rzlast, gamma;
+  int i, ncgsteps, icc, n, l22, pc;
+  double *U = u, *G = gb, *H = h, *AH = Ah;
+  double *D = Dinv, *ZG = Zg;
+
+  n = ns2;
+  l22 = L22;
+  pc = Precond;
+  if (pc)
+    precondset();
+
+#pragma omp target data map(tofrom : U[0 : n + 1])                            \
+    map(to : gx[0 : n + 1], gy[0 : n + 1], gz[0 : n + 1])                      \
+    map(alloc : G[0 : n + 1], H[0 : n + 1], AH[0 : n + 1])
+  {
+#pragma omp target data map(to : D[0 : n + 1]) map(alloc : ZG[0 : n + 1])     \
+    if (pc)
+    {
+      gpumatprod(U, G);
+      if (pc) {
+#pragma omp target teams distribute parallel for
+        for (i = 1; i <= n; i++) {
+          ZG[i] = D[i] * G[i];
+          H[i] = ZG[i];
+        }
+      } else {
+#pragma omp target teams distribute parallel for
+        for (i = 1; i <= n; i++) {
+          H[i] = G[i];
+        }
+      }
+
+      gg = gpudot(G, G);
+      rz = pc ? gpudot(G, ZG) : gg;
+      fprintf(outfile, "After first stage gg is %lf \n", gg);
+      fflush(outfile);
+      if (gg >= gtest) {
+        gpumatprod(H, AH);
+        hAh = gpudot(H, AH);
+
+        lambda = rz / hAh;
+#pragma omp target teams distribute parallel for
+        for (i = 1; i <= n; i++) {
+          U[i] -= lambda * H[i];
+          G[i] -= lambda * AH[i];
+        }
+
+        ncgsteps = 8000;
+
+        for (icc = 1; ((icc <= ncgsteps) && (gg >= gtest)); icc++) {
+          rzlast = rz;
+          gg = gpudot(G, G);
+          rz = gg;
+          if (gg >= gtest && pc) {
+#pragma omp target teams distribute parallel for
+            for (i = l22 + 1; i <= n - l22; i++) {
+              ZG[i] = D[i] * G[i];
+            }
+            gpuwrapfaces(ZG);
+            rz = gpudot(G, ZG);
+          }
+          if (gg >= gtest) {
+            gamma = rz / rzlast;
+#pragma omp target teams distribute parallel for
+            for (i = 1; i <= n; i++) {
+              H[i] = (pc ? ZG[i] : G[i]) + gamma * H[i];
+            }
+            gpumatprod(H, AH);
+            hAh = gpudot(H, AH);
+            lambda = rz / hAh;
+#pragma omp target teams distribute parallel for
+            for (i = 1; i <= n; i++) {
+              U[i] -= lambda * H[i];
+              G[i] -= lambda * AH[i];
+            }
+          }
+          ic = icc;
+          if ((icc % 30) == 0) {
+#pragma omp target update from(U[0 : n + 1])
+            fprintf(outfile, "After %d cycles \n", icc);
+            fprintf(outfile, "gg = %lf\n", gg);
+            current(doitz, 0);
+            fprintf(outfile, "currx = %lf\n", currx);
+            fprintf(outfile, "curry = %lf\n", curry);
+            fprintf(outfile, "currz = %lf\n", currz);
+            fflush(outfile);
+          }
+        }
+        if (gg >= gtest) {
+          fprintf(outfile, "\nNO CONVERGENCE: %d steps\n", ncgsteps);
+        }
+      }
+    }
+  }
+
+  return;
+}
+#endif
+
+/*  Function that gives the conductivity in direction d (1, 2 or 3 for */
+/*  x, y or z) of the f x f x f block of pixels whose first site is m0. */
+/*  It is the mean of two bounds: the columns along d in parallel, each */
+/*  column its pixels in series, and the planes across d in series, */
+/*  each plane its pixels in parallel.  An insulating plane across d */
+/*  makes both zero, and an insulating pixel in every column makes the */
+/*  first zero, so a block that blocks the current is not averaged */
+/*  into a conductor as a plain mean of its pixels would be. */
+double blocksigma(int *p, int m0, int f, int d, int sy, int sz) {
+  int a, b, c, m, blocked, sa, sb, sc;
+  double s, r, cols, planes, plane;
+
+  /*  Stride along d, and along the two directions across it */
+  if (d == 1) {
+    sa = 1;
+    sb = sy;
+    sc = sz;
+  } else if (d == 2) {
+    sa = sy;
+    sb = 1;
+    sc = sz;
+  } else {
+    sa = sz;
+    sb = 1;
+    sc = sy;
+  }
+
+  /*  Columns in parallel */
+  cols = 0.0;
+  for (c = 0; c < f; c++) {
+    for (b = 0; b < f; b++) {
+      r = 0.0;
+      blocked = 0;
+      for (a = 0; a < f; a++) {
+        m = m0 + a * sa + b * sb + c * sc;
+        s = sigma[p[m]][d];
+        if (s == 0.0) {
+          blocked = 1;
+        } else {
+          r += 1.0 / s;
+        }
+      }
+      if (!blocked)
+        cols += (double)f / r;
+    }
+  }
+  cols /= (double)(f * f);
+
+  /*  Planes in series */
+  r = 0.0;
+  blocked = 0;
+  for (a = 0; a < f; a++) {
+    plane = 0.0;
+    for (c = 0; c < f; c++) {
+      for (b = 0; b < f; b++) {
+        m = m0 + a * sa + b * sb + c * sc;
+        plane += sigma[p[m]][d];
+      }
+    }
+    plane /= (double)(f * f);
+    if (plane == 0.0) {
+      blocked = 1;
+    } else {
+      r += 1.0 / plane;
+    }
+  }
+  planes = blocked ? 0.0 : (double)f / r;
+
+  return (0.5 * (cols + planes));
+}
+
+/*  Function that gives the conductance of the bond between two sites */
+/*  of conductivity s1 and s2, the same as be in bond */
+double bondcond(double s1, double s2) {
+  if (s1 == 0.0 || s2 == 0.0)
+    return (0.0);
+
+  return (1.0 / (0.5 / s1 + 0.5 / s2));
+}
+
+/*  Subroutine that estimates the conductivity tensor with random */
+/*  walkers on the conductor network (--walk), after bond has made it. */
+/*  At each step a walker picks one of its six bonds at random and */
+/*  crosses it with probability g / gmax, gmax being the largest bond */
+/*  conductance.  The walk then spreads like the current: uniform */
+/*  densities of walkers stay uniform, and the conductivity is */
+/*  3 gmax <da db> / t for displacements da and db over t steps, */
+/*  times the fraction of sites with a conducting bond, where the */
+/*  walkers start.  The growth of <da db> from half way to the end is */
+/*  used, so that walkers caught in dead ends, whose displacements */
+/*  stop growing, and the short-time spread within the pores do not */
+/*  count.  Over a finite walk the dead ends are not all full yet, so */
+/*  the growth is still slowing and the estimate is too high.  The */
+/*  growth over the third and the fourth quarter of the walk are */
+/*  compared to see this: when the fourth is slower by more than */
+/*  WALKTOL of the estimate, beyond its noise, the walkers go on for */
+/*  as many steps again, up to WALKDOUBLINGS times unless --walk-steps */
+/*  fixed their number.  Walkdrift and Walkdrifthalf keep the last */
+/*  difference, relative to the estimate, and its 95% half-width.  The */
+/*  walkers are split into WALKBATCHES batches with their own random */
+/*  streams, shared out among the threads, so the result does not */
+/*  depend on their number; the spread of the batch estimates gives */
+/*  the confidence intervals.  It is not used under mpirun, so the */
+/*  slab is all of the system.  Returns 1 if there is no room for the */
+/*  walkers, 0 otherwise. */
+int randomwalk(void) {
+  int b, c, i, j, k, m, t, w, nmob, nwalk, from, steps, half, quar, dir;
+  int dx, dy, dz, hx, hy, hz, qx, qy, qz, temp0, more, *wstate, *ws;
+  uint64_t r;
+  double gmax, g, fmob, scale, mean, var, dmean, trmean, sum[6], sum3, sum4;
+  double est[WALKBATCHES][6], drift[WALKBATCHES], tr[WALKBATCHES];
+  Rngstate st[WALKBATCHES];
+
+  gmax = 0.0;
+  nmob = 0;
+  for (k = 2; k <= nz1; k++) {
+    for (j = 2; j <= ny1; j++) {
+      temp0 = (k - 1) * L22 + (j - 1) * nx2;
+      for (i = 2; i <= nx1; i++) {
+        m = temp0 + i;
+        g = gx[m - 1] + gx[m] + gy[m - nx2] + gy[m] + gz[m - L22] + gz[m];
+        if (g > 0.0)
+          nmob++;
+        gmax = (gx[m] > gmax) ? gx[m] : gmax;
+        gmax = (gy[m] > gmax) ? gy[m] : gmax;
+        gmax = (gz[m] > gmax) ? gz[m] : gmax;
+      }
+    }
+  }
+
+  steps = Walksteps;
+  if (steps < 2) {
+    steps = (nx > ny) ? nx : ny;
+    steps = (nz > steps) ? nz : steps;
+    steps = 4 * steps * steps;
+  }
+  steps = (steps < 4) ? 4 : steps;
+  nwalk = (Walkers + WALKBATCHES - 1) / WALKBATCHES;
+  for (c = 0; c < 6; c++) {
+    Walksig[c] = Walkhalf[c] = 0.0;
+  }
+  Walkdrift = Walkdrifthalf = 0.0;
+  fprintf(outfile, "Random walk: %d walkers of %d steps\n",
+          nwalk * WALKBATCHES, steps);
+  if (nmob == 0 || gmax <= 0.0)
+    return (0);
+  fmob = (double)nmob / (double)fxyz;
+
+  /*  Site and displacement of each walker, so that a walk found too */
+  /*  short goes on from where it stopped */
+  wstate = ivector(6 * (size_t)nwalk * WALKBATCHES);
+  if (!wstate)
+    return (1);
+  for (b = 0; b < WALKBATCHES; b++) {
+    rng_stream(&st[b], (uint64_t)Walkseed, b);
+  }
+
+  from = 0;
+  more = (Walksteps < 2) ? WALKDOUBLINGS : 0;
+  for (;;) {
+    half = steps / 2;
+    quar = half + (steps - half) / 2;
+    scale = 3.0 * gmax * fmob / ((double)nwalk * (double)(steps - half));
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(Nthreads) schedule(dynamic, 1)           \
+    private(c, i, j, k, m, t, w, ws, dir, dx, dy, dz, hx, hy, hz, qx, qy, qz,  \
+            r, g, sum, sum3, sum4)
+#endif
+    for (b = 0; b < WALKBATCHES; b++) {
+      for (c = 0; c < 6; c++) {
+        sum[c] = 0.0;
+      }
+      sum3 = sum4 = 0.0;
+      for (w = 0; w < nwalk; w++) {
+        ws = wstate + 6 * ((size_t)b * nwalk + w);
+        if (from == 0) {
+
+          /*  Start at a random site with a conducting bond */
+          do {
+            i = 2 + (int)(rng_uniform(&st[b]) * nx);
+            j = 2 + (int)(rng_uniform(&st[b]) * ny);
+            k = 2 + (int)(rng_uniform(&st[b]) * nz);
+            m = (k - 1) * L22 + (j - 1) * nx2 + i;
+            g = gx[m - 1] + gx[m] + gy[m - nx2] + gy[m] + gz[m - L22] + gz[m];
+          } while (g <= 0.0);
+          dx = dy = dz = 0;
+        } else {
+          i = ws[0];
+          j = ws[1];
+          k = ws[2];
+          m = (k - 1) * L22 + (j - 1) * nx2 + i;
+          dx = ws[3];
+          dy = ws[4];
+          dz = ws[5];
+        }
+
+        /*  A walk that goes on is twice as long, so it is half way */
+        hx = dx;
+        hy = dy;
+        hz = dz;
+        qx = qy = qz = 0;
+        for (t = from + 1; t <= steps; t++) {
+
+          /*  The high 32 bits pick the bond, the low 32 the crossing */
+          r = rng_next(&st[b]);
+          dir = (int)(((r >> 32) * 6) >> 32);
+          g = (double)(r & 0xffffffffu) * (gmax / 4294967296.0);
+          switch (dir) {
+          case 0:
+            if (g < gx[m]) {
+              m++;
+              dx++;
+              if (++i > nx1) {
+                i = 2;
+                m -= nx;
+              }
+            }
+            break;
+          case 1:
+            if (g < gx[m - 1]) {
+              m--;
+              dx--;
+              if (--i < 2) {
+                i = nx1;
+                m += nx;
+              }
+            }
+            break;
+          case 2:
+            if (g < gy[m]) {
+              m += nx2;
+              dy++;
+              if (++j > ny1) {
+                j = 2;
+                m -= ny * nx2;
+              }
+            }
+            break;
+          case 3:
+            if (g < gy[m - nx2]) {
+              m -= nx2;
+              dy--;
+              if (--j < 2) {
+                j = ny1;
+                m += ny * nx2;
+              }
+            }
+            break;
+          case 4:
+            if (g < gz[m]) {
+              m += L22;
+              dz++;
+              if (++k > nz1) {
+                k = 2;
+                m -= nz * L22;
+              }
+            }
+            break;
+          default:
+            if (g < gz[m - L22]) {
+              m -= L22;
+              dz--;
+              if (--k < 2) {
+                k = nz1;
+                m += nz * L22;
+              }
+            }
+            break;
+          }
+          if (t == half) {
+            hx = dx;
+            hy = dy;
+            hz = dz;
+          } else if (t == quar) {
+            qx = dx;
+            qy = dy;
+            qz = dz;
+          }
+        }
+        ws[0] = i;
+        ws[1] = j;
+        ws[2] = k;
+        ws[3] = dx;
+        ws[4] = dy;
+        ws[5] = dz;
+        sum[0] += (double)dx * dx - (double)hx * hx;
+        sum[1] += (double)dy * dy - (double)hy * hy;
+        sum[2] += (double)dz * dz - (double)hz * hz;
+        sum[3] += (double)dy * dz - (double)hy * hz;
+        sum[4] += (double)dx * dz - (double)hx * hz;
+        sum[5] += (double)dx * dy - (double)hx * hy;
+        sum3 += (double)qx * qx + (double)qy * qy + (double)qz * qz -
+                (double)hx * hx - (double)hy * hy - (double)hz * hz;
+        sum4 += (double)dx * dx + (double)dy * dy + (double)dz * dz -
+                (double)qx * qx - (double)qy * qy - (double)qz * qz;
+      }
+      for (c = 0; c < 6; c++) {
+        est[b][c] = scale * sum[c];
+      }
+
+      /*  Growth per step over each quarter, as a conductivity */
+      tr[b] = est[b][0] + est[b][1] + est[b][2];
+      drift[b] = scale * (double)(steps - half) *
+                 (sum3 / (double)(quar - half) - sum4 / (double)(steps - quar));
+    }
+
+    /*  Mean of the batches, and 1.96 standard errors */
+    for (c = 0; c < 6; c++) {
+      mean = 0.0;
+      for (b = 0; b < WALKBATCHES; b++) {
+        mean += est[b][c];
+      }
+      mean /= (double)WALKBATCHES;
+      var = 0.0;
+      for (b = 0; b < WALKBATCHES; b++) {
+        var += (est[b][c] - mean) * (est[b][c] - mean);
+      }
+      var /= (double)(WALKBATCHES - 1);
+      Walksig[c] = mean;
+      Walkhalf[c] = 1.96 * sqrt(var / (double)WALKBATCHES);
+    }
+
+    /*  Slowing of the growth from the third to the fourth quarter */
+    dmean = trmean = 0.0;
+    for (b = 0; b < WALKBATCHES; b++) {
+      dmean += drift[b];
+      trmean += tr[b];
+    }
+    dmean /= (double)WALKBATCHES;
+    trmean /= (double)WALKBATCHES;
+    var = 0.0;
+    for (b = 0; b < WALKBATCHES; b++) {
+      var += (drift[b] - dmean) * (drift[b] - dmean);
+    }
+    var /= (double)(WALKBATCHES - 1);
+    if (trmean > 0.0) {
+      Walkdrift = dmean / trmean;
+      Walkdrifthalf = 1.96 * sqrt(var / (double)WALKBATCHES) / trmean;
+    }
+    fprintf(outfile, "After %d steps: growth of the fourth quarter %.1lf%% ",
+            steps, 100.0 * Walkdrift);
+    fprintf(outfile, "+/- %.1lf%% below the third\n", 100.0 * Walkdrifthalf);
 
-  /*  Note:  voltage gradients are maintained because in the conjugate gradient
-    relaxation algorithm, the voltage vector is only modified by adding a
-    periodic vector to it. */
-  /*  First stage, compute initial value of gradient (gb), initialize h, the
-    conjugate gradient direction, and compute norm squared of gradient vector.
-  */
+    if (more == 0 || Walkdrift - Walkdrifthalf <= WALKTOL)
+      break;
+    more--;
+    from = steps;
+    steps *= 2;
+  }
+  free_ivector(wstate);
+
+  return (0);
+}
 
-  prod();
-  for (i = 1; i <= ns2; i++) {
-    h[i] = gb[i];
+/*  Subroutine that solves the problem on a grid coarsened f times along */
+/*  each axis (--coarsen f), and adds the periodic part of its voltages */
+/*  to u to start the full solution.  Each coarse site has the */
+/*  conductivities of its block of pixels from blocksigma, and the */
+/*  field across a coarse site is f times that across a pixel.  The */
+/*  globals for the system size and the conductor network are set to */
+/*  the coarse grid while dembx and current work on it, and put back */
+/*  afterwards; the work vectors gb, h, Ah, Zg, Dinv and Planesum are */
+/*  big enough for either grid.  The currents of the coarse solution, */
+/*  per pixel, go in Coarsecurr.  Returns 1, leaving u alone, if f does */
+/*  not divide the system size.  It is not used under mpirun, so the */
+/*  slab of the coarse grid is all of it. */
+int coarsesolve(int f) {
+  int i, j, k, d, m, mc, temp0, temp1, cn, cns;
+  int fnx, fny, fnz, fnx2, fny2, fnz2, fL22, fns2, ffxyz;
+  int *fpix, *cpix, *i0, *i1;
+  double fgtest, x, w;
+  double *fgx, *fgy, *fgz, *fu, *cgx, *cgy, *cgz, *cu, *cs[4], *wt;
+
+  if ((nx % f) || (ny % f) || (nz % f)) {
+    printf("\nWARNING: --coarsen %d does not divide the system size", f);
+    fflush(stdout);
+    return (1);
   }
 
-  /*   Variable gg is the norm squared of the gradient vector */
-  gg = 0.0;
-  for (k = 1; k <= ndlist; k++) {
-    m = list[k];
-    gg += gb[m] * gb[m];
+  /*  Keep the fine grid */
+  fnx = nx;
+  fny = ny;
+  fnz = nz;
+  fnx2 = nx2;
+  fny2 = ny2;
+  fnz2 = nz2;
+  fL22 = L22;
+  fns2 = ns2;
+  ffxyz = fxyz;
+  fgtest = gtest;
+  fpix = pix;
+  fgx = gx;
+  fgy = gy;
+  fgz = gz;
+  fu = u;
+
+  /*  Coarse grid */
+  nx = fnx / f;
+  ny = fny / f;
+  nz = fnz / f;
+  fxyz = nx * ny * nz;
+  nx1 = nx + 1;
+  ny1 = ny + 1;
+  nz1 = nz + 1;
+  nx2 = nx + 2;
+  ny2 = ny + 2;
+  nz2 = nz + 2;
+  L22 = nx2 * ny2;
+  ns2 = nx2 * ny2 * nz2;
+  gtest = (1.0e-12) * 5000.0 * ns2;
+  Zhi = nz;
+  Sitecount = ns2;
+
+  cpix = ivector(ns2 + 1);
+  cgx = dvector(ns2 + 1);
+  cgy = dvector(ns2 + 1);
+  cgz = dvector(ns2 + 1);
+  cu = dvector(ns2 + 1);
+  for (d = 1; d <= 3; d++) {
+    cs[d] = dvector(ns2 + 1);
   }
-  fprintf(outfile, "After first stage gg is %lf \n", gg);
-  fflush(outfile);
-  /*   Second stage, initialize Ah variable, compute parameter lamdba,
-    make first change in voltage array, update gradient (gb) vector */
-  if (gg >= gtest) {
-    prod1();
-    hAh = 0.0;
-    for (k = 1; k <= ndlist; k++) {
-      m = list[k];
-      hAh += h[m] * Ah[m];
+
+  /*  Conductivities of the coarse sites, wrapped onto the extra layer */
+  for (k = 2; k <= nz1; k++) {
+    for (j = 2; j <= ny1; j++) {
+      for (i = 2; i <= nx1; i++) {
+        mc = (k - 1) * L22 + (j - 1) * nx2 + i;
+        m = (f * (k - 2) + 1) * fL22 + (f * (j - 2) + 1) * fnx2 +
+            f * (i - 2) + 2;
+        for (d = 1; d <= 3; d++) {
+          cs[d][mc] = blocksigma(fpix, m, f, d, fnx2, fL22);
+        }
+      }
     }
+  }
+  for (d = 1; d <= 3; d++) {
+    wrapfaces(cs[d]);
+  }
 
-    lambda = gg / hAh;
-    for (i = 1; i <= ns2; i++) {
-      u[i] -= lambda * h[i];
-      gb[i] -= lambda * Ah[i];
+  /*  Conductor network, as in bond, and a uniform field */
+  for (m = 1; m <= ns2; m++) {
+    cpix[m] = 1;
+    cgx[m] = cgy[m] = cgz[m] = 0.0;
+  }
+  for (k = 1; k <= nz1; k++) {
+    for (j = 1; j <= ny2; j++) {
+      for (i = 1; i <= nx2; i++) {
+        m = (k - 1) * L22 + (j - 1) * nx2 + i;
+        cgz[m] = bondcond(cs[3][m], cs[3][m + L22]);
+        if (j <= ny1)
+          cgy[m] = bondcond(cs[2][m], cs[2][m + nx2]);
+        if (i <= nx1)
+          cgx[m] = bondcond(cs[1][m], cs[1][m + 1]);
+      }
+    }
+  }
+  for (k = 1; k <= nz2; k++) {
+    temp0 = (k - 1) * L22;
+    for (j = 1; j <= ny2; j++) {
+      temp1 = temp0 + (j - 1) * nx2;
+      for (i = 1; i <= nx2; i++) {
+        cu[temp1 + i] = -(double)f * (ex * i + ey * j + ez * k);
+      }
     }
+  }
 
-    /*  third stage:  iterate conjugate gradient solution process until
-      gg < gtest criterion is satisfied.
-      (USER) The parameter ncgsteps is the total number of conjugate gradient
-      steps to go through.  Only in very unusual problems, like when the
-      conductivity of one phase is much higher than all the rest, will this many
-      steps be used. */
-    ncgsteps = 8000;
+  pix = cpix;
+  gx = cgx;
+  gy = cgy;
+  gz = cgz;
+  u = cu;
 
-    for (icc = 1; ((icc <= ncgsteps) && (gg >= gtest)); icc++) {
-      gglast = gg;
-      gg = 0.0;
-      for (k = 1; k <= ndlist; k++) {
-        m = list[k];
-        gg += gb[m] * gb[m];
+  fprintf(outfile, "Coarse solution, %d x %d x %d sites of %d^3 pixels\n", nx,
+          ny, nz, f);
+  fflush(outfile);
+  dembx(0);
+  current(0, 0);
+  Coarsecurr[0] = currx / (double)f;
+  Coarsecurr[1] = curry / (double)f;
+  Coarsecurr[2] = currz / (double)f;
+  printf("\nCoarse_cycles %d", ic);
+  printf("\nCoarse_curr_x %lf", Coarsecurr[0]);
+  printf("\nCoarse_curr_y %lf", Coarsecurr[1]);
+  printf("\nCoarse_curr_z %lf\n", Coarsecurr[2]);
+  fflush(stdout);
+  fprintf(outfile, "Coarse_cycles %d \n", ic);
+  fprintf(outfile, "Coarse_curr_x %lf \n", Coarsecurr[0]);
+  fprintf(outfile, "Coarse_curr_y %lf \n", Coarsecurr[1]);
+  fprintf(outfile, "Coarse_curr_z %lf \n\n", Coarsecurr[2]);
+  fflush(outfile);
+
+  /*  Periodic part of the coarse voltages */
+  for (k = 1; k <= nz2; k++) {
+    temp0 = (k - 1) * L22;
+    for (j = 1; j <= ny2; j++) {
+      temp1 = temp0 + (j - 1) * nx2;
+      for (i = 1; i <= nx2; i++) {
+        cu[temp1 + i] += (double)f * (ex * i + ey * j + ez * k);
       }
-      if (gg >= gtest) {
-        gamma = gg / gglast;
-        /*  update conjugate gradient direction */
-        for (i = 1; i <= ns2; i++) {
-          h[i] = gb[i] + gamma * h[i];
-        }
-        prod1();
-        hAh = 0.0;
-        for (k = 1; k <= ndlist; k++) {
-          m = list[k];
-          hAh += h[m] * Ah[m];
-        }
-        lambda = gg / hAh;
-        /*  update voltage, gradient vectors */
-        for (i = 1; i <= ns2; i++) {
-          u[i] -= lambda * h[i];
-          gb[i] -= lambda * Ah[i];
-        }
+    }
+  }
 
-      } /* end of 2nd if gg gt gtest loop */
-      ic = icc;
-      if ((icc % 30) == 0) {
-        fprintf(outfile, "After %d cycles \n", icc);
-        fprintf(outfile, "gg = %lf\n", gg);
-        current(doitz, 0);
-        fprintf(outfile, "currx = %lf\n", currx);
-        fprintf(outfile, "curry = %lf\n", curry);
-        fprintf(outfile, "currz = %lf\n", currz);
-        fflush(outfile);
+  /*  Put back the fine grid */
+  nx = fnx;
+  ny = fny;
+  nz = fnz;
+  nx1 = nx + 1;
+  ny1 = ny + 1;
+  nz1 = nz + 1;
+  nx2 = fnx2;
+  ny2 = fny2;
+  nz2 = fnz2;
+  L22 = fL22;
+  ns2 = fns2;
+  Zhi = fnz;
+  Sitecount = fns2;
+  fxyz = ffxyz;
+  gtest = fgtest;
+  pix = fpix;
+  gx = fgx;
+  gy = fgy;
+  gz = fgz;
+  u = fu;
+  for (i = 1; i < NPHMAX; i++) {
+    pcurr[i][0] = pcurr[i][1] = pcurr[i][2] = 0.0;
+  }
+
+  /*  Trilinear interpolation of the periodic part between the centers */
+  /*  of the coarse sites, for every fine site.  Along each axis, fine */
+  /*  site n lies between coarse sites i0[n] and i1[n] (wrapped around */
+  /*  periodically), with weight wt[n] on the second. */
+  cn = (fnx2 > fny2) ? fnx2 : fny2;
+  cn = (fnz2 > cn) ? fnz2 : cn;
+  i0 = ivector(3 * (cn + 1));
+  i1 = ivector(3 * (cn + 1));
+  wt = dvector(3 * (cn + 1));
+  for (d = 0; d < 3; d++) {
+    cns = (d == 0) ? fnx / f : ((d == 1) ? fny / f : fnz / f);
+    temp0 = (d == 0) ? fnx2 : ((d == 1) ? fny2 : fnz2);
+    for (i = 1; i <= temp0; i++) {
+      x = ((double)(i - 2) - 0.5 * (double)(f - 1)) / (double)f;
+      m = (int)floor(x);
+      wt[d * (cn + 1) + i] = x - (double)m;
+      i0[d * (cn + 1) + i] = ((m % cns) + cns) % cns + 2;
+      i1[d * (cn + 1) + i] = (((m + 1) % cns) + cns) % cns + 2;
+    }
+  }
+
+  temp0 = (fnx / f) + 2;
+  temp1 = temp0 * ((fny / f) + 2);
+  for (k = 1; k <= nz2; k++) {
+    for (j = 1; j <= ny2; j++) {
+      for (i = 1; i <= nx2; i++) {
+        m = (k - 1) * L22 + (j - 1) * nx2 + i;
+        w = 0.0;
+        for (d = 0; d < 8; d++) {
+          mc = (d & 4) ? i1[2 * (cn + 1) + k] : i0[2 * (cn + 1) + k];
+          x = (d & 4) ? wt[2 * (cn + 1) + k] : 1.0 - wt[2 * (cn + 1) + k];
+          mc = (mc - 1) * temp1;
+          if (d & 2) {
+            mc += (i1[(cn + 1) + j] - 1) * temp0;
+            x *= wt[(cn + 1) + j];
+          } else {
+            mc += (i0[(cn + 1) + j] - 1) * temp0;
+            x *= 1.0 - wt[(cn + 1) + j];
+          }
+          if (d & 1) {
+            mc += i1[i];
+            x *= wt[i];
+          } else {
+            mc += i0[i];
+            x *= 1.0 - wt[i];
+          }
+          w += x * cu[mc];
+        }
+        u[m] += w;
       }
-    } /* end of ncgsteps loop */
-    if (gg >= gtest) {
-      fprintf(outfile, "\nNO CONVERGENCE: %d steps\n", ncgsteps);
     }
-  } /* end of if gg gt gtest loop */
+  }
+
+  free_ivector(i0);
+  free_ivector(i1);
+  free_dvector(wt);
+  free_ivector(cpix);
+  free_dvector(cgx);
+  free_dvector(cgy);
+  free_dvector(cgz);
+  free_dvector(cu);
+  for (d = 1; d <= 3; d++) {
+    free_dvector(cs[d]);
+  }
+
+  return (0);
 }
 
-int main(void) {
-  int i, j, k, micro, phasein, phasemax, doitz, oval, nagg1;
-  int m, nlist = 0, temp1, temp0;
-  char phasename[MAXSTRING];
+int main(int argc, char *argv[]) {
+  int i, j, k, micro, phasein, phasemax, doitz, oval, nagg1, cached, nocache;
+  int m, temp1, temp0;
+  char phasename[MAXSTRING], buff[MAXSTRING];
   double ety, etz, sigmax, xj, layersigma;
   double sigma0, sigma1, sigma2, avesigma, formfact;
+  Rescache rc;
+  FILE *cfp;
 
   doitz = oval = nagg1 = 0;
   layersigma = 0.0;
@@ -759,18 +2366,55 @@ int main(void) {
 
   phasemax = NPHASE;
 
+  slabstart(&argc, &argv);
+  if (checkargs(argc, argv)) {
+    if (Mpirank == 0)
+      printHelp();
+    slabstop();
+    exit(1);
+  }
+  if (Coarseonly && Coarsen < 2)
+    Coarsen = 2;
+#ifdef _OPENMP
+  if (Gpu && omp_get_num_devices() < 1) {
+    printf("\nNo offload device found; solving on the host");
+    Gpu = 0;
+  }
+#else
+  if (Gpu) {
+    printf("\nBuilt without OpenMP; solving on the host");
+    Gpu = 0;
+  }
+#endif
+  if (Mpisize > 1 && (Gpu || Coarsen > 1)) {
+    printf("\n--gpu and --coarsen are not used under mpirun; solving in full"
+           " on the host");
+    Gpu = 0;
+    Coarsen = 1;
+    Coarseonly = 0;
+  }
+  if (Mpisize > 1 && Walkers) {
+    printf("\n--walk is not used under mpirun; solving in full");
+    Walkers = 0;
+  }
+  if (Mpisize > 1 && Precond == FFTGREEN) {
+    printf("\n--fft is not used under mpirun; solving without a"
+           " preconditioner");
+    Precond = NOPRECOND;
+  }
+
   printf("\nInside main routine.\n");
 
   printf("\n\nEnter the fully-resolved name of the input image: ");
   fflush(stdout);
-  read_string(filein, sizeof(filein));
+  nextinput(Imagefile, filein, sizeof(filein));
 
   printf("File name is %s\n", filein);
   fflush(stdout);
 
   printf("Enter name of folder to output data files");
   printf("\n(Include final separator in path) ");
-  read_string(Outfolder, sizeof(Outfolder));
+  nextinput(Outdir, Outfolder, sizeof(Outfolder));
   Filesep = Outfolder[strlen(Outfolder) - 1];
   if ((Filesep != '/') && (Filesep != '\\')) {
     printf("\nNo final file separator detected.  Using /");
@@ -779,14 +2423,14 @@ int main(void) {
   printf("\n%s\n", Outfolder);
 
   printf("Enter fully-resolved name of major output file: ");
-  read_string(Outfilename, sizeof(Outfilename));
+  nextinput(Outputfile, Outfilename, sizeof(Outfilename));
   printf("\nOutput file name is %s\n", Outfilename);
 
   printf("Enter fully-resolved name of final results file: ");
-  read_string(Resultsfilename, sizeof(Resultsfilename));
+  nextinput(Resultsfile, Resultsfilename, sizeof(Resultsfilename));
   printf("\nResults file name is %s\n", Resultsfilename);
 
-  read_string(PCfilename, sizeof(PCfilename));
+  nextinput(Pcfile, PCfilename, sizeof(PCfilename));
   printf("Relative phase contributions file name is %s\n", PCfilename);
   printf("\nRelative phase contributions will be printed to file %s\n",
          PCfilename);
@@ -817,8 +2461,20 @@ int main(void) {
 
   Nsites = (Xsyssize + 2) * (Ysyssize + 2) * (Zsyssize + 2);
 
+  /*  Under mpirun each rank keeps the planes of its own slab */
+  if (slabsplit(Zsyssize, &Zlo, &Zhi)) {
+    bailout("transport", "Fewer layers of the system than MPI ranks");
+    slabstop();
+    exit(1);
+  }
+  Sitebase = Zlo * (Xsyssize + 2) * (Ysyssize + 2);
+  Sitecount = (Zhi - Zlo + 2) * (Xsyssize + 2) * (Ysyssize + 2);
+  if (Mpisize > 1) {
+    printf("\nRank %d of %d solves for z planes %d to %d", Mpirank, Mpisize,
+           Zlo, Zhi - 1);
+  }
+
   pix = NULL;
-  list = NULL;
   gx = NULL;
   gy = NULL;
   gz = NULL;
@@ -827,19 +2483,31 @@ int main(void) {
   h = NULL;
   Ah = NULL;
   Lsigma = NULL;
-
-  pix = ivector(Nsites);
-  list = ivector(Nsites);
-  gx = dvector(Nsites);
-  gy = dvector(Nsites);
-  gz = dvector(Nsites);
-  u = dvector(Nsites);
-  gb = dvector(Nsites);
-  h = dvector(Nsites);
-  Ah = dvector(Nsites);
+  Dinv = NULL;
+  Zg = NULL;
+  Planesum = NULL;
+  Layercurr = NULL;
+
+  /* Site labels run from 1 to ns2 */
+  pix = ivector(Nsites + 1);
+  gx = sitevec();
+  gy = sitevec();
+  gz = sitevec();
+  u = sitevec();
+  gb = sitevec();
+  h = sitevec();
+  Ah = sitevec();
   Lsigma = dvector(Xsyssize + 10);
+  Planesum = dvector(Zsyssize + 3);
+  Layercurr = dvector(4 * (Xsyssize + 2));
+  if (Precond == JACOBI)
+    Dinv = sitevec();
+  if (Precond)
+    Zg = sitevec();
 
-  if (!pix || !list || !gx || !gy || !gz || !u || !gb || !h || !Ah || !Lsigma) {
+  if (!pix || !gx || !gy || !gz || !u || !gb || !h || !Ah || !Lsigma ||
+      !Planesum || !Layercurr || (Precond && !Zg) ||
+      (Precond == JACOBI && !Dinv)) {
 
     freeallmem();
     bailout("transport", "Memory allocation failure");
@@ -892,20 +2560,6 @@ int main(void) {
   nphase = NPHASE;
   ntot = NPHMAX;
 
-  /*  Make list of real (interior) sites, used in subroutine dembx.  The 1-d
-    labelling scheme goes over all ns2 sites, so a list of the real sites
-    is needed. */
-  for (i = 2; i <= nx1; i++) {
-    for (j = 2; j <= ny1; j++) {
-      temp1 = (j - 1) * nx2;
-      for (k = 2; k <= nz1; k++) {
-        m = i + temp1 + (k - 1) * L22;
-        nlist += 1;
-        list[nlist] = m;
-      }
-    }
-  }
-
   /*  (USER) input value of real conductivity tensor for each phase
     (diagonal only). 1,2,3 = x,y,z, respectively. */
 
@@ -981,21 +2635,27 @@ int main(void) {
   sigma[(INERTAGG) + 1][2] = 0.000;
   sigma[(INERTAGG) + 1][3] = 0.000;
 
-  outfile = filehandler("transport", Outfilename, "WRITE");
+  /*  Under mpirun only rank 0 writes the output files, and the other */
+  /*  ranks write to scratch files */
+  outfile = (Mpirank > 0) ? tmpfile()
+                          : filehandler("transport", Outfilename, "WRITE");
   if (!outfile) {
     freeallmem();
     exit(1);
   }
   printf("\nSuccessfully opened output file...");
   fflush(stdout);
-  resultsfile = filehandler("transport", Resultsfilename, "WRITE");
+  resultsfile = (Mpirank > 0)
+                    ? tmpfile()
+                    : filehandler("transport", Resultsfilename, "WRITE");
   if (!resultsfile) {
     freeallmem();
     exit(1);
   }
   printf("\nSuccessfully opened results file...");
   fflush(stdout);
-  pcfile = filehandler("transport", PCfilename, "WRITE");
+  pcfile = (Mpirank > 0) ? tmpfile()
+                         : filehandler("transport", PCfilename, "WRITE");
   if (!pcfile) {
     freeallmem();
     exit(1);
@@ -1067,6 +2727,11 @@ int main(void) {
       doitz = 1;
 
     /*  (USER) Set components of applied field, E = (ex,ey,ez) */
+    /*  The three components are applied together, so a single solution */
+    /*  by dembx gives currx, curry and currz, and with them the three */
+    /*  diagonal conductivities, at once; there is no separate solution */
+    /*  for each direction.  (The off-diagonal terms, which would need */
+    /*  separate fields, are taken to be zero.) */
     ex = 1.0;
     ey = 1.0;
     ez = 1.0;
@@ -1076,7 +2741,7 @@ int main(void) {
     fflush(outfile);
 
     /*   Initialize the voltage distribution by putting on uniform field. */
-    for (k = 1; k <= nz2; k++) {
+    for (k = Zlo + 1; k <= Zhi + 2; k++) {
       temp0 = (k - 1) * L22;
       etz = ez * (float)k;
       for (j = 1; j <= ny2; j++) {
@@ -1100,22 +2765,105 @@ int main(void) {
     printf("\nsigmax = %lf", sigmax);
     fflush(stdout);
 
-    /*  Subroutine dembx accepts gx,gy,gz and solves for the voltage field
-      that minimizes the dissipated energy.   */
-    dembx(nlist, doitz);
-    printf("\nOut of dembx ...");
-    fflush(stdout);
-    printf("\nsigmax = %lf", sigmax);
-    fflush(stdout);
+    /*  With --coarsen, a coarse solution starts the voltage field, and */
+    /*  with --coarse-only its currents are the answer.  The layers of */
+    /*  the ITZ are too thin for a coarse grid, so a system with */
+    /*  aggregate is always solved in full. */
+    /*  The random walk has no currents for the ITZ either. */
+    if ((Coarseonly || Walkers) && doitz) {
+      printf("\nWARNING: aggregate present, so solving in full");
+      fflush(stdout);
+      Coarseonly = 0;
+      Walkers = 0;
+    }
 
-    /*  find final current after voltage solution is done */
-    printf("\nGoing into current for the last time now..");
-    fflush(stdout);
-    current(doitz, 1);
-    printf("\nOut of current");
-    fflush(stdout);
-    printf("\nsigmax = %lf", sigmax);
-    fflush(stdout);
+    /*  Look for the currents of a full solution in the cache */
+    /*  (--cache) before solving, coarse or full.  The random walk and */
+    /*  the coarse solution are estimates, so they are not kept, */
+    /*  under mpirun a rank has only its slab of the sites, and --vtk */
+    /*  needs the field, which the cache does not keep. */
+    cached = 0;
+    nocache = (Mpisize > 1 || Walkers || Coarseonly || Vtkout);
+    rescache_init(&rc, nocache ? "" : Cachedir, "transport");
+    rescache_add(&rc, &nx, sizeof(int));
+    rescache_add(&rc, &ny, sizeof(int));
+    rescache_add(&rc, &nz, sizeof(int));
+    rescache_add(&rc, pix + 1, (size_t)ns2 * sizeof(int));
+    rescache_add(&rc, sigma, sizeof(sigma));
+    rescache_add(&rc, &gtest, sizeof(gtest));
+    rescache_add(&rc, &ex, sizeof(ex));
+    rescache_add(&rc, &ey, sizeof(ey));
+    rescache_add(&rc, &ez, sizeof(ez));
+    rescache_add(&rc, &doitz, sizeof(int));
+    rescache_add(&rc, &nagg1, sizeof(int));
+    if ((cfp = rescache_open(&rc))) {
+      cached = !cacheio(cfp, doitz, 0);
+      fclose(cfp);
+    }
+
+    if (!cached && !Walkers && Coarsen > 1 && coarsesolve(Coarsen))
+      Coarseonly = 0;
+
+    if (cached) {
+      printf("\nResults taken from the cache in %s", Cachedir);
+      fflush(stdout);
+    } else if (Walkers) {
+      if (randomwalk()) {
+        printf("\nNo room for the random walkers");
+        freeallmem();
+        exit(1);
+      }
+      currx = Walksig[0] * ex;
+      curry = Walksig[1] * ey;
+      currz = Walksig[2] * ez;
+      printf("\nRandom walk conductivities (95%% confidence half-widths):");
+      printf("\n\txx %lf +/- %lf  yy %lf +/- %lf  zz %lf +/- %lf", Walksig[0],
+             Walkhalf[0], Walksig[1], Walkhalf[1], Walksig[2], Walkhalf[2]);
+      printf("\n\tyz %lf +/- %lf  xz %lf +/- %lf  xy %lf +/- %lf\n",
+             Walksig[3], Walkhalf[3], Walksig[4], Walkhalf[4], Walksig[5],
+             Walkhalf[5]);
+      if (Walkdrift + Walkdrifthalf > WALKTOL) {
+        printf("\tWARNING: the walk is not shown to settle (last quarter "
+               "%.1lf%% +/- %.1lf%% slower\n\tthan the third); the estimates "
+               "may be too high by more than the half-widths\n",
+               100.0 * Walkdrift, 100.0 * Walkdrifthalf);
+      }
+      fflush(stdout);
+    } else if (Coarseonly) {
+      currx = Coarsecurr[0];
+      curry = Coarsecurr[1];
+      currz = Coarsecurr[2];
+    } else {
+      /*  Subroutine dembx accepts gx,gy,gz and solves for the voltage field
+        that minimizes the dissipated energy.   */
+      dembx(doitz);
+      printf("\nOut of dembx ...");
+      fflush(stdout);
+      printf("\nsigmax = %lf", sigmax);
+      fflush(stdout);
+
+      /*  find final current after voltage solution is done */
+      printf("\nGoing into current for the last time now..");
+      fflush(stdout);
+      if (Vtkout)
+        Curfield = dvector(4 * (size_t)fxyz);
+      current(doitz, 1);
+      printf("\nOut of current");
+      fflush(stdout);
+      printf("\nsigmax = %lf", sigmax);
+      fflush(stdout);
+      if ((cfp = rescache_create(&rc)))
+        rescache_commit(&rc, cfp, cacheio(cfp, doitz, 1));
+      if (Vtkout) {
+        snprintf(buff, sizeof(buff), "%scurrent.vti", Outfolder);
+        if (currentvtk(buff)) {
+          printf("\n\nWARNING:  Could not write output file %s", buff);
+        } else if (Mpirank == 0) {
+          printf("\nField written to %s", buff);
+        }
+        fflush(stdout);
+      }
+    }
     printf("RESULTS:\n");
     fflush(stdout);
     fprintf(outfile, "RESULTS:\n");
@@ -1184,6 +2932,28 @@ int main(void) {
   fprintf(resultsfile, "\tX-direction conductivity = %lf\n", sigma0);
   fprintf(resultsfile, "\tY-direction conductivity = %lf\n", sigma1);
   fprintf(resultsfile, "\tZ-direction conductivity = %lf\n\n", sigma2);
+  if (Walkers) {
+    fprintf(resultsfile, "RANDOM WALK ESTIMATE (95%% CONFIDENCE):\n\n");
+    fprintf(resultsfile, "\tX-direction conductivity +/- %lf\n",
+            Walkhalf[0] / sigmax);
+    fprintf(resultsfile, "\tY-direction conductivity +/- %lf\n",
+            Walkhalf[1] / sigmax);
+    fprintf(resultsfile, "\tZ-direction conductivity +/- %lf\n",
+            Walkhalf[2] / sigmax);
+    fprintf(resultsfile, "\tYZ conductivity = %lf +/- %lf\n",
+            Walksig[3] / sigmax, Walkhalf[3] / sigmax);
+    fprintf(resultsfile, "\tXZ conductivity = %lf +/- %lf\n",
+            Walksig[4] / sigmax, Walkhalf[4] / sigmax);
+    fprintf(resultsfile, "\tXY conductivity = %lf +/- %lf\n\n",
+            Walksig[5] / sigmax, Walkhalf[5] / sigmax);
+    if (Walkdrift + Walkdrifthalf > WALKTOL) {
+      fprintf(resultsfile, "\tWALK NOT SHOWN TO SETTLE: LAST QUARTER %.1lf%% "
+              "+/- %.1lf%% SLOWER,\n",
+              100.0 * Walkdrift, 100.0 * Walkdrifthalf);
+      fprintf(resultsfile, "\tESTIMATES MAY BE HIGHER THAN THE INTERVALS "
+              "ALLOW\n\n");
+    }
+  }
   if (formfact > 0.0) {
     fprintf(resultsfile, "FORMATION FACTOR OF PASTE = %lf\n\n", formfact);
     fprintf(resultsfile, "TRANSPORT FACTOR OF PASTE = %lf\n\n", 1.0 / formfact);
@@ -1197,8 +2967,13 @@ int main(void) {
    ***/
 
   fprintf(pcfile, "PHASE-SPECIFIC INFORMATION\n\n");
+  if (Coarseonly) {
+    fprintf(pcfile, "Not found by the coarse solution (--coarse-only)\n");
+  } else if (Walkers) {
+    fprintf(pcfile, "Not found by the random walk (--walk)\n");
+  }
   for (i = 1; i <= NPHASE; i++) {
-    if (a[i] > pthresh) {
+    if (a[i] > pthresh && !Coarseonly && !Walkers) {
       id2phasename(i - 1, phasename);
       fprintf(pcfile, "Phase %s\n", phasename);
       fprintf(pcfile, "\tVolume fraction: %lf\n", a[i]);
@@ -1274,6 +3049,7 @@ int main(void) {
 
   if (outfile != NULL)
     fclose(outfile);
+  outfile = NULL;
 
   /***
    *	Now, if ITZ calculation turned on, then we have to output
@@ -1285,7 +3061,7 @@ int main(void) {
    *	2nd pixel at x = 1.5, etc.
    ***/
 
-  if ((doitz) && (nagg1 > 0)) {
+  if ((doitz) && (nagg1 > 0) && Mpirank == 0) {
     outfile = filehandler("transport", Layerfilename, "WRITE");
     if (!outfile) {
       printf("\n\nWARNING:  Could not open output file %s", Layerfilename);
@@ -1301,10 +3077,11 @@ int main(void) {
     }
     printf("END");
     fclose(outfile);
+    outfile = NULL;
   }
 
   printf("\nDone with cement paste calculations.");
-  if (doitz) {
+  if (doitz && Mpirank == 0) {
     oval = conctransport(nagg1, avesigma, sigmax);
   }
 
@@ -1316,6 +3093,7 @@ int main(void) {
     fclose(pcfile);
 
   freeallmem();
+  slabstop();
 
   return (0);
 }
@@ -1331,8 +3109,8 @@ int main(void) {
 /*                                                                         */
 /***************************************************************************/
 int conctransport(int nagg1, double avesigma, double sigmax) {
-  register int i, j, k, ii;
-  int itzpix, numfinebins[NUMFINESOURCES], numfinebinstot, cnt, done;
+  register int i, j, k;
+  int itzpix, numfinebins[NUMFINESOURCES], numfinebinstot, cnt;
   int num_fine_sources, num_coarse_sources;
   int finebegin[NUMFINESOURCES], fineend[NUMFINESOURCES];
   int coarsebegin[NUMCOARSESOURCES], coarseend[NUMCOARSESOURCES];
@@ -1342,18 +3120,15 @@ int conctransport(int nagg1, double avesigma, double sigmax) {
   char buff1[MAXSTRING];
   char cempsdfile[MAXSTRING];
   char coarsegfile[MAXSTRING], finegfile[MAXSTRING];
-  double sum, sfine, scoarse, sign, finevftot, coarsevftot;
+  double sum, sfine, scoarse, finevftot, coarsevftot;
   double aggfrac, airfrac;
-  double target_agg_vf, sumint, conductivity;
-  double s, ssave[EMT_ITERATIONS], sint[EMT_ITERATIONS];
-  double track, xtrack[EMT_ITERATIONS];
-  double ss, xs, z, ba, alpha;
+  double target_agg_vf;
+  double ss, xs;
   FILE *gfile, *cempsd;
 
   /* Initialize global arrays */
 
   sum = 0.0;
-  done = 0;
   aggfrac = 0.0;
   finevftot = coarsevftot = 0.0;
 
@@ -1366,10 +3141,6 @@ int conctransport(int nagg1, double avesigma, double sigmax) {
 
   /* Initialize local arrays */
 
-  for (i = 0; i < EMT_ITERATIONS; i++) {
-    ssave[i] = sint[i] = xtrack[i] = 0.0;
-  }
-
   for (i = 0; i < NUMFINESOURCES; i++) {
     fine_agg_vf[i] = 0.0;
     numfinebins[i] = 0;
@@ -1724,93 +3495,13 @@ int conctransport(int nagg1, double avesigma, double sigmax) {
   Vf_conctransport[N_conctransport] = airfrac / (aggfrac + airfrac);
   target_agg_vf = (aggfrac + airfrac);
 
-  effective(itzwidth, sitz);
-
-  s = scem;
-  ssave[0] = s;
-  ss = 0.0;
-
-  /***
-   * Concrete differential EMT method
-   * Solve volume fraction in terms of conductivity, i.e.
-   *   conductivity is the integrating variable, not volume fraction
-   * Loop over effective particles, S_conctransport, to compute <m>
-   * All conductivities are given in terms of the initial matrix
-   *   conductivity
-   ***/
-
-  ssave[0] = scem;
-  sint[0] = 0.0;
-  xs = track = 0.0;
-  ss = -1.0;
-
   /* Get the Gaussian quadrature points */
 
   Ng = (int)NG;
-  getGausspoints();
-  i = 1;
-  done = 0;
-
-  while ((i < EMT_ITERATIONS) && (!done)) {
-    printf("\nEMT iteration %d out of Max %d", i, ((int)EMT_ITERATIONS));
-    fflush(stdout);
-    sign = ss / fabs(ss);
-    ssave[i] = scem * (1.0 + (sign * (((double)i) * 0.0099)));
-    /*
-    printf("\n\tDummy conductivity variable = %f",ssave[i]);
-    */
-    sumint = 0.0;
-
-    /* Here is loop over Gaussian points */
-
-    for (j = 0; j < Ng; j++) {
-
-      conductivity = 0.5 * (ssave[i] - ssave[i - 1]) * Xg[j] +
-                     0.5 * (ssave[i] + ssave[i - 1]);
-      /*
-      printf("\n\t\tGaussian weights X[%d] W[%d] = %f,%f, Quadrature point =
-      %f",j,j,Xg[j],Wg[j],conductivity);
-      */
-
-      /* Compute the mean slope, ss, over different sieves */
-      ss = 0.0;
-      for (ii = 0; ii <= N_conctransport; ii++) {
-        if (Diam_conctransport[ii] > 0.0) {
-          ba = (Diam_conctransport[ii] + 2.0 * itzwidth) /
-               Diam_conctransport[ii];
-          alpha = pow(ba, 3.0);
-          ss += (Vf_conctransport[ii] *
-                 (3.0 * alpha * (S_conctransport[ii] - conductivity)) /
-                 ((2.0 * conductivity) + S_conctransport[ii]));
-        }
-      }
-
-      /* Now do EMT integral */
-
-      sumint -= (0.5 * (ssave[i] - ssave[i - 1]) * Wg[j] / (ss * conductivity));
-    }
-
-    sint[i] = sumint;
-
-    /* track keeps a running total of the integral */
-
-    track += sint[i];
-
-    /* xtrack keeps a running track of the volume fraction obtained in the
-     * integral so far */
-
-    xtrack[i] = 1.0 - exp(track);
-    printf("\n\tVf = %f (target = %f), ssave = %f, slope = %f", xtrack[i],
-           target_agg_vf, ssave[i], ss);
-    fflush(stdout);
+  if (getGausspoints())
+    return (1);
 
-    if (xtrack[i] > target_agg_vf) {
-      z = (target_agg_vf - xtrack[i - 1]) / (xtrack[i] - xtrack[i - 1]);
-      xs = ssave[i - 1] + (z * (ssave[i] - ssave[i - 1]));
-      break;
-    }
-    i++;
-  }
+  xs = emtsolve(scem, sitz, itzwidth, target_agg_vf, 1);
 
   fprintf(resultsfile, "\tAggregate_vol_frac: %.4f\n", target_agg_vf);
   for (i = 0; i < num_fine_sources; i++) {
@@ -1828,30 +3519,40 @@ int conctransport(int nagg1, double avesigma, double sigmax) {
   } else {
     fprintf(resultsfile, "\nFORMATION FACTOR OF CONCRETE UNDEFINED");
   }
+
+  if (strlen(Emtsweepfile) > 0)
+    emtsweep(itzwidth, target_agg_vf, sigmax);
+
   return (0);
 }
 
-void effective(double itzwidth, double sitz) {
+void effective(double itzwidth, double sitz, int verbose) {
   register int i;
   double ba, c;
 
-  printf("\nIn function effective:");
+  if (verbose)
+    printf("\nIn function effective:");
   for (i = 0; i < N_conctransport; i++) {
 
-    printf("\n\tDiam[%d] = %f, itzwidth = %f", i, Diam_conctransport[i],
-           itzwidth);
+    if (verbose) {
+      printf("\n\tDiam[%d] = %f, itzwidth = %f", i, Diam_conctransport[i],
+             itzwidth);
+    }
     ba = (Diam_conctransport[i] + 2.0 * itzwidth) / Diam_conctransport[i];
     c = pow(ba, 3.0);
 
-    printf("\nba = %f and c = %f", ba, c);
-    printf("\nSi_conctransport[%d] = %f and sitz = %f", i, Si_conctransport[i],
-           sitz);
+    if (verbose) {
+      printf("\nba = %f and c = %f", ba, c);
+      printf("\nSi_conctransport[%d] = %f and sitz = %f", i,
+             Si_conctransport[i], sitz);
+    }
     S_conctransport[i] = sitz * ((2.0 * (Si_conctransport[i] - sitz)) +
                                  (c * (Si_conctransport[i] + (2.0 * sitz))));
     S_conctransport[i] /= ((c * (Si_conctransport[i] + 2.0 * sitz)) -
                            (Si_conctransport[i] - sitz));
 
-    printf("\nS_conctransport[%d] = %f", i, S_conctransport[i]);
+    if (verbose)
+      printf("\nS_conctransport[%d] = %f", i, S_conctransport[i]);
   }
   fflush(stdout);
 
@@ -1876,14 +3577,207 @@ void slope(double itzwidth, double *ss, double s) {
   return;
 }
 
+/***
+ *	emtslope
+ *
+ * 	Mean slope m(s) over the sieves of the differential effective
+ * 	medium equation at conductivity s, with the volume of each
+ * 	particle and its ITZ (Alpha_conctransport) found once by emtsolve
+ *
+ * 	Arguments:	double conductivity s
+ * 	Returns:	double slope
+ *
+ *	Calls:		no routines
+ *	Called by:	emtint, emtsolve
+ ***/
+double emtslope(double s) {
+  int i;
+  double ss;
+
+  ss = 0.0;
+  for (i = 0; i <= N_conctransport; i++) {
+    ss += (Vf_conctransport[i] *
+           (3.0 * Alpha_conctransport[i] * (S_conctransport[i] - s)) /
+           ((2.0 * s) + S_conctransport[i]));
+  }
+
+  return (ss);
+}
+
+/***
+ *	emtint
+ *
+ * 	Integral of -1/(s m(s)) from s0 to s1, by Gauss-Legendre
+ * 	quadrature on the points Xg, Wg
+ *
+ * 	Arguments:	double limits s0 and s1
+ * 	Returns:	double integral
+ *
+ *	Calls:		emtslope
+ *	Called by:	emtsolve
+ ***/
+double emtint(double s0, double s1) {
+  int j;
+  double s, sum;
+
+  sum = 0.0;
+  for (j = 1; j <= Ng; j++) {
+    s = 0.5 * (s1 - s0) * Xg[j] + 0.5 * (s1 + s0);
+    sum -= Wg[j] / (emtslope(s) * s);
+  }
+
+  return (0.5 * (s1 - s0) * sum);
+}
+
+/***
+ *	emtsolve
+ *
+ * 	Concrete differential EMT method.  Conductivity is the
+ * 	integrating variable, not volume fraction: the aggregate
+ * 	(and air) volume fraction x reached at conductivity s is
+ *
+ * 		ln(1 - x) = integral from scem to s of -ds'/(s' m(s'))
+ *
+ * 	which is solved for the s that gives the target x by Newton's
+ * 	method, the derivative of the right side being its integrand.
+ * 	The integral over each Newton step is done by emtint, and the
+ * 	step is halved while it would reach a zero of m(s), where the
+ * 	integral diverges, or while the quadrature over it does not
+ * 	agree with that over its two halves.  All conductivities are
+ * 	given in terms of the initial matrix conductivity.
+ *
+ * 	Arguments:	double conductivities of the bulk paste and the ITZ
+ * 				double ITZ width (mm)
+ * 				double target volume fraction of aggregate and air
+ * 				int verbose flag, to print each iteration
+ * 	Returns:	double effective conductivity of the concrete
+ *
+ *	Calls:		effective, emtslope, emtint
+ *	Called by:	conctransport, emtsweep
+ ***/
+double emtsolve(double scem, double sitz, double itzwidth, double target,
+                int verbose) {
+  int i, it;
+  double lim, track, s, snew, ds, m, mnew, whole, part, ba;
+
+  if (target <= 0.0)
+    return (scem);
+  if (target >= 1.0 || scem <= 0.0)
+    return (0.0);
+
+  effective(itzwidth, sitz, verbose);
+  for (i = 0; i <= N_conctransport; i++) {
+    Alpha_conctransport[i] = 0.0;
+    if (Diam_conctransport[i] > 0.0) {
+      ba = (Diam_conctransport[i] + 2.0 * itzwidth) / Diam_conctransport[i];
+      Alpha_conctransport[i] = pow(ba, 3.0);
+    }
+  }
+
+  lim = log(1.0 - target);
+  track = 0.0;
+  s = scem;
+  m = emtslope(s);
+
+  for (it = 1; (it < EMT_ITERATIONS) && (m != 0.0); it++) {
+    ds = (lim - track) * (-s * m);
+    part = 0.0;
+    snew = mnew = 0.0;
+    while (fabs(ds) > 1.0e-14 * s) {
+      snew = s + ds;
+      mnew = (snew > 0.0) ? emtslope(snew) : 0.0;
+      if (mnew * m > 0.0) {
+        whole = emtint(s, snew);
+        part = emtint(s, s + 0.5 * ds) + emtint(s + 0.5 * ds, snew);
+        if (fabs(part - whole) <= 1.0e-10 * fabs(part))
+          break;
+      }
+      ds *= 0.5;
+    }
+    if (fabs(ds) <= 1.0e-14 * s) {
+      printf("\nWARNING: EMT iteration stopped at s = %f", s);
+      break;
+    }
+
+    /* track keeps a running total of the integral */
+
+    track += part;
+    s = snew;
+    m = mnew;
+    if (verbose) {
+      printf("\nEMT iteration %d out of Max %d", it, ((int)EMT_ITERATIONS));
+      printf("\n\tVf = %f (target = %f), s = %f, slope = %f",
+             1.0 - exp(track), target, s, m);
+      fflush(stdout);
+    }
+    if (fabs(lim - track) <= 1.0e-12 * fabs(lim))
+      break;
+  }
+
+  return (s);
+}
+
+/***
+ *	emtsweep
+ *
+ * 	Finds the concrete conductivity for each pair of bulk paste and
+ * 	ITZ conductivities in the file given by --emt-sweep, one pair to
+ * 	a line, with the aggregate grading, air and ITZ width already
+ * 	read by conctransport, and adds them to the results file
+ *
+ * 	Arguments:	double ITZ width (mm)
+ * 				double target volume fraction of aggregate and air
+ * 				double maximum conductivity, for the formation factor
+ * 	Returns:	nothing
+ *
+ *	Calls:		emtsolve
+ *	Called by:	conctransport
+ ***/
+void emtsweep(double itzwidth, double target, double sigmax) {
+  int n;
+  double scem, sitz, xs;
+  FILE *fp;
+
+  fp = filehandler("conctransport", Emtsweepfile, "READ");
+  if (!fp)
+    return;
+
+  fprintf(resultsfile, "\n\nCONCRETE CONDUCTIVITY SWEEP:\n");
+  fprintf(resultsfile, "\tPaste\tITZ\tConcrete\tFormation_factor\n");
+  n = 0;
+  while (fscanf(fp, "%lf %lf", &scem, &sitz) == 2) {
+    xs = emtsolve(scem, sitz, itzwidth, target, 0);
+    if (xs > 0.0) {
+      fprintf(resultsfile, "\t%.4f\t%.4f\t%.4f\t%lf\n", scem, sitz, xs,
+              sigmax / xs);
+    } else {
+      fprintf(resultsfile, "\t%.4f\t%.4f\t%.4f\tundefined\n", scem, sitz, xs);
+    }
+    n++;
+  }
+  fclose(fp);
+
+  printf("\nConcrete conductivity found for %d paste inputs", n);
+  fflush(stdout);
+
+  return;
+}
+
 int getGausspoints(void) {
   int m, i;
+  static int ngdone = 0;
   double eps = 1.0e-14;
-  double dn, e1, t, x0, den, d1, pnm1, pn, pnp1, dpn, d2pn, u, v, x1;
+  double dn, e1, t, x0, den, d1, pnm1, pn, pnp1, dpn, d2pn, u, v, x1, dx;
   double *x, *w;
 
   const double Pi = 4.0 * atan(1.0);
 
+  /* The points for Ng are kept from the last call */
+
+  if (Xg && Wg && ngdone == Ng)
+    return (0);
+  ngdone = 0;
+
   /* Allocate memory for the Xg and Wg vectors */
 
   if (Xg)
@@ -1947,8 +3841,9 @@ int getGausspoints(void) {
       u = pn / dpn;
       v = d2pn / dpn;
       x1 = x0 - (u * (1.0 + (0.50 * u * v)));
+      dx = x1 - x0;
       x0 = x1;
-    } while ((x1 - x0) >= eps);
+    } while (fabs(dx) >= eps);
     x0 = x1;
     legendr(Ng, &x0, &pn, &pnm1, &pnp1);
     x[i] = x0;
@@ -1969,6 +3864,7 @@ int getGausspoints(void) {
 
   free_dvector(w);
   free_dvector(x);
+  ngdone = Ng;
   return (0);
 }
 
@@ -0,0 +1,599 @@
+/******************************************************
+ *
+ * Program vcctlbench
+ *
+ * Microbenchmarks of the vcctllib kernels, each run on
+ * its own so that a change to the library can be timed
+ * without a whole simulation:
+ *
+ *	rng        ran1 and the explicit-state generator
+ *	           (rng.c), numbers per second
+ *	image      reading an ASCII and a compressed binary
+ *	           image (header and voxels), voxels per second
+ *	alloc      allocating, filling and freeing the box and
+ *	           grid arrays of memutil.c, voxels per second
+ *	perc       labeling the pore network (perc_label, the
+ *	           burning test of perc3d), voxels per second
+ *	poresize   pore size distribution (poresizes, as used
+ *	           by calcporedist3d), voxels per second
+ *
+ * The microstructure is a periodic packing of spheres of
+ * C3S and C2S in porosity, made the same way every time.
+ * Each kernel is run several times and the best time is
+ * reported.  One line per kernel goes to standard output
+ * in CSV form, to compare across builds.
+ ******************************************************/
+#include "include/vcctl.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUMBERS 10000000 /* random numbers drawn per run */
+
+/***
+ *	Global variables
+ ***/
+int Size = 100;
+int Reps = 3;
+char Scratch[MAXSTRING];
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
+double benchclock(void);
+void report(char *kernel, double best, double count, char *unit);
+void makemic(unsigned char *vox, int size);
+int bench_rng(void);
+int bench_image(unsigned char *vox);
+int bench_alloc(void);
+int bench_perc(unsigned char *vox);
+int bench_poresize(unsigned char *vox);
+
+int main(int argc, char *argv[]) {
+  int nerr;
+  unsigned char *vox;
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    return (1);
+  }
+
+  vox = (unsigned char *)malloc((size_t)Size * Size * Size);
+  if (!vox) {
+    bailout("vcctlbench", "Could not allocate memory for microstructure");
+    return (1);
+  }
+  makemic(vox, Size);
+
+  printf("Kernel,Size,Seconds,Rate,Unit\n");
+  fflush(stdout);
+
+  nerr = bench_rng();
+  nerr += bench_image(vox);
+  nerr += bench_alloc();
+  nerr += bench_perc(vox);
+  nerr += bench_poresize(vox);
+
+  free(vox);
+
+  return (nerr ? 1 : 0);
+}
+
+/***
+ *	checkargs
+ *
+ *	Checks the command line arguments
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"size", required_argument, 0, 's'},
+                                      {"reps", required_argument, 0, 'r'},
+                                      {"scratch", required_argument, 0, 'o'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  snprintf(Scratch, sizeof(Scratch), "vcctlbench.tmp");
+  while ((opt_char = getopt_long(argc, argv, "s:r:o:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -s or --size */
+    case (int)('s'):
+      Size = atoi(optarg);
+      break;
+    /* -r or --reps */
+    case (int)('r'):
+      Reps = atoi(optarg);
+      break;
+    /* -o or --scratch */
+    case (int)('o'):
+      snprintf(Scratch, sizeof(Scratch), "%s", optarg);
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (Size < 10 || Size > MAXSIZE || Reps < 1 || optind < argc)
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUSAGE:  vcctlbench [-s,--size <n>] [-r,--reps <n>] "
+                  "[-o,--scratch <file>]\n\n");
+  fprintf(stderr, "Times the vcctllib kernels on an n*n*n microstructure "
+                  "(default 100)\n");
+  fprintf(stderr, "and prints the best of the repetitions (default 3) "
+                  "as CSV.\n\n");
+  fprintf(stderr, "  --scratch  file for the image reading benchmark "
+                  "(default vcctlbench.tmp)\n\n");
+
+  return;
+}
+
+/***
+ *	benchclock
+ *
+ *	Read the monotonic clock
+ *
+ * 	Arguments:	None
+ * 	Returns:	double time in seconds from an arbitrary start
+ *
+ *	Calls:		No other routines
+ *	Called by:	bench_*
+ ***/
+double benchclock(void) {
+  struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+  return ((double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec);
+}
+
+/***
+ *	report
+ *
+ *	Print one line of results
+ *
+ * 	Arguments:	char pointer to name of the kernel
+ * 				double best time of one run (s)
+ * 				double number of items handled in one run
+ * 				char pointer to name of the items
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	bench_*
+ ***/
+void report(char *kernel, double best, double count, char *unit) {
+  printf("%s,%d,%.6f,%.4e,%s/s\n", kernel, Size, best,
+         (best > 0.0) ? count / best : 0.0, unit);
+  fflush(stdout);
+
+  return;
+}
+
+/***
+ *	makemic
+ *
+ *	Fill a size^3 image, in C order, with porosity and then
+ *	with periodic spheres of C3S and C2S until a little over
+ *	half of it is solid
+ *
+ * 	Arguments:	unsigned char pointer to the voxels
+ * 				int size of each dimension
+ * 	Returns:	Nothing
+ *
+ *	Calls:		rng_seed, rng_uniform
+ *	Called by:	main program
+ ***/
+void makemic(unsigned char *vox, int size) {
+  int x, y, z, dx, dy, dz, cx, cy, cz, rad, ph;
+  size_t n, nvox, nsolid;
+  Rngstate st;
+
+  nvox = (size_t)size * size * size;
+  memset(vox, POROSITY, nvox);
+  rng_seed(&st, 12345);
+
+  nsolid = 0;
+  while (nsolid < nvox * 55 / 100) {
+    cx = (int)(size * rng_uniform(&st));
+    cy = (int)(size * rng_uniform(&st));
+    cz = (int)(size * rng_uniform(&st));
+    rad = 2 + (int)(5.0 * rng_uniform(&st));
+    ph = (rng_uniform(&st) < 0.7) ? C3S : C2S;
+    for (dx = -rad; dx <= rad; dx++) {
+      for (dy = -rad; dy <= rad; dy++) {
+        for (dz = -rad; dz <= rad; dz++) {
+          if (dx * dx + dy * dy + dz * dz > rad * rad)
+            continue;
+          x = (cx + dx + size) % size;
+          y = (cy + dy + size) % size;
+          z = (cz + dz + size) % size;
+          n = ((size_t)x * size + y) * size + z;
+          if (vox[n] == POROSITY)
+            nsolid++;
+          vox[n] = (unsigned char)ph;
+        }
+      }
+    }
+  }
+
+  return;
+}
+
+/***
+ *	bench_rng
+ *
+ *	Time NUMBERS draws from ran1, rng_uniform and rng_fill
+ *
+ * 	Arguments:	None
+ * 	Returns:	int number of errors
+ *
+ *	Calls:		ran1, rng_seed, rng_uniform, rng_fill
+ *	Called by:	main program
+ ***/
+int bench_rng(void) {
+  int i, r, seed;
+  double t, best, sum;
+  double *buf;
+  Rngstate st;
+
+  sum = 0.0;
+  best = 0.0;
+  for (r = 0; r < Reps; r++) {
+    seed = -12345;
+    t = benchclock();
+    for (i = 0; i < NUMBERS; i++)
+      sum += ran1(&seed);
+    t = benchclock() - t;
+    if (r == 0 || t < best)
+      best = t;
+  }
+  report("ran1", best, (double)NUMBERS, "numbers");
+
+  for (r = 0; r < Reps; r++) {
+    rng_seed(&st, 12345);
+    t = benchclock();
+    for (i = 0; i < NUMBERS; i++)
+      sum += rng_uniform(&st);
+    t = benchclock() - t;
+    if (r == 0 || t < best)
+      best = t;
+  }
+  report("rng_uniform", best, (double)NUMBERS, "numbers");
+
+  buf = (double *)malloc(NUMBERS * sizeof(double));
+  if (!buf) {
+    warning("vcctlbench", "Could not allocate memory for random numbers");
+    return (1);
+  }
+  for (r = 0; r < Reps; r++) {
+    rng_seed(&st, 12345);
+    t = benchclock();
+    rng_fill(&st, buf, NUMBERS);
+    t = benchclock() - t;
+    if (r == 0 || t < best)
+      best = t;
+  }
+  sum += buf[NUMBERS - 1];
+  free(buf);
+  report("rng_fill", best, (double)NUMBERS, "numbers");
+
+  /* Keep the sums from being optimized away */
+
+  if (sum < 0.0)
+    printf("%f\n", sum);
+
+  return (0);
+}
+
+/***
+ *	bench_image
+ *
+ *	Write the microstructure to the scratch file as an
+ *	ASCII and then a compressed binary image, and time
+ *	reading its header and voxels back
+ *
+ * 	Arguments:	unsigned char pointer to the voxels
+ * 	Returns:	int number of errors
+ *
+ *	Calls:		write_binimg, read_imgheader_fmt, read_micvoxels
+ *	Called by:	main program
+ ***/
+int bench_image(unsigned char *vox) {
+  int i, r, format, xsize, ysize, zsize, informat, nerr;
+  size_t n, nvox;
+  float ver, res;
+  double t, best;
+  unsigned char *back;
+  FILE *fp;
+
+  nvox = (size_t)Size * Size * Size;
+  back = (unsigned char *)malloc(nvox);
+  if (!back) {
+    warning("vcctlbench", "Could not allocate memory for image");
+    return (1);
+  }
+
+  nerr = 0;
+  for (i = 0; i < 2; i++) {
+    format = (i == 0) ? IMG_ASCII : IMG_UINT8Z;
+    fp = fopen(Scratch, (format == IMG_ASCII) ? "w" : "wb");
+    if (!fp) {
+      warning("vcctlbench", "Could not open scratch file");
+      nerr++;
+      break;
+    }
+    if (format == IMG_ASCII) {
+      fprintf(fp, "Version: 5.0\nX_Size: %d\nY_Size: %d\nZ_Size: %d\n", Size,
+              Size, Size);
+      fprintf(fp, "Image_Resolution: 1.0\n");
+      for (n = 0; n < nvox; n++)
+        fprintf(fp, "%d\n", (int)vox[n]);
+    } else {
+      nerr += write_binimg(fp, vox, Size, Size, Size, 1.0, format);
+    }
+    if (fclose(fp))
+      nerr++;
+
+    best = 0.0;
+    for (r = 0; r < Reps && !nerr; r++) {
+      fp = fopen(Scratch, "rb");
+      if (!fp) {
+        nerr++;
+        break;
+      }
+      t = benchclock();
+      if (read_imgheader_fmt(fp, &ver, &xsize, &ysize, &zsize, &res,
+                             &informat) ||
+          read_micvoxels(fp, back, xsize, ysize, zsize, ver, informat))
+        nerr++;
+      t = benchclock() - t;
+      fclose(fp);
+      if (r == 0 || t < best)
+        best = t;
+    }
+    if (nerr || memcmp(back, vox, nvox)) {
+      warning("vcctlbench", "Image did not read back correctly");
+      nerr++;
+      break;
+    }
+    report((format == IMG_ASCII) ? "image_ascii" : "image_uint8z", best,
+           (double)nvox, "voxels");
+  }
+
+  remove(Scratch);
+  free(back);
+
+  return (nerr);
+}
+
+/***
+ *	bench_alloc
+ *
+ *	Time allocating a system-sized array, writing every
+ *	element and freeing it, for the pointer-per-row boxes
+ *	and the contiguous grids of char, short int and int
+ *
+ * 	Arguments:	None
+ * 	Returns:	int number of errors
+ *
+ *	Calls:		cbox, sibox, ibox, cgrid, sigrid, igrid and
+ *				their free_* routines
+ *	Called by:	main program
+ ***/
+int bench_alloc(void) {
+  int k, r, x, y, z, nerr;
+  double t, best;
+  char ***cb;
+  short int ***sb;
+  int ***ib;
+  static char *name[6] = {"cbox",  "sibox",  "ibox",
+                          "cgrid", "sigrid", "igrid"};
+
+  nerr = 0;
+  for (k = 0; k < 6; k++) {
+    best = 0.0;
+    for (r = 0; r < Reps; r++) {
+      cb = NULL;
+      sb = NULL;
+      ib = NULL;
+      t = benchclock();
+      if (k == 0)
+        cb = cbox(Size, Size, Size);
+      else if (k == 1)
+        sb = sibox(Size, Size, Size);
+      else if (k == 2)
+        ib = ibox(Size, Size, Size);
+      else if (k == 3)
+        cb = cgrid(Size, Size, Size);
+      else if (k == 4)
+        sb = sigrid(Size, Size, Size);
+      else
+        ib = igrid(Size, Size, Size);
+      if (!cb && !sb && !ib) {
+        warning("vcctlbench", "Could not allocate array");
+        nerr++;
+        break;
+      }
+      for (x = 0; x < Size; x++) {
+        for (y = 0; y < Size; y++) {
+          for (z = 0; z < Size; z++) {
+            if (cb)
+              cb[x][y][z] = (char)z;
+            else if (sb)
+              sb[x][y][z] = (short int)z;
+            else
+              ib[x][y][z] = z;
+          }
+        }
+      }
+      if (k == 0)
+        free_cbox(cb, Size, Size);
+      else if (k == 1)
+        free_sibox(sb, Size, Size);
+      else if (k == 2)
+        free_ibox(ib, Size, Size);
+      else if (k == 3)
+        free_cgrid(cb);
+      else if (k == 4)
+        free_sigrid(sb);
+      else
+        free_igrid(ib);
+      t = benchclock() - t;
+      if (r == 0 || t < best)
+        best = t;
+    }
+    if (nerr)
+      break;
+    report(name[k], best, (double)Size * Size * Size, "voxels");
+  }
+
+  return (nerr);
+}
+
+/***
+ *	bench_perc
+ *
+ *	Time labeling the pore network of the microstructure
+ *	and testing it for percolation in all three directions
+ *
+ * 	Arguments:	unsigned char pointer to the voxels
+ * 	Returns:	int number of errors
+ *
+ *	Calls:		cgrid, perc_label, free_cgrid
+ *	Called by:	main program
+ ***/
+int bench_perc(unsigned char *vox) {
+  int r, x, y, z, nerr;
+  size_t n;
+  double t, best;
+  char ***mic;
+  unsigned char cls[CENSUSIDS];
+  unsigned char link[PERCCLASSES][PERCCLASSES];
+  Percstats ps;
+
+  mic = cgrid(Size, Size, Size);
+  if (!mic) {
+    warning("vcctlbench", "Could not allocate memory for microstructure");
+    return (1);
+  }
+  n = 0;
+  for (x = 0; x < Size; x++) {
+    for (y = 0; y < Size; y++) {
+      for (z = 0; z < Size; z++)
+        mic[x][y][z] = (char)vox[n++];
+    }
+  }
+
+  memset(cls, 0, sizeof(cls));
+  cls[POROSITY] = 1;
+  memset(link, PERCNOLINK, sizeof(link));
+  link[1][1] = PERCLINK;
+
+  nerr = 0;
+  best = 0.0;
+  for (r = 0; r < Reps; r++) {
+    t = benchclock();
+    if (perc_label(mic, NULL, Size, Size, Size, cls, link, &ps)) {
+      warning("vcctlbench", "Could not allocate cluster labels");
+      nerr++;
+      break;
+    }
+    t = benchclock() - t;
+    if (r == 0 || t < best)
+      best = t;
+  }
+  free_cgrid(mic);
+  if (!nerr)
+    report("perc_label", best, (double)Size * Size * Size, "voxels");
+
+  return (nerr);
+}
+
+/***
+ *	bench_poresize
+ *
+ *	Time finding the pore size distribution of the
+ *	microstructure, with the largest diameter that
+ *	calcporedist3d would use
+ *
+ * 	Arguments:	unsigned char pointer to the voxels
+ * 	Returns:	int number of errors
+ *
+ *	Calls:		poresizes
+ *	Called by:	main program
+ ***/
+int bench_poresize(unsigned char *vox) {
+  int r, maxdiam, nerr;
+  int *ndiam;
+  size_t n, nvox;
+  double t, best;
+  unsigned char *pore;
+
+  maxdiam = (int)(0.2 * Size);
+  if (maxdiam % 2 == 0)
+    maxdiam++;
+
+  nvox = (size_t)Size * Size * Size;
+  pore = (unsigned char *)malloc(nvox);
+  ndiam = ivector(maxdiam + 1);
+  if (!pore || !ndiam) {
+    warning("vcctlbench", "Could not allocate memory for pore sizes");
+    if (pore)
+      free(pore);
+    if (ndiam)
+      free_ivector(ndiam);
+    return (1);
+  }
+
+  nerr = 0;
+  best = 0.0;
+  for (r = 0; r < Reps; r++) {
+    for (n = 0; n < nvox; n++)
+      pore[n] = (vox[n] == POROSITY) ? 1 : 0;
+    t = benchclock();
+    if (poresizes(pore, Size, Size, Size, maxdiam, ndiam)) {
+      warning("vcctlbench", "Could not allocate memory for pore sizes");
+      nerr++;
+      break;
+    }
+    t = benchclock() - t;
+    if (r == 0 || t < best)
+      best = t;
+  }
+  free(pore);
+  free_ivector(ndiam);
+  if (!nerr)
+    report("poresizes", best, (double)nvox, "voxels");
+
+  return (nerr);
+}
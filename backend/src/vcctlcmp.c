@@ -0,0 +1,437 @@
+/******************************************************
+ *
+ * Program vcctlcmp
+ *
+ * Compares an output file of one run with the same
+ * output of a reference run, to check a faster mode
+ * of a program against its legacy path.
+ *
+ * Files that are byte for byte the same are equal.
+ * Otherwise, with --exact, they differ.  Without it:
+ *
+ *	images     (files starting with a VCCTL image header,
+ *	           ASCII or binary) must have the same size,
+ *	           and each phase's volume fraction must be
+ *	           within --fraction of the reference
+ *	text       is split into fields at white space and
+ *	           commas; both files must have the same
+ *	           number of fields, fields that are numbers
+ *	           must agree within --rel (relative) plus
+ *	           --abs (absolute), and the rest must match
+ *
+ * One line describing the largest difference is
+ * printed.  The exit status is 0 if the files are
+ * equal, 1 if they differ and 2 if one could not be
+ * read.
+ ******************************************************/
+#include "include/vcctl.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***
+ *	Global variables
+ ***/
+int Exact = 0;
+double Reltol = 0.02;
+double Abstol = 1.0e-9;
+double Fractol = 0.01;
+
+/***
+ *	Function declarations
+ ***/
+int checkargs(int argc, char *argv[]);
+void printHelp(void);
+char *readfile(char *name, size_t *len);
+int isimage(char *buf, size_t len);
+int cmpimage(char *refname, char *name);
+int cmptext(char *ref, char *buf);
+char *nextfield(char **pos, size_t *len);
+
+int main(int argc, char *argv[]) {
+  int status;
+  size_t reflen, len;
+  char *ref, *buf;
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    return (2);
+  }
+
+  ref = readfile(argv[optind], &reflen);
+  buf = readfile(argv[optind + 1], &len);
+  if (!ref || !buf) {
+    if (ref)
+      free(ref);
+    if (buf)
+      free(buf);
+    printf("unreadable\n");
+    return (2);
+  }
+
+  if (len == reflen && !memcmp(ref, buf, len)) {
+    status = 0;
+    printf("identical\n");
+  } else if (isimage(ref, reflen) && isimage(buf, len)) {
+    status = cmpimage(argv[optind], argv[optind + 1]);
+    if (Exact && !status)
+      status = 1;
+  } else if (Exact || memchr(ref, '\0', reflen) || memchr(buf, '\0', len)) {
+    status = 1;
+    printf("different bytes\n");
+  } else {
+    status = cmptext(ref, buf);
+  }
+
+  free(ref);
+  free(buf);
+
+  return (status);
+}
+
+/***
+ *	checkargs
+ *
+ *	Checks the command line arguments
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"exact", no_argument, 0, 'e'},
+                                      {"rel", required_argument, 0, 'r'},
+                                      {"abs", required_argument, 0, 'a'},
+                                      {"fraction", required_argument, 0, 'f'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  while ((opt_char = getopt_long(argc, argv, "er:a:f:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -e or --exact */
+    case (int)('e'):
+      Exact = 1;
+      break;
+    /* -r or --rel */
+    case (int)('r'):
+      Reltol = atof(optarg);
+      break;
+    /* -a or --abs */
+    case (int)('a'):
+      Abstol = atof(optarg);
+      break;
+    /* -f or --fraction */
+    case (int)('f'):
+      Fractol = atof(optarg);
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (Reltol < 0.0 || Abstol < 0.0 || Fractol < 0.0)
+    return (1);
+
+  return ((argc - optind == 2) ? 0 : 1);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void printHelp(void) {
+  fprintf(stderr, "\n\nUSAGE:  vcctlcmp [-e,--exact] [-r,--rel <tol>] "
+                  "[-a,--abs <tol>]\n");
+  fprintf(stderr, "                 [-f,--fraction <tol>] <reference> "
+                  "<file>\n\n");
+  fprintf(stderr, "Exit status 0 if the files are equal, 1 if they differ, "
+                  "2 if unreadable.\n\n");
+  fprintf(stderr, "  --exact     only byte for byte equal files are "
+                  "equal\n");
+  fprintf(stderr, "  --rel       relative tolerance of numbers in text "
+                  "(default 0.02)\n");
+  fprintf(stderr, "  --abs       absolute tolerance of numbers in text "
+                  "(default 1e-9)\n");
+  fprintf(stderr, "  --fraction  tolerance of phase volume fractions of "
+                  "images (default 0.01)\n\n");
+
+  return;
+}
+
+/***
+ *	readfile
+ *
+ *	Read a whole file into memory, with a terminating zero
+ *	byte after its contents
+ *
+ * 	Arguments:	char pointer to name of the file
+ * 				size_t pointer to length of the contents
+ * 	Returns:	char pointer to the contents (to be freed),
+ * 				or NULL if the file could not be read
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+char *readfile(char *name, size_t *len) {
+  size_t cap, n;
+  char *buf, *newbuf;
+  FILE *fp;
+
+  fp = fopen(name, "rb");
+  if (!fp)
+    return (NULL);
+
+  cap = 65536;
+  *len = 0;
+  buf = (char *)malloc(cap + 1);
+  while (buf) {
+    n = fread(buf + *len, 1, cap - *len, fp);
+    *len += n;
+    if (*len < cap)
+      break;
+    cap *= 2;
+    newbuf = (char *)realloc(buf, cap + 1);
+    if (!newbuf) {
+      free(buf);
+      buf = NULL;
+    } else {
+      buf = newbuf;
+    }
+  }
+  if (buf && ferror(fp)) {
+    free(buf);
+    buf = NULL;
+  }
+  fclose(fp);
+
+  if (buf)
+    buf[*len] = '\0';
+
+  return (buf);
+}
+
+/***
+ *	isimage
+ *
+ *	Tell whether file contents start with a VCCTL image header
+ *
+ * 	Arguments:	char pointer to the contents
+ * 				size_t length of the contents
+ * 	Returns:	int 1 if so, 0 otherwise
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int isimage(char *buf, size_t len) {
+  size_t n;
+
+  n = strlen(VERSIONSTRING);
+  return (len > n && !strncmp(buf, VERSIONSTRING, n));
+}
+
+/***
+ *	cmpimage
+ *
+ *	Compare two images voxel by voxel and by phase volume
+ *	fractions
+ *
+ * 	Arguments:	char pointer to name of the reference image
+ * 				char pointer to name of the other image
+ * 	Returns:	int 0 if equal, 1 if different, 2 if unreadable
+ *
+ *	Calls:		load_microstructure
+ *	Called by:	main program
+ ***/
+int cmpimage(char *refname, char *name) {
+  int i, k, xsize[2], ysize[2], zsize[2], maxid;
+  long int count[2][CENSUSIDS];
+  size_t n, nvox, ndiff, cap[2];
+  float ver, res;
+  double diff, maxdiff;
+  unsigned char *vox[2];
+  FILE *fp;
+
+  vox[0] = vox[1] = NULL;
+  cap[0] = cap[1] = 0;
+  for (k = 0; k < 2; k++) {
+    fp = fopen((k == 0) ? refname : name, "rb");
+    if (!fp || load_microstructure(fp, &vox[k], &cap[k], &ver, &xsize[k],
+                                   &ysize[k], &zsize[k], &res)) {
+      if (fp)
+        fclose(fp);
+      if (vox[0])
+        free(vox[0]);
+      if (vox[1])
+        free(vox[1]);
+      printf("unreadable image\n");
+      return (2);
+    }
+    fclose(fp);
+  }
+
+  if (xsize[0] != xsize[1] || ysize[0] != ysize[1] || zsize[0] != zsize[1]) {
+    printf("different image sizes %dx%dx%d and %dx%dx%d\n", xsize[0],
+           ysize[0], zsize[0], xsize[1], ysize[1], zsize[1]);
+    free(vox[0]);
+    free(vox[1]);
+    return (1);
+  }
+
+  nvox = (size_t)xsize[0] * ysize[0] * zsize[0];
+  memset(count, 0, sizeof(count));
+  ndiff = 0;
+  for (n = 0; n < nvox; n++) {
+    count[0][vox[0][n]]++;
+    count[1][vox[1][n]]++;
+    if (vox[0][n] != vox[1][n])
+      ndiff++;
+  }
+  free(vox[0]);
+  free(vox[1]);
+
+  maxid = 0;
+  maxdiff = 0.0;
+  for (i = 0; i < CENSUSIDS; i++) {
+    diff = fabs((double)(count[1][i] - count[0][i])) / (double)nvox;
+    if (diff > maxdiff) {
+      maxdiff = diff;
+      maxid = i;
+    }
+  }
+
+  printf("%lu of %lu voxels differ; largest fraction difference %g "
+         "(phase %d)\n",
+         (unsigned long)ndiff, (unsigned long)nvox, maxdiff, maxid);
+
+  if (ndiff == 0)
+    return (0);
+
+  return ((Exact || maxdiff > Fractol) ? 1 : 0);
+}
+
+/***
+ *	nextfield
+ *
+ *	Find the next field of text, skipping white space and
+ *	commas
+ *
+ * 	Arguments:	char pointer pointer to position in the text,
+ * 					moved past the field
+ * 				size_t pointer to length of the field
+ * 	Returns:	char pointer to start of the field, or NULL at
+ * 				the end of the text
+ *
+ *	Calls:		no routines
+ *	Called by:	cmptext
+ ***/
+char *nextfield(char **pos, size_t *len) {
+  char *p, *start;
+
+  p = *pos;
+  while (*p && (strchr(" \t\r\n,", *p)))
+    p++;
+  if (!*p) {
+    *pos = p;
+    return (NULL);
+  }
+
+  start = p;
+  while (*p && !strchr(" \t\r\n,", *p))
+    p++;
+  *len = (size_t)(p - start);
+  *pos = p;
+
+  return (start);
+}
+
+/***
+ *	cmptext
+ *
+ *	Compare two texts field by field, numbers within the
+ *	tolerances and other fields exactly
+ *
+ * 	Arguments:	char pointer to the reference text
+ * 				char pointer to the other text
+ * 	Returns:	int 0 if equal, 1 if different
+ *
+ *	Calls:		nextfield
+ *	Called by:	main program
+ ***/
+int cmptext(char *ref, char *buf) {
+  int line, badline, status;
+  size_t reflen, len;
+  char *rp, *bp, *rf, *bf, *c, *rend, *bend;
+  double a, b, diff, rel, maxrel;
+
+  status = 0;
+  line = 1;
+  badline = 0;
+  maxrel = 0.0;
+  rp = ref;
+  bp = buf;
+  while (1) {
+    c = rp;
+    rf = nextfield(&rp, &reflen);
+    bf = nextfield(&bp, &len);
+
+    /* Count lines of the reference, for the report */
+
+    for (; c < (rf ? rf : rp); c++) {
+      if (*c == '\n')
+        line++;
+    }
+    if (!rf || !bf) {
+      if (rf || bf) {
+        status = 1;
+        printf("different number of fields (from line %d)\n", line);
+        return (status);
+      }
+      break;
+    }
+
+    a = strtod(rf, &rend);
+    b = strtod(bf, &bend);
+    if (rend == rf + reflen && bend == bf + len) {
+      diff = fabs(a - b);
+      rel = (diff > 0.0) ? diff / fmax(fabs(a), fabs(b)) : 0.0;
+      if (rel > maxrel)
+        maxrel = rel;
+      if (diff > Abstol + Reltol * fmax(fabs(a), fabs(b)) ||
+          !isnan(a) != !isnan(b)) {
+        if (!status)
+          badline = line;
+        status = 1;
+      }
+    } else if (reflen != len || strncmp(rf, bf, len)) {
+      status = 1;
+      printf("different text \"%.*s\" and \"%.*s\"\n", (int)reflen, rf,
+             (int)len, bf);
+      return (status);
+    }
+  }
+
+  if (status) {
+    printf("numbers differ beyond tolerance (first at line %d); "
+           "largest relative difference %g\n",
+           badline, maxrel);
+  } else {
+    printf("equal within tolerance; largest relative difference %g\n",
+           maxrel);
+  }
+
+  return (status);
+}
@@ -0,0 +1,687 @@
+/******************************************************
+ *
+ * Python module vcctlcore
+ *
+ * The image loaders and analysis kernels of vcctllib for
+ * the user interface and for analysis scripts, so that
+ * they read a 300^3 image and take its census, pore sizes
+ * and percolation with the code the programs use instead
+ * of parsing the text in Python.
+ *
+ *	read_imgheader(path)   dict of version, xsize, ysize,
+ *	                       zsize, res and format
+ *	load_image(path)       phase ids, shape (x, y, z)
+ *	pores(ids)             1 at the pore voxels, 0 elsewhere
+ *	census(ids)            (voxels, faces shared with a
+ *	                       pore) of each phase id
+ *	poresizes(pore, maxdiam=0)
+ *	                       pore voxels of each diameter,
+ *	                       0 to maxdiam (0 for the largest
+ *	                       calcporedist3d counts)
+ *	percolation(classes, links=((1, 1),))
+ *	                       dict of the Percstats of the
+ *	                       network of classes 1 and up,
+ *	                       joined where a pair is in links
+ *
+ * Arrays are three dimensional, voxel (x,y,z) at
+ * (x*ysize+y)*zsize+z, as in the images.  Results come
+ * back as NumPy arrays when NumPy can be imported, and
+ * otherwise as objects with the buffer protocol, which
+ * memoryview or any array package can wrap.  Neither way
+ * copies them: the array is a view of memory that the
+ * module holds until the array goes away.  A raw binary
+ * image (IMG_UINT8) whose ids need no conversion is that
+ * memory mapped read-only, so that loading it costs only
+ * the pages that are read; other images are read with
+ * load_microstructure.  Arrays given to the module are
+ * read where they are, through the buffer protocol, and
+ * must be C contiguous bytes.
+ *
+ * The interpreter lock is let go while a file is read or a
+ * kernel runs, so that other Python threads, such as the
+ * main loop of the interface, go on meanwhile.
+ *
+ * Built when VCCTL_PYTHON is on (see CMakeLists.txt).
+ ******************************************************/
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "include/vcctl.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***
+ *	Memory behind an array given back to Python
+ *
+ *		img:     mapping or buffer from map_binimg, if
+ *		         mapped is set
+ *		data:    buffer from malloc otherwise
+ *		shape, strides, ndim, format, itemsize: as the
+ *		         buffer protocol gives them
+ ***/
+typedef struct {
+  PyObject_HEAD
+  Mappedimg img;
+  int mapped;
+  void *data;
+  int readonly;
+  int ndim;
+  Py_ssize_t shape[3], strides[3];
+  Py_ssize_t itemsize;
+  char *format;
+} Vbuffer;
+
+/***
+ *	Global variables
+ ***/
+static PyObject *Asarray = NULL; /* numpy.asarray, or NULL */
+
+/***
+ *	Function declarations
+ ***/
+static void vbuffer_dealloc(Vbuffer *vb);
+static int vbuffer_getbuffer(Vbuffer *vb, Py_buffer *view, int flags);
+static Vbuffer *vbuffer_new(int ndim, Py_ssize_t *shape, char *format,
+                            Py_ssize_t itemsize);
+static PyObject *asarray(Vbuffer *vb);
+static int getvoxels(PyObject *obj, Py_buffer *view, int *xsize, int *ysize,
+                     int *zsize);
+static int idsneeded(float ver);
+
+static PyBufferProcs Vbuffer_as_buffer = {(getbufferproc)vbuffer_getbuffer,
+                                          NULL};
+
+static PyTypeObject Vbuffer_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "vcctlcore.Buffer",
+    .tp_basicsize = sizeof(Vbuffer),
+    .tp_dealloc = (destructor)vbuffer_dealloc,
+    .tp_as_buffer = &Vbuffer_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Memory of an array made by vcctlcore"};
+
+/***
+ *	vbuffer_dealloc
+ *
+ *	Releases the memory of an array once nothing uses it
+ *
+ * 	Arguments:	Vbuffer pointer
+ * 	Returns:	nothing
+ *
+ *	Calls:		unmap_binimg
+ *	Called by:	Python
+ ***/
+static void vbuffer_dealloc(Vbuffer *vb) {
+  if (vb->mapped) {
+    unmap_binimg(&vb->img);
+  } else {
+    free(vb->data);
+  }
+  Py_TYPE(vb)->tp_free((PyObject *)vb);
+}
+
+/***
+ *	vbuffer_getbuffer
+ *
+ *	Gives the memory of an array to the buffer protocol
+ *
+ * 	Arguments:	Vbuffer pointer
+ * 				Py_buffer pointer to fill
+ * 				int flags of the request
+ * 	Returns:	int 0 if okay, -1 with an exception set
+ *
+ *	Calls:		no routines
+ *	Called by:	Python
+ ***/
+static int vbuffer_getbuffer(Vbuffer *vb, Py_buffer *view, int flags) {
+  int i;
+
+  if ((flags & PyBUF_WRITABLE) && vb->readonly) {
+    PyErr_SetString(PyExc_BufferError, "Array of a mapped image is read-only");
+    view->obj = NULL;
+    return (-1);
+  }
+
+  view->obj = (PyObject *)vb;
+  Py_INCREF(vb);
+  view->buf = vb->mapped ? (void *)vb->img.vox : vb->data;
+  view->len = vb->itemsize;
+  for (i = 0; i < vb->ndim; i++) {
+    view->len *= vb->shape[i];
+  }
+  view->readonly = vb->readonly;
+  view->itemsize = vb->itemsize;
+  view->format = (flags & PyBUF_FORMAT) ? vb->format : NULL;
+  view->ndim = vb->ndim;
+  view->shape = (flags & PyBUF_ND) ? vb->shape : NULL;
+  view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? vb->strides
+                                                             : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+
+  return (0);
+}
+
+/***
+ *	vbuffer_new
+ *
+ *	Makes an array object with no memory behind it yet
+ *
+ * 	Arguments:	int dimensions, at most 3
+ * 				Py_ssize_t pointer to the size of each
+ * 				char pointer to the struct format of an item
+ * 				Py_ssize_t bytes of an item
+ * 	Returns:	Vbuffer pointer, or NULL with an exception set
+ *
+ *	Calls:		no routines
+ *	Called by:	load_image, pores, census, poresizes
+ ***/
+static Vbuffer *vbuffer_new(int ndim, Py_ssize_t *shape, char *format,
+                            Py_ssize_t itemsize) {
+  int i;
+  Vbuffer *vb;
+
+  vb = PyObject_New(Vbuffer, &Vbuffer_type);
+  if (!vb)
+    return (NULL);
+
+  memset(&vb->img, 0, sizeof(Mappedimg));
+  vb->mapped = 0;
+  vb->data = NULL;
+  vb->readonly = 0;
+  vb->ndim = ndim;
+  vb->itemsize = itemsize;
+  vb->format = format;
+  for (i = ndim - 1; i >= 0; i--) {
+    vb->shape[i] = shape[i];
+    vb->strides[i] = (i == ndim - 1) ? itemsize
+                                     : vb->strides[i + 1] * vb->shape[i + 1];
+  }
+
+  return (vb);
+}
+
+/***
+ *	asarray
+ *
+ *	Gives an array object back as a NumPy array viewing its
+ *	memory, when NumPy is there, and as itself otherwise
+ *
+ * 	Arguments:	Vbuffer pointer, whose reference is taken over
+ * 	Returns:	PyObject pointer, or NULL with an exception set
+ *
+ *	Calls:		no routines
+ *	Called by:	load_image, pores, census, poresizes
+ ***/
+static PyObject *asarray(Vbuffer *vb) {
+  PyObject *arr;
+
+  if (!vb || !Asarray)
+    return ((PyObject *)vb);
+
+  arr = PyObject_CallOneArg(Asarray, (PyObject *)vb);
+  Py_DECREF(vb);
+
+  return (arr);
+}
+
+/***
+ *	getvoxels
+ *
+ *	Takes the bytes of a three dimensional array given to the
+ *	module, in place
+ *
+ * 	Arguments:	PyObject pointer to the array
+ * 				Py_buffer pointer to fill, to be released
+ * 				int pointers to xsize, ysize, zsize
+ * 	Returns:	int 0 if okay, -1 with an exception set
+ *
+ *	Calls:		no routines
+ *	Called by:	pores, census, poresizes, percolation
+ ***/
+static int getvoxels(PyObject *obj, Py_buffer *view, int *xsize, int *ysize,
+                     int *zsize) {
+  if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT))
+    return (-1);
+
+  if (view->ndim != 3 || view->itemsize != 1 ||
+      (view->format && strcmp(view->format, "B") && strcmp(view->format, "b") &&
+       strcmp(view->format, "?"))) {
+    PyBuffer_Release(view);
+    PyErr_SetString(PyExc_ValueError,
+                    "Voxels must be a three dimensional array of bytes");
+    return (-1);
+  }
+  if (view->shape[0] > INT_MAX || view->shape[1] > INT_MAX ||
+      view->shape[2] > INT_MAX || view->len == 0) {
+    PyBuffer_Release(view);
+    PyErr_SetString(PyExc_ValueError, "Array is too large or empty");
+    return (-1);
+  }
+
+  *xsize = (int)view->shape[0];
+  *ysize = (int)view->shape[1];
+  *zsize = (int)view->shape[2];
+
+  return (0);
+}
+
+/***
+ *	idsneeded
+ *
+ *	Tells whether the ids of an image of a version must be
+ *	converted with convert_id, so that the image cannot be
+ *	used as it is in the file
+ *
+ * 	Arguments:	float version from the header
+ * 	Returns:	int 1 if they must, 0 if not
+ *
+ *	Calls:		convert_id
+ *	Called by:	load_image
+ ***/
+static int idsneeded(float ver) {
+  int i;
+
+  for (i = 0; i < CENSUSIDS; i++) {
+    if (convert_id(i, ver) != i)
+      return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	read_imgheader
+ *
+ *	Python: read_imgheader(path) -> dict
+ ***/
+static PyObject *py_read_imgheader(PyObject *self, PyObject *args) {
+  int xsize, ysize, zsize, format, status;
+  float ver, res;
+  const char *path;
+  FILE *fp;
+  static const char *formatname[] = {"ascii",  "uint8",   "uint8z", "moviez",
+                                     "unknown", "unknown", "seriesz"};
+
+  if (!PyArg_ParseTuple(args, "s", &path))
+    return (NULL);
+
+  Py_BEGIN_ALLOW_THREADS;
+  fp = fopen(path, "rb");
+  status = !fp || read_imgheader_fmt(fp, &ver, &xsize, &ysize, &zsize, &res,
+                                     &format);
+  if (fp)
+    fclose(fp);
+  Py_END_ALLOW_THREADS;
+
+  if (status) {
+    PyErr_Format(PyExc_OSError, "Could not read the header of %s", path);
+    return (NULL);
+  }
+
+  return (Py_BuildValue(
+      "{s:f,s:i,s:i,s:i,s:f,s:s}", "version", (double)ver, "xsize", xsize,
+      "ysize", ysize, "zsize", zsize, "res", (double)res, "format",
+      (format >= 0 && format <= IMG_SERIESZ) ? formatname[format]
+                                             : "unknown"));
+}
+
+/***
+ *	load_image
+ *
+ *	Python: load_image(path) -> uint8 array (x, y, z)
+ ***/
+static PyObject *py_load_image(PyObject *self, PyObject *args) {
+  int xsize, ysize, zsize, format, status, mapped;
+  float ver, res;
+  size_t cap;
+  Py_ssize_t shape[3];
+  const char *path;
+  unsigned char *vox;
+  Mappedimg img;
+  Vbuffer *vb;
+  FILE *fp;
+
+  if (!PyArg_ParseTuple(args, "s", &path))
+    return (NULL);
+
+  /* A raw image that needs no conversion is mapped, the rest read */
+
+  vox = NULL;
+  cap = 0;
+  mapped = 0;
+  Py_BEGIN_ALLOW_THREADS;
+  fp = fopen(path, "rb");
+  status = !fp || read_imgheader_fmt(fp, &ver, &xsize, &ysize, &zsize, &res,
+                                     &format);
+  if (fp)
+    fclose(fp);
+  if (!status && format == IMG_UINT8 && !idsneeded(ver) &&
+      !map_binimg((char *)path, &img)) {
+    mapped = 1;
+  } else if (!status) {
+    fp = fopen(path, "rb");
+    status = !fp || load_microstructure(fp, &vox, &cap, &ver, &xsize, &ysize,
+                                        &zsize, &res);
+    if (fp)
+      fclose(fp);
+  }
+  Py_END_ALLOW_THREADS;
+
+  if (status) {
+    free(vox);
+    PyErr_Format(PyExc_OSError, "Error reading microstructure image %s",
+                 path);
+    return (NULL);
+  }
+
+  shape[0] = xsize;
+  shape[1] = ysize;
+  shape[2] = zsize;
+  vb = vbuffer_new(3, shape, "B", 1);
+  if (!vb) {
+    if (mapped)
+      unmap_binimg(&img);
+    free(vox);
+    return (NULL);
+  }
+  if (mapped) {
+    vb->img = img;
+    vb->mapped = 1;
+    vb->readonly = 1;
+  } else {
+    vb->data = vox;
+  }
+
+  return (asarray(vb));
+}
+
+/***
+ *	pores
+ *
+ *	Python: pores(ids) -> uint8 array, 1 at the pore voxels
+ ***/
+static PyObject *py_pores(PyObject *self, PyObject *args) {
+  int xsize, ysize, zsize;
+  size_t n, nvox;
+  unsigned char ispore[256], *vox, *cl;
+  PyObject *obj;
+  Py_buffer view;
+  Vbuffer *vb;
+
+  if (!PyArg_ParseTuple(args, "O", &obj) ||
+      getvoxels(obj, &view, &xsize, &ysize, &zsize))
+    return (NULL);
+
+  nvox = (size_t)view.len;
+  vb = vbuffer_new(3, view.shape, "B", 1);
+  cl = vb ? (unsigned char *)malloc(nvox) : NULL;
+  if (!cl) {
+    PyBuffer_Release(&view);
+    Py_XDECREF(vb);
+    return (vb ? PyErr_NoMemory() : NULL);
+  }
+  vb->data = cl;
+
+  memset(ispore, 0, sizeof(ispore));
+  ispore[POROSITY] = ispore[EMPTYP] = ispore[EMPTYDP] = ispore[CRACKP] = 1;
+  vox = (unsigned char *)view.buf;
+  Py_BEGIN_ALLOW_THREADS;
+  for (n = 0; n < nvox; n++) {
+    cl[n] = ispore[vox[n]];
+  }
+  Py_END_ALLOW_THREADS;
+  PyBuffer_Release(&view);
+
+  return (asarray(vb));
+}
+
+/***
+ *	census
+ *
+ *	Python: census(ids, nids=NPHASES) -> (counts, faces)
+ ***/
+static PyObject *py_census(PyObject *self, PyObject *args, PyObject *kw) {
+  int xsize, ysize, zsize, nids;
+  int *count;
+  Py_ssize_t shape[1];
+  PyObject *obj, *res[2];
+  Py_buffer view;
+  Vbuffer *vb[2];
+  static char *kwlist[] = {"ids", "nids", NULL};
+
+  nids = NPHASES;
+  if (!PyArg_ParseTupleAndKeywords(args, kw, "O|i", kwlist, &obj, &nids))
+    return (NULL);
+  if (nids < 1 || nids > CENSUSIDS) {
+    PyErr_SetString(PyExc_ValueError, "nids must be 1 to 256");
+    return (NULL);
+  }
+  if (getvoxels(obj, &view, &xsize, &ysize, &zsize))
+    return (NULL);
+
+  shape[0] = nids;
+  vb[0] = vbuffer_new(1, shape, "i", sizeof(int));
+  vb[1] = vbuffer_new(1, shape, "i", sizeof(int));
+  if (vb[0])
+    vb[0]->data = calloc(nids, sizeof(int));
+  if (vb[1])
+    vb[1]->data = calloc(nids, sizeof(int));
+  if (!vb[0] || !vb[1] || !vb[0]->data || !vb[1]->data) {
+    PyBuffer_Release(&view);
+    Py_XDECREF(vb[0]);
+    Py_XDECREF(vb[1]);
+    return (PyErr_Occurred() ? NULL : PyErr_NoMemory());
+  }
+
+  count = (int *)vb[0]->data;
+  Py_BEGIN_ALLOW_THREADS;
+  phase_census((unsigned char *)view.buf, xsize, ysize, zsize, nids, count,
+               (int *)vb[1]->data);
+  Py_END_ALLOW_THREADS;
+  PyBuffer_Release(&view);
+
+  res[0] = asarray(vb[0]);
+  res[1] = asarray(vb[1]);
+  if (!res[0] || !res[1]) {
+    Py_XDECREF(res[0]);
+    Py_XDECREF(res[1]);
+    return (NULL);
+  }
+
+  return (Py_BuildValue("(NN)", res[0], res[1]));
+}
+
+/***
+ *	poresizes
+ *
+ *	Python: poresizes(pore, maxdiam=0) -> int array, the pore
+ *	voxels of each diameter 0 to maxdiam
+ ***/
+static PyObject *py_poresizes(PyObject *self, PyObject *args, PyObject *kw) {
+  int xsize, ysize, zsize, maxdiam, mindim, status;
+  Py_ssize_t shape[1];
+  PyObject *obj;
+  Py_buffer view;
+  Vbuffer *vb;
+  static char *kwlist[] = {"pore", "maxdiam", NULL};
+
+  maxdiam = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kw, "O|i", kwlist, &obj, &maxdiam) ||
+      getvoxels(obj, &view, &xsize, &ysize, &zsize))
+    return (NULL);
+
+  /* By default the largest diameter calcporedist3d counts */
+
+  if (maxdiam < 1) {
+    mindim = xsize;
+    if (ysize < mindim)
+      mindim = ysize;
+    if (zsize < mindim)
+      mindim = zsize;
+    maxdiam = (int)(0.2 * mindim);
+  }
+  if (maxdiam % 2 == 0)
+    maxdiam++;
+
+  shape[0] = maxdiam + 1;
+  vb = vbuffer_new(1, shape, "i", sizeof(int));
+  if (vb)
+    vb->data = calloc(maxdiam + 1, sizeof(int));
+  if (!vb || !vb->data) {
+    PyBuffer_Release(&view);
+    Py_XDECREF(vb);
+    return (PyErr_Occurred() ? NULL : PyErr_NoMemory());
+  }
+
+  /* The kernel takes x fastest, the reverse of the image order */
+
+  Py_BEGIN_ALLOW_THREADS;
+  status = poresizes((unsigned char *)view.buf, zsize, ysize, xsize, maxdiam,
+                     (int *)vb->data);
+  Py_END_ALLOW_THREADS;
+  PyBuffer_Release(&view);
+
+  if (status) {
+    Py_DECREF(vb);
+    return (PyErr_NoMemory());
+  }
+
+  return (asarray(vb));
+}
+
+/***
+ *	percolation
+ *
+ *	Python: percolation(classes, links=((1, 1),)) -> dict
+ ***/
+static PyObject *py_percolation(PyObject *self, PyObject *args,
+                                PyObject *kw) {
+  int xsize, ysize, zsize, status, a, b, d;
+  size_t n;
+  unsigned char link[PERCCLASSES][PERCCLASSES], *cl;
+  PyObject *obj, *links = NULL, *seq, *item, *out;
+  Py_buffer view;
+  Percstats ps;
+  static char *kwlist[] = {"classes", "links", NULL};
+
+  if (!PyArg_ParseTupleAndKeywords(args, kw, "O|O", kwlist, &obj, &links))
+    return (NULL);
+
+  memset(link, PERCNOLINK, sizeof(link));
+  if (!links) {
+    link[1][1] = PERCLINK;
+  } else {
+    seq = PySequence_Fast(links, "links must be a sequence of class pairs");
+    if (!seq)
+      return (NULL);
+    for (n = 0; n < (size_t)PySequence_Fast_GET_SIZE(seq); n++) {
+      item = PySequence_Fast_GET_ITEM(seq, n);
+      if (!PyArg_ParseTuple(item, "ii", &a, &b) || a < 1 ||
+          a >= PERCCLASSES || b < 1 || b >= PERCCLASSES) {
+        Py_DECREF(seq);
+        if (!PyErr_Occurred())
+          PyErr_SetString(PyExc_ValueError, "Classes must be 1 to 7");
+        return (NULL);
+      }
+      link[a][b] = link[b][a] = PERCLINK;
+    }
+    Py_DECREF(seq);
+  }
+
+  if (getvoxels(obj, &view, &xsize, &ysize, &zsize))
+    return (NULL);
+  cl = (unsigned char *)view.buf;
+  for (n = 0; n < (size_t)view.len && cl[n] < PERCCLASSES; n++)
+    ;
+  if (n < (size_t)view.len) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_ValueError, "Classes must be 0 to 7");
+    return (NULL);
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  status = perc_label_classes(cl, NULL, xsize, ysize, zsize, link, &ps);
+  Py_END_ALLOW_THREADS;
+  PyBuffer_Release(&view);
+
+  if (status)
+    return (PyErr_NoMemory());
+
+  out = Py_BuildValue(
+      "{s:i,s:(iii),s:(iii),s:(iii),s:(iii),s:i,s:i}", "nset", ps.nset,
+      "nthrough", ps.nthrough[0], ps.nthrough[1], ps.nthrough[2], "nfront",
+      ps.nfront[0], ps.nfront[1], ps.nfront[2], "nmeet", ps.nmeet[0],
+      ps.nmeet[1], ps.nmeet[2], "nspan", ps.nspan[0], ps.nspan[1],
+      ps.nspan[2], "ncluster", ps.ncluster, "maxcluster", ps.maxcluster);
+  if (!out)
+    return (NULL);
+  item = PyList_New(PERCSIZEBINS);
+  for (d = 0; item && d < PERCSIZEBINS; d++) {
+    PyList_SET_ITEM(item, d, PyLong_FromLong(ps.nsize[d]));
+  }
+  if (!item || PyDict_SetItemString(out, "nsize", item)) {
+    Py_XDECREF(item);
+    Py_DECREF(out);
+    return (NULL);
+  }
+  Py_DECREF(item);
+
+  return (out);
+}
+
+static PyMethodDef Vcctlcore_methods[] = {
+    {"read_imgheader", py_read_imgheader, METH_VARARGS,
+     "read_imgheader(path) -> dict of version, xsize, ysize, zsize, res "
+     "and format"},
+    {"load_image", py_load_image, METH_VARARGS,
+     "load_image(path) -> phase ids, shape (xsize, ysize, zsize)"},
+    {"pores", py_pores, METH_VARARGS,
+     "pores(ids) -> 1 at the pore voxels, 0 elsewhere"},
+    {"census", (PyCFunction)(void (*)(void))py_census,
+     METH_VARARGS | METH_KEYWORDS,
+     "census(ids, nids=NPHASES) -> (voxels, faces shared with a pore) of "
+     "each phase id"},
+    {"poresizes", (PyCFunction)(void (*)(void))py_poresizes,
+     METH_VARARGS | METH_KEYWORDS,
+     "poresizes(pore, maxdiam=0) -> pore voxels of each diameter"},
+    {"percolation", (PyCFunction)(void (*)(void))py_percolation,
+     METH_VARARGS | METH_KEYWORDS,
+     "percolation(classes, links=((1, 1),)) -> dict of the statistics of "
+     "the network"},
+    {NULL, NULL, 0, NULL}};
+
+static struct PyModuleDef Vcctlcore_module = {
+    PyModuleDef_HEAD_INIT, "vcctlcore",
+    "Image loaders and analysis kernels of vcctllib", -1, Vcctlcore_methods};
+
+PyMODINIT_FUNC PyInit_vcctlcore(void) {
+  PyObject *mod, *numpy;
+
+  if (PyType_Ready(&Vbuffer_type) < 0)
+    return (NULL);
+
+  mod = PyModule_Create(&Vcctlcore_module);
+  if (!mod)
+    return (NULL);
+  Py_INCREF(&Vbuffer_type);
+  if (PyModule_AddObject(mod, "Buffer", (PyObject *)&Vbuffer_type) ||
+      PyModule_AddIntConstant(mod, "NPHASES", NPHASES)) {
+    Py_DECREF(&Vbuffer_type);
+    Py_DECREF(mod);
+    return (NULL);
+  }
+
+  /* Without NumPy the arrays are given back as they are */
+
+  numpy = PyImport_ImportModule("numpy");
+  if (numpy) {
+    Asarray = PyObject_GetAttrString(numpy, "asarray");
+    Py_DECREF(numpy);
+  }
+  PyErr_Clear();
+
+  return (mod);
+}
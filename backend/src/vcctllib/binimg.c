@@ -0,0 +1,588 @@
+/******************************************************************************
+ *	Collection of functions to read and write binary microstructure
+ *	images.
+ *
+ *	A binary image has the usual text header written by
+ *	write_imgheader, followed by an Image_Format line (see vcctl.h),
+ *	and is padded with blanks to BINIMGHEADERSIZE bytes.  The voxel
+ *	phase ids follow as unsigned bytes in C order (z varies fastest,
+ *	then y, then x), either raw, so that the file can be memory
+ *	mapped, or as one zlib chunk per x plane.  Phase ids are stored
+ *	exactly as they would be written to an ASCII image, so readers
+ *	still apply convert_id with the version from the header.
+ *	Particle id images are laid out the same way with four bytes,
+ *	little-endian, per voxel.
+ *
+ *	Writers and readers that do not hold the whole image in one
+ *	buffer can go one x plane at a time with write_binheader,
+ *	write_binplane and read_binplane.
+ *
+ *	Binary files must be opened in binary mode ("rb" or "wb").
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/******************************************************************************
+ *	Function read_imgformat checks, right after the Image_Resolution
+ *	line of a header, for an optional Image_Format line.  For a
+ *	binary image the stream is left at the first voxel; otherwise it
+ *	is left where it was.
+ *
+ * 	Arguments:	file pointer
+ *
+ *	Returns:	int format (IMG_ASCII, IMG_UINT8, IMG_UINT8Z,
+ *				IMG_MOVIEZ or IMG_SERIESZ), or -1 if the format
+ *				is not recognized
+ ******************************************************************************/
+int read_imgformat(FILE *fpin) {
+  long pos;
+  int format = IMG_ASCII;
+  char buff[MAXSTRING];
+
+  pos = ftell(fpin);
+  if (pos < 0)
+    return (IMG_ASCII);
+
+  if ((fscanf(fpin, "%s", buff) == 1) && !strcmp(buff, IMGFORMATSTRING)) {
+    format = -1;
+    if (fscanf(fpin, "%s", buff) == 1) {
+      if (!strcmp(buff, IMGFORMATUINT8)) {
+        format = IMG_UINT8;
+      } else if (!strcmp(buff, IMGFORMATUINT8Z)) {
+        format = IMG_UINT8Z;
+      } else if (!strcmp(buff, IMGFORMATUINT32)) {
+        format = IMG_UINT32;
+      } else if (!strcmp(buff, IMGFORMATUINT32Z)) {
+        format = IMG_UINT32Z;
+      } else if (!strcmp(buff, IMGFORMATMOVIEZ)) {
+        format = IMG_MOVIEZ;
+      } else if (!strcmp(buff, IMGFORMATSERIESZ)) {
+        format = IMG_SERIESZ;
+      }
+    }
+    if (format != -1)
+      fseek(fpin, BINIMGHEADERSIZE, SEEK_SET);
+  } else {
+    fseek(fpin, pos, SEEK_SET);
+  }
+
+  return (format);
+}
+
+/******************************************************************************
+ *	Function binformat_name gives the Image_Format word of a binary
+ *	voxel format, or NULL if it is not one
+ ******************************************************************************/
+static const char *binformat_name(int format) {
+  switch (format) {
+  case IMG_UINT8:
+    return (IMGFORMATUINT8);
+  case IMG_UINT8Z:
+    return (IMGFORMATUINT8Z);
+  case IMG_UINT32:
+    return (IMGFORMATUINT32);
+  case IMG_UINT32Z:
+    return (IMGFORMATUINT32Z);
+  default:
+    return (NULL);
+  }
+}
+
+/******************************************************************************
+ *	Function write_binheader writes the header of a binary image,
+ *	with its Image_Format line, and pads it to BINIMGHEADERSIZE
+ *	bytes, so that the x planes of voxels can follow
+ *
+ * 	Arguments:	file pointer (opened with "wb")
+ * 				int xsize, ysize, zsize
+ * 				float resolution
+ * 				int format (IMG_UINT8, IMG_UINT8Z, IMG_UINT32 or
+ * 				IMG_UINT32Z)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int write_binheader(FILE *fpout, int xsize, int ysize, int zsize, float res,
+                    int format) {
+  long pos;
+
+  if (!fpout || !binformat_name(format))
+    return (1);
+
+  if (write_imgheader(fpout, xsize, ysize, zsize, res))
+    return (1);
+  fprintf(fpout, "\n%s %s", IMGFORMATSTRING, binformat_name(format));
+
+  pos = ftell(fpout);
+  if (pos < 0 || pos >= BINIMGHEADERSIZE)
+    return (1);
+  for (; pos < BINIMGHEADERSIZE - 1; pos++)
+    fputc(' ', fpout);
+  fputc('\n', fpout);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function write_binplane writes the voxels of one x plane of a
+ *	binary image, raw or as a zlib chunk after its 4-byte length
+ *
+ * 	Arguments:	file pointer (opened with "wb")
+ * 				unsigned char pointer to the bytes of the plane
+ * 				size_t number of bytes in the plane
+ * 				int format
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int write_binplane(FILE *fpout, unsigned char *plane, size_t nbytes,
+                   int format) {
+  uLongf clen;
+  unsigned char *cbuf, lenbytes[4];
+
+  if (format == IMG_UINT8 || format == IMG_UINT32)
+    return ((fwrite(plane, 1, nbytes, fpout) == nbytes) ? 0 : 1);
+  if (format != IMG_UINT8Z && format != IMG_UINT32Z)
+    return (1);
+
+  clen = compressBound((uLong)nbytes);
+  cbuf = (unsigned char *)malloc(clen);
+  if (!cbuf)
+    return (1);
+
+  if (compress2(cbuf, &clen, plane, (uLong)nbytes, Z_DEFAULT_COMPRESSION) !=
+      Z_OK) {
+    free(cbuf);
+    return (1);
+  }
+  lenbytes[0] = (unsigned char)(clen & 0xff);
+  lenbytes[1] = (unsigned char)((clen >> 8) & 0xff);
+  lenbytes[2] = (unsigned char)((clen >> 16) & 0xff);
+  lenbytes[3] = (unsigned char)((clen >> 24) & 0xff);
+  if (fwrite(lenbytes, 1, 4, fpout) != 4 ||
+      fwrite(cbuf, 1, (size_t)clen, fpout) != (size_t)clen) {
+    free(cbuf);
+    return (1);
+  }
+
+  free(cbuf);
+  return (0);
+}
+
+/******************************************************************************
+ *	Function read_binplane reads the voxels of one x plane of a
+ *	binary image, as written by write_binplane
+ *
+ * 	Arguments:	file pointer (opened with "rb")
+ * 				unsigned char pointer to the bytes of the plane
+ * 				size_t number of bytes in the plane
+ * 				int format
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int read_binplane(FILE *fpin, unsigned char *plane, size_t nbytes,
+                  int format) {
+  size_t maxc, clen;
+  uLongf dlen;
+  unsigned char *cbuf, lenbytes[4];
+
+  if (format == IMG_UINT8 || format == IMG_UINT32)
+    return ((fread(plane, 1, nbytes, fpin) == nbytes) ? 0 : 1);
+  if (format != IMG_UINT8Z && format != IMG_UINT32Z)
+    return (1);
+
+  if (fread(lenbytes, 1, 4, fpin) != 4)
+    return (1);
+  clen = (size_t)lenbytes[0] | ((size_t)lenbytes[1] << 8) |
+         ((size_t)lenbytes[2] << 16) | ((size_t)lenbytes[3] << 24);
+  maxc = compressBound((uLong)nbytes);
+  if (clen > maxc)
+    return (1);
+
+  cbuf = (unsigned char *)malloc(clen + 1);
+  if (!cbuf)
+    return (1);
+
+  dlen = (uLongf)nbytes;
+  if (fread(cbuf, 1, clen, fpin) != clen ||
+      uncompress(plane, &dlen, cbuf, (uLong)clen) != Z_OK ||
+      dlen != (uLongf)nbytes) {
+    free(cbuf);
+    return (1);
+  }
+
+  free(cbuf);
+  return (0);
+}
+
+/******************************************************************************
+ *	Function write_binimg writes a complete binary microstructure
+ *	image: header, padding and voxels
+ *
+ * 	Arguments:	file pointer (opened with "wb")
+ * 				unsigned char pointer to voxels in C order
+ * 				int xsize, ysize, zsize
+ * 				float resolution
+ * 				int format (IMG_UINT8 or IMG_UINT8Z)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int write_binimg(FILE *fpout, unsigned char *vox, int xsize, int ysize,
+                 int zsize, float res, int format) {
+  int ix;
+  size_t plane;
+
+  if (format != IMG_UINT8 && format != IMG_UINT8Z)
+    return (1);
+  if (write_binheader(fpout, xsize, ysize, zsize, res, format))
+    return (1);
+
+  plane = (size_t)ysize * (size_t)zsize;
+  if (format == IMG_UINT8)
+    return (write_binplane(fpout, vox, (size_t)xsize * plane, format));
+
+  for (ix = 0; ix < xsize; ix++) {
+    if (write_binplane(fpout, vox + (size_t)ix * plane, plane, format))
+      return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function read_binvoxels reads the voxels of a binary image from
+ *	a stream positioned at the first voxel (as left by
+ *	read_imgheader_fmt)
+ *
+ * 	Arguments:	file pointer (opened with "rb")
+ * 				unsigned char pointer to xsize*ysize*zsize bytes
+ * 				int xsize, ysize, zsize
+ * 				int format (IMG_UINT8 or IMG_UINT8Z)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int read_binvoxels(FILE *fpin, unsigned char *vox, int xsize, int ysize,
+                   int zsize, int format) {
+  int ix;
+  size_t plane;
+
+  if (!fpin || (format != IMG_UINT8 && format != IMG_UINT8Z))
+    return (1);
+
+  plane = (size_t)ysize * (size_t)zsize;
+  if (format == IMG_UINT8)
+    return (read_binplane(fpin, vox, (size_t)xsize * plane, format));
+
+  for (ix = 0; ix < xsize; ix++) {
+    if (read_binplane(fpin, vox + (size_t)ix * plane, plane, format))
+      return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function read_binslab reads a few consecutive planes of a binary
+ *	image normal to one axis, from a stream positioned at the first
+ *	voxel, without reading the rest of the image into memory.  The
+ *	planes run from first, wrapping around the image periodically,
+ *	and come back as a box in C order whose extent along the axis
+ *	is nplanes.
+ *
+ *	Raw x planes are found with fseek, and rows normal to y are
+ *	read one at a time.  Compressed planes that are not needed are
+ *	skipped by their length, but every plane has to be uncompressed
+ *	for a slab normal to y or z, as does every raw plane for a slab
+ *	normal to z, whose voxels are scattered through each plane.
+ *
+ * 	Arguments:	file pointer (opened with "rb")
+ * 				unsigned char pointer to the slab, with room
+ * 				for nplanes planes of 1 byte (uint8) or 4 bytes
+ * 				(uint32) per voxel
+ * 				int xsize, ysize, zsize
+ * 				int format (IMG_UINT8, IMG_UINT8Z, IMG_UINT32 or
+ * 				IMG_UINT32Z)
+ * 				int axis (0 for x, 1 for y, 2 for z)
+ * 				int first plane
+ * 				int nplanes (1 up to the size along the axis)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int read_binslab(FILE *fpin, unsigned char *slab, int xsize, int ysize,
+                 int zsize, int format, int axis, int first, int nplanes) {
+  int ix, iy, d, n, size, status;
+  size_t bpv, row, plane, clen, srow;
+  long base, pos;
+  unsigned char *buf, lenbytes[4];
+
+  if (!fpin || !slab || !binformat_name(format))
+    return (1);
+  size = (axis == 0) ? xsize : ((axis == 1) ? ysize : zsize);
+  if (axis < 0 || axis > 2 || first < 0 || first >= size || nplanes < 1 ||
+      nplanes > size)
+    return (1);
+
+  bpv = (format == IMG_UINT32 || format == IMG_UINT32Z) ? 4 : 1;
+  row = (size_t)zsize * bpv;
+  plane = (size_t)ysize * row;
+  base = ftell(fpin);
+  if (base < 0)
+    return (1);
+
+  /* Raw planes and rows can be read where they lie */
+
+  if (format == IMG_UINT8 || format == IMG_UINT32) {
+    if (axis == 0) {
+      for (d = 0; d < nplanes; d++) {
+        ix = (first + d) % xsize;
+        pos = base + (long)((size_t)ix * plane);
+        if (fseek(fpin, pos, SEEK_SET) ||
+            fread(slab + (size_t)d * plane, 1, plane, fpin) != plane)
+          return (1);
+      }
+      return (0);
+    }
+    if (axis == 1) {
+      for (ix = 0; ix < xsize; ix++) {
+        for (d = 0; d < nplanes; d++) {
+          iy = (first + d) % ysize;
+          pos = base + (long)((size_t)ix * plane + (size_t)iy * row);
+          if (fseek(fpin, pos, SEEK_SET) ||
+              fread(slab + ((size_t)ix * nplanes + d) * row, 1, row, fpin) !=
+                  row)
+            return (1);
+        }
+      }
+      return (0);
+    }
+  }
+
+  /***
+   *	Otherwise go through the x planes in order, one at
+   *	a time, copying what is needed from each
+   ***/
+
+  buf = (unsigned char *)malloc(plane);
+  if (!buf)
+    return (1);
+
+  srow = (size_t)nplanes * bpv;
+  status = 0;
+  for (ix = 0; ix < xsize && !status; ix++) {
+    d = (ix - first + xsize) % xsize;
+    if (axis == 0 && d >= nplanes) {
+
+      /* Skip this compressed plane */
+
+      if (fread(lenbytes, 1, 4, fpin) != 4) {
+        status = 1;
+        break;
+      }
+      clen = (size_t)lenbytes[0] | ((size_t)lenbytes[1] << 8) |
+             ((size_t)lenbytes[2] << 16) | ((size_t)lenbytes[3] << 24);
+      if (fseek(fpin, (long)clen, SEEK_CUR))
+        status = 1;
+      continue;
+    }
+    if (read_binplane(fpin, buf, plane, format)) {
+      status = 1;
+      break;
+    }
+    if (axis == 0) {
+      memcpy(slab + (size_t)d * plane, buf, plane);
+    } else if (axis == 1) {
+      for (d = 0; d < nplanes; d++) {
+        iy = (first + d) % ysize;
+        memcpy(slab + ((size_t)ix * nplanes + d) * row, buf + (size_t)iy * row,
+               row);
+      }
+    } else {
+      for (iy = 0; iy < ysize; iy++) {
+        for (d = 0; d < nplanes; d++) {
+          n = (first + d) % zsize;
+          memcpy(slab + ((size_t)ix * ysize + iy) * srow + (size_t)d * bpv,
+                 buf + (size_t)iy * row + (size_t)n * bpv, bpv);
+        }
+      }
+    }
+  }
+
+  free(buf);
+  return (status);
+}
+
+/******************************************************************************
+ *	Function map_binimg makes the voxels of a binary image available
+ *	in memory.  Raw images are memory mapped read-only where the
+ *	platform supports it; compressed images, and raw images on
+ *	other platforms, are read into an allocated buffer.  Release
+ *	with unmap_binimg.
+ *
+ * 	Arguments:	char pointer to file name
+ * 				Mappedimg pointer to fill
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise,
+ *				including when the image is ASCII)
+ ******************************************************************************/
+int map_binimg(char *name, Mappedimg *img) {
+  int format;
+  size_t n;
+  FILE *fpin;
+
+  img->base = NULL;
+  img->vox = NULL;
+  img->len = 0;
+  img->mapped = 0;
+
+  if ((fpin = fopen(name, "rb")) == NULL)
+    return (1);
+
+  if (read_imgheader_fmt(fpin, &(img->ver), &(img->xsize), &(img->ysize),
+                         &(img->zsize), &(img->res), &format) ||
+      (format != IMG_UINT8 && format != IMG_UINT8Z)) {
+    fclose(fpin);
+    return (1);
+  }
+
+  n = (size_t)img->xsize * (size_t)img->ysize * (size_t)img->zsize;
+
+#if !defined(_WIN32)
+  if (format == IMG_UINT8) {
+    struct stat sb;
+    void *p;
+
+    if (fstat(fileno(fpin), &sb) == 0 &&
+        (size_t)sb.st_size >= BINIMGHEADERSIZE + n) {
+      p = mmap(NULL, BINIMGHEADERSIZE + n, PROT_READ, MAP_PRIVATE,
+               fileno(fpin), 0);
+      if (p != MAP_FAILED) {
+        fclose(fpin);
+        img->base = p;
+        img->len = BINIMGHEADERSIZE + n;
+        img->mapped = 1;
+        img->vox = (unsigned char *)p + BINIMGHEADERSIZE;
+        return (0);
+      }
+    }
+  }
+#endif
+
+  img->base = malloc(n);
+  if (!img->base) {
+    fclose(fpin);
+    return (1);
+  }
+  if (read_binvoxels(fpin, (unsigned char *)img->base, img->xsize,
+                     img->ysize, img->zsize, format)) {
+    free(img->base);
+    img->base = NULL;
+    fclose(fpin);
+    return (1);
+  }
+  fclose(fpin);
+  img->len = n;
+  img->vox = (unsigned char *)img->base;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function create_binimg makes a raw binary image file of the given
+ *	size and maps its voxels writable, so that they can be filled in
+ *	any order and reach the file as they are written.  The voxels
+ *	start as zeros.  Release with unmap_binimg.  There is no mapping
+ *	on Windows.
+ *
+ * 	Arguments:	char pointer to file name
+ * 				int x, y, z size of image
+ * 				float resolution
+ * 				Mappedimg pointer to fill
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int create_binimg(char *name, int xsize, int ysize, int zsize, float res,
+                  Mappedimg *img) {
+  img->base = NULL;
+  img->vox = NULL;
+  img->len = 0;
+  img->mapped = 0;
+
+#if !defined(_WIN32)
+  size_t n;
+  void *p;
+  FILE *fpout;
+
+  if ((fpout = fopen(name, "w+b")) == NULL)
+    return (1);
+
+  n = (size_t)xsize * (size_t)ysize * (size_t)zsize;
+  if (write_binheader(fpout, xsize, ysize, zsize, res, IMG_UINT8) ||
+      fflush(fpout) ||
+      ftruncate(fileno(fpout), (off_t)(BINIMGHEADERSIZE + n))) {
+    fclose(fpout);
+    return (1);
+  }
+
+  p = mmap(NULL, BINIMGHEADERSIZE + n, PROT_READ | PROT_WRITE, MAP_SHARED,
+           fileno(fpout), 0);
+  fclose(fpout);
+  if (p == MAP_FAILED)
+    return (1);
+
+  img->base = p;
+  img->len = BINIMGHEADERSIZE + n;
+  img->mapped = 1;
+  img->vox = (unsigned char *)p + BINIMGHEADERSIZE;
+  img->ver = atof(VERSIONNUMBER);
+  img->xsize = xsize;
+  img->ysize = ysize;
+  img->zsize = zsize;
+  img->res = res;
+
+  return (0);
+#else
+  (void)name;
+  (void)xsize;
+  (void)ysize;
+  (void)zsize;
+  (void)res;
+  return (1);
+#endif
+}
+
+/******************************************************************************
+ *	Function unmap_binimg releases an image obtained from map_binimg
+ *
+ * 	Arguments:	Mappedimg pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void unmap_binimg(Mappedimg *img) {
+  if (!img->base)
+    return;
+
+#if !defined(_WIN32)
+  if (img->mapped) {
+    munmap(img->base, img->len);
+  } else {
+    free(img->base);
+  }
+#else
+  free(img->base);
+#endif
+
+  img->base = NULL;
+  img->vox = NULL;
+  img->len = 0;
+  img->mapped = 0;
+
+  return;
+}
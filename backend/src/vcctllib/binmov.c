@@ -0,0 +1,708 @@
+/******************************************************************************
+ *	Collection of functions to write and read binary hydration
+ *	movies.
+ *
+ *	A movie starts with the usual text header written by
+ *	write_imgheader, with a Z_Size of 1 and an Image_Format line
+ *	of movie-zlib, padded with blanks to BINIMGHEADERSIZE bytes.
+ *	An index block of MOVINDEXLEN 8-byte little-endian offsets
+ *	follows.  All but the last entry give, in order, where each
+ *	frame starts (0 for an unused entry); the last gives where the
+ *	next index block starts, or 0 if there is none yet.  New
+ *	index blocks are appended when the current one is full.
+ *
+ *	Each frame is an xsize by ysize slice of phase ids, x varying
+ *	fastest, compressed with zlib and preceded by its compressed
+ *	length as a 4-byte little-endian integer.  Phase ids are
+ *	stored as they are in the microstructure, so readers still
+ *	apply convert_id with the version from the header.
+ *
+ *	A movie can be cut back to its length at any time between
+ *	frames (disrealnew does this on restart from a checkpoint).
+ *	movie_open drops index entries that point past the end of the
+ *	file, and clears them if the movie is opened for writing.
+ *
+ *	A series of whole microstructure images is kept in the same
+ *	container, with an Image_Format of series-zlib and the full
+ *	Z_Size.  Each of its frames, once uncompressed, is one byte
+ *	giving the kind of frame (SERIESKEY or SERIESDELTA), the time
+ *	as a 4-byte little-endian float, and then either all of the
+ *	voxels in C order or, for each voxel that changed since the
+ *	image before, the number of unchanged voxels skipped since the
+ *	last change (a little-endian base-128 varint) and the new
+ *	phase id.  Image 0 and every keyevery-th image after it are
+ *	keyframes, as is any image whose changes would take more than
+ *	half as many bytes as the image itself, so reading any image
+ *	takes one keyframe and at most keyevery - 1 sets of changes.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define MOVENTRY 8 /* bytes per index entry */
+
+#define SERIESKEY 0   /* series frame holding the whole image */
+#define SERIESDELTA 1 /* series frame holding the changed voxels */
+#define SERIESHEAD 5  /* bytes of kind and time before the voxels */
+
+/******************************************************************************
+ *	Function movie_put writes an index entry at a given position
+ *
+ * 	Arguments:	Movie pointer
+ * 				long position of the entry
+ * 				long value to write
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int movie_put(Movie *mv, long pos, long val) {
+  int i;
+  unsigned char b[MOVENTRY];
+
+  for (i = 0; i < MOVENTRY; i++) {
+    b[i] = (unsigned char)(((unsigned long long)val >> (8 * i)) & 0xff);
+  }
+  if (fseek(mv->fp, pos, SEEK_SET) ||
+      fwrite(b, 1, MOVENTRY, mv->fp) != MOVENTRY)
+    return (1);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function movie_addoffset records the offset of a frame in
+ *	memory, growing the offset list as needed
+ *
+ * 	Arguments:	Movie pointer
+ * 				long offset of the frame
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int movie_addoffset(Movie *mv, long off) {
+  int newcap;
+  long *newp;
+
+  if (mv->nframes >= mv->cap) {
+    newcap = (mv->cap > 0) ? 2 * mv->cap : MOVINDEXLEN;
+    newp = (long *)realloc(mv->offset, (size_t)newcap * sizeof(long));
+    if (!newp)
+      return (1);
+    mv->offset = newp;
+    mv->cap = newcap;
+  }
+  mv->offset[mv->nframes++] = off;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function movie_newblock appends an empty index block to the
+ *	file
+ *
+ * 	Arguments:	Movie pointer
+ *
+ *	Returns:	long position of the block, or -1 on error
+ ******************************************************************************/
+static long movie_newblock(Movie *mv) {
+  long pos;
+  unsigned char zero[MOVINDEXLEN * MOVENTRY];
+
+  memset(zero, 0, sizeof(zero));
+  if (fseek(mv->fp, 0L, SEEK_END) || (pos = ftell(mv->fp)) < 0)
+    return (-1);
+  if (fwrite(zero, 1, sizeof(zero), mv->fp) != sizeof(zero))
+    return (-1);
+
+  return (pos);
+}
+
+/******************************************************************************
+ *	Function movie_init creates a new, empty container with the
+ *	given sizes and Image_Format word and leaves it open for
+ *	writing
+ *
+ * 	Arguments:	char pointer to file name
+ * 				Movie pointer to fill
+ * 				int xsize, ysize, zsize for the header
+ * 				float resolution
+ * 				char pointer to the Image_Format word
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int movie_init(char *name, Movie *mv, int xsize, int ysize, int zsize,
+                      float res, const char *format) {
+  long pos;
+
+  memset(mv, 0, sizeof(Movie));
+  if ((mv->fp = fopen(name, "w+b")) == NULL)
+    return (1);
+
+  mv->writable = 1;
+  mv->ver = atof(VERSIONNUMBER);
+  mv->xsize = xsize;
+  mv->ysize = ysize;
+  mv->res = res;
+
+  if (write_imgheader(mv->fp, xsize, ysize, zsize, res)) {
+    movie_close(mv);
+    return (1);
+  }
+  fprintf(mv->fp, "\n%s %s", IMGFORMATSTRING, format);
+
+  pos = ftell(mv->fp);
+  if (pos < 0 || pos >= BINIMGHEADERSIZE) {
+    movie_close(mv);
+    return (1);
+  }
+  for (; pos < BINIMGHEADERSIZE - 1; pos++)
+    fputc(' ', mv->fp);
+  fputc('\n', mv->fp);
+
+  mv->lastblock = movie_newblock(mv);
+  if (mv->lastblock != BINIMGHEADERSIZE || fflush(mv->fp)) {
+    movie_close(mv);
+    return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function movie_create creates a new, empty movie and leaves it
+ *	open for movie_append
+ *
+ * 	Arguments:	char pointer to file name
+ * 				Movie pointer to fill
+ * 				int xsize, ysize of each frame
+ * 				float resolution
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int movie_create(char *name, Movie *mv, int xsize, int ysize, float res) {
+  return (movie_init(name, mv, xsize, ysize, 1, res, IMGFORMATMOVIEZ));
+}
+
+/******************************************************************************
+ *	Function movie_openfmt opens an existing container of a given
+ *	format and reads its index
+ *
+ * 	Arguments:	char pointer to file name
+ * 				Movie pointer to fill
+ * 				int writable (1 to append, 0 to read only)
+ * 				int format expected (IMG_MOVIEZ or IMG_SERIESZ)
+ * 				int pointer to the Z_Size of the header
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise,
+ *				including when the file has another format)
+ ******************************************************************************/
+static int movie_openfmt(char *name, Movie *mv, int writable, int want,
+                         int *zsize) {
+  int i, j, format;
+  long fsize, block, off, next;
+  size_t clen;
+  unsigned char b[MOVINDEXLEN * MOVENTRY], lenbytes[4];
+
+  memset(mv, 0, sizeof(Movie));
+  if ((mv->fp = fopen(name, writable ? "r+b" : "rb")) == NULL)
+    return (1);
+  mv->writable = writable;
+
+  if (read_imgheader_fmt(mv->fp, &(mv->ver), &(mv->xsize), &(mv->ysize),
+                         zsize, &(mv->res), &format) ||
+      format != want || fseek(mv->fp, 0L, SEEK_END) ||
+      (fsize = ftell(mv->fp)) < BINIMGHEADERSIZE + (long)sizeof(b)) {
+    movie_close(mv);
+    return (1);
+  }
+
+  block = BINIMGHEADERSIZE;
+  for (;;) {
+    if (fseek(mv->fp, block, SEEK_SET) ||
+        fread(b, 1, sizeof(b), mv->fp) != sizeof(b)) {
+      movie_close(mv);
+      return (1);
+    }
+    mv->lastblock = block;
+
+    /* Offsets of the frames that are wholly in the file */
+
+    for (i = 0; i < MOVINDEXLEN - 1; i++) {
+      off = 0;
+      for (j = MOVENTRY - 1; j >= 0; j--) {
+        off = (off << 8) | (long)b[i * MOVENTRY + j];
+      }
+      if (off <= 0 || off > fsize - 4 || fseek(mv->fp, off, SEEK_SET) ||
+          fread(lenbytes, 1, 4, mv->fp) != 4)
+        break;
+      clen = (size_t)lenbytes[0] | ((size_t)lenbytes[1] << 8) |
+             ((size_t)lenbytes[2] << 16) | ((size_t)lenbytes[3] << 24);
+      if ((size_t)(fsize - off - 4) < clen)
+        break;
+      if (movie_addoffset(mv, off)) {
+        movie_close(mv);
+        return (1);
+      }
+    }
+    mv->lastused = i;
+
+    next = 0;
+    for (j = MOVENTRY - 1; j >= 0; j--) {
+      next = (next << 8) | (long)b[(MOVINDEXLEN - 1) * MOVENTRY + j];
+    }
+
+    if (i < MOVINDEXLEN - 1 || next <= block ||
+        next > fsize - (long)sizeof(b)) {
+
+      /* End of the index; clear anything the file was cut back past */
+
+      if (writable) {
+        for (j = i; j < MOVINDEXLEN; j++) {
+          if (movie_put(mv, block + (long)j * MOVENTRY, 0L)) {
+            movie_close(mv);
+            return (1);
+          }
+        }
+        fflush(mv->fp);
+      }
+      break;
+    }
+    block = next;
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function movie_open opens an existing movie and reads its frame
+ *	index.  A movie opened for writing can be added to with
+ *	movie_append.
+ *
+ * 	Arguments:	char pointer to file name
+ * 				Movie pointer to fill
+ * 				int writable (1 to append frames, 0 to read only)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise,
+ *				including when the file is not a binary movie)
+ ******************************************************************************/
+int movie_open(char *name, Movie *mv, int writable) {
+  int zsize;
+
+  if (movie_openfmt(name, mv, writable, IMG_MOVIEZ, &zsize))
+    return (1);
+  if (zsize != 1) {
+    movie_close(mv);
+    return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function movie_putrec compresses a record, adds it to the end
+ *	of the container and records it in the index.  The file is
+ *	flushed, so its length always ends at a whole record.
+ *
+ * 	Arguments:	Movie pointer open for writing
+ * 				unsigned char pointer to the record
+ * 				size_t length of the record in bytes
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int movie_putrec(Movie *mv, unsigned char *rec, size_t n) {
+  long off, block;
+  size_t bound;
+  uLongf clen;
+  unsigned char lenbytes[4];
+  void *newp;
+
+  if (!mv->fp || !mv->writable)
+    return (1);
+
+  if (mv->lastused >= MOVINDEXLEN - 1) {
+    block = movie_newblock(mv);
+    if (block < 0 ||
+        movie_put(mv, mv->lastblock + (long)(MOVINDEXLEN - 1) * MOVENTRY,
+                  block))
+      return (1);
+    mv->lastblock = block;
+    mv->lastused = 0;
+  }
+
+  bound = (size_t)compressBound((uLong)n);
+  if (mv->ccap < bound) {
+    newp = realloc(mv->cbuf, bound);
+    if (!newp)
+      return (1);
+    mv->cbuf = (unsigned char *)newp;
+    mv->ccap = bound;
+  }
+
+  clen = (uLongf)bound;
+  if (compress2(mv->cbuf, &clen, rec, (uLong)n, Z_DEFAULT_COMPRESSION) !=
+      Z_OK)
+    return (1);
+  lenbytes[0] = (unsigned char)(clen & 0xff);
+  lenbytes[1] = (unsigned char)((clen >> 8) & 0xff);
+  lenbytes[2] = (unsigned char)((clen >> 16) & 0xff);
+  lenbytes[3] = (unsigned char)((clen >> 24) & 0xff);
+
+  if (fseek(mv->fp, 0L, SEEK_END) || (off = ftell(mv->fp)) < 0)
+    return (1);
+  if (fwrite(lenbytes, 1, 4, mv->fp) != 4 ||
+      fwrite(mv->cbuf, 1, (size_t)clen, mv->fp) != (size_t)clen)
+    return (1);
+
+  if (movie_put(mv, mv->lastblock + (long)mv->lastused * MOVENTRY, off) ||
+      movie_addoffset(mv, off) || fflush(mv->fp))
+    return (1);
+  mv->lastused++;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function movie_append compresses a frame, adds it to the end of
+ *	the movie and records it in the index.  The file is flushed, so
+ *	its length always ends at a whole frame.
+ *
+ * 	Arguments:	Movie pointer (from movie_create, or movie_open
+ * 					for writing)
+ * 				unsigned char pointer to xsize*ysize phase ids
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int movie_append(Movie *mv, unsigned char *frame) {
+  return (movie_putrec(mv, frame, (size_t)mv->xsize * (size_t)mv->ysize));
+}
+
+/******************************************************************************
+ *	Function movie_getrec reads and uncompresses any one record
+ *
+ * 	Arguments:	Movie pointer
+ * 				int record number (0 to nframes - 1)
+ * 				unsigned char pointer to the record buffer
+ * 				size_t size of the buffer
+ * 				size_t pointer to the length of the record
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int movie_getrec(Movie *mv, int k, unsigned char *rec, size_t cap,
+                        size_t *n) {
+  size_t clen;
+  uLongf dlen;
+  unsigned char lenbytes[4];
+  void *newp;
+
+  if (!mv->fp || k < 0 || k >= mv->nframes)
+    return (1);
+
+  if (fseek(mv->fp, mv->offset[k], SEEK_SET) ||
+      fread(lenbytes, 1, 4, mv->fp) != 4)
+    return (1);
+  clen = (size_t)lenbytes[0] | ((size_t)lenbytes[1] << 8) |
+         ((size_t)lenbytes[2] << 16) | ((size_t)lenbytes[3] << 24);
+
+  if (clen > (size_t)compressBound((uLong)cap))
+    return (1);
+  if (mv->ccap < clen) {
+    newp = realloc(mv->cbuf, clen);
+    if (!newp)
+      return (1);
+    mv->cbuf = (unsigned char *)newp;
+    mv->ccap = clen;
+  }
+  if (fread(mv->cbuf, 1, clen, mv->fp) != clen)
+    return (1);
+
+  dlen = (uLongf)cap;
+  if (uncompress(rec, &dlen, mv->cbuf, (uLong)clen) != Z_OK)
+    return (1);
+  *n = (size_t)dlen;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function movie_frame reads any one frame of a movie
+ *
+ * 	Arguments:	Movie pointer
+ * 				int frame number (0 to nframes - 1)
+ * 				unsigned char pointer to xsize*ysize bytes
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int movie_frame(Movie *mv, int k, unsigned char *frame) {
+  size_t n, len;
+
+  n = (size_t)mv->xsize * (size_t)mv->ysize;
+  if (movie_getrec(mv, k, frame, n, &len) || len != n)
+    return (1);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function movie_close closes a movie and frees its index and
+ *	buffers
+ *
+ * 	Arguments:	Movie pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void movie_close(Movie *mv) {
+  if (mv->fp)
+    fclose(mv->fp);
+  if (mv->offset)
+    free(mv->offset);
+  if (mv->cbuf)
+    free(mv->cbuf);
+  memset(mv, 0, sizeof(Movie));
+
+  return;
+}
+
+/******************************************************************************
+ *	Function series_alloc sets aside the image and record buffers
+ *	of a series whose sizes are known
+ *
+ * 	Arguments:	Series pointer
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int series_alloc(Series *sr) {
+  size_t nvox;
+
+  nvox = (size_t)sr->mv.xsize * (size_t)sr->mv.ysize * (size_t)sr->zsize;
+  sr->vox = (unsigned char *)malloc(nvox);
+  sr->rec = (unsigned char *)malloc(nvox + SERIESHEAD);
+  sr->cur = -1;
+
+  return ((sr->vox && sr->rec) ? 0 : 1);
+}
+
+/******************************************************************************
+ *	Function series_create creates a new, empty series and leaves
+ *	it open for series_append
+ *
+ * 	Arguments:	char pointer to file name
+ * 				Series pointer to fill
+ * 				int xsize, ysize, zsize of each image
+ * 				float resolution
+ * 				int images from one keyframe to the next
+ * 					(SERIESKEYEVERY if 0)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int series_create(char *name, Series *sr, int xsize, int ysize, int zsize,
+                  float res, int keyevery) {
+  memset(sr, 0, sizeof(Series));
+  if (movie_init(name, &(sr->mv), xsize, ysize, zsize, res,
+                 IMGFORMATSERIESZ))
+    return (1);
+  sr->zsize = zsize;
+  sr->keyevery = (keyevery > 0) ? keyevery : SERIESKEYEVERY;
+  if (series_alloc(sr)) {
+    series_close(sr);
+    return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function series_open opens an existing series and reads its
+ *	index.  A series opened for writing can be added to with
+ *	series_append, and keyframes go on every SERIESKEYEVERY
+ *	images.
+ *
+ * 	Arguments:	char pointer to file name
+ * 				Series pointer to fill
+ * 				int writable (1 to append images, 0 to read only)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise,
+ *				including when the file is not a series)
+ ******************************************************************************/
+int series_open(char *name, Series *sr, int writable) {
+  memset(sr, 0, sizeof(Series));
+  if (movie_openfmt(name, &(sr->mv), writable, IMG_SERIESZ, &(sr->zsize)))
+    return (1);
+  sr->keyevery = SERIESKEYEVERY;
+  if (sr->zsize < 1 || series_alloc(sr)) {
+    series_close(sr);
+    return (1);
+  }
+
+  /* The changes in the next image are from the last one */
+
+  if (writable && sr->mv.nframes > 0 &&
+      series_frame(sr, sr->mv.nframes - 1, NULL, NULL)) {
+    series_close(sr);
+    return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function series_append adds an image to the end of a series,
+ *	as a keyframe or as the voxels that changed since the image
+ *	before
+ *
+ * 	Arguments:	Series pointer (from series_create, or series_open
+ * 					for writing)
+ * 				unsigned char pointer to the phase ids, C order
+ * 				float time of the image
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int series_append(Series *sr, unsigned char *vox, float time) {
+  int i, k;
+  size_t n, nvox, len, last, gap;
+  uint32_t bits;
+
+  if (!sr->mv.fp || !sr->mv.writable)
+    return (1);
+
+  nvox = (size_t)sr->mv.xsize * (size_t)sr->mv.ysize * (size_t)sr->zsize;
+  k = sr->mv.nframes;
+  memcpy(&bits, &time, 4);
+  for (i = 0; i < 4; i++) {
+    sr->rec[1 + i] = (unsigned char)((bits >> (8 * i)) & 0xff);
+  }
+
+  len = 0;
+  if (k % sr->keyevery != 0 && sr->cur == k - 1) {
+    len = SERIESHEAD;
+    last = 0;
+    for (n = 0; n < nvox && len <= nvox / 2; n++) {
+      if (vox[n] == sr->vox[n])
+        continue;
+      for (gap = n - last; gap >= 0x80; gap >>= 7) {
+        sr->rec[len++] = (unsigned char)((gap & 0x7f) | 0x80);
+      }
+      sr->rec[len++] = (unsigned char)gap;
+      sr->rec[len++] = vox[n];
+      last = n + 1;
+    }
+    if (n < nvox || len > nvox / 2)
+      len = 0;
+  }
+
+  if (len > 0) {
+    sr->rec[0] = SERIESDELTA;
+  } else {
+    sr->rec[0] = SERIESKEY;
+    memcpy(sr->rec + SERIESHEAD, vox, nvox);
+    len = SERIESHEAD + nvox;
+  }
+  if (movie_putrec(&(sr->mv), sr->rec, len))
+    return (1);
+
+  memcpy(sr->vox, vox, nvox);
+  sr->cur = k;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function series_frame reads any one image of a series, from the
+ *	keyframe at or before it and the changes after that.  Reading
+ *	the images in order only applies the changes of each one.
+ *
+ * 	Arguments:	Series pointer
+ * 				int image number (0 to mv.nframes - 1)
+ * 				unsigned char pointer to xsize*ysize*zsize
+ * 					bytes for the image, or NULL to
+ * 					leave it in sr->vox only
+ * 				float pointer to the time of the image, or NULL
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int series_frame(Series *sr, int k, unsigned char *vox, float *time) {
+  int i, j, shift;
+  size_t n, nvox, len, pos;
+  uint32_t bits;
+
+  if (!sr->mv.fp || k < 0 || k >= sr->mv.nframes)
+    return (1);
+  nvox = (size_t)sr->mv.xsize * (size_t)sr->mv.ysize * (size_t)sr->zsize;
+
+  /* Back to the keyframe, or to the image already held if that is later */
+
+  for (j = k; j != sr->cur; j--) {
+    if (movie_getrec(&(sr->mv), j, sr->rec, nvox + SERIESHEAD, &len) ||
+        len < SERIESHEAD)
+      return (1);
+    if (sr->rec[0] == SERIESKEY) {
+      if (len != SERIESHEAD + nvox)
+        return (1);
+      memcpy(sr->vox, sr->rec + SERIESHEAD, nvox);
+      sr->cur = j;
+      break;
+    }
+    if (j == 0)
+      return (1);
+  }
+
+  /* Then forward through the changes */
+
+  for (j = sr->cur + 1; j <= k; j++) {
+    if (movie_getrec(&(sr->mv), j, sr->rec, nvox + SERIESHEAD, &len) ||
+        len < SERIESHEAD)
+      return (1);
+    if (sr->rec[0] == SERIESKEY) {
+      if (len != SERIESHEAD + nvox)
+        return (1);
+      memcpy(sr->vox, sr->rec + SERIESHEAD, nvox);
+    } else {
+      n = 0;
+      pos = SERIESHEAD;
+      while (pos < len) {
+        for (shift = 0; pos < len && (sr->rec[pos] & 0x80); shift += 7) {
+          n += (size_t)(sr->rec[pos++] & 0x7f) << shift;
+        }
+        if (pos + 1 >= len)
+          return (1);
+        n += (size_t)sr->rec[pos++] << shift;
+        if (n >= nvox)
+          return (1);
+        sr->vox[n++] = sr->rec[pos++];
+      }
+    }
+    sr->cur = j;
+  }
+
+  if (time) {
+    if (movie_getrec(&(sr->mv), k, sr->rec, nvox + SERIESHEAD, &len) ||
+        len < SERIESHEAD)
+      return (1);
+    bits = 0;
+    for (i = 3; i >= 0; i--) {
+      bits = (bits << 8) | sr->rec[1 + i];
+    }
+    memcpy(time, &bits, 4);
+  }
+  if (vox)
+    memcpy(vox, sr->vox, nvox);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function series_close closes a series and frees its buffers
+ *
+ * 	Arguments:	Series pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void series_close(Series *sr) {
+  movie_close(&(sr->mv));
+  if (sr->vox)
+    free(sr->vox);
+  if (sr->rec)
+    free(sr->rec);
+  memset(sr, 0, sizeof(Series));
+
+  return;
+}
@@ -0,0 +1,185 @@
+/******************************************************************************
+ *	Summed-volume table of a periodic microstructure, for counting
+ *	the marked pixels (usually pores) in a box with a few lookups
+ *	instead of a loop over every pixel of the box.
+ *
+ *	The caller allocates a table with boxtable_alloc, sets
+ *	BOXCELL(bt,x,y,z) to 1 for every marked pixel, and calls
+ *	boxtable_build once.  From then on boxtable_count gives the
+ *	same answer as a loop over the box with checkbc, as long as
+ *	nothing is marked or unmarked in the image; the table has to
+ *	be rebuilt after the image changes.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/******************************************************************************
+ *	Function boxtable_alloc allocates a table for an image of
+ *	xsize*ysize*zsize pixels, with no pixels marked
+ *
+ * 	Arguments:	Boxtable pointer to fill
+ * 				int xsize, ysize, zsize
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int boxtable_alloc(Boxtable *bt, int xsize, int ysize, int zsize) {
+  size_t n;
+
+  n = (size_t)(xsize + 1) * (size_t)(ysize + 1) * (size_t)(zsize + 1);
+  bt->xsize = xsize;
+  bt->ysize = ysize;
+  bt->zsize = zsize;
+  bt->sum = (int *)calloc(n, sizeof(int));
+
+  return ((bt->sum) ? 0 : 1);
+}
+
+/******************************************************************************
+ *	Function boxtable_build turns the marks set with BOXCELL into
+ *	the summed-volume table, with one running sum along each axis
+ *
+ * 	Arguments:	Boxtable pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void boxtable_build(Boxtable *bt) {
+  int i, j, k;
+  size_t nz, nyz, row;
+  int *s = bt->sum;
+
+  nz = (size_t)(bt->zsize + 1);
+  nyz = (size_t)(bt->ysize + 1) * nz;
+
+  for (i = 1; i <= bt->xsize; i++) {
+    for (j = 1; j <= bt->ysize; j++) {
+      row = (size_t)i * nyz + (size_t)j * nz;
+      for (k = 1; k <= bt->zsize; k++) {
+        s[row + k] += s[row + k - 1];
+      }
+    }
+  }
+
+  for (i = 1; i <= bt->xsize; i++) {
+    for (j = 1; j <= bt->ysize; j++) {
+      row = (size_t)i * nyz + (size_t)j * nz;
+      for (k = 1; k <= bt->zsize; k++) {
+        s[row + k] += s[row - nz + k];
+      }
+    }
+  }
+
+  for (i = 1; i <= bt->xsize; i++) {
+    for (j = 1; j <= bt->ysize; j++) {
+      row = (size_t)i * nyz + (size_t)j * nz;
+      for (k = 1; k <= bt->zsize; k++) {
+        s[row + k] += s[row - nyz + k];
+      }
+    }
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function boxsegments splits the periodic interval lo..hi
+ *	(inclusive) of an axis with n pixels into at most three
+ *	half-open pieces a..b of 0..n, each counted w times
+ *
+ * 	Arguments:	int lo, hi, n
+ * 				int arrays a, b, w of at least three elements
+ *
+ *	Returns:	int number of pieces
+ ******************************************************************************/
+static int boxsegments(int lo, int hi, int n, int *a, int *b, int *w) {
+  int len, start, nseg = 0;
+
+  len = hi - lo + 1;
+  start = ((lo % n) + n) % n;
+
+  if (len / n > 0) {
+    a[nseg] = 0;
+    b[nseg] = n;
+    w[nseg++] = len / n;
+  }
+
+  len %= n;
+  if (len > 0) {
+    if (start + len <= n) {
+      a[nseg] = start;
+      b[nseg] = start + len;
+      w[nseg++] = 1;
+    } else {
+      a[nseg] = start;
+      b[nseg] = n;
+      w[nseg++] = 1;
+      a[nseg] = 0;
+      b[nseg] = start + len - n;
+      w[nseg++] = 1;
+    }
+  }
+
+  return (nseg);
+}
+
+/******************************************************************************
+ *	Function boxtable_count counts the marked pixels within a cube
+ *	of size boxsize centered at (qx,qy,qz), using periodic
+ *	boundaries.  A box that wraps around a face is split into the
+ *	pieces on either side, so most queries need eight lookups and
+ *	none needs more than 216.
+ *
+ * 	Arguments:	Boxtable pointer (after boxtable_build)
+ * 				int boxsize
+ * 				int x,y, and z coordinates of box center
+ *
+ *	Returns:	int number of marked pixels found within box
+ ******************************************************************************/
+int boxtable_count(Boxtable *bt, int boxsize, int qx, int qy, int qz) {
+  int boxhalf, nx, ny, nz, ix, iy, iz, nfound;
+  int ax[3], bx[3], wx[3], ay[3], by[3], wy[3], az[3], bz[3], wz[3];
+  size_t sz, syz, x0, x1, y0, y1;
+  int *s = bt->sum;
+
+  boxhalf = boxsize / 2;
+  nx = boxsegments(qx - boxhalf, qx + boxhalf, bt->xsize, ax, bx, wx);
+  ny = boxsegments(qy - boxhalf, qy + boxhalf, bt->ysize, ay, by, wy);
+  nz = boxsegments(qz - boxhalf, qz + boxhalf, bt->zsize, az, bz, wz);
+
+  sz = (size_t)(bt->zsize + 1);
+  syz = (size_t)(bt->ysize + 1) * sz;
+  nfound = 0;
+
+  for (ix = 0; ix < nx; ix++) {
+    x0 = (size_t)ax[ix] * syz;
+    x1 = (size_t)bx[ix] * syz;
+    for (iy = 0; iy < ny; iy++) {
+      y0 = (size_t)ay[iy] * sz;
+      y1 = (size_t)by[iy] * sz;
+      for (iz = 0; iz < nz; iz++) {
+        nfound += wx[ix] * wy[iy] * wz[iz] *
+                  (s[x1 + y1 + bz[iz]] - s[x1 + y1 + az[iz]] -
+                   s[x1 + y0 + bz[iz]] + s[x1 + y0 + az[iz]] -
+                   s[x0 + y1 + bz[iz]] + s[x0 + y1 + az[iz]] +
+                   s[x0 + y0 + bz[iz]] - s[x0 + y0 + az[iz]]);
+      }
+    }
+  }
+
+  return (nfound);
+}
+
+/******************************************************************************
+ *	Function boxtable_free releases a table made by boxtable_alloc
+ *
+ * 	Arguments:	Boxtable pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void boxtable_free(Boxtable *bt) {
+  if (bt->sum)
+    free(bt->sum);
+  bt->sum = NULL;
+
+  return;
+}
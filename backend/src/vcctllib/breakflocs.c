@@ -1,6 +1,16 @@
 /******************************************************
  * breakflocs is a VCCTL function for eliminating contacts
  * between anhydrous particles in contact
+ *
+ * A pixel can only take part in a contact if, in the image as
+ * read, one of its 26 neighbors is anhydrous and in another
+ * particle, because the pass only ever takes pixels away.
+ * Those pixels are found first, in parallel over the planes of
+ * constant z, each pair of neighbors compared once from the
+ * pixel on its low side (the 13 neighbors of Flochalf).  The
+ * contacts are then broken as before, in raster order over the
+ * marked pixels only, so the result is the same as that of the
+ * pass over every pixel.
  *******************************************************/
 
 /***
@@ -15,25 +25,99 @@
  *				System size (ssize)
  *				VCCTL Version number (version)
  *				Resolution of microstructure (resol)
+ *				Number of threads (0 for the OpenMP default)
  *
  *	Returns:	Status flag (0 if okay, nonzero otherwise)
  *
- *	Calls:		checkbc
+ *	Calls:		checkbc, flocphase, flocmark
  *	Called by:	cpelas.c program
  ***/
 #include "../include/vcctl.h"
 #include <stdio.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* Neighbors on the high side of a pixel (dx, dy, dz) */
+
+static const int Flochalf[13][3] = {
+    {1, 0, 0},  {-1, 1, 0}, {0, 1, 0},  {1, 1, 0},  {-1, -1, 1},
+    {0, -1, 1}, {1, -1, 1}, {-1, 0, 1}, {0, 0, 1},  {1, 0, 1},
+    {-1, 1, 1}, {0, 1, 1},  {1, 1, 1}};
+
+/***
+ *	flocphase
+ *
+ *	Whether a phase is one of the anhydrous cement phases whose
+ *	particles are separated
+ *
+ *	Arguments:	int phase id
+ *	Returns:	1 if it is, 0 otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	breakflocs, flocmark
+ ***/
+static int flocphase(int ph) {
+  return (ph == C3S || ph == C2S || ph == C3A || ph == OC3A || ph == C4AF ||
+          ph == GYPSUM || ph == HEMIHYD || ph == ANHYDRITE || ph == CACO3 ||
+          ph == NA2SO4 || ph == K2SO4);
+}
+
+/***
+ *	flocmark
+ *
+ *	Mark both pixels of every pair of neighbors in one plane of
+ *	constant z and the plane above that are anhydrous and in
+ *	different particles.  Only planes k and k + 1 are written,
+ *	so planes two apart can be done at once.
+ *
+ *	Arguments:	Arrays of pix values (p) and particle ids (part)
+ *				Array of marks (mark)
+ *				int plane k, System size
+ *	Returns:	Nothing
+ *
+ *	Calls:		flocphase
+ *	Called by:	breakflocs
+ ***/
+static void flocmark(short int *p, short int *part, unsigned char *mark,
+                     int k, int xsize, int ysize, int zsize) {
+  int i, j, n, i1, j1, k1;
+  size_t nxy, m, mm;
+
+  nxy = (size_t)xsize * ysize;
+  for (j = 0; j < ysize; j++) {
+    for (i = 0; i < xsize; i++) {
+      m = k * nxy + (size_t)j * xsize + i;
+      if (!flocphase(p[m]))
+        continue;
+      for (n = 0; n < 13; n++) {
+        i1 = (i + Flochalf[n][0] + xsize) % xsize;
+        j1 = (j + Flochalf[n][1] + ysize) % ysize;
+        k1 = (k + Flochalf[n][2]) % zsize;
+        mm = k1 * nxy + (size_t)j1 * xsize + i1;
+        if (part[mm] != part[m] && flocphase(p[mm])) {
+          mark[m] = 1;
+          mark[mm] = 1;
+        }
+      }
+    }
+  }
+
+  return;
+}
 
 int breakflocs(FILE *pfile, short int *p, short int *part, short int *in,
                short int *jn, short int *kn, int xsize, int ysize, int zsize,
-               float version, float resol) {
+               float version, float resol, int nthreads) {
   int status = 0;
-  int nxy, i, j, k, ijk, n, inval, oinval, nsw, done;
+  int nxy, i, j, k, ijk, n, inval, oinval, nsw, done, nt, pass, kend;
+  int klo, khi;
   int i1, j1, k1, ipp, px, py, pz;
   int m, m1, m2, mm, npartmin, npartmax, taggednpartmax;
   float pres, pver;
   float tiny = 1.0e-4;
   char buff[MAXSTRING];
+  unsigned char *mark;
 
   /***
    *	Set up neighbor table for 3 x 3 x 3 box of neighbor pixels
@@ -136,10 +220,7 @@ int breakflocs(FILE *pfile, short int *p, short int *part, short int *in,
         m = m1 + m2 + i;
         oinval = part[m];
         inval = p[m];
-        if (inval == C3S || inval == C2S || inval == C3A || inval == OC3A ||
-            inval == C4AF || inval == GYPSUM || inval == HEMIHYD ||
-            inval == ANHYDRITE || inval == CACO3 || inval == NA2SO4 ||
-            inval == K2SO4) {
+        if (flocphase(inval)) {
 
           /***
            *  If cementitious, but not in part[m], then must
@@ -167,6 +248,31 @@ int breakflocs(FILE *pfile, short int *p, short int *part, short int *in,
   printf("\tMaximum particle label = %d\n", npartmax);
   fflush(stdout);
 
+  /***
+   *  Mark the pixels in contact with another particle, the even
+   *  planes, then the odd ones, then the last plane if the number
+   *  of planes is odd, since it writes the plane above it, plane 0
+   ***/
+
+  mark = (unsigned char *)calloc((size_t)nxy * zsize, 1);
+  if (mark) {
+    nt = 1;
+#ifdef _OPENMP
+    nt = (nthreads > 0) ? nthreads : omp_get_max_threads();
+#endif
+    kend = zsize - (zsize & 1);
+    for (pass = 0; pass < 3; pass++) {
+      klo = (pass < 2) ? pass : kend;
+      khi = (pass < 2) ? kend : zsize;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(static)
+#endif
+      for (k = klo; k < khi; k += 2) {
+        flocmark(p, part, mark, k, xsize, ysize, zsize);
+      }
+    }
+  }
+
   nsw = 0; /* Number of particles switched off */
   for (k = 0; k < zsize; k++) {
     m1 = k * nxy;
@@ -174,11 +280,10 @@ int breakflocs(FILE *pfile, short int *p, short int *part, short int *in,
       m2 = j * xsize;
       for (i = 0; i < xsize; i++) {
         m = m1 + m2 + i;
+        if (mark && !mark[m])
+          continue;
         inval = p[m];
-        if (inval == C3S || inval == C2S || inval == C3A || inval == OC3A ||
-            inval == C4AF || inval == GYPSUM || inval == HEMIHYD ||
-            inval == ANHYDRITE || inval == CACO3 || inval == NA2SO4 ||
-            inval == K2SO4) {
+        if (flocphase(inval)) {
 
           done = 0;
           for (ijk = 0; ijk < 27 && !done; ijk++) {
@@ -193,10 +298,7 @@ int breakflocs(FILE *pfile, short int *p, short int *part, short int *in,
 
             ipp = p[mm];
 
-            if (ipp == C3S || ipp == C2S || ipp == C3A || ipp == OC3A ||
-                ipp == C4AF || ipp == GYPSUM || ipp == HEMIHYD ||
-                ipp == ANHYDRITE || ipp == CACO3 || ipp == NA2SO4 ||
-                ipp == K2SO4) {
+            if (flocphase(ipp)) {
 
               if (part[m] > part[mm]) {
                 p[m] = EMPTYP;
@@ -216,6 +318,8 @@ int breakflocs(FILE *pfile, short int *p, short int *part, short int *in,
     }
   }
 
+  free(mark);
+
   printf("\nTotal number switched = %d\n", nsw);
   fflush(stdout);
   return (status);
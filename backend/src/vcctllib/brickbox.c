@@ -0,0 +1,252 @@
+/******************************************************************************
+ *	Collection of functions to keep a box of ints as bricks of
+ *	BRICKSIDE voxels on a side (see Brickbox in vcctl.h), for images
+ *	that are mostly large uniform regions, such as the packings of
+ *	genaggpack, whose aggregate particles are blobs far bigger than a
+ *	brick.  A brick whose voxels are all the same costs one int; only
+ *	the bricks that hold a boundary hold their voxels.
+ *
+ *	BRICKGET reads a voxel and brickbox_set writes one, giving a
+ *	uniform brick its voxels when it first gets a different value.
+ *	Bricks that have become uniform again are given back their one
+ *	value by brickbox_tidy, which brickbox_set calls itself each time
+ *	the number of bricks with voxels has doubled since the last time,
+ *	so that a box being filled in never holds much more than it needs.
+ *
+ *	The bricks on the high faces of the box overhang it when a size
+ *	is not a multiple of BRICKSIDE.  Their voxels outside the box are
+ *	never read, and are left out when deciding whether a brick is
+ *	uniform.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BRICKTIDYMIN 64 /* bricks with voxels before the first tidy */
+
+/******************************************************************************
+ *	Function brickspan gives how many voxels of brick b, along an axis
+ *	of n voxels, lie inside the box
+ ******************************************************************************/
+static int brickspan(int b, int n) {
+  int left;
+
+  left = n - (b << BRICKBITS);
+  return ((left < BRICKSIDE) ? left : BRICKSIDE);
+}
+
+/******************************************************************************
+ *	Function brickuniform tells whether the voxels of a brick that lie
+ *	inside the box are all the same, and gives their value
+ ******************************************************************************/
+static int brickuniform(Brickbox *bb, size_t n, const int *vox, int *val) {
+  int bx, by, bz, nx, ny, nz, x, y, z;
+  const int *row;
+
+  bx = (int)(n % bb->nbx);
+  by = (int)((n / bb->nbx) % bb->nby);
+  bz = (int)(n / ((size_t)bb->nbx * bb->nby));
+  nx = brickspan(bx, bb->xsize);
+  ny = brickspan(by, bb->ysize);
+  nz = brickspan(bz, bb->zsize);
+
+  *val = vox[0];
+  for (z = 0; z < nz; z++) {
+    for (y = 0; y < ny; y++) {
+      row = vox + ((z << BRICKBITS) + y) * BRICKSIDE;
+      for (x = 0; x < nx; x++) {
+        if (row[x] != *val)
+          return (0);
+      }
+    }
+  }
+
+  return (1);
+}
+
+/******************************************************************************
+ *	Function brickbox_alloc makes a box with every voxel set to one
+ *	value
+ *
+ * 	Arguments:	Brickbox pointer to fill
+ * 				int xsize, ysize, zsize
+ * 				int value of every voxel
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int brickbox_alloc(Brickbox *bb, int xsize, int ysize, int zsize, int val) {
+  size_t n;
+
+  memset(bb, 0, sizeof(Brickbox));
+  if (xsize < 1 || ysize < 1 || zsize < 1)
+    return (1);
+
+  bb->xsize = xsize;
+  bb->ysize = ysize;
+  bb->zsize = zsize;
+  bb->nbx = (xsize + BRICKMASK) >> BRICKBITS;
+  bb->nby = (ysize + BRICKMASK) >> BRICKBITS;
+  bb->nbz = (zsize + BRICKMASK) >> BRICKBITS;
+  bb->nbrick = (size_t)bb->nbx * bb->nby * bb->nbz;
+  bb->nexttidy = BRICKTIDYMIN;
+
+  bb->fill = (int *)malloc(bb->nbrick * sizeof(int));
+  bb->vox = (int **)calloc(bb->nbrick, sizeof(int *));
+  if (!bb->fill || !bb->vox) {
+    brickbox_free(bb);
+    return (1);
+  }
+  for (n = 0; n < bb->nbrick; n++) {
+    bb->fill[n] = val;
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function brickbox_set sets one voxel
+ *
+ * 	Arguments:	Brickbox pointer
+ * 				int x, y, z inside the box
+ * 				int value
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory, in
+ *				which case the voxel is as it was)
+ ******************************************************************************/
+int brickbox_set(Brickbox *bb, int x, int y, int z, int val) {
+  int i;
+  size_t n;
+  int *vox;
+
+  n = BRICKNUM(bb, x, y, z);
+  if (!bb->vox[n]) {
+    if (bb->fill[n] == val)
+      return (0);
+    vox = (int *)malloc(BRICKVOX * sizeof(int));
+    if (!vox)
+      return (1);
+    for (i = 0; i < BRICKVOX; i++) {
+      vox[i] = bb->fill[n];
+    }
+    bb->vox[n] = vox;
+    bb->ndense++;
+  }
+  bb->vox[n][BRICKPOS(x, y, z)] = val;
+
+  if (bb->ndense >= bb->nexttidy)
+    brickbox_tidy(bb);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function brickbox_tidy gives the bricks whose voxels are all the
+ *	same their one value back
+ *
+ * 	Arguments:	Brickbox pointer
+ *
+ *	Returns:	size_t number of bricks still holding voxels
+ ******************************************************************************/
+size_t brickbox_tidy(Brickbox *bb) {
+  int val;
+  size_t n;
+
+  for (n = 0; n < bb->nbrick; n++) {
+    if (bb->vox[n] && brickuniform(bb, n, bb->vox[n], &val)) {
+      free(bb->vox[n]);
+      bb->vox[n] = NULL;
+      bb->fill[n] = val;
+      bb->ndense--;
+    }
+  }
+
+  bb->nexttidy = 2 * bb->ndense;
+  if (bb->nexttidy < BRICKTIDYMIN)
+    bb->nexttidy = BRICKTIDYMIN;
+
+  return (bb->ndense);
+}
+
+/******************************************************************************
+ *	Function brickbox_copy copies the voxels of one brick, x varying
+ *	fastest, whether or not it holds them
+ *
+ * 	Arguments:	Brickbox pointer
+ * 				size_t number of the brick
+ * 				int pointer to BRICKVOX ints to fill
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void brickbox_copy(Brickbox *bb, size_t n, int *vox) {
+  int i;
+
+  if (bb->vox[n]) {
+    memcpy(vox, bb->vox[n], BRICKVOX * sizeof(int));
+  } else {
+    for (i = 0; i < BRICKVOX; i++) {
+      vox[i] = bb->fill[n];
+    }
+  }
+}
+
+/******************************************************************************
+ *	Function brickbox_put replaces all the voxels of one brick,
+ *	taking over the voxels given, which must have come from malloc.
+ *	They are freed at once if they are all the same.
+ *
+ * 	Arguments:	Brickbox pointer
+ * 				size_t number of the brick
+ * 				int pointer to BRICKVOX ints, x varying fastest
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void brickbox_put(Brickbox *bb, size_t n, int *vox) {
+  int val;
+
+  if (bb->vox[n]) {
+    free(bb->vox[n]);
+    bb->ndense--;
+  }
+
+  if (brickuniform(bb, n, vox, &val)) {
+    free(vox);
+    bb->vox[n] = NULL;
+    bb->fill[n] = val;
+  } else {
+    bb->vox[n] = vox;
+    bb->ndense++;
+  }
+}
+
+/******************************************************************************
+ *	Function brickbox_bytes gives the memory a box takes
+ *
+ * 	Arguments:	Brickbox pointer
+ *
+ *	Returns:	size_t number of bytes
+ ******************************************************************************/
+size_t brickbox_bytes(Brickbox *bb) {
+  return (bb->nbrick * (sizeof(int) + sizeof(int *)) +
+          bb->ndense * BRICKVOX * sizeof(int));
+}
+
+/******************************************************************************
+ *	Function brickbox_free releases a box
+ *
+ * 	Arguments:	Brickbox pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void brickbox_free(Brickbox *bb) {
+  size_t n;
+
+  for (n = 0; bb->vox && n < bb->nbrick; n++) {
+    free(bb->vox[n]);
+  }
+  free(bb->vox);
+  free(bb->fill);
+  bb->vox = NULL;
+  bb->fill = NULL;
+  bb->nbrick = bb->ndense = 0;
+}
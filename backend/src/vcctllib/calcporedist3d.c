@@ -1,16 +1,10 @@
 /******************************************************************************
- *	Function calcporedist3d calculates the pore size distribution of
- *       a microstructure, writes the information to a file, and then returns
- *       control to calling function
- *
- * 	Arguments:	pointer to char array file name to open
- * 				pointer to float version
- * 				pointer to int xsize
- * 				pointer to int ysize
- * 				pointer to int zsize
- * 				pointer to float resolution
- *
- *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *	Functions calcporedist3d, calcporedist3dmic and calcporedist3dvox
+ *       calculate the pore size distribution of a microstructure, write
+ *       the information to a file, and then return control to calling
+ *       function.  The first reads the image from its file; the others
+ *       take a microstructure already in memory, so a program that has
+ *       just written the image need not read it back.
  *
  *	Programmer:	Jeffrey W. Bullard
  *				NIST
@@ -25,130 +19,27 @@
  *	16 March 2004
  ******************************************************************************/
 #include "../include/vcctl.h"
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/***
- *    Function declarations
- ***/
-
-int maketemp(int size, int *xsph, int *ysph, int *zsph);
-int pix2x(int pid, int xsize, int ysize);
-int pix2y(int pid, int xsize, int ysize);
-int pix2z(int pid, int xsize, int ysize);
-
-int calcporedist3d(char *name) {
-  register int i1, i2, i3;
-  int iout, oiout, status;
-  char instring[MAXSTRING];
-  int syspix = DEFAULTSYSTEMSIZE * DEFAULTSYSTEMSIZE * DEFAULTSYSTEMSIZE;
-  int xsize = DEFAULTSYSTEMSIZE;
-  int ysize = DEFAULTSYSTEMSIZE;
-  int zsize = DEFAULTSYSTEMSIZE;
-  float res = 1.0;
-  float sizemag = 1.0;
-  int isizemag = 1;
-  float resmag = 1.0;
-  int iresmag = 1;
+/******************************************************************************
+ *	Function poredistwrite counts the pore voxels of each local
+ *	thickness and writes the distribution to name.poredist
+ *
+ * 	Arguments:	pointer to char array image file name
+ * 				unsigned char pointer to the image, nonzero at
+ * 				the pore voxels (z varies fastest)
+ * 				int xsize, ysize, zsize
+ * 				int number of pore voxels
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int poredistwrite(char *name, unsigned char *pore, int xsize,
+                         int ysize, int zsize, int porecnt) {
   char filename[MAXSTRING];
-  int i, *pores, *ndiam, porecnt, index, ns, maxsph, nsph;
-  int ix, iy, iz, max_allowed_diam, mindim, nd, failed, nrad;
-  int xc, yc, zc;
-  int ***tmic, ***mic;
-  int *xsph, *ysph, *zsph;
-  FILE *infile, *outfile;
-
-  /* VCCTL software version used to create input file */
-  float version;
-
-  sprintf(filename, "%s", name);
-
-  infile = filehandler("calcporedist3d", filename, "READ");
-  if (!infile) {
-    printf("\n==>Could not open file for reading.");
-    fflush(stdout);
-    return (1);
-  }
-
-  /***
-   *    Determine whether system size and resolution
-   *    are specified in the image file
-   ***/
-
-  if (read_imgheader(infile, &version, &xsize, &ysize, &zsize, &res)) {
-    fclose(infile);
-    bailout("calcporedist3d", "Error reading image header");
-    return (1);
-  }
-
-  /***
-   *    Define the number of histogram bins
-   ***/
-
-  syspix = xsize * ysize * zsize;
-  sizemag =
-      pow(((float)syspix) / (pow(((float)DEFAULTSYSTEMSIZE), 3.0)), (1. / 3.));
-  isizemag = (int)(sizemag + 0.5);
-  resmag = ((float)DEFAULTRESOLUTION) / res;
-  iresmag = (int)(resmag + 0.5);
-
-  /***
-   *    Allocate memory for all global variables
-   ***/
-
-  mic = NULL;
-  mic = ibox(xsize + 1, ysize + 1, zsize + 1);
-
-  if (!mic) {
-    bailout("calcporedist3d", "Memory allocation failure");
-    fflush(stdout);
-    return (1);
-  }
-
-  /***
-   *    Read the microstructure file
-   ***/
-
-  for (i3 = 0; i3 < zsize; i3++) {
-    for (i2 = 0; i2 < ysize; i2++) {
-      for (i1 = 0; i1 < xsize; i1++) {
-        fscanf(infile, "%s", instring);
-        oiout = atoi(instring);
-        iout = convert_id(oiout, version);
-        mic[i1][i2][i3] = iout;
-      }
-    }
-  }
-
-  fclose(infile);
-
-  /* Allocate memory for temporary microstructure image */
-
-  tmic = NULL;
-
-  tmic = ibox(xsize + 1, ysize + 1, zsize + 1);
-  if (!tmic) {
-    warning("calcporedist3d", "Could not allocate required memory for "
-                              "temporary microstructure image");
-    return (1);
-  }
-
-  porecnt = 0;
-  for (iz = 0; iz < zsize; iz++) {
-    for (iy = 0; iy < ysize; iy++) {
-      for (ix = 0; ix < xsize; ix++) {
-        if (mic[ix][iy][iz] == POROSITY || mic[ix][iy][iz] == EMPTYP ||
-            mic[ix][iy][iz] == EMPTYDP || mic[ix][iy][iz] == CRACKP) {
-          tmic[ix][iy][iz] = POROSITY;
-          porecnt++;
-        } else {
-          tmic[ix][iy][iz] = 10000;
-        }
-      }
-    }
-  }
+  int i, *ndiam, max_allowed_diam, mindim;
+  FILE *outfile;
 
   mindim = xsize;
   if (ysize < mindim)
@@ -158,146 +49,36 @@ int calcporedist3d(char *name) {
 
   max_allowed_diam = (int)(0.2 * mindim);
 
-  /* Allocate memory for ndiam vector */
-  ndiam = NULL;
-  ndiam = ivector(max_allowed_diam + 1);
-  if (!ndiam) {
-    warning("calcporedist3d", "Could not allocate required memory");
-    free_ibox(tmic, xsize + 1, ysize + 1);
-    free_ibox(mic, xsize + 1, ysize + 1);
-    return (1);
-  }
-
   /* Ensure that diameter is odd */
   if (max_allowed_diam % 2 == 0)
     max_allowed_diam++;
-  maxsph = diam2vol((float)max_allowed_diam);
 
-  /* Allocate memory for xsph,ysph, and zsph vectors */
-  xsph = NULL;
-  xsph = ivector(maxsph);
-  if (!xsph) {
+  /* Allocate memory for ndiam vector */
+  ndiam = NULL;
+  ndiam = ivector(max_allowed_diam + 1);
+  if (!ndiam) {
     warning("calcporedist3d", "Could not allocate required memory");
-    free_ivector(ndiam);
-    free_ibox(tmic, xsize + 1, ysize + 1);
-    free_ibox(mic, xsize + 1, ysize + 1);
     return (1);
   }
 
-  ysph = NULL;
-  ysph = ivector(maxsph);
-  if (!ysph) {
-    warning("calcporedist3d", "Could not allocate required memory");
-    free_ivector(xsph);
-    free_ivector(ndiam);
-    free_ibox(tmic, xsize + 1, ysize + 1);
-    free_ibox(mic, xsize + 1, ysize + 1);
-    return (1);
-  }
+  /***
+   *    Give every pore voxel the diameter of the largest sphere
+   *    of pore voxels that covers it (see poresizes).  The image
+   *    is in C order, so z is passed as the fastest axis.
+   ***/
 
-  zsph = NULL;
-  zsph = ivector(maxsph);
-  if (!zsph) {
+  if (poresizes(pore, zsize, ysize, xsize, max_allowed_diam, ndiam)) {
     warning("calcporedist3d", "Could not allocate required memory");
-    free_ivector(ysph);
-    free_ivector(xsph);
-    free_ivector(ndiam);
-    free_ibox(tmic, xsize + 1, ysize + 1);
-    free_ibox(mic, xsize + 1, ysize + 1);
-    return (1);
-  }
-
-  /* Allocate memory for porosity locator vector */
-
-  pores = NULL;
-  pores = ivector(porecnt);
-  if (!pores) {
-    warning("poredist3d", "Could not allocate required memory");
-    fflush(stdout);
-    free_ivector(zsph);
-    free_ivector(ysph);
-    free_ivector(xsph);
     free_ivector(ndiam);
-    free_ibox(tmic, xsize + 1, ysize + 1);
-    free_ibox(mic, xsize + 1, ysize + 1);
     return (1);
   }
 
-  /* Load up the locator vector */
-
-  index = 0;
-  ns = 0;
-  for (iz = 0; iz < zsize && index < porecnt; iz++) {
-    for (iy = 0; iy < ysize && index < porecnt; iy++) {
-      for (ix = 0; ix < xsize && index < porecnt; ix++) {
-        if (mic[ix][iy][iz] == POROSITY || mic[ix][iy][iz] == EMPTYP ||
-            mic[ix][iy][iz] == EMPTYDP || mic[ix][iy][iz] == CRACKP) {
-          pores[index] = ns;
-          index++;
-        }
-        ns++;
-      }
-    }
-  }
-
-  /* Initialize the ndiam vector */
-
-  for (i = 0; i <= max_allowed_diam; i++)
-    ndiam[i] = 0;
-
-  /* Start with largest allowed pore diameter */
-
-  for (nd = max_allowed_diam; nd >= 1; nd -= 2) {
-    nrad = nd / 2;
-    nsph = maketemp(nrad, xsph, ysph, zsph);
-
-    /* Check all pore pixels in the 3-D system */
-
-    for (index = 0; index < porecnt; index++) {
-      xc = pix2x(pores[index], xsize, ysize);
-      yc = pix2y(pores[index], xsize, ysize);
-      zc = pix2z(pores[index], xsize, ysize);
-      if (tmic[xc][yc][zc] == POROSITY) {
-        failed = 0;
-        for (i = 0; (i < nsph) && (!failed); i++) {
-          ix = xc + xsph[i];
-          iy = yc + ysph[i];
-          iz = zc + zsph[i];
-          ix += checkbc(ix, xsize);
-          iy += checkbc(iy, ysize);
-          iz += checkbc(iz, zsize);
-          if (tmic[ix][iy][iz] > max_allowed_diam)
-            failed = 1;
-        }
-        if (!failed) {
-          for (i = 0; i < nsph; i++) {
-            ix = xc + xsph[i];
-            iy = yc + ysph[i];
-            iz = zc + zsph[i];
-            ix += checkbc(ix, xsize);
-            iy += checkbc(iy, ysize);
-            iz += checkbc(iz, zsize);
-            if (tmic[ix][iy][iz] < nd) {
-              tmic[ix][iy][iz] = nd;
-              ndiam[nd]++;
-            }
-          }
-        }
-      }
-    }
-  }
-
-  strcat(filename, ".poredist");
+  sprintf(filename, "%s.poredist", name);
   outfile = filehandler("poredist3d", filename, "WRITE");
   if (!outfile) {
     warning("poredist3d", "Could not open output file");
     fflush(stdout);
-    free_ivector(zsph);
-    free_ivector(ysph);
-    free_ivector(xsph);
     free_ivector(ndiam);
-    free_ibox(tmic, xsize + 1, ysize + 1);
-    free_ibox(mic, xsize + 1, ysize + 1);
     return (1);
   }
 
@@ -310,124 +91,166 @@ int calcporedist3d(char *name) {
 
   fclose(outfile);
 
-  free_ivector(pores);
-  free_ivector(zsph);
-  free_ivector(ysph);
-  free_ivector(xsph);
   free_ivector(ndiam);
-  free_ibox(tmic, xsize + 1, ysize + 1);
-  free_ibox(mic, xsize + 1, ysize + 1);
 
   return (0);
 }
 
-/***
- *    maketemp
- *
- *    Routine to create a template for the sphere of
- *    interest of radius size to be used in
- *    curvature evaluation
+/******************************************************************************
+ *	Function calcporedist3d reads a microstructure image and writes
+ *	its pore size distribution to name.poredist
  *
- *    Arguments:  int size (the radius of the sphere)
- *                int pointer to xsph vector
- *                int pointer to ysph vector
- *                int pointer to zsph vector
- *    Returns:    int number of pixels in sphere
+ * 	Arguments:	pointer to char array file name to open
  *
- *    Calls:		no other routines
- *    Called by:	runsint
- ***/
-int maketemp(int size, int *xsph, int *ysph, int *zsph) {
-  int icirc, xval, yval, zval;
-  float xtmp, ytmp, dist;
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int calcporedist3d(char *name) {
+  size_t n, nvox, cap = 0;
+  unsigned char *vox = NULL;
+  int xsize = DEFAULTSYSTEMSIZE;
+  int ysize = DEFAULTSYSTEMSIZE;
+  int zsize = DEFAULTSYSTEMSIZE;
+  float res = 1.0;
+  int porecnt, status;
+  FILE *infile;
+
+  /* VCCTL software version used to create input file */
+  float version;
+
+  infile = filehandler("calcporedist3d", name, "READ");
+  if (!infile) {
+    printf("\n==>Could not open file for reading.");
+    fflush(stdout);
+    return (1);
+  }
 
   /***
-   *   Determine and store the locations of all
-   *   pixels in the 3-D sphere
+   *    Read the header and the voxels of the image
    ***/
 
-  icirc = 0;
-  for (xval = (-size); xval <= size; xval++) {
+  if (load_microstructure(infile, &vox, &cap, &version, &xsize, &ysize, &zsize,
+                          &res)) {
+    fclose(infile);
+    if (vox)
+      free(vox);
+    bailout("calcporedist3d", "Error reading microstructure image");
+    return (1);
+  }
+  fclose(infile);
+
+  /***
+   *    Mark the pore voxels in place of their phase ids
+   ***/
+
+  nvox = (size_t)xsize * ysize * zsize;
+  porecnt = 0;
+  for (n = 0; n < nvox; n++) {
+    if (vox[n] == POROSITY || vox[n] == EMPTYP || vox[n] == EMPTYDP ||
+        vox[n] == CRACKP) {
+      vox[n] = 1;
+      porecnt++;
+    } else {
+      vox[n] = 0;
+    }
+  }
+
+  status = poredistwrite(name, vox, xsize, ysize, zsize, porecnt);
+  free(vox);
 
-    xtmp = (float)(xval * xval);
-    for (yval = (-size); yval <= size; yval++) {
+  return (status);
+}
 
-      ytmp = (float)(yval * yval);
-      for (zval = (-size); zval <= size; zval++) {
+/******************************************************************************
+ *	Function calcporedist3dmic writes the pore size distribution of
+ *	a microstructure in memory to name.poredist.  Only a one-byte
+ *	pore mask is made from it.  With a refinement factor rf > 1,
+ *	each voxel stands for an rf*rf*rf block, as when a coarsened
+ *	system is written at its original resolution.
+ *
+ * 	Arguments:	pointer to char array name of the image file
+ * 				char pointer to 3-D microstructure, mic[x][y][z]
+ * 				int xsize, ysize, zsize of mic
+ * 				int refinement factor rf
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int calcporedist3dmic(char *name, char ***mic, int xsize, int ysize,
+                      int zsize, int rf) {
+  int ix, iy, iz, porecnt, status, ph;
+  unsigned char *pore, *p;
 
-        dist = sqrt(xtmp + ytmp + (float)(zval * zval));
+  if (rf < 1)
+    rf = 1;
 
-        if (dist <= ((float)size + 0.5)) {
+  pore = (unsigned char *)malloc((size_t)(rf * xsize) * (size_t)(rf * ysize) *
+                                 (size_t)(rf * zsize));
+  if (!pore) {
+    warning("calcporedist3d", "Could not allocate required memory");
+    return (1);
+  }
 
-          xsph[icirc] = xval;
-          ysph[icirc] = yval;
-          zsph[icirc] = zval;
-          icirc++;
+  porecnt = 0;
+  p = pore;
+  for (ix = 0; ix < rf * xsize; ix++) {
+    for (iy = 0; iy < rf * ysize; iy++) {
+      for (iz = 0; iz < rf * zsize; iz++) {
+        ph = mic[ix / rf][iy / rf][iz / rf];
+        if (ph == POROSITY || ph == EMPTYP || ph == EMPTYDP || ph == CRACKP) {
+          *p++ = 1;
+          porecnt++;
+        } else {
+          *p++ = 0;
         }
       }
     }
   }
 
-  /***
-   *   Return the number of pixels contained in
-   *   sphere of radius (size+0.5)
-   ***/
+  status = poredistwrite(name, pore, rf * xsize, rf * ysize, rf * zsize,
+                         porecnt);
+  free(pore);
 
-  return (icirc);
+  return (status);
 }
 
-/***
-*    pix2x
-*
-*    Convert pixel id number to x coordinate
-*
-*    Arguments:    int pixel id number
-                   int xsize,ysize are the x,y dimensions of the system
-*    Returns:      int x coordinate
-*
-*    Calls:        no other routines
-*    Called by:    calcporedist3d
-***/
-int pix2x(int pid, int xsize, int ysize) {
-  int x, y, z;
-  z = pid / (xsize * ysize);
-  y = (pid - (z * xsize * ysize)) / xsize;
-  x = (pid - (z * xsize * ysize) - (y * xsize));
-  return (x);
-}
+/******************************************************************************
+ *	Function calcporedist3dvox writes the pore size distribution of
+ *	an image held as one byte per voxel to name.poredist, after
+ *	mapping each voxel through a table of the ids it is written as
+ *
+ * 	Arguments:	pointer to char array name of the image
+ * 				unsigned char pointer to the voxels (C order)
+ * 				unsigned char pointer to a table of 256 ids
+ * 					(NULL to use the voxels as they are)
+ * 				int xsize, ysize, zsize of the image
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int calcporedist3dvox(char *name, unsigned char *vox, const unsigned char *id,
+                      int xsize, int ysize, int zsize) {
+  int porecnt, status, ph;
+  size_t n, nvox;
+  unsigned char *pore;
+
+  nvox = (size_t)xsize * (size_t)ysize * (size_t)zsize;
+  pore = (unsigned char *)malloc(nvox);
+  if (!pore) {
+    warning("calcporedist3d", "Could not allocate required memory");
+    return (1);
+  }
 
-/***
-*    pix2y
-*
-*    Convert pixel id number to y coordinate
-*
-*    Arguments:    int pixel id number
-                   int xsize,ysize are the x,y dimensions of the system
-*    Returns:      int x coordinate
-*
-*    Calls:        no other routines
-*    Called by:    calcporedist3d
-***/
-int pix2y(int pid, int xsize, int ysize) {
-  int y, z;
-  z = pid / (xsize * ysize);
-  y = (pid - (z * xsize * ysize)) / xsize;
-  return (y);
-}
+  porecnt = 0;
+  for (n = 0; n < nvox; n++) {
+    ph = id ? id[vox[n]] : vox[n];
+    if (ph == POROSITY || ph == EMPTYP || ph == EMPTYDP || ph == CRACKP) {
+      pore[n] = 1;
+      porecnt++;
+    } else {
+      pore[n] = 0;
+    }
+  }
+
+  status = poredistwrite(name, pore, xsize, ysize, zsize, porecnt);
+  free(pore);
 
-/***
-*    pix2z
-*
-*    Convert pixel id number to z coordinate
-*
-*    Arguments:    int pixel id number
-                   int xsize,ysize are the x,y dimensions of the system
-*    Returns:      int x coordinate
-*
-*    Calls:        no other routines
-*    Called by:    calcporedist3d
-***/
-int pix2z(int pid, int xsize, int ysize) {
-  int z = pid / (xsize * ysize);
-  return (z);
+  return (status);
 }
@@ -0,0 +1,462 @@
+/******************************************************************************
+ *	Functions to take a census of the phases in a microstructure:
+ *	the number of voxels of each phase id and, optionally, the
+ *	number of faces each phase shares with pore voxels.
+ *
+ *	Counts are kept in CENSUSTABLES separate tables that take
+ *	turns, so that a run of equal ids (the usual case in a
+ *	microstructure) does not make every increment wait on the one
+ *	before it.  The tables are added together at the end.
+ *
+ *	A pore voxel, for the face counts, is saturated porosity or
+ *	anything above NSPHASES (diffusing species and the other kinds
+ *	of porosity), the same test used by countbox in disrealnew
+ *	and by stat3d.
+ *
+ *	phase_interfaces counts, in the same pass as the voxels, the
+ *	faces shared by every pair of phases and the voxels on the
+ *	surface of each phase, with the planes of the image shared out
+ *	among OpenMP threads when there are any.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define CENSUSTABLES 4 /* partial count tables used in turn */
+
+/******************************************************************************
+ *	Function census_row adds one contiguous run of voxels to the
+ *	partial count tables
+ *
+ * 	Arguments:	unsigned char pointer to the first voxel
+ * 				size_t number of voxels
+ * 				int partial tables [CENSUSTABLES][CENSUSIDS]
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void census_row(const unsigned char *row, size_t n,
+                       int part[CENSUSTABLES][CENSUSIDS]) {
+  size_t i;
+
+  for (i = 0; i + CENSUSTABLES <= n; i += CENSUSTABLES) {
+    part[0][row[i]]++;
+    part[1][row[i + 1]]++;
+    part[2][row[i + 2]]++;
+    part[3][row[i + 3]]++;
+  }
+  for (; i < n; i++) {
+    part[0][row[i]]++;
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function census_sum adds the partial tables together into the
+ *	caller's counts
+ *
+ * 	Arguments:	int partial tables [CENSUSTABLES][CENSUSIDS]
+ * 				int number of ids to return
+ * 				int pointer to nids counts
+ *
+ *	Returns:	int number of voxels with an id of nids or more
+ ******************************************************************************/
+static int census_sum(int part[CENSUSTABLES][CENSUSIDS], int nids,
+                      int *count) {
+  int i, t, sum, nout = 0;
+
+  for (i = 0; i < CENSUSIDS; i++) {
+    sum = 0;
+    for (t = 0; t < CENSUSTABLES; t++) {
+      sum += part[t][i];
+    }
+    if (i < nids) {
+      count[i] = sum;
+    } else {
+      nout += sum;
+    }
+  }
+
+  return (nout);
+}
+
+/******************************************************************************
+ *	Function phase_census counts the voxels of each phase in a
+ *	contiguous image and, if poreface is not NULL, the faces of the
+ *	voxels of each phase that touch a pore voxel, using periodic
+ *	boundaries.  A voxel with six pore neighbors adds six to the
+ *	face count of its phase.
+ *
+ * 	Arguments:	unsigned char pointer to voxels in C order
+ * 				(z varies fastest, then y, then x)
+ * 				int xsize, ysize, zsize
+ * 				int nids (number of phase ids to count, at most CENSUSIDS)
+ * 				int pointer to nids voxel counts
+ * 				int pointer to nids face counts, or NULL
+ *
+ *	Returns:	int number of voxels with an id of nids or more,
+ *				which are left out of both sets of counts
+ ******************************************************************************/
+int phase_census(unsigned char *vox, int xsize, int ysize, int zsize,
+                 int nids, int *count, int *poreface) {
+  int ix, iy, iz, zm, zp, nf, t;
+  int ispore[CENSUSIDS];
+  int part[CENSUSTABLES][CENSUSIDS], fpart[CENSUSTABLES][CENSUSIDS];
+  size_t plane, ncol;
+  unsigned char *row, *xm, *xp, *ym, *yp;
+
+  if (nids > CENSUSIDS)
+    nids = CENSUSIDS;
+
+  memset(part, 0, sizeof(part));
+  memset(fpart, 0, sizeof(fpart));
+
+  plane = (size_t)ysize * (size_t)zsize;
+  ncol = (size_t)zsize;
+
+  if (!poreface) {
+    census_row(vox, (size_t)xsize * plane, part);
+    return (census_sum(part, nids, count));
+  }
+
+  for (t = 0; t < CENSUSIDS; t++) {
+    ispore[t] = ((t == POROSITY) || (t > NSPHASES)) ? 1 : 0;
+  }
+
+  for (ix = 0; ix < xsize; ix++) {
+    for (iy = 0; iy < ysize; iy++) {
+      row = vox + (size_t)ix * plane + (size_t)iy * ncol;
+      xm = vox + (size_t)((ix > 0) ? ix - 1 : xsize - 1) * plane +
+           (size_t)iy * ncol;
+      xp = vox + (size_t)((ix < xsize - 1) ? ix + 1 : 0) * plane +
+           (size_t)iy * ncol;
+      ym = vox + (size_t)ix * plane +
+           (size_t)((iy > 0) ? iy - 1 : ysize - 1) * ncol;
+      yp = vox + (size_t)ix * plane +
+           (size_t)((iy < ysize - 1) ? iy + 1 : 0) * ncol;
+
+      census_row(row, ncol, part);
+
+      for (iz = 0; iz < zsize; iz++) {
+        zm = (iz > 0) ? iz - 1 : zsize - 1;
+        zp = (iz < zsize - 1) ? iz + 1 : 0;
+        nf = ispore[xm[iz]] + ispore[xp[iz]] + ispore[ym[iz]] +
+             ispore[yp[iz]] + ispore[row[zm]] + ispore[row[zp]];
+        fpart[iz % CENSUSTABLES][row[iz]] += nf;
+      }
+    }
+  }
+
+  census_sum(fpart, nids, poreface);
+
+  return (census_sum(part, nids, count));
+}
+
+/******************************************************************************
+ *	Function grid_census counts the voxels of each phase in a char
+ *	grid (such as one made by cgrid or cgridhalo), one z row at a
+ *	time, so the grid may have a halo or be larger than the part
+ *	being counted
+ *
+ * 	Arguments:	char pointer to 3-D grid
+ * 				int xsize, ysize, zsize (extent to count)
+ * 				int nids (number of phase ids to count, at most CENSUSIDS)
+ * 				int pointer to nids voxel counts
+ *
+ *	Returns:	int number of voxels with an id of nids or more
+ *				(left out of the counts)
+ ******************************************************************************/
+int grid_census(char ***grid, int xsize, int ysize, int zsize, int nids,
+                int *count) {
+  int ix, iy;
+  int part[CENSUSTABLES][CENSUSIDS];
+
+  if (nids > CENSUSIDS)
+    nids = CENSUSIDS;
+
+  memset(part, 0, sizeof(part));
+
+  for (ix = 0; ix < xsize; ix++) {
+    for (iy = 0; iy < ysize; iy++) {
+      census_row((unsigned char *)grid[ix][iy], (size_t)zsize, part);
+    }
+  }
+
+  return (census_sum(part, nids, count));
+}
+
+/******************************************************************************
+ *	Function face_row marks, for one z row, which faces of each
+ *	voxel lie between unlike voxels: bits 0-2 for the faces toward
+ *	+x, +y and +z, and bit 3 for any face toward -x, -y or -z.
+ *	Each test compares the row with a shifted copy of itself or a
+ *	neighboring row, so the loops are plain byte compares, which
+ *	are marked for the compiler to vectorize when OpenMP is on.
+ *	The body is built once for each level of cpu_level, and
+ *	face_row_pick gives the variant to use.
+ *
+ * 	Arguments:	unsigned char pointers to the row and its
+ * 				neighboring rows in +x, -x, +y and -y
+ * 				int length of the row
+ * 				unsigned char pointer to the marks
+ *
+ *	Returns:	int nonzero if any face of the row is marked
+ ******************************************************************************/
+VCCTL_KERNEL int face_row_body(const unsigned char *row,
+                               const unsigned char *xp,
+                               const unsigned char *xm,
+                               const unsigned char *yp,
+                               const unsigned char *ym, int n,
+                               unsigned char *dif) {
+  int iz, any;
+
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for (iz = 0; iz < n - 1; iz++) {
+    dif[iz] = (unsigned char)((row[iz] != xp[iz]) | ((row[iz] != yp[iz]) << 1) |
+                              ((row[iz] != row[iz + 1]) << 2));
+  }
+  dif[n - 1] = (unsigned char)((row[n - 1] != xp[n - 1]) |
+                               ((row[n - 1] != yp[n - 1]) << 1) |
+                               ((row[n - 1] != row[0]) << 2));
+
+  dif[0] |= (unsigned char)(((row[0] != xm[0]) | (row[0] != ym[0]) |
+                             (row[0] != row[n - 1]))
+                            << 3);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for (iz = 1; iz < n; iz++) {
+    dif[iz] |= (unsigned char)(((row[iz] != xm[iz]) | (row[iz] != ym[iz]) |
+                                (row[iz] != row[iz - 1]))
+                               << 3);
+  }
+
+  any = 0;
+#ifdef _OPENMP
+#pragma omp simd reduction(| : any)
+#endif
+  for (iz = 0; iz < n; iz++) {
+    any |= dif[iz];
+  }
+
+  return (any);
+}
+
+typedef int (*Facerowfn)(const unsigned char *, const unsigned char *,
+                         const unsigned char *, const unsigned char *,
+                         const unsigned char *, int, unsigned char *);
+
+static int face_row_generic(const unsigned char *row, const unsigned char *xp,
+                            const unsigned char *xm, const unsigned char *yp,
+                            const unsigned char *ym, int n,
+                            unsigned char *dif) {
+  return (face_row_body(row, xp, xm, yp, ym, n, dif));
+}
+
+#if VCCTL_X86SIMD
+VCCTL_TARGET_AVX2 static int
+face_row_avx2(const unsigned char *row, const unsigned char *xp,
+              const unsigned char *xm, const unsigned char *yp,
+              const unsigned char *ym, int n, unsigned char *dif) {
+  return (face_row_body(row, xp, xm, yp, ym, n, dif));
+}
+
+VCCTL_TARGET_AVX512 static int
+face_row_avx512(const unsigned char *row, const unsigned char *xp,
+                const unsigned char *xm, const unsigned char *yp,
+                const unsigned char *ym, int n, unsigned char *dif) {
+  return (face_row_body(row, xp, xm, yp, ym, n, dif));
+}
+#endif
+
+/******************************************************************************
+ *	Function face_row_pick gives the variant of face_row built for
+ *	the level of cpu_level
+ *
+ * 	Arguments:	None
+ *
+ *	Returns:	Facerowfn pointer to the variant
+ ******************************************************************************/
+static Facerowfn face_row_pick(void) {
+  switch (cpu_level()) {
+#if VCCTL_X86SIMD
+  case CPUAVX512:
+    return (face_row_avx512);
+  case CPUAVX2:
+    return (face_row_avx2);
+#endif
+  default:
+    return (face_row_generic);
+  }
+}
+
+/******************************************************************************
+ *	Function phase_interfaces counts the voxels of each phase in a
+ *	contiguous image and the faces shared by each pair of unlike
+ *	phases, using periodic boundaries.  Each face is counted once,
+ *	from the voxel on its low side, and the count is stored for
+ *	both orders of the pair, so pair[a * nids + b] == pair[b * nids + a]
+ *	and the diagonal is zero.  The faces of phase a with every other
+ *	phase add up to its surface.  If surfvox is not NULL, it gets
+ *	the number of voxels of each phase with at least one unlike
+ *	neighbor.
+ *
+ *	Each row is first compared with its neighbors (face_row), and
+ *	only the voxels with an unlike face go into the tables, so the
+ *	cost of the interiors of large particles is a few vector
+ *	compares.  Each thread keeps its own tables, indexed by any id
+ *	a voxel can hold, and they are added together at the end.
+ *
+ * 	Arguments:	unsigned char pointer to voxels in C order
+ * 				(z varies fastest, then y, then x)
+ * 				int xsize, ysize, zsize
+ * 				int nids (number of phase ids to count, at most CENSUSIDS)
+ * 				int pointer to nids voxel counts
+ * 				int pointer to nids * nids face counts
+ * 				int pointer to nids surface voxel counts, or NULL
+ * 				int number of threads (0 for the OpenMP default)
+ *
+ *	Returns:	int number of voxels with an id of nids or more,
+ *				which are left out of all the counts
+ *				(-1 if out of memory)
+ ******************************************************************************/
+int phase_interfaces(unsigned char *vox, int xsize, int ysize, int zsize,
+                     int nids, int *count, int *pair, int *surfvox,
+                     int nthreads) {
+  int a, b, t, nt, ix;
+  int part[CENSUSTABLES][CENSUSIDS];
+  size_t plane, ncol, tsize;
+  int *tabs;
+  unsigned char *difs;
+  Facerowfn face_row;
+
+  if (nids > CENSUSIDS)
+    nids = CENSUSIDS;
+
+  face_row = face_row_pick();
+
+  nt = 1;
+#ifdef _OPENMP
+  nt = (nthreads > 0) ? nthreads : omp_get_max_threads();
+  if (nt > xsize)
+    nt = xsize;
+  if (nt < 1)
+    nt = 1;
+#endif
+
+  /***
+   *    Per thread: CENSUSTABLES voxel tables, the pair table and
+   *    the surface voxel table, and one row of face marks
+   ***/
+
+  tsize = (size_t)(CENSUSTABLES + 1) * CENSUSIDS +
+          (size_t)CENSUSIDS * CENSUSIDS;
+  tabs = (int *)calloc((size_t)nt * tsize, sizeof(int));
+  difs = (unsigned char *)malloc((size_t)nt * zsize);
+  if (!tabs || !difs) {
+    free(tabs);
+    free(difs);
+    return (-1);
+  }
+
+  plane = (size_t)ysize * (size_t)zsize;
+  ncol = (size_t)zsize;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(static)
+#endif
+  for (ix = 0; ix < xsize; ix++) {
+    int iy, iz, tid;
+    int(*vpart)[CENSUSIDS];
+    int *ptab, *stab;
+    unsigned char *row, *xp, *xm, *yp, *ym, *dif;
+
+    tid = 0;
+#ifdef _OPENMP
+    tid = omp_get_thread_num();
+#endif
+    vpart = (int(*)[CENSUSIDS])(tabs + (size_t)tid * tsize);
+    stab = tabs + (size_t)tid * tsize + (size_t)CENSUSTABLES * CENSUSIDS;
+    ptab = stab + CENSUSIDS;
+    dif = difs + (size_t)tid * zsize;
+
+    for (iy = 0; iy < ysize; iy++) {
+      row = vox + (size_t)ix * plane + (size_t)iy * ncol;
+      xp = vox + (size_t)((ix < xsize - 1) ? ix + 1 : 0) * plane +
+           (size_t)iy * ncol;
+      xm = vox + (size_t)((ix > 0) ? ix - 1 : xsize - 1) * plane +
+           (size_t)iy * ncol;
+      yp = vox + (size_t)ix * plane +
+           (size_t)((iy < ysize - 1) ? iy + 1 : 0) * ncol;
+      ym = vox + (size_t)ix * plane +
+           (size_t)((iy > 0) ? iy - 1 : ysize - 1) * ncol;
+
+      census_row(row, ncol, vpart);
+
+      if (!face_row(row, xp, xm, yp, ym, zsize, dif))
+        continue;
+
+      for (iz = 0; iz < zsize; iz++) {
+        if (!dif[iz])
+          continue;
+        if (dif[iz] & 1)
+          ptab[row[iz] * CENSUSIDS + xp[iz]]++;
+        if (dif[iz] & 2)
+          ptab[row[iz] * CENSUSIDS + yp[iz]]++;
+        if (dif[iz] & 4)
+          ptab[row[iz] * CENSUSIDS + row[(iz < zsize - 1) ? iz + 1 : 0]]++;
+        stab[row[iz]]++;
+      }
+    }
+  }
+
+  /* Add the threads' tables together */
+
+  memset(part, 0, sizeof(part));
+  for (a = 0; a < nids * nids; a++) {
+    pair[a] = 0;
+  }
+  if (surfvox) {
+    for (a = 0; a < nids; a++) {
+      surfvox[a] = 0;
+    }
+  }
+  for (t = 0; t < nt; t++) {
+    for (a = 0; a < CENSUSTABLES * CENSUSIDS; a++) {
+      part[a / CENSUSIDS][a % CENSUSIDS] += tabs[(size_t)t * tsize + a];
+    }
+    if (surfvox) {
+      for (a = 0; a < nids; a++) {
+        surfvox[a] +=
+            tabs[(size_t)t * tsize + (size_t)CENSUSTABLES * CENSUSIDS + a];
+      }
+    }
+    for (a = 0; a < nids; a++) {
+      for (b = 0; b < nids; b++) {
+        pair[a * nids + b] +=
+            tabs[(size_t)t * tsize + (size_t)(CENSUSTABLES + 1) * CENSUSIDS +
+                 a * CENSUSIDS + b];
+      }
+    }
+  }
+
+  /* Each face was counted for one order of its pair only */
+
+  for (a = 0; a < nids; a++) {
+    for (b = a + 1; b < nids; b++) {
+      pair[a * nids + b] += pair[b * nids + a];
+      pair[b * nids + a] = pair[a * nids + b];
+    }
+  }
+
+  free(difs);
+  free(tabs);
+
+  return (census_sum(part, nids, count));
+}
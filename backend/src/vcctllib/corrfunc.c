@@ -0,0 +1,266 @@
+/******************************************************************************
+ *	Two-point correlation and chord-length distributions of a phase
+ *	in a periodic three-dimensional image, for calibrating the
+ *	correlation files that genmic's rand3d reads.
+ *
+ *	The phase and, optionally, a domain (such as the clinker solids
+ *	the phase is part of) are given as masks in C order, with the
+ *	phase inside the domain.  The correlation S2(r) is the chance
+ *	that two points a distance r apart are both in the phase, given
+ *	that both are in the domain: the autocorrelation of the phase
+ *	divided by that of the domain, each summed over all
+ *	displacements that round to r.  Both autocorrelations come from
+ *	one complex FFT (phase as the real part, domain as the
+ *	imaginary part) and one inverse, instead of a sum over every
+ *	pair of voxels.
+ *
+ *	Chords are the runs of phase voxels along the x, y and z lines
+ *	of the image, with periodic ends.  The lineal path L(l) is the
+ *	chance that l consecutive voxels along a line are all in the
+ *	phase, given that they are all in the domain.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******************************************************************************
+ *	Function twopoint finds the two-point correlation of a phase
+ *
+ * 	Arguments:	unsigned char pointer to the phase mask, nonzero
+ * 				in the phase (C order, z varies fastest)
+ * 				unsigned char pointer to the domain mask, or
+ * 				NULL for the whole image
+ * 				int xsize, ysize, zsize
+ * 				int largest distance rmax (voxels)
+ * 				double pointer to s2[0..rmax], zero where no
+ * 				pair of domain voxels is that far apart
+ * 				int number of threads for the FFT
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int twopoint(unsigned char *in, unsigned char *dom, int xsize, int ysize,
+             int zsize, int rmax, double *s2, int nthreads) {
+  int ix, iy, iz, jx, jy, jz, dx, dy, dz, r;
+  size_t n, m, nvox;
+  double ar, ai, br, bi, pa, pd, *ca, *cd;
+  Fft3d ft;
+
+  if (fft3d_alloc(&ft, xsize, ysize, zsize, nthreads))
+    return (1);
+
+  ca = (double *)calloc(2 * ((size_t)rmax + 1), sizeof(double));
+  if (!ca) {
+    fft3d_free(&ft);
+    return (1);
+  }
+  cd = ca + rmax + 1;
+
+  nvox = (size_t)xsize * ysize * zsize;
+  for (n = 0; n < nvox; n++) {
+    ft.data[2 * n] = in[n] ? 1.0 : 0.0;
+    ft.data[2 * n + 1] = (!dom || dom[n]) ? 1.0 : 0.0;
+  }
+
+  fft3d_forward(&ft);
+
+  /***
+   *    With Z = FA + i FD, the two spectra at k and -k are
+   *    FA(k) = (Z(k) + conj Z(-k)) / 2 and
+   *    FD(k) = (Z(k) - conj Z(-k)) / 2i.
+   *    Put |FA|^2 + i |FD|^2 at both k and -k, so the inverse
+   *    has the two autocorrelations as its real and imaginary parts.
+   ***/
+
+  for (ix = 0; ix < xsize; ix++) {
+    jx = (ix > 0) ? xsize - ix : 0;
+    for (iy = 0; iy < ysize; iy++) {
+      jy = (iy > 0) ? ysize - iy : 0;
+      for (iz = 0; iz < zsize; iz++) {
+        jz = (iz > 0) ? zsize - iz : 0;
+        n = ((size_t)ix * ysize + iy) * zsize + iz;
+        m = ((size_t)jx * ysize + jy) * zsize + jz;
+        if (m < n)
+          continue;
+        ar = ft.data[2 * n] + ft.data[2 * m];
+        ai = ft.data[2 * n + 1] - ft.data[2 * m + 1];
+        br = ft.data[2 * n] - ft.data[2 * m];
+        bi = ft.data[2 * n + 1] + ft.data[2 * m + 1];
+        pa = 0.25 * (ar * ar + ai * ai);
+        pd = 0.25 * (br * br + bi * bi);
+        ft.data[2 * n] = ft.data[2 * m] = pa;
+        ft.data[2 * n + 1] = ft.data[2 * m + 1] = pd;
+      }
+    }
+  }
+
+  fft3d_inverse(&ft);
+
+  /* Average over the displacements at each rounded distance */
+
+  for (ix = 0; ix < xsize; ix++) {
+    dx = (ix <= xsize / 2) ? ix : xsize - ix;
+    for (iy = 0; iy < ysize; iy++) {
+      dy = (iy <= ysize / 2) ? iy : ysize - iy;
+      for (iz = 0; iz < zsize; iz++) {
+        dz = (iz <= zsize / 2) ? iz : zsize - iz;
+        r = (int)(sqrt((double)(dx * dx + dy * dy + dz * dz)) + 0.5);
+        if (r > rmax)
+          continue;
+        n = ((size_t)ix * ysize + iy) * zsize + iz;
+        ca[r] += ft.data[2 * n];
+        cd[r] += ft.data[2 * n + 1];
+      }
+    }
+  }
+
+  for (r = 0; r <= rmax; r++) {
+    s2[r] = (cd[r] > 0.5 * (double)nvox) ? ca[r] / cd[r] : 0.0;
+  }
+
+  free(ca);
+  fft3d_free(&ft);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function linerun adds the runs along one line of the image to
+ *	the counts: chords of the phase, and for the lineal path the
+ *	number of places l consecutive voxels fit in a run of the
+ *	phase and in a run of the domain.  A line entirely in one
+ *	set is periodic, so l voxels fit at every one of its n places.
+ *
+ * 	Arguments:	unsigned char pointers to the phase and domain
+ * 				masks at the start of the line (domain may be
+ * 				NULL)
+ * 				size_t stride along the line
+ * 				int length n of the line
+ * 				int largest length maxlen
+ * 				double pointers to the chord counts and the
+ * 				two sets of fit counts, [0..maxlen]
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void linerun(unsigned char *in, unsigned char *dom, size_t stride,
+                    int n, int maxlen, double *nchord, double *fa,
+                    double *fd) {
+  int set, i, i0, len, l, first, inset;
+  double *fit;
+
+  for (set = 0; set < 2; set++) {
+    fit = set ? fd : fa;
+
+    /* Start just after a voxel outside the set, if there is one */
+
+    first = -1;
+    for (i = 0; i < n && first < 0; i++) {
+      inset = set ? (!dom || dom[i * stride]) : (in[i * stride] != 0);
+      if (!inset)
+        first = i;
+    }
+
+    if (first < 0) {
+      for (l = 1; l <= maxlen; l++) {
+        fit[l] += (double)n;
+      }
+      continue;
+    }
+
+    len = 0;
+    for (i0 = 1; i0 <= n; i0++) {
+      i = (first + i0) % n;
+      inset = set ? (!dom || dom[i * stride]) : (in[i * stride] != 0);
+      if (inset) {
+        len++;
+        continue;
+      }
+      if (len > 0) {
+        if (!set)
+          nchord[(len < maxlen) ? len : maxlen] += 1.0;
+        for (l = 1; l <= len && l <= maxlen; l++) {
+          fit[l] += (double)(len - l + 1);
+        }
+      }
+      len = 0;
+    }
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function chords finds the chord-length distribution and the
+ *	lineal path of a phase along the three axes
+ *
+ * 	Arguments:	unsigned char pointer to the phase mask, nonzero
+ * 				in the phase (C order, z varies fastest)
+ * 				unsigned char pointer to the domain mask, or
+ * 				NULL for the whole image
+ * 				int xsize, ysize, zsize
+ * 				int largest length maxlen (voxels); longer
+ * 				chords are counted at maxlen
+ * 				double pointer to the chord counts,
+ * 				nchord[0..maxlen]
+ * 				double pointer to the lineal path,
+ * 				lineal[0..maxlen] (lineal[0] is 1)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int chords(unsigned char *in, unsigned char *dom, int xsize, int ysize,
+           int zsize, int maxlen, double *nchord, double *lineal) {
+  int ix, iy, iz, l;
+  size_t plane, base;
+  double *fa, *fd;
+
+  fa = (double *)calloc(2 * ((size_t)maxlen + 1), sizeof(double));
+  if (!fa)
+    return (1);
+  fd = fa + maxlen + 1;
+
+  for (l = 0; l <= maxlen; l++) {
+    nchord[l] = 0.0;
+  }
+
+  plane = (size_t)ysize * zsize;
+
+  /* Lines along x */
+
+  for (iy = 0; iy < ysize; iy++) {
+    for (iz = 0; iz < zsize; iz++) {
+      base = (size_t)iy * zsize + iz;
+      linerun(in + base, dom ? dom + base : NULL, plane, xsize, maxlen,
+              nchord, fa, fd);
+    }
+  }
+
+  /* Lines along y */
+
+  for (ix = 0; ix < xsize; ix++) {
+    for (iz = 0; iz < zsize; iz++) {
+      base = (size_t)ix * plane + iz;
+      linerun(in + base, dom ? dom + base : NULL, (size_t)zsize, ysize,
+              maxlen, nchord, fa, fd);
+    }
+  }
+
+  /* Lines along z */
+
+  for (ix = 0; ix < xsize; ix++) {
+    for (iy = 0; iy < ysize; iy++) {
+      base = (size_t)ix * plane + (size_t)iy * zsize;
+      linerun(in + base, dom ? dom + base : NULL, 1, zsize, maxlen, nchord,
+              fa, fd);
+    }
+  }
+
+  lineal[0] = 1.0;
+  for (l = 1; l <= maxlen; l++) {
+    lineal[l] = (fd[l] > 0.0) ? fa[l] / fd[l] : 0.0;
+  }
+
+  free(fa);
+
+  return (0);
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+ *	Choice of the instruction set for the kernels of vcctllib that
+ *	are built in more than one variant (see CPUGENERIC in vcctl.h).
+ *
+ *	cpu_level asks the processor once what it has and keeps the
+ *	answer, so a kernel can pick its variant each time it is
+ *	called for the cost of a compare.  The environment variable
+ *	VCCTL_SIMD lowers the level, for comparing the variants of a
+ *	kernel on one machine; a name it does not know, or a level the
+ *	processor lacks, leaves the level as found.
+ *
+ *	The first call should come before any threads are started;
+ *	the kernels make it before their parallel loops.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+
+static int Cpulevel = -1;
+
+/******************************************************************************
+ *	Function cpu_detect finds the best level the processor has
+ *
+ * 	Arguments:	None
+ *
+ *	Returns:	int level (CPUGENERIC, CPUNEON, CPUAVX2 or CPUAVX512)
+ ******************************************************************************/
+static int cpu_detect(void) {
+#if VCCTL_X86SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return (CPUAVX512);
+  if (__builtin_cpu_supports("avx2"))
+    return (CPUAVX2);
+  return (CPUGENERIC);
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+  return (CPUNEON);
+#else
+  return (CPUGENERIC);
+#endif
+}
+
+/******************************************************************************
+ *	Function cpu_level gives the level the variants of the kernels
+ *	are chosen by: the best the processor has, or the one asked for
+ *	with VCCTL_SIMD if the processor has it
+ *
+ * 	Arguments:	None
+ *
+ *	Returns:	int level (CPUGENERIC, CPUNEON, CPUAVX2 or CPUAVX512)
+ ******************************************************************************/
+int cpu_level(void) {
+  int found, want;
+  char *env;
+
+  if (Cpulevel >= 0)
+    return (Cpulevel);
+
+  found = cpu_detect();
+  want = found;
+  env = getenv("VCCTL_SIMD");
+  if (env) {
+    if (!strcmp(env, "generic")) {
+      want = CPUGENERIC;
+    } else if (!strcmp(env, "neon") && found == CPUNEON) {
+      want = CPUNEON;
+    } else if (!strcmp(env, "avx2") && found >= CPUAVX2) {
+      want = CPUAVX2;
+    } else if (!strcmp(env, "avx512") && found == CPUAVX512) {
+      want = CPUAVX512;
+    }
+  }
+
+  Cpulevel = want;
+  return (Cpulevel);
+}
+
+/******************************************************************************
+ *	Function cpu_levelname gives the name of a level, as used in
+ *	VCCTL_SIMD
+ *
+ * 	Arguments:	int level
+ *
+ *	Returns:	char pointer to the name
+ ******************************************************************************/
+const char *cpu_levelname(int level) {
+  switch (level) {
+  case CPUNEON:
+    return ("neon");
+  case CPUAVX2:
+    return ("avx2");
+  case CPUAVX512:
+    return ("avx512");
+  default:
+    return ("generic");
+  }
+}
@@ -0,0 +1,397 @@
+/******************************************************************************
+ *	Discrete Fourier transform of a periodic three-dimensional
+ *	image of any size, for the convolutions that are otherwise
+ *	done with a sum over a template at every pixel.
+ *
+ *	The caller allocates an Fft3d with fft3d_alloc, fills its
+ *	data with FFTRE and FFTIM, and calls fft3d_forward or
+ *	fft3d_inverse as often as it likes.  Each axis is done with
+ *	a mixed-radix Cooley-Tukey transform over the factors of its
+ *	length; factors of 2 get their own butterfly, and any other
+ *	factor a direct sum, so a prime length still works, only
+ *	more slowly.  The inverse is not scaled: a forward and an
+ *	inverse transform multiply the data by the number of pixels.
+ *
+ *	When the library is built with OpenMP, the lines along each
+ *	axis are shared out among the threads given to fft3d_alloc,
+ *	each with its own scratch space.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
+/******************************************************************************
+ *	Function fftcombine puts together p sub-transforms of length m,
+ *	stored one after another in out, into one transform of length
+ *	p*m, with a butterfly for p of 2 and a direct sum otherwise.
+ *	The body is built once for each level of cpu_level, and
+ *	fftcombine_pick gives the variant to use; all the variants do
+ *	the same operations in the same order, so the result does not
+ *	depend on the variant.
+ *
+ * 	Arguments:	double pointer to the sub-transforms (2pm values)
+ * 				int number p of sub-transforms
+ * 				int length m of each
+ * 				double pointer to the twiddle factors of the
+ * 				full length
+ * 				int step through the twiddle factors
+ * 				int sign of the exponent (-1 forward, +1
+ * 				inverse)
+ * 				double pointer to scratch for one butterfly
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+VCCTL_KERNEL void fftcombine_body(double *out, int p, int m, const double *tw,
+                                  int twstep, int sign, double *t) {
+  int j, k, q;
+  size_t idx;
+  double wr, wi, xr, xi, sr, si;
+
+  if (p == 2) {
+    for (k = 0; k < m; k++) {
+      idx = (size_t)k * twstep;
+      wr = tw[2 * idx];
+      wi = sign * tw[2 * idx + 1];
+      xr = out[2 * (m + k)] * wr - out[2 * (m + k) + 1] * wi;
+      xi = out[2 * (m + k)] * wi + out[2 * (m + k) + 1] * wr;
+      out[2 * (m + k)] = out[2 * k] - xr;
+      out[2 * (m + k) + 1] = out[2 * k + 1] - xi;
+      out[2 * k] += xr;
+      out[2 * k + 1] += xi;
+    }
+    return;
+  }
+
+  for (k = 0; k < m; k++) {
+    for (j = 0; j < p; j++) {
+      idx = (size_t)j * k * twstep;
+      wr = tw[2 * idx];
+      wi = sign * tw[2 * idx + 1];
+      xr = out[2 * ((size_t)j * m + k)];
+      xi = out[2 * ((size_t)j * m + k) + 1];
+      t[2 * j] = xr * wr - xi * wi;
+      t[2 * j + 1] = xr * wi + xi * wr;
+    }
+    for (q = 0; q < p; q++) {
+      sr = si = 0.0;
+      for (j = 0; j < p; j++) {
+        idx = (size_t)((j * q) % p) * m * twstep;
+        wr = tw[2 * idx];
+        wi = sign * tw[2 * idx + 1];
+        sr += t[2 * j] * wr - t[2 * j + 1] * wi;
+        si += t[2 * j] * wi + t[2 * j + 1] * wr;
+      }
+      out[2 * ((size_t)q * m + k)] = sr;
+      out[2 * ((size_t)q * m + k) + 1] = si;
+    }
+  }
+
+  return;
+}
+
+typedef void (*Fftcombfn)(double *, int, int, const double *, int, int,
+                          double *);
+
+static void fftcombine_generic(double *out, int p, int m, const double *tw,
+                               int twstep, int sign, double *t) {
+  fftcombine_body(out, p, m, tw, twstep, sign, t);
+}
+
+/* AVX-512 brings FMA with it, which would round differently */
+
+#if VCCTL_X86SIMD
+VCCTL_TARGET_AVX2 static void fftcombine_avx2(double *out, int p, int m,
+                                              const double *tw, int twstep,
+                                              int sign, double *t) {
+  fftcombine_body(out, p, m, tw, twstep, sign, t);
+}
+#endif
+
+/******************************************************************************
+ *	Function fftcombine_pick gives the variant of fftcombine built
+ *	for the level of cpu_level, the AVX2 one for AVX-512 as well
+ *
+ * 	Arguments:	None
+ *
+ *	Returns:	Fftcombfn pointer to the variant
+ ******************************************************************************/
+static Fftcombfn fftcombine_pick(void) {
+  switch (cpu_level()) {
+#if VCCTL_X86SIMD
+  case CPUAVX512:
+  case CPUAVX2:
+    return (fftcombine_avx2);
+#endif
+  default:
+    return (fftcombine_generic);
+  }
+}
+
+/******************************************************************************
+ *	Function fftstep does one transform of length n, reading
+ *	the input with a stride and writing the output contiguously.
+ *	The sub-transforms over every fac[0]-th element are done
+ *	first, by recursion, and then put together with fftcombine.
+ *
+ * 	Arguments:	double pointer to output (2n values)
+ * 				double pointer to input
+ * 				int length n
+ * 				size_t stride of the input, in complex values
+ * 				int pointer to the factors of n
+ * 				double pointer to the twiddle factors of the
+ * 				full length
+ * 				int step through the twiddle factors
+ * 				int sign of the exponent (-1 forward, +1
+ * 				inverse)
+ * 				double pointer to scratch for one butterfly
+ * 				Fftcombfn variant of fftcombine to use
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void fftstep(double *out, const double *in, int n, size_t stride,
+                    const int *fac, const double *tw, int twstep, int sign,
+                    double *t, Fftcombfn comb) {
+  int p, m, j;
+
+  p = fac[0];
+  m = n / p;
+
+  if (m == 1) {
+    for (j = 0; j < p; j++) {
+      out[2 * j] = in[2 * j * stride];
+      out[2 * j + 1] = in[2 * j * stride + 1];
+    }
+  } else {
+    for (j = 0; j < p; j++) {
+      fftstep(out + 2 * (size_t)j * m, in + 2 * (size_t)j * stride, m,
+              stride * p, fac + 1, tw, twstep * p, sign, t, comb);
+    }
+  }
+
+  comb(out, p, m, tw, twstep, sign, t);
+
+  return;
+}
+
+/******************************************************************************
+ *	Function fftaxis_alloc factors the length of one axis and
+ *	makes its twiddle factors and scratch space
+ *
+ * 	Arguments:	Fftaxis pointer to fill
+ * 				int length
+ * 				int number of threads to make scratch for
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+static int fftaxis_alloc(Fftaxis *fa, int n, int nthreads) {
+  int i, r, f;
+
+  fa->n = n;
+  fa->nfac = 0;
+  fa->tw = NULL;
+  fa->buf = NULL;
+
+  /* Factors of 2 first, then the odd ones in increasing order */
+
+  r = n;
+  for (f = 2; r > 1 && fa->nfac < FFTMAXFAC - 1;) {
+    if (r % f == 0) {
+      fa->fac[fa->nfac++] = f;
+      r /= f;
+    } else {
+      f = (f == 2) ? 3 : f + 2;
+      if (f * f > r)
+        f = r;
+    }
+  }
+  if (r > 1)
+    fa->fac[fa->nfac++] = r;
+
+  fa->tw = (double *)malloc(2 * (size_t)n * sizeof(double));
+  fa->buf = (double *)malloc(6 * (size_t)n * nthreads * sizeof(double));
+  if (!fa->tw || !fa->buf) {
+    free(fa->tw);
+    free(fa->buf);
+    fa->tw = fa->buf = NULL;
+    return (1);
+  }
+
+  for (i = 0; i < n; i++) {
+    fa->tw[2 * i] = cos(2.0 * PI * (double)i / (double)n);
+    fa->tw[2 * i + 1] = sin(2.0 * PI * (double)i / (double)n);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function fft3d_alloc makes a transform for an image of
+ *	xsize*ysize*zsize pixels, with the data set to zero
+ *
+ * 	Arguments:	Fft3d pointer to fill
+ * 				int xsize, ysize, zsize
+ * 				int number of threads for the transforms
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int fft3d_alloc(Fft3d *ft, int xsize, int ysize, int zsize, int nthreads) {
+  int a, status;
+
+  ft->xsize = xsize;
+  ft->ysize = ysize;
+  ft->zsize = zsize;
+  ft->nthreads = (nthreads > 1) ? nthreads : 1;
+  ft->data = (double *)calloc(2 * (size_t)xsize * (size_t)ysize *
+                                  (size_t)zsize,
+                              sizeof(double));
+
+  status = (ft->data == NULL);
+  status |= fftaxis_alloc(&ft->ax[0], xsize, ft->nthreads);
+  status |= fftaxis_alloc(&ft->ax[1], ysize, ft->nthreads);
+  status |= fftaxis_alloc(&ft->ax[2], zsize, ft->nthreads);
+
+  if (status) {
+    fft3d_free(ft);
+    return (1);
+  }
+
+  for (a = 0; a < 3; a++) {
+    if (ft->ax[a].nfac == 0)
+      ft->ax[a].fac[ft->ax[a].nfac++] = 1;
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function fft3d_run transforms the data along each axis in
+ *	turn, one line at a time through the scratch space of the
+ *	thread doing the line
+ *
+ * 	Arguments:	Fft3d pointer
+ * 				int sign of the exponent (-1 forward, +1
+ * 				inverse)
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void fft3d_run(Fft3d *ft, int sign) {
+  int a, n, i, j, l, ni, nj, line;
+  size_t base, stride, si, sj;
+  double *in, *out, *d;
+  Fftaxis *fa;
+  Fftcombfn comb;
+
+  comb = fftcombine_pick();
+  d = ft->data;
+  for (a = 0; a < 3; a++) {
+    fa = &ft->ax[a];
+    n = fa->n;
+    if (n < 2)
+      continue;
+
+    /* The two other axes, and the strides of all three */
+
+    if (a == 0) {
+      ni = ft->ysize;
+      nj = ft->zsize;
+      si = (size_t)ft->zsize;
+      sj = 1;
+      stride = (size_t)ft->ysize * ft->zsize;
+    } else if (a == 1) {
+      ni = ft->xsize;
+      nj = ft->zsize;
+      si = (size_t)ft->ysize * ft->zsize;
+      sj = 1;
+      stride = (size_t)ft->zsize;
+    } else {
+      ni = ft->xsize;
+      nj = ft->ysize;
+      si = (size_t)ft->ysize * ft->zsize;
+      sj = (size_t)ft->zsize;
+      stride = 1;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(ft->nthreads) schedule(static)           \
+    private(i, j, l, base, in, out)
+#endif
+    for (line = 0; line < ni * nj; line++) {
+#ifdef _OPENMP
+      in = fa->buf + 6 * (size_t)n * omp_get_thread_num();
+#else
+      in = fa->buf;
+#endif
+      out = in + 2 * (size_t)n;
+      i = line / nj;
+      j = line % nj;
+      base = (size_t)i * si + (size_t)j * sj;
+      for (l = 0; l < n; l++) {
+        in[2 * l] = d[2 * (base + l * stride)];
+        in[2 * l + 1] = d[2 * (base + l * stride) + 1];
+      }
+      fftstep(out, in, n, 1, fa->fac, fa->tw, 1, sign, out + 2 * (size_t)n,
+              comb);
+      for (l = 0; l < n; l++) {
+        d[2 * (base + l * stride)] = out[2 * l];
+        d[2 * (base + l * stride) + 1] = out[2 * l + 1];
+      }
+    }
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function fft3d_forward replaces the data with its transform,
+ *	with exponent -2 pi i k x / n
+ *
+ * 	Arguments:	Fft3d pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void fft3d_forward(Fft3d *ft) {
+  fft3d_run(ft, -1);
+  return;
+}
+
+/******************************************************************************
+ *	Function fft3d_inverse replaces the data with its inverse
+ *	transform, with exponent +2 pi i k x / n and no scaling
+ *
+ * 	Arguments:	Fft3d pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void fft3d_inverse(Fft3d *ft) {
+  fft3d_run(ft, 1);
+  return;
+}
+
+/******************************************************************************
+ *	Function fft3d_free releases everything fft3d_alloc made
+ *
+ * 	Arguments:	Fft3d pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void fft3d_free(Fft3d *ft) {
+  int a;
+
+  for (a = 0; a < 3; a++) {
+    free(ft->ax[a].tw);
+    free(ft->ax[a].buf);
+    ft->ax[a].tw = ft->ax[a].buf = NULL;
+  }
+  free(ft->data);
+  ft->data = NULL;
+
+  return;
+}
@@ -0,0 +1,142 @@
+/******************************************************************************
+ *	Collection of functions to hand microstructure images from one
+ *	program to the next in memory, as genmic and disrealnew do with
+ *	--handoff name, instead of through image files.
+ *
+ *	Each image is held in a POSIX shared memory segment (shm_open)
+ *	named after the handoff and the kind of image, /name.img or
+ *	/name.pimg, laid out exactly as a raw binary image file (see
+ *	binimg.c).  The writer creates the segment at its full length,
+ *	and the reader opens it and removes its name at once, so a
+ *	segment lasts from the writer to the one reader it was made
+ *	for.  Both get an ordinary stream over the segment (fmemopen),
+ *	so the image is written and read by the same code as a binary
+ *	image file; handoff_close closes the stream and unmaps the
+ *	segment.
+ *
+ *	There are no segments on Windows.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define HANDOFFMAX 4
+
+/* Segments with a stream open over them */
+
+static struct {
+  FILE *fp;
+  void *map;
+  size_t len;
+} Handoff[HANDOFFMAX];
+
+/******************************************************************************
+ *	Function handoff_open opens one image of a handoff: for writing
+ *	if a length is given, creating or replacing the segment, and
+ *	otherwise for reading, removing the name of the segment
+ *
+ * 	Arguments:	char name of the handoff
+ * 				char kind of image ("img" or "pimg")
+ * 				size_t length of the image in bytes, or 0 to read
+ *
+ *	Returns:	FILE pointer to a stream over the segment, or NULL if
+ *				it cannot be opened
+ ******************************************************************************/
+FILE *handoff_open(char *name, char *kind, size_t len) {
+#if !defined(_WIN32)
+  int i, fd, writing;
+  void *p;
+  char shm[MAXSTRING];
+  struct stat sb;
+  FILE *fp;
+
+  for (i = 0; i < HANDOFFMAX && Handoff[i].fp; i++)
+    ;
+  if (i == HANDOFFMAX)
+    return (NULL);
+
+  /* shm_open wants one leading slash and no others */
+
+  snprintf(shm, sizeof(shm), "%s%s.%s", (name[0] == '/') ? "" : "/", name,
+           kind);
+
+  writing = (len > 0);
+  if (writing) {
+    fd = shm_open(shm, O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (fd < 0)
+      return (NULL);
+    if (ftruncate(fd, (off_t)len)) {
+      close(fd);
+      shm_unlink(shm);
+      return (NULL);
+    }
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  } else {
+    fd = shm_open(shm, O_RDONLY, 0);
+    if (fd < 0)
+      return (NULL);
+    shm_unlink(shm);
+    if (fstat(fd, &sb) || sb.st_size <= 0) {
+      close(fd);
+      return (NULL);
+    }
+    len = (size_t)sb.st_size;
+    p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (p == MAP_FAILED)
+    return (NULL);
+
+  fp = fmemopen(p, len, writing ? "wb" : "rb");
+  if (!fp) {
+    munmap(p, len);
+    return (NULL);
+  }
+
+  Handoff[i].fp = fp;
+  Handoff[i].map = p;
+  Handoff[i].len = len;
+  return (fp);
+#else
+  (void)name;
+  (void)kind;
+  (void)len;
+  return (NULL);
+#endif
+}
+
+/******************************************************************************
+ *	Function handoff_close closes a stream opened by handoff_open
+ *	and unmaps its segment, or closes any other stream
+ *
+ * 	Arguments:	FILE pointer
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the stream could not
+ *				be written to the end)
+ ******************************************************************************/
+int handoff_close(FILE *fp) {
+  int i, status;
+
+  for (i = 0; i < HANDOFFMAX && Handoff[i].fp != fp; i++)
+    ;
+  status = (fclose(fp) != 0);
+
+#if !defined(_WIN32)
+  if (i < HANDOFFMAX) {
+    munmap(Handoff[i].map, Handoff[i].len);
+    Handoff[i].fp = NULL;
+    Handoff[i].map = NULL;
+    Handoff[i].len = 0;
+  }
+#endif
+
+  return (status);
+}
@@ -0,0 +1,191 @@
+/******************************************************************************
+ *	Streaming reader and writer of the ids of an image, one x plane
+ *	at a time.
+ *
+ *	Programs that only need to look at each voxel once, such as
+ *	converters and filters, can use them instead of holding the
+ *	whole image.  The reader takes ASCII images of any integer ids
+ *	(phase or particle ids), read in large blocks and parsed by
+ *	hand, and binary images of the uint8 and uint32 formats (see
+ *	binimg.c), and gives the raw ids either way; phase ids still
+ *	need convert_id.  The writer puts out phase ids as an ASCII
+ *	image or a uint8 binary image.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define IDREADBLOCK 65536 /* bytes read per fread of an ASCII image */
+#define IDMAXDIGITS 9     /* longest ASCII id, so that it fits an int */
+#define IDWRITEBLOCK 4096 /* bytes of ASCII ids written per fwrite */
+
+/******************************************************************************
+ *	Function idreader_open gets ready to read an image whose header
+ *	has been read by read_imgheader_fmt
+ *
+ * 	Arguments:	Idreader pointer to fill
+ * 				file pointer, positioned at the first voxel
+ * 				int format from the header
+ * 				size_t number of voxels in an x plane
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the format cannot
+ *				be read or out of memory)
+ ******************************************************************************/
+int idreader_open(Idreader *rd, FILE *fpin, int format, size_t nplane) {
+  rd->fp = fpin;
+  rd->format = format;
+  rd->nplane = nplane;
+  rd->n = rd->pos = 0;
+  rd->buf = NULL;
+
+  switch (format) {
+  case IMG_ASCII:
+    rd->buf = (unsigned char *)malloc(IDREADBLOCK);
+    break;
+  case IMG_UINT8:
+  case IMG_UINT8Z:
+    rd->buf = (unsigned char *)malloc(nplane);
+    break;
+  case IMG_UINT32:
+  case IMG_UINT32Z:
+    rd->buf = (unsigned char *)malloc(4 * nplane);
+    break;
+  default:
+    return (1);
+  }
+
+  return (rd->buf ? 0 : 1);
+}
+
+/******************************************************************************
+ *	Function idreader_plane reads the ids of the next x plane, in
+ *	C order
+ *
+ * 	Arguments:	Idreader pointer
+ * 				int pointer to nplane ids to fill
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the image is short,
+ *				holds something other than ids, or cannot be
+ *				read)
+ ******************************************************************************/
+int idreader_plane(Idreader *rd, int *ids) {
+  size_t i;
+  int val, neg, ndigit;
+  unsigned char c, *b;
+
+  if (rd->format == IMG_UINT8 || rd->format == IMG_UINT8Z) {
+    if (read_binplane(rd->fp, rd->buf, rd->nplane, rd->format))
+      return (1);
+    for (i = 0; i < rd->nplane; i++)
+      ids[i] = (int)rd->buf[i];
+    return (0);
+  }
+
+  if (rd->format == IMG_UINT32 || rd->format == IMG_UINT32Z) {
+    if (read_binplane(rd->fp, rd->buf, 4 * rd->nplane, rd->format))
+      return (1);
+    for (i = 0, b = rd->buf; i < rd->nplane; i++, b += 4) {
+      ids[i] = (int)((unsigned int)b[0] | ((unsigned int)b[1] << 8) |
+                     ((unsigned int)b[2] << 16) | ((unsigned int)b[3] << 24));
+    }
+    return (0);
+  }
+
+  i = 0;
+  val = neg = ndigit = 0;
+  while (i < rd->nplane) {
+    if (rd->pos == rd->n) {
+      rd->n = fread(rd->buf, 1, IDREADBLOCK, rd->fp);
+      rd->pos = 0;
+      if (rd->n == 0) {
+
+        /* The last id may end at the end of the file */
+
+        if (ndigit && i == rd->nplane - 1) {
+          ids[i] = neg ? -val : val;
+          return (0);
+        }
+        return (1);
+      }
+    }
+    c = rd->buf[rd->pos++];
+    if (c >= '0' && c <= '9') {
+      if (++ndigit > IDMAXDIGITS)
+        return (1);
+      val = 10 * val + (int)(c - '0');
+    } else if (c == '-' && !ndigit && !neg) {
+      neg = 1;
+    } else if (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+               c == '\f') {
+      if (ndigit) {
+        ids[i++] = neg ? -val : val;
+        val = neg = ndigit = 0;
+      } else if (neg) {
+        return (1);
+      }
+    } else {
+      return (1);
+    }
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function idreader_close releases what idreader_open allocated.
+ *	The file is left open.
+ *
+ * 	Arguments:	Idreader pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void idreader_close(Idreader *rd) {
+  if (rd->buf)
+    free(rd->buf);
+  rd->buf = NULL;
+
+  return;
+}
+
+/******************************************************************************
+ *	Function write_idplane writes the phase ids of one x plane, in
+ *	C order, after the header of an image.  An ASCII image has each
+ *	id on its own line, starting with a newline, as written after
+ *	write_imgheader.
+ *
+ * 	Arguments:	file pointer (opened with "wb" for a binary image)
+ * 				unsigned char pointer to the ids of the plane
+ * 				size_t number of ids in the plane
+ * 				int format (IMG_ASCII, IMG_UINT8 or IMG_UINT8Z)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int write_idplane(FILE *fpout, unsigned char *plane, size_t nplane,
+                  int format) {
+  int id;
+  size_t m, nout;
+  char out[IDWRITEBLOCK];
+
+  if (format != IMG_ASCII)
+    return (write_binplane(fpout, plane, nplane, format));
+
+  nout = 0;
+  for (m = 0; m < nplane; m++) {
+    if (nout > IDWRITEBLOCK - 4) {
+      if (fwrite(out, 1, nout, fpout) != nout)
+        return (1);
+      nout = 0;
+    }
+    id = plane[m];
+    out[nout++] = '\n';
+    if (id >= 100)
+      out[nout++] = (char)('0' + id / 100);
+    if (id >= 10)
+      out[nout++] = (char)('0' + (id / 10) % 10);
+    out[nout++] = (char)('0' + id % 10);
+  }
+  if (nout && fwrite(out, 1, nout, fpout) != nout)
+    return (1);
+
+  return (0);
+}
@@ -9,6 +9,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define PNGSTRIPMIN 65536 /* fewest filtered bytes worth a strip */
+#define PNGWINDOW 32768   /* bytes of history deflate can refer to */
 
 /******************************************************************************
  *	Function cemcolors assigns colors of cement paste phases into
@@ -440,6 +448,25 @@ pixel_t *pixel_at(bitmap_t *bitmap, int x, int y) {
  *       For more information, visit http://www.lemoda.net/c/write-png/
  ******************************************************************************/
 int save_png_to_file(bitmap_t *bitmap, const char *path) {
+  return (save_png_level(bitmap, path, -1));
+}
+
+/******************************************************************************
+ *	Function to write a bitmap to a PNG file with a given zlib
+ *	compression level.  Level 0 or 1 also uses only the "up" row
+ *	filter rather than trying each filter on every row.  Rows of
+ *	a magnified image repeat, so this costs little in size and
+ *	writes a movie's frames several times faster than the default
+ *	level.
+ *
+ * 	Arguments:	pointer to bitmap_t structure
+ *			const char pointer to path string
+ *			int compression level (0 to 9, or -1 for the
+ *			libpng default)
+ *
+ *	Returns:	0 on success, non-zero on error
+ ******************************************************************************/
+int save_png_level(bitmap_t *bitmap, const char *path, int level) {
   FILE *fp;
   png_structp png_ptr = NULL;
   png_infop info_ptr = NULL;
@@ -484,6 +511,12 @@ int save_png_to_file(bitmap_t *bitmap, const char *path) {
                PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
                PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
+  if (level >= 0) {
+    png_set_compression_level(png_ptr, (level > 9) ? 9 : level);
+    if (level <= 1)
+      png_set_filter(png_ptr, 0, PNG_FILTER_UP);
+  }
+
   /* Initialize rows of PNG. */
 
   row_pointers = png_malloc(png_ptr, bitmap->height * sizeof(png_byte *));
@@ -523,3 +556,302 @@ png_create_write_struct_failed:
 fopen_failed:
   return status;
 }
+
+/******************************************************************************
+ *	Function pngput32 puts a 32-bit number in the big-endian order of
+ *	a PNG file
+ ******************************************************************************/
+static void pngput32(unsigned char *b, unsigned long v) {
+  b[0] = (unsigned char)((v >> 24) & 0xff);
+  b[1] = (unsigned char)((v >> 16) & 0xff);
+  b[2] = (unsigned char)((v >> 8) & 0xff);
+  b[3] = (unsigned char)(v & 0xff);
+}
+
+/******************************************************************************
+ *	Function pngchunk writes one chunk of a PNG file: its length, its
+ *	type, its data and the CRC of the type and data
+ ******************************************************************************/
+static int pngchunk(FILE *fp, const char *type, const unsigned char *data,
+                    size_t n) {
+  unsigned char b[4];
+  uLong crc;
+
+  if (n > 0x7fffffffUL)
+    return (1);
+  crc = crc32(0L, (const Bytef *)type, 4);
+  if (n > 0)
+    crc = crc32(crc, data, (uInt)n);
+
+  pngput32(b, (unsigned long)n);
+  if (fwrite(b, 1, 4, fp) != 4 || fwrite(type, 1, 4, fp) != 4)
+    return (1);
+  if (n > 0 && fwrite(data, 1, n, fp) != n)
+    return (1);
+  pngput32(b, (unsigned long)crc);
+
+  return (fwrite(b, 1, 4, fp) != 4);
+}
+
+/******************************************************************************
+ *	Function pngpredict gives what PNG filter type f predicts for byte
+ *	i of a row of three-byte pixels, from the row above (zero for the
+ *	first row) and the bytes before it
+ ******************************************************************************/
+static int pngpredict(int f, const unsigned char *cur,
+                      const unsigned char *prev, size_t i) {
+  int a, b, c, p, pa, pb, pc;
+
+  a = (i >= 3) ? cur[i - 3] : 0;
+  b = prev ? prev[i] : 0;
+  c = (prev && i >= 3) ? prev[i - 3] : 0;
+  switch (f) {
+  case 1:
+    return (a);
+  case 2:
+    return (b);
+  case 3:
+    return ((a + b) / 2);
+  case 4:
+    p = a + b - c;
+    pa = abs(p - a);
+    pb = abs(p - b);
+    pc = abs(p - c);
+    return ((pa <= pb && pa <= pc) ? a : ((pb <= pc) ? b : c));
+  default:
+    return (0);
+  }
+}
+
+/******************************************************************************
+ *	Function pngfilter filters one row of a PNG image into its filter
+ *	byte and n filtered bytes.  Unless only the "up" filter is asked
+ *	for, the filter is the one whose bytes, taken as signed, have the
+ *	smallest sum of magnitudes, as libpng chooses it.
+ ******************************************************************************/
+static void pngfilter(const unsigned char *cur, const unsigned char *prev,
+                      size_t n, int uponly, unsigned char *out) {
+  int f, best;
+  size_t i;
+  unsigned long sum, bestsum = 0;
+
+  best = 2;
+  for (f = 0; !uponly && f <= 4; f++) {
+    sum = 0;
+    for (i = 0; i < n; i++) {
+      sum += abs((signed char)(cur[i] - pngpredict(f, cur, prev, i)));
+    }
+    if (f == 0 || sum < bestsum) {
+      best = f;
+      bestsum = sum;
+    }
+  }
+
+  out[0] = (unsigned char)best;
+  for (i = 0; i < n; i++) {
+    out[i + 1] = (unsigned char)(cur[i] - pngpredict(best, cur, prev, i));
+  }
+}
+
+/******************************************************************************
+ *	Function to write a bitmap to a PNG file with a given zlib
+ *	compression level, using several threads for one image.  The
+ *	rows are filtered in parallel, and the filtered image is cut
+ *	into strips of rows that are deflated in parallel.  Each strip
+ *	is primed with the 32 kB before it as its dictionary, and all
+ *	but the last end on a byte boundary (a sync flush), so that the
+ *	strips laid end to end are one deflate stream, and their
+ *	checksums are combined into the one of the whole stream.  The
+ *	file holds the same pixels as save_png_level would write, a few
+ *	bytes larger for each strip.  Level 0 or 1 uses only the "up"
+ *	row filter, as in save_png_level.
+ *
+ *	An image too small to be worth cutting up, or one thread, is
+ *	handed to save_png_level.
+ *
+ * 	Arguments:	pointer to bitmap_t structure
+ *			const char pointer to path string
+ *			int compression level (0 to 9, or -1 for the
+ *			zlib default)
+ *			int number of threads
+ *
+ *	Returns:	0 on success, non-zero on error
+ ******************************************************************************/
+int save_png_threads(bitmap_t *bitmap, const char *path, int level,
+                     int nthreads) {
+  FILE *fp;
+  int s, nstrip, zlevel, flevel, status = -1;
+  int *err = NULL;
+  long y;
+  size_t rowbytes, total, rows, *first = NULL, *len = NULL;
+  unsigned char *filt = NULL, **out = NULL, head[13];
+  uLong adler, *sadler = NULL;
+  static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+  rowbytes = 3 * bitmap->width;
+  total = (rowbytes + 1) * bitmap->height;
+  nstrip = (int)(total / PNGSTRIPMIN);
+  if (nstrip > nthreads)
+    nstrip = nthreads;
+  if (nstrip > (int)bitmap->height)
+    nstrip = (int)bitmap->height;
+  if (nstrip < 2)
+    return (save_png_level(bitmap, path, level));
+
+  zlevel = (level < 0) ? Z_DEFAULT_COMPRESSION : ((level > 9) ? 9 : level);
+
+  filt = (unsigned char *)malloc(total);
+  out = (unsigned char **)calloc(nstrip, sizeof(unsigned char *));
+  first = (size_t *)malloc(nstrip * sizeof(size_t));
+  len = (size_t *)malloc(nstrip * sizeof(size_t));
+  sadler = (uLong *)malloc(nstrip * sizeof(uLong));
+  err = (int *)calloc(nstrip, sizeof(int));
+  if (!filt || !out || !first || !len || !sadler || !err)
+    goto png_threads_done;
+
+  /* Filter the rows, each from the unfiltered row above it */
+
+#pragma omp parallel for num_threads(nthreads) schedule(static)
+  for (y = 0; y < (long)bitmap->height; y++) {
+    pngfilter((const unsigned char *)pixel_at(bitmap, 0, (int)y),
+              (y > 0) ? (const unsigned char *)pixel_at(bitmap, 0, (int)y - 1)
+                      : NULL,
+              rowbytes, (level >= 0 && level <= 1), filt + y * (rowbytes + 1));
+  }
+
+  /***
+   *	Deflate the strips, raw, with room in the first for the
+   *	zlib header and in the last for the checksum
+   ***/
+
+#pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+  for (s = 0; s < nstrip; s++) {
+    size_t b0, b1, back, cap;
+    unsigned char *o;
+    int flush;
+    z_stream zs;
+
+    b0 = (bitmap->height * s / nstrip) * (rowbytes + 1);
+    b1 = (bitmap->height * (s + 1) / nstrip) * (rowbytes + 1);
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, zlevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) !=
+        Z_OK) {
+      err[s] = 1;
+      continue;
+    }
+    cap = deflateBound(&zs, (uLong)(b1 - b0)) + 16;
+    o = (unsigned char *)malloc(cap + 6);
+    out[s] = o;
+    if (!o) {
+      deflateEnd(&zs);
+      err[s] = 1;
+      continue;
+    }
+    if (s > 0) {
+      back = (b0 > PNGWINDOW) ? PNGWINDOW : b0;
+      deflateSetDictionary(&zs, filt + b0 - back, (uInt)back);
+    }
+
+    first[s] = (s == 0) ? 2 : 0;
+    zs.next_in = filt + b0;
+    zs.avail_in = (uInt)(b1 - b0);
+    zs.next_out = o + first[s];
+    zs.avail_out = (uInt)cap;
+    flush = (s == nstrip - 1) ? Z_FINISH : Z_SYNC_FLUSH;
+    if (deflate(&zs, flush) != ((flush == Z_FINISH) ? Z_STREAM_END : Z_OK) ||
+        zs.avail_in > 0)
+      err[s] = 1;
+    len[s] = first[s] + (cap - zs.avail_out);
+    deflateEnd(&zs);
+    sadler[s] = adler32(adler32(0L, Z_NULL, 0), filt + b0, (uInt)(b1 - b0));
+  }
+
+  for (s = 0; s < nstrip; s++) {
+    if (err[s])
+      goto png_threads_done;
+  }
+
+  /***
+   *	The zlib header says how hard the stream was compressed,
+   *	and the checksum of the whole stream comes from those of
+   *	the strips
+   ***/
+
+  flevel = (zlevel == Z_DEFAULT_COMPRESSION || zlevel == 6)
+               ? 2
+               : ((zlevel < 2) ? 0 : ((zlevel < 6) ? 1 : 3));
+  out[0][0] = 0x78;
+  out[0][1] = (unsigned char)(flevel << 6);
+  out[0][1] += (unsigned char)(31 - (0x78 * 256 + out[0][1]) % 31);
+  adler = sadler[0];
+  for (s = 1; s < nstrip; s++) {
+    rows = bitmap->height * (s + 1) / nstrip - bitmap->height * s / nstrip;
+    adler = adler32_combine(adler, sadler[s], (z_off_t)(rows * (rowbytes + 1)));
+  }
+  pngput32(out[nstrip - 1] + len[nstrip - 1], (unsigned long)adler);
+  len[nstrip - 1] += 4;
+
+  /* Write the file, one IDAT chunk for each strip */
+
+  fp = fopen(path, "wb");
+  if (!fp)
+    goto png_threads_done;
+  pngput32(head, (unsigned long)bitmap->width);
+  pngput32(head + 4, (unsigned long)bitmap->height);
+  head[8] = 8;  /* bit depth */
+  head[9] = 2;  /* RGB */
+  head[10] = 0; /* deflate */
+  head[11] = 0; /* adaptive filtering */
+  head[12] = 0; /* not interlaced */
+  status = (fwrite(signature, 1, 8, fp) != 8) || pngchunk(fp, "IHDR", head, 13);
+  for (s = 0; !status && s < nstrip; s++) {
+    status = pngchunk(fp, "IDAT", out[s], len[s]);
+  }
+  if (!status)
+    status = pngchunk(fp, "IEND", NULL, 0);
+  if (fclose(fp))
+    status = 1;
+  if (status)
+    status = -1;
+
+png_threads_done:
+  for (s = 0; out && s < nstrip; s++) {
+    free(out[s]);
+  }
+  free(out);
+  free(filt);
+  free(first);
+  free(len);
+  free(sadler);
+  free(err);
+  return status;
+}
+
+/******************************************************************************
+ *	Function to write a bitmap to a binary (P6) PPM file specified
+ *	by path.  A bitmap's pixels are already three bytes each, in
+ *	the order a P6 file keeps them, so they are written as they are.
+ *
+ * 	Arguments:	pointer to bitmap_t structure
+ *			const char pointer to path string
+ *
+ *	Returns:	0 on success, non-zero on error
+ ******************************************************************************/
+int save_ppm_to_file(bitmap_t *bitmap, const char *path) {
+  size_t n;
+  FILE *fp;
+
+  fp = fopen(path, "wb");
+  if (!fp)
+    return (-1);
+
+  n = bitmap->width * bitmap->height;
+  fprintf(fp, "P6\n%d %d\n%d\n", (int)bitmap->width, (int)bitmap->height,
+          SAT);
+  if (fwrite(bitmap->pixels, sizeof(pixel_t), n, fp) != n) {
+    fclose(fp);
+    return (-1);
+  }
+
+  return ((fclose(fp) == 0) ? 0 : -1);
+}
@@ -0,0 +1,320 @@
+/******************************************************************************
+ *	Collection of functions to keep only a window of the layers of a
+ *	microstructure in memory, for the attack models (chlorattack3d,
+ *	sulfattack3d --window) on specimens too deep to hold whole.
+ *
+ *	The input is a raw binary image (see binimg.c), memory mapped
+ *	read-only, and the output is a raw binary image of the same size
+ *	made with create_binimg.  The window is a box of short ints with
+ *	one column per (x, y), like those of sibox, holding the layers
+ *	zlow to zhigh of the whole image.  Each column pointer is offset
+ *	by zlow, as the vectors of Numerical Recipes are by their lowest
+ *	index, so that the programs index the window with the layer in
+ *	the whole image and need not know where it starts.
+ *
+ *	The window only moves down: layers that leave it at the top go
+ *	out to the output image, and layers that join it at the bottom
+ *	come in from the input image, their ids passed through convert_id
+ *	for the version of the input.  Layer 0 holds the top id and layer
+ *	zsize + 1 the bottom id, as the boundary layers of the attack
+ *	models do.  Layers the window never reached are copied from the
+ *	input to the output when the window is closed.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+/******************************************************************************
+ *	Function layerpos gives the place of a voxel of layers 1 to zsize
+ *	in the input and output images
+ ******************************************************************************/
+static size_t layerpos(Layerwin *w, int ix, int iy, int iz) {
+  if (w->order == LAYERWIN_ZSLOW)
+    return (((size_t)(iz - 1) * w->ysize + iy) * w->xsize + ix);
+
+  return (((size_t)ix * w->ysize + iy) * w->zsize + (iz - 1));
+}
+
+/******************************************************************************
+ *	Function layerout writes one layer of the window to the output
+ *	image
+ ******************************************************************************/
+static void layerout(Layerwin *w, int iz) {
+  int ix, iy;
+
+  if (iz < 1 || iz > w->zsize)
+    return;
+
+  for (ix = 0; ix < w->xsize; ix++) {
+    for (iy = 0; iy < w->ysize; iy++) {
+      w->out.vox[layerpos(w, ix, iy, iz)] = (unsigned char)w->mic[ix][iy][iz];
+    }
+  }
+}
+
+/******************************************************************************
+ *	Function layercopy copies one layer the window never held from
+ *	the input image to the output image
+ ******************************************************************************/
+static void layercopy(Layerwin *w, int iz) {
+  int ix, iy;
+  size_t n;
+
+  if (iz < 1 || iz > w->zsize)
+    return;
+
+  for (ix = 0; ix < w->xsize; ix++) {
+    for (iy = 0; iy < w->ysize; iy++) {
+      n = layerpos(w, ix, iy, iz);
+      w->out.vox[n] = (unsigned char)w->table[w->in.vox[n]];
+    }
+  }
+}
+
+/******************************************************************************
+ *	Function layerwin_open opens a window on a microstructure, with no
+ *	layers in it yet
+ *
+ * 	Arguments:	Layerwin pointer to fill
+ * 				char pointer to name of input image (raw binary)
+ * 				char pointer to name of output image
+ * 				int order of the voxels in the images
+ * 				(LAYERWIN_ZFAST or LAYERWIN_ZSLOW)
+ * 				int ids of the top and bottom boundary layers
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the input is not a raw
+ *				binary image that can be mapped, or the output
+ *				cannot be made)
+ ******************************************************************************/
+int layerwin_open(Layerwin *w, char *inname, char *outname, int order,
+                  int top, int bottom) {
+  int i, id, ix;
+
+  memset(w, 0, sizeof(Layerwin));
+  w->zhigh = -1;
+
+  if (map_binimg(inname, &w->in))
+    return (1);
+  if (!w->in.mapped) {
+    unmap_binimg(&w->in);
+    return (1);
+  }
+
+  w->xsize = w->in.xsize;
+  w->ysize = w->in.ysize;
+  w->zsize = w->in.zsize;
+  w->order = order;
+  w->top = top;
+  w->bottom = bottom;
+  for (i = 0; i < 256; i++) {
+    id = convert_id(i, w->in.ver);
+    w->table[i] = (id >= 0 && id <= 255) ? id : -1;
+  }
+
+  if (create_binimg(outname, w->xsize, w->ysize, w->zsize, w->in.res,
+                    &w->out)) {
+    unmap_binimg(&w->in);
+    return (1);
+  }
+
+  w->mic = (short int ***)calloc(w->xsize, sizeof(short int **));
+  w->react = (short int ***)calloc(w->xsize, sizeof(short int **));
+  if (!w->mic || !w->react) {
+    layerwin_free(w);
+    return (1);
+  }
+  for (ix = 0; ix < w->xsize; ix++) {
+    w->mic[ix] = (short int **)calloc(w->ysize, sizeof(short int *));
+    w->react[ix] = (short int **)calloc(w->ysize, sizeof(short int *));
+    if (!w->mic[ix] || !w->react[ix]) {
+      layerwin_free(w);
+      return (1);
+    }
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function layerwin_id gives the converted id of a voxel of the input
+ *	image, whether or not its layer is in the window
+ *
+ * 	Arguments:	Layerwin pointer
+ * 				int coordinates of the voxel, z from 0 to zsize + 1
+ *
+ *	Returns:	int phase id, or -1 if the input id cannot be converted
+ ******************************************************************************/
+int layerwin_id(Layerwin *w, int ix, int iy, int iz) {
+  if (iz <= 0)
+    return (w->top);
+  if (iz > w->zsize)
+    return (w->bottom);
+
+  return (w->table[w->in.vox[layerpos(w, ix, iy, iz)]]);
+}
+
+/******************************************************************************
+ *	Function layerwin_need moves the window so that it holds at least
+ *	the layers zlo to zhi.  The window never moves back up, so layers
+ *	above it that are asked for again are left out, and it never
+ *	shrinks at the bottom.  React is zero in the layers that come in.
+ *
+ * 	Arguments:	Layerwin pointer
+ * 				int first and last layer needed
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory, in
+ *				which case the window is as it was)
+ ******************************************************************************/
+int layerwin_need(Layerwin *w, int zlo, int zhi) {
+  int ix, iy, iz, n, newcap, keep, shift, first;
+  short int *mcol, *rcol;
+
+  if (zlo < w->zlow)
+    zlo = w->zlow;
+  if (zhi > w->zsize + 1)
+    zhi = w->zsize + 1;
+  if (zhi < w->zhigh)
+    zhi = w->zhigh;
+  if (zlo > zhi)
+    zlo = zhi;
+  if (zlo == w->zlow && zhi == w->zhigh)
+    return (0);
+
+  /* Make room first, so that running out of memory changes nothing */
+
+  n = zhi - zlo + 1;
+  if (n > w->cap) {
+    newcap = (2 * w->cap > n) ? 2 * w->cap : n;
+    if (newcap > w->zsize + 2)
+      newcap = w->zsize + 2;
+    for (ix = 0; ix < w->xsize; ix++) {
+      for (iy = 0; iy < w->ysize; iy++) {
+        mcol = (w->cap > 0) ? w->mic[ix][iy] + w->zlow : NULL;
+        rcol = (w->cap > 0) ? w->react[ix][iy] + w->zlow : NULL;
+        mcol = (short int *)realloc(mcol, newcap * sizeof(short int));
+        if (mcol)
+          w->mic[ix][iy] = mcol - w->zlow;
+        rcol = (short int *)realloc(rcol, newcap * sizeof(short int));
+        if (rcol)
+          w->react[ix][iy] = rcol - w->zlow;
+        if (!mcol || !rcol)
+          return (1);
+      }
+    }
+    w->cap = newcap;
+  }
+
+  /***
+   *	Layers that leave the window at the top go out, and any
+   *	that it skips over go straight from the input to the output
+   ***/
+
+  for (iz = w->zlow; iz < zlo; iz++) {
+    if (iz <= w->zhigh) {
+      layerout(w, iz);
+    } else {
+      layercopy(w, iz);
+    }
+  }
+
+  /***
+   *	Slide the layers that stay to the start of each column
+   *	and read in the new ones below them
+   ***/
+
+  shift = zlo - w->zlow;
+  keep = w->zhigh - zlo + 1;
+  first = (w->zhigh + 1 > zlo) ? w->zhigh + 1 : zlo;
+  for (ix = 0; ix < w->xsize; ix++) {
+    for (iy = 0; iy < w->ysize; iy++) {
+      mcol = w->mic[ix][iy] + w->zlow;
+      rcol = w->react[ix][iy] + w->zlow;
+      if (keep > 0 && shift > 0) {
+        memmove(mcol, mcol + shift, keep * sizeof(short int));
+        memmove(rcol, rcol + shift, keep * sizeof(short int));
+      }
+      for (iz = first; iz <= zhi; iz++) {
+        mcol[iz - zlo] = (short int)layerwin_id(w, ix, iy, iz);
+        rcol[iz - zlo] = 0;
+      }
+      w->mic[ix][iy] = mcol - zlo;
+      w->react[ix][iy] = rcol - zlo;
+    }
+  }
+
+  w->zlow = zlo;
+  w->zhigh = zhi;
+  if (n > w->maxheld)
+    w->maxheld = n;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function layerwin_close writes the layers still in the window, and
+ *	those it never reached, to the output image, and releases the
+ *	window
+ *
+ * 	Arguments:	Layerwin pointer
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the output image could
+ *				not be written)
+ ******************************************************************************/
+int layerwin_close(Layerwin *w) {
+  int iz, status = 0;
+
+  for (iz = w->zlow; iz <= w->zhigh; iz++) {
+    layerout(w, iz);
+  }
+  for (iz = (w->zhigh >= w->zlow) ? w->zhigh + 1 : w->zlow; iz <= w->zsize;
+       iz++) {
+    layercopy(w, iz);
+  }
+
+#if !defined(_WIN32)
+  if (msync(w->out.base, w->out.len, MS_SYNC))
+    status = 1;
+#endif
+
+  layerwin_free(w);
+  return (status);
+}
+
+/******************************************************************************
+ *	Function layerwin_free releases a window without writing anything
+ *	more to the output image
+ *
+ * 	Arguments:	Layerwin pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void layerwin_free(Layerwin *w) {
+  int ix, iy;
+
+  for (ix = 0; ix < w->xsize; ix++) {
+    for (iy = 0; iy < w->ysize; iy++) {
+      if (w->mic && w->mic[ix] && w->mic[ix][iy])
+        free(w->mic[ix][iy] + w->zlow);
+      if (w->react && w->react[ix] && w->react[ix][iy])
+        free(w->react[ix][iy] + w->zlow);
+    }
+    if (w->mic && w->mic[ix])
+      free(w->mic[ix]);
+    if (w->react && w->react[ix])
+      free(w->react[ix]);
+  }
+  if (w->mic)
+    free(w->mic);
+  if (w->react)
+    free(w->react);
+  w->mic = w->react = NULL;
+  w->cap = 0;
+
+  unmap_binimg(&w->in);
+  unmap_binimg(&w->out);
+}
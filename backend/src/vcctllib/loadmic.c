@@ -0,0 +1,163 @@
+/******************************************************************************
+ *	Functions to read a whole microstructure image, header and
+ *	voxels, into one contiguous buffer of phase ids in C order
+ *	(z varies fastest, then y, then x).
+ *
+ *	ASCII voxels are read in large blocks with fread and parsed by
+ *	hand instead of one fscanf call per voxel, and binary voxels
+ *	are read with read_binvoxels.  Either way every id is passed
+ *	through convert_id once per distinct value, using a lookup
+ *	table built for the version found in the header.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MICREADBLOCK 65536 /* bytes read per fread of an ASCII image */
+#define MICMAXID 255       /* largest id a voxel byte can hold */
+
+/******************************************************************************
+ *	Function make_idtable fills a lookup table with the converted
+ *	value of every id a voxel byte can hold, or -1 where
+ *	convert_id gives a value that does not fit in a byte
+ ******************************************************************************/
+static void make_idtable(int *table, float ver) {
+  int i, id;
+
+  for (i = 0; i <= MICMAXID; i++) {
+    id = convert_id(i, ver);
+    table[i] = (id >= 0 && id <= MICMAXID) ? id : -1;
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function read_micvoxels reads the voxels of an image from a
+ *	stream positioned just after the header (as left by
+ *	read_imgheader_fmt) and converts them with convert_id
+ *
+ * 	Arguments:	file pointer
+ * 				unsigned char pointer to xsize*ysize*zsize bytes
+ * 				int xsize, ysize, zsize
+ * 				float version from the header
+ * 				int format (IMG_ASCII, IMG_UINT8 or IMG_UINT8Z)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the image is short,
+ *				holds something other than phase ids, or
+ *				cannot be read)
+ ******************************************************************************/
+int read_micvoxels(FILE *fpin, unsigned char *vox, int xsize, int ysize,
+                   int zsize, float ver, int format) {
+  int table[MICMAXID + 1];
+  int val, intoken;
+  size_t i, n, nread, nvox;
+  unsigned char c, *buf;
+
+  if (!fpin || !vox)
+    return (1);
+
+  make_idtable(table, ver);
+  nvox = (size_t)xsize * (size_t)ysize * (size_t)zsize;
+
+  if (format != IMG_ASCII) {
+    if (read_binvoxels(fpin, vox, xsize, ysize, zsize, format))
+      return (1);
+    for (n = 0; n < nvox; n++) {
+      if (table[vox[n]] < 0)
+        return (1);
+      vox[n] = (unsigned char)table[vox[n]];
+    }
+    return (0);
+  }
+
+  buf = (unsigned char *)malloc(MICREADBLOCK);
+  if (!buf)
+    return (1);
+
+  n = 0;
+  val = 0;
+  intoken = 0;
+  while (n < nvox && (nread = fread(buf, 1, MICREADBLOCK, fpin)) > 0) {
+    for (i = 0; i < nread && n < nvox; i++) {
+      c = buf[i];
+      if (c >= '0' && c <= '9') {
+        val = 10 * val + (int)(c - '0');
+        if (val > MICMAXID) {
+          free(buf);
+          return (1);
+        }
+        intoken = 1;
+      } else if (c == ' ' || c == '\n' || c == '\r' || c == '\t' ||
+                 c == '\v' || c == '\f') {
+        if (intoken) {
+          if (table[val] < 0) {
+            free(buf);
+            return (1);
+          }
+          vox[n++] = (unsigned char)table[val];
+          val = 0;
+          intoken = 0;
+        }
+      } else {
+        free(buf);
+        return (1);
+      }
+    }
+  }
+
+  /* The last id may end at the end of the file */
+
+  if (intoken && n < nvox) {
+    if (table[val] < 0) {
+      free(buf);
+      return (1);
+    }
+    vox[n++] = (unsigned char)table[val];
+  }
+
+  free(buf);
+  return ((n == nvox) ? 0 : 1);
+}
+
+/******************************************************************************
+ *	Function load_microstructure reads the header and all the
+ *	voxels of an image from an open stream at the start of the
+ *	file.  The voxels go into a buffer chosen by the caller, which
+ *	is grown with realloc when it is too small for the image (so it
+ *	must be NULL or come from malloc).  A tool reading several
+ *	images of the same size can therefore reuse one buffer.
+ *
+ * 	Arguments:	file pointer (binary images need "rb" on Windows)
+ * 				pointer to unsigned char pointer to the buffer
+ * 				pointer to size_t buffer size in bytes
+ * 				pointer to float version
+ * 				pointer to int xsize, ysize, zsize
+ * 				pointer to float resolution
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int load_microstructure(FILE *fpin, unsigned char **vox, size_t *cap,
+                        float *ver, int *xsize, int *ysize, int *zsize,
+                        float *res) {
+  int format;
+  size_t nvox;
+  void *newp;
+
+  if (read_imgheader_fmt(fpin, ver, xsize, ysize, zsize, res, &format))
+    return (1);
+  if (*xsize < 1 || *ysize < 1 || *zsize < 1)
+    return (1);
+
+  nvox = (size_t)(*xsize) * (size_t)(*ysize) * (size_t)(*zsize);
+  if (*vox == NULL || *cap < nvox) {
+    newp = realloc(*vox, nvox);
+    if (!newp)
+      return (1);
+    *vox = (unsigned char *)newp;
+    *cap = nvox;
+  }
+
+  return (read_micvoxels(fpin, *vox, *xsize, *ysize, *zsize, *ver, format));
+}
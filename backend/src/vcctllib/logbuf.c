@@ -0,0 +1,196 @@
+/******************************************************************************
+ *	Buffered log files.  The programs write their logs with fprintf
+ *	and used to call fflush after nearly every message, which costs
+ *	one write to the file system each time; on a working directory
+ *	mounted over NFS that is a sizable part of a genmic run.
+ *
+ *	A log opened by log_open (or handed to log_attach) gets a stdio
+ *	buffer of LOGBUFSIZE bytes, and log_flush only empties it when
+ *	LOGFLUSHSECS seconds have gone by since it last did, so the log
+ *	still shows progress while the writes come in large blocks.
+ *	Everything buffered is written when the log is closed, when the
+ *	program exits, and when it is stopped by a signal such as
+ *	SIGSEGV, SIGABRT or SIGTERM, so a crash loses nothing.
+ *
+ *	Debugging messages belong in LOGDEBUG (vcctl.h), which is
+ *	compiled out below VCCTL_LOGLEVEL 1.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <signal.h>
+#include <time.h>
+
+#define LOGBUFSIZE (1 << 20)
+#define LOGFLUSHSECS 2
+#define LOGMAXFILES 8
+
+/***
+ *	The logs that are buffered, with their buffers and the time
+ *	each was last flushed
+ ***/
+static FILE *Logfp[LOGMAXFILES];
+static char *Logbuf[LOGMAXFILES];
+static time_t Logtime[LOGMAXFILES];
+static int Loghooked = 0;
+
+/***
+ *	log_flushall
+ *
+ *	Write out whatever every buffered log holds
+ *
+ * 	Arguments:	None
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	log_signal, and at exit
+ ***/
+static void log_flushall(void) {
+  int i;
+
+  for (i = 0; i < LOGMAXFILES; i++) {
+    if (Logfp[i])
+      fflush(Logfp[i]);
+  }
+
+  return;
+}
+
+/***
+ *	log_signal
+ *
+ *	Write out the logs when the program is stopped by a signal,
+ *	then let the signal take its usual course
+ *
+ * 	Arguments:	int signal number
+ * 	Returns:	Nothing
+ *
+ *	Calls:		log_flushall
+ *	Called by:	The signals hooked by log_attach
+ ***/
+static void log_signal(int sig) {
+  log_flushall();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/***
+ *	log_attach
+ *
+ *	Buffer a log that is already open.  The first call also hooks
+ *	the exit of the program and the signals that stop it, so that
+ *	the buffers are written out.
+ *
+ * 	Arguments:	FILE pointer to the log, which may be NULL
+ * 	Returns:	The same FILE pointer
+ *
+ *	Calls:		No other routines
+ *	Called by:	log_open, and programs with a log they open
+ *				themselves
+ ***/
+FILE *log_attach(FILE *fp) {
+  int i;
+
+  if (!fp)
+    return (fp);
+
+  if (!Loghooked) {
+    Loghooked = 1;
+    atexit(log_flushall);
+    signal(SIGSEGV, log_signal);
+    signal(SIGFPE, log_signal);
+    signal(SIGABRT, log_signal);
+    signal(SIGTERM, log_signal);
+    signal(SIGINT, log_signal);
+  }
+
+  for (i = 0; i < LOGMAXFILES && Logfp[i]; i++)
+    ;
+  if (i == LOGMAXFILES)
+    return (fp);
+
+  /* Without the memory for a buffer the log keeps the stdio default */
+
+  Logbuf[i] = (char *)malloc(LOGBUFSIZE);
+  if (Logbuf[i] && setvbuf(fp, Logbuf[i], _IOFBF, LOGBUFSIZE)) {
+    free(Logbuf[i]);
+    Logbuf[i] = NULL;
+  }
+  Logfp[i] = fp;
+  Logtime[i] = time(NULL);
+
+  return (fp);
+}
+
+/***
+ *	log_open
+ *
+ *	Open a log file, buffered as log_attach describes
+ *
+ * 	Arguments:	char pointer to the file name
+ * 				char pointer to the mode, as for fopen
+ * 	Returns:	FILE pointer, or NULL if it could not be opened
+ *
+ *	Calls:		log_attach
+ *	Called by:	disrealnew, elastic, genmic
+ ***/
+FILE *log_open(const char *name, const char *mode) {
+  return (log_attach(fopen(name, mode)));
+}
+
+/***
+ *	log_flush
+ *
+ *	Write out a log if LOGFLUSHSECS seconds have gone by since it
+ *	was last written out.  Any other stream is flushed at once,
+ *	as by fflush.
+ *
+ * 	Arguments:	FILE pointer to the log
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	disrealnew, elastic, genmic
+ ***/
+void log_flush(FILE *fp) {
+  int i;
+  time_t now;
+
+  for (i = 0; i < LOGMAXFILES && Logfp[i] != fp; i++)
+    ;
+  if (i == LOGMAXFILES || !fp) {
+    fflush(fp);
+    return;
+  }
+
+  now = time(NULL);
+  if (difftime(now, Logtime[i]) >= LOGFLUSHSECS) {
+    fflush(fp);
+    Logtime[i] = now;
+  }
+
+  return;
+}
+
+/***
+ *	log_close
+ *
+ *	Close a log, writing out what it holds and freeing its buffer
+ *
+ * 	Arguments:	FILE pointer to the log
+ * 	Returns:	0 if okay, EOF as for fclose otherwise
+ *
+ *	Calls:		No other routines
+ *	Called by:	disrealnew, elastic, genmic
+ ***/
+int log_close(FILE *fp) {
+  int i, status;
+
+  status = fclose(fp);
+  for (i = 0; i < LOGMAXFILES; i++) {
+    if (Logfp[i] == fp) {
+      free(Logbuf[i]);
+      Logbuf[i] = NULL;
+      Logfp[i] = NULL;
+    }
+  }
+
+  return (status);
+}
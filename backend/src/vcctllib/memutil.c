@@ -17,11 +17,372 @@
  * 	square = 2-D of equal dimensions
  * 	cube = 3-D of equal dimensions
  * 	box = 3-D of unequal dimensions in x,y,z
+ * 	grid = 3-D of unequal dimensions in x,y,z, stored in
+ * 	       one contiguous aligned block (see Gridinfo in
+ * 	       vcctl.h)
  *
  *******************************************************/
 #include "../include/vcctl.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/***
+ *	Accounting of the memory the routines below hand out, asked
+ *	for with the environment variable VCCTL_MEMSTATS (any value)
+ *	or VCCTL_MEMBUDGET (megabytes).  Every array is noted with
+ *	its size, elements and pointer tables together, under the tag
+ *	set with memtag or else the name of the routine that made it,
+ *	and forgotten when the matching free_ routine releases it.
+ *	memreport writes the current and peak bytes of each tag; with
+ *	VCCTL_MEMSTATS the report goes to stderr at exit as well.
+ *
+ *	With VCCTL_MEMBUDGET, an array that would take the total past
+ *	the budget is refused before anything is allocated, with a
+ *	message naming it, so an oversized run stops at the start
+ *	instead of when the system runs out.
+ *
+ *	Arrays released with plain free() stay counted.  Without
+ *	either variable nothing is kept and the cost is one test.
+ ***/
+#define MEMTAGS 64 /* most tags reported apart; the rest are "other" */
+
+/* Bytes of a 2D and a 3D array with its pointer tables */
+
+#define MEMRECT(x, y, el) ((x) * (sizeof(void *) + (y) * (el)))
+#define MEMBOX(x, y, z, el)                                                    \
+  ((x) * (sizeof(void *) + (y) * (sizeof(void *) + (z) * (el))))
+
+typedef struct {
+  const char *tag;
+  size_t cur, peak;
+  long nalloc;
+} Memtag;
+
+static int Memon = -1;
+static size_t Membudget = 0, Memcur = 0, Mempeak = 0;
+static const char *Memtagnow = NULL;
+static Memtag Memtags[MEMTAGS];
+static int Nmemtags = 0;
+static void **Memkey = NULL;
+static size_t *Memsize = NULL;
+static short *Memtagid = NULL;
+static size_t Memcap = 0, Memused = 0;
+
+static void memexit(void) { memreport(stderr); }
+
+/***
+ *	memstart
+ *
+ *	Routine to read the accounting variables the first time an
+ *	array is made
+ *
+ *	Arguments:	None
+ *	Returns:	int nonzero if arrays are accounted for
+ *
+ *	Calls:		no other routines
+ *	Called by:	memroom, memnote, memforget, mempeak
+ *
+ ***/
+static int memstart(void) {
+  char *env;
+  double mb;
+
+  if (Memon >= 0)
+    return (Memon);
+
+  Memon = 0;
+  env = getenv("VCCTL_MEMBUDGET");
+  if (env && (mb = atof(env)) > 0.0) {
+    Membudget = (size_t)(mb * 1048576.0);
+    Memon = 1;
+  }
+  if (getenv("VCCTL_MEMSTATS")) {
+    Memon = 1;
+    atexit(memexit);
+  }
+
+  return (Memon);
+}
+
+/***
+ *	memslot
+ *
+ *	Routine to find the slot of an array in the table of arrays,
+ *	or the empty slot where it would go, by linear probing from
+ *	the slot memhash gives it
+ *
+ *	Arguments:	Pointer to the array
+ *	Returns:	size_t slot
+ *
+ *	Calls:		memhash
+ *	Called by:	memnote, memforget
+ *
+ ***/
+static size_t memhash(void *p) {
+  return ((size_t)(((uint64_t)(uintptr_t)p >> 4) * 0x9e3779b97f4a7c15ULL >>
+                   32) &
+          (Memcap - 1));
+}
+
+static size_t memslot(void *p) {
+  size_t i;
+
+  for (i = memhash(p); Memkey[i] && Memkey[i] != p; i = (i + 1) & (Memcap - 1))
+    ;
+
+  return (i);
+}
+
+/***
+ *	memroom
+ *
+ *	Routine to see whether an array fits in the budget
+ *
+ *	Arguments:	size_t number of bytes
+ *	            char pointer to the name of the routine
+ *	Returns:	int 0 if it fits (or there is no budget), 1 if not
+ *
+ *	Calls:		memstart
+ *	Called by:	every routine that makes an array
+ *
+ ***/
+static int memroom(size_t nbytes, const char *name) {
+  if (!memstart() || !Membudget || Memcur + nbytes <= Membudget)
+    return (0);
+
+  printf("\n\nCould not allocate %.1f MB for %s%s%s: %.1f MB are in use "
+         "and VCCTL_MEMBUDGET is %.1f MB.",
+         nbytes / 1048576.0, name, Memtagnow ? " of " : "",
+         Memtagnow ? Memtagnow : "", Memcur / 1048576.0,
+         Membudget / 1048576.0);
+  fflush(stdout);
+
+  return (1);
+}
+
+/***
+ *	memnote
+ *
+ *	Routine to count an array just made under the current tag
+ *
+ *	Arguments:	Pointer to the array
+ *	            size_t number of bytes
+ *	            char pointer to the name of the routine
+ *	Returns:	nothing
+ *
+ *	Calls:		memstart, memslot
+ *	Called by:	every routine that makes an array
+ *
+ ***/
+static void memnote(void *p, size_t nbytes, const char *name) {
+  int t;
+  size_t i, j, cap, oldcap;
+  void **oldkey;
+  size_t *oldsize;
+  short *oldtag;
+  const char *tag;
+
+  if (!p || !memstart())
+    return;
+
+#ifdef _OPENMP
+#pragma omp critical(memutil)
+#endif
+  {
+    tag = Memtagnow ? Memtagnow : name;
+    for (t = 0; t < Nmemtags && strcmp(Memtags[t].tag, tag); t++)
+      ;
+    if (t == Nmemtags) {
+      if (Nmemtags < MEMTAGS - 1) {
+        Memtags[t].tag = tag;
+        Nmemtags++;
+      } else {
+        t = MEMTAGS - 1;
+        Memtags[t].tag = "other";
+      }
+    }
+
+    /* Keep the table of arrays at most half full */
+
+    if (2 * (Memused + 1) > Memcap) {
+      oldcap = Memcap;
+      oldkey = Memkey;
+      oldsize = Memsize;
+      oldtag = Memtagid;
+      cap = oldcap ? 2 * oldcap : 1024;
+      Memkey = (void **)calloc(cap, sizeof(void *));
+      Memsize = (size_t *)malloc(cap * sizeof(size_t));
+      Memtagid = (short *)malloc(cap * sizeof(short));
+      if (!Memkey || !Memsize || !Memtagid) {
+        free(Memkey);
+        free(Memsize);
+        free(Memtagid);
+        Memkey = oldkey;
+        Memsize = oldsize;
+        Memtagid = oldtag;
+      } else {
+        Memcap = cap;
+        for (i = 0; i < oldcap; i++) {
+          if (oldkey[i]) {
+            j = memslot(oldkey[i]);
+            Memkey[j] = oldkey[i];
+            Memsize[j] = oldsize[i];
+            Memtagid[j] = oldtag[i];
+          }
+        }
+        free(oldkey);
+        free(oldsize);
+        free(oldtag);
+      }
+    }
+
+    if (2 * (Memused + 1) <= Memcap) {
+      i = memslot(p);
+      if (!Memkey[i])
+        Memused++;
+      Memkey[i] = p;
+      Memsize[i] = nbytes;
+      Memtagid[i] = (short)t;
+    }
+
+    Memtags[t].cur += nbytes;
+    Memtags[t].nalloc++;
+    if (Memtags[t].cur > Memtags[t].peak)
+      Memtags[t].peak = Memtags[t].cur;
+    Memcur += nbytes;
+    if (Memcur > Mempeak)
+      Mempeak = Memcur;
+  }
+
+  return;
+}
+
+/***
+ *	memforget
+ *
+ *	Routine to stop counting an array about to be released.
+ *	Arrays the table does not know are ignored.
+ *
+ *	Arguments:	Pointer to the array
+ *	Returns:	nothing
+ *
+ *	Calls:		memslot, memhash
+ *	Called by:	every routine that releases an array
+ *
+ ***/
+static void memforget(void *p) {
+  size_t i, j, k;
+
+  if (!p || Memon <= 0 || !Memused)
+    return;
+
+#ifdef _OPENMP
+#pragma omp critical(memutil)
+#endif
+  {
+    i = memslot(p);
+    if (Memkey[i]) {
+      Memtags[Memtagid[i]].cur -= Memsize[i];
+      Memcur -= Memsize[i];
+      Memused--;
+
+      /* Move later entries of the run back into the hole */
+
+      for (j = (i + 1) & (Memcap - 1); Memkey[j]; j = (j + 1) & (Memcap - 1)) {
+        k = memhash(Memkey[j]);
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+          Memkey[i] = Memkey[j];
+          Memsize[i] = Memsize[j];
+          Memtagid[i] = Memtagid[j];
+          i = j;
+        }
+      }
+      Memkey[i] = NULL;
+    }
+  }
+
+  return;
+}
+
+/***
+ *	memtag
+ *
+ *	Routine to set the tag the following arrays are counted
+ *	under, until the next call.  The string is kept, not copied.
+ *
+ *	Arguments:	char pointer to the tag, or NULL for the name of
+ *	            the routine that makes each array
+ *	Returns:	nothing
+ *
+ *	Calls:		no other routines
+ *	Called by:	main routine
+ *
+ ***/
+void memtag(const char *tag) {
+  Memtagnow = tag;
+  return;
+}
+
+/***
+ *	mempeak
+ *
+ *	Routine to get the most bytes the arrays have held at once
+ *
+ *	Arguments:	None
+ *	Returns:	size_t bytes (0 without accounting)
+ *
+ *	Calls:		memstart
+ *	Called by:	main routine
+ *
+ ***/
+size_t mempeak(void) { return (memstart() ? Mempeak : 0); }
+
+/***
+ *	memreport
+ *
+ *	Routine to write the current and peak bytes of each tag,
+ *	and of all of them, if arrays are accounted for
+ *
+ *	Arguments:	FILE pointer
+ *	Returns:	nothing
+ *
+ *	Calls:		memstart
+ *	Called by:	main routine, at exit with VCCTL_MEMSTATS
+ *
+ ***/
+void memreport(FILE *fp) {
+  int t;
+
+  if (!fp || !memstart())
+    return;
+
+  fprintf(fp, "\nMemory of the arrays (MB): now, peak, number made");
+  for (t = 0; t < MEMTAGS; t++) {
+    if (Memtags[t].tag) {
+      fprintf(fp, "\n\t%-20s %10.1f %10.1f %8ld", Memtags[t].tag,
+              Memtags[t].cur / 1048576.0, Memtags[t].peak / 1048576.0,
+              Memtags[t].nalloc);
+    }
+  }
+  fprintf(fp, "\n\t%-20s %10.1f %10.1f", "all", Memcur / 1048576.0,
+          Mempeak / 1048576.0);
+  if (Membudget)
+    fprintf(fp, "\n\tbudget (VCCTL_MEMBUDGET) %.1f MB", Membudget / 1048576.0);
+  fprintf(fp, "\n");
+  fflush(fp);
+
+  return;
+}
 
 /***
  *	ivector
@@ -38,12 +399,17 @@
 int *ivector(size_t size) {
   int *iv;
 
+  if (memroom(size * sizeof(int), "ivector"))
+    return (NULL);
+
   iv = (int *)malloc(size * sizeof(int));
   if (!iv) {
     printf("\n\nCould not allocate space for int vector.");
     return (NULL);
   }
 
+  memnote(iv, size * sizeof(int), "ivector");
+
   return (iv);
 }
 
@@ -62,12 +428,17 @@ int *ivector(size_t size) {
 short int *sivector(size_t size) {
   short int *iv;
 
+  if (memroom(size * sizeof(short int), "sivector"))
+    return (NULL);
+
   iv = (short int *)malloc(size * sizeof(short int));
   if (!iv) {
     printf("\n\nCould not allocate space for short int vector.");
     return (NULL);
   }
 
+  memnote(iv, size * sizeof(short int), "sivector");
+
   return (iv);
 }
 
@@ -86,12 +457,17 @@ short int *sivector(size_t size) {
 long int *livector(size_t size) {
   long int *iv;
 
+  if (memroom(size * sizeof(long int), "livector"))
+    return (NULL);
+
   iv = (long int *)malloc(size * sizeof(long int));
   if (!iv) {
     printf("\n\nCould not allocate space for long int vector.");
     return (NULL);
   }
 
+  memnote(iv, size * sizeof(long int), "livector");
+
   return (iv);
 }
 
@@ -110,12 +486,17 @@ long int *livector(size_t size) {
 float *fvector(size_t size) {
   float *fv;
 
+  if (memroom(size * sizeof(float), "fvector"))
+    return (NULL);
+
   fv = (float *)malloc(size * sizeof(float));
   if (!fv) {
     printf("\n\nCould not allocate space for float vector.");
     return (NULL);
   }
 
+  memnote(fv, size * sizeof(float), "fvector");
+
   return (fv);
 }
 
@@ -134,12 +515,17 @@ float *fvector(size_t size) {
 double *dvector(size_t size) {
   double *dv;
 
+  if (memroom(size * sizeof(double), "dvector"))
+    return (NULL);
+
   dv = (double *)malloc(size * sizeof(double));
   if (!dv) {
     printf("\n\nCould not allocate space for double vector.");
     return (NULL);
   }
 
+  memnote(dv, size * sizeof(double), "dvector");
+
   return (dv);
 }
 
@@ -158,12 +544,17 @@ double *dvector(size_t size) {
 pixel_t *pixelvector(size_t size) {
   pixel_t *ptv;
 
+  if (memroom(size * sizeof(pixel_t), "pixelvector"))
+    return (NULL);
+
   ptv = (pixel_t *)malloc(size * sizeof(pixel_t));
   if (!ptv) {
     printf("\n\nCould not allocate space for pixel_t vector.");
     return (NULL);
   }
 
+  memnote(ptv, size * sizeof(pixel_t), "pixelvector");
+
   return (ptv);
 }
 
@@ -184,6 +575,9 @@ short int **sisquare(size_t size) {
   size_t i;
   short int **is;
 
+  if (memroom(MEMRECT(size, size, sizeof(short int)), "sisquare"))
+    return (NULL);
+
   is = (short int **)malloc(size * sizeof(*is));
   if (!is) {
     printf("\n\nCould not allocate space for row of sisquare.");
@@ -203,6 +597,8 @@ short int **sisquare(size_t size) {
     }
   }
 
+  memnote(is, MEMRECT(size, size, sizeof(short int)), "sisquare");
+
   return (is);
 }
 
@@ -223,6 +619,9 @@ short int **sirect(size_t xsize, size_t ysize) {
   size_t i;
   short int **is;
 
+  if (memroom(MEMRECT(xsize, ysize, sizeof(short int)), "sirect"))
+    return (NULL);
+
   is = (short int **)malloc(xsize * sizeof(*is));
   if (!is) {
     printf("\n\nCould not allocate space for row of sirect.");
@@ -242,6 +641,8 @@ short int **sirect(size_t xsize, size_t ysize) {
     }
   }
 
+  memnote(is, MEMRECT(xsize, ysize, sizeof(short int)), "sirect");
+
   return (is);
 }
 
@@ -262,6 +663,9 @@ int **irect(size_t xsize, size_t ysize) {
   size_t i;
   int **is;
 
+  if (memroom(MEMRECT(xsize, ysize, sizeof(int)), "irect"))
+    return (NULL);
+
   is = (int **)malloc(xsize * sizeof(*is));
   if (!is) {
     printf("\n\nCould not allocate space for row of irect.");
@@ -281,6 +685,8 @@ int **irect(size_t xsize, size_t ysize) {
     }
   }
 
+  memnote(is, MEMRECT(xsize, ysize, sizeof(int)), "irect");
+
   return (is);
 }
 
@@ -288,7 +694,9 @@ int **irect(size_t xsize, size_t ysize) {
  *	drect
  *
  *	Routine to allocate memory for an 2D rectangle array of doubles
- *	All array indices are assumed to start with zero.
+ *	All array indices are assumed to start with zero.  The elements
+ *	are in one contiguous block, row after row, so is[0] can also
+ *	be used as a vector of xsize*ysize doubles.
  *
  *	Arguments:	int number of elements in each dimension
  *	Returns:	Pointer to memory location of first element
@@ -299,27 +707,32 @@ int **irect(size_t xsize, size_t ysize) {
  ***/
 double **drect(size_t xsize, size_t ysize) {
   size_t i;
-  double **is;
+  double **is, *block;
+
+  if (memroom(MEMRECT(xsize, ysize, sizeof(double)), "drect"))
+    return (NULL);
 
-  is = (double **)malloc(xsize * sizeof(*is));
+  is = (double **)malloc((xsize > 0 ? xsize : 1) * sizeof(*is));
   if (!is) {
     printf("\n\nCould not allocate space for row of drect.");
     return (NULL);
   }
 
-  for (i = 0; i < xsize; ++i) {
-    is[i] = NULL;
+  block = (double *)malloc((xsize * ysize > 0 ? xsize * ysize : 1) *
+                           sizeof(*block));
+  if (!block) {
+    printf("\n\nCould not allocate space for column of drect.");
+    free(is);
+    return (NULL);
   }
 
+  is[0] = block;
   for (i = 0; i < xsize; ++i) {
-    is[i] = (double *)malloc(ysize * sizeof(*is[i]));
-    if (!is[i]) {
-      printf("\n\nCould not allocate space for column of drect.");
-      free_drect(is, xsize);
-      return (NULL);
-    }
+    is[i] = block + i * ysize;
   }
 
+  memnote(is, MEMRECT(xsize, ysize, sizeof(double)), "drect");
+
   return (is);
 }
 
@@ -340,6 +753,9 @@ char ***ccube(size_t size) {
   size_t i, j;
   char ***fc;
 
+  if (memroom(MEMBOX(size, size, size, sizeof(char)), "ccube"))
+    return (NULL);
+
   fc = (char ***)malloc(size * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of ccube.");
@@ -376,6 +792,8 @@ char ***ccube(size_t size) {
     }
   }
 
+  memnote(fc, MEMBOX(size, size, size, sizeof(char)), "ccube");
+
   return (fc);
 }
 
@@ -396,6 +814,9 @@ char ***cbox(size_t xsize, size_t ysize, size_t zsize) {
   size_t i, j;
   char ***fc;
 
+  if (memroom(MEMBOX(xsize, ysize, zsize, sizeof(char)), "cbox"))
+    return (NULL);
+
   fc = (char ***)malloc(xsize * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of cbox.");
@@ -432,6 +853,8 @@ char ***cbox(size_t xsize, size_t ysize, size_t zsize) {
     }
   }
 
+  memnote(fc, MEMBOX(xsize, ysize, zsize, sizeof(char)), "cbox");
+
   return (fc);
 }
 
@@ -452,6 +875,9 @@ short int ***sicube(size_t size) {
   size_t i, j;
   short int ***fc;
 
+  if (memroom(MEMBOX(size, size, size, sizeof(short int)), "sicube"))
+    return (NULL);
+
   fc = (short int ***)malloc(size * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of sicube.");
@@ -488,6 +914,8 @@ short int ***sicube(size_t size) {
     }
   }
 
+  memnote(fc, MEMBOX(size, size, size, sizeof(short int)), "sicube");
+
   return (fc);
 }
 
@@ -508,6 +936,9 @@ short int ***sibox(size_t xsize, size_t ysize, size_t zsize) {
   size_t i, j;
   short int ***fc;
 
+  if (memroom(MEMBOX(xsize, ysize, zsize, sizeof(short int)), "sibox"))
+    return (NULL);
+
   fc = (short int ***)malloc(xsize * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of sibox.");
@@ -544,6 +975,8 @@ short int ***sibox(size_t xsize, size_t ysize, size_t zsize) {
     }
   }
 
+  memnote(fc, MEMBOX(xsize, ysize, zsize, sizeof(short int)), "sibox");
+
   return (fc);
 }
 
@@ -564,6 +997,9 @@ float ***fcube(size_t size) {
   size_t i, j;
   float ***fc;
 
+  if (memroom(MEMBOX(size, size, size, sizeof(float)), "fcube"))
+    return (NULL);
+
   fc = (float ***)malloc(size * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of fcube.");
@@ -600,6 +1036,8 @@ float ***fcube(size_t size) {
     }
   }
 
+  memnote(fc, MEMBOX(size, size, size, sizeof(float)), "fcube");
+
   return (fc);
 }
 
@@ -620,6 +1058,9 @@ float ***fbox(size_t xsize, size_t ysize, size_t zsize) {
   size_t i, j;
   float ***fc;
 
+  if (memroom(MEMBOX(xsize, ysize, zsize, sizeof(float)), "fbox"))
+    return (NULL);
+
   fc = (float ***)malloc(xsize * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of fbox.");
@@ -656,6 +1097,8 @@ float ***fbox(size_t xsize, size_t ysize, size_t zsize) {
     }
   }
 
+  memnote(fc, MEMBOX(xsize, ysize, zsize, sizeof(float)), "fbox");
+
   return (fc);
 }
 
@@ -676,6 +1119,9 @@ double ***dbox(size_t xsize, size_t ysize, size_t zsize) {
   size_t i, j;
   double ***fc;
 
+  if (memroom(MEMBOX(xsize, ysize, zsize, sizeof(double)), "dbox"))
+    return (NULL);
+
   fc = (double ***)malloc(xsize * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of dbox.");
@@ -712,6 +1158,8 @@ double ***dbox(size_t xsize, size_t ysize, size_t zsize) {
     }
   }
 
+  memnote(fc, MEMBOX(xsize, ysize, zsize, sizeof(double)), "dbox");
+
   return (fc);
 }
 
@@ -732,6 +1180,9 @@ int ***icube(size_t size) {
   size_t i, j;
   int ***fc;
 
+  if (memroom(MEMBOX(size, size, size, sizeof(int)), "icube"))
+    return (NULL);
+
   fc = (int ***)malloc(size * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of icube.");
@@ -768,6 +1219,8 @@ int ***icube(size_t size) {
     }
   }
 
+  memnote(fc, MEMBOX(size, size, size, sizeof(int)), "icube");
+
   return (fc);
 }
 
@@ -788,6 +1241,9 @@ int ***ibox(size_t xsize, size_t ysize, size_t zsize) {
   size_t i, j;
   int ***fc;
 
+  if (memroom(MEMBOX(xsize, ysize, zsize, sizeof(int)), "ibox"))
+    return (NULL);
+
   fc = (int ***)malloc(xsize * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of ibox.");
@@ -824,6 +1280,8 @@ int ***ibox(size_t xsize, size_t ysize, size_t zsize) {
     }
   }
 
+  memnote(fc, MEMBOX(xsize, ysize, zsize, sizeof(int)), "ibox");
+
   return (fc);
 }
 
@@ -832,11 +1290,12 @@ int ***ibox(size_t xsize, size_t ysize, size_t zsize) {
  *
  *	Routine to allocate memory for an 3D array of ints
  *	All array indices are assumed to start with zero.
+ *	The elements are one aligned block (see alignedblock).
  *
  *	Arguments:	int number of elements in each dimension
- *	Returns:	Pointer to memory location of first element
+ *	Returns:	0 if okay, 1 otherwise
  *
- *	Calls:		no other routines
+ *	Calls:		alignedblock
  *	Called by:	main routine
  *
  ***/
@@ -845,10 +1304,15 @@ int Int3darray(Int3d *thing, size_t xsize, size_t ysize, size_t zsize) {
   thing->y = ysize;
   thing->z = zsize;
   thing->val = NULL;
-  thing->val = malloc(thing->x * thing->y * thing->z * sizeof(*thing->val));
+  if (memroom(xsize * ysize * zsize * sizeof(*thing->val), "Int3darray"))
+    return (1);
+  thing->val = (int *)alignedblock(thing->x * thing->y * thing->z *
+                                   sizeof(*thing->val));
   if (thing->val == NULL) {
     return (1);
   }
+  memnote(thing->val, xsize * ysize * zsize * sizeof(*thing->val),
+          "Int3darray");
   return (0);
 }
 
@@ -881,12 +1345,83 @@ size_t getInt3dindex(Int3d thing, size_t x, size_t y, size_t z) {
  *	Arguments:	int number of elements in each dimension
  *	Returns:	Pointer to memory location of first element
  *
- *	Calls:		no other routines
+ *	Calls:		free_alignedblock
  *	Called by:	main routine
  *
  ***/
 void free_Int3darray(Int3d *thing) {
-  free(thing->val);
+  memforget(thing->val);
+  free_alignedblock(thing->val);
+  thing->val = NULL;
+  return;
+}
+
+/***
+ *	UChar3darray
+ *
+ *	Routine to allocate memory for an 3D array of unsigned
+ *	chars, such as phase ids, laid out as an Int3d.
+ *	All array indices are assumed to start with zero.
+ *	The elements are one aligned block (see alignedblock).
+ *
+ *	Arguments:	int number of elements in each dimension
+ *	Returns:	0 if okay, 1 otherwise
+ *
+ *	Calls:		alignedblock
+ *	Called by:	main routine
+ *
+ ***/
+int UChar3darray(UChar3d *thing, size_t xsize, size_t ysize, size_t zsize) {
+  thing->x = xsize;
+  thing->y = ysize;
+  thing->z = zsize;
+  thing->val = NULL;
+  if (memroom(xsize * ysize * zsize * sizeof(*thing->val), "UChar3darray"))
+    return (1);
+  thing->val = (unsigned char *)alignedblock(thing->x * thing->y * thing->z *
+                                             sizeof(*thing->val));
+  if (thing->val == NULL) {
+    return (1);
+  }
+  memnote(thing->val, xsize * ysize * zsize * sizeof(*thing->val),
+          "UChar3darray");
+  return (0);
+}
+
+/***
+ *	getUChar3dindex
+ *
+ *	Index of element x, y, z of a UChar3d, in the same
+ *	order as getInt3dindex
+ *
+ *	Arguments:	UChar3d, and the x, y and z of the element
+ *	Returns:	size_t index into val
+ *
+ *	Calls:		no other routines
+ *	Called by:	main routine
+ *
+ ***/
+size_t getUChar3dindex(UChar3d thing, size_t x, size_t y, size_t z) {
+  return ((z * thing.y * thing.x) + (y * thing.x) + x);
+}
+
+/***
+ *	free_UChar3darray
+ *
+ *	Routine to deallocate memory for a 3D array of
+ *	unsigned chars
+ *
+ *	Arguments:	pointer to the UChar3d
+ *	Returns:	Nothing
+ *
+ *	Calls:		free_alignedblock
+ *	Called by:	main routine
+ *
+ ***/
+void free_UChar3darray(UChar3d *thing) {
+  memforget(thing->val);
+  free_alignedblock(thing->val);
+  thing->val = NULL;
   return;
 }
 
@@ -907,6 +1442,9 @@ unsigned short int ***usicube(size_t size) {
   size_t i, j;
   unsigned short int ***fc;
 
+  if (memroom(MEMBOX(size, size, size, sizeof(unsigned short int)), "usicube"))
+    return (NULL);
+
   fc = (unsigned short int ***)malloc(size * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of usicube.");
@@ -943,6 +1481,8 @@ unsigned short int ***usicube(size_t size) {
     }
   }
 
+  memnote(fc, MEMBOX(size, size, size, sizeof(unsigned short int)), "usicube");
+
   return (fc);
 }
 
@@ -963,6 +1503,10 @@ unsigned short int ***usibox(size_t xsize, size_t ysize, size_t zsize) {
   size_t i, j;
   unsigned short int ***fc;
 
+  if (memroom(MEMBOX(xsize, ysize, zsize, sizeof(unsigned short int)),
+              "usibox"))
+    return (NULL);
+
   fc = (unsigned short int ***)malloc(xsize * sizeof(*fc));
   if (!fc) {
     printf("\n\nCould not allocate space for column of usibox.");
@@ -999,56 +1543,784 @@ unsigned short int ***usibox(size_t xsize, size_t ysize, size_t zsize) {
     }
   }
 
+  memnote(fc, MEMBOX(xsize, ysize, zsize, sizeof(unsigned short int)),
+          "usibox");
+
   return (fc);
 }
 
 /***
- *	free_fvector
- *
- *	Routine to free the allocated memory for a vector of floats
- *	All array indices are assumed to start with zero.
+ *	alignedblock
  *
- *	Arguments:	float pointer to memory
+ *	Routine to allocate a block of memory aligned to GRIDALIGN
+ *	bytes, or to GRIDHUGEPAGE bytes if the block is at least
+ *	that big.  Where the system supports it, large blocks are
+ *	also advised as candidates for transparent huge pages.
+ *	Release with free_alignedblock.
  *
- *	Returns:	nothing
+ *	Arguments:	size_t number of bytes
+ *	Returns:	Pointer to the block, or NULL
  *
  *	Calls:		no other routines
- *	Called by:	main routine
+ *	Called by:	Int3darray, makegrid
  *
  ***/
-void free_fvector(float *fv) {
-  free(fv);
-  if (fv)
-    fv = NULL;
-
-  return;
+void *alignedblock(size_t nbytes) {
+  size_t align;
+  void *p = NULL;
+
+  align = (nbytes >= GRIDHUGEPAGE) ? GRIDHUGEPAGE : GRIDALIGN;
+
+#if defined(_WIN32)
+  p = _aligned_malloc(nbytes, align);
+#else
+  if (posix_memalign(&p, align, nbytes))
+    p = NULL;
+#if defined(MADV_HUGEPAGE)
+  if (p && align == GRIDHUGEPAGE)
+    madvise(p, nbytes, MADV_HUGEPAGE);
+#endif
+#endif
+
+  return (p);
 }
 
 /***
- *	free_dvector
+ *	free_alignedblock
  *
- *	Routine to free the allocated memory for a vector of doubles
- *	All array indices are assumed to start with zero.
- *
- *	Arguments:	double pointer to memory
+ *	Routine to free a block obtained from alignedblock
  *
+ *	Arguments:	Pointer to the block
  *	Returns:	nothing
  *
  *	Calls:		no other routines
- *	Called by:	main routine
+ *	Called by:	free_Int3darray, free_anygrid
  *
  ***/
-void free_dvector(double *dv) {
-  free(dv);
-  if (dv)
-    dv = NULL;
+void free_alignedblock(void *p) {
+  if (!p)
+    return;
+
+#if defined(_WIN32)
+  _aligned_free(p);
+#else
+  free(p);
+#endif
 
   return;
 }
 
 /***
- *	free_ldvector
- *
+ *	Size of the Gridinfo record kept in front of the x pointer
+ *	table of a grid, rounded up to a whole number of pointers,
+ *	plus room for the x pointers of the deepest halo.  The record
+ *	is therefore at the same place for every halo depth.
+ ***/
+#define GRIDHEADSIZE                                                           \
+  ((((sizeof(Gridinfo) + sizeof(void *) - 1) / sizeof(void *)) +              \
+    GRIDMAXHALO) *                                                             \
+   sizeof(void *))
+
+/***
+ *	mortonkey
+ *
+ *	Routine to interleave the bits of a row's x and y indices,
+ *	x in the odd bits and y in the even ones, so that rows
+ *	sorted by the key follow a Z-order curve through the x-y
+ *	plane
+ *
+ *	Arguments:	size_t x and y indices (below 65536)
+ *	Returns:	uint64_t key (below 2^32)
+ *
+ *	Calls:		no other routines
+ *	Called by:	makegrid
+ *
+ ***/
+static uint64_t mortonkey(size_t x, size_t y) {
+  int b;
+  uint64_t key = 0;
+
+  for (b = 0; b < 16; b++) {
+    key |= (uint64_t)((y >> b) & 1) << (2 * b);
+    key |= (uint64_t)((x >> b) & 1) << (2 * b + 1);
+  }
+
+  return (key);
+}
+
+/***
+ *	rowkeycmp
+ *
+ *	Comparison of two row keys for qsort
+ *
+ *	Arguments:	Pointers to the two uint64_t keys
+ *	Returns:	-1, 0 or 1
+ *
+ *	Calls:		no other routines
+ *	Called by:	makegrid
+ *
+ ***/
+static int rowkeycmp(const void *a, const void *b) {
+  uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+
+  return ((ka > kb) - (ka < kb));
+}
+
+/***
+ *	makegrid
+ *
+ *	Routine to allocate a 3D array of elements of any size as one
+ *	aligned block in C order, together with the pointer tables
+ *	that let it be indexed as grid[x][y][z].  The Gridinfo record
+ *	and both pointer tables share a single allocation in front of
+ *	the x table, so a grid is released with one call that needs
+ *	no dimensions.  The tables are built as void pointers and
+ *	read back through the typed T*** view; all platforms VCCTL
+ *	supports represent every object pointer the same way.
+ *
+ *	With a halo, every dimension is padded by halo elements on
+ *	both sides and the tables are offset so that index 0 is the
+ *	first interior element.
+ *
+ *	A tiled grid keeps each z row contiguous but puts the rows
+ *	in the block in Morton order of their (x, y) indices, halo
+ *	rows included, instead of x-major order.  The rows around a
+ *	voxel then lie a few rows apart in the block, rather than
+ *	a whole x plane apart.
+ *
+ *	Arguments:	size_t number of elements in each dimension
+ *	            size_t size of one element in bytes
+ *	            int depth of halo (0 to GRIDMAXHALO)
+ *	            int nonzero for rows in Morton order
+ *	            char pointer to name used in error messages
+ *	Returns:	Pointer to element 0 of the x pointer table, or NULL
+ *
+ *	Calls:		alignedblock, mortonkey, rowkeycmp
+ *	Called by:	cgrid, sigrid, igrid, fgrid, dgrid, usigrid,
+ *	            cgridhalo, sigridhalo, cgridtile, sigridtile
+ *
+ ***/
+static void *makegrid(size_t xsize, size_t ysize, size_t zsize, size_t elsize,
+                      int halo, int tiled, const char *name) {
+  size_t i, nx, ny, nz, nrow;
+  unsigned char *mem;
+  char *base;
+  void **xtab, **ytab;
+  uint64_t *order;
+  Gridinfo *info;
+
+  if (xsize == 0 || ysize == 0 || zsize == 0) {
+    printf("\n\nCannot allocate %s with a zero dimension.", name);
+    return (NULL);
+  }
+  if (halo < 0 || halo > GRIDMAXHALO) {
+    printf("\n\nCannot allocate %s with a halo of %d.", name, halo);
+    return (NULL);
+  }
+
+  nx = xsize + 2 * (size_t)halo;
+  ny = ysize + 2 * (size_t)halo;
+  nz = zsize + 2 * (size_t)halo;
+  nrow = nx * ny;
+  if (memroom(GRIDHEADSIZE + (xsize + (size_t)halo + nrow) * sizeof(void *) +
+                  nrow * nz * elsize,
+              name))
+    return (NULL);
+  mem = (unsigned char *)malloc(GRIDHEADSIZE + (xsize + (size_t)halo + nrow) *
+                                                   sizeof(void *));
+  if (!mem) {
+    printf("\n\nCould not allocate space for pointer tables of %s.", name);
+    return (NULL);
+  }
+
+  info = (Gridinfo *)mem;
+  info->xsize = xsize;
+  info->ysize = ysize;
+  info->zsize = zsize;
+  info->elsize = elsize;
+  info->halo = halo;
+  info->tiled = tiled;
+  info->nbytes = nrow * nz * elsize;
+  info->block = alignedblock(info->nbytes);
+  if (!info->block) {
+    printf("\n\nCould not allocate space for %s.", name);
+    free(mem);
+    return (NULL);
+  }
+
+  xtab = (void **)(mem + GRIDHEADSIZE) - halo;
+  ytab = xtab + nx;
+  base = (char *)info->block;
+
+  for (i = 0; i < nx; ++i) {
+    xtab[i] = (void *)(ytab + i * ny + halo);
+  }
+  if (!tiled) {
+    for (i = 0; i < nrow; ++i) {
+      ytab[i] = (void *)(base + (i * nz + halo) * elsize);
+    }
+    memnote((void *)(xtab + halo),
+            GRIDHEADSIZE + (xsize + (size_t)halo + nrow) * sizeof(void *) +
+                info->nbytes,
+            name);
+    return ((void *)(xtab + halo));
+  }
+
+  /***
+   *    Rows go in the block in Morton order of (x, y): the key
+   *    of row i is in the high bits of order[], its index in
+   *    the low 32, and sorting puts each row at its rank
+   ***/
+
+  order = (uint64_t *)malloc(nrow * sizeof(uint64_t));
+  if (!order || nrow > 0xffffffffULL) {
+    printf("\n\nCould not allocate space for the row order of %s.", name);
+    if (order)
+      free(order);
+    free_alignedblock(info->block);
+    free(mem);
+    return (NULL);
+  }
+  for (i = 0; i < nrow; ++i) {
+    order[i] = (mortonkey(i / ny, i % ny) << 32) | (uint64_t)i;
+  }
+  qsort(order, nrow, sizeof(uint64_t), rowkeycmp);
+  for (i = 0; i < nrow; ++i) {
+    ytab[order[i] & 0xffffffffULL] = (void *)(base + (i * nz + halo) * elsize);
+  }
+  free(order);
+
+  memnote((void *)(xtab + halo),
+          GRIDHEADSIZE + (xsize + (size_t)halo + nrow) * sizeof(void *) +
+              info->nbytes,
+          name);
+
+  return ((void *)(xtab + halo));
+}
+
+/***
+ *	gridinfo
+ *
+ *	Routine to find the description of a grid made by one of
+ *	the *grid routines
+ *
+ *	Arguments:	Pointer returned by cgrid, sigrid, ...
+ *	Returns:	Pointer to the Gridinfo record of the grid
+ *
+ *	Calls:		no other routines
+ *	Called by:	gridblock, free_anygrid, main routine
+ *
+ ***/
+Gridinfo *gridinfo(void *grid) {
+  return ((Gridinfo *)((unsigned char *)grid - GRIDHEADSIZE));
+}
+
+/***
+ *	gridblock
+ *
+ *	Routine to get the contiguous block holding all elements of
+ *	a grid, for whole-array operations (copy, fill, read, write)
+ *
+ *	Arguments:	Pointer returned by cgrid, sigrid, ...
+ *	Returns:	Pointer to element [0][0][0]
+ *
+ *	Calls:		gridinfo
+ *	Called by:	main routine
+ *
+ ***/
+void *gridblock(void *grid) { return (gridinfo(grid)->block); }
+
+/***
+ *	touchblock
+ *
+ *	Routine to set a block to zero from several threads, so that
+ *	on a machine with more than one memory node each page is
+ *	placed, when it is first written, on the node of a thread
+ *	that works on it.  The block is cut into nthreads runs of
+ *	whole pages, one per thread, the way the parallel loops over
+ *	x planes or blocks of nodes with a static schedule share it
+ *	out.  With the environment variable VCCTL_NUMA set to
+ *	interleave, the pages are dealt out to the threads in turn
+ *	instead, spreading the block over the nodes for kernels that
+ *	read all of it from every thread.  Without OpenMP, or with
+ *	one thread, the block is simply set to zero.
+ *
+ *	Arguments:	Pointer to the block
+ *	            size_t number of bytes
+ *	            int number of threads
+ *	Returns:	nothing
+ *
+ *	Calls:		no other routines
+ *	Called by:	gridtouch, main routine
+ *
+ ***/
+void touchblock(void *p, size_t nbytes, int nthreads) {
+#ifdef _OPENMP
+  long pg, npage, lo, hi;
+  int interleave;
+  char *env;
+  unsigned char *mem;
+
+  npage = (long)((nbytes + GRIDPAGE - 1) / GRIDPAGE);
+  if (nthreads < 2 || npage < 2) {
+    memset(p, 0, nbytes);
+    return;
+  }
+  if (nthreads > npage)
+    nthreads = (int)npage;
+
+  env = getenv("VCCTL_NUMA");
+  interleave = (env && !strcmp(env, "interleave"));
+  mem = (unsigned char *)p;
+
+#pragma omp parallel num_threads(nthreads) private(pg, lo, hi)
+  {
+    int t, nt;
+
+    t = omp_get_thread_num();
+    nt = omp_get_num_threads();
+    if (interleave) {
+      lo = t;
+      hi = npage;
+    } else {
+      lo = npage * t / nt;
+      hi = npage * (t + 1) / nt;
+    }
+    for (pg = lo; pg < hi; pg += interleave ? nt : 1) {
+      memset(mem + (size_t)pg * GRIDPAGE, 0,
+             (pg == npage - 1) ? nbytes - (size_t)pg * GRIDPAGE : GRIDPAGE);
+    }
+  }
+#else
+  (void)nthreads;
+  memset(p, 0, nbytes);
+#endif
+
+  return;
+}
+
+/***
+ *	gridtouch
+ *
+ *	Routine to set every element of a grid, halo included, to
+ *	zero with touchblock before the grid is first filled
+ *
+ *	Arguments:	Pointer returned by cgrid, sigrid, ...
+ *	            int number of threads
+ *	Returns:	nothing
+ *
+ *	Calls:		gridinfo, touchblock
+ *	Called by:	main routine
+ *
+ ***/
+void gridtouch(void *grid, int nthreads) {
+  Gridinfo *info;
+
+  info = gridinfo(grid);
+  touchblock(info->block, info->nbytes, nthreads);
+
+  return;
+}
+
+/***
+ *	cgrid
+ *
+ *	Routine to allocate memory for a contiguous 3D array of chars
+ *	All array indices are assumed to start with zero.
+ *
+ *	Arguments:	int number of elements in each dimension
+ *	Returns:	Pointer to memory location of first element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+char ***cgrid(size_t xsize, size_t ysize, size_t zsize) {
+  return (
+      (char ***)makegrid(xsize, ysize, zsize, sizeof(char), 0, 0, "cgrid"));
+}
+
+/***
+ *	sigrid
+ *
+ *	Routine to allocate memory for a contiguous 3D array of
+ *	short ints.  All array indices are assumed to start with zero.
+ *
+ *	Arguments:	int number of elements in each dimension
+ *	Returns:	Pointer to memory location of first element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+short int ***sigrid(size_t xsize, size_t ysize, size_t zsize) {
+  return ((short int ***)makegrid(xsize, ysize, zsize, sizeof(short int), 0, 0,
+                                  "sigrid"));
+}
+
+/***
+ *	igrid
+ *
+ *	Routine to allocate memory for a contiguous 3D array of ints
+ *	All array indices are assumed to start with zero.
+ *
+ *	Arguments:	int number of elements in each dimension
+ *	Returns:	Pointer to memory location of first element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+int ***igrid(size_t xsize, size_t ysize, size_t zsize) {
+  return ((int ***)makegrid(xsize, ysize, zsize, sizeof(int), 0, 0, "igrid"));
+}
+
+/***
+ *	fgrid
+ *
+ *	Routine to allocate memory for a contiguous 3D array of floats
+ *	All array indices are assumed to start with zero.
+ *
+ *	Arguments:	int number of elements in each dimension
+ *	Returns:	Pointer to memory location of first element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+float ***fgrid(size_t xsize, size_t ysize, size_t zsize) {
+  return (
+      (float ***)makegrid(xsize, ysize, zsize, sizeof(float), 0, 0, "fgrid"));
+}
+
+/***
+ *	dgrid
+ *
+ *	Routine to allocate memory for a contiguous 3D array of doubles
+ *	All array indices are assumed to start with zero.
+ *
+ *	Arguments:	int number of elements in each dimension
+ *	Returns:	Pointer to memory location of first element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+double ***dgrid(size_t xsize, size_t ysize, size_t zsize) {
+  return (
+      (double ***)makegrid(xsize, ysize, zsize, sizeof(double), 0, 0,
+                           "dgrid"));
+}
+
+/***
+ *	usigrid
+ *
+ *	Routine to allocate memory for a contiguous 3D array of
+ *	unsigned short ints.  All array indices are assumed to start
+ *	with zero.
+ *
+ *	Arguments:	int number of elements in each dimension
+ *	Returns:	Pointer to memory location of first element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+unsigned short int ***usigrid(size_t xsize, size_t ysize, size_t zsize) {
+  return ((unsigned short int ***)makegrid(
+      xsize, ysize, zsize, sizeof(unsigned short int), 0, 0, "usigrid"));
+}
+
+/***
+ *	cgridhalo
+ *
+ *	Routine to allocate memory for a contiguous 3D array of chars
+ *	with a halo on every face (see Gridinfo in vcctl.h).  Interior
+ *	indices start with zero.
+ *
+ *	Arguments:	int number of interior elements in each dimension
+ *	            int depth of halo
+ *	Returns:	Pointer to memory location of first interior element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+char ***cgridhalo(size_t xsize, size_t ysize, size_t zsize, int halo) {
+  return ((char ***)makegrid(xsize, ysize, zsize, sizeof(char), halo, 0,
+                             "cgridhalo"));
+}
+
+/***
+ *	sigridhalo
+ *
+ *	Routine to allocate memory for a contiguous 3D array of
+ *	short ints with a halo on every face (see Gridinfo in
+ *	vcctl.h).  Interior indices start with zero.
+ *
+ *	Arguments:	int number of interior elements in each dimension
+ *	            int depth of halo
+ *	Returns:	Pointer to memory location of first interior element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+short int ***sigridhalo(size_t xsize, size_t ysize, size_t zsize, int halo) {
+  return ((short int ***)makegrid(xsize, ysize, zsize, sizeof(short int), halo,
+                                  0, "sigridhalo"));
+}
+
+/***
+ *	cgridtile
+ *
+ *	Routine to allocate memory for a 3D array of chars with a
+ *	halo, as cgridhalo does, with its rows in Morton order (see
+ *	makegrid)
+ *
+ *	Arguments:	int number of interior elements in each dimension
+ *	            int depth of halo
+ *	Returns:	Pointer to memory location of first interior element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+char ***cgridtile(size_t xsize, size_t ysize, size_t zsize, int halo) {
+  return ((char ***)makegrid(xsize, ysize, zsize, sizeof(char), halo, 1,
+                             "cgridtile"));
+}
+
+/***
+ *	sigridtile
+ *
+ *	Routine to allocate memory for a 3D array of short ints
+ *	with a halo, as sigridhalo does, with its rows in Morton
+ *	order (see makegrid)
+ *
+ *	Arguments:	int number of interior elements in each dimension
+ *	            int depth of halo
+ *	Returns:	Pointer to memory location of first interior element
+ *
+ *	Calls:		makegrid
+ *	Called by:	main routine
+ *
+ ***/
+short int ***sigridtile(size_t xsize, size_t ysize, size_t zsize, int halo) {
+  return ((short int ***)makegrid(xsize, ysize, zsize, sizeof(short int), halo,
+                                  1, "sigridtile"));
+}
+
+/***
+ *	gridhalo
+ *
+ *	Routine to fill the halo of a grid with periodic images of
+ *	its interior.  The sizes given may be smaller than those the
+ *	grid was made with (disrealnew allocates room for a crack
+ *	before the crack opens); the halo then sits at the given
+ *	sizes, inside the spare elements.  Faces are done z, then y,
+ *	then x, each over the full range already filled, so edges
+ *	and corners get the right images too.
+ *
+ *	Arguments:	Pointer returned by cgridhalo, sigridhalo, ...
+ *	            int current number of elements in each dimension
+ *	Returns:	Nothing
+ *
+ *	Calls:		gridinfo
+ *	Called by:	main routine
+ *
+ ***/
+void gridhalo(void *grid, int xsize, int ysize, int zsize) {
+  int i, j, d, h;
+  size_t el, rowlen;
+  char ***g;
+  Gridinfo *info;
+
+  if (!grid)
+    return;
+
+  info = gridinfo(grid);
+  h = info->halo;
+  if (h == 0 || xsize < h || ysize < h || zsize < h)
+    return;
+
+  g = (char ***)grid;
+  el = info->elsize;
+  rowlen = (size_t)(zsize + 2 * h) * el;
+
+  for (i = 0; i < xsize; i++) {
+    for (j = 0; j < ysize; j++) {
+      memcpy(g[i][j] - h * el, g[i][j] + (zsize - h) * el, h * el);
+      memcpy(g[i][j] + zsize * el, g[i][j], h * el);
+    }
+  }
+
+  for (i = 0; i < xsize; i++) {
+    for (d = 1; d <= h; d++) {
+      memcpy(g[i][-d] - h * el, g[i][ysize - d] - h * el, rowlen);
+      memcpy(g[i][ysize - 1 + d] - h * el, g[i][d - 1] - h * el, rowlen);
+    }
+  }
+
+  for (d = 1; d <= h; d++) {
+    for (j = -h; j < ysize + h; j++) {
+      memcpy(g[-d][j] - h * el, g[xsize - d][j] - h * el, rowlen);
+      memcpy(g[xsize - 1 + d][j] - h * el, g[d - 1][j] - h * el, rowlen);
+    }
+  }
+
+  return;
+}
+
+/***
+ *	gridcrack
+ *
+ *	Routine to open a gap in a grid, as when a crack is added:
+ *	the planes after plane start along the given axis move up by
+ *	width, and the width planes of the gap are zeroed.  Each
+ *	stretch of the block that moves is contiguous (every plane
+ *	for a crack in x, every x plane for y, every row for z), so
+ *	the grid is shifted with one memmove per stretch.  The
+ *	sizes are the current ones; the grid must have been made
+ *	with at least width more elements along the axis.  A halo
+ *	is moved along with the interior and has to be refilled
+ *	with gridhalo afterwards.  In a tiled grid only the rows are
+ *	contiguous, so a crack in x or y moves one row at a time.
+ *
+ *	Arguments:	Pointer returned by cgrid, sigrid, ...
+ *	            int axis (1 = x, 2 = y, 3 = z)
+ *	            int last plane that stays put, int width of the gap
+ *	            int current number of elements in each dimension
+ *	Returns:	0 if okay, 1 if the grid has no room for the gap
+ *
+ *	Calls:		gridinfo
+ *	Called by:	main routine
+ *
+ ***/
+int gridcrack(void *grid, int axis, int start, int width, int xsize,
+              int ysize, int zsize) {
+  int i, j, h, size, nmove, ny;
+  size_t el, rowlen, planelen, run, gap;
+  char ***g, *src;
+  Gridinfo *info;
+
+  if (!grid || width <= 0)
+    return (0);
+
+  info = gridinfo(grid);
+  size = (axis == 1) ? xsize : ((axis == 2) ? ysize : zsize);
+  if (axis < 1 || axis > 3 || start < -1 || start >= size ||
+      (size_t)(size + width) >
+          ((axis == 1) ? info->xsize
+                       : ((axis == 2) ? info->ysize : info->zsize)))
+    return (1);
+
+  g = (char ***)grid;
+  h = info->halo;
+  el = info->elsize;
+  rowlen = (info->zsize + 2 * (size_t)h) * el;
+  planelen = (info->ysize + 2 * (size_t)h) * rowlen;
+  nmove = size - 1 - start;
+
+  if (info->tiled && axis == 1) {
+    ny = (int)info->ysize + h;
+    for (i = size - 1; i > start; i--) {
+      for (j = -h; j < ny; j++) {
+        memcpy(g[i + width][j] - h * el, g[i][j] - h * el, rowlen);
+      }
+    }
+    for (i = start + 1; i <= start + width; i++) {
+      for (j = -h; j < ny; j++) {
+        memset(g[i][j] - h * el, 0, rowlen);
+      }
+    }
+  } else if (info->tiled && axis == 2) {
+    for (i = 0; i < xsize; i++) {
+      for (j = size - 1; j > start; j--) {
+        memcpy(g[i][j + width] - h * el, g[i][j] - h * el, rowlen);
+      }
+      for (j = start + 1; j <= start + width; j++) {
+        memset(g[i][j] - h * el, 0, rowlen);
+      }
+    }
+  } else if (axis == 1) {
+    src = g[start + 1][-h] - h * el;
+    run = (size_t)nmove * planelen;
+    gap = (size_t)width * planelen;
+    memmove(src + gap, src, run);
+    memset(src, 0, gap);
+  } else if (axis == 2) {
+    run = (size_t)nmove * rowlen;
+    gap = (size_t)width * rowlen;
+    for (i = 0; i < xsize; i++) {
+      src = g[i][start + 1] - h * el;
+      memmove(src + gap, src, run);
+      memset(src, 0, gap);
+    }
+  } else {
+    run = (size_t)nmove * el;
+    gap = (size_t)width * el;
+    for (i = 0; i < xsize; i++) {
+      for (j = 0; j < ysize; j++) {
+        src = g[i][j] + (start + 1) * el;
+        memmove(src + gap, src, run);
+        memset(src, 0, gap);
+      }
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *	free_fvector
+ *
+ *	Routine to free the allocated memory for a vector of floats
+ *	All array indices are assumed to start with zero.
+ *
+ *	Arguments:	float pointer to memory
+ *
+ *	Returns:	nothing
+ *
+ *	Calls:		no other routines
+ *	Called by:	main routine
+ *
+ ***/
+void free_fvector(float *fv) {
+  memforget(fv);
+  free(fv);
+  if (fv)
+    fv = NULL;
+
+  return;
+}
+
+/***
+ *	free_dvector
+ *
+ *	Routine to free the allocated memory for a vector of doubles
+ *	All array indices are assumed to start with zero.
+ *
+ *	Arguments:	double pointer to memory
+ *
+ *	Returns:	nothing
+ *
+ *	Calls:		no other routines
+ *	Called by:	main routine
+ *
+ ***/
+void free_dvector(double *dv) {
+  memforget(dv);
+  free(dv);
+  if (dv)
+    dv = NULL;
+
+  return;
+}
+
+/***
+ *	free_ldvector
+ *
  *	Routine to free the allocated memory for a vector of long doubles
  *	All array indices are assumed to start with zero.
  *
@@ -1083,6 +2355,7 @@ void free_ldvector(long double *ldv) {
  *
  ***/
 void free_pixelvector(pixel_t *ptv) {
+  memforget(ptv);
   free(ptv);
   if (ptv)
     ptv = NULL;
@@ -1105,6 +2378,7 @@ void free_pixelvector(pixel_t *ptv) {
  *
  ***/
 void free_ivector(int *iv) {
+  memforget(iv);
   free(iv);
   if (iv)
     iv = NULL;
@@ -1127,6 +2401,7 @@ void free_ivector(int *iv) {
  *
  ***/
 void free_sivector(short int *iv) {
+  memforget(iv);
   free(iv);
   if (iv)
     iv = NULL;
@@ -1149,6 +2424,7 @@ void free_sivector(short int *iv) {
  *
  ***/
 void free_livector(long int *iv) {
+  memforget(iv);
   free(iv);
   if (iv)
     iv = NULL;
@@ -1172,6 +2448,9 @@ void free_livector(long int *iv) {
  ***/
 void free_sicube(short int ***fc, size_t size) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < size; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < size; ++j) {
@@ -1203,6 +2482,9 @@ void free_sicube(short int ***fc, size_t size) {
  ***/
 void free_sibox(short int ***fc, size_t xsize, size_t ysize) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < xsize; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < ysize; ++j) {
@@ -1233,6 +2515,9 @@ void free_sibox(short int ***fc, size_t xsize, size_t ysize) {
  ***/
 void free_ccube(char ***fc, size_t size) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < size; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < size; ++j) {
@@ -1264,6 +2549,9 @@ void free_ccube(char ***fc, size_t size) {
  ***/
 void free_cbox(char ***fc, size_t xsize, size_t ysize) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < xsize; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < ysize; ++j) {
@@ -1294,6 +2582,9 @@ void free_cbox(char ***fc, size_t xsize, size_t ysize) {
  ***/
 void free_fcube(float ***fc, size_t size) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < size; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < size; ++j) {
@@ -1325,6 +2616,9 @@ void free_fcube(float ***fc, size_t size) {
  ***/
 void free_fbox(float ***fc, size_t xsize, size_t ysize) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < xsize; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < ysize; ++j) {
@@ -1356,6 +2650,9 @@ void free_fbox(float ***fc, size_t xsize, size_t ysize) {
  ***/
 void free_dbox(double ***fc, size_t xsize, size_t ysize) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < xsize; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < ysize; ++j) {
@@ -1386,6 +2683,9 @@ void free_dbox(double ***fc, size_t xsize, size_t ysize) {
  ***/
 void free_icube(int ***fc, size_t size) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < size; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < size; ++j) {
@@ -1417,6 +2717,9 @@ void free_icube(int ***fc, size_t size) {
  ***/
 void free_ibox(int ***fc, size_t xsize, size_t ysize) {
   size_t i, j;
+
+  memforget(fc);
+
   if (fc != NULL) {
     for (i = 0; i < xsize; ++i) {
       if (fc[i] != NULL) {
@@ -1453,6 +2756,9 @@ void free_ibox(int ***fc, size_t xsize, size_t ysize) {
  ***/
 void free_usicube(unsigned short int ***fc, size_t size) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < size; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < size; ++j) {
@@ -1486,6 +2792,9 @@ void free_usicube(unsigned short int ***fc, size_t size) {
  ***/
 void free_usibox(unsigned short int ***fc, size_t xsize, size_t ysize) {
   size_t i, j;
+
+  memforget(fc);
+
   for (i = 0; i < xsize; ++i) {
     if (fc[i] != NULL) {
       for (j = 0; j < ysize; ++j) {
@@ -1517,6 +2826,9 @@ void free_usibox(unsigned short int ***fc, size_t xsize, size_t ysize) {
  ***/
 void free_sisquare(short int **is, size_t size) {
   size_t i;
+
+  memforget(is);
+
   for (i = 0; i < size; ++i) {
     if (is[i] != NULL) {
       free(is[i]);
@@ -1545,6 +2857,9 @@ void free_sisquare(short int **is, size_t size) {
  ***/
 void free_sirect(short int **is, size_t xsize) {
   size_t i;
+
+  memforget(is);
+
   for (i = 0; i < xsize; ++i) {
     if (is[i] != NULL) {
       free(is[i]);
@@ -1573,6 +2888,9 @@ void free_sirect(short int **is, size_t xsize) {
  ***/
 void free_irect(int **is, size_t xsize) {
   size_t i;
+
+  memforget(is);
+
   for (i = 0; i < xsize; ++i) {
     if (is[i] != NULL) {
       free(is[i]);
@@ -1600,13 +2918,143 @@ void free_irect(int **is, size_t xsize) {
  *
  ***/
 void free_drect(double **is, size_t xsize) {
-  size_t i;
-  for (i = 0; i < xsize; ++i) {
-    if (is[i] != NULL) {
-      free(is[i]);
-    }
+  memforget(is);
+  if (is != NULL) {
+    free(is[0]);
   }
   free(is);
 
   return;
 }
+
+/***
+ *	free_anygrid
+ *
+ *	Routine to free a grid of any element type
+ *
+ *	Arguments:	Pointer returned by cgrid, sigrid, ...
+ * 	Returns:	Nothing
+ *
+ *	Calls:		gridinfo, free_alignedblock
+ *	Called by:	free_cgrid, free_sigrid, free_igrid, free_fgrid,
+ *	            free_dgrid, free_usigrid
+ *
+ ***/
+static void free_anygrid(void *grid) {
+  Gridinfo *info;
+
+  memforget(grid);
+
+  if (!grid)
+    return;
+
+  info = gridinfo(grid);
+  free_alignedblock(info->block);
+  free(info);
+
+  return;
+}
+
+/***
+ *	free_cgrid
+ *
+ *	Routine to free the memory of a contiguous 3D array of chars
+ *
+ *	Arguments:	Pointer to memory location of first element
+ * 	Returns:	Nothing
+ *
+ *	Calls:		free_anygrid
+ *	Called by:	main routine, freeallmem
+ *
+ ***/
+void free_cgrid(char ***fc) {
+  free_anygrid((void *)fc);
+  return;
+}
+
+/***
+ *	free_sigrid
+ *
+ *	Routine to free the memory of a contiguous 3D array of
+ *	short ints
+ *
+ *	Arguments:	Pointer to memory location of first element
+ * 	Returns:	Nothing
+ *
+ *	Calls:		free_anygrid
+ *	Called by:	main routine, freeallmem
+ *
+ ***/
+void free_sigrid(short int ***fc) {
+  free_anygrid((void *)fc);
+  return;
+}
+
+/***
+ *	free_igrid
+ *
+ *	Routine to free the memory of a contiguous 3D array of ints
+ *
+ *	Arguments:	Pointer to memory location of first element
+ * 	Returns:	Nothing
+ *
+ *	Calls:		free_anygrid
+ *	Called by:	main routine, freeallmem
+ *
+ ***/
+void free_igrid(int ***fc) {
+  free_anygrid((void *)fc);
+  return;
+}
+
+/***
+ *	free_fgrid
+ *
+ *	Routine to free the memory of a contiguous 3D array of floats
+ *
+ *	Arguments:	Pointer to memory location of first element
+ * 	Returns:	Nothing
+ *
+ *	Calls:		free_anygrid
+ *	Called by:	main routine, freeallmem
+ *
+ ***/
+void free_fgrid(float ***fc) {
+  free_anygrid((void *)fc);
+  return;
+}
+
+/***
+ *	free_dgrid
+ *
+ *	Routine to free the memory of a contiguous 3D array of doubles
+ *
+ *	Arguments:	Pointer to memory location of first element
+ * 	Returns:	Nothing
+ *
+ *	Calls:		free_anygrid
+ *	Called by:	main routine, freeallmem
+ *
+ ***/
+void free_dgrid(double ***fc) {
+  free_anygrid((void *)fc);
+  return;
+}
+
+/***
+ *	free_usigrid
+ *
+ *	Routine to free the memory of a contiguous 3D array of
+ *	unsigned short ints
+ *
+ *	Arguments:	Pointer to memory location of first element
+ * 	Returns:	Nothing
+ *
+ *	Calls:		free_anygrid
+ *	Called by:	main routine, freeallmem
+ *
+ ***/
+void free_usigrid(unsigned short int ***fc) {
+  free_anygrid((void *)fc);
+  return;
+}
@@ -0,0 +1,146 @@
+/******************************************************************************
+ *	A pool of nodes of one size, for linked lists that are built and
+ *	taken apart many times in a run.
+ *
+ *	The caller makes a Nodepool with nodepool_alloc for nodes of
+ *	size elsize, takes nodes with nodepool_get in place of malloc
+ *	and may give single nodes back with nodepool_put.  Nodes come
+ *	from chunks of perchunk nodes that are kept until
+ *	nodepool_free, so taking a node costs a pointer bump or a pop
+ *	from the list of nodes given back, and nodepool_reset gives
+ *	every node back at once, whatever their number, when a list is
+ *	rebuilt from scratch.  Nodes are aligned for any type and are
+ *	not cleared.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/******************************************************************************
+ *	Function nodepool_alloc makes an empty pool
+ *
+ * 	Arguments:	Nodepool pointer to fill
+ * 				size_t size of one node in bytes
+ * 				size_t number of nodes in each chunk
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the sizes are zero)
+ ******************************************************************************/
+int nodepool_alloc(Nodepool *np, size_t elsize, size_t perchunk) {
+  size_t align;
+
+  /* Round up so that every node is aligned as malloc would align it */
+
+  align = sizeof(long double) > sizeof(void *) ? sizeof(long double)
+                                                : sizeof(void *);
+  np->elsize = ((elsize + align - 1) / align) * align;
+  np->perchunk = perchunk;
+  np->chunk = NULL;
+  np->nchunk = np->capchunk = 0;
+  np->cur = 0;
+  np->used = 0;
+  np->freed = NULL;
+
+  return (elsize == 0 || perchunk == 0);
+}
+
+/******************************************************************************
+ *	Function nodepool_get takes one node from a pool
+ *
+ * 	Arguments:	Nodepool pointer
+ *
+ *	Returns:	void pointer to the node, or NULL if out of memory
+ ******************************************************************************/
+void *nodepool_get(Nodepool *np) {
+  void *node, **newchunk;
+  size_t cap;
+
+  if (np->freed) {
+    node = np->freed;
+    np->freed = *(void **)node;
+    return (node);
+  }
+
+  /* Move on to the next chunk, making it if it is not there yet */
+
+  if (np->nchunk == 0 || np->used == np->perchunk) {
+    if (np->nchunk > 0 && np->cur + 1 < np->nchunk) {
+      np->cur++;
+    } else {
+      if (np->nchunk == np->capchunk) {
+        cap = np->capchunk ? 2 * np->capchunk : 16;
+        newchunk = (void **)realloc(np->chunk, cap * sizeof(void *));
+        if (!newchunk)
+          return (NULL);
+        np->chunk = newchunk;
+        np->capchunk = cap;
+      }
+      np->chunk[np->nchunk] = malloc(np->perchunk * np->elsize);
+      if (!np->chunk[np->nchunk])
+        return (NULL);
+      np->cur = np->nchunk++;
+    }
+    np->used = 0;
+  }
+
+  node = (char *)np->chunk[np->cur] + np->used * np->elsize;
+  np->used++;
+
+  return (node);
+}
+
+/******************************************************************************
+ *	Function nodepool_put gives one node back to its pool
+ *
+ * 	Arguments:	Nodepool pointer
+ * 				void pointer to a node taken from that pool
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void nodepool_put(Nodepool *np, void *node) {
+  if (!node)
+    return;
+
+  *(void **)node = np->freed;
+  np->freed = node;
+
+  return;
+}
+
+/******************************************************************************
+ *	Function nodepool_reset gives every node back to the pool at
+ *	once, keeping the chunks for the nodes taken next
+ *
+ * 	Arguments:	Nodepool pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void nodepool_reset(Nodepool *np) {
+  np->cur = 0;
+  np->used = 0;
+  np->freed = NULL;
+
+  return;
+}
+
+/******************************************************************************
+ *	Function nodepool_free releases the chunks of a pool
+ *
+ * 	Arguments:	Nodepool pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void nodepool_free(Nodepool *np) {
+  size_t i;
+
+  for (i = 0; i < np->nchunk; i++) {
+    free(np->chunk[i]);
+  }
+  free(np->chunk);
+  np->chunk = NULL;
+  np->nchunk = np->capchunk = 0;
+  np->cur = 0;
+  np->used = 0;
+  np->freed = NULL;
+
+  return;
+}
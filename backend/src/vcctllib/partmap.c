@@ -0,0 +1,352 @@
+/******************************************************************************
+ *	A compact map of particle ids, for the image of the original
+ *	particles that a hydration run keeps beside its microstructure.
+ *
+ *	The box is cut into blocks of PARTMAPBLK voxels on a side, and
+ *	each block keeps as few bits per voxel as the number of ids in
+ *	it allows.  A block of one id (the inside of a particle, or of
+ *	the space between particles) is that id alone.  A block of two,
+ *	up to four or up to sixteen ids is a palette of them, indexed
+ *	with 1, 2 or 4 bits per voxel.  Only a block of more ids keeps
+ *	a full id for each voxel.  Ids are ints, so the number of
+ *	particles is not held to what a short can count.
+ *
+ *	partmap_alloc makes a map with every id 0, and partmap_putslab
+ *	fills it one slab of PARTMAPBLK x planes at a time, each slab
+ *	once.  Reading an id with partmap_get costs a look at the
+ *	block and at most two loads.  The map does not change after
+ *	it is filled; partmap_crack makes it anew with a gap.  Every
+ *	map made gets its own stamp, so a caller that remembers the
+ *	stamp can tell whether the map has changed since.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned long Partmapstamp = 0;
+
+/******************************************************************************
+ *	Function partmap_alloc makes a map of a box with every id 0
+ *
+ * 	Arguments:	Partmap pointer to fill
+ * 				int xsize, ysize, zsize
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int partmap_alloc(Partmap *pm, int xsize, int ysize, int zsize) {
+  size_t nblock;
+
+  memset(pm, 0, sizeof(Partmap));
+  pm->xsize = xsize;
+  pm->ysize = ysize;
+  pm->zsize = zsize;
+  pm->bx = (xsize + PARTMAPBLK - 1) >> PARTMAPSHIFT;
+  pm->by = (ysize + PARTMAPBLK - 1) >> PARTMAPSHIFT;
+  pm->bz = (zsize + PARTMAPBLK - 1) >> PARTMAPSHIFT;
+  pm->stamp = ++Partmapstamp;
+
+  nblock = (size_t)pm->bx * pm->by * pm->bz;
+  pm->off = (uint32_t *)calloc(nblock, sizeof(uint32_t));
+  pm->bits = (unsigned char *)calloc(nblock, 1);
+  if (!pm->off || !pm->bits) {
+    partmap_free(pm);
+    return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function partmap_reserve makes sure the pool of a map has room
+ *	for at least nwords words, keeping what it holds
+ *
+ * 	Arguments:	Partmap pointer
+ * 				size_t number of words
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory or
+ *				past what a block offset can address)
+ ******************************************************************************/
+int partmap_reserve(Partmap *pm, size_t nwords) {
+  size_t cap;
+  uint32_t *newpool;
+
+  if (nwords <= pm->cappool)
+    return (0);
+  if (nwords > (size_t)UINT32_MAX)
+    return (1);
+
+  cap = pm->cappool ? pm->cappool : 4096;
+  while (cap < nwords) {
+    cap *= 2;
+  }
+  if (cap > (size_t)UINT32_MAX)
+    cap = (size_t)UINT32_MAX;
+  newpool = (uint32_t *)realloc(pm->pool, cap * sizeof(uint32_t));
+  if (!newpool)
+    return (1);
+  pm->pool = newpool;
+  pm->cappool = cap;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function partmap_putslab stores the ids of one slab of x planes.
+ *	Voxels of a block past the end of the box take the id of the
+ *	last voxel inside it, so they add nothing to its palette.
+ *
+ * 	Arguments:	Partmap pointer
+ * 				int first x plane of the slab (a multiple of
+ * 					PARTMAPBLK)
+ * 				int pointer to the ids of the PARTMAPBLK planes
+ * 					from x0 (fewer at the end of the box),
+ * 					voxel (x,y,z) at
+ * 					((x-x0)*ysize+y)*zsize+z
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory or
+ *				x0 is not the start of a slab)
+ ******************************************************************************/
+int partmap_putslab(Partmap *pm, int x0, const int *ids) {
+  int jy, jz, k, i, np, nb, x, y, z;
+  uint32_t v[PARTMAPVOX], pal[16], *p;
+  size_t b, plane, need, nidx;
+
+  if (x0 < 0 || x0 >= pm->xsize || (x0 & (PARTMAPBLK - 1)))
+    return (1);
+
+  plane = (size_t)pm->ysize * pm->zsize;
+  for (jy = 0; jy < pm->by; jy++) {
+    for (jz = 0; jz < pm->bz; jz++) {
+      b = ((size_t)(x0 >> PARTMAPSHIFT) * pm->by + jy) * pm->bz + jz;
+
+      /* The ids of the block, and the distinct ones up to 16 */
+
+      np = 0;
+      for (k = 0; k < PARTMAPVOX; k++) {
+        x = x0 + (k >> (2 * PARTMAPSHIFT));
+        y = (jy << PARTMAPSHIFT) + ((k >> PARTMAPSHIFT) & (PARTMAPBLK - 1));
+        z = (jz << PARTMAPSHIFT) + (k & (PARTMAPBLK - 1));
+        if (x >= pm->xsize)
+          x = pm->xsize - 1;
+        if (y >= pm->ysize)
+          y = pm->ysize - 1;
+        if (z >= pm->zsize)
+          z = pm->zsize - 1;
+        v[k] = (uint32_t)ids[(size_t)(x - x0) * plane +
+                             (size_t)y * pm->zsize + z];
+        if ((int)v[k] > pm->maxid)
+          pm->maxid = (int)v[k];
+        if (np > 16)
+          continue;
+        for (i = 0; i < np && pal[i] != v[k]; i++)
+          ;
+        if (i == np) {
+          if (np < 16)
+            pal[i] = v[k];
+          np++;
+        }
+      }
+
+      if (np == 1) {
+        pm->bits[b] = 0;
+        pm->off[b] = v[0];
+        continue;
+      }
+
+      nb = (np <= 2) ? 1 : ((np <= 4) ? 2 : ((np <= 16) ? 4 : 32));
+      nidx = (nb == 32) ? 0 : ((size_t)1 << nb);
+      need = nidx + (size_t)PARTMAPVOX * nb / 32;
+      if (partmap_reserve(pm, pm->npool + need))
+        return (1);
+      p = pm->pool + pm->npool;
+      pm->off[b] = (uint32_t)pm->npool;
+      pm->bits[b] = (unsigned char)nb;
+      pm->npool += need;
+
+      if (nb == 32) {
+        memcpy(p, v, sizeof(v));
+        continue;
+      }
+
+      /* Palette, then the index of each voxel in it */
+
+      for (i = 0; i < (int)nidx; i++) {
+        p[i] = (i < np) ? pal[i] : pal[0];
+      }
+      memset(p + nidx, 0, (need - nidx) * sizeof(uint32_t));
+      for (k = 0; k < PARTMAPVOX; k++) {
+        for (i = 0; pal[i] != v[k]; i++)
+          ;
+        p[nidx + ((k * nb) >> 5)] |= (uint32_t)i << ((k * nb) & 31);
+      }
+    }
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function partmap_get gives the id of one voxel
+ *
+ * 	Arguments:	Partmap pointer
+ * 				int x, y, z coordinates, inside the box
+ *
+ *	Returns:	int id
+ ******************************************************************************/
+int partmap_get(const Partmap *pm, int x, int y, int z) {
+  int nb, k;
+  size_t b;
+  const uint32_t *p;
+
+  b = ((size_t)(x >> PARTMAPSHIFT) * pm->by + (y >> PARTMAPSHIFT)) * pm->bz +
+      (z >> PARTMAPSHIFT);
+  nb = pm->bits[b];
+  if (!nb)
+    return ((int)pm->off[b]);
+
+  p = pm->pool + pm->off[b];
+  k = ((x & (PARTMAPBLK - 1)) << (2 * PARTMAPSHIFT)) |
+      ((y & (PARTMAPBLK - 1)) << PARTMAPSHIFT) | (z & (PARTMAPBLK - 1));
+  if (nb == 32)
+    return ((int)p[k]);
+
+  return ((int)p[(p[(1 << nb) + ((k * nb) >> 5)] >> ((k * nb) & 31)) &
+                 ((1u << nb) - 1)]);
+}
+
+/******************************************************************************
+ *	Function partmap_row gives the ids of a whole row along z, a
+ *	block at a time
+ *
+ * 	Arguments:	Partmap pointer
+ * 				int x, y coordinates of the row
+ * 				int pointer to zsize ids to fill
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void partmap_row(const Partmap *pm, int x, int y, int *dst) {
+  int jz, z, z1, nb, k0, k, id;
+  size_t b;
+  const uint32_t *p;
+
+  b = ((size_t)(x >> PARTMAPSHIFT) * pm->by + (y >> PARTMAPSHIFT)) * pm->bz;
+  k0 = ((x & (PARTMAPBLK - 1)) << (2 * PARTMAPSHIFT)) |
+       ((y & (PARTMAPBLK - 1)) << PARTMAPSHIFT);
+  for (jz = 0; jz < pm->bz; jz++, b++) {
+    z = jz << PARTMAPSHIFT;
+    z1 = (z + PARTMAPBLK < pm->zsize) ? z + PARTMAPBLK : pm->zsize;
+    nb = pm->bits[b];
+    if (!nb) {
+      id = (int)pm->off[b];
+      for (; z < z1; z++) {
+        dst[z] = id;
+      }
+      continue;
+    }
+    p = pm->pool + pm->off[b];
+    for (k = k0; z < z1; z++, k++) {
+      if (nb == 32) {
+        dst[z] = (int)p[k];
+      } else {
+        dst[z] = (int)p[(p[(1 << nb) + ((k * nb) >> 5)] >> ((k * nb) & 31)) &
+                        ((1u << nb) - 1)];
+      }
+    }
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function partmap_crack makes a map anew with a gap of width x,
+ *	y or z planes of id 0 after plane start, the planes after it
+ *	moved up by width, as gridcrack does for a grid
+ *
+ * 	Arguments:	Partmap pointer
+ * 				int axis (1 = x, 2 = y, 3 = z)
+ * 				int last plane that stays put, int width of the gap
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory, in
+ *				which case the map is unchanged)
+ ******************************************************************************/
+int partmap_crack(Partmap *pm, int axis, int start, int width) {
+  int x, y, z, x0, ox, oy, oz, *slab, *row;
+  size_t plane;
+  Partmap cracked;
+
+  if (partmap_alloc(&cracked, pm->xsize + ((axis == 1) ? width : 0),
+                    pm->ysize + ((axis == 2) ? width : 0),
+                    pm->zsize + ((axis == 3) ? width : 0)))
+    return (1);
+
+  plane = (size_t)cracked.ysize * cracked.zsize;
+  slab = (int *)malloc(PARTMAPBLK * plane * sizeof(int));
+  if (!slab) {
+    partmap_free(&cracked);
+    return (1);
+  }
+
+  for (x0 = 0; x0 < cracked.xsize; x0 += PARTMAPBLK) {
+    for (x = x0; x < x0 + PARTMAPBLK && x < cracked.xsize; x++) {
+      for (y = 0; y < cracked.ysize; y++) {
+        row = slab + (size_t)(x - x0) * plane + (size_t)y * cracked.zsize;
+        ox = (axis == 1 && x > start) ? x - width : x;
+        oy = (axis == 2 && y > start) ? y - width : y;
+        if ((axis == 1 && x > start && x <= start + width) ||
+            (axis == 2 && y > start && y <= start + width)) {
+          memset(row, 0, (size_t)cracked.zsize * sizeof(int));
+          continue;
+        }
+        for (z = 0; z < cracked.zsize; z++) {
+          oz = (axis == 3 && z > start) ? z - width : z;
+          row[z] = (axis == 3 && z > start && z <= start + width)
+                       ? 0
+                       : partmap_get(pm, ox, oy, oz);
+        }
+      }
+    }
+    if (partmap_putslab(&cracked, x0, slab)) {
+      free(slab);
+      partmap_free(&cracked);
+      return (1);
+    }
+  }
+
+  free(slab);
+  partmap_free(pm);
+  *pm = cracked;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function partmap_bytes gives the memory a map holds
+ *
+ * 	Arguments:	Partmap pointer
+ *
+ *	Returns:	size_t bytes
+ ******************************************************************************/
+size_t partmap_bytes(const Partmap *pm) {
+  return ((size_t)pm->bx * pm->by * pm->bz * (sizeof(uint32_t) + 1) +
+          pm->cappool * sizeof(uint32_t));
+}
+
+/******************************************************************************
+ *	Function partmap_free frees a map and leaves it zeroed
+ *
+ * 	Arguments:	Partmap pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void partmap_free(Partmap *pm) {
+  if (pm->off)
+    free(pm->off);
+  if (pm->bits)
+    free(pm->bits);
+  if (pm->pool)
+    free(pm->pool);
+  memset(pm, 0, sizeof(Partmap));
+
+  return;
+}
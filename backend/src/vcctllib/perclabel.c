@@ -0,0 +1,758 @@
+/******************************************************************************
+ *	Connected-component labeling of a microstructure with union-find
+ *	(Hoshen-Kopelman style), for percolation tests in all three
+ *	directions at once.
+ *
+ *	Each phase id is given a class by the caller (0 for phases
+ *	that are not part of the network), and a table says whether two
+ *	face-sharing voxels of given classes are joined.  One scan of
+ *	the image joins voxels inside the box.  For each direction the
+ *	resulting clusters are then joined across the two faces that are
+ *	periodic for that direction, and a cluster percolates in that
+ *	direction if it holds the voxels at the same transverse position
+ *	on both of the faces normal to it.  This is the same test as
+ *	the burning algorithm that starts a front from every voxel of
+ *	the first face, with periodic boundaries in the other two
+ *	directions.
+ *
+ *	The clusters are also joined across all three pairs of faces at
+ *	once, to count the clusters of the fully periodic image and the
+ *	distribution of their sizes.  perc_clusters lists those clusters
+ *	one by one, largest first, with the directions each percolates
+ *	in.
+ *
+ *	Networks that share no voxels, such as the pores, the CH and
+ *	the C-S-H of a leached paste, are tested together by
+ *	perc_label_groups: one labeling joins voxels of the same group
+ *	only, and the statistics are kept apart for each group.
+ *
+ *	A caller that tests the same network again and again (disrealnew
+ *	checks percolation while the microstructure hydrates) can use
+ *	perc_track instead, with scratch space (a Percwork) that it
+ *	keeps between calls.  The tracker remembers the class of every
+ *	voxel at the last labeling, and gives back the last result
+ *	without labeling again when no voxel has changed class since.
+ *	A caller whose image is not a grid of phase ids (genmic and
+ *	genaggpack keep theirs as int arrays) can give the class of
+ *	every voxel itself to perc_label_classes.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******************************************************************************
+ *	Function perc_find finds the root of a tree in a parent array,
+ *	halving the path on the way.  Parents never have larger indices
+ *	than their children.
+ *
+ * 	Arguments:	int pointer to parent array
+ * 				size_t index of starting element
+ *
+ *	Returns:	size_t index of root
+ ******************************************************************************/
+static size_t perc_find(int *parent, size_t i) {
+  while ((size_t)parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = (size_t)parent[i];
+  }
+
+  return (i);
+}
+
+/******************************************************************************
+ *	Function perc_union joins the trees holding two elements, making
+ *	the root with the smaller index the root of both
+ *
+ * 	Arguments:	int pointer to parent array
+ * 				size_t indices of the two elements
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void perc_union(int *parent, size_t i, size_t j) {
+  i = perc_find(parent, i);
+  j = perc_find(parent, j);
+  if (i < j) {
+    parent[j] = (int)i;
+  } else if (j < i) {
+    parent[i] = (int)j;
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function perc_linked decides whether two face-sharing voxels
+ *	belong to the same network
+ *
+ * 	Arguments:	int classes of the two voxels
+ * 				link table
+ * 				int particle ids of the two voxels
+ *
+ *	Returns:	1 if the voxels are joined, 0 otherwise
+ ******************************************************************************/
+static int perc_linked(int c1, int c2,
+                       const unsigned char link[PERCCLASSES][PERCCLASSES],
+                       int p1, int p2) {
+  if (!c1 || !c2)
+    return (0);
+  if (link[c1][c2] == PERCLINK)
+    return (1);
+  if ((link[c1][c2] == PERCSAMEPART) && (p1 == p2) && (p1 != 0))
+    return (1);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function percwork_alloc makes sure scratch space has room for at
+ *	least nvox voxels and ncl clusters, keeping what it already has
+ *	if that is enough.  A zeroed Percwork starts out empty.
+ *
+ * 	Arguments:	Percwork pointer
+ * 				size_t number of voxels
+ * 				size_t number of clusters
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory, in
+ *				which case the space is freed)
+ ******************************************************************************/
+int percwork_alloc(Percwork *pw, size_t nvox, size_t ncl) {
+  void *newp;
+
+  if (nvox > pw->nvox) {
+    newp = realloc(pw->parent, nvox * sizeof(int));
+    if (!newp) {
+      percwork_free(pw);
+      return (1);
+    }
+    pw->parent = (int *)newp;
+    pw->nvox = nvox;
+  }
+
+  if (ncl > pw->ncl) {
+    newp = realloc(pw->csize, ncl * sizeof(int));
+    if (newp)
+      pw->csize = (int *)newp;
+    newp = (newp) ? realloc(pw->cpar, ncl * sizeof(int)) : NULL;
+    if (newp)
+      pw->cpar = (int *)newp;
+    newp = (newp) ? realloc(pw->cthrough, ncl) : NULL;
+    if (newp)
+      pw->cthrough = (unsigned char *)newp;
+    newp = (newp) ? realloc(pw->cfront, ncl) : NULL;
+    if (!newp) {
+      percwork_free(pw);
+      return (1);
+    }
+    pw->cfront = (unsigned char *)newp;
+    pw->ncl = ncl;
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function percwork_free frees scratch space and leaves it zeroed
+ *
+ * 	Arguments:	Percwork pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void percwork_free(Percwork *pw) {
+  if (pw->parent)
+    free(pw->parent);
+  if (pw->csize)
+    free(pw->csize);
+  if (pw->cpar)
+    free(pw->cpar);
+  if (pw->cthrough)
+    free(pw->cthrough);
+  if (pw->cfront)
+    free(pw->cfront);
+  memset(pw, 0, sizeof(Percwork));
+
+  return;
+}
+
+/******************************************************************************
+ *	Function perc_classify records the class of every voxel, in the
+ *	order used by perc_run
+ *
+ * 	Arguments:	unsigned char pointer to class array to fill
+ * 				char pointer to 3-D grid of phase ids
+ * 				int xsize, ysize, zsize
+ * 				unsigned char class of each of the CENSUSIDS ids
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void perc_classify(unsigned char *snap, char ***mic, int xsize,
+                          int ysize, int zsize, const unsigned char *cls) {
+  int x, y, z;
+  size_t i;
+
+  i = 0;
+  for (x = 0; x < xsize; x++) {
+    for (y = 0; y < ysize; y++) {
+      for (z = 0; z < zsize; z++, i++) {
+        snap[i] = cls[(unsigned char)mic[x][y][z]];
+      }
+    }
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function perc_bysize orders clusters from the largest down, for
+ *	qsort
+ *
+ * 	Arguments:	void pointers to two Perccluster
+ *
+ *	Returns:	int, negative if the first is larger
+ ******************************************************************************/
+static int perc_bysize(const void *a, const void *b) {
+  const Perccluster *ca = (const Perccluster *)a;
+  const Perccluster *cb = (const Perccluster *)b;
+
+  return ((cb->size > ca->size) - (cb->size < ca->size));
+}
+
+/******************************************************************************
+ *	Function perc_run does the work of perc_label in scratch space
+ *	chosen by the caller, given the class of every voxel
+ *
+ * 	Arguments:	Percwork pointer
+ * 				unsigned char pointer to the class of each voxel
+ * 					(0 to PERCCLASSES - 1, 0 = not in network),
+ * 					voxel (x,y,z) at (x*ysize+y)*zsize+z
+ * 				Partmap pointer to the particle ids
+ * 					(may be NULL if no link is PERCSAMEPART)
+ * 				int xsize, ysize, zsize
+ * 				unsigned char symmetric link table of PERCNOLINK,
+ * 					PERCLINK or PERCSAMEPART (joined only
+ * 					when both voxels have the same nonzero
+ * 					particle id) entries, indexed by class
+ * 				Percstats pointer to fill, or to PERCCLASSES of
+ * 					them if byclass is set
+ * 				Perccluster pointer pointer set to a new list
+ * 					of the ps->ncluster clusters of the
+ * 					periodic image, largest first (NULL if
+ * 					no list is wanted)
+ * 				int byclass flag: the link table joins only
+ * 					voxels of the same class, and the
+ * 					statistics of the clusters of class c go
+ * 					to ps[c] (ps[0] is left empty)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+static int perc_run(Percwork *pw, const unsigned char *cl, const Partmap *part,
+                    int xsize, int ysize, int zsize,
+                    const unsigned char link[PERCCLASSES][PERCCLASSES],
+                    Percstats *ps, Perccluster **clist, int byclass) {
+  int x, y, z, c, d, e, a, b, u, v, bin, dims[3], pa[3], pb[3];
+  int *parent, *csize, *cpar;
+  unsigned char *cthrough, *cfront, *kflag, *kcls;
+  size_t i, nvox, nc, k, ia, ib, ra, rb, syz;
+  int p0;
+  Percstats *pk;
+
+  dims[0] = xsize;
+  dims[1] = ysize;
+  dims[2] = zsize;
+  syz = (size_t)ysize * (size_t)zsize;
+  nvox = (size_t)xsize * syz;
+
+  memset(ps, 0, (byclass ? PERCCLASSES : 1) * sizeof(Percstats));
+
+  if (percwork_alloc(pw, nvox, 0))
+    return (1);
+  parent = pw->parent;
+
+  /***
+   *	One scan joins each voxel to the voxels before it
+   *	in x, y and z, without wrapping around the box
+   ***/
+
+  i = 0;
+  for (x = 0; x < xsize; x++) {
+    for (y = 0; y < ysize; y++) {
+      for (z = 0; z < zsize; z++, i++) {
+        c = cl[i];
+        if (!c) {
+          parent[i] = -1;
+          continue;
+        }
+        parent[i] = (int)i;
+        ps[byclass ? c : 0].nset++;
+        p0 = (part) ? partmap_get(part, x, y, z) : 0;
+
+        if ((z > 0) && (parent[i - 1] >= 0) &&
+            perc_linked(c, cl[i - 1], link, p0,
+                        (part) ? partmap_get(part, x, y, z - 1) : 0)) {
+          perc_union(parent, i, i - 1);
+        }
+        if ((y > 0) && (parent[i - zsize] >= 0) &&
+            perc_linked(c, cl[i - zsize], link, p0,
+                        (part) ? partmap_get(part, x, y - 1, z) : 0)) {
+          perc_union(parent, i, i - zsize);
+        }
+        if ((x > 0) && (parent[i - syz] >= 0) &&
+            perc_linked(c, cl[i - syz], link, p0,
+                        (part) ? partmap_get(part, x - 1, y, z) : 0)) {
+          perc_union(parent, i, i - syz);
+        }
+      }
+    }
+  }
+
+  /***
+   *	Every parent has a smaller index than its child, so
+   *	one more scan in order replaces each entry with the
+   *	number of its cluster
+   ***/
+
+  nc = 0;
+  for (i = 0; i < nvox; i++) {
+    if (parent[i] < 0)
+      continue;
+    if ((size_t)parent[i] == i) {
+      parent[i] = (int)nc++;
+    } else {
+      parent[i] = parent[parent[i]];
+    }
+  }
+
+  if (percwork_alloc(pw, 0, nc + 1))
+    return (1);
+  csize = pw->csize;
+  cpar = pw->cpar;
+  cthrough = pw->cthrough;
+  cfront = pw->cfront;
+  memset(csize, 0, (nc + 1) * sizeof(int));
+
+  kflag = kcls = NULL;
+  if (clist) {
+    *clist = NULL;
+    kflag = (unsigned char *)calloc(nc + 1, 1);
+    if (!kflag)
+      return (1);
+  }
+
+  /* The class of each cluster, when the classes are counted apart */
+
+  if (byclass) {
+    kcls = (unsigned char *)calloc(nc + 1, 1);
+    if (!kcls) {
+      free(kflag);
+      return (1);
+    }
+  }
+
+  for (i = 0; i < nvox; i++) {
+    if (parent[i] >= 0) {
+      csize[parent[i]]++;
+      if (kcls)
+        kcls[parent[i]] = cl[i];
+    }
+  }
+
+  /***
+   *	Direction 3 stands for all three at once: the clusters
+   *	are joined across every pair of faces, for the sizes
+   *	of the clusters of the periodic image
+   ***/
+
+  for (d = 0; d <= 3; d++) {
+
+    for (k = 0; k < nc; k++) {
+      cpar[k] = (int)k;
+      cthrough[k] = cfront[k] = 0;
+    }
+
+    /***
+     *	Join clusters across the faces that are periodic
+     *	for this direction
+     ***/
+
+    for (e = 0; e < 3; e++) {
+      if (e == d)
+        continue;
+      u = (e + 1) % 3;
+      v = (e + 2) % 3;
+      for (a = 0; a < dims[u]; a++) {
+        for (b = 0; b < dims[v]; b++) {
+          pa[e] = 0;
+          pb[e] = dims[e] - 1;
+          pa[u] = pb[u] = a;
+          pa[v] = pb[v] = b;
+          ia = ((size_t)pa[0] * ysize + pa[1]) * zsize + pa[2];
+          ib = ((size_t)pb[0] * ysize + pb[1]) * zsize + pb[2];
+          if ((parent[ia] < 0) || (parent[ib] < 0))
+            continue;
+          if (perc_linked(cl[ia], cl[ib], link,
+                          (part) ? partmap_get(part, pa[0], pa[1], pa[2]) : 0,
+                          (part) ? partmap_get(part, pb[0], pb[1], pb[2])
+                                 : 0)) {
+            perc_union(cpar, (size_t)parent[ia], (size_t)parent[ib]);
+          }
+        }
+      }
+    }
+
+    if (d == 3)
+      break;
+
+    /***
+     *	A cluster percolates if it holds the voxels at the
+     *	same transverse position on both faces normal to
+     *	this direction.  A burn from the first face reaches
+     *	every cluster with a voxel on that face, and spans
+     *	the box if the cluster also has a voxel on the last
+     *	face (bit 1 of cthrough).
+     ***/
+
+    u = (d + 1) % 3;
+    v = (d + 2) % 3;
+    pa[d] = 0;
+    pb[d] = dims[d] - 1;
+    for (a = 0; a < dims[u]; a++) {
+      for (b = 0; b < dims[v]; b++) {
+        pa[u] = a;
+        pa[v] = b;
+        ia = ((size_t)pa[0] * ysize + pa[1]) * zsize + pa[2];
+        if (parent[ia] >= 0)
+          cfront[perc_find(cpar, (size_t)parent[ia])] = 1;
+      }
+    }
+
+    for (a = 0; a < dims[u]; a++) {
+      for (b = 0; b < dims[v]; b++) {
+        pa[u] = pb[u] = a;
+        pa[v] = pb[v] = b;
+        ib = ((size_t)pb[0] * ysize + pb[1]) * zsize + pb[2];
+        if (parent[ib] < 0)
+          continue;
+        rb = perc_find(cpar, (size_t)parent[ib]);
+        cthrough[rb] |= 2;
+        ia = ((size_t)pa[0] * ysize + pa[1]) * zsize + pa[2];
+        if ((parent[ia] < 0) || (byclass && (cl[ia] != cl[ib])))
+          continue;
+        ra = perc_find(cpar, (size_t)parent[ia]);
+        if (ra == rb)
+          cthrough[ra] |= 1;
+        if (cfront[rb])
+          ps[byclass ? cl[ib] : 0].nmeet[d]++;
+      }
+    }
+
+    for (k = 0; k < nc; k++) {
+      ra = perc_find(cpar, k);
+      pk = ps + (kcls ? kcls[k] : 0);
+      if (cthrough[ra] & 1) {
+        pk->nthrough[d] += csize[k];
+        if (kflag)
+          kflag[k] |= (unsigned char)(1 << d);
+      }
+      if (cfront[ra])
+        pk->nfront[d] += csize[k];
+      if (cfront[ra] && (cthrough[ra] & 2))
+        pk->nspan[d] += csize[k];
+    }
+  }
+
+  /***
+   *	Add the size of each cluster to its root, which has a
+   *	smaller number, and bin the sizes of the roots by
+   *	powers of two
+   ***/
+
+  for (k = 0; k < nc; k++) {
+    ra = perc_find(cpar, k);
+    if (ra != k) {
+      csize[ra] += csize[k];
+      csize[k] = 0;
+      if (kflag)
+        kflag[ra] |= kflag[k];
+    }
+  }
+  for (k = 0; k < nc; k++) {
+    if (csize[k] == 0)
+      continue;
+    pk = ps + (kcls ? kcls[k] : 0);
+    pk->ncluster++;
+    if (csize[k] > pk->maxcluster)
+      pk->maxcluster = csize[k];
+    for (bin = 0; (bin < PERCSIZEBINS - 1) && (csize[k] >> (bin + 1)); bin++)
+      ;
+    pk->nsize[bin]++;
+  }
+  if (kcls)
+    free(kcls);
+
+  if (!clist)
+    return (0);
+
+  *clist = (Perccluster *)malloc(((size_t)ps->ncluster + 1) *
+                                 sizeof(Perccluster));
+  if (!*clist) {
+    free(kflag);
+    return (1);
+  }
+  c = 0;
+  for (k = 0; k < nc; k++) {
+    if (csize[k] == 0)
+      continue;
+    (*clist)[c].size = csize[k];
+    (*clist)[c].through = kflag[k];
+    c++;
+  }
+  free(kflag);
+  qsort(*clist, (size_t)c, sizeof(Perccluster), perc_bysize);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function perc_label finds the clusters of a network of phases
+ *	and, for each of the three directions, the number of voxels in
+ *	clusters that percolate in that direction
+ *
+ * 	Arguments:	char pointer to 3-D grid of phase ids
+ * 				Partmap pointer to the particle ids
+ * 					(may be NULL if no link is PERCSAMEPART)
+ * 				int xsize, ysize, zsize
+ * 				unsigned char class of each of the CENSUSIDS ids
+ * 					(0 to PERCCLASSES - 1, 0 = not in network)
+ * 				unsigned char symmetric link table of PERCNOLINK,
+ * 					PERCLINK or PERCSAMEPART (joined only
+ * 					when both voxels have the same nonzero
+ * 					particle id) entries, indexed by class
+ * 				Percstats pointer to fill
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int perc_label(char ***mic, const Partmap *part, int xsize, int ysize,
+               int zsize, const unsigned char *cls,
+               const unsigned char link[PERCCLASSES][PERCCLASSES],
+               Percstats *ps) {
+  int status;
+  unsigned char *cl;
+
+  cl = (unsigned char *)malloc((size_t)xsize * ysize * zsize);
+  if (!cl)
+    return (1);
+
+  perc_classify(cl, mic, xsize, ysize, zsize, cls);
+  status = perc_label_classes(cl, part, xsize, ysize, zsize, link, ps);
+  free(cl);
+
+  return (status);
+}
+
+/******************************************************************************
+ *	Function perc_label_classes does the same as perc_label for an
+ *	image whose voxels the caller has already put into classes
+ *
+ * 	Arguments:	unsigned char pointer to the class of each voxel
+ * 					(0 to PERCCLASSES - 1, 0 = not in network),
+ * 					voxel (x,y,z) at (x*ysize+y)*zsize+z
+ * 				Partmap pointer to the particle ids
+ * 					(may be NULL if no link is PERCSAMEPART)
+ * 				int xsize, ysize, zsize
+ * 				unsigned char link table, as for perc_label
+ * 				Percstats pointer to fill
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int perc_label_classes(const unsigned char *cl, const Partmap *part, int xsize,
+                       int ysize, int zsize,
+                       const unsigned char link[PERCCLASSES][PERCCLASSES],
+                       Percstats *ps) {
+  int status;
+  Percwork pw;
+
+  memset(&pw, 0, sizeof(Percwork));
+  status = perc_run(&pw, cl, part, xsize, ysize, zsize, link, ps, NULL, 0);
+  percwork_free(&pw);
+
+  return (status);
+}
+
+/******************************************************************************
+ *	Function perc_clusters does the same as perc_label and also
+ *	lists the clusters of the periodic image, largest first, each
+ *	with its size and the directions it percolates in, from the
+ *	same labeling
+ *
+ * 	Arguments:	arguments of perc_label
+ * 				Perccluster pointer pointer set to the new list
+ * 					of ps->ncluster clusters, which the
+ * 					caller frees
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory, in
+ *				which case there is no list)
+ ******************************************************************************/
+int perc_clusters(char ***mic, const Partmap *part, int xsize, int ysize,
+                  int zsize, const unsigned char *cls,
+                  const unsigned char link[PERCCLASSES][PERCCLASSES],
+                  Percstats *ps, Perccluster **clist) {
+  int status;
+  unsigned char *cl;
+  Percwork pw;
+
+  *clist = NULL;
+  cl = (unsigned char *)malloc((size_t)xsize * ysize * zsize);
+  if (!cl)
+    return (1);
+
+  perc_classify(cl, mic, xsize, ysize, zsize, cls);
+  memset(&pw, 0, sizeof(Percwork));
+  status = perc_run(&pw, cl, part, xsize, ysize, zsize, link, ps, clist, 0);
+  percwork_free(&pw);
+  free(cl);
+
+  return (status);
+}
+
+/******************************************************************************
+ *	Function perc_label_groups tests several networks at once.  Each
+ *	phase id is put in one group (0 for none), voxels are joined
+ *	only to face-sharing voxels of the same group, and one labeling
+ *	of the image gives the statistics of every group, as perc_label
+ *	would for each on its own.
+ *
+ * 	Arguments:	char pointer to 3-D grid of phase ids
+ * 				int xsize, ysize, zsize
+ * 				unsigned char group of each of the CENSUSIDS ids
+ * 					(0 to PERCCLASSES - 1, 0 = in no group)
+ * 				Percstats pointer to PERCCLASSES of them, filled
+ * 					for each group (ps[0] is left empty)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int perc_label_groups(char ***mic, int xsize, int ysize, int zsize,
+                      const unsigned char *grp, Percstats *ps) {
+  int g, status;
+  unsigned char *cl;
+  unsigned char link[PERCCLASSES][PERCCLASSES];
+  Percwork pw;
+
+  cl = (unsigned char *)malloc((size_t)xsize * ysize * zsize);
+  if (!cl)
+    return (1);
+
+  memset(link, PERCNOLINK, sizeof(link));
+  for (g = 1; g < PERCCLASSES; g++) {
+    link[g][g] = PERCLINK;
+  }
+
+  perc_classify(cl, mic, xsize, ysize, zsize, grp);
+  memset(&pw, 0, sizeof(Percwork));
+  status = perc_run(&pw, cl, NULL, xsize, ysize, zsize, link, ps, NULL, 1);
+  percwork_free(&pw);
+  free(cl);
+
+  return (status);
+}
+
+/******************************************************************************
+ *	Function perc_unchanged compares the classes of the voxels with
+ *	the snapshot taken at the last labeling, stopping at the first
+ *	difference
+ *
+ * 	Arguments:	Perctrack pointer
+ * 				char pointer to 3-D grid of phase ids
+ * 				unsigned char class of each of the CENSUSIDS ids
+ *
+ *	Returns:	1 if no voxel has changed, 0 otherwise
+ ******************************************************************************/
+static int perc_unchanged(Perctrack *pt, char ***mic,
+                          const unsigned char *cls) {
+  int x, y, z, c;
+  size_t i;
+
+  i = 0;
+  for (x = 0; x < pt->xsize; x++) {
+    for (y = 0; y < pt->ysize; y++) {
+      for (z = 0; z < pt->zsize; z++, i++) {
+        c = cls[(unsigned char)mic[x][y][z]];
+        if (c != pt->snap[i])
+          return (0);
+      }
+    }
+  }
+
+  return (1);
+}
+
+/******************************************************************************
+ *	Function perc_track does the same as perc_label for a network
+ *	that is tested many times as the microstructure changes.  The
+ *	tracker must start out zeroed, and the link table must be the
+ *	same on every call with it.  Its snapshot is allocated on the
+ *	first call (and again if the box grows).  When no voxel has
+ *	changed class since the last call, and the particle map is the
+ *	same one (by its stamp), the last result is given back without
+ *	labeling the image again.  Any number of trackers may share one
+ *	Percwork.
+ *
+ * 	Arguments:	Perctrack pointer
+ * 				Percwork pointer to scratch space
+ * 				arguments of perc_label
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int perc_track(Perctrack *pt, Percwork *pw, char ***mic, const Partmap *part,
+               int xsize, int ysize, int zsize, const unsigned char *cls,
+               const unsigned char link[PERCCLASSES][PERCCLASSES],
+               Percstats *ps) {
+  size_t nvox;
+  unsigned long stamp;
+
+  stamp = (part) ? part->stamp : 0;
+  if (pt->valid && (pt->xsize == xsize) && (pt->ysize == ysize) &&
+      (pt->zsize == zsize) && (pt->partstamp == stamp) &&
+      perc_unchanged(pt, mic, cls)) {
+    *ps = pt->last;
+    return (0);
+  }
+
+  nvox = (size_t)xsize * (size_t)ysize * (size_t)zsize;
+  if (nvox > pt->cap) {
+    perc_track_free(pt);
+    pt->snap = (unsigned char *)malloc(nvox);
+    if (!pt->snap)
+      return (1);
+    pt->cap = nvox;
+  }
+
+  pt->valid = 0;
+  pt->xsize = xsize;
+  pt->ysize = ysize;
+  pt->zsize = zsize;
+  pt->partstamp = stamp;
+  perc_classify(pt->snap, mic, xsize, ysize, zsize, cls);
+  if (perc_run(pw, pt->snap, part, xsize, ysize, zsize, link, ps, NULL, 0))
+    return (1);
+
+  pt->last = *ps;
+  pt->valid = 1;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function perc_track_free frees the snapshot of a tracker and
+ *	leaves it zeroed, ready to be used again
+ *
+ * 	Arguments:	Perctrack pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void perc_track_free(Perctrack *pt) {
+  if (pt->snap)
+    free(pt->snap);
+  memset(pt, 0, sizeof(Perctrack));
+
+  return;
+}
@@ -0,0 +1,517 @@
+/******************************************************************************
+ *	Pore size distribution of a periodic three-dimensional image by
+ *	local thickness, for poredist3d and calcporedist3d.
+ *
+ *	A pore voxel belongs to a pore of diameter 2r+1 when it lies in
+ *	a digital sphere of radius r (the offsets no farther than r+0.5
+ *	from the center) that holds only pore voxels, and it is given
+ *	the largest such diameter, up to a limit.  A sphere of radius r
+ *	fits at a center whose squared distance to the nearest solid
+ *	voxel is at least r*r+r+1, and it holds the voxels whose squared
+ *	distance to the center is at most r*r+r.  Both distances come
+ *	from exact squared Euclidean distance transforms, done one axis
+ *	at a time by the lower envelope of parabolas (Felzenszwalb and
+ *	Huttenlocher), with periodic boundaries.  The first transform,
+ *	to the solid, gives the largest sphere at every center; then,
+ *	from the largest radius down, a transform to the centers of each
+ *	radius marks the voxels their spheres cover that no larger
+ *	sphere has.  Each transform is linear in the number of voxels,
+ *	instead of a template of every size at every pore voxel.
+ *
+ *	The same distance map gives simulated mercury intrusion
+ *	(poreintrude): the radius at which each center is first reached
+ *	from the intrusion face is found by one flood fill, and the
+ *	spheres at those radii are counted the same way.
+ *
+ *	The first transform on its own (sqdistance) gives the distance
+ *	of every voxel to any feature, such as the aggregate surfaces
+ *	that measagg profiles the paste around.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define EDTFAR INT_MAX
+
+/******************************************************************************
+ *	Function edtline does the squared distance transform of one
+ *	periodic line of n values.  Each value is a squared distance
+ *	(EDTFAR if none); the line is extended by up to reach copies of
+ *	its values at each end, which makes the result exact wherever it
+ *	is not more than reach*reach, and no smaller than that elsewhere.
+ *
+ * 	Arguments:	int pointer to the line, replaced by its transform
+ * 				int length n
+ * 				int reach
+ * 				int pointer to scratch for 7n values
+ * 				double pointer to scratch for 3n+1 values
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void edtline(int *f, int n, int reach, int *w, double *z) {
+  int i, j, k, m, p, q, *g, *v, *d;
+  double s;
+
+  p = (reach < n) ? reach : n;
+  m = n + 2 * p;
+  g = w;
+  v = w + m;
+  d = w + m + m;
+
+  /* Lower envelope of the parabolas at the finite values */
+
+  k = -1;
+  s = 0.0;
+  for (q = 0; q < m; q++) {
+    g[q] = f[(q - p + n) % n];
+    if (g[q] == EDTFAR)
+      continue;
+    while (k >= 0) {
+      s = ((double)g[q] + (double)q * q - (double)g[v[k]] -
+           (double)v[k] * v[k]) /
+          (2.0 * (q - v[k]));
+      if (s > z[k])
+        break;
+      k--;
+    }
+    k++;
+    v[k] = q;
+    z[k] = (k == 0) ? -1.0e30 : s;
+    z[k + 1] = 1.0e30;
+  }
+
+  if (k < 0)
+    return;
+
+  j = 0;
+  for (i = 0; i < n; i++) {
+    q = i + p;
+    while (z[j + 1] < (double)q)
+      j++;
+    d[i] = (q - v[j]) * (q - v[j]) + g[v[j]];
+  }
+  for (i = 0; i < n; i++) {
+    f[i] = d[i];
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function sqedt replaces an image of squared distances (0 at the
+ *	features, EDTFAR elsewhere) by the squared distance of every
+ *	voxel to the nearest feature, exact up to reach*reach
+ *
+ * 	Arguments:	int pointer to the image (x varies fastest)
+ * 				int xsize, ysize, zsize
+ * 				int reach
+ * 				int pointer to scratch for 8*maxsize values
+ * 				double pointer to scratch for 3*maxsize+1
+ * 				values
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void sqedt(int *e, int xsize, int ysize, int zsize, int reach, int *w,
+                  double *z) {
+  int i, j, k, *f;
+  size_t base, nxy;
+
+  nxy = (size_t)xsize * ysize;
+  f = w + 7 * ((xsize > ysize) ? ((xsize > zsize) ? xsize : zsize)
+                               : ((ysize > zsize) ? ysize : zsize));
+
+  for (k = 0; k < zsize; k++) {
+    for (j = 0; j < ysize; j++) {
+      edtline(e + k * nxy + (size_t)j * xsize, xsize, reach, w, z);
+    }
+  }
+
+  for (k = 0; k < zsize; k++) {
+    for (i = 0; i < xsize; i++) {
+      base = k * nxy + i;
+      for (j = 0; j < ysize; j++) {
+        f[j] = e[base + (size_t)j * xsize];
+      }
+      edtline(f, ysize, reach, w, z);
+      for (j = 0; j < ysize; j++) {
+        e[base + (size_t)j * xsize] = f[j];
+      }
+    }
+  }
+
+  for (j = 0; j < ysize; j++) {
+    for (i = 0; i < xsize; i++) {
+      base = (size_t)j * xsize + i;
+      for (k = 0; k < zsize; k++) {
+        f[k] = e[base + k * nxy];
+      }
+      edtline(f, zsize, reach, w, z);
+      for (k = 0; k < zsize; k++) {
+        e[base + k * nxy] = f[k];
+      }
+    }
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function poreradii gives every pore voxel the radius of the
+ *	largest sphere of pore voxels centered on it, up to a limit,
+ *	from the squared distance to the nearest solid voxel
+ *
+ * 	Arguments:	unsigned char pointer to the image, nonzero at
+ * 				the pore voxels (x varies fastest)
+ * 				int xsize, ysize, zsize
+ * 				int largest radius
+ * 				int pointer to the radii, -1 at the solid voxels
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int poreradii(unsigned char *pore, int xsize, int ysize, int zsize, int rmax,
+              int *rad) {
+  int r, maxsize, *w;
+  size_t n, nvox;
+  double *z;
+
+  nvox = (size_t)xsize * ysize * zsize;
+  maxsize = xsize;
+  if (ysize > maxsize)
+    maxsize = ysize;
+  if (zsize > maxsize)
+    maxsize = zsize;
+
+  w = (int *)malloc(8 * (size_t)maxsize * sizeof(int));
+  z = (double *)malloc((3 * (size_t)maxsize + 1) * sizeof(double));
+  if (!w || !z) {
+    free(w);
+    free(z);
+    return (1);
+  }
+
+  for (n = 0; n < nvox; n++) {
+    rad[n] = pore[n] ? EDTFAR : 0;
+  }
+  sqedt(rad, xsize, ysize, zsize, rmax + 1, w, z);
+
+  for (n = 0; n < nvox; n++) {
+    if (pore[n]) {
+      for (r = rmax; r > 0 && rad[n] < r * r + r + 1; r--)
+        ;
+      rad[n] = r;
+    } else {
+      rad[n] = -1;
+    }
+  }
+
+  free(w);
+  free(z);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function sphcover counts the voxels by the radius of the largest
+ *	of a set of spheres that covers them.  Each voxel may be the
+ *	center of one sphere, whose radius is given, and every sphere
+ *	must hold only pore voxels (its radius no larger than that from
+ *	poreradii).  From the largest radius down, a distance transform
+ *	to the centers of each radius marks the voxels their spheres
+ *	cover that no larger sphere has.
+ *
+ * 	Arguments:	int pointer to the radius of the sphere at each
+ * 				voxel, -1 if none (x varies fastest); it is
+ * 				overwritten
+ * 				int xsize, ysize, zsize
+ * 				int largest radius
+ * 				int pointer to the counts, ndiam[0..2*rmax+1],
+ * 				filled at the odd diameters 2r+1 and zero
+ * 				elsewhere; voxels no sphere covers are not
+ * 				counted
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int sphcover(int *rad, int xsize, int ysize, int zsize, int rmax,
+             int *ndiam) {
+  int i, r, b, maxsize, found, *e, *w;
+  size_t n, nvox;
+  double *z;
+
+  nvox = (size_t)xsize * ysize * zsize;
+  maxsize = xsize;
+  if (ysize > maxsize)
+    maxsize = ysize;
+  if (zsize > maxsize)
+    maxsize = zsize;
+
+  e = (int *)malloc(nvox * sizeof(int));
+  w = (int *)malloc(8 * (size_t)maxsize * sizeof(int));
+  z = (double *)malloc((3 * (size_t)maxsize + 1) * sizeof(double));
+  if (!e || !w || !z) {
+    free(e);
+    free(w);
+    free(z);
+    return (1);
+  }
+
+  for (i = 0; i <= 2 * rmax + 1; i++) {
+    ndiam[i] = 0;
+  }
+
+  /***
+   *	A voxel keeps one more than the radius of its own sphere (0 if
+   *	none) in rad % b, and the diameter it is given, if any, in
+   *	rad / b
+   ***/
+
+  b = rmax + 2;
+  for (n = 0; n < nvox; n++) {
+    rad[n] = (rad[n] < 0) ? 0 : ((rad[n] > rmax) ? rmax : rad[n]) + 1;
+  }
+
+  for (r = rmax; r > 0; r--) {
+    found = 0;
+    for (n = 0; n < nvox; n++) {
+      e[n] = EDTFAR;
+      if (rad[n] % b == r + 1) {
+        e[n] = 0;
+        found = 1;
+      }
+    }
+    if (!found)
+      continue;
+    sqedt(e, xsize, ysize, zsize, r + 1, w, z);
+    for (n = 0; n < nvox; n++) {
+      if (rad[n] < b && e[n] <= r * r + r) {
+        rad[n] += b * (2 * r + 1);
+      }
+    }
+  }
+
+  for (n = 0; n < nvox; n++) {
+    if (rad[n] >= b) {
+      ndiam[rad[n] / b]++;
+    } else if (rad[n] == 1) {
+      ndiam[1]++;
+    }
+  }
+
+  free(e);
+  free(w);
+  free(z);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function bktpush puts a voxel in the bucket of a radius, making
+ *	the bucket larger if it is full
+ *
+ * 	Arguments:	int pointers to the buckets, their lengths and
+ * 				their capacities
+ * 				int radius
+ * 				int voxel
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+static int bktpush(int **bkt, int *bn, int *bcap, int r, int m) {
+  int *grow;
+
+  if (bn[r] == bcap[r]) {
+    grow = (int *)realloc(bkt[r], 2 * ((size_t)bcap[r] + 512) * sizeof(int));
+    if (!grow)
+      return (1);
+    bkt[r] = grow;
+    bcap[r] = 2 * (bcap[r] + 512);
+  }
+  bkt[r][bn[r]++] = m;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function poreintrude turns the radii from poreradii into the
+ *	radius at which a sphere coming in through the face z = 0, as
+ *	mercury does, reaches each voxel: the largest r for which a path
+ *	of face-sharing centers, every one with room for a sphere of
+ *	radius r, leads to the voxel from a center on that face.  The
+ *	other faces are periodic, as is z across the far face.  Voxels
+ *	are settled from a bucket queue by that radius, largest first,
+ *	so each is settled once for the whole intrusion curve; the
+ *	spheres at the radii it gives, counted by sphcover, make the
+ *	volume intruded at each radius.
+ *
+ * 	Arguments:	int pointer to the radii from poreradii (x varies
+ * 				fastest), replaced by the intrusion radii, -1
+ * 				at the voxels never reached
+ * 				int xsize, ysize, zsize
+ * 				int largest radius
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int poreintrude(int *rad, int xsize, int ysize, int zsize, int rmax) {
+  int i, j, k, r, q, d, m, nxy, done, status, *key, **bkt, *bn, *bcap;
+  int nb[6];
+  size_t n, nvox;
+
+  nxy = xsize * ysize;
+  nvox = (size_t)nxy * zsize;
+  done = rmax + 1;
+  status = 0;
+
+  key = (int *)malloc(nvox * sizeof(int));
+  bkt = (int **)calloc(rmax + 1, sizeof(int *));
+  bn = (int *)calloc(rmax + 1, sizeof(int));
+  bcap = (int *)calloc(rmax + 1, sizeof(int));
+  if (!key || !bkt || !bn || !bcap) {
+    free(key);
+    free(bkt);
+    free(bn);
+    free(bcap);
+    return (1);
+  }
+
+  /***
+   *	key is the best radius found so far for a voxel (-1 if none),
+   *	or done plus its radius once the voxel is settled.  The
+   *	centers on the face z = 0 start with their own radii.
+   ***/
+
+  for (n = 0; n < nvox; n++) {
+    if (rad[n] > rmax)
+      rad[n] = rmax;
+    key[n] = -1;
+  }
+
+  for (m = 0; m < nxy && !status; m++) {
+    if (rad[m] >= 0) {
+      key[m] = rad[m];
+      status = bktpush(bkt, bn, bcap, rad[m], m);
+    }
+  }
+
+  for (r = rmax; r >= 0 && !status; r--) {
+    while (bn[r] > 0 && !status) {
+      m = bkt[r][--bn[r]];
+      if (key[m] != r)
+        continue;
+      key[m] = done + r;
+
+      i = m % xsize;
+      j = (m / xsize) % ysize;
+      k = m / nxy;
+      nb[0] = m + ((i > 0) ? -1 : xsize - 1);
+      nb[1] = m + ((i < xsize - 1) ? 1 : 1 - xsize);
+      nb[2] = m + ((j > 0) ? -xsize : (ysize - 1) * xsize);
+      nb[3] = m + ((j < ysize - 1) ? xsize : (1 - ysize) * xsize);
+      nb[4] = m + ((k > 0) ? -nxy : (zsize - 1) * nxy);
+      nb[5] = m + ((k < zsize - 1) ? nxy : (1 - zsize) * nxy);
+
+      for (d = 0; d < 6 && !status; d++) {
+        q = (rad[nb[d]] < r) ? rad[nb[d]] : r;
+        if (q > key[nb[d]] && key[nb[d]] < done) {
+          key[nb[d]] = q;
+          status = bktpush(bkt, bn, bcap, q, nb[d]);
+        }
+      }
+    }
+  }
+
+  if (!status) {
+    for (n = 0; n < nvox; n++) {
+      rad[n] = (key[n] >= done) ? key[n] - done : -1;
+    }
+  }
+
+  for (r = 0; r <= rmax; r++) {
+    free(bkt[r]);
+  }
+  free(key);
+  free(bkt);
+  free(bn);
+  free(bcap);
+
+  return (status);
+}
+
+/******************************************************************************
+ *	Function poresizes finds the local thickness of every pore voxel
+ *	of an image, the diameter of the largest sphere of pore voxels
+ *	that covers it, and counts the voxels of each diameter
+ *
+ * 	Arguments:	unsigned char pointer to the image, nonzero at
+ * 				the pore voxels (x varies fastest)
+ * 				int xsize, ysize, zsize
+ * 				int largest diameter, odd
+ * 				int pointer to the counts, ndiam[0..maxdiam],
+ * 				filled at the odd diameters and zero elsewhere
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int poresizes(unsigned char *pore, int xsize, int ysize, int zsize,
+              int maxdiam, int *ndiam) {
+  int status, *rad;
+
+  rad = (int *)malloc((size_t)xsize * ysize * zsize * sizeof(int));
+  if (!rad)
+    return (1);
+
+  status = poreradii(pore, xsize, ysize, zsize, maxdiam / 2, rad);
+  if (!status)
+    status = sphcover(rad, xsize, ysize, zsize, maxdiam / 2, ndiam);
+
+  free(rad);
+
+  return (status);
+}
+
+/******************************************************************************
+ *	Function sqdistance gives every voxel its exact squared distance
+ *	to the nearest feature voxel, with periodic boundaries, by the
+ *	same transform as poreradii.  Feature voxels get 0.
+ *
+ * 	Arguments:	unsigned char pointer to the image, nonzero at
+ * 				the feature voxels (x varies fastest)
+ * 				int xsize, ysize, zsize
+ * 				int pointer to the squared distances, -1
+ * 				everywhere if there is no feature voxel
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int sqdistance(unsigned char *feat, int xsize, int ysize, int zsize,
+               int *d2) {
+  int maxsize, *w;
+  size_t n, nvox;
+  double *z;
+
+  nvox = (size_t)xsize * ysize * zsize;
+  maxsize = xsize;
+  if (ysize > maxsize)
+    maxsize = ysize;
+  if (zsize > maxsize)
+    maxsize = zsize;
+
+  w = (int *)malloc(8 * (size_t)maxsize * sizeof(int));
+  z = (double *)malloc((3 * (size_t)maxsize + 1) * sizeof(double));
+  if (!w || !z) {
+    free(w);
+    free(z);
+    return (1);
+  }
+
+  for (n = 0; n < nvox; n++) {
+    d2[n] = feat[n] ? 0 : EDTFAR;
+  }
+  sqedt(d2, xsize, ysize, zsize, maxsize, w, z);
+
+  for (n = 0; n < nvox; n++) {
+    if (d2[n] == EDTFAR)
+      d2[n] = -1;
+  }
+
+  free(w);
+  free(z);
+
+  return (0);
+}
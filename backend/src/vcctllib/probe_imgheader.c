@@ -31,12 +31,35 @@
 
 int probe_imgheader(char *name, float *ver, int *xsize, int *ysize, int *zsize,
                     float *res) {
+  int format;
+
+  return (probe_imgheader_fmt(name, ver, xsize, ysize, zsize, res, &format));
+}
+
+/******************************************************************************
+ *	Function probe_imgheader_fmt does the work of probe_imgheader and
+ *	also reports the encoding of the voxel data
+ *
+ * 	Arguments:	pointer to char array file name to open
+ * 				pointer to float version
+ * 				pointer to int xsize
+ * 				pointer to int ysize
+ * 				pointer to int zsize
+ * 				pointer to float resolution
+ * 				pointer to int format (IMG_ASCII, IMG_UINT8, IMG_UINT8Z)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int probe_imgheader_fmt(char *name, float *ver, int *xsize, int *ysize,
+                        int *zsize, float *res, int *format) {
   register int i;
   int done, status = 0;
   char buff[MAXSTRING], buff1[MAXSTRING];
   FILE *fpin;
 
-  if ((fpin = fopen(name, "r")) == NULL) {
+  *format = IMG_ASCII;
+
+  if ((fpin = fopen(name, "rb")) == NULL) {
     status = 1;
     return (status);
   }
@@ -66,6 +89,9 @@ int probe_imgheader(char *name, float *ver, int *xsize, int *ysize, int *zsize,
       fscanf(fpin, "%s", buff);
       *res = atof(buff);
       done = 1;
+      *format = read_imgformat(fpin);
+      if (*format < 0)
+        status = 1;
     }
 
   } else {
@@ -82,13 +108,9 @@ int probe_imgheader(char *name, float *ver, int *xsize, int *ysize, int *zsize,
     *xsize = DEFAULTSYSTEMSIZE;
     *ysize = DEFAULTSYSTEMSIZE;
     *zsize = DEFAULTSYSTEMSIZE;
-
-    fclose(fpin);
-    if ((fpin = fopen(name, "r")) == NULL) {
-      status = 1;
-      return (status);
-    }
   }
 
+  fclose(fpin);
+
   return (status);
 }
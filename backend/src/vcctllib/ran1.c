@@ -10,6 +10,13 @@
  * 	"Numerical Recipes in C".  2nd Edition. Cambridge
  * 	University Press,	London, 1997.
  *
+ * 	The shuffle table is private to each thread, so threads
+ * 	that draw from different seeds produce independent
+ * 	streams.  A single-threaded program behaves exactly as
+ * 	before.  New code that needs several streams should hold
+ * 	them in explicit state, either with ran1_r or with the
+ * 	generators in rng.c.
+ *
  * 	Arguments:	int seed
  *
  * 	Returns:	float random number
@@ -24,39 +31,116 @@
 #define IM 2147483647
 #define IQ 127773
 #define IR 2836
-#define NTAB 32
+#define NTAB RAN1NTAB
 #define EPS (1.2E-07)
 #define MAX(a, b) (a > b) ? a : b
 #define MIN(a, b) (a < b) ? a : b
 
+/* Shuffle table of the calling thread, used by ran1 */
+
+static VCCTL_THREADLOCAL Ran1state Ran1cur;
+
 double ran1(int *idum) {
+  double r;
+
+  Ran1cur.idum = *idum;
+  r = ran1_r(&Ran1cur);
+  *idum = Ran1cur.idum;
+
+  return (r);
+}
+
+/***
+ *	ran1_r
+ *
+ * 	The ran1 generator with all of its state, seed included,
+ * 	in an explicit structure supplied by the caller.  Streams
+ * 	held in different structures are independent, and ran1
+ * 	itself is this routine applied to a per-thread structure.
+ * 	Set idum to a negative seed and iy to zero to (re)start a
+ * 	stream.
+ *
+ * 	Arguments:	Ran1state pointer to the stream
+ *
+ * 	Returns:	double random number
+ *
+ *	Calls:		No other routines
+ *	Called by:	ran1, programs with more than one random stream
+ ***/
+double ran1_r(Ran1state *st) {
   int j, k;
-  static int iv[NTAB], iy = 0;
   static double NDIV = 1.0 / (1.0 + (IM - 1.0) / NTAB);
   static double RNMX = (1.0 - EPS);
   static double AM = (1.0 / IM);
 
-  if ((*idum <= 0) || (iy == 0)) {
-    *idum = MAX(-*idum, *idum);
+  if ((st->idum <= 0) || (st->iy == 0)) {
+    st->idum = MAX(-st->idum, st->idum);
 
     for (j = NTAB + 7; j >= 0; j--) {
-      k = *idum / IQ;
-      *idum = IA * (*idum - k * IQ) - IR * k;
-      if (*idum < 0)
-        *idum += IM;
+      k = st->idum / IQ;
+      st->idum = IA * (st->idum - k * IQ) - IR * k;
+      if (st->idum < 0)
+        st->idum += IM;
       if (j < NTAB)
-        iv[j] = *idum;
+        st->iv[j] = st->idum;
     }
 
-    iy = iv[0];
+    st->iy = st->iv[0];
   }
 
-  k = *idum / IQ;
-  *idum = IA * (*idum - k * IQ) - IR * k;
-  if (*idum < 0)
-    *idum += IM;
-  j = iy * NDIV;
-  iy = iv[j];
-  iv[j] = *idum;
-  return MIN(AM * iy, RNMX);
+  k = st->idum / IQ;
+  st->idum = IA * (st->idum - k * IQ) - IR * k;
+  if (st->idum < 0)
+    st->idum += IM;
+  j = st->iy * NDIV;
+  st->iy = st->iv[j];
+  st->iv[j] = st->idum;
+  return MIN(AM * st->iy, RNMX);
+}
+
+/***
+ *	ran1load
+ *
+ * 	Make a saved shuffle table the current one for the
+ * 	calling thread.  The seed in the state is not touched;
+ * 	pass its address to ran1 to continue that stream.
+ * 	A state with iy equal to zero makes the next call to
+ * 	ran1 reinitialize from the seed.
+ *
+ * 	Arguments:	Ran1state pointer to saved state
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	Programs with more than one random stream
+ ***/
+void ran1load(Ran1state *state) {
+  int j;
+
+  for (j = 0; j < NTAB; j++)
+    Ran1cur.iv[j] = state->iv[j];
+  Ran1cur.iy = state->iy;
+
+  return;
+}
+
+/***
+ *	ran1save
+ *
+ * 	Copy the current shuffle table of the calling thread
+ * 	into a state structure
+ *
+ * 	Arguments:	Ran1state pointer to state to fill
+ * 	Returns:	Nothing
+ *
+ *	Calls:		No other routines
+ *	Called by:	Programs with more than one random stream
+ ***/
+void ran1save(Ran1state *state) {
+  int j;
+
+  for (j = 0; j < NTAB; j++)
+    state->iv[j] = Ran1cur.iv[j];
+  state->iy = Ran1cur.iy;
+
+  return;
 }
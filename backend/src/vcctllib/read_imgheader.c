@@ -31,9 +31,40 @@
 
 int read_imgheader(FILE *fpin, float *ver, int *xsize, int *ysize, int *zsize,
                    float *res) {
+  int status, format;
+
+  status = read_imgheader_fmt(fpin, ver, xsize, ysize, zsize, res, &format);
+  if (!status && format != IMG_ASCII) {
+    warning("read_imgheader",
+            "Binary image found where an ASCII image was expected");
+  }
+
+  return (status);
+}
+
+/******************************************************************************
+ *    Function read_imgheader_fmt does the work of read_imgheader and
+ *    also reports the encoding of the voxel data.  For a binary image
+ *    the stream is left at the first voxel, so the caller can go on
+ *    with read_binvoxels.
+ *
+ *     Arguments:    file pointer
+ *                   pointer to float version
+ *                   pointer to int xsize
+ *                   pointer to int ysize
+ *                   pointer to int zsize
+ *                   pointer to float resolution
+ *                   pointer to int format (IMG_ASCII, IMG_UINT8, IMG_UINT8Z)
+ *
+ *    Returns:    int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int read_imgheader_fmt(FILE *fpin, float *ver, int *xsize, int *ysize,
+                       int *zsize, float *res, int *format) {
   int status = 0;
   char buff[MAXSTRING], buff1[MAXSTRING];
 
+  *format = IMG_ASCII;
+
   if (!fpin) {
     status = 1;
     return (status);
@@ -53,6 +84,9 @@ int read_imgheader(FILE *fpin, float *ver, int *xsize, int *ysize, int *zsize,
       *zsize = atoi(buff1);
       fscanf(fpin, "%s %s", buff, buff1);
       *res = atof(buff1);
+      *format = read_imgformat(fpin);
+      if (*format < 0)
+        status = 1;
     } else if (!strcmp(buff, IMGSIZESTRING)) {
       fscanf(fpin, "%s", buff);
       *xsize = atoi(buff);
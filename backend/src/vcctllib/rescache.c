@@ -0,0 +1,282 @@
+/******************************************************************************
+ *	Cache of the results of the property programs, so that asking
+ *	again for the moduli, conductivity, pore sizes or percolation
+ *	of a microstructure that was already analyzed costs a read of
+ *	one small file instead of a solution.
+ *
+ *	A program fills a Rescache with rescache_init and rescache_add,
+ *	giving it everything its results depend on: the phase of each
+ *	voxel and the parameters of the model (moduli, conductivities,
+ *	stopping criterion, ITZ flags).  These are hashed into a 128-bit
+ *	key, two 64-bit FNV-1a hashes with different offset bases, and
+ *	the results are kept in the file prog-key.vrc of the cache
+ *	directory.  The file starts with RESCACHEMAGIC, the key and the
+ *	number of bytes of results that follow, which the program
+ *	writes and reads back itself in the same order.
+ *
+ *	A file is written under a temporary name and renamed when it is
+ *	complete, so a reader sees the whole of it or nothing, and one
+ *	that was cut short or belongs to another key is taken as a miss.
+ *	The cache can be shared by several programs and runs; removing
+ *	the directory, or any file in it, only empties it.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifdef _WIN32
+#include <direct.h>
+#define MAKEDIR(d) _mkdir(d)
+#define PATH_SEPARATOR "\\"
+#else
+#define MAKEDIR(d) mkdir((d), 0755)
+#define PATH_SEPARATOR "/"
+#endif
+
+#define RESCACHEMAGIC "VCCTLRC1"
+#define RESCACHEHEAD 32 /* bytes of magic, key and length */
+
+#define FNVBASIS0 0xcbf29ce484222325ULL
+#define FNVBASIS1 0x84222325cbf29ce4ULL
+#define FNVPRIME 0x100000001b3ULL
+
+/******************************************************************************
+ *	Function rescache_path makes the name of the file for the key
+ *
+ * 	Arguments:	Rescache pointer
+ * 				char pointer to the name, MAXSTRING long
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the name is too long)
+ ******************************************************************************/
+static int rescache_path(Rescache *rc, char *path) {
+  int n;
+
+  n = snprintf(path, MAXSTRING, "%s%s%s-%016llx%016llx.vrc", rc->dir,
+               PATH_SEPARATOR, rc->prog, (unsigned long long)rc->key[0],
+               (unsigned long long)rc->key[1]);
+
+  return (n < 0 || n >= MAXSTRING - 8);
+}
+
+/******************************************************************************
+ *	Function rescache_put64 writes a 64-bit value, little-endian
+ *
+ * 	Arguments:	FILE pointer
+ * 				uint64_t value
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int rescache_put64(FILE *fp, uint64_t val) {
+  unsigned char b[8];
+  int i;
+
+  for (i = 0; i < 8; i++)
+    b[i] = (unsigned char)(val >> (8 * i));
+
+  return (fwrite(b, 1, 8, fp) != 8);
+}
+
+/******************************************************************************
+ *	Function rescache_get64 reads a 64-bit value, little-endian
+ *
+ * 	Arguments:	FILE pointer
+ * 				uint64_t pointer to the value
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int rescache_get64(FILE *fp, uint64_t *val) {
+  unsigned char b[8];
+  int i;
+
+  if (fread(b, 1, 8, fp) != 8)
+    return (1);
+  *val = 0;
+  for (i = 7; i >= 0; i--)
+    *val = (*val << 8) | b[i];
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function rescache_init starts the key of a result.  An empty
+ *	directory name turns the cache off, so that rescache_open always
+ *	misses and rescache_create gives no file.
+ *
+ * 	Arguments:	Rescache pointer
+ * 				char pointer to the cache directory ("" for none)
+ * 				char pointer to the name of the program, which
+ * 					also starts the key
+ *
+ *	Returns:	Nothing
+ ******************************************************************************/
+void rescache_init(Rescache *rc, const char *dir, const char *prog) {
+  size_t n;
+
+  rc->on = (dir && strlen(dir) > 0);
+  strncpy(rc->dir, rc->on ? dir : "", MAXSTRING - 1);
+  rc->dir[MAXSTRING - 1] = '\0';
+  n = strlen(rc->dir);
+  if (n > 1 && rc->dir[n - 1] == PATH_SEPARATOR[0])
+    rc->dir[n - 1] = '\0';
+  strncpy(rc->prog, prog, sizeof(rc->prog) - 1);
+  rc->prog[sizeof(rc->prog) - 1] = '\0';
+  rc->key[0] = FNVBASIS0;
+  rc->key[1] = FNVBASIS1;
+  rc->tmpname[0] = '\0';
+  rescache_add(rc, rc->prog, strlen(rc->prog));
+
+  return;
+}
+
+/******************************************************************************
+ *	Function rescache_add hashes more of what a result depends on
+ *	into its key.  Values are hashed as they are held in memory.
+ *
+ * 	Arguments:	Rescache pointer
+ * 				pointer to the data
+ * 				size_t number of bytes
+ *
+ *	Returns:	Nothing
+ ******************************************************************************/
+void rescache_add(Rescache *rc, const void *data, size_t n) {
+  const unsigned char *p = (const unsigned char *)data;
+  uint64_t h0, h1;
+  size_t i;
+
+  if (!rc->on)
+    return;
+
+  h0 = rc->key[0];
+  h1 = rc->key[1];
+  for (i = 0; i < n; i++) {
+    h0 = (h0 ^ p[i]) * FNVPRIME;
+    h1 = (h1 ^ p[i]) * FNVPRIME;
+    h1 ^= h1 >> 29;
+  }
+  rc->key[0] = h0;
+  rc->key[1] = h1;
+
+  return;
+}
+
+/******************************************************************************
+ *	Function rescache_open looks up the result of the key
+ *
+ * 	Arguments:	Rescache pointer
+ *
+ *	Returns:	FILE pointer placed at the start of the results, to be
+ *				read and closed by the caller, or NULL if the
+ *				result is not in the cache
+ ******************************************************************************/
+FILE *rescache_open(Rescache *rc) {
+  char path[MAXSTRING], magic[8];
+  uint64_t key0, key1, len;
+  long size;
+  FILE *fp;
+
+  if (!rc->on || rescache_path(rc, path))
+    return (NULL);
+  fp = fopen(path, "rb");
+  if (!fp)
+    return (NULL);
+
+  if (fseek(fp, 0L, SEEK_END) || (size = ftell(fp)) < RESCACHEHEAD ||
+      fseek(fp, 0L, SEEK_SET) || fread(magic, 1, 8, fp) != 8 ||
+      memcmp(magic, RESCACHEMAGIC, 8) || rescache_get64(fp, &key0) ||
+      rescache_get64(fp, &key1) || rescache_get64(fp, &len) ||
+      key0 != rc->key[0] || key1 != rc->key[1] ||
+      len != (uint64_t)(size - RESCACHEHEAD)) {
+    fclose(fp);
+    return (NULL);
+  }
+
+  return (fp);
+}
+
+/******************************************************************************
+ *	Function rescache_create starts the file for the result of the
+ *	key, making the cache directory if there is none
+ *
+ * 	Arguments:	Rescache pointer
+ *
+ *	Returns:	FILE pointer to write the results to and hand to
+ *				rescache_commit, or NULL if the cache is off
+ *				or the file could not be made
+ ******************************************************************************/
+FILE *rescache_create(Rescache *rc) {
+  char path[MAXSTRING];
+  FILE *fp;
+
+  if (!rc->on || rescache_path(rc, path))
+    return (NULL);
+  MAKEDIR(rc->dir);
+
+  /* The clock and address make it unlikely that two runs share the */
+  /* temporary file */
+
+  snprintf(rc->tmpname, MAXSTRING, "%s.%lx", path,
+           (unsigned long)clock() ^ (unsigned long)(size_t)rc);
+  fp = fopen(rc->tmpname, "wb");
+  if (!fp) {
+    rc->tmpname[0] = '\0';
+    return (NULL);
+  }
+
+  /* The length is filled in by rescache_commit */
+
+  if (fwrite(RESCACHEMAGIC, 1, 8, fp) != 8 ||
+      rescache_put64(fp, rc->key[0]) || rescache_put64(fp, rc->key[1]) ||
+      rescache_put64(fp, 0)) {
+    fclose(fp);
+    remove(rc->tmpname);
+    rc->tmpname[0] = '\0';
+    return (NULL);
+  }
+
+  return (fp);
+}
+
+/******************************************************************************
+ *	Function rescache_commit finishes the file started by
+ *	rescache_create and puts it in the cache, or throws it away if
+ *	the results could not all be written
+ *
+ * 	Arguments:	Rescache pointer
+ * 				FILE pointer from rescache_create (NULL is okay)
+ * 				int nonzero if writing the results failed
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int rescache_commit(Rescache *rc, FILE *fp, int failed) {
+  char path[MAXSTRING];
+  long size;
+
+  if (!fp)
+    return (1);
+
+  if (!failed) {
+    failed = fseek(fp, 0L, SEEK_END) || (size = ftell(fp)) < RESCACHEHEAD ||
+             fseek(fp, 24L, SEEK_SET) ||
+             rescache_put64(fp, (uint64_t)(size - RESCACHEHEAD));
+  }
+  if (fclose(fp))
+    failed = 1;
+
+  /* rename will not replace a file on Windows, so clear the way */
+
+  if (!failed && !rescache_path(rc, path)) {
+#ifdef _WIN32
+    remove(path);
+#endif
+    failed = rename(rc->tmpname, path);
+  } else {
+    failed = 1;
+  }
+  if (failed)
+    remove(rc->tmpname);
+  rc->tmpname[0] = '\0';
+
+  return (failed != 0);
+}
@@ -0,0 +1,258 @@
+/******************************************************************************
+ *	rng.c is a random number generator with explicit state, for
+ *	programs that need many independent, reproducible streams (one
+ *	per thread or per subdomain) instead of the single hidden stream
+ *	of ran1.
+ *
+ *	The generator is xoshiro256** of D. Blackman and S. Vigna,
+ *	"Scrambled linear pseudorandom number generators", ACM Trans.
+ *	Math. Softw. 47 (2021) 36.  It has a period of 2^256 - 1, and
+ *	rng_jump advances a stream by 2^128 draws, so streams made by
+ *	rng_stream from the same seed never overlap in practice.
+ *
+ *	Each Rngstate belongs to one thread at a time; nothing in this
+ *	file keeps hidden state, so all routines are thread-safe.
+ *	Legacy models keep using ran1, whose output is unchanged.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+
+/***
+ *	rotl
+ *
+ *	Rotate a 64-bit word left by k bits
+ ***/
+static inline uint64_t rotl(const uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+/***
+ *	splitmix64
+ *
+ *	Advance a 64-bit counter and return a well-mixed word;
+ *	used only to expand a seed into a full generator state
+ ***/
+static uint64_t splitmix64(uint64_t *x) {
+  uint64_t z;
+
+  z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return (z ^ (z >> 31));
+}
+
+/***
+ *	rng_seed
+ *
+ *	Initialize a stream from a 64-bit seed.  Any seed, zero
+ *	included, gives a valid state.
+ *
+ * 	Arguments:	Rngstate pointer to the stream
+ * 				uint64_t seed
+ *
+ * 	Returns:	Nothing
+ *
+ *	Calls:		splitmix64
+ *	Called by:	Programs with explicit random streams
+ ***/
+void rng_seed(Rngstate *st, uint64_t seed) {
+  int i;
+
+  for (i = 0; i < 4; i++)
+    st->s[i] = splitmix64(&seed);
+
+  return;
+}
+
+/***
+ *	rng_next
+ *
+ *	Return the next 64 random bits of a stream
+ *
+ * 	Arguments:	Rngstate pointer to the stream
+ *
+ * 	Returns:	uint64_t random word
+ *
+ *	Calls:		rotl
+ *	Called by:	rng_uniform, programs with explicit random streams
+ ***/
+uint64_t rng_next(Rngstate *st) {
+  uint64_t result, t;
+
+  result = rotl(st->s[1] * 5, 7) * 9;
+  t = st->s[1] << 17;
+
+  st->s[2] ^= st->s[0];
+  st->s[3] ^= st->s[1];
+  st->s[1] ^= st->s[2];
+  st->s[0] ^= st->s[3];
+  st->s[2] ^= t;
+  st->s[3] = rotl(st->s[3], 45);
+
+  return (result);
+}
+
+/***
+ *	rng_uniform
+ *
+ *	Return a random number uniformly distributed in the
+ *	interval [0.0,1.0), with 53 random bits
+ *
+ * 	Arguments:	Rngstate pointer to the stream
+ *
+ * 	Returns:	double random number
+ *
+ *	Calls:		rng_next
+ *	Called by:	Programs with explicit random streams
+ ***/
+double rng_uniform(Rngstate *st) {
+  return ((double)(rng_next(st) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/***
+ *	rng_fill
+ *
+ *	Fill an array with uniform random numbers in [0.0,1.0).
+ *	The result is the same as n calls to rng_uniform, but the
+ *	state is kept in registers for the whole loop and the
+ *	conversion to double has no dependence on earlier draws.
+ *
+ * 	Arguments:	Rngstate pointer to the stream
+ * 				double pointer to the array to fill
+ * 				size_t number of values
+ *
+ * 	Returns:	Nothing
+ *
+ *	Calls:		rotl
+ *	Called by:	Programs with explicit random streams
+ ***/
+void rng_fill(Rngstate *st, double *buf, size_t n) {
+  size_t i;
+  uint64_t s0, s1, s2, s3, result, t;
+
+  s0 = st->s[0];
+  s1 = st->s[1];
+  s2 = st->s[2];
+  s3 = st->s[3];
+
+  for (i = 0; i < n; i++) {
+    result = rotl(s1 * 5, 7) * 9;
+    t = s1 << 17;
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = rotl(s3, 45);
+    buf[i] = (double)(result >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  st->s[0] = s0;
+  st->s[1] = s1;
+  st->s[2] = s2;
+  st->s[3] = s3;
+
+  return;
+}
+
+/***
+ *	rng_jumpby
+ *
+ *	Advance a stream by the number of draws encoded in a
+ *	jump polynomial
+ ***/
+static void rng_jumpby(Rngstate *st, const uint64_t *jump) {
+  int i, b;
+  uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+  for (i = 0; i < 4; i++) {
+    for (b = 0; b < 64; b++) {
+      if (jump[i] & ((uint64_t)1 << b)) {
+        s0 ^= st->s[0];
+        s1 ^= st->s[1];
+        s2 ^= st->s[2];
+        s3 ^= st->s[3];
+      }
+      rng_next(st);
+    }
+  }
+
+  st->s[0] = s0;
+  st->s[1] = s1;
+  st->s[2] = s2;
+  st->s[3] = s3;
+
+  return;
+}
+
+/***
+ *	rng_jump
+ *
+ *	Advance a stream by 2^128 draws
+ *
+ * 	Arguments:	Rngstate pointer to the stream
+ *
+ * 	Returns:	Nothing
+ *
+ *	Calls:		rng_jumpby
+ *	Called by:	rng_stream, programs with explicit random streams
+ ***/
+void rng_jump(Rngstate *st) {
+  static const uint64_t jump[4] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                   0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+
+  rng_jumpby(st, jump);
+
+  return;
+}
+
+/***
+ *	rng_longjump
+ *
+ *	Advance a stream by 2^192 draws, for splitting streams
+ *	that will themselves be split with rng_jump
+ *
+ * 	Arguments:	Rngstate pointer to the stream
+ *
+ * 	Returns:	Nothing
+ *
+ *	Calls:		rng_jumpby
+ *	Called by:	Programs with explicit random streams
+ ***/
+void rng_longjump(Rngstate *st) {
+  static const uint64_t longjump[4] = {
+      0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL,
+      0x39109bb02acbe635ULL};
+
+  rng_jumpby(st, longjump);
+
+  return;
+}
+
+/***
+ *	rng_stream
+ *
+ *	Make stream number k of a family of non-overlapping
+ *	streams derived from one seed: the seeded state advanced
+ *	by k jumps of 2^128 draws.  Stream k is the same no matter
+ *	how many streams are made or on which thread, so a thread
+ *	or subdomain that always uses the same k always gets the
+ *	same numbers.
+ *
+ * 	Arguments:	Rngstate pointer to the stream to set
+ * 				uint64_t seed of the family
+ * 				int stream number (0 or greater)
+ *
+ * 	Returns:	Nothing
+ *
+ *	Calls:		rng_seed, rng_jump
+ *	Called by:	Programs with explicit random streams
+ ***/
+void rng_stream(Rngstate *st, uint64_t seed, int k) {
+  int i;
+
+  rng_seed(st, seed);
+  for (i = 0; i < k; i++)
+    rng_jump(st);
+
+  return;
+}
@@ -34,6 +34,7 @@ void skip_imgheader(FILE *fpin) {
     fscanf(fpin, "%s", buff);
     if (!strcmp(buff, IMGRESSTRING)) {
       fscanf(fpin, "%s", buff);
+      read_imgformat(fpin);
       done = 1;
     }
   }
@@ -0,0 +1,450 @@
+#include "../include/vcctlcomplex.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
+/******************************************************************
+ *	Spherical harmonics for the real-shape particles of genmic
+ *	and genaggpack.  The normalized associated Legendre
+ *	functions are found by the usual three-term recurrence in
+ *	n, with its coefficients tabulated once, and the
+ *	factorials come from a table.  An Shgrid keeps the
+ *	harmonics at every point of a Gaussian quadrature grid,
+ *	so the volume and extent of a particle on that grid are
+ *	sums of its coefficients times the stored values.
+ ******************************************************************/
+
+/* Coefficients of the recurrences, filled by shinit */
+
+static int Shready = 0;
+static double Sha[SHMAXDEG + 1][SHMAXDEG + 1];
+static double Shb[SHMAXDEG + 1][SHMAXDEG + 1];
+static double Shd[SHMAXDEG + 1];
+static double Factab[FACTABMAX + 1];
+
+/******************************************************
+ *
+ *	shinit
+ *
+ *	Tabulate the factorials and the coefficients of the
+ *	Legendre recurrences
+ *
+ *	Arguments:	None
+ *	Returns:	Nothing
+ *
+ *	Calls: No other routines
+ *	Called by:  factorial, sphharm
+ *
+ ******************************************************/
+static void shinit(void) {
+  int n, m;
+  double xn, xm;
+
+  Factab[0] = 1.0;
+  for (n = 1; n <= FACTABMAX; n++) {
+    Factab[n] = Factab[n - 1] * (double)n;
+  }
+
+  for (m = 0; m <= SHMAXDEG; m++) {
+    xm = (double)m;
+    Shd[m] = (m > 0) ? -sqrt((2.0 * xm + 1.0) / (2.0 * xm)) : 1.0;
+    for (n = m + 2; n <= SHMAXDEG; n++) {
+      xn = (double)n;
+      Sha[n][m] = sqrt((4.0 * xn * xn - 1.0) / (xn * xn - xm * xm));
+      Shb[n][m] = sqrt(((xn - 1.0) * (xn - 1.0) - xm * xm) /
+                       (4.0 * (xn - 1.0) * (xn - 1.0) - 1.0));
+    }
+  }
+
+  Shready = 1;
+
+  return;
+}
+
+/******************************************************
+ *
+ *	factorial
+ *
+ *	Factorial of a non-negative integer, from a table up
+ *	to FACTABMAX
+ *
+ *	Arguments:	int j
+ *	Returns:	double j!
+ *
+ *	Calls: shinit
+ *	Called by:  calling program
+ *
+ ******************************************************/
+double factorial(int j) {
+  int i;
+  double fact;
+
+  if (!Shready)
+    shinit();
+
+  if (j <= 1)
+    return (1.0);
+  if (j <= FACTABMAX)
+    return (Factab[j]);
+
+  fact = Factab[FACTABMAX];
+  for (i = FACTABMAX + 1; i <= j; i++) {
+    fact *= (double)i;
+  }
+
+  return (fact);
+}
+
+/******************************************************
+ *
+ *	sphharm
+ *
+ *	Complex spherical harmonics Y(n,m) at one direction,
+ *	for 0 <= n <= nmax and -n <= m <= n, with the
+ *	Condon-Shortley phase (as in Arfken).  For each m the
+ *	normalized Legendre function starts from the exact
+ *	m = n value and goes up in n by recurrence, which is
+ *	stable for any direction.  Terms with n > SHMAXDEG
+ *	are set to zero.
+ *
+ *	Arguments:	double theta and phi coordinates
+ *				int nmax, the largest n
+ *				fcomplex matrix y[0..nmax][-nmax..nmax]
+ *				to fill
+ *	Returns:	Nothing
+ *
+ *	Calls: shinit
+ *	Called by:  harm in genmic and genaggpack, shgrid_make
+ *
+ ******************************************************/
+void sphharm(double theta, double phi, int nmax, fcomplex **y) {
+  int n, m, ntop;
+  double x, s, qmm, q0, q1, q2, cm, sm, c1, s1, tmp, sign;
+
+  if (!Shready)
+    shinit();
+
+  ntop = (nmax < SHMAXDEG) ? nmax : SHMAXDEG;
+  for (n = ntop + 1; n <= nmax; n++) {
+    for (m = -n; m <= n; m++) {
+      y[n][m].r = y[n][m].i = 0.0;
+    }
+  }
+
+  x = cos(theta);
+  s = sqrt(1.0 - (x * x));
+  c1 = cos(phi);
+  s1 = sin(phi);
+
+  qmm = 1.0 / sqrt(4.0 * PI);
+  cm = 1.0;
+  sm = 0.0;
+  sign = 1.0;
+
+  for (m = 0; m <= ntop; m++) {
+    if (m > 0) {
+      qmm *= Shd[m] * s;
+      tmp = cm * c1 - sm * s1;
+      sm = sm * c1 + cm * s1;
+      cm = tmp;
+      sign = -sign;
+    }
+
+    q2 = qmm;
+    q1 = sqrt(2.0 * m + 3.0) * x * qmm;
+    for (n = m; n <= ntop; n++) {
+      if (n == m) {
+        q0 = q2;
+      } else if (n == m + 1) {
+        q0 = q1;
+      } else {
+        q0 = Sha[n][m] * (x * q1 - Shb[n][m] * q2);
+        q2 = q1;
+        q1 = q0;
+      }
+      y[n][m].r = q0 * cm;
+      y[n][m].i = q0 * sm;
+      if (m > 0) {
+        y[n][-m].r = sign * q0 * cm;
+        y[n][-m].i = -sign * q0 * sm;
+      }
+    }
+  }
+
+  return;
+}
+
+/******************************************************
+ *
+ *	sphradius
+ *
+ *	Real part of the spherical harmonic series with
+ *	coefficients a at the direction whose harmonics are
+ *	in y, which is the radius of a real-shape particle
+ *	in that direction
+ *
+ *	Arguments:	fcomplex matrices a and y, [0..nmax][-nmax..nmax]
+ *				int nmax, the largest n
+ *	Returns:	double radius
+ *
+ *	Calls: No other routines
+ *	Called by:  image in genmic and genaggpack
+ *
+ ******************************************************/
+double sphradius(fcomplex **a, fcomplex **y, int nmax) {
+  int n, m;
+  double r;
+
+  r = 0.0;
+  for (n = 0; n <= nmax; n++) {
+    for (m = -n; m <= n; m++) {
+      r += a[n][m].r * y[n][m].r - a[n][m].i * y[n][m].i;
+    }
+  }
+
+  return (r);
+}
+
+/******************************************************
+ *
+ *	shgrid_make
+ *
+ *	Make the table of spherical harmonics on a Gaussian
+ *	quadrature grid, unless g already holds the table
+ *	for the same grid and nmax.  Point (i,j) has
+ *	theta = (pi/2)(xg[i]+1) and phi = pi(xg[j]+1), for
+ *	1 <= i <= ntheta and 1 <= j <= nphi, and weight
+ *	wg[i]*wg[j].  An Shgrid starts out zeroed.
+ *
+ *	Arguments:	Shgrid pointer
+ *				int nmax, the largest n
+ *				int ntheta, nphi
+ *				float xg[1..], wg[1..], the quadrature points
+ *				and weights
+ *	Returns:	0 if okay, 1 if out of memory
+ *
+ *	Calls: sphharm, complexmatrix, shgrid_free
+ *	Called by:  genparticles in genmic and genaggpack
+ *
+ ******************************************************/
+int shgrid_make(Shgrid *g, int nmax, int ntheta, int nphi, float *xg,
+                float *wg) {
+  int i, j, n, m, k, npt, nsh, nxg;
+  double theta, phi;
+  fcomplex **y, *yp;
+
+  nxg = (ntheta > nphi) ? ntheta : nphi;
+  if (g->y && g->nmax == nmax && g->ntheta == ntheta && g->nphi == nphi &&
+      !memcmp(g->xg, xg + 1, nxg * sizeof(float)) &&
+      !memcmp(g->wg, wg + 1, nxg * sizeof(float))) {
+    return (0);
+  }
+
+  shgrid_free(g);
+
+  npt = ntheta * nphi;
+  nsh = (nmax + 1) * (nmax + 1);
+  g->xg = (float *)malloc(nxg * sizeof(float));
+  g->wg = (float *)malloc(nxg * sizeof(float));
+  g->y = (fcomplex *)malloc((size_t)npt * nsh * sizeof(fcomplex));
+  g->geom = (double *)malloc((size_t)npt * 4 * sizeof(double));
+  y = complexmatrix(0, nmax, -nmax, nmax);
+  if (!g->xg || !g->wg || !g->y || !g->geom || !y) {
+    if (y)
+      free_complexmatrix(y, 0, nmax, -nmax, nmax);
+    shgrid_free(g);
+    return (1);
+  }
+
+  g->nmax = nmax;
+  g->ntheta = ntheta;
+  g->nphi = nphi;
+  memcpy(g->xg, xg + 1, nxg * sizeof(float));
+  memcpy(g->wg, wg + 1, nxg * sizeof(float));
+
+  k = 0;
+  for (i = 1; i <= ntheta; i++) {
+    theta = 0.5 * PI * (xg[i] + 1.0);
+    for (j = 1; j <= nphi; j++) {
+      phi = PI * (xg[j] + 1.0);
+      sphharm(theta, phi, nmax, y);
+      yp = g->y + (size_t)k * nsh;
+      for (n = 0; n <= nmax; n++) {
+        for (m = -n; m <= n; m++) {
+          yp[n * n + n + m] = y[n][m];
+        }
+      }
+      g->geom[4 * k] = sin(theta) * cos(phi);
+      g->geom[4 * k + 1] = sin(theta) * sin(phi);
+      g->geom[4 * k + 2] = cos(theta);
+      g->geom[4 * k + 3] = (sin(theta) / 3.0) * wg[i] * wg[j];
+      k++;
+    }
+  }
+
+  free_complexmatrix(y, 0, nmax, -nmax, nmax);
+
+  return (0);
+}
+
+/******************************************************
+ *
+ *	shgrid_volume
+ *
+ *	Volume of a real-shape particle by quadrature over
+ *	the grid, and its largest extent along each axis
+ *
+ *	Arguments:	Shgrid pointer, made by shgrid_make
+ *				fcomplex matrix a[0..nmax][-nmax..nmax] of
+ *				coefficients
+ *				float pointers to the extents in x, y, z
+ *	Returns:	double volume
+ *
+ *	Calls: No other routines
+ *	Called by:  genparticles in genmic and genaggpack
+ *
+ ******************************************************/
+double shgrid_volume(Shgrid *g, fcomplex **a, float *maxrx, float *maxry,
+                     float *maxrz) {
+  int k, n, m, npt, nsh;
+  double r, rx, ry, rz, volume;
+  fcomplex *yp;
+
+  npt = g->ntheta * g->nphi;
+  nsh = (g->nmax + 1) * (g->nmax + 1);
+  *maxrx = *maxry = *maxrz = 0.0;
+  volume = 0.0;
+
+  for (k = 0; k < npt; k++) {
+    yp = g->y + (size_t)k * nsh;
+    r = 0.0;
+    for (n = 0; n <= g->nmax; n++) {
+      for (m = -n; m <= n; m++) {
+        r += a[n][m].r * yp[n * n + n + m].r - a[n][m].i * yp[n * n + n + m].i;
+      }
+    }
+
+    rx = fabs(r * g->geom[4 * k]);
+    ry = fabs(r * g->geom[4 * k + 1]);
+    rz = fabs(r * g->geom[4 * k + 2]);
+    if (rx > *maxrx)
+      *maxrx = rx;
+    if (ry > *maxry)
+      *maxry = ry;
+    if (rz > *maxrz)
+      *maxrz = rz;
+
+    volume += r * r * r * g->geom[4 * k + 3];
+  }
+
+  return (0.5 * PI * PI * volume);
+}
+
+/******************************************************
+ *
+ *	shrotate
+ *
+ *	Rotate the coefficients of a real-shape particle by
+ *	the Euler angles alpha, beta, gamma and scale them.
+ *	Each degree n is multiplied by its Wigner D matrix,
+ *
+ *	  aa(n,m) = scale * sum over m' of a(n,m') *
+ *	      sqrt((n+m')!(n-m')!/((n+m)!(n-m)!)) *
+ *	      d(n,m',m)(beta) * exp(-i m' alpha) * exp(-i m gamma)
+ *
+ *	with the small d from its sum over k, so the rotated
+ *	particle is a new set of coefficients.  The powers of
+ *	cos(beta/2) and sin(beta/2) and the phases are found
+ *	once per call, so the cost is that of the sums.
+ *
+ *	Arguments:	fcomplex matrices a and aa [0..nmax][-nmax..nmax]
+ *				int nmax, the largest n (at most SHMAXDEG)
+ *				double Euler angles alpha, beta, gamma
+ *				double scale factor
+ *	Returns:	Nothing
+ *
+ *	Calls: shinit
+ *	Called by:  genparticles in genmic and genaggpack
+ *
+ ******************************************************/
+void shrotate(fcomplex **a, fcomplex **aa, int nmax, double alpha,
+              double beta, double gamma, double scale) {
+  int n, m, mp, k, klow, khigh;
+  double cb[2 * SHMAXDEG + 1], sb[2 * SHMAXDEG + 1];
+  double ca[2 * SHMAXDEG + 1], sa[2 * SHMAXDEG + 1];
+  double cg[2 * SHMAXDEG + 1], sg[2 * SHMAXDEG + 1];
+  double total, term, norm, re, im;
+
+  if (!Shready)
+    shinit();
+  if (nmax > SHMAXDEG)
+    nmax = SHMAXDEG;
+
+  cb[0] = sb[0] = 1.0;
+  for (k = 1; k <= 2 * nmax; k++) {
+    cb[k] = cb[k - 1] * cos(0.5 * beta);
+    sb[k] = sb[k - 1] * sin(0.5 * beta);
+  }
+
+  /* Phases exp(-i m alpha) and exp(-i m gamma), m + nmax */
+
+  for (m = -nmax; m <= nmax; m++) {
+    ca[m + nmax] = cos(m * alpha);
+    sa[m + nmax] = -sin(m * alpha);
+    cg[m + nmax] = cos(m * gamma);
+    sg[m + nmax] = -sin(m * gamma);
+  }
+
+  for (n = 0; n <= nmax; n++) {
+    for (m = -n; m <= n; m++) {
+      re = im = 0.0;
+      for (mp = -n; mp <= n; mp++) {
+        klow = (m - mp > 0) ? m - mp : 0;
+        khigh = (n - mp < n + m) ? n - mp : n + m;
+        total = 0.0;
+        for (k = klow; k <= khigh; k++) {
+          term = Factab[n + m] / Factab[k] / Factab[n + m - k];
+          term *= Factab[n - m] / Factab[n - mp - k] / Factab[mp + k - m];
+          term *= cb[2 * n + m - mp - 2 * k] * sb[2 * k + mp - m];
+          total += ((k + mp - m) % 2) ? -term : term;
+        }
+        norm = total * sqrt(Factab[n + mp] * Factab[n - mp] / Factab[n + m] /
+                            Factab[n - m]);
+        re += norm * (a[n][mp].r * ca[mp + nmax] - a[n][mp].i * sa[mp + nmax]);
+        im += norm * (a[n][mp].r * sa[mp + nmax] + a[n][mp].i * ca[mp + nmax]);
+      }
+      aa[n][m].r = (float)(scale * (re * cg[m + nmax] - im * sg[m + nmax]));
+      aa[n][m].i = (float)(scale * (re * sg[m + nmax] + im * cg[m + nmax]));
+    }
+  }
+
+  return;
+}
+
+/******************************************************
+ *
+ *	shgrid_free
+ *
+ *	Release the table of an Shgrid and zero it
+ *
+ *	Arguments:	Shgrid pointer
+ *	Returns:	Nothing
+ *
+ *	Calls: No other routines
+ *	Called by:  shgrid_make, freegenmic, freeallmem
+ *
+ ******************************************************/
+void shgrid_free(Shgrid *g) {
+  free(g->xg);
+  free(g->wg);
+  free(g->y);
+  free(g->geom);
+  memset(g, 0, sizeof(Shgrid));
+
+  return;
+}
@@ -0,0 +1,323 @@
+/******************************************************************************
+ *	Conversion of THAMES microstructure images to VCCTL images.
+ *
+ *	The phase id of each voxel is looked up in a table as it is
+ *	read, one x plane at a time, so an image of any size is
+ *	converted with memory for one plane.  The voxels stay in the
+ *	order they are read.  The input may be an ASCII image or a
+ *	uint8 binary image (see binimg.c), and the output may be
+ *	written either way.
+ *
+ *	A path may name one image or a directory, in which case every
+ *	image (*.img) in it is converted in order of name, which is
+ *	the order of a time series.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <dirent.h>
+#endif
+
+/******************************************************************************
+ *	Function thames_idtable fills the table of VCCTL phase ids for
+ *	each THAMES phase id.  Ids with no VCCTL phase become porosity.
+ *	For the correlation function programs each phase is then put
+ *	into one of a few classes instead:
+ *
+ *		1 = C3S or C2S, 2 = C3A or C4AF, 4 = CH, 5 = CSH,
+ *		6 = ettringite, 7 = AFm, 8 = porosity, 0 = the rest
+ *
+ * 	Arguments:	int pointer to CENSUSIDS entries to fill
+ * 				int corr (1 for correlation classes, 0 otherwise)
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void thames_idtable(int *table, int corr) {
+  int i, val;
+  static const int vcctlid[] = {EMPTYP,  POROSITY, C3S,     C2S,     C3A,
+                                C4AF,    K2SO4,    NA2SO4,  GYPSUM,  HEMIHYD,
+                                CACO3,   CH,       CSH,     AFMC,    AFM,
+                                ETTR,    BRUCITE,  C3AH6,   AFM,     FREELIME,
+                                FREELIME};
+  const int nid = (int)(sizeof(vcctlid) / sizeof(vcctlid[0]));
+
+  for (i = 0; i < CENSUSIDS; i++) {
+    val = (i < nid) ? vcctlid[i] : POROSITY;
+    if (corr) {
+      if (val == C3S || val == C2S) {
+        val = 1;
+      } else if (val == C3A || val == C4AF) {
+        val = 2;
+      } else if (val == CH) {
+        val = 4;
+      } else if (val == CSH) {
+        val = 5;
+      } else if (val == ETTR) {
+        val = 6;
+      } else if (val == AFM) {
+        val = 7;
+      } else if (val == POROSITY) {
+        val = 8;
+      } else {
+        val = 0;
+      }
+    }
+    table[i] = val;
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function thames_convert converts one THAMES image, read from
+ *	the start of its header, to a VCCTL image
+ *
+ * 	Arguments:	file pointer to the THAMES image
+ * 				file pointer to the VCCTL image (opened with "wb"
+ * 					for a binary image)
+ * 				int pointer to the table made by thames_idtable
+ * 				int format of the VCCTL image (IMG_ASCII,
+ * 					IMG_UINT8 or IMG_UINT8Z)
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int thames_convert(FILE *fpin, FILE *fpout, int *table, int format) {
+  int i, xsize, ysize, zsize, informat, status, id;
+  int len[CENSUSIDS], *ids;
+  char str[CENSUSIDS][8];
+  size_t n, nplane, nout;
+  float ver, res;
+  unsigned char *plane;
+  char *text;
+  Idreader rd;
+
+  if (format != IMG_ASCII && format != IMG_UINT8 && format != IMG_UINT8Z)
+    return (1);
+  if (read_imgheader_fmt(fpin, &ver, &xsize, &ysize, &zsize, &res,
+                         &informat))
+    return (1);
+  if (informat != IMG_ASCII && informat != IMG_UINT8 &&
+      informat != IMG_UINT8Z)
+    return (1);
+  if (xsize < 1 || ysize < 1 || zsize < 1)
+    return (1);
+
+  if (format == IMG_ASCII) {
+    fprintf(fpout, "Version: 5.0\n");
+    fprintf(fpout, "X_Size: %d\n", xsize);
+    fprintf(fpout, "Y_Size: %d\n", ysize);
+    fprintf(fpout, "Z_Size: %d\n", zsize);
+    fprintf(fpout, "Image_Resolution: 1.0\n");
+  } else if (write_binheader(fpout, xsize, ysize, zsize, 1.0, format)) {
+    return (1);
+  }
+
+  /***
+   *	An ASCII image is written from the text of each id,
+   *	made once
+   ***/
+
+  for (i = 0; i < CENSUSIDS; i++)
+    len[i] = sprintf(str[i], "%d\n", i);
+
+  nplane = (size_t)ysize * zsize;
+  plane = (unsigned char *)malloc(nplane);
+  ids = (int *)malloc(nplane * sizeof(int));
+  text = (format == IMG_ASCII) ? (char *)malloc(4 * nplane) : NULL;
+  if (!plane || !ids || (format == IMG_ASCII && !text) ||
+      idreader_open(&rd, fpin, informat, nplane)) {
+    if (plane)
+      free(plane);
+    if (ids)
+      free(ids);
+    if (text)
+      free(text);
+    return (1);
+  }
+
+  /***
+   *	An id that is negative or too big for the table gets
+   *	the last entry, which is that of an unknown id
+   ***/
+
+  status = 0;
+  for (i = 0; i < xsize && !status; i++) {
+    status = idreader_plane(&rd, ids);
+    if (status)
+      break;
+    for (n = 0; n < nplane; n++) {
+      id = ids[n];
+      plane[n] = (unsigned char)table[(id < 0 || id >= CENSUSIDS)
+                                          ? CENSUSIDS - 1
+                                          : id];
+    }
+
+    if (format == IMG_ASCII) {
+      nout = 0;
+      for (n = 0; n < nplane; n++) {
+        memcpy(text + nout, str[plane[n]], (size_t)len[plane[n]]);
+        nout += (size_t)len[plane[n]];
+      }
+      status = (fwrite(text, 1, nout, fpout) != nout);
+    } else {
+      status = write_binplane(fpout, plane, nplane, format);
+    }
+  }
+
+  idreader_close(&rd);
+  free(plane);
+  free(ids);
+  if (text)
+    free(text);
+
+  return (status);
+}
+
+/******************************************************************************
+ *	Function convertone converts the THAMES image name to name.vcctl.img,
+ *	put in outdir if one is given
+ *
+ * 	Arguments:	char pointer to name of the program, for messages
+ * 				char pointer to name of the THAMES image
+ * 				char pointer to output directory, or NULL
+ * 				int pointer to the table made by thames_idtable
+ * 				int format of the VCCTL image
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+static int convertone(char *progname, char *name, char *outdir, int *table,
+                      int format) {
+  int status;
+  char fileout[MAXSTRING], *base;
+  size_t len;
+  FILE *fpin, *fpout;
+
+  if (outdir && outdir[0]) {
+    base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    len = strlen(outdir);
+    snprintf(fileout, sizeof(fileout), "%s%s%s.vcctl.img", outdir,
+             (outdir[len - 1] == '/') ? "" : "/", base);
+  } else {
+    snprintf(fileout, sizeof(fileout), "%s.vcctl.img", name);
+  }
+
+  fpin = fopen(name, "rb");
+  if (!fpin) {
+    bailout(progname, "Could not open image file");
+    return (1);
+  }
+  fpout = fopen(fileout, (format == IMG_ASCII) ? "w" : "wb");
+  if (!fpout) {
+    fclose(fpin);
+    bailout(progname, "Could not open output image file");
+    return (1);
+  }
+
+  status = thames_convert(fpin, fpout, table, format);
+  fclose(fpin);
+  if (fclose(fpout))
+    status = 1;
+
+  if (status) {
+    printf("\nERROR:  Could not convert %s\n", name);
+    remove(fileout);
+  } else {
+    printf("%s -> %s\n", name, fileout);
+  }
+  fflush(stdout);
+
+  return (status);
+}
+
+/******************************************************************************
+ *	Function namecmp orders two file names for qsort
+ ******************************************************************************/
+static int namecmp(const void *a, const void *b) {
+  return (strcmp(*(char *const *)a, *(char *const *)b));
+}
+
+/******************************************************************************
+ *	Function thames_convert_path converts a THAMES image, or every
+ *	image in a directory (names ending in .img, other than those
+ *	made by an earlier conversion), in order of name
+ *
+ * 	Arguments:	char pointer to name of the program, for messages
+ * 				char pointer to the image or directory
+ * 				char pointer to output directory, or NULL to put
+ * 					each VCCTL image next to its THAMES image
+ * 				int pointer to the table made by thames_idtable
+ * 				int format of the VCCTL images (IMG_ASCII,
+ * 					IMG_UINT8 or IMG_UINT8Z)
+ *
+ *	Returns:	int number of images that could not be converted
+ ******************************************************************************/
+int thames_convert_path(char *progname, char *path, char *outdir, int *table,
+                        int format) {
+  int i, nname, maxname, nfail;
+  char name[MAXSTRING], **names, **newnames;
+  size_t len;
+  struct stat sb;
+#if !defined(_WIN32)
+  DIR *dir;
+  struct dirent *ent;
+#endif
+
+  if (stat(path, &sb) || (sb.st_mode & S_IFMT) != S_IFDIR)
+    return (convertone(progname, path, outdir, table, format));
+
+#if defined(_WIN32)
+  bailout(progname, "Converting a directory is not supported here");
+  return (1);
+#else
+  dir = opendir(path);
+  if (!dir) {
+    bailout(progname, "Could not open image directory");
+    return (1);
+  }
+
+  nname = maxname = nfail = 0;
+  names = NULL;
+  while ((ent = readdir(dir)) != NULL) {
+    len = strlen(ent->d_name);
+    if (len < 4 || strcmp(ent->d_name + len - 4, ".img"))
+      continue;
+    if (len >= 10 && !strcmp(ent->d_name + len - 10, ".vcctl.img"))
+      continue;
+    snprintf(name, sizeof(name), "%s%s%s", path,
+             (path[strlen(path) - 1] == '/') ? "" : "/", ent->d_name);
+    if (stat(name, &sb) || (sb.st_mode & S_IFMT) != S_IFREG)
+      continue;
+    if (nname == maxname) {
+      maxname = (maxname > 0) ? 2 * maxname : 64;
+      newnames = (char **)realloc(names, (size_t)maxname * sizeof(char *));
+      if (!newnames) {
+        nfail++;
+        break;
+      }
+      names = newnames;
+    }
+    names[nname] = (char *)malloc(strlen(name) + 1);
+    if (!names[nname]) {
+      nfail++;
+      break;
+    }
+    strcpy(names[nname++], name);
+  }
+  closedir(dir);
+
+  if (nname > 0)
+    qsort(names, (size_t)nname, sizeof(char *), namecmp);
+  for (i = 0; i < nname; i++) {
+    nfail += convertone(progname, names[i], outdir, table, format);
+    free(names[i]);
+  }
+  if (names)
+    free(names);
+
+  return (nfail);
+#endif
+}
@@ -0,0 +1,51 @@
+/******************************************************************************
+ *	Number of threads a program uses when it is not given one with
+ *	--threads.
+ *
+ *	The programs share their work out among OpenMP threads, each
+ *	with its own --threads n.  When several of them run at once,
+ *	as the user interface may start them, each one sized for the
+ *	whole machine would oversubscribe it.  The environment
+ *	variable VCCTL_THREADS gives every program the same default
+ *	instead, so the caller can divide the processors among the
+ *	programs it starts; --threads still overrides it.  The value
+ *	is held to the number of processors.
+ *
+ *	Programs where the number of threads chooses the model and not
+ *	just its speed (disrealnew, genmic and chlorattack3d, where
+ *	--threads switches to the explicit random streams) leave it to
+ *	--threads alone.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/******************************************************************************
+ *	Function thread_default gives the number of threads a program
+ *	starts with before reading its command line: VCCTL_THREADS if
+ *	it is set to a positive number, at most the number of
+ *	processors, and otherwise the program's own default
+ *
+ * 	Arguments:	int the program's own default
+ *
+ *	Returns:	int number of threads
+ ******************************************************************************/
+int thread_default(int dflt) {
+  int n;
+  char *env;
+
+  env = getenv("VCCTL_THREADS");
+  if (!env)
+    return (dflt);
+  n = atoi(env);
+  if (n < 1)
+    return (dflt);
+
+#ifdef _OPENMP
+  if (n > omp_get_num_procs())
+    n = omp_get_num_procs();
+#endif
+
+  return (n);
+}
@@ -0,0 +1,183 @@
+/******************************************************************************
+ *	The best few sites of an image, ranked by a count such as the
+ *	number of pores around each one, found in one pass over the
+ *	image.
+ *
+ *	The caller allocates a Topsites with room for max sites and
+ *	offers it every candidate with topsites_offer.  It keeps the
+ *	max sites with the highest counts, and among sites with the
+ *	same count the ones offered first, which is the order a sorted
+ *	list filled in the same pass would keep.  The kept sites are
+ *	held in a heap with the worst one at the root, so each offer
+ *	costs O(log max) rather than a walk along the list.  Sites with
+ *	a count of zero or less are never kept.
+ *
+ *	A caller that visits the sites in some other order (such as the
+ *	order of the image in memory) can give each one its rank in the
+ *	order that should break ties with topsites_rank instead.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/******************************************************************************
+ *	Function topsites_alloc allocates room for max sites
+ *
+ * 	Arguments:	Topsites pointer to fill
+ * 				int max
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+int topsites_alloc(Topsites *ts, int max) {
+  ts->max = (max > 0) ? max : 0;
+  ts->n = 0;
+  ts->nseen = 0;
+  ts->count = ts->site = ts->seq = NULL;
+  if (ts->max == 0)
+    return (0);
+
+  ts->count = (int *)malloc((size_t)ts->max * sizeof(int));
+  ts->site = (int *)malloc((size_t)ts->max * sizeof(int));
+  ts->seq = (int *)malloc((size_t)ts->max * sizeof(int));
+  if (!ts->count || !ts->site || !ts->seq) {
+    topsites_free(ts);
+    return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function worse says whether kept site i ranks below kept site j
+ *
+ * 	Arguments:	Topsites pointer
+ * 				int places i and j in the heap
+ *
+ *	Returns:	int 1 if site i ranks below site j, 0 otherwise
+ ******************************************************************************/
+static int worse(Topsites *ts, int i, int j) {
+  if (ts->count[i] != ts->count[j])
+    return (ts->count[i] < ts->count[j]);
+
+  return (ts->seq[i] > ts->seq[j]);
+}
+
+/******************************************************************************
+ *	Function swapsites swaps two places in the heap
+ *
+ * 	Arguments:	Topsites pointer
+ * 				int places i and j in the heap
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void swapsites(Topsites *ts, int i, int j) {
+  int t;
+
+  t = ts->count[i];
+  ts->count[i] = ts->count[j];
+  ts->count[j] = t;
+  t = ts->site[i];
+  ts->site[i] = ts->site[j];
+  ts->site[j] = t;
+  t = ts->seq[i];
+  ts->seq[i] = ts->seq[j];
+  ts->seq[j] = t;
+
+  return;
+}
+
+/******************************************************************************
+ *	Function topsites_rank offers a site with its place in the order
+ *	that breaks ties, and keeps it if it ranks among the best max
+ *	offered so far
+ *
+ * 	Arguments:	Topsites pointer
+ * 				int count of the site
+ * 				int site (any index the caller can decode)
+ * 				int seq (among equal counts, lower seq ranks higher)
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void topsites_rank(Topsites *ts, int count, int site, int seq) {
+  int i, parent, child;
+
+  if ((ts->max == 0) || (count <= 0))
+    return;
+
+  if (ts->n < ts->max) {
+
+    /* Room left, so add it at the bottom and sift it up */
+
+    i = ts->n++;
+    ts->count[i] = count;
+    ts->site[i] = site;
+    ts->seq[i] = seq;
+    while (i > 0) {
+      parent = (i - 1) / 2;
+      if (!worse(ts, i, parent))
+        break;
+      swapsites(ts, i, parent);
+      i = parent;
+    }
+    return;
+  }
+
+  /* Full, so it replaces the worst site if it ranks above it */
+
+  if ((count < ts->count[0]) ||
+      ((count == ts->count[0]) && (seq >= ts->seq[0])))
+    return;
+
+  ts->count[0] = count;
+  ts->site[0] = site;
+  ts->seq[0] = seq;
+  i = 0;
+  while ((child = 2 * i + 1) < ts->n) {
+    if ((child + 1 < ts->n) && worse(ts, child + 1, child))
+      child++;
+    if (!worse(ts, child, i))
+      break;
+    swapsites(ts, i, child);
+    i = child;
+  }
+
+  return;
+}
+
+/******************************************************************************
+ *	Function topsites_offer offers a site, which is kept if it
+ *	ranks among the best max offered so far.  It ranks below every
+ *	site offered before it with the same count.
+ *
+ * 	Arguments:	Topsites pointer
+ * 				int count of the site
+ * 				int site (any index the caller can decode)
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void topsites_offer(Topsites *ts, int count, int site) {
+  ts->nseen++;
+  topsites_rank(ts, count, site, ts->nseen);
+
+  return;
+}
+
+/******************************************************************************
+ *	Function topsites_free releases a Topsites made by topsites_alloc
+ *
+ * 	Arguments:	Topsites pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void topsites_free(Topsites *ts) {
+  if (ts->count)
+    free(ts->count);
+  if (ts->site)
+    free(ts->site);
+  if (ts->seq)
+    free(ts->seq);
+  ts->count = ts->site = ts->seq = NULL;
+  ts->n = ts->max = 0;
+
+  return;
+}
@@ -0,0 +1,325 @@
+/******************************************************************************
+ *	Collection of functions to write a timeline of a run (--trace in
+ *	disrealnew, elastic and genmic) in the trace event format that
+ *	the Chrome trace viewer and Perfetto open, to show when each part
+ *	of the run happened on each thread and where threads waited.
+ *
+ *	The file is a JSON array of events, one to a line.  A span is a
+ *	complete event ("ph": "X") with its start and length in
+ *	microseconds from the opening of the trace, on a thread numbered
+ *	by the caller: TRACEMAIN for the main thread, TRACEWRITER for a
+ *	background writer, and TRACEPOOL + n for thread n of a parallel
+ *	loop.  Each event is written with one fprintf, which the C library
+ *	does under the lock of the stream, so threads can add spans at the
+ *	same time.
+ *
+ *	With counters asked for, the hardware counters of the main thread
+ *	(cycles, instructions and cache misses, read with perf_event_open
+ *	on Linux) are read at both ends of its spans and given with each
+ *	span, and trace_report writes the totals for each name to a log.
+ *	They count the main thread only, so across a parallel loop they
+ *	count its share of the work.  Where they cannot be opened (another
+ *	system, or perf_event_paranoid set too high) the spans are written
+ *	without them.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define TRACENAMES 64 /* names of main thread spans totalled */
+
+static FILE *Tracefile = NULL;
+static double Tracestart;
+static int Hwon = 0, Hwfd[TRACEHW];
+
+/* Main thread spans totalled by name, for the log */
+
+static struct {
+  const char *name;
+  long calls;
+  double secs;
+  long long hw[TRACEHW];
+} Tracetot[TRACENAMES];
+static int Ntracetot = 0;
+
+/******************************************************************************
+ *	Function traceclock reads the monotonic clock
+ ******************************************************************************/
+static double traceclock(void) {
+  struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+  return ((double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec);
+}
+
+/******************************************************************************
+ *	Function hwopen opens the hardware counters of the calling thread,
+ *	all or none of them
+ ******************************************************************************/
+static int hwopen(void) {
+#if defined(__linux__)
+  int i, k;
+  struct perf_event_attr pe;
+  static const unsigned long long config[TRACEHW] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES};
+
+  for (i = 0; i < TRACEHW; i++) {
+    memset(&pe, 0, sizeof(pe));
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = config[i];
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    Hwfd[i] = (int)syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+    if (Hwfd[i] < 0) {
+      for (k = 0; k < i; k++) {
+        close(Hwfd[k]);
+      }
+      return (1);
+    }
+  }
+
+  Hwon = 1;
+  return (0);
+#else
+  return (1);
+#endif
+}
+
+/******************************************************************************
+ *	Function hwread reads the hardware counters of the main thread
+ ******************************************************************************/
+static void hwread(long long *hw) {
+  int i;
+
+  for (i = 0; i < TRACEHW; i++) {
+    hw[i] = 0;
+#if defined(__linux__)
+    if (read(Hwfd[i], &hw[i], sizeof(long long)) != sizeof(long long))
+      hw[i] = 0;
+#endif
+  }
+}
+
+/******************************************************************************
+ *	Function trace_open opens a trace file and names the threads in it
+ *
+ * 	Arguments:	char pointer to name of the trace file
+ * 				char pointer to name of the program
+ * 				int threads of the parallel loops
+ * 				int nonzero to read the hardware counters
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the file could not be
+ *				opened, 2 if it was but the counters could not be)
+ ******************************************************************************/
+int trace_open(char *name, char *prog, int nthreads, int counters) {
+  int n;
+
+  Tracefile = fopen(name, "w");
+  if (!Tracefile)
+    return (1);
+  Tracestart = traceclock();
+  Ntracetot = 0;
+
+  fprintf(Tracefile, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                     "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+          TRACEMAIN, prog);
+  fprintf(Tracefile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                     "\"tid\":%d,\"args\":{\"name\":\"main\"}}",
+          TRACEMAIN);
+  fprintf(Tracefile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                     "\"tid\":%d,\"args\":{\"name\":\"writer\"}}",
+          TRACEWRITER);
+  for (n = 0; n < nthreads; n++) {
+    fprintf(Tracefile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                       "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            TRACEPOOL + n, n);
+  }
+
+  if (counters && hwopen())
+    return (2);
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function trace_on tells whether a trace is being written
+ *
+ * 	Arguments:	none
+ *
+ *	Returns:	int nonzero if it is
+ ******************************************************************************/
+int trace_on(void) { return (Tracefile != NULL); }
+
+/******************************************************************************
+ *	Function trace_begin marks the start of a span
+ *
+ * 	Arguments:	Tracemark pointer to fill
+ * 				int thread of the span
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void trace_begin(Tracemark *m, int tid) {
+  if (!Tracefile)
+    return;
+
+  m->t0 = traceclock();
+  if (Hwon && tid == TRACEMAIN)
+    hwread(m->hw);
+}
+
+/******************************************************************************
+ *	Function trace_end writes a span from its mark to now, with the
+ *	counts of the hardware counters over it on the main thread
+ *
+ * 	Arguments:	Tracemark pointer filled by trace_begin
+ * 				char pointer to name of the span
+ * 				int thread of the span, as given to trace_begin
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void trace_end(Tracemark *m, const char *name, int tid) {
+  int i, k;
+  double t1;
+  long long hw[TRACEHW];
+
+  if (!Tracefile)
+    return;
+
+  t1 = traceclock();
+  if (!(Hwon && tid == TRACEMAIN)) {
+    fprintf(Tracefile,
+            ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":1,\"tid\":%d}",
+            name, 1.0e6 * (m->t0 - Tracestart), 1.0e6 * (t1 - m->t0), tid);
+  } else {
+    hwread(hw);
+    for (i = 0; i < TRACEHW; i++) {
+      hw[i] -= m->hw[i];
+    }
+    fprintf(Tracefile,
+            ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":1,\"tid\":%d,\"args\":{\"cycles\":%lld,"
+            "\"instructions\":%lld,\"cache_misses\":%lld,\"ipc\":%.3f}}",
+            name, 1.0e6 * (m->t0 - Tracestart), 1.0e6 * (t1 - m->t0), tid,
+            hw[0], hw[1], hw[2], (hw[0] > 0) ? (double)hw[1] / hw[0] : 0.0);
+  }
+
+  /* Only the main thread adds to the totals, so they need no lock */
+
+  if (tid != TRACEMAIN)
+    return;
+  for (k = 0; k < Ntracetot && strcmp(Tracetot[k].name, name); k++)
+    ;
+  if (k == Ntracetot) {
+    if (Ntracetot == TRACENAMES)
+      return;
+    memset(&Tracetot[k], 0, sizeof(Tracetot[k]));
+    Tracetot[k].name = name;
+    Ntracetot++;
+  }
+  Tracetot[k].calls++;
+  Tracetot[k].secs += t1 - m->t0;
+  for (i = 0; Hwon && i < TRACEHW; i++) {
+    Tracetot[k].hw[i] += hw[i];
+  }
+}
+
+/******************************************************************************
+ *	Function trace_report writes the totals of the main thread spans so
+ *	far to a log
+ *
+ * 	Arguments:	FILE pointer to the log
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void trace_report(FILE *log) {
+  int k;
+
+  if (!Tracefile || !log || Ntracetot == 0)
+    return;
+
+  fprintf(log, "\nSpans of the main thread in the trace:");
+  for (k = 0; k < Ntracetot; k++) {
+    fprintf(log, "\n\t%s: %ld calls, %.3f s", Tracetot[k].name,
+            Tracetot[k].calls, Tracetot[k].secs);
+    if (Hwon) {
+      fprintf(log, ", %lld cycles, IPC %.3f, %lld cache misses",
+              Tracetot[k].hw[0],
+              (Tracetot[k].hw[0] > 0)
+                  ? (double)Tracetot[k].hw[1] / Tracetot[k].hw[0]
+                  : 0.0,
+              Tracetot[k].hw[2]);
+    }
+  }
+  fflush(log);
+}
+
+/******************************************************************************
+ *	Function trace_close ends the trace file.  No other thread may be
+ *	adding spans to it.
+ *
+ * 	Arguments:	none
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the trace could not be
+ *				written)
+ ******************************************************************************/
+int trace_close(void) {
+  int i, status;
+
+  if (!Tracefile)
+    return (0);
+
+  fprintf(Tracefile, "\n]\n");
+  status = (fclose(Tracefile) != 0);
+  Tracefile = NULL;
+
+#if defined(__linux__)
+  for (i = 0; Hwon && i < TRACEHW; i++) {
+    close(Hwfd[i]);
+  }
+#else
+  (void)i;
+#endif
+  Hwon = 0;
+
+  return (status);
+}
+
+/******************************************************************************
+ *	Function trace_detach lets go of a trace inherited across a fork,
+ *	without ending it, so that only the parent writes to it.  The
+ *	parent must flush its streams before it forks.
+ *
+ * 	Arguments:	none
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void trace_detach(void) {
+  int i;
+
+  Tracefile = NULL;
+
+#if defined(__linux__)
+  for (i = 0; Hwon && i < TRACEHW; i++) {
+    close(Hwfd[i]);
+  }
+#else
+  (void)i;
+#endif
+  Hwon = 0;
+}
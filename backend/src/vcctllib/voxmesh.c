@@ -0,0 +1,363 @@
+/******************************************************************************
+ *	Surface meshes of the phases of a box of voxels.
+ *
+ *	voxmesh_build finds the faces of each phase that are exposed,
+ *	meaning that the voxel on the other side is of a different
+ *	phase or lies outside the box, and merges neighboring exposed
+ *	faces of the same phase and orientation in each plane into
+ *	rectangles (greedy meshing).  Each phase then has a closed
+ *	surface with outward facing quadrilaterals, and a flat patch of
+ *	a phase costs one quadrilateral however many voxels it covers.
+ *	Faces between two voxels of the same phase are never made.
+ *
+ *	The mesh can be written as a binary little-endian PLY file,
+ *	with a color for each face, or as a VRML file with one
+ *	IndexedFaceSet per phase.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******************************************************************************
+ *	Function addquad appends one rectangle to a mesh, growing it
+ *	when it is full
+ *
+ * 	Arguments:	Voxmesh pointer
+ * 				Voxquad pointer to copy
+ *
+ *	Returns:	int status flag (0 if okay, 1 if out of memory)
+ ******************************************************************************/
+static int addquad(Voxmesh *vm, Voxquad *q) {
+  int newmax;
+  Voxquad *newquad;
+
+  if (vm->n == vm->max) {
+    newmax = (vm->max > 0) ? 2 * vm->max : 1024;
+    newquad = (Voxquad *)realloc(vm->quad, (size_t)newmax * sizeof(Voxquad));
+    if (!newquad)
+      return (1);
+    vm->quad = newquad;
+    vm->max = newmax;
+  }
+  vm->quad[vm->n++] = *q;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function voxmesh_build makes the surface mesh of every phase
+ *	but one in a box of an image
+ *
+ * 	Arguments:	Voxmesh pointer to fill
+ * 				unsigned char pointer to the phase ids, in C order
+ * 				int xsize, ysize, zsize of the image
+ * 				int lo[3], hi[3] bounds of the box (lo inclusive,
+ * 					hi exclusive)
+ * 				int skip phase with no surface (such as POROSITY),
+ * 					or -1 to mesh every phase
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int voxmesh_build(Voxmesh *vm, unsigned char *vox, int xsize, int ysize,
+                  int zsize, int *lo, int *hi, int skip) {
+  int d, u, v, s, c, iu, iv, w, h, k, m, ok, nu, nv;
+  int size[3], pos[3], nbr[3];
+  int *mask;
+  size_t stride[2], nmask;
+  Voxquad q;
+
+  vm->n = vm->max = 0;
+  vm->quad = NULL;
+
+  size[0] = xsize;
+  size[1] = ysize;
+  size[2] = zsize;
+  for (d = 0; d < 3; d++) {
+    if (lo[d] < 0 || hi[d] > size[d] || lo[d] >= hi[d])
+      return (1);
+  }
+  stride[0] = (size_t)ysize * zsize;
+  stride[1] = (size_t)zsize;
+
+  nmask = 0;
+  for (d = 0; d < 3; d++) {
+    u = (d + 1) % 3;
+    if ((size_t)(hi[d] - lo[d]) * (hi[u] - lo[u]) > nmask)
+      nmask = (size_t)(hi[d] - lo[d]) * (hi[u] - lo[u]);
+  }
+  mask = (int *)malloc(nmask * sizeof(int));
+  if (!mask)
+    return (1);
+
+  /***
+   *	For each axis d and each of its two directions s, sweep the
+   *	planes normal to d.  The mask of a plane holds one more than
+   *	the phase of each exposed face, or zero where there is none.
+   ***/
+
+  for (d = 0; d < 3; d++) {
+    u = (d + 1) % 3;
+    v = (d + 2) % 3;
+    nu = hi[u] - lo[u];
+    nv = hi[v] - lo[v];
+    for (s = -1; s <= 1; s += 2) {
+      for (c = lo[d]; c < hi[d]; c++) {
+        pos[d] = c;
+        nbr[d] = c + s;
+        for (iu = 0; iu < nu; iu++) {
+          pos[u] = nbr[u] = lo[u] + iu;
+          for (iv = 0; iv < nv; iv++) {
+            pos[v] = nbr[v] = lo[v] + iv;
+            m = vox[pos[0] * stride[0] + pos[1] * stride[1] + pos[2]];
+            if (m == skip) {
+              m = 0;
+            } else if (nbr[d] >= lo[d] && nbr[d] < hi[d] &&
+                       vox[nbr[0] * stride[0] + nbr[1] * stride[1] + nbr[2]] ==
+                           m) {
+              m = 0;
+            } else {
+              m++;
+            }
+            mask[iu * nv + iv] = m;
+          }
+        }
+
+        /***
+         *	Greedy merge: grow each rectangle along v as far
+         *	as the phase lasts, then along u while every face
+         *	of the next row matches, and clear what it covers
+         ***/
+
+        for (iu = 0; iu < nu; iu++) {
+          for (iv = 0; iv < nv;) {
+            m = mask[iu * nv + iv];
+            if (!m) {
+              iv++;
+              continue;
+            }
+            for (w = 1; iv + w < nv && mask[iu * nv + iv + w] == m; w++)
+              ;
+            for (h = 1, ok = 1; iu + h < nu && ok; h += ok) {
+              for (k = 0; k < w; k++) {
+                if (mask[(iu + h) * nv + iv + k] != m) {
+                  ok = 0;
+                  break;
+                }
+              }
+            }
+            for (k = 0; k < h; k++)
+              memset(mask + (iu + k) * nv + iv, 0, (size_t)w * sizeof(int));
+
+            q.phase = m - 1;
+            q.normal = 2 * d + (s > 0);
+            q.corner[d] = c + (s > 0) - lo[d];
+            q.corner[u] = iu;
+            q.corner[v] = iv;
+            q.du = h;
+            q.dv = w;
+            if (addquad(vm, &q)) {
+              free(mask);
+              voxmesh_free(vm);
+              return (1);
+            }
+            iv += w;
+          }
+        }
+      }
+    }
+  }
+
+  free(mask);
+  return (0);
+}
+
+/******************************************************************************
+ *	Function voxmesh_corners finds the four corners of a rectangle,
+ *	counterclockwise when seen from outside its phase
+ *
+ * 	Arguments:	Voxquad pointer
+ * 				int pointer to twelve coordinates to fill
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void voxmesh_corners(Voxquad *q, int *xyz) {
+  int d, u, v, i, j;
+
+  d = q->normal / 2;
+  u = (d + 1) % 3;
+  v = (d + 2) % 3;
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 3; j++)
+      xyz[3 * i + j] = q->corner[j];
+  }
+
+  /***
+   *	Going from the u axis to the v axis turns counterclockwise
+   *	about +d, so the corners of a face looking down -d are
+   *	taken the other way around
+   ***/
+
+  i = (q->normal % 2) ? 1 : 3;
+  j = (q->normal % 2) ? 3 : 1;
+  xyz[3 * i + u] += q->du;
+  xyz[3 * 2 + u] += q->du;
+  xyz[3 * 2 + v] += q->dv;
+  xyz[3 * j + v] += q->dv;
+
+  return;
+}
+
+/******************************************************************************
+ *	Function putle32 stores four bytes little-endian
+ *
+ * 	Arguments:	unsigned char pointer to the four bytes
+ * 				unsigned int value
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+static void putle32(unsigned char *b, unsigned int val) {
+  b[0] = (unsigned char)(val & 0xff);
+  b[1] = (unsigned char)((val >> 8) & 0xff);
+  b[2] = (unsigned char)((val >> 16) & 0xff);
+  b[3] = (unsigned char)((val >> 24) & 0xff);
+
+  return;
+}
+
+/******************************************************************************
+ *	Function voxmesh_write_ply writes a mesh as a binary little-endian
+ *	PLY file.  Each rectangle has its own four vertices and one face
+ *	with the color of its phase.
+ *
+ * 	Arguments:	Voxmesh pointer
+ * 				file pointer (opened with "wb")
+ * 				float scale, the length of a voxel edge
+ * 				int pointers to red, green and blue of each phase
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int voxmesh_write_ply(Voxmesh *vm, FILE *fpout, float scale, int *red,
+                      int *green, int *blue) {
+  int i, j, xyz[12];
+  unsigned int bits;
+  float val;
+  unsigned char rec[4 * 12 + 1 + 4 * 4 + 3];
+
+  fprintf(fpout, "ply\n");
+  fprintf(fpout, "format binary_little_endian 1.0\n");
+  fprintf(fpout, "comment VCCTL voxel surface mesh\n");
+  fprintf(fpout, "element vertex %d\n", 4 * vm->n);
+  fprintf(fpout, "property float x\n");
+  fprintf(fpout, "property float y\n");
+  fprintf(fpout, "property float z\n");
+  fprintf(fpout, "element face %d\n", vm->n);
+  fprintf(fpout, "property list uchar int vertex_indices\n");
+  fprintf(fpout, "property uchar red\n");
+  fprintf(fpout, "property uchar green\n");
+  fprintf(fpout, "property uchar blue\n");
+  fprintf(fpout, "end_header\n");
+
+  for (i = 0; i < vm->n; i++) {
+    voxmesh_corners(&vm->quad[i], xyz);
+    for (j = 0; j < 12; j++) {
+      val = scale * (float)xyz[j];
+      memcpy(&bits, &val, sizeof(bits));
+      putle32(rec + 4 * j, bits);
+    }
+    if (fwrite(rec, 1, 4 * 12, fpout) != 4 * 12)
+      return (1);
+  }
+
+  for (i = 0; i < vm->n; i++) {
+    rec[0] = 4;
+    for (j = 0; j < 4; j++)
+      putle32(rec + 1 + 4 * j, (unsigned int)(4 * i + j));
+    j = vm->quad[i].phase;
+    rec[17] = (unsigned char)red[j];
+    rec[18] = (unsigned char)green[j];
+    rec[19] = (unsigned char)blue[j];
+    if (fwrite(rec, 1, 20, fpout) != 20)
+      return (1);
+  }
+
+  return (ferror(fpout) ? 1 : 0);
+}
+
+/******************************************************************************
+ *	Function voxmesh_write_vrml writes a mesh as a VRML 2.0 file with
+ *	one Shape for each phase that has a surface
+ *
+ * 	Arguments:	Voxmesh pointer
+ * 				file pointer
+ * 				float scale, the length of a voxel edge
+ * 				int pointers to red, green and blue of each phase
+ *
+ *	Returns:	int status flag (0 if okay, 1 if otherwise)
+ ******************************************************************************/
+int voxmesh_write_vrml(Voxmesh *vm, FILE *fpout, float scale, int *red,
+                       int *green, int *blue) {
+  int i, j, p, nv, xyz[12];
+  int count[CENSUSIDS];
+
+  memset(count, 0, sizeof(count));
+  for (i = 0; i < vm->n; i++)
+    count[vm->quad[i].phase]++;
+
+  fprintf(fpout, "#VRML V2.0 utf8\n");
+  fprintf(fpout, "Background {skyColor [0.2 0.2 1.0]}\n");
+  fprintf(fpout, "Group {\n");
+  fprintf(fpout, "  children [\n");
+
+  for (p = 0; p < CENSUSIDS; p++) {
+    if (!count[p])
+      continue;
+    fprintf(fpout, "Shape {\n");
+    fprintf(fpout, "  appearance Appearance {\n");
+    fprintf(fpout, "    material Material {diffuseColor %.4f %.4f %.4f}\n",
+            red[p] / (float)SAT, green[p] / (float)SAT, blue[p] / (float)SAT);
+    fprintf(fpout, "  }\n");
+    fprintf(fpout, "  geometry IndexedFaceSet {\n");
+    fprintf(fpout, "    solid TRUE\n");
+    fprintf(fpout, "    coord Coordinate {\n");
+    fprintf(fpout, "      point [\n");
+    for (i = 0; i < vm->n; i++) {
+      if (vm->quad[i].phase != p)
+        continue;
+      voxmesh_corners(&vm->quad[i], xyz);
+      for (j = 0; j < 4; j++) {
+        fprintf(fpout, "%g %g %g,\n", scale * xyz[3 * j],
+                scale * xyz[3 * j + 1], scale * xyz[3 * j + 2]);
+      }
+    }
+    fprintf(fpout, "      ]\n");
+    fprintf(fpout, "    }\n");
+    fprintf(fpout, "    coordIndex [\n");
+    for (nv = 0; nv < 4 * count[p]; nv += 4) {
+      fprintf(fpout, "%d %d %d %d -1,\n", nv, nv + 1, nv + 2, nv + 3);
+    }
+    fprintf(fpout, "    ]\n");
+    fprintf(fpout, "  }\n");
+    fprintf(fpout, "}\n");
+  }
+
+  fprintf(fpout, "]}\n");
+
+  return (ferror(fpout) ? 1 : 0);
+}
+
+/******************************************************************************
+ *	Function voxmesh_free releases a mesh made by voxmesh_build
+ *
+ * 	Arguments:	Voxmesh pointer
+ *
+ *	Returns:	nothing
+ ******************************************************************************/
+void voxmesh_free(Voxmesh *vm) {
+  if (vm->quad)
+    free(vm->quad);
+  vm->quad = NULL;
+  vm->n = vm->max = 0;
+
+  return;
+}
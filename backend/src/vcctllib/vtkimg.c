@@ -0,0 +1,304 @@
+/******************************************************************************
+ *	Collection of functions to write microstructures and fields as VTK
+ *	image files (.vti), which ParaView opens directly, without first
+ *	turning the text images into something it can read.
+ *
+ *	The file is the XML ImageData format with its arrays in one
+ *	appended raw section, compressed with zlib the way VTK's
+ *	vtkZLibDataCompressor does it: each array is a header of 64-bit
+ *	words (number of blocks, size of a block, size of the last block
+ *	and the compressed size of each block) followed by the blocks.
+ *	Here a block is one z plane of the array, x varying fastest, so
+ *	that a writer only ever holds one plane, and every block is the
+ *	same size.  The voxels are cells of an image of xsize by ysize by
+ *	zsize cells with the resolution as their spacing.
+ *
+ *	The arrays are declared before the first is written, since the
+ *	header lists them all.  The offset of each array in the header,
+ *	and the sizes in its block header, are left blank and filled in
+ *	once they are known, so the file must be one that can be seeked.
+ *
+ *	A writer goes
+ *
+ *		vtkimg_open, vtkimg_array for each array,
+ *		then for each array vtkimg_begin, vtkimg_plane for
+ *		each z plane and vtkimg_end,
+ *		and vtkimg_close.
+ *
+ *	A failure anywhere is remembered, and the calls after it do
+ *	nothing, so that the status of vtkimg_close is enough.
+ ******************************************************************************/
+#include "../include/vcctl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define VTKOFFWIDTH 20 /* digits left for the offset of an array */
+
+static const char *Vtktype[] = {"UInt8", "Int32", "Float32", "Float64"};
+static const size_t Vtksize[] = {1, 4, 4, 8};
+
+/******************************************************************************
+ *	Function vtkplanebytes gives the bytes in one z plane of array k
+ ******************************************************************************/
+static size_t vtkplanebytes(Vtkimg *v, int k) {
+  return ((size_t)v->xsize * (size_t)v->ysize * (size_t)v->ncomp[k] *
+          Vtksize[v->type[k]]);
+}
+
+/******************************************************************************
+ *	Function vtkwords writes 64-bit words in the byte order of the
+ *	machine, which the header of the file gives
+ ******************************************************************************/
+static int vtkwords(Vtkimg *v, unsigned long long *w, size_t n) {
+  return (fwrite(w, sizeof(unsigned long long), n, v->fp) != n);
+}
+
+/******************************************************************************
+ *	Function vtkheader writes the XML header, with a blank offset for
+ *	each array, up to the start of the appended data
+ ******************************************************************************/
+static int vtkheader(Vtkimg *v) {
+  int k;
+  unsigned short one = 1;
+
+  fprintf(v->fp,
+          "<?xml version=\"1.0\"?>\n<VTKFile type=\"ImageData\" "
+          "version=\"1.0\" byte_order=\"%s\" header_type=\"UInt64\" "
+          "compressor=\"vtkZLibDataCompressor\">\n",
+          (*(unsigned char *)&one) ? "LittleEndian" : "BigEndian");
+  fprintf(v->fp,
+          "  <ImageData WholeExtent=\"0 %d 0 %d 0 %d\" Origin=\"0 0 0\" "
+          "Spacing=\"%g %g %g\">\n    <Piece Extent=\"0 %d 0 %d 0 %d\">\n"
+          "      <CellData Scalars=\"%s\">\n",
+          v->xsize, v->ysize, v->zsize, v->res, v->res, v->res, v->xsize,
+          v->ysize, v->zsize, v->name[0]);
+  for (k = 0; k < v->narray; k++) {
+    fprintf(v->fp,
+            "        <DataArray type=\"%s\" Name=\"%s\" "
+            "NumberOfComponents=\"%d\" format=\"appended\" offset=\"",
+            Vtktype[v->type[k]], v->name[k], v->ncomp[k]);
+    v->offpos[k] = ftell(v->fp);
+    fprintf(v->fp, "%0*d\"/>\n", VTKOFFWIDTH, 0);
+  }
+  fprintf(v->fp, "      </CellData>\n    </Piece>\n  </ImageData>\n"
+                 "  <AppendedData encoding=\"raw\">\n   _");
+  v->start = ftell(v->fp);
+
+  return (ferror(v->fp) || v->start < 0);
+}
+
+/******************************************************************************
+ *	Function vtkimg_open creates a VTK image file
+ *
+ * 	Arguments:	Vtkimg pointer to fill
+ * 				char pointer to name of the file
+ * 				int xsize, ysize, zsize
+ * 				float resolution
+ *
+ *	Returns:	int status flag (0 if okay, 1 if the file could not be
+ *				created)
+ ******************************************************************************/
+int vtkimg_open(Vtkimg *v, char *name, int xsize, int ysize, int zsize,
+                float res) {
+  memset(v, 0, sizeof(Vtkimg));
+  v->xsize = xsize;
+  v->ysize = ysize;
+  v->zsize = zsize;
+  v->res = res;
+  v->cur = -1;
+
+  if (xsize < 1 || ysize < 1 || zsize < 1)
+    return (1);
+  v->csize =
+      (unsigned long long *)malloc((size_t)zsize * sizeof(unsigned long long));
+  if (!v->csize)
+    return (1);
+  v->fp = fopen(name, "wb");
+  if (!v->fp) {
+    free(v->csize);
+    v->csize = NULL;
+    return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function vtkimg_array declares the next array of the file.  All of
+ *	them are declared before the first is begun; the first one is the
+ *	one ParaView shows at first.
+ *
+ * 	Arguments:	Vtkimg pointer
+ * 				char pointer to name of the array
+ * 				int type (VTKUINT8, VTKINT32, VTKFLOAT32 or
+ * 				VTKFLOAT64)
+ * 				int components of each cell (1 for a scalar, 3
+ * 				for a vector)
+ *
+ *	Returns:	int status flag (0 if okay, 1 otherwise)
+ ******************************************************************************/
+int vtkimg_array(Vtkimg *v, const char *name, int type, int ncomp) {
+  if (v->err || !v->fp || v->cur >= 0 || v->narray == VTKMAXARRAY ||
+      type < VTKUINT8 || type > VTKFLOAT64 || ncomp < 1 ||
+      strlen(name) >= sizeof(v->name[0])) {
+    v->err = 1;
+    return (1);
+  }
+
+  strcpy(v->name[v->narray], name);
+  v->type[v->narray] = type;
+  v->ncomp[v->narray] = ncomp;
+  v->narray++;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function vtkimg_begin starts the next array, writing the header of
+ *	the file before the first one
+ *
+ * 	Arguments:	Vtkimg pointer
+ *
+ *	Returns:	int status flag (0 if okay, 1 otherwise)
+ ******************************************************************************/
+int vtkimg_begin(Vtkimg *v) {
+  int k;
+  long pos;
+  size_t bound;
+
+  if (v->err || !v->fp || v->cur + 1 >= v->narray || v->nplane > 0) {
+    v->err = 1;
+    return (1);
+  }
+  if (v->cur < 0 && vtkheader(v)) {
+    v->err = 1;
+    return (1);
+  }
+  k = ++v->cur;
+
+  bound = (size_t)compressBound((uLong)vtkplanebytes(v, k));
+  if (bound > v->ccap) {
+    free(v->cbuf);
+    v->cbuf = (unsigned char *)malloc(bound);
+    v->ccap = v->cbuf ? bound : 0;
+    if (!v->cbuf) {
+      v->err = 1;
+      return (1);
+    }
+  }
+
+  /* The offset goes in the header, and the block header is left blank */
+
+  pos = ftell(v->fp);
+  if (pos < 0 || fseek(v->fp, v->offpos[k], SEEK_SET) ||
+      fprintf(v->fp, "%0*ld", VTKOFFWIDTH, pos - v->start) != VTKOFFWIDTH ||
+      fseek(v->fp, pos, SEEK_SET)) {
+    v->err = 1;
+    return (1);
+  }
+  v->hdrpos = pos;
+  memset(v->csize, 0, (size_t)v->zsize * sizeof(unsigned long long));
+  if (fseek(v->fp, (long)((3 + v->zsize) * sizeof(unsigned long long)),
+            SEEK_CUR)) {
+    v->err = 1;
+    return (1);
+  }
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function vtkimg_plane adds the next z plane of the array begun
+ *
+ * 	Arguments:	Vtkimg pointer
+ * 				pointer to xsize * ysize cells of the type of the
+ * 				array, x varying fastest, the components of a
+ * 				cell together
+ *
+ *	Returns:	int status flag (0 if okay, 1 otherwise)
+ ******************************************************************************/
+int vtkimg_plane(Vtkimg *v, const void *plane) {
+  uLongf clen;
+
+  if (v->err || v->cur < 0 || v->nplane >= v->zsize) {
+    v->err = 1;
+    return (1);
+  }
+
+  clen = (uLongf)v->ccap;
+  if (compress2(v->cbuf, &clen, (const Bytef *)plane,
+                (uLong)vtkplanebytes(v, v->cur), Z_DEFAULT_COMPRESSION) !=
+          Z_OK ||
+      fwrite(v->cbuf, 1, (size_t)clen, v->fp) != (size_t)clen) {
+    v->err = 1;
+    return (1);
+  }
+  v->csize[v->nplane++] = (unsigned long long)clen;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function vtkimg_end finishes the array begun, once all its planes
+ *	are written, by filling in its block header
+ *
+ * 	Arguments:	Vtkimg pointer
+ *
+ *	Returns:	int status flag (0 if okay, 1 otherwise)
+ ******************************************************************************/
+int vtkimg_end(Vtkimg *v) {
+  long pos;
+  unsigned long long head[3];
+
+  if (v->err || v->cur < 0 || v->nplane != v->zsize) {
+    v->err = 1;
+    return (1);
+  }
+
+  head[0] = (unsigned long long)v->zsize;
+  head[1] = head[2] = (unsigned long long)vtkplanebytes(v, v->cur);
+  pos = ftell(v->fp);
+  if (pos < 0 || fseek(v->fp, v->hdrpos, SEEK_SET) || vtkwords(v, head, 3) ||
+      vtkwords(v, v->csize, (size_t)v->zsize) ||
+      fseek(v->fp, pos, SEEK_SET)) {
+    v->err = 1;
+    return (1);
+  }
+  v->nplane = 0;
+
+  return (0);
+}
+
+/******************************************************************************
+ *	Function vtkimg_close ends the file and releases the writer.  The
+ *	file is complete only if every array declared was written.
+ *
+ * 	Arguments:	Vtkimg pointer
+ *
+ *	Returns:	int status flag (0 if okay, 1 if anything along the way
+ *				failed)
+ ******************************************************************************/
+int vtkimg_close(Vtkimg *v) {
+  int status;
+
+  status = v->err || v->narray == 0 || v->cur + 1 != v->narray ||
+           v->nplane > 0;
+  if (v->fp) {
+    fprintf(v->fp, "\n  </AppendedData>\n</VTKFile>\n");
+    if (fclose(v->fp))
+      status = 1;
+  } else {
+    status = 1;
+  }
+
+  free(v->csize);
+  free(v->cbuf);
+  v->fp = NULL;
+  v->csize = NULL;
+  v->cbuf = NULL;
+  v->ccap = 0;
+
+  return (status);
+}
@@ -0,0 +1,1294 @@
+/******************************************************
+ *
+ * Program vcctlsweep
+ *
+ * Runs a parameter study, such as mix design x curing
+ * temperature x seed x age, as one graph of program runs
+ * in which every run is done once, however many of the
+ * results further down need it.  The study is given in a
+ * sweep file of axes and stages:
+ *
+ *	# the values each parameter takes
+ *	axis mix  m1 m2
+ *	axis seed -11 -12 -13
+ *	axis temp 20 35
+ *	axis age  7 28
+ *
+ *	# a stage is a program with its input
+ *	stage mic genmic
+ *	uses mix seed
+ *	input genmic-${mix}.in
+ *
+ *	stage hyd disrealnew
+ *	after mic
+ *	uses temp
+ *	input hyd.in
+ *
+ *	stage elas elastic
+ *	after hyd
+ *	uses age
+ *	input elas.in
+ *
+ * A stage depends on the axes it uses and on every axis of
+ * the stages it comes after, and is run once for each
+ * combination of their values: above, mic six times, hyd
+ * twelve times, each from one mic, and elas twenty-four
+ * times, two ages of each hyd run.  The lines of a stage
+ * are
+ *
+ *	stage name program   begins the stage
+ *	after name ...       stages whose results it reads,
+ *	                     given before it in the file
+ *	uses axis ...        axes it depends on itself
+ *	input file           prompt input, read on standard
+ *	                     input by the program
+ *	args arg ...         command line arguments
+ *
+ * In the input and the arguments, ${axis} is the value of
+ * the axis, ${stage} the directory of the run of a stage
+ * it comes after (directly or not) that this run reads,
+ * ${dir} its own directory and ${input} its own prompt
+ * input file, so that hyd.in names its microstructure
+ * ${mic}/mic.img.
+ *
+ * Each run is kept in the cache directory (--cache) in a
+ * directory named by the stage and a 128-bit key hashed,
+ * as rescache does, from the program, its arguments and
+ * input with the axis values put in, and the keys of the
+ * runs it reads.  A run whose directory holds a done
+ * marker with its key is not run again, in this sweep or
+ * any later one, and two runs whose keys are the same,
+ * because they read the same things, are one run.  Only
+ * the names of other files that an input reads (shape sets,
+ * correlation files) are hashed, not what is in them.
+ *
+ * Runs are started as soon as the runs they read are done,
+ * at most --jobs at a time, each with an equal share of
+ * the processors as its default number of threads
+ * (VCCTL_THREADS, see threads.c).  With --submit, each run
+ * is instead written as a script, run.sh in its directory,
+ * and given to the command (for example "srun" or "qsub
+ * -sync y"), which must wait for the job to end, so that a
+ * cluster queue runs the jobs while vcctlsweep keeps track
+ * of the graph.  A run that fails stops the runs that read
+ * it, and the rest go on.
+ *
+ * The runs, with their axis values, directories and how
+ * each ended, are written to a CSV table (--output).
+ *
+ * Not available on Windows, which has no fork.
+ ******************************************************/
+#include "include/vcctl.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAXAXES 16     /* axes of a sweep */
+#define MAXSTAGES 32   /* stages of a sweep */
+#define MAXAFTER 8     /* stages a stage comes after */
+#define MAXARGS 64     /* arguments of a stage */
+#define MAXNAME 32     /* longest axis or stage name */
+#define MAXRUNS 100000 /* runs of a sweep */
+
+/* State of a run */
+#define RUNWAITING 0
+#define RUNRUNNING 1
+#define RUNDONE 2
+#define RUNCACHED 3
+#define RUNFAILED 4
+#define RUNSKIPPED 5
+
+/* What ${stage}, ${dir} and ${input} become in expand */
+#define FORKEY 0
+#define FORRUN 1
+
+/***
+ *	One axis: its name and values
+ ***/
+typedef struct {
+  char name[MAXNAME];
+  int nval;
+  char **val;
+} Axis;
+
+/***
+ *	One stage
+ *
+ *		name, program: as given on its stage line
+ *		input:    text of its prompt input, or NULL
+ *		arg:      its arguments, before expansion
+ *		after:    stages it comes after
+ *		axes:     bits of the axes it depends on, its own
+ *		          and those of the stages it comes after
+ *		first, nrun: its runs in Runs
+ ***/
+typedef struct {
+  char name[MAXNAME];
+  char program[MAXSTRING];
+  char *input;
+  int nargs;
+  char *arg[MAXARGS];
+  int nafter;
+  int after[MAXAFTER];
+  unsigned int axes;
+  int first, nrun;
+} Stage;
+
+/***
+ *	One run of a stage
+ *
+ *		val:      value of each axis the stage depends on
+ *		after:    run of each stage it comes after
+ *		same:     an earlier run with the same key, which
+ *		          stands for this one, or -1
+ ***/
+typedef struct {
+  int stage;
+  int val[MAXAXES];
+  int after[MAXAFTER];
+  int same;
+  uint64_t key[2];
+  char dir[MAXSTRING];
+  int state;
+  int status;
+  pid_t pid;
+} Run;
+
+/***
+ *	Global variables
+ ***/
+int Njobs = 0, Dryrun = 0;
+char Bindir[MAXSTRING], Cachedir[MAXSTRING], Submit[MAXSTRING];
+char Sweepname[MAXSTRING], Outname[MAXSTRING];
+Axis Axes[MAXAXES];
+int Naxes = 0;
+Stage Stages[MAXSTAGES];
+int Nstages = 0;
+Run *Runs = NULL;
+int Nruns = 0;
+
+/***
+ *	Function declarations
+ ***/
+static int checkargs(int argc, char *argv[]);
+static void printHelp(void);
+int readsweep(char *name);
+char *readtext(char *name);
+int findaxis(char *name);
+int findstage(char *name);
+int makeruns(void);
+int runindex(int s, int *val);
+int ancestor(int r, char *name);
+char *expand(const char *text, int r, int mode);
+int keyruns(void);
+int isdone(Run *rn);
+int prepare(int r, char ***argv, char *inpath);
+int startrun(int r, int nthreads);
+void reapruns(void);
+int schedule(void);
+int writeindex(char *name);
+void freesweep(void);
+
+int main(int argc, char *argv[]) {
+  int r, nerr, counts[6];
+  long nproc;
+  char path[PATH_MAX];
+  static const char *statename[6] = {"waiting", "running", "done",
+                                     "cached",  "failed",  "skipped"};
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    return (1);
+  }
+
+  /* Programs come from the directory of this one by default */
+
+  if (Bindir[0] == '\0' && strchr(argv[0], '/')) {
+    snprintf(Bindir, sizeof(Bindir), "%s", argv[0]);
+    *strrchr(Bindir, '/') = '\0';
+    if (Bindir[0] == '\0')
+      strcpy(Bindir, "/");
+  }
+
+  /* Runs change directory, so the programs and cache need full paths */
+
+  if (Bindir[0] != '\0' && realpath(Bindir, path))
+    snprintf(Bindir, sizeof(Bindir), "%s", path);
+  if (mkdir(Cachedir, 0755) && errno != EEXIST) {
+    bailout("vcctlsweep", "Could not make the cache directory");
+    return (1);
+  }
+  if (!realpath(Cachedir, path)) {
+    bailout("vcctlsweep", "Could not find the cache directory");
+    return (1);
+  }
+  if (strlen(path) + 2 * MAXNAME + 48 >= MAXSTRING) {
+    bailout("vcctlsweep", "Name of the cache directory is too long");
+    return (1);
+  }
+  snprintf(Cachedir, sizeof(Cachedir), "%s", path);
+
+  if (Njobs < 1) {
+    nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    Njobs = (int)((nproc > 0) ? nproc : 1);
+  }
+
+  if (readsweep(Sweepname) || makeruns() || keyruns()) {
+    freesweep();
+    return (1);
+  }
+
+  if (Dryrun) {
+    for (r = 0; r < Nruns; r++) {
+      if (Runs[r].same < 0)
+        printf("%s %s %s\n", (Runs[r].state == RUNCACHED) ? "Cached" : "Run",
+               Stages[Runs[r].stage].name, Runs[r].dir);
+    }
+  }
+
+  nerr = Dryrun ? 0 : schedule();
+  nerr += writeindex(Outname);
+
+  memset(counts, 0, sizeof(counts));
+  for (r = 0; r < Nruns; r++) {
+    if (Runs[r].same < 0)
+      counts[Runs[r].state]++;
+  }
+  printf("\n%d runs of %d stages, %d of them distinct:", Nruns, Nstages,
+         counts[0] + counts[1] + counts[2] + counts[3] + counts[4] +
+             counts[5]);
+  for (r = 0; r < 6; r++) {
+    if (counts[r] > 0)
+      printf(" %d %s", counts[r], statename[r]);
+  }
+  printf("\n");
+
+  if (!Dryrun)
+    nerr += counts[RUNFAILED] + counts[RUNSKIPPED];
+  freesweep();
+
+  return (nerr ? 1 : 0);
+}
+
+/***
+ *	checkargs
+ *
+ *	Checks the command line arguments
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+static int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index;
+
+  static struct option long_opts[] = {{"cache", required_argument, 0, 'c'},
+                                      {"jobs", required_argument, 0, 'n'},
+                                      {"submit", required_argument, 0, 's'},
+                                      {"bindir", required_argument, 0, 'b'},
+                                      {"output", required_argument, 0, 'o'},
+                                      {"dry-run", no_argument, 0, 'd'},
+                                      {"help", no_argument, 0, 'h'},
+                                      {NULL, 0, 0, 0}};
+
+  Bindir[0] = Submit[0] = '\0';
+  snprintf(Cachedir, sizeof(Cachedir), "sweepcache");
+  snprintf(Outname, sizeof(Outname), "sweep.csv");
+
+  while ((opt_char = getopt_long(argc, argv, "c:n:s:b:o:dh", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -c or --cache */
+    case (int)('c'):
+      snprintf(Cachedir, sizeof(Cachedir), "%s", optarg);
+      break;
+    /* -n or --jobs */
+    case (int)('n'):
+      Njobs = atoi(optarg);
+      break;
+    /* -s or --submit */
+    case (int)('s'):
+      snprintf(Submit, sizeof(Submit), "%s", optarg);
+      break;
+    /* -b or --bindir */
+    case (int)('b'):
+      snprintf(Bindir, sizeof(Bindir), "%s", optarg);
+      break;
+    /* -o or --output */
+    case (int)('o'):
+      snprintf(Outname, sizeof(Outname), "%s", optarg);
+      break;
+    /* -d or --dry-run */
+    case (int)('d'):
+      Dryrun = 1;
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (optind != argc - 1 || Cachedir[0] == '\0')
+    return (1);
+  snprintf(Sweepname, sizeof(Sweepname), "%s", argv[optind]);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+static void printHelp(void) {
+  fprintf(stderr, "\n\nUSAGE:  vcctlsweep [-c,--cache <dir>] [-n,--jobs <n>] "
+                  "[-s,--submit <cmd>]\n");
+  fprintf(stderr, "                   [-b,--bindir <dir>] [-o,--output "
+                  "<csv>] [-d,--dry-run]\n");
+  fprintf(stderr, "                   sweepfile\n\n");
+  fprintf(stderr, "Runs the stages of a parameter sweep once for each "
+                  "combination of the\n");
+  fprintf(stderr, "axes they depend on, each run once and kept in the "
+                  "cache.\n\n");
+  fprintf(stderr, "  --cache         directory of the runs (default "
+                  "sweepcache)\n");
+  fprintf(stderr, "  --jobs          runs at a time (default one per "
+                  "processor)\n");
+  fprintf(stderr, "  --submit        command that runs the script of a "
+                  "run on a cluster\n");
+  fprintf(stderr, "                  queue and waits for it, in place of "
+                  "running it here\n");
+  fprintf(stderr, "  --bindir        directory of the backend programs "
+                  "(default that of\n");
+  fprintf(stderr, "                  vcctlsweep)\n");
+  fprintf(stderr, "  --output        table of the runs (default "
+                  "sweep.csv)\n");
+  fprintf(stderr, "  --dry-run       list the runs and which are cached, "
+                  "without running\n\n");
+}
+
+/***
+ *	readtext
+ *
+ *	Reads the whole of a text file
+ *
+ * 	Arguments:	char pointer to the name of the file
+ * 	Returns:	char pointer to the text, ending with '\0',
+ * 				or NULL if it could not be read
+ *
+ *	Calls:		no routines
+ *	Called by:	readsweep
+ ***/
+char *readtext(char *name) {
+  long n;
+  char *text;
+  FILE *fp;
+
+  fp = fopen(name, "rb");
+  if (!fp)
+    return (NULL);
+  if (fseek(fp, 0, SEEK_END) || (n = ftell(fp)) < 0 ||
+      fseek(fp, 0, SEEK_SET)) {
+    fclose(fp);
+    return (NULL);
+  }
+  text = (char *)malloc((size_t)n + 1);
+  if (text && fread(text, 1, (size_t)n, fp) != (size_t)n) {
+    free(text);
+    text = NULL;
+  }
+  fclose(fp);
+  if (text)
+    text[n] = '\0';
+
+  return (text);
+}
+
+/***
+ *	findaxis, findstage
+ *
+ *	Find an axis or a stage by name
+ *
+ * 	Arguments:	char pointer to the name
+ * 	Returns:	int number of the axis or stage, or -1
+ *
+ *	Calls:		no routines
+ *	Called by:	readsweep, ancestor, expand
+ ***/
+int findaxis(char *name) {
+  int a;
+
+  for (a = 0; a < Naxes && strcmp(Axes[a].name, name); a++)
+    ;
+
+  return ((a < Naxes) ? a : -1);
+}
+
+int findstage(char *name) {
+  int s;
+
+  for (s = 0; s < Nstages && strcmp(Stages[s].name, name); s++)
+    ;
+
+  return ((s < Nstages) ? s : -1);
+}
+
+/***
+ *	readsweep
+ *
+ *	Reads the axes and stages of a sweep file
+ *
+ * 	Arguments:	char pointer to the name of the file
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		readtext, findaxis, findstage
+ *	Called by:	main program
+ ***/
+int readsweep(char *name) {
+  int a, s, lineno;
+  char line[MAXSTRING], msg[MAXSTRING], *word, *tok, *text;
+  Stage *st = NULL;
+  FILE *fp;
+
+  fp = fopen(name, "r");
+  if (!fp) {
+    snprintf(msg, sizeof(msg), "Could not open sweep file %s", name);
+    bailout("vcctlsweep", msg);
+    return (1);
+  }
+
+  msg[0] = '\0';
+  lineno = 0;
+  while (msg[0] == '\0' && fgets(line, sizeof(line), fp)) {
+    lineno++;
+    if (strchr(line, '#'))
+      *strchr(line, '#') = '\0';
+    word = strtok(line, " \t\r\n");
+    if (!word)
+      continue;
+
+    if (!strcmp(word, "axis")) {
+      tok = strtok(NULL, " \t\r\n");
+      if (!tok || strlen(tok) >= MAXNAME || findaxis(tok) >= 0 ||
+          findstage(tok) >= 0 || !strcmp(tok, "dir") ||
+          !strcmp(tok, "input")) {
+        snprintf(msg, sizeof(msg), "Line %d: axis needs a new name", lineno);
+      } else if (Naxes == MAXAXES) {
+        snprintf(msg, sizeof(msg), "Line %d: too many axes", lineno);
+      } else {
+        a = Naxes++;
+        strcpy(Axes[a].name, tok);
+        while ((tok = strtok(NULL, " \t\r\n")) && msg[0] == '\0') {
+          Axes[a].val = (char **)realloc(Axes[a].val,
+                                         (Axes[a].nval + 1) * sizeof(char *));
+          if (!Axes[a].val || !(Axes[a].val[Axes[a].nval++] = strdup(tok)))
+            snprintf(msg, sizeof(msg), "Out of memory for the axes");
+        }
+        if (msg[0] == '\0' && Axes[a].nval == 0)
+          snprintf(msg, sizeof(msg), "Line %d: axis %s has no values", lineno,
+                   Axes[a].name);
+      }
+
+    } else if (!strcmp(word, "stage")) {
+      tok = strtok(NULL, " \t\r\n");
+      word = strtok(NULL, " \t\r\n");
+      if (!tok || strlen(tok) >= MAXNAME || findaxis(tok) >= 0 ||
+          findstage(tok) >= 0 || !strcmp(tok, "dir") ||
+          !strcmp(tok, "input")) {
+        snprintf(msg, sizeof(msg), "Line %d: stage needs a new name", lineno);
+      } else if (!word || strchr(word, '/')) {
+        snprintf(msg, sizeof(msg),
+                 "Line %d: stage needs the name of a backend program", lineno);
+      } else if (Nstages == MAXSTAGES) {
+        snprintf(msg, sizeof(msg), "Line %d: too many stages", lineno);
+      } else {
+        st = &Stages[Nstages++];
+        strcpy(st->name, tok);
+        snprintf(st->program, sizeof(st->program), "%s", word);
+      }
+
+    } else if (!st) {
+      snprintf(msg, sizeof(msg), "Line %d: %s before the first stage", lineno,
+               word);
+
+    } else if (!strcmp(word, "after")) {
+      while ((tok = strtok(NULL, " \t\r\n")) && msg[0] == '\0') {
+        s = findstage(tok);
+        if (s < 0 || s == (int)(st - Stages)) {
+          snprintf(msg, sizeof(msg), "Line %d: no stage %s before %s", lineno,
+                   tok, st->name);
+        } else if (st->nafter == MAXAFTER) {
+          snprintf(msg, sizeof(msg), "Line %d: too many stages before %s",
+                   lineno, st->name);
+        } else {
+          st->after[st->nafter++] = s;
+          st->axes |= Stages[s].axes;
+        }
+      }
+
+    } else if (!strcmp(word, "uses")) {
+      while ((tok = strtok(NULL, " \t\r\n")) && msg[0] == '\0') {
+        a = findaxis(tok);
+        if (a < 0) {
+          snprintf(msg, sizeof(msg), "Line %d: no axis %s", lineno, tok);
+        } else {
+          st->axes |= 1u << a;
+        }
+      }
+
+    } else if (!strcmp(word, "input")) {
+      tok = strtok(NULL, " \t\r\n");
+      text = tok ? readtext(tok) : NULL;
+      if (!text || st->input) {
+        snprintf(msg, sizeof(msg), "Line %d: could not read input %s", lineno,
+                 tok ? tok : "");
+        free(text);
+      } else {
+        st->input = text;
+      }
+
+    } else if (!strcmp(word, "args")) {
+      while ((tok = strtok(NULL, " \t\r\n")) && msg[0] == '\0') {
+        if (st->nargs == MAXARGS) {
+          snprintf(msg, sizeof(msg), "Line %d: too many arguments", lineno);
+        } else if (!(st->arg[st->nargs++] = strdup(tok))) {
+          snprintf(msg, sizeof(msg), "Out of memory for the arguments");
+        }
+      }
+
+    } else {
+      snprintf(msg, sizeof(msg), "Line %d: unknown line %s", lineno, word);
+    }
+  }
+  fclose(fp);
+
+  if (msg[0] == '\0' && Nstages == 0)
+    snprintf(msg, sizeof(msg), "No stages in sweep file %s", name);
+  if (msg[0] != '\0') {
+    bailout("vcctlsweep", msg);
+    return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	runindex
+ *
+ *	Finds the run of a stage for values of the axes.  The runs
+ *	of a stage go through the combinations of its axes with
+ *	the last axis varying fastest.
+ *
+ * 	Arguments:	int stage
+ * 				int pointer to the value of each axis
+ * 	Returns:	int number of the run in Runs
+ *
+ *	Calls:		no routines
+ *	Called by:	makeruns
+ ***/
+int runindex(int s, int *val) {
+  int a, n;
+
+  n = 0;
+  for (a = 0; a < Naxes; a++) {
+    if (Stages[s].axes & (1u << a))
+      n = n * Axes[a].nval + val[a];
+  }
+
+  return (Stages[s].first + n);
+}
+
+/***
+ *	makeruns
+ *
+ *	Makes the runs of every stage, one for each combination
+ *	of the values of its axes, and links each to the runs it
+ *	reads
+ *
+ * 	Arguments:	none
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		runindex
+ *	Called by:	main program
+ ***/
+int makeruns(void) {
+  int a, s, n, r, k;
+  long total;
+  Stage *st;
+  Run *rn;
+
+  total = 0;
+  for (s = 0; s < Nstages; s++) {
+    st = &Stages[s];
+    st->first = (int)total;
+    st->nrun = 1;
+    for (a = 0; a < Naxes; a++) {
+      if (st->axes & (1u << a))
+        st->nrun *= Axes[a].nval;
+      if (st->nrun > MAXRUNS)
+        break;
+    }
+    total += st->nrun;
+    if (total > MAXRUNS) {
+      bailout("vcctlsweep", "Too many runs in the sweep");
+      return (1);
+    }
+  }
+
+  Nruns = (int)total;
+  Runs = (Run *)calloc(Nruns, sizeof(Run));
+  if (!Runs) {
+    bailout("vcctlsweep", "Could not allocate memory for the runs");
+    return (1);
+  }
+
+  for (s = 0; s < Nstages; s++) {
+    st = &Stages[s];
+    for (n = 0; n < st->nrun; n++) {
+      rn = &Runs[st->first + n];
+      rn->stage = s;
+      rn->same = -1;
+      rn->state = RUNWAITING;
+      k = n;
+      for (a = Naxes - 1; a >= 0; a--) {
+        if (st->axes & (1u << a)) {
+          rn->val[a] = k % Axes[a].nval;
+          k /= Axes[a].nval;
+        } else {
+          rn->val[a] = -1;
+        }
+      }
+      for (k = 0; k < st->nafter; k++) {
+        r = runindex(st->after[k], rn->val);
+        rn->after[k] = r;
+      }
+    }
+  }
+
+  return (0);
+}
+
+/***
+ *	ancestor
+ *
+ *	Finds the run of a stage that a run reads, directly or
+ *	through the runs it reads
+ *
+ * 	Arguments:	int run
+ * 				char pointer to the name of the stage
+ * 	Returns:	int number of the run, or -1 if there is none
+ *
+ *	Calls:		ancestor
+ *	Called by:	expand
+ ***/
+int ancestor(int r, char *name) {
+  int k, found;
+  Run *rn = &Runs[r];
+
+  for (k = 0; k < Stages[rn->stage].nafter; k++) {
+    if (!strcmp(Stages[Runs[rn->after[k]].stage].name, name))
+      return (rn->after[k]);
+  }
+  for (k = 0; k < Stages[rn->stage].nafter; k++) {
+    found = ancestor(rn->after[k], name);
+    if (found >= 0)
+      return (found);
+  }
+
+  return (-1);
+}
+
+/***
+ *	expand
+ *
+ *	Puts the values of a run in place of the ${...} in the
+ *	input or an argument of its stage.  For the key, a stage
+ *	becomes the key of the run read, and ${dir} and ${input}
+ *	are left as they are, since the directory of the run is
+ *	named by its key.
+ *
+ * 	Arguments:	char pointer to the text
+ * 				int run
+ * 				int FORKEY or FORRUN
+ * 	Returns:	char pointer to the text made, to be freed, or
+ * 				NULL if a name is not known or there is no memory
+ *
+ *	Calls:		findaxis, ancestor
+ *	Called by:	keyruns, prepare
+ ***/
+char *expand(const char *text, int r, int mode) {
+  int a, up;
+  size_t n, len, cap;
+  const char *p, *end;
+  char name[MAXNAME], keyhex[33], inpath[MAXSTRING + 16], *out, *grown;
+  const char *val;
+  Run *rn = &Runs[r];
+
+  cap = strlen(text) + 256;
+  out = (char *)malloc(cap);
+  if (!out)
+    return (NULL);
+  n = 0;
+
+  for (p = text; *p != '\0'; p++) {
+    val = NULL;
+    len = 1;
+    if (p[0] == '$' && p[1] == '{' && (end = strchr(p + 2, '}'))) {
+      if ((size_t)(end - p - 2) >= MAXNAME) {
+        free(out);
+        return (NULL);
+      }
+      memcpy(name, p + 2, end - p - 2);
+      name[end - p - 2] = '\0';
+      if (!strcmp(name, "dir") || !strcmp(name, "input")) {
+        if (mode == FORKEY) {
+          val = p;
+          len = end - p + 1;
+        } else if (!strcmp(name, "dir")) {
+          val = rn->dir;
+        } else {
+          snprintf(inpath, sizeof(inpath), "%s/prompts.in", rn->dir);
+          val = inpath;
+        }
+      } else if ((a = findaxis(name)) >= 0) {
+        if (rn->val[a] < 0) {
+          free(out);
+          return (NULL);
+        }
+        val = Axes[a].val[rn->val[a]];
+      } else if ((up = ancestor(r, name)) >= 0) {
+        if (Runs[up].same >= 0)
+          up = Runs[up].same;
+        if (mode == FORKEY) {
+          snprintf(keyhex, sizeof(keyhex), "%016llx%016llx",
+                   (unsigned long long)Runs[up].key[0],
+                   (unsigned long long)Runs[up].key[1]);
+          val = keyhex;
+        } else {
+          val = Runs[up].dir;
+        }
+      } else {
+        free(out);
+        return (NULL);
+      }
+      p = end;
+    }
+
+    if (val && len == 1)
+      len = strlen(val);
+    if (!val)
+      val = p;
+    if (n + len + 16 > cap) {
+      cap = 2 * (n + len + 16);
+      grown = (char *)realloc(out, cap);
+      if (!grown) {
+        free(out);
+        return (NULL);
+      }
+      out = grown;
+    }
+    memcpy(out + n, val, len);
+    n += len;
+  }
+  out[n] = '\0';
+
+  return (out);
+}
+
+/***
+ *	keyruns
+ *
+ *	Hashes the key of every run, stage by stage so that the
+ *	keys of the runs read are known, names its directory, and
+ *	finds the runs that are the same as an earlier one
+ *
+ * 	Arguments:	none
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		expand, rescache_init, rescache_add, isdone
+ *	Called by:	main program
+ ***/
+int keyruns(void) {
+  int r, k, j;
+  char *text, msg[MAXSTRING];
+  Rescache rc;
+  Stage *st;
+  Run *rn;
+
+  for (r = 0; r < Nruns; r++) {
+    rn = &Runs[r];
+    st = &Stages[rn->stage];
+    rescache_init(&rc, Cachedir, st->program);
+    for (k = -1; k < st->nargs; k++) {
+      text = expand((k < 0) ? (st->input ? st->input : "") : st->arg[k], r,
+                    FORKEY);
+      if (!text) {
+        snprintf(msg, sizeof(msg),
+                 "Stage %s names an axis it does not use or a stage it "
+                 "does not come after",
+                 st->name);
+        bailout("vcctlsweep", msg);
+        return (1);
+      }
+      rescache_add(&rc, text, strlen(text) + 1);
+      free(text);
+    }
+    for (k = 0; k < st->nafter; k++) {
+      j = Runs[rn->after[k]].same;
+      rescache_add(&rc, Runs[(j >= 0) ? j : rn->after[k]].key,
+                   2 * sizeof(uint64_t));
+    }
+    rn->key[0] = rc.key[0];
+    rn->key[1] = rc.key[1];
+    snprintf(rn->dir, sizeof(rn->dir), "%s/%s-%016llx%016llx", Cachedir,
+             st->name, (unsigned long long)rn->key[0],
+             (unsigned long long)rn->key[1]);
+
+    for (j = st->first; j < r; j++) {
+      if (Runs[j].same < 0 && Runs[j].key[0] == rn->key[0] &&
+          Runs[j].key[1] == rn->key[1]) {
+        rn->same = j;
+        break;
+      }
+    }
+    if (rn->same < 0 && isdone(rn))
+      rn->state = RUNCACHED;
+  }
+
+  return (0);
+}
+
+/***
+ *	isdone
+ *
+ *	Tells whether the directory of a run holds the done
+ *	marker of its key
+ *
+ * 	Arguments:	Run pointer
+ * 	Returns:	int 1 if it does, 0 if not
+ *
+ *	Calls:		no routines
+ *	Called by:	keyruns
+ ***/
+int isdone(Run *rn) {
+  char path[MAXSTRING + 8], want[40], got[40];
+  FILE *fp;
+
+  snprintf(path, sizeof(path), "%s/done", rn->dir);
+  fp = fopen(path, "r");
+  if (!fp)
+    return (0);
+  snprintf(want, sizeof(want), "%016llx%016llx", (unsigned long long)rn->key[0],
+           (unsigned long long)rn->key[1]);
+  got[0] = '\0';
+  if (!fgets(got, sizeof(got), fp))
+    got[0] = '\0';
+  fclose(fp);
+  got[strcspn(got, "\r\n")] = '\0';
+
+  return (!strcmp(got, want));
+}
+
+/***
+ *	prepare
+ *
+ *	Makes the directory of a run and writes its prompt input
+ *	there, and with --submit its script
+ *
+ * 	Arguments:	int run
+ * 				char ***pointer to the argument list made, ending
+ * 				with NULL, to be freed
+ * 				char pointer to the name of the input written, or
+ * 				"" if there is none
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		expand
+ *	Called by:	startrun
+ ***/
+int prepare(int r, char ***argv, char *inpath) {
+  int k, bad;
+  size_t i;
+  char path[MAXSTRING + 16], *text, **args;
+  Stage *st = &Stages[Runs[r].stage];
+  FILE *fp;
+
+  if (mkdir(Runs[r].dir, 0755) && errno != EEXIST)
+    return (1);
+  snprintf(path, sizeof(path), "%s/done", Runs[r].dir);
+  remove(path);
+
+  inpath[0] = '\0';
+  if (st->input) {
+    text = expand(st->input, r, FORRUN);
+    snprintf(inpath, MAXSTRING, "%s/prompts.in", Runs[r].dir);
+    fp = text ? fopen(inpath, "w") : NULL;
+    bad = (!fp || fputs(text, fp) == EOF);
+    if (fp && fclose(fp))
+      bad = 1;
+    free(text);
+    if (bad)
+      return (1);
+  }
+
+  args = (char **)calloc(st->nargs + 2, sizeof(char *));
+  if (!args)
+    return (1);
+  args[0] = strdup(st->program);
+  bad = !args[0];
+  for (k = 0; k < st->nargs && !bad; k++) {
+    args[k + 1] = expand(st->arg[k], r, FORRUN);
+    bad = !args[k + 1];
+  }
+  *argv = args;
+  if (bad)
+    return (1);
+  if (Submit[0] == '\0')
+    return (0);
+
+  /* The script quotes every word, as a single quote in one ends it */
+
+  snprintf(path, sizeof(path), "%s/run.sh", Runs[r].dir);
+  fp = fopen(path, "w");
+  if (!fp)
+    return (1);
+  fprintf(fp, "#!/bin/sh\ncd '%s' || exit 127\nexec ", Runs[r].dir);
+  for (k = 0; args[k]; k++) {
+    fputc('\'', fp);
+    if (k == 0 && Bindir[0] != '\0')
+      fprintf(fp, "%s/", Bindir);
+    for (i = 0; args[k][i] != '\0'; i++) {
+      if (args[k][i] == '\'') {
+        fputs("'\\''", fp);
+      } else {
+        fputc(args[k][i], fp);
+      }
+    }
+    fputs("' ", fp);
+  }
+  fprintf(fp, "< %s > run.log 2>&1\n",
+          (inpath[0] != '\0') ? "prompts.in" : "/dev/null");
+  bad = ferror(fp);
+  if (fclose(fp) || bad || chmod(path, 0755))
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	startrun
+ *
+ *	Starts a run in a process of its own, in its directory,
+ *	with its prompt input and log in place of standard input
+ *	and output, or with --submit gives its script to the
+ *	command
+ *
+ * 	Arguments:	int run
+ * 				int default number of threads of the program
+ * 	Returns:	int status flag (0 if started, 1 if otherwise)
+ *
+ *	Calls:		prepare
+ *	Called by:	schedule
+ ***/
+int startrun(int r, int nthreads) {
+  int k, fd, bad;
+  pid_t pid;
+  char path[MAXSTRING], inpath[MAXSTRING], threads[32], **args = NULL;
+  char *cmd;
+  Run *rn = &Runs[r];
+
+  bad = prepare(r, &args, inpath);
+  cmd = NULL;
+  if (!bad && Submit[0] != '\0') {
+    cmd = (char *)malloc(2 * MAXSTRING + 16);
+    if (cmd) {
+      snprintf(cmd, 2 * MAXSTRING + 16, "%s %s/run.sh", Submit, rn->dir);
+    } else {
+      bad = 1;
+    }
+  }
+
+  if (!bad) {
+    if (Bindir[0] != '\0') {
+      snprintf(path, sizeof(path), "%s/%s", Bindir, args[0]);
+    } else {
+      snprintf(path, sizeof(path), "%s", args[0]);
+    }
+    snprintf(threads, sizeof(threads), "%d", nthreads);
+
+    fflush(NULL);
+    pid = fork();
+    if (pid == 0) {
+      signal(SIGPIPE, SIG_DFL);
+      if (chdir(rn->dir))
+        _exit(127);
+      if (cmd) {
+        execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+        _exit(127);
+      }
+      fd = open((inpath[0] != '\0') ? inpath : "/dev/null", O_RDONLY);
+      if (fd < 0)
+        _exit(127);
+      dup2(fd, 0);
+      close(fd);
+      fd = open("run.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0)
+        _exit(127);
+      dup2(fd, 1);
+      dup2(fd, 2);
+      close(fd);
+      setenv("VCCTL_THREADS", threads, 1);
+      if (Bindir[0] != '\0') {
+        execv(path, args);
+      } else {
+        execvp(path, args);
+      }
+      _exit(127);
+    }
+    if (pid < 0) {
+      bad = 1;
+    } else {
+      rn->pid = pid;
+    }
+  }
+
+  for (k = 0; args && args[k]; k++) {
+    free(args[k]);
+  }
+  free(args);
+  free(cmd);
+
+  return (bad);
+}
+
+/***
+ *	reapruns
+ *
+ *	Waits for a run to end, and marks it done, with the done
+ *	marker of its key in its directory, or failed
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	schedule
+ ***/
+void reapruns(void) {
+  int r, wstatus;
+  pid_t pid;
+  char path[MAXSTRING + 8], tmp[MAXSTRING + 8];
+  Run *rn;
+  FILE *fp;
+
+  do {
+    pid = waitpid(-1, &wstatus, 0);
+  } while (pid < 0 && errno == EINTR);
+  if (pid <= 0)
+    return;
+
+  for (r = 0; r < Nruns && !(Runs[r].state == RUNRUNNING &&
+                             Runs[r].pid == pid);
+       r++)
+    ;
+  if (r == Nruns)
+    return;
+
+  rn = &Runs[r];
+  if (WIFEXITED(wstatus)) {
+    rn->status = WEXITSTATUS(wstatus);
+  } else {
+    rn->status = 128 + WTERMSIG(wstatus);
+  }
+
+  /* The marker is renamed into place, so it is never seen half written */
+
+  rn->state = RUNFAILED;
+  if (rn->status == 0) {
+    snprintf(path, sizeof(path), "%s/done", rn->dir);
+    snprintf(tmp, sizeof(tmp), "%s/done.tmp", rn->dir);
+    fp = fopen(tmp, "w");
+    if (fp) {
+      fprintf(fp, "%016llx%016llx\n", (unsigned long long)rn->key[0],
+              (unsigned long long)rn->key[1]);
+      if (!ferror(fp) && !fclose(fp) && !rename(tmp, path)) {
+        rn->state = RUNDONE;
+      }
+    }
+  }
+
+  printf("%s %s %s (status %d)\n", (rn->state == RUNDONE) ? "Done" : "Failed",
+         Stages[rn->stage].name, rn->dir, rn->status);
+  fflush(stdout);
+}
+
+/***
+ *	schedule
+ *
+ *	Runs the graph: starts each run once the runs it reads
+ *	are done, at most Njobs at a time, and skips those that
+ *	read a run that failed
+ *
+ * 	Arguments:	none
+ * 	Returns:	int number of runs that could not be started
+ *
+ *	Calls:		startrun, reapruns
+ *	Called by:	main program
+ ***/
+int schedule(void) {
+  int r, k, j, st, ready, running, nthreads, nerr, changed;
+  long nproc;
+  Run *rn;
+
+  nproc = sysconf(_SC_NPROCESSORS_ONLN);
+  nthreads = (nproc > Njobs) ? (int)(nproc / Njobs) : 1;
+  nerr = 0;
+
+  for (;;) {
+
+    /* Runs are in stage order, so one pass settles every skip */
+
+    running = 0;
+    changed = 0;
+    for (r = 0; r < Nruns; r++) {
+      rn = &Runs[r];
+      if (rn->same >= 0)
+        continue;
+      if (rn->state == RUNRUNNING)
+        running++;
+      if (rn->state != RUNWAITING)
+        continue;
+      ready = 1;
+      for (k = 0; k < Stages[rn->stage].nafter; k++) {
+        j = rn->after[k];
+        if (Runs[j].same >= 0)
+          j = Runs[j].same;
+        st = Runs[j].state;
+        if (st == RUNFAILED || st == RUNSKIPPED) {
+          rn->state = RUNSKIPPED;
+          changed = 1;
+        }
+        if (st != RUNDONE && st != RUNCACHED)
+          ready = 0;
+      }
+      if (!ready || rn->state != RUNWAITING || running >= Njobs)
+        continue;
+
+      if (startrun(r, nthreads)) {
+        rn->state = RUNFAILED;
+        rn->status = -1;
+        nerr++;
+        printf("Failed %s %s (could not start)\n", Stages[rn->stage].name,
+               rn->dir);
+      } else {
+        rn->state = RUNRUNNING;
+        running++;
+        printf("Start %s %s\n", Stages[rn->stage].name, rn->dir);
+      }
+      fflush(stdout);
+      changed = 1;
+    }
+
+    if (running == 0 && !changed)
+      break;
+    if (running > 0)
+      reapruns();
+  }
+
+  return (nerr);
+}
+
+/***
+ *	writeindex
+ *
+ *	Writes the table of the runs: stage, how it ended, its
+ *	directory and the value of each axis it depends on
+ *
+ * 	Arguments:	char pointer to the name of the file
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+int writeindex(char *name) {
+  int a, r, bad;
+  Run *rn, *rs;
+  FILE *fp;
+  static const char *statename[6] = {"waiting", "running", "done",
+                                     "cached",  "failed",  "skipped"};
+
+  fp = fopen(name, "w");
+  if (!fp) {
+    bailout("vcctlsweep", "Could not write the table of the runs");
+    return (1);
+  }
+
+  fprintf(fp, "stage,state,dir");
+  for (a = 0; a < Naxes; a++) {
+    fprintf(fp, ",%s", Axes[a].name);
+  }
+  fprintf(fp, "\n");
+  for (r = 0; r < Nruns; r++) {
+    rn = &Runs[r];
+    rs = (rn->same >= 0) ? &Runs[rn->same] : rn;
+    fprintf(fp, "%s,%s,%s", Stages[rn->stage].name, statename[rs->state],
+            rs->dir);
+    for (a = 0; a < Naxes; a++) {
+      fprintf(fp, ",%s", (rn->val[a] >= 0) ? Axes[a].val[rn->val[a]] : "");
+    }
+    fprintf(fp, "\n");
+  }
+
+  bad = ferror(fp);
+  if (fclose(fp) || bad) {
+    bailout("vcctlsweep", "Could not write the table of the runs");
+    return (1);
+  }
+
+  return (0);
+}
+
+/***
+ *	freesweep
+ *
+ *	Frees the axes, stages and runs
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+void freesweep(void) {
+  int a, s, k;
+
+  for (a = 0; a < Naxes; a++) {
+    for (k = 0; k < Axes[a].nval; k++) {
+      free(Axes[a].val[k]);
+    }
+    free(Axes[a].val);
+  }
+  for (s = 0; s < Nstages; s++) {
+    free(Stages[s].input);
+    for (k = 0; k < Stages[s].nargs; k++) {
+      free(Stages[s].arg[k]);
+    }
+  }
+  free(Runs);
+  Runs = NULL;
+  Naxes = Nstages = Nruns = 0;
+}
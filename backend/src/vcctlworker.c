@@ -0,0 +1,1518 @@
+/******************************************************
+ *
+ * Program vcctlworker
+ *
+ * A backend process that stays up for as long as the user
+ * interface does, so that each operation does not pay for
+ * starting a program and reading its image again.
+ * Requests come in on standard input and answers go out
+ * on standard output, one JSON object to a line:
+ *
+ *	{"id": 7, "op": "census", "image": "mic.img"}
+ *	{"id": 7, "ok": true, "voxels": 1000000, ...}
+ *	{"id": 8, "ok": false, "error": "..."}
+ *
+ * A request is a flat object whose values are strings or
+ * numbers, except "args", an array of strings.  "id" may
+ * be a number or a string and is given back with the
+ * answer.  The operations are
+ *
+ *	load     read an image into the cache: image
+ *	census   voxels of each phase (phase_census): image
+ *	slice    PNG of one slice of an image: image, axis
+ *	         (x, y or z), index, png
+ *	pores    pore size distribution (poresizes): image
+ *	perc     percolation of the pores and of the solids in
+ *	         each direction (perc_label_classes): image
+ *	drop     take an image out of the cache, or all of
+ *	         them if none is named: image
+ *	run      start a backend program as a job: program,
+ *	         args, and optionally dir, input and log
+ *	cancel   stop a job, or take it out of the queue: job
+ *	status   the images in the cache and the jobs
+ *	quit     stop reading requests
+ *
+ * The images stay in a cache of --cache-mb megabytes, the
+ * one used longest ago going first when it is full, and
+ * are read again only when the file has changed, so a
+ * slice or a census of an image already seen takes no
+ * more than the pass over its voxels.
+ *
+ * A job is a backend program (genmic, disrealnew, elastic
+ * and so on) run in a process of its own, from --bindir
+ * or else the directory vcctlworker was started from, in
+ * the directory dir, with its standard input read from
+ * the file input (for the programs that read prompts) and
+ * its output written to the file log.  At most --jobs of
+ * them run at a time and the rest wait their turn; each
+ * starts with an equal share of the processors as its
+ * default number of threads (VCCTL_THREADS, see
+ * threads.c).  The answer to run comes at once, and a line
+ *
+ *	{"event": "job", "job": 3, "state": "done", "status": 0}
+ *
+ * when the job ends.  The programs keep what they build
+ * (shape sets, correlation filters, parameters) in
+ * globals, so they are run as jobs and not inside the
+ * worker.
+ *
+ * When standard input ends, or after quit, the worker
+ * waits for the jobs already running and exits; those
+ * still waiting are not started.
+ *
+ * Not available on Windows, which has no fork.
+ ******************************************************/
+#include "include/vcctl.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAXREQUEST 65536 /* longest request line (bytes) */
+#define MAXFIELDS 16     /* fields of a request besides args */
+#define MAXARGS 64       /* arguments of a job */
+#define MAXCACHED 64     /* images in the cache */
+#define POLLMS 250       /* wait for input between checks on jobs */
+
+/* State of a job */
+#define JOBQUEUED 0
+#define JOBRUNNING 1
+#define JOBDONE 2
+#define JOBFAILED 3
+#define JOBCANCELLED 4
+
+/***
+ *	One request: its fields, with whether each value was a
+ *	string, and the strings of args
+ ***/
+typedef struct {
+  int nfield;
+  char key[MAXFIELDS][32];
+  char val[MAXFIELDS][MAXSTRING];
+  int isstr[MAXFIELDS];
+  int nargs;
+  char arg[MAXARGS][MAXSTRING];
+} Request;
+
+/***
+ *	One image in the cache
+ *
+ *		name:   file name, as given
+ *		mtime, size: of the file when it was read
+ *		vox, cap: voxels (z fastest) and size of the buffer
+ *		used:   clock of the last request for it
+ ***/
+typedef struct {
+  char name[MAXSTRING];
+  time_t mtime;
+  off_t size;
+  unsigned char *vox;
+  size_t cap;
+  int xsize, ysize, zsize;
+  float res;
+  unsigned long used;
+} Cached;
+
+/***
+ *	One job
+ ***/
+typedef struct {
+  int state;
+  int cancel;
+  pid_t pid;
+  int status;
+  char program[MAXSTRING];
+  char dir[MAXSTRING], input[MAXSTRING], log[MAXSTRING];
+  int nargs;
+  char **args;
+} Job;
+
+/***
+ *	Global variables
+ ***/
+int Njobs = 0, Quitting = 0;
+size_t Cachemax = (size_t)1024 << 20;
+char Bindir[MAXSTRING];
+Request Req;
+Cached Cache[MAXCACHED];
+int Ncached = 0;
+unsigned long Clock = 0;
+Job *Jobs = NULL;
+int Njob = 0, Jobcap = 0;
+pixel_t Lut[256];
+
+/***
+ *	Function declarations
+ ***/
+static int checkargs(int argc, char *argv[]);
+static void printHelp(void);
+int parsereq(char *line, Request *rq);
+char *field(char *key);
+void putstr(const char *s);
+void answer(void);
+void endanswer(void);
+void fail(const char *msg);
+Cached *cacheget(char *name, char *err);
+void cachedrop(int k);
+void request(char *line);
+void doload(void);
+void docensus(void);
+void doslice(void);
+void dopores(void);
+void doperc(void);
+void dodrop(void);
+void dorun(void);
+void docancel(void);
+void dostatus(void);
+void startjobs(void);
+void reapjobs(int block);
+void jobevent(int k);
+
+int main(int argc, char *argv[]) {
+  int i, k, red[256], green[256], blue[256];
+  long nproc;
+  size_t len, start;
+  ssize_t got;
+  char *nl, *line, path[PATH_MAX];
+  struct pollfd pfd;
+
+  if (checkargs(argc, argv)) {
+    printHelp();
+    return (1);
+  }
+
+  /* Programs come from the directory of this one by default */
+
+  if (Bindir[0] == '\0' && strchr(argv[0], '/')) {
+    snprintf(Bindir, sizeof(Bindir), "%s", argv[0]);
+    *strrchr(Bindir, '/') = '\0';
+    if (Bindir[0] == '\0')
+      strcpy(Bindir, "/");
+  }
+
+  /* Jobs change directory, so the programs need a full path */
+
+  if (Bindir[0] != '\0' && realpath(Bindir, path))
+    snprintf(Bindir, sizeof(Bindir), "%s", path);
+
+  if (Njobs < 1) {
+    nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    Njobs = (int)((nproc > 0) ? nproc : 1);
+  }
+
+  cemcolors(red, green, blue, 0);
+  for (k = 0; k < 256; k++) {
+    if (k < (NPHASES)) {
+      Lut[k].red = red[k];
+      Lut[k].green = green[k];
+      Lut[k].blue = blue[k];
+    } else {
+      Lut[k].red = Lut[k].green = Lut[k].blue = 0;
+    }
+  }
+
+  /* A front end that goes away should not kill running jobs */
+
+  signal(SIGPIPE, SIG_IGN);
+
+  line = (char *)malloc(MAXREQUEST);
+  if (!line) {
+    bailout("vcctlworker", "Could not allocate memory for requests");
+    return (1);
+  }
+
+  /***
+   *	Read requests as they come, and between them start
+   *	the jobs waiting and report those that have ended
+   ***/
+
+  len = 0;
+  pfd.fd = 0;
+  pfd.events = POLLIN;
+  while (!Quitting) {
+    reapjobs(0);
+    startjobs();
+    fflush(stdout);
+
+    pfd.revents = 0;
+    if (poll(&pfd, 1, POLLMS) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+      continue;
+
+    got = read(0, line + len, MAXREQUEST - 1 - len);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      break;
+    len += (size_t)got;
+
+    start = 0;
+    while ((nl = memchr(line + start, '\n', len - start)) != NULL) {
+      *nl = '\0';
+      request(line + start);
+      start = (size_t)(nl - line) + 1;
+      if (Quitting)
+        break;
+    }
+    memmove(line, line + start, len - start);
+    len -= start;
+
+    /* A line too long for the buffer is thrown away */
+
+    if (len == MAXREQUEST - 1) {
+      Req.nfield = Req.nargs = 0;
+      fail("Request too long");
+      len = 0;
+      while ((got = read(0, line, MAXREQUEST - 1)) > 0 &&
+             !memchr(line, '\n', (size_t)got))
+        ;
+      if (got > 0) {
+        nl = memchr(line, '\n', (size_t)got);
+        len = (size_t)(line + got - (nl + 1));
+        memmove(line, nl + 1, len);
+      }
+    }
+  }
+
+  /* A last request need not end with a newline */
+
+  if (!Quitting && len > 0) {
+    line[len] = '\0';
+    request(line);
+  }
+
+  /***
+   *	Jobs still waiting are not started; wait for the rest
+   ***/
+
+  for (k = 0; k < Njob; k++) {
+    if (Jobs[k].state == JOBQUEUED) {
+      Jobs[k].state = JOBCANCELLED;
+      jobevent(k);
+    }
+  }
+  reapjobs(1);
+  fflush(stdout);
+
+  for (k = 0; k < Ncached; k++) {
+    if (Cache[k].vox)
+      free(Cache[k].vox);
+  }
+  for (k = 0; k < Njob; k++) {
+    for (i = 0; i < Jobs[k].nargs; i++) {
+      free(Jobs[k].args[i]);
+    }
+    free(Jobs[k].args);
+  }
+  if (Jobs)
+    free(Jobs);
+  free(line);
+
+  return (0);
+}
+
+/***
+ *	checkargs
+ *
+ *	Checks the command line arguments
+ *
+ * 	Arguments:	int argc, char *argv[]
+ * 	Returns:	int status flag (0 if okay, 1 if otherwise)
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+static int checkargs(int argc, char *argv[]) {
+  int opt_char, option_index, mb;
+
+  static struct option long_opts[] = {
+      {"jobs", required_argument, 0, 'n'},
+      {"cache-mb", required_argument, 0, 'm'},
+      {"bindir", required_argument, 0, 'b'},
+      {"help", no_argument, 0, 'h'},
+      {NULL, 0, 0, 0}};
+
+  Bindir[0] = '\0';
+  while ((opt_char = getopt_long(argc, argv, "n:m:b:h", long_opts,
+                                 &option_index)) != -1) {
+    switch (opt_char) {
+    /* -n or --jobs */
+    case (int)('n'):
+      Njobs = atoi(optarg);
+      break;
+    /* -m or --cache-mb */
+    case (int)('m'):
+      mb = atoi(optarg);
+      if (mb < 0)
+        return (1);
+      Cachemax = (size_t)mb << 20;
+      break;
+    /* -b or --bindir */
+    case (int)('b'):
+      snprintf(Bindir, sizeof(Bindir), "%s", optarg);
+      break;
+    default:
+      return (1);
+    }
+  }
+
+  if (optind < argc)
+    return (1);
+
+  return (0);
+}
+
+/***
+ *	printHelp
+ *
+ *	Prints a usage message for the program
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program
+ ***/
+static void printHelp(void) {
+  fprintf(stderr, "\n\nUSAGE:  vcctlworker [-n,--jobs <n>] "
+                  "[-m,--cache-mb <mb>] [-b,--bindir <dir>]\n\n");
+  fprintf(stderr, "Answers requests from the user interface, one JSON "
+                  "object to a line on\n");
+  fprintf(stderr, "standard input, with one JSON object to a line on "
+                  "standard output, keeping\n");
+  fprintf(stderr, "the images it reads and running backend programs as "
+                  "jobs.\n\n");
+  fprintf(stderr, "  --jobs          jobs run at a time (default one per "
+                  "processor)\n");
+  fprintf(stderr, "  --cache-mb      memory for cached images (default "
+                  "1024)\n");
+  fprintf(stderr, "  --bindir        directory of the backend programs "
+                  "(default that of\n");
+  fprintf(stderr, "                  vcctlworker)\n\n");
+  fprintf(stderr, "Operations (op): load, census, slice, pores, perc, "
+                  "drop, run, cancel,\n");
+  fprintf(stderr, "status, quit.\n\n");
+}
+
+/***
+ *	skipspace
+ *
+ *	Skips white space in a request
+ *
+ * 	Arguments:	char pointer into the request
+ * 	Returns:	char pointer to the next other character
+ *
+ *	Calls:		no routines
+ *	Called by:	parsereq
+ ***/
+static char *skipspace(char *p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r')
+    p++;
+  return (p);
+}
+
+/***
+ *	getstring
+ *
+ *	Reads a JSON string from a request, decoding its escapes;
+ *	\u escapes beyond ASCII become '?'
+ *
+ * 	Arguments:	pointer to char pointer at the opening quote,
+ * 				moved past the closing one
+ * 				char buffer and its size
+ * 	Returns:	int status flag (0 if okay, 1 if not a string or
+ * 				too long for the buffer)
+ *
+ *	Calls:		no routines
+ *	Called by:	parsereq
+ ***/
+static int getstring(char **pp, char *buf, size_t size) {
+  int i, code;
+  char c, *p;
+  size_t n;
+
+  p = *pp;
+  if (*p++ != '"')
+    return (1);
+
+  n = 0;
+  while (*p != '"') {
+    c = *p++;
+    if (c == '\0')
+      return (1);
+    if (c == '\\') {
+      c = *p++;
+      switch (c) {
+      case 'n':
+        c = '\n';
+        break;
+      case 't':
+        c = '\t';
+        break;
+      case 'r':
+        c = '\r';
+        break;
+      case 'b':
+        c = '\b';
+        break;
+      case 'f':
+        c = '\f';
+        break;
+      case 'u':
+        code = 0;
+        for (i = 0; i < 4; i++, p++) {
+          if (*p >= '0' && *p <= '9') {
+            code = 16 * code + (*p - '0');
+          } else if (*p >= 'a' && *p <= 'f') {
+            code = 16 * code + (*p - 'a' + 10);
+          } else if (*p >= 'A' && *p <= 'F') {
+            code = 16 * code + (*p - 'A' + 10);
+          } else {
+            return (1);
+          }
+        }
+        c = (code > 0 && code < 128) ? (char)code : '?';
+        break;
+      case '\0':
+        return (1);
+      default:
+        break;
+      }
+    }
+    if (n + 1 >= size)
+      return (1);
+    buf[n++] = c;
+  }
+  buf[n] = '\0';
+
+  *pp = p + 1;
+  return (0);
+}
+
+/***
+ *	parsereq
+ *
+ *	Parses one request: a flat JSON object whose values are
+ *	strings, numbers or literals, except args, an array of
+ *	strings
+ *
+ * 	Arguments:	char pointer to the line
+ * 				Request pointer to fill
+ * 	Returns:	int status flag (0 if okay, 1 if not a request)
+ *
+ *	Calls:		skipspace, getstring
+ *	Called by:	request
+ ***/
+int parsereq(char *line, Request *rq) {
+  int k, n;
+  char key[32], *p;
+
+  rq->nfield = rq->nargs = 0;
+  p = skipspace(line);
+  if (*p++ != '{')
+    return (1);
+  p = skipspace(p);
+  if (*p == '}')
+    return (0);
+
+  for (;;) {
+    if (getstring(&p, key, sizeof(key)))
+      return (1);
+    p = skipspace(p);
+    if (*p++ != ':')
+      return (1);
+    p = skipspace(p);
+
+    if (*p == '[') {
+      if (strcmp(key, "args"))
+        return (1);
+      p = skipspace(p + 1);
+      while (*p != ']') {
+        if (rq->nargs == MAXARGS ||
+            getstring(&p, rq->arg[rq->nargs], MAXSTRING))
+          return (1);
+        rq->nargs++;
+        p = skipspace(p);
+        if (*p == ',')
+          p = skipspace(p + 1);
+        else if (*p != ']')
+          return (1);
+      }
+      p++;
+    } else {
+      if (rq->nfield == MAXFIELDS)
+        return (1);
+      k = rq->nfield;
+      snprintf(rq->key[k], sizeof(rq->key[k]), "%s", key);
+      rq->isstr[k] = (*p == '"');
+      if (rq->isstr[k]) {
+        if (getstring(&p, rq->val[k], MAXSTRING))
+          return (1);
+      } else {
+
+        /* Numbers and literals, which are given back as they are */
+
+        for (n = 0; *p && strchr("0123456789+-.eEtrufalsn", *p); n++, p++) {
+          if (n + 1 >= MAXSTRING)
+            return (1);
+          rq->val[k][n] = *p;
+        }
+        rq->val[k][n] = '\0';
+        if (n == 0)
+          return (1);
+      }
+      rq->nfield++;
+    }
+
+    p = skipspace(p);
+    if (*p == '}')
+      return (0);
+    if (*p++ != ',')
+      return (1);
+    p = skipspace(p);
+  }
+}
+
+/***
+ *	field
+ *
+ *	Finds a field of the current request
+ *
+ * 	Arguments:	char pointer to the key
+ * 	Returns:	char pointer to the value, or NULL if there is none
+ *
+ *	Calls:		no routines
+ *	Called by:	request and the operations
+ ***/
+char *field(char *key) {
+  int k;
+
+  for (k = 0; k < Req.nfield; k++) {
+    if (!strcmp(Req.key[k], key))
+      return (Req.val[k]);
+  }
+
+  return (NULL);
+}
+
+/***
+ *	putstr
+ *
+ *	Writes a JSON string to the answer
+ *
+ * 	Arguments:	char pointer to the string
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	answer, fail and the operations
+ ***/
+void putstr(const char *s) {
+  putchar('"');
+  for (; *s; s++) {
+    switch (*s) {
+    case '"':
+      fputs("\\\"", stdout);
+      break;
+    case '\\':
+      fputs("\\\\", stdout);
+      break;
+    case '\n':
+      fputs("\\n", stdout);
+      break;
+    case '\t':
+      fputs("\\t", stdout);
+      break;
+    default:
+      if ((unsigned char)*s < 0x20) {
+        printf("\\u%04x", (unsigned char)*s);
+      } else {
+        putchar(*s);
+      }
+      break;
+    }
+  }
+  putchar('"');
+}
+
+/***
+ *	putid
+ *
+ *	Writes the id of the current request, or null if it has none
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		putstr
+ *	Called by:	answer, fail
+ ***/
+static void putid(void) {
+  int k;
+
+  for (k = 0; k < Req.nfield && strcmp(Req.key[k], "id"); k++)
+    ;
+  if (k == Req.nfield) {
+    fputs("null", stdout);
+  } else if (Req.isstr[k]) {
+    putstr(Req.val[k]);
+  } else {
+    fputs(Req.val[k], stdout);
+  }
+}
+
+/***
+ *	answer
+ *
+ *	Starts the answer to a request that succeeded; the
+ *	operation adds its fields and calls endanswer
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		putid
+ *	Called by:	the operations
+ ***/
+void answer(void) {
+  fputs("{\"id\":", stdout);
+  putid();
+  fputs(",\"ok\":true", stdout);
+}
+
+/***
+ *	endanswer
+ *
+ *	Ends an answer and sends it
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	the operations
+ ***/
+void endanswer(void) {
+  fputs("}\n", stdout);
+  fflush(stdout);
+}
+
+/***
+ *	fail
+ *
+ *	Answers a request that failed
+ *
+ * 	Arguments:	char pointer to the reason
+ * 	Returns:	nothing
+ *
+ *	Calls:		putid, putstr
+ *	Called by:	main program, request and the operations
+ ***/
+void fail(const char *msg) {
+  fputs("{\"id\":", stdout);
+  putid();
+  fputs(",\"ok\":false,\"error\":", stdout);
+  putstr(msg);
+  endanswer();
+}
+
+/***
+ *	request
+ *
+ *	Parses one request line and does what it asks
+ *
+ * 	Arguments:	char pointer to the line
+ * 	Returns:	nothing
+ *
+ *	Calls:		parsereq, fail and the operations
+ *	Called by:	main program
+ ***/
+void request(char *line) {
+  char *op, msg[MAXSTRING];
+
+  if (*skipspace(line) == '\0')
+    return;
+  if (parsereq(line, &Req)) {
+    Req.nfield = Req.nargs = 0;
+    fail("Malformed request");
+    return;
+  }
+
+  op = field("op");
+  if (!op) {
+    fail("No operation given");
+  } else if (!strcmp(op, "load")) {
+    doload();
+  } else if (!strcmp(op, "census")) {
+    docensus();
+  } else if (!strcmp(op, "slice")) {
+    doslice();
+  } else if (!strcmp(op, "pores")) {
+    dopores();
+  } else if (!strcmp(op, "perc")) {
+    doperc();
+  } else if (!strcmp(op, "drop")) {
+    dodrop();
+  } else if (!strcmp(op, "run")) {
+    dorun();
+  } else if (!strcmp(op, "cancel")) {
+    docancel();
+  } else if (!strcmp(op, "status")) {
+    dostatus();
+  } else if (!strcmp(op, "quit")) {
+    Quitting = 1;
+    answer();
+    endanswer();
+  } else {
+    snprintf(msg, sizeof(msg), "Unknown operation %s", op);
+    fail(msg);
+  }
+}
+
+/***
+ *	cacheget
+ *
+ *	Gives an image from the cache, reading it if it is not
+ *	there or its file has changed since it was read, and then
+ *	dropping the images used longest ago until the cache is
+ *	within its budget (the image asked for always stays)
+ *
+ * 	Arguments:	char pointer to the file name
+ * 				char buffer for the reason it failed
+ * 	Returns:	Cached pointer, or NULL if the image cannot be read
+ *
+ *	Calls:		load_microstructure, cachedrop
+ *	Called by:	the operations
+ ***/
+Cached *cacheget(char *name, char *err) {
+  int k, old;
+  float ver;
+  size_t total;
+  struct stat sb;
+  FILE *fp;
+  Cached *c;
+
+  if (!name || name[0] == '\0') {
+    strcpy(err, "No image given");
+    return (NULL);
+  }
+  if (stat(name, &sb)) {
+    snprintf(err, MAXSTRING, "Could not open file %s", name);
+    return (NULL);
+  }
+
+  for (k = 0; k < Ncached && strcmp(Cache[k].name, name); k++)
+    ;
+  if (k < Ncached && Cache[k].mtime == sb.st_mtime &&
+      Cache[k].size == sb.st_size) {
+    Cache[k].used = ++Clock;
+    return (&Cache[k]);
+  }
+
+  if (k == Ncached) {
+    if (Ncached == MAXCACHED) {
+      for (old = 0, k = 1; k < Ncached; k++) {
+        if (Cache[k].used < Cache[old].used)
+          old = k;
+      }
+      cachedrop(old);
+    }
+    k = Ncached++;
+    memset(&Cache[k], 0, sizeof(Cached));
+    snprintf(Cache[k].name, sizeof(Cache[k].name), "%s", name);
+  }
+
+  /* An image that changed is read into the buffer it had */
+
+  c = &Cache[k];
+  fp = fopen(name, "rb");
+  if (!fp || load_microstructure(fp, &c->vox, &c->cap, &ver, &c->xsize,
+                                 &c->ysize, &c->zsize, &c->res)) {
+    if (fp)
+      fclose(fp);
+    cachedrop(k);
+    snprintf(err, MAXSTRING, "Error reading microstructure image %s", name);
+    return (NULL);
+  }
+  fclose(fp);
+  c->mtime = sb.st_mtime;
+  c->size = sb.st_size;
+  c->used = ++Clock;
+
+  for (;;) {
+    total = 0;
+    old = -1;
+    for (k = 0; k < Ncached; k++) {
+      total += Cache[k].cap;
+      if (Cache[k].used != Clock &&
+          (old < 0 || Cache[k].used < Cache[old].used))
+        old = k;
+    }
+    if (total <= Cachemax || old < 0)
+      break;
+    cachedrop(old);
+  }
+
+  for (k = 0; Cache[k].used != Clock; k++)
+    ;
+  return (&Cache[k]);
+}
+
+/***
+ *	cachedrop
+ *
+ *	Takes one image out of the cache
+ *
+ * 	Arguments:	int index in the cache
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	cacheget, dodrop
+ ***/
+void cachedrop(int k) {
+  if (Cache[k].vox)
+    free(Cache[k].vox);
+  Cache[k] = Cache[--Ncached];
+}
+
+/***
+ *	doload
+ *
+ *	Reads an image into the cache and gives its size
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		cacheget
+ *	Called by:	request
+ ***/
+void doload(void) {
+  char err[MAXSTRING];
+  Cached *c;
+
+  c = cacheget(field("image"), err);
+  if (!c) {
+    fail(err);
+    return;
+  }
+
+  answer();
+  printf(",\"xsize\":%d,\"ysize\":%d,\"zsize\":%d,\"res\":%.2f", c->xsize,
+         c->ysize, c->zsize, c->res);
+  endanswer();
+}
+
+/***
+ *	docensus
+ *
+ *	Gives the voxels of each phase of an image, by name
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		cacheget, phase_census, id2phasename
+ *	Called by:	request
+ ***/
+void docensus(void) {
+  int i, first, count[NPHASES];
+  char err[MAXSTRING], phasename[MAXSTRING];
+  Cached *c;
+
+  c = cacheget(field("image"), err);
+  if (!c) {
+    fail(err);
+    return;
+  }
+
+  phase_census(c->vox, c->xsize, c->ysize, c->zsize, NPHASES, count, NULL);
+
+  answer();
+  printf(",\"voxels\":%lu,\"counts\":{",
+         (unsigned long)c->xsize * c->ysize * c->zsize);
+  first = 1;
+  for (i = 0; i < NPHASES; i++) {
+    if (count[i] > 0) {
+      id2phasename(i, phasename);
+      if (!first)
+        putchar(',');
+      putstr(phasename);
+      printf(":%d", count[i]);
+      first = 0;
+    }
+  }
+  putchar('}');
+  endanswer();
+}
+
+/***
+ *	doslice
+ *
+ *	Writes one slice of an image normal to an axis as a PNG,
+ *	one color per phase as imagetiles does
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		cacheget, pixelvector, save_png_threads
+ *	Called by:	request
+ ***/
+void doslice(void) {
+  int axis, s, i, j, x, y, z, dx, dy, n;
+  char err[MAXSTRING], *val, *png;
+  bitmap_t image;
+  Cached *c;
+
+  val = field("axis");
+  png = field("png");
+  if (!val || !val[0] || val[1] || !strchr("xyz", val[0])) {
+    fail("Axis must be x, y or z");
+    return;
+  }
+  if (!png || png[0] == '\0') {
+    fail("No PNG file given");
+    return;
+  }
+  axis = val[0] - 'x';
+
+  c = cacheget(field("image"), err);
+  if (!c) {
+    fail(err);
+    return;
+  }
+
+  n = (axis == 0) ? c->xsize : ((axis == 1) ? c->ysize : c->zsize);
+  val = field("index");
+  s = val ? atoi(val) : n / 2;
+  if (s < 0 || s >= n) {
+    fail("Slice index out of range");
+    return;
+  }
+
+  dx = (axis == 0) ? c->ysize : c->xsize;
+  dy = (axis == 2) ? c->ysize : c->zsize;
+  image.width = dx;
+  image.height = dy;
+  image.pixels = pixelvector((size_t)dx * dy);
+  if (!image.pixels) {
+    fail("Could not allocate memory for the slice");
+    return;
+  }
+  for (j = 0; j < dy; j++) {
+    for (i = 0; i < dx; i++) {
+      x = (axis == 0) ? s : i;
+      y = (axis == 1) ? s : ((axis == 0) ? i : j);
+      z = (axis == 2) ? s : j;
+      image.pixels[(size_t)j * dx + i] =
+          Lut[c->vox[((size_t)x * c->ysize + y) * c->zsize + z]];
+    }
+  }
+  if (save_png_threads(&image, png, -1, thread_default(1))) {
+    free_pixelvector(image.pixels);
+    snprintf(err, sizeof(err), "Could not write file %s", png);
+    fail(err);
+    return;
+  }
+  free_pixelvector(image.pixels);
+
+  answer();
+  printf(",\"width\":%d,\"height\":%d", dx, dy);
+  endanswer();
+}
+
+/***
+ *	markpores
+ *
+ *	Marks the pore voxels of an image: porosity, empty
+ *	porosity and crack space
+ *
+ * 	Arguments:	Cached pointer to the image
+ * 				unsigned char buffer for the marks (1 for a pore)
+ * 	Returns:	size_t number of pore voxels
+ *
+ *	Calls:		no routines
+ *	Called by:	dopores, doperc
+ ***/
+static size_t markpores(Cached *c, unsigned char *cl) {
+  size_t n, nvox, npore;
+  unsigned char ispore[256];
+
+  memset(ispore, 0, sizeof(ispore));
+  ispore[POROSITY] = ispore[EMPTYP] = ispore[EMPTYDP] = ispore[CRACKP] = 1;
+
+  nvox = (size_t)c->xsize * c->ysize * c->zsize;
+  npore = 0;
+  for (n = 0; n < nvox; n++) {
+    cl[n] = ispore[c->vox[n]];
+    npore += cl[n];
+  }
+
+  return (npore);
+}
+
+/***
+ *	dopores
+ *
+ *	Gives the pore size distribution of an image, up to the
+ *	largest diameter calcporedist3d counts
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		cacheget, markpores, poresizes
+ *	Called by:	request
+ ***/
+void dopores(void) {
+  int d, mindim, maxdiam, *ndiam;
+  size_t npore;
+  char err[MAXSTRING];
+  unsigned char *cl;
+  Cached *c;
+
+  c = cacheget(field("image"), err);
+  if (!c) {
+    fail(err);
+    return;
+  }
+
+  mindim = c->xsize;
+  if (c->ysize < mindim)
+    mindim = c->ysize;
+  if (c->zsize < mindim)
+    mindim = c->zsize;
+  maxdiam = (int)(0.2 * mindim);
+  if (maxdiam % 2 == 0)
+    maxdiam++;
+
+  cl = (unsigned char *)malloc((size_t)c->xsize * c->ysize * c->zsize);
+  ndiam = ivector(maxdiam + 1);
+  if (!cl || !ndiam) {
+    if (cl)
+      free(cl);
+    if (ndiam)
+      free_ivector(ndiam);
+    fail("Could not allocate memory for the pore sizes");
+    return;
+  }
+  npore = markpores(c, cl);
+  if (poresizes(cl, c->zsize, c->ysize, c->xsize, maxdiam, ndiam)) {
+    free(cl);
+    free_ivector(ndiam);
+    fail("Could not allocate memory for the pore sizes");
+    return;
+  }
+  free(cl);
+
+  answer();
+  printf(",\"npore\":%lu,\"maxdiam\":%d,\"diameters\":[", (unsigned long)npore,
+         maxdiam);
+  for (d = 1; d <= maxdiam; d += 2) {
+    printf("%s%d", (d > 1) ? "," : "", d);
+  }
+  fputs("],\"counts\":[", stdout);
+  for (d = 1; d <= maxdiam; d += 2) {
+    printf("%s%d", (d > 1) ? "," : "", ndiam[d]);
+  }
+  putchar(']');
+  endanswer();
+  free_ivector(ndiam);
+}
+
+/***
+ *	doperc
+ *
+ *	Gives the percolation of the pores and of the solids of an
+ *	image: the voxels of each, and those in clusters that reach
+ *	across it in each direction
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		cacheget, markpores, perc_label_classes
+ *	Called by:	request
+ ***/
+void doperc(void) {
+  int net;
+  size_t n, nvox;
+  char err[MAXSTRING];
+  unsigned char *cl, link[PERCCLASSES][PERCCLASSES];
+  Percstats ps[2];
+  Cached *c;
+  static const char *netname[2] = {"pore", "solid"};
+
+  c = cacheget(field("image"), err);
+  if (!c) {
+    fail(err);
+    return;
+  }
+
+  nvox = (size_t)c->xsize * c->ysize * c->zsize;
+  cl = (unsigned char *)malloc(nvox);
+  if (!cl) {
+    fail("Could not allocate memory for percolation");
+    return;
+  }
+  memset(link, PERCNOLINK, sizeof(link));
+  link[1][1] = PERCLINK;
+  for (net = 0; net < 2; net++) {
+    markpores(c, cl);
+    if (net == 1) {
+      for (n = 0; n < nvox; n++) {
+        cl[n] = !cl[n];
+      }
+    }
+    if (perc_label_classes(cl, NULL, c->xsize, c->ysize, c->zsize, link,
+                           &ps[net])) {
+      free(cl);
+      fail("Could not allocate memory for percolation");
+      return;
+    }
+  }
+  free(cl);
+
+  answer();
+  for (net = 0; net < 2; net++) {
+    printf(",\"%s\":{\"voxels\":%d,\"through\":[%d,%d,%d]}", netname[net],
+           ps[net].nset, ps[net].nthrough[0], ps[net].nthrough[1],
+           ps[net].nthrough[2]);
+  }
+  endanswer();
+}
+
+/***
+ *	dodrop
+ *
+ *	Takes an image, or every image, out of the cache
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		cachedrop
+ *	Called by:	request
+ ***/
+void dodrop(void) {
+  int k, ndrop;
+  char *name;
+
+  name = field("image");
+  ndrop = 0;
+  for (k = Ncached - 1; k >= 0; k--) {
+    if (!name || !strcmp(Cache[k].name, name)) {
+      cachedrop(k);
+      ndrop++;
+    }
+  }
+
+  answer();
+  printf(",\"dropped\":%d", ndrop);
+  endanswer();
+}
+
+/***
+ *	dorun
+ *
+ *	Puts a backend program in the queue of jobs
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	request
+ ***/
+void dorun(void) {
+  int i, k;
+  char *program, *val;
+  Job *jb, *newp;
+
+  program = field("program");
+  if (!program || program[0] == '\0' || strchr(program, '/')) {
+    fail("Program must be the name of a backend program");
+    return;
+  }
+
+  if (Njob == Jobcap) {
+    newp = (Job *)realloc(Jobs, (Jobcap + 16) * sizeof(Job));
+    if (!newp) {
+      fail("Could not allocate memory for the job");
+      return;
+    }
+    Jobs = newp;
+    Jobcap += 16;
+  }
+
+  k = Njob;
+  jb = &Jobs[k];
+  memset(jb, 0, sizeof(Job));
+  jb->args = (char **)calloc(Req.nargs + 2, sizeof(char *));
+  if (!jb->args) {
+    fail("Could not allocate memory for the job");
+    return;
+  }
+  snprintf(jb->program, sizeof(jb->program), "%s", program);
+  val = field("dir");
+  snprintf(jb->dir, sizeof(jb->dir), "%s", val ? val : "");
+  val = field("input");
+  snprintf(jb->input, sizeof(jb->input), "%s", val ? val : "");
+  val = field("log");
+  snprintf(jb->log, sizeof(jb->log), "%s", val ? val : "");
+
+  /* The argument list ends with NULL, as execv wants */
+
+  jb->nargs = Req.nargs + 1;
+  jb->args[0] = strdup(program);
+  for (i = 0; i < Req.nargs; i++) {
+    jb->args[i + 1] = strdup(Req.arg[i]);
+  }
+  for (i = 0; i < jb->nargs && jb->args[i]; i++)
+    ;
+  if (i < jb->nargs) {
+    for (i = 0; i < jb->nargs; i++) {
+      if (jb->args[i])
+        free(jb->args[i]);
+    }
+    free(jb->args);
+    fail("Could not allocate memory for the job");
+    return;
+  }
+  jb->state = JOBQUEUED;
+  Njob++;
+
+  answer();
+  printf(",\"job\":%d", k);
+  endanswer();
+}
+
+/***
+ *	docancel
+ *
+ *	Stops a running job (SIGTERM), or takes a waiting one out
+ *	of the queue
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		jobevent
+ *	Called by:	request
+ ***/
+void docancel(void) {
+  int k;
+  char *val, msg[MAXSTRING];
+
+  val = field("job");
+  k = val ? atoi(val) : -1;
+  if (k < 0 || k >= Njob) {
+    fail("No such job");
+    return;
+  }
+
+  if (Jobs[k].state == JOBQUEUED) {
+    Jobs[k].state = JOBCANCELLED;
+    answer();
+    endanswer();
+    jobevent(k);
+  } else if (Jobs[k].state == JOBRUNNING) {
+    Jobs[k].cancel = 1;
+    kill(Jobs[k].pid, SIGTERM);
+    answer();
+    endanswer();
+  } else {
+    snprintf(msg, sizeof(msg), "Job %d has already ended", k);
+    fail(msg);
+  }
+}
+
+/***
+ *	dostatus
+ *
+ *	Gives the images in the cache and the state of every job
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		putstr
+ *	Called by:	request
+ ***/
+void dostatus(void) {
+  int k;
+  size_t total;
+  static const char *statename[5] = {"queued", "running", "done", "failed",
+                                     "cancelled"};
+
+  total = 0;
+  for (k = 0; k < Ncached; k++) {
+    total += Cache[k].cap;
+  }
+
+  answer();
+  printf(",\"cachemb\":%.1f,\"images\":[", total / 1048576.0);
+  for (k = 0; k < Ncached; k++) {
+    printf("%s{\"image\":", (k > 0) ? "," : "");
+    putstr(Cache[k].name);
+    printf(",\"xsize\":%d,\"ysize\":%d,\"zsize\":%d}", Cache[k].xsize,
+           Cache[k].ysize, Cache[k].zsize);
+  }
+  fputs("],\"jobs\":[", stdout);
+  for (k = 0; k < Njob; k++) {
+    printf("%s{\"job\":%d,\"program\":", (k > 0) ? "," : "", k);
+    putstr(Jobs[k].program);
+    printf(",\"state\":\"%s\"}", statename[Jobs[k].state]);
+  }
+  putchar(']');
+  endanswer();
+}
+
+/***
+ *	startjobs
+ *
+ *	Starts the jobs waiting, in turn, while fewer than Njobs
+ *	are running.  Each runs in its own process, in its own
+ *	directory, with its input and log in place of standard
+ *	input and output and an equal share of the processors.
+ *
+ * 	Arguments:	none
+ * 	Returns:	nothing
+ *
+ *	Calls:		jobevent
+ *	Called by:	main program
+ ***/
+void startjobs(void) {
+  int k, fd, running, nthreads;
+  long nproc;
+  pid_t pid;
+  char path[MAXSTRING], threads[32];
+  Job *jb;
+
+  running = 0;
+  for (k = 0; k < Njob; k++) {
+    running += (Jobs[k].state == JOBRUNNING);
+  }
+
+  nproc = sysconf(_SC_NPROCESSORS_ONLN);
+  nthreads = (nproc > Njobs) ? (int)(nproc / Njobs) : 1;
+  snprintf(threads, sizeof(threads), "%d", nthreads);
+
+  for (k = 0; k < Njob && running < Njobs; k++) {
+    jb = &Jobs[k];
+    if (jb->state != JOBQUEUED)
+      continue;
+
+    if (Bindir[0] != '\0') {
+      snprintf(path, sizeof(path), "%s/%s", Bindir, jb->program);
+    } else {
+      snprintf(path, sizeof(path), "%s", jb->program);
+    }
+
+    fflush(NULL);
+    pid = fork();
+    if (pid == 0) {
+      signal(SIGPIPE, SIG_DFL);
+      if (jb->dir[0] != '\0' && chdir(jb->dir))
+        _exit(127);
+      fd = open((jb->input[0] != '\0') ? jb->input : "/dev/null", O_RDONLY);
+      if (fd < 0)
+        _exit(127);
+      dup2(fd, 0);
+      close(fd);
+      if (jb->log[0] != '\0') {
+        fd = open(jb->log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      } else {
+        fd = open("/dev/null", O_WRONLY);
+      }
+      if (fd < 0)
+        _exit(127);
+      dup2(fd, 1);
+      dup2(fd, 2);
+      close(fd);
+      setenv("VCCTL_THREADS", threads, 1);
+      if (Bindir[0] != '\0') {
+        execv(path, jb->args);
+      } else {
+        execvp(path, jb->args);
+      }
+      _exit(127);
+    }
+
+    if (pid < 0) {
+      jb->state = JOBFAILED;
+      jb->status = -1;
+      jobevent(k);
+    } else {
+      jb->state = JOBRUNNING;
+      jb->pid = pid;
+      running++;
+    }
+  }
+}
+
+/***
+ *	reapjobs
+ *
+ *	Collects the jobs that have ended and reports each one
+ *
+ * 	Arguments:	int flag to wait for every running job
+ * 	Returns:	nothing
+ *
+ *	Calls:		jobevent
+ *	Called by:	main program
+ ***/
+void reapjobs(int block) {
+  int k, wstatus;
+  pid_t pid;
+
+  for (;;) {
+    pid = waitpid(-1, &wstatus, block ? 0 : WNOHANG);
+    if (pid < 0 && errno == EINTR)
+      continue;
+    if (pid <= 0)
+      return;
+
+    for (k = 0; k < Njob && !(Jobs[k].state == JOBRUNNING &&
+                              Jobs[k].pid == pid);
+         k++)
+      ;
+    if (k == Njob)
+      continue;
+
+    if (WIFEXITED(wstatus)) {
+      Jobs[k].status = WEXITSTATUS(wstatus);
+    } else {
+      Jobs[k].status = 128 + WTERMSIG(wstatus);
+    }
+    if (Jobs[k].cancel) {
+      Jobs[k].state = JOBCANCELLED;
+    } else if (Jobs[k].status == 0) {
+      Jobs[k].state = JOBDONE;
+    } else {
+      Jobs[k].state = JOBFAILED;
+    }
+    jobevent(k);
+  }
+}
+
+/***
+ *	jobevent
+ *
+ *	Reports that a job has ended, or will not start
+ *
+ * 	Arguments:	int number of the job
+ * 	Returns:	nothing
+ *
+ *	Calls:		no routines
+ *	Called by:	main program, docancel, startjobs, reapjobs
+ ***/
+void jobevent(int k) {
+  static const char *statename[5] = {"queued", "running", "done", "failed",
+                                     "cancelled"};
+
+  printf("{\"event\":\"job\",\"job\":%d,\"state\":\"%s\",\"status\":%d}\n", k,
+         statename[Jobs[k].state], Jobs[k].status);
+  fflush(stdout);
+}